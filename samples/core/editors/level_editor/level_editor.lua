@@ -377,6 +377,33 @@ function UnitBox:set_sprite(layer, depth)
 	RenderWorld.sprite_set_depth(LevelEditor._rw, self._unit_id, depth)
 end
 
+-- Sets the property key of the component to value.
+-- Vector and color values are tables of numbers.
+function UnitBox:set_property(component, key, value)
+	local rw = LevelEditor._rw
+	local unit_id = self._unit_id
+
+	if component == "sprite_renderer" then
+		if not RenderWorld.sprite_instances(rw, unit_id) then return end
+		if key == "layer" then RenderWorld.sprite_set_layer(rw, unit_id, value)
+		elseif key == "depth" then RenderWorld.sprite_set_depth(rw, unit_id, value)
+		elseif key == "visible" then RenderWorld.sprite_set_visible(rw, unit_id, value)
+		end
+	elseif component == "mesh_renderer" then
+		local mesh = RenderWorld.mesh_instances(rw, unit_id)
+		if not mesh then return end
+		if key == "visible" then RenderWorld.mesh_set_visible(rw, mesh, value) end
+	elseif component == "light" then
+		if not RenderWorld.light_instances(rw, unit_id) then return end
+		if key == "type" then RenderWorld.light_set_type(rw, unit_id, value)
+		elseif key == "range" then RenderWorld.light_set_range(rw, unit_id, value)
+		elseif key == "intensity" then RenderWorld.light_set_intensity(rw, unit_id, value)
+		elseif key == "spot_angle" then RenderWorld.light_set_spot_angle(rw, unit_id, value)
+		elseif key == "color" then RenderWorld.light_set_color(rw, unit_id, Quaternion.from_elements(value[1], value[2], value[3], 1))
+		end
+	end
+end
+
 SoundObject = class(SoundObject)
 
 function SoundObject:init(world, id, name, range, volume, loop)
@@ -479,6 +506,10 @@ function SoundObject:draw()
 	end
 end
 
+function SoundObject:set_property(component, key, value)
+	if key == "range" then self:set_range(value) end
+end
+
 function SoundObject:set_range(range)
 	self._range = range
 end
@@ -1582,6 +1613,31 @@ function LevelEditor:move_object(id, pos, rot, scale)
 	unit_box:set_local_scale(scale)
 end
 
+-- Moves many objects at once. The poses are packed in a flat array of
+-- 10 numbers per object: position, rotation and scale.
+function LevelEditor:move_objects(ids, poses)
+	for i, id in ipairs(ids) do
+		local obj = self._objects[id]
+		if obj ~= nil then
+			local p = (i - 1) * 10
+			obj:set_local_position(Vector3(poses[p+1], poses[p+2], poses[p+3]))
+			obj:set_local_rotation(Quaternion.from_elements(poses[p+4], poses[p+5], poses[p+6], poses[p+7]))
+			obj:set_local_scale(Vector3(poses[p+8], poses[p+9], poses[p+10]))
+		end
+	end
+end
+
+-- Applies a batch of property edits. Each edit is a table of the form
+-- { id, component, key, value }.
+function LevelEditor:set_properties(edits)
+	for _, e in ipairs(edits) do
+		local obj = self._objects[e[1]]
+		if obj ~= nil then
+			obj:set_property(e[2], e[3], e[4])
+		end
+	end
+end
+
 function LevelEditor:set_placeable(placeable_type, name)
 	self.place_tool:set_placeable(placeable_type, name)
 end
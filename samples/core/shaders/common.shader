@@ -927,6 +927,68 @@ bgfx_shaders = {
 			}
 
 			#endif // __SHADERLIB_SH__
+
+			#if BGFX_SHADER_TYPE_VERTEX
+			uniform vec4 u_mesh_decode[2]; // Scale of the positions and 1 if the vertices are quantized, bias of the positions
+
+			// Returns the model-space position of the mesh vertex @a p.
+			vec3 decode_position(vec3 p)
+			{
+				return p * u_mesh_decode[0].xyz + u_mesh_decode[1].xyz;
+			}
+
+			// Returns the model-space normal of the mesh vertex @a n, which
+			// is octahedral-encoded in its xy if the vertices are quantized.
+			vec3 decode_normal(vec3 n)
+			{
+				if (u_mesh_decode[0].w < 0.5)
+					return n;
+
+				vec3 v = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+				float t = max(-v.z, 0.0);
+				v.x += v.x >= 0.0 ? -t : t;
+				v.y += v.y >= 0.0 ? -t : t;
+				return normalize(v);
+			}
+			#endif // BGFX_SHADER_TYPE_VERTEX
+
+			#if defined(SKINNING) && BGFX_SHADER_TYPE_VERTEX
+			// Keep in sync with SKIN_PALETTE_WIDTH and SKIN_PALETTE_HEIGHT.
+			#define SKIN_PALETTE_WIDTH 1024.0
+			#define SKIN_PALETTE_HEIGHT 12.0
+
+			uniform vec4 u_skin;           // Offset of the first bone in the palette, 1 if the mesh is skinned
+			SAMPLER2D(u_skin_palette, 11); // First three columns of the skin matrix of each bone, as rows
+
+			void skin_bone(float bone, float weight, inout vec4 r0, inout vec4 r1, inout vec4 r2)
+			{
+				float i = (u_skin.x + bone) * 3.0;
+				vec2 size = vec2(SKIN_PALETTE_WIDTH, SKIN_PALETTE_HEIGHT);
+				vec2 uv0 = vec2(mod(i + 0.0, SKIN_PALETTE_WIDTH), floor((i + 0.0) / SKIN_PALETTE_WIDTH));
+				vec2 uv1 = vec2(mod(i + 1.0, SKIN_PALETTE_WIDTH), floor((i + 1.0) / SKIN_PALETTE_WIDTH));
+				vec2 uv2 = vec2(mod(i + 2.0, SKIN_PALETTE_WIDTH), floor((i + 2.0) / SKIN_PALETTE_WIDTH));
+				r0 += texture2DLod(u_skin_palette, (uv0 + 0.5) / size, 0.0) * weight;
+				r1 += texture2DLod(u_skin_palette, (uv1 + 0.5) / size, 0.0) * weight;
+				r2 += texture2DLod(u_skin_palette, (uv2 + 0.5) / size, 0.0) * weight;
+			}
+
+			// Returns the model-space @a v transformed by the four bones
+			// @a indices blended with @a weights.
+			vec4 skin(vec4 v, vec4 indices, vec4 weights)
+			{
+				if (u_skin.y < 0.5)
+					return v;
+
+				vec4 r0 = vec4_splat(0.0);
+				vec4 r1 = vec4_splat(0.0);
+				vec4 r2 = vec4_splat(0.0);
+				skin_bone(indices.x, weights.x, r0, r1, r2);
+				skin_bone(indices.y, weights.y, r0, r1, r2);
+				skin_bone(indices.z, weights.z, r0, r1, r2);
+				skin_bone(indices.w, weights.w, r0, r1, r2);
+				return vec4(dot(r0, v), dot(r1, v), dot(r2, v), v.w);
+			}
+			#endif // defined(SKINNING) && BGFX_SHADER_TYPE_VERTEX
 		"""
 	}
 }
@@ -51,6 +51,18 @@ render_states = {
 		cull_mode = "cw"
 	}
 
+	particle = {
+		rgb_write_enable = true
+		alpha_write_enable = true
+		depth_func = "lequal"
+		depth_enable = true
+		depth_write_enable = false
+		blend_enable = true
+		blend_src = "src_alpha"
+		blend_dst = "inv_src_alpha"
+		cull_mode = "none"
+	}
+
 	mesh = {
 		rgb_write_enable = true
 		alpha_write_enable = true
@@ -60,6 +72,16 @@ render_states = {
 		blend_enable = false
 		cull_mode = "cw"
 	}
+
+	shadow = {
+		rgb_write_enable = false
+		alpha_write_enable = false
+		depth_func = "lequal"
+		depth_enable = true
+		depth_write_enable = true
+		blend_enable = false
+		cull_mode = "none"
+	}
 }
 
 bgfx_shaders = {
@@ -196,8 +218,109 @@ bgfx_shaders = {
 		"""
 	}
 
+	particle = {
+		includes = "common"
+
+		samplers = {
+			u_albedo = { sampler_state = "clamp_anisotropic" }
+		}
+
+		varying = """
+			vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
+			vec4 v_color0    : COLOR0 = vec4(0.0, 0.0, 0.0, 0.0);
+
+			vec3 a_position  : POSITION;
+			vec2 a_texcoord0 : TEXCOORD0;
+			vec4 a_color0    : COLOR0;
+		"""
+
+		vs_input_output = """
+			$input a_position, a_texcoord0, a_color0
+			$output v_texcoord0, v_color0
+		"""
+
+		vs_code = """
+			void main()
+			{
+				gl_Position = mul(u_viewProj, vec4(a_position, 1.0));
+				v_texcoord0 = a_texcoord0;
+				v_color0 = a_color0;
+			}
+		"""
+
+		fs_input_output = """
+			$input v_texcoord0, v_color0
+		"""
+
+		fs_code = """
+			SAMPLER2D(u_albedo, 0);
+
+			void main()
+			{
+				gl_FragColor = texture2D(u_albedo, v_texcoord0) * v_color0;
+			}
+		"""
+	}
+
+	sprite_loop = {
+		includes = "common"
+
+		samplers = {
+			u_albedo = { sampler_state = "clamp_point" }
+		}
+
+		varying = """
+			vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
+
+			vec3 a_position  : POSITION;
+			vec2 a_texcoord0 : TEXCOORD0;
+			vec4 a_texcoord1 : TEXCOORD1;
+		"""
+
+		vs_input_output = """
+			$input a_position, a_texcoord0, a_texcoord1
+			$output v_texcoord0
+		"""
+
+		vs_code = """
+			uniform vec4 u_sprite_time;
+
+			void main()
+			{
+				// a_texcoord1 is the frame of the quad, the number of frames,
+				// the fps and the start time of the loop. The positions are
+				// in world space.
+				float frame = mod(floor((u_sprite_time.x - a_texcoord1.w) * a_texcoord1.z), a_texcoord1.y);
+				float visible = step(abs(frame - a_texcoord1.x), 0.5);
+
+				// The quads of the other frames collapse to a point.
+				gl_Position = mul(u_viewProj, vec4(a_position, 1.0)) * visible;
+				v_texcoord0 = a_texcoord0;
+			}
+		"""
+
+		fs_input_output = """
+			$input v_texcoord0
+		"""
+
+		fs_code = """
+			uniform vec4 u_color;
+			SAMPLER2D(u_albedo, 0);
+
+			void main()
+			{
+				vec4 color = texture2D(u_albedo, v_texcoord0);
+				if (color.a <= 0.0)
+					discard;
+
+				gl_FragColor = color * u_color;
+			}
+		"""
+	}
+
 	mesh = {
 		includes = "common"
+		instancing = true
 
 		samplers = {
 			u_albedo = { sampler_state = "mirror_anisotropic" }
@@ -207,6 +330,7 @@ bgfx_shaders = {
 			vec3 v_normal    : NORMAL    = vec3(0.0, 0.0, 0.0);
 			vec4 v_view      : TEXCOORD0 = vec4(0.0, 0.0, 0.0, 0.0);
 			vec2 v_texcoord0 : TEXCOORD1 = vec2(0.0, 0.0);
+			vec4 v_clip      : TEXCOORD2 = vec4(0.0, 0.0, 0.0, 0.0);
 
 			vec3 a_position  : POSITION;
 			vec3 a_normal    : NORMAL;
@@ -215,31 +339,127 @@ bgfx_shaders = {
 
 		vs_input_output = """
 			$input a_position, a_normal, a_texcoord0
-			$output v_normal, v_view, v_texcoord0
+			$output v_normal, v_view, v_texcoord0, v_clip
 		"""
 
 		vs_code = """
 			void main()
 			{
-				gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
-				v_view = mul(u_modelView, vec4(a_position, 1.0));
-				v_normal = normalize(mul(u_modelView, vec4(a_normal, 0.0)).xyz);
+		#ifdef INSTANCING
+				mat4 model = mtxFromCols(i_data0, i_data1, i_data2, i_data3);
+				vec4 world = mul(model, vec4(decode_position(a_position), 1.0));
+				gl_Position = mul(u_viewProj, world);
+				v_view = mul(u_view, world);
+				v_normal = normalize(mul(u_view, mul(model, vec4(decode_normal(a_normal), 0.0))).xyz);
+		#else
+			#ifdef SKINNING
+				vec4 position = skin(vec4(decode_position(a_position), 1.0), a_indices, a_weight);
+				vec4 normal = skin(vec4(decode_normal(a_normal), 0.0), a_indices, a_weight);
+			#else
+				vec4 position = vec4(decode_position(a_position), 1.0);
+				vec4 normal = vec4(decode_normal(a_normal), 0.0);
+			#endif // SKINNING
+				gl_Position = mul(u_modelViewProj, position);
+				v_view = mul(u_modelView, position);
+				v_normal = normalize(mul(u_modelView, normal).xyz);
+		#endif // INSTANCING
 
 				v_texcoord0 = a_texcoord0;
+				v_clip = gl_Position;
 			}
 		"""
 
 		fs_input_output = """
-			$input v_normal, v_view, v_texcoord0
+			$input v_normal, v_view, v_texcoord0, v_clip
 		"""
 
 		fs_code = """
 		#if !defined(NO_LIGHT)
-			uniform vec4 u_light_position;  // In world-space
-			uniform vec4 u_light_direction; // In view-space
-			uniform vec4 u_light_color;
-			uniform vec4 u_light_range;
-			uniform vec4 u_light_intensity;
+			// Keep in sync with CROWN_MAX_DIRECTIONAL_LIGHTS,
+			// CROWN_MAX_LIGHTS_PER_CLUSTER, CROWN_SHADOW_CASCADES,
+			// CROWN_SHADOW_NEAR and LIGHT_DATA_ROWS.
+			#define MAX_DIRECTIONAL_LIGHTS 4
+			#define MAX_LIGHTS_PER_CLUSTER 32
+			#define SHADOW_CASCADES 4
+			#define SHADOW_NEAR 0.05
+			#define LIGHT_DATA_ROWS 8.0
+
+			uniform vec4 u_lighting;       // num_directional, near, slices / log(far / near)
+			uniform vec4 u_light_clusters; // Number of clusters along x, y and z
+			uniform vec4 u_light_textures; // Width of the light data, width and height of the light indices
+			SAMPLER2D(u_light_data, 13);    // In view-space: position and range, direction and spot cosine, color and type, shadow tile, spot shadow matrix
+			SAMPLER2D(u_light_cluster, 14); // Offset and number of the indices of each cluster
+			SAMPLER2D(u_light_index, 15);   // Lights of each cluster
+
+			uniform mat4 u_shadow_cascades[SHADOW_CASCADES]; // From view-space to the shadow atlas
+			uniform vec4 u_shadow_splits;  // Far view-space depth of each cascade
+			uniform vec4 u_shadow_params;  // Bias, directional light casting the cascades or -1, homogeneous depth, origin bottom left
+			SAMPLER2DSHADOW(u_shadow_atlas, 12); // Depth of the cascades and of the tiles of the local lights
+
+			#define FETCH(sampler, x, y, w, h) texture2DLod(sampler, vec2((x) + 0.5, (y) + 0.5) / vec2(w, h), 0.0)
+			#define FETCH_LIGHT(light, row) FETCH(u_light_data, light, row, u_light_textures.x, LIGHT_DATA_ROWS)
+
+			// Returns the fraction of light reaching the view-space position
+			// @a p from the directional light casting the cascades.
+			float cascade_shadow(vec3 p)
+			{
+				float cascade = dot(step(u_shadow_splits, vec4_splat(p.z)), vec4_splat(1.0));
+				if (cascade >= float(SHADOW_CASCADES))
+					return 1.0;
+
+				vec4 coord = mul(u_shadow_cascades[int(cascade)], vec4(p, 1.0));
+				return shadow2D(u_shadow_atlas, coord.xyz);
+			}
+
+			// Returns the fraction of light reaching the view-space position
+			// @a p from the spot @a light.
+			float spot_shadow(float light, vec3 p)
+			{
+				vec4 coord = FETCH_LIGHT(light, 4.0) * p.x
+					+ FETCH_LIGHT(light, 5.0) * p.y
+					+ FETCH_LIGHT(light, 6.0) * p.z
+					+ FETCH_LIGHT(light, 7.0)
+					;
+				return shadow2D(u_shadow_atlas, coord.xyz / coord.w);
+			}
+
+			// Returns the fraction of light reaching the world-space offset
+			// @a d from an omni light of the given @a range, whose six faces
+			// are in the shadow atlas @a tile.
+			float omni_shadow(vec4 tile, vec3 d, float range)
+			{
+				vec3 a = abs(d);
+				float face;
+				float z;
+				vec2 xy;
+
+				if (a.x >= a.y && a.x >= a.z)
+				{
+					face = d.x > 0.0 ? 0.0 : 1.0;
+					z = a.x;
+					xy = vec2(d.x > 0.0 ? -d.z : d.z, d.y);
+				}
+				else if (a.y >= a.z)
+				{
+					face = d.y > 0.0 ? 2.0 : 3.0;
+					z = a.y;
+					xy = vec2(d.x, d.y > 0.0 ? -d.z : d.z);
+				}
+				else
+				{
+					face = d.z > 0.0 ? 4.0 : 5.0;
+					z = a.z;
+					xy = vec2(d.z > 0.0 ? d.x : -d.x, d.y);
+				}
+
+				float depth = range / (range - SHADOW_NEAR) * (1.0 - SHADOW_NEAR / z);
+				depth = u_shadow_params.z > 0.5 ? depth * 0.5 + 0.5 : depth;
+
+				vec2 uv = (xy / z * 0.5 + 0.5) * tile.z;
+				uv.x += tile.x + face * tile.z;
+				uv.y = u_shadow_params.w > 0.5 ? 1.0 - tile.y - tile.z + uv.y : tile.y + tile.z - uv.y;
+				return shadow2D(u_shadow_atlas, vec3(uv, depth));
+			}
 
 			uniform vec4 u_ambient;
 			uniform vec4 u_diffuse;
@@ -255,13 +475,76 @@ bgfx_shaders = {
 		#if !defined(NO_LIGHT)
 				// normalize both input vectors
 				vec3 n = normalize(v_normal);
-				vec3 e = normalize(v_view.xyz);
-				vec3 l = u_light_direction.xyz;
-
-				float nl = max(0.0, dot(n, l));
-				vec4 light_diffuse = nl * u_light_color * u_light_intensity.x;
-
-				vec4 color = max(u_diffuse * light_diffuse, u_ambient);
+				vec3 light_diffuse = vec3(0.0, 0.0, 0.0);
+
+				for (int i = 0; i < MAX_DIRECTIONAL_LIGHTS; ++i)
+				{
+					if (float(i) >= u_lighting.x)
+						break;
+
+					vec4 dir = FETCH_LIGHT(float(i), 1.0);
+					vec4 col = FETCH_LIGHT(float(i), 2.0);
+
+					float shadow = 1.0;
+					if (float(i) == u_shadow_params.y)
+						shadow = cascade_shadow(v_view.xyz + dir.xyz * u_shadow_params.x);
+
+					light_diffuse += max(0.0, dot(n, dir.xyz)) * shadow * col.rgb;
+				}
+
+				// Find the cluster of the fragment
+				vec2 ndc = v_clip.xy / v_clip.w;
+				vec3 cluster = vec3(floor((ndc * 0.5 + 0.5) * u_light_clusters.xy)
+					, floor(log(max(v_view.z, u_lighting.y) / u_lighting.y) * u_lighting.z)
+					);
+				cluster = clamp(cluster, vec3(0.0, 0.0, 0.0), u_light_clusters.xyz - 1.0);
+				vec4 range = FETCH(u_light_cluster
+					, cluster.y * u_light_clusters.x + cluster.x
+					, cluster.z
+					, u_light_clusters.x * u_light_clusters.y
+					, u_light_clusters.z
+					);
+
+				for (int i = 0; i < MAX_LIGHTS_PER_CLUSTER; ++i)
+				{
+					if (float(i) >= range.y)
+						break;
+
+					float index = range.x + float(i);
+					float light = FETCH(u_light_index
+						, mod(index, u_light_textures.y)
+						, floor(index / u_light_textures.y)
+						, u_light_textures.y
+						, u_light_textures.z
+						).x;
+
+					vec4 pos = FETCH_LIGHT(light, 0.0);
+					vec4 dir = FETCH_LIGHT(light, 1.0);
+					vec4 col = FETCH_LIGHT(light, 2.0);
+					vec4 tile = FETCH_LIGHT(light, 3.0);
+
+					vec3 l = pos.xyz - v_view.xyz;
+					float dist = length(l);
+					l /= max(dist, 0.0001);
+
+					// Spot lights point towards -z, like directional lights
+					float attenuation = max(0.0, 1.0 - dist / pos.w);
+					float spot = step(dir.w, dot(l, dir.xyz));
+
+					float shadow = 1.0;
+					if (tile.w > 0.0)
+					{
+						vec3 p = v_view.xyz + l * u_shadow_params.x;
+						if (col.w > 1.5)
+							shadow = spot_shadow(light, p);
+						else
+							shadow = omni_shadow(tile, mul(u_invView, vec4(p - pos.xyz, 0.0)).xyz, pos.w);
+					}
+
+					light_diffuse += max(0.0, dot(n, l)) * attenuation * spot * shadow * col.rgb;
+				}
+
+				vec4 color = max(u_diffuse * vec4(light_diffuse, 1.0), u_ambient);
 		#else
 				vec4 color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 		#endif // !defined(NO_LIGHT)
@@ -403,6 +686,134 @@ bgfx_shaders = {
 		"""
 	}
 
+	upscale = {
+		includes = "common"
+
+		varying = """
+			vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
+
+			vec3 a_position  : POSITION;
+			vec2 a_texcoord0 : TEXCOORD0;
+		"""
+
+		vs_input_output = """
+			$input a_position, a_texcoord0
+			$output v_texcoord0
+		"""
+
+		vs_code = """
+			uniform vec4 u_upscale; // Scale and offset of the texture coordinates
+
+			void main()
+			{
+				gl_Position = mul(u_viewProj, vec4(a_position.xy, 0.0, 1.0) );
+				v_texcoord0 = a_texcoord0 * u_upscale.xy + u_upscale.zw;
+			}
+		"""
+
+		fs_input_output = """
+			$input v_texcoord0
+		"""
+
+		fs_code = """
+			SAMPLER2D(s_texColor, 0);
+
+			void main()
+			{
+				gl_FragColor = texture2D(s_texColor, v_texcoord0);
+			}
+		"""
+	}
+
+	occlusion = {
+		includes = "common"
+
+		varying = """
+			vec2 v_texcoord0 : TEXCOORD0 = vec2(0.0, 0.0);
+
+			vec3 a_position  : POSITION;
+			vec2 a_texcoord0 : TEXCOORD0;
+		"""
+
+		vs_input_output = """
+			$input a_position, a_texcoord0
+			$output v_texcoord0
+		"""
+
+		vs_code = """
+			void main()
+			{
+				gl_Position = mul(u_viewProj, vec4(a_position.xy, 0.0, 1.0) );
+				v_texcoord0 = a_texcoord0;
+			}
+		"""
+
+		fs_input_output = """
+			$input v_texcoord0
+		"""
+
+		fs_code = """
+			SAMPLER2D(s_occlusion_depth, 0);
+			uniform vec4 u_occlusion_size;   // Source width and height, destination width and height
+			uniform vec4 u_occlusion_region; // Offset and size, in texels, of the source region
+
+			// Writes the farthest depth of the 2x2 source texels of the
+			// destination texel. The source region is stretched over the
+			// whole source, so that a scaled down scene covers at most 3x3
+			// texels. The last row and column of odd sources are clamped so
+			// that every source texel is covered.
+			void main()
+			{
+				vec2 scale = u_occlusion_region.zw / u_occlusion_size.xy;
+				vec2 base = floor(v_texcoord0 * u_occlusion_size.zw) * 2.0;
+				vec2 last = u_occlusion_region.xy + u_occlusion_region.zw - 1.0;
+				vec2 t0 = u_occlusion_region.xy + floor(base * scale);
+				vec2 t2 = u_occlusion_region.xy + ceil((base + 2.0) * scale) - 1.0;
+				vec2 uv0 = (min(t0, last) + 0.5) / u_occlusion_size.xy;
+				vec2 uv1 = (min(min(t0 + 1.0, t2), last) + 0.5) / u_occlusion_size.xy;
+				vec2 uv2 = (min(t2, last) + 0.5) / u_occlusion_size.xy;
+
+				float d0 = max(max(texture2D(s_occlusion_depth, uv0).x, texture2D(s_occlusion_depth, vec2(uv1.x, uv0.y) ).x), texture2D(s_occlusion_depth, vec2(uv2.x, uv0.y) ).x);
+				float d1 = max(max(texture2D(s_occlusion_depth, vec2(uv0.x, uv1.y) ).x, texture2D(s_occlusion_depth, uv1).x), texture2D(s_occlusion_depth, vec2(uv2.x, uv1.y) ).x);
+				float d2 = max(max(texture2D(s_occlusion_depth, vec2(uv0.x, uv2.y) ).x, texture2D(s_occlusion_depth, vec2(uv1.x, uv2.y) ).x), texture2D(s_occlusion_depth, uv2).x);
+				gl_FragColor = vec4(max(max(d0, d1), d2), 0.0, 0.0, 1.0);
+			}
+		"""
+	}
+
+	shadow = {
+		includes = "common"
+
+		varying = """
+			vec3 a_position  : POSITION;
+		"""
+
+		vs_input_output = """
+			$input a_position
+		"""
+
+		vs_code = """
+			void main()
+			{
+			#ifdef SKINNING
+				gl_Position = mul(u_modelViewProj, skin(vec4(decode_position(a_position), 1.0), a_indices, a_weight));
+			#else
+				gl_Position = mul(u_modelViewProj, vec4(decode_position(a_position), 1.0));
+			#endif // SKINNING
+			}
+		"""
+
+		fs_input_output = """
+		"""
+
+		fs_code = """
+			void main()
+			{
+				gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+			}
+		"""
+	}
+
 	fallback = {
 		includes = "common"
 
@@ -455,6 +866,16 @@ shaders = {
 		render_state = "sprite"
 	}
 
+	sprite_loop = {
+		bgfx_shader = "sprite_loop"
+		render_state = "sprite"
+	}
+
+	particle = {
+		bgfx_shader = "particle"
+		render_state = "particle"
+	}
+
 	mesh = {
 		bgfx_shader = "mesh"
 		render_state = "mesh"
@@ -475,6 +896,21 @@ shaders = {
 		render_state = "gui"
 	}
 
+	upscale = {
+		bgfx_shader = "upscale"
+		render_state = "gui"
+	}
+
+	occlusion = {
+		bgfx_shader = "occlusion"
+		render_state = "gui"
+	}
+
+	shadow = {
+		bgfx_shader = "shadow"
+		render_state = "shadow"
+	}
+
 	fallback = {
 		bgfx_shader = "fallback"
 		render_state = "mesh"
@@ -488,12 +924,20 @@ static_compile = [
 	{ shader = "gui" defines = [] }
 	{ shader = "gui" defines = ["DIFFUSE_MAP"]}
 	{ shader = "sprite" defines = [] }
+	{ shader = "sprite_loop" defines = [] }
+	{ shader = "particle" defines = [] }
 	{ shader = "mesh" defines = [] }
 	{ shader = "mesh" defines = ["DIFFUSE_MAP"] }
 	{ shader = "mesh" defines = ["DIFFUSE_MAP" "NO_LIGHT"] }
+	{ shader = "mesh" defines = ["SKINNING"] }
+	{ shader = "mesh" defines = ["DIFFUSE_MAP" "SKINNING"] }
 	{ shader = "ocornut_imgui" defines = [] }
 	{ shader = "imgui_image" defines = [] }
 	{ shader = "blit" defines = [] }
+	{ shader = "upscale" defines = [] }
+	{ shader = "occlusion" defines = [] }
+	{ shader = "shadow" defines = [] }
+	{ shader = "shadow" defines = ["SKINNING"] }
 	{ shader = "fallback" defines = [] }
 
 ]
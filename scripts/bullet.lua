@@ -16,7 +16,7 @@ project "bullet"
 	configuration {}
 
 	defines {
-		"BT_THREADSAFE=0",
+		"BT_THREADSAFE=" .. (_OPTIONS["with-bullet-mt"] and "1" or "0"),
 		"BT_USE_TBB=0",
 		"BT_USE_PPL=0",
 		"BT_USE_OPENMP=0",
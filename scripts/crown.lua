@@ -11,6 +11,7 @@ function crown_project(_name, _kind, _defines)
 		includedirs {
 			CROWN_DIR .. "src",
 			CROWN_DIR .. "3rdparty/bgfx/include",
+			CROWN_DIR .. "3rdparty/bimg/include",
 			CROWN_DIR .. "3rdparty/bx/include",
 			CROWN_DIR .. "3rdparty/stb",
 			CROWN_DIR .. "3rdparty/bullet3/src",
@@ -23,12 +24,20 @@ function crown_project(_name, _kind, _defines)
 
 		links {
 			"bgfx",
+			"bimg_encode",
+			"bimg_decode",
 			"bimg",
 			"bx",
 			"bullet",
 			"openal",
 		}
 
+		if _OPTIONS["with-bullet-mt"] then
+			defines {
+				"CROWN_PHYSICS_BULLET_MT=1",
+			}
+		end
+
 		if _OPTIONS["with-luajit"] then
 			includedirs {
 				CROWN_DIR .. "3rdparty/luajit/src",
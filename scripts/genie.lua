@@ -23,6 +23,11 @@ newoption {
 	description = "Build with tools."
 }
 
+newoption {
+	trigger = "with-bullet-mt",
+	description = "Build with the multithreaded Bullet dynamics world."
+}
+
 newoption {
 	trigger = "no-level-editor",
 	description = "Do not build Level Editor."
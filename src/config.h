@@ -25,6 +25,10 @@
 	#define CROWN_BUILD_UNIT_TESTS 1
 #endif // CROWN_BUILD_UNIT_TESTS
 
+#ifndef CROWN_BUILD_BENCHMARKS
+	#define CROWN_BUILD_BENCHMARKS 1
+#endif // CROWN_BUILD_BENCHMARKS
+
 #if !defined(CROWN_PHYSICS_BULLET) \
 	&& !defined(CROWN_PHYSICS_NOOP)
 
@@ -45,6 +49,10 @@
 	#endif // CROWN_PHYSICS_NOOP
 #endif
 
+#ifndef CROWN_PHYSICS_BULLET_MT
+	#define CROWN_PHYSICS_BULLET_MT 0 // Whether to step Bullet with its multithreaded dispatcher and solver, requires Bullet built with BT_THREADSAFE=1
+#endif // CROWN_PHYSICS_BULLET_MT
+
 #if !defined(CROWN_SOUND_OPENAL) \
 	&& !defined(CROWN_SOUND_NOOP)
 
@@ -77,14 +85,454 @@
 	#define CROWN_DEFAULT_WINDOW_HEIGHT 720
 #endif // CROWN_DEFAULT_WINDOW_HEIGHT
 
+#ifndef CROWN_DEFAULT_HEADLESS_TICK_RATE
+	#define CROWN_DEFAULT_HEADLESS_TICK_RATE 60 // Frames per second in headless mode when the boot config has no tick_rate
+#endif // CROWN_DEFAULT_HEADLESS_TICK_RATE
+
+#ifndef CROWN_DEFAULT_PAUSED_FRAME_RATE
+	#define CROWN_DEFAULT_PAUSED_FRAME_RATE 10 // Frames per second while the device is paused
+#endif // CROWN_DEFAULT_PAUSED_FRAME_RATE
+
+#ifndef CROWN_DEFAULT_BENCHMARK_FRAMES
+	#define CROWN_DEFAULT_BENCHMARK_FRAMES 600 // Number of frames measured by --benchmark-scene
+#endif // CROWN_DEFAULT_BENCHMARK_FRAMES
+
+#ifndef CROWN_BENCHMARK_WARMUP_FRAMES
+	#define CROWN_BENCHMARK_WARMUP_FRAMES 60 // Number of frames run by --benchmark-scene before measuring
+#endif // CROWN_BENCHMARK_WARMUP_FRAMES
+
+#ifndef CROWN_SCENE_BENCHMARK_MAX_DEPTH
+	#define CROWN_SCENE_BENCHMARK_MAX_DEPTH 32 // Maximum depth of the profiler scopes measured by --benchmark-scene
+#endif // CROWN_SCENE_BENCHMARK_MAX_DEPTH
+
+#ifndef CROWN_PERF_OVERLAY_FRAMES
+	#define CROWN_PERF_OVERLAY_FRAMES 96 // Number of frames in the frame time graph of the performance overlay
+#endif // CROWN_PERF_OVERLAY_FRAMES
+
+#ifndef CROWN_PERF_OVERLAY_MAX_DEPTH
+	#define CROWN_PERF_OVERLAY_MAX_DEPTH 32 // Maximum depth of the profiler scopes measured by the performance overlay
+#endif // CROWN_PERF_OVERLAY_MAX_DEPTH
+
+#ifndef CROWN_FRAME_PACING_SPIN
+	#define CROWN_FRAME_PACING_SPIN 2.0 // Milliseconds spent spinning instead of sleeping before the start of a frame
+#endif // CROWN_FRAME_PACING_SPIN
+
+#ifndef CROWN_FRAME_PACING_LATE_MARGIN
+	#define CROWN_FRAME_PACING_LATE_MARGIN 1.0 // Milliseconds of slack left to the frames started late to sample the input
+#endif // CROWN_FRAME_PACING_LATE_MARGIN
+
+#ifndef CROWN_FRAME_PACING_SMOOTHING
+	#define CROWN_FRAME_PACING_SMOOTHING 0.1 // Weight of the last frame in the moving averages of the frame times
+#endif // CROWN_FRAME_PACING_SMOOTHING
+
+#ifndef CROWN_FRAME_TIME_HISTOGRAM_SIZE
+	#define CROWN_FRAME_TIME_HISTOGRAM_SIZE 100 // Number of 1 ms buckets of the frame time histogram
+#endif // CROWN_FRAME_TIME_HISTOGRAM_SIZE
+
 #ifndef CROWN_DEFAULT_CONSOLE_PORT
 	#define CROWN_DEFAULT_CONSOLE_PORT 10001
 #endif // CROWN_DEFAULT_CONSOLE_PORT
 
+#ifndef CROWN_CONSOLE_READ_SIZE
+	#define CROWN_CONSOLE_READ_SIZE (16*1024) // Bytes read at once from a console client
+#endif // CROWN_CONSOLE_READ_SIZE
+
+#ifndef CROWN_CONSOLE_WRITE_SIZE
+	#define CROWN_CONSOLE_WRITE_SIZE (64*1024) // Bytes of queued messages written at once to a console client
+#endif // CROWN_CONSOLE_WRITE_SIZE
+
+#ifndef CROWN_CONSOLE_BULK_SIZE
+	#define CROWN_CONSOLE_BULK_SIZE (16*1024) // Console messages at least this big are sent in fragments of this size with the binary framing
+#endif // CROWN_CONSOLE_BULK_SIZE
+
+#ifndef CROWN_CONSOLE_MAX_QUEUED
+	#define CROWN_CONSOLE_MAX_QUEUED (64*1024*1024) // Maximum bytes queued to a console client before it is disconnected
+#endif // CROWN_CONSOLE_MAX_QUEUED
+
+#ifndef CROWN_REPLICATION_MAX_VALUES
+	#define CROWN_REPLICATION_MAX_VALUES 4 // Number of values replicated with the pose of each unit
+#endif // CROWN_REPLICATION_MAX_VALUES
+
+#ifndef CROWN_REPLICATION_SNAPSHOTS
+	#define CROWN_REPLICATION_SNAPSHOTS 32 // Number of snapshots kept as delta baselines, must be a power of two
+#endif // CROWN_REPLICATION_SNAPSHOTS
+
+#ifndef CROWN_REPLICATION_PACKET_SIZE
+	#define CROWN_REPLICATION_PACKET_SIZE 1200 // Maximum bytes of a replication packet
+#endif // CROWN_REPLICATION_PACKET_SIZE
+
+#ifndef CROWN_REPLICATION_POSITION_STEPS
+	#define CROWN_REPLICATION_POSITION_STEPS 1024 // Quantization steps per unit of the replicated positions and scales
+#endif // CROWN_REPLICATION_POSITION_STEPS
+
+#ifndef CROWN_REPLICATION_MAX_CLIENTS
+	#define CROWN_REPLICATION_MAX_CLIENTS 32 // Maximum number of clients of a replication server
+#endif // CROWN_REPLICATION_MAX_CLIENTS
+
+#ifndef CROWN_REPLICATION_TIMEOUT
+	#define CROWN_REPLICATION_TIMEOUT 5.0f // Seconds without packets after which a replication client is dropped
+#endif // CROWN_REPLICATION_TIMEOUT
+
 #ifndef CROWN_DEFAULT_COMPILER_PORT
 	#define CROWN_DEFAULT_COMPILER_PORT 10618
 #endif // CROWN_DEFAULT_COMPILER_PORT
 
+#ifndef CROWN_DEFAULT_RESOURCE_LOADER_THREADS
+	#define CROWN_DEFAULT_RESOURCE_LOADER_THREADS 2
+#endif // CROWN_DEFAULT_RESOURCE_LOADER_THREADS
+
+#ifndef CROWN_MAX_RESOURCE_LOADER_THREADS
+	#define CROWN_MAX_RESOURCE_LOADER_THREADS 16
+#endif // CROWN_MAX_RESOURCE_LOADER_THREADS
+
+#ifndef CROWN_DEFAULT_COMPILER_THREADS
+	#define CROWN_DEFAULT_COMPILER_THREADS 4
+#endif // CROWN_DEFAULT_COMPILER_THREADS
+
+#ifndef CROWN_MAX_COMPILER_THREADS
+	#define CROWN_MAX_COMPILER_THREADS 64
+#endif // CROWN_MAX_COMPILER_THREADS
+
+#ifndef CROWN_MIN_FREE_UNIT_INDICES
+	#define CROWN_MIN_FREE_UNIT_INDICES 1024 // Free unit indices kept before reusing one
+#endif // CROWN_MIN_FREE_UNIT_INDICES
+
+#ifndef CROWN_MAX_JOB_WORKERS
+	#define CROWN_MAX_JOB_WORKERS 16
+#endif // CROWN_MAX_JOB_WORKERS
+
+#ifndef CROWN_DEFAULT_JOB_WORKERS
+	#define CROWN_DEFAULT_JOB_WORKERS 3
+#endif // CROWN_DEFAULT_JOB_WORKERS
+
+#ifndef CROWN_MAX_CPU_CLUSTERS
+	#define CROWN_MAX_CPU_CLUSTERS 4 // Maximum number of processor clusters reported by thread::cpu_topology()
+#endif // CROWN_MAX_CPU_CLUSTERS
+
+#ifndef CROWN_FRAME_ALLOCATOR_SIZE
+	#define CROWN_FRAME_ALLOCATOR_SIZE (2*1024*1024) // Bytes of each of the two buffers of the frame allocator
+#endif // CROWN_FRAME_ALLOCATOR_SIZE
+
+#ifndef CROWN_PROFILER_HISTORY_SIZE
+	#define CROWN_PROFILER_HISTORY_SIZE (16*1024*1024) // Bytes of the ring buffer which keeps the profiler events of the last frames
+#endif // CROWN_PROFILER_HISTORY_SIZE
+
+#ifndef CROWN_PROFILER_COUNTER_SLOTS
+	#define CROWN_PROFILER_COUNTER_SLOTS 1024 // Number of per-thread slots of the profiler counters, a histogram takes 34
+#endif // CROWN_PROFILER_COUNTER_SLOTS
+
+#ifndef CROWN_PROFILER_STREAM_BUDGET
+	#define CROWN_PROFILER_STREAM_BUDGET (2*1024*1024) // Maximum bytes per second of the binary profiler stream
+#endif // CROWN_PROFILER_STREAM_BUDGET
+
+#ifndef CROWN_CALLSTACK_MAX_FRAMES
+	#define CROWN_CALLSTACK_MAX_FRAMES 32 // Maximum number of frames of the call stacks stored by CallstackTable
+#endif // CROWN_CALLSTACK_MAX_FRAMES
+
+#ifndef CROWN_CALLSTACK_TABLE_BUCKETS
+	#define CROWN_CALLSTACK_TABLE_BUCKETS 4096 // Number of hash buckets of CallstackTable
+#endif // CROWN_CALLSTACK_TABLE_BUCKETS
+
+#ifndef CROWN_MEMORY_TRACKING_DEPTH
+	#define CROWN_MEMORY_TRACKING_DEPTH 16 // Maximum number of frames of the call stacks recorded by the memory tracking
+#endif // CROWN_MEMORY_TRACKING_DEPTH
+
+#ifndef CROWN_HEAP_SPAN_SIZE
+	#define CROWN_HEAP_SPAN_SIZE (64*1024) // Bytes allocated at once for the blocks of a size class of the default allocator
+#endif // CROWN_HEAP_SPAN_SIZE
+
+#ifndef CROWN_HEAP_PAGE_BLOCK_SIZE
+	#define CROWN_HEAP_PAGE_BLOCK_SIZE (1024*1024) // Blocks of the default allocator of this many bytes or more are mapped directly from the OS
+#endif // CROWN_HEAP_PAGE_BLOCK_SIZE
+
+#ifndef CROWN_HUGE_PAGE_SIZE
+	#define CROWN_HUGE_PAGE_SIZE (2*1024*1024) // Size of the huge pages used with --huge-pages
+#endif // CROWN_HUGE_PAGE_SIZE
+
+#ifndef CROWN_HEAP_CACHE_SIZE
+	#define CROWN_HEAP_CACHE_SIZE 128 // Maximum number of free blocks per size class kept by each thread
+#endif // CROWN_HEAP_CACHE_SIZE
+
+#ifndef CROWN_HEAP_BATCH_SIZE
+	#define CROWN_HEAP_BATCH_SIZE 32 // Number of blocks moved at once between a thread and the central free lists
+#endif // CROWN_HEAP_BATCH_SIZE
+
+#ifndef CROWN_JOB_QUEUE_SIZE
+	#define CROWN_JOB_QUEUE_SIZE 1024 // Maximum number of pending jobs per thread
+#endif // CROWN_JOB_QUEUE_SIZE
+
+#ifndef CROWN_SCENE_GRAPH_PARALLEL_THRESHOLD
+	#define CROWN_SCENE_GRAPH_PARALLEL_THRESHOLD 4096 // Minimum number of nodes to update in parallel
+#endif // CROWN_SCENE_GRAPH_PARALLEL_THRESHOLD
+
+#ifndef CROWN_ANIMATION_PARALLEL_THRESHOLD
+	#define CROWN_ANIMATION_PARALLEL_THRESHOLD 1024 // Minimum number of animations to update in parallel
+#endif // CROWN_ANIMATION_PARALLEL_THRESHOLD
+
+#ifndef CROWN_SKELETON_PARALLEL_THRESHOLD
+	#define CROWN_SKELETON_PARALLEL_THRESHOLD 8 // Minimum number of skeletons to animate in parallel
+#endif // CROWN_SKELETON_PARALLEL_THRESHOLD
+
+#ifndef CROWN_PHYSICS_CAST_GRAIN_SIZE
+	#define CROWN_PHYSICS_CAST_GRAIN_SIZE 64 // Number of casts processed by each job of PhysicsWorld::cast_batch()
+#endif // CROWN_PHYSICS_CAST_GRAIN_SIZE
+
+#ifndef CROWN_PHYSICS_MOVER_GRAIN_SIZE
+	#define CROWN_PHYSICS_MOVER_GRAIN_SIZE 16 // Number of movers moved by each job of PhysicsWorld::update()
+#endif // CROWN_PHYSICS_MOVER_GRAIN_SIZE
+
+#ifndef CROWN_PHYSICS_MOVER_ITERATIONS
+	#define CROWN_PHYSICS_MOVER_ITERATIONS 4 // Maximum number of slides of a mover along the surfaces it hits in each update
+#endif // CROWN_PHYSICS_MOVER_ITERATIONS
+
+#ifndef CROWN_PHYSICS_POOL_CHUNK_SIZE
+	#define CROWN_PHYSICS_POOL_CHUNK_SIZE 64 // Minimum number of objects allocated at once by the pools of each PhysicsWorld
+#endif // CROWN_PHYSICS_POOL_CHUNK_SIZE
+
+#ifndef CROWN_PHYSICS_DISPATCHER_GRAIN_SIZE
+	#define CROWN_PHYSICS_DISPATCHER_GRAIN_SIZE 40 // Number of collision pairs processed by each job of the multithreaded dispatcher
+#endif // CROWN_PHYSICS_DISPATCHER_GRAIN_SIZE
+
+#ifndef CROWN_NAVIGATION_PATHS_PER_JOB
+	#define CROWN_NAVIGATION_PATHS_PER_JOB 8 // Number of paths searched by each job of NavigationWorld::update()
+#endif // CROWN_NAVIGATION_PATHS_PER_JOB
+
+#ifndef CROWN_MAX_CAMERAS
+	#define CROWN_MAX_CAMERAS 4 // Maximum number of cameras rendered in one frame
+#endif // CROWN_MAX_CAMERAS
+
+#ifndef CROWN_MAX_SKELETON_BONES
+	#define CROWN_MAX_SKELETON_BONES 256 // Maximum number of bones of a skeleton
+#endif // CROWN_MAX_SKELETON_BONES
+
+#ifndef CROWN_MAX_SKIN_BONES
+	#define CROWN_MAX_SKIN_BONES 4096 // Maximum number of bones skinned per frame
+#endif // CROWN_MAX_SKIN_BONES
+
+#ifndef CROWN_MAX_SOUND_BUFFERS
+	#define CROWN_MAX_SOUND_BUFFERS 1024 // Maximum number of sound resources online at the same time
+#endif // CROWN_MAX_SOUND_BUFFERS
+
+#ifndef CROWN_MAX_SOUND_VOICES
+	#define CROWN_MAX_SOUND_VOICES 32 // Maximum number of sounds mixed at the same time
+#endif // CROWN_MAX_SOUND_VOICES
+
+#ifndef CROWN_SOUND_VOICE_FADE_TIME
+	#define CROWN_SOUND_VOICE_FADE_TIME 0.05f // Time to fade a sound in or out when it gains or loses its voice, in seconds
+#endif // CROWN_SOUND_VOICE_FADE_TIME
+
+#ifndef CROWN_SOUND_STREAM_BUFFERS
+	#define CROWN_SOUND_STREAM_BUFFERS 4 // Number of audio buffers queued by each streamed sound
+#endif // CROWN_SOUND_STREAM_BUFFERS
+
+#ifndef CROWN_SOUND_STREAM_BUFFER_SIZE
+	#define CROWN_SOUND_STREAM_BUFFER_SIZE 65536 // Size of the audio buffers and of the compressed input of streamed sounds, in bytes
+#endif // CROWN_SOUND_STREAM_BUFFER_SIZE
+
+#ifndef CROWN_SOUND_UPDATE_PERIOD
+	#define CROWN_SOUND_UPDATE_PERIOD 5 // Time between the updates of the audio thread, in milliseconds
+#endif // CROWN_SOUND_UPDATE_PERIOD
+
+#ifndef CROWN_LEVEL_LOAD_CHUNK_SIZE
+	#define CROWN_LEVEL_LOAD_CHUNK_SIZE 32 // Number of units spawned between two time budget checks
+#endif // CROWN_LEVEL_LOAD_CHUNK_SIZE
+
+#ifndef CROWN_AABB_TREE_MARGIN
+	#define CROWN_AABB_TREE_MARGIN 0.1f // Amount by which the boxes stored in an AABBTree are enlarged
+#endif // CROWN_AABB_TREE_MARGIN
+
+#ifndef CROWN_OCCLUSION_BUFFER_WIDTH
+	#define CROWN_OCCLUSION_BUFFER_WIDTH 256 // Maximum width of the depth read back for occlusion culling
+#endif // CROWN_OCCLUSION_BUFFER_WIDTH
+
+#ifndef CROWN_OCCLUSION_BUFFER_HEIGHT
+	#define CROWN_OCCLUSION_BUFFER_HEIGHT 128 // Maximum height of the depth read back for occlusion culling
+#endif // CROWN_OCCLUSION_BUFFER_HEIGHT
+
+#ifndef CROWN_LIGHT_CLUSTERS_X
+	#define CROWN_LIGHT_CLUSTERS_X 16 // Number of light clusters along the width of the screen
+#endif // CROWN_LIGHT_CLUSTERS_X
+
+#ifndef CROWN_LIGHT_CLUSTERS_Y
+	#define CROWN_LIGHT_CLUSTERS_Y 8 // Number of light clusters along the height of the screen
+#endif // CROWN_LIGHT_CLUSTERS_Y
+
+#ifndef CROWN_LIGHT_CLUSTERS_Z
+	#define CROWN_LIGHT_CLUSTERS_Z 24 // Number of light clusters along the depth, exponentially spaced
+#endif // CROWN_LIGHT_CLUSTERS_Z
+
+#ifndef CROWN_MAX_LIGHTS
+	#define CROWN_MAX_LIGHTS 256 // Maximum number of lights rendered per frame
+#endif // CROWN_MAX_LIGHTS
+
+#ifndef CROWN_MAX_DIRECTIONAL_LIGHTS
+	#define CROWN_MAX_DIRECTIONAL_LIGHTS 4 // Must match the mesh shader
+#endif // CROWN_MAX_DIRECTIONAL_LIGHTS
+
+#ifndef CROWN_MAX_LIGHTS_PER_CLUSTER
+	#define CROWN_MAX_LIGHTS_PER_CLUSTER 32 // Must match the mesh shader
+#endif // CROWN_MAX_LIGHTS_PER_CLUSTER
+
+#ifndef CROWN_MAX_LIGHT_INDICES
+	#define CROWN_MAX_LIGHT_INDICES (256*32) // Maximum number of light indices in all the clusters
+#endif // CROWN_MAX_LIGHT_INDICES
+
+#ifndef CROWN_SHADOW_ATLAS_SIZE
+	#define CROWN_SHADOW_ATLAS_SIZE 4096 // Width and height of the texture holding all the shadow maps
+#endif // CROWN_SHADOW_ATLAS_SIZE
+
+#ifndef CROWN_SHADOW_CASCADES
+	#define CROWN_SHADOW_CASCADES 4 // Must match the mesh shader
+#endif // CROWN_SHADOW_CASCADES
+
+#ifndef CROWN_SHADOW_TILE_SIZE
+	#define CROWN_SHADOW_TILE_SIZE 512 // Size of the shadow map of a spot light, or of a face of an omni light
+#endif // CROWN_SHADOW_TILE_SIZE
+
+#ifndef CROWN_SHADOW_DISTANCE
+	#define CROWN_SHADOW_DISTANCE 100.0f // Distance from the camera covered by the shadow cascades, in meters
+#endif // CROWN_SHADOW_DISTANCE
+
+#ifndef CROWN_SHADOW_CASCADE_PADDING
+	#define CROWN_SHADOW_CASCADE_PADDING 0.25f // Fraction of its radius a cascade is enlarged by, so that it can be reused while the camera moves
+#endif // CROWN_SHADOW_CASCADE_PADDING
+
+#ifndef CROWN_SHADOW_BIAS
+	#define CROWN_SHADOW_BIAS 0.05f // Distance the surfaces are moved towards the lights when sampling the shadow maps, in meters
+#endif // CROWN_SHADOW_BIAS
+
+#ifndef CROWN_SHADOW_NEAR
+	#define CROWN_SHADOW_NEAR 0.05f // Near plane of the shadow maps of the local lights, must match the mesh shader
+#endif // CROWN_SHADOW_NEAR
+
+#ifndef CROWN_MIN_MESH_INSTANCES
+	#define CROWN_MIN_MESH_INSTANCES 2 // Minimum number of meshes sharing geometry and material to draw them with instancing
+#endif // CROWN_MIN_MESH_INSTANCES
+
+#ifndef CROWN_MESH_LOD_HYSTERESIS
+	#define CROWN_MESH_LOD_HYSTERESIS 0.1f // Fraction of its screen size a mesh has to move past a lod threshold before switching lod
+#endif // CROWN_MESH_LOD_HYSTERESIS
+
+#ifndef CROWN_GUI_MAX_VERTICES
+	#define CROWN_GUI_MAX_VERTICES 16384 // Maximum number of vertices drawn by the guis of a world per frame
+#endif // CROWN_GUI_MAX_VERTICES
+
+#ifndef CROWN_GUI_MAX_INDICES
+	#define CROWN_GUI_MAX_INDICES 24576 // Maximum number of indices drawn by the guis of a world per frame
+#endif // CROWN_GUI_MAX_INDICES
+
+#ifndef CROWN_GUI_TEXT_CACHE_SIZE
+	#define CROWN_GUI_TEXT_CACHE_SIZE 16384 // Number of cached glyphs above which the text layout cache is cleared
+#endif // CROWN_GUI_TEXT_CACHE_SIZE
+
+#ifndef CROWN_SPRITE_BATCH_SIZE
+	#define CROWN_SPRITE_BATCH_SIZE 16384 // Maximum number of sprites drawn with a single draw call, at most 16384
+#endif // CROWN_SPRITE_BATCH_SIZE
+
+#ifndef CROWN_MAX_PARTICLES
+	#define CROWN_MAX_PARTICLES 65536 // Maximum number of particles alive in a single emitter
+#endif // CROWN_MAX_PARTICLES
+
+#ifndef CROWN_PARTICLE_MIN_JOB_SIZE
+	#define CROWN_PARTICLE_MIN_JOB_SIZE 8192 // Particles alive below which the emitters are simulated on the main thread
+#endif // CROWN_PARTICLE_MIN_JOB_SIZE
+
+#ifndef CROWN_TILEMAP_CHUNK_SIZE
+	#define CROWN_TILEMAP_CHUNK_SIZE 32 // Width and height in tiles of the chunks of a tilemap, at most 128
+#endif // CROWN_TILEMAP_CHUNK_SIZE
+
+#ifndef CROWN_RENDER_QUEUE_MIN_CHUNK_SIZE
+	#define CROWN_RENDER_QUEUE_MIN_CHUNK_SIZE 256 // Minimum number of draws submitted by each bgfx encoder
+#endif // CROWN_RENDER_QUEUE_MIN_CHUNK_SIZE
+
+#ifndef CROWN_FILE_MONITOR_QUIET_TIME
+	#define CROWN_FILE_MONITOR_QUIET_TIME 250
+#endif // CROWN_FILE_MONITOR_QUIET_TIME
+
+#ifndef CROWN_FILE_MONITOR_MAX_DELAY
+	#define CROWN_FILE_MONITOR_MAX_DELAY 2000
+#endif // CROWN_FILE_MONITOR_MAX_DELAY
+
+#ifndef CROWN_BINARY_READER_BUFFER_SIZE
+	#define CROWN_BINARY_READER_BUFFER_SIZE (64*1024) // Bytes read at a time by BinaryReader from files that cannot be mapped
+#endif // CROWN_BINARY_READER_BUFFER_SIZE
+
+#ifndef CROWN_BINARY_WRITER_BUFFER_SIZE
+	#define CROWN_BINARY_WRITER_BUFFER_SIZE (64*1024) // Bytes collected by BinaryWriter before writing them to the file
+#endif // CROWN_BINARY_WRITER_BUFFER_SIZE
+
+#ifndef CROWN_UNIT_COMPILER_CHUNK_SIZE
+	#define CROWN_UNIT_COMPILER_CHUNK_SIZE 1024
+#endif // CROWN_UNIT_COMPILER_CHUNK_SIZE
+
+#ifndef CROWN_DEFAULT_RESOURCE_ONLINE_BUDGET
+	#define CROWN_DEFAULT_RESOURCE_ONLINE_BUDGET 4.0f // In milliseconds
+#endif // CROWN_DEFAULT_RESOURCE_ONLINE_BUDGET
+
+#ifndef CROWN_DEFAULT_LUA_GC_BUDGET
+	#define CROWN_DEFAULT_LUA_GC_BUDGET 0.0f // In milliseconds, 0 for automatic garbage collection
+#endif // CROWN_DEFAULT_LUA_GC_BUDGET
+
+#ifndef CROWN_LUA_NUM_SIZE_CLASSES
+	#define CROWN_LUA_NUM_SIZE_CLASSES 5 // Blocks of 16, 32, 64, 128 and 256 bytes are pooled
+#endif // CROWN_LUA_NUM_SIZE_CLASSES
+
+#ifndef CROWN_LUA_POOL_CHUNK_SIZE
+	#define CROWN_LUA_POOL_CHUNK_SIZE 16384 // In bytes
+#endif // CROWN_LUA_POOL_CHUNK_SIZE
+
+#ifndef CROWN_LUA_SAMPLE_INTERVAL
+	#define CROWN_LUA_SAMPLE_INTERVAL 1.0f // In milliseconds
+#endif // CROWN_LUA_SAMPLE_INTERVAL
+
+#ifndef CROWN_LUA_SAMPLE_INSTRUCTIONS
+	#define CROWN_LUA_SAMPLE_INSTRUCTIONS 1000 // Number of VM instructions between two checks of the sampling interval
+#endif // CROWN_LUA_SAMPLE_INSTRUCTIONS
+
+#ifndef CROWN_LUA_SAMPLE_MAX_DEPTH
+	#define CROWN_LUA_SAMPLE_MAX_DEPTH 16 // Maximum number of frames of a sampled stack
+#endif // CROWN_LUA_SAMPLE_MAX_DEPTH
+
+#ifndef CROWN_DEFAULT_MAX_TICKS_PER_FRAME
+	#define CROWN_DEFAULT_MAX_TICKS_PER_FRAME 4
+#endif // CROWN_DEFAULT_MAX_TICKS_PER_FRAME
+
+#ifndef CROWN_SPRITE_ATLAS_MAX_SIZE
+	#define CROWN_SPRITE_ATLAS_MAX_SIZE 8192 // Maximum width and height of a sprite atlas, in pixels
+#endif // CROWN_SPRITE_ATLAS_MAX_SIZE
+
+#ifndef CROWN_SPRITE_ATLAS_ALIGN
+	#define CROWN_SPRITE_ATLAS_ALIGN 4 // Alignment of the images in a sprite atlas, in pixels, so that they stay texel aligned in the first mips
+#endif // CROWN_SPRITE_ATLAS_ALIGN
+
+#ifndef CROWN_TEXTURE_STREAMING_BASE_SIZE
+	#define CROWN_TEXTURE_STREAMING_BASE_SIZE 64 // Size of the mip loaded before streaming, in pixels
+#endif // CROWN_TEXTURE_STREAMING_BASE_SIZE
+
+#ifndef CROWN_TEXTURE_STREAMING_DISTANCE
+	#define CROWN_TEXTURE_STREAMING_DISTANCE 10.0f // Distance up to which the most detailed mip is used, in meters
+#endif // CROWN_TEXTURE_STREAMING_DISTANCE
+
+#ifndef CROWN_MAX_TEXTURE_STREAMS
+	#define CROWN_MAX_TEXTURE_STREAMS 4
+#endif // CROWN_MAX_TEXTURE_STREAMS
+
+#ifndef CROWN_DEFAULT_TEXTURE_MEMORY_BUDGET
+	#define CROWN_DEFAULT_TEXTURE_MEMORY_BUDGET 256 // In MiB
+#endif // CROWN_DEFAULT_TEXTURE_MEMORY_BUDGET
+
+#ifndef CROWN_DEFAULT_TEXTURE_UPLOAD_BUDGET
+	#define CROWN_DEFAULT_TEXTURE_UPLOAD_BUDGET 2048 // Maximum size of texture data uploaded each frame, in KiB
+#endif // CROWN_DEFAULT_TEXTURE_UPLOAD_BUDGET
+
+#ifndef CROWN_MAX_IO_THREADS
+	#define CROWN_MAX_IO_THREADS 16
+#endif // CROWN_MAX_IO_THREADS
+
+#ifndef CROWN_MAX_IO_BUFFERS
+	#define CROWN_MAX_IO_BUFFERS 16 // Maximum number of buffers of a scatter read
+#endif // CROWN_MAX_IO_BUFFERS
+
 #ifndef CROWN_BOOT_CONFIG
 	#define CROWN_BOOT_CONFIG "boot"
 #endif // CROWN_BOOT_CONFIG
@@ -97,6 +545,22 @@
 	#define CROWN_TEMP_DIRECTORY "temp"
 #endif // CROWN_TEMP_DIRECTORY
 
+#ifndef CROWN_COMPILE_DATABASE
+	#define CROWN_COMPILE_DATABASE CROWN_TEMP_DIRECTORY "/compile_database.sjson"
+#endif // CROWN_COMPILE_DATABASE
+
+#ifndef CROWN_SOURCE_SNAPSHOT
+	#define CROWN_SOURCE_SNAPSHOT CROWN_TEMP_DIRECTORY "/source_snapshot.sjson"
+#endif // CROWN_SOURCE_SNAPSHOT
+
+#ifndef CROWN_COMPILE_REPORT
+	#define CROWN_COMPILE_REPORT CROWN_TEMP_DIRECTORY "/compile_report.json"
+#endif // CROWN_COMPILE_REPORT
+
+#ifndef CROWN_COMPILE_REPORT_SLOWEST
+	#define CROWN_COMPILE_REPORT_SLOWEST 20
+#endif // CROWN_COMPILE_REPORT_SLOWEST
+
 #ifndef CROWN_DATAIGNORE
 	#define CROWN_DATAIGNORE ".dataignore"
 #endif // CROWN_DATAIGNORE
@@ -105,18 +569,22 @@
 	#define CROWN_LAST_LOG "last.log"
 #endif // CROWN_LAST_LOG
 
+#ifndef CROWN_LOG_QUEUE_SIZE
+	#define CROWN_LOG_QUEUE_SIZE 512 // Maximum number of messages waiting for the logger thread, must be a power of two
+#endif // CROWN_LOG_QUEUE_SIZE
+
+#ifndef CROWN_LOG_ENTRY_SIZE
+	#define CROWN_LOG_ENTRY_SIZE 256 // Bytes of a message stored inline in the log queue, longer ones are allocated
+#endif // CROWN_LOG_ENTRY_SIZE
+
+#ifndef CROWN_SCREEN_CAPTURE_FRAMES
+	#define CROWN_SCREEN_CAPTURE_FRAMES 4 // Maximum number of screenshots waiting to be written, must be a power of two
+#endif // CROWN_SCREEN_CAPTURE_FRAMES
+
 #ifndef CROWN_MAX_JOYPADS
 	#define CROWN_MAX_JOYPADS 4
 #endif // CROWN_MAX_JOYPADS
 
-#ifndef CROWN_LUA_MAX_VECTOR3_SIZE
-	#define CROWN_LUA_MAX_VECTOR3_SIZE (129*1024)
-#endif // CE_MAX
-
-#ifndef CROWN_LUA_MAX_QUATERNION_SIZE
-	#define CROWN_LUA_MAX_QUATERNION_SIZE (128*1024)
-#endif // CE_MAX
-
-#ifndef CROWN_LUA_MAX_MATRIX4X4_SIZE
-	#define CROWN_LUA_MAX_MATRIX4X4_SIZE (128*1024)
-#endif // CE_MAX
+#ifndef CROWN_INPUT_POLL_INTERVAL
+	#define CROWN_INPUT_POLL_INTERVAL 1 // Maximum time in milliseconds between two polls of the joypads.
+#endif // CROWN_INPUT_POLL_INTERVAL
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/adpcm.h"
+#include "core/error/error.h"
+
+#define ADPCM_HEADER_SIZE 4 // s16 first sample, u8 step index, u8 unused
+
+namespace crown
+{
+namespace adpcm
+{
+	static const s32 s_step_table[89] =
+	{
+		    7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+		   19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+		   50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+		  130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+		  337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+		  876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+		 2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+		 5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+		15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+	};
+
+	static const s32 s_index_table[16] =
+	{
+		-1, -1, -1, -1, 2, 4, 6, 8,
+		-1, -1, -1, -1, 2, 4, 6, 8
+	};
+
+	static inline u32 channel_size()
+	{
+		return ADPCM_HEADER_SIZE + (ADPCM_SAMPLES_PER_BLOCK - 1) / 2;
+	}
+
+	// Updates the @a predictor and the step @a index with the @a nibble.
+	static inline void decode_sample(s32& predictor, s32& index, u32 nibble)
+	{
+		const s32 step = s_step_table[index];
+
+		s32 delta = step >> 3;
+		if (nibble & 4) delta += step;
+		if (nibble & 2) delta += step >> 1;
+		if (nibble & 1) delta += step >> 2;
+
+		predictor += (nibble & 8) ? -delta : delta;
+		predictor = predictor < -32768 ? -32768 : predictor > 32767 ? 32767 : predictor;
+
+		index += s_index_table[nibble];
+		index = index < 0 ? 0 : index > 88 ? 88 : index;
+	}
+
+	static inline u32 encode_sample(s32& predictor, s32& index, s32 sample)
+	{
+		const s32 step = s_step_table[index];
+		s32 diff = sample - predictor;
+
+		u32 nibble = 0;
+		if (diff < 0)
+		{
+			nibble = 8;
+			diff = -diff;
+		}
+
+		if (diff >= step)
+		{
+			nibble |= 4;
+			diff -= step;
+		}
+		if (diff >= step >> 1)
+		{
+			nibble |= 2;
+			diff -= step >> 1;
+		}
+		if (diff >= step >> 2)
+			nibble |= 1;
+
+		// Track the decoder to not accumulate errors
+		decode_sample(predictor, index, nibble);
+		return nibble;
+	}
+
+	u32 block_size(u32 num_channels)
+	{
+		return channel_size() * num_channels;
+	}
+
+	u32 encoded_size(u32 num_samples, u32 num_channels)
+	{
+		const u32 num_blocks = (num_samples + ADPCM_SAMPLES_PER_BLOCK - 1) / ADPCM_SAMPLES_PER_BLOCK;
+		return num_blocks * block_size(num_channels);
+	}
+
+	void encode(const s16* src, u32 num_samples, u32 num_channels, void* dst)
+	{
+		u8* out = (u8*)dst;
+
+		for (u32 c = 0; c < num_channels; ++c)
+		{
+			// Start from the step closest to the first difference, then
+			// carry the step index over from a block to the next
+			s32 index = 0;
+			if (num_samples > 1)
+			{
+				s32 diff = src[num_channels + c] - src[c];
+				diff = diff < 0 ? -diff : diff;
+				while (index < 88 && s_step_table[index] < diff)
+					++index;
+			}
+
+			for (u32 first = 0; first < num_samples; first += ADPCM_SAMPLES_PER_BLOCK)
+			{
+				u8* block = out + (first / ADPCM_SAMPLES_PER_BLOCK) * block_size(num_channels) + c * channel_size();
+
+				s32 predictor = src[first*num_channels + c];
+				block[0] = u8(predictor & 0xff);
+				block[1] = u8((predictor >> 8) & 0xff);
+				block[2] = u8(index);
+				block[3] = 0;
+
+				u8* nibbles = block + ADPCM_HEADER_SIZE;
+				for (u32 i = 1; i < ADPCM_SAMPLES_PER_BLOCK; ++i)
+				{
+					const u32 s = first + i;
+					const s32 sample = s < num_samples ? src[s*num_channels + c] : 0;
+					const u32 nibble = encode_sample(predictor, index, sample);
+
+					if (i & 1)
+						nibbles[(i - 1) / 2] = u8(nibble);
+					else
+						nibbles[(i - 1) / 2] |= u8(nibble << 4);
+				}
+			}
+		}
+	}
+
+	void decode_block(const void* src, u32 num_samples, u32 num_channels, s16* dst)
+	{
+		CE_ASSERT(num_samples <= ADPCM_SAMPLES_PER_BLOCK, "Too many samples");
+
+		for (u32 c = 0; c < num_channels; ++c)
+		{
+			const u8* block = (const u8*)src + c * channel_size();
+
+			s32 predictor = s16(block[0] | (block[1] << 8));
+			s32 index = block[2] > 88 ? 88 : block[2];
+
+			if (num_samples > 0)
+				dst[c] = s16(predictor);
+
+			const u8* nibbles = block + ADPCM_HEADER_SIZE;
+			for (u32 i = 1; i < num_samples; ++i)
+			{
+				const u32 byte = nibbles[(i - 1) / 2];
+				const u32 nibble = (i & 1) ? byte & 0xf : byte >> 4;
+				decode_sample(predictor, index, nibble);
+				dst[i*num_channels + c] = s16(predictor);
+			}
+		}
+	}
+
+} // namespace adpcm
+
+} // namespace crown
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+/// Number of samples per channel in each ADPCM block.
+#define ADPCM_SAMPLES_PER_BLOCK 1017
+
+namespace crown
+{
+/// Functions to encode and decode 16 bits PCM samples with IMA ADPCM.
+///
+/// Samples are encoded in blocks of ADPCM_SAMPLES_PER_BLOCK samples per
+/// channel at 4 bits per sample. Each block starts with the first sample of
+/// each channel, so blocks can be decoded independently of each other.
+///
+/// @ingroup Core
+namespace adpcm
+{
+	/// Returns the size of a block of @a num_channels channels.
+	u32 block_size(u32 num_channels);
+
+	/// Returns the size of @a num_samples samples per channel of
+	/// @a num_channels channels once encoded.
+	u32 encoded_size(u32 num_samples, u32 num_channels);
+
+	/// Encodes @a num_samples interleaved samples per channel of
+	/// @a num_channels channels from @a src into @a dst, which must hold
+	/// encoded_size() bytes. The last block is padded with silence.
+	void encode(const s16* src, u32 num_samples, u32 num_channels, void* dst);
+
+	/// Decodes the first @a num_samples samples per channel of the block
+	/// @a src of @a num_channels channels into @a dst, interleaved.
+	void decode_block(const void* src, u32 num_samples, u32 num_channels, s16* dst);
+
+} // namespace adpcm
+
+} // namespace crown
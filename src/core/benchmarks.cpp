@@ -0,0 +1,945 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+
+#if CROWN_BUILD_BENCHMARKS
+
+#include "core/containers/array.h"
+#include "core/containers/event_stream.h"
+#include "core/containers/hash_map.h"
+#include "core/containers/queue.h"
+#include "core/containers/sort_map.h"
+#include "core/filesystem/file.h"
+#include "core/filesystem/filesystem_disk.h"
+#include "core/json/json_document.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/math/aabb.h"
+#include "core/math/frustum.h"
+#include "core/math/intersection.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/quaternion.h"
+#include "core/math/random.h"
+#include "core/math/sphere.h"
+#include "core/math/vector3.h"
+#include "core/memory/frame_allocator.h"
+#include "core/memory/linear_allocator.h"
+#include "core/memory/memory.h"
+#include "core/memory/pool_allocator.h"
+#include "core/memory/stack_allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "core/memory/tlsf_allocator.h"
+#include "core/murmur.h"
+#include "core/os.h"
+#include "core/strings/string.h"
+#include "core/strings/string_id.h"
+#include "core/strings/string_stream.h"
+#include "resource/expression_language.h"
+#include <algorithm> // std::sort
+#include <stdio.h>   // printf
+
+namespace crown
+{
+namespace benchmark_internal
+{
+	static const u32 NUM_SAMPLES = 32;
+	static const f64 WARMUP_TIME = 0.05;  // Seconds
+	static const f64 SAMPLE_TIME = 0.002; // Seconds
+	static const u32 MAX_ITERATIONS = 1u << 24;
+
+	// Benchmarks do @a n operations on @a user_data.
+	typedef void (*BenchmarkFunction)(void* user_data, u32 n);
+
+	struct Result
+	{
+		const char* name;
+		u32 iterations; // Operations per sample.
+		f64 min;        // Nanoseconds per operation.
+		f64 p50;
+		f64 p90;
+		f64 p99;
+		f64 max;
+	};
+
+	struct Suite
+	{
+		const char* filter;
+		Array<Result> results;
+
+		Suite(Allocator& a, const char* filter)
+			: filter(filter)
+			, results(a)
+		{
+		}
+	};
+
+	// Sinks for the results of the benchmarks, so that the compiler can
+	// not discard the computations.
+	static volatile u32 s_sink_u32;
+	static volatile u64 s_sink_u64;
+	static volatile f32 s_sink_f32;
+
+	static inline void keep(u32 v) { s_sink_u32 = v; }
+	static inline void keep(u64 v) { s_sink_u64 = v; }
+	static inline void keep(f32 v) { s_sink_f32 = v; }
+	static inline void keep(const void* p) { s_sink_u64 = (u64)(uintptr_t)p; }
+
+	static f64 seconds(BenchmarkFunction func, void* user_data, u32 n)
+	{
+		const s64 start = os::clocktime();
+		func(user_data, n);
+		const s64 end = os::clocktime();
+		return f64(end - start) / f64(os::clockfrequency());
+	}
+
+	static f64 percentile(const f64* sorted, u32 num, f64 p)
+	{
+		const u32 i = u32(p * f64(num - 1) + 0.5);
+		return sorted[i < num ? i : num - 1];
+	}
+
+	static void run(Suite& suite, const char* name, BenchmarkFunction func, void* user_data = NULL)
+	{
+		if (suite.filter != NULL && strstr(name, suite.filter) == NULL)
+			return;
+
+		// Find the number of operations which takes about SAMPLE_TIME
+		u32 n = 1;
+		f64 t = seconds(func, user_data, n);
+		while (t < SAMPLE_TIME && n < MAX_ITERATIONS)
+		{
+			n *= 2;
+			t = seconds(func, user_data, n);
+		}
+
+		// Warm up caches and branch predictors
+		for (f64 elapsed = t; elapsed < WARMUP_TIME; )
+			elapsed += seconds(func, user_data, n);
+
+		f64 ns[NUM_SAMPLES];
+		for (u32 i = 0; i < NUM_SAMPLES; ++i)
+			ns[i] = seconds(func, user_data, n) * 1e9 / f64(n);
+		std::sort(ns, ns + NUM_SAMPLES);
+
+		Result r;
+		r.name = name;
+		r.iterations = n;
+		r.min = ns[0];
+		r.p50 = percentile(ns, NUM_SAMPLES, 0.50);
+		r.p90 = percentile(ns, NUM_SAMPLES, 0.90);
+		r.p99 = percentile(ns, NUM_SAMPLES, 0.99);
+		r.max = ns[NUM_SAMPLES - 1];
+		array::push_back(suite.results, r);
+
+		printf("%-32s %10u %12.2f %12.2f %12.2f %12.2f %12.2f\n"
+			, r.name
+			, r.iterations
+			, r.min
+			, r.p50
+			, r.p90
+			, r.p99
+			, r.max
+			);
+	}
+
+	static void write_json(const Suite& suite, const char* path)
+	{
+		TempAllocator4096 ta;
+		StringStream ss(ta);
+
+		ss << "{\"benchmarks\":[";
+		for (u32 i = 0; i < array::size(suite.results); ++i)
+		{
+			const Result& r = suite.results[i];
+			char buf[256];
+			snprintf(buf, sizeof(buf)
+				, "%s{\"name\":\"%s\",\"iterations\":%u,\"min\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}"
+				, i > 0 ? "," : ""
+				, r.name
+				, r.iterations
+				, r.min
+				, r.p50
+				, r.p90
+				, r.p99
+				, r.max
+				);
+			ss << buf;
+		}
+		ss << "]}\n";
+
+		char cwd[1024];
+		FilesystemDisk fs(default_allocator());
+		fs.set_prefix(os::getcwd(cwd, sizeof(cwd)));
+
+		File* file = fs.open(path, FileOpenMode::WRITE);
+		if (file->is_open())
+			file->write(string_stream::c_str(ss), strlen32(string_stream::c_str(ss)));
+		else
+			printf("Unable to write '%s'\n", path);
+		fs.close(*file);
+	}
+
+	//
+	// Containers
+	//
+
+	static void array_push_back(void* /*user_data*/, u32 n)
+	{
+		Array<u32> a(default_allocator());
+		for (u32 i = 0; i < n; ++i)
+			array::push_back(a, i);
+		keep(array::size(a));
+	}
+
+	static void hash_map_set(void* /*user_data*/, u32 n)
+	{
+		HashMap<u32, u32> m(default_allocator());
+		for (u32 i = 0; i < n; ++i)
+			hash_map::set(m, i * 2654435761u, i);
+		keep(hash_map::size(m));
+	}
+
+	static void hash_map_get(void* user_data, u32 n)
+	{
+		const HashMap<u32, u32>& m = *(HashMap<u32, u32>*)user_data;
+		u32 sum = 0;
+		for (u32 i = 0; i < n; ++i)
+			sum += hash_map::get(m, (i & 4095) * 2654435761u, 0u);
+		keep(sum);
+	}
+
+	static void sort_map_get(void* user_data, u32 n)
+	{
+		const SortMap<u32, u32>& m = *(SortMap<u32, u32>*)user_data;
+		u32 sum = 0;
+		for (u32 i = 0; i < n; ++i)
+			sum += sort_map::get(m, (i * 7) & 4095, 0u);
+		keep(sum);
+	}
+
+	static void queue_push_pop(void* user_data, u32 n)
+	{
+		Queue<u32>& q = *(Queue<u32>*)user_data;
+		for (u32 i = 0; i < n; ++i)
+		{
+			queue::push_back(q, i);
+			queue::pop_front(q);
+		}
+		keep(queue::size(q));
+	}
+
+	static void event_stream_write_read(void* user_data, u32 n)
+	{
+		EventStream& s = *(EventStream*)user_data;
+		const Vector3 ev = { 1.0f, 2.0f, 3.0f };
+
+		u32 sum = 0;
+		for (u32 done = 0; done < n; )
+		{
+			array::clear(s);
+			const u32 num = n - done < 256 ? n - done : 256;
+			for (u32 i = 0; i < num; ++i)
+				event_stream::write(s, i, ev);
+
+			const char* cur = array::begin(s);
+			const char* end = array::end(s);
+			while (cur < end)
+			{
+				const EventHeader* eh = (const EventHeader*)cur;
+				sum += eh->type;
+				cur += sizeof(*eh) + eh->size;
+			}
+			done += num;
+		}
+		keep(sum);
+	}
+
+	//
+	// Allocators
+	//
+
+	static void heap_allocator(void* /*user_data*/, u32 n)
+	{
+		Allocator& a = default_allocator();
+		for (u32 i = 0; i < n; ++i)
+			a.deallocate(a.allocate(16 + (i & 255)));
+	}
+
+	static void tlsf_allocator(void* user_data, u32 n)
+	{
+		Allocator& a = *(TlsfAllocator*)user_data;
+		void* ptrs[16];
+		for (u32 i = 0; i < n; ++i)
+		{
+			void*& p = ptrs[i & 15];
+			if (i >= 16)
+				a.deallocate(p);
+			p = a.allocate(16 + (i & 255));
+		}
+		for (u32 i = 0; i < (n < 16 ? n : 16); ++i)
+			a.deallocate(ptrs[i]);
+	}
+
+	static void pool_allocator(void* user_data, u32 n)
+	{
+		Allocator& a = *(PoolAllocator*)user_data;
+		for (u32 i = 0; i < n; ++i)
+			a.deallocate(a.allocate(64));
+	}
+
+	static void stack_allocator(void* user_data, u32 n)
+	{
+		Allocator& a = *(StackAllocator*)user_data;
+		for (u32 i = 0; i < n; ++i)
+			a.deallocate(a.allocate(16 + (i & 255)));
+	}
+
+	static void linear_allocator(void* user_data, u32 n)
+	{
+		LinearAllocator& a = *(LinearAllocator*)user_data;
+		for (u32 i = 0; i < n; ++i)
+		{
+			if ((i & 1023) == 0)
+				a.clear();
+			keep(a.allocate(16 + (i & 255)));
+		}
+		a.clear();
+	}
+
+	static void frame_allocator(void* user_data, u32 n)
+	{
+		FrameAllocator& a = *(FrameAllocator*)user_data;
+		for (u32 i = 0; i < n; ++i)
+		{
+			if ((i & 1023) == 0)
+				a.reset();
+			keep(a.allocate(16 + (i & 255)));
+		}
+		a.reset();
+	}
+
+	static void temp_allocator(void* /*user_data*/, u32 n)
+	{
+		for (u32 i = 0; i < n; ++i)
+		{
+			TempAllocator1024 ta;
+			keep(ta.allocate(16 + (i & 255)));
+		}
+	}
+
+	//
+	// Hashing
+	//
+
+	static const char* s_key = "core/units/primitives/cube/cube.unit";
+
+	static void murmur32(void* /*user_data*/, u32 n)
+	{
+		const u32 len = strlen32(s_key);
+		u32 h = 0;
+		for (u32 i = 0; i < n; ++i)
+			h = crown::murmur32(s_key, len, h);
+		keep(h);
+	}
+
+	static void murmur64(void* /*user_data*/, u32 n)
+	{
+		const u32 len = strlen32(s_key);
+		u64 h = 0;
+		for (u32 i = 0; i < n; ++i)
+			h = crown::murmur64(s_key, len, h);
+		keep(h);
+	}
+
+	static void string_id32(void* /*user_data*/, u32 n)
+	{
+		u32 h = 0;
+		for (u32 i = 0; i < n; ++i)
+			h ^= StringId32(s_key)._id;
+		keep(h);
+	}
+
+	static void string_id64(void* /*user_data*/, u32 n)
+	{
+		u64 h = 0;
+		for (u32 i = 0; i < n; ++i)
+			h ^= StringId64(s_key)._id;
+		keep(h);
+	}
+
+	//
+	// Number formatting
+	//
+
+	static void string_stream_f32(void* /*user_data*/, u32 n)
+	{
+		TempAllocator4096 ta;
+		StringStream ss(ta);
+		f32 val = 0.1f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			if ((i & 127) == 0)
+				array::clear(ss);
+			ss << val;
+			val = val * 1.37f + 0.01f;
+			if (val > 1.0e6f)
+				val = 0.1f;
+		}
+		keep(array::size(ss));
+	}
+
+	static void string_stream_u32(void* /*user_data*/, u32 n)
+	{
+		TempAllocator4096 ta;
+		StringStream ss(ta);
+		for (u32 i = 0; i < n; ++i)
+		{
+			if ((i & 127) == 0)
+				array::clear(ss);
+			ss << i * 2654435761u;
+		}
+		keep(array::size(ss));
+	}
+
+	//
+	// Random
+	//
+
+	static void random_lcg(void* /*user_data*/, u32 n)
+	{
+		Random r(42);
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += r.unit_float();
+		keep(sum);
+	}
+
+	static void random_pcg32(void* /*user_data*/, u32 n)
+	{
+		Pcg32 r(42);
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += r.unit_float();
+		keep(sum);
+	}
+
+	static void random_pcg32_fill(void* /*user_data*/, u32 n)
+	{
+		Pcg32 r(42);
+		f32 values[256];
+		for (u32 i = 0; i < n; ++i)
+		{
+			random::fill(r, values, countof(values));
+			keep(values[i & 255]);
+		}
+	}
+
+	//
+	// SJSON
+	//
+
+	static const char* s_sjson =
+		"units = {\n"
+		"	\"5f7a3b9c-0d4e-4a61-9b8f-1c2d3e4f5a6b\" = {\n"
+		"		position = [ 1.5 2.25 -3 ]\n"
+		"		rotation = [ 0 0 0 1 ]\n"
+		"		scale = [ 1 1 1 ]\n"
+		"		name = \"crate\"\n"
+		"		prefab = \"units/crate\"\n"
+		"		components = [ \"transform\" \"mesh_renderer\" \"collider\" ]\n"
+		"	}\n"
+		"	\"8a1b2c3d-4e5f-4061-8293-a4b5c6d7e8f9\" = {\n"
+		"		position = [ -4 0 12.5 ]\n"
+		"		rotation = [ 0 0.7071 0 0.7071 ]\n"
+		"		scale = [ 2 2 2 ]\n"
+		"		name = \"barrel\"\n"
+		"		prefab = \"units/barrel\"\n"
+		"		components = [ \"transform\" \"mesh_renderer\" ]\n"
+		"	}\n"
+		"}\n"
+		"sounds = []\n"
+		"skydome_unit = \"core/units/skydome/skydome\"\n"
+		"ambient_color = [ 0.1 0.1 0.1 ]\n"
+		;
+
+	static void sjson_parse_object(void* /*user_data*/, u32 n)
+	{
+		for (u32 i = 0; i < n; ++i)
+		{
+			TempAllocator4096 ta;
+			JsonObject obj(ta);
+			sjson::parse(s_sjson, obj);
+			keep(json_object::size(obj));
+		}
+	}
+
+	static void sjson_parse_document(void* /*user_data*/, u32 n)
+	{
+		for (u32 i = 0; i < n; ++i)
+		{
+			JsonDocument jd(default_allocator());
+			sjson::parse(s_sjson, jd);
+			keep(&jd);
+		}
+	}
+
+	//
+	// Math
+	//
+
+	static void matrix4x4_multiply(void* /*user_data*/, u32 n)
+	{
+		Matrix4x4 a = matrix4x4(quaternion(VECTOR3_YAXIS, 0.1f), vector3(1.0f, 2.0f, 3.0f));
+		Matrix4x4 m = MATRIX4X4_IDENTITY;
+		for (u32 i = 0; i < n; ++i)
+			m = m * a;
+		keep(m.t.x);
+	}
+
+	static void matrix4x4_invert(void* /*user_data*/, u32 n)
+	{
+		Matrix4x4 m = matrix4x4(quaternion(VECTOR3_YAXIS, 0.1f), vector3(1.0f, 2.0f, 3.0f));
+		for (u32 i = 0; i < n; ++i)
+			m = get_inverted(m);
+		keep(m.t.x);
+	}
+
+	static void matrix4x4_transform(void* /*user_data*/, u32 n)
+	{
+		const Matrix4x4 m = matrix4x4(quaternion(VECTOR3_YAXIS, 0.1f), vector3(1.0f, 2.0f, 3.0f));
+		Vector3 v = { 1.0f, 0.0f, 0.0f };
+		for (u32 i = 0; i < n; ++i)
+			v = v * m;
+		keep(v.x);
+	}
+
+	static void quaternion_multiply(void* /*user_data*/, u32 n)
+	{
+		const Quaternion a = quaternion(VECTOR3_YAXIS, 0.1f);
+		Quaternion q = QUATERNION_IDENTITY;
+		for (u32 i = 0; i < n; ++i)
+			q = q * a;
+		keep(q.w);
+	}
+
+	static void quaternion_lerp(void* /*user_data*/, u32 n)
+	{
+		const Quaternion a = quaternion(VECTOR3_YAXIS, 0.1f);
+		const Quaternion b = quaternion(VECTOR3_XAXIS, 1.2f);
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += lerp(a, b, f32(i & 255) / 255.0f).w;
+		keep(sum);
+	}
+
+	static void quaternion_from_matrix(void* /*user_data*/, u32 n)
+	{
+		Matrix4x4 m = matrix4x4(quaternion(VECTOR3_YAXIS, 0.1f), vector3(1.0f, 2.0f, 3.0f));
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			m.t.x = f32(i);
+			sum += rotation(m).w;
+		}
+		keep(sum);
+	}
+
+	//
+	// Intersection
+	//
+
+	static void ray_sphere(void* /*user_data*/, u32 n)
+	{
+		Sphere s;
+		s.c = vector3(0.0f, 0.0f, 10.0f);
+		s.r = 2.0f;
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += ray_sphere_intersection(vector3(f32(i & 3), 0.0f, 0.0f), dir, s);
+		keep(sum);
+	}
+
+	static void ray_aabb(void* /*user_data*/, u32 n)
+	{
+		AABB b;
+		b.min = vector3(-1.0f, -1.0f, 9.0f);
+		b.max = vector3( 1.0f,  1.0f, 11.0f);
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += ray_aabb_intersection(vector3(f32(i & 3) * 0.5f, 0.0f, 0.0f), dir, b);
+		keep(sum);
+	}
+
+	static void ray_obb(void* /*user_data*/, u32 n)
+	{
+		const Matrix4x4 tm = matrix4x4(quaternion(VECTOR3_YAXIS, 0.3f), vector3(0.0f, 0.0f, 10.0f));
+		const Vector3 half_extents = { 1.0f, 1.0f, 1.0f };
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += ray_obb_intersection(vector3(f32(i & 3) * 0.5f, 0.0f, 0.0f), dir, tm, half_extents);
+		keep(sum);
+	}
+
+	static void ray_triangle(void* /*user_data*/, u32 n)
+	{
+		const Vector3 v0 = { -1.0f, -1.0f, 10.0f };
+		const Vector3 v1 = {  1.0f, -1.0f, 10.0f };
+		const Vector3 v2 = {  0.0f,  1.0f, 10.0f };
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+			sum += ray_triangle_intersection(vector3(f32(i & 3) * 0.25f, 0.0f, 0.0f), dir, v0, v1, v2);
+		keep(sum);
+	}
+
+	static void frustum_sphere(void* /*user_data*/, u32 n)
+	{
+		Matrix4x4 pr;
+		perspective(pr, frad(60.0f), 16.0f/9.0f, 0.1f, 100.0f);
+		Frustum f;
+		frustum::from_matrix(f, pr);
+
+		u32 num = 0;
+		for (u32 i = 0; i < n; ++i)
+		{
+			Sphere s;
+			s.c = vector3(f32(i & 63) - 32.0f, 0.0f, f32(i & 127));
+			s.r = 1.0f;
+			num += frustum_sphere_intersection(f, s);
+		}
+		keep(num);
+	}
+
+	static void frustum_box(void* /*user_data*/, u32 n)
+	{
+		Matrix4x4 pr;
+		perspective(pr, frad(60.0f), 16.0f/9.0f, 0.1f, 100.0f);
+		Frustum f;
+		frustum::from_matrix(f, pr);
+
+		u32 num = 0;
+		for (u32 i = 0; i < n; ++i)
+		{
+			AABB b;
+			b.min = vector3(f32(i & 63) - 32.0f, -1.0f, f32(i & 127));
+			b.max = b.min + vector3(2.0f, 2.0f, 2.0f);
+			num += frustum_box_intersection(f, b);
+		}
+		keep(num);
+	}
+
+	// Spheres and boxes on a 16x16 grid in front of the camera.
+	struct Shapes
+	{
+		enum { NUM = 256 };
+		f32 c[3][NUM];
+		f32 r[NUM];
+		f32 min[3][NUM];
+		f32 max[3][NUM];
+		Sphere spheres[NUM];
+		AABB boxes[NUM];
+		SphereSoA sphere_soa;
+		AABBSoA aabb_soa;
+		Frustum frustum;
+
+		Shapes()
+		{
+			for (u32 i = 0; i < NUM; ++i)
+			{
+				const Vector3 center = vector3(f32(i % 16) - 8.0f, f32(i / 16) - 8.0f, 10.0f + f32(i % 7));
+				spheres[i].c = center;
+				spheres[i].r = 0.4f;
+				boxes[i].min = center - vector3(0.4f, 0.4f, 0.4f);
+				boxes[i].max = center + vector3(0.4f, 0.4f, 0.4f);
+				for (u32 j = 0; j < 3; ++j)
+				{
+					c[j][i] = to_float_ptr(spheres[i].c)[j];
+					min[j][i] = to_float_ptr(boxes[i].min)[j];
+					max[j][i] = to_float_ptr(boxes[i].max)[j];
+				}
+				r[i] = spheres[i].r;
+			}
+
+			sphere_soa.c[0] = c[0]; sphere_soa.c[1] = c[1]; sphere_soa.c[2] = c[2];
+			sphere_soa.r = r;
+			sphere_soa.num = NUM;
+			for (u32 j = 0; j < 3; ++j)
+			{
+				aabb_soa.min[j] = min[j];
+				aabb_soa.max[j] = max[j];
+			}
+			aabb_soa.num = NUM;
+
+			Matrix4x4 pr;
+			perspective(pr, frad(30.0f), 1.0f, 0.1f, 100.0f);
+			frustum::from_matrix(frustum, pr);
+		}
+	};
+
+	static void ray_sphere_batch(void* user_data, u32 n)
+	{
+		const Shapes& s = *(Shapes*)user_data;
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		u32 sum = 0;
+		for (u32 i = 0; i < n; ++i)
+			sum += ray_sphere_intersection(vector3(f32(i & 7) * 0.5f, 0.0f, 0.0f), dir, s.sphere_soa, NULL);
+		keep(sum);
+	}
+
+	static void ray_sphere_loop(void* user_data, u32 n)
+	{
+		const Shapes& s = *(Shapes*)user_data;
+		const Vector3 dir = { 0.0f, 0.0f, 1.0f };
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			const Vector3 from = vector3(f32(i & 7) * 0.5f, 0.0f, 0.0f);
+			for (u32 j = 0; j < Shapes::NUM; ++j)
+				sum += ray_sphere_intersection(from, dir, s.spheres[j]);
+		}
+		keep(sum);
+	}
+
+	static void frustum_box_batch(void* user_data, u32 n)
+	{
+		const Shapes& s = *(Shapes*)user_data;
+		u32 mask[Shapes::NUM / 32];
+		u32 sum = 0;
+		for (u32 i = 0; i < n; ++i)
+			sum += frustum_box_intersection(s.frustum, s.aabb_soa, mask);
+		keep(sum);
+	}
+
+	static void frustum_box_loop(void* user_data, u32 n)
+	{
+		const Shapes& s = *(Shapes*)user_data;
+		u32 sum = 0;
+		for (u32 i = 0; i < n; ++i)
+		{
+			for (u32 j = 0; j < Shapes::NUM; ++j)
+				sum += frustum_box_intersection(s.frustum, s.boxes[j]);
+		}
+		keep(sum);
+	}
+
+	//
+	// Expression language
+	//
+
+	struct Expression
+	{
+		enum { NUM = 256 };
+
+		unsigned byte_code[64];
+		float variables[2];
+		float variables_soa[2*NUM]; ///< The variables of NUM instances.
+		float out[NUM];
+	};
+
+	static void expression_run(void* user_data, u32 n)
+	{
+		using namespace skinny::expression_language;
+		Expression& e = *(Expression*)user_data;
+
+		float stack_data[32];
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			e.variables[0] = f32(i & 255);
+			Stack stack(stack_data, countof(stack_data));
+			run(e.byte_code, e.variables, stack);
+			sum += stack.data[0];
+		}
+		keep(sum);
+	}
+
+	static void expression_run_loop(void* user_data, u32 n)
+	{
+		using namespace skinny::expression_language;
+		Expression& e = *(Expression*)user_data;
+
+		float stack_data[32];
+		float variables[2];
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			for (u32 j = 0; j < Expression::NUM; ++j)
+			{
+				variables[0] = e.variables_soa[j];
+				variables[1] = e.variables_soa[Expression::NUM + j];
+				Stack stack(stack_data, countof(stack_data));
+				run(e.byte_code, variables, stack);
+				e.out[j] = stack.data[0];
+			}
+			sum += e.out[i & (Expression::NUM - 1)];
+		}
+		keep(sum);
+	}
+
+	static void expression_run_batch(void* user_data, u32 n)
+	{
+		using namespace skinny::expression_language;
+		Expression& e = *(Expression*)user_data;
+
+		f32 sum = 0.0f;
+		for (u32 i = 0; i < n; ++i)
+		{
+			run_batch(e.byte_code, e.variables_soa, Expression::NUM, Expression::NUM, e.out);
+			sum += e.out[i & (Expression::NUM - 1)];
+		}
+		keep(sum);
+	}
+
+} // namespace benchmark_internal
+
+int main_benchmarks(const char* filter, const char* json_path)
+{
+	using namespace benchmark_internal;
+
+	memory_globals::init();
+	{
+		Suite suite(default_allocator(), filter);
+
+		printf("%-32s %10s %12s %12s %12s %12s %12s\n"
+			, "benchmark (ns/op)"
+			, "iterations"
+			, "min"
+			, "p50"
+			, "p90"
+			, "p99"
+			, "max"
+			);
+
+		run(suite, "array.push_back", array_push_back);
+		run(suite, "hash_map.set", hash_map_set);
+		{
+			HashMap<u32, u32> m(default_allocator());
+			for (u32 i = 0; i < 4096; ++i)
+				hash_map::set(m, i * 2654435761u, i);
+			run(suite, "hash_map.get", hash_map_get, &m);
+		}
+		{
+			SortMap<u32, u32> m(default_allocator());
+			for (u32 i = 0; i < 4096; ++i)
+				sort_map::set(m, i, i);
+			sort_map::sort(m);
+			run(suite, "sort_map.get", sort_map_get, &m);
+		}
+		{
+			Queue<u32> q(default_allocator());
+			queue::increase_capacity(q, 16);
+			run(suite, "queue.push_pop", queue_push_pop, &q);
+		}
+		{
+			EventStream s(default_allocator());
+			run(suite, "event_stream.write_read", event_stream_write_read, &s);
+		}
+
+		run(suite, "allocator.heap", heap_allocator);
+		{
+			TlsfAllocator a(default_allocator(), 1024*1024);
+			run(suite, "allocator.tlsf", tlsf_allocator, &a);
+		}
+		{
+			PoolAllocator a(default_allocator(), 16, 64);
+			run(suite, "allocator.pool", pool_allocator, &a);
+		}
+		{
+			char* mem = (char*)default_allocator().allocate(64*1024);
+			StackAllocator a(mem, 64*1024);
+			run(suite, "allocator.stack", stack_allocator, &a);
+			default_allocator().deallocate(mem);
+		}
+		{
+			LinearAllocator a(default_allocator(), 512*1024);
+			run(suite, "allocator.linear", linear_allocator, &a);
+		}
+		{
+			FrameAllocator a(default_allocator(), 512*1024);
+			run(suite, "allocator.frame", frame_allocator, &a);
+		}
+		run(suite, "allocator.temp", temp_allocator);
+
+		run(suite, "murmur32", murmur32);
+		run(suite, "murmur64", murmur64);
+		run(suite, "string_id32", string_id32);
+		run(suite, "string_id64", string_id64);
+
+		run(suite, "string_stream.f32", string_stream_f32);
+		run(suite, "string_stream.u32", string_stream_u32);
+
+		run(suite, "random.lcg_unit_float", random_lcg);
+		run(suite, "random.pcg32_unit_float", random_pcg32);
+		run(suite, "random.pcg32_fill_256", random_pcg32_fill);
+
+		run(suite, "sjson.parse_object", sjson_parse_object);
+		run(suite, "sjson.parse_document", sjson_parse_document);
+
+		run(suite, "matrix4x4.multiply", matrix4x4_multiply);
+		run(suite, "matrix4x4.invert", matrix4x4_invert);
+		run(suite, "matrix4x4.transform", matrix4x4_transform);
+		run(suite, "quaternion.multiply", quaternion_multiply);
+		run(suite, "quaternion.lerp", quaternion_lerp);
+		run(suite, "quaternion.from_matrix", quaternion_from_matrix);
+
+		run(suite, "intersection.ray_sphere", ray_sphere);
+		run(suite, "intersection.ray_aabb", ray_aabb);
+		run(suite, "intersection.ray_obb", ray_obb);
+		run(suite, "intersection.ray_triangle", ray_triangle);
+		run(suite, "intersection.frustum_sphere", frustum_sphere);
+		run(suite, "intersection.frustum_box", frustum_box);
+		{
+			Shapes* shapes = CE_NEW(default_allocator(), Shapes)();
+			run(suite, "intersection.ray_sphere_256", ray_sphere_loop, shapes);
+			run(suite, "intersection.ray_sphere_256_batch", ray_sphere_batch, shapes);
+			run(suite, "intersection.frustum_box_256", frustum_box_loop, shapes);
+			run(suite, "intersection.frustum_box_256_batch", frustum_box_batch, shapes);
+			CE_DELETE(default_allocator(), shapes);
+		}
+
+		{
+			using namespace skinny::expression_language;
+			const char* variables[] = { "speed", "blend" };
+			const char* constants[] = { "PI" };
+			const f32 constant_values[] = { PI };
+
+			Expression e;
+			e.variables[1] = 0.5f;
+			compile("speed * blend + sin(speed * PI) * max(blend, 0.25)"
+				, countof(variables)
+				, variables
+				, countof(constants)
+				, constants
+				, constant_values
+				, e.byte_code
+				, countof(e.byte_code)
+				);
+			run(suite, "expression_language.run", expression_run, &e);
+
+			for (u32 i = 0; i < Expression::NUM; ++i)
+			{
+				e.variables_soa[i] = f32(i);
+				e.variables_soa[Expression::NUM + i] = 0.5f;
+			}
+			run(suite, "expression_language.run_256", expression_run_loop, &e);
+			run(suite, "expression_language.run_256_batch", expression_run_batch, &e);
+		}
+
+		if (json_path != NULL)
+			write_json(suite, json_path);
+	}
+	memory_globals::shutdown();
+
+	return EXIT_SUCCESS;
+}
+
+} // namespace crown
+
+#endif // CROWN_BUILD_BENCHMARKS
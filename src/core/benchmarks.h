@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+namespace crown
+{
+	/// Runs the benchmarks whose name contains @a filter, or all of them if
+	/// @a filter is NULL, and prints the results. The results are also
+	/// written as JSON to the file at @a json_path if it is not NULL.
+	int main_benchmarks(const char* filter, const char* json_path);
+
+} // namespace crown
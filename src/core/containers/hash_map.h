@@ -44,6 +44,12 @@ namespace hash_map
 	/// Calls destructor on the items.
 	template <typename TKey, typename TValue, typename Hash> void clear(HashMap<TKey, TValue, Hash>& m);
 
+	/// Grows the map @a m so that it can hold @a size items without rehashing.
+	template <typename TKey, typename TValue, typename Hash> void reserve(HashMap<TKey, TValue, Hash>& m, u32 size);
+
+	/// Shrinks the map @a m to the smallest capacity which can hold its items.
+	template <typename TKey, typename TValue, typename Hash> void shrink_to_fit(HashMap<TKey, TValue, Hash>& m);
+
 } // namespace hash_map
 
 namespace hash_map_internal
@@ -265,6 +271,28 @@ namespace hash_map
 		m._size = 0;
 	}
 
+	template <typename TKey, typename TValue, typename Hash>
+	void reserve(HashMap<TKey, TValue, Hash>& m, u32 size)
+	{
+		u32 new_capacity = (m._capacity == 0 ? 16 : m._capacity);
+		while (size >= new_capacity * 0.9f)
+			new_capacity *= 2;
+
+		if (new_capacity != m._capacity)
+			hash_map_internal::rehash(m, new_capacity);
+	}
+
+	template <typename TKey, typename TValue, typename Hash>
+	void shrink_to_fit(HashMap<TKey, TValue, Hash>& m)
+	{
+		u32 new_capacity = 16;
+		while (m._size >= new_capacity * 0.9f)
+			new_capacity *= 2;
+
+		if (new_capacity < m._capacity)
+			hash_map_internal::rehash(m, new_capacity);
+	}
+
 } // namespace hash_map
 
 template <typename TKey, typename TValue, typename Hash>
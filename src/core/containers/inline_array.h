@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/array.h"
+#include "core/memory/inline_allocator.h"
+#include "core/memory/memory.h"
+
+namespace crown
+{
+/// Array of POD items which stores up to N items inline and allocates
+/// from the backing allocator only when it grows past them. Can be passed
+/// to all the array:: functions.
+///
+/// @note
+/// Copies made with Array<T>'s copy constructor share the inline
+/// allocator and must not outlive the InlineArray.
+///
+/// @ingroup Containers
+template <typename T, u32 N>
+struct InlineArray : private InlineAllocator<N * sizeof(T)>, public Array<T>
+{
+	///
+	InlineArray(Allocator& a = default_allocator())
+		: InlineAllocator<N * sizeof(T)>(a)
+		, Array<T>(static_cast<InlineAllocator<N * sizeof(T)>&>(*this))
+	{
+		array::set_capacity(*this, N);
+	}
+
+	///
+	InlineArray(const InlineArray<T, N>& other)
+		: InlineAllocator<N * sizeof(T)>(*other._backing)
+		, Array<T>(static_cast<InlineAllocator<N * sizeof(T)>&>(*this))
+	{
+		array::set_capacity(*this, N);
+		Array<T>::operator=(other);
+	}
+
+	///
+	InlineArray<T, N>& operator=(const Array<T>& other)
+	{
+		Array<T>::operator=(other);
+		return *this;
+	}
+
+	///
+	InlineArray<T, N>& operator=(const InlineArray<T, N>& other)
+	{
+		Array<T>::operator=(other);
+		return *this;
+	}
+};
+
+} // namespace crown
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/error/error.h"
+#include "core/memory/allocator.h"
+#include "core/platform.h"
+#include "core/thread/atomic.h"
+#include <new>
+
+namespace crown
+{
+/// Bounded lock-free queue of POD items with any number of producer and
+/// consumer threads.
+///
+/// Each cell carries a sequence number which tells whether it is ready to
+/// be written or read at a given position, so producers and consumers only
+/// contend on their own counter (Dmitry Vyukov's bounded MPMC queue).
+///
+/// @ingroup Containers
+template <typename T>
+struct MpmcQueue
+{
+	struct Cell
+	{
+		AtomicU32 sequence;
+		T data;
+	};
+
+	Allocator* _allocator;
+	u32 _mask;
+	Cell* _cells;
+	CE_ALIGN_DECL(CROWN_CACHE_LINE_SIZE, AtomicU32 _tail); ///< Next position to write.
+	CE_ALIGN_DECL(CROWN_CACHE_LINE_SIZE, AtomicU32 _head); ///< Next position to read.
+
+	/// Creates a queue which holds up to @a capacity items.
+	/// @a capacity must be a power of two.
+	MpmcQueue(Allocator& a, u32 capacity);
+
+	///
+	~MpmcQueue();
+
+	///
+	MpmcQueue(const MpmcQueue&) = delete;
+
+	///
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+	/// Appends @a item to the back of the queue.
+	/// Returns false if the queue is full.
+	bool push(const T& item);
+
+	/// Removes the item at the front of the queue and copies it to @a item.
+	/// Returns false if the queue is empty.
+	bool pop(T& item);
+};
+
+template <typename T>
+inline MpmcQueue<T>::MpmcQueue(Allocator& a, u32 capacity)
+	: _allocator(&a)
+	, _mask(capacity - 1)
+	, _cells(NULL)
+	, _tail(0)
+	, _head(0)
+{
+	CE_ASSERT(capacity > 1 && (capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+	_cells = (Cell*)a.allocate(capacity * sizeof(Cell), alignof(Cell));
+	for (u32 i = 0; i < capacity; ++i)
+		new (&_cells[i].sequence) AtomicU32(i);
+}
+
+template <typename T>
+inline MpmcQueue<T>::~MpmcQueue()
+{
+	_allocator->deallocate(_cells);
+}
+
+template <typename T>
+inline bool MpmcQueue<T>::push(const T& item)
+{
+	u32 pos = _tail.load(MemoryOrder::RELAXED);
+	Cell* cell;
+
+	for (;;)
+	{
+		cell = &_cells[pos & _mask];
+		const s32 diff = (s32)(cell->sequence.load(MemoryOrder::ACQUIRE) - pos);
+
+		if (diff == 0)
+		{
+			// The cell is free, try to claim the position
+			if (_tail.compare_exchange(pos, pos + 1, MemoryOrder::RELAXED))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// The cell still holds the item from the previous lap
+			return false;
+		}
+		else
+		{
+			pos = _tail.load(MemoryOrder::RELAXED);
+		}
+	}
+
+	cell->data = item;
+	// The cell is ready to be read
+	cell->sequence.store(pos + 1, MemoryOrder::RELEASE);
+	return true;
+}
+
+template <typename T>
+inline bool MpmcQueue<T>::pop(T& item)
+{
+	u32 pos = _head.load(MemoryOrder::RELAXED);
+	Cell* cell;
+
+	for (;;)
+	{
+		cell = &_cells[pos & _mask];
+		const s32 diff = (s32)(cell->sequence.load(MemoryOrder::ACQUIRE) - (pos + 1));
+
+		if (diff == 0)
+		{
+			// The cell is full, try to claim the position
+			if (_head.compare_exchange(pos, pos + 1, MemoryOrder::RELAXED))
+				break;
+		}
+		else if (diff < 0)
+		{
+			// The cell has not been written yet
+			return false;
+		}
+		else
+		{
+			pos = _head.load(MemoryOrder::RELAXED);
+		}
+	}
+
+	item = cell->data;
+	// The cell is ready to be written in the next lap
+	cell->sequence.store(pos + _mask + 1, MemoryOrder::RELEASE);
+	return true;
+}
+
+} // namespace crown
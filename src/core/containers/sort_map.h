@@ -32,8 +32,17 @@ namespace sort_map
 	/// Sorts the keys in the map.
 	template <typename TKey, typename TValue, typename Compare> void sort(SortMap<TKey, TValue, Compare>& m);
 
+	/// Sets the @a val for the @a key, inserting the key at its sorted
+	/// position if it does not exist.
 	template <typename TKey, typename TValue, typename Compare> void set(SortMap<TKey, TValue, Compare>& m, const TKey& key, const TValue& val);
 
+	/// Sets the @a num values @a vals for the @a keys. The new keys are
+	/// sorted once and merged with the existing ones, which is faster than
+	/// calling set() for each key when inserting many keys at once.
+	/// @note
+	/// The @a keys must be unique.
+	template <typename TKey, typename TValue, typename Compare> void set(SortMap<TKey, TValue, Compare>& m, const TKey* keys, const TValue* vals, u32 num);
+
 	/// Removes the @a key from the map if it exists.
 	template <typename TKey, typename TValue, typename Compare> void remove(SortMap<TKey, TValue, Compare>& m, const TKey& key);
 
@@ -74,20 +83,26 @@ namespace sort_map_internal
 		Compare comp;
 	};
 
+	/// Returns the index of the first item whose key is not less than @a key.
 	template <typename TKey, typename TValue, typename Compare>
-	inline FindResult find(const SortMap<TKey, TValue, Compare>& m, const TKey& key)
+	inline u32 lower_bound(const SortMap<TKey, TValue, Compare>& m, const TKey& key)
 	{
-		CE_ASSERT(m._is_sorted, "Map not sorted");
-
-		FindResult result;
-		result.item_i = END_OF_LIST;
-
 		const typename SortMap<TKey, TValue, Compare>::Entry* first =
 			std::lower_bound(vector::begin(m._data), vector::end(m._data), key,
 			sort_map_internal::CompareEntry<TKey, TValue, Compare>());
 
-		if (first != vector::end(m._data) && !(key < first->first))
-			result.item_i = u32(first - vector::begin(m._data));
+		return u32(first - vector::begin(m._data));
+	}
+
+	template <typename TKey, typename TValue, typename Compare>
+	inline FindResult find(const SortMap<TKey, TValue, Compare>& m, const TKey& key)
+	{
+		FindResult result;
+		result.item_i = END_OF_LIST;
+
+		const u32 i = lower_bound(m, key);
+		if (i != vector::size(m._data) && !(key < m._data[i].first))
+			result.item_i = i;
 
 		return result;
 	}
@@ -130,30 +145,74 @@ namespace sort_map
 	{
 		std::sort(vector::begin(m._data), vector::end(m._data),
 			sort_map_internal::CompareEntry<TKey, TValue, Compare>());
-#if CROWN_DEBUG
-		m._is_sorted = true;
-#endif // CROWN_DEBUG
 	}
 
 	template <typename TKey, typename TValue, typename Compare>
 	inline void set(SortMap<TKey, TValue, Compare>& m, const TKey& key, const TValue& val)
 	{
-		sort_map_internal::FindResult result = sort_map_internal::find(m, key);
+		const u32 i = sort_map_internal::lower_bound(m, key);
 
-		if (result.item_i == sort_map_internal::END_OF_LIST)
+		if (i != vector::size(m._data) && !(key < m._data[i].first))
 		{
-			typename SortMap<TKey, TValue, Compare>::Entry e(*m._data._allocator);
-			e.first = key;
-			e.second = val;
-			vector::push_back(m._data, e);
+			m._data[i].second = val;
+			return;
 		}
-		else
+
+		typename SortMap<TKey, TValue, Compare>::Entry e(*m._data._allocator);
+		e.first = key;
+		e.second = val;
+		vector::push_back(m._data, e);
+
+		// Items are not trivially copyable, shift them one by one
+		for (u32 j = vector::size(m._data) - 1; j > i; --j)
+			m._data[j] = m._data[j - 1];
+		m._data[i] = e;
+	}
+
+	template <typename TKey, typename TValue, typename Compare>
+	inline void set(SortMap<TKey, TValue, Compare>& m, const TKey* keys, const TValue* vals, u32 num)
+	{
+		typedef typename SortMap<TKey, TValue, Compare>::Entry Entry;
+
+		// Update the existing keys and collect the others
+		Vector<Entry> added(*m._data._allocator);
+		for (u32 i = 0; i < num; ++i)
+		{
+			sort_map_internal::FindResult result = sort_map_internal::find(m, keys[i]);
+
+			if (result.item_i != sort_map_internal::END_OF_LIST)
+			{
+				m._data[result.item_i].second = vals[i];
+			}
+			else
+			{
+				Entry e(*m._data._allocator);
+				e.first = keys[i];
+				e.second = vals[i];
+				vector::push_back(added, e);
+			}
+		}
+
+		std::sort(vector::begin(added), vector::end(added),
+			sort_map_internal::CompareEntry<TKey, TValue, Compare>());
+
+		// Merge from the back so that each item is moved at most once
+		const u32 num_items = vector::size(m._data);
+		const u32 num_added = vector::size(added);
+		vector::resize(m._data, num_items + num_added);
+
+		sort_map_internal::CompareEntry<TKey, TValue, Compare> comp;
+		u32 i = num_items;
+		u32 j = num_added;
+		for (u32 w = num_items + num_added; j > 0; --w)
 		{
-			m._data[result.item_i].second = val;
+			CE_ASSERT(j == 1 || comp(added[j - 2], added[j - 1]), "Duplicate keys");
+
+			if (i > 0 && comp(added[j - 1], m._data[i - 1]))
+				m._data[w - 1] = m._data[--i];
+			else
+				m._data[w - 1] = added[--j];
 		}
-#if CROWN_DEBUG
-		m._is_sorted = false;
-#endif // CROWN_DEBUG
 	}
 
 	template <typename TKey, typename TValue, typename Compare>
@@ -164,23 +223,17 @@ namespace sort_map
 		if (result.item_i == sort_map_internal::END_OF_LIST)
 			return;
 
-		if (vector::size(m._data))
-		{
-			m._data[result.item_i] = m._data[vector::size(m._data) - 1];
-			vector::pop_back(m._data);
-		}
-#if CROWN_DEBUG
-		m._is_sorted = false;
-#endif // CROWN_DEBUG
+		// Keep the items sorted
+		const u32 size = vector::size(m._data);
+		for (u32 j = result.item_i; j < size - 1; ++j)
+			m._data[j] = m._data[j + 1];
+		vector::pop_back(m._data);
 	}
 
 	template <typename TKey, typename TValue, typename Compare>
 	inline void clear(SortMap<TKey, TValue, Compare>& m)
 	{
 		vector::clear(m._data);
-#if CROWN_DEBUG
-		m._is_sorted = true;
-#endif // CROWN_DEBUG
 	}
 
 	template <typename TKey, typename TValue, typename Compare>
@@ -200,9 +253,6 @@ namespace sort_map
 template <typename TKey, typename TValue, typename Compare>
 inline SortMap<TKey, TValue, Compare>::SortMap(Allocator& a)
 	: _data(a)
-#if CROWN_DEBUG
-	, _is_sorted(true)
-#endif // CROWN_DEBUG
 {
 }
 
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/error/error.h"
+#include "core/memory/allocator.h"
+#include "core/platform.h"
+#include "core/thread/atomic.h"
+
+namespace crown
+{
+/// Bounded lock-free queue of POD items with exactly one producer thread
+/// and one consumer thread.
+///
+/// @ingroup Containers
+template <typename T>
+struct SpscQueue
+{
+	Allocator* _allocator;
+	u32 _mask;
+	T* _data;
+	CE_ALIGN_DECL(CROWN_CACHE_LINE_SIZE, AtomicU32 _tail); ///< Written by the producer only.
+	u32 _head_cached; ///< Producer's last known _head.
+	CE_ALIGN_DECL(CROWN_CACHE_LINE_SIZE, AtomicU32 _head); ///< Written by the consumer only.
+	u32 _tail_cached; ///< Consumer's last known _tail.
+
+	/// Creates a queue which holds up to @a capacity items.
+	/// @a capacity must be a power of two.
+	SpscQueue(Allocator& a, u32 capacity);
+
+	///
+	~SpscQueue();
+
+	///
+	SpscQueue(const SpscQueue&) = delete;
+
+	///
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	/// Appends @a item to the back of the queue.
+	/// Returns false if the queue is full.
+	/// @note
+	/// Must only be called by the producer thread.
+	bool push(const T& item);
+
+	/// Removes the item at the front of the queue and copies it to @a item.
+	/// Returns false if the queue is empty.
+	/// @note
+	/// Must only be called by the consumer thread.
+	bool pop(T& item);
+
+	/// Returns the number of items in the queue.
+	/// @note
+	/// The result may be out of date by the time it is returned.
+	u32 size();
+};
+
+template <typename T>
+inline SpscQueue<T>::SpscQueue(Allocator& a, u32 capacity)
+	: _allocator(&a)
+	, _mask(capacity - 1)
+	, _data(NULL)
+	, _tail(0)
+	, _head_cached(0)
+	, _head(0)
+	, _tail_cached(0)
+{
+	CE_ASSERT(capacity > 0 && (capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+	_data = (T*)a.allocate(capacity * sizeof(T), alignof(T));
+}
+
+template <typename T>
+inline SpscQueue<T>::~SpscQueue()
+{
+	_allocator->deallocate(_data);
+}
+
+template <typename T>
+inline bool SpscQueue<T>::push(const T& item)
+{
+	const u32 tail = _tail.load(MemoryOrder::RELAXED);
+	if (tail - _head_cached > _mask)
+	{
+		// Only read the consumer's cache line when the queue looks full
+		_head_cached = _head.load(MemoryOrder::ACQUIRE);
+		if (tail - _head_cached > _mask)
+			return false;
+	}
+
+	_data[tail & _mask] = item;
+	_tail.store(tail + 1, MemoryOrder::RELEASE);
+	return true;
+}
+
+template <typename T>
+inline bool SpscQueue<T>::pop(T& item)
+{
+	const u32 head = _head.load(MemoryOrder::RELAXED);
+	if (head == _tail_cached)
+	{
+		// Only read the producer's cache line when the queue looks empty
+		_tail_cached = _tail.load(MemoryOrder::ACQUIRE);
+		if (head == _tail_cached)
+			return false;
+	}
+
+	item = _data[head & _mask];
+	_head.store(head + 1, MemoryOrder::RELEASE);
+	return true;
+}
+
+template <typename T>
+inline u32 SpscQueue<T>::size()
+{
+	return _tail.load(MemoryOrder::ACQUIRE) - _head.load(MemoryOrder::ACQUIRE);
+}
+
+} // namespace crown
@@ -147,8 +147,9 @@ struct HashMap
 /// Vector of sorted items.
 ///
 /// @note
-/// Items are not automatically sorted, you have to call sort_map::sort()
-/// whenever you are done inserting/removing items.
+/// Items are kept sorted by sort_map::set() and sort_map::remove(), which
+/// insert and remove keys in O(n). Use the batched sort_map::set() to
+/// insert many keys at once.
 ///
 /// @ingroup Containers.
 template <typename TKey, typename TValue, typename Compare = less<TKey> >
@@ -159,9 +160,6 @@ struct SortMap
 	typedef PAIR(TKey, TValue) Entry;
 
 	Vector<Entry> _data;
-#if CROWN_DEBUG
-	bool _is_sorted;
-#endif
 
 	SortMap(Allocator& a);
 };
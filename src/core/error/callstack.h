@@ -14,6 +14,16 @@ namespace error
 	/// Fills @a ss with the current call stack.
 	void callstack(StringStream& ss);
 
+	/// Captures up to @a max return addresses of the current call stack into
+	/// @a frames, skipping the @a skip innermost frames, and returns the
+	/// number of addresses captured. Much faster than callstack(ss) since
+	/// symbols are not resolved.
+	u32 callstack(void** frames, u32 max, u32 skip = 0);
+
+	/// Fills @a ss with the call stack of @a num return addresses captured
+	/// by callstack(frames, max, skip).
+	void callstack(StringStream& ss, void* const* frames, u32 num);
+
 } // namespace error
 
 } // namespace crown
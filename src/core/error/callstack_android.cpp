@@ -7,7 +7,10 @@
 
 #if CROWN_PLATFORM_ANDROID
 
+#include "core/error/callstack.h"
 #include "core/strings/string_stream.h"
+#include <stdio.h> // snprintf
+#include <unwind.h>
 
 namespace crown
 {
@@ -18,6 +21,57 @@ namespace error
 		ss << "Not supported";
 	}
 
+	struct UnwindState
+	{
+		void** frames;
+		u32 max;
+		u32 skip;
+		u32 num;
+	};
+
+	static _Unwind_Reason_Code unwind_callback(struct _Unwind_Context* ctx, void* user_data)
+	{
+		UnwindState* us = (UnwindState*)user_data;
+
+		const uintptr_t ip = _Unwind_GetIP(ctx);
+		if (ip == 0)
+			return _URC_END_OF_STACK;
+
+		if (us->skip > 0)
+		{
+			--us->skip;
+			return _URC_NO_REASON;
+		}
+
+		us->frames[us->num++] = (void*)ip;
+		return us->num < us->max ? _URC_NO_REASON : _URC_END_OF_STACK;
+	}
+
+	u32 callstack(void** frames, u32 max, u32 skip)
+	{
+		if (max == 0)
+			return 0;
+
+		// Skip first stack frame (points here)
+		UnwindState us;
+		us.frames = frames;
+		us.max = max;
+		us.skip = 1 + skip;
+		us.num = 0;
+		_Unwind_Backtrace(unwind_callback, &us);
+		return us.num;
+	}
+
+	void callstack(StringStream& ss, void* const* frames, u32 num)
+	{
+		char buf[64];
+		for (u32 i = 0; i < num; ++i)
+		{
+			snprintf(buf, sizeof(buf), "    [%2u] %p\n", i + 1, frames[i]);
+			ss << buf;
+		}
+	}
+
 } // namespace error
 
 } // namespace crown
@@ -7,6 +7,7 @@
 
 #if CROWN_PLATFORM_LINUX && CROWN_COMPILER_GCC
 
+#include "core/error/callstack.h"
 #include "core/strings/string.h"
 #include "core/strings/string_stream.h"
 #include <cxxabi.h>
@@ -14,6 +15,7 @@
 #include <stdlib.h>
 #include <string.h> // strchr
 #include <unistd.h> // getpid
+#include <unwind.h>
 
 namespace crown
 {
@@ -35,14 +37,62 @@ namespace error
 		return "<addr2line missing>";
 	}
 
+	struct UnwindState
+	{
+		void** frames;
+		u32 max;
+		u32 skip;
+		u32 num;
+	};
+
+	static _Unwind_Reason_Code unwind_callback(struct _Unwind_Context* ctx, void* user_data)
+	{
+		UnwindState* us = (UnwindState*)user_data;
+
+		const uintptr_t ip = _Unwind_GetIP(ctx);
+		if (ip == 0)
+			return _URC_END_OF_STACK;
+
+		if (us->skip > 0)
+		{
+			--us->skip;
+			return _URC_NO_REASON;
+		}
+
+		us->frames[us->num++] = (void*)ip;
+		return us->num < us->max ? _URC_NO_REASON : _URC_END_OF_STACK;
+	}
+
+	u32 callstack(void** frames, u32 max, u32 skip)
+	{
+		if (max == 0)
+			return 0;
+
+		// Walk the stack directly instead of going through backtrace(),
+		// which always unwinds all the frames into its own buffer. The
+		// unwind tables are cached by the runtime after the first walk.
+		// Skip first stack frame (points here)
+		UnwindState us;
+		us.frames = frames;
+		us.max = max;
+		us.skip = 1 + skip;
+		us.num = 0;
+		_Unwind_Backtrace(unwind_callback, &us);
+		return us.num;
+	}
+
 	void callstack(StringStream& ss)
 	{
-		void* array[64];
-		int size = backtrace(array, countof(array));
-		char** messages = backtrace_symbols(array, size);
+		void* frames[64];
+		const u32 num = callstack(frames, countof(frames), 1);
+		callstack(ss, frames, num);
+	}
+
+	void callstack(StringStream& ss, void* const* frames, u32 num)
+	{
+		char** messages = backtrace_symbols(frames, num);
 
-		// skip first stack frame (points here)
-		for (int i = 1; i < size && messages != NULL; ++i)
+		for (u32 i = 0; i < num && messages != NULL; ++i)
 		{
 			char* msg = messages[i];
 			char* mangled_name = strchr(msg, '(');
@@ -69,8 +119,8 @@ namespace error
 
 				snprintf(buf
 					, sizeof(buf)
-					, "    [%2d] %s: (%s)+%s in %s\n"
-					, i
+					, "    [%2u] %s: (%s)+%s in %s\n"
+					, i + 1
 					, msg
 					, (demangle_ok == 0 ? real_name : mangled_name)
 					, offset_begin
@@ -81,7 +131,7 @@ namespace error
 			}
 			else
 			{
-				snprintf(buf, sizeof(buf), "    [%2d] %s\n", i, msg);
+				snprintf(buf, sizeof(buf), "    [%2u] %s\n", i + 1, msg);
 			}
 
 			ss << buf;
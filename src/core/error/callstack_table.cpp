@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/callstack.h"
+#include "core/error/callstack_table.h"
+#include "core/error/error.h"
+#include "core/murmur.h"
+#include <stdlib.h> // malloc, realloc, free
+#include <string.h> // memcmp, memcpy, memset
+
+namespace crown
+{
+CallstackTable::CallstackTable()
+	: _entries(NULL)
+	, _num_entries(0)
+	, _entries_capacity(0)
+	, _frames(NULL)
+	, _num_frames(0)
+	, _frames_capacity(0)
+{
+	memset(_buckets, 0xff, sizeof(_buckets));
+}
+
+CallstackTable::~CallstackTable()
+{
+	clear();
+}
+
+u32 CallstackTable::intern(void* const* frames, u32 num)
+{
+	const u32 hash = murmur32(frames, num * sizeof(void*), 0);
+
+	ScopedMutex sm(_mutex);
+
+	u32* bucket = &_buckets[hash % CROWN_CALLSTACK_TABLE_BUCKETS];
+	for (u32 i = *bucket; i != UINT32_MAX; i = _entries[i].next)
+	{
+		const Entry& e = _entries[i];
+		if (e.hash == hash
+			&& e.num_frames == num
+			&& memcmp(&_frames[e.offset], frames, num * sizeof(void*)) == 0
+			)
+			return i;
+	}
+
+	if (_num_entries == _entries_capacity)
+	{
+		_entries_capacity = _entries_capacity == 0 ? 1024 : _entries_capacity * 2;
+		_entries = (Entry*)realloc(_entries, _entries_capacity * sizeof(Entry));
+		CE_ENSURE(_entries != NULL);
+	}
+
+	if (_num_frames + num > _frames_capacity)
+	{
+		while (_num_frames + num > _frames_capacity)
+			_frames_capacity = _frames_capacity == 0 ? 16*1024 : _frames_capacity * 2;
+		_frames = (void**)realloc(_frames, _frames_capacity * sizeof(void*));
+		CE_ENSURE(_frames != NULL);
+	}
+
+	Entry& e = _entries[_num_entries];
+	e.hash = hash;
+	e.next = *bucket;
+	e.offset = _num_frames;
+	e.num_frames = num;
+	memcpy(&_frames[_num_frames], frames, num * sizeof(void*));
+	_num_frames += num;
+
+	*bucket = _num_entries;
+	return _num_entries++;
+}
+
+u32 CallstackTable::capture(u32 skip)
+{
+	void* frames[CROWN_CALLSTACK_MAX_FRAMES];
+	const u32 num = error::callstack(frames, countof(frames), 1 + skip);
+	return intern(frames, num);
+}
+
+u32 CallstackTable::frames(void** frames, u32 max, u32 id)
+{
+	ScopedMutex sm(_mutex);
+	CE_ASSERT(id < _num_entries, "Index out of bounds");
+
+	const Entry& e = _entries[id];
+	const u32 num = e.num_frames < max ? e.num_frames : max;
+	memcpy(frames, &_frames[e.offset], num * sizeof(void*));
+	return num;
+}
+
+void CallstackTable::symbolize(StringStream& ss, u32 id)
+{
+	void* frames[CROWN_CALLSTACK_MAX_FRAMES];
+	const u32 num = this->frames(frames, countof(frames), id);
+	error::callstack(ss, frames, num);
+}
+
+u32 CallstackTable::size()
+{
+	ScopedMutex sm(_mutex);
+	return _num_entries;
+}
+
+void CallstackTable::clear()
+{
+	ScopedMutex sm(_mutex);
+
+	free(_entries);
+	free(_frames);
+	_entries = NULL;
+	_num_entries = 0;
+	_entries_capacity = 0;
+	_frames = NULL;
+	_num_frames = 0;
+	_frames_capacity = 0;
+	memset(_buckets, 0xff, sizeof(_buckets));
+}
+
+} // namespace crown
@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/strings/types.h"
+#include "core/thread/mutex.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Interns the call stacks captured by error::callstack(frames, max, skip).
+///
+/// Each distinct sequence of return addresses is stored once and is
+/// identified by its index, so that profilers can record a u32 per sample
+/// and resolve the symbols only when their data is exported. Memory is
+/// allocated with malloc() so that the table can be used while tracking
+/// the allocations themselves.
+///
+/// @ingroup Error
+struct CallstackTable
+{
+	struct Entry
+	{
+		u32 hash;
+		u32 next;       ///< Next entry in the same bucket, UINT32_MAX if none.
+		u32 offset;     ///< Index of the first frame in _frames.
+		u32 num_frames;
+	};
+
+	Mutex _mutex;
+	u32 _buckets[CROWN_CALLSTACK_TABLE_BUCKETS];
+	Entry* _entries;
+	u32 _num_entries;
+	u32 _entries_capacity;
+	void** _frames;
+	u32 _num_frames;
+	u32 _frames_capacity;
+
+	///
+	CallstackTable();
+
+	///
+	~CallstackTable();
+
+	///
+	CallstackTable(const CallstackTable&) = delete;
+
+	///
+	CallstackTable& operator=(const CallstackTable&) = delete;
+
+	/// Returns the id of the call stack of @a num return addresses
+	/// @a frames, adding it to the table if it is not there yet.
+	u32 intern(void* const* frames, u32 num);
+
+	/// Captures the current call stack, skipping the @a skip innermost
+	/// frames, and returns its id.
+	u32 capture(u32 skip = 0);
+
+	/// Copies up to @a max return addresses of the call stack @a id to
+	/// @a frames and returns the number of addresses copied.
+	u32 frames(void** frames, u32 max, u32 id);
+
+	/// Fills @a ss with the symbols of the call stack @a id.
+	void symbolize(StringStream& ss, u32 id);
+
+	/// Returns the number of call stacks in the table.
+	u32 size();
+
+	/// Removes all the call stacks and frees the memory.
+	void clear();
+};
+
+} // namespace crown
@@ -7,6 +7,7 @@
 
 #if CROWN_PLATFORM_WINDOWS
 
+#include "core/error/callstack.h"
 #include "core/strings/string_stream.h"
 #include <windows.h>
 #include <dbghelp.h>
@@ -108,6 +109,67 @@ namespace error
 		SymCleanup(GetCurrentProcess());
 	}
 
+	u32 callstack(void** frames, u32 max, u32 skip)
+	{
+		// skip first stack frame (points here)
+		return CaptureStackBackTrace(1 + skip, max, frames, NULL);
+	}
+
+	void callstack(StringStream& ss, void* const* frames, u32 num)
+	{
+		SymInitialize(GetCurrentProcess(), NULL, TRUE);
+		SymSetOptions(SYMOPT_LOAD_LINES | SYMOPT_UNDNAME);
+
+		DWORD ldsp = 0;
+		IMAGEHLP_LINE64 line;
+		ZeroMemory(&line, sizeof(IMAGEHLP_LINE64));
+		line.SizeOfStruct = sizeof(IMAGEHLP_LINE64);
+
+		char buf[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(TCHAR)];
+		PSYMBOL_INFO sym = (PSYMBOL_INFO)buf;
+		sym->SizeOfStruct = sizeof(SYMBOL_INFO);
+		sym->MaxNameLen = MAX_SYM_NAME;
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const DWORD64 addr = (DWORD64)frames[i];
+
+			BOOL res = SymGetLineFromAddr64(GetCurrentProcess()
+						, addr
+						, &ldsp
+						, &line
+						);
+			res = res && SymFromAddr(GetCurrentProcess(), addr, 0, sym);
+
+			char msg[512];
+
+			if (res == TRUE)
+			{
+				snprintf(msg
+					, sizeof(msg)
+					, "    [%2u] %s in %s:%d\n"
+					, i + 1
+					, sym->Name
+					, line.FileName
+					, line.LineNumber
+					);
+			}
+			else
+			{
+				snprintf(msg
+					, sizeof(msg)
+					, "    [%2u] 0x%p\n"
+					, i + 1
+					, frames[i]
+					);
+			}
+
+			ss << msg;
+		}
+
+		SymCleanup(GetCurrentProcess());
+	}
+
 } // namespace error
 
 } // namespace crown
@@ -54,6 +54,13 @@ struct File
 
 	/// Forces the previouses write operations to complete.
 	virtual void flush() = 0;
+
+	/// Returns a pointer to the whole content of the file, or NULL if the
+	/// file cannot be accessed in place. The size of the content is
+	/// returned in @a size. The pointer is valid until the file is closed.
+	/// @note
+	/// The cursor position is not affected.
+	virtual const void* map(u32& size) = 0;
 };
 
 } // namespace crown
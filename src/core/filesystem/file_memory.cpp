@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/filesystem/file_memory.h"
+#include <string.h> // memcpy
+
+namespace crown
+{
+FileMemory::FileMemory(const void* data, u32 size)
+	: _data((const char*)data)
+	, _size(size)
+	, _position(0)
+{
+}
+
+void FileMemory::open(const char* /*path*/, FileOpenMode::Enum /*mode*/)
+{
+	CE_FATAL("Memory files cannot be opened");
+}
+
+void FileMemory::close()
+{
+	_data = NULL;
+	_size = 0;
+	_position = 0;
+}
+
+bool FileMemory::is_open()
+{
+	return _data != NULL;
+}
+
+u32 FileMemory::size()
+{
+	return _size;
+}
+
+u32 FileMemory::position()
+{
+	return _position;
+}
+
+bool FileMemory::end_of_file()
+{
+	return _position == _size;
+}
+
+void FileMemory::seek(u32 position)
+{
+	CE_ASSERT(position <= _size, "Position out of bounds");
+	_position = position;
+}
+
+void FileMemory::seek_to_end()
+{
+	_position = _size;
+}
+
+void FileMemory::skip(u32 bytes)
+{
+	CE_ASSERT(_position + bytes <= _size, "Position out of bounds");
+	_position += bytes;
+}
+
+u32 FileMemory::read(void* data, u32 size)
+{
+	CE_ENSURE(NULL != data);
+
+	const u32 num = _size - _position < size ? _size - _position : size;
+	memcpy(data, _data + _position, num);
+	_position += num;
+	return num;
+}
+
+u32 FileMemory::write(const void* /*data*/, u32 /*size*/)
+{
+	CE_FATAL("Memory files are read only!");
+	return 0;
+}
+
+void FileMemory::flush()
+{
+	// Not needed
+}
+
+const void* FileMemory::map(u32& size)
+{
+	size = _size;
+	return _data;
+}
+
+} // namespace crown
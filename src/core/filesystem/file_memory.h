@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/filesystem/file.h"
+
+namespace crown
+{
+/// Read-only file over a region of memory.
+/// The memory is not copied and must outlive the file.
+///
+/// @ingroup Filesystem
+struct FileMemory : public File
+{
+	const char* _data;
+	u32 _size;
+	u32 _position;
+
+	/// Reads from the @a size bytes at @a data.
+	FileMemory(const void* data, u32 size);
+
+	/// Does nothing, use FileMemory::FileMemory().
+	void open(const char* path, FileOpenMode::Enum mode);
+
+	/// @copydoc File::close()
+	void close();
+
+	/// @copydoc File::is_open()
+	bool is_open();
+
+	/// @copydoc File::size()
+	u32 size();
+
+	/// @copydoc File::position()
+	u32 position();
+
+	/// @copydoc File::end_of_file()
+	bool end_of_file();
+
+	/// @copydoc File::seek()
+	void seek(u32 position);
+
+	/// @copydoc File::seek_to_end()
+	void seek_to_end();
+
+	/// @copydoc File::skip()
+	void skip(u32 bytes);
+
+	/// @copydoc File::read()
+	u32 read(void* data, u32 size);
+
+	/// @copydoc File::write()
+	u32 write(const void* data, u32 size);
+
+	/// @copydoc File::flush()
+	void flush();
+
+	/// @copydoc File::map()
+	const void* map(u32& size);
+};
+
+} // namespace crown
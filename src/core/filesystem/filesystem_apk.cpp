@@ -111,6 +111,15 @@ struct FileApk : public File
 	{
 		// Not needed
 	}
+
+	const void* map(u32& size)
+	{
+		CE_ASSERT(is_open(), "File is not open");
+		// Only uncompressed assets can be accessed in place.
+		const void* data = AAsset_getBuffer(_asset);
+		size = data != NULL ? (u32)AAsset_getLength(_asset) : 0;
+		return data;
+	}
 };
 
 FilesystemApk::FilesystemApk(Allocator& a, AAssetManager* asset_manager)
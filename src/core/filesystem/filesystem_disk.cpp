@@ -14,6 +14,7 @@
 #if CROWN_PLATFORM_POSIX
 	#include <stdio.h>
 	#include <errno.h>
+	#include <sys/mman.h>
 #elif CROWN_PLATFORM_WINDOWS
 	#include <tchar.h>
 	#include <windows.h>
@@ -27,8 +28,11 @@ struct FileDisk : public File
 	FILE* _file;
 #elif CROWN_PLATFORM_WINDOWS
 	HANDLE _file;
+	HANDLE _mapping;
 	bool _eof;
 #endif
+	const void* _map;
+	u32 _map_size;
 
 	/// Opens the file located at @a path with the given @a mode.
 	FileDisk()
@@ -36,8 +40,11 @@ struct FileDisk : public File
 		: _file(NULL)
 #elif CROWN_PLATFORM_WINDOWS
 		: _file(INVALID_HANDLE_VALUE)
+		, _mapping(NULL)
 		, _eof(false)
 #endif
+		, _map(NULL)
+		, _map_size(0)
 	{
 	}
 
@@ -64,6 +71,19 @@ struct FileDisk : public File
 
 	void close()
 	{
+		if (_map != NULL)
+		{
+#if CROWN_PLATFORM_POSIX
+			munmap((void*)_map, _map_size);
+#elif CROWN_PLATFORM_WINDOWS
+			UnmapViewOfFile(_map);
+			CloseHandle(_mapping);
+			_mapping = NULL;
+#endif
+			_map = NULL;
+			_map_size = 0;
+		}
+
 		if (is_open())
 		{
 #if CROWN_PLATFORM_POSIX
@@ -230,6 +250,49 @@ struct FileDisk : public File
 #endif
 		CE_UNUSED(err);
 	}
+
+	const void* map(u32& size)
+	{
+		CE_ASSERT(is_open(), "File is not open");
+
+		if (_map == NULL)
+		{
+			const u32 file_size = this->size();
+			if (file_size == 0)
+			{
+				size = 0;
+				return NULL;
+			}
+#if CROWN_PLATFORM_POSIX
+			void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fileno(_file), 0);
+			if (data != MAP_FAILED)
+			{
+				// Mapped files are read front to back
+				madvise(data, file_size, MADV_SEQUENTIAL);
+				_map = data;
+				_map_size = file_size;
+			}
+#elif CROWN_PLATFORM_WINDOWS
+			_mapping = CreateFileMapping(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (_mapping != NULL)
+			{
+				_map = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (_map != NULL)
+				{
+					_map_size = file_size;
+				}
+				else
+				{
+					CloseHandle(_mapping);
+					_mapping = NULL;
+				}
+			}
+#endif
+		}
+
+		size = _map_size;
+		return _map;
+	}
 };
 
 FilesystemDisk::FilesystemDisk(Allocator& a)
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/hash_map.h"
+#include "core/containers/queue.h"
+#include "core/error/error.h"
+#include "core/filesystem/file.h"
+#include "core/filesystem/io_queue.h"
+
+namespace crown
+{
+static s32 thread_proc(void* thiz)
+{
+	return ((IoQueue*)thiz)->run();
+}
+
+IoQueue::IoQueue(Allocator& a, u32 num_threads)
+	: _requests(a)
+	, _completed(a)
+	, _num_threads(num_threads)
+	, _next_id(0)
+	, _exit(false)
+{
+	CE_ASSERT(num_threads > 0 && num_threads <= CROWN_MAX_IO_THREADS
+		, "Invalid number of I/O threads: %u"
+		, num_threads
+		);
+
+	for (u32 i = 0; i < _num_threads; ++i)
+	{
+		_threads[i].set_name("io_queue");
+		_threads[i].set_priority(ThreadPriority::LOW);
+		_threads[i].start(thread_proc, this);
+	}
+}
+
+IoQueue::~IoQueue()
+{
+	_mutex.lock();
+	_exit = true;
+	_requests_condition.broadcast();
+	_mutex.unlock();
+
+	for (u32 i = 0; i < _num_threads; ++i)
+		_threads[i].stop();
+}
+
+u32 IoQueue::read(File& file, u32 offset, void* data, u32 size)
+{
+	IoBuffer buffer;
+	buffer.data = data;
+	buffer.size = size;
+	return read(file, offset, &buffer, 1);
+}
+
+u32 IoQueue::read(File& file, u32 offset, const IoBuffer* buffers, u32 num_buffers)
+{
+	CE_ASSERT(num_buffers <= CROWN_MAX_IO_BUFFERS, "Too many buffers: %u", num_buffers);
+
+	Request req;
+	req.file = &file;
+	req.offset = offset;
+	req.num_buffers = num_buffers;
+	for (u32 i = 0; i < num_buffers; ++i)
+		req.buffers[i] = buffers[i];
+
+	ScopedMutex sm(_mutex);
+	req.id = _next_id++;
+	queue::push_back(_requests, req);
+	_requests_condition.signal();
+	return req.id;
+}
+
+bool IoQueue::poll(u32 id, u32& bytes_read)
+{
+	ScopedMutex sm(_mutex);
+	if (!hash_map::has(_completed, id))
+		return false;
+
+	bytes_read = hash_map::get(_completed, id, 0u);
+	hash_map::remove(_completed, id);
+	return true;
+}
+
+u32 IoQueue::wait(u32 id)
+{
+	ScopedMutex sm(_mutex);
+	while (!hash_map::has(_completed, id))
+		_completed_condition.wait(_mutex);
+
+	const u32 bytes_read = hash_map::get(_completed, id, 0u);
+	hash_map::remove(_completed, id);
+	return bytes_read;
+}
+
+s32 IoQueue::run()
+{
+	while (1)
+	{
+		_mutex.lock();
+		while (queue::empty(_requests) && !_exit)
+			_requests_condition.wait(_mutex);
+
+		if (_exit)
+			break;
+
+		Request req = queue::front(_requests);
+		queue::pop_front(_requests);
+		_mutex.unlock();
+
+		u32 bytes_read = 0;
+		req.file->seek(req.offset);
+		for (u32 i = 0; i < req.num_buffers; ++i)
+		{
+			const u32 num = req.file->read(req.buffers[i].data, req.buffers[i].size);
+			bytes_read += num;
+
+			if (num != req.buffers[i].size)
+				break;
+		}
+
+		_mutex.lock();
+		hash_map::set(_completed, req.id, bytes_read);
+		_completed_condition.broadcast();
+		_mutex.unlock();
+	}
+
+	_mutex.unlock();
+	return 0;
+}
+
+} // namespace crown
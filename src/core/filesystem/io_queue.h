@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/types.h"
+#include "core/filesystem/types.h"
+#include "core/thread/condition_variable.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Destination of a read.
+///
+/// @ingroup Filesystem
+struct IoBuffer
+{
+	void* data;
+	u32 size;
+};
+
+/// Reads files asynchronously in a pool of background threads.
+/// Requests are served in FIFO order and up to one request per thread
+/// is in flight at any given time.
+/// @note
+/// A File must not be used by more than one request at a time, nor by
+/// the caller while a request on it is in flight.
+///
+/// @ingroup Filesystem
+struct IoQueue
+{
+	struct Request
+	{
+		u32 id;
+		File* file;
+		u32 offset;
+		u32 num_buffers;
+		IoBuffer buffers[CROWN_MAX_IO_BUFFERS];
+	};
+
+	Queue<Request> _requests;
+	HashMap<u32, u32> _completed;
+	Thread _threads[CROWN_MAX_IO_THREADS];
+	u32 _num_threads;
+	u32 _next_id;
+	Mutex _mutex;
+	ConditionVariable _requests_condition;
+	ConditionVariable _completed_condition;
+	bool _exit;
+
+	/// Do not call explicitly.
+	s32 run();
+
+	/// Serves requests with @a num_threads threads.
+	IoQueue(Allocator& a, u32 num_threads);
+
+	///
+	~IoQueue();
+
+	///
+	IoQueue(const IoQueue&) = delete;
+
+	///
+	IoQueue& operator=(const IoQueue&) = delete;
+
+	/// Submits a read of @a size bytes from @a file, starting at @a offset,
+	/// into @a data. Returns a handle that can be passed to poll() or wait().
+	u32 read(File& file, u32 offset, void* data, u32 size);
+
+	/// Submits a scatter read from @a file, starting at @a offset: the
+	/// @a num_buffers @a buffers are filled one after the other.
+	/// Returns a handle that can be passed to poll() or wait().
+	u32 read(File& file, u32 offset, const IoBuffer* buffers, u32 num_buffers);
+
+	/// Returns whether the request @a id has completed and, if so, returns
+	/// the number of bytes read in @a bytes_read. A completed request is
+	/// forgotten after it has been reported.
+	bool poll(u32 id, u32& bytes_read);
+
+	/// Blocks until the request @a id has completed and returns the number
+	/// of bytes read.
+	u32 wait(u32 id);
+};
+
+} // namespace crown
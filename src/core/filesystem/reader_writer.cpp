@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/filesystem/reader_writer.h"
+#include "core/memory/memory.h"
+
+namespace crown
+{
+BinaryWriter::BinaryWriter(File& file)
+	: _file(file)
+	, _buffer((char*)default_allocator().allocate(CROWN_BINARY_WRITER_BUFFER_SIZE))
+	, _size(0)
+{
+}
+
+BinaryWriter::~BinaryWriter()
+{
+	flush();
+	default_allocator().deallocate(_buffer);
+}
+
+void BinaryWriter::skip(u32 bytes)
+{
+	flush();
+	_file.skip(bytes);
+}
+
+void BinaryWriter::flush()
+{
+	if (_size > 0)
+		_file.write(_buffer, _size);
+	_size = 0;
+}
+
+void BinaryWriter::write_slow(const void* data, u32 size)
+{
+	flush();
+
+	// Large blocks gain nothing from buffering
+	if (size >= CROWN_BINARY_WRITER_BUFFER_SIZE)
+	{
+		_file.write(data, size);
+		return;
+	}
+
+	memcpy(_buffer, data, size);
+	_size = size;
+}
+
+BinaryReader::BinaryReader(File& file)
+	: _file(file)
+	, _data(NULL)
+	, _offset(0)
+	, _size(0)
+	, _position(0)
+	, _buffer(NULL)
+{
+	u32 size;
+	const void* data = file.map(size);
+	if (data != NULL)
+	{
+		_data = (const char*)data;
+		_size = size;
+		_position = file.position();
+	}
+	else
+	{
+		_buffer = (char*)default_allocator().allocate(CROWN_BINARY_READER_BUFFER_SIZE);
+		_data = _buffer;
+		_offset = file.position();
+	}
+}
+
+BinaryReader::~BinaryReader()
+{
+	if (_buffer != NULL)
+	{
+		_file.seek(position());
+		default_allocator().deallocate(_buffer);
+	}
+	else
+	{
+		_file.seek(_position);
+	}
+}
+
+void BinaryReader::seek(u32 position)
+{
+	if (position >= _offset && position <= _offset + _size)
+	{
+		_position = position - _offset;
+		return;
+	}
+
+	CE_ASSERT(_buffer != NULL, "Position out of bounds");
+	_file.seek(position);
+	_offset = position;
+	_size = 0;
+	_position = 0;
+}
+
+u32 BinaryReader::read_slow(void* data, u32 size)
+{
+	// Consume what is left in the window first
+	const u32 avail = _size - _position;
+	memcpy(data, _data + _position, avail);
+	_position = _size;
+
+	if (_buffer == NULL)
+		return avail;
+
+	// The file position is always at the end of the window
+	char* dst = (char*)data + avail;
+	const u32 rest = size - avail;
+	_offset += _size;
+	_size = 0;
+	_position = 0;
+
+	// Large blocks gain nothing from buffering
+	if (rest >= CROWN_BINARY_READER_BUFFER_SIZE)
+	{
+		const u32 num = _file.read(dst, rest);
+		_offset += num;
+		return avail + num;
+	}
+
+	_size = _file.read(_buffer, CROWN_BINARY_READER_BUFFER_SIZE);
+	const u32 num = rest < _size ? rest : _size;
+	memcpy(dst, _buffer, num);
+	_position = num;
+	return avail + num;
+}
+
+} // namespace crown
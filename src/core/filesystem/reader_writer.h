@@ -5,67 +5,131 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/filesystem/file.h"
 #include "core/types.h"
+#include <string.h> // memcpy
 
 namespace crown
 {
-/// A writer that offers a convenient way to write to a File
+/// A writer that offers a convenient way to write to a File.
+/// Data is collected in a buffer and written to the file in blocks of
+/// CROWN_BINARY_WRITER_BUFFER_SIZE bytes, or when the writer is destroyed.
 ///
 /// @ingroup Filesystem
 struct BinaryWriter
 {
 	File& _file;
+	char* _buffer;
+	u32 _size; ///< Bytes in _buffer not yet written to _file.
 
-	BinaryWriter(File& file)
-		: _file(file)
-	{
-	}
+	///
+	BinaryWriter(File& file);
+
+	/// Writes the buffered data to the file.
+	~BinaryWriter();
 
+	///
+	BinaryWriter(const BinaryWriter&) = delete;
+
+	///
+	BinaryWriter& operator=(const BinaryWriter&) = delete;
+
+	/// Writes @a size bytes of @a data.
 	void write(const void* data, u32 size)
 	{
-		_file.write(data, size);
+		if (_size + size <= CROWN_BINARY_WRITER_BUFFER_SIZE)
+		{
+			memcpy(_buffer + _size, data, size);
+			_size += size;
+			return;
+		}
+
+		write_slow(data, size);
 	}
 
+	/// Writes @a data.
 	template <typename T>
 	void write(const T& data)
 	{
-		_file.write(&data, sizeof(T));
+		write(&data, sizeof(T));
 	}
 
-	void skip(u32 bytes)
-	{
-		_file.skip(bytes);
-	}
+	/// Skips @a bytes in the file.
+	void skip(u32 bytes);
+
+	/// Writes the buffered data to the file.
+	void flush();
+
+	void write_slow(const void* data, u32 size);
 };
 
-/// A reader that offers a convenient way to read from a File
+/// A reader that offers a convenient way to read from a File.
+/// If the file can be mapped, data is read from memory directly. Otherwise
+/// it is read in blocks of CROWN_BINARY_READER_BUFFER_SIZE bytes. In both
+/// cases, reading small values does not call into the File.
+/// The position of the file is unspecified until the reader is destroyed.
 ///
 /// @ingroup Filesystem
 struct BinaryReader
 {
 	File& _file;
+	const char* _data; ///< Window over the content of the file.
+	u32 _offset;       ///< Position in the file of _data[0].
+	u32 _size;         ///< Bytes in the window.
+	u32 _position;     ///< Position in the window.
+	char* _buffer;     ///< Buffer the window points to, or NULL if the file is mapped.
 
-	BinaryReader(File& file)
-		: _file(file)
-	{
-	}
+	///
+	BinaryReader(File& file);
+
+	/// Moves the position of the file to the position of the reader.
+	~BinaryReader();
 
-	void read(void* data, u32 size)
+	///
+	BinaryReader(const BinaryReader&) = delete;
+
+	///
+	BinaryReader& operator=(const BinaryReader&) = delete;
+
+	/// Reads @a size bytes to @a data.
+	/// Returns the number of bytes read.
+	u32 read(void* data, u32 size)
 	{
-		_file.read(data, size);
+		if (_position + size <= _size)
+		{
+			memcpy(data, _data + _position, size);
+			_position += size;
+			return size;
+		}
+
+		return read_slow(data, size);
 	}
 
+	/// Reads @a data.
 	template <typename T>
 	void read(T& data)
 	{
-		_file.read(&data, sizeof(T));
+		read(&data, sizeof(T));
 	}
 
+	/// Skips @a bytes.
 	void skip(u32 bytes)
 	{
-		_file.skip(bytes);
+		seek(position() + bytes);
 	}
+
+	/// Sets the position to @a position bytes from the beginning of the file.
+	void seek(u32 position);
+
+	/// Returns the number of bytes from the beginning of the file to the
+	/// position of the reader.
+	u32 position() const
+	{
+		return _offset + _position;
+	}
+
+	u32 read_slow(void* data, u32 size);
 };
 
 } // namespace crown
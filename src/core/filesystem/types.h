@@ -12,6 +12,7 @@ namespace crown
 struct File;
 struct FileMonitor;
 struct Filesystem;
+struct IoQueue;
 
 /// Enumerates file open modes.
 ///
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/array.h"
+#include "core/json/types.h"
+#include "core/strings/fixed_string.h"
+#include <string.h> // strncmp
+
+namespace crown
+{
+/// Functions to manipulate JsonDocument.
+///
+/// @ingroup JSON
+namespace json_document
+{
+	/// Returns the root node of the document @a jd.
+	inline const JsonNode* root(const JsonDocument& jd)
+	{
+		CE_ASSERT(array::size(jd._nodes) > 0, "Empty document");
+		return array::begin(jd._nodes);
+	}
+
+	/// Returns the first child of @a node or NULL if it has no children.
+	inline const JsonNode* first(const JsonDocument& /*jd*/, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		return node->size > 0 && (node->type == JsonValueType::ARRAY || node->type == JsonValueType::OBJECT) ? node + 1 : NULL;
+	}
+
+	/// Returns the sibling following @a node or NULL if it is the last one.
+	inline const JsonNode* next(const JsonDocument& jd, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		return node->next != 0 ? &jd._nodes[node->next] : NULL;
+	}
+
+	/// Returns the key of the object member @a node.
+	inline FixedString key(const JsonDocument& jd, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		return FixedString(jd._json + node->key_offset, node->key_length);
+	}
+
+	/// Returns a pointer to the source text of the value @a node.
+	inline const char* text(const JsonDocument& jd, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		return jd._json + node->offset;
+	}
+
+	/// Returns the value of the @a key in the @a object or NULL.
+	inline const JsonNode* get(const JsonDocument& jd, const JsonNode* object, const char* key)
+	{
+		CE_ENSURE(NULL != object);
+		CE_ASSERT(object->type == JsonValueType::OBJECT, "Not an object");
+
+		const u32 len = u32(strlen(key));
+		for (const JsonNode* n = first(jd, object); n != NULL; n = next(jd, n))
+		{
+			if (n->key_length == len && strncmp(jd._json + n->key_offset, key, len) == 0)
+				return n;
+		}
+
+		return NULL;
+	}
+
+	/// Returns whether the @a object has the @a key.
+	inline bool has(const JsonDocument& jd, const JsonNode* object, const char* key)
+	{
+		return get(jd, object, key) != NULL;
+	}
+
+} // namespace json_document
+
+inline JsonDocument::JsonDocument(Allocator& a)
+	: _json(NULL)
+	, _nodes(a)
+{
+}
+
+/// Returns the value of the @a key in the root object or NULL.
+inline const JsonNode* JsonDocument::operator[](const char* key) const
+{
+	return json_document::get(*this, json_document::root(*this), key);
+}
+
+} // namespace crown
@@ -4,10 +4,12 @@
  */
 
 #include "core/containers/map.h"
+#include "core/json/json_document.h"
 #include "core/json/sjson.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
+#include <stdlib.h> // strtod
 
 namespace crown
 {
@@ -373,6 +375,27 @@ namespace sjson
 		CE_FATAL("Bad object");
 	}
 
+	const char* parse_object_member(const char* json, DynamicString& key, const char*& value)
+	{
+		CE_ENSURE(NULL != json);
+
+		json = skip_spaces(json);
+		if (*json == '{')
+			json = skip_spaces(++json);
+
+		if (*json == '}' || *json == '\0')
+			return NULL;
+
+		key = "";
+		json = parse_key(json, key);
+		json = skip_spaces(json);
+		json = next(json, (*json == '=') ? '=' : ':');
+		json = skip_spaces(json);
+
+		value = json;
+		return skip_value(json);
+	}
+
 	void parse(const char* json, JsonObject& object)
 	{
 		CE_ENSURE(NULL != json);
@@ -392,6 +415,153 @@ namespace sjson
 		parse(array::begin(json), object);
 	}
 
+	static u32 add_node(JsonDocument& jd, JsonValueType::Enum type, const char* json, const char* key, u32 key_length)
+	{
+		JsonNode node;
+		node.number = 0.0;
+		node.type = type;
+		node.offset = u32(json - jd._json);
+		node.size = 0;
+		node.next = 0;
+		node.key_offset = key != NULL ? u32(key - jd._json) : 0;
+		node.key_length = key_length;
+		array::push_back(jd._nodes, node);
+		return array::size(jd._nodes) - 1;
+	}
+
+	static const char* parse_node(const char* json, JsonDocument& jd, const char* key, u32 key_length);
+
+	// Parses the members of the object @a parent until @a end is found.
+	// @a end is '\0' for root objects without braces.
+	static const char* parse_members(const char* json, JsonDocument& jd, u32 parent, char end)
+	{
+		u32 prev = 0;
+
+		while (true)
+		{
+			json = skip_spaces(json);
+
+			if (*json == end)
+				return end != '\0' ? json + 1 : json;
+
+			CE_ASSERT(*json != '\0', "Bad object");
+
+			const char* key_begin = json;
+			const char* key_end = json;
+			if (*json == '"')
+			{
+				++key_begin;
+				json = skip_string(json);
+				key_end = json - 1;
+			}
+			else
+			{
+				while (*json != '\0' && !isspace(*json) && *json != '=' && *json != ':')
+					++json;
+				key_end = json;
+			}
+
+			json = skip_spaces(json);
+			json = next(json, (*json == '=') ? '=' : ':');
+			json = skip_spaces(json);
+
+			const u32 child = array::size(jd._nodes);
+			json = parse_node(json, jd, key_begin, u32(key_end - key_begin));
+
+			if (prev != 0)
+				jd._nodes[prev].next = child;
+			prev = child;
+			++jd._nodes[parent].size;
+		}
+	}
+
+	static const char* parse_items(const char* json, JsonDocument& jd, u32 parent)
+	{
+		u32 prev = 0;
+
+		while (true)
+		{
+			json = skip_spaces(json);
+
+			if (*json == ']')
+				return json + 1;
+
+			CE_ASSERT(*json != '\0', "Bad array");
+
+			const u32 child = array::size(jd._nodes);
+			json = parse_node(json, jd, NULL, 0);
+
+			if (prev != 0)
+				jd._nodes[prev].next = child;
+			prev = child;
+			++jd._nodes[parent].size;
+		}
+	}
+
+	static const char* parse_node(const char* json, JsonDocument& jd, const char* key, u32 key_length)
+	{
+		CE_ENSURE(NULL != json);
+
+		switch (*json)
+		{
+		case '{':
+			return parse_members(json + 1, jd, add_node(jd, JsonValueType::OBJECT, json, key, key_length), '}');
+
+		case '[':
+			return parse_items(json + 1, jd, add_node(jd, JsonValueType::ARRAY, json, key, key_length));
+
+		case '"':
+			{
+				const u32 i = add_node(jd, JsonValueType::STRING, json, key, key_length);
+				const char* end = skip_value(json);
+				// Length of the raw text between the quotes
+				const bool verbatim = json[1] == '"' && json[2] == '"';
+				jd._nodes[i].size = u32(end - json) - (verbatim ? 6 : 2);
+				return end;
+			}
+
+		case 't':
+		case 'f':
+			jd._nodes[add_node(jd, JsonValueType::BOOL, json, key, key_length)].number = parse_bool(json) ? 1.0 : 0.0;
+			return skip_value(json);
+
+		case 'n':
+			add_node(jd, JsonValueType::NIL, json, key, key_length);
+			return skip_value(json);
+
+		default:
+			{
+				const u32 i = add_node(jd, JsonValueType::NUMBER, json, key, key_length);
+				char* end;
+				jd._nodes[i].number = strtod(json, &end);
+				CE_ASSERT(end != json, "Bad number");
+				return end;
+			}
+		}
+	}
+
+	void parse(const char* json, JsonDocument& jd)
+	{
+		CE_ENSURE(NULL != json);
+
+		jd._json = json;
+		array::clear(jd._nodes);
+
+		json = skip_spaces(json);
+
+		if (*json == '{')
+			parse_node(json, jd, NULL, 0);
+		else
+			parse_members(json, jd, add_node(jd, JsonValueType::OBJECT, json, NULL, 0), '\0');
+	}
+
+	void parse(Buffer& json, JsonDocument& jd)
+	{
+		array::push_back(json, '\0');
+		array::pop_back(json);
+		parse(array::begin(json), jd);
+	}
+
 } // namespace sjson
 
 namespace sjson
@@ -518,4 +688,126 @@ namespace sjson
 
 } // namespace json
 
+namespace sjson
+{
+	s32 parse_int(const JsonDocument& /*jd*/, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		CE_ASSERT(node->type == JsonValueType::NUMBER, "Not a number");
+		return s32(node->number);
+	}
+
+	f32 parse_float(const JsonDocument& /*jd*/, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		CE_ASSERT(node->type == JsonValueType::NUMBER, "Not a number");
+		return f32(node->number);
+	}
+
+	bool parse_bool(const JsonDocument& /*jd*/, const JsonNode* node)
+	{
+		CE_ENSURE(NULL != node);
+		CE_ASSERT(node->type == JsonValueType::BOOL, "Not a boolean");
+		return node->number != 0.0;
+	}
+
+	void parse_string(const JsonDocument& jd, const JsonNode* node, DynamicString& string)
+	{
+		CE_ENSURE(NULL != node);
+		CE_ASSERT(node->type == JsonValueType::STRING, "Not a string");
+		parse_string(json_document::text(jd, node), string);
+	}
+
+	// Reads @a num numbers from the items of the array @a node.
+	static void parse_floats(const JsonDocument& jd, const JsonNode* node, f32* floats, u32 num)
+	{
+		CE_ENSURE(NULL != node);
+		CE_ASSERT(node->type == JsonValueType::ARRAY, "Not an array");
+		CE_ASSERT(node->size >= num, "Not enough items");
+
+		const JsonNode* item = json_document::first(jd, node);
+		for (u32 i = 0; i < num; ++i, item = json_document::next(jd, item))
+			floats[i] = parse_float(jd, item);
+	}
+
+	Vector2 parse_vector2(const JsonDocument& jd, const JsonNode* node)
+	{
+		f32 f[2];
+		parse_floats(jd, node, f, countof(f));
+		Vector2 v;
+		v.x = f[0];
+		v.y = f[1];
+		return v;
+	}
+
+	Vector3 parse_vector3(const JsonDocument& jd, const JsonNode* node)
+	{
+		f32 f[3];
+		parse_floats(jd, node, f, countof(f));
+		Vector3 v;
+		v.x = f[0];
+		v.y = f[1];
+		v.z = f[2];
+		return v;
+	}
+
+	Vector4 parse_vector4(const JsonDocument& jd, const JsonNode* node)
+	{
+		f32 f[4];
+		parse_floats(jd, node, f, countof(f));
+		Vector4 v;
+		v.x = f[0];
+		v.y = f[1];
+		v.z = f[2];
+		v.w = f[3];
+		return v;
+	}
+
+	Quaternion parse_quaternion(const JsonDocument& jd, const JsonNode* node)
+	{
+		f32 f[4];
+		parse_floats(jd, node, f, countof(f));
+		Quaternion q;
+		q.x = f[0];
+		q.y = f[1];
+		q.z = f[2];
+		q.w = f[3];
+		return q;
+	}
+
+	Matrix4x4 parse_matrix4x4(const JsonDocument& jd, const JsonNode* node)
+	{
+		f32 f[16];
+		parse_floats(jd, node, f, countof(f));
+		Matrix4x4 m;
+		memcpy(&m, f, sizeof(m));
+		return m;
+	}
+
+	StringId32 parse_string_id(const JsonDocument& jd, const JsonNode* node)
+	{
+		TempAllocator256 ta;
+		DynamicString str(ta);
+		parse_string(jd, node, str);
+		return str.to_string_id();
+	}
+
+	ResourceId parse_resource_id(const JsonDocument& jd, const JsonNode* node)
+	{
+		TempAllocator256 ta;
+		DynamicString str(ta);
+		parse_string(jd, node, str);
+		return ResourceId(str.c_str());
+	}
+
+	Guid parse_guid(const JsonDocument& jd, const JsonNode* node)
+	{
+		TempAllocator64 ta;
+		DynamicString str(ta);
+		parse_string(jd, node, str);
+		return guid::parse(str.c_str());
+	}
+
+} // namespace sjson
+
 } // namespace crown
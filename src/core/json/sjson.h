@@ -40,12 +40,29 @@ namespace sjson
 	/// key to pointer to the corresponding value into the original string @a json.
 	void parse_object(const char* json, JsonObject& object);
 
+	/// Parses the next member of the SJSON object @a json without building a
+	/// JsonObject, so that objects with many members can be processed one
+	/// member at a time. @a json must point to the object itself on the first
+	/// call and to the pointer returned by the previous call afterwards.
+	/// Puts the key of the member into @a key and makes @a value point to its
+	/// value into the original string. Returns NULL when there are no more
+	/// members.
+	const char* parse_object_member(const char* json, DynamicString& key, const char*& value);
+
 	/// Parses the SJSON-encoded @a json.
 	void parse(const char* json, JsonObject& object);
 
 	/// Parses the SJSON-encoded @a json.
 	void parse(Buffer& json, JsonObject& object);
 
+	/// Parses the SJSON-encoded @a json into the document @a jd in a single
+	/// pass. The document references @a json, which must outlive it.
+	void parse(const char* json, JsonDocument& jd);
+
+	/// Parses the SJSON-encoded @a json into the document @a jd in a single
+	/// pass. The document references @a json, which must outlive it.
+	void parse(Buffer& json, JsonDocument& jd);
+
 } // namespace sjson
 
 namespace sjson
@@ -84,4 +101,44 @@ namespace sjson
 
 } // namespace sjson
 
+namespace sjson
+{
+	/// Returns the number @a node of the document @a jd as int.
+	s32 parse_int(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the number @a node of the document @a jd as f32.
+	f32 parse_float(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the boolean @a node of the document @a jd as bool.
+	bool parse_bool(const JsonDocument& jd, const JsonNode* node);
+
+	/// Parses the string @a node of the document @a jd and puts it into @a string.
+	void parse_string(const JsonDocument& jd, const JsonNode* node, DynamicString& string);
+
+	/// Returns the array @a node of the document @a jd as Vector2.
+	Vector2 parse_vector2(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the array @a node of the document @a jd as Vector3.
+	Vector3 parse_vector3(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the array @a node of the document @a jd as Vector4.
+	Vector4 parse_vector4(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the array @a node of the document @a jd as Quaternion.
+	Quaternion parse_quaternion(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the array @a node of the document @a jd as Matrix4x4.
+	Matrix4x4 parse_matrix4x4(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the string @a node of the document @a jd as StringId32.
+	StringId32 parse_string_id(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the string @a node of the document @a jd as ResourceId.
+	ResourceId parse_resource_id(const JsonDocument& jd, const JsonNode* node);
+
+	/// Returns the string @a node of the document @a jd as Guid.
+	Guid parse_guid(const JsonDocument& jd, const JsonNode* node);
+
+} // namespace sjson
+
 } // namespace crown
@@ -46,4 +46,35 @@ struct JsonObject
 	const char* operator[](const FixedString& key) const;
 };
 
+/// Node of a JsonDocument.
+///
+/// @ingroup JSON
+struct JsonNode
+{
+	f64 number;      ///< Value of numbers and booleans.
+	u32 type;        ///< JsonValueType::Enum.
+	u32 offset;      ///< Offset of the value in the source text.
+	u32 size;        ///< Number of items of arrays and objects, length of strings.
+	u32 next;        ///< Index of the next sibling, or 0 if this is the last one.
+	u32 key_offset;  ///< Offset of the key in the source text, members of objects only.
+	u32 key_length;  ///< Length of the key, members of objects only.
+};
+
+/// Tree of nodes built by parsing SJSON in a single pass.
+/// Nodes are stored in depth-first order: the first child of a node, if
+/// any, immediately follows it. Numbers and booleans are parsed upfront,
+/// strings, keys and verbatim values point back into the source text,
+/// which must outlive the document.
+///
+/// @ingroup JSON
+struct JsonDocument
+{
+	const char* _json;
+	Array<JsonNode> _nodes;
+
+	JsonDocument(Allocator& a);
+
+	const JsonNode* operator[](const char* key) const;
+};
+
 } // namespace crown
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/lz4.h"
+#include <string.h> // memcpy, memset
+
+#define LZ4_MIN_MATCH    4
+#define LZ4_LAST_LITERALS 5  // The last bytes of a block are always literals
+#define LZ4_MF_LIMIT     12 // The last match must start before this many bytes from the end
+#define LZ4_MAX_OFFSET   65535
+#define LZ4_HASH_LOG     12
+
+namespace crown
+{
+namespace lz4
+{
+	static inline u32 read32(const u8* p)
+	{
+		u32 v;
+		memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	static inline u32 hash(u32 sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+	}
+
+	static inline u8* write_length(u8* op, u32 len)
+	{
+		for (; len >= 255; len -= 255)
+			*op++ = 255;
+		*op++ = u8(len);
+		return op;
+	}
+
+	static inline u8* write_sequence(u8* op, const u8* oend, const u8* literals, u32 num_literals, u32 offset, u32 match_len)
+	{
+		// Token + literals length + literals + offset + match length
+		if (op + 1 + num_literals/255 + 1 + num_literals + 2 + match_len/255 + 1 > oend)
+			return NULL;
+
+		u8* token = op++;
+		*token = u8((num_literals < 15 ? num_literals : 15) << 4);
+		if (num_literals >= 15)
+			op = write_length(op, num_literals - 15);
+
+		memcpy(op, literals, num_literals);
+		op += num_literals;
+
+		if (match_len == 0) // Last literals
+			return op;
+
+		*op++ = u8(offset);
+		*op++ = u8(offset >> 8);
+
+		match_len -= LZ4_MIN_MATCH;
+		*token |= u8(match_len < 15 ? match_len : 15);
+		if (match_len >= 15)
+			op = write_length(op, match_len - 15);
+
+		return op;
+	}
+
+	u32 compress_bound(u32 size)
+	{
+		return size + size/255 + 16;
+	}
+
+	u32 compress(const void* src, u32 size, void* dst, u32 capacity)
+	{
+		const u8* base   = (const u8*)src;
+		const u8* ip     = base;
+		const u8* anchor = base;
+		const u8* iend   = base + size;
+		u8* op           = (u8*)dst;
+		const u8* oend   = op + capacity;
+
+		if (size > LZ4_MF_LIMIT)
+		{
+			u32 table[1 << LZ4_HASH_LOG];
+			memset(table, 0, sizeof(table));
+
+			const u8* mflimit    = iend - LZ4_MF_LIMIT;
+			const u8* matchlimit = iend - LZ4_LAST_LITERALS;
+
+			while (ip < mflimit)
+			{
+				const u32 sequence = read32(ip);
+				const u32 h = hash(sequence);
+				const u8* ref = base + table[h];
+				table[h] = u32(ip - base);
+
+				if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read32(ref) != sequence)
+				{
+					++ip;
+					continue;
+				}
+
+				u32 match_len = LZ4_MIN_MATCH;
+				while (ip + match_len < matchlimit && ref[match_len] == ip[match_len])
+					++match_len;
+
+				op = write_sequence(op, oend, anchor, u32(ip - anchor), u32(ip - ref), match_len);
+				if (op == NULL)
+					return 0;
+
+				ip += match_len;
+				anchor = ip;
+			}
+		}
+
+		op = write_sequence(op, oend, anchor, u32(iend - anchor), 0, 0);
+		return op != NULL ? u32(op - (u8*)dst) : 0;
+	}
+
+	bool decompress(const void* src, u32 size, void* dst, u32 dst_size)
+	{
+		const u8* ip   = (const u8*)src;
+		const u8* iend = ip + size;
+		u8* op         = (u8*)dst;
+		u8* ostart     = op;
+		const u8* oend = op + dst_size;
+
+		while (ip < iend)
+		{
+			const u32 token = *ip++;
+
+			// Copy literals
+			u32 num_literals = token >> 4;
+			if (num_literals == 15)
+			{
+				u32 b;
+				do
+				{
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					num_literals += b;
+				}
+				while (b == 255);
+			}
+
+			if (num_literals > u32(iend - ip) || num_literals > u32(oend - op))
+				return false;
+
+			memcpy(op, ip, num_literals);
+			ip += num_literals;
+			op += num_literals;
+
+			if (ip == iend) // Last literals
+				break;
+
+			// Copy match
+			if (iend - ip < 2)
+				return false;
+
+			const u32 offset = u32(ip[0]) | (u32(ip[1]) << 8);
+			ip += 2;
+			if (offset == 0 || offset > u32(op - ostart))
+				return false;
+
+			u32 match_len = token & 15;
+			if (match_len == 15)
+			{
+				u32 b;
+				do
+				{
+					if (ip >= iend)
+						return false;
+					b = *ip++;
+					match_len += b;
+				}
+				while (b == 255);
+			}
+			match_len += LZ4_MIN_MATCH;
+
+			if (match_len > u32(oend - op))
+				return false;
+
+			// Matches may overlap the data being written
+			const u8* ref = op - offset;
+			for (u32 i = 0; i < match_len; ++i)
+				op[i] = ref[i];
+			op += match_len;
+		}
+
+		return op == oend;
+	}
+
+} // namespace lz4
+
+} // namespace crown
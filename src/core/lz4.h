@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Functions to compress and decompress data in the LZ4 block format.
+///
+/// @ingroup Core
+namespace lz4
+{
+	/// Returns the maximum size of @a size bytes of data once compressed.
+	u32 compress_bound(u32 size);
+
+	/// Compresses @a size bytes from @a src into @a dst, which can hold
+	/// up to @a capacity bytes.
+	/// Returns the size of the compressed data or 0 if it does not fit
+	/// in @a dst.
+	u32 compress(const void* src, u32 size, void* dst, u32 capacity);
+
+	/// Decompresses @a size bytes from @a src into @a dst, which must hold
+	/// exactly @a dst_size bytes once decompressed.
+	/// Returns whether the compressed data is well-formed.
+	bool decompress(const void* src, u32 size, void* dst, u32 dst_size);
+
+} // namespace lz4
+
+} // namespace crown
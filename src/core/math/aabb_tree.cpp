@@ -0,0 +1,467 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/math/aabb_tree.h"
+#include "core/math/intersection.h"
+#include "core/math/vector3.h"
+
+namespace crown
+{
+// Maximum depth of the traversal stack. The tree is balanced, so this
+// is never reached in practice.
+#define AABB_TREE_STACK_SIZE 128
+
+static inline bool is_leaf(const AABBTree::Node& n)
+{
+	return n.left == UINT32_MAX;
+}
+
+static inline AABB merge(const AABB& a, const AABB& b)
+{
+	AABB r;
+	r.min = min(a.min, b.min);
+	r.max = max(a.max, b.max);
+	return r;
+}
+
+static inline f32 surface_area(const AABB& b)
+{
+	const Vector3 d = b.max - b.min;
+	return 2.0f * (d.x*d.y + d.y*d.z + d.z*d.x);
+}
+
+static inline bool contains(const AABB& a, const AABB& b)
+{
+	return a.min.x <= b.min.x
+		&& a.min.y <= b.min.y
+		&& a.min.z <= b.min.z
+		&& a.max.x >= b.max.x
+		&& a.max.y >= b.max.y
+		&& a.max.z >= b.max.z
+		;
+}
+
+static inline bool overlaps(const AABB& a, const AABB& b)
+{
+	return a.min.x <= b.max.x
+		&& a.min.y <= b.max.y
+		&& a.min.z <= b.max.z
+		&& a.max.x >= b.min.x
+		&& a.max.y >= b.min.y
+		&& a.max.z >= b.min.z
+		;
+}
+
+template <typename Test>
+static void query(AABBTree& t, Test& test, Array<u32>& user_data)
+{
+	if (t._root == UINT32_MAX)
+		return;
+
+	u32 stack[AABB_TREE_STACK_SIZE];
+	u32 num = 0;
+	stack[num++] = t._root;
+
+	while (num > 0)
+	{
+		const AABBTree::Node& n = t._nodes[stack[--num]];
+
+		if (!test(n.aabb))
+			continue;
+
+		if (is_leaf(n))
+		{
+			array::push_back(user_data, n.user_data);
+		}
+		else
+		{
+			CE_ASSERT(num + 2 <= AABB_TREE_STACK_SIZE, "Stack overflow");
+			stack[num++] = n.left;
+			stack[num++] = n.right;
+		}
+	}
+}
+
+struct AABBTest
+{
+	const AABB& box;
+	AABBTest(const AABB& b) : box(b) {}
+	bool operator()(const AABB& b) { return overlaps(box, b); }
+};
+
+struct FrustumTest
+{
+	const Frustum& frustum;
+	FrustumTest(const Frustum& f) : frustum(f) {}
+	bool operator()(const AABB& b) { return frustum_box_intersection(frustum, b); }
+};
+
+struct RayTest
+{
+	const Vector3& from;
+	const Vector3& dir;
+	f32 max_distance;
+	RayTest(const Vector3& f, const Vector3& d, f32 md) : from(f), dir(d), max_distance(md) {}
+	bool operator()(const AABB& b)
+	{
+		const f32 t = ray_aabb_intersection(from, dir, b);
+		return t != -1.0f && t <= max_distance;
+	}
+};
+
+AABBTree::AABBTree(Allocator& a, f32 margin)
+	: _nodes(a)
+	, _root(UINT32_MAX)
+	, _free_list(UINT32_MAX)
+	, _margin(margin)
+{
+}
+
+u32 AABBTree::create(const AABB& b, u32 user_data)
+{
+	const u32 leaf = allocate_node();
+	const Vector3 margin = vector3(_margin, _margin, _margin);
+
+	Node& n = _nodes[leaf];
+	n.aabb.min  = b.min - margin;
+	n.aabb.max  = b.max + margin;
+	n.user_data = user_data;
+	n.height    = 0;
+
+	insert_leaf(leaf);
+	return leaf;
+}
+
+void AABBTree::destroy(u32 leaf)
+{
+	CE_ASSERT(leaf < array::size(_nodes), "Index out of bounds");
+	CE_ASSERT(is_leaf(_nodes[leaf]), "Node is not a leaf");
+
+	remove_leaf(leaf);
+	free_node(leaf);
+}
+
+bool AABBTree::move(u32 leaf, const AABB& b)
+{
+	CE_ASSERT(leaf < array::size(_nodes), "Index out of bounds");
+	CE_ASSERT(is_leaf(_nodes[leaf]), "Node is not a leaf");
+
+	if (contains(_nodes[leaf].aabb, b))
+		return false;
+
+	remove_leaf(leaf);
+
+	const Vector3 margin = vector3(_margin, _margin, _margin);
+	_nodes[leaf].aabb.min = b.min - margin;
+	_nodes[leaf].aabb.max = b.max + margin;
+
+	insert_leaf(leaf);
+	return true;
+}
+
+u32 AABBTree::user_data(u32 leaf)
+{
+	CE_ASSERT(leaf < array::size(_nodes), "Index out of bounds");
+	return _nodes[leaf].user_data;
+}
+
+void AABBTree::set_user_data(u32 leaf, u32 user_data)
+{
+	CE_ASSERT(leaf < array::size(_nodes), "Index out of bounds");
+	_nodes[leaf].user_data = user_data;
+}
+
+const AABB& AABBTree::fat_aabb(u32 leaf)
+{
+	CE_ASSERT(leaf < array::size(_nodes), "Index out of bounds");
+	return _nodes[leaf].aabb;
+}
+
+u32 AABBTree::height()
+{
+	return _root == UINT32_MAX ? 0 : u32(_nodes[_root].height) + 1;
+}
+
+void AABBTree::clear()
+{
+	array::clear(_nodes);
+	_root = UINT32_MAX;
+	_free_list = UINT32_MAX;
+}
+
+void AABBTree::query_aabb(const AABB& b, Array<u32>& user_data)
+{
+	AABBTest test(b);
+	query(*this, test, user_data);
+}
+
+void AABBTree::query_frustum(const Frustum& f, Array<u32>& user_data)
+{
+	FrustumTest test(f);
+	query(*this, test, user_data);
+}
+
+void AABBTree::query_ray(const Vector3& from, const Vector3& dir, f32 max_distance, Array<u32>& user_data)
+{
+	RayTest test(from, dir, max_distance);
+	query(*this, test, user_data);
+}
+
+u32 AABBTree::allocate_node()
+{
+	u32 i;
+	if (_free_list != UINT32_MAX)
+	{
+		i = _free_list;
+		_free_list = _nodes[i].parent;
+	}
+	else
+	{
+		i = array::size(_nodes);
+		array::resize(_nodes, i + 1);
+	}
+
+	Node& n = _nodes[i];
+	n.parent    = UINT32_MAX;
+	n.left      = UINT32_MAX;
+	n.right     = UINT32_MAX;
+	n.user_data = UINT32_MAX;
+	n.height    = 0;
+	return i;
+}
+
+void AABBTree::free_node(u32 i)
+{
+	_nodes[i].parent = _free_list;
+	_nodes[i].height = -1;
+	_free_list = i;
+}
+
+void AABBTree::insert_leaf(u32 leaf)
+{
+	if (_root == UINT32_MAX)
+	{
+		_root = leaf;
+		_nodes[leaf].parent = UINT32_MAX;
+		return;
+	}
+
+	// Find the best sibling by descending the tree along the children
+	// which increase the surface area of the hierarchy the least
+	const AABB leaf_aabb = _nodes[leaf].aabb;
+	u32 index = _root;
+
+	while (!is_leaf(_nodes[index]))
+	{
+		const Node& n = _nodes[index];
+		const f32 area = surface_area(n.aabb);
+		const f32 combined_area = surface_area(merge(n.aabb, leaf_aabb));
+
+		// Cost of creating a new parent for this node and the new leaf
+		const f32 cost = 2.0f * combined_area;
+
+		// Minimum cost of pushing the leaf further down the tree
+		const f32 inheritance_cost = 2.0f * (combined_area - area);
+
+		f32 child_cost[2];
+		const u32 children[2] = { n.left, n.right };
+		for (u32 c = 0; c < 2; ++c)
+		{
+			const Node& child = _nodes[children[c]];
+			const f32 merged_area = surface_area(merge(child.aabb, leaf_aabb));
+			child_cost[c] = is_leaf(child)
+				? merged_area + inheritance_cost
+				: merged_area - surface_area(child.aabb) + inheritance_cost
+				;
+		}
+
+		if (cost < child_cost[0] && cost < child_cost[1])
+			break;
+
+		index = child_cost[0] < child_cost[1] ? n.left : n.right;
+	}
+
+	const u32 sibling = index;
+	const u32 old_parent = _nodes[sibling].parent;
+	const u32 new_parent = allocate_node();
+
+	_nodes[new_parent].parent = old_parent;
+	_nodes[new_parent].aabb   = merge(leaf_aabb, _nodes[sibling].aabb);
+	_nodes[new_parent].height = _nodes[sibling].height + 1;
+	_nodes[new_parent].left   = sibling;
+	_nodes[new_parent].right  = leaf;
+	_nodes[sibling].parent    = new_parent;
+	_nodes[leaf].parent       = new_parent;
+
+	if (old_parent == UINT32_MAX)
+		_root = new_parent;
+	else if (_nodes[old_parent].left == sibling)
+		_nodes[old_parent].left = new_parent;
+	else
+		_nodes[old_parent].right = new_parent;
+
+	refit(_nodes[leaf].parent);
+}
+
+void AABBTree::remove_leaf(u32 leaf)
+{
+	if (leaf == _root)
+	{
+		_root = UINT32_MAX;
+		return;
+	}
+
+	const u32 parent = _nodes[leaf].parent;
+	const u32 grand_parent = _nodes[parent].parent;
+	const u32 sibling = _nodes[parent].left == leaf
+		? _nodes[parent].right
+		: _nodes[parent].left
+		;
+
+	free_node(parent);
+
+	if (grand_parent == UINT32_MAX)
+	{
+		_root = sibling;
+		_nodes[sibling].parent = UINT32_MAX;
+		return;
+	}
+
+	if (_nodes[grand_parent].left == parent)
+		_nodes[grand_parent].left = sibling;
+	else
+		_nodes[grand_parent].right = sibling;
+	_nodes[sibling].parent = grand_parent;
+
+	refit(grand_parent);
+}
+
+// Rebalances and updates the boxes and the heights of the nodes from
+// @a i up to the root.
+void AABBTree::refit(u32 i)
+{
+	while (i != UINT32_MAX)
+	{
+		i = balance(i);
+
+		Node& n = _nodes[i];
+		const Node& l = _nodes[n.left];
+		const Node& r = _nodes[n.right];
+		n.aabb   = merge(l.aabb, r.aabb);
+		n.height = 1 + (l.height > r.height ? l.height : r.height);
+
+		i = n.parent;
+	}
+}
+
+// Rotates the child of @a ia which is taller than the other by more than
+// one level up, and returns the index of the node which has taken the
+// place of @a ia.
+u32 AABBTree::balance(u32 ia)
+{
+	Node& a = _nodes[ia];
+	if (is_leaf(a) || a.height < 2)
+		return ia;
+
+	const u32 ib = a.left;
+	const u32 ic = a.right;
+	Node& b = _nodes[ib];
+	Node& c = _nodes[ic];
+	const s32 bal = c.height - b.height;
+
+	if (bal > 1)
+	{
+		const u32 i_f = c.left;
+		const u32 i_g = c.right;
+		Node& f = _nodes[i_f];
+		Node& g = _nodes[i_g];
+
+		// Swap a and c
+		c.left = ia;
+		c.parent = a.parent;
+		a.parent = ic;
+
+		if (c.parent == UINT32_MAX)
+			_root = ic;
+		else if (_nodes[c.parent].left == ia)
+			_nodes[c.parent].left = ic;
+		else
+			_nodes[c.parent].right = ic;
+
+		// Keep the tallest of f and g under c
+		if (f.height > g.height)
+		{
+			c.right = i_f;
+			a.right = i_g;
+			g.parent = ia;
+			a.aabb = merge(b.aabb, g.aabb);
+			c.aabb = merge(a.aabb, f.aabb);
+			a.height = 1 + (b.height > g.height ? b.height : g.height);
+			c.height = 1 + (a.height > f.height ? a.height : f.height);
+		}
+		else
+		{
+			c.right = i_g;
+			a.right = i_f;
+			f.parent = ia;
+			a.aabb = merge(b.aabb, f.aabb);
+			c.aabb = merge(a.aabb, g.aabb);
+			a.height = 1 + (b.height > f.height ? b.height : f.height);
+			c.height = 1 + (a.height > g.height ? a.height : g.height);
+		}
+
+		return ic;
+	}
+
+	if (bal < -1)
+	{
+		const u32 i_d = b.left;
+		const u32 i_e = b.right;
+		Node& d = _nodes[i_d];
+		Node& e = _nodes[i_e];
+
+		// Swap a and b
+		b.left = ia;
+		b.parent = a.parent;
+		a.parent = ib;
+
+		if (b.parent == UINT32_MAX)
+			_root = ib;
+		else if (_nodes[b.parent].left == ia)
+			_nodes[b.parent].left = ib;
+		else
+			_nodes[b.parent].right = ib;
+
+		// Keep the tallest of d and e under b
+		if (d.height > e.height)
+		{
+			b.right = i_d;
+			a.left = i_e;
+			e.parent = ia;
+			a.aabb = merge(c.aabb, e.aabb);
+			b.aabb = merge(a.aabb, d.aabb);
+			a.height = 1 + (c.height > e.height ? c.height : e.height);
+			b.height = 1 + (a.height > d.height ? a.height : d.height);
+		}
+		else
+		{
+			b.right = i_e;
+			a.left = i_d;
+			d.parent = ia;
+			a.aabb = merge(c.aabb, d.aabb);
+			b.aabb = merge(a.aabb, e.aabb);
+			a.height = 1 + (c.height > d.height ? c.height : d.height);
+			b.height = 1 + (a.height > e.height ? a.height : e.height);
+		}
+
+		return ib;
+	}
+
+	return ia;
+}
+
+} // namespace crown
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Dynamic bounding volume hierarchy of AABBs.
+/// Leaves store a box enlarged by a margin so that small movements do
+/// not require the tree to be updated; the tree is kept balanced with
+/// rotations as leaves are inserted and removed.
+///
+/// @ingroup Math
+struct AABBTree
+{
+	struct Node
+	{
+		AABB aabb;
+		u32 parent; ///< Next free node if the node is free.
+		u32 left;   ///< UINT32_MAX if the node is a leaf.
+		u32 right;
+		u32 user_data;
+		s32 height; ///< 0 for leaves, -1 for free nodes.
+	};
+
+	Array<Node> _nodes;
+	u32 _root;
+	u32 _free_list;
+	f32 _margin;
+
+	///
+	AABBTree(Allocator& a, f32 margin = CROWN_AABB_TREE_MARGIN);
+
+	/// Inserts the box @a b and returns the leaf which holds it.
+	u32 create(const AABB& b, u32 user_data);
+
+	/// Removes the @a leaf from the tree.
+	void destroy(u32 leaf);
+
+	/// Moves the @a leaf to the box @a b. The tree is only modified if
+	/// @a b does not fit in the enlarged box of the leaf anymore.
+	/// Returns whether the tree has been modified.
+	bool move(u32 leaf, const AABB& b);
+
+	/// Returns the user data of the @a leaf.
+	u32 user_data(u32 leaf);
+
+	/// Sets the user data of the @a leaf.
+	void set_user_data(u32 leaf, u32 user_data);
+
+	/// Returns the enlarged box of the @a leaf.
+	const AABB& fat_aabb(u32 leaf);
+
+	/// Returns the height of the tree, 0 if the tree is empty.
+	u32 height();
+
+	/// Removes all the leaves from the tree.
+	void clear();
+
+	/// Appends to @a user_data the user data of the leaves whose
+	/// enlarged box overlaps the box @a b.
+	void query_aabb(const AABB& b, Array<u32>& user_data);
+
+	/// Appends to @a user_data the user data of the leaves whose
+	/// enlarged box intersects the frustum @a f.
+	void query_frustum(const Frustum& f, Array<u32>& user_data);
+
+	/// Appends to @a user_data the user data of the leaves whose
+	/// enlarged box is hit by the ray (from, dir) within @a max_distance.
+	void query_ray(const Vector3& from, const Vector3& dir, f32 max_distance, Array<u32>& user_data);
+
+	u32 allocate_node();
+	void free_node(u32 i);
+	void insert_leaf(u32 leaf);
+	void remove_leaf(u32 leaf);
+	u32 balance(u32 i);
+	void refit(u32 i);
+};
+
+} // namespace crown
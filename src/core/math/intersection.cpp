@@ -3,14 +3,75 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/error/error.h"
 #include "core/math/aabb.h"
 #include "core/math/intersection.h"
 #include "core/math/plane3.h"
+#include "core/math/simd.h"
 #include "core/math/sphere.h"
 #include "core/math/vector3.h"
+#include <float.h> // FLT_MAX
 
 namespace crown
 {
+namespace intersection_internal
+{
+	// Loads the 4 values of @a p starting at @a i, padding with zeros past @a num.
+	static inline simd::Float4 load(const f32* p, u32 i, u32 num)
+	{
+		if (i + 4 <= num)
+			return simd::load(p + i);
+
+		f32 v[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (u32 j = 0; i + j < num; ++j)
+			v[j] = p[i + j];
+		return simd::load(v);
+	}
+
+	// Returns the mask of the lanes [i, i + 4) which are less than @a num.
+	static inline u32 lanes(u32 i, u32 num)
+	{
+		return num - i >= 4 ? 0xf : (1u << (num - i)) - 1;
+	}
+
+	static inline u32 count_bits4(u32 bits)
+	{
+		return (bits & 1) + ((bits >> 1) & 1) + ((bits >> 2) & 1) + ((bits >> 3) & 1);
+	}
+
+	// Writes the distances @a tt of the lanes [i, i + 4) which are hit
+	// according to @a hit, -1.0 otherwise, and updates the nearest hit.
+	static inline void store_hits(f32* t, u32 i, u32 num, simd::Mask4 hit, simd::Float4 tt, u32& nearest, f32& nearest_t)
+	{
+		const u32 bits = simd::mask_bits(hit) & lanes(i, num);
+		if (bits == 0 && t == NULL)
+			return;
+
+		f32 v[4];
+		simd::store(v, tt);
+		for (u32 j = 0; j < 4 && i + j < num; ++j)
+		{
+			const bool is_hit = (bits >> j) & 1;
+			if (t != NULL)
+				t[i + j] = is_hit ? v[j] : -1.0f;
+
+			if (is_hit && v[j] < nearest_t)
+			{
+				nearest_t = v[j];
+				nearest = i + j;
+			}
+		}
+	}
+
+	// Clears the @a mask of @a num bits.
+	static inline void clear_mask(u32* mask, u32 num)
+	{
+		for (u32 w = 0; w < (num + 31) / 32; ++w)
+			mask[w] = 0;
+	}
+
+} // namespace intersection_internal
+
 f32 ray_plane_intersection(const Vector3& from, const Vector3& dir, const Plane3& p)
 {
 	const f32 num = dot(from, p.n);
@@ -51,6 +112,47 @@ f32 ray_sphere_intersection(const Vector3& from, const Vector3& dir, const Spher
 	return b - fsqrt(det);
 }
 
+f32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABB& b)
+{
+	f32 tmin = 0.0f;
+	f32 tmax = FLT_MAX;
+
+	const f32* o  = to_float_ptr(from);
+	const f32* d  = to_float_ptr(dir);
+	const f32* mn = to_float_ptr(b.min);
+	const f32* mx = to_float_ptr(b.max);
+
+	for (u32 i = 0; i < 3; ++i)
+	{
+		if (fequal(d[i], 0.0f))
+		{
+			// Ray is parallel to the slab
+			if (o[i] < mn[i] || o[i] > mx[i])
+				return -1.0f;
+			continue;
+		}
+
+		const f32 inv_d = 1.0f / d[i];
+		f32 t1 = (mn[i] - o[i]) * inv_d;
+		f32 t2 = (mx[i] - o[i]) * inv_d;
+
+		if (t1 > t2)
+		{
+			const f32 t = t1;
+			t1 = t2;
+			t2 = t;
+		}
+
+		tmin = t1 > tmin ? t1 : tmin;
+		tmax = t2 < tmax ? t2 : tmax;
+
+		if (tmin > tmax)
+			return -1.0f;
+	}
+
+	return tmin;
+}
+
 // http://www.opengl-tutorial.org/miscellaneous/clicking-on-objects/picking-with-custom-ray-obb-function/
 f32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const Vector3& half_extents)
 {
@@ -153,7 +255,8 @@ f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vec
 	return ray_mesh_intersection(from, dir, MATRIX4X4_IDENTITY, verts, sizeof(Vector3), inds, 3);
 }
 
-f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num)
+template <typename IndexType>
+static f32 ray_mesh_intersection_internal(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const IndexType* indices, u32 num)
 {
 	bool hit = false;
 	f32 tmin = 999999999.9f;
@@ -217,6 +320,16 @@ f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4
 	return hit ? tmin : -1.0f;
 }
 
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num)
+{
+	return ray_mesh_intersection_internal(from, dir, tm, vertices, stride, indices, num);
+}
+
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num)
+{
+	return ray_mesh_intersection_internal(from, dir, tm, vertices, stride, indices, num);
+}
+
 bool plane_3_intersection(const Plane3& a, const Plane3& b, const Plane3& c, Vector3& ip)
 {
 	const Vector3 na = a.n;
@@ -342,4 +455,206 @@ bool frustum_box_intersection(const Frustum& f, const AABB& b)
 	return true;
 }
 
+u32 ray_sphere_intersection(const Vector3& from, const Vector3& dir, const SphereSoA& s, f32* t)
+{
+	using namespace intersection_internal;
+
+	const simd::Float4 ox = simd::splat(from.x);
+	const simd::Float4 oy = simd::splat(from.y);
+	const simd::Float4 oz = simd::splat(from.z);
+	const simd::Float4 dx = simd::splat(dir.x);
+	const simd::Float4 dy = simd::splat(dir.y);
+	const simd::Float4 dz = simd::splat(dir.z);
+	const simd::Float4 zero = simd::splat(0.0f);
+	const simd::Float4 miss = simd::splat(-1.0f);
+
+	u32 nearest = UINT32_MAX;
+	f32 nearest_t = FLT_MAX;
+
+	for (u32 i = 0; i < s.num; i += 4)
+	{
+		const simd::Float4 vx = simd::sub(load(s.c[0], i, s.num), ox);
+		const simd::Float4 vy = simd::sub(load(s.c[1], i, s.num), oy);
+		const simd::Float4 vz = simd::sub(load(s.c[2], i, s.num), oz);
+		const simd::Float4 r  = load(s.r, i, s.num);
+
+		const simd::Float4 b   = simd::madd(vx, dx, simd::madd(vy, dy, simd::mul(vz, dz)));
+		const simd::Float4 vv  = simd::madd(vx, vx, simd::madd(vy, vy, simd::mul(vz, vz)));
+		const simd::Float4 det = simd::add(simd::sub(simd::mul(r, r), vv), simd::mul(b, b));
+
+		const simd::Mask4 hit = simd::mask_and(simd::cmple(zero, det), simd::cmple(r, b));
+		const simd::Float4 tt = simd::select(hit, simd::sub(b, simd::sqrt(simd::max(det, zero))), miss);
+		store_hits(t, i, s.num, hit, tt, nearest, nearest_t);
+	}
+
+	return nearest;
+}
+
+u32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABBSoA& b, f32* t)
+{
+	using namespace intersection_internal;
+
+	const f32* o = to_float_ptr(from);
+	const f32* d = to_float_ptr(dir);
+	const simd::Float4 zero = simd::splat(0.0f);
+	const simd::Float4 miss = simd::splat(-1.0f);
+
+	u32 nearest = UINT32_MAX;
+	f32 nearest_t = FLT_MAX;
+
+	for (u32 i = 0; i < b.num; i += 4)
+	{
+		simd::Float4 tmin = zero;
+		simd::Float4 tmax = simd::splat(FLT_MAX);
+		simd::Mask4 hit = simd::cmple(zero, zero);
+
+		for (u32 a = 0; a < 3; ++a)
+		{
+			const simd::Float4 va = simd::splat(o[a]);
+			const simd::Float4 mn = load(b.min[a], i, b.num);
+			const simd::Float4 mx = load(b.max[a], i, b.num);
+
+			if (fequal(d[a], 0.0f))
+			{
+				// Ray is parallel to the slab
+				hit = simd::mask_and(hit, simd::mask_and(simd::cmple(mn, va), simd::cmple(va, mx)));
+				continue;
+			}
+
+			const simd::Float4 inv_d = simd::splat(1.0f / d[a]);
+			const simd::Float4 t1 = simd::mul(simd::sub(mn, va), inv_d);
+			const simd::Float4 t2 = simd::mul(simd::sub(mx, va), inv_d);
+			tmin = simd::max(tmin, simd::min(t1, t2));
+			tmax = simd::min(tmax, simd::max(t1, t2));
+		}
+
+		hit = simd::mask_and(hit, simd::cmple(tmin, tmax));
+		store_hits(t, i, b.num, hit, simd::select(hit, tmin, miss), nearest, nearest_t);
+	}
+
+	return nearest;
+}
+
+u32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const OBBSoA& b, f32* t)
+{
+	using namespace intersection_internal;
+
+	const f32* o = to_float_ptr(from);
+	const simd::Float4 dx = simd::splat(dir.x);
+	const simd::Float4 dy = simd::splat(dir.y);
+	const simd::Float4 dz = simd::splat(dir.z);
+	const simd::Float4 zero = simd::splat(0.0f);
+	const simd::Float4 miss = simd::splat(-1.0f);
+	const simd::Float4 epsilon = simd::splat(0.001f);
+
+	u32 nearest = UINT32_MAX;
+	f32 nearest_t = FLT_MAX;
+
+	for (u32 i = 0; i < b.num; i += 4)
+	{
+		simd::Float4 delta[3];
+		for (u32 j = 0; j < 3; ++j)
+			delta[j] = simd::sub(load(b.center[j], i, b.num), simd::splat(o[j]));
+
+		simd::Float4 tmin = zero;
+		simd::Float4 tmax = simd::splat(999999999.9f);
+		simd::Mask4 hit = simd::cmple(zero, zero);
+
+		for (u32 a = 0; a < 3; ++a)
+		{
+			const simd::Float4 ax = load(b.axis[a][0], i, b.num);
+			const simd::Float4 ay = load(b.axis[a][1], i, b.num);
+			const simd::Float4 az = load(b.axis[a][2], i, b.num);
+			const simd::Float4 he = load(b.half_extents[a], i, b.num);
+
+			const simd::Float4 e = simd::madd(ax, delta[0], simd::madd(ay, delta[1], simd::mul(az, delta[2])));
+			const simd::Float4 f = simd::madd(ax, dx, simd::madd(ay, dy, simd::mul(az, dz)));
+			const simd::Mask4 slab = simd::cmpgt(simd::abs(f), epsilon);
+
+			const simd::Float4 t1 = simd::div(simd::sub(e, he), f);
+			const simd::Float4 t2 = simd::div(simd::add(e, he), f);
+			tmin = simd::select(slab, simd::max(tmin, simd::min(t1, t2)), tmin);
+			tmax = simd::select(slab, simd::min(tmax, simd::max(t1, t2)), tmax);
+
+			// The ray is parallel to the slab, it must start between its planes
+			const simd::Float4 ne = simd::sub(zero, e);
+			const simd::Mask4 inside = simd::mask_and(simd::cmple(simd::sub(ne, he), zero), simd::cmple(zero, simd::add(ne, he)));
+			hit = simd::mask_and(hit, simd::mask_or(slab, inside));
+		}
+
+		hit = simd::mask_and(hit, simd::cmple(tmin, tmax));
+		store_hits(t, i, b.num, hit, simd::select(hit, tmin, miss), nearest, nearest_t);
+	}
+
+	return nearest;
+}
+
+u32 frustum_sphere_intersection(const Frustum& f, const SphereSoA& s, u32* mask)
+{
+	using namespace intersection_internal;
+
+	CE_STATIC_ASSERT(sizeof(Frustum) == 6*sizeof(Plane3));
+	const Plane3* planes = &f.plane_left;
+	const simd::Float4 zero = simd::splat(0.0f);
+	clear_mask(mask, s.num);
+
+	u32 num = 0;
+	for (u32 i = 0; i < s.num; i += 4)
+	{
+		const simd::Float4 cx = load(s.c[0], i, s.num);
+		const simd::Float4 cy = load(s.c[1], i, s.num);
+		const simd::Float4 cz = load(s.c[2], i, s.num);
+		const simd::Float4 nr = simd::sub(zero, load(s.r, i, s.num));
+
+		simd::Mask4 inside = simd::cmple(zero, zero);
+		for (u32 p = 0; p < 6; ++p)
+		{
+			const Plane3& pl = planes[p];
+			const simd::Float4 dist = simd::madd(simd::splat(pl.n.x), cx
+				, simd::madd(simd::splat(pl.n.y), cy
+				, simd::madd(simd::splat(pl.n.z), cz, simd::splat(pl.d))));
+			inside = simd::mask_and(inside, simd::cmple(nr, dist));
+		}
+
+		const u32 bits = simd::mask_bits(inside) & lanes(i, s.num);
+		mask[i / 32] |= bits << (i % 32);
+		num += count_bits4(bits);
+	}
+
+	return num;
+}
+
+u32 frustum_box_intersection(const Frustum& f, const AABBSoA& b, u32* mask)
+{
+	using namespace intersection_internal;
+
+	const Plane3* planes = &f.plane_left;
+	const simd::Float4 zero = simd::splat(0.0f);
+	clear_mask(mask, b.num);
+
+	u32 num = 0;
+	for (u32 i = 0; i < b.num; i += 4)
+	{
+		simd::Mask4 inside = simd::cmple(zero, zero);
+		for (u32 p = 0; p < 6; ++p)
+		{
+			// A box is outside if its vertex farthest along the normal is behind the plane
+			const Plane3& pl = planes[p];
+			const simd::Float4 vx = load(pl.n.x > 0.0f ? b.max[0] : b.min[0], i, b.num);
+			const simd::Float4 vy = load(pl.n.y > 0.0f ? b.max[1] : b.min[1], i, b.num);
+			const simd::Float4 vz = load(pl.n.z > 0.0f ? b.max[2] : b.min[2], i, b.num);
+			const simd::Float4 dist = simd::madd(simd::splat(pl.n.x), vx
+				, simd::madd(simd::splat(pl.n.y), vy
+				, simd::madd(simd::splat(pl.n.z), vz, simd::splat(pl.d))));
+			inside = simd::mask_and(inside, simd::cmple(zero, dist));
+		}
+
+		const u32 bits = simd::mask_bits(inside) & lanes(i, b.num);
+		mask[i / 32] |= bits << (i % 32);
+		num += count_bits4(bits);
+	}
+
+	return num;
+}
+
 } // namespace crown
@@ -28,6 +28,10 @@ f32 ray_sphere_intersection(const Vector3& from, const Vector3& dir, const Spher
 /// bounding box (tm, half_extents) or -1.0 if no intersection.
 f32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const Vector3& half_extents);
 
+/// Returns the distance along ray (from, dir) to intersection point with the box @a b
+/// or -1.0 if no intersection. Returns 0.0 if @a from is inside the box.
+f32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABB& b);
+
 /// Returns the distance along ray (from, dir) to intersection point with the triangle
 /// (v0, v1, v2) or -1.0 if no intersection.
 f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vector3& v0, const Vector3& v1, const Vector3& v2);
@@ -36,6 +40,9 @@ f32 ray_triangle_intersection(const Vector3& from, const Vector3& dir, const Vec
 /// mesh defined by (vertices, stride, indices, num) or -1.0 if no intersection.
 f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num);
 
+/// @copydoc ray_mesh_intersection()
+f32 ray_mesh_intersection(const Vector3& from, const Vector3& dir, const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num);
+
 /// Returns whether the planes @a a, @a b and @a c intersects and if so fills @a ip with the intersection point.
 bool plane_3_intersection(const Plane3& a, const Plane3& b, const Plane3& c, Vector3& ip);
 
@@ -45,6 +52,29 @@ bool frustum_sphere_intersection(const Frustum& f, const Sphere& s);
 /// Returns whether the frustum @a f and the AABB @a b intersects.
 bool frustum_box_intersection(const Frustum& f, const AABB& b);
 
+/// Tests the ray (from, dir) against all the spheres @a s, four at a time.
+/// Writes the distance to each intersection point, or -1.0 if no intersection,
+/// to @a t if it is not NULL. Returns the index of the nearest sphere hit or
+/// UINT32_MAX if no sphere is hit.
+u32 ray_sphere_intersection(const Vector3& from, const Vector3& dir, const SphereSoA& s, f32* t);
+
+/// Tests the ray (from, dir) against all the boxes @a b, four at a time.
+/// @see ray_sphere_intersection(const Vector3&, const Vector3&, const SphereSoA&, f32*)
+u32 ray_aabb_intersection(const Vector3& from, const Vector3& dir, const AABBSoA& b, f32* t);
+
+/// Tests the ray (from, dir) against all the oriented boxes @a b, four at a time.
+/// @see ray_sphere_intersection(const Vector3&, const Vector3&, const SphereSoA&, f32*)
+u32 ray_obb_intersection(const Vector3& from, const Vector3& dir, const OBBSoA& b, f32* t);
+
+/// Tests the frustum @a f against all the spheres @a s, four at a time, and sets
+/// the bit i of @a mask if the sphere i intersects. @a mask must hold at least
+/// (s.num + 31) / 32 words. Returns the number of spheres which intersect.
+u32 frustum_sphere_intersection(const Frustum& f, const SphereSoA& s, u32* mask);
+
+/// Tests the frustum @a f against all the boxes @a b, four at a time.
+/// @see frustum_sphere_intersection(const Frustum&, const SphereSoA&, u32*)
+u32 frustum_box_intersection(const Frustum& f, const AABBSoA& b, u32* mask);
+
 /// @}
 
 } // namespace crown
@@ -105,35 +105,103 @@ Matrix4x4& invert(Matrix4x4& m)
 	const f32 tz = m.t.z;
 	const f32 tw = m.t.w;
 
-	f32 det = 0.0f;
-	det += xx * (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw));
-	det -= yx * (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw));
-	det += zx * (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw));
-	det -= tx * (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw));
-
+	// 2x2 determinants of the upper and lower halves, each shared by
+	// several cofactors (Laplace expansion)
+	const f32 s0 = xx*yy - yx*xy;
+	const f32 s1 = xx*yz - yx*xz;
+	const f32 s2 = xx*yw - yx*xw;
+	const f32 s3 = xy*yz - yy*xz;
+	const f32 s4 = xy*yw - yy*xw;
+	const f32 s5 = xz*yw - yz*xw;
+
+	const f32 c0 = zx*ty - tx*zy;
+	const f32 c1 = zx*tz - tx*zz;
+	const f32 c2 = zx*tw - tx*zw;
+	const f32 c3 = zy*tz - ty*zz;
+	const f32 c4 = zy*tw - ty*zw;
+	const f32 c5 = zz*tw - tz*zw;
+
+	const f32 det = s0*c5 - s1*c4 + s2*c3 + s3*c2 - s4*c1 + s5*c0;
 	const f32 inv_det = 1.0f / det;
 
-	m.x.x = + (yy * (zz*tw - tz*zw) - zy * (yz*tw - tz*yw) + ty * (yz*zw - zz*yw)) * inv_det;
-	m.x.y = - (xy * (zz*tw - tz*zw) - zy * (xz*tw - tz*xw) + ty * (xz*zw - zz*xw)) * inv_det;
-	m.x.z = + (xy * (yz*tw - tz*yw) - yy * (xz*tw - tz*xw) + ty * (xz*yw - yz*xw)) * inv_det;
-	m.x.w = - (xy * (yz*zw - zz*yw) - yy * (xz*zw - zz*xw) + zy * (xz*yw - yz*xw)) * inv_det;
+	m.x.x = (+ yy*c5 - yz*c4 + yw*c3) * inv_det;
+	m.x.y = (- xy*c5 + xz*c4 - xw*c3) * inv_det;
+	m.x.z = (+ ty*s5 - tz*s4 + tw*s3) * inv_det;
+	m.x.w = (- zy*s5 + zz*s4 - zw*s3) * inv_det;
 
-	m.y.x = - (yx * (zz*tw - tz*zw) - zx * (yz*tw - tz*yw) + tx * (yz*zw - zz*yw)) * inv_det;
-	m.y.y = + (xx * (zz*tw - tz*zw) - zx * (xz*tw - tz*xw) + tx * (xz*zw - zz*xw)) * inv_det;
-	m.y.z = - (xx * (yz*tw - tz*yw) - yx * (xz*tw - tz*xw) + tx * (xz*yw - yz*xw)) * inv_det;
-	m.y.w = + (xx * (yz*zw - zz*yw) - yx * (xz*zw - zz*xw) + zx * (xz*yw - yz*xw)) * inv_det;
+	m.y.x = (- yx*c5 + yz*c2 - yw*c1) * inv_det;
+	m.y.y = (+ xx*c5 - xz*c2 + xw*c1) * inv_det;
+	m.y.z = (- tx*s5 + tz*s2 - tw*s1) * inv_det;
+	m.y.w = (+ zx*s5 - zz*s2 + zw*s1) * inv_det;
 
-	m.z.x = + (yx * (zy*tw - ty*zw) - zx * (yy*tw - ty*yw) + tx * (yy*zw - zy*yw)) * inv_det;
-	m.z.y = - (xx * (zy*tw - ty*zw) - zx * (xy*tw - ty*xw) + tx * (xy*zw - zy*xw)) * inv_det;
-	m.z.z = + (xx * (yy*tw - ty*yw) - yx * (xy*tw - ty*xw) + tx * (xy*yw - yy*xw)) * inv_det;
-	m.z.w = - (xx * (yy*zw - zy*yw) - yx * (xy*zw - zy*xw) + zx * (xy*yw - yy*xw)) * inv_det;
+	m.z.x = (+ yx*c4 - yy*c2 + yw*c0) * inv_det;
+	m.z.y = (- xx*c4 + xy*c2 - xw*c0) * inv_det;
+	m.z.z = (+ tx*s4 - ty*s2 + tw*s0) * inv_det;
+	m.z.w = (- zx*s4 + zy*s2 - zw*s0) * inv_det;
 
-	m.t.x = - (yx * (zy*tz - ty*zz) - zx * (yy*tz - ty*yz) + tx * (yy*zz - zy*yz)) * inv_det;
-	m.t.y = + (xx * (zy*tz - ty*zz) - zx * (xy*tz - ty*xz) + tx * (xy*zz - zy*xz)) * inv_det;
-	m.t.z = - (xx * (yy*tz - ty*yz) - yx * (xy*tz - ty*xz) + tx * (xy*yz - yy*xz)) * inv_det;
-	m.t.w = + (xx * (yy*zz - zy*yz) - yx * (xy*zz - zy*xz) + zx * (xy*yz - yy*xz)) * inv_det;
+	m.t.x = (- yx*c3 + yy*c1 - yz*c0) * inv_det;
+	m.t.y = (+ xx*c3 - xy*c1 + xz*c0) * inv_det;
+	m.t.z = (- tx*s3 + ty*s1 - tz*s0) * inv_det;
+	m.t.w = (+ zx*s3 - zy*s1 + zz*s0) * inv_det;
 
 	return m;
 }
 
+void multiply(Matrix4x4* dst, const Matrix4x4* a, const Matrix4x4* b, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+		dst[i] = a[i] * b[i];
+}
+
+void multiply(Matrix4x4* dst, const Matrix4x4* a, const Matrix4x4& b, u32 num)
+{
+	// Keep the rows of b in registers across the whole batch
+	const simd::Float4 bx = simd::load(&b.x.x);
+	const simd::Float4 by = simd::load(&b.y.x);
+	const simd::Float4 bz = simd::load(&b.z.x);
+	const simd::Float4 bt = simd::load(&b.t.x);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const simd::Float4 rx = simd::transform(simd::load(&a[i].x.x), bx, by, bz, bt);
+		const simd::Float4 ry = simd::transform(simd::load(&a[i].y.x), bx, by, bz, bt);
+		const simd::Float4 rz = simd::transform(simd::load(&a[i].z.x), bx, by, bz, bt);
+		const simd::Float4 rt = simd::transform(simd::load(&a[i].t.x), bx, by, bz, bt);
+
+		simd::store(&dst[i].x.x, rx);
+		simd::store(&dst[i].y.x, ry);
+		simd::store(&dst[i].z.x, rz);
+		simd::store(&dst[i].t.x, rt);
+	}
+}
+
+void transform_points(Vector3* dst, const Vector3* points, u32 num, const Matrix4x4& m)
+{
+	const simd::Float4 mx = simd::load(&m.x.x);
+	const simd::Float4 my = simd::load(&m.y.x);
+	const simd::Float4 mz = simd::load(&m.z.x);
+	const simd::Float4 mt = simd::load(&m.t.x);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const Vector3 p = points[i];
+		f32 tmp[4];
+		simd::store(tmp, simd::transform_point(p.x, p.y, p.z, mx, my, mz, mt));
+		dst[i].x = tmp[0];
+		dst[i].y = tmp[1];
+		dst[i].z = tmp[2];
+	}
+}
+
+void transform_points(Vector4* dst, const Vector4* vectors, u32 num, const Matrix4x4& m)
+{
+	const simd::Float4 mx = simd::load(&m.x.x);
+	const simd::Float4 my = simd::load(&m.y.x);
+	const simd::Float4 mz = simd::load(&m.z.x);
+	const simd::Float4 mt = simd::load(&m.t.x);
+
+	for (u32 i = 0; i < num; ++i)
+		simd::store(&dst[i].x, simd::transform(simd::load(&vectors[i].x), mx, my, mz, mt));
+}
+
 } // namespace crown
@@ -8,7 +8,9 @@
 #include "core/math/math.h"
 #include "core/math/matrix3x3.h"
 #include "core/math/quaternion.h"
+#include "core/math/simd.h"
 #include "core/math/types.h"
+#include "core/math/vector3.h"
 #include "core/math/vector4.h"
 
 namespace crown
@@ -209,29 +211,20 @@ inline Matrix4x4& operator*=(Matrix4x4& a, f32 k)
 /// Multiplies the matrix @a a by @a b and returns the result. (i.e. transforms first by @a a then by @a b)
 inline Matrix4x4& operator*=(Matrix4x4& a, const Matrix4x4& b)
 {
-	Matrix4x4 tmp;
+	const simd::Float4 bx = simd::load(&b.x.x);
+	const simd::Float4 by = simd::load(&b.y.x);
+	const simd::Float4 bz = simd::load(&b.z.x);
+	const simd::Float4 bt = simd::load(&b.t.x);
 
-	tmp.x.x = a.x.x*b.x.x + a.x.y*b.y.x + a.x.z*b.z.x + a.x.w*b.t.x;
-	tmp.x.y = a.x.x*b.x.y + a.x.y*b.y.y + a.x.z*b.z.y + a.x.w*b.t.y;
-	tmp.x.z = a.x.x*b.x.z + a.x.y*b.y.z + a.x.z*b.z.z + a.x.w*b.t.z;
-	tmp.x.w = a.x.x*b.x.w + a.x.y*b.y.w + a.x.z*b.z.w + a.x.w*b.t.w;
+	const simd::Float4 rx = simd::transform(simd::load(&a.x.x), bx, by, bz, bt);
+	const simd::Float4 ry = simd::transform(simd::load(&a.y.x), bx, by, bz, bt);
+	const simd::Float4 rz = simd::transform(simd::load(&a.z.x), bx, by, bz, bt);
+	const simd::Float4 rt = simd::transform(simd::load(&a.t.x), bx, by, bz, bt);
 
-	tmp.y.x = a.y.x*b.x.x + a.y.y*b.y.x + a.y.z*b.z.x + a.y.w*b.t.x;
-	tmp.y.y = a.y.x*b.x.y + a.y.y*b.y.y + a.y.z*b.z.y + a.y.w*b.t.y;
-	tmp.y.z = a.y.x*b.x.z + a.y.y*b.y.z + a.y.z*b.z.z + a.y.w*b.t.z;
-	tmp.y.w = a.y.x*b.x.w + a.y.y*b.y.w + a.y.z*b.z.w + a.y.w*b.t.w;
-
-	tmp.z.x = a.z.x*b.x.x + a.z.y*b.y.x + a.z.z*b.z.x + a.z.w*b.t.x;
-	tmp.z.y = a.z.x*b.x.y + a.z.y*b.y.y + a.z.z*b.z.y + a.z.w*b.t.y;
-	tmp.z.z = a.z.x*b.x.z + a.z.y*b.y.z + a.z.z*b.z.z + a.z.w*b.t.z;
-	tmp.z.w = a.z.x*b.x.w + a.z.y*b.y.w + a.z.z*b.z.w + a.z.w*b.t.w;
-
-	tmp.t.x = a.t.x*b.x.x + a.t.y*b.y.x + a.t.z*b.z.x + a.t.w*b.t.x;
-	tmp.t.y = a.t.x*b.x.y + a.t.y*b.y.y + a.t.z*b.z.y + a.t.w*b.t.y;
-	tmp.t.z = a.t.x*b.x.z + a.t.y*b.y.z + a.t.z*b.z.z + a.t.w*b.t.z;
-	tmp.t.w = a.t.x*b.x.w + a.t.y*b.y.w + a.t.z*b.z.w + a.t.w*b.t.w;
-
-	a = tmp;
+	simd::store(&a.x.x, rx);
+	simd::store(&a.y.x, ry);
+	simd::store(&a.z.x, rz);
+	simd::store(&a.t.x, rt);
 	return a;
 }
 
@@ -266,22 +259,31 @@ inline Matrix4x4 operator*(f32 k, Matrix4x4 a)
 /// Multiplies the matrix @a a by the vector @a v and returns the result.
 inline Vector3 operator*(const Vector3& v, const Matrix4x4& a)
 {
-	Vector3 r;
-	r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + a.t.x;
-	r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + a.t.y;
-	r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + a.t.z;
-	return r;
+	const simd::Float4 r = simd::transform_point(v.x, v.y, v.z
+		, simd::load(&a.x.x)
+		, simd::load(&a.y.x)
+		, simd::load(&a.z.x)
+		, simd::load(&a.t.x)
+		);
+
+	f32 tmp[4];
+	simd::store(tmp, r);
+	return vector3(tmp[0], tmp[1], tmp[2]);
 }
 
 /// Multiplies the matrix @a by the vector @a v and returns the result.
 inline Vector4 operator*(const Vector4& v, const Matrix4x4& a)
 {
-	Vector4 r;
-	r.x = v.x*a.x.x + v.y*a.y.x + v.z*a.z.x + v.w*a.t.x;
-	r.y = v.x*a.x.y + v.y*a.y.y + v.z*a.z.y + v.w*a.t.y;
-	r.z = v.x*a.x.z + v.y*a.y.z + v.z*a.z.z + v.w*a.t.z;
-	r.w = v.x*a.x.w + v.y*a.y.w + v.z*a.z.w + v.w*a.t.w;
-	return r;
+	const simd::Float4 r = simd::transform(simd::load(&v.x)
+		, simd::load(&a.x.x)
+		, simd::load(&a.y.x)
+		, simd::load(&a.z.x)
+		, simd::load(&a.t.x)
+		);
+
+	Vector4 res;
+	simd::store(&res.x, r);
+	return res;
 }
 
 /// Multiplies the matrix @a a by @a b and returns the result. (i.e. transforms first by @a a then by @a b)
@@ -291,6 +293,23 @@ inline Matrix4x4 operator*(Matrix4x4 a, const Matrix4x4& b)
 	return a;
 }
 
+/// Multiplies each of the @a num matrices in @a a by the corresponding
+/// matrix in @a b and writes the results to @a dst. @a dst can be either
+/// @a a or @a b.
+void multiply(Matrix4x4* dst, const Matrix4x4* a, const Matrix4x4* b, u32 num);
+
+/// Multiplies each of the @a num matrices in @a a by @a b and writes the
+/// results to @a dst. @a dst can be @a a.
+void multiply(Matrix4x4* dst, const Matrix4x4* a, const Matrix4x4& b, u32 num);
+
+/// Transforms the @a num points in @a points by the matrix @a m and writes
+/// the results to @a dst. @a dst can be @a points.
+void transform_points(Vector3* dst, const Vector3* points, u32 num, const Matrix4x4& m);
+
+/// Transforms the @a num vectors in @a vectors by the matrix @a m and
+/// writes the results to @a dst. @a dst can be @a vectors.
+void transform_points(Vector4* dst, const Vector4* vectors, u32 num, const Matrix4x4& m);
+
 /// Sets the matrix @a m to perspective.
 void perspective(Matrix4x4& m, f32 fovy, f32 aspect, f32 nnear, f32 ffar);
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/math/random.h"
+
+namespace crown
+{
+namespace random_internal
+{
+	// Number of values generated at a time by the bulk functions.
+	// The loops in fill() are unrolled accordingly.
+	const u32 NUM_LANES = 4;
+
+	// Sets up NUM_LANES states, each of which generates every NUM_LANES-th
+	// value of the sequence of @a r. The lanes do not depend on each other
+	// and can be advanced in parallel with @a mul and @a add.
+	static void init_lanes(const Pcg32& r, u64* lanes, u64& mul, u64& add)
+	{
+		lanes[0] = r._state;
+		for (u32 i = 1; i < NUM_LANES; ++i)
+			lanes[i] = lanes[i - 1] * PCG32_MULTIPLIER + r._inc;
+
+		// Advancing by NUM_LANES steps is itself an LCG step with
+		// mul = M^n and add = inc * (M^(n-1) + ... + M + 1).
+		mul = 1;
+		add = 0;
+		for (u32 i = 0; i < NUM_LANES; ++i)
+		{
+			add = add * PCG32_MULTIPLIER + r._inc;
+			mul *= PCG32_MULTIPLIER;
+		}
+	}
+
+	// Returns the output of @a lane and advances it by NUM_LANES steps.
+	static inline u32 next(u64& lane, u64 mul, u64 add)
+	{
+		const u32 val = pcg32_output(lane);
+		lane = lane * mul + add;
+		return val;
+	}
+
+} // namespace random_internal
+
+namespace random
+{
+	void fill(Pcg32& r, u32* data, u32 num)
+	{
+		using namespace random_internal;
+
+		u64 lanes[NUM_LANES];
+		u64 mul;
+		u64 add;
+		init_lanes(r, lanes, mul, add);
+
+		u32 i = 0;
+		for (; i + NUM_LANES <= num; i += NUM_LANES)
+		{
+			data[i + 0] = next(lanes[0], mul, add);
+			data[i + 1] = next(lanes[1], mul, add);
+			data[i + 2] = next(lanes[2], mul, add);
+			data[i + 3] = next(lanes[3], mul, add);
+		}
+
+		r._state = lanes[0];
+		for (; i < num; ++i)
+			data[i] = r.integer();
+	}
+
+	void fill(Pcg32& r, f32* data, u32 num, f32 min, f32 max)
+	{
+		using namespace random_internal;
+
+		u64 lanes[NUM_LANES];
+		u64 mul;
+		u64 add;
+		init_lanes(r, lanes, mul, add);
+
+		const f32 scale = max - min;
+		u32 i = 0;
+		for (; i + NUM_LANES <= num; i += NUM_LANES)
+		{
+			data[i + 0] = min + scale * to_unit_float(next(lanes[0], mul, add));
+			data[i + 1] = min + scale * to_unit_float(next(lanes[1], mul, add));
+			data[i + 2] = min + scale * to_unit_float(next(lanes[2], mul, add));
+			data[i + 3] = min + scale * to_unit_float(next(lanes[3], mul, add));
+		}
+
+		r._state = lanes[0];
+		for (; i < num; ++i)
+			data[i] = r.range(min, max);
+	}
+
+} // namespace random
+
+} // namespace crown
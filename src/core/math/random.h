@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "core/error/error.h"
 #include "core/types.h"
 
 namespace crown
@@ -50,4 +51,133 @@ inline f32 Random::unit_float()
 	return integer() / (f32)0x7fff;
 }
 
+/// Pseudo-random number generator.
+///
+/// Uses PCG32 (XSH-RR variant): 64 bits of state, a period of 2^64 and
+/// 2^63 independent streams. Jobs that need reproducible results should
+/// each use their own stream, created with Pcg32(seed, stream) or split().
+struct Pcg32
+{
+	u64 _state;
+	u64 _inc;
+
+	/// Initializes the generator with the given @a seed and selects the
+	/// sequence @a stream.
+	Pcg32(u64 seed, u64 stream = 0xda3e39cb94b95bdbull);
+
+	/// Returns a pseudo-random integer in the range [0, UINT32_MAX].
+	u32 integer();
+
+	/// Returns a pseudo-random integer in the range [0, max).
+	/// Unlike integer() % max, it is not biased towards small values.
+	u32 integer(u32 max);
+
+	/// Returns a pseudo-random integer in the range [min, max].
+	s32 range(s32 min, s32 max);
+
+	/// Returns a pseudo-random f32 in the range [0.0, 1.0).
+	f32 unit_float();
+
+	/// Returns a pseudo-random f32 in the range [min, max).
+	f32 range(f32 min, f32 max);
+
+	/// Returns a new generator whose seed and stream are drawn from this
+	/// one, so that splitting in the same order gives the same generators.
+	Pcg32 split();
+};
+
+namespace random
+{
+	/// Fills @a data with @a num pseudo-random integers from @a r.
+	/// The result is the same as calling r.integer() @a num times.
+	void fill(Pcg32& r, u32* data, u32 num);
+
+	/// Fills @a data with @a num pseudo-random f32 in the range [min, max)
+	/// from @a r. The result is the same as calling r.range(min, max)
+	/// @a num times.
+	void fill(Pcg32& r, f32* data, u32 num, f32 min = 0.0f, f32 max = 1.0f);
+
+} // namespace random
+
+namespace random_internal
+{
+	const u64 PCG32_MULTIPLIER = 6364136223846793005ull;
+
+	inline u32 pcg32_output(u64 state)
+	{
+		const u32 xorshifted = u32(((state >> 18u) ^ state) >> 27u);
+		const u32 rot = u32(state >> 59u);
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+	}
+
+	inline f32 to_unit_float(u32 x)
+	{
+		// Top 24 bits, so that every value is exactly representable
+		return f32(x >> 8) * (1.0f / 16777216.0f);
+	}
+
+} // namespace random_internal
+
+inline Pcg32::Pcg32(u64 seed, u64 stream)
+	: _state(0)
+	, _inc((stream << 1u) | 1u)
+{
+	integer();
+	_state += seed;
+	integer();
+}
+
+inline u32 Pcg32::integer()
+{
+	const u64 old = _state;
+	_state = old * random_internal::PCG32_MULTIPLIER + _inc;
+	return random_internal::pcg32_output(old);
+}
+
+inline u32 Pcg32::integer(u32 max)
+{
+	if (max == 0)
+		return 0;
+
+	// See: Lemire, Fast Random Integer Generation in an Interval
+	u64 m = u64(integer()) * u64(max);
+	u32 low = u32(m);
+	if (low < max)
+	{
+		const u32 threshold = u32(-max) % max;
+		while (low < threshold)
+		{
+			m = u64(integer()) * u64(max);
+			low = u32(m);
+		}
+	}
+	return u32(m >> 32);
+}
+
+inline s32 Pcg32::range(s32 min, s32 max)
+{
+	CE_ASSERT(min <= max, "Invalid range: min = %d, max = %d", min, max);
+	const u32 span = u32(max) - u32(min) + 1u;
+	return s32(u32(min) + (span == 0 ? integer() : integer(span)));
+}
+
+inline f32 Pcg32::unit_float()
+{
+	return random_internal::to_unit_float(integer());
+}
+
+inline f32 Pcg32::range(f32 min, f32 max)
+{
+	return min + (max - min) * unit_float();
+}
+
+inline Pcg32 Pcg32::split()
+{
+	u64 seed = u64(integer()) << 32;
+	seed |= integer();
+	u64 stream = u64(integer()) << 32;
+	stream |= integer();
+	return Pcg32(seed, stream);
+}
+
 } // namespace crown
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/platform.h"
+#include "core/types.h"
+
+#define CROWN_SIMD_SSE 0
+#define CROWN_SIMD_NEON 0
+
+// Define CROWN_SIMD_DISABLE to force the scalar implementation.
+#if !defined(CROWN_SIMD_DISABLE)
+	#if CROWN_CPU_X86 && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+		#undef CROWN_SIMD_SSE
+		#define CROWN_SIMD_SSE 1
+	#elif CROWN_CPU_ARM && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+		#undef CROWN_SIMD_NEON
+		#define CROWN_SIMD_NEON 1
+	#endif
+#endif // !defined(CROWN_SIMD_DISABLE)
+
+#if CROWN_SIMD_SSE
+	#include <xmmintrin.h>
+#elif CROWN_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+#include <math.h> // sqrtf, fabsf
+
+namespace crown
+{
+/// Minimal 4-wide float vector used to implement the math functions.
+/// Loads and stores do not require any particular alignment. Comparisons
+/// return a Mask4 whose lanes are all ones or all zeros.
+///
+/// @ingroup Math
+namespace simd
+{
+#if CROWN_SIMD_SSE
+	typedef __m128 Float4;
+
+	inline Float4 load(const f32* p)                                 { return _mm_loadu_ps(p); }
+	inline void store(f32* p, Float4 a)                              { _mm_storeu_ps(p, a); }
+	inline Float4 splat(f32 k)                                       { return _mm_set1_ps(k); }
+	inline Float4 add(Float4 a, Float4 b)                            { return _mm_add_ps(a, b); }
+	inline Float4 sub(Float4 a, Float4 b)                            { return _mm_sub_ps(a, b); }
+	inline Float4 mul(Float4 a, Float4 b)                            { return _mm_mul_ps(a, b); }
+	inline Float4 madd(Float4 a, Float4 b, Float4 c)                 { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+	template <int I> inline Float4 splat(Float4 a)                   { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(I, I, I, I)); }
+	inline Float4 div(Float4 a, Float4 b)                            { return _mm_div_ps(a, b); }
+	inline Float4 min(Float4 a, Float4 b)                            { return _mm_min_ps(a, b); }
+	inline Float4 max(Float4 a, Float4 b)                            { return _mm_max_ps(a, b); }
+	inline Float4 sqrt(Float4 a)                                     { return _mm_sqrt_ps(a); }
+	inline Float4 abs(Float4 a)                                      { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+	typedef __m128 Mask4;
+
+	inline Mask4 cmplt(Float4 a, Float4 b)                           { return _mm_cmplt_ps(a, b); }
+	inline Mask4 cmple(Float4 a, Float4 b)                           { return _mm_cmple_ps(a, b); }
+	inline Mask4 cmpgt(Float4 a, Float4 b)                           { return _mm_cmpgt_ps(a, b); }
+	inline Mask4 mask_and(Mask4 a, Mask4 b)                          { return _mm_and_ps(a, b); }
+	inline Mask4 mask_or(Mask4 a, Mask4 b)                           { return _mm_or_ps(a, b); }
+	inline u32 mask_bits(Mask4 m)                                    { return (u32)_mm_movemask_ps(m); }
+	inline Float4 select(Mask4 m, Float4 a, Float4 b)                { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+#elif CROWN_SIMD_NEON
+	typedef float32x4_t Float4;
+
+	inline Float4 load(const f32* p)                                 { return vld1q_f32(p); }
+	inline void store(f32* p, Float4 a)                              { vst1q_f32(p, a); }
+	inline Float4 splat(f32 k)                                       { return vdupq_n_f32(k); }
+	inline Float4 add(Float4 a, Float4 b)                            { return vaddq_f32(a, b); }
+	inline Float4 sub(Float4 a, Float4 b)                            { return vsubq_f32(a, b); }
+	inline Float4 mul(Float4 a, Float4 b)                            { return vmulq_f32(a, b); }
+	inline Float4 madd(Float4 a, Float4 b, Float4 c)                 { return vmlaq_f32(c, a, b); }
+	template <int I> inline Float4 splat(Float4 a)                   { return vdupq_n_f32(vgetq_lane_f32(a, I)); }
+	inline Float4 min(Float4 a, Float4 b)                            { return vminq_f32(a, b); }
+	inline Float4 max(Float4 a, Float4 b)                            { return vmaxq_f32(a, b); }
+	inline Float4 abs(Float4 a)                                      { return vabsq_f32(a); }
+	inline Float4 div(Float4 a, Float4 b)
+	{
+		// Two Newton-Raphson steps on the reciprocal estimate
+		float32x4_t r = vrecpeq_f32(b);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		return vmulq_f32(a, r);
+	}
+	inline Float4 sqrt(Float4 a)
+	{
+		const f32 v[4] = { ::sqrtf(vgetq_lane_f32(a, 0)), ::sqrtf(vgetq_lane_f32(a, 1)), ::sqrtf(vgetq_lane_f32(a, 2)), ::sqrtf(vgetq_lane_f32(a, 3)) };
+		return vld1q_f32(v);
+	}
+
+	typedef uint32x4_t Mask4;
+
+	inline Mask4 cmplt(Float4 a, Float4 b)                           { return vcltq_f32(a, b); }
+	inline Mask4 cmple(Float4 a, Float4 b)                           { return vcleq_f32(a, b); }
+	inline Mask4 cmpgt(Float4 a, Float4 b)                           { return vcgtq_f32(a, b); }
+	inline Mask4 mask_and(Mask4 a, Mask4 b)                          { return vandq_u32(a, b); }
+	inline Mask4 mask_or(Mask4 a, Mask4 b)                           { return vorrq_u32(a, b); }
+	inline u32 mask_bits(Mask4 m)
+	{
+		return (vgetq_lane_u32(m, 0) & 1)
+			| (vgetq_lane_u32(m, 1) & 2)
+			| (vgetq_lane_u32(m, 2) & 4)
+			| (vgetq_lane_u32(m, 3) & 8)
+			;
+	}
+	inline Float4 select(Mask4 m, Float4 a, Float4 b)                { return vbslq_f32(m, a, b); }
+#else
+	struct Float4 { f32 v[4]; };
+
+	inline Float4 load(const f32* p)                                 { Float4 r = {{ p[0], p[1], p[2], p[3] }}; return r; }
+	inline void store(f32* p, Float4 a)                              { p[0] = a.v[0]; p[1] = a.v[1]; p[2] = a.v[2]; p[3] = a.v[3]; }
+	inline Float4 splat(f32 k)                                       { Float4 r = {{ k, k, k, k }}; return r; }
+	inline Float4 add(Float4 a, Float4 b)                            { Float4 r = {{ a.v[0]+b.v[0], a.v[1]+b.v[1], a.v[2]+b.v[2], a.v[3]+b.v[3] }}; return r; }
+	inline Float4 sub(Float4 a, Float4 b)                            { Float4 r = {{ a.v[0]-b.v[0], a.v[1]-b.v[1], a.v[2]-b.v[2], a.v[3]-b.v[3] }}; return r; }
+	inline Float4 mul(Float4 a, Float4 b)                            { Float4 r = {{ a.v[0]*b.v[0], a.v[1]*b.v[1], a.v[2]*b.v[2], a.v[3]*b.v[3] }}; return r; }
+	inline Float4 madd(Float4 a, Float4 b, Float4 c)                 { return add(mul(a, b), c); }
+	template <int I> inline Float4 splat(Float4 a)                   { return splat(a.v[I]); }
+	inline Float4 div(Float4 a, Float4 b)                            { Float4 r = {{ a.v[0]/b.v[0], a.v[1]/b.v[1], a.v[2]/b.v[2], a.v[3]/b.v[3] }}; return r; }
+	inline Float4 min(Float4 a, Float4 b)                            { Float4 r; for (u32 i = 0; i < 4; ++i) r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return r; }
+	inline Float4 max(Float4 a, Float4 b)                            { Float4 r; for (u32 i = 0; i < 4; ++i) r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return r; }
+	inline Float4 sqrt(Float4 a)                                     { Float4 r = {{ ::sqrtf(a.v[0]), ::sqrtf(a.v[1]), ::sqrtf(a.v[2]), ::sqrtf(a.v[3]) }}; return r; }
+	inline Float4 abs(Float4 a)                                      { Float4 r = {{ ::fabsf(a.v[0]), ::fabsf(a.v[1]), ::fabsf(a.v[2]), ::fabsf(a.v[3]) }}; return r; }
+
+	struct Mask4 { bool v[4]; };
+
+	inline Mask4 cmplt(Float4 a, Float4 b)                           { Mask4 m = {{ a.v[0] < b.v[0], a.v[1] < b.v[1], a.v[2] < b.v[2], a.v[3] < b.v[3] }}; return m; }
+	inline Mask4 cmple(Float4 a, Float4 b)                           { Mask4 m = {{ a.v[0] <= b.v[0], a.v[1] <= b.v[1], a.v[2] <= b.v[2], a.v[3] <= b.v[3] }}; return m; }
+	inline Mask4 cmpgt(Float4 a, Float4 b)                           { Mask4 m = {{ a.v[0] > b.v[0], a.v[1] > b.v[1], a.v[2] > b.v[2], a.v[3] > b.v[3] }}; return m; }
+	inline Mask4 mask_and(Mask4 a, Mask4 b)                          { Mask4 m = {{ a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3] }}; return m; }
+	inline Mask4 mask_or(Mask4 a, Mask4 b)                           { Mask4 m = {{ a.v[0] || b.v[0], a.v[1] || b.v[1], a.v[2] || b.v[2], a.v[3] || b.v[3] }}; return m; }
+	inline u32 mask_bits(Mask4 m)                                    { return u32(m.v[0]) | u32(m.v[1]) << 1 | u32(m.v[2]) << 2 | u32(m.v[3]) << 3; }
+	inline Float4 select(Mask4 m, Float4 a, Float4 b)                { Float4 r = {{ m.v[0] ? a.v[0] : b.v[0], m.v[1] ? a.v[1] : b.v[1], m.v[2] ? a.v[2] : b.v[2], m.v[3] ? a.v[3] : b.v[3] }}; return r; }
+#endif // CROWN_SIMD_SSE
+
+	/// Returns the row vector @a v multiplied by the matrix whose rows
+	/// are @a x, @a y, @a z and @a t.
+	inline Float4 transform(Float4 v, Float4 x, Float4 y, Float4 z, Float4 t)
+	{
+		Float4 r = mul(splat<0>(v), x);
+		r = madd(splat<1>(v), y, r);
+		r = madd(splat<2>(v), z, r);
+		r = madd(splat<3>(v), t, r);
+		return r;
+	}
+
+	/// Returns the point (@a px, @a py, @a pz, 1) multiplied by the matrix
+	/// whose rows are @a x, @a y, @a z and @a t.
+	inline Float4 transform_point(f32 px, f32 py, f32 pz, Float4 x, Float4 y, Float4 z, Float4 t)
+	{
+		Float4 r = madd(splat(px), x, t);
+		r = madd(splat(py), y, r);
+		r = madd(splat(pz), z, r);
+		return r;
+	}
+
+} // namespace simd
+
+} // namespace crown
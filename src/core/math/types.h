@@ -84,6 +84,31 @@ struct Sphere
 	f32 r;
 };
 
+/// Spheres stored as a structure of arrays, for the batch intersection tests.
+struct SphereSoA
+{
+	const f32* c[3]; ///< x, y and z of the centers.
+	const f32* r;
+	u32 num;
+};
+
+/// Axis-aligned boxes stored as a structure of arrays, for the batch intersection tests.
+struct AABBSoA
+{
+	const f32* min[3]; ///< x, y and z of the minimum corners.
+	const f32* max[3]; ///< x, y and z of the maximum corners.
+	u32 num;
+};
+
+/// Oriented boxes stored as a structure of arrays, for the batch intersection tests.
+struct OBBSoA
+{
+	const f32* center[3];       ///< x, y and z of the centers.
+	const f32* axis[3][3];      ///< axis[i][j] is the component j of the i-th unit axis.
+	const f32* half_extents[3]; ///< Half extents along each axis.
+	u32 num;
+};
+
 static const Vector2 VECTOR2_ZERO  = { 0.0f, 0.0f };
 static const Vector2 VECTOR2_ONE   = { 1.0f, 1.0f };
 static const Vector2 VECTOR2_XAXIS = { 1.0f, 0.0f };
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/memory/frame_allocator.h"
+#include "core/memory/memory.h"
+
+namespace crown
+{
+FrameAllocator::FrameAllocator(Allocator& backing, u32 size)
+	: _backing(backing)
+	, _size(size)
+	, _current(0)
+	, _offset(0)
+{
+	CE_ASSERT(size < 0x80000000u, "Unsupported size");
+
+	_buffers[0] = (char*)backing.allocate(size, 16);
+	_buffers[1] = (char*)backing.allocate(size, 16);
+	_overflow[0] = NULL;
+	_overflow[1] = NULL;
+}
+
+FrameAllocator::~FrameAllocator()
+{
+	reset();
+	reset();
+
+	_backing.deallocate(_buffers[1]);
+	_backing.deallocate(_buffers[0]);
+}
+
+void* FrameAllocator::allocate(u32 size, u32 align)
+{
+	const u32 actual_size = size + align;
+	const u32 offset = (u32)_offset.fetch_add(actual_size);
+
+	if (actual_size <= _size && offset <= _size - actual_size)
+		return memory::align_top(_buffers[_current] + offset, align);
+
+	// Out of memory, fall back to the backing allocator
+	ScopedMutex sm(_mutex);
+	void* p = _backing.allocate(sizeof(void*) + actual_size);
+	*(void**)p = _overflow[_current];
+	_overflow[_current] = p;
+	return memory::align_top((char*)p + sizeof(void*), align);
+}
+
+void FrameAllocator::reset()
+{
+	_current ^= 1;
+	_offset.store(0);
+
+	void* p = _overflow[_current];
+	while (p != NULL)
+	{
+		void* next = *(void**)p;
+		_backing.deallocate(p);
+		p = next;
+	}
+	_overflow[_current] = NULL;
+}
+
+u32 FrameAllocator::total_allocated()
+{
+	const u32 offset = (u32)_offset.load();
+	return offset < _size ? offset : _size;
+}
+
+} // namespace crown
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/memory/allocator.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/mutex.h"
+
+namespace crown
+{
+/// Allocates memory linearly from one of two fixed chunks of memory, which
+/// are swapped and cleared by reset(). Memory allocated between two calls
+/// to reset() stays valid until the second call after them, so data
+/// produced in a frame can be consumed during the next one. Allocations
+/// which do not fit in the chunk are served by the backing allocator and
+/// freed the same way. Thread-safe, except for reset().
+///
+/// @ingroup Memory
+struct FrameAllocator : public Allocator
+{
+	Allocator& _backing;
+	Mutex _mutex;
+	char* _buffers[2];
+	void* _overflow[2]; ///< Blocks from the backing allocator, linked through the first pointer.
+	u32 _size;
+	u32 _current;
+	AtomicInt _offset;
+
+	/// Allocates two chunks of @a size bytes from @a backing.
+	FrameAllocator(Allocator& backing, u32 size);
+	~FrameAllocator();
+
+	/// @copydoc Allocator::allocate()
+	void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN);
+
+	/// @copydoc Allocator::deallocate()
+	/// @note
+	/// The frame allocator does not support deallocating
+	/// individual allocations, memory is freed by reset().
+	void deallocate(void* /*data*/) {}
+
+	/// Swaps the chunks and frees all the allocations made before the
+	/// previous call to reset().
+	void reset();
+
+	/// @copydoc Allocator::allocated_size()
+	u32 allocated_size(const void* /*ptr*/) { return SIZE_NOT_TRACKED; }
+
+	/// @copydoc Allocator::total_allocated()
+	/// Returns the number of bytes allocated from the current chunk.
+	u32 total_allocated();
+};
+
+} // namespace crown
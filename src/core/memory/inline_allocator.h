@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/memory/allocator.h"
+
+namespace crown
+{
+/// Serves one allocation at a time of up to BUFFER_SIZE bytes from a local
+/// buffer and any other allocation from the backing allocator. Meant to
+/// give containers storage for their first few items, see InlineArray.
+///
+/// @ingroup Memory
+template <u32 BUFFER_SIZE>
+struct InlineAllocator : public Allocator
+{
+	CE_ALIGN_DECL(16, char _buffer[BUFFER_SIZE]);
+	Allocator* _backing;
+	bool _used;
+
+	///
+	InlineAllocator(Allocator& backing)
+		: _backing(&backing)
+		, _used(false)
+	{
+	}
+
+	/// @copydoc Allocator::allocate()
+	void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN)
+	{
+		if (!_used && size <= BUFFER_SIZE && align <= 16)
+		{
+			_used = true;
+			return _buffer;
+		}
+
+		return _backing->allocate(size, align);
+	}
+
+	/// @copydoc Allocator::deallocate()
+	void deallocate(void* data)
+	{
+		if (data == _buffer)
+			_used = false;
+		else
+			_backing->deallocate(data);
+	}
+
+	/// @copydoc Allocator::allocated_size()
+	u32 allocated_size(const void* ptr)
+	{
+		return ptr == _buffer ? BUFFER_SIZE : _backing->allocated_size(ptr);
+	}
+
+	/// Returns SIZE_NOT_TRACKED.
+	u32 total_allocated()
+	{
+		return SIZE_NOT_TRACKED;
+	}
+};
+
+} // namespace crown
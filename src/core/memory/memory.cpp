@@ -3,10 +3,16 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/memory/allocator.h"
+#include "core/memory/frame_allocator.h"
 #include "core/memory/memory.h"
+#include "core/memory/memory_tracker.h"
+#include "core/os.h"
 #include "core/thread/mutex.h"
+#include "device/profiler.h"
 #include <stdlib.h> // malloc
+#include <string.h> // memset
 
 // void* operator new(size_t) throw (std::bad_alloc)
 // {
@@ -88,44 +94,278 @@ namespace memory
 		}
 	}
 
+	// Size classes of the blocks served from the thread caches. Larger
+	// blocks are allocated with malloc().
+	static const u32 s_size_classes[] =
+	{
+		16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512
+	};
+	static const u32 NUM_SIZE_CLASSES = countof(s_size_classes);
+	static const u32 MAX_SMALL_SIZE = 512;
+
+	// Set in the header of the blocks served from the size classes, the
+	// other bits store the size class.
+	static const u32 SMALL_BLOCK = 0x80000000u;
+
+	// Returns the size class of the blocks of @a size bytes.
+	inline u32 size_class(u32 size)
+	{
+		if (size <= 128)
+			return (size + 15) / 16 - 1;
+		if (size <= 256)
+			return 8 + (size - 129) / 32;
+		return 12 + (size - 257) / 64;
+	}
+
+	// Stored at the beginning of the blocks mapped directly from the OS,
+	// before their header.
+	struct PageBlock
+	{
+		u32 size; // Bytes mapped.
+		u32 huge; // Whether the block is backed by huge pages.
+	};
+
+	// Free block of a size class.
+	struct FreeBlock
+	{
+		FreeBlock* next;
+	};
+
+	// Free blocks and allocation counters of a thread.
+	struct ThreadCache
+	{
+		FreeBlock* blocks[NUM_SIZE_CLASSES];
+		u32 num_blocks[NUM_SIZE_CLASSES];
+		u32 allocated_size;   // Net bytes allocated by the thread, may wrap around.
+		u32 allocation_count; // Net allocations made by the thread, may wrap around.
+		bool in_use;
+		ThreadCache* next;
+	};
+
+	// Cache of the calling thread, NULL until its first allocation.
+	static CE_THREAD ThreadCache* _thread_cache = NULL;
+
 	/// Allocator based on C malloc().
+	/// Blocks up to MAX_SMALL_SIZE bytes are served from per-thread free
+	/// lists, without locking. Each thread keeps at most
+	/// CROWN_HEAP_CACHE_SIZE free blocks per size class and exchanges them
+	/// in batches with the central free lists, which are the only ones
+	/// protected by a mutex. Blocks can be deallocated by any thread: they
+	/// go to the cache of the thread which deallocates them.
 	struct HeapAllocator : public Allocator
 	{
-		Mutex _mutex;
-		u32 _allocated_size;
-		u32 _allocation_count;
+		Mutex _mutex;                            // Protects everything below.
+		FreeBlock* _blocks[NUM_SIZE_CLASSES];    // Central free lists.
+		u32 _num_blocks[NUM_SIZE_CLASSES];
+		void* _spans;                            // Memory of the size classes, linked through the first pointer.
+		ThreadCache* _caches;
+		memory_globals::PageStats _page_stats;
+		bool _huge_pages;                        // Whether to back the blocks mapped from the OS with huge pages.
 
 		HeapAllocator()
-			: _allocated_size(0)
-			, _allocation_count(0)
+			: _spans(NULL)
+			, _caches(NULL)
+			, _huge_pages(false)
 		{
+			memset(_blocks, 0, sizeof(_blocks));
+			memset(_num_blocks, 0, sizeof(_num_blocks));
+			memset(&_page_stats, 0, sizeof(_page_stats));
 		}
 
 		~HeapAllocator()
 		{
-			CE_ASSERT(_allocation_count == 0 && total_allocated() == 0
+			CE_ASSERT(allocation_count() == 0 && total_allocated() == 0
 				, "Missing %d deallocations causing a leak of %d bytes"
-				, _allocation_count
+				, allocation_count()
 				, total_allocated()
 				);
+
+			while (_spans != NULL)
+			{
+				void* next = *(void**)_spans;
+				free(_spans);
+				_spans = next;
+			}
+
+			while (_caches != NULL)
+			{
+				ThreadCache* next = _caches->next;
+				free(_caches);
+				_caches = next;
+			}
+
+			_thread_cache = NULL;
 		}
 
-		/// @copydoc Allocator::allocate()
-		void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN)
+		// Returns the cache of the calling thread.
+		ThreadCache& thread_cache()
+		{
+			if (_thread_cache != NULL)
+				return *_thread_cache;
+
+			ScopedMutex sm(_mutex);
+
+			// Reuse the cache of a thread which has exited
+			ThreadCache* tc = _caches;
+			while (tc != NULL && tc->in_use)
+				tc = tc->next;
+
+			if (tc == NULL)
+			{
+				tc = (ThreadCache*)malloc(sizeof(ThreadCache));
+				memset(tc, 0, sizeof(*tc));
+				tc->next = _caches;
+				_caches = tc;
+			}
+
+			tc->in_use = true;
+			_thread_cache = tc;
+			return *tc;
+		}
+
+		// Moves up to @a num blocks of the size class @a sc from the central
+		// free lists to the cache @a tc. The central free lists must be locked.
+		void move_to_cache(ThreadCache& tc, u32 sc, u32 num)
+		{
+			while (num-- > 0 && _blocks[sc] != NULL)
+			{
+				FreeBlock* fb = _blocks[sc];
+				_blocks[sc] = fb->next;
+				--_num_blocks[sc];
+
+				fb->next = tc.blocks[sc];
+				tc.blocks[sc] = fb;
+				++tc.num_blocks[sc];
+			}
+		}
+
+		// Moves up to @a num blocks of the size class @a sc from the cache
+		// @a tc to the central free lists. The central free lists must be locked.
+		void move_to_central(ThreadCache& tc, u32 sc, u32 num)
+		{
+			while (num-- > 0 && tc.blocks[sc] != NULL)
+			{
+				FreeBlock* fb = tc.blocks[sc];
+				tc.blocks[sc] = fb->next;
+				--tc.num_blocks[sc];
+
+				fb->next = _blocks[sc];
+				_blocks[sc] = fb;
+				++_num_blocks[sc];
+			}
+		}
+
+		// Fills the cache @a tc with a batch of blocks of the size class @a sc.
+		void refill(ThreadCache& tc, u32 sc)
 		{
 			ScopedMutex sm(_mutex);
 
-			u32 actual_size = actual_allocation_size(size, align);
+			if (_blocks[sc] == NULL)
+			{
+				// Carve a new span into blocks
+				char* span = (char*)malloc(CROWN_HEAP_SPAN_SIZE);
+				CE_ENSURE(span != NULL);
+				*(void**)span = _spans;
+				_spans = span;
+
+				const u32 size = s_size_classes[sc];
+				for (char* b = span + 16; b + size <= span + CROWN_HEAP_SPAN_SIZE; b += size)
+				{
+					FreeBlock* fb = (FreeBlock*)b;
+					fb->next = _blocks[sc];
+					_blocks[sc] = fb;
+					++_num_blocks[sc];
+				}
+			}
+
+			move_to_cache(tc, sc, CROWN_HEAP_BATCH_SIZE);
+		}
 
-			Header* h = (Header*)malloc(actual_size);
-			h->size = actual_size;
+		// Maps a block of @a size bytes directly from the OS. Blocks of
+		// at least one huge page are backed by huge pages when enabled,
+		// or by regular pages if none are available.
+		Header* map_block(u32 size)
+		{
+			const bool huge = _huge_pages && size >= CROWN_HUGE_PAGE_SIZE;
+			const u32 granularity = huge ? CROWN_HUGE_PAGE_SIZE : 4096;
+			const u32 mapped_size = (size + sizeof(PageBlock) + granularity - 1) / granularity * granularity;
+
+			bool huge_mapped;
+			PageBlock* pb = (PageBlock*)os::map_pages(mapped_size, huge, huge_mapped);
+			CE_ENSURE(pb != NULL);
+			pb->size = mapped_size;
+			pb->huge = huge_mapped;
+
+			ScopedMutex sm(_mutex);
+			_page_stats.num_blocks++;
+			_page_stats.mapped_size += mapped_size;
+			if (huge_mapped)
+				_page_stats.huge_size += mapped_size;
+			else if (huge)
+				_page_stats.num_fallbacks++;
+
+			return (Header*)(pb + 1);
+		}
+
+		// Unmaps the block @a h returned by map_block().
+		void unmap_block(Header* h)
+		{
+			PageBlock* pb = (PageBlock*)h - 1;
+
+			{
+				ScopedMutex sm(_mutex);
+				_page_stats.num_blocks--;
+				_page_stats.mapped_size -= pb->size;
+				if (pb->huge)
+					_page_stats.huge_size -= pb->size;
+			}
+
+			os::unmap_pages(pb, pb->size);
+		}
+
+		/// @copydoc Allocator::allocate()
+		void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN)
+		{
+			ThreadCache& tc = thread_cache();
+			const u32 actual_size = actual_allocation_size(size, align);
+
+			Header* h;
+			if (actual_size <= MAX_SMALL_SIZE)
+			{
+				const u32 sc = size_class(actual_size);
+				if (tc.blocks[sc] == NULL)
+					refill(tc, sc);
+
+				FreeBlock* fb = tc.blocks[sc];
+				tc.blocks[sc] = fb->next;
+				--tc.num_blocks[sc];
+
+				h = (Header*)fb;
+				h->size = SMALL_BLOCK | sc;
+				tc.allocated_size += s_size_classes[sc];
+			}
+			else if (actual_size < CROWN_HEAP_PAGE_BLOCK_SIZE)
+			{
+				h = (Header*)malloc(actual_size);
+				CE_ENSURE(h != NULL);
+				h->size = actual_size;
+				tc.allocated_size += actual_size;
+			}
+			else
+			{
+				h = map_block(actual_size);
+				h->size = actual_size;
+				tc.allocated_size += actual_size;
+			}
 
 			void* data = memory::align_top(h + 1, align);
 
 			pad(h, data);
 
-			_allocated_size += actual_size;
-			_allocation_count++;
+			tc.allocation_count++;
+
+			if (memory_tracker::enabled())
+				memory_tracker::allocate(data, size);
 
 			return data;
 		}
@@ -133,17 +373,61 @@ namespace memory
 		/// @copydoc Allocator::deallocate()
 		void deallocate(void* data)
 		{
-			ScopedMutex sm(_mutex);
-
 			if (!data)
 				return;
 
+			if (memory_tracker::enabled())
+				memory_tracker::deallocate(data);
+
+			ThreadCache& tc = thread_cache();
 			Header* h = header(data);
 
-			_allocated_size -= h->size;
-			_allocation_count--;
+			tc.allocation_count--;
 
-			free(h);
+			if (h->size & SMALL_BLOCK)
+			{
+				const u32 sc = h->size & ~SMALL_BLOCK;
+				tc.allocated_size -= s_size_classes[sc];
+
+				FreeBlock* fb = (FreeBlock*)h;
+				fb->next = tc.blocks[sc];
+				tc.blocks[sc] = fb;
+				++tc.num_blocks[sc];
+
+				if (tc.num_blocks[sc] > CROWN_HEAP_CACHE_SIZE)
+				{
+					ScopedMutex sm(_mutex);
+					move_to_central(tc, sc, CROWN_HEAP_CACHE_SIZE / 2);
+				}
+			}
+			else if (h->size < CROWN_HEAP_PAGE_BLOCK_SIZE)
+			{
+				tc.allocated_size -= h->size;
+				free(h);
+			}
+			else
+			{
+				tc.allocated_size -= h->size;
+				unmap_block(h);
+			}
+		}
+
+		/// Returns the free blocks cached by the calling thread to the
+		/// central free lists, so that other threads can use them.
+		void release_thread_cache()
+		{
+			if (_thread_cache == NULL)
+				return;
+
+			ScopedMutex sm(_mutex);
+
+			for (u32 sc = 0; sc < NUM_SIZE_CLASSES; ++sc)
+				move_to_central(*_thread_cache, sc, UINT32_MAX);
+
+			// The counters are kept: the blocks allocated by the thread can
+			// still be deallocated by others
+			_thread_cache->in_use = false;
+			_thread_cache = NULL;
 		}
 
 		/// @copydoc Allocator::allocated_size()
@@ -153,18 +437,33 @@ namespace memory
 		}
 
 		/// @copydoc Allocator::total_allocated()
+		/// @note
+		/// The counters of the other threads are read without
+		/// synchronizing with them, so the result may be slightly stale.
 		u32 total_allocated()
 		{
 			ScopedMutex sm(_mutex);
-			return _allocated_size;
+			u32 size = 0;
+			for (ThreadCache* tc = _caches; tc != NULL; tc = tc->next)
+				size += tc->allocated_size;
+			return size;
+		}
+
+		/// Returns the number of live allocations.
+		u32 allocation_count()
+		{
+			ScopedMutex sm(_mutex);
+			u32 num = 0;
+			for (ThreadCache* tc = _caches; tc != NULL; tc = tc->next)
+				num += tc->allocation_count;
+			return num;
 		}
 
 		/// Returns the size in bytes of the block of memory pointed by @a data
 		u32 get_size(const void* data)
 		{
-			ScopedMutex sm(_mutex);
 			Header* h = header(data);
-			return h->size;
+			return (h->size & SMALL_BLOCK) ? s_size_classes[h->size & ~SMALL_BLOCK] : h->size;
 		}
 	};
 
@@ -307,21 +606,68 @@ namespace memory_globals
 
 	static const u32 SIZE = sizeof(HeapAllocator)
 		+ sizeof(ScratchAllocator)
+		+ sizeof(FrameAllocator)
 		;
 	char _buffer[SIZE];
 	HeapAllocator* _default_allocator = NULL;
 	ScratchAllocator* _default_scratch_allocator = NULL;
+	FrameAllocator* _default_frame_allocator = NULL;
 
 	void init()
 	{
 		_default_allocator = new (_buffer) HeapAllocator();
 		_default_scratch_allocator = new (_buffer + sizeof(HeapAllocator)) ScratchAllocator(*_default_allocator, 1024*1024);
+		_default_frame_allocator = new (_buffer + sizeof(HeapAllocator) + sizeof(ScratchAllocator)) FrameAllocator(*_default_allocator, CROWN_FRAME_ALLOCATOR_SIZE);
 	}
 
 	void shutdown()
 	{
+		_default_frame_allocator->~FrameAllocator();
 		_default_scratch_allocator->~ScratchAllocator();
+		memory_tracker::shutdown();
 		_default_allocator->~HeapAllocator();
+		_default_allocator = NULL;
+	}
+
+	void enable_tracking(bool enable)
+	{
+		memory_tracker::enable(enable);
+	}
+
+	void record_tracking_stats()
+	{
+		memory_tracker::record_stats();
+	}
+
+	void enable_huge_pages(bool enable)
+	{
+		_default_allocator->_huge_pages = enable;
+	}
+
+	PageStats page_stats()
+	{
+		ScopedMutex sm(_default_allocator->_mutex);
+		return _default_allocator->_page_stats;
+	}
+
+	void record_page_stats()
+	{
+		const PageStats ps = page_stats();
+		RECORD_FLOAT("memory.page_blocks", f32(ps.num_blocks));
+		RECORD_FLOAT("memory.page_mapped", f32(ps.mapped_size));
+		RECORD_FLOAT("memory.page_huge", f32(ps.huge_size));
+		RECORD_FLOAT("memory.page_fallbacks", f32(ps.num_fallbacks));
+	}
+
+	void reset_frame_allocator()
+	{
+		_default_frame_allocator->reset();
+	}
+
+	void release_thread_cache()
+	{
+		if (_default_allocator != NULL)
+			_default_allocator->release_thread_cache();
 	}
 
 } // namespace memory_globals
@@ -336,4 +682,9 @@ Allocator& default_scratch_allocator()
 	return *memory_globals::_default_scratch_allocator;
 }
 
+Allocator& default_frame_allocator()
+{
+	return *memory_globals::_default_frame_allocator;
+}
+
 } // namespace crown
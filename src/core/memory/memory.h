@@ -15,6 +15,10 @@ namespace crown
 Allocator& default_allocator();
 Allocator& default_scratch_allocator();
 
+/// Returns the thread-safe allocator for data which only lives until the
+/// end of the next frame. See FrameAllocator.
+Allocator& default_frame_allocator();
+
 namespace memory
 {
 	/// Returns the pointer @a p aligned to the desired @a align byte
@@ -32,6 +36,15 @@ namespace memory
 		return (void*)ptr;
 	}
 
+	/// Sets the tag of the allocations subsequently made by the calling
+	/// thread, NULL for none, and returns the previous one. See
+	/// memory_globals::enable_tracking().
+	const char* set_tag(const char* tag);
+
+	/// Sets the name of the allocator of the allocations subsequently made
+	/// by the calling thread and returns the previous one.
+	const char* set_allocator_name(const char* name);
+
 	/// Respects standard behaviour when calling on NULL @a ptr
 	template <typename T>
 	inline void call_destructor_and_deallocate(Allocator& a, T* ptr)
@@ -73,6 +86,22 @@ template <typename T> inline T &construct(void *p, Allocator& a, Int2Type<true>)
 template <typename T> inline T &construct(void *p, Allocator& /*a*/, Int2Type<false>) {new (p) T; return *(T *)p;}
 template <typename T> inline T &construct(void *p, Allocator& a) {return construct<T>(p, a, IS_ALLOCATOR_AWARE_TYPE(T)());}
 
+/// Tags the allocations made by the calling thread in the current scope.
+struct ScopedMemoryTag
+{
+	const char* _prev;
+
+	ScopedMemoryTag(const char* tag)
+		: _prev(memory::set_tag(tag))
+	{
+	}
+
+	~ScopedMemoryTag()
+	{
+		memory::set_tag(_prev);
+	}
+};
+
 namespace memory_globals
 {
 	/// Constructs the initial default allocators.
@@ -85,6 +114,51 @@ namespace memory_globals
 	/// Should be the last call of the program.
 	void shutdown();
 
+	/// Enables or disables the tracking of the allocations made with
+	/// default_allocator(). Each allocation is recorded together with its
+	/// call stack, the name of the innermost ProxyAllocator it went through
+	/// and the tag set with memory::set_tag(). The allocations still alive
+	/// at shutdown() are logged grouped by call stack.
+	/// @note
+	/// Tracking is slow, it is meant to find leaks and allocation spikes.
+	void enable_tracking(bool enable);
+
+	/// Records the number of allocations and bytes allocated since the
+	/// previous call to the profiler. Called by Device once per frame.
+	void record_tracking_stats();
+
+	/// Statistics of the blocks of default_allocator() mapped directly from
+	/// the OS, i.e. those of at least CROWN_HEAP_PAGE_BLOCK_SIZE bytes.
+	struct PageStats
+	{
+		u32 num_blocks;    ///< Number of blocks mapped.
+		u32 mapped_size;   ///< Bytes mapped.
+		u32 huge_size;     ///< Bytes mapped with huge pages.
+		u32 num_fallbacks; ///< Blocks which asked for huge pages but got regular ones.
+	};
+
+	/// Enables or disables huge pages (large pages on Windows) for the
+	/// blocks of default_allocator() of at least CROWN_HUGE_PAGE_SIZE bytes.
+	/// These include the resource data and the memory of the arenas, such
+	/// as LinearAllocator and TlsfAllocator, backed by default_allocator().
+	/// Regular pages are used when no huge pages are available.
+	void enable_huge_pages(bool enable);
+
+	/// Returns the statistics of the blocks mapped from the OS.
+	PageStats page_stats();
+
+	/// Records the statistics returned by page_stats() to the profiler.
+	/// Called by Device once per frame.
+	void record_page_stats();
+
+	/// Frees the memory allocated from default_frame_allocator() before
+	/// the previous call. Called by Device at the end of each frame.
+	void reset_frame_allocator();
+
+	/// Returns the memory cached by the calling thread to the default
+	/// allocator. Called by Thread when its function returns.
+	void release_thread_cache();
+
 } // namespace memory_globals
 
 } // namespace crown
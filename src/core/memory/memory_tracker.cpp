@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/error/callstack.h"
+#include "core/error/callstack_table.h"
+#include "core/memory/memory.h"
+#include "core/memory/memory_tracker.h"
+#include "core/strings/string_stream.h"
+#include "core/thread/mutex.h"
+#include "device/log.h"
+#include "device/profiler.h"
+#include <stdlib.h> // malloc, qsort
+#include <string.h> // memcmp, memset
+
+namespace { const crown::log_internal::System MEMORY = { "memory" }; }
+
+namespace crown
+{
+namespace memory
+{
+	static CE_THREAD const char* _tag = NULL;
+	static CE_THREAD const char* _allocator_name = NULL;
+
+	const char* set_tag(const char* tag)
+	{
+		const char* prev = _tag;
+		_tag = tag;
+		return prev;
+	}
+
+	const char* set_allocator_name(const char* name)
+	{
+		const char* prev = _allocator_name;
+		_allocator_name = name;
+		return prev;
+	}
+
+} // namespace memory
+
+namespace memory_tracker
+{
+	// Allocations made from the same call stack.
+	struct Callsite
+	{
+		const char* allocator; // Name of the allocator of the first allocation.
+		const char* tag;       // Tag of the first allocation.
+		u32 num_allocations;   // Live allocations.
+		u32 size;              // Live bytes.
+	};
+
+	struct Record
+	{
+		const void* data;
+		u32 callsite;
+		u32 size;
+	};
+
+	bool _enabled = false;
+	static Mutex _mutex;
+	static CallstackTable _callstacks;
+	static Callsite* _callsites = NULL; // Indexed by call stack id.
+	static u32 _num_callsites = 0;
+	static u32 _callsites_capacity = 0;
+	static Record* _records = NULL; // Open addressing, keyed by data.
+	static u32 _capacity = 0;
+	static u32 _num_records = 0;
+	static u32 _frame_allocations = 0;
+	static u32 _frame_size = 0;
+
+	static inline u32 home(const void* data, u32 capacity)
+	{
+		return u32(((uintptr_t)data >> 4) * 2654435761u) & (capacity - 1);
+	}
+
+	static u32 find(const void* data)
+	{
+		u32 i = home(data, _capacity);
+		while (_records[i].data != NULL && _records[i].data != data)
+			i = (i + 1) & (_capacity - 1);
+		return i;
+	}
+
+	static void grow()
+	{
+		Record* old_records = _records;
+		const u32 old_capacity = _capacity;
+
+		_capacity = old_capacity == 0 ? 4096 : old_capacity * 2;
+		_records = (Record*)malloc(_capacity * sizeof(Record));
+		CE_ENSURE(_records != NULL);
+		memset(_records, 0, _capacity * sizeof(Record));
+
+		for (u32 i = 0; i < old_capacity; ++i)
+		{
+			if (old_records[i].data != NULL)
+				_records[find(old_records[i].data)] = old_records[i];
+		}
+
+		free(old_records);
+	}
+
+	// Removes the record at @a i shifting back the records which collided with it.
+	static void erase(u32 i)
+	{
+		const u32 mask = _capacity - 1;
+		for (u32 j = (i + 1) & mask; _records[j].data != NULL; j = (j + 1) & mask)
+		{
+			const u32 k = home(_records[j].data, _capacity);
+			if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+			{
+				_records[i] = _records[j];
+				i = j;
+			}
+		}
+
+		_records[i].data = NULL;
+	}
+
+	// Returns the id of the call stack of @a num_frames @a frames.
+	static u32 callsite(void* const* frames, u32 num_frames)
+	{
+		const u32 id = _callstacks.intern(frames, num_frames);
+		if (id < _num_callsites)
+			return id;
+
+		// Ids are assigned in order, the call stack is new
+		if (id >= _callsites_capacity)
+		{
+			_callsites_capacity = _callsites_capacity == 0 ? 1024 : _callsites_capacity * 2;
+			_callsites = (Callsite*)realloc(_callsites, _callsites_capacity * sizeof(Callsite));
+			CE_ENSURE(_callsites != NULL);
+		}
+
+		Callsite& cs = _callsites[id];
+		cs.allocator = memory::_allocator_name;
+		cs.tag = memory::_tag;
+		cs.num_allocations = 0;
+		cs.size = 0;
+		_num_callsites = id + 1;
+		return id;
+	}
+
+	void enable(bool enable)
+	{
+		ScopedMutex sm(_mutex);
+		_enabled = enable;
+	}
+
+	void allocate(const void* data, u32 size)
+	{
+		// Skip the frames of the tracker and of the allocator
+		void* frames[CROWN_MEMORY_TRACKING_DEPTH];
+		const u32 num_frames = error::callstack(frames, countof(frames), 2);
+
+		ScopedMutex sm(_mutex);
+
+		if (!_enabled)
+			return;
+
+		if ((_num_records + 1) * 2 > _capacity)
+			grow();
+
+		const u32 cs = callsite(frames, num_frames);
+		_callsites[cs].num_allocations++;
+		_callsites[cs].size += size;
+
+		Record& r = _records[find(data)];
+		r.data = data;
+		r.callsite = cs;
+		r.size = size;
+		_num_records++;
+
+		_frame_allocations++;
+		_frame_size += size;
+	}
+
+	void deallocate(const void* data)
+	{
+		ScopedMutex sm(_mutex);
+
+		if (_capacity == 0)
+			return;
+
+		// Allocations made before the tracking was enabled are not found
+		const u32 i = find(data);
+		if (_records[i].data == NULL)
+			return;
+
+		Callsite& cs = _callsites[_records[i].callsite];
+		cs.num_allocations--;
+		cs.size -= _records[i].size;
+
+		erase(i);
+		_num_records--;
+	}
+
+	void record_stats()
+	{
+		ScopedMutex sm(_mutex);
+
+		if (!_enabled)
+			return;
+
+		RECORD_FLOAT("memory.allocations", f32(_frame_allocations));
+		RECORD_FLOAT("memory.allocated", f32(_frame_size));
+		RECORD_FLOAT("memory.live_allocations", f32(_num_records));
+		_frame_allocations = 0;
+		_frame_size = 0;
+	}
+
+	static int compare_size(const void* a, const void* b)
+	{
+		const Callsite& ca = _callsites[*(const u32*)a];
+		const Callsite& cb = _callsites[*(const u32*)b];
+		return ca.size > cb.size ? -1 : ca.size < cb.size;
+	}
+
+	void shutdown()
+	{
+		enable(false);
+
+		// Largest leaks first
+		u32* leaks = (u32*)malloc((_num_callsites + 1) * sizeof(u32));
+		CE_ENSURE(leaks != NULL);
+		u32 num_leaks = 0;
+		for (u32 i = 0; i < _num_callsites; ++i)
+		{
+			if (_callsites[i].num_allocations > 0)
+				leaks[num_leaks++] = i;
+		}
+		qsort(leaks, num_leaks, sizeof(u32), compare_size);
+
+		// Symbols are resolved only now, for the call stacks which leaked
+		for (u32 i = 0; i < num_leaks; ++i)
+		{
+			const Callsite& cs = _callsites[leaks[i]];
+
+			StringStream ss(default_allocator());
+			_callstacks.symbolize(ss, leaks[i]);
+			logw(MEMORY, "Leak of %u bytes in %u allocations from allocator '%s' with tag '%s':\n%s"
+				, cs.size
+				, cs.num_allocations
+				, cs.allocator != NULL ? cs.allocator : "default"
+				, cs.tag != NULL ? cs.tag : ""
+				, string_stream::c_str(ss)
+				);
+		}
+
+		free(leaks);
+
+		_callstacks.clear();
+		free(_callsites);
+		_callsites = NULL;
+		_num_callsites = 0;
+		_callsites_capacity = 0;
+
+		free(_records);
+		_records = NULL;
+		_capacity = 0;
+		_num_records = 0;
+	}
+
+} // namespace memory_tracker
+
+} // namespace crown
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Records the live allocations of the default allocator together with
+/// their size, allocator name, tag and call stack.
+///
+/// @ingroup Memory
+namespace memory_tracker
+{
+	extern bool _enabled;
+
+	/// Returns whether the allocations are being tracked.
+	inline bool enabled() { return _enabled; }
+
+	/// Enables or disables the tracking.
+	void enable(bool enable);
+
+	/// Records the allocation of @a size bytes at @a data.
+	void allocate(const void* data, u32 size);
+
+	/// Forgets the allocation at @a data.
+	void deallocate(const void* data);
+
+	/// Records the allocations made since the previous call to the profiler.
+	void record_stats();
+
+	/// Logs the live allocations grouped by call stack, disables the
+	/// tracking and frees its memory.
+	void shutdown();
+
+} // namespace memory_tracker
+
+} // namespace crown
@@ -4,6 +4,7 @@
  */
 
 #include "core/error/error.h"
+#include "core/memory/memory.h"
 #include "core/memory/proxy_allocator.h"
 #include "device/profiler.h"
 
@@ -12,23 +13,51 @@ namespace crown
 ProxyAllocator::ProxyAllocator(Allocator& allocator, const char* name)
 	: _allocator(allocator)
 	, _name(name)
+	, _total_allocated(0)
 {
 	CE_ASSERT(name != NULL, "Name must be != NULL");
 }
 
 void* ProxyAllocator::allocate(u32 size, u32 align)
 {
+	// Attribute the allocation to the innermost proxy allocator
+	const char* outer_name = memory::set_allocator_name(_name);
+	if (outer_name != NULL)
+		memory::set_allocator_name(outer_name);
+
 	void* p = _allocator.allocate(size, align);
-	ALLOCATE_MEMORY(_name, _allocator.allocated_size(p));
+	memory::set_allocator_name(outer_name);
+	const u32 actual_size = _allocator.allocated_size(p);
+	if (actual_size != SIZE_NOT_TRACKED)
+		_total_allocated.fetch_add((s32)actual_size);
+
+	ALLOCATE_MEMORY(_name, actual_size);
 	return p;
 }
 
 void ProxyAllocator::deallocate(void* data)
 {
-	DEALLOCATE_MEMORY(_name, (data == NULL) ? 0 :_allocator.allocated_size((const void*)data));
+	const u32 actual_size = (data == NULL) ? 0 :_allocator.allocated_size((const void*)data);
+	if (actual_size != SIZE_NOT_TRACKED)
+		_total_allocated.fetch_add(-(s32)actual_size);
+
+	DEALLOCATE_MEMORY(_name, actual_size);
 	_allocator.deallocate(data);
 }
 
+u32 ProxyAllocator::allocated_size(const void* ptr)
+{
+	return _allocator.allocated_size(ptr);
+}
+
+u32 ProxyAllocator::total_allocated()
+{
+	return _allocator.total_allocated() == SIZE_NOT_TRACKED
+		? SIZE_NOT_TRACKED
+		: (u32)_total_allocated.load()
+		;
+}
+
 const char* ProxyAllocator::name() const
 {
 	return _name;
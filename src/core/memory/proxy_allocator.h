@@ -6,18 +6,22 @@
 #pragma once
 
 #include "core/memory/allocator.h"
+#include "core/thread/atomic_int.h"
 
 namespace crown
 {
 /// Offers the facility to tag allocators by a string identifier.
 /// Proxy allocator is appended to a global linked list when instantiated
 /// so that it is possible to later visit that list for debugging purposes.
+/// Counts the bytes it has allocated if the backing allocator tracks the
+/// size of its allocations.
 ///
 /// @ingroup Memory
 struct ProxyAllocator : public Allocator
 {
 	Allocator& _allocator;
 	const char* _name;
+	AtomicInt _total_allocated;
 
 	/// Tag all allocations made with @a allocator by the given @a name
 	ProxyAllocator(Allocator& allocator, const char* name);
@@ -29,10 +33,10 @@ struct ProxyAllocator : public Allocator
 	void deallocate(void* data);
 
 	/// @copydoc Allocator::allocated_size()
-	u32 allocated_size(const void* /*ptr*/) { return SIZE_NOT_TRACKED; }
+	u32 allocated_size(const void* ptr);
 
 	/// @copydoc Allocator::total_allocated()
-	u32 total_allocated() { return SIZE_NOT_TRACKED; }
+	u32 total_allocated();
 
 	/// Returns the name of the proxy allocator
 	const char* name() const;
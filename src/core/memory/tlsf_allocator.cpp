@@ -0,0 +1,324 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/memory/memory.h"
+#include "core/memory/tlsf_allocator.h"
+#include <string.h> // memset
+
+#if CROWN_COMPILER_MSVC
+	#include <intrin.h>
+#endif
+
+namespace crown
+{
+namespace tlsf_allocator_internal
+{
+	static const u32 FREE = 1u;
+
+	// Returns the index of the most significant bit set in @a v.
+	static inline u32 fls(u32 v)
+	{
+#if CROWN_COMPILER_MSVC
+		unsigned long index;
+		_BitScanReverse(&index, v);
+		return index;
+#else
+		return 31 - __builtin_clz(v);
+#endif
+	}
+
+	// Returns the index of the least significant bit set in @a v.
+	static inline u32 ffs(u32 v)
+	{
+#if CROWN_COMPILER_MSVC
+		unsigned long index;
+		_BitScanForward(&index, v);
+		return index;
+#else
+		return __builtin_ctz(v);
+#endif
+	}
+
+	static inline u32 block_size(const TlsfAllocator::Block* b)
+	{
+		return b->size & ~FREE;
+	}
+
+	static inline TlsfAllocator::FreeLinks* links(TlsfAllocator::Block* b)
+	{
+		return (TlsfAllocator::FreeLinks*)(b + 1);
+	}
+
+	static inline TlsfAllocator::Block* next_phys(TlsfAllocator::Block* b)
+	{
+		return (TlsfAllocator::Block*)((char*)(b + 1) + block_size(b));
+	}
+
+	static inline TlsfAllocator::Block* block(const void* data)
+	{
+		return (TlsfAllocator::Block*)((char*)data - ((const u32*)data)[-1]);
+	}
+
+	// Returns the free list where blocks of @a size bytes are stored.
+	static inline void mapping(u32 size, u32& fl, u32& sl)
+	{
+		if (size < TlsfAllocator::SMALL_SIZE)
+		{
+			fl = 0;
+			sl = size >> TlsfAllocator::ALIGN_LOG2;
+		}
+		else
+		{
+			const u32 t = fls(size);
+			sl = (size >> (t - TlsfAllocator::SL_INDEX_LOG2)) ^ TlsfAllocator::SL_INDEX_COUNT;
+			fl = t - (TlsfAllocator::FL_INDEX_SHIFT - 1);
+		}
+	}
+
+	// Returns the first free list whose blocks are all at least @a size bytes.
+	static inline void mapping_search(u32 size, u32& fl, u32& sl)
+	{
+		if (size >= TlsfAllocator::SMALL_SIZE)
+			size += (1u << (fls(size) - TlsfAllocator::SL_INDEX_LOG2)) - 1;
+
+		mapping(size, fl, sl);
+	}
+
+} // namespace tlsf_allocator_internal
+
+TlsfAllocator::TlsfAllocator(Allocator& backing, u32 size)
+	: _backing(&backing)
+	, _physical_start(NULL)
+{
+	_physical_start = backing.allocate(size, ALIGN);
+	init(_physical_start, size);
+}
+
+TlsfAllocator::TlsfAllocator(void* start, u32 size)
+	: _backing(NULL)
+	, _physical_start(start)
+{
+	init(start, size);
+}
+
+TlsfAllocator::~TlsfAllocator()
+{
+	CE_ASSERT(_num_allocations == 0
+		, "Missing %d deallocations causing a leak of %d bytes"
+		, _num_allocations
+		, _allocated_size
+		);
+
+	if (_backing)
+		_backing->deallocate(_physical_start);
+}
+
+void TlsfAllocator::init(void* start, u32 size)
+{
+	using namespace tlsf_allocator_internal;
+	CE_STATIC_ASSERT(sizeof(Block) == ALIGN);
+	CE_STATIC_ASSERT(sizeof(FreeLinks) <= ALIGN);
+
+	_total_size = size;
+	_allocated_size = 0;
+	_num_allocations = 0;
+	_fl_bitmap = 0;
+	memset(_sl_bitmap, 0, sizeof(_sl_bitmap));
+	memset(_free, 0, sizeof(_free));
+
+	char* begin = (char*)memory::align_top(start, ALIGN);
+	char* end = (char*)(((uintptr_t)start + size) & ~(uintptr_t)(ALIGN - 1));
+	CE_ASSERT(end > begin && u32(end - begin) >= 2*sizeof(Block) + ALIGN, "Memory too small");
+
+	// One free block spanning the whole memory, followed by an empty block
+	// which is never free and stops the coalescing.
+	Block* b = (Block*)begin;
+	b->prev_phys = NULL;
+	b->size = u32(end - begin - 2*sizeof(Block));
+	b->offset = sizeof(Block);
+
+	Block* sentinel = next_phys(b);
+	sentinel->prev_phys = b;
+	sentinel->size = 0;
+	sentinel->offset = sizeof(Block);
+
+	insert(b);
+}
+
+void TlsfAllocator::insert(Block* b)
+{
+	using namespace tlsf_allocator_internal;
+
+	u32 fl, sl;
+	mapping(block_size(b), fl, sl);
+
+	Block* head = _free[fl][sl];
+	links(b)->next = head;
+	links(b)->prev = NULL;
+	if (head != NULL)
+		links(head)->prev = b;
+
+	_free[fl][sl] = b;
+	_fl_bitmap |= 1u << fl;
+	_sl_bitmap[fl] |= 1u << sl;
+	b->size |= FREE;
+}
+
+void TlsfAllocator::remove(Block* b)
+{
+	using namespace tlsf_allocator_internal;
+
+	u32 fl, sl;
+	mapping(block_size(b), fl, sl);
+
+	Block* next = links(b)->next;
+	Block* prev = links(b)->prev;
+	if (next != NULL)
+		links(next)->prev = prev;
+	if (prev != NULL)
+		links(prev)->next = next;
+
+	if (_free[fl][sl] == b)
+	{
+		_free[fl][sl] = next;
+		if (next == NULL)
+		{
+			_sl_bitmap[fl] &= ~(1u << sl);
+			if (_sl_bitmap[fl] == 0)
+				_fl_bitmap &= ~(1u << fl);
+		}
+	}
+
+	b->size &= ~FREE;
+}
+
+void* TlsfAllocator::allocate(u32 size, u32 align)
+{
+	using namespace tlsf_allocator_internal;
+
+	// Out of memory
+	if (size > _total_size)
+		return NULL;
+
+	u32 actual_size = size < ALIGN ? u32(ALIGN) : (size + ALIGN - 1) & ~(ALIGN - 1);
+	if (align > ALIGN)
+		actual_size += align;
+
+	// Find the first non-empty free list whose blocks are all large enough
+	u32 fl, sl;
+	mapping_search(actual_size, fl, sl);
+
+	u32 sl_map = _sl_bitmap[fl] & (~0u << sl);
+	if (sl_map == 0)
+	{
+		const u32 fl_map = _fl_bitmap & (~0u << (fl + 1));
+
+		// Out of memory
+		if (fl_map == 0)
+			return NULL;
+
+		fl = ffs(fl_map);
+		sl_map = _sl_bitmap[fl];
+	}
+	sl = ffs(sl_map);
+
+	Block* b = _free[fl][sl];
+	remove(b);
+
+	// Return the excess to the free lists
+	const u32 bs = block_size(b);
+	if (bs >= actual_size + sizeof(Block) + ALIGN)
+	{
+		Block* rest = (Block*)((char*)(b + 1) + actual_size);
+		rest->prev_phys = b;
+		rest->size = u32(bs - actual_size - sizeof(Block));
+		rest->offset = sizeof(Block);
+		next_phys(rest)->prev_phys = rest;
+		b->size = actual_size;
+		insert(rest);
+	}
+
+	void* data = memory::align_top(b + 1, align);
+	((u32*)data)[-1] = u32((char*)data - (char*)b);
+
+	_allocated_size += block_size(b);
+	_num_allocations++;
+
+	return data;
+}
+
+void TlsfAllocator::deallocate(void* data)
+{
+	using namespace tlsf_allocator_internal;
+
+	if (!data)
+		return;
+
+	Block* b = block(data);
+	CE_ASSERT((b->size & FREE) == 0, "Double deallocation");
+	CE_ASSERT(_num_allocations > 0, "Did not allocate");
+
+	_allocated_size -= block_size(b);
+	_num_allocations--;
+
+	b->offset = sizeof(Block);
+
+	// Coalesce with the neighbors
+	Block* prev = b->prev_phys;
+	if (prev != NULL && (prev->size & FREE))
+	{
+		remove(prev);
+		prev->size += u32(sizeof(Block) + block_size(b));
+		next_phys(prev)->prev_phys = prev;
+		b = prev;
+	}
+
+	Block* next = next_phys(b);
+	if (next->size & FREE)
+	{
+		remove(next);
+		b->size += u32(sizeof(Block) + block_size(next));
+		next_phys(b)->prev_phys = b;
+	}
+
+	insert(b);
+}
+
+u32 TlsfAllocator::allocated_size(const void* ptr)
+{
+	using namespace tlsf_allocator_internal;
+
+	const Block* b = block(ptr);
+	return block_size(b) - (((const u32*)ptr)[-1] - sizeof(Block));
+}
+
+void TlsfAllocator::stats(Stats& stats)
+{
+	using namespace tlsf_allocator_internal;
+
+	stats.free_size = 0;
+	stats.largest_free_block = 0;
+	stats.num_free_blocks = 0;
+	stats.num_allocations = _num_allocations;
+
+	for (Block* b = (Block*)memory::align_top(_physical_start, ALIGN); b->size != 0; b = next_phys(b))
+	{
+		if ((b->size & FREE) == 0)
+			continue;
+
+		const u32 bs = block_size(b);
+		stats.free_size += bs;
+		stats.largest_free_block = bs > stats.largest_free_block ? bs : stats.largest_free_block;
+		stats.num_free_blocks++;
+	}
+
+	stats.fragmentation = stats.free_size > 0
+		? 1.0f - f32(stats.largest_free_block) / f32(stats.free_size)
+		: 0.0f
+		;
+}
+
+} // namespace crown
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/memory/allocator.h"
+
+namespace crown
+{
+/// Allocates variable-size memory blocks from a fixed chunk of memory
+/// using a Two-Level Segregated Fit scheme: both allocate() and
+/// deallocate() run in constant time regardless of the number of blocks.
+///
+/// @ingroup Memory
+struct TlsfAllocator : public Allocator
+{
+	struct Block
+	{
+		Block* prev_phys; ///< Previous block in memory, NULL for the first one.
+#if CROWN_ARCH_32BIT
+		u32 _pad;
+#endif
+		u32 size;         ///< Size of the data that follows, bit 0 is set when the block is free.
+		u32 offset;       ///< Distance from the block to its data.
+	};
+
+	struct FreeLinks
+	{
+		Block* next;
+		Block* prev;
+	};
+
+	/// Fragmentation statistics.
+	struct Stats
+	{
+		u32 free_size;          ///< Total number of free bytes.
+		u32 largest_free_block; ///< Size of the largest free block.
+		u32 num_free_blocks;
+		u32 num_allocations;
+		f32 fragmentation;      ///< 1 - largest_free_block/free_size.
+	};
+
+	enum
+	{
+		ALIGN_LOG2     = 4,
+		ALIGN          = 1 << ALIGN_LOG2,
+		SL_INDEX_LOG2  = 5,
+		SL_INDEX_COUNT = 1 << SL_INDEX_LOG2,
+		FL_INDEX_SHIFT = SL_INDEX_LOG2 + ALIGN_LOG2,
+		FL_INDEX_COUNT = 32 - FL_INDEX_SHIFT + 1,
+		SMALL_SIZE     = 1 << FL_INDEX_SHIFT
+	};
+
+	Allocator* _backing;
+	void* _physical_start;
+	u32 _total_size;
+	u32 _allocated_size;
+	u32 _num_allocations;
+	u32 _fl_bitmap;
+	u32 _sl_bitmap[FL_INDEX_COUNT];
+	Block* _free[FL_INDEX_COUNT][SL_INDEX_COUNT];
+
+	/// Allocates @a size bytes from @a backing.
+	TlsfAllocator(Allocator& backing, u32 size);
+
+	/// Uses @a size bytes of memory from @a start.
+	TlsfAllocator(void* start, u32 size);
+	~TlsfAllocator();
+
+	/// @copydoc Allocator::allocate()
+	/// @note
+	/// Returns NULL if there is no free block large enough.
+	void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN);
+
+	/// @copydoc Allocator::deallocate()
+	void deallocate(void* data);
+
+	/// @copydoc Allocator::allocated_size()
+	u32 allocated_size(const void* ptr);
+
+	/// @copydoc Allocator::total_allocated()
+	u32 total_allocated() { return _allocated_size; }
+
+	/// Returns the fragmentation statistics in @a stats.
+	/// @note
+	/// Walks every block, intended for debugging and profiling only.
+	void stats(Stats& stats);
+
+	void init(void* start, u32 size);
+	void insert(Block* b);
+	void remove(Block* b);
+};
+
+} // namespace crown
@@ -12,4 +12,79 @@ namespace crown
 u32 murmur32(const void* key, u32 len, u32 seed);
 u64 murmur64(const void* key, u32 len, u64 seed);
 
+namespace murmur_internal
+{
+	// Compile-time versions of murmur32() and murmur64(). They read the
+	// input as little-endian and must produce the very same hashes.
+	static const u32 M32 = 0x5bd1e995u;
+	static const u64 M64 = 0xc6a4a7935bd1e995ull;
+
+	constexpr u32 byte(const char* s, u32 i)
+	{
+		return u32(u8(s[i]));
+	}
+
+	constexpr u32 load32(const char* s, u32 i)
+	{
+		return byte(s, i) | byte(s, i+1) << 8 | byte(s, i+2) << 16 | byte(s, i+3) << 24;
+	}
+
+	constexpr u64 load64(const char* s, u32 i, u32 n)
+	{
+		return n == 0 ? 0 : u64(byte(s, i+n-1)) << (8*(n-1)) | load64(s, i, n-1);
+	}
+
+	constexpr u32 shift_mix32(u32 k, u32 r)
+	{
+		return (k ^ (k >> r)) * M32;
+	}
+
+	constexpr u64 shift_mix64(u64 k)
+	{
+		return (k ^ (k >> 47)) * M64;
+	}
+
+	constexpr u32 tail32(const char* s, u32 i, u32 n)
+	{
+		return n == 3 ? byte(s, i+2) << 16 | byte(s, i+1) << 8 | byte(s, i)
+			: n == 2 ? byte(s, i+1) << 8 | byte(s, i)
+			: byte(s, i)
+			;
+	}
+
+	constexpr u32 final32(u32 h)
+	{
+		return shift_mix32(h, 13) ^ (shift_mix32(h, 13) >> 15);
+	}
+
+	constexpr u32 body32(const char* s, u32 i, u32 len, u32 h)
+	{
+		return len - i >= 4 ? body32(s, i+4, len, (h * M32) ^ shift_mix32(load32(s, i) * M32, 24))
+			: len - i == 0 ? final32(h)
+			: final32((h ^ tail32(s, i, len - i)) * M32)
+			;
+	}
+
+	constexpr u64 body64(const char* s, u32 i, u32 len, u64 h)
+	{
+		return len - i >= 8 ? body64(s, i+8, len, (h ^ shift_mix64(load64(s, i, 8) * M64)) * M64)
+			: len - i == 0 ? shift_mix64(h) ^ (shift_mix64(h) >> 47)
+			: body64(s, len, len, (h ^ load64(s, i, len - i)) * M64)
+			;
+	}
+
+	/// Returns the same value as murmur32(str, len, seed), at compile time.
+	constexpr u32 murmur32(const char* str, u32 len, u32 seed)
+	{
+		return body32(str, 0, len, seed ^ len);
+	}
+
+	/// Returns the same value as murmur64(str, len, seed), at compile time.
+	constexpr u64 murmur64(const char* str, u32 len, u64 seed)
+	{
+		return body64(str, 0, len, seed ^ (u64(len) * M64));
+	}
+
+} // namespace murmur_internal
+
 } // namespace crown
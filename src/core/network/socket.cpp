@@ -7,6 +7,9 @@
 #include "core/network/ip_address.h"
 #include "core/network/socket.h"
 #include "core/platform.h"
+#include <string.h> // memset
+
+#define CROWN_SOCKET_POLLER_EPOLL (CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID)
 
 #if CROWN_PLATFORM_POSIX
 	#include <errno.h>
@@ -14,6 +17,12 @@
 	#include <netinet/in.h> // htons, htonl, ...
 	#include <sys/socket.h>
 	#include <unistd.h>     // close
+	#if CROWN_SOCKET_POLLER_EPOLL
+		#include <sys/epoll.h>
+		#include <sys/eventfd.h>
+	#else
+		#include <poll.h>
+	#endif // CROWN_SOCKET_POLLER_EPOLL
 	typedef int SOCKET;
 	#define INVALID_SOCKET (-1)
 	#define SOCKET_ERROR (-1)
@@ -22,8 +31,15 @@
 	#define WSAECONNREFUSED ECONNREFUSED
 	#define WSAETIMEDOUT ETIMEDOUT
 	#define WSAEWOULDBLOCK EWOULDBLOCK
+	#ifndef MSG_NOSIGNAL
+		#define MSG_NOSIGNAL 0
+	#endif // MSG_NOSIGNAL
 #elif CROWN_PLATFORM_WINDOWS
 	#include <winsock2.h>
+	typedef int socklen_t;
+	typedef WSAPOLLFD pollfd;
+	#define poll WSAPoll
+	#define MSG_NOSIGNAL 0
 #endif // CROWN_PLATFORM_POSIX
 
 namespace crown
@@ -46,6 +62,18 @@ struct Private
 	SOCKET socket;
 };
 
+struct PollerPrivate
+{
+#if CROWN_SOCKET_POLLER_EPOLL
+	int epoll;
+	int event; ///< eventfd written by wakeup().
+#else
+	pollfd fds[1 + SOCKET_POLLER_MAX_SOCKETS]; ///< fds[0] is the socket written by wakeup().
+	void* user_data[1 + SOCKET_POLLER_MAX_SOCKETS];
+	u32 num;
+#endif
+};
+
 namespace socket_internal
 {
 	SOCKET open()
@@ -55,6 +83,19 @@ namespace socket_internal
 		return socket;
 	}
 
+	void set_blocking(SOCKET socket, bool blocking)
+	{
+#if CROWN_PLATFORM_POSIX
+		int flags = fcntl(socket, F_GETFL, 0);
+		fcntl(socket, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : O_NONBLOCK);
+#elif CROWN_PLATFORM_WINDOWS
+		u_long non_blocking = blocking ? 0 : 1;
+		int err = ioctlsocket(socket, FIONBIO, &non_blocking);
+		CE_ASSERT(err == 0, "ioctlsocket: last_error() = %d", last_error());
+		CE_UNUSED(err);
+#endif
+	}
+
 	AcceptResult accept(SOCKET socket, TCPSocket& c)
 	{
 		SOCKET err = ::accept(socket, NULL, NULL);
@@ -130,7 +171,7 @@ namespace socket_internal
 			int bytes_wrote = ::send(socket
 				, (char*)data + wr.bytes_wrote
 				, to_write
-				, 0
+				, MSG_NOSIGNAL
 				);
 
 			if (bytes_wrote == SOCKET_ERROR)
@@ -294,16 +335,7 @@ WriteResult TCPSocket::write_nonblock(const void* data, u32 size)
 void TCPSocket::set_blocking(bool blocking)
 {
 	Private* priv = (Private*)_data;
-
-#if CROWN_PLATFORM_POSIX
-	int flags = fcntl(priv->socket, F_GETFL, 0);
-	fcntl(priv->socket, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : O_NONBLOCK);
-#elif CROWN_PLATFORM_WINDOWS
-	u_long non_blocking = blocking ? 0 : 1;
-	int err = ioctlsocket(priv->socket, FIONBIO, &non_blocking);
-	CE_ASSERT(err == 0, "ioctlsocket: last_error() = %d", last_error());
-	CE_UNUSED(err);
-#endif
+	socket_internal::set_blocking(priv->socket, blocking);
 }
 
 void TCPSocket::set_reuse_address(bool reuse)
@@ -331,4 +363,488 @@ void TCPSocket::set_timeout(u32 seconds)
 	CE_UNUSED(err);
 }
 
+namespace udp_socket_internal
+{
+	static void to_sockaddr(sockaddr_in& addr, const IPAddress& ip, u16 port)
+	{
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(ip.address());
+		addr.sin_port = htons(port);
+	}
+
+	static void from_sockaddr(const sockaddr_in& addr, IPAddress& ip, u16& port)
+	{
+		const u32 a = ntohl(addr.sin_addr.s_addr);
+		ip.a = u8(a >> 24);
+		ip.b = u8(a >> 16);
+		ip.c = u8(a >> 8);
+		ip.d = u8(a);
+		port = ntohs(addr.sin_port);
+	}
+
+} // namespace udp_socket_internal
+
+UDPSocket::UDPSocket()
+{
+	CE_STATIC_ASSERT(sizeof(_data) >= sizeof(SOCKET));
+	Private* priv = (Private*)_data;
+	priv->socket = INVALID_SOCKET;
+}
+
+void UDPSocket::close()
+{
+	Private* priv = (Private*)_data;
+
+	if (priv->socket != INVALID_SOCKET)
+	{
+		::closesocket(priv->socket);
+		priv->socket = INVALID_SOCKET;
+	}
+}
+
+BindResult UDPSocket::bind(u16 port)
+{
+	Private* priv = (Private*)_data;
+
+	close();
+	priv->socket = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	CE_ASSERT(priv->socket != INVALID_SOCKET, "socket: last_error() = %d", last_error());
+	socket_internal::set_blocking(priv->socket, false);
+
+	sockaddr_in address;
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	int err = ::bind(priv->socket, (const sockaddr*)&address, sizeof(sockaddr_in));
+
+	BindResult br;
+	br.error = BindResult::SUCCESS;
+
+	if (err == SOCKET_ERROR)
+	{
+		if (last_error() == WSAEADDRINUSE)
+			br.error = BindResult::ADDRESS_IN_USE;
+		else
+			br.error = BindResult::UNKNOWN;
+	}
+
+	return br;
+}
+
+u16 UDPSocket::port()
+{
+	Private* priv = (Private*)_data;
+
+	sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	if (::getsockname(priv->socket, (sockaddr*)&addr, &addr_len) == SOCKET_ERROR)
+		return 0;
+
+	return ntohs(addr.sin_port);
+}
+
+WriteResult UDPSocket::send(const IPAddress& ip, u16 port, const void* data, u32 size)
+{
+	Private* priv = (Private*)_data;
+
+	sockaddr_in addr;
+	udp_socket_internal::to_sockaddr(addr, ip, port);
+
+	int bytes_wrote = ::sendto(priv->socket
+		, (const char*)data
+		, size
+		, MSG_NOSIGNAL
+		, (const sockaddr*)&addr
+		, sizeof(addr)
+		);
+
+	WriteResult wr;
+	wr.error = WriteResult::SUCCESS;
+	wr.bytes_wrote = 0;
+
+	if (bytes_wrote == SOCKET_ERROR)
+	{
+		if (last_error() == WSAEWOULDBLOCK)
+			wr.error = WriteResult::WOULDBLOCK;
+		else
+			wr.error = WriteResult::UNKNOWN;
+	}
+	else
+	{
+		wr.bytes_wrote = (u32)bytes_wrote;
+	}
+
+	return wr;
+}
+
+ReadResult UDPSocket::receive(void* data, u32 size, IPAddress& ip, u16& port)
+{
+	Private* priv = (Private*)_data;
+
+	sockaddr_in addr;
+	socklen_t addr_len = sizeof(addr);
+	int bytes_read = ::recvfrom(priv->socket
+		, (char*)data
+		, size
+		, 0
+		, (sockaddr*)&addr
+		, &addr_len
+		);
+
+	ReadResult rr;
+	rr.error = ReadResult::SUCCESS;
+	rr.bytes_read = 0;
+
+	if (bytes_read == SOCKET_ERROR)
+	{
+		if (last_error() == WSAEWOULDBLOCK)
+			rr.error = ReadResult::WOULDBLOCK;
+		else
+			rr.error = ReadResult::UNKNOWN;
+	}
+	else
+	{
+		rr.bytes_read = (u32)bytes_read;
+		udp_socket_internal::from_sockaddr(addr, ip, port);
+	}
+
+	return rr;
+}
+
+#if CROWN_PLATFORM_LINUX
+u32 UDPSocket::send(const UDPDatagram* datagrams, u32 num)
+{
+	Private* priv = (Private*)_data;
+
+	const u32 BATCH_SIZE = 64;
+	mmsghdr msgs[BATCH_SIZE];
+	iovec iovs[BATCH_SIZE];
+	sockaddr_in addrs[BATCH_SIZE];
+
+	u32 num_sent = 0;
+	while (num_sent < num)
+	{
+		const u32 n = num - num_sent < BATCH_SIZE ? num - num_sent : BATCH_SIZE;
+		for (u32 i = 0; i < n; ++i)
+		{
+			const UDPDatagram& dg = datagrams[num_sent + i];
+			udp_socket_internal::to_sockaddr(addrs[i], dg.ip, dg.port);
+			iovs[i].iov_base = dg.data;
+			iovs[i].iov_len = dg.size;
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		const int sent = ::sendmmsg(priv->socket, msgs, n, MSG_NOSIGNAL);
+		if (sent <= 0)
+			break;
+
+		num_sent += (u32)sent;
+		if ((u32)sent < n)
+			break;
+	}
+
+	return num_sent;
+}
+
+u32 UDPSocket::receive(UDPDatagram* datagrams, u32 num)
+{
+	Private* priv = (Private*)_data;
+
+	const u32 BATCH_SIZE = 64;
+	mmsghdr msgs[BATCH_SIZE];
+	iovec iovs[BATCH_SIZE];
+	sockaddr_in addrs[BATCH_SIZE];
+
+	u32 num_received = 0;
+	while (num_received < num)
+	{
+		const u32 n = num - num_received < BATCH_SIZE ? num - num_received : BATCH_SIZE;
+		for (u32 i = 0; i < n; ++i)
+		{
+			UDPDatagram& dg = datagrams[num_received + i];
+			iovs[i].iov_base = dg.data;
+			iovs[i].iov_len = dg.size;
+			memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		const int received = ::recvmmsg(priv->socket, msgs, n, MSG_DONTWAIT, NULL);
+		if (received <= 0)
+			break;
+
+		for (int i = 0; i < received; ++i)
+		{
+			UDPDatagram& dg = datagrams[num_received + i];
+			dg.size = msgs[i].msg_len;
+			udp_socket_internal::from_sockaddr(addrs[i], dg.ip, dg.port);
+		}
+
+		num_received += (u32)received;
+		if ((u32)received < n)
+			break;
+	}
+
+	return num_received;
+}
+#else
+u32 UDPSocket::send(const UDPDatagram* datagrams, u32 num)
+{
+	u32 num_sent = 0;
+	for (; num_sent < num; ++num_sent)
+	{
+		const UDPDatagram& dg = datagrams[num_sent];
+		if (send(dg.ip, dg.port, dg.data, dg.size).error != WriteResult::SUCCESS)
+			break;
+	}
+	return num_sent;
+}
+
+u32 UDPSocket::receive(UDPDatagram* datagrams, u32 num)
+{
+	u32 num_received = 0;
+	for (; num_received < num; ++num_received)
+	{
+		UDPDatagram& dg = datagrams[num_received];
+		ReadResult rr = receive(dg.data, dg.size, dg.ip, dg.port);
+		if (rr.error != ReadResult::SUCCESS)
+			break;
+		dg.size = rr.bytes_read;
+	}
+	return num_received;
+}
+#endif // CROWN_PLATFORM_LINUX
+
+#if CROWN_SOCKET_POLLER_EPOLL
+SocketPoller::SocketPoller()
+{
+	CE_STATIC_ASSERT(sizeof(_data) >= sizeof(PollerPrivate));
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	priv->epoll = epoll_create1(EPOLL_CLOEXEC);
+	CE_ASSERT(priv->epoll != -1, "epoll_create1: errno = %d", errno);
+	priv->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	CE_ASSERT(priv->event != -1, "eventfd: errno = %d", errno);
+
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = priv;
+	int err = epoll_ctl(priv->epoll, EPOLL_CTL_ADD, priv->event, &ev);
+	CE_ASSERT(err == 0, "epoll_ctl: errno = %d", errno);
+	CE_UNUSED(err);
+}
+
+SocketPoller::~SocketPoller()
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+	::close(priv->event);
+	::close(priv->epoll);
+}
+
+bool SocketPoller::add(const TCPSocket& socket, void* user_data, bool write)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	epoll_event ev;
+	ev.events = write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = user_data;
+	return epoll_ctl(priv->epoll, EPOLL_CTL_ADD, ((Private*)socket._data)->socket, &ev) == 0;
+}
+
+void SocketPoller::modify(const TCPSocket& socket, void* user_data, bool write)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	epoll_event ev;
+	ev.events = write ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = user_data;
+	epoll_ctl(priv->epoll, EPOLL_CTL_MOD, ((Private*)socket._data)->socket, &ev);
+}
+
+void SocketPoller::remove(const TCPSocket& socket)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	epoll_event ev; // Kernels before 2.6.9 require a non-NULL event.
+	epoll_ctl(priv->epoll, EPOLL_CTL_DEL, ((Private*)socket._data)->socket, &ev);
+}
+
+u32 SocketPoller::wait(PollEvent* events, u32 max, s32 timeout_ms)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	epoll_event evs[SOCKET_POLLER_MAX_SOCKETS];
+	const int n = epoll_wait(priv->epoll, evs, max < countof(evs) ? max : countof(evs), timeout_ms);
+
+	u32 num = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		if (evs[i].data.ptr == priv)
+		{
+			u64 val;
+			ssize_t bytes_read = ::read(priv->event, &val, sizeof(val));
+			CE_UNUSED(bytes_read);
+			continue;
+		}
+
+		events[num].flags = 0;
+		events[num].flags |= (evs[i].events & EPOLLIN) ? PollEvent::READ : 0;
+		events[num].flags |= (evs[i].events & EPOLLOUT) ? PollEvent::WRITE : 0;
+		events[num].flags |= (evs[i].events & (EPOLLHUP | EPOLLERR)) ? PollEvent::HANGUP : 0;
+		events[num].user_data = evs[i].data.ptr;
+		++num;
+	}
+
+	return num;
+}
+
+void SocketPoller::wakeup()
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	const u64 val = 1;
+	ssize_t bytes_wrote = ::write(priv->event, &val, sizeof(val));
+	CE_UNUSED(bytes_wrote);
+}
+#else
+namespace socket_poller_internal
+{
+	// Returns the index of @a socket in @a priv->fds or UINT32_MAX.
+	static u32 find(const PollerPrivate* priv, const TCPSocket& socket)
+	{
+		const SOCKET s = ((Private*)socket._data)->socket;
+		for (u32 i = 1; i < priv->num; ++i)
+		{
+			if (priv->fds[i].fd == s)
+				return i;
+		}
+		return UINT32_MAX;
+	}
+
+} // namespace socket_poller_internal
+
+SocketPoller::SocketPoller()
+{
+	CE_STATIC_ASSERT(sizeof(_data) >= sizeof(PollerPrivate));
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	// wakeup() sends a datagram to a socket connected to itself, because
+	// WSAPoll() only watches sockets.
+	SOCKET s = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	CE_ASSERT(s != INVALID_SOCKET, "socket: last_error() = %d", last_error());
+
+	sockaddr_in addr;
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	socklen_t addr_len = sizeof(addr);
+	int err = ::bind(s, (const sockaddr*)&addr, sizeof(addr));
+	CE_ASSERT(err == 0, "bind: last_error() = %d", last_error());
+	err = ::getsockname(s, (sockaddr*)&addr, &addr_len);
+	CE_ASSERT(err == 0, "getsockname: last_error() = %d", last_error());
+	err = ::connect(s, (const sockaddr*)&addr, sizeof(addr));
+	CE_ASSERT(err == 0, "connect: last_error() = %d", last_error());
+	CE_UNUSED(err);
+	socket_internal::set_blocking(s, false);
+
+	priv->fds[0].fd = s;
+	priv->fds[0].events = POLLIN;
+	priv->user_data[0] = NULL;
+	priv->num = 1;
+}
+
+SocketPoller::~SocketPoller()
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+	::closesocket(priv->fds[0].fd);
+}
+
+bool SocketPoller::add(const TCPSocket& socket, void* user_data, bool write)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+	if (priv->num == countof(priv->fds))
+		return false;
+
+	priv->fds[priv->num].fd = ((Private*)socket._data)->socket;
+	priv->fds[priv->num].events = POLLIN | (write ? POLLOUT : 0);
+	priv->fds[priv->num].revents = 0;
+	priv->user_data[priv->num] = user_data;
+	++priv->num;
+	return true;
+}
+
+void SocketPoller::modify(const TCPSocket& socket, void* user_data, bool write)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	const u32 i = socket_poller_internal::find(priv, socket);
+	if (i == UINT32_MAX)
+		return;
+
+	priv->fds[i].events = POLLIN | (write ? POLLOUT : 0);
+	priv->user_data[i] = user_data;
+}
+
+void SocketPoller::remove(const TCPSocket& socket)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	const u32 i = socket_poller_internal::find(priv, socket);
+	if (i == UINT32_MAX)
+		return;
+
+	--priv->num;
+	priv->fds[i] = priv->fds[priv->num];
+	priv->user_data[i] = priv->user_data[priv->num];
+}
+
+u32 SocketPoller::wait(PollEvent* events, u32 max, s32 timeout_ms)
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	const int n = ::poll(priv->fds, priv->num, timeout_ms);
+	if (n <= 0)
+		return 0;
+
+	if (priv->fds[0].revents != 0)
+	{
+		char buf[64];
+		while (::recv(priv->fds[0].fd, buf, sizeof(buf), 0) > 0)
+			;
+	}
+
+	u32 num = 0;
+	for (u32 i = 1; i < priv->num && num < max; ++i)
+	{
+		const short re = priv->fds[i].revents;
+		if (re == 0)
+			continue;
+
+		events[num].flags = 0;
+		events[num].flags |= (re & POLLIN) ? PollEvent::READ : 0;
+		events[num].flags |= (re & POLLOUT) ? PollEvent::WRITE : 0;
+		events[num].flags |= (re & (POLLHUP | POLLERR | POLLNVAL)) ? PollEvent::HANGUP : 0;
+		events[num].user_data = priv->user_data[i];
+		++num;
+	}
+
+	return num;
+}
+
+void SocketPoller::wakeup()
+{
+	PollerPrivate* priv = (PollerPrivate*)_data;
+
+	const char val = 0;
+	::send(priv->fds[0].fd, &val, 1, 0);
+}
+#endif // CROWN_SOCKET_POLLER_EPOLL
+
 } // namespace crown
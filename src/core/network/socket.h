@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "core/network/ip_address.h"
 #include "core/network/types.h"
 #include "core/types.h"
 
@@ -117,4 +118,114 @@ struct TCPSocket
 	void set_timeout(u32 seconds);
 };
 
+/// Datagram sent or received by UDPSocket.
+///
+/// @ingroup Network
+struct UDPDatagram
+{
+	IPAddress ip;
+	u16 port;
+	void* data;
+	u32 size;
+};
+
+/// UDP socket. The socket is non-blocking.
+///
+/// @ingroup Network
+struct UDPSocket
+{
+	CE_ALIGN_DECL(16, u8 _data[8]);
+
+	///
+	UDPSocket();
+
+	/// Closes the socket.
+	void close();
+
+	/// Binds the socket to @a port, or to any free port if it is 0, and
+	/// returns the result.
+	BindResult bind(u16 port);
+
+	/// Returns the port the socket is bound to.
+	u16 port();
+
+	/// Sends the @a size bytes of @a data to @a ip and @a port and returns
+	/// the result.
+	WriteResult send(const IPAddress& ip, u16 port, const void* data, u32 size);
+
+	/// Receives a datagram in the @a size bytes of @a data and writes its
+	/// sender to @a ip and @a port. Returns WOULDBLOCK if there is none.
+	ReadResult receive(void* data, u32 size, IPAddress& ip, u16& port);
+
+	/// Sends the @a num @a datagrams and returns how many have been sent.
+	/// Uses sendmmsg() on Linux.
+	u32 send(const UDPDatagram* datagrams, u32 num);
+
+	/// Receives at most @a num datagrams and returns how many have been
+	/// received. The i-th one is stored in the @a datagrams[i].size bytes
+	/// of @a datagrams[i].data, with its size and sender written back to
+	/// @a datagrams[i]. Uses recvmmsg() on Linux.
+	u32 receive(UDPDatagram* datagrams, u32 num);
+};
+
+/// Maximum number of sockets watched by a SocketPoller.
+const u32 SOCKET_POLLER_MAX_SOCKETS = 64;
+
+/// Event returned by SocketPoller::wait().
+///
+/// @ingroup Network
+struct PollEvent
+{
+	enum
+	{
+		READ   = 1 << 0, ///< The socket has data to read or a connection to accept.
+		WRITE  = 1 << 1, ///< The socket can be written without blocking.
+		HANGUP = 1 << 2  ///< The connection has been closed or has failed.
+	};
+
+	u32 flags;
+	void* user_data;
+};
+
+/// Waits for any of a set of sockets to become ready. Uses epoll on Linux
+/// and Android, and poll() or WSAPoll() elsewhere.
+///
+/// @ingroup Network
+struct SocketPoller
+{
+	CE_ALIGN_DECL(16, u8 _data[2048]);
+
+	///
+	SocketPoller();
+
+	///
+	~SocketPoller();
+
+	///
+	SocketPoller(const SocketPoller&) = delete;
+
+	///
+	SocketPoller& operator=(const SocketPoller&) = delete;
+
+	/// Watches @a socket for reading, and for writing too if @a write is
+	/// true. The events of @a socket are returned with @a user_data.
+	/// Returns false if SOCKET_POLLER_MAX_SOCKETS sockets are already watched.
+	bool add(const TCPSocket& socket, void* user_data, bool write = false);
+
+	/// Sets whether @a socket is watched for writing.
+	void modify(const TCPSocket& socket, void* user_data, bool write);
+
+	/// Stops watching @a socket.
+	void remove(const TCPSocket& socket);
+
+	/// Waits at most @a timeout_ms milliseconds, or forever if it is
+	/// negative, for events and writes at most @a max of them to @a events.
+	/// Returns the number of events written.
+	u32 wait(PollEvent* events, u32 max, s32 timeout_ms);
+
+	/// Makes the wait() in progress, or the next one, return. Can be called
+	/// from any thread.
+	void wakeup();
+};
+
 } // namespace crown
@@ -17,9 +17,11 @@
 	#include <dirent.h>   // opendir, readdir
 	#include <dlfcn.h>    // dlopen, dlclose, dlsym
 	#include <errno.h>
-	#include <stdio.h>    // fputs
+	#include <stdio.h>    // fputs, rename
+	#include <fcntl.h>    // open
 	#include <stdlib.h>   // getenv
 	#include <string.h>   // memset
+	#include <sys/mman.h> // mmap, munmap
 	#include <sys/wait.h> // wait
 	#include <time.h>     // clock_gettime
 	#include <unistd.h>   // unlink, rmdir, getcwd, fork, execv
@@ -160,6 +162,15 @@ namespace os
 #endif
 	}
 
+	bool rename(const char* old_path, const char* new_path)
+	{
+#if CROWN_PLATFORM_POSIX
+		return ::rename(old_path, new_path) == 0;
+#elif CROWN_PLATFORM_WINDOWS
+		return MoveFileEx(old_path, new_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#endif
+	}
+
 	void create_directory(const char* path)
 	{
 #if CROWN_PLATFORM_POSIX
@@ -186,6 +197,134 @@ namespace os
 #endif
 	}
 
+	const void* map_file(const char* path, u32& size)
+	{
+		size = 0;
+#if CROWN_PLATFORM_POSIX
+		int fd = ::open(path, O_RDONLY);
+		if (fd == -1)
+			return NULL;
+
+		struct stat buf;
+		if (fstat(fd, &buf) != 0 || buf.st_size == 0)
+		{
+			::close(fd);
+			return NULL;
+		}
+
+		void* data = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd); // The mapping keeps a reference to the file
+		if (data == MAP_FAILED)
+			return NULL;
+
+		size = (u32)buf.st_size;
+		return data;
+#elif CROWN_PLATFORM_WINDOWS
+		HANDLE file = CreateFile(path
+			, GENERIC_READ
+			, FILE_SHARE_READ
+			, NULL
+			, OPEN_EXISTING
+			, FILE_ATTRIBUTE_NORMAL
+			, NULL
+			);
+		if (file == INVALID_HANDLE_VALUE)
+			return NULL;
+
+		const DWORD file_size = GetFileSize(file, NULL);
+		if (file_size == 0 || file_size == INVALID_FILE_SIZE)
+		{
+			CloseHandle(file);
+			return NULL;
+		}
+
+		HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		CloseHandle(file);
+		if (mapping == NULL)
+			return NULL;
+
+		void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); // The view keeps a reference to the mapping
+		if (data == NULL)
+			return NULL;
+
+		size = (u32)file_size;
+		return data;
+#endif
+	}
+
+	void unmap_file(const void* data, u32 size)
+	{
+#if CROWN_PLATFORM_POSIX
+		int err = munmap((void*)data, size);
+		CE_ASSERT(err == 0, "munmap: errno = %d", errno);
+		CE_UNUSED(err);
+#elif CROWN_PLATFORM_WINDOWS
+		BOOL err = UnmapViewOfFile(data);
+		CE_ASSERT(err != 0, "UnmapViewOfFile: GetLastError = %d", GetLastError());
+		CE_UNUSED(err);
+		CE_UNUSED(size);
+#endif
+	}
+
+	void* map_pages(u32 size, bool huge, bool& huge_mapped)
+	{
+		huge_mapped = false;
+#if CROWN_PLATFORM_POSIX
+	#if defined(MAP_HUGETLB)
+		if (huge)
+		{
+			void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+			if (data != MAP_FAILED)
+			{
+				huge_mapped = true;
+				return data;
+			}
+		}
+	#endif // MAP_HUGETLB
+
+		void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (data == MAP_FAILED)
+			return NULL;
+
+	#if defined(MADV_HUGEPAGE)
+		// No huge pages reserved: let the kernel back the memory with
+		// transparent huge pages if it can
+		if (huge)
+			madvise(data, size, MADV_HUGEPAGE);
+	#endif // MADV_HUGEPAGE
+		return data;
+#elif CROWN_PLATFORM_WINDOWS
+		// Large pages need the SeLockMemoryPrivilege
+		const SIZE_T large_page = GetLargePageMinimum();
+		if (huge && large_page != 0 && size % large_page == 0)
+		{
+			void* data = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (data != NULL)
+			{
+				huge_mapped = true;
+				return data;
+			}
+		}
+
+		return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#endif
+	}
+
+	void unmap_pages(void* data, u32 size)
+	{
+#if CROWN_PLATFORM_POSIX
+		int err = munmap(data, size);
+		CE_ASSERT(err == 0, "munmap: errno = %d", errno);
+		CE_UNUSED(err);
+#elif CROWN_PLATFORM_WINDOWS
+		BOOL err = VirtualFree(data, 0, MEM_RELEASE);
+		CE_ASSERT(err != 0, "VirtualFree: GetLastError = %d", GetLastError());
+		CE_UNUSED(err);
+		CE_UNUSED(size);
+#endif
+	}
+
 	const char* getcwd(char* buf, u32 size)
 	{
 #if CROWN_PLATFORM_POSIX
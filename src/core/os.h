@@ -60,12 +60,34 @@ namespace os
 	/// Deletes the file at @a path.
 	void delete_file(const char* path);
 
+	/// Renames the file @a old_path to @a new_path, replacing
+	/// @a new_path if it exists. Returns whether the file has been renamed.
+	bool rename(const char* old_path, const char* new_path);
+
 	/// Creates a directory named @a path.
 	void create_directory(const char* path);
 
 	/// Deletes the directory at @a path.
 	void delete_directory(const char* path);
 
+	/// Maps the whole file at @a path into memory for reading and returns
+	/// its address, or NULL if the file cannot be mapped. The size of the
+	/// mapping is returned in @a size.
+	const void* map_file(const char* path, u32& size);
+
+	/// Unmaps the @a data of @a size bytes previously returned by map_file().
+	void unmap_file(const void* data, u32 size);
+
+	/// Maps @a size bytes of zeroed, read-write memory and returns its
+	/// address, or NULL if the memory cannot be mapped. When @a huge, huge
+	/// pages (large pages on Windows) are tried first, and @a huge_mapped
+	/// tells whether they back the memory. @a size must be a multiple of
+	/// the huge page size in that case.
+	void* map_pages(u32 size, bool huge, bool& huge_mapped);
+
+	/// Unmaps the @a data of @a size bytes previously returned by map_pages().
+	void unmap_pages(void* data, u32 size);
+
 	/// Returns the list of @a files at the given @a path.
 	void list_files(const char* path, Vector<DynamicString>& files);
 
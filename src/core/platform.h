@@ -77,7 +77,7 @@
 						|| CROWN_PLATFORM_OSX)
 
 // http://sourceforge.net/apps/mediawiki/predef/index.php?title=Architectures
-#if defined(__arm__)
+#if defined(__arm__) || defined(__aarch64__) || defined(_M_ARM)
 	#undef CROWN_CPU_ARM
 	#define CROWN_CPU_ARM 1
 	#define CROWN_CACHE_LINE_SIZE 64
@@ -99,7 +99,7 @@
 	#define CROWN_CACHE_LINE_SIZE 64
 #endif //
 
-#if defined(__x86_64__) || defined(_M_X64) || defined(__64BIT__) || defined(__powerpc64__) || defined(__ppc64__)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(__64BIT__) || defined(__powerpc64__) || defined(__ppc64__)
 	#undef CROWN_ARCH_64BIT
 	#define CROWN_ARCH_64BIT 64
 #else
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/radix_sort.h"
+#include <string.h> // memcpy, memset
+
+namespace crown
+{
+/// Least significant digit radix sort, one byte per pass. Passes where
+/// all the keys have the same digit are skipped, so keys which only use
+/// their high bits sort in a few passes.
+void radix_sort(u64* keys, u32* values, u64* tmp_keys, u32* tmp_values, u32 num)
+{
+	if (num < 2)
+		return;
+
+	u32 histogram[8][256];
+	memset(histogram, 0, sizeof(histogram));
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		for (u32 d = 0; d < 8; ++d)
+			++histogram[d][(keys[i] >> (d*8)) & 0xff];
+	}
+
+	u64* src_keys = keys;
+	u32* src_values = values;
+	u64* dst_keys = tmp_keys;
+	u32* dst_values = tmp_values;
+
+	for (u32 d = 0; d < 8; ++d)
+	{
+		u32* count = histogram[d];
+		if (count[(keys[0] >> (d*8)) & 0xff] == num)
+			continue;
+
+		u32 offset = 0;
+		for (u32 b = 0; b < 256; ++b)
+		{
+			const u32 c = count[b];
+			count[b] = offset;
+			offset += c;
+		}
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const u32 dst = count[(src_keys[i] >> (d*8)) & 0xff]++;
+			dst_keys[dst] = src_keys[i];
+			dst_values[dst] = src_values[i];
+		}
+
+		u64* k = src_keys; src_keys = dst_keys; dst_keys = k;
+		u32* v = src_values; src_values = dst_values; dst_values = v;
+	}
+
+	if (src_keys != keys)
+	{
+		memcpy(keys, src_keys, num*sizeof(*keys));
+		memcpy(values, src_values, num*sizeof(*values));
+	}
+}
+
+} // namespace crown
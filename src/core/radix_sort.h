@@ -0,0 +1,17 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Sorts the @a num @a keys in ascending order and moves the @a values
+/// along with them. The sort is stable.
+/// @a tmp_keys and @a tmp_values must have room for @a num items each.
+void radix_sort(u64* keys, u32* values, u64* tmp_keys, u32* tmp_values, u32 num);
+
+} // namespace crown
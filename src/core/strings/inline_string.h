@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/memory/inline_allocator.h"
+#include "core/strings/dynamic_string.h"
+
+namespace crown
+{
+/// DynamicString which stores up to N characters, including the
+/// terminating NULL, inline and allocates from the backing allocator only
+/// when it grows past them. Can be used wherever a DynamicString is
+/// expected.
+///
+/// @note
+/// Copies made with DynamicString's copy constructor share the inline
+/// allocator and must not outlive the InlineString.
+///
+/// @ingroup String
+template <u32 N>
+struct InlineString : private InlineAllocator<N>, public DynamicString
+{
+	///
+	InlineString(Allocator& a = default_allocator())
+		: InlineAllocator<N>(a)
+		, DynamicString(static_cast<InlineAllocator<N>&>(*this))
+	{
+		array::set_capacity(_data, N);
+	}
+
+	///
+	InlineString(const InlineString<N>& other)
+		: InlineAllocator<N>(*other._backing)
+		, DynamicString(static_cast<InlineAllocator<N>&>(*this))
+	{
+		array::set_capacity(_data, N);
+		_data = other._data;
+	}
+
+	///
+	InlineString(const char* str, Allocator& a = default_allocator())
+		: InlineAllocator<N>(a)
+		, DynamicString(static_cast<InlineAllocator<N>&>(*this))
+	{
+		array::set_capacity(_data, N);
+		DynamicString::operator=(str);
+	}
+
+	using DynamicString::operator=;
+
+	///
+	InlineString<N>& operator=(const InlineString<N>& other)
+	{
+		_data = other._data;
+		return *this;
+	}
+};
+
+} // namespace crown
@@ -0,0 +1,646 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/strings/number.h"
+#include <string.h> // memcpy, memset
+
+namespace crown
+{
+namespace number_internal
+{
+	static const char s_digits[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899"
+		;
+
+	static const u32 s_pow10[] =
+	{
+		1u,
+		10u,
+		100u,
+		1000u,
+		10000u,
+		100000u,
+		1000000u,
+		10000000u,
+		100000000u,
+		1000000000u
+	};
+
+	// Number of 32-bit words needed by the largest value handled by
+	// shortest(), that is 2^53 * 10^324 plus some headroom.
+	const u32 BIGNUM_WORDS = 40;
+
+	// Unsigned integer of arbitrary size, least significant word first.
+	struct Bignum
+	{
+		u32 num;
+		u32 w[BIGNUM_WORDS];
+	};
+
+	static inline void set(Bignum& a, u64 val)
+	{
+		a.w[0] = u32(val);
+		a.w[1] = u32(val >> 32);
+		a.num = a.w[1] != 0 ? 2 : (a.w[0] != 0 ? 1 : 0);
+	}
+
+	static void mul(Bignum& a, u32 val)
+	{
+		u64 carry = 0;
+		for (u32 i = 0; i < a.num; ++i)
+		{
+			const u64 p = u64(a.w[i]) * val + carry;
+			a.w[i] = u32(p);
+			carry = p >> 32;
+		}
+		if (carry != 0)
+		{
+			CE_ASSERT(a.num < BIGNUM_WORDS, "Bignum overflow");
+			a.w[a.num++] = u32(carry);
+		}
+	}
+
+	static void mul_pow10(Bignum& a, u32 exp)
+	{
+		for (; exp >= 9; exp -= 9)
+			mul(a, s_pow10[9]);
+		if (exp > 0)
+			mul(a, s_pow10[exp]);
+	}
+
+	static void shl(Bignum& a, u32 bits)
+	{
+		if (a.num == 0)
+			return;
+
+		const u32 words = bits / 32;
+		const u32 shift = bits % 32;
+		CE_ASSERT(a.num + words < BIGNUM_WORDS, "Bignum overflow");
+
+		u32 i = a.num;
+		a.w[i + words] = 0;
+		for (; i > 0; --i)
+		{
+			const u64 v = (u64(a.w[i - 1]) << shift);
+			a.w[i + words] |= u32(v >> 32);
+			a.w[i + words - 1] = u32(v);
+		}
+		memset(a.w, 0, words * sizeof(u32));
+		a.num += words + 1;
+		if (a.w[a.num - 1] == 0)
+			--a.num;
+	}
+
+	static s32 cmp(const Bignum& a, const Bignum& b)
+	{
+		if (a.num != b.num)
+			return a.num < b.num ? -1 : 1;
+
+		for (u32 i = a.num; i > 0; --i)
+		{
+			if (a.w[i - 1] != b.w[i - 1])
+				return a.w[i - 1] < b.w[i - 1] ? -1 : 1;
+		}
+		return 0;
+	}
+
+	// out = a + b.
+	static void add(Bignum& out, const Bignum& a, const Bignum& b)
+	{
+		const Bignum& big = a.num > b.num ? a : b;
+		const Bignum& small = a.num > b.num ? b : a;
+
+		u64 carry = 0;
+		u32 i = 0;
+		for (; i < small.num; ++i)
+		{
+			const u64 s = u64(big.w[i]) + small.w[i] + carry;
+			out.w[i] = u32(s);
+			carry = s >> 32;
+		}
+		for (; i < big.num; ++i)
+		{
+			const u64 s = u64(big.w[i]) + carry;
+			out.w[i] = u32(s);
+			carry = s >> 32;
+		}
+		out.num = big.num;
+		if (carry != 0)
+		{
+			CE_ASSERT(out.num < BIGNUM_WORDS, "Bignum overflow");
+			out.w[out.num++] = u32(carry);
+		}
+	}
+
+	// a -= b, with a >= b.
+	static void sub(Bignum& a, const Bignum& b)
+	{
+		s64 borrow = 0;
+		u32 i = 0;
+		for (; i < b.num; ++i)
+		{
+			const s64 d = s64(a.w[i]) - b.w[i] - borrow;
+			a.w[i] = u32(d);
+			borrow = d < 0 ? 1 : 0;
+		}
+		for (; borrow != 0 && i < a.num; ++i)
+		{
+			const s64 d = s64(a.w[i]) - borrow;
+			a.w[i] = u32(d);
+			borrow = d < 0 ? 1 : 0;
+		}
+		while (a.num > 0 && a.w[a.num - 1] == 0)
+			--a.num;
+	}
+
+	// Writes to @a digits the shortest digits d1 d2 ... dn such that
+	// 0.d1d2...dn * 10^point reads back as mantissa * 2^exponent, and
+	// returns n. @a lower_closer tells whether the previous floating point
+	// number is closer than the next one, which happens at powers of two.
+	// See: Burger, Dybvig, Printing Floating-Point Numbers Quickly and Accurately.
+	static u32 shortest(char* digits, s32& point, u64 mantissa, s32 exponent, bool lower_closer)
+	{
+		// The value is r/s and the neighbouring numbers are halfway at
+		// (r - m_minus)/s and (r + m_plus)/s. With round-half-even, the
+		// halfway points themselves read back as the value if its mantissa
+		// is even.
+		Bignum r;
+		Bignum s;
+		Bignum m_plus;
+		Bignum m_minus;
+		const bool even = (mantissa & 1) == 0;
+
+		set(r, mantissa);
+		if (exponent >= 0)
+		{
+			set(m_minus, 1);
+			shl(m_minus, exponent);
+			m_plus = m_minus;
+			if (lower_closer)
+				shl(m_plus, 1);
+			shl(r, exponent + (lower_closer ? 2 : 1));
+			set(s, lower_closer ? 4 : 2);
+		}
+		else
+		{
+			set(m_minus, 1);
+			set(m_plus, lower_closer ? 2 : 1);
+			shl(r, lower_closer ? 2 : 1);
+			set(s, 1);
+			shl(s, u32(-exponent) + (lower_closer ? 2 : 1));
+		}
+
+		// Estimate point = ceil(log10(value)), then fix it up if too small.
+		u32 bits = 0;
+		for (u64 m = mantissa; m != 0; m >>= 1)
+			++bits;
+		const f64 log10_low = f64(exponent + s32(bits) - 1) * 0.30102999566398114;
+		s32 k = s32(log10_low);
+		if (f64(k) < log10_low - 1e-10)
+			++k;
+
+		if (k >= 0)
+		{
+			mul_pow10(s, u32(k));
+		}
+		else
+		{
+			mul_pow10(r, u32(-k));
+			mul_pow10(m_plus, u32(-k));
+			mul_pow10(m_minus, u32(-k));
+		}
+
+		// Without a closer lower neighbour, m_minus is always equal to
+		// m_plus and is not kept up to date below.
+
+		Bignum high;
+		add(high, r, m_plus);
+		while (cmp(high, s) >= (even ? 0 : 1))
+		{
+			mul(s, 10);
+			++k;
+		}
+		point = k;
+
+		u32 num = 0;
+		while (true)
+		{
+			mul(r, 10);
+			mul(m_plus, 10);
+			if (lower_closer)
+				mul(m_minus, 10);
+
+			char d = 0;
+			while (cmp(r, s) >= 0)
+			{
+				sub(r, s);
+				++d;
+			}
+
+			add(high, r, m_plus);
+			const bool low_done  = cmp(r, lower_closer ? m_minus : m_plus) < (even ? 1 : 0);
+			const bool high_done = cmp(high, s) >= (even ? 0 : 1);
+
+			if (!low_done && !high_done)
+			{
+				digits[num++] = '0' + d;
+				continue;
+			}
+
+			if (low_done && high_done)
+			{
+				// Pick the digit closest to the value
+				Bignum r2 = r;
+				shl(r2, 1);
+				if (cmp(r2, s) >= 0)
+					++d;
+			}
+			else if (high_done)
+			{
+				++d;
+			}
+
+			digits[num++] = '0' + d;
+			break;
+		}
+
+		while (num > 1 && digits[num - 1] == '0')
+			--num;
+		return num;
+	}
+
+	static const u64 s_pow10_u64[] =
+	{
+		1ull,
+		10ull,
+		100ull,
+		1000ull,
+		10000ull,
+		100000ull,
+		1000000ull,
+		10000000ull,
+		100000000ull,
+		1000000000ull,
+		10000000000ull,
+		100000000000ull,
+		1000000000000ull,
+		10000000000000ull,
+		100000000000000ull,
+		1000000000000000ull,
+		10000000000000000ull,
+		100000000000000000ull,
+		1000000000000000000ull
+	};
+
+	static const f64 s_pow10_f64[] =
+	{
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+		1e20, 1e21, 1e22, 1e23, 1e24, 1e25, 1e26, 1e27, 1e28, 1e29,
+		1e30, 1e31, 1e32, 1e33, 1e34, 1e35, 1e36, 1e37, 1e38, 1e39,
+		1e40, 1e41, 1e42, 1e43, 1e44, 1e45, 1e46, 1e47, 1e48, 1e49,
+		1e50, 1e51, 1e52, 1e53, 1e54, 1e55, 1e56, 1e57, 1e58, 1e59,
+		1e60, 1e61
+	};
+
+	// Like shortest() for the positive finite f32 with the given @a bits,
+	// but computed in f64. Values of f32 and the halfway points between
+	// them are exact in f64, and once scaled to 17 or 18 digits their error
+	// is far smaller than the distance between two f32. Returns 0 when a
+	// candidate is too close to a halfway point to tell which side it is
+	// on, and shortest() must be used instead.
+	static u32 shortest_f32(char* digits, s32& point, u32 bits)
+	{
+		// The next f32 of the largest ones is infinite
+		if ((bits >> 23) >= 0xfe)
+			return 0;
+
+		f32 val;
+		f32 prev;
+		f32 next;
+		const u32 prev_bits = bits - 1;
+		const u32 next_bits = bits + 1;
+		memcpy(&val, &bits, sizeof(val));
+		memcpy(&prev, &prev_bits, sizeof(prev));
+		memcpy(&next, &next_bits, sizeof(next));
+
+		const f64 v = val;
+		const f64 lo = (v + f64(prev)) * 0.5;
+		const f64 hi = (v + f64(next)) * 0.5;
+
+		// Scale so that v is in [10^16, 10^18)
+		u64 vbits;
+		memcpy(&vbits, &v, sizeof(vbits));
+		const s32 e2 = s32((vbits >> 52) & 0x7ff) - 1023;
+		const s32 e10 = s32(f64(e2) * 0.30102999566398114 + 1000.0) - 1000;
+		const s32 k = 16 - e10;
+
+		f64 d, l, h;
+		if (k >= 0)
+		{
+			d = v * s_pow10_f64[k];
+			l = lo * s_pow10_f64[k];
+			h = hi * s_pow10_f64[k];
+		}
+		else
+		{
+			d = v / s_pow10_f64[-k];
+			l = lo / s_pow10_f64[-k];
+			h = hi / s_pow10_f64[-k];
+		}
+
+		// Integers up to low_out and from high_out are surely outside the
+		// interval, those from low_in to high_in surely inside.
+		const f64 margin = d * (1.0 / 17592186044416.0); // 2^-44
+		const u64 low_out  = u64(l - margin);
+		const u64 low_in   = u64(l + margin) + 1;
+		const u64 high_in  = u64(h - margin);
+		const u64 high_out = u64(h + margin) + 1;
+		const u64 dint = u64(d);
+
+		// An interval as wide as 10^t always contains a multiple of 10^t
+		const u64 width = high_in - low_in;
+		u32 t = 0;
+		while (t + 1 < countof(s_pow10_u64) && s_pow10_u64[t + 1] <= width)
+			++t;
+		if (t + 1 < countof(s_pow10_u64))
+			++t;
+
+		for (;; --t)
+		{
+			const u64 div = s_pow10_u64[t];
+			const u64 first = (low_out / div + 1) * div;
+			if (first >= high_out)
+			{
+				if (t == 0)
+					return 0;
+				continue;
+			}
+
+			// The multiples closest to v are the candidates
+			const u64 below = dint / div * div;
+			const u64 above = below + div;
+			u64 pick = 0;
+			f64 pick_dist = 0.0;
+			const u64 candidates[] = { below, above };
+			for (u32 i = 0; i < countof(candidates); ++i)
+			{
+				const u64 c = candidates[i];
+				if (c <= low_out || c >= high_out)
+					continue;
+				if (c < low_in || c > high_in)
+					return 0;
+
+				const f64 dist = f64(c) > d ? f64(c) - d : d - f64(c);
+				if (pick != 0 && dist + 4.0*margin > pick_dist && pick_dist + 4.0*margin > dist)
+					return 0;
+				if (pick == 0 || dist < pick_dist)
+				{
+					pick = c;
+					pick_dist = dist;
+				}
+			}
+
+			if (pick == 0)
+				return 0;
+
+			u32 num = number::format(digits, pick / div);
+			point = s32(num + t) - k;
+			while (num > 1 && digits[num - 1] == '0')
+				--num;
+			return num;
+		}
+	}
+
+	// Writes @a num @a digits with the decimal point at @a point like
+	// JavaScript's Number.toString() does.
+	static u32 write_decimal(char* str, const char* digits, u32 num, s32 point)
+	{
+		char* p = str;
+		const s32 n = s32(num);
+
+		if (n <= point && point <= 21)
+		{
+			memcpy(p, digits, num);
+			p += num;
+			memset(p, '0', point - n);
+			p += point - n;
+		}
+		else if (0 < point && point <= 21)
+		{
+			memcpy(p, digits, point);
+			p += point;
+			*p++ = '.';
+			memcpy(p, digits + point, n - point);
+			p += n - point;
+		}
+		else if (-6 < point && point <= 0)
+		{
+			*p++ = '0';
+			*p++ = '.';
+			memset(p, '0', -point);
+			p += -point;
+			memcpy(p, digits, num);
+			p += num;
+		}
+		else
+		{
+			*p++ = digits[0];
+			if (num > 1)
+			{
+				*p++ = '.';
+				memcpy(p, digits + 1, num - 1);
+				p += num - 1;
+			}
+			*p++ = 'e';
+			const s32 exp = point - 1;
+			*p++ = exp < 0 ? '-' : '+';
+			p += number::format(p, u64(exp < 0 ? -exp : exp));
+		}
+
+		return u32(p - str);
+	}
+
+	// Writes infinities, NaNs and zeros, or returns 0 if @a str has not
+	// been written.
+	static u32 write_special(char* str, bool negative, bool inf_or_nan, u64 fraction, u64 exponent_bits)
+	{
+		char* p = str;
+		if (inf_or_nan)
+		{
+			if (fraction != 0)
+			{
+				memcpy(p, "nan", 3);
+				return 3;
+			}
+
+			if (negative)
+				*p++ = '-';
+			memcpy(p, "inf", 3);
+			return u32(p - str) + 3;
+		}
+
+		if (fraction == 0 && exponent_bits == 0)
+		{
+			if (negative)
+				*p++ = '-';
+			*p++ = '0';
+			return u32(p - str);
+		}
+
+		return 0;
+	}
+
+} // namespace number_internal
+
+namespace number
+{
+	u32 format(char* str, u64 val)
+	{
+		using namespace number_internal;
+
+		char buf[20];
+		char* end = buf + sizeof(buf);
+		char* p = end;
+
+		while (val >= 100)
+		{
+			const u32 i = u32(val % 100) * 2;
+			val /= 100;
+			p -= 2;
+			p[0] = s_digits[i + 0];
+			p[1] = s_digits[i + 1];
+		}
+
+		if (val >= 10)
+		{
+			p -= 2;
+			p[0] = s_digits[val*2 + 0];
+			p[1] = s_digits[val*2 + 1];
+		}
+		else
+		{
+			*--p = char('0' + val);
+		}
+
+		const u32 len = u32(end - p);
+		memcpy(str, p, len);
+		return len;
+	}
+
+	u32 format(char* str, s64 val)
+	{
+		if (val >= 0)
+			return format(str, u64(val));
+
+		str[0] = '-';
+		return 1 + format(str + 1, u64(0) - u64(val));
+	}
+
+	u32 format(char* str, f32 val)
+	{
+		using namespace number_internal;
+
+		u32 bits;
+		memcpy(&bits, &val, sizeof(bits));
+		const bool negative   = (bits >> 31) != 0;
+		const u32 biased      = (bits >> 23) & 0xff;
+		const u32 fraction    = bits & 0x7fffff;
+
+		const u32 len = write_special(str, negative, biased == 0xff, fraction, biased);
+		if (len != 0)
+			return len;
+
+		char* p = str;
+		if (negative)
+			*p++ = '-';
+
+		const u64 mantissa = biased == 0 ? fraction : fraction | (1u << 23);
+		const s32 exponent = biased == 0 ? -149 : s32(biased) - 150;
+
+		char digits[NUMBER_FORMAT_MAX];
+		s32 point;
+		u32 num = shortest_f32(digits, point, bits & 0x7fffffff);
+		if (num == 0)
+			num = shortest(digits, point, mantissa, exponent, fraction == 0 && biased > 1);
+		return u32(p - str) + write_decimal(p, digits, num, point);
+	}
+
+	u32 format(char* str, f64 val)
+	{
+		using namespace number_internal;
+
+		u64 bits;
+		memcpy(&bits, &val, sizeof(bits));
+		const bool negative   = (bits >> 63) != 0;
+		const u64 biased      = (bits >> 52) & 0x7ff;
+		const u64 fraction    = bits & 0xfffffffffffffull;
+
+		const u32 len = write_special(str, negative, biased == 0x7ff, fraction, biased);
+		if (len != 0)
+			return len;
+
+		char* p = str;
+		if (negative)
+			*p++ = '-';
+
+		const u64 mantissa = biased == 0 ? fraction : fraction | (u64(1) << 52);
+		const s32 exponent = biased == 0 ? -1074 : s32(biased) - 1075;
+
+		char digits[NUMBER_FORMAT_MAX];
+		s32 point;
+		const u32 num = shortest(digits, point, mantissa, exponent, fraction == 0 && biased > 1);
+		return u32(p - str) + write_decimal(p, digits, num, point);
+	}
+
+	u32 format_fixed(char* str, f64 val, u32 decimals)
+	{
+		using namespace number_internal;
+		CE_ASSERT(decimals <= 9, "Too many decimals: %u", decimals);
+
+		const bool negative = val < 0.0;
+		const f64 abs = negative ? -val : val;
+		const f64 scaled = abs * f64(s_pow10[decimals]) + 0.5;
+
+		// Also true for NaNs
+		if (!(scaled < 9.0e18))
+			return format(str, val);
+
+		const u64 q = u64(scaled);
+		const u64 integer = q / s_pow10[decimals];
+		u32 fraction = u32(q % s_pow10[decimals]);
+
+		char* p = str;
+		if (negative)
+			*p++ = '-';
+		p += format(p, integer);
+
+		if (decimals > 0)
+		{
+			*p++ = '.';
+			for (u32 i = decimals; i > 0; --i)
+			{
+				p[i - 1] = char('0' + fraction % 10);
+				fraction /= 10;
+			}
+			p += decimals;
+		}
+
+		return u32(p - str);
+	}
+
+} // namespace number
+
+} // namespace crown
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Maximum number of characters written by the number::format functions.
+const u32 NUMBER_FORMAT_MAX = 32;
+
+/// Functions to convert numbers to strings without going through printf.
+/// The output does not depend on the locale and is not NUL-terminated.
+///
+/// @ingroup String
+namespace number
+{
+	/// Writes the decimal representation of @a val to @a str and returns its length.
+	u32 format(char* str, u64 val);
+
+	/// Writes the decimal representation of @a val to @a str and returns its length.
+	u32 format(char* str, s64 val);
+
+	/// Writes the shortest decimal representation that reads back as @a val
+	/// to @a str and returns its length. Numbers are written in the same
+	/// notation as JavaScript's Number.toString(), exponential notation is
+	/// only used below 1e-6 and from 1e21 on. Infinities and NaNs are written
+	/// as "inf", "-inf" and "nan".
+	u32 format(char* str, f32 val);
+
+	/// @copydoc number::format(char*, f32)
+	u32 format(char* str, f64 val);
+
+	/// Writes @a val with exactly @a decimals digits after the decimal point
+	/// to @a str and returns its length, like printf("%.*f") except that
+	/// halfway cases are rounded away from zero. @a decimals must be at
+	/// most 9. Numbers too large to be written this way are
+	/// written with number::format(char*, f64) instead.
+	u32 format_fixed(char* str, f64 val, u32 decimals);
+
+} // namespace number
+
+} // namespace crown
@@ -8,10 +8,141 @@
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
 #include "core/strings/string_id.h"
+#include "core/thread/mutex.h"
+#include "device/log.h"
 #include <inttypes.h> // PRIx64
+#include <stdlib.h>   // malloc, free
+#include <string.h>   // memcpy, memset, strncmp
+
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+namespace { const crown::log_internal::System STRING_ID = { "string_id" }; }
+#endif
 
 namespace crown
 {
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+namespace string_id_internal
+{
+	// Maps the ids back to their strings. It uses malloc() directly because
+	// ids are hashed before and after the lifetime of the memory system.
+	struct Registry
+	{
+		struct Entry
+		{
+			u64 id;
+			u32 bits; // 0 if the entry is empty.
+			char* str;
+		};
+
+		Mutex mutex;
+		Entry* entries;
+		u32 capacity;
+		u32 size;
+
+		Registry()
+			: entries(NULL)
+			, capacity(0)
+			, size(0)
+		{
+		}
+
+		~Registry()
+		{
+			for (u32 i = 0; i < capacity; ++i)
+				free(entries[i].str);
+			free(entries);
+		}
+
+		Entry* find(u64 id, u32 bits)
+		{
+			if (capacity == 0)
+				return NULL;
+
+			u32 i = u32(id) & (capacity - 1);
+			while (entries[i].bits != 0 && (entries[i].id != id || entries[i].bits != bits))
+				i = (i + 1) & (capacity - 1);
+
+			return &entries[i];
+		}
+
+		void grow()
+		{
+			Entry* old_entries = entries;
+			const u32 old_capacity = capacity;
+
+			capacity = capacity == 0 ? 1024 : capacity * 2;
+			entries = (Entry*)malloc(capacity * sizeof(Entry));
+			CE_ENSURE(entries != NULL);
+			memset(entries, 0, capacity * sizeof(Entry));
+
+			for (u32 i = 0; i < old_capacity; ++i)
+			{
+				if (old_entries[i].bits != 0)
+					*find(old_entries[i].id, old_entries[i].bits) = old_entries[i];
+			}
+
+			free(old_entries);
+		}
+
+		void add(u64 id, u32 bits, const char* str, u32 len)
+		{
+			ScopedMutex sm(mutex);
+
+			Entry* e = find(id, bits);
+			if (e != NULL && e->bits != 0)
+			{
+				if (strncmp(e->str, str, len) != 0 || e->str[len] != '\0')
+					logw(STRING_ID, "Hash collision: '%.*s' and '%s'", len, str, e->str);
+				return;
+			}
+
+			if (size >= capacity / 2)
+			{
+				grow();
+				e = find(id, bits);
+			}
+
+			e->id = id;
+			e->bits = bits;
+			e->str = (char*)malloc(len + 1);
+			CE_ENSURE(e->str != NULL);
+			memcpy(e->str, str, len);
+			e->str[len] = '\0';
+			++size;
+		}
+
+		const char* lookup(u64 id, u32 bits)
+		{
+			ScopedMutex sm(mutex);
+
+			const Entry* e = find(id, bits);
+			return e != NULL && e->bits != 0 ? e->str : NULL;
+		}
+	};
+
+	static Registry& registry()
+	{
+		static Registry r;
+		return r;
+	}
+
+} // namespace string_id_internal
+
+namespace string_id
+{
+	const char* lookup(StringId32 id)
+	{
+		return string_id_internal::registry().lookup(id._id, 32);
+	}
+
+	const char* lookup(StringId64 id)
+	{
+		return string_id_internal::registry().lookup(id._id, 64);
+	}
+
+} // namespace string_id
+#endif // CROWN_DEBUG || CROWN_DEVELOPMENT
+
 StringId32::StringId32(const char* str)
 {
 	hash(str, strlen32(str));
@@ -26,6 +157,9 @@ void StringId32::hash(const char* str, u32 len)
 {
 	CE_ENSURE(NULL != str);
 	_id = murmur32(str, len, 0);
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+	string_id_internal::registry().add(_id, 32, str, len);
+#endif
 }
 
 void StringId32::to_string(DynamicString& s)
@@ -49,6 +183,9 @@ void StringId64::hash(const char* str, u32 len)
 {
 	CE_ENSURE(NULL != str);
 	_id = murmur64(str, len, 0);
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+	string_id_internal::registry().add(_id, 64, str, len);
+#endif
 }
 
 void StringId64::to_string(DynamicString& s)
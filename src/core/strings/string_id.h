@@ -5,8 +5,10 @@
 
 #pragma once
 
+#include "core/murmur.h"
 #include "core/strings/types.h"
 #include "core/types.h"
+#include <stddef.h> // size_t
 
 namespace crown
 {
@@ -17,8 +19,8 @@ struct StringId32
 {
 	u32 _id;
 
-	StringId32() : _id(0) {}
-	explicit StringId32(u32 idx) : _id(idx) {}
+	constexpr StringId32() : _id(0) {}
+	explicit constexpr StringId32(u32 idx) : _id(idx) {}
 	explicit StringId32(const char* str);
 	explicit StringId32(const char* str, u32 len);
 
@@ -35,8 +37,8 @@ struct StringId64
 {
 	u64 _id;
 
-	StringId64() : _id(0) {}
-	explicit StringId64(u64 idx) : _id(idx) {}
+	constexpr StringId64() : _id(0) {}
+	explicit constexpr StringId64(u64 idx) : _id(idx) {}
 	explicit StringId64(const char* str);
 	explicit StringId64(const char* str, u32 len);
 
@@ -46,6 +48,42 @@ struct StringId64
 	void to_string(DynamicString& s);
 };
 
+/// Returns the StringId32 of the string literal @a str, computed at
+/// compile time. E.g. "foo"_id32 == StringId32("foo").
+///
+/// @ingroup String
+constexpr StringId32 operator"" _id32(const char* str, size_t len)
+{
+	return StringId32(murmur_internal::murmur32(str, u32(len), 0));
+}
+
+/// Returns the StringId64 of the string literal @a str, computed at
+/// compile time. E.g. "foo"_id64 == StringId64("foo").
+///
+/// @ingroup String
+constexpr StringId64 operator"" _id64(const char* str, size_t len)
+{
+	return StringId64(murmur_internal::murmur64(str, u32(len), 0));
+}
+
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+/// Functions to map string ids back to the strings they were hashed from.
+///
+/// @ingroup String
+namespace string_id
+{
+	/// Returns the string @a id was hashed from or NULL if unknown.
+	/// @note
+	/// Only the strings hashed at run time are recorded, ids obtained
+	/// from _id32 literals or from compiled data can not be looked up.
+	const char* lookup(StringId32 id);
+
+	/// Returns the string @a id was hashed from or NULL if unknown.
+	const char* lookup(StringId64 id);
+
+} // namespace string_id
+#endif // CROWN_DEBUG || CROWN_DEVELOPMENT
+
 /// @addtogroup String
 /// @{
 inline bool operator==(const StringId32& a, const StringId32& b)
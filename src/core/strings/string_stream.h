@@ -6,6 +6,7 @@
 #pragma once
 
 #include "core/containers/array.h"
+#include "core/strings/number.h"
 #include "core/strings/string.h"
 #include "core/strings/types.h"
 
@@ -21,6 +22,13 @@ namespace string_stream
 
 	template <typename T> StringStream& stream_printf(StringStream& s, const char* format, T& val);
 
+	/// Appends @a val to the stream @a s with number::format().
+	template <typename T> StringStream& stream_number(StringStream& s, T val);
+
+	/// Appends @a val to the stream @a s with @a decimals digits after the
+	/// decimal point, see number::format_fixed().
+	StringStream& stream_fixed(StringStream& s, f64 val, u32 decimals);
+
 } // namespace string_stream
 
 /// @addtogroup String
@@ -36,49 +44,49 @@ inline StringStream& operator<<(StringStream& s, char val)
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, s16 val)
 {
-	return string_stream::stream_printf(s, "%hd", val);
+	return string_stream::stream_number(s, s64(val));
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, u16 val)
 {
-	return string_stream::stream_printf(s, "%hu", val);
+	return string_stream::stream_number(s, u64(val));
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, s32 val)
 {
-	return string_stream::stream_printf(s, "%d", val);
+	return string_stream::stream_number(s, s64(val));
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, u32 val)
 {
-	return string_stream::stream_printf(s, "%u", val);
+	return string_stream::stream_number(s, u64(val));
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, s64 val)
 {
-	return string_stream::stream_printf(s, "%lld", val);
+	return string_stream::stream_number(s, val);
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, u64 val)
 {
-	return string_stream::stream_printf(s, "%llu", val);
+	return string_stream::stream_number(s, val);
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, f32 val)
 {
-	return string_stream::stream_printf(s, "%g", val);
+	return string_stream::stream_number(s, val);
 }
 
 /// Appends @a val to the stream @a s using appropriate formatting.
 inline StringStream& operator<<(StringStream& s, f64 val)
 {
-	return string_stream::stream_printf(s, "%g", val);
+	return string_stream::stream_number(s, val);
 }
 
 /// Appends the string @a str to the stream @a s.
@@ -106,6 +114,26 @@ namespace string_stream
 		return s << buf;
 	}
 
+	template <typename T>
+	inline StringStream& stream_number(StringStream& s, T val)
+	{
+		// Format straight into the stream
+		const u32 size = array::size(s);
+		array::reserve(s, size + NUMBER_FORMAT_MAX);
+		array::resize(s, size + NUMBER_FORMAT_MAX);
+		array::resize(s, size + number::format(array::begin(s) + size, val));
+		return s;
+	}
+
+	inline StringStream& stream_fixed(StringStream& s, f64 val, u32 decimals)
+	{
+		const u32 size = array::size(s);
+		array::reserve(s, size + NUMBER_FORMAT_MAX);
+		array::resize(s, size + NUMBER_FORMAT_MAX);
+		array::resize(s, size + number::format_fixed(array::begin(s) + size, val, decimals));
+		return s;
+	}
+
 } // namespace string_stream
 
 } // namespace crown
@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/platform.h"
+#include "core/types.h"
+
+#if CROWN_COMPILER_MSVC
+	#include <intrin.h>
+#endif
+
+namespace crown
+{
+/// Enumerates memory orderings of atomic operations.
+///
+/// @ingroup Thread
+struct MemoryOrder
+{
+	enum Enum
+	{
+		RELAXED, ///< No ordering, only atomicity.
+		ACQUIRE, ///< Later loads and stores are not moved before the operation.
+		RELEASE, ///< Earlier loads and stores are not moved after the operation.
+		ACQ_REL, ///< Both ACQUIRE and RELEASE.
+		SEQ_CST  ///< ACQ_REL plus a single total order of all SEQ_CST operations.
+	};
+};
+
+namespace atomic_internal
+{
+#if CROWN_COMPILER_GCC || CROWN_COMPILER_CLANG
+	inline int order(MemoryOrder::Enum mo)
+	{
+		return mo == MemoryOrder::RELAXED ? __ATOMIC_RELAXED
+			: mo == MemoryOrder::ACQUIRE ? __ATOMIC_ACQUIRE
+			: mo == MemoryOrder::RELEASE ? __ATOMIC_RELEASE
+			: mo == MemoryOrder::ACQ_REL ? __ATOMIC_ACQ_REL
+			: __ATOMIC_SEQ_CST
+			;
+	}
+
+	// The order of a failed compare_exchange can not be a release.
+	inline int failure_order(MemoryOrder::Enum mo)
+	{
+		return mo == MemoryOrder::RELEASE ? __ATOMIC_RELAXED
+			: mo == MemoryOrder::ACQ_REL ? __ATOMIC_ACQUIRE
+			: order(mo)
+			;
+	}
+
+	template <typename T>
+	inline T load(const volatile T* p, MemoryOrder::Enum mo)
+	{
+		return __atomic_load_n(p, order(mo));
+	}
+
+	template <typename T>
+	inline void store(volatile T* p, T val, MemoryOrder::Enum mo)
+	{
+		__atomic_store_n(p, val, order(mo));
+	}
+
+	template <typename T>
+	inline T exchange(volatile T* p, T val, MemoryOrder::Enum mo)
+	{
+		return __atomic_exchange_n(p, val, order(mo));
+	}
+
+	template <typename T>
+	inline bool compare_exchange(volatile T* p, T& expected, T desired, MemoryOrder::Enum mo)
+	{
+		return __atomic_compare_exchange_n(p, &expected, desired, false, order(mo), failure_order(mo));
+	}
+
+	template <typename T>
+	inline T fetch_add(volatile T* p, T val, MemoryOrder::Enum mo)
+	{
+		return __atomic_fetch_add(p, val, order(mo));
+	}
+
+	template <typename T>
+	inline T fetch_and(volatile T* p, T val, MemoryOrder::Enum mo)
+	{
+		return __atomic_fetch_and(p, val, order(mo));
+	}
+
+	template <typename T>
+	inline T fetch_or(volatile T* p, T val, MemoryOrder::Enum mo)
+	{
+		return __atomic_fetch_or(p, val, order(mo));
+	}
+#elif CROWN_COMPILER_MSVC
+	// Interlocked operations are full barriers. Aligned loads and stores
+	// are atomic and only need a compiler barrier on x86, and a hardware
+	// barrier elsewhere.
+	inline void barrier(MemoryOrder::Enum mo)
+	{
+		if (mo == MemoryOrder::RELAXED)
+			return;
+	#if CROWN_CPU_X86
+		_ReadWriteBarrier();
+	#else
+		__dmb(_ARM_BARRIER_ISH);
+	#endif
+	}
+
+	inline u32 load(const volatile u32* p, MemoryOrder::Enum mo)
+	{
+		const u32 val = *p;
+		barrier(mo);
+		return val;
+	}
+
+	inline void store(volatile u32* p, u32 val, MemoryOrder::Enum mo)
+	{
+		if (mo == MemoryOrder::SEQ_CST)
+		{
+			_InterlockedExchange((volatile long*)p, (long)val);
+			return;
+		}
+		barrier(mo);
+		*p = val;
+	}
+
+	inline u32 exchange(volatile u32* p, u32 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u32)_InterlockedExchange((volatile long*)p, (long)val);
+	}
+
+	inline bool compare_exchange(volatile u32* p, u32& expected, u32 desired, MemoryOrder::Enum /*mo*/)
+	{
+		const u32 prev = (u32)_InterlockedCompareExchange((volatile long*)p, (long)desired, (long)expected);
+		const bool ok = prev == expected;
+		expected = prev;
+		return ok;
+	}
+
+	inline u32 fetch_add(volatile u32* p, u32 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u32)_InterlockedExchangeAdd((volatile long*)p, (long)val);
+	}
+
+	inline u32 fetch_and(volatile u32* p, u32 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u32)_InterlockedAnd((volatile long*)p, (long)val);
+	}
+
+	inline u32 fetch_or(volatile u32* p, u32 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u32)_InterlockedOr((volatile long*)p, (long)val);
+	}
+
+	inline bool compare_exchange(volatile u64* p, u64& expected, u64 desired, MemoryOrder::Enum /*mo*/)
+	{
+		const u64 prev = (u64)_InterlockedCompareExchange64((volatile __int64*)p, (__int64)desired, (__int64)expected);
+		const bool ok = prev == expected;
+		expected = prev;
+		return ok;
+	}
+
+	#if CROWN_ARCH_64BIT
+	inline u64 load(const volatile u64* p, MemoryOrder::Enum mo)
+	{
+		const u64 val = *p;
+		barrier(mo);
+		return val;
+	}
+
+	inline void store(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		if (mo == MemoryOrder::SEQ_CST)
+		{
+			_InterlockedExchange64((volatile __int64*)p, (__int64)val);
+			return;
+		}
+		barrier(mo);
+		*p = val;
+	}
+
+	inline u64 exchange(volatile u64* p, u64 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u64)_InterlockedExchange64((volatile __int64*)p, (__int64)val);
+	}
+
+	inline u64 fetch_add(volatile u64* p, u64 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u64)_InterlockedExchangeAdd64((volatile __int64*)p, (__int64)val);
+	}
+
+	inline u64 fetch_and(volatile u64* p, u64 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u64)_InterlockedAnd64((volatile __int64*)p, (__int64)val);
+	}
+
+	inline u64 fetch_or(volatile u64* p, u64 val, MemoryOrder::Enum /*mo*/)
+	{
+		return (u64)_InterlockedOr64((volatile __int64*)p, (__int64)val);
+	}
+	#else
+	// 32-bit targets have no 64-bit interlocked operations other than
+	// compare-exchange, so everything is built on it.
+	inline u64 load(const volatile u64* p, MemoryOrder::Enum mo)
+	{
+		u64 val = 0;
+		compare_exchange((volatile u64*)p, val, 0, mo);
+		return val;
+	}
+
+	inline u64 exchange(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		u64 prev = *p;
+		while (!compare_exchange(p, prev, val, mo))
+			;
+		return prev;
+	}
+
+	inline void store(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		exchange(p, val, mo);
+	}
+
+	inline u64 fetch_add(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		u64 prev = *p;
+		while (!compare_exchange(p, prev, prev + val, mo))
+			;
+		return prev;
+	}
+
+	inline u64 fetch_and(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		u64 prev = *p;
+		while (!compare_exchange(p, prev, prev & val, mo))
+			;
+		return prev;
+	}
+
+	inline u64 fetch_or(volatile u64* p, u64 val, MemoryOrder::Enum mo)
+	{
+		u64 prev = *p;
+		while (!compare_exchange(p, prev, prev | val, mo))
+			;
+		return prev;
+	}
+	#endif // CROWN_ARCH_64BIT
+#endif // CROWN_COMPILER_MSVC
+
+	/// Atomic unsigned integer of type T.
+	template <typename T>
+	struct AtomicUint
+	{
+		volatile T _val;
+
+		/// Initialization is not atomic.
+		explicit AtomicUint(T val = 0) : _val(val) {}
+
+		///
+		AtomicUint(const AtomicUint&) = delete;
+
+		///
+		AtomicUint& operator=(const AtomicUint&) = delete;
+
+		///
+		T load(MemoryOrder::Enum mo = MemoryOrder::SEQ_CST) const
+		{
+			return atomic_internal::load(&_val, mo);
+		}
+
+		///
+		void store(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			atomic_internal::store(&_val, val, mo);
+		}
+
+		/// Replaces the value with @a val and returns the previous value.
+		T exchange(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::exchange(&_val, val, mo);
+		}
+
+		/// Replaces the value with @a desired if it equals @a expected and
+		/// returns true. Otherwise, copies the current value to @a expected
+		/// and returns false.
+		bool compare_exchange(T& expected, T desired, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::compare_exchange(&_val, expected, desired, mo);
+		}
+
+		/// Adds @a val to the value and returns the previous value.
+		T fetch_add(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::fetch_add(&_val, val, mo);
+		}
+
+		/// Subtracts @a val from the value and returns the previous value.
+		T fetch_sub(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::fetch_add(&_val, T(0) - val, mo);
+		}
+
+		/// Ands @a val to the value and returns the previous value.
+		T fetch_and(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::fetch_and(&_val, val, mo);
+		}
+
+		/// Ors @a val to the value and returns the previous value.
+		T fetch_or(T val, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+		{
+			return atomic_internal::fetch_or(&_val, val, mo);
+		}
+	};
+
+} // namespace atomic_internal
+
+/// Atomic 32-bit unsigned integer.
+///
+/// @ingroup Thread
+typedef atomic_internal::AtomicUint<u32> AtomicU32;
+
+/// Atomic 64-bit unsigned integer.
+///
+/// @ingroup Thread
+typedef atomic_internal::AtomicUint<u64> AtomicU64;
+
+/// Atomic pointer to T.
+///
+/// @ingroup Thread
+template <typename T>
+struct AtomicPtr
+{
+	atomic_internal::AtomicUint<uintptr_t> _ptr;
+
+	/// Initialization is not atomic.
+	explicit AtomicPtr(T* ptr = NULL) : _ptr((uintptr_t)ptr) {}
+
+	///
+	T* load(MemoryOrder::Enum mo = MemoryOrder::SEQ_CST) const
+	{
+		return (T*)_ptr.load(mo);
+	}
+
+	///
+	void store(T* ptr, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+	{
+		_ptr.store((uintptr_t)ptr, mo);
+	}
+
+	/// Replaces the pointer with @a ptr and returns the previous pointer.
+	T* exchange(T* ptr, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+	{
+		return (T*)_ptr.exchange((uintptr_t)ptr, mo);
+	}
+
+	/// Replaces the pointer with @a desired if it equals @a expected and
+	/// returns true. Otherwise, copies the current pointer to @a expected
+	/// and returns false.
+	bool compare_exchange(T*& expected, T* desired, MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+	{
+		uintptr_t exp = (uintptr_t)expected;
+		const bool ok = _ptr.compare_exchange(exp, (uintptr_t)desired, mo);
+		expected = (T*)exp;
+		return ok;
+	}
+};
+
+/// Issues a memory fence with the ordering @a mo.
+///
+/// @ingroup Thread
+inline void atomic_thread_fence(MemoryOrder::Enum mo = MemoryOrder::SEQ_CST)
+{
+#if CROWN_COMPILER_GCC || CROWN_COMPILER_CLANG
+	__atomic_thread_fence(atomic_internal::order(mo));
+#elif CROWN_COMPILER_MSVC
+	if (mo == MemoryOrder::SEQ_CST)
+	{
+		long dummy = 0;
+		_InterlockedExchange(&dummy, 0);
+	}
+	else
+	{
+		atomic_internal::barrier(mo);
+	}
+#endif
+}
+
+} // namespace crown
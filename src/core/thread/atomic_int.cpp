@@ -37,4 +37,22 @@ void AtomicInt::store(s32 val)
 #endif
 }
 
+s32 AtomicInt::fetch_add(s32 val)
+{
+#if CROWN_PLATFORM_POSIX && CROWN_COMPILER_GCC
+	return __sync_fetch_and_add(&_val, val);
+#elif CROWN_PLATFORM_WINDOWS
+	return InterlockedExchangeAdd((LONG*)&_val, val);
+#endif
+}
+
+s32 AtomicInt::compare_exchange(s32 expected, s32 desired)
+{
+#if CROWN_PLATFORM_POSIX && CROWN_COMPILER_GCC
+	return __sync_val_compare_and_swap(&_val, expected, desired);
+#elif CROWN_PLATFORM_WINDOWS
+	return InterlockedCompareExchange((LONG*)&_val, desired, expected);
+#endif
+}
+
 } // namespace crown
@@ -24,6 +24,13 @@ struct AtomicInt
 
 	///
 	void store(s32 val);
+
+	/// Adds @a val to the integer and returns its previous value.
+	s32 fetch_add(s32 val);
+
+	/// Replaces the integer with @a desired if it is equal to @a expected.
+	/// Returns the value of the integer before the operation.
+	s32 compare_exchange(s32 expected, s32 desired);
 };
 
 } // namespace crown
@@ -8,7 +8,9 @@
 #include "core/thread/condition_variable.h"
 
 #if CROWN_PLATFORM_POSIX
+	#include <errno.h>
 	#include <pthread.h>
+	#include <time.h> // clock_gettime
 #elif CROWN_PLATFORM_WINDOWS
 	#include <windows.h>
 #endif
@@ -64,6 +66,29 @@ void ConditionVariable::wait(Mutex& mutex)
 #endif
 }
 
+bool ConditionVariable::wait(Mutex& mutex, u32 ms)
+{
+	Private* priv = (Private*)_data;
+
+#if CROWN_PLATFORM_POSIX
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec  += ms / 1000;
+	ts.tv_nsec += long(ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000)
+	{
+		ts.tv_sec  += 1;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	int err = pthread_cond_timedwait(&priv->cond, (pthread_mutex_t*)mutex.native_handle(), &ts);
+	CE_ASSERT(err == 0 || err == ETIMEDOUT, "pthread_cond_timedwait: errno = %d", err);
+	return err == 0;
+#elif CROWN_PLATFORM_WINDOWS
+	return SleepConditionVariableCS(&priv->cv, (CRITICAL_SECTION*)mutex.native_handle(), ms) != 0;
+#endif
+}
+
 void ConditionVariable::signal()
 {
 	Private* priv = (Private*)_data;
@@ -77,4 +102,17 @@ void ConditionVariable::signal()
 #endif
 }
 
+void ConditionVariable::broadcast()
+{
+	Private* priv = (Private*)_data;
+
+#if CROWN_PLATFORM_POSIX
+	int err = pthread_cond_broadcast(&priv->cond);
+	CE_ASSERT(err == 0, "pthread_cond_broadcast: errno = %d", err);
+	CE_UNUSED(err);
+#elif CROWN_PLATFORM_WINDOWS
+	WakeAllConditionVariable(&priv->cv);
+#endif
+}
+
 } // namespace crown
@@ -31,8 +31,14 @@ struct ConditionVariable
 	///
 	void wait(Mutex& mutex);
 
+	/// Waits at most @a ms milliseconds. Returns false if the time ran out.
+	bool wait(Mutex& mutex, u32 ms);
+
 	///
 	void signal();
+
+	/// Wakes up all the threads waiting on the condition variable.
+	void broadcast();
 };
 
 } // namespace crown
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/memory/memory.h"
+#include "core/memory/temp_allocator.h"
+#include "core/thread/job_system.h"
+#include "core/thread/mutex.h"
+#include "core/thread/semaphore.h"
+#include "core/thread/thread.h"
+#include "device/profiler.h"
+#include <stdint.h> // uintptr_t
+
+namespace crown
+{
+struct JobQueue
+{
+	Mutex mutex;
+	u32 head; ///< Oldest job, where thieves take from.
+	u32 tail; ///< Newest job, where the owner pushes to and pops from.
+	Job jobs[CROWN_JOB_QUEUE_SIZE];
+
+	JobQueue()
+		: head(0)
+		, tail(0)
+	{
+	}
+};
+
+struct JobSystem
+{
+	JobQueue queues[CROWN_MAX_JOB_WORKERS + 1];
+	Thread threads[CROWN_MAX_JOB_WORKERS];
+	u32 num_workers;
+	Semaphore work;
+	AtomicInt exit;
+
+	JobSystem()
+		: num_workers(0)
+		, exit(0)
+	{
+	}
+};
+
+namespace job_system_globals
+{
+	static JobSystem* _job_system = NULL;
+
+	// Index of the queue owned by the calling thread. The main thread and
+	// threads not owned by the job system share the queue 0.
+	static CE_THREAD u32 _queue_index = 0;
+
+} // namespace job_system_globals
+
+namespace job_system
+{
+	static bool push(JobSystem& js, const Job& job)
+	{
+		JobQueue& q = js.queues[job_system_globals::_queue_index];
+		ScopedMutex sm(q.mutex);
+
+		if (q.tail - q.head == CROWN_JOB_QUEUE_SIZE)
+			return false;
+
+		q.jobs[q.tail++ % CROWN_JOB_QUEUE_SIZE] = job;
+		return true;
+	}
+
+	static bool pop(JobQueue& q, Job& job)
+	{
+		ScopedMutex sm(q.mutex);
+
+		if (q.tail == q.head)
+			return false;
+
+		job = q.jobs[--q.tail % CROWN_JOB_QUEUE_SIZE];
+		return true;
+	}
+
+	static bool steal(JobQueue& q, Job& job)
+	{
+		ScopedMutex sm(q.mutex);
+
+		if (q.tail == q.head)
+			return false;
+
+		job = q.jobs[q.head++ % CROWN_JOB_QUEUE_SIZE];
+		return true;
+	}
+
+	static bool next_job(JobSystem& js, Job& job)
+	{
+		const u32 self = job_system_globals::_queue_index;
+		const u32 num_queues = js.num_workers + 1;
+
+		if (pop(js.queues[self], job))
+			return true;
+
+		for (u32 i = 1; i < num_queues; ++i)
+		{
+			if (steal(js.queues[(self + i) % num_queues], job))
+				return true;
+		}
+
+		return false;
+	}
+
+	static void execute(const Job& job)
+	{
+		ENTER_PROFILE_SCOPE("job");
+		job.function(job.user_data);
+		LEAVE_PROFILE_SCOPE();
+
+		if (job.counter != NULL)
+			job.counter->fetch_add(-1);
+	}
+
+	static s32 worker(void* user_data)
+	{
+		JobSystem& js = *job_system_globals::_job_system;
+		job_system_globals::_queue_index = (u32)(uintptr_t)user_data;
+
+		while (true)
+		{
+			Job job;
+			if (next_job(js, job))
+			{
+				execute(job);
+				// Make the events visible to the profiler as soon as possible
+				profiler::flush_local_buffer();
+				continue;
+			}
+
+			js.work.wait();
+
+			if (js.exit.load() != 0)
+				break;
+		}
+
+		return 0;
+	}
+
+	u32 num_threads()
+	{
+		JobSystem* js = job_system_globals::_job_system;
+		return js != NULL ? js->num_workers + 1 : 1;
+	}
+
+	void run(Job* jobs, u32 num, AtomicInt* counter)
+	{
+		if (counter != NULL)
+		{
+			counter->fetch_add((s32)num);
+			for (u32 i = 0; i < num; ++i)
+				jobs[i].counter = counter;
+		}
+
+		JobSystem* js = job_system_globals::_job_system;
+		if (js == NULL || js->num_workers == 0)
+		{
+			for (u32 i = 0; i < num; ++i)
+				execute(jobs[i]);
+			return;
+		}
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			// Execute the job right away if the queue is full
+			if (!push(*js, jobs[i]))
+				execute(jobs[i]);
+		}
+
+		js->work.post(num < js->num_workers ? num : js->num_workers);
+	}
+
+	void wait(AtomicInt& counter)
+	{
+		JobSystem* js = job_system_globals::_job_system;
+
+		while (counter.load() > 0)
+		{
+			Job job;
+			if (js != NULL && next_job(*js, job))
+				execute(job);
+		}
+	}
+
+	struct RangeJob
+	{
+		RangeFunction function;
+		void* user_data;
+		u32 begin;
+		u32 end;
+	};
+
+	static void range_job(void* user_data)
+	{
+		RangeJob& rj = *(RangeJob*)user_data;
+		rj.function(rj.begin, rj.end, rj.user_data);
+	}
+
+	void parallel_for(u32 begin, u32 end, u32 grain_size, RangeFunction function, void* user_data)
+	{
+		if (begin >= end)
+			return;
+
+		const u32 num = end - begin;
+		if (grain_size == 0)
+		{
+			const u32 num_chunks = num_threads() * 4;
+			grain_size = (num + num_chunks - 1) / num_chunks;
+		}
+
+		if (num <= grain_size || num_threads() == 1)
+		{
+			function(begin, end, user_data);
+			return;
+		}
+
+		const u32 num_jobs = (num + grain_size - 1) / grain_size;
+
+		TempAllocator1024 ta;
+		Array<RangeJob> range_jobs(ta);
+		Array<Job> jobs(ta);
+		array::resize(range_jobs, num_jobs);
+		array::resize(jobs, num_jobs);
+
+		for (u32 i = 0; i < num_jobs; ++i)
+		{
+			range_jobs[i].function  = function;
+			range_jobs[i].user_data = user_data;
+			range_jobs[i].begin     = begin + i*grain_size;
+			range_jobs[i].end       = end - range_jobs[i].begin < grain_size ? end : range_jobs[i].begin + grain_size;
+
+			jobs[i].function  = range_job;
+			jobs[i].user_data = &range_jobs[i];
+			jobs[i].counter   = NULL;
+		}
+
+		AtomicInt counter(0);
+		run(array::begin(jobs), num_jobs, &counter);
+		wait(counter);
+	}
+
+} // namespace job_system
+
+namespace job_system_globals
+{
+	void init(u32 num_workers)
+	{
+		CE_ASSERT(_job_system == NULL, "Job system already initialized");
+		CE_ASSERT(num_workers <= CROWN_MAX_JOB_WORKERS, "Too many workers");
+
+		_job_system = CE_NEW(default_allocator(), JobSystem)();
+		_job_system->num_workers = num_workers;
+
+		// Keep the workers on the fastest cores of big.LITTLE processors
+		CpuTopology ct;
+		thread::cpu_topology(ct);
+		const u64 affinity = ct.num_clusters > 1 ? ct.cluster_mask[0] : 0;
+
+		for (u32 i = 0; i < num_workers; ++i)
+		{
+			_job_system->threads[i].set_name("job_worker");
+			_job_system->threads[i].set_affinity(affinity);
+			_job_system->threads[i].start(job_system::worker, (void*)(uintptr_t)(i + 1));
+		}
+	}
+
+	void shutdown()
+	{
+		CE_ASSERT(_job_system != NULL, "Job system not initialized");
+
+		_job_system->exit.store(1);
+		_job_system->work.post(_job_system->num_workers);
+
+		for (u32 i = 0; i < _job_system->num_workers; ++i)
+			_job_system->threads[i].stop();
+
+		for (u32 i = 0; i < _job_system->num_workers + 1; ++i)
+			CE_ASSERT(_job_system->queues[i].tail == _job_system->queues[i].head, "Jobs still pending");
+
+		CE_DELETE(default_allocator(), _job_system);
+		_job_system = NULL;
+	}
+
+} // namespace job_system_globals
+
+} // namespace crown
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/thread/atomic_int.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Unit of work executed by the job system.
+///
+/// @ingroup Thread
+struct Job
+{
+	typedef void (*JobFunction)(void* user_data);
+
+	JobFunction function;
+	void* user_data;
+	AtomicInt* counter; ///< Decremented when the job completes, may be NULL.
+};
+
+/// Global job system functions.
+///
+/// @ingroup Thread
+namespace job_system_globals
+{
+	/// Starts @a num_workers worker threads. With zero workers, or if
+	/// init() is never called, jobs are executed by the thread which
+	/// submits them.
+	void init(u32 num_workers);
+
+	/// Stops the worker threads. All the jobs must have completed.
+	void shutdown();
+
+} // namespace job_system_globals
+
+/// Work-stealing job system.
+/// Each worker, plus the main thread, owns a queue: jobs are pushed to and
+/// popped from the queue of the calling thread in LIFO order, and idle
+/// threads steal the oldest jobs from the queues of the others.
+/// Threads waiting for a counter execute pending jobs in the meantime, so
+/// jobs can wait for the jobs they submit without deadlocking.
+///
+/// @ingroup Thread
+namespace job_system
+{
+	typedef void (*RangeFunction)(u32 begin, u32 end, void* user_data);
+
+	/// Returns the number of threads which execute jobs, including the
+	/// main thread.
+	u32 num_threads();
+
+	/// Submits the @a num @a jobs. If @a counter is not NULL, it is
+	/// incremented by @a num and all the jobs will decrement it when they
+	/// complete; otherwise the counter of each job is used as is.
+	void run(Job* jobs, u32 num, AtomicInt* counter = NULL);
+
+	/// Executes pending jobs until @a counter reaches zero.
+	void wait(AtomicInt& counter);
+
+	/// Calls @a function on consecutive sub-ranges of [@a begin, @a end)
+	/// of at most @a grain_size elements, in parallel, and waits for all
+	/// of them to complete. A @a grain_size of 0 splits the range evenly
+	/// among the threads.
+	void parallel_for(u32 begin, u32 end, u32 grain_size, RangeFunction function, void* user_data);
+
+} // namespace job_system
+
+} // namespace crown
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/thread/read_write_lock.h"
+#include "core/thread/spinlock.h"
+
+namespace crown
+{
+void ReadWriteLock::lock_read()
+{
+	Backoff backoff;
+	u32 state = _state.load(MemoryOrder::RELAXED);
+
+	for (;;)
+	{
+		if ((state & (WRITER | WRITER_PENDING)) == 0)
+		{
+			if (_state.compare_exchange(state, state + 1, MemoryOrder::ACQUIRE))
+				return;
+		}
+		else
+		{
+			backoff.spin();
+			state = _state.load(MemoryOrder::RELAXED);
+		}
+	}
+}
+
+void ReadWriteLock::unlock_read()
+{
+	const u32 prev = _state.fetch_sub(1, MemoryOrder::RELEASE);
+	CE_ASSERT((prev & READERS_MASK) != 0, "Not locked for reading");
+	CE_UNUSED(prev);
+}
+
+void ReadWriteLock::lock_write()
+{
+	Backoff backoff;
+	u32 state = _state.load(MemoryOrder::RELAXED);
+
+	for (;;)
+	{
+		if ((state & ~WRITER_PENDING) == 0)
+		{
+			// Clears WRITER_PENDING too, other waiting writers will set it again
+			if (_state.compare_exchange(state, WRITER, MemoryOrder::ACQUIRE))
+				return;
+		}
+		else
+		{
+			if ((state & WRITER_PENDING) == 0)
+				_state.fetch_or(WRITER_PENDING, MemoryOrder::RELAXED);
+
+			backoff.spin();
+			state = _state.load(MemoryOrder::RELAXED);
+		}
+	}
+}
+
+void ReadWriteLock::unlock_write()
+{
+	const u32 prev = _state.fetch_and(~u32(WRITER), MemoryOrder::RELEASE);
+	CE_ASSERT((prev & WRITER) != 0, "Not locked for writing");
+	CE_UNUSED(prev);
+}
+
+} // namespace crown
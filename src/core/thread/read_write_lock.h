@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/thread/atomic.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Spinning lock which admits either any number of readers or a single
+/// writer. Writers have priority: once a writer is waiting, new readers
+/// wait until it is done.
+///
+/// @ingroup Thread
+struct ReadWriteLock
+{
+	enum : u32
+	{
+		WRITER         = 1u << 31,
+		WRITER_PENDING = 1u << 30,
+		READERS_MASK   = WRITER_PENDING - 1
+	};
+
+	AtomicU32 _state;
+
+	///
+	ReadWriteLock() : _state(0) {}
+
+	///
+	ReadWriteLock(const ReadWriteLock&) = delete;
+
+	///
+	ReadWriteLock& operator=(const ReadWriteLock&) = delete;
+
+	/// Locks for reading.
+	void lock_read();
+
+	/// Unlocks for reading.
+	void unlock_read();
+
+	/// Locks for writing.
+	void lock_write();
+
+	/// Unlocks for writing.
+	void unlock_write();
+};
+
+/// Automatically locks a ReadWriteLock for reading when created and
+/// unlocks it when destroyed.
+///
+/// @ingroup Thread
+struct ScopedReadLock
+{
+	ReadWriteLock& _lock;
+
+	///
+	ScopedReadLock(ReadWriteLock& l)
+		: _lock(l)
+	{
+		_lock.lock_read();
+	}
+
+	///
+	~ScopedReadLock()
+	{
+		_lock.unlock_read();
+	}
+
+	///
+	ScopedReadLock(const ScopedReadLock&) = delete;
+
+	///
+	ScopedReadLock& operator=(const ScopedReadLock&) = delete;
+};
+
+/// Automatically locks a ReadWriteLock for writing when created and
+/// unlocks it when destroyed.
+///
+/// @ingroup Thread
+struct ScopedWriteLock
+{
+	ReadWriteLock& _lock;
+
+	///
+	ScopedWriteLock(ReadWriteLock& l)
+		: _lock(l)
+	{
+		_lock.lock_write();
+	}
+
+	///
+	~ScopedWriteLock()
+	{
+		_lock.unlock_write();
+	}
+
+	///
+	ScopedWriteLock(const ScopedWriteLock&) = delete;
+
+	///
+	ScopedWriteLock& operator=(const ScopedWriteLock&) = delete;
+};
+
+} // namespace crown
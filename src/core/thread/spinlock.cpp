@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/platform.h"
+#include "core/thread/spinlock.h"
+
+#if CROWN_PLATFORM_POSIX
+	#include <sched.h>
+#elif CROWN_PLATFORM_WINDOWS
+	#include <windows.h>
+#endif
+
+#if CROWN_CPU_X86 && CROWN_COMPILER_MSVC
+	#include <intrin.h>
+#endif
+
+namespace crown
+{
+// Maximum number of doublings of the pause count before yielding.
+static const u32 MAX_SPIN_LOG2 = 6;
+
+static inline void cpu_pause()
+{
+#if CROWN_CPU_X86
+	#if CROWN_COMPILER_MSVC
+	_mm_pause();
+	#else
+	__builtin_ia32_pause();
+	#endif
+#elif CROWN_CPU_ARM
+	#if CROWN_COMPILER_MSVC
+	__yield();
+	#else
+	__asm__ __volatile__("yield");
+	#endif
+#endif
+}
+
+void Backoff::spin()
+{
+	if (_count < MAX_SPIN_LOG2)
+	{
+		for (u32 i = 0, n = 1u << _count; i < n; ++i)
+			cpu_pause();
+		++_count;
+		return;
+	}
+
+#if CROWN_PLATFORM_POSIX
+	sched_yield();
+#elif CROWN_PLATFORM_WINDOWS
+	SwitchToThread();
+#endif
+}
+
+} // namespace crown
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/thread/atomic.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Exponential backoff for spin-wait loops. It spins with a CPU pause
+/// hint, doubling the number of pauses at each call, and then starts
+/// yielding the rest of the time slice to other threads.
+///
+/// @ingroup Thread
+struct Backoff
+{
+	u32 _count;
+
+	///
+	Backoff() : _count(0) {}
+
+	/// Waits a little longer than the previous call.
+	void spin();
+
+	/// Restarts from the shortest wait.
+	void reset() { _count = 0; }
+};
+
+/// Lock which busy-waits instead of putting the thread to sleep.
+/// Use it only to protect a few instructions, Mutex otherwise.
+///
+/// @ingroup Thread
+struct Spinlock
+{
+	AtomicU32 _locked;
+
+	///
+	Spinlock() : _locked(0) {}
+
+	///
+	Spinlock(const Spinlock&) = delete;
+
+	///
+	Spinlock& operator=(const Spinlock&) = delete;
+
+	/// Tries to lock the spinlock once and returns whether it succeeded.
+	bool try_lock()
+	{
+		return _locked.load(MemoryOrder::RELAXED) == 0
+			&& _locked.exchange(1, MemoryOrder::ACQUIRE) == 0
+			;
+	}
+
+	/// Locks the spinlock.
+	void lock()
+	{
+		Backoff backoff;
+		while (!try_lock())
+			backoff.spin();
+	}
+
+	/// Unlocks the spinlock.
+	void unlock()
+	{
+		_locked.store(0, MemoryOrder::RELEASE);
+	}
+};
+
+/// Automatically locks a spinlock when created and unlocks when destroyed.
+///
+/// @ingroup Thread
+struct ScopedSpinlock
+{
+	Spinlock& _spinlock;
+
+	/// Locks the spinlock @a sl.
+	ScopedSpinlock(Spinlock& sl)
+		: _spinlock(sl)
+	{
+		_spinlock.lock();
+	}
+
+	/// Unlocks the spinlock passed to ScopedSpinlock::ScopedSpinlock()
+	~ScopedSpinlock()
+	{
+		_spinlock.unlock();
+	}
+
+	///
+	ScopedSpinlock(const ScopedSpinlock&) = delete;
+
+	///
+	ScopedSpinlock& operator=(const ScopedSpinlock&) = delete;
+};
+
+} // namespace crown
@@ -4,11 +4,22 @@
  */
 
 #include "core/error/error.h"
+#include "core/memory/memory.h"
 #include "core/platform.h"
 #include "core/thread/thread.h"
+#include "device/profiler.h"
+
+#include <string.h> // memset
 
 #if CROWN_PLATFORM_POSIX
 	#include <pthread.h>
+	#include <unistd.h> // sysconf
+#endif
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+	#include <sched.h>        // sched_setaffinity
+	#include <stdio.h>        // fopen, fscanf
+	#include <sys/resource.h> // setpriority
+	#include <sys/syscall.h>  // SYS_gettid
 #elif CROWN_PLATFORM_WINDOWS
 	#include <windows.h>
 	#include <process.h>
@@ -25,19 +36,95 @@ struct Private
 #endif
 };
 
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+// Nice value of each ThreadPriority.
+static const int s_nice[] = { 10, 0, -5, -10 };
+CE_STATIC_ASSERT(countof(s_nice) == ThreadPriority::COUNT);
+#elif CROWN_PLATFORM_WINDOWS
+static const int s_priority[] =
+{
+	THREAD_PRIORITY_BELOW_NORMAL,
+	THREAD_PRIORITY_NORMAL,
+	THREAD_PRIORITY_ABOVE_NORMAL,
+	THREAD_PRIORITY_TIME_CRITICAL
+};
+CE_STATIC_ASSERT(countof(s_priority) == ThreadPriority::COUNT);
+
+typedef HRESULT (WINAPI *SetThreadDescriptionFunction)(HANDLE, PCWSTR);
+#endif
+
+// Applies the name, affinity and priority of @a thread to the calling thread.
+static void setup_thread(const Thread& thread)
+{
+	if (thread._name != NULL)
+	{
+		profiler::set_thread_name(thread._name);
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+		char name[16];
+		strncpy(name, thread._name, sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+		pthread_setname_np(pthread_self(), name);
+#elif CROWN_PLATFORM_IOS || CROWN_PLATFORM_OSX
+		pthread_setname_np(thread._name);
+#elif CROWN_PLATFORM_WINDOWS
+		// SetThreadDescription() is only available since Windows 10 1607
+		SetThreadDescriptionFunction set_thread_description = (SetThreadDescriptionFunction)GetProcAddress(GetModuleHandleA("kernel32.dll"), "SetThreadDescription");
+		if (set_thread_description != NULL)
+		{
+			WCHAR name[64];
+			MultiByteToWideChar(CP_UTF8, 0, thread._name, -1, name, countof(name));
+			name[countof(name) - 1] = 0;
+			set_thread_description(GetCurrentThread(), name);
+		}
+#endif
+	}
+
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+	if (thread._affinity != 0)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (u32 i = 0; i < 64; ++i)
+		{
+			if (thread._affinity & (u64(1) << i))
+				CPU_SET(i, &set);
+		}
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+
+	// Threads have their own nice value on Linux
+	if (thread._priority != ThreadPriority::NORMAL)
+		setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), s_nice[thread._priority]);
+#elif CROWN_PLATFORM_WINDOWS
+	if (thread._affinity != 0)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)thread._affinity);
+
+	if (thread._priority != ThreadPriority::NORMAL)
+		SetThreadPriority(GetCurrentThread(), s_priority[thread._priority]);
+#endif
+}
+
 #if CROWN_PLATFORM_POSIX
 static void* thread_proc(void* arg)
 {
 	Thread* thread = (Thread*)arg;
+	setup_thread(*thread);
 	thread->_sem.post();
-	return (void*)(uintptr_t)thread->_function(thread->_user_data);
+	s32 exit_code = thread->_function(thread->_user_data);
+	profiler::release_thread_buffer();
+	memory_globals::release_thread_cache();
+	return (void*)(uintptr_t)exit_code;
 }
 #elif CROWN_PLATFORM_WINDOWS
 static DWORD WINAPI thread_proc(void* arg)
 {
 	Thread* thread = (Thread*)arg;
+	setup_thread(*thread);
 	thread->_sem.post();
-	return thread->_function(thread->_user_data);
+	s32 exit_code = thread->_function(thread->_user_data);
+	profiler::release_thread_buffer();
+	memory_globals::release_thread_cache();
+	return exit_code;
 }
 #endif
 
@@ -46,6 +133,9 @@ Thread::Thread()
 	, _user_data(NULL)
 	, _is_running(false)
 	, _exit_code(0)
+	, _name(NULL)
+	, _affinity(0)
+	, _priority(ThreadPriority::NORMAL)
 {
 	Private* priv = (Private*)_data;
 	CE_STATIC_ASSERT(sizeof(_data) >= sizeof(Private));
@@ -62,6 +152,22 @@ Thread::~Thread()
 		stop();
 }
 
+void Thread::set_name(const char* name)
+{
+	_name = name;
+}
+
+void Thread::set_affinity(u64 mask)
+{
+	_affinity = mask;
+}
+
+void Thread::set_priority(ThreadPriority::Enum priority)
+{
+	CE_ASSERT(priority < ThreadPriority::COUNT, "Unknown priority");
+	_priority = priority;
+}
+
 void Thread::start(ThreadFunction func, void* user_data, u32 stack_size)
 {
 	Private* priv = (Private*)_data;
@@ -131,4 +237,118 @@ s32 Thread::exit_code()
 	return _exit_code;
 }
 
+namespace thread
+{
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+	// Reads the unsigned integer in the file at @a path, returns @a deffault on failure.
+	static u32 read_u32(const char* path, u32 deffault)
+	{
+		FILE* file = fopen(path, "r");
+		if (file == NULL)
+			return deffault;
+
+		u32 val = deffault;
+		if (fscanf(file, "%u", &val) != 1)
+			val = deffault;
+		fclose(file);
+		return val;
+	}
+#endif
+
+	void cpu_topology(CpuTopology& ct)
+	{
+		memset(&ct, 0, sizeof(ct));
+
+#if CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+		long num = sysconf(_SC_NPROCESSORS_CONF);
+		ct.num_logical = num < 1 ? 1 : num > 64 ? 64 : (u32)num;
+
+		u64 core_ids[64];
+		u32 max_freq[CROWN_MAX_CPU_CLUSTERS];
+		for (u32 i = 0; i < ct.num_logical; ++i)
+		{
+			char path[128];
+
+			// Cores are identified by package and core id, the hardware
+			// threads of the same core share both
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", i);
+			const u32 package = read_u32(path, 0);
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", i);
+			const u64 core = (u64(package) << 32) | read_u32(path, i);
+
+			u32 j = 0;
+			while (j < ct.num_physical && core_ids[j] != core)
+				++j;
+			if (j == ct.num_physical)
+				core_ids[ct.num_physical++] = core;
+
+			// Cores of the same cluster run at the same maximum frequency
+			snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", i);
+			const u32 freq = read_u32(path, 0);
+
+			u32 c = 0;
+			while (c < ct.num_clusters && max_freq[c] != freq)
+				++c;
+			if (c == ct.num_clusters)
+			{
+				if (ct.num_clusters == CROWN_MAX_CPU_CLUSTERS)
+					c = CROWN_MAX_CPU_CLUSTERS - 1;
+				else
+					max_freq[ct.num_clusters++] = freq;
+			}
+			ct.cluster_mask[c] |= u64(1) << i;
+		}
+
+		// Sort the clusters from the fastest to the slowest
+		for (u32 i = 1; i < ct.num_clusters; ++i)
+		{
+			for (u32 j = i; j > 0 && max_freq[j - 1] < max_freq[j]; --j)
+			{
+				const u32 freq = max_freq[j];
+				max_freq[j] = max_freq[j - 1];
+				max_freq[j - 1] = freq;
+				const u64 mask = ct.cluster_mask[j];
+				ct.cluster_mask[j] = ct.cluster_mask[j - 1];
+				ct.cluster_mask[j - 1] = mask;
+			}
+		}
+#elif CROWN_PLATFORM_WINDOWS
+		SYSTEM_LOGICAL_PROCESSOR_INFORMATION info[256];
+		DWORD size = sizeof(info);
+		if (GetLogicalProcessorInformation(info, &size))
+		{
+			for (u32 i = 0; i < size / sizeof(info[0]); ++i)
+			{
+				if (info[i].Relationship != RelationProcessorCore)
+					continue;
+
+				++ct.num_physical;
+				ct.cluster_mask[0] |= (u64)info[i].ProcessorMask;
+			}
+
+			for (u32 i = 0; i < 64; ++i)
+			{
+				if (ct.cluster_mask[0] & (u64(1) << i))
+					++ct.num_logical;
+			}
+			ct.num_clusters = 1;
+		}
+#else
+		long num = sysconf(_SC_NPROCESSORS_ONLN);
+		ct.num_logical = num < 1 ? 1 : num > 64 ? 64 : (u32)num;
+#endif // CROWN_PLATFORM_LINUX || CROWN_PLATFORM_ANDROID
+
+		if (ct.num_logical == 0)
+			ct.num_logical = 1;
+		if (ct.num_physical == 0)
+			ct.num_physical = ct.num_logical;
+		if (ct.num_clusters == 0)
+		{
+			ct.num_clusters = 1;
+			ct.cluster_mask[0] = ct.num_logical == 64 ? UINT64_MAX : (u64(1) << ct.num_logical) - 1;
+		}
+	}
+
+} // namespace thread
+
 } // namespace crown
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/thread/semaphore.h"
 #include "core/types.h"
 
@@ -12,6 +13,33 @@
 /// @ingroup Core
 namespace crown
 {
+/// Enumerates thread priorities.
+///
+/// @ingroup Thread
+struct ThreadPriority
+{
+	enum Enum
+	{
+		LOW,      ///< Background work, e.g. loading and logging.
+		NORMAL,
+		HIGH,
+		CRITICAL, ///< Work with hard deadlines, e.g. audio mixing.
+
+		COUNT
+	};
+};
+
+/// Processors of the machine.
+///
+/// @ingroup Thread
+struct CpuTopology
+{
+	u32 num_logical;  ///< Number of hardware threads.
+	u32 num_physical; ///< Number of cores.
+	u32 num_clusters; ///< Number of groups of cores with the same maximum frequency.
+	u64 cluster_mask[CROWN_MAX_CPU_CLUSTERS]; ///< Logical processors of each cluster, fastest cluster first.
+};
+
 /// Thread.
 ///
 /// @ingroup Thread.
@@ -24,6 +52,9 @@ struct Thread
 	Semaphore _sem;
 	bool _is_running;
 	s32 _exit_code;
+	const char* _name;
+	u64 _affinity;
+	ThreadPriority::Enum _priority;
 	CE_ALIGN_DECL(16, u8 _data[32]);
 
 	///
@@ -38,6 +69,23 @@ struct Thread
 	///
 	Thread& operator=(const Thread&) = delete;
 
+	/// Sets the @a name of the thread, shown by debuggers and in the
+	/// profiler data. Operating systems may truncate it to 15 characters.
+	/// The name is not copied and must be valid while the thread runs.
+	/// Takes effect at the next start().
+	void set_name(const char* name);
+
+	/// Restricts the thread to the logical processors in @a mask, bit i
+	/// being processor i. A @a mask of 0 lets the thread run on any
+	/// processor. Not supported on iOS and OS X.
+	/// Takes effect at the next start().
+	void set_affinity(u64 mask);
+
+	/// Sets the @a priority of the thread. Raising the priority above
+	/// NORMAL may require privileges and fail silently without them.
+	/// Takes effect at the next start().
+	void set_priority(ThreadPriority::Enum priority);
+
 	///
 	void start(ThreadFunction func, void* user_data = NULL, u32 stack_size = 0);
 
@@ -51,4 +99,16 @@ struct Thread
 	s32 exit_code();
 };
 
+/// Functions to query the processors.
+///
+/// @ingroup Thread
+namespace thread
+{
+	/// Fills @a ct with the processors of the machine. Clusters are
+	/// detected on Linux and Android only, from the maximum frequency of
+	/// each core, elsewhere all the processors are in one cluster.
+	void cpu_topology(CpuTopology& ct);
+
+} // namespace thread
+
 } // namespace crown
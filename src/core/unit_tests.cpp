@@ -7,31 +7,64 @@
 
 #if CROWN_BUILD_UNIT_TESTS
 
+#include "core/adpcm.h"
 #include "core/command_line.h"
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
+#include "core/containers/inline_array.h"
+#include "core/containers/mpmc_queue.h"
+#include "core/containers/sort_map.h"
+#include "core/containers/spsc_queue.h"
 #include "core/containers/vector.h"
+#include "core/error/callstack.h"
+#include "core/error/callstack_table.h"
+#include "core/filesystem/file_memory.h"
+#include "core/filesystem/io_queue.h"
 #include "core/filesystem/path.h"
+#include "core/filesystem/reader_writer.h"
 #include "core/guid.h"
+#include "core/lz4.h"
 #include "core/json/json.h"
+#include "core/json/json_document.h"
 #include "core/json/sjson.h"
 #include "core/math/aabb.h"
+#include "core/math/aabb_tree.h"
 #include "core/math/color4.h"
+#include "core/math/frustum.h"
+#include "core/math/intersection.h"
 #include "core/math/math.h"
 #include "core/math/matrix3x3.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/quaternion.h"
+#include "core/math/random.h"
 #include "core/math/sphere.h"
 #include "core/math/vector2.h"
 #include "core/math/vector3.h"
 #include "core/math/vector4.h"
+#include "core/memory/frame_allocator.h"
 #include "core/memory/memory.h"
+#include "core/memory/proxy_allocator.h"
 #include "core/memory/temp_allocator.h"
+#include "core/memory/tlsf_allocator.h"
 #include "core/murmur.h"
+#include "core/network/socket.h"
+#include "core/os.h"
+#include "core/radix_sort.h"
 #include "core/strings/dynamic_string.h"
+#include "core/strings/inline_string.h"
+#include "core/strings/number.h"
 #include "core/strings/string.h"
 #include "core/strings/string_id.h"
+#include "core/strings/string_stream.h"
+#include "core/thread/atomic.h"
+#include "core/thread/condition_variable.h"
+#include "core/thread/job_system.h"
+#include "core/thread/read_write_lock.h"
+#include "core/thread/spinlock.h"
 #include "core/thread/thread.h"
+#include <float.h>  // FLT_MAX
+#include <stdlib.h> // strtod, strtof
+#include <string.h> // memcmp
 
 #define ENSURE(condition)                                \
 	do                                                   \
@@ -59,6 +92,130 @@ static void test_memory()
 	ENSURE(a.allocated_size(p) >= 32);
 	a.deallocate(p);
 
+	{
+		ProxyAllocator pa(a, "test");
+		ProxyAllocator pb(pa, "test-child");
+		ENSURE(pa.total_allocated() == 0);
+
+		void* q = pb.allocate(64);
+		ENSURE(pb.total_allocated() == a.allocated_size(q));
+		ENSURE(pa.total_allocated() == pb.total_allocated());
+
+		pb.deallocate(q);
+		ENSURE(pa.total_allocated() == 0);
+		ENSURE(pb.total_allocated() == 0);
+	}
+
+	{
+		// Blocks deallocated by a thread other than the one which allocated them
+		const u32 allocated = a.total_allocated();
+		void* blocks[256];
+		for (u32 i = 0; i < countof(blocks); ++i)
+		{
+			blocks[i] = a.allocate(i*8 + 1, i % 2 ? 16 : 64);
+			ENSURE(((uintptr_t)blocks[i] & (i % 2 ? 15 : 63)) == 0);
+			memset(blocks[i], 0xff, i*8 + 1);
+		}
+		ENSURE(a.total_allocated() > allocated);
+
+		Thread thread;
+		thread.start([](void* data) {
+				void** blocks = (void**)data;
+				for (u32 i = 0; i < 256; ++i)
+					default_allocator().deallocate(blocks[i]);
+				return 0;
+			}
+			, blocks
+			);
+		thread.stop();
+		ENSURE(a.total_allocated() == allocated);
+	}
+
+	{
+		// Large blocks are mapped from the OS, with huge pages if possible
+		memory_globals::enable_huge_pages(true);
+		const u32 allocated = a.total_allocated();
+		const u32 size = 2*CROWN_HUGE_PAGE_SIZE;
+		char* q = (char*)a.allocate(size, 64);
+		ENSURE(((uintptr_t)q & 63) == 0);
+		memset(q, 0xff, size);
+		ENSURE(a.allocated_size(q) >= size);
+
+		const memory_globals::PageStats ps = memory_globals::page_stats();
+		ENSURE(ps.num_blocks == 1);
+		ENSURE(ps.mapped_size >= size);
+		ENSURE(ps.huge_size == ps.mapped_size || ps.num_fallbacks == 1);
+
+		a.deallocate(q);
+		ENSURE(a.total_allocated() == allocated);
+		ENSURE(memory_globals::page_stats().num_blocks == 0);
+		ENSURE(memory_globals::page_stats().mapped_size == 0);
+		memory_globals::enable_huge_pages(false);
+	}
+
+	{
+		FrameAllocator fa(a, 1024);
+		char* p = (char*)fa.allocate(100, 16);
+		ENSURE(memory::align_top(p, 16) == p);
+		ENSURE(fa.total_allocated() == 116);
+
+		// Allocations larger than the buffer come from the backing allocator
+		const u32 allocated = a.total_allocated();
+		char* q = (char*)fa.allocate(2048);
+		ENSURE(a.total_allocated() > allocated);
+		memset(q, 0xff, 2048);
+
+		// Both allocations survive the first reset
+		fa.reset();
+		ENSURE(fa.total_allocated() == 0);
+		ENSURE(fa.allocate(100, 16) != p);
+		ENSURE(a.total_allocated() > allocated);
+
+		fa.reset();
+		ENSURE(a.total_allocated() == allocated);
+		ENSURE(fa.allocate(100, 16) == p);
+	}
+
+	{
+		TlsfAllocator ta(a, 64*1024);
+		TlsfAllocator::Stats stats;
+		ta.stats(stats);
+		const u32 free_size = stats.free_size;
+		ENSURE(stats.num_free_blocks == 1);
+		ENSURE(stats.fragmentation == 0.0f);
+
+		void* blocks[64];
+		for (u32 i = 0; i < countof(blocks); ++i)
+		{
+			blocks[i] = ta.allocate(i*13 + 1, i % 3 ? 4 : 64);
+			ENSURE(blocks[i] != NULL);
+			ENSURE(((uintptr_t)blocks[i] & (i % 3 ? 3 : 63)) == 0);
+			ENSURE(ta.allocated_size(blocks[i]) >= i*13 + 1);
+			memset(blocks[i], 0xff, i*13 + 1);
+		}
+		ENSURE(ta.allocate(64*1024) == NULL);
+
+		// Deallocating every other block leaves holes
+		for (u32 i = 0; i < countof(blocks); i += 2)
+			ta.deallocate(blocks[i]);
+		ta.stats(stats);
+		ENSURE(stats.num_allocations == countof(blocks)/2);
+		ENSURE(stats.num_free_blocks > 1);
+		ENSURE(stats.fragmentation > 0.0f);
+
+		// The holes are coalesced back into a single block
+		for (u32 i = 1; i < countof(blocks); i += 2)
+			ta.deallocate(blocks[i]);
+		ta.stats(stats);
+		ENSURE(ta.total_allocated() == 0);
+		ENSURE(stats.num_free_blocks == 1);
+		ENSURE(stats.free_size == free_size);
+
+		void* p = ta.allocate(free_size/2);
+		ENSURE(p != NULL);
+		ta.deallocate(p);
+	}
+
 	memory_globals::shutdown();
 }
 
@@ -74,6 +231,23 @@ static void test_array()
 		ENSURE(array::size(v) == 1);
 		ENSURE(v[0] == 1);
 	}
+	const u32 allocated = a.total_allocated();
+	{
+		InlineArray<int, 8> v(a);
+		for (int i = 0; i < 8; ++i)
+			array::push_back(v, i);
+		ENSURE(a.total_allocated() == allocated);
+
+		InlineArray<int, 8> w(v);
+		ENSURE(array::size(w) == 8);
+		ENSURE(w[7] == 7);
+
+		// Spills to the backing allocator
+		array::push_back(v, 8);
+		ENSURE(a.total_allocated() > allocated);
+		ENSURE(v[0] == 0 && v[8] == 8);
+	}
+	ENSURE(a.total_allocated() == allocated);
 	memory_globals::shutdown();
 }
 
@@ -140,6 +314,88 @@ static void test_hash_map()
 			hash_map::remove(m, i);
 		}
 	}
+	{
+		HashMap<s32, s32> m(a);
+		hash_map::set(m, 0, 7);
+		hash_map::reserve(m, 1000);
+		const u32 capacity = hash_map::capacity(m);
+		ENSURE(capacity >= 1000);
+		ENSURE(hash_map::get(m, 0, 0) == 7);
+
+		for (s32 i = 1; i < 1000; ++i)
+			hash_map::set(m, i, i);
+		ENSURE(hash_map::capacity(m) == capacity);
+		ENSURE(hash_map::size(m) == 1000);
+	}
+	{
+		HashMap<s32, s32> m(a);
+		for (s32 i = 0; i < 1000; ++i)
+			hash_map::set(m, i, i);
+		for (s32 i = 10; i < 1000; ++i)
+			hash_map::remove(m, i);
+
+		hash_map::shrink_to_fit(m);
+		ENSURE(hash_map::capacity(m) == 16);
+		ENSURE(hash_map::size(m) == 10);
+		for (s32 i = 0; i < 10; ++i)
+			ENSURE(hash_map::get(m, i, -1) == i);
+		ENSURE(!hash_map::has(m, 10));
+	}
+	memory_globals::shutdown();
+}
+
+static void test_sort_map()
+{
+	memory_globals::init();
+	Allocator& a = default_allocator();
+	{
+		SortMap<s32, s32> m(a);
+
+		ENSURE(sort_map::size(m) == 0);
+		ENSURE(sort_map::get(m, 0, 42) == 42);
+		ENSURE(!sort_map::has(m, 10));
+
+		for (s32 i = 0; i < 100; ++i)
+			sort_map::set(m, (i*37) % 100, i);
+		for (s32 i = 0; i < 100; ++i)
+			ENSURE(sort_map::get(m, (i*37) % 100, -1) == i);
+		ENSURE(sort_map::size(m) == 100);
+
+		sort_map::remove(m, 20);
+		ENSURE(!sort_map::has(m, 20));
+		ENSURE(sort_map::has(m, 21));
+
+		sort_map::remove(m, 2000);
+		ENSURE(sort_map::size(m) == 99);
+
+		for (const SortMap<s32, s32>::Entry* e = sort_map::begin(m); e + 1 != sort_map::end(m); ++e)
+			ENSURE(e->first < (e + 1)->first);
+
+		sort_map::clear(m);
+		ENSURE(sort_map::size(m) == 0);
+	}
+	{
+		SortMap<s32, s32> m(a);
+		for (s32 i = 0; i < 100; i += 2)
+			sort_map::set(m, i, i);
+
+		// Half of the keys exist already
+		s32 keys[100];
+		s32 vals[100];
+		for (s32 i = 0; i < 100; ++i)
+		{
+			keys[i] = 99 - i;
+			vals[i] = -i;
+		}
+		sort_map::set(m, keys, vals, countof(keys));
+		ENSURE(sort_map::size(m) == 100);
+
+		for (s32 i = 0; i < 100; ++i)
+			ENSURE(sort_map::get(m, 99 - i, 0) == -i);
+
+		for (const SortMap<s32, s32>::Entry* e = sort_map::begin(m); e + 1 != sort_map::end(m); ++e)
+			ENSURE(e->first < (e + 1)->first);
+	}
 	memory_globals::shutdown();
 }
 
@@ -670,6 +926,40 @@ static void test_matrix4x4()
 		ENSURE(fequal(b.t.z, -9.2f, 0.00001f));
 		ENSURE(fequal(b.t.w,  4.9f, 0.00001f));
 	}
+	{
+		const Matrix4x4 a[] =
+		{
+			matrix4x4(1.2f, -2.3f, 5.1f, -1.2f
+				,  2.2f, -5.1f,  1.1f, -7.4f
+				,  3.2f,  3.3f, -3.8f, -9.2f
+				, -6.8f, -2.9f,  1.0f,  4.9f
+				),
+			MATRIX4X4_IDENTITY
+		};
+		const Matrix4x4 b = matrix4x4(3.2f, 4.8f, 6.0f, 5.3f
+			, -1.6f, -7.1f, -2.4f, -6.2f
+			, -3.1f, -2.2f,  8.9f,  8.3f
+			,  3.8f,  9.1f, -3.1f, -7.1f
+			);
+		Matrix4x4 c[2];
+		multiply(c, a, b, 2);
+		ENSURE(fequal(c[0].x.x, -12.85f, 0.00001f));
+		ENSURE(fequal(c[0].t.w, -44.55f, 0.00001f));
+		ENSURE(fequal(c[1].y.z,  -2.4f,  0.00001f));
+		ENSURE(fequal(c[1].t.x,   3.8f,  0.00001f));
+	}
+	{
+		Matrix4x4 a = MATRIX4X4_IDENTITY;
+		set_translation(a, vector3(1.0f, 2.0f, 3.0f));
+		Vector3 p[] = { vector3(1.0f, 1.0f, 1.0f), vector3(-1.0f, 0.0f, 2.0f) };
+		transform_points(p, p, 2, a);
+		ENSURE(fequal(p[0].x, 2.0f, 0.00001f));
+		ENSURE(fequal(p[0].y, 3.0f, 0.00001f));
+		ENSURE(fequal(p[0].z, 4.0f, 0.00001f));
+		ENSURE(fequal(p[1].x, 0.0f, 0.00001f));
+		ENSURE(fequal(p[1].y, 2.0f, 0.00001f));
+		ENSURE(fequal(p[1].z, 5.0f, 0.00001f));
+	}
 }
 
 static void test_aabb()
@@ -752,6 +1042,101 @@ static void test_aabb()
 	}
 }
 
+static void test_aabb_tree()
+{
+	memory_globals::init();
+	Allocator& a = default_allocator();
+	{
+		AABB b;
+		b.min = vector3(-1.0f, -1.0f, -1.0f);
+		b.max = vector3( 1.0f,  1.0f,  1.0f);
+		ENSURE(fequal(ray_aabb_intersection(vector3(-5.0f, 0.0f, 0.0f), vector3( 1.0f, 0.0f, 0.0f), b), 4.0f, 0.00001f));
+		ENSURE(fequal(ray_aabb_intersection(vector3( 0.0f, 0.0f, 0.0f), vector3( 1.0f, 0.0f, 0.0f), b), 0.0f, 0.00001f));
+		ENSURE(ray_aabb_intersection(vector3(-5.0f, 0.0f, 0.0f), vector3(-1.0f, 0.0f, 0.0f), b) == -1.0f);
+		ENSURE(ray_aabb_intersection(vector3(-5.0f, 2.0f, 0.0f), vector3( 1.0f, 0.0f, 0.0f), b) == -1.0f);
+	}
+	{
+		AABBTree tree(a, 0.0f);
+		ENSURE(tree.height() == 0);
+
+		const u32 num = 512;
+		AABB boxes[num];
+		u32 leaves[num];
+		Random rnd(42);
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const Vector3 c = vector3(rnd.unit_float()*100.0f, rnd.unit_float()*100.0f, rnd.unit_float()*100.0f);
+			const Vector3 e = vector3(rnd.unit_float()*2.0f, rnd.unit_float()*2.0f, rnd.unit_float()*2.0f);
+			boxes[i].min = c - e;
+			boxes[i].max = c + e;
+			leaves[i] = tree.create(boxes[i], i);
+		}
+
+		// Balanced trees of 512 leaves should not be much taller than 10
+		ENSURE(tree.height() < 20);
+
+		// Move half of the boxes and destroy a quarter of them
+		for (u32 i = 0; i < num; i += 2)
+		{
+			const Vector3 d = vector3(rnd.unit_float()*10.0f, 0.0f, 0.0f);
+			boxes[i].min += d;
+			boxes[i].max += d;
+			tree.move(leaves[i], boxes[i]);
+		}
+		for (u32 i = 0; i < num; i += 4)
+		{
+			tree.destroy(leaves[i]);
+			leaves[i] = UINT32_MAX;
+		}
+
+		AABB q;
+		q.min = vector3(20.0f, 20.0f, 20.0f);
+		q.max = vector3(60.0f, 60.0f, 60.0f);
+
+		Array<u32> result(a);
+		tree.query_aabb(q, result);
+
+		u32 num_expected = 0;
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (leaves[i] == UINT32_MAX)
+				continue;
+
+			const bool overlap = boxes[i].min.x <= q.max.x && boxes[i].max.x >= q.min.x
+				&& boxes[i].min.y <= q.max.y && boxes[i].max.y >= q.min.y
+				&& boxes[i].min.z <= q.max.z && boxes[i].max.z >= q.min.z
+				;
+			if (!overlap)
+				continue;
+
+			++num_expected;
+			bool found = false;
+			for (u32 j = 0; j < array::size(result); ++j)
+				found = found || result[j] == i;
+			ENSURE(found);
+		}
+		ENSURE(array::size(result) == num_expected);
+
+		const Vector3 from = vector3(-10.0f, 50.0f, 50.0f);
+		const Vector3 dir = vector3(1.0f, 0.0f, 0.0f);
+		array::clear(result);
+		tree.query_ray(from, dir, 1000.0f, result);
+
+		num_expected = 0;
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (leaves[i] != UINT32_MAX && ray_aabb_intersection(from, dir, boxes[i]) != -1.0f)
+				++num_expected;
+		}
+		ENSURE(array::size(result) == num_expected);
+
+		tree.clear();
+		ENSURE(tree.height() == 0);
+	}
+	memory_globals::shutdown();
+}
+
 static void test_sphere()
 {
 	{
@@ -823,6 +1208,188 @@ static void test_sphere()
 	}
 }
 
+static void test_intersection()
+{
+	const u32 NUM = 37;
+	Random rnd(42);
+	f32 sc[3][NUM], sr[NUM];
+	f32 bmin[3][NUM], bmax[3][NUM];
+	f32 oc[3][NUM], oaxis[3][3][NUM], ohe[3][NUM];
+	Sphere spheres[NUM];
+	AABB boxes[NUM];
+	Matrix4x4 obb_tm[NUM];
+	Vector3 obb_he[NUM];
+
+	for (u32 i = 0; i < NUM; ++i)
+	{
+		const Vector3 c = vector3(rnd.unit_float()*20.0f - 10.0f, rnd.unit_float()*20.0f - 10.0f, rnd.unit_float()*20.0f);
+		const Vector3 he = vector3(rnd.unit_float() + 0.5f, rnd.unit_float() + 0.5f, rnd.unit_float() + 0.5f);
+		Vector3 axis = vector3(rnd.unit_float(), rnd.unit_float(), rnd.unit_float() + 0.1f);
+		const Quaternion q = quaternion(normalize(axis), rnd.unit_float()*3.0f);
+
+		spheres[i].c = c;
+		spheres[i].r = he.x * 2.0f;
+		boxes[i].min = c - he;
+		boxes[i].max = c + he;
+		obb_tm[i] = matrix4x4(q, c);
+		obb_he[i] = he;
+
+		for (u32 j = 0; j < 3; ++j)
+		{
+			sc[j][i] = to_float_ptr(c)[j];
+			bmin[j][i] = to_float_ptr(boxes[i].min)[j];
+			bmax[j][i] = to_float_ptr(boxes[i].max)[j];
+			oc[j][i] = to_float_ptr(c)[j];
+			ohe[j][i] = to_float_ptr(he)[j];
+			oaxis[0][j][i] = to_float_ptr(obb_tm[i].x)[j];
+			oaxis[1][j][i] = to_float_ptr(obb_tm[i].y)[j];
+			oaxis[2][j][i] = to_float_ptr(obb_tm[i].z)[j];
+		}
+		sr[i] = spheres[i].r;
+	}
+
+	SphereSoA ss = { { sc[0], sc[1], sc[2] }, sr, NUM };
+	AABBSoA bs = { { bmin[0], bmin[1], bmin[2] }, { bmax[0], bmax[1], bmax[2] }, NUM };
+	OBBSoA os;
+	for (u32 j = 0; j < 3; ++j)
+	{
+		os.center[j] = oc[j];
+		os.half_extents[j] = ohe[j];
+		for (u32 k = 0; k < 3; ++k)
+			os.axis[j][k] = oaxis[j][k];
+	}
+	os.num = NUM;
+
+	Vector3 dirs[] =
+	{
+		vector3(0.1f, -0.05f, 1.0f),
+		vector3(0.0f, 0.0f, 1.0f),
+		vector3(1.0f, 0.2f, 0.3f),
+	};
+	for (u32 r = 0; r < countof(dirs); ++r)
+	{
+		normalize(dirs[r]);
+		const Vector3 from = vector3(0.5f, 0.25f, -5.0f);
+		f32 t[NUM];
+
+		u32 nearest = UINT32_MAX;
+		f32 nearest_t = FLT_MAX;
+		u32 hit = ray_sphere_intersection(from, dirs[r], ss, t);
+		for (u32 i = 0; i < NUM; ++i)
+		{
+			const f32 expected = ray_sphere_intersection(from, dirs[r], spheres[i]);
+			ENSURE(fequal(t[i], expected, 0.001f));
+			if (expected != -1.0f && expected < nearest_t) { nearest_t = expected; nearest = i; }
+		}
+		ENSURE(hit == nearest);
+		ENSURE(ray_sphere_intersection(from, dirs[r], ss, NULL) == nearest);
+
+		nearest = UINT32_MAX;
+		nearest_t = FLT_MAX;
+		hit = ray_aabb_intersection(from, dirs[r], bs, t);
+		for (u32 i = 0; i < NUM; ++i)
+		{
+			const f32 expected = ray_aabb_intersection(from, dirs[r], boxes[i]);
+			ENSURE(fequal(t[i], expected, 0.001f));
+			if (expected != -1.0f && expected < nearest_t) { nearest_t = expected; nearest = i; }
+		}
+		ENSURE(hit == nearest);
+
+		nearest = UINT32_MAX;
+		nearest_t = FLT_MAX;
+		hit = ray_obb_intersection(from, dirs[r], os, t);
+		for (u32 i = 0; i < NUM; ++i)
+		{
+			const f32 expected = ray_obb_intersection(from, dirs[r], obb_tm[i], obb_he[i]);
+			ENSURE(fequal(t[i], expected, 0.001f));
+			if (expected != -1.0f && expected < nearest_t) { nearest_t = expected; nearest = i; }
+		}
+		ENSURE(hit == nearest);
+	}
+	{
+		Matrix4x4 pr;
+		perspective(pr, frad(45.0f), 1.0f, 0.1f, 15.0f);
+		Frustum f;
+		frustum::from_matrix(f, pr);
+
+		u32 mask[(NUM + 31) / 32];
+		u32 num = frustum_sphere_intersection(f, ss, mask);
+		u32 expected_num = 0;
+		for (u32 i = 0; i < NUM; ++i)
+		{
+			const bool expected = frustum_sphere_intersection(f, spheres[i]);
+			ENSURE(((mask[i / 32] >> (i % 32)) & 1) == (expected ? 1u : 0u));
+			expected_num += expected ? 1 : 0;
+		}
+		ENSURE(num == expected_num);
+		ENSURE(num > 0 && num < NUM);
+
+		num = frustum_box_intersection(f, bs, mask);
+		expected_num = 0;
+		for (u32 i = 0; i < NUM; ++i)
+		{
+			const bool expected = frustum_box_intersection(f, boxes[i]);
+			ENSURE(((mask[i / 32] >> (i % 32)) & 1) == (expected ? 1u : 0u));
+			expected_num += expected ? 1 : 0;
+		}
+		ENSURE(num == expected_num);
+	}
+}
+
+static void test_random()
+{
+	{
+		// Reference output of pcg32_srandom(42, 54)
+		Pcg32 r(42, 54);
+		ENSURE(r.integer() == 0xa15c02b7u);
+		ENSURE(r.integer() == 0x7b47f409u);
+		ENSURE(r.integer() == 0xba1d3330u);
+		ENSURE(r.integer() == 0x83d2f293u);
+		ENSURE(r.integer() == 0xbfa4784bu);
+		ENSURE(r.integer() == 0xcbed606eu);
+	}
+	{
+		Pcg32 r(7);
+		for (u32 i = 0; i < 1000; ++i)
+		{
+			ENSURE(r.integer(10) < 10);
+			const s32 s = r.range(-3, 3);
+			ENSURE(s >= -3 && s <= 3);
+			const f32 u = r.unit_float();
+			ENSURE(u >= 0.0f && u < 1.0f);
+			const f32 f = r.range(2.0f, 4.0f);
+			ENSURE(f >= 2.0f && f < 4.0f);
+		}
+		ENSURE(r.integer(0) == 0);
+		ENSURE(r.range(5, 5) == 5);
+	}
+	{
+		// Bulk functions generate the same sequence
+		Pcg32 a(1234);
+		Pcg32 b(1234);
+		u32 ints[11];
+		random::fill(a, ints, countof(ints));
+		for (u32 i = 0; i < countof(ints); ++i)
+			ENSURE(ints[i] == b.integer());
+
+		f32 floats[13];
+		random::fill(a, floats, countof(floats), -1.0f, 1.0f);
+		for (u32 i = 0; i < countof(floats); ++i)
+			ENSURE(floats[i] == b.range(-1.0f, 1.0f));
+		ENSURE(a.integer() == b.integer());
+	}
+	{
+		// Split streams are reproducible and differ from their parent
+		Pcg32 a(99);
+		Pcg32 b(99);
+		Pcg32 sa = a.split();
+		Pcg32 sb = b.split();
+		ENSURE(sa._state == sb._state && sa._inc == sb._inc);
+		ENSURE(sa._inc != a._inc);
+		ENSURE(sa.integer() == sb.integer());
+	}
+}
+
 static void test_murmur()
 {
 	const u32 m = murmur32("murmur32", 8, 0);
@@ -831,6 +1398,136 @@ static void test_murmur()
 	ENSURE(n == 0x90631502d1a3432bu);
 }
 
+static void test_radix_sort()
+{
+	{
+		u64 keys[] = { 5, 0xff00000000000000ull, 3, 5, 0, 0x100 };
+		u32 values[] = { 0, 1, 2, 3, 4, 5 };
+		u64 tmp_keys[countof(keys)];
+		u32 tmp_values[countof(keys)];
+		radix_sort(keys, values, tmp_keys, tmp_values, countof(keys));
+		ENSURE(keys[0] == 0 && values[0] == 4);
+		ENSURE(keys[1] == 3 && values[1] == 2);
+		ENSURE(keys[2] == 5 && values[2] == 0);
+		ENSURE(keys[3] == 5 && values[3] == 3);
+		ENSURE(keys[4] == 0x100 && values[4] == 5);
+		ENSURE(keys[5] == 0xff00000000000000ull && values[5] == 1);
+	}
+	{
+		Random r(7);
+		u64 keys[257];
+		u32 values[countof(keys)];
+		u64 tmp_keys[countof(keys)];
+		u32 tmp_values[countof(keys)];
+		for (u32 i = 0; i < countof(keys); ++i)
+		{
+			keys[i] = (u64(r.integer()) << 48) | (u64(r.integer()) << 8) | (u64(r.integer()) & 0x3);
+			values[i] = i;
+		}
+		radix_sort(keys, values, tmp_keys, tmp_values, countof(keys));
+		for (u32 i = 1; i < countof(keys); ++i)
+			ENSURE(keys[i - 1] < keys[i] || (keys[i - 1] == keys[i] && values[i - 1] < values[i]));
+	}
+}
+
+static void test_lz4()
+{
+	memory_globals::init();
+	{
+		// Empty input
+		char compressed[64];
+		const u32 empty_size = lz4::compress("", 0, compressed, sizeof(compressed));
+		ENSURE(empty_size != 0);
+		ENSURE(lz4::decompress(compressed, empty_size, NULL, 0));
+	}
+	{
+		// Repetitive and incompressible input
+		const u32 size = 100*1024;
+		char* src = (char*)default_allocator().allocate(size);
+		char* dst = (char*)default_allocator().allocate(lz4::compress_bound(size));
+		char* out = (char*)default_allocator().allocate(size);
+
+		for (u32 i = 0; i < size; ++i)
+			src[i] = "crown engine"[i % 12];
+
+		u32 csize = lz4::compress(src, size, dst, lz4::compress_bound(size));
+		ENSURE(csize != 0 && csize < size / 10);
+		ENSURE(lz4::decompress(dst, csize, out, size));
+		ENSURE(memcmp(src, out, size) == 0);
+		ENSURE(!lz4::decompress(dst, csize, out, size - 1));
+		ENSURE(!lz4::decompress(dst, csize - 1, out, size));
+
+		u32 seed = 1;
+		for (u32 i = 0; i < size; ++i)
+		{
+			seed = seed * 1103515245u + 12345u;
+			src[i] = char(seed >> 16);
+		}
+
+		csize = lz4::compress(src, size, dst, lz4::compress_bound(size));
+		ENSURE(csize != 0);
+		ENSURE(lz4::decompress(dst, csize, out, size));
+		ENSURE(memcmp(src, out, size) == 0);
+		ENSURE(lz4::compress(src, size, dst, size / 2) == 0);
+
+		default_allocator().deallocate(out);
+		default_allocator().deallocate(dst);
+		default_allocator().deallocate(src);
+	}
+	memory_globals::shutdown();
+}
+
+static void test_adpcm()
+{
+	memory_globals::init();
+	{
+		ENSURE(adpcm::encoded_size(0, 2) == 0);
+		ENSURE(adpcm::encoded_size(1, 1) == adpcm::block_size(1));
+		ENSURE(adpcm::encoded_size(ADPCM_SAMPLES_PER_BLOCK + 1, 2) == 2*adpcm::block_size(2));
+	}
+	{
+		// Stereo sine waves, with a partial last block
+		const u32 num_samples = 3*ADPCM_SAMPLES_PER_BLOCK + 100;
+		const u32 size = adpcm::encoded_size(num_samples, 2);
+		s16* src = (s16*)default_allocator().allocate(num_samples*2*sizeof(s16));
+		u8* dst = (u8*)default_allocator().allocate(size);
+		s16 out[ADPCM_SAMPLES_PER_BLOCK*2];
+
+		for (u32 i = 0; i < num_samples; ++i)
+		{
+			src[i*2 + 0] = s16(16000.0f*fsin(f32(i)*0.05f));
+			src[i*2 + 1] = s16(-8000.0f*fcos(f32(i)*0.01f));
+		}
+
+		adpcm::encode(src, num_samples, 2, dst);
+
+		s32 max_error = 0;
+		for (u32 first = 0; first < num_samples; first += ADPCM_SAMPLES_PER_BLOCK)
+		{
+			const u32 n = num_samples - first < ADPCM_SAMPLES_PER_BLOCK
+				? num_samples - first
+				: ADPCM_SAMPLES_PER_BLOCK
+				;
+			adpcm::decode_block(dst + (first / ADPCM_SAMPLES_PER_BLOCK)*adpcm::block_size(2), n, 2, out);
+
+			// Blocks start with the exact samples
+			ENSURE(out[0] == src[first*2 + 0]);
+			ENSURE(out[1] == src[first*2 + 1]);
+
+			for (u32 i = 0; i < n*2; ++i)
+			{
+				const s32 err = s32(out[i]) - s32(src[first*2 + i]);
+				max_error = err > max_error ? err : -err > max_error ? -err : max_error;
+			}
+		}
+		ENSURE(max_error < 512);
+
+		default_allocator().deallocate(dst);
+		default_allocator().deallocate(src);
+	}
+	memory_globals::shutdown();
+}
+
 static void test_string_id()
 {
 	memory_globals::init();
@@ -858,6 +1555,104 @@ static void test_string_id()
 		a.to_string(str);
 		ENSURE(strcmp(str.c_str(), "90631502d1a3432b") == 0);
 	}
+	{
+		CE_STATIC_ASSERT("murmur32"_id32._id == 0x7c2365dbu);
+		CE_STATIC_ASSERT("murmur64"_id64._id == 0x90631502d1a3432bu);
+
+		// Exercise every tail length.
+		const char* str = "core/fallback/fallback";
+		for (u32 len = 0; len <= 8; ++len)
+		{
+			ENSURE(murmur_internal::murmur32(str, len, 0) == murmur32(str, len, 0));
+			ENSURE(murmur_internal::murmur64(str, len, 0) == murmur64(str, len, 0));
+		}
+		ENSURE("core/fallback/fallback"_id32 == StringId32(str));
+		ENSURE("core/fallback/fallback"_id64 == StringId64(str));
+	}
+#if CROWN_DEBUG || CROWN_DEVELOPMENT
+	{
+		StringId32 a("lookup32");
+		StringId64 b("lookup64", 8);
+		ENSURE(strcmp(string_id::lookup(a), "lookup32") == 0);
+		ENSURE(strcmp(string_id::lookup(b), "lookup64") == 0);
+		ENSURE(string_id::lookup(StringId32(a._id + 1)) == NULL);
+		ENSURE(string_id::lookup(StringId64(a._id)) == NULL);
+	}
+#endif // CROWN_DEBUG || CROWN_DEVELOPMENT
+	memory_globals::shutdown();
+}
+
+static void test_number()
+{
+	memory_globals::init();
+	{
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		ss << 0 << ' ' << -12 << ' ' << u32(4000000000u) << ' ' << s64(-9223372036854775807ll - 1) << ' ' << u64(18446744073709551615ull);
+		ENSURE(strcmp(string_stream::c_str(ss), "0 -12 4000000000 -9223372036854775808 18446744073709551615") == 0);
+	}
+	{
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		ss << 0.0f << ' ' << -0.0f << ' ' << 0.1f << ' ' << 3.14159274f << ' ' << 100.0f << ' ' << -2.5f;
+		ENSURE(strcmp(string_stream::c_str(ss), "0 -0 0.1 3.1415927 100 -2.5") == 0);
+	}
+	{
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		ss << 1e-7f << ' ' << 0.000001f << ' ' << 1e20f << ' ' << 1e21f << ' ' << 1.4e-45f << ' ' << FLT_MAX;
+		ENSURE(strcmp(string_stream::c_str(ss), "1e-7 0.000001 100000000000000000000 1e+21 1e-45 3.4028235e+38") == 0);
+	}
+	{
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		ss << 0.1 << ' ' << 1e23 << ' ' << 5e-324 << ' ' << 1.7976931348623157e308 << ' ' << 123.456;
+		ENSURE(strcmp(string_stream::c_str(ss), "0.1 1e+23 5e-324 1.7976931348623157e+308 123.456") == 0);
+	}
+	{
+		TempAllocator512 ta;
+		StringStream ss(ta);
+		string_stream::stream_fixed(ss, 1234.56789, 3);
+		ss << ' ';
+		string_stream::stream_fixed(ss, -0.5, 0);
+		ss << ' ';
+		string_stream::stream_fixed(ss, 7.0, 2);
+		ENSURE(strcmp(string_stream::c_str(ss), "1234.568 -1 7.00") == 0);
+	}
+	{
+		char buf[NUMBER_FORMAT_MAX + 1];
+		const f32 inf = FLT_MAX * 2.0f;
+		buf[number::format(buf, inf)] = '\0';
+		ENSURE(strcmp(buf, "inf") == 0);
+		buf[number::format(buf, -inf)] = '\0';
+		ENSURE(strcmp(buf, "-inf") == 0);
+		buf[number::format(buf, inf - inf)] = '\0';
+		ENSURE(strcmp(buf, "nan") == 0);
+	}
+	{
+		// Numbers read back to the same value
+		Pcg32 r(3);
+		bool equal = true;
+		for (u32 i = 0; i < 10000; ++i)
+		{
+			char buf[NUMBER_FORMAT_MAX + 1];
+			u32 bits = r.integer();
+			if (((bits >> 23) & 0xff) == 0xff)
+				continue;
+
+			f32 a;
+			memcpy(&a, &bits, sizeof(a));
+			buf[number::format(buf, a)] = '\0';
+			const f32 b = strtof(buf, NULL);
+			equal = equal && memcmp(&a, &b, sizeof(a)) == 0;
+
+			const f64 c = f64(a) / 3.0;
+			buf[number::format(buf, c)] = '\0';
+			const f64 d = strtod(buf, NULL);
+			equal = equal && memcmp(&c, &d, sizeof(c)) == 0;
+		}
+		ENSURE(equal);
+	}
 	memory_globals::shutdown();
 }
 
@@ -914,6 +1709,19 @@ static void test_dynamic_string()
 		ENSURE(!str.has_prefix("Hello everyone!!!"));
 		ENSURE(!str.has_suffix("Hello everyone!!!"));
 	}
+	{
+		Allocator& a = default_allocator();
+		const u32 allocated = a.total_allocated();
+		InlineString<16> str("Hello", a);
+		str += " everyone";
+		ENSURE(str == "Hello everyone");
+		ENSURE(a.total_allocated() == allocated);
+
+		InlineString<16> copy(str);
+		copy += ", how are you?";
+		ENSURE(strcmp(copy.c_str(), "Hello everyone, how are you?") == 0);
+		ENSURE(str == "Hello everyone");
+	}
 	memory_globals::shutdown();
 }
 
@@ -1045,6 +1853,31 @@ static void test_sjson()
 		sjson::parse_string("\"This is JSON\"", str);
 		ENSURE(strcmp(str.c_str(), "This is JSON") == 0);
 	}
+	{
+		TempAllocator1024 ta;
+		DynamicString key(ta);
+		const char* value = NULL;
+		const char* json = "{ foo = 1, \"bar\" = { a = 2 } baz = [ 3 ] }";
+
+		json = sjson::parse_object_member(json, key, value);
+		ENSURE(json != NULL);
+		ENSURE(strcmp(key.c_str(), "foo") == 0);
+		ENSURE(sjson::parse_int(value) == 1);
+
+		json = sjson::parse_object_member(json, key, value);
+		ENSURE(json != NULL);
+		ENSURE(strcmp(key.c_str(), "bar") == 0);
+		ENSURE(sjson::type(value) == JsonValueType::OBJECT);
+
+		json = sjson::parse_object_member(json, key, value);
+		ENSURE(json != NULL);
+		ENSURE(strcmp(key.c_str(), "baz") == 0);
+		ENSURE(sjson::type(value) == JsonValueType::ARRAY);
+
+		json = sjson::parse_object_member(json, key, value);
+		ENSURE(json == NULL);
+		ENSURE(sjson::parse_object_member("{}", key, value) == NULL);
+	}
 	{
 		const Vector2 a = sjson::parse_vector2("[ 1.2 -2.5 ]");
 		ENSURE(fequal(a.x,  1.2f));
@@ -1115,6 +1948,58 @@ static void test_sjson()
 		sjson::parse_verbatim("\"\"\"verbatim\"\"\"", str);
 		ENSURE(strcmp(str.c_str(), "verbatim") == 0);
 	}
+	{
+		const char* json = "a = 1.5 // comment\n"
+			"b = { c = [ 1, 2, 3 ] d = true }\n"
+			"\"e\" = \"foo\\\"bar\"\n"
+			"f = null\n"
+			"g = \"\"\"verbatim\"\"\"\n"
+			"h = [ ]\n"
+			;
+
+		TempAllocator1024 ta;
+		JsonDocument jd(ta);
+		sjson::parse(json, jd);
+
+		const JsonNode* root = json_document::root(jd);
+		ENSURE(root->type == JsonValueType::OBJECT);
+		ENSURE(root->size == 6);
+		ENSURE(jd["a"]->type == JsonValueType::NUMBER);
+		ENSURE(fequal(sjson::parse_float(jd, jd["a"]), 1.5f));
+
+		const JsonNode* b = jd["b"];
+		ENSURE(b->type == JsonValueType::OBJECT);
+		ENSURE(b->size == 2);
+		const Vector3 c = sjson::parse_vector3(jd, json_document::get(jd, b, "c"));
+		ENSURE(fequal(c.x, 1.0f));
+		ENSURE(fequal(c.y, 2.0f));
+		ENSURE(fequal(c.z, 3.0f));
+		ENSURE(sjson::parse_bool(jd, json_document::get(jd, b, "d")) == true);
+		ENSURE(json_document::get(jd, b, "a") == NULL);
+
+		DynamicString str(ta);
+		sjson::parse_string(jd, jd["e"], str);
+		ENSURE(strcmp(str.c_str(), "foo\"bar") == 0);
+		ENSURE(jd["f"]->type == JsonValueType::NIL);
+		ENSURE(jd["g"]->size == 8);
+		ENSURE(jd["h"]->type == JsonValueType::ARRAY);
+		ENSURE(json_document::first(jd, jd["h"]) == NULL);
+		ENSURE(jd["z"] == NULL);
+
+		u32 num = 0;
+		for (const JsonNode* n = json_document::first(jd, root); n != NULL; n = json_document::next(jd, n))
+			++num;
+		ENSURE(num == 6);
+		ENSURE(json_document::key(jd, json_document::next(jd, json_document::first(jd, root))) == "b");
+	}
+	{
+		TempAllocator512 ta;
+		JsonDocument jd(ta);
+		sjson::parse("{ q = [ 0, 0, 0, 1 ] s = \"murmur32\" }", jd);
+		const Quaternion q = sjson::parse_quaternion(jd, jd["q"]);
+		ENSURE(fequal(q.w, 1.0f));
+		ENSURE(sjson::parse_string_id(jd, jd["s"])._id == 0x7c2365dbu);
+	}
 	memory_globals::shutdown();
 }
 
@@ -1246,6 +2131,32 @@ static void test_command_line()
 	ENSURE(orange != NULL && strcmp(orange, "orange") == 0);
 }
 
+static void test_callstack()
+{
+	void* frames[8];
+	ENSURE(error::callstack(frames, countof(frames)) > 0);
+	ENSURE(error::callstack(frames, 0) == 0);
+
+	CallstackTable table;
+	u32 ids[2];
+	for (u32 i = 0; i < countof(ids); ++i)
+		ids[i] = table.capture();
+	ENSURE(ids[0] == ids[1]);
+	ENSURE(table.size() == 1);
+
+	void* const a[] = { (void*)0x10, (void*)0x20, (void*)0x30 };
+	const u32 id = table.intern(a, countof(a));
+	ENSURE(table.intern(a, countof(a)) == id);
+	ENSURE(table.intern(a, 2) != id);
+	ENSURE(table.size() == 3);
+	ENSURE(table.frames(frames, countof(frames), id) == countof(a));
+	ENSURE(memcmp(frames, a, sizeof(a)) == 0);
+	ENSURE(table.frames(frames, 1, id) == 1);
+
+	table.clear();
+	ENSURE(table.size() == 0);
+}
+
 static void test_thread()
 {
 	Thread thread;
@@ -1258,6 +2169,477 @@ static void test_thread()
 	thread.start([](void*) { return -1; }, NULL);
 	thread.stop();
 	ENSURE(thread.exit_code() == -1);
+
+	{
+		CpuTopology ct;
+		thread::cpu_topology(ct);
+		ENSURE(ct.num_logical >= ct.num_physical);
+		ENSURE(ct.num_clusters >= 1 && ct.num_clusters <= CROWN_MAX_CPU_CLUSTERS);
+
+		u64 all = 0;
+		for (u32 i = 0; i < ct.num_clusters; ++i)
+		{
+			ENSURE((all & ct.cluster_mask[i]) == 0);
+			all |= ct.cluster_mask[i];
+		}
+		ENSURE(all != 0);
+
+		Thread named;
+		named.set_name("unit_test_thread");
+		named.set_affinity(ct.cluster_mask[0]);
+		named.set_priority(ThreadPriority::LOW);
+		named.start([](void*) { return 7; }, NULL);
+		named.stop();
+		ENSURE(named.exit_code() == 7);
+	}
+	{
+		Mutex mutex;
+		ConditionVariable cv;
+		ScopedMutex sm(mutex);
+		ENSURE(!cv.wait(mutex, 1));
+	}
+}
+
+static void test_atomic()
+{
+	{
+		AtomicU32 a(5);
+		ENSURE(a.load() == 5);
+		ENSURE(a.fetch_add(3) == 5);
+		ENSURE(a.fetch_sub(1, MemoryOrder::RELAXED) == 8);
+		ENSURE(a.exchange(0xf0) == 7);
+		ENSURE(a.fetch_or(0x0f) == 0xf0);
+		ENSURE(a.fetch_and(0x3c) == 0xff);
+		ENSURE(a.load(MemoryOrder::ACQUIRE) == 0x3c);
+
+		u32 expected = 1;
+		ENSURE(!a.compare_exchange(expected, 2));
+		ENSURE(expected == 0x3c);
+		ENSURE(a.compare_exchange(expected, 2, MemoryOrder::ACQ_REL));
+		ENSURE(a.load() == 2);
+	}
+	{
+		AtomicU64 a(0xffffffffu);
+		ENSURE(a.fetch_add(1) == 0xffffffffu);
+		ENSURE(a.load() == 0x100000000ull);
+		a.store(0, MemoryOrder::RELEASE);
+		ENSURE(a.load() == 0);
+	}
+	{
+		s32 x, y;
+		AtomicPtr<s32> p(&x);
+		ENSURE(p.load() == &x);
+		s32* expected = &y;
+		ENSURE(!p.compare_exchange(expected, &y));
+		ENSURE(expected == &x);
+		ENSURE(p.compare_exchange(expected, &y));
+		ENSURE(p.exchange(NULL) == &y);
+		ENSURE(p.load() == NULL);
+	}
+	{
+		// Increments of a plain integer must not be lost
+		struct Context
+		{
+			Spinlock spinlock;
+			ReadWriteLock rwlock;
+			u32 counter;
+			u32 readers_sum;
+		};
+		Context ctx;
+		ctx.counter = 0;
+		ctx.readers_sum = 0;
+
+		Thread threads[4];
+		for (u32 i = 0; i < countof(threads); ++i)
+		{
+			threads[i].start([](void* data) {
+				Context* ctx = (Context*)data;
+				for (u32 i = 0; i < 10000; ++i)
+				{
+					ScopedSpinlock sl(ctx->spinlock);
+					ctx->counter++;
+				}
+				for (u32 i = 0; i < 1000; ++i)
+				{
+					{
+						ScopedWriteLock wl(ctx->rwlock);
+						ctx->readers_sum++;
+					}
+					{
+						ScopedReadLock rl(ctx->rwlock);
+						CE_UNUSED(ctx->readers_sum);
+					}
+				}
+				return 0;
+			}, &ctx);
+		}
+		for (u32 i = 0; i < countof(threads); ++i)
+			threads[i].stop();
+
+		ENSURE(ctx.counter == 4*10000);
+		ENSURE(ctx.readers_sum == 4*1000);
+		ENSURE(ctx.spinlock.try_lock());
+		ENSURE(!ctx.spinlock.try_lock());
+		ctx.spinlock.unlock();
+	}
+}
+
+static void test_spsc_queue()
+{
+	memory_globals::init();
+	Allocator& a = default_allocator();
+	{
+		SpscQueue<s32> q(a, 4);
+		s32 val = 0;
+		ENSURE(!q.pop(val));
+		for (s32 i = 0; i < 4; ++i)
+			ENSURE(q.push(i));
+		ENSURE(!q.push(4));
+		ENSURE(q.size() == 4);
+		for (s32 i = 0; i < 4; ++i)
+		{
+			ENSURE(q.pop(val));
+			ENSURE(val == i);
+		}
+		ENSURE(!q.pop(val));
+	}
+	{
+		// Items must arrive in order across threads
+		SpscQueue<u32> q(a, 64);
+		Thread producer;
+		producer.start([](void* data) {
+			SpscQueue<u32>* q = (SpscQueue<u32>*)data;
+			for (u32 i = 0; i < 100000; ++i)
+			{
+				while (!q->push(i))
+					;
+			}
+			return 0;
+		}, &q);
+
+		u32 expected = 0;
+		u32 val;
+		while (expected < 100000)
+		{
+			if (q.pop(val))
+			{
+				ENSURE(val == expected);
+				++expected;
+			}
+		}
+		producer.stop();
+	}
+	memory_globals::shutdown();
+}
+
+static void test_mpmc_queue()
+{
+	memory_globals::init();
+	Allocator& a = default_allocator();
+	{
+		MpmcQueue<s32> q(a, 4);
+		s32 val = 0;
+		ENSURE(!q.pop(val));
+		for (s32 i = 0; i < 4; ++i)
+			ENSURE(q.push(i));
+		ENSURE(!q.push(4));
+		for (s32 i = 0; i < 4; ++i)
+		{
+			ENSURE(q.pop(val));
+			ENSURE(val == i);
+		}
+		ENSURE(!q.pop(val));
+	}
+	{
+		// Every item must be popped exactly once
+		struct Context
+		{
+			MpmcQueue<s32>* queue;
+			AtomicInt* popped;
+			AtomicInt* sum;
+		};
+		MpmcQueue<s32> q(a, 64);
+		AtomicInt popped(0);
+		AtomicInt sum(0);
+		Context ctx = { &q, &popped, &sum };
+
+		Thread producers[2];
+		Thread consumers[2];
+		for (u32 i = 0; i < countof(producers); ++i)
+		{
+			producers[i].start([](void* data) {
+				MpmcQueue<s32>* q = ((Context*)data)->queue;
+				for (s32 i = 1; i <= 10000; ++i)
+				{
+					while (!q->push(i))
+						;
+				}
+				return 0;
+			}, &ctx);
+		}
+		for (u32 i = 0; i < countof(consumers); ++i)
+		{
+			consumers[i].start([](void* data) {
+				Context* ctx = (Context*)data;
+				s32 val;
+				while (ctx->popped->load() < 2*10000)
+				{
+					if (ctx->queue->pop(val))
+					{
+						ctx->sum->fetch_add(val);
+						ctx->popped->fetch_add(1);
+					}
+				}
+				return 0;
+			}, &ctx);
+		}
+		for (u32 i = 0; i < countof(producers); ++i)
+			producers[i].stop();
+		for (u32 i = 0; i < countof(consumers); ++i)
+			consumers[i].stop();
+
+		ENSURE(popped.load() == 2*10000);
+		ENSURE(sum.load() == 2*(10000*10001/2));
+	}
+	memory_globals::shutdown();
+}
+
+static void test_job_system()
+{
+	memory_globals::init();
+	job_system_globals::init(3);
+	{
+		ENSURE(job_system::num_threads() == 4);
+
+		// Each job adds its index to the total
+		struct Add
+		{
+			AtomicInt* total;
+			s32 value;
+		};
+		AtomicInt total(0);
+		Add add[64];
+
+		Job jobs[64];
+		for (u32 i = 0; i < countof(jobs); ++i)
+		{
+			add[i].total = &total;
+			add[i].value = (s32)i;
+			jobs[i].user_data = &add[i];
+			jobs[i].function = [](void* data) {
+				Add* a = (Add*)data;
+				a->total->fetch_add(a->value);
+			};
+		}
+
+		AtomicInt counter(0);
+		job_system::run(jobs, countof(jobs), &counter);
+		job_system::wait(counter);
+		ENSURE(counter.load() == 0);
+		ENSURE(total.load() == 64*63/2);
+	}
+	{
+		u32 data[10000];
+		job_system::parallel_for(0, countof(data), 0, [](u32 begin, u32 end, void* user_data) {
+			for (u32 i = begin; i < end; ++i)
+				((u32*)user_data)[i] = i*2;
+		}, data);
+
+		bool ok = true;
+		for (u32 i = 0; i < countof(data); ++i)
+			ok = ok && data[i] == i*2;
+		ENSURE(ok);
+	}
+	{
+		// Jobs waiting for the jobs they submit
+		AtomicInt total(0);
+		job_system::parallel_for(0, 16, 1, [](u32 begin, u32 end, void* user_data) {
+			job_system::parallel_for(begin*100, end*100, 10, [](u32 b, u32 e, void* ud) {
+				((AtomicInt*)ud)->fetch_add(s32(e - b));
+			}, user_data);
+		}, &total);
+		ENSURE(total.load() == 1600);
+	}
+	job_system_globals::shutdown();
+	memory_globals::shutdown();
+}
+
+// Growable file in memory which cannot be mapped.
+struct BufferFile : public File
+{
+	Buffer _data;
+	u32 _position;
+
+	BufferFile(Allocator& a) : _data(a), _position(0) {}
+	void open(const char* /*path*/, FileOpenMode::Enum /*mode*/) {}
+	void close() {}
+	bool is_open() { return true; }
+	u32 size() { return array::size(_data); }
+	u32 position() { return _position; }
+	bool end_of_file() { return _position == array::size(_data); }
+	void seek(u32 position) { _position = position; }
+	void seek_to_end() { _position = array::size(_data); }
+	void skip(u32 bytes) { _position += bytes; }
+	void flush() {}
+	const void* map(u32& size) { size = 0; return NULL; }
+
+	u32 read(void* data, u32 size)
+	{
+		const u32 avail = array::size(_data) - _position;
+		const u32 num = size < avail ? size : avail;
+		memcpy(data, array::begin(_data) + _position, num);
+		_position += num;
+		return num;
+	}
+
+	u32 write(const void* data, u32 size)
+	{
+		if (_position + size > array::size(_data))
+			array::resize(_data, _position + size);
+		memcpy(array::begin(_data) + _position, data, size);
+		_position += size;
+		return size;
+	}
+};
+
+static void test_reader_writer()
+{
+	memory_globals::init();
+	{
+		const u32 num = 3*CROWN_BINARY_READER_BUFFER_SIZE/sizeof(u32);
+		BufferFile file(default_allocator());
+		{
+			BinaryWriter bw(file);
+			for (u32 i = 0; i < num; ++i)
+				bw.write(i);
+			ENSURE(array::size(file._data) < num*sizeof(u32));
+		}
+		ENSURE(array::size(file._data) == num*sizeof(u32));
+
+		FileMemory fm(array::begin(file._data), array::size(file._data));
+		File* files[] = { &file, &fm };
+		for (u32 f = 0; f < countof(files); ++f)
+		{
+			files[f]->seek(0);
+			BinaryReader br(*files[f]);
+			bool equal = true;
+			for (u32 i = 0; i < num/2; ++i)
+			{
+				u32 val;
+				br.read(val);
+				equal = equal && val == i;
+			}
+			ENSURE(equal);
+			ENSURE(br.position() == num/2*sizeof(u32));
+
+			// Large read spanning the buffer
+			Array<u32> vals(default_allocator());
+			array::resize(vals, num/4);
+			ENSURE(br.read(array::begin(vals), num/4*sizeof(u32)) == num/4*sizeof(u32));
+			ENSURE(vals[0] == num/2 && vals[num/4 - 1] == num/2 + num/4 - 1);
+
+			u32 val;
+			br.skip(sizeof(u32));
+			br.read(val);
+			ENSURE(val == num/2 + num/4 + 1);
+			br.seek(4*sizeof(u32));
+			br.read(val);
+			ENSURE(val == 4);
+
+			// Short read at the end of the file
+			br.seek((num - 1)*sizeof(u32));
+			u64 last = 0;
+			ENSURE(br.read(&last, sizeof(last)) == sizeof(u32));
+			ENSURE(last == num - 1);
+		}
+		ENSURE(file.position() == num*sizeof(u32));
+	}
+	memory_globals::shutdown();
+}
+
+static void test_io_queue()
+{
+	memory_globals::init();
+	const char data[] = "0123456789abcdef";
+	{
+		IoQueue ioq(default_allocator(), 2);
+
+		FileMemory fm(data, sizeof(data) - 1);
+		char buf[4];
+		const u32 id = ioq.read(fm, 6, buf, sizeof(buf));
+		ENSURE(ioq.wait(id) == 4);
+		ENSURE(memcmp(buf, "6789", 4) == 0);
+	}
+	{
+		IoQueue ioq(default_allocator(), 2);
+
+		FileMemory fm(data, sizeof(data) - 1);
+		char a[3];
+		char b[5];
+		IoBuffer buffers[] = { { a, sizeof(a) }, { b, sizeof(b) } };
+		const u32 id = ioq.read(fm, 10, buffers, countof(buffers));
+		u32 bytes_read;
+		while (!ioq.poll(id, bytes_read)) {}
+		ENSURE(bytes_read == 6);
+		ENSURE(memcmp(a, "abc", 3) == 0);
+		ENSURE(memcmp(b, "def", 3) == 0);
+		ENSURE(!ioq.poll(id, bytes_read));
+	}
+	memory_globals::shutdown();
+}
+
+static void test_udp_socket()
+{
+	memory_globals::init();
+	{
+		UDPSocket a;
+		UDPSocket b;
+		ENSURE(a.bind(0).error == BindResult::SUCCESS);
+		ENSURE(b.bind(0).error == BindResult::SUCCESS);
+		ENSURE(a.port() != 0);
+
+		u32 values[8];
+		UDPDatagram out[countof(values)];
+		for (u32 i = 0; i < countof(values); ++i)
+		{
+			values[i] = i * 3;
+			out[i].ip = IP_ADDRESS_LOOPBACK;
+			out[i].port = b.port();
+			out[i].data = &values[i];
+			out[i].size = sizeof(values[i]);
+		}
+		ENSURE(a.send(out, countof(out)) == countof(out));
+
+		u32 received[countof(values)];
+		u32 num = 0;
+		for (u32 tries = 0; num < countof(received) && tries < 1000; ++tries)
+		{
+			UDPDatagram in[countof(received)];
+			for (u32 i = 0; i < countof(in); ++i)
+			{
+				in[i].data = &received[num + i];
+				in[i].size = sizeof(received[num + i]);
+			}
+
+			const u32 n = b.receive(in, countof(in) - num);
+			for (u32 i = 0; i < n; ++i)
+			{
+				ENSURE(in[i].size == sizeof(u32));
+				ENSURE(in[i].port == a.port());
+			}
+			num += n;
+			if (n == 0)
+				os::sleep(1);
+		}
+		ENSURE(num == countof(values));
+		ENSURE(memcmp(received, values, sizeof(values)) == 0);
+
+		u32 value;
+		IPAddress ip;
+		u16 port;
+		ENSURE(b.receive(&value, sizeof(value), ip, port).error == ReadResult::WOULDBLOCK);
+	}
+	memory_globals::shutdown();
 }
 
 int main_unit_tests()
@@ -1266,6 +2648,7 @@ int main_unit_tests()
 	test_array();
 	test_vector();
 	test_hash_map();
+	test_sort_map();
 	test_vector2();
 	test_vector3();
 	test_vector4();
@@ -1274,16 +2657,31 @@ int main_unit_tests()
 	test_matrix3x3();
 	test_matrix4x4();
 	test_aabb();
+	test_aabb_tree();
 	test_sphere();
+	test_intersection();
+	test_random();
 	test_murmur();
+	test_radix_sort();
+	test_lz4();
+	test_adpcm();
 	test_string_id();
+	test_number();
 	test_dynamic_string();
 	test_guid();
 	test_json();
 	test_sjson();
 	test_path();
 	test_command_line();
+	test_callstack();
 	test_thread();
+	test_atomic();
+	test_spsc_queue();
+	test_mpmc_queue();
+	test_job_system();
+	test_reader_writer();
+	test_io_queue();
+	test_udp_socket();
 
 	return EXIT_SUCCESS;
 }
@@ -4,6 +4,7 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
 #include "core/containers/map.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
@@ -17,12 +18,30 @@ namespace crown
 BootConfig::BootConfig(Allocator& a)
 	: boot_script_name(u64(0))
 	, boot_package_name(u64(0))
+	, render_graph_name("core/renderers/default")
 	, window_title(a)
+	, resource_online_budget(CROWN_DEFAULT_RESOURCE_ONLINE_BUDGET)
+	, lua_gc_budget(CROWN_DEFAULT_LUA_GC_BUDGET)
+	, texture_memory_budget(CROWN_DEFAULT_TEXTURE_MEMORY_BUDGET)
+	, texture_upload_budget(CROWN_DEFAULT_TEXTURE_UPLOAD_BUDGET)
+	, tick_rate(0)
+	, max_ticks_per_frame(CROWN_DEFAULT_MAX_TICKS_PER_FRAME)
+	, frame_rate(0)
+	, paused_frame_rate(CROWN_DEFAULT_PAUSED_FRAME_RATE)
+	, resource_budgets(a)
 	, window_w(CROWN_DEFAULT_WINDOW_WIDTH)
 	, window_h(CROWN_DEFAULT_WINDOW_HEIGHT)
 	, aspect_ratio(-1.0f)
+	, mesh_lod_bias(1.0f)
+	, resolution_min_scale(0.5f)
+	, resolution_max_scale(1.0f)
+	, resolution_gpu_time(0.0f)
 	, vsync(true)
+	, flush_after_render(false)
+	, late_input(false)
 	, fullscreen(false)
+	, prefetch_level_neighbours(false)
+	, paused_release_targets(false)
 {
 }
 
@@ -36,9 +55,61 @@ bool BootConfig::parse(const char* json)
 	boot_script_name  = sjson::parse_resource_id(cfg["boot_script"]);
 	boot_package_name = sjson::parse_resource_id(cfg["boot_package"]);
 
+	if (json_object::has(cfg, "render_graph"))
+		render_graph_name = sjson::parse_resource_id(cfg["render_graph"]);
+
 	if (json_object::has(cfg, "window_title"))
 		sjson::parse_string(cfg["window_title"], window_title);
 
+	if (json_object::has(cfg, "resource_online_budget"))
+		resource_online_budget = sjson::parse_float(cfg["resource_online_budget"]);
+
+	if (json_object::has(cfg, "lua_gc_budget"))
+		lua_gc_budget = sjson::parse_float(cfg["lua_gc_budget"]);
+
+	if (json_object::has(cfg, "texture_memory_budget"))
+		texture_memory_budget = sjson::parse_int(cfg["texture_memory_budget"]);
+
+	if (json_object::has(cfg, "texture_upload_budget"))
+		texture_upload_budget = sjson::parse_int(cfg["texture_upload_budget"]);
+
+	if (json_object::has(cfg, "tick_rate"))
+		tick_rate = sjson::parse_int(cfg["tick_rate"]);
+
+	if (json_object::has(cfg, "max_ticks_per_frame"))
+		max_ticks_per_frame = sjson::parse_int(cfg["max_ticks_per_frame"]);
+
+	if (json_object::has(cfg, "frame_rate"))
+		frame_rate = sjson::parse_int(cfg["frame_rate"]);
+
+	if (json_object::has(cfg, "late_input"))
+		late_input = sjson::parse_bool(cfg["late_input"]);
+
+	if (json_object::has(cfg, "paused_frame_rate"))
+		paused_frame_rate = sjson::parse_int(cfg["paused_frame_rate"]);
+
+	if (json_object::has(cfg, "paused_release_targets"))
+		paused_release_targets = sjson::parse_bool(cfg["paused_release_targets"]);
+
+	if (json_object::has(cfg, "resource_budgets"))
+	{
+		JsonObject budgets(ta);
+		sjson::parse_object(cfg["resource_budgets"], budgets);
+
+		auto cur = json_object::begin(budgets);
+		auto end = json_object::end(budgets);
+		for (; cur != end; ++cur)
+		{
+			ResourceBudget rb;
+			rb.type = StringId64(cur->pair.first.data(), cur->pair.first.length());
+			rb.size = sjson::parse_int(cur->pair.second);
+			array::push_back(resource_budgets, rb);
+		}
+	}
+
+	if (json_object::has(cfg, "prefetch_level_neighbours"))
+		prefetch_level_neighbours = sjson::parse_bool(cfg["prefetch_level_neighbours"]);
+
 	// Platform-specific configs
 	if (json_object::has(cfg, CROWN_PLATFORM_NAME))
 	{
@@ -59,8 +130,23 @@ bool BootConfig::parse(const char* json)
 			}
 			if (json_object::has(renderer, "aspect_ratio"))
 				aspect_ratio = sjson::parse_float(renderer["aspect_ratio"]);
+			if (json_object::has(renderer, "mesh_lod_bias"))
+				mesh_lod_bias = sjson::parse_float(renderer["mesh_lod_bias"]);
+			if (json_object::has(renderer, "dynamic_resolution"))
+			{
+				JsonObject dynamic_resolution(ta);
+				sjson::parse(renderer["dynamic_resolution"], dynamic_resolution);
+				resolution_gpu_time = sjson::parse_float(dynamic_resolution["gpu_time"]);
+
+				if (json_object::has(dynamic_resolution, "min_scale"))
+					resolution_min_scale = sjson::parse_float(dynamic_resolution["min_scale"]);
+				if (json_object::has(dynamic_resolution, "max_scale"))
+					resolution_max_scale = sjson::parse_float(dynamic_resolution["max_scale"]);
+			}
 			if (json_object::has(renderer, "vsync"))
 				vsync = sjson::parse_bool(renderer["vsync"]);
+			if (json_object::has(renderer, "flush_after_render"))
+				flush_after_render = sjson::parse_bool(renderer["flush_after_render"]);
 			if (json_object::has(renderer, "fullscreen"))
 				fullscreen = sjson::parse_bool(renderer["fullscreen"]);
 		}
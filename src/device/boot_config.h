@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "core/containers/types.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
@@ -16,14 +17,38 @@ namespace crown
 /// @ingroup Device
 struct BootConfig
 {
+	struct ResourceBudget
+	{
+		StringId64 type;
+		u32 size;
+	};
+
 	StringId64 boot_script_name;
 	StringId64 boot_package_name;
+	StringId64 render_graph_name;
 	DynamicString window_title;
+	f32 resource_online_budget;
+	f32 lua_gc_budget;
+	u32 texture_memory_budget;
+	u32 texture_upload_budget;
+	u32 tick_rate;
+	u32 max_ticks_per_frame;
+	u32 frame_rate;
+	u32 paused_frame_rate;
+	Array<ResourceBudget> resource_budgets;
 	u16 window_w;
 	u16 window_h;
 	float aspect_ratio;
+	f32 mesh_lod_bias;
+	f32 resolution_min_scale;
+	f32 resolution_max_scale;
+	f32 resolution_gpu_time;
 	bool vsync;
+	bool flush_after_render;
+	bool late_input;
 	bool fullscreen;
+	bool prefetch_level_neighbours;
+	bool paused_release_targets;
 
 	BootConfig(Allocator& a);
 	bool parse(const char* json);
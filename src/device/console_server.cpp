@@ -3,24 +3,450 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/hash_map.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
 #include "core/memory/temp_allocator.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
 #include "core/strings/string_id.h"
 #include "core/strings/string_stream.h"
 #include "device/console_server.h"
+#include <string.h> // memcpy, memmove
 
 namespace crown
 {
+namespace console_server_internal
+{
+	struct RecordFlags
+	{
+		enum Enum
+		{
+			BINARY              = 1 << 0, ///< The message is binary.
+			SET_BINARY_FRAMING  = 1 << 1, ///< The frames after the message use the binary framing.
+			SET_PLAIN_FRAMING   = 1 << 2  ///< The frames after the message use the plain framing.
+		};
+	};
+
+	struct FrameFlags
+	{
+		enum Enum
+		{
+			BINARY   = 1 << 0, ///< The message is binary.
+			FRAGMENT = 1 << 1, ///< The frame carries a fragment of a message.
+			LAST     = 1 << 2  ///< The frame carries the last fragment of a message.
+		};
+	};
+
+	/// Header of the messages in the output and bulk buffers of a client.
+	struct Record
+	{
+		u32 size;
+		u32 flags;
+	};
+
+	static bool same_socket(const TCPSocket& a, const TCPSocket& b)
+	{
+		return memcmp(a._data, b._data, sizeof(a._data)) == 0;
+	}
+
+	// Removes the first @a read bytes of @a buf.
+	static void consume(Buffer& buf, u32& read)
+	{
+		const u32 size = array::size(buf);
+		if (read == size)
+		{
+			array::clear(buf);
+			read = 0;
+		}
+		else if (read > size / 2)
+		{
+			memmove(array::begin(buf), array::begin(buf) + read, size - read);
+			array::resize(buf, size - read);
+			read = 0;
+		}
+	}
+
+	// Wakes the network thread unless it has already been woken since it
+	// last wrote the messages queued.
+	static void wakeup(ConsoleServer& cs)
+	{
+		if (cs._wakeup_pending.exchange(1, MemoryOrder::SEQ_CST) == 0)
+			cs._poller.wakeup();
+	}
+
+	// Queues the message @a data of @a size bytes to @a client. Must be
+	// called with cs._mutex locked.
+	static void enqueue(ConsoleServer::Client& client, const void* data, u32 size, u32 flags)
+	{
+		if (client.closing)
+			return;
+
+		const u32 queued = array::size(client.output) - client.output_read
+			+ array::size(client.bulk) - client.bulk_read
+			;
+		if (queued + size > CROWN_CONSOLE_MAX_QUEUED)
+		{
+			// The client does not keep up.
+			client.closing = true;
+			return;
+		}
+
+		const bool bulk = size >= CROWN_CONSOLE_BULK_SIZE
+			&& (flags & (RecordFlags::SET_BINARY_FRAMING | RecordFlags::SET_PLAIN_FRAMING)) == 0
+			;
+		Buffer& buf = bulk ? client.bulk : client.output;
+
+		Record r;
+		r.size = size;
+		r.flags = flags;
+		array::push(buf, (const char*)&r, sizeof(r));
+		array::push(buf, (const char*)data, size);
+	}
+
+	static void send_to(ConsoleServer& cs, TCPSocket socket, const void* data, u32 size, u32 flags)
+	{
+		{
+			ScopedMutex sm(cs._mutex);
+			for (u32 i = 0; i < array::size(cs._clients); ++i)
+			{
+				if (same_socket(cs._clients[i]->socket, socket))
+				{
+					enqueue(*cs._clients[i], data, size, flags);
+					break;
+				}
+			}
+		}
+
+		wakeup(cs);
+	}
+
+	static void send_to_all(ConsoleServer& cs, const void* data, u32 size, u32 flags)
+	{
+		{
+			ScopedMutex sm(cs._mutex);
+			for (u32 i = 0; i < array::size(cs._clients); ++i)
+				enqueue(*cs._clients[i], data, size, flags);
+		}
+
+		wakeup(cs);
+	}
+
+	static void add_client(ConsoleServer& cs, TCPSocket socket)
+	{
+		ConsoleServer::Client* client = CE_NEW(*cs._allocator, ConsoleServer::Client)(*cs._allocator);
+		client->socket = socket;
+
+		if (!cs._poller.add(socket, client))
+		{
+			socket.close();
+			CE_DELETE(*cs._allocator, client);
+			return;
+		}
+
+		ScopedMutex sm(cs._mutex);
+		array::push_back(cs._clients, client);
+	}
+
+	static void remove_closing_clients(ConsoleServer& cs)
+	{
+		ScopedMutex sm(cs._mutex);
+		for (u32 i = 0; i < array::size(cs._clients);)
+		{
+			ConsoleServer::Client* client = cs._clients[i];
+			if (!client->closing)
+			{
+				++i;
+				continue;
+			}
+
+			cs._poller.remove(client->socket);
+			client->socket.close();
+			CE_DELETE(*cs._allocator, client);
+			cs._clients[i] = array::back(cs._clients);
+			array::pop_back(cs._clients);
+		}
+	}
+
+	static void write_header(Buffer& wire, bool binary_framing, u32 size, u32 flags)
+	{
+		array::push(wire, (const char*)&size, sizeof(size));
+		if (binary_framing)
+			array::push(wire, (const char*)&flags, sizeof(flags));
+	}
+
+	// Moves the messages queued to @a client to its wire buffer, framed.
+	// Large messages are sent in fragments with the binary framing, so
+	// that the smaller ones can be sent between them.
+	static void frame(ConsoleServer& cs, ConsoleServer::Client& client)
+	{
+		ScopedMutex sm(cs._mutex);
+
+		while (array::size(client.wire) < CROWN_CONSOLE_WRITE_SIZE)
+		{
+			const bool has_output = client.output_read < array::size(client.output);
+			const bool has_bulk = client.bulk_read < array::size(client.bulk);
+			if (!has_output && !has_bulk)
+				break;
+
+			Record r;
+			r.size = 0;
+			r.flags = 0;
+			if (has_output)
+				memcpy(&r, array::begin(client.output) + client.output_read, sizeof(r));
+
+			// Plain frames can not be interleaved, and the framing can only
+			// change between whole messages.
+			const bool change_framing = (r.flags & (RecordFlags::SET_BINARY_FRAMING | RecordFlags::SET_PLAIN_FRAMING)) != 0;
+			if (has_output && (client.bulk_sent == 0 || (client.binary_framing && !change_framing)))
+			{
+				const u32 flags = (r.flags & RecordFlags::BINARY) ? FrameFlags::BINARY : 0;
+				write_header(client.wire, client.binary_framing, r.size, flags);
+				array::push(client.wire, array::begin(client.output) + client.output_read + sizeof(r), r.size);
+				client.output_read += sizeof(r) + r.size;
+
+				if (r.flags & RecordFlags::SET_BINARY_FRAMING)
+					client.binary_framing = true;
+				else if (r.flags & RecordFlags::SET_PLAIN_FRAMING)
+					client.binary_framing = false;
+				continue;
+			}
+
+			if (!has_bulk)
+				break;
+
+			memcpy(&r, array::begin(client.bulk) + client.bulk_read, sizeof(r));
+			const u32 remaining = r.size - client.bulk_sent;
+			const u32 num = remaining < CROWN_CONSOLE_BULK_SIZE ? remaining : CROWN_CONSOLE_BULK_SIZE;
+
+			if (client.binary_framing)
+			{
+				u32 flags = (r.flags & RecordFlags::BINARY) ? FrameFlags::BINARY : 0;
+				if (r.size > CROWN_CONSOLE_BULK_SIZE)
+					flags |= FrameFlags::FRAGMENT | (num == remaining ? FrameFlags::LAST : 0);
+				write_header(client.wire, true, num, flags);
+			}
+			else if (client.bulk_sent == 0)
+			{
+				write_header(client.wire, false, r.size, 0);
+			}
+
+			array::push(client.wire, array::begin(client.bulk) + client.bulk_read + sizeof(r) + client.bulk_sent, num);
+			client.bulk_sent += num;
+
+			if (client.bulk_sent == r.size)
+			{
+				client.bulk_read += sizeof(r) + r.size;
+				client.bulk_sent = 0;
+			}
+		}
+
+		consume(client.output, client.output_read);
+		if (client.bulk_sent == 0)
+			consume(client.bulk, client.bulk_read);
+	}
+
+	// Writes as much as possible of the messages queued to each client.
+	static void flush(ConsoleServer& cs)
+	{
+		for (u32 i = 0; i < array::size(cs._clients); ++i)
+		{
+			ConsoleServer::Client& client = *cs._clients[i];
+
+			while (!client.closing)
+			{
+				if (client.wire_sent == array::size(client.wire))
+				{
+					array::clear(client.wire);
+					client.wire_sent = 0;
+					frame(cs, client);
+					if (array::size(client.wire) == 0)
+						break;
+				}
+
+				WriteResult wr = client.socket.write_nonblock(array::begin(client.wire) + client.wire_sent
+					, array::size(client.wire) - client.wire_sent
+					);
+				client.wire_sent += wr.bytes_wrote;
+
+				if (wr.error == WriteResult::WOULDBLOCK)
+					break;
+
+				if (wr.error != WriteResult::SUCCESS)
+					client.closing = true;
+			}
+
+			// Wait for the socket to be writable only while the kernel buffer is full.
+			const bool writing = !client.closing && client.wire_sent < array::size(client.wire);
+			if (writing != client.writing)
+			{
+				cs._poller.modify(client.socket, &client, writing);
+				client.writing = writing;
+			}
+		}
+	}
+
+	// Reads the data available from @a client and queues the whole
+	// messages received for update().
+	static void receive(ConsoleServer& cs, ConsoleServer::Client& client)
+	{
+		for (;;)
+		{
+			const u32 size = array::size(client.input);
+			array::reserve(client.input, size + CROWN_CONSOLE_READ_SIZE);
+			array::resize(client.input, size + CROWN_CONSOLE_READ_SIZE);
+
+			ReadResult rr = client.socket.read_nonblock(array::begin(client.input) + size, CROWN_CONSOLE_READ_SIZE);
+			array::resize(client.input, size + rr.bytes_read);
+
+			if (rr.error == ReadResult::WOULDBLOCK)
+				break;
+
+			if (rr.error != ReadResult::SUCCESS)
+			{
+				client.closing = true;
+				break;
+			}
+		}
+
+		u32 read = 0;
+		const u32 size = array::size(client.input);
+		const char* data = array::begin(client.input);
+
+		ScopedMutex sm(cs._mutex);
+		while (size - read >= sizeof(u32))
+		{
+			u32 msg_size;
+			memcpy(&msg_size, data + read, sizeof(msg_size));
+
+			if (msg_size > CROWN_CONSOLE_MAX_QUEUED)
+			{
+				client.closing = true;
+				break;
+			}
+
+			if (size - read - sizeof(u32) < msg_size)
+				break;
+
+			array::push(cs._inbound, (const char*)&client.socket, sizeof(client.socket));
+			array::push(cs._inbound, data + read, sizeof(u32) + msg_size);
+			array::push_back(cs._inbound, '\0');
+			read += sizeof(u32) + msg_size;
+		}
+
+		consume(client.input, read);
+	}
+
+	static void accept_clients(ConsoleServer& cs)
+	{
+		for (;;)
+		{
+			TCPSocket socket;
+			AcceptResult ar = cs._server.accept_nonblock(socket);
+			if (ar.error != AcceptResult::SUCCESS)
+				break;
+
+			add_client(cs, socket);
+		}
+	}
+
+	static s32 network_thread(void* user_data)
+	{
+		ConsoleServer& cs = *(ConsoleServer*)user_data;
+
+		PollEvent events[SOCKET_POLLER_MAX_SOCKETS];
+		while (cs._exit.load(MemoryOrder::ACQUIRE) == 0)
+		{
+			const u32 num = cs._poller.wait(events, countof(events), -1);
+
+			// Messages sent from now on wake the thread again.
+			cs._wakeup_pending.store(0, MemoryOrder::SEQ_CST);
+
+			for (u32 i = 0; i < num; ++i)
+			{
+				if (events[i].user_data == &cs._server)
+				{
+					accept_clients(cs);
+					continue;
+				}
+
+				ConsoleServer::Client& client = *(ConsoleServer::Client*)events[i].user_data;
+				if (events[i].flags & (PollEvent::READ | PollEvent::HANGUP))
+					receive(cs, client);
+			}
+
+			flush(cs);
+			remove_closing_clients(cs);
+		}
+
+		flush(cs);
+		return 0;
+	}
+
+	static void console_command_framing(ConsoleServer& cs, TCPSocket client, const char* json, void* /*user_data*/)
+	{
+		TempAllocator1024 ta;
+		JsonObject obj(ta);
+		DynamicString mode(ta);
+		sjson::parse(json, obj);
+		sjson::parse_string(obj["mode"], mode);
+
+		u32 flags;
+		if (mode == "binary")
+			flags = RecordFlags::SET_BINARY_FRAMING;
+		else if (mode == "plain")
+			flags = RecordFlags::SET_PLAIN_FRAMING;
+		else
+		{
+			cs.error(client, "Usage: framing binary|plain");
+			return;
+		}
+
+		// The reply is the last message with the old framing.
+		TempAllocator256 ta_reply;
+		StringStream ss(ta_reply);
+		ss << "{\"type\":\"framing\",\"mode\":\"" << mode.c_str() << "\"}";
+		const char* reply = string_stream::c_str(ss);
+		send_to(cs, client, reply, strlen32(reply), flags);
+	}
+
+} // namespace console_server_internal
+
+ConsoleServer::Client::Client(Allocator& a)
+	: binary_framing(false)
+	, writing(false)
+	, closing(false)
+	, input(a)
+	, wire(a)
+	, wire_sent(0)
+	, output(a)
+	, output_read(0)
+	, bulk(a)
+	, bulk_read(0)
+	, bulk_sent(0)
+{
+}
+
 ConsoleServer::ConsoleServer(Allocator& a)
-	: _clients(a)
+	: _allocator(&a)
+	, _clients(a)
+	, _inbound(a)
+	, _executing(a)
+	, _wakeup_pending(0)
+	, _exit(0)
 	, _commands(a)
 {
+	_message_callback.function = NULL;
+	_message_callback.user_data = NULL;
+
+	register_command("framing", console_server_internal::console_command_framing, NULL);
 }
 
 void ConsoleServer::listen(u16 port, bool wait)
 {
+	CE_ASSERT(!_thread.is_running(), "Already listening");
+
 	_server.bind(port);
 	_server.listen(5);
 
@@ -34,23 +460,51 @@ void ConsoleServer::listen(u16 port, bool wait)
 		}
 		while (ar.error != AcceptResult::SUCCESS);
 
-		array::push_back(_clients, client);
+		console_server_internal::add_client(*this, client);
 	}
+
+	_server.set_blocking(false);
+	_poller.add(_server, &_server);
+	_exit.store(0, MemoryOrder::RELAXED);
+	_thread.set_name("console");
+	_thread.set_priority(ThreadPriority::LOW);
+	_thread.start(console_server_internal::network_thread, this);
 }
 
 void ConsoleServer::shutdown()
 {
+	if (_thread.is_running())
+	{
+		_exit.store(1, MemoryOrder::RELEASE);
+		_poller.wakeup();
+		_thread.stop();
+	}
+
 	for (u32 i = 0; i < array::size(_clients); ++i)
-		_clients[i].close();
+	{
+		_poller.remove(_clients[i]->socket);
+		_clients[i]->socket.close();
+		CE_DELETE(*_allocator, _clients[i]);
+	}
+	array::clear(_clients);
 
+	_poller.remove(_server);
 	_server.close();
 }
 
 void ConsoleServer::send(TCPSocket client, const char* json)
 {
-	u32 len = strlen32(json);
-	client.write(&len, 4);
-	client.write(json, len);
+	console_server_internal::send_to(*this, client, json, strlen32(json), 0);
+}
+
+void ConsoleServer::send(TCPSocket client, const void* data, u32 size)
+{
+	console_server_internal::send_to(*this, client, data, size, console_server_internal::RecordFlags::BINARY);
+}
+
+void ConsoleServer::send(const void* data, u32 size)
+{
+	console_server_internal::send_to_all(*this, data, size, console_server_internal::RecordFlags::BINARY);
 }
 
 void ConsoleServer::error(TCPSocket client, const char* msg)
@@ -63,79 +517,37 @@ void ConsoleServer::error(TCPSocket client, const char* msg)
 
 void ConsoleServer::send(const char* json)
 {
-	for (u32 i = 0; i < array::size(_clients); ++i)
-		send(_clients[i], json);
+	console_server_internal::send_to_all(*this, json, strlen32(json), 0);
 }
 
 void ConsoleServer::update()
 {
-	TCPSocket client;
-	AcceptResult ar = _server.accept_nonblock(client);
-	if (ar.error == AcceptResult::SUCCESS)
-		array::push_back(_clients, client);
-
-	TempAllocator256 alloc;
-	Array<u32> to_remove(alloc);
-
-	// Update all clients
-	for (u32 i = 0; i < array::size(_clients); ++i)
 	{
-		for (;;)
-		{
-			u32 msg_len = 0;
-			ReadResult rr = _clients[i].read_nonblock(&msg_len, 4);
-
-			if (rr.error == ReadResult::WOULDBLOCK)
-				break;
-
-			if (rr.error != ReadResult::SUCCESS)
-			{
-				array::push_back(to_remove, i);
-				break;
-			}
-
-			// Read message
-			TempAllocator4096 ta;
-			Array<char> msg(ta);
-			array::resize(msg, msg_len + 1);
-			rr = _clients[i].read(array::begin(msg), msg_len);
-			array::push_back(msg, '\0');
-
-			if (rr.error != ReadResult::SUCCESS)
-			{
-				array::push_back(to_remove, i);
-				break;
-			}
-
-			// Process message
-			JsonObject obj(ta);
-			sjson::parse(array::begin(msg), obj);
-
-			Command cmd;
-			cmd.function = NULL;
-			cmd.user_data = NULL;
-			cmd = hash_map::get(_commands
-				, sjson::parse_string_id(obj["type"])
-				, cmd
-				);
-
-			if (cmd.function)
-				cmd.function(*this, _clients[i], array::begin(msg), cmd.user_data);
-			else
-				error(_clients[i], "Unknown command");
-		}
+		ScopedMutex sm(_mutex);
+		array::push(_executing, array::begin(_inbound), array::size(_inbound));
+		array::clear(_inbound);
 	}
 
-	// Remove clients
-	for (u32 i = 0; i < array::size(to_remove); ++i)
+	// Each message is the client socket, the u32 size and the
+	// NUL-terminated JSON.
+	const char* cur = array::begin(_executing);
+	const char* end = array::end(_executing);
+	while (cur < end)
 	{
-		const u32 last = array::size(_clients) - 1;
-		const u32 c = to_remove[i];
+		TCPSocket client;
+		u32 size;
+		memcpy(&client, cur, sizeof(client));
+		memcpy(&size, cur + sizeof(client), sizeof(size));
+		const char* json = cur + sizeof(client) + sizeof(size);
+		cur = json + size + 1;
+
+		if (_message_callback.function)
+			_message_callback.function(*this, client, json, _message_callback.user_data);
 
-		_clients[c].close();
-		_clients[c] = _clients[last];
-		array::pop_back(_clients);
+		execute(client, json);
 	}
+
+	array::clear(_executing);
 }
 
 void ConsoleServer::register_command(const char* type, CommandFunction function, void* user_data)
@@ -150,6 +562,32 @@ void ConsoleServer::register_command(const char* type, CommandFunction function,
 	hash_map::set(_commands, StringId32(type), cmd);
 }
 
+void ConsoleServer::execute(TCPSocket client, const char* json)
+{
+	TempAllocator4096 ta;
+	JsonObject obj(ta);
+	sjson::parse(json, obj);
+
+	Command cmd;
+	cmd.function = NULL;
+	cmd.user_data = NULL;
+	cmd = hash_map::get(_commands
+		, sjson::parse_string_id(obj["type"])
+		, cmd
+		);
+
+	if (cmd.function)
+		cmd.function(*this, client, json, cmd.user_data);
+	else
+		error(client, "Unknown command");
+}
+
+void ConsoleServer::set_message_callback(CommandFunction function, void* user_data)
+{
+	_message_callback.function = function;
+	_message_callback.user_data = user_data;
+}
+
 namespace console_server_globals
 {
 	ConsoleServer* _console_server = NULL;
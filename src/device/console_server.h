@@ -9,11 +9,18 @@
 #include "core/containers/types.h"
 #include "core/network/socket.h"
 #include "core/strings/types.h"
+#include "core/thread/atomic.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 
 namespace crown
 {
 /// Provides service to communicate with engine via TCP/IP.
 ///
+/// A network thread accepts the clients, reads their messages and writes
+/// the messages sent to them. The messages received are executed on the
+/// thread calling update(), and the messages can be sent from any thread.
+///
 /// @ingroup Device
 struct ConsoleServer
 {
@@ -25,9 +32,37 @@ struct ConsoleServer
 		void* user_data;
 	};
 
+	struct Client
+	{
+		TCPSocket socket;
+		bool binary_framing; ///< Whether the frames have the header of the binary framing. Network thread only.
+		bool writing;        ///< Whether the poller watches the socket for writing. Network thread only.
+		bool closing;        ///< Whether the client must be disconnected.
+		Buffer input;        ///< Bytes received which do not form a whole message yet. Network thread only.
+		Buffer wire;         ///< Frames being written to the socket. Network thread only.
+		u32 wire_sent;
+		Buffer output;       ///< Messages waiting to be framed.
+		u32 output_read;
+		Buffer bulk;         ///< Messages of at least CROWN_CONSOLE_BULK_SIZE bytes waiting to be framed.
+		u32 bulk_read;
+		u32 bulk_sent;       ///< Bytes of the first message in bulk already framed.
+
+		///
+		Client(Allocator& a);
+	};
+
+	Allocator* _allocator;
 	TCPSocket _server;
-	Array<TCPSocket> _clients;
+	SocketPoller _poller;
+	Thread _thread;
+	Mutex _mutex;                    ///< Protects _clients, _inbound and the output of each client.
+	Array<Client*> _clients;
+	Buffer _inbound;                 ///< Messages received and not yet executed.
+	Buffer _executing;               ///< Messages being executed by update().
+	AtomicU32 _wakeup_pending;
+	AtomicU32 _exit;
 	HashMap<StringId32, Command> _commands;
+	Command _message_callback;
 
 	/// Constructor.
 	ConsoleServer(Allocator& a);
@@ -39,7 +74,7 @@ struct ConsoleServer
 	/// Shutdowns the server.
 	void shutdown();
 
-	/// Collects requests from clients and processes them all.
+	/// Executes all the messages received from clients.
 	void update();
 
 	/// Sends the given JSON-encoded string to all clients.
@@ -48,6 +83,15 @@ struct ConsoleServer
 	/// Sends the given JSON-encoded string to @a client.
 	void send(TCPSocket client, const char* json);
 
+	/// Sends the binary message @a data of @a size bytes to all clients.
+	/// @note
+	/// Clients which did not enable the binary framing must tell binary
+	/// messages apart from JSON ones by their first byte, which is never '{'.
+	void send(const void* data, u32 size);
+
+	/// Sends the binary message @a data of @a size bytes to @a client.
+	void send(TCPSocket client, const void* data, u32 size);
+
 	/// Sends an error message to @a client.
 	void error(TCPSocket client, const char* msg);
 
@@ -56,6 +100,14 @@ struct ConsoleServer
 
 	/// Registers the command @a type.
 	void register_command(const char* type, CommandFunction cmd, void* user_data);
+
+	/// Executes the JSON-encoded command @a json as if it was received
+	/// from @a client.
+	void execute(TCPSocket client, const char* json);
+
+	/// Sets the function to call with each message received from clients,
+	/// before it is executed. @a function can be NULL.
+	void set_message_callback(CommandFunction function, void* user_data);
 };
 
 namespace console_server_globals
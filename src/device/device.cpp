@@ -19,17 +19,24 @@
 #include "core/memory/proxy_allocator.h"
 #include "core/memory/temp_allocator.h"
 #include "core/os.h"
+#include "core/strings/inline_string.h"
 #include "core/strings/string.h"
 #include "core/strings/string_stream.h"
+#include "core/thread/job_system.h"
+#include "core/thread/thread.h"
 #include "core/types.h"
 #include "device/console_server.h"
 #include "device/device.h"
 #include "device/device_event_queue.h"
+#include "device/frame_pacer.h"
+#include "device/gpu_memory.h"
 #include "device/input_device.h"
 #include "device/input_manager.h"
 #include "device/log.h"
 #include "device/pipeline.h"
 #include "device/profiler.h"
+#include "device/replay.h"
+#include "device/screen_capture.h"
 #include "lua/lua_environment.h"
 #include "resource/config_resource.h"
 #include "resource/font_resource.h"
@@ -51,11 +58,17 @@
 #include "world/audio.h"
 #include "world/material_manager.h"
 #include "world/physics.h"
+#include "world/render_world.h"
+#include "world/script_world.h"
 #include "world/shader_manager.h"
+#include "world/texture_manager.h"
 #include "world/unit_manager.h"
+#include "world/unit_template.h"
 #include "world/world.h"
 #include <bgfx/bgfx.h>
 #include <bx/allocator.h>
+#include <math.h> // fmod
+#include <string.h> // memcpy
 
 #define MAX_SUBSYSTEMS_HEAP 8 * 1024 * 1024
 
@@ -70,10 +83,18 @@ extern void tool_shutdown(void);
 extern bool tool_process_events();
 #endif
 
-extern bool next_event(OsEvent& ev);
+extern bool next_event(OsEvent& ev, s64& time);
+extern void wait_event(u32 ms);
 
 struct BgfxCallback : public bgfx::CallbackI
 {
+	ScreenCapture* _screen_capture;
+
+	explicit BgfxCallback(ScreenCapture& sc)
+		: _screen_capture(&sc)
+	{
+	}
+
 	virtual void fatal(bgfx::Fatal::Enum _code, const char* _str)
 	{
 		CE_ASSERT(false, "Fatal error: 0x%08x: %s", _code, _str);
@@ -115,8 +136,9 @@ struct BgfxCallback : public bgfx::CallbackI
 	{
 	}
 
-	virtual void screenShot(const char* /*_filePath*/, u32 /*_width*/, u32 /*_height*/, u32 /*_pitch*/, const void* /*_data*/, u32 /*_size*/, bool /*_yflip*/)
+	virtual void screenShot(const char* _filePath, u32 _width, u32 _height, u32 _pitch, const void* _data, u32 _size, bool _yflip)
 	{
+		_screen_capture->push(_filePath, _width, _height, _pitch, _data, _size, _yflip);
 	}
 
 	virtual void captureBegin(u32 /*_width*/, u32 /*_height*/, u32 /*_pitch*/, bgfx::TextureFormat::Enum /*_format*/, bool /*_yflip*/)
@@ -132,6 +154,8 @@ struct BgfxCallback : public bgfx::CallbackI
 	}
 };
 
+// Forwards the CPU allocations of bgfx, from any thread, to a
+// ProxyAllocator which counts them, tagged "bgfx".
 struct BgfxAllocator : public bx::AllocatorI
 {
 	ProxyAllocator _allocator;
@@ -143,6 +167,8 @@ struct BgfxAllocator : public bx::AllocatorI
 
 	virtual void* realloc(void* _ptr, size_t _size, size_t _align, const char* /*_file*/, u32 /*_line*/)
 	{
+		ScopedMemoryTag tag("bgfx");
+
 		if (!_ptr)
 			return _allocator.allocate((u32)_size, (u32)_align == 0 ? 16 : (u32)_align);
 
@@ -154,11 +180,48 @@ struct BgfxAllocator : public bx::AllocatorI
 
 		// Realloc
 		void* p = _allocator.allocate((u32)_size, (u32)_align == 0 ? 16 : (u32)_align);
+		const u32 old_size = _allocator.allocated_size(_ptr);
+		if (old_size != Allocator::SIZE_NOT_TRACKED)
+			memcpy(p, _ptr, old_size < (u32)_size ? old_size : (u32)_size);
 		_allocator.deallocate(_ptr);
 		return p;
 	}
 };
 
+// Window used in headless mode, it only remembers its title.
+struct WindowNull : public Window
+{
+	DynamicString _title;
+
+	WindowNull()
+		: _title(default_allocator())
+	{
+	}
+
+	void open(u16 /*x*/, u16 /*y*/, u16 /*width*/, u16 /*height*/, u32 /*parent*/) {}
+	void close() {}
+	void show() {}
+	void hide() {}
+	void resize(u16 /*width*/, u16 /*height*/) {}
+	void move(u16 /*x*/, u16 /*y*/) {}
+	void minimize() {}
+	void maximize() {}
+	void restore() {}
+	const char* title() { return _title.c_str(); }
+	void set_title(const char* title) { _title = title; }
+	void* handle() { return NULL; }
+	void show_cursor(bool /*show*/) {}
+	void set_fullscreen(bool /*fullscreen*/) {}
+	void bgfx_setup() {}
+};
+
+// Display used in headless mode, it has no modes.
+struct DisplayNull : public Display
+{
+	void modes(Array<DisplayMode>& /*modes*/) {}
+	void set_mode(u32 /*id*/) {}
+};
+
 static void console_command_script(ConsoleServer& /*cs*/, TCPSocket /*client*/, const char* json, void* user_data)
 {
 	TempAllocator4096 ta;
@@ -200,10 +263,234 @@ static void console_command(ConsoleServer& cs, TCPSocket client, const char* jso
 		sjson::parse_string(args[1], type);
 		sjson::parse_string(args[2], name);
 
-		((Device*)user_data)->reload(ResourceId(type.c_str()), ResourceId(name.c_str()));
+		// Resources which are not loaded will be read from the new data
+		Device* device = (Device*)user_data;
+		if (device->_resource_manager->find(ResourceId(type.c_str()), ResourceId(name.c_str())) == NULL)
+			return;
+
+		device->reload(ResourceId(type.c_str()), ResourceId(name.c_str()));
+	}
+	else if (cmd == "profiler")
+	{
+		Device* device = (Device*)user_data;
+		DynamicString action(ta);
+		DynamicString mode(ta);
+		if (array::size(args) >= 2)
+			sjson::parse_string(args[1], action);
+		if (array::size(args) >= 3 && action == "start")
+			sjson::parse_string(args[2], mode);
+
+		if (action == "start" && (mode == "" || mode == "binary"))
+		{
+			device->_profiler_streaming = true;
+			device->_profiler_binary = mode == "binary";
+			const s32 decimation = array::size(args) >= 4 ? sjson::parse_int(args[3]) : 1;
+			device->_profiler_decimation = decimation > 0 ? (u32)decimation : 1;
+			device->_profiler_frame = 0;
+			device->_profiler_dropped = 0;
+			device->_profiler_budget = 0.0;
+			device->_profiler_encoder.reset();
+		}
+		else if (action == "stop")
+		{
+			device->_profiler_streaming = false;
+		}
+		else if (action == "history" && array::size(args) >= 3)
+		{
+			device->_profiler_history.set_duration(sjson::parse_float(args[2]));
+			device->_profiler_spike = array::size(args) >= 4 ? sjson::parse_float(args[3]) / 1000.0f : 0.0f;
+		}
+		else if (action == "dump")
+		{
+			device->profiler_dump_history(&client);
+		}
+		else
+		{
+			cs.error(client, "Usage: profiler start [binary [decimation]]|stop|history seconds [spike_ms]|dump");
+		}
+	}
+	else if (cmd == "render_stats")
+	{
+		DynamicString action(ta);
+		if (array::size(args) == 2)
+			sjson::parse_string(args[1], action);
+
+		if (action == "start")
+			((Device*)user_data)->_render_stats_streaming = true;
+		else if (action == "stop")
+			((Device*)user_data)->_render_stats_streaming = false;
+		else
+			cs.error(client, "Usage: render_stats start|stop");
+	}
+	else if (cmd == "perf_overlay")
+	{
+		Device* device = (Device*)user_data;
+		DynamicString action(ta);
+		if (array::size(args) == 2)
+			sjson::parse_string(args[1], action);
+
+		if (action == "show")
+			device->_perf_overlay._enabled = true;
+		else if (action == "hide")
+			device->_perf_overlay._enabled = false;
+		else if (action == "toggle")
+			device->_perf_overlay._enabled = !device->_perf_overlay._enabled;
+		else
+			cs.error(client, "Usage: perf_overlay show|hide|toggle");
+	}
+	else if (cmd == "screenshot")
+	{
+		if (array::size(args) != 2)
+		{
+			cs.error(client, "Usage: screenshot <path>");
+			return;
+		}
+
+		DynamicString path(ta);
+		sjson::parse_string(args[1], path);
+		((Device*)user_data)->_screen_capture->screenshot(path.c_str());
+	}
+	else if (cmd == "capture")
+	{
+		Device* device = (Device*)user_data;
+		DynamicString action(ta);
+		if (array::size(args) >= 2)
+			sjson::parse_string(args[1], action);
+
+		if (action == "start" && (array::size(args) == 3 || array::size(args) == 4))
+		{
+			DynamicString prefix(ta);
+			sjson::parse_string(args[2], prefix);
+			const f32 fps = array::size(args) == 4 ? sjson::parse_float(args[3]) : 30.0f;
+			device->_screen_capture->start(prefix.c_str(), fps);
+		}
+		else if (action == "stop")
+		{
+			device->_screen_capture->stop();
+		}
+		else
+		{
+			cs.error(client, "Usage: capture start <prefix> [fps] | capture stop");
+		}
+	}
+	else if (cmd == "sounds")
+	{
+		StringStream json(ta);
+		audio_globals::to_json(json);
+		cs.send(client, string_stream::c_str(json));
+	}
+}
+
+// Writes the render statistics of the @a num @a worlds to @a json.
+static void render_stats_to_json(StringStream& json, World* const* worlds, u32 num)
+{
+	json << "{\"type\":\"render_stats\",\"worlds\":[";
+	for (u32 i = 0; i < num; ++i)
+	{
+		const RenderStats& rs = worlds[i]->_render_world->stats();
+		json << (i > 0 ? ",{" : "{");
+		json << "\"mesh_draw_calls\":" << rs.mesh_draw_calls;
+		json << ",\"mesh_material_binds\":" << rs.mesh_material_binds;
+		json << ",\"mesh_triangles\":" << rs.mesh_triangles;
+		json << ",\"meshes_submitted\":" << rs.meshes_submitted;
+		json << ",\"meshes_culled\":" << rs.meshes_culled;
+		json << ",\"meshes_occluded\":" << rs.meshes_occluded;
+		json << ",\"sprites_submitted\":" << rs.sprites_submitted;
+		json << ",\"sprites_culled\":" << rs.sprites_culled;
+		json << ",\"sprite_draw_calls\":" << rs.sprite_draw_calls;
+		json << ",\"tilemap_draw_calls\":" << rs.tilemap_draw_calls;
+		json << ",\"tilemap_chunks_culled\":" << rs.tilemap_chunks_culled;
+		json << ",\"transient_vb_used\":" << rs.transient_vb_used;
+		json << ",\"texture_memory\":" << rs.texture_memory;
+		json << "}";
+	}
+	json << "]}";
+}
+
+struct ViewProfile
+{
+	u16 first;
+	u16 num;
+	const char* name;
+	const char* gpu_time;
+	const char* cpu_time;
+};
+
+// Views whose times are recorded, the times of the views in each range are summed.
+static const ViewProfile s_view_profiles[] =
+{
+	{ VIEW_PREWARM,   1,                   "prewarm",   "bgfx.view.prewarm.gpu_time",   "bgfx.view.prewarm.cpu_time"   },
+	{ VIEW_SHADOW,    MAX_SHADOW_VIEWS,    "shadow",    "bgfx.view.shadow.gpu_time",    "bgfx.view.shadow.cpu_time"    },
+	{ VIEW_SPRITE_0,  1,                   "sprite_0",  "bgfx.view.sprite_0.gpu_time",  "bgfx.view.sprite_0.cpu_time"  },
+	{ VIEW_SPRITE_1,  1,                   "sprite_1",  "bgfx.view.sprite_1.gpu_time",  "bgfx.view.sprite_1.cpu_time"  },
+	{ VIEW_SPRITE_2,  1,                   "sprite_2",  "bgfx.view.sprite_2.gpu_time",  "bgfx.view.sprite_2.cpu_time"  },
+	{ VIEW_SPRITE_3,  1,                   "sprite_3",  "bgfx.view.sprite_3.gpu_time",  "bgfx.view.sprite_3.cpu_time"  },
+	{ VIEW_SPRITE_4,  1,                   "sprite_4",  "bgfx.view.sprite_4.gpu_time",  "bgfx.view.sprite_4.cpu_time"  },
+	{ VIEW_SPRITE_5,  1,                   "sprite_5",  "bgfx.view.sprite_5.gpu_time",  "bgfx.view.sprite_5.cpu_time"  },
+	{ VIEW_SPRITE_6,  1,                   "sprite_6",  "bgfx.view.sprite_6.gpu_time",  "bgfx.view.sprite_6.cpu_time"  },
+	{ VIEW_SPRITE_7,  1,                   "sprite_7",  "bgfx.view.sprite_7.gpu_time",  "bgfx.view.sprite_7.cpu_time"  },
+	{ VIEW_MESH,      1,                   "mesh",      "bgfx.view.mesh.gpu_time",      "bgfx.view.mesh.cpu_time"      },
+	{ VIEW_CAMERAS,   MAX_CAMERAS_VIEWS,   "cameras",   "bgfx.view.cameras.gpu_time",   "bgfx.view.cameras.cpu_time"   },
+	{ VIEW_OCCLUSION, MAX_OCCLUSION_VIEWS, "occlusion", "bgfx.view.occlusion.gpu_time", "bgfx.view.occlusion.cpu_time" },
+	{ VIEW_DEBUG,     CROWN_MAX_CAMERAS,   "debug",     "bgfx.view.debug.gpu_time",     "bgfx.view.debug.cpu_time"     },
+	{ VIEW_UPSCALE,   1,                   "upscale",   "bgfx.view.upscale.gpu_time",   "bgfx.view.upscale.cpu_time"   },
+	{ VIEW_GUI,       1,                   "gui",       "bgfx.view.gui.gpu_time",       "bgfx.view.gui.cpu_time"       },
+	{ VIEW_POST,      MAX_POST_VIEWS,      "post",      "bgfx.view.post.gpu_time",      "bgfx.view.post.cpu_time"      },
+	{ VIEW_IMGUI,     1,                   "imgui",     "bgfx.view.imgui.gpu_time",     "bgfx.view.imgui.cpu_time"     }
+};
+
+// Records the statistics of the last frame rendered by bgfx. The times
+// of the views are only available while BGFX_DEBUG_PROFILER is enabled.
+static void record_bgfx_stats(const bgfx::Stats* stats)
+{
+	const f64 gpu_freq = f64(stats->gpuTimerFreq);
+	const f64 cpu_freq = f64(stats->cpuTimerFreq);
+
+	RECORD_FLOAT("bgfx.gpu_time", f32(f64(stats->gpuTimeEnd - stats->gpuTimeBegin)*1000.0/gpu_freq));
+	RECORD_FLOAT("bgfx.cpu_time", f32(f64(stats->cpuTimeEnd - stats->cpuTimeBegin)*1000.0/cpu_freq));
+	RECORD_FLOAT("bgfx.wait_render", f32(f64(stats->waitRender)*1000.0/cpu_freq));
+	RECORD_FLOAT("bgfx.wait_submit", f32(f64(stats->waitSubmit)*1000.0/cpu_freq));
+	RECORD_FLOAT("bgfx.draw_calls", f32(stats->numDraw));
+	RECORD_FLOAT("bgfx.triangles", f32(stats->numPrims[bgfx::Topology::TriList] + stats->numPrims[bgfx::Topology::TriStrip]));
+	RECORD_FLOAT("bgfx.lines", f32(stats->numPrims[bgfx::Topology::LineList] + stats->numPrims[bgfx::Topology::LineStrip]));
+	RECORD_FLOAT("bgfx.transient_vb_used", f32(stats->transientVbUsed));
+	RECORD_FLOAT("bgfx.transient_ib_used", f32(stats->transientIbUsed));
+
+	// Reported by the driver only with some renderers
+	if (stats->gpuMemoryUsed > 0)
+		RECORD_FLOAT("bgfx.gpu_memory_used", f32(f64(stats->gpuMemoryUsed) / (1024.0*1024.0)));
+
+	for (u32 p = 0; p < countof(s_view_profiles); ++p)
+	{
+		const ViewProfile& vp = s_view_profiles[p];
+		s64 gpu_time = 0;
+		s64 cpu_time = 0;
+		u32 num = 0;
+
+		for (u32 v = 0; v < stats->numViews; ++v)
+		{
+			const bgfx::ViewStats& vs = stats->viewStats[v];
+			if (vs.view < vp.first || vs.view >= vp.first + vp.num)
+				continue;
+
+			gpu_time += vs.gpuTimeElapsed;
+			cpu_time += vs.cpuTimeElapsed;
+			++num;
+		}
+
+		if (num == 0)
+			continue;
+
+		RECORD_FLOAT(vp.gpu_time, f32(f64(gpu_time)*1000.0/gpu_freq));
+		RECORD_FLOAT(vp.cpu_time, f32(f64(cpu_time)*1000.0/cpu_freq));
 	}
 }
 
+static void console_message_record(ConsoleServer& /*cs*/, TCPSocket /*client*/, const char* json, void* user_data)
+{
+	((Replay*)user_data)->add_command(json);
+}
+
 Device::Device(const DeviceOptions& opts, ConsoleServer& cs)
 	: _allocator(default_allocator(), MAX_SUBSYSTEMS_HEAP)
 	, _device_options(opts)
@@ -215,23 +502,195 @@ Device::Device(const DeviceOptions& opts, ConsoleServer& cs)
 	, _resource_manager(NULL)
 	, _bgfx_allocator(NULL)
 	, _bgfx_callback(NULL)
+	, _screen_capture(NULL)
 	, _shader_manager(NULL)
 	, _material_manager(NULL)
+	, _unit_template_manager(NULL)
+	, _texture_manager(NULL)
 	, _input_manager(NULL)
 	, _unit_manager(NULL)
 	, _lua_environment(NULL)
 	, _pipeline(NULL)
 	, _display(NULL)
 	, _window(NULL)
+	, _replay(NULL)
+	, _replay_file(NULL)
+	, _replay_profile(NULL)
+	, _profile_trace(NULL)
+	, _scene_benchmark(NULL)
 	, _worlds(default_allocator())
+	, _reloads(default_allocator())
 	, _width(0)
 	, _height(0)
+	, _tick_accumulator(0.0)
+	, _interpolation_alpha(1.0f)
 	, _quit(false)
 	, _paused(false)
+	, _profiler_streaming(false)
+	, _render_stats_streaming(false)
+	, _perf_overlay(default_allocator())
+	, _profiler_encoder(default_allocator())
+	, _profiler_history(default_allocator())
+	, _profiler_binary(false)
+	, _profiler_decimation(1)
+	, _profiler_frame(0)
+	, _profiler_dropped(0)
+	, _profiler_budget(0.0)
+	, _profiler_spike(0.0f)
+	, _profiler_last_dump(0)
 {
 }
 
-bool Device::process_events(bool vsync)
+void Device::replay_init()
+{
+	_replay = CE_NEW(_allocator, Replay)(default_allocator());
+
+	if (_device_options._record_path != NULL)
+	{
+		_replay_file = _data_filesystem->open(_device_options._record_path, FileOpenMode::WRITE);
+		if (_replay_file->is_open())
+		{
+			_replay->record(*_replay_file, u32(os::clocktime()));
+			_console_server->set_message_callback(console_message_record, _replay);
+		}
+		else
+		{
+			loge(DEVICE, "Unable to record to: %s", _device_options._record_path);
+		}
+	}
+	else
+	{
+		_replay_file = _data_filesystem->open(_device_options._replay_path, FileOpenMode::READ);
+		if (!_replay_file->is_open() || !_replay->play(*_replay_file))
+		{
+			loge(DEVICE, "Invalid replay: %s", _device_options._replay_path);
+			_quit = true;
+		}
+		else if (_device_options._replay_profile_path != NULL)
+		{
+			_replay_profile = _data_filesystem->open(_device_options._replay_profile_path, FileOpenMode::WRITE);
+		}
+	}
+
+	if (_replay->_mode == ReplayMode::COUNT)
+	{
+		replay_shutdown();
+		return;
+	}
+
+	// Seed Lua's generator so that the replay is deterministic
+	TempAllocator128 ta;
+	StringStream ss(ta);
+	ss << "math.randomseed(" << _replay->_seed << ")";
+	_lua_environment->execute_string(string_stream::c_str(ss));
+
+	logi(DEVICE, "%s: %s"
+		, _replay->_mode == ReplayMode::RECORD ? "Recording" : "Replaying"
+		, _device_options._record_path != NULL ? _device_options._record_path : _device_options._replay_path
+		);
+}
+
+void Device::replay_shutdown()
+{
+	_console_server->set_message_callback(NULL, NULL);
+
+	if (_replay_profile)
+		_data_filesystem->close(*_replay_profile);
+	if (_replay_file)
+		_data_filesystem->close(*_replay_file);
+
+	CE_DELETE(_allocator, _replay);
+	_replay = NULL;
+	_replay_file = NULL;
+	_replay_profile = NULL;
+}
+
+void Device::profiler_update(f32 dt)
+{
+	const char* begin = profiler_globals::buffer();
+	const char* end = begin + profiler_globals::buffer_size();
+	const s64 now = os::clocktime();
+
+	if (_profiler_history.enabled())
+	{
+		_profiler_history.add(begin, end, now);
+
+		// Send the history at most once per history duration, so that a
+		// long hitch does not flood the clients
+		if (_profiler_spike > 0.0f
+			&& dt > _profiler_spike
+			&& now - _profiler_last_dump > _profiler_history._duration
+			)
+		{
+			logw(DEVICE, "Frame spike of %.2f ms, sending %u frames of profiler history"
+				, dt * 1000.0f
+				, _profiler_history.num_frames()
+				);
+			profiler_dump_history(NULL);
+			_profiler_last_dump = now;
+		}
+	}
+
+	if (!_profiler_streaming)
+		return;
+
+	if (!_profiler_binary)
+	{
+		TempAllocator4096 ta;
+		StringStream json(ta);
+		profiler_globals::to_json(json);
+		_console_server->send(string_stream::c_str(json));
+		return;
+	}
+
+	// Token bucket: the budget refills at CROWN_PROFILER_STREAM_BUDGET
+	// bytes per second and sending is allowed as long as it is positive
+	_profiler_budget += f64(dt) * CROWN_PROFILER_STREAM_BUDGET;
+	if (_profiler_budget > CROWN_PROFILER_STREAM_BUDGET)
+		_profiler_budget = CROWN_PROFILER_STREAM_BUDGET;
+
+	if (_profiler_frame++ % _profiler_decimation != 0 || _profiler_budget <= 0.0)
+	{
+		++_profiler_dropped;
+		return;
+	}
+
+	Buffer msg(default_frame_allocator());
+	_profiler_encoder.begin_message(msg);
+	_profiler_encoder.encode(msg, begin, end, _profiler_dropped);
+	_console_server->send(array::begin(msg), array::size(msg));
+
+	_profiler_budget -= f64(array::size(msg));
+	_profiler_dropped = 0;
+}
+
+void Device::profiler_dump_history(TCPSocket* client)
+{
+	Buffer msg(default_allocator());
+	_profiler_history.encode(msg, default_allocator());
+
+	if (client != NULL)
+		_console_server->send(*client, array::begin(msg), array::size(msg));
+	else
+		_console_server->send(array::begin(msg), array::size(msg));
+}
+
+// Logs the time elapsed since @a start to mark the end of a startup @a step.
+static void log_startup(const char* step, s64 start)
+{
+	logi(DEVICE, "Startup: %-20s %8.2f ms", step, f64(os::clocktime() - start) * 1000.0 / f64(os::clockfrequency()));
+}
+
+// Returns the bgfx reset flags of the boot config @a bc.
+static u32 reset_flags(const BootConfig& bc)
+{
+	u32 flags = bc.vsync ? BGFX_RESET_VSYNC : BGFX_RESET_NONE;
+	if (bc.flush_after_render)
+		flags |= BGFX_RESET_FLUSH_AFTER_RENDER;
+	return flags;
+}
+
+bool Device::process_events()
 {
 #if CROWN_TOOLS
 	return tool_process_events();
@@ -241,7 +700,8 @@ bool Device::process_events(bool vsync)
 	bool reset = false;
 
 	OsEvent event;
-	while (next_event(event))
+	s64 time;
+	while (next_event(event, time))
 	{
 		if (event.type == OsEventType::NONE)
 			continue;
@@ -251,7 +711,12 @@ bool Device::process_events(bool vsync)
 		case OsEventType::BUTTON:
 		case OsEventType::AXIS:
 		case OsEventType::STATUS:
-			_input_manager->read(event);
+			// Input comes from the replay when playing back
+			if (_replay != NULL && _replay->_mode == ReplayMode::PLAY)
+				break;
+			if (_replay != NULL)
+				_replay->add_event(event);
+			_input_manager->read(event, time);
 			break;
 
 		case OsEventType::RESOLUTION:
@@ -281,14 +746,33 @@ bool Device::process_events(bool vsync)
 		}
 	}
 
+	if (_replay != NULL && _replay->_mode == ReplayMode::PLAY)
+	{
+		if (_replay->next_frame())
+		{
+			const s64 now = os::clocktime();
+			for (u32 i = 0; i < array::size(_replay->_events); ++i)
+				_input_manager->read(_replay->_events[i], now);
+		}
+		else
+		{
+			exit = true;
+		}
+	}
+
 	if (reset)
-		bgfx::reset(_width, _height, (vsync ? BGFX_RESET_VSYNC : BGFX_RESET_NONE));
+		bgfx::reset(_width, _height, reset_flags(_boot_config));
 
 	return exit;
 }
 
 void Device::run()
 {
+	const s64 startup = os::clocktime();
+
+	memory_globals::enable_tracking(_device_options._track_memory);
+	memory_globals::enable_huge_pages(_device_options._huge_pages);
+
 	_console_server->register_command("command", console_command, this);
 	_console_server->register_command("script",  console_command_script, this);
 
@@ -312,7 +796,19 @@ void Device::run()
 
 	logi(DEVICE, "Initializing Crown Engine %s %s %s", CROWN_VERSION, CROWN_PLATFORM_NAME, CROWN_ARCH_NAME);
 
+	{
+		CpuTopology ct;
+		thread::cpu_topology(ct);
+		logi(DEVICE, "CPU: %u threads, %u cores, %u clusters", ct.num_logical, ct.num_physical, ct.num_clusters);
+	}
+
 	profiler_globals::init();
+	profiler::set_thread_name("main");
+
+	if (_device_options._async_log)
+		log_globals::start_async();
+
+	job_system_globals::init(_device_options._job_workers);
 
 	namespace smr = state_machine_internal;
 	namespace cor = config_resource_internal;
@@ -331,28 +827,34 @@ void Device::run()
 	namespace txr = texture_resource_internal;
 	namespace utr = unit_resource_internal;
 
-	_resource_loader  = CE_NEW(_allocator, ResourceLoader)(*_data_filesystem);
-	_resource_loader->register_fallback(RESOURCE_TYPE_TEXTURE,  StringId64("core/fallback/fallback"));
-	_resource_loader->register_fallback(RESOURCE_TYPE_MATERIAL, StringId64("core/fallback/fallback"));
-	_resource_loader->register_fallback(RESOURCE_TYPE_UNIT,     StringId64("core/fallback/fallback"));
+	_resource_loader  = CE_NEW(_allocator, ResourceLoader)(*_data_filesystem, _device_options._loader_threads);
+	_resource_loader->register_fallback(RESOURCE_TYPE_TEXTURE,  "core/fallback/fallback"_id64);
+	_resource_loader->register_fallback(RESOURCE_TYPE_MATERIAL, "core/fallback/fallback"_id64);
+	_resource_loader->register_fallback(RESOURCE_TYPE_UNIT,     "core/fallback/fallback"_id64);
 
 	_resource_manager = CE_NEW(_allocator, ResourceManager)(*_resource_loader);
 	_resource_manager->register_type(RESOURCE_TYPE_CONFIG,           RESOURCE_VERSION_CONFIG,           cor::load, cor::unload, NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_FONT,             RESOURCE_VERSION_FONT,             NULL,      NULL,        NULL,        NULL        );
-	_resource_manager->register_type(RESOURCE_TYPE_LEVEL,            RESOURCE_VERSION_LEVEL,            NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_LEVEL,            RESOURCE_VERSION_LEVEL,            NULL,      NULL,        lvr::online, lvr::offline);
 	_resource_manager->register_type(RESOURCE_TYPE_MATERIAL,         RESOURCE_VERSION_MATERIAL,         mtr::load, mtr::unload, mtr::online, mtr::offline);
 	_resource_manager->register_type(RESOURCE_TYPE_MESH,             RESOURCE_VERSION_MESH,             mhr::load, mhr::unload, mhr::online, mhr::offline);
+	_resource_manager->register_type(RESOURCE_TYPE_NAV_GRID,         RESOURCE_VERSION_NAV_GRID,         NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_PACKAGE,          RESOURCE_VERSION_PACKAGE,          pkr::load, pkr::unload, NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_PARTICLE,         RESOURCE_VERSION_PARTICLE,         NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_PHYSICS,          RESOURCE_VERSION_PHYSICS,          NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_PHYSICS_CONFIG,   RESOURCE_VERSION_PHYSICS_CONFIG,   NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_RENDER_GRAPH,     RESOURCE_VERSION_RENDER_GRAPH,     NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SCRIPT,           RESOURCE_VERSION_SCRIPT,           NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SHADER,           RESOURCE_VERSION_SHADER,           shr::load, shr::unload, shr::online, shr::offline);
-	_resource_manager->register_type(RESOURCE_TYPE_SOUND,            RESOURCE_VERSION_SOUND,            NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_SKELETON,         RESOURCE_VERSION_SKELETON,         NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_SKELETON_ANIMATION, RESOURCE_VERSION_SKELETON_ANIMATION, NULL,  NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_SOUND,            RESOURCE_VERSION_SOUND,            sdr::load, sdr::unload, sdr::online, sdr::offline);
 	_resource_manager->register_type(RESOURCE_TYPE_SPRITE,           RESOURCE_VERSION_SPRITE,           NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_SPRITE_ANIMATION, RESOURCE_VERSION_SPRITE_ANIMATION, NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_STATE_MACHINE,    RESOURCE_VERSION_STATE_MACHINE,    NULL,      NULL,        NULL,        NULL        );
 	_resource_manager->register_type(RESOURCE_TYPE_TEXTURE,          RESOURCE_VERSION_TEXTURE,          txr::load, txr::unload, txr::online, txr::offline);
-	_resource_manager->register_type(RESOURCE_TYPE_UNIT,             RESOURCE_VERSION_UNIT,             NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_TILEMAP,          RESOURCE_VERSION_TILEMAP,          NULL,      NULL,        NULL,        NULL        );
+	_resource_manager->register_type(RESOURCE_TYPE_UNIT,             RESOURCE_VERSION_UNIT,             NULL,      NULL,        utr::online, utr::offline);
 
 	// Read config
 	{
@@ -367,22 +869,46 @@ void Device::run()
 		boot_dir += CROWN_BOOT_CONFIG;
 
 		const StringId64 config_name(boot_dir.c_str());
-		_resource_manager->load(RESOURCE_TYPE_CONFIG, config_name);
-		_resource_manager->flush();
+		_resource_manager->load(RESOURCE_TYPE_CONFIG, config_name, ResourcePriority::CRITICAL);
+		_resource_manager->wait(RESOURCE_TYPE_CONFIG, config_name);
 		_boot_config.parse((const char*)_resource_manager->get(RESOURCE_TYPE_CONFIG, config_name));
 		_resource_manager->unload(RESOURCE_TYPE_CONFIG, config_name);
 	}
+	log_startup("boot config", startup);
+
+	// The managers are needed by the loader threads to load the resources
+	_shader_manager   = CE_NEW(_allocator, ShaderManager)(default_allocator());
+	_material_manager = CE_NEW(_allocator, MaterialManager)(default_allocator(), *_resource_manager);
+	_unit_template_manager = CE_NEW(_allocator, UnitTemplateManager)(default_allocator(), *_resource_manager, *_material_manager);
+	_texture_manager  = CE_NEW(_allocator, TextureManager)(default_allocator(), *_resource_manager);
+	_texture_manager->set_memory_budget(u64(_boot_config.texture_memory_budget)*1024*1024);
+	_texture_manager->set_upload_budget(_boot_config.texture_upload_budget*1024);
+	_resource_manager->enable_neighbours_prefetch(_boot_config.prefetch_level_neighbours);
+	for (u32 i = 0; i < array::size(_boot_config.resource_budgets); ++i)
+	{
+		const BootConfig::ResourceBudget& rb = _boot_config.resource_budgets[i];
+		_resource_manager->set_budget(rb.type, u64(rb.size)*1024*1024);
+	}
+
+	// Load the boot package while the remaining subsystems are initialized.
+	// Resources are brought online by flush(), once the renderer is ready.
+	ResourcePackage* boot_package = create_resource_package(_boot_config.boot_package_name);
+	boot_package->load(ResourcePriority::CRITICAL);
+	_resource_manager->load(RESOURCE_TYPE_RENDER_GRAPH, _boot_config.render_graph_name, ResourcePriority::CRITICAL);
+	log_startup("boot package request", startup);
 
 	// Init all remaining subsystems
 	_bgfx_allocator = CE_NEW(_allocator, BgfxAllocator)(default_allocator());
-	_bgfx_callback  = CE_NEW(_allocator, BgfxCallback)();
+	_screen_capture = CE_NEW(_allocator, ScreenCapture)(default_allocator());
+	_bgfx_callback  = CE_NEW(_allocator, BgfxCallback)(*_screen_capture);
 
-	_display = display::create(_allocator);
+	const bool headless = _device_options._headless;
+	_display = headless ? CE_NEW(_allocator, DisplayNull)() : display::create(_allocator);
 
 	_width  = _boot_config.window_w;
 	_height = _boot_config.window_h;
 
-	_window = window::create(_allocator);
+	_window = headless ? CE_NEW(_allocator, WindowNull)() : window::create(_allocator);
 	_window->open(_device_options._window_x
 		, _device_options._window_y
 		, _width
@@ -393,35 +919,85 @@ void Device::run()
 	_window->set_fullscreen(_boot_config.fullscreen);
 	_window->bgfx_setup();
 
+	// Headless devices keep the bgfx API working but never touch the GPU
 	bgfx::Init init;
-	init.type     = bgfx::RendererType::Count;
+	init.type     = headless ? bgfx::RendererType::Noop : bgfx::RendererType::Count;
 	init.vendorId = BGFX_PCI_ID_NONE;
 	init.resolution.width  = _width;
 	init.resolution.height = _height;
-	init.resolution.reset  = _boot_config.vsync ? BGFX_RESET_VSYNC : BGFX_RESET_NONE;
+	init.resolution.reset  = reset_flags(_boot_config);
 	init.callback  = _bgfx_callback;
 	init.allocator = _bgfx_allocator;
 	bgfx::init(init);
+	log_startup("window and renderer", startup);
 
-	_shader_manager   = CE_NEW(_allocator, ShaderManager)(default_allocator());
-	_material_manager = CE_NEW(_allocator, MaterialManager)(default_allocator(), *_resource_manager);
 	_input_manager    = CE_NEW(_allocator, InputManager)(default_allocator());
 	_unit_manager     = CE_NEW(_allocator, UnitManager)(default_allocator());
-	_lua_environment  = CE_NEW(_allocator, LuaEnvironment)();
+	_lua_environment  = CE_NEW(_allocator, LuaEnvironment)(default_allocator());
 
 	audio_globals::init();
 	physics_globals::init(_allocator);
+	log_startup("subsystems", startup);
+
+	_lua_environment->load_libs();
+	log_startup("lua", startup);
 
-	ResourcePackage* boot_package = create_resource_package(_boot_config.boot_package_name);
-	boot_package->load();
 	boot_package->flush();
+	log_startup("boot package", startup);
+
+	if (_device_options._record_path != NULL || _device_options._replay_path != NULL)
+		replay_init();
+
+	if (_device_options._profile_trace_path != NULL)
+	{
+		_profile_trace = _data_filesystem->open(_device_options._profile_trace_path, FileOpenMode::WRITE);
+		if (_profile_trace->is_open())
+		{
+			const char* header = "[{\"ph\":\"M\",\"pid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"crown\"}}";
+			_profile_trace->write(header, strlen32(header));
+		}
+		else
+		{
+			loge(DEVICE, "Unable to write the profile trace to: %s", _device_options._profile_trace_path);
+			_data_filesystem->close(*_profile_trace);
+			_profile_trace = NULL;
+		}
+	}
+
+	if (_device_options._benchmark_scene_path != NULL)
+	{
+		_scene_benchmark = CE_NEW(_allocator, SceneBenchmark)(default_allocator()
+			, _device_options._benchmark_frames
+			, CROWN_BENCHMARK_WARMUP_FRAMES
+			);
+	}
 
-	_lua_environment->load_libs();
 	_lua_environment->execute_string(_device_options._lua_string.c_str());
 	_lua_environment->execute((LuaResource*)_resource_manager->get(RESOURCE_TYPE_SCRIPT, _boot_config.boot_script_name));
+	log_startup("boot script", startup);
+
+	_resource_manager->wait(RESOURCE_TYPE_RENDER_GRAPH, _boot_config.render_graph_name);
+
+	_pipeline = CE_NEW(_allocator, Pipeline)(default_allocator());
+	if (_boot_config.resolution_gpu_time > 0.0f)
+	{
+		_pipeline->set_dynamic_resolution(_boot_config.resolution_min_scale
+			, _boot_config.resolution_max_scale
+			, _boot_config.resolution_gpu_time
+			);
+	}
+	_pipeline->create((const RenderGraphResource*)_resource_manager->get(RESOURCE_TYPE_RENDER_GRAPH, _boot_config.render_graph_name)
+		, _width
+		, _height
+		);
+	prewarm(*boot_package);
+	log_startup("pipeline", startup);
 
-	_pipeline = CE_NEW(_allocator, Pipeline)();
-	_pipeline->create(_width, _height);
+	for (u32 p = 0; p < countof(s_view_profiles); ++p)
+	{
+		for (u16 v = 0; v < s_view_profiles[p].num; ++v)
+			bgfx::setViewName(s_view_profiles[p].first + v, s_view_profiles[p].name);
+	}
 
 #if CROWN_TOOLS
 	tool_init();
@@ -430,23 +1006,72 @@ void Device::run()
 	logi(DEVICE, "Initialized");
 
 	_lua_environment->call_global("init", 0);
+	log_startup("init", startup);
 
 	s64 time_last = os::clocktime();
 	u16 old_width = _width;
 	u16 old_height = _height;
+	u32 debug_flags = BGFX_DEBUG_NONE;
+
+	// Headless devices advance by a fixed step so that the simulation is
+	// deterministic, and sleep off the rest of it to run in real time.
+	// Benchmarks advance by the same step but run as fast as possible
+	const bool fixed_step = headless || _scene_benchmark != NULL;
+	const f64 headless_step = 1.0 / f64(_boot_config.tick_rate > 0 ? _boot_config.tick_rate : CROWN_DEFAULT_HEADLESS_TICK_RATE);
+
+	FramePacer frame_pacer(_boot_config.frame_rate, _boot_config.late_input);
+	frame_pacer.begin_frame(os::clocktime());
+	bool targets_released = false;
 
-	while (!process_events(_boot_config.vsync) && !_quit)
+	while (!process_events() && !_quit)
 	{
 		const s64 time = os::clocktime();
 		const f64 freq = (f64)os::clockfrequency();
-		const f32 dt   = f32(f64(time - time_last) / freq);
+		f32 dt         = f32(f64(time - time_last) / freq);
 		time_last = time;
 
+		if (fixed_step)
+			dt = f32(headless_step);
+
+		const bool playing = _replay != NULL && _replay->_mode == ReplayMode::PLAY;
+		if (playing)
+			dt = _replay->_dt;
+
 		profiler_globals::clear();
 		_console_server->update();
 
+		if (playing)
+		{
+			for (u32 i = 0; i < _replay->num_commands(); ++i)
+				_console_server->execute(TCPSocket(), _replay->command(i));
+		}
+
+		// Paused frames only serve the console, then block until the OS
+		// sends an event, so that the device resumes without delay
+		if (_paused && _boot_config.paused_frame_rate > 0)
+		{
+			if (_boot_config.paused_release_targets && !targets_released)
+			{
+				_pipeline->destroy_targets();
+				bgfx::frame();
+				targets_released = true;
+			}
+
+			memory_globals::reset_frame_allocator();
+			wait_event(1000 / _boot_config.paused_frame_rate);
+			frame_pacer.begin_frame(os::clocktime());
+			continue;
+		}
+
+		if (targets_released)
+		{
+			_pipeline->create_targets(_width, _height);
+			targets_released = false;
+		}
+
 		RECORD_FLOAT("device.dt", dt);
 		RECORD_FLOAT("device.fps", 1.0f/dt);
+		frame_pacer.record();
 
 		if (_width != old_width || _height != old_height)
 		{
@@ -455,13 +1080,39 @@ void Device::run()
 			_pipeline->reset(_width, _height);
 		}
 
+		u32 num_ticks = 1;
 		if (!_paused)
 		{
-			_resource_manager->complete_requests();
+			_resource_manager->complete_requests(_boot_config.resource_online_budget);
+			complete_reloads();
+			report_missing();
+			_resource_manager->update_prefetched();
+			_texture_manager->update();
 
 			{
 				const s64 t0 = os::clocktime();
-				_lua_environment->call_global("update", 1, ARGUMENT_FLOAT, dt);
+				if (_boot_config.tick_rate == 0)
+				{
+					_lua_environment->call_global("update", 1, ARGUMENT_FLOAT, dt);
+				}
+				else
+				{
+					// Run the simulation at a fixed rate and interpolate the
+					// poses of the last two ticks at render time
+					const f64 tick = 1.0 / f64(_boot_config.tick_rate);
+					_tick_accumulator += dt;
+
+					for (num_ticks = 0; _tick_accumulator >= tick && num_ticks < _boot_config.max_ticks_per_frame; ++num_ticks)
+					{
+						_lua_environment->call_global("update", 1, ARGUMENT_FLOAT, f32(tick));
+						_tick_accumulator -= tick;
+					}
+
+					if (_tick_accumulator >= tick)
+						_tick_accumulator = fmod(_tick_accumulator, tick);
+
+					_interpolation_alpha = f32(_tick_accumulator / tick);
+				}
 				RECORD_FLOAT("lua.update", f32(f64(os::clocktime() - t0) / freq));
 			}
 			{
@@ -469,22 +1120,123 @@ void Device::run()
 				_lua_environment->call_global("render", 1, ARGUMENT_FLOAT, dt);
 				RECORD_FLOAT("lua.render", f32(f64(os::clocktime() - t0) / freq));
 			}
+
+			_lua_environment->collect_garbage(_boot_config.lua_gc_budget);
 		}
 
-		_lua_environment->reset_temporaries();
-		_input_manager->update();
+		// Input events are consumed by the ticks: keep them for the next
+		// frame if the simulation did not advance
+		if (num_ticks > 0)
+			_input_manager->update();
+
+		// The times of the views need GPU queries, only issue them while
+		// the profiler data is consumed
+		const bool profiling = _profiler_streaming
+			|| _replay_profile != NULL
+			|| _profile_trace != NULL
+			|| _profiler_history.enabled()
+			;
+		const u32 debug = 0
+			| (profiling ? BGFX_DEBUG_PROFILER : BGFX_DEBUG_NONE)
+			| (_perf_overlay._enabled ? BGFX_DEBUG_TEXT : BGFX_DEBUG_NONE)
+			;
+		if (debug != debug_flags)
+		{
+			bgfx::setDebug(debug);
+			debug_flags = debug;
+		}
 
-		const bgfx::Stats* stats = bgfx::getStats();
-		RECORD_FLOAT("bgfx.gpu_time", f32(f64(stats->gpuTimeEnd - stats->gpuTimeBegin)*1000.0/stats->gpuTimerFreq));
-		RECORD_FLOAT("bgfx.cpu_time", f32(f64(stats->cpuTimeEnd - stats->cpuTimeBegin)*1000.0/stats->cpuTimerFreq));
+		// The script stacks are sampled while the profiler data is consumed
+		_lua_environment->set_sampling(profiling);
+		_lua_environment->record_samples();
+
+		record_bgfx_stats(bgfx::getStats());
+		RECORD_FLOAT("memory.bgfx", f32(f64(bgfx_allocated()) / (1024.0*1024.0)));
+		gpu_memory::record_stats();
+		memory_globals::record_tracking_stats();
+		memory_globals::record_page_stats();
+		audio_globals::record_stats();
 
 		profiler_globals::flush();
 
+		profiler_update(dt);
+
+		_perf_overlay.update(dt
+			, profiler_globals::buffer()
+			, profiler_globals::buffer() + profiler_globals::buffer_size()
+			);
+		_perf_overlay.draw(_width, _height);
+		_screen_capture->update(dt);
+
+		if (_profile_trace != NULL)
+		{
+			TempAllocator4096 ta;
+			StringStream json(ta);
+			profiler_globals::to_chrome_trace(json);
+			const char* str = string_stream::c_str(json);
+			_profile_trace->write(str, strlen32(str));
+		}
+
+		if (_render_stats_streaming)
+		{
+			TempAllocator4096 ta;
+			StringStream json(ta);
+			render_stats_to_json(json, array::begin(_worlds), array::size(_worlds));
+			_console_server->send(string_stream::c_str(json));
+		}
+
+		if (_replay != NULL)
+		{
+			if (_replay->_mode == ReplayMode::RECORD)
+				_replay->end_frame(dt);
+
+			if (_replay_profile != NULL)
+			{
+				TempAllocator4096 ta;
+				StringStream json(ta);
+				profiler_globals::to_json(json);
+				json << "\n";
+				const char* str = string_stream::c_str(json);
+				_replay_profile->write(str, strlen32(str));
+			}
+		}
+
 #if CROWN_TOOLS
 		tool_update(dt);
 #endif
 
-		bgfx::frame();
+		// Submit the gui batches still pending
+		for (u32 i = 0; i < array::size(_worlds); ++i)
+			_worlds[i]->_gui_buffer.flush();
+
+		frame_pacer.end_frame();
+		ENTER_PROFILE_SCOPE("device.frame_submit");
+		_pipeline->frame(bgfx::frame());
+		LEAVE_PROFILE_SCOPE();
+
+		RECORD_FLOAT("memory.frame_allocator", f32(default_frame_allocator().total_allocated()));
+		memory_globals::reset_frame_allocator();
+
+		if (_scene_benchmark != NULL)
+		{
+			const char* begin = profiler_globals::buffer();
+			const char* end = begin + profiler_globals::buffer_size();
+			const f32 frame_time = f32(f64(os::clocktime() - time) / freq);
+			if (_scene_benchmark->add_frame(frame_time, begin, end))
+				_quit = true;
+		}
+		else if (headless)
+		{
+			const f64 elapsed = f64(os::clocktime() - time) / freq;
+			if (elapsed < headless_step)
+				os::sleep(u32((headless_step - elapsed) * 1000.0));
+		}
+		else
+		{
+			frame_pacer.wait();
+		}
+
+		frame_pacer.begin_frame(os::clocktime());
 	}
 
 #if CROWN_TOOLS
@@ -493,35 +1245,83 @@ void Device::run()
 
 	_lua_environment->call_global("shutdown", 0);
 
+	if (_replay != NULL)
+		replay_shutdown();
+
+	if (_profile_trace != NULL)
+	{
+		_profile_trace->write("]\n", 2);
+		_data_filesystem->close(*_profile_trace);
+		_profile_trace = NULL;
+	}
+
+	if (_scene_benchmark != NULL)
+	{
+		File* file = _data_filesystem->open(_device_options._benchmark_scene_path, FileOpenMode::WRITE);
+		if (file->is_open())
+		{
+			TempAllocator4096 ta;
+			StringStream json(ta);
+			_scene_benchmark->to_json(json, f32(headless_step));
+			const char* str = string_stream::c_str(json);
+			file->write(str, strlen32(str));
+			logi(DEVICE, "Benchmark results written to: %s", _device_options._benchmark_scene_path);
+		}
+		else
+		{
+			loge(DEVICE, "Unable to write the benchmark results to: %s", _device_options._benchmark_scene_path);
+		}
+		_data_filesystem->close(*file);
+
+		CE_DELETE(_allocator, _scene_benchmark);
+		_scene_benchmark = NULL;
+	}
+
+	_resource_manager->unload_prefetched();
 	boot_package->unload();
 	destroy_resource_package(*boot_package);
 
 	physics_globals::shutdown(_allocator);
 	audio_globals::shutdown();
 
+	_pipeline->destroy();
+	_resource_manager->unload(RESOURCE_TYPE_RENDER_GRAPH, _boot_config.render_graph_name);
+
 	CE_DELETE(_allocator, _pipeline);
 	CE_DELETE(_allocator, _lua_environment);
 	CE_DELETE(_allocator, _unit_manager);
 	CE_DELETE(_allocator, _input_manager);
+	CE_DELETE(_allocator, _texture_manager);
 	CE_DELETE(_allocator, _material_manager);
 	CE_DELETE(_allocator, _shader_manager);
 	CE_DELETE(_allocator, _resource_manager);
+	CE_DELETE(_allocator, _unit_template_manager);
 	CE_DELETE(_allocator, _resource_loader);
 
-	_pipeline->destroy();
-
 	bgfx::shutdown();
 	_window->close();
-	window::destroy(_allocator, *_window);
-	display::destroy(_allocator, *_display);
+	if (headless)
+	{
+		CE_DELETE(_allocator, (WindowNull*)_window);
+		CE_DELETE(_allocator, (DisplayNull*)_display);
+	}
+	else
+	{
+		window::destroy(_allocator, *_window);
+		display::destroy(_allocator, *_display);
+	}
 	CE_DELETE(_allocator, _bgfx_callback);
+	CE_DELETE(_allocator, _screen_capture);
 	CE_DELETE(_allocator, _bgfx_allocator);
 
+	log_globals::stop_async();
+
 	if (_last_log)
 		_data_filesystem->close(*_last_log);
 
 	CE_DELETE(_allocator, _data_filesystem);
 
+	job_system_globals::shutdown();
 	profiler_globals::shutdown();
 
 	_allocator.clear();
@@ -552,84 +1352,92 @@ void Device::resolution(u16& width, u16& height)
 
 void Device::render(World& world, UnitId camera_unit)
 {
-	float aspect_ratio = (_boot_config.aspect_ratio == -1.0f
-		? (float)_width/(float)_height
-		: _boot_config.aspect_ratio
-		);
-	world.camera_set_aspect(camera_unit, aspect_ratio);
-	world.camera_set_viewport_metrics(camera_unit, 0, 0, _width, _height);
+	render(world, &camera_unit, 1);
+}
+
+void Device::render(World& world, const UnitId* cameras, u32 num)
+{
+	CE_ASSERT(num > 0 && num <= CROWN_MAX_CAMERAS, "Invalid number of cameras: %u", num);
+
+	if (_boot_config.tick_rate > 0)
+		world.interpolate(_interpolation_alpha);
 
-	const Matrix4x4 view = world.camera_view_matrix(camera_unit);
-	const Matrix4x4 proj = world.camera_projection_matrix(camera_unit);
+	// Nothing would be shown
+	if (_device_options._headless)
+		return;
+
+	_pipeline->update_resolution(_width, _height);
+
+	Matrix4x4 views[CROWN_MAX_CAMERAS];
+	Matrix4x4 projs[CROWN_MAX_CAMERAS];
+	bool full_window = true;
+
+	for (u32 c = 0; c < num; ++c)
+	{
+		const Vector4 vp = world.camera_viewport(cameras[c]);
+		full_window = full_window && vp.x == 0.0f && vp.y == 0.0f && vp.z == 1.0f && vp.w == 1.0f;
+
+		const u16 x = u16(vp.x*_width);
+		const u16 y = u16(vp.y*_height);
+		const u16 width = u16(vp.z*_width);
+		const u16 height = u16(vp.w*_height);
+
+		float aspect_ratio = (_boot_config.aspect_ratio == -1.0f
+			? (float)width/(float)height
+			: _boot_config.aspect_ratio
+			);
+		world.camera_set_aspect(cameras[c], aspect_ratio);
+		world.camera_set_viewport_metrics(cameras[c], x, y, width, height);
+
+		views[c] = world.camera_view_matrix(cameras[c]);
+		projs[c] = world.camera_projection_matrix(cameras[c]);
+
+		// The scene is rendered at its own resolution, see Pipeline::update_resolution()
+		const u16 rect_x = u16(vp.x*_pipeline->_scene_width);
+		const u16 rect_y = u16(vp.y*_pipeline->_scene_height);
+		const u16 rect_width = u16(vp.z*_pipeline->_scene_width);
+		const u16 rect_height = u16(vp.w*_pipeline->_scene_height);
+
+		// Each camera owns the sprite layers and the mesh view, offset by
+		// VIEW_CAMERA_NUM, and one debug view
+		bgfx::setViewClear(VIEW_SPRITE_0 + c*VIEW_CAMERA_NUM, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x353839ff, 1.0f, 0);
+
+		for (u32 v = 0; v < VIEW_CAMERA_NUM + 1; ++v)
+		{
+			const bgfx::ViewId id = v < VIEW_CAMERA_NUM
+				? bgfx::ViewId(VIEW_SPRITE_0 + c*VIEW_CAMERA_NUM + v)
+				: bgfx::ViewId(VIEW_DEBUG + c)
+				;
+
+			bgfx::setViewTransform(id, to_float_ptr(views[c]), to_float_ptr(projs[c]));
+			bgfx::setViewRect(id, rect_x, rect_y, rect_width, rect_height);
+			bgfx::setViewFrameBuffer(id, _pipeline->_scene_frame_buffer);
+			if (v < VIEW_CAMERA_NUM)
+				bgfx::setViewMode(id, bgfx::ViewMode::DepthAscending); // Depth is the RenderQueue order for meshes
+			bgfx::touch(id);
+		}
+	}
 
 	Matrix4x4 ortho_proj;
 	orthographic(ortho_proj, 0, _width, 0, _height, 0.01f, 1.0f);
 
-	bgfx::setViewClear(VIEW_SPRITE_0, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, 0x353839ff, 1.0f, 0);
-
-	bgfx::setViewTransform(VIEW_SPRITE_0, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_1, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_2, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_3, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_4, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_5, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_6, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_SPRITE_7, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_MESH, to_float_ptr(view), to_float_ptr(proj));
-	bgfx::setViewTransform(VIEW_DEBUG, to_float_ptr(view), to_float_ptr(proj));
 	bgfx::setViewTransform(VIEW_GUI, to_float_ptr(MATRIX4X4_IDENTITY), to_float_ptr(ortho_proj));
-
-	bgfx::setViewRect(VIEW_SPRITE_0, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_1, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_2, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_3, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_4, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_5, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_6, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_SPRITE_7, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_MESH, 0, 0, _width, _height);
-	bgfx::setViewRect(VIEW_DEBUG, 0, 0, _width, _height);
 	bgfx::setViewRect(VIEW_GUI, 0, 0, _width, _height);
-
-	bgfx::setViewMode(VIEW_SPRITE_0, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_1, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_2, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_3, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_4, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_5, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_6, bgfx::ViewMode::DepthAscending);
-	bgfx::setViewMode(VIEW_SPRITE_7, bgfx::ViewMode::DepthAscending);
 	bgfx::setViewMode(VIEW_GUI, bgfx::ViewMode::Sequential);
-
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_0, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_1, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_2, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_3, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_4, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_5, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_6, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_SPRITE_7, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_MESH, _pipeline->_frame_buffer);
-	bgfx::setViewFrameBuffer(VIEW_DEBUG, _pipeline->_frame_buffer);
 	bgfx::setViewFrameBuffer(VIEW_GUI, _pipeline->_frame_buffer);
-
-	bgfx::touch(VIEW_SPRITE_0);
-	bgfx::touch(VIEW_SPRITE_1);
-	bgfx::touch(VIEW_SPRITE_2);
-	bgfx::touch(VIEW_SPRITE_3);
-	bgfx::touch(VIEW_SPRITE_4);
-	bgfx::touch(VIEW_SPRITE_5);
-	bgfx::touch(VIEW_SPRITE_6);
-	bgfx::touch(VIEW_SPRITE_7);
-	bgfx::touch(VIEW_MESH);
-	bgfx::touch(VIEW_DEBUG);
 	bgfx::touch(VIEW_GUI);
 
-	world.render(view);
+	world.render(views, projs, num);
+
+	// Meshes hidden behind the depth of this frame are culled in the next
+	// ones. The depth only matches a single camera covering the window.
+	if (num == 1 && full_window)
+		_pipeline->render_occlusion(*_shader_manager, views[0] * projs[0]);
+	else
+		_pipeline->_occlusion_buffer.reset();
 
-#if !CROWN_TOOLS
-	_pipeline->render(*_shader_manager, StringId32("blit"), 0, _width, _height);
-#endif // CROWN_TOOLS
+	_pipeline->upscale(*_shader_manager, _width, _height);
+	_pipeline->render(*_shader_manager, _width, _height);
 }
 
 World* Device::create_world()
@@ -638,9 +1446,13 @@ World* Device::create_world()
 		, *_resource_manager
 		, *_shader_manager
 		, *_material_manager
+		, *_texture_manager
 		, *_unit_manager
+		, *_unit_template_manager
 		, *_lua_environment
 		);
+	w->_render_world->set_mesh_lod_bias(_boot_config.mesh_lod_bias);
+	w->_render_world->set_occlusion_buffer(&_pipeline->_occlusion_buffer);
 	array::push_back(_worlds, w);
 	return w;
 }
@@ -671,26 +1483,154 @@ void Device::destroy_resource_package(ResourcePackage& rp)
 	CE_DELETE(default_allocator(), &rp);
 }
 
+static void push_unique(Array<StringId32>& shaders, StringId32 name)
+{
+	for (u32 i = 0; i < array::size(shaders); ++i)
+	{
+		if (shaders[i] == name)
+			return;
+	}
+
+	array::push_back(shaders, name);
+}
+
+void Device::prewarm(const ResourcePackage& rp)
+{
+	if (rp._package == NULL)
+		return;
+
+	ENTER_PROFILE_SCOPE("device.prewarm");
+
+	// The shaders of the materials and of the shader resources in the package
+	TempAllocator1024 ta;
+	Array<StringId32> shaders(ta);
+
+	for (u32 i = 0; i < array::size(rp._package->resources); ++i)
+	{
+		const PackageResource::Resource& res = rp._package->resources[i];
+		if (!_resource_manager->can_get(res.type, res.name))
+			continue;
+
+		if (res.type == RESOURCE_TYPE_MATERIAL)
+		{
+			const MaterialResource* mr = (MaterialResource*)_resource_manager->get(res.type, res.name);
+			push_unique(shaders, mr->shader);
+		}
+		else if (res.type == RESOURCE_TYPE_SHADER)
+		{
+			const ShaderResource* sr = (ShaderResource*)_resource_manager->get(res.type, res.name);
+			for (u32 j = 0; j < array::size(sr->_data); ++j)
+				push_unique(shaders, sr->_data[j].name);
+		}
+	}
+
+	_pipeline->prewarm(*_shader_manager, array::begin(shaders), array::size(shaders));
+
+	LEAVE_PROFILE_SCOPE();
+}
+
 void Device::reload(StringId64 type, StringId64 name)
 {
 	StringId64 mix;
 	mix._id = type._id ^ name._id;
 
-	TempAllocator128 ta;
-	DynamicString path(ta);
+	InlineString<32> path;
 	mix.to_string(path);
 
 	logi(DEVICE, "Reloading #ID(%s)", path.c_str());
 
+	PendingReload pr;
+	pr.type = type;
+	pr.name = name;
+	pr.handle = _resource_manager->handle(type, name);
 	_resource_manager->reload(type, name);
-	const void* new_resource = _resource_manager->get(type, name);
+	array::push_back(_reloads, pr);
+}
 
-	if (type == RESOURCE_TYPE_SCRIPT)
+void Device::complete_reloads()
+{
+	for (u32 i = 0; i < array::size(_reloads);)
 	{
-		_lua_environment->execute((const LuaResource*)new_resource);
+		const PendingReload pr = _reloads[i];
+		const ResourceHandle rh = _resource_manager->handle(pr.type, pr.name);
+
+		// The new resource replaces the old one with a new generation.
+		if (rh.index == pr.handle.index && rh.generation == pr.handle.generation)
+		{
+			++i;
+			continue;
+		}
+
+		if (pr.type == RESOURCE_TYPE_SCRIPT)
+			_lua_environment->reload(pr.name);
+
+		if (pr.type == RESOURCE_TYPE_SCRIPT && _resource_manager->is_valid(rh))
+		{
+			// Patch in place the module of the script, wherever it is held
+			Array<int> module_refs(default_allocator());
+			for (u32 j = 0; j < array::size(_worlds); ++j)
+			{
+				const int ref = script_world::module_ref(*_worlds[j]->_script_world, pr.name);
+				if (ref != LUA_NOREF)
+					array::push_back(module_refs, ref);
+			}
+
+			_lua_environment->reload_module(pr.name
+				, (const LuaResource*)_resource_manager->get(rh)
+				, array::begin(module_refs)
+				, array::size(module_refs)
+				);
+		}
+
+		if (pr.type == RESOURCE_TYPE_RENDER_GRAPH && pr.name == _boot_config.render_graph_name && _resource_manager->is_valid(rh))
+		{
+			_pipeline->destroy();
+			_pipeline->create((const RenderGraphResource*)_resource_manager->get(rh), _width, _height);
+		}
+
+		StringId64 mix;
+		mix._id = pr.type._id ^ pr.name._id;
+
+		InlineString<32> path;
+		mix.to_string(path);
+		logi(DEVICE, "Reloaded #ID(%s)", path.c_str());
+
+		_reloads[i] = array::back(_reloads);
+		array::pop_back(_reloads);
 	}
+}
 
-	logi(DEVICE, "Reloaded #ID(%s)", path.c_str());
+// Tells the clients which resources fell back because their data is
+// missing, so that a data compiler can compile them first.
+void Device::report_missing()
+{
+	Array<ResourceLoader::MissingResource> missing(default_allocator());
+	_resource_loader->get_missing(missing);
+	if (array::size(missing) == 0)
+		return;
+
+	TempAllocator1024 ta;
+	StringStream ss(ta);
+	ss << "{\"type\":\"missing_resources\",\"resources\":[";
+	for (u32 i = 0; i < array::size(missing); ++i)
+	{
+		InlineString<32> type;
+		InlineString<32> name;
+		missing[i].type.to_string(type);
+		missing[i].name.to_string(name);
+
+		ss << (i == 0 ? "" : ",");
+		ss << "{\"type\":\"" << type.c_str() << "\",\"name\":\"" << name.c_str() << "\"}";
+	}
+	ss << "]}";
+
+	_console_server->send(string_stream::c_str(ss));
+}
+
+u32 Device::bgfx_allocated()
+{
+	const u32 size = _bgfx_allocator->_allocator.total_allocated();
+	return size != Allocator::SIZE_NOT_TRACKED ? size : 0;
 }
 
 void Device::log(const char* msg)
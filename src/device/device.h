@@ -17,7 +17,10 @@
 #include "device/device_options.h"
 #include "device/display.h"
 #include "device/input_types.h"
+#include "device/perf_overlay.h"
 #include "device/pipeline.h"
+#include "device/profiler_stream.h"
+#include "device/scene_benchmark.h"
 #include "device/window.h"
 #include "lua/types.h"
 #include "resource/types.h"
@@ -29,6 +32,8 @@ namespace crown
 {
 struct BgfxAllocator;
 struct BgfxCallback;
+struct Replay;
+struct ScreenCapture;
 
 /// This is the place where to look for accessing all of
 /// the engine subsystems and related stuff.
@@ -47,23 +52,64 @@ struct Device
 	ResourceManager* _resource_manager;
 	BgfxAllocator* _bgfx_allocator;
 	BgfxCallback* _bgfx_callback;
+	ScreenCapture* _screen_capture;
 	ShaderManager* _shader_manager;
 	MaterialManager* _material_manager;
+	UnitTemplateManager* _unit_template_manager;
+	TextureManager* _texture_manager;
 	InputManager* _input_manager;
 	UnitManager* _unit_manager;
 	LuaEnvironment* _lua_environment;
 	Pipeline* _pipeline;
 	Display* _display;
 	Window* _window;
+	Replay* _replay;
+	File* _replay_file;
+	File* _replay_profile;
+	File* _profile_trace;
+	SceneBenchmark* _scene_benchmark;
 	Array<World*> _worlds;
 
+	struct PendingReload
+	{
+		StringId64 type;
+		StringId64 name;
+		ResourceHandle handle;
+	};
+
+	Array<PendingReload> _reloads;
+
 	u16 _width;
 	u16 _height;
 
+	f64 _tick_accumulator;
+	f32 _interpolation_alpha; ///< Position of the frame between the last two ticks.
+
 	bool _quit;
 	bool _paused;
-
-	bool process_events(bool vsync);
+	bool _profiler_streaming;
+	bool _render_stats_streaming;
+	PerfOverlay _perf_overlay;
+
+	// Binary profiler stream and history.
+	ProfilerEncoder _profiler_encoder;
+	ProfilerHistory _profiler_history;
+	bool _profiler_binary;
+	u32 _profiler_decimation; ///< Send one frame every _profiler_decimation.
+	u32 _profiler_frame;
+	u32 _profiler_dropped;    ///< Frames not sent since the last one.
+	f64 _profiler_budget;     ///< Bytes that can still be sent, negative when over budget.
+	f32 _profiler_spike;      ///< Frame time in seconds above which the history is sent, 0 to disable.
+	s64 _profiler_last_dump;
+
+	void profiler_update(f32 dt);
+	void profiler_dump_history(TCPSocket* client);
+
+	bool process_events();
+	void complete_reloads();
+	void report_missing();
+	void replay_init();
+	void replay_shutdown();
 
 	///
 	Device(const DeviceOptions& opts, ConsoleServer& cs);
@@ -94,6 +140,10 @@ struct Device
 	/// Renders @a world using @a camera.
 	void render(World& world, UnitId camera_unit);
 
+	/// Renders @a world using @a num @a cameras in the same frame, each
+	/// into its own viewport. See World::camera_set_viewport().
+	void render(World& world, const UnitId* cameras, u32 num);
+
 	/// Creates a new world.
 	World* create_world();
 
@@ -109,9 +159,20 @@ struct Device
 	/// You have to call ResourcePackage::unload() before destroying a package.
 	void destroy_resource_package(ResourcePackage& rp);
 
+	/// Issues a draw with each shader used by the resources in the
+	/// package @a rp, so that drivers compiling them at first use do it
+	/// now instead of during gameplay. Call it after the package has been
+	/// flushed.
+	void prewarm(const ResourcePackage& rp);
+
 	/// Reloads the resource @a type @a name.
+	/// The resource is reloaded in the background and swapped with the
+	/// old one at the beginning of a subsequent frame.
 	void reload(StringId64 type, StringId64 name);
 
+	/// Returns the bytes of CPU memory allocated by bgfx.
+	u32 bgfx_allocated();
+
 	/// Logs @a msg to log file and console.
 	void log(const char* msg);
 };
@@ -5,7 +5,10 @@
 
 #pragma once
 
+#include "core/os.h"
 #include "core/thread/atomic_int.h"
+#include "core/thread/condition_variable.h"
+#include "core/thread/mutex.h"
 #include "core/types.h"
 
 namespace crown
@@ -80,12 +83,16 @@ union OsEvent
 
 /// Single Producer Single Consumer event queue.
 /// Used only to pass events from os thread to main thread.
+/// Each event is stamped with the os::clocktime() at which it is pushed.
 struct DeviceEventQueue
 {
 	AtomicInt _tail;
 	AtomicInt _head;
-#define MAX_OS_EVENTS 128
+#define MAX_OS_EVENTS 1024
 	OsEvent _queue[MAX_OS_EVENTS];
+	s64 _time[MAX_OS_EVENTS];
+	Mutex _mutex;
+	ConditionVariable _pushed;
 
 	DeviceEventQueue()
 		: _tail(0)
@@ -148,6 +155,22 @@ struct DeviceEventQueue
 		push_event(ev);
 	}
 
+	void push_pause_event()
+	{
+		OsEvent ev;
+		ev.type = OsEventType::PAUSE;
+
+		push_event(ev);
+	}
+
+	void push_resume_event()
+	{
+		OsEvent ev;
+		ev.type = OsEventType::RESUME;
+
+		push_event(ev);
+	}
+
 	void push_text_event(u8 len, u8 utf8[4])
 	{
 		OsEvent ev;
@@ -174,14 +197,27 @@ struct DeviceEventQueue
 		if (tail_next != _head.load())
 		{
 			_queue[tail] = ev;
+			_time[tail] = os::clocktime();
 			_tail.store(tail_next);
+
+			ScopedMutex sm(_mutex);
+			_pushed.signal();
 			return true;
 		}
 
 		return false;
 	}
 
-	bool pop_event(OsEvent& ev)
+	/// Blocks until an event is pushed, or for at most @a ms milliseconds.
+	/// Returns immediately if events are waiting to be popped.
+	void wait_event(u32 ms)
+	{
+		ScopedMutex sm(_mutex);
+		if (_head.load() == _tail.load())
+			_pushed.wait(_mutex, ms);
+	}
+
+	bool pop_event(OsEvent& ev, s64& time)
 	{
 		const int head = _head.load();
 
@@ -189,6 +225,7 @@ struct DeviceEventQueue
 			return false;
 
 		ev = _queue[head];
+		time = _time[head];
 		_head.store((head + 1) % MAX_OS_EVENTS);
 
 		return true;
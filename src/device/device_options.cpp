@@ -33,11 +33,26 @@ static void help(const char* msg = NULL)
 		"      linux\n"
 		"      windows\n"
 		"      android\n"
+		"  --compile-cache <path>          Share compiled resources through the cache in <path>.\n"
 		"  --continue                      Run the engine after resource compilation.\n"
 		"  --console-port <port>           Set port of the console.\n"
 		"  --wait-console                  Wait for a console connection before starting up.\n"
 		"  --parent-window <handle>        Set the parent window <handle> of the main window.\n"
 		"  --server                        Run the engine in server mode.\n"
+		"  --headless                      Run the engine without a window and without rendering.\n"
+		"  --loader-threads <count>        Use <count> threads to load resources.\n"
+		"  --job-workers <count>           Use <count> worker threads to run jobs.\n"
+		"  -j, --jobs <count>              Use <count> threads to compile resources.\n"
+		"  --record <path>                 Record input, frame times and console commands to <path>.\n"
+		"  --replay <path>                 Play back the frames recorded to <path>.\n"
+		"  --replay-profile <path>         Write the profiler data of each replayed frame to <path>.\n"
+		"  --profile-trace <path>          Write the profiler events to <path> in Chrome's trace format.\n"
+		"  --benchmark-scene <path>        Run the game at a fixed step and write the frame timings to <path>.\n"
+		"  --benchmark-frames <count>      Measure <count> frames with --benchmark-scene.\n"
+		"  --track-memory                  Track allocations and log the leaks at exit.\n"
+		"  --huge-pages                    Back large allocations with huge pages.\n"
+		"  --async-log                     Write the log messages from a separate thread.\n"
+		"  --render-thread                 Run the renderer backend on the thread that owns the window.\n"
 		"\n"
 		"Complete documentation available at https://dbartolini.github.io/crown/html/v" CROWN_VERSION "\n"
 	);
@@ -55,12 +70,27 @@ DeviceOptions::DeviceOptions(Allocator& a, int argc, const char** argv)
 	, _data_dir(a)
 	, _boot_dir(NULL)
 	, _platform(NULL)
+	, _compile_cache_dir(NULL)
 	, _lua_string(a)
+	, _record_path(NULL)
+	, _replay_path(NULL)
+	, _replay_profile_path(NULL)
+	, _profile_trace_path(NULL)
+	, _benchmark_scene_path(NULL)
 	, _wait_console(false)
 	, _do_compile(false)
 	, _do_continue(false)
 	, _server(false)
+	, _headless(false)
+	, _track_memory(false)
+	, _huge_pages(false)
+	, _async_log(false)
+	, _render_thread(false)
 	, _parent_window(0)
+	, _loader_threads(CROWN_DEFAULT_RESOURCE_LOADER_THREADS)
+	, _job_workers(CROWN_DEFAULT_JOB_WORKERS)
+	, _compiler_threads(CROWN_DEFAULT_COMPILER_THREADS)
+	, _benchmark_frames(CROWN_DEFAULT_BENCHMARK_FRAMES)
 	, _console_port(CROWN_DEFAULT_CONSOLE_PORT)
 	, _window_x(0)
 	, _window_y(0)
@@ -134,6 +164,16 @@ int DeviceOptions::parse(bool* quit)
 		}
 	}
 
+	_compile_cache_dir = cl.get_parameter(0, "compile-cache");
+	if (_compile_cache_dir)
+	{
+		if (!path::is_absolute(_compile_cache_dir))
+		{
+			help("Compile cache dir must be absolute.");
+			return EXIT_FAILURE;
+		}
+	}
+
 	_server = cl.has_option("server");
 	if (_server)
 	{
@@ -173,6 +213,8 @@ int DeviceOptions::parse(bool* quit)
 
 	_do_continue = cl.has_option("continue");
 
+	_headless = cl.has_option("headless");
+
 	_boot_dir = cl.get_parameter(0, "boot-dir");
 	if (_boot_dir)
 	{
@@ -205,6 +247,77 @@ int DeviceOptions::parse(bool* quit)
 		}
 	}
 
+	const char* lt = cl.get_parameter(0, "loader-threads");
+	if (lt)
+	{
+		if (sscanf(lt, "%u", &_loader_threads) != 1
+			|| _loader_threads == 0
+			|| _loader_threads > CROWN_MAX_RESOURCE_LOADER_THREADS
+			)
+		{
+			help("Number of loader threads is invalid.");
+			return EXIT_FAILURE;
+		}
+	}
+
+	const char* jw = cl.get_parameter(0, "job-workers");
+	if (jw)
+	{
+		if (sscanf(jw, "%u", &_job_workers) != 1
+			|| _job_workers > CROWN_MAX_JOB_WORKERS
+			)
+		{
+			help("Number of job workers is invalid.");
+			return EXIT_FAILURE;
+		}
+	}
+
+	const char* jobs = cl.get_parameter(0, "jobs", 'j');
+	if (jobs)
+	{
+		if (sscanf(jobs, "%u", &_compiler_threads) != 1
+			|| _compiler_threads == 0
+			|| _compiler_threads > CROWN_MAX_COMPILER_THREADS
+			)
+		{
+			help("Number of jobs is invalid.");
+			return EXIT_FAILURE;
+		}
+	}
+
+	_record_path = cl.get_parameter(0, "record");
+	_replay_path = cl.get_parameter(0, "replay");
+	if (_record_path && _replay_path)
+	{
+		help("Cannot record and replay at the same time.");
+		return EXIT_FAILURE;
+	}
+
+	_replay_profile_path = cl.get_parameter(0, "replay-profile");
+	if (_replay_profile_path && !_replay_path)
+	{
+		help("Replay profile requires a replay.");
+		return EXIT_FAILURE;
+	}
+
+	_profile_trace_path = cl.get_parameter(0, "profile-trace");
+
+	_benchmark_scene_path = cl.get_parameter(0, "benchmark-scene");
+	const char* bf = cl.get_parameter(0, "benchmark-frames");
+	if (bf)
+	{
+		if (sscanf(bf, "%u", &_benchmark_frames) != 1 || _benchmark_frames == 0)
+		{
+			help("Number of benchmark frames is invalid.");
+			return EXIT_FAILURE;
+		}
+	}
+
+	_track_memory = cl.has_option("track-memory");
+	_huge_pages = cl.has_option("huge-pages");
+	_async_log = cl.has_option("async-log");
+	_render_thread = cl.has_option("render-thread");
+
 	const char* ls = cl.get_parameter(0, "lua-string");
 	if (ls)
 		_lua_string = ls;
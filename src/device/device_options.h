@@ -24,12 +24,27 @@ struct DeviceOptions
 	DynamicString _data_dir;
 	const char* _boot_dir;
 	const char* _platform;
+	const char* _compile_cache_dir;
 	DynamicString _lua_string;
+	const char* _record_path;
+	const char* _replay_path;
+	const char* _replay_profile_path;
+	const char* _profile_trace_path;
+	const char* _benchmark_scene_path;
 	bool _wait_console;
 	bool _do_compile;
 	bool _do_continue;
 	bool _server;
+	bool _headless;
+	bool _track_memory;
+	bool _huge_pages;
+	bool _async_log;
+	bool _render_thread;
 	u32 _parent_window;
+	u32 _loader_threads;
+	u32 _job_workers;
+	u32 _compiler_threads;
+	u32 _benchmark_frames;
 	u16 _console_port;
 	u16 _window_x;
 	u16 _window_y;
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/os.h"
+#include "device/frame_pacer.h"
+#include "device/profiler.h"
+#include <string.h> // memset
+
+namespace crown
+{
+FramePacer::FramePacer(u32 frame_rate, bool late_input)
+	: _frequency((f64)os::clockfrequency())
+	, _period(frame_rate > 0 ? s64(_frequency / frame_rate) : 0)
+	, _late_input(late_input)
+	, _frame_start(0)
+	, _work(0)
+	, _work_average(0.0)
+	, _frame_average(0.0)
+	, _num_frames(0)
+{
+	memset(_histogram, 0, sizeof(_histogram));
+}
+
+void FramePacer::begin_frame(s64 time)
+{
+	if (_frame_start != 0)
+	{
+		const f64 frame = f64(time - _frame_start);
+		_frame_average = _num_frames == 0 ? frame : _frame_average + (frame - _frame_average) * CROWN_FRAME_PACING_SMOOTHING;
+
+		u32 bucket = u32(frame * 1000.0 / _frequency);
+		if (bucket >= CROWN_FRAME_TIME_HISTOGRAM_SIZE)
+			bucket = CROWN_FRAME_TIME_HISTOGRAM_SIZE - 1;
+		++_histogram[bucket];
+		++_num_frames;
+	}
+
+	_frame_start = time;
+}
+
+void FramePacer::end_frame()
+{
+	_work = os::clocktime() - _frame_start;
+	_work_average = _work_average == 0.0 ? f64(_work) : _work_average + (f64(_work) - _work_average) * CROWN_FRAME_PACING_SMOOTHING;
+}
+
+void FramePacer::wait()
+{
+	const s64 now = os::clocktime();
+	s64 deadline = _frame_start + _period;
+
+	if (_late_input)
+	{
+		// Start the next frame as late as possible for it to be submitted
+		// within one period from now. Without a frame rate limit, the
+		// period is the one measured, which is the one of the display when
+		// vsync is enabled.
+		const f64 period = _period > 0 ? f64(_period) : _frame_average;
+		const f64 margin = CROWN_FRAME_PACING_LATE_MARGIN * _frequency / 1000.0;
+		const f64 work = _work_average > f64(_work) ? _work_average : f64(_work);
+		const s64 late = now + s64(period - work - margin);
+		if (late > deadline)
+			deadline = late;
+	}
+
+	const s64 spin = s64(CROWN_FRAME_PACING_SPIN * _frequency / 1000.0);
+	if (deadline - spin > now)
+		os::sleep(u32(f64(deadline - spin - now) * 1000.0 / _frequency));
+
+	while (os::clocktime() < deadline)
+		;
+}
+
+f32 FramePacer::percentile(f32 percentile) const
+{
+	const u32 target = u32(f64(_num_frames) * percentile / 100.0);
+
+	u32 num = 0;
+	for (u32 i = 0; i < CROWN_FRAME_TIME_HISTOGRAM_SIZE; ++i)
+	{
+		num += _histogram[i];
+		if (num > target)
+			return f32(i + 1);
+	}
+
+	return f32(CROWN_FRAME_TIME_HISTOGRAM_SIZE);
+}
+
+void FramePacer::record() const
+{
+	if (_num_frames == 0)
+		return;
+
+	RECORD_FLOAT("device.frame_time_p50", percentile(50.0f));
+	RECORD_FLOAT("device.frame_time_p99", percentile(99.0f));
+	RECORD_FLOAT("device.input_to_submit", f32(f64(_work) * 1000.0 / _frequency));
+}
+
+} // namespace crown
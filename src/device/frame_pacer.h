@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Limits the frame rate and delays the start of the frames to reduce
+/// the latency between input and display.
+/// Keeps a histogram of the frame times, which never grows no matter how
+/// many frames are run.
+///
+/// @ingroup Device
+struct FramePacer
+{
+	f64 _frequency;
+	s64 _period;          ///< Minimum duration of a frame, 0 if unlimited.
+	bool _late_input;
+	s64 _frame_start;     ///< Time at which the current frame started.
+	s64 _work;            ///< Time spent by the current frame before submitting.
+	f64 _work_average;    ///< Moving average of _work.
+	f64 _frame_average;   ///< Moving average of the duration of the frames.
+	u32 _histogram[CROWN_FRAME_TIME_HISTOGRAM_SIZE]; ///< Number of frames by duration in milliseconds, the last bucket holds the longer ones.
+	u32 _num_frames;
+
+	/// Limits the frames to @a frame_rate per second, or not at all if
+	/// @a frame_rate is 0. If @a late_input is true, wait() delays the start
+	/// of the next frame so that it is submitted right before the display
+	/// needs it.
+	FramePacer(u32 frame_rate, bool late_input);
+
+	/// Starts a new frame at @a time. Call right before sampling the input.
+	void begin_frame(s64 time);
+
+	/// Marks the end of the work of the current frame. Call right before
+	/// submitting it to the renderer.
+	void end_frame();
+
+	/// Waits for the next frame to start. Call right after submitting the
+	/// current frame to the renderer. Sleeps for the most part and spins
+	/// for the last CROWN_FRAME_PACING_SPIN milliseconds.
+	void wait();
+
+	/// Returns the duration in milliseconds under which fall @a percentile
+	/// percent of the frames run so far.
+	f32 percentile(f32 percentile) const;
+
+	/// Records the frame time percentiles to the profiler.
+	void record() const;
+};
+
+} // namespace crown
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/error/error.h"
+#include "core/thread/atomic.h"
+#include "device/gpu_memory.h"
+#include "device/profiler.h"
+
+namespace crown
+{
+namespace gpu_memory_globals
+{
+	static const char* s_names[] =
+	{
+		"texture",
+		"mesh",
+		"shader",
+		"render_target"
+	};
+	CE_STATIC_ASSERT(countof(s_names) == GpuMemoryCategory::COUNT);
+
+	static const char* s_record_names[] =
+	{
+		"gpu_memory.texture",
+		"gpu_memory.mesh",
+		"gpu_memory.shader",
+		"gpu_memory.render_target"
+	};
+	CE_STATIC_ASSERT(countof(s_record_names) == GpuMemoryCategory::COUNT);
+
+	static AtomicU64 s_allocated[GpuMemoryCategory::COUNT];
+	static AtomicU64 s_peak[GpuMemoryCategory::COUNT];
+
+} // namespace gpu_memory_globals
+
+namespace gpu_memory
+{
+	void allocate(GpuMemoryCategory::Enum category, u64 size)
+	{
+		CE_ASSERT(category < GpuMemoryCategory::COUNT, "Index out of bounds");
+		AtomicU64& peak = gpu_memory_globals::s_peak[category];
+
+		const u64 allocated = gpu_memory_globals::s_allocated[category].fetch_add(size, MemoryOrder::RELAXED) + size;
+		u64 cur_peak = peak.load(MemoryOrder::RELAXED);
+		while (allocated > cur_peak && !peak.compare_exchange(cur_peak, allocated, MemoryOrder::RELAXED))
+		{
+		}
+	}
+
+	void deallocate(GpuMemoryCategory::Enum category, u64 size)
+	{
+		CE_ASSERT(category < GpuMemoryCategory::COUNT, "Index out of bounds");
+		const u64 allocated = gpu_memory_globals::s_allocated[category].fetch_sub(size, MemoryOrder::RELAXED);
+		CE_ASSERT(allocated >= size, "Deallocating more than allocated");
+		CE_UNUSED(allocated);
+	}
+
+	u64 allocated(GpuMemoryCategory::Enum category)
+	{
+		CE_ASSERT(category < GpuMemoryCategory::COUNT, "Index out of bounds");
+		return gpu_memory_globals::s_allocated[category].load(MemoryOrder::RELAXED);
+	}
+
+	u64 peak(GpuMemoryCategory::Enum category)
+	{
+		CE_ASSERT(category < GpuMemoryCategory::COUNT, "Index out of bounds");
+		return gpu_memory_globals::s_peak[category].load(MemoryOrder::RELAXED);
+	}
+
+	u64 total_allocated()
+	{
+		u64 total = 0;
+		for (u32 i = 0; i < GpuMemoryCategory::COUNT; ++i)
+			total += allocated(GpuMemoryCategory::Enum(i));
+		return total;
+	}
+
+	const char* name(GpuMemoryCategory::Enum category)
+	{
+		CE_ASSERT(category < GpuMemoryCategory::COUNT, "Index out of bounds");
+		return gpu_memory_globals::s_names[category];
+	}
+
+	void record_stats()
+	{
+		for (u32 i = 0; i < GpuMemoryCategory::COUNT; ++i)
+			RECORD_FLOAT(gpu_memory_globals::s_record_names[i], f32(f64(allocated(GpuMemoryCategory::Enum(i))) / (1024.0*1024.0)));
+		RECORD_FLOAT("gpu_memory.total", f32(f64(total_allocated()) / (1024.0*1024.0)));
+	}
+
+} // namespace gpu_memory
+
+} // namespace crown
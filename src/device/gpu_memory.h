@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Enumerates the kinds of GPU memory accounted by gpu_memory.
+///
+/// @ingroup Device
+struct GpuMemoryCategory
+{
+	enum Enum
+	{
+		TEXTURE,       ///< Resident mip levels of the texture resources.
+		MESH,          ///< Vertex and index buffers of the mesh resources.
+		SHADER,        ///< Shader binaries of the shader resources.
+		RENDER_TARGET, ///< Targets created by the Pipeline.
+
+		COUNT
+	};
+};
+
+/// Estimates of the GPU memory used by the renderer.
+///
+/// bgfx does not tell how much memory the driver allocates for each
+/// object, so the sizes are computed from the data and the formats of the
+/// objects when they are created and destroyed.
+///
+/// @ingroup Device
+namespace gpu_memory
+{
+	/// Adds @a size bytes to @a category.
+	void allocate(GpuMemoryCategory::Enum category, u64 size);
+
+	/// Removes @a size bytes from @a category.
+	void deallocate(GpuMemoryCategory::Enum category, u64 size);
+
+	/// Returns the bytes currently in @a category.
+	u64 allocated(GpuMemoryCategory::Enum category);
+
+	/// Returns the most bytes ever in @a category at once.
+	u64 peak(GpuMemoryCategory::Enum category);
+
+	/// Returns the bytes in all the categories.
+	u64 total_allocated();
+
+	/// Returns the name of @a category.
+	const char* name(GpuMemoryCategory::Enum category);
+
+	/// Records the size of each category, in megabytes, to the profiler
+	/// as gpu_memory.<name>.
+	void record_stats();
+
+} // namespace gpu_memory
+
+} // namespace crown
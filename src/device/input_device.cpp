@@ -38,7 +38,7 @@ u8 InputDevice::num_axes() const
 bool InputDevice::pressed(u8 id) const
 {
 	return id < _num_buttons
-		? (~_last_state[id] & _state[id]) != 0
+		? (_edges[id] & PRESSED) != 0
 		: false
 		;
 }
@@ -46,7 +46,7 @@ bool InputDevice::pressed(u8 id) const
 bool InputDevice::released(u8 id) const
 {
 	return id < _num_buttons
-		? (_last_state[id] & ~_state[id]) != 0
+		? (_edges[id] & RELEASED) != 0
 		: false
 		;
 }
@@ -174,6 +174,8 @@ void InputDevice::set_button(u8 id, bool state)
 {
 	CE_ASSERT(id < _num_buttons, "Index out of bounds");
 	_last_button = id;
+	if (_state[id] != state)
+		_edges[id] |= state ? PRESSED : RELEASED;
 	_state[id] = state;
 }
 
@@ -188,6 +190,7 @@ void InputDevice::set_axis(u8 id, f32 x, f32 y, f32 z)
 void InputDevice::update()
 {
 	memcpy(_last_state, _state, sizeof(u8)*_num_buttons);
+	memset(_edges, 0, sizeof(u8)*_num_buttons);
 }
 
 namespace input_device
@@ -196,7 +199,7 @@ namespace input_device
 	{
 		const u32 size = 0
 			+ sizeof(InputDevice) + alignof(InputDevice)
-			+ sizeof(u8)*num_buttons*2 + alignof(u8)
+			+ sizeof(u8)*num_buttons*3 + alignof(u8)
 			+ sizeof(Vector3)*num_axes + alignof(Vector3)
 			+ sizeof(u32)*num_axes + alignof(u32)
 			+ sizeof(f32)*num_axes + alignof(f32)
@@ -216,7 +219,8 @@ namespace input_device
 
 		id->_last_state    = (u8*         )&id[1];
 		id->_state         = (u8*         )memory::align_top(id->_last_state + num_buttons,  alignof(u8         ));
-		id->_axis          = (Vector3*    )memory::align_top(id->_state + num_buttons,       alignof(Vector3    ));
+		id->_edges         = (u8*         )memory::align_top(id->_state + num_buttons,       alignof(u8         ));
+		id->_axis          = (Vector3*    )memory::align_top(id->_edges + num_buttons,       alignof(Vector3    ));
 		id->_deadzone_mode = (u32*        )memory::align_top(id->_axis + num_axes,           alignof(u32        ));
 		id->_deadzone_size = (f32*        )memory::align_top(id->_deadzone_mode + num_axes,  alignof(f32        ));
 		id->_button_hash   = (StringId32* )memory::align_top(id->_deadzone_size + num_axes,  alignof(StringId32 ));
@@ -225,6 +229,7 @@ namespace input_device
 
 		memset(id->_last_state, 0, sizeof(u8)*num_buttons);
 		memset(id->_state, 0, sizeof(u8)*num_buttons);
+		memset(id->_edges, 0, sizeof(u8)*num_buttons);
 		memset(id->_axis, 0, sizeof(Vector3)*num_axes);
 		memset(id->_deadzone_mode, 0, sizeof(*id->_deadzone_mode)*num_axes);
 		memset(id->_deadzone_size, 0, sizeof(*id->_deadzone_size)*num_axes);
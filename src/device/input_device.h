@@ -18,6 +18,12 @@ namespace crown
 /// @ingroup Input
 struct InputDevice
 {
+	enum
+	{
+		PRESSED  = 1 << 0,
+		RELEASED = 1 << 1
+	};
+
 	bool _connected;
 	u8 _num_buttons;
 	u8 _num_axes;
@@ -27,6 +33,7 @@ struct InputDevice
 
 	u8* _last_state;          // num_buttons
 	u8* _state;               // num_buttons
+	u8* _edges;               // num_buttons, combination of PRESSED and RELEASED since the last update().
 	Vector3* _axis;           // num_axes
 	u32* _deadzone_mode;      // num_axes
 	f32* _deadzone_size;      // num_axes
@@ -51,6 +58,8 @@ struct InputDevice
 	u8 num_axes() const;
 
 	/// Returns whether the button @a id is pressed in the current frame.
+	/// A button pressed and released within the same frame is both pressed
+	/// and released.
 	bool pressed(u8 id) const;
 
 	/// Returns whether the button @a id is released in the current frame.
@@ -3,6 +3,7 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
 #include "core/math/vector3.h"
 #include "core/memory/memory.h"
 #include "device/input_device.h"
@@ -176,6 +177,7 @@ InputManager::InputManager(Allocator& a)
 	, _touch(NULL)
 	, _mouse_last_x(0)
 	, _mouse_last_y(0)
+	, _events(a)
 {
 	_keyboard = input_device::create(*_allocator
 		, "Keyboard"
@@ -255,8 +257,16 @@ InputDevice* InputManager::joypad(u8 i)
 	return _joypad[i];
 }
 
-void InputManager::read(const OsEvent& event)
+void InputManager::read(const OsEvent& event, s64 time)
 {
+	InputEvent ie;
+	ie.device = NULL;
+	ie.time = time;
+	ie.type = event.type;
+	ie.id = 0;
+	ie.pressed = false;
+	ie.value = VECTOR3_ZERO;
+
 	switch (event.type)
 	{
 	case OsEventType::BUTTON:
@@ -265,21 +275,27 @@ void InputManager::read(const OsEvent& event)
 			switch (ev.device_id)
 			{
 			case InputDeviceType::KEYBOARD:
-				_keyboard->set_button(ev.button_num, ev.pressed);
+				ie.device = _keyboard;
 				break;
 
 			case InputDeviceType::MOUSE:
-				_mouse->set_button(ev.button_num, ev.pressed);
+				ie.device = _mouse;
 				break;
 
 			case InputDeviceType::TOUCHSCREEN:
-				_touch->set_button(ev.button_num, ev.pressed);
+				ie.device = _touch;
 				break;
 
 			case InputDeviceType::JOYPAD:
-				_joypad[ev.device_num]->set_button(ev.button_num, ev.pressed);
+				ie.device = _joypad[ev.device_num];
 				break;
 			}
+
+			ie.id = ev.button_num;
+			ie.pressed = ev.pressed;
+
+			if (ie.device != NULL)
+				ie.device->set_button(ie.id, ie.pressed);
 		}
 		break;
 
@@ -289,17 +305,23 @@ void InputManager::read(const OsEvent& event)
 			switch (ev.device_id)
 			{
 			case InputDeviceType::MOUSE:
-				_mouse->set_axis(ev.axis_num, ev.axis_x, ev.axis_y, ev.axis_z);
+				ie.device = _mouse;
+				ie.value = vector3(ev.axis_x, ev.axis_y, ev.axis_z);
 				break;
 
 			case InputDeviceType::JOYPAD:
-				_joypad[ev.device_num]->set_axis(ev.axis_num
-					, (f32)ev.axis_x / (f32)INT16_MAX
+				ie.device = _joypad[ev.device_num];
+				ie.value = vector3((f32)ev.axis_x / (f32)INT16_MAX
 					, (f32)ev.axis_y / (f32)INT16_MAX
 					, (f32)ev.axis_z / (f32)INT16_MAX
 					);
 				break;
 			}
+
+			ie.id = ev.axis_num;
+
+			if (ie.device != NULL)
+				ie.device->set_axis(ie.id, ie.value.x, ie.value.y, ie.value.z);
 		}
 		break;
 
@@ -319,6 +341,15 @@ void InputManager::read(const OsEvent& event)
 		CE_FATAL("Unknown input event type");
 		break;
 	}
+
+	if (ie.device != NULL)
+		array::push_back(_events, ie);
+}
+
+void InputManager::events(const InputEvent** events, u32* num) const
+{
+	*events = array::begin(_events);
+	*num = array::size(_events);
 }
 
 void InputManager::update()
@@ -339,6 +370,8 @@ void InputManager::update()
 
 	for (u8 i = 0; i < CROWN_MAX_JOYPADS; ++i)
 		_joypad[i]->update();
+
+	array::clear(_events);
 }
 
 } // namespace crown
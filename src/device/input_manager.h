@@ -6,6 +6,8 @@
 #pragma once
 
 #include "config.h"
+#include "core/containers/types.h"
+#include "core/math/types.h"
 #include "core/memory/types.h"
 #include "core/types.h"
 #include "device/device_event_queue.h"
@@ -13,6 +15,19 @@
 
 namespace crown
 {
+/// Button or axis event received by an input device.
+///
+/// @ingroup Input
+struct InputEvent
+{
+	InputDevice* device;
+	s64 time;      ///< Time at which the event has been received, see os::clocktime().
+	u16 type;      ///< OsEventType::BUTTON or OsEventType::AXIS.
+	u8 id;         ///< Id of the button or of the axis.
+	bool pressed;  ///< Whether the button has been pressed.
+	Vector3 value; ///< Value of the axis.
+};
+
 /// Manages input devices.
 ///
 /// @ingroup Input
@@ -25,6 +40,7 @@ struct InputManager
 	InputDevice* _joypad[CROWN_MAX_JOYPADS];
 	s16 _mouse_last_x;
 	s16 _mouse_last_y;
+	Array<InputEvent> _events; ///< Events received since the last update(), oldest first.
 
 	/// Constructor.
 	InputManager(Allocator& a);
@@ -47,10 +63,14 @@ struct InputManager
 	/// Returns the joypad @a i.
 	InputDevice* joypad(u8 i);
 
-	///
-	void read(const OsEvent& ev);
+	/// Reads the input event @a ev received at @a time.
+	void read(const OsEvent& ev, s64 time);
+
+	/// Returns the number of the events received by the devices
+	/// since the last update() and stores them in @a events.
+	void events(const InputEvent** events, u32* num) const;
 
-	/// Updates the input devices.
+	/// Updates the input devices and discards the events received so far.
 	void update();
 };
 
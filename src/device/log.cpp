@@ -3,30 +3,50 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
+#include "core/containers/mpmc_queue.h"
+#include "core/memory/memory.h"
 #include "core/memory/temp_allocator.h"
 #include "core/os.h"
 #include "core/platform.h"
 #include "core/strings/string.h"
 #include "core/strings/string_stream.h"
+#include "core/thread/atomic.h"
 #include "core/thread/mutex.h"
+#include "core/thread/semaphore.h"
+#include "core/thread/thread.h"
 #include "device/console_server.h"
 #include "device/device.h"
 #include "device/log.h"
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy
 
 namespace crown
 {
 namespace log_internal
 {
-	static Mutex s_mutex;
+	struct Entry
+	{
+		LogSeverity::Enum sev;
+		System system;
+		char* long_msg; ///< Message if it does not fit in msg, allocated with malloc().
+		char msg[CROWN_LOG_ENTRY_SIZE];
+	};
 
-	void vlogx(LogSeverity::Enum sev, System system, const char* msg, va_list args)
+	static Mutex s_mutex;
+	static MpmcQueue<Entry>* s_queue = NULL;
+	static Thread s_thread;
+	static Semaphore s_sem;
+	static AtomicU32 s_async(0);   ///< Whether the messages go to s_queue.
+	static AtomicU32 s_pushing(0); ///< Number of threads pushing to s_queue.
+	static AtomicU32 s_dropped(0); ///< Number of messages dropped because s_queue was full.
+	static AtomicU32 s_exit(0);
+
+	// Writes @a buf to all the sinks.
+	static void write(LogSeverity::Enum sev, System system, const char* buf)
 	{
 		ScopedMutex sm(s_mutex);
 
-		char buf[8192];
-		int len = vsnprintf(buf, sizeof(buf), msg, args);
-		buf[len] = '\0';
-
 #if CROWN_PLATFORM_POSIX
 		#define ANSI_RESET  "\x1b[0m"
 		#define ANSI_YELLOW "\x1b[33m"
@@ -83,6 +103,95 @@ namespace log_internal
 			device()->log(buf);
 	}
 
+	// Pushes the message to the queue of the logger thread.
+	// Returns false if the messages must be written synchronously.
+	static bool push(LogSeverity::Enum sev, System system, const char* buf, u32 len)
+	{
+		if (sev == LogSeverity::LOG_ERROR)
+			return false;
+
+		// stop_async() waits for s_pushing to drop to zero before it
+		// destroys s_queue.
+		s_pushing.fetch_add(1, MemoryOrder::SEQ_CST);
+		if (s_async.load(MemoryOrder::SEQ_CST) == 0)
+		{
+			s_pushing.fetch_sub(1, MemoryOrder::RELEASE);
+			return false;
+		}
+
+		Entry e;
+		e.sev = sev;
+		e.system = system;
+		e.long_msg = NULL;
+		if (len < sizeof(e.msg))
+		{
+			memcpy(e.msg, buf, len + 1);
+		}
+		else
+		{
+			// Not from default_allocator(): the allocators log too.
+			e.long_msg = (char*)malloc(len + 1);
+			memcpy(e.long_msg, buf, len + 1);
+		}
+
+		if (s_queue->push(e))
+		{
+			s_sem.post();
+		}
+		else
+		{
+			free(e.long_msg);
+			s_dropped.fetch_add(1, MemoryOrder::RELAXED);
+		}
+
+		s_pushing.fetch_sub(1, MemoryOrder::RELEASE);
+		return true;
+	}
+
+	// Writes all the messages in the queue.
+	static void drain()
+	{
+		Entry e;
+		while (s_queue->pop(e))
+		{
+			write(e.sev, e.system, e.long_msg != NULL ? e.long_msg : e.msg);
+			free(e.long_msg);
+		}
+
+		const u32 num_dropped = s_dropped.exchange(0, MemoryOrder::RELAXED);
+		if (num_dropped > 0)
+		{
+			char buf[64];
+			snprintf(buf, sizeof(buf), "%u log messages dropped", num_dropped);
+			const System system = { "log" };
+			write(LogSeverity::LOG_WARN, system, buf);
+		}
+	}
+
+	static s32 logger_thread(void* /*user_data*/)
+	{
+		do
+		{
+			s_sem.wait();
+			drain();
+		}
+		while (s_exit.load(MemoryOrder::ACQUIRE) == 0);
+
+		drain();
+		return 0;
+	}
+
+	void vlogx(LogSeverity::Enum sev, System system, const char* msg, va_list args)
+	{
+		char buf[8192];
+		int len = vsnprintf(buf, sizeof(buf), msg, args);
+		len = len < 0 ? 0 : (len < (int)sizeof(buf) ? len : (int)sizeof(buf) - 1);
+		buf[len] = '\0';
+
+		if (!push(sev, system, buf, (u32)len))
+			write(sev, system, buf);
+	}
+
 	void logx(LogSeverity::Enum sev, System system, const char* msg, ...)
 	{
 		va_list args;
@@ -93,4 +202,39 @@ namespace log_internal
 
 } // namespace log
 
+namespace log_globals
+{
+	void start_async()
+	{
+		using namespace log_internal;
+		CE_ASSERT(s_queue == NULL, "Async logging already started");
+
+		s_queue = CE_NEW(default_allocator(), MpmcQueue<Entry>)(default_allocator(), CROWN_LOG_QUEUE_SIZE);
+		s_exit.store(0, MemoryOrder::RELAXED);
+		s_thread.set_name("logger");
+		s_thread.set_priority(ThreadPriority::LOW);
+		s_thread.start(logger_thread);
+		s_async.store(1, MemoryOrder::SEQ_CST);
+	}
+
+	void stop_async()
+	{
+		using namespace log_internal;
+		if (s_queue == NULL)
+			return;
+
+		s_async.store(0, MemoryOrder::SEQ_CST);
+		while (s_pushing.load(MemoryOrder::ACQUIRE) != 0)
+			os::sleep(0);
+
+		s_exit.store(1, MemoryOrder::RELEASE);
+		s_sem.post();
+		s_thread.stop();
+
+		CE_DELETE(default_allocator(), s_queue);
+		s_queue = NULL;
+	}
+
+} // namespace log_globals
+
 } // namespace crown
@@ -36,6 +36,18 @@ namespace log_internal
 
 } // namespace log_internal
 
+namespace log_globals
+{
+	/// Starts a thread which writes the messages to stdout, the log file
+	/// and the console clients: the threads which log only format the
+	/// message and push it to a queue. Errors are still written immediately.
+	void start_async();
+
+	/// Writes the messages still in the queue and stops the logger thread.
+	void stop_async();
+
+} // namespace log_globals
+
 } // namespace crown
 
 #define vlogi(system, msg, va_list) crown::log_internal::vlogx(crown::LogSeverity::LOG_INFO, system, msg, va_list)
@@ -107,6 +107,14 @@ struct AndroidDevice
 			// Not triggered by Android
 			break;
 
+		case APP_CMD_RESUME:
+			_queue.push_resume_event();
+			break;
+
+		case APP_CMD_PAUSE:
+			_queue.push_pause_event();
+			break;
+
 		case APP_CMD_GAINED_FOCUS:
 			break;
 
@@ -322,9 +330,14 @@ namespace display
 
 static AndroidDevice s_advc;
 
-bool next_event(OsEvent& ev)
+bool next_event(OsEvent& ev, s64& time)
+{
+	return s_advc._queue.pop_event(ev, time);
+}
+
+void wait_event(u32 ms)
 {
-	return s_advc._queue.pop_event(ev);
+	s_advc._queue.wait_event(ms);
 }
 
 } // namespace crown
@@ -11,6 +11,7 @@
 #include "core/containers/array.h"
 #include "core/os.h"
 #include "core/thread/thread.h"
+#include "core/benchmarks.h"
 #include "core/unit_tests.h"
 #include "device/device.h"
 #include "device/device_event_queue.h"
@@ -19,6 +20,7 @@
 #include "resource/data_compiler.h"
 #include <bgfx/platform.h>
 #include <fcntl.h>  // O_RDONLY, ...
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h> // memset
 #include <unistd.h> // close
@@ -336,6 +338,13 @@ struct LinuxDevice
 
 	int run(DeviceOptions* opts)
 	{
+		// Headless devices need no display connection nor events
+		if (opts->_headless)
+		{
+			crown::run(*opts);
+			return EXIT_SUCCESS;
+		}
+
 		// http://tronche.com/gui/x/xlib/display/XInitThreads.html
 		Status xs = XInitThreads();
 		CE_ASSERT(xs != 0, "XInitThreads: error");
@@ -385,6 +394,11 @@ struct LinuxDevice
 		bitmap = XCreateBitmapFromData(_x11_display, root_window, data, 8, 8);
 		_x11_hidden_cursor = XCreatePixmapCursor(_x11_display, bitmap, bitmap, &dummy, &dummy, 0, 0);
 
+		// Make this thread the renderer thread before bgfx::init() is
+		// called, so that bgfx does not create one of its own
+		if (opts->_render_thread)
+			bgfx::renderFrame();
+
 		// Start main thread
 		MainThreadArgs mta;
 		mta.opts = opts;
@@ -401,7 +415,22 @@ struct LinuxDevice
 
 			if (!pending)
 			{
-				os::sleep(8);
+				// Run the renderer backend while there are no events. It
+				// waits for the main thread to finish the next frame at most
+				// as long as poll() below would. Before bgfx::init() and
+				// after bgfx::shutdown() there is nothing to render
+				if (opts->_render_thread
+					&& bgfx::renderFrame(CROWN_INPUT_POLL_INTERVAL) != bgfx::RenderFrame::NoContext
+					)
+					continue;
+
+				// Wake up as soon as the X server sends new events, so
+				// that their timestamps are accurate
+				pollfd pfd;
+				pfd.fd = ConnectionNumber(_x11_display);
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				poll(&pfd, 1, CROWN_INPUT_POLL_INTERVAL);
 			}
 			else
 			{
@@ -790,9 +819,14 @@ namespace display
 
 } // namespace display
 
-bool next_event(OsEvent& ev)
+bool next_event(OsEvent& ev, s64& time)
+{
+	return s_ldvc._queue.pop_event(ev, time);
+}
+
+void wait_event(u32 ms)
 {
-	return s_ldvc._queue.pop_event(ev);
+	s_ldvc._queue.wait_event(ms);
 }
 
 } // namespace crown
@@ -820,6 +854,14 @@ int main(int argc, char** argv)
 		return main_unit_tests();
 	}
 #endif // CROWN_BUILD_UNIT_TESTS
+#if CROWN_BUILD_BENCHMARKS
+	if (cl.has_option("run-benchmarks"))
+	{
+		return main_benchmarks(cl.get_parameter(0, "benchmark-filter")
+			, cl.get_parameter(0, "benchmark-json")
+			);
+	}
+#endif // CROWN_BUILD_BENCHMARKS
 	if (cl.has_option("compile") || cl.has_option("server"))
 	{
 		if (main_data_compiler(argc, argv) != EXIT_SUCCESS || !cl.has_option("continue"))
@@ -9,6 +9,7 @@
 
 #include "core/command_line.h"
 #include "core/thread/thread.h"
+#include "core/benchmarks.h"
 #include "core/unit_tests.h"
 #include "device/device.h"
 #include "device/device_event_queue.h"
@@ -309,6 +310,13 @@ struct WindowsDevice
 
 	int	run(DeviceOptions* opts)
 	{
+		// Headless devices need no window nor events
+		if (opts->_headless)
+		{
+			crown::run(*opts);
+			return EXIT_SUCCESS;
+		}
+
 		MainThreadArgs mta;
 		mta.opts = opts;
 
@@ -347,6 +355,11 @@ struct WindowsDevice
 			);
 		CE_ASSERT(_hwnd != NULL, "CreateWindowA: GetLastError = %d", GetLastError());
 
+		// Make this thread the renderer thread before bgfx::init() is
+		// called, so that bgfx does not create one of its own
+		if (opts->_render_thread)
+			bgfx::renderFrame();
+
 		Thread main_thread;
 		main_thread.start(func, &mta);
 
@@ -362,6 +375,9 @@ struct WindowsDevice
 				TranslateMessage(&msg);
 				DispatchMessage(&msg);
 			}
+
+			if (opts->_render_thread)
+				bgfx::renderFrame(CROWN_INPUT_POLL_INTERVAL);
 		}
 
 		main_thread.stop();
@@ -672,9 +688,14 @@ namespace display
 
 } // namespace display
 
-bool next_event(OsEvent& ev)
+bool next_event(OsEvent& ev, s64& time)
 {
-	return s_wdvc._queue.pop_event(ev);
+	return s_wdvc._queue.pop_event(ev, time);
+}
+
+void wait_event(u32 ms)
+{
+	s_wdvc._queue.wait_event(ms);
 }
 
 } // namespace crown
@@ -709,6 +730,14 @@ int main(int argc, char** argv)
 		return main_unit_tests();
 	}
 #endif // CROWN_BUILD_UNIT_TESTS
+#if CROWN_BUILD_BENCHMARKS
+	if (cl.has_option("run-benchmarks"))
+	{
+		return main_benchmarks(cl.get_parameter(0, "benchmark-filter")
+			, cl.get_parameter(0, "benchmark-json")
+			);
+	}
+#endif // CROWN_BUILD_BENCHMARKS
 	if (cl.has_option("compile") || cl.has_option("server"))
 	{
 		if (main_data_compiler(argc, argv) != EXIT_SUCCESS || !cl.has_option("continue"))
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/memory/allocator.h"
+#include "core/memory/memory.h"
+#include "core/os.h"
+#include "device/perf_overlay.h"
+#include "device/profiler.h"
+#include <bgfx/bgfx.h>
+#include <stdint.h> // UINT32_MAX
+#include <string.h> // strcmp
+
+namespace crown
+{
+namespace perf_overlay_internal
+{
+	struct Metric
+	{
+		const char* name;
+		bool scope;  ///< Time spent in the scope, otherwise the value recorded with RECORD_FLOAT().
+		u32 row;
+		f32 scale;   ///< Converts the metric to the unit of the row.
+	};
+
+	static const Metric s_metrics[] =
+	{
+		{ "lua.update",               false, PerfOverlay::Row::LUA,             1000.0f         },
+		{ "lua.render",               false, PerfOverlay::Row::LUA,             1000.0f         },
+		{ "world.physics",            true,  PerfOverlay::Row::PHYSICS,         1.0f            },
+		{ "world.scene_graph",        true,  PerfOverlay::Row::SCENE,           1.0f            },
+		{ "world.render",             true,  PerfOverlay::Row::RENDER,          1.0f            },
+		{ "device.frame_submit",      true,  PerfOverlay::Row::SUBMIT,          1.0f            },
+		{ "bgfx.gpu_time",            false, PerfOverlay::Row::GPU,             1.0f            },
+		{ "bgfx.draw_calls",          false, PerfOverlay::Row::DRAW_CALLS,      1.0f            },
+		{ "resource_loader.requests", false, PerfOverlay::Row::LOADER_REQUESTS, 1.0f            },
+		{ "resource_manager.backlog", false, PerfOverlay::Row::LOADER_BACKLOG,  1.0f            },
+		{ "lua.heap_kb",              false, PerfOverlay::Row::LUA_MEMORY,      1.0f / 1024.0f  },
+		{ "texture_manager.memory",   false, PerfOverlay::Row::TEXTURE_MEMORY,  1.0f            }
+	};
+
+	// Returns the index into s_metrics of the metric @a name, or UINT32_MAX.
+	static u32 find_metric(const char* name, bool scope)
+	{
+		for (u32 i = 0; i < countof(s_metrics); ++i)
+		{
+			if (s_metrics[i].scope == scope && strcmp(s_metrics[i].name, name) == 0)
+				return i;
+		}
+
+		return UINT32_MAX;
+	}
+
+	static f32 megabytes(Allocator& a)
+	{
+		return f32(f64(a.total_allocated()) / (1024.0*1024.0));
+	}
+
+} // namespace perf_overlay_internal
+
+PerfOverlay::PerfOverlay(Allocator& a)
+	: _threads(a)
+	, _frame(0)
+	, _enabled(false)
+{
+	memset(_frame_times, 0, sizeof(_frame_times));
+	memset(_rows, 0, sizeof(_rows));
+}
+
+void PerfOverlay::update(f32 seconds, const char* begin, const char* end)
+{
+	using namespace perf_overlay_internal;
+
+	if (!_enabled)
+		return;
+
+	_frame_times[_frame++ % CROWN_PERF_OVERLAY_FRAMES] = seconds * 1000.0f;
+	memset(_rows, 0, sizeof(_rows));
+
+	const f64 ms_per_tick = 1000.0 / f64(os::clockfrequency());
+
+	if (array::size(_threads) == 0)
+	{
+		ThreadStack ts;
+		ts.depth = 0;
+		array::push_back(_threads, ts);
+	}
+	ThreadStack* thread = &_threads[0];
+
+	const char* cur = begin;
+	while (cur < end)
+	{
+		const u32 type = *(u32*)cur;
+		if (type == ProfilerEventType::COUNT)
+			break;
+
+		const u32 size = *(u32*)(cur + sizeof(u32));
+		const char* data = cur + 2*sizeof(u32);
+		cur = data + size;
+
+		switch (type)
+		{
+		case ProfilerEventType::PROFILER_THREAD:
+			{
+				const ProfilerThread* ev = (const ProfilerThread*)data;
+				while (array::size(_threads) <= ev->id)
+				{
+					ThreadStack ts;
+					ts.depth = 0;
+					array::push_back(_threads, ts);
+				}
+				thread = &_threads[ev->id];
+			}
+			break;
+
+		case ProfilerEventType::ENTER_PROFILE_SCOPE:
+			{
+				const EnterProfileScope* ev = (const EnterProfileScope*)data;
+				if (thread->depth < CROWN_PERF_OVERLAY_MAX_DEPTH)
+				{
+					OpenScope& scope = thread->scopes[thread->depth];
+					const u32 m = find_metric(ev->name, true);
+					scope.row = m != UINT32_MAX ? s_metrics[m].row : UINT32_MAX;
+					scope.time = ev->time;
+				}
+				++thread->depth;
+			}
+			break;
+
+		case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+			{
+				const LeaveProfileScope* ev = (const LeaveProfileScope*)data;
+				if (thread->depth == 0)
+					break;
+
+				--thread->depth;
+				if (thread->depth < CROWN_PERF_OVERLAY_MAX_DEPTH)
+				{
+					const OpenScope& scope = thread->scopes[thread->depth];
+					if (scope.row != UINT32_MAX)
+						_rows[scope.row] += f32(f64(ev->time - scope.time) * ms_per_tick);
+				}
+			}
+			break;
+
+		case ProfilerEventType::RECORD_FLOAT:
+			{
+				const RecordFloat* ev = (const RecordFloat*)data;
+				const u32 m = find_metric(ev->name, false);
+				if (m != UINT32_MAX)
+					_rows[s_metrics[m].row] += ev->value * s_metrics[m].scale;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+void PerfOverlay::draw(u16 width, u16 height)
+{
+	using namespace perf_overlay_internal;
+
+	if (!_enabled)
+		return;
+
+	bgfx::dbgTextClear();
+
+	// The debug font is 8x16 pixels
+	const u32 columns = width / 8;
+	const u32 lines = height / 16;
+	const u32 num_frames = _frame < CROWN_PERF_OVERLAY_FRAMES ? _frame : CROWN_PERF_OVERLAY_FRAMES;
+	if (num_frames == 0 || columns < 48 || lines < 24)
+		return;
+
+	f32 sum = 0.0f;
+	f32 max = 0.0f;
+	for (u32 i = 0; i < num_frames; ++i)
+	{
+		sum += _frame_times[i];
+		max = max > _frame_times[i] ? max : _frame_times[i];
+	}
+
+	const f32 last = _frame_times[(_frame - 1) % CROWN_PERF_OVERLAY_FRAMES];
+	bgfx::dbgTextPrintf(1, 1, 0x0f, "Frame %6.2f ms  Avg %6.2f ms  Max %6.2f ms", last, sum / f32(num_frames), max);
+
+	// Frame time graph, newest frame on the right. Each line covers 5 ms:
+	// green up to 16.6 ms, yellow up to 33.3 ms, red above
+	const u32 graph_lines = 8;
+	const u32 graph_frames = num_frames < columns - 2 ? num_frames : columns - 2;
+	char line[CROWN_PERF_OVERLAY_FRAMES + 1];
+	for (u32 l = 0; l < graph_lines; ++l)
+	{
+		const f32 threshold = f32(graph_lines - 1 - l) * 5.0f;
+		for (u32 i = 0; i < graph_frames; ++i)
+		{
+			const f32 ft = _frame_times[(_frame - graph_frames + i) % CROWN_PERF_OVERLAY_FRAMES];
+			line[i] = ft > threshold + 2.5f ? '\xdb' : ft > threshold ? '\xdc' : ' ';
+		}
+		line[graph_frames] = '\0';
+
+		const u8 attr = threshold < 16.6f ? 0x0a : threshold < 33.3f ? 0x0e : 0x0c;
+		bgfx::dbgTextPrintf(1, 2 + l, attr, "%s", line);
+	}
+
+	u16 y = 3 + graph_lines;
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Lua     %6.2f ms   GPU    %6.2f ms", _rows[Row::LUA], _rows[Row::GPU]);
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Physics %6.2f ms   Submit %6.2f ms", _rows[Row::PHYSICS], _rows[Row::SUBMIT]);
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Scene   %6.2f ms   Render %6.2f ms", _rows[Row::SCENE], _rows[Row::RENDER]);
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Draw calls %u", u32(_rows[Row::DRAW_CALLS]));
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Loader  %u requests, %u waiting online", u32(_rows[Row::LOADER_REQUESTS]), u32(_rows[Row::LOADER_BACKLOG]));
+	++y;
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Memory (MB)");
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Default %8.2f   Scratch  %8.2f   Frame %8.2f"
+		, megabytes(default_allocator())
+		, megabytes(default_scratch_allocator())
+		, megabytes(default_frame_allocator())
+		);
+	bgfx::dbgTextPrintf(1, y++, 0x0f, "Lua     %8.2f   Textures %8.2f"
+		, _rows[Row::LUA_MEMORY]
+		, _rows[Row::TEXTURE_MEMORY]
+		);
+}
+
+} // namespace crown
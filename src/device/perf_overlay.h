@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/types.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Shows the frame times, the time spent in the main subsystems, the memory
+/// used and the loader queue on top of the game, using bgfx's debug text.
+///
+/// @ingroup Device
+struct PerfOverlay
+{
+	/// Rows of the overlay, each summing one or more profiler metrics.
+	struct Row
+	{
+		enum Enum
+		{
+			LUA,
+			PHYSICS,
+			SCENE,
+			RENDER,
+			SUBMIT,
+			GPU,
+			DRAW_CALLS,
+			LOADER_REQUESTS,
+			LOADER_BACKLOG,
+			LUA_MEMORY,
+			TEXTURE_MEMORY,
+
+			COUNT
+		};
+	};
+
+	struct OpenScope
+	{
+		u32 row; ///< Row the scope is summed to, or UINT32_MAX.
+		s64 time;
+	};
+
+	struct ThreadStack
+	{
+		u32 depth;
+		OpenScope scopes[CROWN_PERF_OVERLAY_MAX_DEPTH];
+	};
+
+	Array<ThreadStack> _threads;
+	f32 _frame_times[CROWN_PERF_OVERLAY_FRAMES]; ///< Milliseconds, ring buffer.
+	u32 _frame;
+	f32 _rows[Row::COUNT];
+	bool _enabled;
+
+	///
+	explicit PerfOverlay(Allocator& a);
+
+	/// Adds a frame which took @a seconds and whose profiler events are
+	/// [begin, end). Does nothing when the overlay is disabled.
+	void update(f32 seconds, const char* begin, const char* end);
+
+	/// Draws the overlay on a backbuffer of @a width by @a height pixels.
+	/// Does nothing when the overlay is disabled.
+	void draw(u16 width, u16 height);
+};
+
+} // namespace crown
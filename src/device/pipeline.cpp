@@ -3,10 +3,15 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/error/error.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
 #include "core/types.h"
+#include "device/gpu_memory.h"
 #include "device/pipeline.h"
 #include "world/shader_manager.h"
 #include <bx/math.h>
+#include <string.h> // memcpy, memset
 
 namespace crown
 {
@@ -95,75 +100,526 @@ void screenSpaceQuad(float _textureWidth, float _textureHeight, float _texelHalf
 	}
 }
 
-Pipeline::Pipeline()
-	: _frame_buffer(BGFX_INVALID_HANDLE)
+static u16 target_size(u16 size, f32 scale)
 {
-	for (u32 i = 0; i < countof(_buffers); ++i)
-		_buffers[i] = BGFX_INVALID_HANDLE;
+	return bx::max<u16>(1, u16(f32(size)*scale));
 }
 
-void Pipeline::create(uint16_t width, uint16_t height)
+static bool is_depth(u32 format)
 {
+	return format >= bgfx::TextureFormat::D16 && format <= bgfx::TextureFormat::D0S8;
+}
+
+// Returns the estimated size in bytes of a 2D texture without mips.
+static u32 texture_memory(u16 width, u16 height, u32 format)
+{
+	bgfx::TextureInfo ti;
+	bgfx::calcTextureSize(ti, width, height, 1, false, false, 1, bgfx::TextureFormat::Enum(format));
+	return ti.storageSize;
+}
+
+Pipeline::Pipeline(Allocator& a)
+	: _graph(NULL)
+	, _num_textures(0)
+	, _num_passes(0)
+	, _frame_buffer(BGFX_INVALID_HANDLE)
+	, _color(BGFX_INVALID_HANDLE)
+	, _depth(BGFX_INVALID_HANDLE)
+	, _scaled_color(BGFX_INVALID_HANDLE)
+	, _scaled_frame_buffer(BGFX_INVALID_HANDLE)
+	, _scene_frame_buffer(BGFX_INVALID_HANDLE)
+	, _resolution_scale(1.0f)
+	, _resolution_min_scale(1.0f)
+	, _resolution_max_scale(1.0f)
+	, _resolution_gpu_time(0.0f)
+	, _scene_width(0)
+	, _scene_height(0)
+	, _target_memory(0)
+	, _occlusion_readback(BGFX_INVALID_HANDLE)
+	, _num_occlusion_levels(0)
+	, _occlusion_frame(UINT32_MAX)
+	, _occlusion_view_proj(MATRIX4X4_IDENTITY)
+	, _occlusion_buffer(a)
+	, _occlusion_memory(0)
+{
+	for (u32 i = 0; i < countof(_occlusion_levels); ++i)
+	{
+		_occlusion_levels[i] = BGFX_INVALID_HANDLE;
+		_occlusion_frame_buffers[i] = BGFX_INVALID_HANDLE;
+	}
+}
+
+void Pipeline::create(const RenderGraphResource* graph, u16 width, u16 height)
+{
+	CE_ASSERT(graph->num_targets <= RENDER_GRAPH_MAX_TARGETS, "Too many targets");
+	CE_ASSERT(graph->num_passes <= RENDER_GRAPH_MAX_PASSES, "Too many passes");
+
 	PosTexCoord0Vertex::init();
-	_tex_color = bgfx::createUniform("s_texColor",  bgfx::UniformType::Int1);
+	_u_occlusion_depth = bgfx::createUniform("s_occlusion_depth", bgfx::UniformType::Int1);
+	_u_occlusion_size  = bgfx::createUniform("u_occlusion_size", bgfx::UniformType::Vec4);
+	_u_occlusion_region = bgfx::createUniform("u_occlusion_region", bgfx::UniformType::Vec4);
+	_u_upscale       = bgfx::createUniform("u_upscale", bgfx::UniformType::Vec4);
+	_u_upscale_color = bgfx::createUniform("s_texColor", bgfx::UniformType::Int1);
+
+	_graph = graph;
+
+	// Walk the passes backwards and keep those which write the back buffer
+	// or a target read by a pass already kept. The scene pass is always kept
+	// because the tools render the worlds without presenting them.
+	bool live[RENDER_GRAPH_MAX_PASSES];
+	bool read[RENDER_GRAPH_MAX_TARGETS];
+	memset(read, 0, sizeof(read));
+
+	for (u32 i = graph->num_passes; i-- > 0;)
+	{
+		const RenderGraphPass* pass = render_graph_resource::pass(graph, i);
+
+		live[i] = pass->type == RenderGraphPassType::SCENE;
+		for (u32 j = 0; j < pass->num_outputs; ++j)
+		{
+			const u32 t = pass->outputs[j];
+			if (t != RENDER_GRAPH_BACKBUFFER)
+				live[i] = live[i] || read[t];
+#if !CROWN_TOOLS
+			else
+				live[i] = true;
+#endif // CROWN_TOOLS
+		}
+
+		if (!live[i])
+			continue;
+
+		for (u32 j = 0; j < pass->num_inputs; ++j)
+			read[pass->inputs[j]] = true;
+	}
+
+	// Lifetime of each target, in live passes
+	u32 first_use[RENDER_GRAPH_MAX_TARGETS];
+	u32 last_use[RENDER_GRAPH_MAX_TARGETS];
+	for (u32 t = 0; t < graph->num_targets; ++t)
+	{
+		first_use[t] = UINT32_MAX;
+		last_use[t] = 0;
+		_target_texture[t] = UINT32_MAX;
+	}
 
-	reset(width, height);
+	_num_passes = 0;
+	for (u32 i = 0; i < graph->num_passes; ++i)
+	{
+		if (!live[i])
+			continue;
+
+		const RenderGraphPass* pass = render_graph_resource::pass(graph, i);
+		const u32 p = _num_passes++;
+
+		RenderPass& rp = _passes[p];
+		rp.pass = pass;
+		rp.frame_buffer = BGFX_INVALID_HANDLE;
+		for (u32 j = 0; j < countof(rp.samplers); ++j)
+			rp.samplers[j] = BGFX_INVALID_HANDLE;
+
+		for (u32 j = 0; j < pass->num_inputs; ++j)
+		{
+			rp.samplers[j] = bgfx::createUniform(pass->samplers[j], bgfx::UniformType::Int1);
+			last_use[pass->inputs[j]] = p;
+		}
+
+		for (u32 j = 0; j < pass->num_outputs; ++j)
+		{
+			const u32 t = pass->outputs[j];
+			if (t == RENDER_GRAPH_BACKBUFFER)
+				continue;
+
+			first_use[t] = bx::min(first_use[t], p);
+			last_use[t] = p;
+		}
+	}
+	CE_ASSERT(_num_passes - 1 <= MAX_POST_VIEWS, "Too many fullscreen passes");
+
+	// Targets are always written before being read, so a target is first
+	// used as an output. Reuse the first texture whose last use comes before.
+	_num_textures = 0;
+	for (u32 p = 0; p < _num_passes; ++p)
+	{
+		const RenderGraphPass* pass = _passes[p].pass;
+
+		for (u32 j = 0; j < pass->num_outputs; ++j)
+		{
+			const u32 t = pass->outputs[j];
+			if (t == RENDER_GRAPH_BACKBUFFER || first_use[t] != p)
+				continue;
+
+			const RenderGraphTarget* rt = render_graph_resource::target(graph, t);
+
+			u32 k = 0;
+			for (; k < _num_textures; ++k)
+			{
+				if (_textures[k].format == rt->format
+					&& _textures[k].scale == rt->scale
+					&& _textures[k].last_pass < p
+					)
+					break;
+			}
+
+			if (k == _num_textures)
+			{
+				_textures[k].texture = BGFX_INVALID_HANDLE;
+				_textures[k].format = rt->format;
+				_textures[k].scale = rt->scale;
+				++_num_textures;
+			}
+
+			_textures[k].last_pass = last_use[t];
+			_target_texture[t] = k;
+		}
+	}
+
+	create_targets(width, height);
 }
 
 void Pipeline::destroy()
 {
-	bgfx::destroy(_frame_buffer);
-	bgfx::destroy(_buffers[1]);
-	bgfx::destroy(_buffers[0]);
-	bgfx::destroy(_tex_color);
+	destroy_occlusion();
+	destroy_targets();
+
+	// The graph may have already been unloaded when it is reloaded
+	for (u32 p = 0; p < _num_passes; ++p)
+	{
+		for (u32 j = 0; j < countof(_passes[p].samplers); ++j)
+		{
+			if (bgfx::isValid(_passes[p].samplers[j]))
+				bgfx::destroy(_passes[p].samplers[j]);
+		}
+	}
+	_num_passes = 0;
+	_num_textures = 0;
+	_graph = NULL;
+
+	bgfx::destroy(_u_upscale_color);
+	bgfx::destroy(_u_upscale);
+	bgfx::destroy(_u_occlusion_region);
+	bgfx::destroy(_u_occlusion_size);
+	bgfx::destroy(_u_occlusion_depth);
 }
 
 void Pipeline::reset(u16 width, u16 height)
 {
-	for (u32 i = 0; i < countof(_buffers); ++i)
+	destroy_targets();
+	create_targets(width, height);
+}
+
+void Pipeline::create_targets(u16 width, u16 height)
+{
+	for (u32 k = 0; k < _num_textures; ++k)
 	{
-		if (bgfx::isValid(_buffers[i]))
-			bgfx::destroy(_buffers[i]);
+		const u16 w = target_size(width, _textures[k].scale);
+		const u16 h = target_size(height, _textures[k].scale);
+		_textures[k].texture = bgfx::createTexture2D(w
+			, h
+			, false
+			, 1
+			, bgfx::TextureFormat::Enum(_textures[k].format)
+			, BGFX_TEXTURE_RT
+			);
+		_target_memory += texture_memory(w, h, _textures[k].format);
 	}
 
-	_buffers[0] = bgfx::createTexture2D(width
-		, height
-		, false
-		, 1
-		, bgfx::TextureFormat::BGRA8
-		, BGFX_TEXTURE_RT
+	for (u32 p = 0; p < _num_passes; ++p)
+	{
+		const RenderGraphPass* pass = _passes[p].pass;
+		if (pass->outputs[0] == RENDER_GRAPH_BACKBUFFER)
+			continue;
+
+		bgfx::TextureHandle handles[RENDER_GRAPH_MAX_OUTPUTS];
+		for (u32 j = 0; j < pass->num_outputs; ++j)
+			handles[j] = _textures[_target_texture[pass->outputs[j]]].texture;
+
+		_passes[p].frame_buffer = bgfx::createFrameBuffer(u8(pass->num_outputs), handles);
+	}
+
+	// The scene pass is the first and writes one color and one depth target
+	const RenderGraphPass* scene = _passes[0].pass;
+	const u32 depth = is_depth(_textures[_target_texture[scene->outputs[0]]].format) ? 0 : 1;
+	const RenderTexture& color = _textures[_target_texture[scene->outputs[1 - depth]]];
+	_frame_buffer = _passes[0].frame_buffer;
+	_color = color.texture;
+	_depth = _textures[_target_texture[scene->outputs[depth]]].texture;
+	_scene_frame_buffer = _frame_buffer;
+
+	// The worlds are rendered to a region of a full size color target, so
+	// that changing the scale does not recreate the targets
+	if (_resolution_gpu_time > 0.0f)
+	{
+		_scaled_color = bgfx::createTexture2D(width
+			, height
+			, false
+			, 1
+			, bgfx::TextureFormat::Enum(color.format)
+			, BGFX_TEXTURE_RT
+			);
+
+		bgfx::TextureHandle handles[] = { _scaled_color, _depth };
+		_scaled_frame_buffer = bgfx::createFrameBuffer(countof(handles), handles);
+		_scene_frame_buffer = _scaled_frame_buffer;
+		_target_memory += texture_memory(width, height, color.format);
+	}
+
+	gpu_memory::allocate(GpuMemoryCategory::RENDER_TARGET, _target_memory);
+
+	_scene_width = target_size(width, _resolution_scale);
+	_scene_height = target_size(height, _resolution_scale);
+
+	create_occlusion(width, height);
+}
+
+void Pipeline::destroy_targets()
+{
+	for (u32 p = 0; p < _num_passes; ++p)
+	{
+		if (bgfx::isValid(_passes[p].frame_buffer))
+			bgfx::destroy(_passes[p].frame_buffer);
+		_passes[p].frame_buffer = BGFX_INVALID_HANDLE;
+	}
+
+	for (u32 k = 0; k < _num_textures; ++k)
+	{
+		if (bgfx::isValid(_textures[k].texture))
+			bgfx::destroy(_textures[k].texture);
+		_textures[k].texture = BGFX_INVALID_HANDLE;
+	}
+
+	if (bgfx::isValid(_scaled_frame_buffer))
+		bgfx::destroy(_scaled_frame_buffer);
+	if (bgfx::isValid(_scaled_color))
+		bgfx::destroy(_scaled_color);
+
+	_frame_buffer = BGFX_INVALID_HANDLE;
+	_color = BGFX_INVALID_HANDLE;
+	_depth = BGFX_INVALID_HANDLE;
+	_scaled_color = BGFX_INVALID_HANDLE;
+	_scaled_frame_buffer = BGFX_INVALID_HANDLE;
+	_scene_frame_buffer = BGFX_INVALID_HANDLE;
+
+	gpu_memory::deallocate(GpuMemoryCategory::RENDER_TARGET, _target_memory);
+	_target_memory = 0;
+}
+
+void Pipeline::create_occlusion(u16 width, u16 height)
+{
+	destroy_occlusion();
+
+	const bgfx::Caps* caps = bgfx::getCaps();
+	const u64 required = BGFX_CAPS_TEXTURE_BLIT | BGFX_CAPS_TEXTURE_READ_BACK;
+	if ((caps->supported & required) != required)
+		return;
+
+	// Halve the depth buffer until it fits the readback
+	u32 w = width;
+	u32 h = height;
+	_occlusion_sizes[0][0] = u16(w);
+	_occlusion_sizes[0][1] = u16(h);
+
+	do
+	{
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+		++_num_occlusion_levels;
+		_occlusion_sizes[_num_occlusion_levels][0] = u16(w);
+		_occlusion_sizes[_num_occlusion_levels][1] = u16(h);
+	}
+	while ((w > CROWN_OCCLUSION_BUFFER_WIDTH || h > CROWN_OCCLUSION_BUFFER_HEIGHT)
+		&& _num_occlusion_levels < countof(_occlusion_levels)
 		);
-	_buffers[1] = bgfx::createTexture2D(width
-		, height
+
+	if (w > CROWN_OCCLUSION_BUFFER_WIDTH || h > CROWN_OCCLUSION_BUFFER_HEIGHT)
+	{
+		_num_occlusion_levels = 0;
+		return;
+	}
+
+	for (u32 i = 0; i < _num_occlusion_levels; ++i)
+	{
+		_occlusion_levels[i] = bgfx::createTexture2D(_occlusion_sizes[i + 1][0]
+			, _occlusion_sizes[i + 1][1]
+			, false
+			, 1
+			, bgfx::TextureFormat::R32F
+			, BGFX_TEXTURE_RT
+			);
+		_occlusion_frame_buffers[i] = bgfx::createFrameBuffer(1, &_occlusion_levels[i]);
+		_occlusion_memory += texture_memory(_occlusion_sizes[i + 1][0], _occlusion_sizes[i + 1][1], bgfx::TextureFormat::R32F);
+	}
+
+	_occlusion_readback = bgfx::createTexture2D(u16(w)
+		, u16(h)
 		, false
 		, 1
-		, bgfx::TextureFormat::D24S8
-		, BGFX_TEXTURE_RT
+		, bgfx::TextureFormat::R32F
+		, BGFX_TEXTURE_BLIT_DST | BGFX_TEXTURE_READ_BACK
 		);
+	_occlusion_memory += texture_memory(u16(w), u16(h), bgfx::TextureFormat::R32F);
 
-	if (bgfx::isValid(_frame_buffer))
-		bgfx::destroy(_frame_buffer);
+	gpu_memory::allocate(GpuMemoryCategory::RENDER_TARGET, _occlusion_memory);
+}
+
+void Pipeline::destroy_occlusion()
+{
+	for (u32 i = 0; i < _num_occlusion_levels; ++i)
+	{
+		bgfx::destroy(_occlusion_frame_buffers[i]);
+		bgfx::destroy(_occlusion_levels[i]);
+		_occlusion_frame_buffers[i] = BGFX_INVALID_HANDLE;
+		_occlusion_levels[i] = BGFX_INVALID_HANDLE;
+	}
+
+	if (bgfx::isValid(_occlusion_readback))
+		bgfx::destroy(_occlusion_readback);
+	_occlusion_readback = BGFX_INVALID_HANDLE;
+
+	gpu_memory::deallocate(GpuMemoryCategory::RENDER_TARGET, _occlusion_memory);
+	_occlusion_memory = 0;
 
-	_frame_buffer = bgfx::createFrameBuffer(countof(_buffers), _buffers);
+	// A readback still in flight writes to _occlusion_data, which is never
+	// reallocated, and is ignored
+	_num_occlusion_levels = 0;
+	_occlusion_frame = UINT32_MAX;
+	_occlusion_buffer.reset();
 }
 
-void Pipeline::render(ShaderManager& sm, StringId32 program, uint8_t view, uint16_t width, uint16_t height)
+void Pipeline::set_dynamic_resolution(f32 min_scale, f32 max_scale, f32 gpu_time)
 {
+	CE_ASSERT(_graph == NULL, "Pipeline already created");
+	CE_ASSERT(min_scale > 0.0f && min_scale <= max_scale && max_scale <= 1.0f
+		, "Invalid scales: %f %f"
+		, min_scale
+		, max_scale
+		);
+
+	_resolution_min_scale = min_scale;
+	_resolution_max_scale = max_scale;
+	_resolution_gpu_time = gpu_time;
+	_resolution_scale = max_scale;
+}
+
+void Pipeline::update_resolution(u16 width, u16 height)
+{
+	const bgfx::Stats* stats = bgfx::getStats();
+
+	if (_resolution_gpu_time > 0.0f
+		&& stats->gpuTimerFreq > 0
+		&& stats->gpuTimeEnd > stats->gpuTimeBegin
+		)
+	{
+		const f32 gpu_time = f32(f64(stats->gpuTimeEnd - stats->gpuTimeBegin)*1000.0/f64(stats->gpuTimerFreq));
+
+		// The GPU time grows roughly with the number of pixels, that is with
+		// the square of the scale. The scale is left alone while the time is
+		// slightly below the target, so that it does not oscillate.
+		if (gpu_time > _resolution_gpu_time || gpu_time < _resolution_gpu_time*0.85f)
+		{
+			const f32 scale = _resolution_scale*fsqrt(_resolution_gpu_time / gpu_time);
+			_resolution_scale = bx::clamp(_resolution_scale + (scale - _resolution_scale)*0.25f
+				, _resolution_min_scale
+				, _resolution_max_scale
+				);
+		}
+	}
+
+	_scene_width = target_size(width, _resolution_scale);
+	_scene_height = target_size(height, _resolution_scale);
+}
+
+void Pipeline::upscale(ShaderManager& sm, u16 width, u16 height)
+{
+	if (!bgfx::isValid(_scaled_frame_buffer))
+		return;
+
 	const bgfx::Caps* caps = bgfx::getCaps();
 
 	f32 ortho[16];
 	bx::mtxOrtho(ortho, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 100.0f, 0.0f, caps->homogeneousDepth);
 
-	bgfx::setViewClear(view
-		, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH | BGFX_CLEAR_STENCIL
-		, 0x353839ff
-		, 1.0f
-		, 0
-		);
+	const uint32_t samplerFlags = 0
+		| BGFX_TEXTURE_RT
+		| BGFX_TEXTURE_MIP_POINT
+		| BGFX_TEXTURE_U_CLAMP
+		| BGFX_TEXTURE_V_CLAMP
+		;
+
+	// The region is at the top of the targets, which is at the end of the
+	// texture coordinates when their origin is at the bottom left
+	const f32 sx = f32(_scene_width) / f32(width);
+	const f32 sy = f32(_scene_height) / f32(height);
+	const f32 upscale[] = { sx, sy, 0.0f, caps->originBottomLeft ? 1.0f - sy : 0.0f };
+
+	bgfx::setViewFrameBuffer(VIEW_UPSCALE, _frame_buffer);
+	bgfx::setViewRect(VIEW_UPSCALE, 0, 0, width, height);
+	bgfx::setViewTransform(VIEW_UPSCALE, NULL, ortho);
+
+	bgfx::setUniform(_u_upscale, upscale);
+	bgfx::setTexture(0, _u_upscale_color, _scaled_color, samplerFlags);
+	screenSpaceQuad(width, height, 0.0f, caps->originBottomLeft);
+	sm.submit("upscale"_id32, VIEW_UPSCALE, 0, BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
+}
+
+void Pipeline::render(ShaderManager& sm, u16 width, u16 height)
+{
+	const bgfx::Caps* caps = bgfx::getCaps();
 
-	bgfx::setViewFrameBuffer(view, BGFX_INVALID_HANDLE);
-	bgfx::setViewRect(view, 0, 0, width, height);
-	bgfx::setViewTransform(view, NULL, ortho);
+	f32 ortho[16];
+	bx::mtxOrtho(ortho, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 100.0f, 0.0f, caps->homogeneousDepth);
+
+	// Inputs with the size of the output are sampled texel by texel, the
+	// others are filtered
+	const uint32_t pointFlags = 0
+		| BGFX_TEXTURE_RT
+		| BGFX_TEXTURE_MIN_POINT
+		| BGFX_TEXTURE_MAG_POINT
+		| BGFX_TEXTURE_MIP_POINT
+		| BGFX_TEXTURE_U_CLAMP
+		| BGFX_TEXTURE_V_CLAMP
+		;
+	const uint32_t linearFlags = 0
+		| BGFX_TEXTURE_RT
+		| BGFX_TEXTURE_MIP_POINT
+		| BGFX_TEXTURE_U_CLAMP
+		| BGFX_TEXTURE_V_CLAMP
+		;
+
+	for (u32 p = 1; p < _num_passes; ++p)
+	{
+		const RenderPass& rp = _passes[p];
+		const u8 view = u8(VIEW_POST + p - 1);
+
+		const u32 out = rp.pass->outputs[0];
+		const f32 scale = out == RENDER_GRAPH_BACKBUFFER ? 1.0f : _textures[_target_texture[out]].scale;
+		const u16 w = target_size(width, scale);
+		const u16 h = target_size(height, scale);
+
+		bgfx::setViewFrameBuffer(view, rp.frame_buffer);
+		bgfx::setViewRect(view, 0, 0, w, h);
+		bgfx::setViewTransform(view, NULL, ortho);
+
+		for (u32 j = 0; j < rp.pass->num_inputs; ++j)
+		{
+			const RenderTexture& rt = _textures[_target_texture[rp.pass->inputs[j]]];
+			bgfx::setTexture(u8(j), rp.samplers[j], rt.texture, rt.scale == scale ? pointFlags : linearFlags);
+		}
+
+		screenSpaceQuad(w, h, 0.0f, caps->originBottomLeft);
+		sm.submit(rp.pass->shader, view, 0, BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
+	}
+}
+
+void Pipeline::render_occlusion(ShaderManager& sm, const Matrix4x4& view_proj)
+{
+	if (_num_occlusion_levels == 0 || _occlusion_frame != UINT32_MAX)
+		return;
+
+	const bgfx::Caps* caps = bgfx::getCaps();
+
+	f32 ortho[16];
+	bx::mtxOrtho(ortho, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f, 100.0f, 0.0f, caps->homogeneousDepth);
 
 	const uint32_t samplerFlags = 0
 		| BGFX_TEXTURE_RT
@@ -173,9 +629,92 @@ void Pipeline::render(ShaderManager& sm, StringId32 program, uint8_t view, uint1
 		| BGFX_TEXTURE_U_CLAMP
 		| BGFX_TEXTURE_V_CLAMP
 		;
-	bgfx::setTexture(0, _tex_color, _buffers[0], samplerFlags);
-	screenSpaceQuad(width, height, 0.0f, caps->originBottomLeft);
-	sm.submit(program, view, 0, BGFX_STATE_WRITE_RGB | BGFX_STATE_WRITE_A);
+
+	// Each level keeps the farthest depth of 2x2 texels of the previous one
+	for (u32 i = 0; i < _num_occlusion_levels; ++i)
+	{
+		const u8 view = u8(VIEW_OCCLUSION + i);
+		const u16 src_w = _occlusion_sizes[i][0];
+		const u16 src_h = _occlusion_sizes[i][1];
+		const u16 dst_w = _occlusion_sizes[i + 1][0];
+		const u16 dst_h = _occlusion_sizes[i + 1][1];
+
+		bgfx::setViewFrameBuffer(view, _occlusion_frame_buffers[i]);
+		bgfx::setViewRect(view, 0, 0, dst_w, dst_h);
+		bgfx::setViewTransform(view, NULL, ortho);
+
+		// The worlds cover only a region of the depth when the resolution
+		// is scaled
+		const u16 region_w = i == 0 ? _scene_width : src_w;
+		const u16 region_h = i == 0 ? _scene_height : src_h;
+		const u16 region_y = i == 0 && caps->originBottomLeft ? src_h - region_h : 0;
+
+		const f32 size[] = { f32(src_w), f32(src_h), f32(dst_w), f32(dst_h) };
+		const f32 region[] = { 0.0f, f32(region_y), f32(region_w), f32(region_h) };
+		bgfx::setUniform(_u_occlusion_size, size);
+		bgfx::setUniform(_u_occlusion_region, region);
+		bgfx::setTexture(0, _u_occlusion_depth, i == 0 ? _depth : _occlusion_levels[i - 1], samplerFlags);
+		screenSpaceQuad(dst_w, dst_h, 0.0f, caps->originBottomLeft);
+		sm.submit("occlusion"_id32, view, 0, BGFX_STATE_WRITE_R);
+	}
+
+	// Blits are executed before the draws of their view
+	const u8 blit_view = u8(VIEW_OCCLUSION + _num_occlusion_levels);
+	bgfx::touch(blit_view);
+	bgfx::blit(blit_view, _occlusion_readback, 0, 0, _occlusion_levels[_num_occlusion_levels - 1]);
+	_occlusion_frame = bgfx::readTexture(_occlusion_readback, _occlusion_data);
+	_occlusion_view_proj = view_proj;
+}
+
+void Pipeline::prewarm(ShaderManager& sm, const StringId32* shaders, u32 num)
+{
+	bgfx::setViewFrameBuffer(VIEW_PREWARM, _frame_buffer);
+	bgfx::setViewRect(VIEW_PREWARM, 0, 0, 1, 1);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const bool instanced = sm.has_instancing(shaders[i]);
+
+		for (u32 j = 0; j < (instanced ? 2u : 1u); ++j)
+		{
+			if (bgfx::getAvailTransientVertexBuffer(3, PosTexCoord0Vertex::ms_decl) != 3)
+				return;
+
+			bgfx::TransientVertexBuffer tvb;
+			bgfx::allocTransientVertexBuffer(&tvb, 3, PosTexCoord0Vertex::ms_decl);
+			memset(tvb.data, 0, tvb.size);
+			bgfx::setVertexBuffer(0, &tvb);
+
+			if (j == 1)
+			{
+				if (bgfx::getAvailInstanceDataBuffer(1, sizeof(Matrix4x4)) != 1)
+					return;
+
+				bgfx::InstanceDataBuffer idb;
+				bgfx::allocInstanceDataBuffer(&idb, 1, sizeof(Matrix4x4));
+				memcpy(idb.data, &MATRIX4X4_IDENTITY, sizeof(Matrix4x4));
+				bgfx::setInstanceDataBuffer(&idb);
+			}
+
+			sm.submit(shaders[i], VIEW_PREWARM, 0, UINT64_MAX, j == 1);
+		}
+	}
+}
+
+void Pipeline::frame(u32 frame_num)
+{
+	if (_occlusion_frame == UINT32_MAX || frame_num < _occlusion_frame)
+		return;
+
+	const bgfx::Caps* caps = bgfx::getCaps();
+	_occlusion_buffer.set(_occlusion_data
+		, _occlusion_sizes[_num_occlusion_levels][0]
+		, _occlusion_sizes[_num_occlusion_levels][1]
+		, _occlusion_view_proj
+		, caps->homogeneousDepth
+		, caps->originBottomLeft
+		);
+	_occlusion_frame = UINT32_MAX;
 }
 
 } // namespace crown
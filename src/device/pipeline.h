@@ -5,43 +5,158 @@
 
 #pragma once
 
+#include "config.h"
+#include "core/math/types.h"
+#include "core/memory/types.h"
+#include "resource/render_graph_resource.h"
+#include "world/occlusion_buffer.h"
 #include "world/types.h"
 #include <bgfx/bgfx.h>
 
-#define VIEW_SPRITE_0   1
-#define VIEW_SPRITE_1   2
-#define VIEW_SPRITE_2   3
-#define VIEW_SPRITE_3   4
-#define VIEW_SPRITE_4   5
-#define VIEW_SPRITE_5   6
-#define VIEW_SPRITE_6   7
-#define VIEW_SPRITE_7   8
-#define VIEW_MESH      16
-#define VIEW_DEBUG     17
+#define VIEW_PREWARM    0
+#define VIEW_SHADOW     1 // First of MAX_SHADOW_VIEWS views
+#define VIEW_SPRITE_0  64 // Views from VIEW_SPRITE_0 to VIEW_MESH are the ones of the first camera,
+#define VIEW_SPRITE_1  65 // each of the next cameras uses the following VIEW_CAMERA_NUM views
+#define VIEW_SPRITE_2  66
+#define VIEW_SPRITE_3  67
+#define VIEW_SPRITE_4  68
+#define VIEW_SPRITE_5  69
+#define VIEW_SPRITE_6  70
+#define VIEW_SPRITE_7  71
+#define VIEW_MESH      72
+#define VIEW_CAMERAS   73 // First of MAX_CAMERAS_VIEWS views of the cameras after the first
+#define VIEW_OCCLUSION 100 // First of MAX_OCCLUSION_VIEWS views
+#define VIEW_DEBUG     108 // First of CROWN_MAX_CAMERAS views
+#define VIEW_UPSCALE   112
 #define VIEW_GUI      128
-#define VIEW_IMGUI    129
+#define VIEW_POST     130 // First of MAX_POST_VIEWS views
+#define VIEW_IMGUI    250
+
+#define MAX_SHADOW_VIEWS    56
+#define MAX_OCCLUSION_VIEWS 8
+#define MAX_POST_VIEWS      32
+#define VIEW_CAMERA_NUM     (VIEW_MESH - VIEW_SPRITE_0 + 1)
+#define MAX_CAMERAS_VIEWS   ((CROWN_MAX_CAMERAS - 1)*VIEW_CAMERA_NUM)
+
+#if VIEW_SPRITE_0 + CROWN_MAX_CAMERAS*VIEW_CAMERA_NUM > VIEW_OCCLUSION || VIEW_DEBUG + CROWN_MAX_CAMERAS > VIEW_UPSCALE
+	#error "Too many cameras for the views"
+#endif
 
 namespace crown
 {
+/// Renders the frame as described by a render graph.
+///
+/// Passes which do not contribute to the back buffer are culled when the
+/// graph is built. Targets are then assigned to physical textures, and
+/// targets whose lifetimes do not overlap share the same texture when they
+/// have the same format and scale.
 struct Pipeline
 {
-	bgfx::TextureHandle _buffers[2];
-	bgfx::FrameBufferHandle _frame_buffer;
-	bgfx::UniformHandle _tex_color;
+	struct RenderTexture
+	{
+		bgfx::TextureHandle texture;
+		u32 format;
+		f32 scale;
+		u32 last_pass; ///< Last live pass which uses the texture.
+	};
+
+	struct RenderPass
+	{
+		const RenderGraphPass* pass;
+		bgfx::FrameBufferHandle frame_buffer; ///< Invalid if the pass writes the back buffer.
+		bgfx::UniformHandle samplers[RENDER_GRAPH_MAX_INPUTS];
+	};
+
+	const RenderGraphResource* _graph;
+	RenderTexture _textures[RENDER_GRAPH_MAX_TARGETS];
+	u32 _num_textures;
+	u32 _target_texture[RENDER_GRAPH_MAX_TARGETS]; ///< Texture of each target, UINT32_MAX if unused.
+	RenderPass _passes[RENDER_GRAPH_MAX_PASSES];   ///< Live passes, the scene pass first.
+	u32 _num_passes;
+	bgfx::FrameBufferHandle _frame_buffer; ///< Frame buffer of the scene pass.
+	bgfx::TextureHandle _color;            ///< Color target of the scene pass.
+	bgfx::TextureHandle _depth;            ///< Depth target of the scene pass.
 
-	Pipeline();
+	bgfx::TextureHandle _scaled_color;           ///< Color of the worlds when the resolution is dynamic.
+	bgfx::FrameBufferHandle _scaled_frame_buffer;
+	bgfx::FrameBufferHandle _scene_frame_buffer; ///< Frame buffer the worlds are rendered to.
+	bgfx::UniformHandle _u_upscale;
+	bgfx::UniformHandle _u_upscale_color;
+	f32 _resolution_scale;
+	f32 _resolution_min_scale;
+	f32 _resolution_max_scale;
+	f32 _resolution_gpu_time; ///< Target GPU time in milliseconds, 0 if the resolution is fixed.
+	u16 _scene_width;         ///< Size of the region of the targets the worlds are rendered to.
+	u16 _scene_height;
+	u64 _target_memory;       ///< Estimated bytes of GPU memory used by the targets.
+
+	bgfx::UniformHandle _u_occlusion_depth;
+	bgfx::UniformHandle _u_occlusion_size;
+	bgfx::UniformHandle _u_occlusion_region;
+	bgfx::TextureHandle _occlusion_levels[MAX_OCCLUSION_VIEWS - 1]; ///< Farthest depth of 2x2 texels of the previous level.
+	bgfx::FrameBufferHandle _occlusion_frame_buffers[MAX_OCCLUSION_VIEWS - 1];
+	bgfx::TextureHandle _occlusion_readback;
+	u16 _occlusion_sizes[MAX_OCCLUSION_VIEWS][2]; ///< Size of the depth buffer followed by the size of each level.
+	u32 _num_occlusion_levels;
+	u32 _occlusion_frame;            ///< Frame at which the pending readback completes, UINT32_MAX if none.
+	Matrix4x4 _occlusion_view_proj;  ///< View-projection of the pending readback.
+	f32 _occlusion_data[CROWN_OCCLUSION_BUFFER_WIDTH*CROWN_OCCLUSION_BUFFER_HEIGHT];
+	OcclusionBuffer _occlusion_buffer;
+	u64 _occlusion_memory;           ///< Estimated bytes of GPU memory used by the occlusion levels and readback.
 
 	///
-	void create(uint16_t width, uint16_t height);
+	Pipeline(Allocator& a);
+
+	/// Builds the passes of @a graph and creates their targets with the
+	/// back buffer size @a width and @a height.
+	void create(const RenderGraphResource* graph, u16 width, u16 height);
 
 	///
 	void destroy();
 
-	///
+	/// Recreates the targets with the back buffer size @a width and @a height.
 	void reset(u16 width, u16 height);
 
-	///
-	void render(ShaderManager& sm, StringId32 program, uint8_t view, uint16_t width, uint16_t height);
+	void create_targets(u16 width, u16 height);
+	void destroy_targets();
+
+	void create_occlusion(u16 width, u16 height);
+	void destroy_occlusion();
+
+	/// Enables the dynamic resolution: the worlds are rendered to a region
+	/// of the targets whose size is scaled between @a min_scale and
+	/// @a max_scale of the back buffer so that the frame takes @a gpu_time
+	/// milliseconds on the GPU. The region is upscaled before the gui is
+	/// rendered. Must be called before create().
+	void set_dynamic_resolution(f32 min_scale, f32 max_scale, f32 gpu_time);
+
+	/// Updates the scale of the resolution from the GPU time of the last
+	/// frames and sets the size of the region the worlds are rendered to.
+	void update_resolution(u16 width, u16 height);
+
+	/// Stretches the region the worlds are rendered to over the targets of
+	/// the scene pass, if the resolution is dynamic.
+	void upscale(ShaderManager& sm, u16 width, u16 height);
+
+	/// Renders the live fullscreen passes, each in one of the post views,
+	/// after the worlds have been rendered to the targets of the scene pass.
+	void render(ShaderManager& sm, u16 width, u16 height);
+
+	/// Downsamples the depth rendered with @a view_proj to a hierarchical
+	/// depth buffer and reads it back to _occlusion_buffer, unless a
+	/// readback is already in progress.
+	void render_occlusion(ShaderManager& sm, const Matrix4x4& view_proj);
+
+	/// Notifies that the frame @a frame_num has started, so that a
+	/// completed readback can be used.
+	void frame(u32 frame_num);
+
+	/// Issues a draw with each of the @a num @a shaders, and with their
+	/// instanced variants, to the frame buffer the meshes are rendered to.
+	/// Drivers which compile the programs, or the pipeline states, at first
+	/// use do it now instead of when they are first drawn. The draws are
+	/// degenerate triangles which produce no fragments.
+	void prewarm(ShaderManager& sm, const StringId32* shaders, u32 num);
 };
 
 } // namespace crown
@@ -4,11 +4,21 @@
  */
 
 #include "core/containers/array.h"
+#include "core/error/error.h"
 #include "core/math/vector3.h"
 #include "core/memory/memory.h"
+#include "core/memory/temp_allocator.h"
 #include "core/os.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
+#include "core/strings/string_id.h"
+#include "core/strings/string_stream.h"
 #include "core/thread/mutex.h"
+#include "core/thread/spinlock.h"
 #include "device/profiler.h"
+#include <stdio.h>  // snprintf
+#include <stdlib.h> // malloc, free
+#include <string.h> // memcpy, memset, strlen
 
 namespace crown
 {
@@ -24,6 +34,9 @@ namespace profiler_globals
 
 	void shutdown()
 	{
+		// The threads still running keep their buffers
+		profiler::release_thread_buffer();
+
 		_buffer->~Buffer();
 		_buffer = NULL;
 	}
@@ -33,36 +46,253 @@ namespace profiler_globals
 		return array::begin(*_buffer);
 	}
 
+	u32 buffer_size()
+	{
+		return array::size(*_buffer);
+	}
+
 } // namespace profiler_globals
 
 namespace profiler
 {
 	enum { THREAD_BUFFER_SIZE = 4 * 1024 };
-	static char _thread_buffer[THREAD_BUFFER_SIZE];
-	static u32 _thread_buffer_size = 0;
+
+	// Events recorded by a thread. The buffers of all the threads are
+	// registered so that profiler_globals::flush() can collect them.
+	struct ThreadBuffer
+	{
+		Spinlock lock;
+		ThreadBuffer* next;
+		const char* name;
+		u32 id;
+		u32 size;
+		char data[THREAD_BUFFER_SIZE];
+	};
+
+	static CE_THREAD ThreadBuffer* _thread_buffer = NULL;
+	static ThreadBuffer* _thread_buffers = NULL;
+	static u32 _next_thread_id = 0;
 	static Mutex _buffer_mutex;
 
-	static void flush_local_buffer()
+	// Buffers are malloc()'d because allocators record profiler events
+	// themselves.
+	static ThreadBuffer* thread_buffer()
+	{
+		if (_thread_buffer != NULL)
+			return _thread_buffer;
+
+		ThreadBuffer* tb = (ThreadBuffer*)malloc(sizeof(ThreadBuffer));
+		CE_ENSURE(tb != NULL);
+		new (&tb->lock) Spinlock();
+		tb->name = NULL;
+		tb->size = 0;
+
+		ScopedMutex sm(_buffer_mutex);
+		tb->id = _next_thread_id++;
+		tb->next = _thread_buffers;
+		_thread_buffers = tb;
+		_thread_buffer = tb;
+		return tb;
+	}
+
+	// Moves the events of @a tb to the global buffer, prefixed by the
+	// thread they belong to. _buffer_mutex must be locked.
+	static void flush_buffer(ThreadBuffer& tb)
+	{
+		ScopedSpinlock sl(tb.lock);
+		if (tb.size == 0)
+			return;
+
+		if (profiler_globals::_buffer != NULL)
+		{
+			ProfilerThread ev;
+			ev.id = tb.id;
+			ev.name = tb.name;
+
+			const u32 header[] = { ProfilerEventType::PROFILER_THREAD, (u32)sizeof(ev) };
+			array::push(*profiler_globals::_buffer, (const char*)header, (u32)sizeof(header));
+			array::push(*profiler_globals::_buffer, (const char*)&ev, (u32)sizeof(ev));
+			array::push(*profiler_globals::_buffer, tb.data, tb.size);
+		}
+		tb.size = 0;
+	}
+
+	void flush_local_buffer()
+	{
+		if (_thread_buffer == NULL)
+			return;
+
+		ScopedMutex sm(_buffer_mutex);
+		flush_buffer(*_thread_buffer);
+	}
+
+	void set_thread_name(const char* name)
+	{
+		ThreadBuffer* tb = thread_buffer();
+		ScopedSpinlock sl(tb->lock);
+		tb->name = name;
+	}
+
+	// Slots of the counters of a thread. The values are only written by
+	// the thread, record_counters() finds out what has been added since
+	// the previous frame by comparing them to those it read last time.
+	struct CounterSlots
+	{
+		CounterSlots* next;
+		u64 value[CROWN_PROFILER_COUNTER_SLOTS];
+		u64 read[CROWN_PROFILER_COUNTER_SLOTS];
+	};
+
+	CE_THREAD u64* _counter_slots = NULL;
+	static CE_THREAD CounterSlots* _thread_counter_slots = NULL;
+	static CounterSlots* _all_counter_slots = NULL;
+	static ProfilerCounter* _counters = NULL;
+	static u32 _num_counter_slots = ProfilerCounter::HISTOGRAM_SLOTS; // The first slots take the counters that do not fit.
+	static u64 _retired[CROWN_PROFILER_COUNTER_SLOTS]; // Added by the threads exited since the last record_counters().
+	static u64 _totals[CROWN_PROFILER_COUNTER_SLOTS];
+	static Mutex _counter_mutex;
+
+	u64* counter_slots()
+	{
+		CounterSlots* cs = (CounterSlots*)malloc(sizeof(CounterSlots));
+		CE_ENSURE(cs != NULL);
+		memset(cs, 0, sizeof(*cs));
+
+		ScopedMutex sm(_counter_mutex);
+		cs->next = _all_counter_slots;
+		_all_counter_slots = cs;
+		_thread_counter_slots = cs;
+		_counter_slots = cs->value;
+		return cs->value;
+	}
+
+	// Frees the counter slots of the calling thread, keeping what it added.
+	static void release_counter_slots()
+	{
+		CounterSlots* cs = _thread_counter_slots;
+		if (cs == NULL)
+			return;
+
+		ScopedMutex sm(_counter_mutex);
+		for (u32 i = 0; i < _num_counter_slots; ++i)
+			_retired[i] += cs->value[i] - cs->read[i];
+
+		CounterSlots** cur = &_all_counter_slots;
+		while (*cur != cs)
+			cur = &(*cur)->next;
+		*cur = cs->next;
+
+		free(cs);
+		_thread_counter_slots = NULL;
+		_counter_slots = NULL;
+	}
+
+	// Returns the largest value of the bucket which holds the fraction
+	// @a p of the @a count values in the histogram @a buckets.
+	static f32 percentile(const u64* buckets, u64 count, f64 p)
 	{
+		const u64 rank = u64(f64(count) * p);
+		u64 num = 0;
+		for (u32 i = 0; i < ProfilerCounter::NUM_BUCKETS; ++i)
+		{
+			num += buckets[i];
+			if (num > rank)
+				return i == 0 ? 0.0f : f32((u64(1) << i) - 1);
+		}
+		return 0.0f;
+	}
+
+	void record_counters()
+	{
+		const ProfilerCounter* counters;
+		{
+			ScopedMutex sm(_counter_mutex);
+			counters = _counters;
+
+			// Slots are read while their threads add to them, which is
+			// safe as long as 64-bit loads are atomic
+			memcpy(_totals, _retired, _num_counter_slots * sizeof(u64));
+			memset(_retired, 0, _num_counter_slots * sizeof(u64));
+			for (CounterSlots* cs = _all_counter_slots; cs != NULL; cs = cs->next)
+			{
+				for (u32 i = 0; i < _num_counter_slots; ++i)
+				{
+					const u64 value = cs->value[i];
+					_totals[i] += value - cs->read[i];
+					cs->read[i] = value;
+				}
+			}
+		}
+
+		// Counters are only ever prepended, the list from the head read
+		// above does not change
+		for (const ProfilerCounter* c = counters; c != NULL; c = c->next)
+		{
+			const u64* slots = &_totals[c->slot];
+
+			if (c->type == ProfilerCounter::COUNTER)
+			{
+				record_float(c->name, f32(slots[0]));
+				continue;
+			}
+
+			u64 count = 0;
+			for (u32 i = 0; i < ProfilerCounter::NUM_BUCKETS; ++i)
+				count += slots[i];
+			const u64 sum = slots[ProfilerCounter::NUM_BUCKETS];
+
+			record_float(c->stat_names[0], f32(count));
+			record_float(c->stat_names[1], count > 0 ? f32(f64(sum) / f64(count)) : 0.0f);
+			record_float(c->stat_names[2], percentile(slots, count, 0.50));
+			record_float(c->stat_names[3], percentile(slots, count, 0.90));
+			record_float(c->stat_names[4], percentile(slots, count, 0.99));
+		}
+	}
+
+	void release_thread_buffer()
+	{
+		release_counter_slots();
+
+		ThreadBuffer* tb = _thread_buffer;
+		if (tb == NULL)
+			return;
+
 		ScopedMutex sm(_buffer_mutex);
-		array::push(*profiler_globals::_buffer, _thread_buffer, _thread_buffer_size);
-		_thread_buffer_size = 0;
+		flush_buffer(*tb);
+
+		ThreadBuffer** cur = &_thread_buffers;
+		while (*cur != tb)
+			cur = &(*cur)->next;
+		*cur = tb->next;
+
+		tb->lock.~Spinlock();
+		free(tb);
+		_thread_buffer = NULL;
 	}
 
 	template <typename T>
 	static void push(ProfilerEventType::Enum type, const T& ev)
 	{
-		if (_thread_buffer_size + 2*sizeof(u32) + sizeof(ev) >= THREAD_BUFFER_SIZE)
+		ThreadBuffer* tb = thread_buffer();
+		tb->lock.lock();
+
+		if (tb->size + 2*sizeof(u32) + sizeof(ev) >= THREAD_BUFFER_SIZE)
+		{
+			// _buffer_mutex must be taken before the spinlock
+			tb->lock.unlock();
 			flush_local_buffer();
+			tb->lock.lock();
+		}
 
-		char* p = _thread_buffer + _thread_buffer_size;
+		char* p = tb->data + tb->size;
 		*(u32*)p = type;
 		p += sizeof(u32);
 		*(u32*)p = sizeof(ev);
 		p += sizeof(u32);
 		*(T*)p = ev;
 
-		_thread_buffer_size += 2*sizeof(u32) + sizeof(ev);
+		tb->size += 2*sizeof(u32) + sizeof(ev);
+		tb->lock.unlock();
 	}
 
 	void enter_profile_scope(const char* name)
@@ -118,22 +348,314 @@ namespace profiler
 		push(ProfilerEventType::DEALLOCATE_MEMORY, ev);
 	}
 
+	void record_resource_load(const RecordResourceLoad& ev)
+	{
+		push(ProfilerEventType::RECORD_RESOURCE_LOAD, ev);
+	}
+
+	void record_samples(const char* stack, u32 num)
+	{
+		RecordSamples ev;
+		ev.stack = stack;
+		ev.num = num;
+
+		push(ProfilerEventType::RECORD_SAMPLES, ev);
+	}
+
 } // namespace profiler
 
+ProfilerCounter::ProfilerCounter(const char* name, Type type)
+	: name(name)
+	, type(type)
+	, slot(0)
+	, next(NULL)
+{
+	memset(stat_names, 0, sizeof(stat_names));
+
+	if (type == HISTOGRAM)
+	{
+		// Names are never freed, like the counters
+		static const char* suffixes[] = { ".count", ".mean", ".p50", ".p90", ".p99" };
+		CE_STATIC_ASSERT(countof(suffixes) == countof(stat_names));
+		const u32 len = strlen32(name) + 7;
+		char* names = (char*)malloc(countof(suffixes) * len);
+		CE_ENSURE(names != NULL);
+		for (u32 i = 0; i < countof(suffixes); ++i)
+		{
+			snprintf(&names[i*len], len, "%s%s", name, suffixes[i]);
+			stat_names[i] = &names[i*len];
+		}
+	}
+
+	const u32 num = type == HISTOGRAM ? (u32)HISTOGRAM_SLOTS : 1u;
+
+	ScopedMutex sm(profiler::_counter_mutex);
+	CE_ASSERT(profiler::_num_counter_slots + num <= CROWN_PROFILER_COUNTER_SLOTS
+		, "Too many profiler counters, increase CROWN_PROFILER_COUNTER_SLOTS"
+		);
+	if (profiler::_num_counter_slots + num > CROWN_PROFILER_COUNTER_SLOTS)
+		return;
+
+	slot = profiler::_num_counter_slots;
+	profiler::_num_counter_slots += num;
+	next = profiler::_counters;
+	profiler::_counters = this;
+}
+
 namespace profiler_globals
 {
 	void flush()
 	{
-		profiler::flush_local_buffer();
+		profiler::record_counters();
+
 		u32 end = ProfilerEventType::COUNT;
+		ScopedMutex sm(profiler::_buffer_mutex);
+		for (profiler::ThreadBuffer* tb = profiler::_thread_buffers; tb != NULL; tb = tb->next)
+			profiler::flush_buffer(*tb);
 		array::push(*_buffer, (const char*)&end, (u32)sizeof(end));
 	}
 
 	void clear()
 	{
+		ScopedMutex sm(profiler::_buffer_mutex);
 		array::clear(*_buffer);
 	}
 
+	static void write_resource_id(StringStream& json, const char* key, StringId64 id)
+	{
+		TempAllocator64 ta;
+		DynamicString str(ta);
+		id.to_string(str);
+		json << "\"" << key << "\":\"" << str.c_str() << "\"";
+	}
+
+	void to_json(StringStream& json)
+	{
+		json << "{\"type\":\"profiler\",\"frequency\":" << os::clockfrequency() << ",\"events\":[";
+
+		const char* cur = array::begin(*_buffer);
+		const char* end = array::end(*_buffer);
+		u32 thread = 0;
+		bool comma = false;
+		while (cur < end)
+		{
+			const u32 type = *(u32*)cur;
+			if (type == ProfilerEventType::COUNT)
+				break;
+
+			const u32 size = *(u32*)(cur + sizeof(u32));
+			const char* data = cur + 2*sizeof(u32);
+			cur = data + size;
+
+			// The events that follow belong to this thread
+			if (type == ProfilerEventType::PROFILER_THREAD)
+			{
+				thread = ((const ProfilerThread*)data)->id;
+				continue;
+			}
+
+			if (comma)
+				json << ",";
+			comma = true;
+
+			json << "{\"thread\":" << thread << ",";
+
+			switch (type)
+			{
+			case ProfilerEventType::ENTER_PROFILE_SCOPE:
+				{
+					const EnterProfileScope* ev = (const EnterProfileScope*)data;
+					json << "\"type\":\"enter_profile_scope\",\"name\":\"" << ev->name << "\",\"time\":" << ev->time << "}";
+				}
+				break;
+
+			case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+				{
+					const LeaveProfileScope* ev = (const LeaveProfileScope*)data;
+					json << "\"type\":\"leave_profile_scope\",\"time\":" << ev->time << "}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_FLOAT:
+				{
+					const RecordFloat* ev = (const RecordFloat*)data;
+					json << "\"type\":\"record_float\",\"name\":\"" << ev->name << "\",\"value\":" << ev->value << "}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_VECTOR3:
+				{
+					const RecordVector3* ev = (const RecordVector3*)data;
+					json << "\"type\":\"record_vector3\",\"name\":\"" << ev->name << "\",\"value\":["
+						<< ev->value.x << "," << ev->value.y << "," << ev->value.z << "]}";
+				}
+				break;
+
+			case ProfilerEventType::ALLOCATE_MEMORY:
+				{
+					const AllocateMemory* ev = (const AllocateMemory*)data;
+					json << "\"type\":\"allocate_memory\",\"name\":\"" << ev->name << "\",\"size\":" << ev->size << "}";
+				}
+				break;
+
+			case ProfilerEventType::DEALLOCATE_MEMORY:
+				{
+					const DeallocateMemory* ev = (const DeallocateMemory*)data;
+					json << "\"type\":\"deallocate_memory\",\"name\":\"" << ev->name << "\",\"size\":" << ev->size << "}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_RESOURCE_LOAD:
+				{
+					const RecordResourceLoad* ev = (const RecordResourceLoad*)data;
+					json << "\"type\":\"record_resource_load\",";
+					write_resource_id(json, "resource_type", ev->type);
+					json << ",";
+					write_resource_id(json, "resource_name", ev->name);
+					json << ",\"size\":"           << ev->size;
+					json << ",\"time_requested\":" << ev->time_requested;
+					json << ",\"time_started\":"   << ev->time_started;
+					json << ",\"time_opened\":"    << ev->time_opened;
+					json << ",\"time_loaded\":"    << ev->time_loaded;
+					json << ",\"time_online\":"    << ev->time_online;
+					json << ",\"time_completed\":" << ev->time_completed;
+					json << "}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_SAMPLES:
+				{
+					const RecordSamples* ev = (const RecordSamples*)data;
+					json << "\"type\":\"record_samples\",\"stack\":\"" << ev->stack << "\",\"num\":" << ev->num << "}";
+				}
+				break;
+
+			default:
+				CE_FATAL("Unknown profiler event type");
+				break;
+			}
+		}
+
+		json << "],\"threads\":[";
+		{
+			ScopedMutex sm(profiler::_buffer_mutex);
+			for (profiler::ThreadBuffer* tb = profiler::_thread_buffers; tb != NULL; tb = tb->next)
+			{
+				json << "{\"id\":" << tb->id << ",\"name\":\"" << (tb->name != NULL ? tb->name : "") << "\"}";
+				if (tb->next != NULL)
+					json << ",";
+			}
+		}
+		json << "]}";
+	}
+
+	// Writes @a ticks in microseconds, the shortest form would often
+	// need more digits than the clock resolution.
+	static void write_us(StringStream& json, s64 ticks, f64 us)
+	{
+		string_stream::stream_fixed(json, f64(ticks) * us, 3);
+	}
+
+	void to_chrome_trace(StringStream& json)
+	{
+		const f64 us = 1000000.0 / f64(os::clockfrequency());
+
+		const char* cur = array::begin(*_buffer);
+		const char* end = array::end(*_buffer);
+		u32 thread = 0;
+		s64 time = os::clocktime();
+		while (cur < end)
+		{
+			const u32 type = *(u32*)cur;
+			if (type == ProfilerEventType::COUNT)
+				break;
+
+			const u32 size = *(u32*)(cur + sizeof(u32));
+			const char* data = cur + 2*sizeof(u32);
+			cur = data + size;
+
+			switch (type)
+			{
+			case ProfilerEventType::PROFILER_THREAD:
+				{
+					const ProfilerThread* ev = (const ProfilerThread*)data;
+					thread = ev->id;
+					if (ev->name != NULL)
+					{
+						json << ",{\"ph\":\"M\",\"pid\":0,\"tid\":" << thread
+							<< ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << ev->name << "\"}}";
+					}
+				}
+				break;
+
+			case ProfilerEventType::ENTER_PROFILE_SCOPE:
+				{
+					const EnterProfileScope* ev = (const EnterProfileScope*)data;
+					time = ev->time;
+					json << ",{\"ph\":\"B\",\"pid\":0,\"tid\":" << thread << ",\"ts\":";
+					write_us(json, time, us);
+					json << ",\"name\":\"" << ev->name << "\"}";
+				}
+				break;
+
+			case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+				{
+					const LeaveProfileScope* ev = (const LeaveProfileScope*)data;
+					time = ev->time;
+					json << ",{\"ph\":\"E\",\"pid\":0,\"tid\":" << thread << ",\"ts\":";
+					write_us(json, time, us);
+					json << "}";
+				}
+				break;
+
+			// Records carry no time, use the one of the last scope event
+			case ProfilerEventType::RECORD_FLOAT:
+				{
+					const RecordFloat* ev = (const RecordFloat*)data;
+					json << ",{\"ph\":\"C\",\"pid\":0,\"tid\":" << thread << ",\"ts\":";
+					write_us(json, time, us);
+					json << ",\"name\":\"" << ev->name << "\",\"args\":{\"value\":" << ev->value << "}}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_VECTOR3:
+				{
+					const RecordVector3* ev = (const RecordVector3*)data;
+					json << ",{\"ph\":\"C\",\"pid\":0,\"tid\":" << thread << ",\"ts\":";
+					write_us(json, time, us);
+					json << ",\"name\":\"" << ev->name << "\",\"args\":{\"x\":" << ev->value.x << ",\"y\":" << ev->value.y << ",\"z\":" << ev->value.z << "}}";
+				}
+				break;
+
+			case ProfilerEventType::RECORD_RESOURCE_LOAD:
+				{
+					const RecordResourceLoad* ev = (const RecordResourceLoad*)data;
+					json << ",{\"ph\":\"X\",\"pid\":0,\"tid\":" << thread << ",\"ts\":";
+					write_us(json, ev->time_requested, us);
+					json << ",\"dur\":";
+					write_us(json, ev->time_completed - ev->time_requested, us);
+					json << ",\"name\":\"resource_load\",\"args\":{";
+					write_resource_id(json, "resource_type", ev->type);
+					json << ",";
+					write_resource_id(json, "resource_name", ev->name);
+					json << ",\"size\":" << ev->size << "}}";
+				}
+				break;
+
+			// Too many to be useful on a timeline
+			case ProfilerEventType::ALLOCATE_MEMORY:
+			case ProfilerEventType::DEALLOCATE_MEMORY:
+			// Not representable as trace events
+			case ProfilerEventType::RECORD_SAMPLES:
+				break;
+
+			default:
+				CE_FATAL("Unknown profiler event type");
+				break;
+			}
+		}
+	}
+
 } // namespace profiler_globals
 
 } // namespace crown
@@ -5,8 +5,14 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/math/types.h"
+#include "core/strings/string_id.h"
+#include "core/strings/types.h"
 #include "core/types.h"
+#if CROWN_COMPILER_MSVC
+	#include <intrin.h> // _BitScanReverse
+#endif
 
 namespace crown
 {
@@ -23,6 +29,9 @@ struct ProfilerEventType
 		RECORD_VECTOR3,
 		ALLOCATE_MEMORY,
 		DEALLOCATE_MEMORY,
+		RECORD_RESOURCE_LOAD,
+		RECORD_SAMPLES,
+		PROFILER_THREAD,
 
 		COUNT
 	};
@@ -63,6 +72,64 @@ struct DeallocateMemory
 	u32 size;
 };
 
+/// Timeline of a resource load. Times are in os::clocktime() ticks.
+struct RecordResourceLoad
+{
+	StringId64 type;
+	StringId64 name;
+	u32 size;             ///< Bytes read.
+	s64 time_requested;   ///< The request has been queued.
+	s64 time_started;     ///< A loader thread has started serving the request.
+	s64 time_opened;      ///< The resource file has been opened.
+	s64 time_loaded;      ///< The load function has returned.
+	s64 time_online;      ///< The resource manager has started bringing the resource online.
+	s64 time_completed;   ///< The resource is online.
+};
+
+/// Number of times a call stack has been sampled by a sampling profiler.
+struct RecordSamples
+{
+	const char* stack; ///< Frames separated by ';', outermost first.
+	u32 num;
+};
+
+/// Marks the start of the events recorded by a thread.
+struct ProfilerThread
+{
+	u32 id;           ///< Unique id, in order of the first event recorded by the thread.
+	const char* name; ///< Name set with profiler::set_thread_name() or NULL.
+};
+
+/// Named counter or histogram updated from hot paths, see
+/// CE_COUNTER_ADD() and CE_COUNTER_HISTOGRAM().
+///
+/// Each thread adds to slots of its own with a plain add. Once per frame,
+/// profiler_globals::flush() sums what the threads added since the
+/// previous frame and records it with record_float(): counters as
+/// their name, histograms as "<name>.count", "<name>.mean", "<name>.p50",
+/// "<name>.p90" and "<name>.p99". Percentiles are approximated by the
+/// largest value of their bucket.
+///
+/// @ingroup Device
+struct ProfilerCounter
+{
+	enum Type { COUNTER, HISTOGRAM };
+
+	/// A histogram has a slot for the values equal to 0, one for each
+	/// range [2^(i-1), 2^i) and one for the sum of the values.
+	enum { NUM_BUCKETS = 33, HISTOGRAM_SLOTS = NUM_BUCKETS + 1 };
+
+	const char* name;
+	Type type;
+	u32 slot;                  ///< Index of the first slot.
+	const char* stat_names[5]; ///< Names of the values recorded for a histogram.
+	ProfilerCounter* next;
+
+	/// Registers the counter. @a name must be valid for the lifetime of
+	/// the program.
+	ProfilerCounter(const char* name, Type type);
+};
+
 /// Functions to access profiler.
 ///
 /// @ingroup Device
@@ -91,6 +158,66 @@ namespace profiler
 	/// Records a memory deallocation of @a size with the given @a name.
 	void deallocate_memory(const char* name, u32 size);
 
+	/// Records the timeline @a ev of a resource load.
+	void record_resource_load(const RecordResourceLoad& ev);
+
+	/// Records that the call @a stack has been sampled @a num times.
+	void record_samples(const char* stack, u32 num);
+
+	/// Moves the events recorded by the calling thread to the global
+	/// buffer. Events are recorded in a per-thread buffer which is
+	/// flushed when full and by profiler_globals::flush().
+	void flush_local_buffer();
+
+	/// Sets the @a name of the calling thread in the profiler data.
+	void set_thread_name(const char* name);
+
+	/// Flushes and frees the buffer of the calling thread.
+	/// Called automatically when a Thread exits.
+	void release_thread_buffer();
+
+	extern CE_THREAD u64* _counter_slots;
+
+	/// Returns the counter slots of the calling thread, allocating them on first use.
+	u64* counter_slots();
+
+	/// Adds @a value to the counter @a c.
+	inline void counter_add(const ProfilerCounter& c, u64 value)
+	{
+		u64* slots = _counter_slots;
+		if (CE_UNLIKELY(slots == NULL))
+			slots = counter_slots();
+		slots[c.slot] += value;
+	}
+
+	/// Returns the bucket of the histograms @a value falls in.
+	inline u32 histogram_bucket(u32 value)
+	{
+		if (value == 0)
+			return 0;
+#if CROWN_COMPILER_MSVC
+		unsigned long msb;
+		_BitScanReverse(&msb, value);
+		return u32(msb) + 1;
+#else
+		return 32 - u32(__builtin_clz(value));
+#endif
+	}
+
+	/// Adds @a value to the histogram @a h.
+	inline void histogram_add(const ProfilerCounter& h, u32 value)
+	{
+		u64* slots = _counter_slots;
+		if (CE_UNLIKELY(slots == NULL))
+			slots = counter_slots();
+		slots[h.slot + histogram_bucket(value)] += 1;
+		slots[h.slot + ProfilerCounter::NUM_BUCKETS] += value;
+	}
+
+	/// Records the values added to the counters since the last call.
+	/// Called by profiler_globals::flush().
+	void record_counters();
+
 } // namespace profiler
 
 namespace profiler_globals
@@ -99,9 +226,20 @@ namespace profiler_globals
 	void shutdown();
 
 	const char* buffer();
+
+	/// Returns the size of the buffer in bytes.
+	u32 buffer_size();
 	void flush();
 	void clear();
 
+	/// Writes the events in the buffer to @a json.
+	void to_json(StringStream& json);
+
+	/// Writes the events in the buffer to @a json in the Chrome trace
+	/// event format. Each event is preceded by a comma, so that the
+	/// events of many frames can be appended to a JSON array.
+	void to_chrome_trace(StringStream& json);
+
 } // namespace profiler_globals
 
 } // namespace crown
@@ -113,6 +251,22 @@ namespace profiler_globals
 	#define RECORD_VECTOR3(name, value) profiler::record_vector3(name, value)
 	#define ALLOCATE_MEMORY(name, size) profiler::allocate_memory(name, size)
 	#define DEALLOCATE_MEMORY(name, size) profiler::deallocate_memory(name, size)
+	#define RECORD_RESOURCE_LOAD(ev) profiler::record_resource_load(ev)
+	#define CE_COUNTER_ADD(name, value)                                                          \
+		do                                                                                       \
+		{                                                                                        \
+			static crown::ProfilerCounter _ce_counter(name, crown::ProfilerCounter::COUNTER);    \
+			crown::profiler::counter_add(_ce_counter, value);                                    \
+		}                                                                                        \
+		while (0)
+	#define CE_COUNTER_INC(name) CE_COUNTER_ADD(name, 1)
+	#define CE_COUNTER_HISTOGRAM(name, value)                                                    \
+		do                                                                                       \
+		{                                                                                        \
+			static crown::ProfilerCounter _ce_counter(name, crown::ProfilerCounter::HISTOGRAM);  \
+			crown::profiler::histogram_add(_ce_counter, value);                                  \
+		}                                                                                        \
+		while (0)
 #else
 	#define ENTER_PROFILE_SCOPE(name) CE_NOOP()
 	#define LEAVE_PROFILE_SCOPE() CE_NOOP()
@@ -120,4 +274,8 @@ namespace profiler_globals
 	#define RECORD_VECTOR3(name, value) CE_NOOP()
 	#define ALLOCATE_MEMORY(name, size) CE_NOOP()
 	#define DEALLOCATE_MEMORY(name, size) CE_NOOP()
+	#define RECORD_RESOURCE_LOAD(ev) CE_NOOP()
+	#define CE_COUNTER_ADD(name, value) CE_NOOP()
+	#define CE_COUNTER_INC(name) CE_NOOP()
+	#define CE_COUNTER_HISTOGRAM(name, value) CE_NOOP()
 #endif // CROWN_DEBUG
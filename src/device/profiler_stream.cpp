@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/containers/queue.h"
+#include "core/error/error.h"
+#include "core/os.h"
+#include "device/profiler.h"
+#include "device/profiler_stream.h"
+#include <string.h> // memcpy, strlen
+
+namespace crown
+{
+namespace profiler_stream_internal
+{
+	static const u8 VERSION = 1;
+
+	static inline void write_u8(Buffer& out, u8 val)
+	{
+		array::push_back(out, (char)val);
+	}
+
+	static inline void write_varint(Buffer& out, u64 val)
+	{
+		while (val >= 0x80)
+		{
+			write_u8(out, u8(val | 0x80));
+			val >>= 7;
+		}
+		write_u8(out, u8(val));
+	}
+
+	static inline void write_zigzag(Buffer& out, s64 val)
+	{
+		write_varint(out, (u64(val) << 1) ^ u64(val >> 63));
+	}
+
+	static inline void write_raw(Buffer& out, const void* data, u32 size)
+	{
+		array::push(out, (const char*)data, size);
+	}
+
+	// Returns the id of the string @a str, sending it first if needed.
+	static u32 intern(ProfilerEncoder& enc, Buffer& out, const char* str)
+	{
+		const u64 key = (u64)(uintptr_t)str;
+		const u32 deffault = UINT32_MAX;
+		const u32 id = hash_map::get(enc._strings, key, deffault);
+		if (id != UINT32_MAX)
+			return id;
+
+		const u32 new_id = hash_map::size(enc._strings);
+		hash_map::set(enc._strings, key, new_id);
+
+		const u32 len = str != NULL ? (u32)strlen(str) : 0;
+		write_u8(out, ProfilerStreamRecord::STRING);
+		write_varint(out, new_id);
+		write_varint(out, len);
+		write_raw(out, str, len);
+		return new_id;
+	}
+
+	// Returns the time delta of @a time on the current thread.
+	static s64 delta(ProfilerEncoder& enc, s64 time)
+	{
+		s64& last = enc._thread_time[enc._thread];
+		const s64 dt = time - last;
+		last = time;
+		return dt;
+	}
+
+} // namespace profiler_stream_internal
+
+ProfilerEncoder::ProfilerEncoder(Allocator& a)
+	: _strings(a)
+	, _thread_time(a)
+	, _thread(0)
+	, _started(false)
+{
+}
+
+void ProfilerEncoder::reset()
+{
+	hash_map::clear(_strings);
+	array::clear(_thread_time);
+	_thread = 0;
+	_started = false;
+}
+
+void ProfilerEncoder::begin_message(Buffer& out)
+{
+	using namespace profiler_stream_internal;
+
+	write_raw(out, "CPRF", 4);
+	write_u8(out, VERSION);
+
+	if (!_started)
+	{
+		write_u8(out, ProfilerStreamRecord::FREQUENCY);
+		write_varint(out, (u64)os::clockfrequency());
+		_started = true;
+	}
+}
+
+void ProfilerEncoder::encode(Buffer& out, const char* begin, const char* end, u32 num_dropped)
+{
+	using namespace profiler_stream_internal;
+
+	write_u8(out, ProfilerStreamRecord::FRAME);
+	write_varint(out, num_dropped);
+
+	if (array::size(_thread_time) == 0)
+		array::push_back(_thread_time, (s64)0);
+	_thread = 0;
+
+	const char* cur = begin;
+	while (cur < end)
+	{
+		const u32 type = *(u32*)cur;
+		if (type == ProfilerEventType::COUNT)
+			break;
+
+		const u32 size = *(u32*)(cur + sizeof(u32));
+		const char* data = cur + 2*sizeof(u32);
+		cur = data + size;
+
+		switch (type)
+		{
+		case ProfilerEventType::PROFILER_THREAD:
+			{
+				const ProfilerThread* ev = (const ProfilerThread*)data;
+				const u32 name = ev->name != NULL ? intern(*this, out, ev->name) + 1 : 0;
+				while (array::size(_thread_time) <= ev->id)
+					array::push_back(_thread_time, (s64)0);
+				_thread = ev->id;
+
+				write_u8(out, ProfilerStreamRecord::THREAD);
+				write_varint(out, ev->id);
+				write_varint(out, name);
+			}
+			break;
+
+		case ProfilerEventType::ENTER_PROFILE_SCOPE:
+			{
+				const EnterProfileScope* ev = (const EnterProfileScope*)data;
+				const u32 name = intern(*this, out, ev->name);
+				write_u8(out, ProfilerStreamRecord::ENTER);
+				write_varint(out, name);
+				write_zigzag(out, delta(*this, ev->time));
+			}
+			break;
+
+		case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+			{
+				const LeaveProfileScope* ev = (const LeaveProfileScope*)data;
+				write_u8(out, ProfilerStreamRecord::LEAVE);
+				write_zigzag(out, delta(*this, ev->time));
+			}
+			break;
+
+		case ProfilerEventType::RECORD_FLOAT:
+			{
+				const RecordFloat* ev = (const RecordFloat*)data;
+				const u32 name = intern(*this, out, ev->name);
+				write_u8(out, ProfilerStreamRecord::FLOAT);
+				write_varint(out, name);
+				write_raw(out, &ev->value, sizeof(ev->value));
+			}
+			break;
+
+		case ProfilerEventType::RECORD_VECTOR3:
+			{
+				const RecordVector3* ev = (const RecordVector3*)data;
+				const u32 name = intern(*this, out, ev->name);
+				write_u8(out, ProfilerStreamRecord::VECTOR3);
+				write_varint(out, name);
+				write_raw(out, &ev->value, sizeof(ev->value));
+			}
+			break;
+
+		case ProfilerEventType::ALLOCATE_MEMORY:
+		case ProfilerEventType::DEALLOCATE_MEMORY:
+			{
+				const AllocateMemory* ev = (const AllocateMemory*)data;
+				const u32 name = intern(*this, out, ev->name);
+				write_u8(out, type == ProfilerEventType::ALLOCATE_MEMORY
+					? ProfilerStreamRecord::ALLOCATE
+					: ProfilerStreamRecord::DEALLOCATE
+					);
+				write_varint(out, name);
+				write_varint(out, ev->size);
+			}
+			break;
+
+		case ProfilerEventType::RECORD_RESOURCE_LOAD:
+			{
+				const RecordResourceLoad* ev = (const RecordResourceLoad*)data;
+				write_u8(out, ProfilerStreamRecord::RESOURCE_LOAD);
+				write_raw(out, &ev->type._id, sizeof(ev->type._id));
+				write_raw(out, &ev->name._id, sizeof(ev->name._id));
+				write_varint(out, ev->size);
+				write_zigzag(out, delta(*this, ev->time_requested));
+				write_varint(out, u64(ev->time_started   - ev->time_requested));
+				write_varint(out, u64(ev->time_opened    - ev->time_requested));
+				write_varint(out, u64(ev->time_loaded    - ev->time_requested));
+				write_varint(out, u64(ev->time_online    - ev->time_requested));
+				write_varint(out, u64(ev->time_completed - ev->time_requested));
+			}
+			break;
+
+		case ProfilerEventType::RECORD_SAMPLES:
+			{
+				const RecordSamples* ev = (const RecordSamples*)data;
+				const u32 stack = intern(*this, out, ev->stack);
+				write_u8(out, ProfilerStreamRecord::SAMPLES);
+				write_varint(out, stack);
+				write_varint(out, ev->num);
+			}
+			break;
+
+		default:
+			CE_FATAL("Unknown profiler event type");
+			break;
+		}
+	}
+}
+
+ProfilerHistory::ProfilerHistory(Allocator& a)
+	: _data(a)
+	, _frames(a)
+	, _write(0)
+	, _duration(0)
+{
+}
+
+void ProfilerHistory::set_duration(f32 seconds)
+{
+	_duration = s64(f64(seconds) * f64(os::clockfrequency()));
+	queue::clear(_frames);
+	_write = 0;
+
+	if (_duration > 0)
+		array::resize(_data, CROWN_PROFILER_HISTORY_SIZE);
+	else
+		array::clear(_data);
+}
+
+void ProfilerHistory::add(const char* begin, const char* end, s64 time)
+{
+	const u32 capacity = array::size(_data);
+	const u32 size = u32(end - begin);
+	if (!enabled() || size > capacity)
+		return;
+
+	// Frames are stored in order from _write around to _write - 1, the
+	// oldest ones are the first overwritten.
+	u32 pos = _write;
+	if (pos + size > capacity)
+	{
+		while (!queue::empty(_frames) && queue::front(_frames).offset >= pos)
+			queue::pop_front(_frames);
+		pos = 0;
+	}
+
+	while (!queue::empty(_frames))
+	{
+		const Frame& f = queue::front(_frames);
+		const bool overlaps = f.offset < pos + size && f.offset + f.size > pos;
+		if (!overlaps && time - f.time <= _duration)
+			break;
+		queue::pop_front(_frames);
+	}
+
+	memcpy(array::begin(_data) + pos, begin, size);
+
+	Frame f;
+	f.offset = pos;
+	f.size = size;
+	f.time = time;
+	queue::push_back(_frames, f);
+	_write = pos + size;
+}
+
+void ProfilerHistory::encode(Buffer& out, Allocator& a)
+{
+	ProfilerEncoder enc(a);
+	enc.begin_message(out);
+
+	for (u32 i = 0; i < queue::size(_frames); ++i)
+	{
+		const Frame& f = _frames[i];
+		const char* data = array::begin(_data) + f.offset;
+		enc.encode(out, data, data + f.size);
+	}
+}
+
+u32 ProfilerHistory::num_frames() const
+{
+	return queue::size(_frames);
+}
+
+} // namespace crown
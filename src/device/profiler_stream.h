@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Enumerates the records of the binary profiler stream.
+///
+/// Messages start with the 4 bytes "CPRF" followed by a version byte and
+/// any number of records. Each record is a tag byte followed by its
+/// fields. Integers are LEB128 varints, signed ones are zigzag-encoded
+/// first. Times are deltas from the previous time of the same thread.
+///
+/// @ingroup Device
+struct ProfilerStreamRecord
+{
+	enum Enum
+	{
+		FREQUENCY,      ///< varint ticks per second.
+		STRING,         ///< varint id, varint length, bytes.
+		THREAD,         ///< varint id, varint name+1 (0 if unnamed).
+		FRAME,          ///< varint number of frames dropped before this one.
+		ENTER,          ///< varint name, zigzag dt.
+		LEAVE,          ///< zigzag dt.
+		FLOAT,          ///< varint name, f32.
+		VECTOR3,        ///< varint name, 3 f32.
+		ALLOCATE,       ///< varint name, varint size.
+		DEALLOCATE,     ///< varint name, varint size.
+		RESOURCE_LOAD,  ///< u64 type, u64 name, varint size, zigzag dt requested, 5 varint times relative to it.
+		SAMPLES,        ///< varint stack, varint num.
+
+		COUNT
+	};
+};
+
+/// Encodes the events of the profiler to the binary stream. Strings
+/// are sent once and then referred to by id, so the encoder keeps the
+/// state of the stream; reset() it whenever a new stream starts.
+///
+/// @ingroup Device
+struct ProfilerEncoder
+{
+	HashMap<u64, u32> _strings; ///< Id of each string pointer.
+	Array<s64> _thread_time;    ///< Time of the last event of each thread.
+	u32 _thread;
+	bool _started;
+
+	///
+	ProfilerEncoder(Allocator& a);
+
+	/// Starts a new stream: strings and times are sent again.
+	void reset();
+
+	/// Appends a message header to @a out.
+	void begin_message(Buffer& out);
+
+	/// Appends the frame of profiler events [begin, end) to @a out,
+	/// @a num_dropped is the number of frames skipped before it.
+	void encode(Buffer& out, const char* begin, const char* end, u32 num_dropped = 0);
+};
+
+/// Keeps the profiler events of the last frames in a ring buffer of
+/// fixed size, so that they can be inspected after the fact.
+///
+/// @ingroup Device
+struct ProfilerHistory
+{
+	struct Frame
+	{
+		u32 offset;
+		u32 size;
+		s64 time;
+	};
+
+	Buffer _data;
+	Queue<Frame> _frames;
+	u32 _write;
+	s64 _duration; ///< Maximum age of the frames in ticks, 0 if disabled.
+
+	///
+	ProfilerHistory(Allocator& a);
+
+	/// Keeps the frames of the last @a seconds, 0 disables the history.
+	void set_duration(f32 seconds);
+
+	/// Returns whether the history is enabled.
+	bool enabled() const { return _duration > 0; }
+
+	/// Adds the frame of profiler events [begin, end) recorded at @a time,
+	/// dropping the frames which are too old or do not fit anymore.
+	void add(const char* begin, const char* end, s64 time);
+
+	/// Encodes all the frames in the history to @a out, as a single
+	/// message of a new stream.
+	void encode(Buffer& out, Allocator& a);
+
+	/// Returns the number of frames in the history.
+	u32 num_frames() const;
+};
+
+} // namespace crown
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/filesystem/file.h"
+#include "core/strings/string.h"
+#include "device/replay.h"
+
+#define REPLAY_MAGIC   0x4c504552 // "REPL"
+#define REPLAY_VERSION 1
+
+namespace crown
+{
+struct ReplayHeader
+{
+	u32 magic;
+	u32 version;
+	u32 seed;
+};
+
+Replay::Replay(Allocator& a)
+	: _file(NULL)
+	, _mode(ReplayMode::COUNT)
+	, _seed(0)
+	, _num_frames(0)
+	, _dt(0.0f)
+	, _events(a)
+	, _commands(a)
+	, _offsets(a)
+{
+}
+
+void Replay::record(File& file, u32 seed)
+{
+	CE_ASSERT(_file == NULL, "Replay already started");
+
+	ReplayHeader header;
+	header.magic   = REPLAY_MAGIC;
+	header.version = REPLAY_VERSION;
+	header.seed    = seed;
+	file.write(&header, sizeof(header));
+
+	_file = &file;
+	_mode = ReplayMode::RECORD;
+	_seed = seed;
+}
+
+bool Replay::play(File& file)
+{
+	CE_ASSERT(_file == NULL, "Replay already started");
+
+	ReplayHeader header;
+	if (file.read(&header, sizeof(header)) != sizeof(header)
+		|| header.magic != REPLAY_MAGIC
+		|| header.version != REPLAY_VERSION
+		)
+		return false;
+
+	_file = &file;
+	_mode = ReplayMode::PLAY;
+	_seed = header.seed;
+	return true;
+}
+
+void Replay::add_event(const OsEvent& ev)
+{
+	CE_ASSERT(_mode == ReplayMode::RECORD, "Not recording");
+	array::push_back(_events, ev);
+}
+
+void Replay::add_command(const char* json)
+{
+	CE_ASSERT(_mode == ReplayMode::RECORD, "Not recording");
+	array::push_back(_offsets, array::size(_commands));
+	array::push(_commands, json, strlen32(json) + 1);
+}
+
+void Replay::end_frame(f32 dt)
+{
+	CE_ASSERT(_mode == ReplayMode::RECORD, "Not recording");
+
+	const u32 num_events = array::size(_events);
+	const u32 num_commands = array::size(_offsets);
+	const u32 commands_size = array::size(_commands);
+
+	_file->write(&dt, sizeof(dt));
+	_file->write(&num_events, sizeof(num_events));
+	_file->write(array::begin(_events), num_events*sizeof(OsEvent));
+	_file->write(&num_commands, sizeof(num_commands));
+	_file->write(&commands_size, sizeof(commands_size));
+	_file->write(array::begin(_commands), commands_size);
+
+	array::clear(_events);
+	array::clear(_commands);
+	array::clear(_offsets);
+	++_num_frames;
+}
+
+bool Replay::next_frame()
+{
+	CE_ASSERT(_mode == ReplayMode::PLAY, "Not playing");
+
+	u32 num_events;
+	u32 num_commands;
+	u32 commands_size;
+
+	if (_file->read(&_dt, sizeof(_dt)) != sizeof(_dt))
+		return false;
+
+	_file->read(&num_events, sizeof(num_events));
+	array::resize(_events, num_events);
+	_file->read(array::begin(_events), num_events*sizeof(OsEvent));
+
+	_file->read(&num_commands, sizeof(num_commands));
+	_file->read(&commands_size, sizeof(commands_size));
+	array::resize(_commands, commands_size);
+	if (_file->read(array::begin(_commands), commands_size) != commands_size)
+		return false;
+
+	array::clear(_offsets);
+	for (u32 i = 0, offset = 0; i < num_commands; ++i)
+	{
+		array::push_back(_offsets, offset);
+		offset += strlen32(&_commands[offset]) + 1;
+	}
+
+	++_num_frames;
+	return true;
+}
+
+u32 Replay::num_commands()
+{
+	return array::size(_offsets);
+}
+
+const char* Replay::command(u32 i)
+{
+	CE_ASSERT(i < array::size(_offsets), "Index out of bounds");
+	return &_commands[_offsets[i]];
+}
+
+} // namespace crown
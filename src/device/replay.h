@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/types.h"
+#include "core/types.h"
+#include "device/device_event_queue.h"
+
+namespace crown
+{
+struct ReplayMode
+{
+	enum Enum
+	{
+		RECORD,
+		PLAY,
+
+		COUNT
+	};
+};
+
+/// Records the input events, the frame times and the console commands
+/// received by each frame to a file, and plays them back, so that the same
+/// frames can be run again deterministically.
+///
+/// The file starts with a header followed by the frames. Each frame stores
+/// its dt, its input events and its console commands.
+///
+/// @ingroup Device
+struct Replay
+{
+	File* _file;
+	ReplayMode::Enum _mode;
+	u32 _seed;
+	u32 _num_frames;
+	f32 _dt;
+	Array<OsEvent> _events;
+	Array<char> _commands; ///< NUL-terminated JSON commands of the frame.
+	Array<u32> _offsets; ///< Offset of each command in _commands.
+
+	///
+	Replay(Allocator& a);
+
+	/// Starts recording to @a file with the random @a seed.
+	void record(File& file, u32 seed);
+
+	/// Starts playing back from @a file.
+	/// Returns false if @a file is not a valid replay.
+	bool play(File& file);
+
+	/// Adds the input event @a ev to the frame being recorded.
+	void add_event(const OsEvent& ev);
+
+	/// Adds the console command @a json to the frame being recorded.
+	void add_command(const char* json);
+
+	/// Writes the frame being recorded, which took @a dt seconds.
+	void end_frame(f32 dt);
+
+	/// Reads the next frame to play back.
+	/// Returns false if there are no more frames.
+	bool next_frame();
+
+	/// Returns the number of console commands of the frame.
+	u32 num_commands();
+
+	/// Returns the console command @a i of the frame.
+	const char* command(u32 i);
+};
+
+} // namespace crown
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/memory/temp_allocator.h"
+#include "core/os.h"
+#include "core/strings/string_stream.h"
+#include "device/profiler.h"
+#include "device/scene_benchmark.h"
+#include <algorithm> // std::sort
+#include <stdio.h>   // snprintf
+#include <string.h>  // memset
+
+namespace crown
+{
+namespace scene_benchmark_internal
+{
+	// Returns the index of the metric @a name, adding it if needed.
+	static u32 metric(SceneBenchmark& sb, const char* name, SceneBenchmark::MetricType::Enum type)
+	{
+		const StringId32 id(name);
+		const u32 deffault = UINT32_MAX;
+		const u32 index = hash_map::get(sb._map, id, deffault);
+		if (index != UINT32_MAX)
+			return index;
+
+		const u32 new_index = array::size(sb._metrics);
+		hash_map::set(sb._map, id, new_index);
+
+		SceneBenchmark::Metric m;
+		m.name = name;
+		m.type = type;
+		array::push_back(sb._metrics, m);
+
+		array::resize(sb._samples, (new_index + 1) * sb._num_frames);
+		memset(array::begin(sb._samples) + new_index * sb._num_frames, 0, sb._num_frames * sizeof(f32));
+		return new_index;
+	}
+
+	// Writes the mean and the percentiles of @a num @a samples to @a json.
+	static void write_stats(StringStream& json, const f32* samples, u32 num)
+	{
+		TempAllocator1024 ta;
+		Array<f32> sorted(ta);
+		array::push(sorted, samples, num);
+		std::sort(array::begin(sorted), array::end(sorted));
+
+		f64 sum = 0.0;
+		for (u32 i = 0; i < num; ++i)
+			sum += sorted[i];
+
+		char buf[256];
+		snprintf(buf, sizeof(buf)
+			, "{\"mean\":%.4f,\"min\":%.4f,\"p50\":%.4f,\"p90\":%.4f,\"p99\":%.4f,\"max\":%.4f}"
+			, num > 0 ? sum / f64(num) : 0.0
+			, num > 0 ? sorted[0] : 0.0f
+			, num > 0 ? sorted[u32(0.50f * f32(num - 1) + 0.5f)] : 0.0f
+			, num > 0 ? sorted[u32(0.90f * f32(num - 1) + 0.5f)] : 0.0f
+			, num > 0 ? sorted[u32(0.99f * f32(num - 1) + 0.5f)] : 0.0f
+			, num > 0 ? sorted[num - 1] : 0.0f
+			);
+		json << buf;
+	}
+
+	static void write_string(StringStream& json, const char* str)
+	{
+		json << "\"";
+		for (const char* ch = str; *ch; ++ch)
+		{
+			if (*ch == '"' || *ch == '\\')
+				json << "\\";
+			json << *ch;
+		}
+		json << "\"";
+	}
+
+} // namespace scene_benchmark_internal
+
+SceneBenchmark::SceneBenchmark(Allocator& a, u32 num_frames, u32 num_warmup)
+	: _map(a)
+	, _metrics(a)
+	, _samples(a)
+	, _frame_times(a)
+	, _threads(a)
+	, _num_frames(num_frames)
+	, _num_warmup(num_warmup)
+	, _frame(0)
+{
+	array::reserve(_frame_times, num_frames);
+}
+
+bool SceneBenchmark::add_frame(f32 seconds, const char* begin, const char* end)
+{
+	using namespace scene_benchmark_internal;
+
+	if (_frame >= _num_warmup + _num_frames)
+		return true;
+
+	const bool measuring = _frame >= _num_warmup;
+	const u32 frame = _frame - _num_warmup;
+	const f64 ms_per_tick = 1000.0 / f64(os::clockfrequency());
+
+	if (array::size(_threads) == 0)
+	{
+		ThreadStack ts;
+		ts.depth = 0;
+		array::push_back(_threads, ts);
+	}
+	ThreadStack* thread = &_threads[0];
+
+	const char* cur = begin;
+	while (cur < end)
+	{
+		const u32 type = *(u32*)cur;
+		if (type == ProfilerEventType::COUNT)
+			break;
+
+		const u32 size = *(u32*)(cur + sizeof(u32));
+		const char* data = cur + 2*sizeof(u32);
+		cur = data + size;
+
+		switch (type)
+		{
+		case ProfilerEventType::PROFILER_THREAD:
+			{
+				const ProfilerThread* ev = (const ProfilerThread*)data;
+				while (array::size(_threads) <= ev->id)
+				{
+					ThreadStack ts;
+					ts.depth = 0;
+					array::push_back(_threads, ts);
+				}
+				thread = &_threads[ev->id];
+			}
+			break;
+
+		case ProfilerEventType::ENTER_PROFILE_SCOPE:
+			{
+				const EnterProfileScope* ev = (const EnterProfileScope*)data;
+				if (thread->depth < CROWN_SCENE_BENCHMARK_MAX_DEPTH)
+				{
+					OpenScope& scope = thread->scopes[thread->depth];
+					scope.metric = metric(*this, ev->name, MetricType::SCOPE);
+					scope.time = ev->time;
+				}
+				++thread->depth;
+			}
+			break;
+
+		case ProfilerEventType::LEAVE_PROFILE_SCOPE:
+			{
+				const LeaveProfileScope* ev = (const LeaveProfileScope*)data;
+				if (thread->depth == 0)
+					break;
+
+				--thread->depth;
+				if (measuring && thread->depth < CROWN_SCENE_BENCHMARK_MAX_DEPTH)
+				{
+					const OpenScope& scope = thread->scopes[thread->depth];
+					_samples[scope.metric * _num_frames + frame] += f32(f64(ev->time - scope.time) * ms_per_tick);
+				}
+			}
+			break;
+
+		case ProfilerEventType::RECORD_FLOAT:
+			{
+				const RecordFloat* ev = (const RecordFloat*)data;
+				const u32 m = metric(*this, ev->name, MetricType::VALUE);
+				if (measuring)
+					_samples[m * _num_frames + frame] = ev->value;
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (measuring)
+		array::push_back(_frame_times, seconds * 1000.0f);
+
+	return ++_frame >= _num_warmup + _num_frames;
+}
+
+void SceneBenchmark::to_json(StringStream& json, f32 dt)
+{
+	using namespace scene_benchmark_internal;
+
+	const u32 num = array::size(_frame_times);
+	char buf[128];
+	snprintf(buf, sizeof(buf), "{\"frames\":%u,\"warmup\":%u,\"dt\":%.6f,\"frame\":", num, _num_warmup, dt);
+	json << buf;
+	write_stats(json, array::begin(_frame_times), num);
+
+	for (u32 t = 0; t < MetricType::COUNT; ++t)
+	{
+		json << (t == MetricType::SCOPE ? ",\"scopes\":{" : ",\"values\":{");
+
+		bool first = true;
+		for (u32 i = 0; i < array::size(_metrics); ++i)
+		{
+			const Metric& m = _metrics[i];
+			if (m.type != t)
+				continue;
+
+			if (!first)
+				json << ",";
+			first = false;
+
+			write_string(json, m.name);
+			json << ":";
+			write_stats(json, array::begin(_samples) + i * _num_frames, num);
+		}
+
+		json << "}";
+	}
+
+	json << "}\n";
+}
+
+} // namespace crown
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/types.h"
+#include "core/strings/string_id.h"
+#include "core/strings/types.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Collects the time of each frame and the profiler data of a fixed
+/// number of frames, and summarizes them per scope and per recorded value.
+///
+/// @ingroup Device
+struct SceneBenchmark
+{
+	struct MetricType
+	{
+		enum Enum
+		{
+			SCOPE, ///< Milliseconds spent in the scope, summed over all threads.
+			VALUE, ///< Last value recorded with RECORD_FLOAT().
+
+			COUNT
+		};
+	};
+
+	struct Metric
+	{
+		const char* name;
+		MetricType::Enum type;
+	};
+
+	struct OpenScope
+	{
+		u32 metric;
+		s64 time;
+	};
+
+	struct ThreadStack
+	{
+		u32 depth;
+		OpenScope scopes[CROWN_SCENE_BENCHMARK_MAX_DEPTH];
+	};
+
+	HashMap<StringId32, u32> _map;
+	Array<Metric> _metrics;
+	Array<f32> _samples; ///< Value of metric i at frame j is at i*_num_frames + j.
+	Array<f32> _frame_times;
+	Array<ThreadStack> _threads;
+	u32 _num_frames;
+	u32 _num_warmup;
+	u32 _frame;
+
+	/// Measures @a num_frames frames after skipping the first @a num_warmup.
+	SceneBenchmark(Allocator& a, u32 num_frames, u32 num_warmup);
+
+	/// Adds a frame which took @a seconds and whose profiler events are
+	/// [begin, end). Returns true when all the frames have been measured.
+	bool add_frame(f32 seconds, const char* begin, const char* end);
+
+	/// Writes the summary of the frames measured to @a json.
+	void to_json(StringStream& json, f32 dt);
+};
+
+} // namespace crown
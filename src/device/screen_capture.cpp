@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/mpmc_queue.h"
+#include "core/error/error.h"
+#include "core/memory/allocator.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
+#include "device/log.h"
+#include "device/profiler.h"
+#include "device/screen_capture.h"
+#include <bgfx/bgfx.h>
+#include <bimg/bimg.h>
+#include <bx/file.h>
+#include <string.h> // memcpy, strncpy
+
+namespace { const crown::log_internal::System SCREEN_CAPTURE = { "screen_capture" }; }
+
+namespace crown
+{
+static s32 thread_proc(void* thiz)
+{
+	return ((ScreenCapture*)thiz)->run();
+}
+
+ScreenCapture::ScreenCapture(Allocator& a)
+	: _allocator(&a)
+	, _free(a, CROWN_SCREEN_CAPTURE_FRAMES)
+	, _pending(a, CROWN_SCREEN_CAPTURE_FRAMES)
+	, _exit(0)
+	, _num_written(0)
+	, _num_dropped(0)
+	, _prefix(a)
+	, _interval(0.0f)
+	, _time(0.0f)
+	, _num_requested(0)
+	, _capturing(false)
+{
+	memset(_frames, 0, sizeof(_frames));
+	for (u32 i = 0; i < CROWN_SCREEN_CAPTURE_FRAMES; ++i)
+		_free.push(i);
+
+	_thread.set_name("screen_capture");
+	_thread.set_priority(ThreadPriority::LOW);
+	_thread.start(thread_proc, this);
+}
+
+ScreenCapture::~ScreenCapture()
+{
+	_exit.store(1);
+	_sem.post();
+	_thread.stop();
+
+	for (u32 i = 0; i < CROWN_SCREEN_CAPTURE_FRAMES; ++i)
+		_allocator->deallocate(_frames[i].data);
+}
+
+void ScreenCapture::screenshot(const char* path)
+{
+	bgfx::requestScreenShot(BGFX_INVALID_HANDLE, path);
+}
+
+void ScreenCapture::start(const char* prefix, f32 fps)
+{
+	CE_ASSERT(fps > 0.0f, "Frame rate must be > 0");
+	_prefix = prefix;
+	_interval = 1.0f / fps;
+	_time = _interval;
+	_num_requested = 0;
+	_capturing = true;
+	_num_dropped.store(0);
+}
+
+void ScreenCapture::stop()
+{
+	if (!_capturing)
+		return;
+
+	_capturing = false;
+	logi(SCREEN_CAPTURE, "Captured %u frames, %u dropped", _num_requested, _num_dropped.load());
+}
+
+void ScreenCapture::update(f32 dt)
+{
+	RECORD_FLOAT("screen_capture.dropped", f32(_num_dropped.load()));
+
+	if (!_capturing)
+		return;
+
+	_time += dt;
+	if (_time < _interval)
+		return;
+
+	// Skip the frames that could not be captured instead of catching up
+	_time -= _interval;
+	if (_time >= _interval)
+		_time = 0.0f;
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s%06u.png", _prefix.c_str(), _num_requested++);
+	screenshot(path);
+}
+
+bool ScreenCapture::push(const char* path, u32 width, u32 height, u32 pitch, const void* data, u32 size, bool yflip)
+{
+	u32 i;
+	if (!_free.pop(i))
+	{
+		_num_dropped.fetch_add(1);
+		return false;
+	}
+
+	Frame& f = _frames[i];
+	if (f.capacity < size)
+	{
+		_allocator->deallocate(f.data);
+		f.data = _allocator->allocate(size);
+		f.capacity = size;
+	}
+
+	strncpy(f.path, path, sizeof(f.path) - 1);
+	f.path[sizeof(f.path) - 1] = '\0';
+	f.width = width;
+	f.height = height;
+	f.pitch = pitch;
+	f.yflip = yflip;
+	memcpy(f.data, data, size);
+
+	_pending.push(i);
+	_sem.post();
+	return true;
+}
+
+s32 ScreenCapture::run()
+{
+	while (true)
+	{
+		_sem.wait();
+
+		u32 i;
+		if (!_pending.pop(i))
+		{
+			if (_exit.load() != 0)
+				break;
+			continue;
+		}
+
+		Frame& f = _frames[i];
+		const u32 len = strlen32(f.path);
+		const bool tga = len >= 4 && strcmp(f.path + len - 4, ".tga") == 0;
+
+		bx::FileWriter writer;
+		bx::Error err;
+		if (bx::open(&writer, f.path, false, &err))
+		{
+			if (tga)
+				bimg::imageWriteTga(&writer, f.width, f.height, f.pitch, f.data, false, f.yflip, &err);
+			else
+				bimg::imageWritePng(&writer, f.width, f.height, f.pitch, f.data, bimg::TextureFormat::BGRA8, f.yflip, &err);
+			bx::close(&writer);
+		}
+
+		if (err.isOk())
+			_num_written.fetch_add(1);
+		else
+			loge(SCREEN_CAPTURE, "Unable to write '%s'", f.path);
+
+		_free.push(i);
+	}
+
+	return 0;
+}
+
+} // namespace crown
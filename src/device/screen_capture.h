@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/mpmc_queue.h"
+#include "core/memory/types.h"
+#include "core/strings/dynamic_string.h"
+#include "core/thread/atomic.h"
+#include "core/thread/semaphore.h"
+#include "core/thread/thread.h"
+#include "core/types.h"
+
+namespace crown
+{
+/// Saves screenshots without stalling the frame.
+///
+/// The back buffer is read back by bgfx, which hands it to push() from
+/// the render thread. push() only copies it into one of
+/// CROWN_SCREEN_CAPTURE_FRAMES pooled frames and a worker thread encodes
+/// and writes it. When all the frames are waiting to be written, new
+/// captures are dropped, so a slow disk never slows down the game.
+///
+/// @ingroup Device
+struct ScreenCapture
+{
+	struct Frame
+	{
+		char path[256];
+		u32 width;
+		u32 height;
+		u32 pitch;
+		bool yflip;
+		void* data;    ///< BGRA8 pixels.
+		u32 capacity;  ///< Size of data in bytes.
+	};
+
+	Allocator* _allocator;
+	Frame _frames[CROWN_SCREEN_CAPTURE_FRAMES];
+	MpmcQueue<u32> _free;    ///< Frames that can be filled.
+	MpmcQueue<u32> _pending; ///< Frames waiting for the worker.
+	Semaphore _sem;
+	Thread _thread;
+	AtomicU32 _exit;
+	AtomicU32 _num_written;
+	AtomicU32 _num_dropped;
+
+	// Continuous capture, main thread only.
+	DynamicString _prefix;
+	f32 _interval;
+	f32 _time;
+	u32 _num_requested;
+	bool _capturing;
+
+	///
+	explicit ScreenCapture(Allocator& a);
+
+	///
+	~ScreenCapture();
+
+	///
+	ScreenCapture(const ScreenCapture&) = delete;
+
+	///
+	ScreenCapture& operator=(const ScreenCapture&) = delete;
+
+	/// Saves the next frame to @a path. The image is written as TGA if
+	/// @a path ends in ".tga", as PNG otherwise.
+	void screenshot(const char* path);
+
+	/// Saves @a fps frames per second to files named @a prefix followed by
+	/// a six digit sequence number and ".png", until stop() is called.
+	void start(const char* prefix, f32 fps);
+
+	/// Stops the capture started with start().
+	void stop();
+
+	/// Requests the screenshots of the continuous capture, if any.
+	/// Called once per frame, @a dt seconds after the previous one.
+	void update(f32 dt);
+
+	/// Queues the image @a data to be written to @a path. Called by bgfx
+	/// from the render thread. Returns false if the image has been
+	/// dropped.
+	bool push(const char* path, u32 width, u32 height, u32 pitch, const void* data, u32 size, bool yflip);
+
+	/// Encodes and writes the queued images until the capture is
+	/// destroyed.
+	s32 run();
+};
+
+} // namespace crown
@@ -18,23 +18,31 @@
 #include "core/strings/string_stream.h"
 #include "device/console_server.h"
 #include "device/device.h"
+#include "device/gpu_memory.h"
 #include "device/input_device.h"
 #include "device/input_manager.h"
 #include "device/profiler.h"
+#include "device/screen_capture.h"
 #include "lua/lua_environment.h"
 #include "lua/lua_stack.h"
+#include "resource/level_resource.h"
 #include "resource/resource_manager.h"
 #include "resource/resource_package.h"
 #include "world/animation_state_machine.h"
 #include "world/debug_line.h"
 #include "world/gui.h"
+#include "world/level.h"
 #include "world/material.h"
+#include "world/navigation_world.h"
 #include "world/physics_world.h"
 #include "world/render_world.h"
+#include "world/replication.h"
 #include "world/scene_graph.h"
+#include "world/skeleton_animation.h"
 #include "world/sound_world.h"
 #include "world/unit_manager.h"
 #include "world/world.h"
+#include <stdio.h> // sscanf
 
 namespace crown
 {
@@ -65,6 +73,29 @@ static const ProjectionInfo s_projection[] =
 };
 CE_STATIC_ASSERT(countof(s_projection) == ProjectionType::COUNT);
 
+struct ResourcePriorityInfo
+{
+	const char* name;
+	ResourcePriority::Enum priority;
+};
+
+static const ResourcePriorityInfo s_resource_priority[] =
+{
+	{ "critical",   ResourcePriority::CRITICAL   },
+	{ "normal",     ResourcePriority::NORMAL     },
+	{ "background", ResourcePriority::BACKGROUND }
+};
+CE_STATIC_ASSERT(countof(s_resource_priority) == ResourcePriority::COUNT);
+
+static const char* s_path_status[] =
+{
+	"pending",
+	"found",
+	"not_found",
+	"invalid"
+};
+CE_STATIC_ASSERT(countof(s_path_status) == PathStatus::COUNT);
+
 static LightType::Enum name_to_light_type(const char* name)
 {
 	for (u32 i = 0; i < countof(s_light); ++i)
@@ -87,6 +118,40 @@ static ProjectionType::Enum name_to_projection_type(const char* name)
 	return ProjectionType::COUNT;
 }
 
+static ResourcePriority::Enum name_to_resource_priority(const char* name)
+{
+	for (u32 i = 0; i < countof(s_resource_priority); ++i)
+	{
+		if (strcmp(s_resource_priority[i].name, name) == 0)
+			return s_resource_priority[i].priority;
+	}
+
+	return ResourcePriority::COUNT;
+}
+
+// Returns the number of elements of the parallel array tables at @a a and @a b.
+static u32 batch_size(LuaStack& stack, int a, int b)
+{
+	LUA_ASSERT(stack.is_table(a), stack, "Table expected");
+	LUA_ASSERT(stack.is_table(b), stack, "Table expected");
+	const u32 num = (u32)lua_objlen(stack.L, a);
+	LUA_ASSERT(num == (u32)lua_objlen(stack.L, b), stack, "Tables must have the same size");
+	return num;
+}
+
+// Reads the first array::size(@a values) elements of the array table at
+// @a i into @a values with the LuaStack getter @a get.
+template <typename T, typename U>
+static void get_batch(LuaStack& stack, int i, U (LuaStack::*get)(int), Array<T>& values)
+{
+	for (u32 j = 0; j < array::size(values); ++j)
+	{
+		lua_rawgeti(stack.L, i, j + 1);
+		values[j] = (T)(stack.*get)(-1);
+		stack.pop(1);
+	}
+}
+
 static int math_ray_plane_intersection(lua_State* L)
 {
 	LuaStack stack(L);
@@ -153,6 +218,73 @@ static int math_ray_triangle_intersection(lua_State* L)
 	return 1;
 }
 
+static int random_ctor(lua_State* L)
+{
+	LuaStack stack(L);
+	const u64 seed = stack.get_id(1 + 1);
+	stack.push_random(stack.num_args() > 2
+		? Pcg32(seed, stack.get_id(2 + 1))
+		: Pcg32(seed)
+		);
+	return 1;
+}
+
+static int random_integer(lua_State* L)
+{
+	LuaStack stack(L);
+	Pcg32& r = stack.get_random(1);
+
+	if (stack.num_args() == 1)
+		stack.push_id(r.integer());
+	else if (stack.num_args() == 2)
+		stack.push_id(r.integer(stack.get_id(2)));
+	else
+		stack.push_int(r.range(stack.get_int(2), stack.get_int(3)));
+	return 1;
+}
+
+static int random_unit_float(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_random(1).unit_float());
+	return 1;
+}
+
+static int random_range(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_random(1).range(stack.get_float(2), stack.get_float(3)));
+	return 1;
+}
+
+static int random_split(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_random(stack.get_random(1).split());
+	return 1;
+}
+
+static int random_fill(lua_State* L)
+{
+	LuaStack stack(L);
+	Pcg32& r = stack.get_random(1);
+	const u32 num = stack.get_id(3);
+	const f32 min = stack.num_args() > 3 ? stack.get_float(4) : 0.0f;
+	const f32 max = stack.num_args() > 4 ? stack.get_float(5) : 1.0f;
+
+	TempAllocator1024 ta;
+	Array<f32> values(ta);
+	array::resize(values, num);
+	random::fill(r, array::begin(values), num, min, max);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_float(values[i]);
+		lua_rawseti(L, 2, i + 1);
+	}
+	return 0;
+}
+
 static int vector3_ctor(lua_State* L)
 {
 	LuaStack stack(L);
@@ -958,74 +1090,6 @@ static int color4_orange(lua_State* L)
 	return 1;
 }
 
-static int lightuserdata_add(lua_State* L)
-{
-	LuaStack stack(L);
-	const Vector3& a = stack.get_vector3(1);
-	const Vector3& b = stack.get_vector3(2);
-	stack.push_vector3(a + b);
-	return 1;
-}
-
-static int lightuserdata_sub(lua_State* L)
-{
-	LuaStack stack(L);
-	const Vector3& a = stack.get_vector3(1);
-	const Vector3& b = stack.get_vector3(2);
-	stack.push_vector3(a - b);
-	return 1;
-}
-
-static int lightuserdata_mul(lua_State* L)
-{
-	LuaStack stack(L);
-	const int i = stack.is_number(1) ? 1 : 2;
-	stack.push_vector3(stack.get_float(i) * stack.get_vector3(3-i));
-	return 1;
-}
-
-static int lightuserdata_unm(lua_State* L)
-{
-	LuaStack stack(L);
-	stack.push_vector3(-stack.get_vector3(1));
-	return 1;
-}
-
-static int lightuserdata_index(lua_State* L)
-{
-	LuaStack stack(L);
-	Vector3& v = stack.get_vector3(1);
-	const char* s = stack.get_string(2);
-
-	switch (s[0])
-	{
-	case 'x': stack.push_float(v.x); return 1;
-	case 'y': stack.push_float(v.y); return 1;
-	case 'z': stack.push_float(v.z); return 1;
-	default: LUA_ASSERT(false, stack, "Bad index: '%c'", s[0]); break;
-	}
-
-	return 0;
-}
-
-static int lightuserdata_newindex(lua_State* L)
-{
-	LuaStack stack(L);
-	Vector3& v = stack.get_vector3(1);
-	const char* s = stack.get_string(2);
-	const f32 value = stack.get_float(3);
-
-	switch (s[0])
-	{
-	case 'x': v.x = value; break;
-	case 'y': v.y = value; break;
-	case 'z': v.z = value; break;
-	default: LUA_ASSERT(false, stack, "Bad index: '%c'", s[0]); break;
-	}
-
-	return 0;
-}
-
 static int input_device_name(lua_State* L, InputDevice& dev)
 {
 	LuaStack stack(L);
@@ -1179,6 +1243,58 @@ static int input_device_set_deadzone(lua_State* L, InputDevice& dev)
 	return 0;
 }
 
+static int input_device_events(lua_State* L, InputDevice& dev)
+{
+	LuaStack stack(L);
+	const InputEvent* events;
+	u32 num;
+	device()->_input_manager->events(&events, &num);
+
+	const s64 now = os::clocktime();
+	const f64 freq = (f64)os::clockfrequency();
+
+	stack.push_table();
+	u32 n = 0;
+	for (u32 i = 0; i < num; ++i)
+	{
+		const InputEvent& ev = events[i];
+		if (ev.device != &dev)
+			continue;
+
+		stack.push_key_begin(++n);
+		stack.push_table(3);
+		{
+			if (ev.type == OsEventType::BUTTON)
+			{
+				stack.push_key_begin("button");
+				stack.push_int(ev.id);
+				stack.push_key_end();
+
+				stack.push_key_begin("pressed");
+				stack.push_bool(ev.pressed);
+				stack.push_key_end();
+			}
+			else
+			{
+				stack.push_key_begin("axis");
+				stack.push_int(ev.id);
+				stack.push_key_end();
+
+				stack.push_key_begin("value");
+				stack.push_vector3(ev.value);
+				stack.push_key_end();
+			}
+
+			stack.push_key_begin("age");
+			stack.push_float(f32(f64(now - ev.time) / freq));
+			stack.push_key_end();
+		}
+		stack.push_key_end();
+	}
+
+	return 1;
+}
+
 #define KEYBOARD(name)                                                          \
 	static int keyboard_ ## name(lua_State* L)                                  \
 	{                                                                           \
@@ -1217,6 +1333,7 @@ KEYBOARD(button_name)
 // KEYBOARD(axis_name)
 KEYBOARD(button_id)
 // KEYBOARD(axis_id)
+KEYBOARD(events)
 
 MOUSE(name)
 MOUSE(connected)
@@ -1232,6 +1349,7 @@ MOUSE(button_name)
 MOUSE(axis_name)
 MOUSE(button_id)
 MOUSE(axis_id)
+MOUSE(events)
 
 TOUCH(name)
 TOUCH(connected)
@@ -1247,6 +1365,7 @@ TOUCH(button_name)
 TOUCH(axis_name)
 TOUCH(button_id)
 TOUCH(axis_id)
+TOUCH(events)
 
 PAD(0, name)
 PAD(0, connected)
@@ -1264,6 +1383,7 @@ PAD(0, button_id)
 PAD(0, axis_id)
 PAD(0, deadzone)
 PAD(0, set_deadzone)
+PAD(0, events)
 
 PAD(1, name)
 PAD(1, connected)
@@ -1281,6 +1401,7 @@ PAD(1, button_id)
 PAD(1, axis_id)
 PAD(1, deadzone)
 PAD(1, set_deadzone)
+PAD(1, events)
 
 PAD(2, name)
 PAD(2, connected)
@@ -1298,6 +1419,7 @@ PAD(2, button_id)
 PAD(2, axis_id)
 PAD(2, deadzone)
 PAD(2, set_deadzone)
+PAD(2, events)
 
 PAD(3, name)
 PAD(3, connected)
@@ -1315,6 +1437,7 @@ PAD(3, button_id)
 PAD(3, axis_id)
 PAD(3, deadzone)
 PAD(3, set_deadzone)
+PAD(3, events)
 
 #undef KEYBOARD
 #undef MOUSE
@@ -1336,6 +1459,40 @@ static int world_spawn_unit(lua_State* L)
 	return 1;
 }
 
+static int world_spawn_unit_batch(lua_State* L)
+{
+	LuaStack stack(L);
+
+	const StringId64 name = stack.get_resource_id(2);
+	LUA_ASSERT(device()->_resource_manager->can_get(RESOURCE_TYPE_UNIT, name), stack, "Unit not found");
+	LUA_ASSERT(stack.is_table(3), stack, "Table expected");
+
+	TempAllocator4096 alloc;
+	Array<Matrix4x4> poses(alloc);
+
+	stack.push_nil();
+	while (stack.next(3) != 0)
+	{
+		array::push_back(poses, stack.get_matrix4x4(-1));
+		stack.pop(1);
+	}
+
+	const u32 num = array::size(poses);
+	Array<UnitId> units(alloc);
+	array::resize(units, num);
+	stack.get_world(1)->spawn_unit_batch(name, array::begin(poses), num, array::begin(units));
+
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin((s32) i + 1);
+		stack.push_unit(units[i]);
+		stack.push_key_end();
+	}
+
+	return 1;
+}
+
 static int world_spawn_empty_unit(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1350,6 +1507,25 @@ static int world_destroy_unit(lua_State* L)
 	return 0;
 }
 
+static int world_destroy_units(lua_State* L)
+{
+	LuaStack stack(L);
+	LUA_ASSERT(stack.is_table(2), stack, "Table expected");
+
+	TempAllocator1024 alloc;
+	Array<UnitId> units(alloc);
+
+	stack.push_nil();
+	while (stack.next(2) != 0)
+	{
+		array::push_back(units, stack.get_unit(-1));
+		stack.pop(1);
+	}
+
+	stack.get_world(1)->destroy_units(array::begin(units), array::size(units));
+	return 0;
+}
+
 static int world_num_units(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1357,6 +1533,42 @@ static int world_num_units(lua_State* L)
 	return 1;
 }
 
+static int world_memory_usage(lua_State* L)
+{
+	LuaStack stack(L);
+	World* world = stack.get_world(1);
+
+	stack.push_table(0, 9);
+	stack.push_key_begin("total");
+	stack.push_int(world->_world_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("scene_graph");
+	stack.push_int(world->_scene_graph_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("render_world");
+	stack.push_int(world->_render_world_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("physics_world");
+	stack.push_int(world->_physics_world_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("sound_world");
+	stack.push_int(world->_sound_world_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("script_world");
+	stack.push_int(world->_script_world_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("animation_state_machine");
+	stack.push_int(world->_animation_state_machine_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("skeleton_animation");
+	stack.push_int(world->_skeleton_animation_allocator.total_allocated());
+	stack.push_key_end();
+	stack.push_key_begin("replication");
+	stack.push_int(world->_replication_allocator.total_allocated());
+	stack.push_key_end();
+	return 1;
+}
+
 static int world_units(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1477,6 +1689,18 @@ static int world_camera_set_orthographic_size(lua_State* L)
 	return 0;
 }
 
+static int world_camera_set_viewport(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_world(1)->camera_set_viewport(stack.get_unit(2)
+		, stack.get_float(3)
+		, stack.get_float(4)
+		, stack.get_float(5)
+		, stack.get_float(6)
+		);
+	return 0;
+}
+
 static int world_camera_screen_to_world(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1522,10 +1746,11 @@ static int world_play_sound(lua_State* L)
 	const f32 volume = nargs > 3 ? stack.get_float(4)   : 1.0f;
 	const Vector3& pos = nargs > 4 ? stack.get_vector3(5) : VECTOR3_ZERO;
 	const f32 range  = nargs > 5 ? stack.get_float(6)   : 1000.0f;
+	const u32 priority = nargs > 6 ? stack.get_int(7)   : 0;
 
 	LUA_ASSERT(device()->_resource_manager->can_get(RESOURCE_TYPE_SOUND, name), stack, "Sound not found");
 
-	stack.push_sound_instance_id(world->play_sound(name, loop, volume, pos, range));
+	stack.push_sound_instance_id(world->play_sound(name, loop, volume, pos, range, priority));
 	return 1;
 }
 
@@ -1560,6 +1785,23 @@ static int world_set_sound_position(lua_State* L)
 	return 0;
 }
 
+static int world_set_sound_positions(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<SoundInstanceId> ids(ta);
+	Array<Vector3> positions(ta);
+	array::resize(ids, num);
+	array::resize(positions, num);
+	get_batch(stack, 2, &LuaStack::get_sound_instance_id, ids);
+	get_batch(stack, 3, &LuaStack::get_vector3, positions);
+
+	stack.get_world(1)->set_sound_positions(num, array::begin(ids), array::begin(positions));
+	return 0;
+}
+
 static int world_set_sound_range(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1595,6 +1837,13 @@ static int world_create_screen_gui(lua_State* L)
 	return 1;
 }
 
+static int world_create_gui_layer(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_gui(stack.get_world(1)->create_gui_layer());
+	return 1;
+}
+
 static int world_destroy_gui(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1615,6 +1864,91 @@ static int world_load_level(lua_State* L)
 	return 1;
 }
 
+static int world_load_level_async(lua_State* L)
+{
+	LuaStack stack(L);
+	const int nargs = stack.num_args();
+
+	const StringId64 name = stack.get_resource_id(2);
+	const Vector3& pos    = nargs > 2 ? stack.get_vector3(3)    : VECTOR3_ZERO;
+	const Quaternion& rot = nargs > 3 ? stack.get_quaternion(4) : QUATERNION_IDENTITY;
+	const u32 max_units   = nargs > 4 ? stack.get_int(5)        : 0;
+	const f32 max_time    = nargs > 5 ? stack.get_float(6)      : 0.0f;
+	LUA_ASSERT(device()->_resource_manager->can_get(RESOURCE_TYPE_LEVEL, name), stack, "Level not found");
+	stack.push_level(stack.get_world(1)->load_level_async(name, pos, rot, max_units, max_time));
+	return 1;
+}
+
+static int world_load_level_streamed(lua_State* L)
+{
+	LuaStack stack(L);
+	const int nargs = stack.num_args();
+
+	const StringId64 name   = stack.get_resource_id(2);
+	const Vector3& pos      = stack.get_vector3(3);
+	const Quaternion& rot   = stack.get_quaternion(4);
+	const f32 load_radius   = stack.get_float(5);
+	const f32 unload_radius = nargs > 5 ? stack.get_float(6) : load_radius;
+	const u32 max_units     = nargs > 6 ? stack.get_int(7)   : 0;
+	const f32 max_time      = nargs > 7 ? stack.get_float(8) : 0.0f;
+	LUA_ASSERT(device()->_resource_manager->can_get(RESOURCE_TYPE_LEVEL, name), stack, "Level not found");
+	LUA_ASSERT(level_resource::num_cells((const LevelResource*)device()->_resource_manager->get(RESOURCE_TYPE_LEVEL, name)) > 0, stack, "Level has no cells");
+	LUA_ASSERT(load_radius <= unload_radius, stack, "Unload radius must not be smaller than load radius");
+	stack.push_level(stack.get_world(1)->load_level_streamed(name, pos, rot, load_radius, unload_radius, max_units, max_time));
+	return 1;
+}
+
+static int world_level_set_observers(lua_State* L)
+{
+	LuaStack stack(L);
+	const int nargs = stack.num_args();
+	Level* level = stack.get_level(2);
+	LUA_ASSERT(level->_streaming, stack, "Level is not streamed");
+
+	TempAllocator256 ta;
+	Array<Vector3> positions(ta);
+	for (int i = 3; i <= nargs; ++i)
+		array::push_back(positions, stack.get_vector3(i));
+
+	level->set_observers(array::begin(positions), array::size(positions));
+	return 0;
+}
+
+static int world_unload_level(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_world(1)->unload_level(stack.get_level(2));
+	return 0;
+}
+
+static int world_shrink_to_fit(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_world(1)->shrink_to_fit();
+	return 0;
+}
+
+static int world_events(lua_State* L)
+{
+	LuaStack stack(L);
+	World* world = stack.get_world(1);
+	const u32 size = array::size(world->_events);
+
+	stack.push_int(size);
+	if (size == 0)
+		return 1;
+
+	stack.push_pointer((void*)array::begin(world->_events));
+	return 2;
+}
+
+static int world_level_progress(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_level(2)->progress());
+	return 1;
+}
+
 static int world_scene_graph(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1643,22 +1977,43 @@ static int world_sound_world(lua_State* L)
 	return 1;
 }
 
-static int world_animation_state_machine(lua_State *L)
+static int world_navigation_world(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.push_animation_state_machine(stack.get_world(1)->_animation_state_machine);
+	stack.push_navigation_world(stack.get_world(1)->_navigation_world);
 	return 1;
 }
 
-static int world_tostring(lua_State* L)
+static int world_animation_state_machine(lua_State *L)
 {
 	LuaStack stack(L);
-	World* w = stack.get_world(1);
-	stack.push_fstring("World (%p)", w);
+	stack.push_animation_state_machine(stack.get_world(1)->_animation_state_machine);
 	return 1;
 }
 
-static int scene_graph_create(lua_State* L)
+static int world_skeleton_animation(lua_State *L)
+{
+	LuaStack stack(L);
+	stack.push_skeleton_animation(stack.get_world(1)->_skeleton_animation);
+	return 1;
+}
+
+static int world_replication(lua_State *L)
+{
+	LuaStack stack(L);
+	stack.push_replication(stack.get_world(1)->_replication);
+	return 1;
+}
+
+static int world_tostring(lua_State* L)
+{
+	LuaStack stack(L);
+	World* w = stack.get_world(1);
+	stack.push_fstring("World (%p)", w);
+	return 1;
+}
+
+static int scene_graph_create(lua_State* L)
 {
 	LuaStack stack(L);
 	SceneGraph* sg = stack.get_scene_graph(1);
@@ -1806,6 +2161,69 @@ static int scene_graph_set_local_pose(lua_State* L)
 	return 0;
 }
 
+static int scene_graph_set_local_positions(lua_State* L)
+{
+	LuaStack stack(L);
+	SceneGraph* sg = stack.get_scene_graph(1);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<Vector3> positions(ta);
+	array::resize(units, num);
+	array::resize(positions, num);
+	get_batch(stack, 2, &LuaStack::get_unit, units);
+	get_batch(stack, 3, &LuaStack::get_vector3, positions);
+
+	for (u32 i = 0; i < num; ++i)
+		LUA_ASSERT(sg->has(units[i]), stack, "Unit does not have transform");
+
+	sg->set_local_positions(array::begin(units), array::begin(positions), num);
+	return 0;
+}
+
+static int scene_graph_set_local_rotations(lua_State* L)
+{
+	LuaStack stack(L);
+	SceneGraph* sg = stack.get_scene_graph(1);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<Quaternion> rotations(ta);
+	array::resize(units, num);
+	array::resize(rotations, num);
+	get_batch(stack, 2, &LuaStack::get_unit, units);
+	get_batch(stack, 3, &LuaStack::get_quaternion, rotations);
+
+	for (u32 i = 0; i < num; ++i)
+		LUA_ASSERT(sg->has(units[i]), stack, "Unit does not have transform");
+
+	sg->set_local_rotations(array::begin(units), array::begin(rotations), num);
+	return 0;
+}
+
+static int scene_graph_set_local_poses(lua_State* L)
+{
+	LuaStack stack(L);
+	SceneGraph* sg = stack.get_scene_graph(1);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<Matrix4x4> poses(ta);
+	array::resize(units, num);
+	array::resize(poses, num);
+	get_batch(stack, 2, &LuaStack::get_unit, units);
+	get_batch(stack, 3, &LuaStack::get_matrix4x4, poses);
+
+	for (u32 i = 0; i < num; ++i)
+		LUA_ASSERT(sg->has(units[i]), stack, "Unit does not have transform");
+
+	sg->set_local_poses(array::begin(units), array::begin(poses), num);
+	return 0;
+}
+
 static int scene_graph_link(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1818,6 +2236,30 @@ static int scene_graph_link(lua_State* L)
 	return 0;
 }
 
+static int scene_graph_link_batch(lua_State* L)
+{
+	LuaStack stack(L);
+	SceneGraph* sg = stack.get_scene_graph(1);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> children(ta);
+	Array<UnitId> parents(ta);
+	array::resize(children, num);
+	array::resize(parents, num);
+	get_batch(stack, 2, &LuaStack::get_unit, children);
+	get_batch(stack, 3, &LuaStack::get_unit, parents);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		LUA_ASSERT(sg->has(children[i]), stack, "Unit child does not have transform");
+		LUA_ASSERT(sg->has(parents[i]), stack, "Unit parent does not have transform");
+	}
+
+	sg->link_batch(array::begin(children), array::begin(parents), num);
+	return 0;
+}
+
 static int scene_graph_unlink(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1828,6 +2270,26 @@ static int scene_graph_unlink(lua_State* L)
 	return 0;
 }
 
+// Pushes the number of instances @a num and, if there are any, raw
+// pointers to their @a units and @a world poses, for use with LuaJIT's FFI.
+static int push_instance_data(LuaStack& stack, u32 num, const UnitId* units, const Matrix4x4* world)
+{
+	stack.push_int(num);
+	if (num == 0)
+		return 1;
+
+	stack.push_pointer((void*)units);
+	stack.push_pointer((void*)world);
+	return 3;
+}
+
+static int scene_graph_data(lua_State* L)
+{
+	LuaStack stack(L);
+	SceneGraph* sg = stack.get_scene_graph(1);
+	return push_instance_data(stack, sg->num_nodes(), sg->units(), sg->world_poses());
+}
+
 static int unit_manager_create(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1910,6 +2372,23 @@ static int render_world_mesh_cast_ray(lua_State* L)
 	return 1;
 }
 
+static int render_world_mesh_raycast(lua_State* L)
+{
+	LuaStack stack(L);
+	const Vector3 from = stack.get_vector3(2);
+	const Vector3 dir = stack.get_vector3(3);
+
+	RenderRaycastHit hit;
+	stack.get_render_world(1)->mesh_cast_rays(&from, &dir, 1, &hit);
+
+	if (!hit.unit.is_valid())
+		return 0;
+
+	stack.push_unit(hit.unit);
+	stack.push_float(hit.distance);
+	return 2;
+}
+
 static int render_world_mesh_set_visible(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1969,6 +2448,40 @@ static int render_world_sprite_set_frame(lua_State* L)
 	return 0;
 }
 
+static int render_world_sprite_set_frames(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<u32> frames(ta);
+	array::resize(units, num);
+	array::resize(frames, num);
+	get_batch(stack, 2, &LuaStack::get_unit, units);
+	get_batch(stack, 3, &LuaStack::get_int, frames);
+
+	stack.get_render_world(1)->sprite_set_frames(array::begin(units), array::begin(frames), num);
+	return 0;
+}
+
+static int render_world_sprite_set_visibilities(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<bool> visible(ta);
+	array::resize(units, num);
+	array::resize(visible, num);
+	get_batch(stack, 2, &LuaStack::get_unit, units);
+	get_batch(stack, 3, &LuaStack::get_bool, visible);
+
+	stack.get_render_world(1)->sprite_set_visibilities(array::begin(units), array::begin(visible), num);
+	return 0;
+}
+
 static int render_world_sprite_flip_x(lua_State* L)
 {
 	LuaStack stack(L);
@@ -1997,6 +2510,30 @@ static int render_world_sprite_set_depth(lua_State* L)
 	return 0;
 }
 
+static int render_world_sprite_set_loop(lua_State* L)
+{
+	LuaStack stack(L);
+	RenderWorld* rw = stack.get_render_world(1);
+	const int nargs = stack.num_args();
+	const f32 start_time = nargs > 5 ? stack.get_float(6) : rw->time();
+	rw->sprite_set_loop(stack.get_unit(2), stack.get_int(3), stack.get_int(4), stack.get_float(5), start_time);
+	return 0;
+}
+
+static int render_world_sprite_stop_loop(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->sprite_set_loop(stack.get_unit(2), 0, 0, 0.0f, 0.0f);
+	return 0;
+}
+
+static int render_world_time(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_render_world(1)->time());
+	return 1;
+}
+
 static int render_world_sprite_obb(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2006,6 +2543,37 @@ static int render_world_sprite_obb(lua_State* L)
 	return 2;
 }
 
+static int render_world_mesh_data(lua_State* L)
+{
+	LuaStack stack(L);
+	RenderWorld* rw = stack.get_render_world(1);
+	return push_instance_data(stack, rw->mesh_num(), rw->mesh_units(), rw->mesh_world_poses());
+}
+
+static int render_world_sprite_data(lua_State* L)
+{
+	LuaStack stack(L);
+	RenderWorld* rw = stack.get_render_world(1);
+	return push_instance_data(stack, rw->sprite_num(), rw->sprite_units(), rw->sprite_world_poses());
+}
+
+static int render_world_sprite_raycast(lua_State* L)
+{
+	LuaStack stack(L);
+	const Vector3 from = stack.get_vector3(2);
+	const Vector3 dir = stack.get_vector3(3);
+
+	RenderRaycastHit hit;
+	stack.get_render_world(1)->sprite_cast_rays(&from, &dir, 1, &hit);
+
+	if (!hit.unit.is_valid())
+		return 0;
+
+	stack.push_unit(hit.unit);
+	stack.push_float(hit.distance);
+	return 2;
+}
+
 static int render_world_sprite_cast_ray(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2038,6 +2606,7 @@ static int render_world_light_create(lua_State* L)
 	ld.intensity  = stack.get_float(5);
 	ld.spot_angle = stack.get_float(6);
 	ld.color      = stack.get_vector3(7);
+	ld.cast_shadows = stack.num_args() > 8 ? stack.get_bool(9) : false;
 
 	Matrix4x4 pose = stack.get_matrix4x4(8);
 
@@ -2102,6 +2671,13 @@ static int render_world_light_spot_angle(lua_State* L)
 	return 1;
 }
 
+static int render_world_light_cast_shadows(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_render_world(1)->light_cast_shadows(stack.get_unit(2)));
+	return 1;
+}
+
 static int render_world_light_set_type(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2142,6 +2718,13 @@ static int render_world_light_set_spot_angle(lua_State* L)
 	return 0;
 }
 
+static int render_world_light_set_cast_shadows(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->light_set_cast_shadows(stack.get_unit(2), stack.get_bool(3));
+	return 0;
+}
+
 static int render_world_light_debug_draw(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2149,6 +2732,152 @@ static int render_world_light_debug_draw(lua_State* L)
 	return 0;
 }
 
+static int render_world_particle_create(lua_State* L)
+{
+	LuaStack stack(L);
+	RenderWorld* rw = stack.get_render_world(1);
+	UnitId unit = stack.get_unit(2);
+
+	ParticleEmitterDesc desc;
+	desc.particle_resource = stack.get_resource_id(3);
+	desc.material_resource = stack.get_resource_id(4);
+	desc.playing = stack.num_args() > 5 ? stack.get_bool(6) : true;
+
+	Matrix4x4 pose = stack.get_matrix4x4(5);
+
+	stack.push_particle_instance(rw->particle_create(unit, desc, pose));
+	return 1;
+}
+
+static int render_world_particle_destroy(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->particle_destroy(stack.get_unit(2)
+		, stack.get_particle_instance(3)
+		);
+	return 0;
+}
+
+static int render_world_particle_instance(lua_State* L)
+{
+	LuaStack stack(L);
+	ParticleInstance inst = stack.get_render_world(1)->particle_instance(stack.get_unit(2));
+
+	if (inst.i == UINT32_MAX)
+		return 0;
+
+	stack.push_particle_instance(inst);
+	return 1;
+}
+
+static int render_world_particle_play(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->particle_play(stack.get_unit(2));
+	return 0;
+}
+
+static int render_world_particle_stop(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->particle_stop(stack.get_unit(2));
+	return 0;
+}
+
+static int render_world_particle_is_playing(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_render_world(1)->particle_is_playing(stack.get_unit(2)));
+	return 1;
+}
+
+static int render_world_particle_burst(lua_State* L)
+{
+	LuaStack stack(L);
+	const s32 num = stack.get_int(3);
+	LUA_ASSERT(num >= 0, stack, "Number of particles must be >= 0");
+	stack.get_render_world(1)->particle_burst(stack.get_unit(2), u32(num));
+	return 0;
+}
+
+static int render_world_particle_num(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_int(stack.get_render_world(1)->particle_num(stack.get_unit(2)));
+	return 1;
+}
+
+static int render_world_tilemap_create(lua_State* L)
+{
+	LuaStack stack(L);
+	RenderWorld* rw = stack.get_render_world(1);
+	UnitId unit = stack.get_unit(2);
+
+	TilemapDesc desc;
+	desc.tilemap_resource = stack.get_resource_id(3);
+	desc.material_resource = stack.get_resource_id(4);
+	desc.layer = stack.get_int(5);
+	desc.depth = stack.get_int(6);
+
+	Matrix4x4 pose = stack.get_matrix4x4(7);
+
+	stack.push_tilemap_instance(rw->tilemap_create(unit, desc, pose));
+	return 1;
+}
+
+static int render_world_tilemap_destroy(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->tilemap_destroy(stack.get_unit(2)
+		, stack.get_tilemap_instance(3)
+		);
+	return 0;
+}
+
+static int render_world_tilemap_instance(lua_State* L)
+{
+	LuaStack stack(L);
+	TilemapInstance inst = stack.get_render_world(1)->tilemap_instance(stack.get_unit(2));
+
+	if (inst.i == UINT32_MAX)
+		return 0;
+
+	stack.push_tilemap_instance(inst);
+	return 1;
+}
+
+static int render_world_tilemap_size(lua_State* L)
+{
+	LuaStack stack(L);
+	u32 width;
+	u32 height;
+	stack.get_render_world(1)->tilemap_size(stack.get_unit(2), width, height);
+	stack.push_int(width);
+	stack.push_int(height);
+	return 2;
+}
+
+static int render_world_tilemap_tile(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_int(stack.get_render_world(1)->tilemap_tile(stack.get_unit(2)
+		, stack.get_int(3)
+		, stack.get_int(4)
+		));
+	return 1;
+}
+
+static int render_world_tilemap_set_tile(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->tilemap_set_tile(stack.get_unit(2)
+		, stack.get_int(3)
+		, stack.get_int(4)
+		, stack.get_int(5)
+		);
+	return 0;
+}
+
 static int render_world_enable_debug_drawing(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2156,6 +2885,68 @@ static int render_world_enable_debug_drawing(lua_State* L)
 	return 0;
 }
 
+static int render_world_set_mesh_lod_bias(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_render_world(1)->set_mesh_lod_bias(stack.get_float(2));
+	return 0;
+}
+
+static int render_world_mesh_lod_bias(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_render_world(1)->mesh_lod_bias());
+	return 1;
+}
+
+static int render_world_stats(lua_State* L)
+{
+	LuaStack stack(L);
+	const RenderStats& rs = stack.get_render_world(1)->stats();
+
+	stack.push_table(0, 13);
+	stack.push_key_begin("mesh_draw_calls");
+	stack.push_int(rs.mesh_draw_calls);
+	stack.push_key_end();
+	stack.push_key_begin("mesh_material_binds");
+	stack.push_int(rs.mesh_material_binds);
+	stack.push_key_end();
+	stack.push_key_begin("mesh_triangles");
+	stack.push_int(rs.mesh_triangles);
+	stack.push_key_end();
+	stack.push_key_begin("meshes_submitted");
+	stack.push_int(rs.meshes_submitted);
+	stack.push_key_end();
+	stack.push_key_begin("meshes_culled");
+	stack.push_int(rs.meshes_culled);
+	stack.push_key_end();
+	stack.push_key_begin("meshes_occluded");
+	stack.push_int(rs.meshes_occluded);
+	stack.push_key_end();
+	stack.push_key_begin("sprites_submitted");
+	stack.push_int(rs.sprites_submitted);
+	stack.push_key_end();
+	stack.push_key_begin("sprites_culled");
+	stack.push_int(rs.sprites_culled);
+	stack.push_key_end();
+	stack.push_key_begin("sprite_draw_calls");
+	stack.push_int(rs.sprite_draw_calls);
+	stack.push_key_end();
+	stack.push_key_begin("tilemap_draw_calls");
+	stack.push_int(rs.tilemap_draw_calls);
+	stack.push_key_end();
+	stack.push_key_begin("tilemap_chunks_culled");
+	stack.push_int(rs.tilemap_chunks_culled);
+	stack.push_key_end();
+	stack.push_key_begin("transient_vb_used");
+	stack.push_int(rs.transient_vb_used);
+	stack.push_key_end();
+	stack.push_key_begin("texture_memory");
+	stack.push_int(rs.texture_memory);
+	stack.push_key_end();
+	return 1;
+}
+
 static int physics_world_actor_instances(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2329,6 +3120,23 @@ static int physics_world_actor_set_linear_velocity(lua_State* L)
 	return 0;
 }
 
+static int physics_world_actor_set_linear_velocities(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<ActorInstance> actors(ta);
+	Array<Vector3> vels(ta);
+	array::resize(actors, num);
+	array::resize(vels, num);
+	get_batch(stack, 2, &LuaStack::get_actor, actors);
+	get_batch(stack, 3, &LuaStack::get_vector3, vels);
+
+	stack.get_physics_world(1)->actor_set_linear_velocities(array::begin(actors), array::begin(vels), num);
+	return 0;
+}
+
 static int physics_world_actor_angular_velocity(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2392,6 +3200,119 @@ static int physics_world_actor_wake_up(lua_State* L)
 	return 0;
 }
 
+static int physics_world_actor_set_max_linear_velocity(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_physics_world(1)->actor_set_max_linear_velocity(stack.get_actor(2), stack.get_float(3));
+	return 0;
+}
+
+static int physics_world_actor_set_report_contacts(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_physics_world(1)->actor_set_report_contacts(stack.get_actor(2), stack.get_bool(3));
+	return 0;
+}
+
+static int physics_world_set_lod_observers(lua_State* L)
+{
+	LuaStack stack(L);
+	LUA_ASSERT(stack.is_table(2), stack, "Table expected");
+
+	TempAllocator1024 ta;
+	Array<Vector3> positions(ta);
+
+	stack.push_nil();
+	while (stack.next(2) != 0)
+	{
+		array::push_back(positions, stack.get_vector3(-1));
+		stack.pop(1);
+	}
+
+	stack.get_physics_world(1)->set_lod_observers(array::begin(positions), array::size(positions));
+	return 0;
+}
+
+static int physics_world_mover_create(lua_State* L)
+{
+	LuaStack stack(L);
+	PhysicsWorld* pw = stack.get_physics_world(1);
+	const UnitId unit = stack.get_unit(2);
+
+	MoverDesc md;
+	md.radius      = stack.get_float(3);
+	md.height      = stack.get_float(4);
+	md.step_height = stack.get_float(5);
+	md.max_slope   = stack.get_float(6);
+
+	stack.push_mover(pw->mover_create(unit, md, stack.get_matrix4x4(7)));
+	return 1;
+}
+
+static int physics_world_mover_destroy(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_physics_world(1)->mover_destroy(stack.get_mover(2));
+	return 0;
+}
+
+static int physics_world_mover(lua_State* L)
+{
+	LuaStack stack(L);
+	MoverInstance inst = stack.get_physics_world(1)->mover(stack.get_unit(2));
+
+	if (is_valid(inst))
+		stack.push_mover(inst);
+	else
+		stack.push_nil();
+	return 1;
+}
+
+static int physics_world_mover_position(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_vector3(stack.get_physics_world(1)->mover_position(stack.get_mover(2)));
+	return 1;
+}
+
+static int physics_world_mover_set_velocities(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<MoverInstance> movers(ta);
+	Array<Vector3> vels(ta);
+	array::resize(movers, num);
+	array::resize(vels, num);
+	get_batch(stack, 2, &LuaStack::get_mover, movers);
+	get_batch(stack, 3, &LuaStack::get_vector3, vels);
+
+	stack.get_physics_world(1)->mover_set_velocities(array::begin(movers), array::begin(vels), num);
+	return 0;
+}
+
+static int physics_world_mover_on_ground(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_physics_world(1)->mover_on_ground(stack.get_mover(2)));
+	return 1;
+}
+
+static int physics_world_mover_collides_sides(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_physics_world(1)->mover_collides_sides(stack.get_mover(2)));
+	return 1;
+}
+
+static int physics_world_mover_collides_up(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_physics_world(1)->mover_collides_up(stack.get_mover(2)));
+	return 1;
+}
+
 static int physics_world_joint_create(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2543,54 +3464,286 @@ static int physics_world_cast_box(lua_State* L)
 	return 1;
 }
 
-static int physics_world_enable_debug_drawing(lua_State* L)
+static int physics_world_cast_batch(lua_State* L)
+{
+	LuaStack stack(L);
+	LUA_ASSERT(stack.is_table(2), stack, "Table expected");
+
+	TempAllocator4096 ta;
+	Array<PhysicsCast> casts(ta);
+
+	stack.push_nil();
+	while (stack.next(2) != 0)
+	{
+		LUA_ASSERT(stack.is_table(-1), stack, "Table expected");
+
+		const char* type = "ray";
+		lua_getfield(L, -1, "type");
+		if (!stack.is_nil(-1))
+			type = stack.get_string(-1);
+		stack.pop(1);
+
+		PhysicsCast pc;
+		pc.half_extents = VECTOR3_ZERO;
+
+		if (strcmp(type, "ray") == 0)
+		{
+			pc.type = PhysicsCast::RAY;
+		}
+		else if (strcmp(type, "sphere") == 0)
+		{
+			pc.type = PhysicsCast::SPHERE;
+			lua_getfield(L, -1, "radius");
+			pc.half_extents.x = stack.get_float(-1);
+			stack.pop(1);
+		}
+		else if (strcmp(type, "box") == 0)
+		{
+			pc.type = PhysicsCast::BOX;
+			lua_getfield(L, -1, "half_extents");
+			pc.half_extents = stack.get_vector3(-1);
+			stack.pop(1);
+		}
+		else
+		{
+			LUA_ASSERT(false, stack, "Unknown cast type: '%s'", type);
+		}
+
+		lua_getfield(L, -1, "from");
+		pc.from = stack.get_vector3(-1);
+		stack.pop(1);
+		lua_getfield(L, -1, "dir");
+		pc.dir = stack.get_vector3(-1);
+		stack.pop(1);
+		lua_getfield(L, -1, "len");
+		pc.len = stack.get_float(-1);
+		stack.pop(1);
+
+		array::push_back(casts, pc);
+		stack.pop(1);
+	}
+
+	const u32 num_casts = array::size(casts);
+	Array<RaycastHit> hits(ta);
+	array::resize(hits, num_casts);
+	stack.get_physics_world(1)->cast_batch(array::begin(hits), array::begin(casts), num_casts);
+
+	stack.push_table(num_casts);
+	for (u32 i = 0; i < num_casts; ++i)
+	{
+		stack.push_key_begin(i+1);
+		if (hits[i].actor.i == UINT32_MAX)
+		{
+			stack.push_bool(false);
+		}
+		else
+		{
+			stack.push_table();
+			{
+				stack.push_key_begin(1);
+				stack.push_vector3(hits[i].position);
+				stack.push_key_end();
+
+				stack.push_key_begin(2);
+				stack.push_vector3(hits[i].normal);
+				stack.push_key_end();
+
+				stack.push_key_begin(3);
+				stack.push_float(hits[i].time);
+				stack.push_key_end();
+
+				stack.push_key_begin(4);
+				stack.push_unit(hits[i].unit);
+				stack.push_key_end();
+
+				stack.push_key_begin(5);
+				stack.push_actor(hits[i].actor);
+				stack.push_key_end();
+			}
+		}
+		stack.push_key_end();
+	}
+
+	return 1;
+}
+
+static int physics_world_enable_debug_drawing(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_physics_world(1)->enable_debug_drawing(stack.get_bool(2));
+	return 0;
+}
+
+static int physics_world_enable_async_update(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_physics_world(1)->enable_async_update(stack.get_bool(2));
+	return 0;
+}
+
+static int physics_world_set_step_frequency(lua_State* L)
+{
+	LuaStack stack(L);
+	const f32 frequency = stack.get_float(2);
+	LUA_ASSERT(frequency > 0.0f, stack, "Frequency must be greater than zero");
+	stack.get_physics_world(1)->set_step_frequency(frequency);
+	return 0;
+}
+
+static int physics_world_set_max_substeps(lua_State* L)
+{
+	LuaStack stack(L);
+	const s32 num = stack.get_int(2);
+	LUA_ASSERT(num > 0, stack, "Max substeps must be greater than zero");
+	stack.get_physics_world(1)->set_max_substeps(u32(num));
+	return 0;
+}
+
+static int physics_world_set_solver_iterations(lua_State* L)
+{
+	LuaStack stack(L);
+	const s32 num = stack.get_int(2);
+	LUA_ASSERT(num > 0, stack, "Solver iterations must be greater than zero");
+	stack.get_physics_world(1)->set_solver_iterations(u32(num));
+	return 0;
+}
+
+static int physics_world_tostring(lua_State* L)
+{
+	LuaStack stack(L);
+	PhysicsWorld* pw = stack.get_physics_world(1);
+	stack.push_fstring("PhysicsWorld (%p)", pw);
+	return 1;
+}
+
+static int sound_world_stop_all(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_sound_world(1)->stop_all();
+	return 0;
+}
+
+static int sound_world_pause_all(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_sound_world(1)->pause_all();
+	return 0;
+}
+
+static int sound_world_resume_all(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_sound_world(1)->resume_all();
+	return 0;
+}
+
+static int sound_world_is_playing(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_sound_world(1)->is_playing(stack.get_sound_instance_id(2)));
+	return 1;
+}
+
+static int sound_world_tostring(lua_State* L)
+{
+	LuaStack stack(L);
+	SoundWorld* sw = stack.get_sound_world(1);
+	stack.push_fstring("SoundWorld (%p)", sw);
+	return 1;
+}
+
+static int navigation_world_set_grid(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_navigation_world(1)->set_grid(stack.get_resource_id(2));
+	return 0;
+}
+
+static int navigation_world_block_static(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_navigation_world(1)->block_static(*stack.get_physics_world(2)
+		, stack.get_float(3)
+		, stack.get_float(4)
+		);
+	return 0;
+}
+
+static int navigation_world_is_walkable(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_physics_world(1)->enable_debug_drawing(stack.get_bool(2));
-	return 0;
+	stack.push_bool(stack.get_navigation_world(1)->is_walkable(stack.get_vector3(2)));
+	return 1;
 }
 
-static int physics_world_tostring(lua_State* L)
+static int navigation_world_find_path(lua_State* L)
 {
 	LuaStack stack(L);
-	PhysicsWorld* pw = stack.get_physics_world(1);
-	stack.push_fstring("PhysicsWorld (%p)", pw);
+	const Vector3 from = stack.get_vector3(2);
+	const Vector3 to = stack.get_vector3(3);
+	stack.push_int(stack.get_navigation_world(1)->find_paths(&from, &to, 1));
 	return 1;
 }
 
-static int sound_world_stop_all(lua_State* L)
+static int navigation_world_find_paths(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_sound_world(1)->stop_all();
-	return 0;
+	const u32 num = batch_size(stack, 2, 3);
+
+	TempAllocator4096 ta;
+	Array<Vector3> from(ta);
+	Array<Vector3> to(ta);
+	array::resize(from, num);
+	array::resize(to, num);
+	get_batch(stack, 2, &LuaStack::get_vector3, from);
+	get_batch(stack, 3, &LuaStack::get_vector3, to);
+
+	stack.push_int(stack.get_navigation_world(1)->find_paths(array::begin(from), array::begin(to), num));
+	return 1;
 }
 
-static int sound_world_pause_all(lua_State* L)
+static int navigation_world_path_status(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_sound_world(1)->pause_all();
-	return 0;
+	const PathStatus::Enum status = stack.get_navigation_world(1)->path_status(stack.get_int(2));
+	stack.push_string(s_path_status[status]);
+	return 1;
 }
 
-static int sound_world_resume_all(lua_State* L)
+static int navigation_world_path(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_sound_world(1)->resume_all();
-	return 0;
+	NavigationWorld* nw = stack.get_navigation_world(1);
+	const u32 handle = stack.get_int(2);
+	LUA_ASSERT(nw->path_status(handle) == PathStatus::FOUND, stack, "Path not found");
+
+	TempAllocator1024 ta;
+	Array<Vector3> points(ta);
+	nw->path(handle, points);
+
+	const u32 num = array::size(points);
+	stack.push_table(num);
+	for (u32 i = 0; i < num; ++i)
+	{
+		stack.push_key_begin(i+1);
+		stack.push_vector3(points[i]);
+		stack.push_key_end();
+	}
+	return 1;
 }
 
-static int sound_world_is_playing(lua_State* L)
+static int navigation_world_destroy_path(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.push_bool(stack.get_sound_world(1)->is_playing(stack.get_sound_instance_id(2)));
-	return 1;
+	stack.get_navigation_world(1)->destroy_path(stack.get_int(2));
+	return 0;
 }
 
-static int sound_world_tostring(lua_State* L)
+static int navigation_world_tostring(lua_State* L)
 {
 	LuaStack stack(L);
-	SoundWorld* sw = stack.get_sound_world(1);
-	stack.push_fstring("SoundWorld (%p)", sw);
+	NavigationWorld* nw = stack.get_navigation_world(1);
+	stack.push_fstring("NavigationWorld (%p)", nw);
 	return 1;
 }
 
@@ -2634,6 +3787,137 @@ static int animation_state_machine_set_variable(lua_State* L)
 	return 0;
 }
 
+static int skeleton_animation_play(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_skeleton_animation(1)->play(stack.get_unit(2)
+		, stack.get_resource_id(3)
+		, stack.num_args() == 4 ? stack.get_bool(4) : true
+		);
+	return 0;
+}
+
+static int skeleton_animation_crossfade(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_skeleton_animation(1)->crossfade(stack.get_unit(2)
+		, stack.get_resource_id(3)
+		, stack.get_float(4)
+		, stack.num_args() == 5 ? stack.get_bool(5) : true
+		);
+	return 0;
+}
+
+static int skeleton_animation_set_speed(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_skeleton_animation(1)->set_speed(stack.get_unit(2)
+		, stack.get_float(3)
+		);
+	return 0;
+}
+
+static int skeleton_animation_time(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_float(stack.get_skeleton_animation(1)->time(stack.get_unit(2)));
+	return 1;
+}
+
+static int skeleton_animation_bone_pose(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_matrix4x4(stack.get_skeleton_animation(1)->bone_pose(stack.get_unit(2)
+		, stack.get_string_id_32(3)
+		));
+	return 1;
+}
+
+static int replication_listen(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_replication(1)->listen((u16)stack.get_int(2)));
+	return 1;
+}
+
+static int replication_connect(lua_State* L)
+{
+	LuaStack stack(L);
+	const char* str = stack.get_string(2);
+
+	u32 a, b, c, d;
+	if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+	{
+		LUA_ASSERT(false, stack, "Invalid IP address: %s", str);
+		stack.push_bool(false);
+		return 1;
+	}
+
+	const IPAddress ip = { u8(a), u8(b), u8(c), u8(d) };
+	stack.push_bool(stack.get_replication(1)->connect(ip, (u16)stack.get_int(3)));
+	return 1;
+}
+
+static int replication_stop(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_replication(1)->stop();
+	return 0;
+}
+
+static int replication_add(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_replication(1)->add(stack.get_unit(2), (u32)stack.get_int(3));
+	return 0;
+}
+
+static int replication_remove(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_replication(1)->remove(stack.get_unit(2));
+	return 0;
+}
+
+static int replication_has(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_replication(1)->has(stack.get_unit(2)));
+	return 1;
+}
+
+static int replication_set_value(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 index = (u32)stack.get_int(3);
+	LUA_ASSERT(index < CROWN_REPLICATION_MAX_VALUES, stack, "Index out of bounds");
+	stack.get_replication(1)->set_value(stack.get_unit(2), index, stack.get_float(4));
+	return 0;
+}
+
+static int replication_value(lua_State* L)
+{
+	LuaStack stack(L);
+	const u32 index = (u32)stack.get_int(3);
+	LUA_ASSERT(index < CROWN_REPLICATION_MAX_VALUES, stack, "Index out of bounds");
+	stack.push_float(stack.get_replication(1)->value(stack.get_unit(2), index));
+	return 1;
+}
+
+static int replication_set_send_interval(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_replication(1)->set_send_interval(stack.get_float(2));
+	return 0;
+}
+
+static int replication_num_clients(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_int(stack.get_replication(1)->num_clients());
+	return 1;
+}
+
 static int device_argv(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2700,10 +3984,36 @@ static int device_destroy_world(lua_State* L)
 	return 0;
 }
 
+static int device_update_worlds(lua_State* L)
+{
+	LuaStack stack(L);
+	LUA_ASSERT(stack.is_table(1), stack, "Table expected");
+
+	TempAllocator256 alloc;
+	Array<World*> worlds(alloc);
+
+	stack.push_nil();
+	while (stack.next(1) != 0)
+	{
+		array::push_back(worlds, stack.get_world(-1));
+		stack.pop(1);
+	}
+
+	update_worlds(array::begin(worlds), array::size(worlds), stack.get_float(2));
+	return 0;
+}
+
 static int device_render(lua_State* L)
 {
 	LuaStack stack(L);
-	device()->render(*stack.get_world(1), stack.get_unit(2));
+	const u32 num = u32(stack.num_args() - 1);
+	LUA_ASSERT(num > 0 && num <= CROWN_MAX_CAMERAS, stack, "Invalid number of cameras: %u", num);
+
+	UnitId cameras[CROWN_MAX_CAMERAS];
+	for (u32 c = 0; c < num; ++c)
+		cameras[c] = stack.get_unit(2 + c);
+
+	device()->render(*stack.get_world(1), cameras, num);
 	return 0;
 }
 
@@ -2721,6 +4031,20 @@ static int device_destroy_resource_package(lua_State* L)
 	return 0;
 }
 
+static int device_prefetch_resource_package(lua_State* L)
+{
+	LuaStack stack(L);
+	device()->_resource_manager->prefetch(stack.get_resource_id(1));
+	return 0;
+}
+
+static int device_unload_prefetched_resource_package(lua_State* L)
+{
+	LuaStack stack(L);
+	device()->_resource_manager->unload_prefetched(stack.get_resource_id(1));
+	return 0;
+}
+
 static void lua_dump_table(lua_State* L, int i, StringStream& json)
 {
 	LuaStack stack(L);
@@ -2861,25 +4185,86 @@ static int device_enable_resource_autoload(lua_State* L)
 
 static int device_temp_count(lua_State* L)
 {
+	// Math values are garbage collected, there are no temporaries anymore.
 	LuaStack stack(L);
-	u32 nv, nq, nm;
-	device()->_lua_environment->temp_count(nv, nq, nm);
-	stack.push_int(nv);
-	stack.push_int(nq);
-	stack.push_int(nm);
+	stack.push_int(0);
+	stack.push_int(0);
+	stack.push_int(0);
 	return 3;
 }
 
-static int device_set_temp_count(lua_State* L)
+static int device_set_temp_count(lua_State* /*L*/)
+{
+	return 0;
+}
+
+static int device_set_perf_overlay(lua_State* L)
+{
+	LuaStack stack(L);
+	device()->_perf_overlay._enabled = stack.get_bool(1);
+	return 0;
+}
+
+static int device_perf_overlay(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(device()->_perf_overlay._enabled);
+	return 1;
+}
+
+static int device_screenshot(lua_State* L)
+{
+	LuaStack stack(L);
+	device()->_screen_capture->screenshot(stack.get_string(1));
+	return 0;
+}
+
+static int device_start_capture(lua_State* L)
 {
 	LuaStack stack(L);
-	u32 nv = stack.get_int(1);
-	u32 nq = stack.get_int(2);
-	u32 nm = stack.get_int(3);
-	device()->_lua_environment->set_temp_count(nv, nq, nm);
+	const f32 fps = stack.num_args() > 1 ? stack.get_float(2) : 30.0f;
+	LUA_ASSERT(fps > 0.0f, stack, "Frame rate must be > 0");
+	device()->_screen_capture->start(stack.get_string(1), fps);
 	return 0;
 }
 
+static int device_stop_capture(lua_State* /*L*/)
+{
+	device()->_screen_capture->stop();
+	return 0;
+}
+
+static int device_memory_usage(lua_State* L)
+{
+	LuaStack stack(L);
+
+	stack.push_table(0, GpuMemoryCategory::COUNT + 3);
+	stack.push_key_begin("bgfx");
+	stack.push_int(device()->bgfx_allocated());
+	stack.push_key_end();
+	for (u32 i = 0; i < GpuMemoryCategory::COUNT; ++i)
+	{
+		stack.push_key_begin(gpu_memory::name(GpuMemoryCategory::Enum(i)));
+		stack.push_int(gpu_memory::allocated(GpuMemoryCategory::Enum(i)));
+		stack.push_key_end();
+	}
+	stack.push_key_begin("gpu_total");
+	stack.push_int(gpu_memory::total_allocated());
+	stack.push_key_end();
+
+	// Peaks since startup, to size the budgets.
+	stack.push_key_begin("gpu_peak");
+	stack.push_table(0, GpuMemoryCategory::COUNT);
+	for (u32 i = 0; i < GpuMemoryCategory::COUNT; ++i)
+	{
+		stack.push_key_begin(gpu_memory::name(GpuMemoryCategory::Enum(i)));
+		stack.push_int(gpu_memory::peak(GpuMemoryCategory::Enum(i)));
+		stack.push_key_end();
+	}
+	stack.push_key_end();
+	return 1;
+}
+
 static int device_guid(lua_State* L)
 {
 	LuaStack stack(L);
@@ -2894,7 +4279,7 @@ static int device_guid(lua_State* L)
 static int profiler_enter_scope(lua_State* L)
 {
 	LuaStack stack(L);
-	profiler::enter_profile_scope(stack.get_string(1));
+	profiler::enter_profile_scope(device()->_lua_environment->intern(stack.get_string(1)));
 	return 0;
 }
 
@@ -2919,6 +4304,47 @@ static int profiler_record(lua_State* L)
 	return 0;
 }
 
+static int job_run(lua_State* L)
+{
+	LuaStack stack(L);
+	const StringId64 name = stack.get_resource_id(1);
+	LUA_ASSERT(device()->_resource_manager->can_get(RESOURCE_TYPE_SCRIPT, name), stack, "Script not found");
+
+	u32 size = 0;
+	const char* input = stack.num_args() > 1 ? stack.get_lstring(2, size) : "";
+
+	const LuaResource* lr = (LuaResource*)device()->_resource_manager->get(RESOURCE_TYPE_SCRIPT, name);
+	stack.push_id(device()->_lua_environment->_jobs.run(lr, input, size));
+	return 1;
+}
+
+static int job_is_done(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(device()->_lua_environment->_jobs.is_done(stack.get_id(1)));
+	return 1;
+}
+
+static int job_result(lua_State* L)
+{
+	LuaStack stack(L);
+	LuaJobs& jobs = device()->_lua_environment->_jobs;
+	const u32 id = stack.get_id(1);
+
+	const LuaJob& lj = jobs.wait(id);
+	const bool error = lj.error;
+	if (lj.output != NULL)
+		stack.push_lstring(lj.output, lj.output_size);
+	else
+		stack.push_nil();
+	jobs.destroy(id);
+
+	if (error)
+		lua_error(L);
+
+	return 1;
+}
+
 static int debug_line_add_line(lua_State* L)
 {
 	LuaStack stack(L);
@@ -3034,6 +4460,27 @@ static int debug_line_add_unit(lua_State* L)
 	return 0;
 }
 
+static int debug_line_set_duration(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_debug_line(1)->set_duration(stack.get_float(2));
+	return 0;
+}
+
+static int debug_line_update(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_debug_line(1)->update(stack.get_float(2));
+	return 0;
+}
+
+static int debug_line_set_pose(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_debug_line(1)->set_pose(stack.get_matrix4x4(2));
+	return 0;
+}
+
 static int debug_line_reset(lua_State* L)
 {
 	LuaStack stack(L);
@@ -3058,7 +4505,16 @@ static int debug_line_tostring(lua_State* L)
 static int resource_package_load(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_resource_package(1)->load();
+
+	ResourcePriority::Enum priority = ResourcePriority::NORMAL;
+	if (stack.num_args() == 2)
+	{
+		const char* name = stack.get_string(2);
+		priority = name_to_resource_priority(name);
+		LUA_ASSERT(priority != ResourcePriority::COUNT, stack, "Unknown resource priority: '%s'", name);
+	}
+
+	stack.get_resource_package(1)->load(priority);
 	return 0;
 }
 
@@ -3072,7 +4528,9 @@ static int resource_package_unload(lua_State* L)
 static int resource_package_flush(lua_State* L)
 {
 	LuaStack stack(L);
-	stack.get_resource_package(1)->flush();
+	ResourcePackage* package = stack.get_resource_package(1);
+	package->flush();
+	device()->prewarm(*package);
 	return 0;
 }
 
@@ -3177,6 +4635,41 @@ static int gui_text(lua_State* L)
 	return 0;
 }
 
+static int gui_dirty(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.push_bool(stack.get_gui(1)->dirty());
+	return 1;
+}
+
+static int gui_set_dirty(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_gui(1)->set_dirty();
+	return 0;
+}
+
+static int gui_begin_layer(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_gui(1)->begin_layer();
+	return 0;
+}
+
+static int gui_end_layer(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_gui(1)->end_layer();
+	return 0;
+}
+
+static int gui_draw_layer(lua_State* L)
+{
+	LuaStack stack(L);
+	stack.get_gui(1)->draw_layer();
+	return 0;
+}
+
 static int display_modes(lua_State* L)
 {
 	LuaStack stack(L);
@@ -3288,6 +4781,13 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Math", "ray_obb_intersection",      math_ray_obb_intersection);
 	env.add_module_function("Math", "ray_triangle_intersection", math_ray_triangle_intersection);
 
+	env.add_module_function("Random", "integer",    random_integer);
+	env.add_module_function("Random", "unit_float", random_unit_float);
+	env.add_module_function("Random", "range",      random_range);
+	env.add_module_function("Random", "split",      random_split);
+	env.add_module_function("Random", "fill",       random_fill);
+	env.add_module_metafunction("Random", "__call", random_ctor);
+
 	env.add_module_function("Vector3", "x",                vector3_x);
 	env.add_module_function("Vector3", "y",                vector3_y);
 	env.add_module_function("Vector3", "z",                vector3_z);
@@ -3404,12 +4904,6 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Color4", "to_string", quaternion_to_string);
 	env.add_module_metafunction("Color4", "__call", color4_ctor);
 
-	env.add_module_metafunction("Lightuserdata_mt", "__add",      lightuserdata_add);
-	env.add_module_metafunction("Lightuserdata_mt", "__sub",      lightuserdata_sub);
-	env.add_module_metafunction("Lightuserdata_mt", "__mul",      lightuserdata_mul);
-	env.add_module_metafunction("Lightuserdata_mt", "__unm",      lightuserdata_unm);
-	env.add_module_metafunction("Lightuserdata_mt", "__index",    lightuserdata_index);
-	env.add_module_metafunction("Lightuserdata_mt", "__newindex", lightuserdata_newindex);
 
 	env.add_module_function("Keyboard", "name",         keyboard_name);
 	env.add_module_function("Keyboard", "connected",    keyboard_connected);
@@ -3422,6 +4916,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Keyboard", "button",       keyboard_button);
 	env.add_module_function("Keyboard", "button_name",  keyboard_button_name);
 	env.add_module_function("Keyboard", "button_id",    keyboard_button_id);
+	env.add_module_function("Keyboard", "events",       keyboard_events);
 
 	env.add_module_function("Mouse", "name",         mouse_name);
 	env.add_module_function("Mouse", "connected",    mouse_connected);
@@ -3437,6 +4932,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Mouse", "axis_name",    mouse_axis_name);
 	env.add_module_function("Mouse", "button_id",    mouse_button_id);
 	env.add_module_function("Mouse", "axis_id",      mouse_axis_id);
+	env.add_module_function("Mouse", "events",       mouse_events);
 
 	env.add_module_function("Touch", "name",         touch_name);
 	env.add_module_function("Touch", "connected",    touch_connected);
@@ -3452,6 +4948,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Touch", "axis_name",    touch_axis_name);
 	env.add_module_function("Touch", "button_id",    touch_button_id);
 	env.add_module_function("Touch", "axis_id",      touch_axis_id);
+	env.add_module_function("Touch", "events",       touch_events);
 
 	env.add_module_function("Pad1", "name",         pad0_name);
 	env.add_module_function("Pad1", "connected",    pad0_connected);
@@ -3469,6 +4966,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Pad1", "axis_id",      pad0_axis_id);
 	env.add_module_function("Pad1", "deadzone",     pad0_deadzone);
 	env.add_module_function("Pad1", "set_deadzone", pad0_set_deadzone);
+	env.add_module_function("Pad1", "events",       pad0_events);
 
 	env.add_module_function("Pad2", "name",         pad1_name);
 	env.add_module_function("Pad2", "connected",    pad1_connected);
@@ -3486,6 +4984,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Pad2", "axis_id",      pad1_axis_id);
 	env.add_module_function("Pad2", "deadzone",     pad1_deadzone);
 	env.add_module_function("Pad2", "set_deadzone", pad1_set_deadzone);
+	env.add_module_function("Pad2", "events",       pad1_events);
 
 	env.add_module_function("Pad3", "name",         pad2_name);
 	env.add_module_function("Pad3", "connected",    pad2_connected);
@@ -3503,6 +5002,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Pad3", "axis_id",      pad2_axis_id);
 	env.add_module_function("Pad3", "deadzone",     pad2_deadzone);
 	env.add_module_function("Pad3", "set_deadzone", pad2_set_deadzone);
+	env.add_module_function("Pad3", "events",       pad2_events);
 
 	env.add_module_function("Pad4", "name",         pad3_name);
 	env.add_module_function("Pad4", "connected",    pad3_connected);
@@ -3520,12 +5020,16 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Pad4", "axis_id",      pad3_axis_id);
 	env.add_module_function("Pad4", "deadzone",     pad3_deadzone);
 	env.add_module_function("Pad4", "set_deadzone", pad3_set_deadzone);
+	env.add_module_function("Pad4", "events",       pad3_events);
 
 	env.add_module_function("World", "spawn_unit",                      world_spawn_unit);
+	env.add_module_function("World", "spawn_unit_batch",                world_spawn_unit_batch);
 	env.add_module_function("World", "spawn_empty_unit",                world_spawn_empty_unit);
 	env.add_module_function("World", "destroy_unit",                    world_destroy_unit);
+	env.add_module_function("World", "destroy_units",                   world_destroy_units);
 	env.add_module_function("World", "num_units",                       world_num_units);
 	env.add_module_function("World", "units",                           world_units);
+	env.add_module_function("World", "memory_usage",                    world_memory_usage);
 	env.add_module_function("World", "camera_create",                   world_camera_create);
 	env.add_module_function("World", "camera_instances",                world_camera_instances);
 	env.add_module_function("World", "camera_set_projection_type",      world_camera_set_projection_type);
@@ -3537,6 +5041,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("World", "camera_far_clip_distance",        world_camera_far_clip_distance);
 	env.add_module_function("World", "camera_set_far_clip_distance",    world_camera_set_far_clip_distance);
 	env.add_module_function("World", "camera_set_orthographic_size",    world_camera_set_orthographic_size);
+	env.add_module_function("World", "camera_set_viewport",             world_camera_set_viewport);
 	env.add_module_function("World", "camera_screen_to_world",          world_camera_screen_to_world);
 	env.add_module_function("World", "camera_world_to_screen",          world_camera_world_to_screen);
 	env.add_module_function("World", "update_animations",               world_update_animations);
@@ -3547,72 +5052,117 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("World", "link_sound",                      world_link_sound);
 	env.add_module_function("World", "set_listener_pose",               world_set_listener_pose);
 	env.add_module_function("World", "set_sound_position",              world_set_sound_position);
+	env.add_module_function("World", "set_sound_positions",             world_set_sound_positions);
 	env.add_module_function("World", "set_sound_range",                 world_set_sound_range);
 	env.add_module_function("World", "set_sound_volume",                world_set_sound_volume);
 	env.add_module_function("World", "create_debug_line",               world_create_debug_line);
 	env.add_module_function("World", "destroy_debug_line",              world_destroy_debug_line);
 	env.add_module_function("World", "create_screen_gui",               world_create_screen_gui);
+	env.add_module_function("World", "create_gui_layer",                world_create_gui_layer);
 	env.add_module_function("World", "destroy_gui",                     world_destroy_gui);
 	env.add_module_function("World", "load_level",                      world_load_level);
+	env.add_module_function("World", "load_level_async",                world_load_level_async);
+	env.add_module_function("World", "load_level_streamed",             world_load_level_streamed);
+	env.add_module_function("World", "level_set_observers",             world_level_set_observers);
+	env.add_module_function("World", "level_progress",                  world_level_progress);
+	env.add_module_function("World", "unload_level",                    world_unload_level);
+	env.add_module_function("World", "shrink_to_fit",                   world_shrink_to_fit);
+	env.add_module_function("World", "events",                          world_events);
 	env.add_module_function("World", "scene_graph",                     world_scene_graph);
 	env.add_module_function("World", "render_world",                    world_render_world);
 	env.add_module_function("World", "physics_world",                   world_physics_world);
 	env.add_module_function("World", "sound_world",                     world_sound_world);
+	env.add_module_function("World", "navigation_world",                world_navigation_world);
 	env.add_module_function("World", "animation_state_machine",         world_animation_state_machine);
+	env.add_module_function("World", "skeleton_animation",              world_skeleton_animation);
+	env.add_module_function("World", "replication",                     world_replication);
 	env.add_module_metafunction("World", "__tostring", world_tostring);
 
-	env.add_module_function("SceneGraph", "create",             scene_graph_create);
-	env.add_module_function("SceneGraph", "destroy",            scene_graph_destroy);
-	env.add_module_function("SceneGraph", "instances",          scene_graph_instances);
-	env.add_module_function("SceneGraph", "local_position",     scene_graph_local_position);
-	env.add_module_function("SceneGraph", "local_rotation",     scene_graph_local_rotation);
-	env.add_module_function("SceneGraph", "local_scale",        scene_graph_local_scale);
-	env.add_module_function("SceneGraph", "local_pose",         scene_graph_local_pose);
-	env.add_module_function("SceneGraph", "world_position",     scene_graph_world_position);
-	env.add_module_function("SceneGraph", "world_rotation",     scene_graph_world_rotation);
-	env.add_module_function("SceneGraph", "world_pose",         scene_graph_world_pose);
-	env.add_module_function("SceneGraph", "set_local_position", scene_graph_set_local_position);
-	env.add_module_function("SceneGraph", "set_local_rotation", scene_graph_set_local_rotation);
-	env.add_module_function("SceneGraph", "set_local_scale",    scene_graph_set_local_scale);
-	env.add_module_function("SceneGraph", "set_local_pose",     scene_graph_set_local_pose);
-	env.add_module_function("SceneGraph", "link",               scene_graph_link);
-	env.add_module_function("SceneGraph", "unlink",             scene_graph_unlink);
+	env.add_module_function("SceneGraph", "create",              scene_graph_create);
+	env.add_module_function("SceneGraph", "destroy",             scene_graph_destroy);
+	env.add_module_function("SceneGraph", "instances",           scene_graph_instances);
+	env.add_module_function("SceneGraph", "local_position",      scene_graph_local_position);
+	env.add_module_function("SceneGraph", "local_rotation",      scene_graph_local_rotation);
+	env.add_module_function("SceneGraph", "local_scale",         scene_graph_local_scale);
+	env.add_module_function("SceneGraph", "local_pose",          scene_graph_local_pose);
+	env.add_module_function("SceneGraph", "world_position",      scene_graph_world_position);
+	env.add_module_function("SceneGraph", "world_rotation",      scene_graph_world_rotation);
+	env.add_module_function("SceneGraph", "world_pose",          scene_graph_world_pose);
+	env.add_module_function("SceneGraph", "set_local_position",  scene_graph_set_local_position);
+	env.add_module_function("SceneGraph", "set_local_rotation",  scene_graph_set_local_rotation);
+	env.add_module_function("SceneGraph", "set_local_scale",     scene_graph_set_local_scale);
+	env.add_module_function("SceneGraph", "set_local_pose",      scene_graph_set_local_pose);
+	env.add_module_function("SceneGraph", "set_local_positions", scene_graph_set_local_positions);
+	env.add_module_function("SceneGraph", "set_local_rotations", scene_graph_set_local_rotations);
+	env.add_module_function("SceneGraph", "set_local_poses",     scene_graph_set_local_poses);
+	env.add_module_function("SceneGraph", "link",                scene_graph_link);
+	env.add_module_function("SceneGraph", "link_batch",          scene_graph_link_batch);
+	env.add_module_function("SceneGraph", "unlink",              scene_graph_unlink);
+	env.add_module_function("SceneGraph", "data",                scene_graph_data);
 
 	env.add_module_function("UnitManager", "create", unit_manager_create);
 	env.add_module_function("UnitManager", "alive",  unit_manager_alive);
 
-	env.add_module_function("RenderWorld", "mesh_create",          render_world_mesh_create);
-	env.add_module_function("RenderWorld", "mesh_destroy",         render_world_mesh_destroy);
-	env.add_module_function("RenderWorld", "mesh_instances",       render_world_mesh_instances);
-	env.add_module_function("RenderWorld", "mesh_obb",             render_world_mesh_obb);
-	env.add_module_function("RenderWorld", "mesh_cast_ray",        render_world_mesh_cast_ray);
-	env.add_module_function("RenderWorld", "mesh_set_visible",     render_world_mesh_set_visible);
-	env.add_module_function("RenderWorld", "sprite_create",        render_world_sprite_create);
-	env.add_module_function("RenderWorld", "sprite_destroy",       render_world_sprite_destroy);
-	env.add_module_function("RenderWorld", "sprite_instances",     render_world_sprite_instances);
-	env.add_module_function("RenderWorld", "sprite_set_frame",     render_world_sprite_set_frame);
-	env.add_module_function("RenderWorld", "sprite_set_visible",   render_world_sprite_set_visible);
-	env.add_module_function("RenderWorld", "sprite_flip_x",        render_world_sprite_flip_x);
-	env.add_module_function("RenderWorld", "sprite_flip_y",        render_world_sprite_flip_y);
-	env.add_module_function("RenderWorld", "sprite_set_layer",     render_world_sprite_set_layer);
-	env.add_module_function("RenderWorld", "sprite_set_depth",     render_world_sprite_set_depth);
-	env.add_module_function("RenderWorld", "sprite_obb",           render_world_sprite_obb);
-	env.add_module_function("RenderWorld", "sprite_cast_ray",      render_world_sprite_cast_ray);
-	env.add_module_function("RenderWorld", "light_create",         render_world_light_create);
-	env.add_module_function("RenderWorld", "light_destroy",        render_world_light_destroy);
-	env.add_module_function("RenderWorld", "light_instances",      render_world_light_instances);
-	env.add_module_function("RenderWorld", "light_type",           render_world_light_type);
-	env.add_module_function("RenderWorld", "light_color",          render_world_light_color);
-	env.add_module_function("RenderWorld", "light_range",          render_world_light_range);
-	env.add_module_function("RenderWorld", "light_intensity",      render_world_light_intensity);
-	env.add_module_function("RenderWorld", "light_spot_angle",     render_world_light_spot_angle);
-	env.add_module_function("RenderWorld", "light_set_type",       render_world_light_set_type);
-	env.add_module_function("RenderWorld", "light_set_color",      render_world_light_set_color);
-	env.add_module_function("RenderWorld", "light_set_range",      render_world_light_set_range);
-	env.add_module_function("RenderWorld", "light_set_intensity",  render_world_light_set_intensity);
-	env.add_module_function("RenderWorld", "light_set_spot_angle", render_world_light_set_spot_angle);
-	env.add_module_function("RenderWorld", "light_debug_draw",     render_world_light_debug_draw);
-	env.add_module_function("RenderWorld", "enable_debug_drawing", render_world_enable_debug_drawing);
+	env.add_module_function("RenderWorld", "mesh_create",             render_world_mesh_create);
+	env.add_module_function("RenderWorld", "mesh_destroy",            render_world_mesh_destroy);
+	env.add_module_function("RenderWorld", "mesh_instances",          render_world_mesh_instances);
+	env.add_module_function("RenderWorld", "mesh_obb",                render_world_mesh_obb);
+	env.add_module_function("RenderWorld", "mesh_cast_ray",           render_world_mesh_cast_ray);
+	env.add_module_function("RenderWorld", "mesh_raycast",            render_world_mesh_raycast);
+	env.add_module_function("RenderWorld", "mesh_data",               render_world_mesh_data);
+	env.add_module_function("RenderWorld", "mesh_set_visible",        render_world_mesh_set_visible);
+	env.add_module_function("RenderWorld", "sprite_create",           render_world_sprite_create);
+	env.add_module_function("RenderWorld", "sprite_destroy",          render_world_sprite_destroy);
+	env.add_module_function("RenderWorld", "sprite_instances",        render_world_sprite_instances);
+	env.add_module_function("RenderWorld", "sprite_set_frame",        render_world_sprite_set_frame);
+	env.add_module_function("RenderWorld", "sprite_set_frames",       render_world_sprite_set_frames);
+	env.add_module_function("RenderWorld", "sprite_set_visibilities", render_world_sprite_set_visibilities);
+	env.add_module_function("RenderWorld", "sprite_set_visible",      render_world_sprite_set_visible);
+	env.add_module_function("RenderWorld", "sprite_flip_x",           render_world_sprite_flip_x);
+	env.add_module_function("RenderWorld", "sprite_flip_y",           render_world_sprite_flip_y);
+	env.add_module_function("RenderWorld", "sprite_set_layer",        render_world_sprite_set_layer);
+	env.add_module_function("RenderWorld", "sprite_set_depth",        render_world_sprite_set_depth);
+	env.add_module_function("RenderWorld", "sprite_set_loop",         render_world_sprite_set_loop);
+	env.add_module_function("RenderWorld", "sprite_stop_loop",        render_world_sprite_stop_loop);
+	env.add_module_function("RenderWorld", "time",                    render_world_time);
+	env.add_module_function("RenderWorld", "sprite_obb",              render_world_sprite_obb);
+	env.add_module_function("RenderWorld", "sprite_cast_ray",         render_world_sprite_cast_ray);
+	env.add_module_function("RenderWorld", "sprite_raycast",          render_world_sprite_raycast);
+	env.add_module_function("RenderWorld", "sprite_data",             render_world_sprite_data);
+	env.add_module_function("RenderWorld", "light_create",            render_world_light_create);
+	env.add_module_function("RenderWorld", "light_destroy",           render_world_light_destroy);
+	env.add_module_function("RenderWorld", "light_instances",         render_world_light_instances);
+	env.add_module_function("RenderWorld", "light_type",              render_world_light_type);
+	env.add_module_function("RenderWorld", "light_color",             render_world_light_color);
+	env.add_module_function("RenderWorld", "light_range",             render_world_light_range);
+	env.add_module_function("RenderWorld", "light_intensity",         render_world_light_intensity);
+	env.add_module_function("RenderWorld", "light_spot_angle",        render_world_light_spot_angle);
+	env.add_module_function("RenderWorld", "light_set_type",          render_world_light_set_type);
+	env.add_module_function("RenderWorld", "light_set_color",         render_world_light_set_color);
+	env.add_module_function("RenderWorld", "light_set_range",         render_world_light_set_range);
+	env.add_module_function("RenderWorld", "light_set_intensity",     render_world_light_set_intensity);
+	env.add_module_function("RenderWorld", "light_set_spot_angle",    render_world_light_set_spot_angle);
+	env.add_module_function("RenderWorld", "light_cast_shadows",      render_world_light_cast_shadows);
+	env.add_module_function("RenderWorld", "light_set_cast_shadows",  render_world_light_set_cast_shadows);
+	env.add_module_function("RenderWorld", "light_debug_draw",        render_world_light_debug_draw);
+	env.add_module_function("RenderWorld", "particle_create",         render_world_particle_create);
+	env.add_module_function("RenderWorld", "particle_destroy",        render_world_particle_destroy);
+	env.add_module_function("RenderWorld", "particle_instance",       render_world_particle_instance);
+	env.add_module_function("RenderWorld", "particle_play",           render_world_particle_play);
+	env.add_module_function("RenderWorld", "particle_stop",           render_world_particle_stop);
+	env.add_module_function("RenderWorld", "particle_is_playing",     render_world_particle_is_playing);
+	env.add_module_function("RenderWorld", "particle_burst",          render_world_particle_burst);
+	env.add_module_function("RenderWorld", "particle_num",            render_world_particle_num);
+	env.add_module_function("RenderWorld", "tilemap_create",          render_world_tilemap_create);
+	env.add_module_function("RenderWorld", "tilemap_destroy",         render_world_tilemap_destroy);
+	env.add_module_function("RenderWorld", "tilemap_instance",        render_world_tilemap_instance);
+	env.add_module_function("RenderWorld", "tilemap_size",            render_world_tilemap_size);
+	env.add_module_function("RenderWorld", "tilemap_tile",            render_world_tilemap_tile);
+	env.add_module_function("RenderWorld", "tilemap_set_tile",        render_world_tilemap_set_tile);
+	env.add_module_function("RenderWorld", "enable_debug_drawing",    render_world_enable_debug_drawing);
+	env.add_module_function("RenderWorld", "set_mesh_lod_bias",       render_world_set_mesh_lod_bias);
+	env.add_module_function("RenderWorld", "mesh_lod_bias",           render_world_mesh_lod_bias);
+	env.add_module_function("RenderWorld", "stats",                   render_world_stats);
 
 	env.add_module_function("PhysicsWorld", "actor_instances",               physics_world_actor_instances);
 	env.add_module_function("PhysicsWorld", "actor_world_position",          physics_world_actor_world_position);
@@ -3638,6 +5188,7 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("PhysicsWorld", "actor_set_angular_damping",     physics_world_actor_set_angular_damping);
 	env.add_module_function("PhysicsWorld", "actor_linear_velocity",         physics_world_actor_linear_velocity);
 	env.add_module_function("PhysicsWorld", "actor_set_linear_velocity",     physics_world_actor_set_linear_velocity);
+	env.add_module_function("PhysicsWorld", "actor_set_linear_velocities",   physics_world_actor_set_linear_velocities);
 	env.add_module_function("PhysicsWorld", "actor_angular_velocity",        physics_world_actor_angular_velocity);
 	env.add_module_function("PhysicsWorld", "actor_set_angular_velocity",    physics_world_actor_set_angular_velocity);
 	env.add_module_function("PhysicsWorld", "actor_add_impulse",             physics_world_actor_add_impulse);
@@ -3647,6 +5198,17 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("PhysicsWorld", "actor_push_at",                 physics_world_actor_push_at);
 	env.add_module_function("PhysicsWorld", "actor_is_sleeping",             physics_world_actor_is_sleeping);
 	env.add_module_function("PhysicsWorld", "actor_wake_up",                 physics_world_actor_wake_up);
+	env.add_module_function("PhysicsWorld", "actor_set_max_linear_velocity", physics_world_actor_set_max_linear_velocity);
+	env.add_module_function("PhysicsWorld", "actor_set_report_contacts",     physics_world_actor_set_report_contacts);
+	env.add_module_function("PhysicsWorld", "set_lod_observers",             physics_world_set_lod_observers);
+	env.add_module_function("PhysicsWorld", "mover_create",                  physics_world_mover_create);
+	env.add_module_function("PhysicsWorld", "mover_destroy",                 physics_world_mover_destroy);
+	env.add_module_function("PhysicsWorld", "mover",                         physics_world_mover);
+	env.add_module_function("PhysicsWorld", "mover_position",                physics_world_mover_position);
+	env.add_module_function("PhysicsWorld", "mover_set_velocities",          physics_world_mover_set_velocities);
+	env.add_module_function("PhysicsWorld", "mover_on_ground",               physics_world_mover_on_ground);
+	env.add_module_function("PhysicsWorld", "mover_collides_sides",          physics_world_mover_collides_sides);
+	env.add_module_function("PhysicsWorld", "mover_collides_up",             physics_world_mover_collides_up);
 	env.add_module_function("PhysicsWorld", "joint_create",                  physics_world_joint_create);
 	env.add_module_function("PhysicsWorld", "gravity",                       physics_world_gravity);
 	env.add_module_function("PhysicsWorld", "set_gravity",                   physics_world_set_gravity);
@@ -3654,7 +5216,12 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("PhysicsWorld", "cast_ray_all",                  physics_world_cast_ray_all);
 	env.add_module_function("PhysicsWorld", "cast_sphere",                   physics_world_cast_sphere);
 	env.add_module_function("PhysicsWorld", "cast_box",                      physics_world_cast_box);
+	env.add_module_function("PhysicsWorld", "cast_batch",                    physics_world_cast_batch);
 	env.add_module_function("PhysicsWorld", "enable_debug_drawing",          physics_world_enable_debug_drawing);
+	env.add_module_function("PhysicsWorld", "enable_async_update",           physics_world_enable_async_update);
+	env.add_module_function("PhysicsWorld", "set_step_frequency",            physics_world_set_step_frequency);
+	env.add_module_function("PhysicsWorld", "set_max_substeps",              physics_world_set_max_substeps);
+	env.add_module_function("PhysicsWorld", "set_solver_iterations",         physics_world_set_solver_iterations);
 	env.add_module_metafunction("PhysicsWorld", "__tostring", physics_world_tostring);
 
 	env.add_module_function("SoundWorld", "stop_all",   sound_world_stop_all);
@@ -3663,11 +5230,38 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("SoundWorld", "is_playing", sound_world_is_playing);
 	env.add_module_metafunction("SoundWorld", "__tostring", sound_world_tostring);
 
+	env.add_module_function("NavigationWorld", "set_grid",     navigation_world_set_grid);
+	env.add_module_function("NavigationWorld", "block_static", navigation_world_block_static);
+	env.add_module_function("NavigationWorld", "is_walkable",  navigation_world_is_walkable);
+	env.add_module_function("NavigationWorld", "find_path",    navigation_world_find_path);
+	env.add_module_function("NavigationWorld", "find_paths",   navigation_world_find_paths);
+	env.add_module_function("NavigationWorld", "path_status",  navigation_world_path_status);
+	env.add_module_function("NavigationWorld", "path",         navigation_world_path);
+	env.add_module_function("NavigationWorld", "destroy_path", navigation_world_destroy_path);
+	env.add_module_metafunction("NavigationWorld", "__tostring", navigation_world_tostring);
+
 	env.add_module_function("AnimationStateMachine", "trigger",      animation_state_machine_trigger);
 	env.add_module_function("AnimationStateMachine", "variable_id",  animation_state_machine_variable_id);
 	env.add_module_function("AnimationStateMachine", "variable",     animation_state_machine_variable);
 	env.add_module_function("AnimationStateMachine", "set_variable", animation_state_machine_set_variable);
 
+	env.add_module_function("SkeletonAnimation", "play",      skeleton_animation_play);
+	env.add_module_function("SkeletonAnimation", "crossfade", skeleton_animation_crossfade);
+	env.add_module_function("SkeletonAnimation", "set_speed", skeleton_animation_set_speed);
+	env.add_module_function("SkeletonAnimation", "time",      skeleton_animation_time);
+	env.add_module_function("SkeletonAnimation", "bone_pose", skeleton_animation_bone_pose);
+
+	env.add_module_function("Replication", "listen",            replication_listen);
+	env.add_module_function("Replication", "connect",           replication_connect);
+	env.add_module_function("Replication", "stop",              replication_stop);
+	env.add_module_function("Replication", "add",               replication_add);
+	env.add_module_function("Replication", "remove",            replication_remove);
+	env.add_module_function("Replication", "has",               replication_has);
+	env.add_module_function("Replication", "set_value",         replication_set_value);
+	env.add_module_function("Replication", "value",             replication_value);
+	env.add_module_function("Replication", "set_send_interval", replication_set_send_interval);
+	env.add_module_function("Replication", "num_clients",       replication_num_clients);
+
 	env.add_module_function("Device", "argv",                     device_argv);
 	env.add_module_function("Device", "platform",                 device_platform);
 	env.add_module_function("Device", "architecture",             device_architecture);
@@ -3676,20 +5270,33 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Device", "resolution",               device_resolution);
 	env.add_module_function("Device", "create_world",             device_create_world);
 	env.add_module_function("Device", "destroy_world",            device_destroy_world);
+	env.add_module_function("Device", "update_worlds",            device_update_worlds);
 	env.add_module_function("Device", "render",                   device_render);
 	env.add_module_function("Device", "create_resource_package",  device_create_resource_package);
 	env.add_module_function("Device", "destroy_resource_package", device_destroy_resource_package);
+	env.add_module_function("Device", "prefetch_resource_package", device_prefetch_resource_package);
+	env.add_module_function("Device", "unload_prefetched_resource_package", device_unload_prefetched_resource_package);
 	env.add_module_function("Device", "console_send",             device_console_send);
 	env.add_module_function("Device", "can_get",                  device_can_get);
 	env.add_module_function("Device", "enable_resource_autoload", device_enable_resource_autoload);
 	env.add_module_function("Device", "temp_count",               device_temp_count);
 	env.add_module_function("Device", "set_temp_count",           device_set_temp_count);
 	env.add_module_function("Device", "guid",                     device_guid);
+	env.add_module_function("Device", "set_perf_overlay",         device_set_perf_overlay);
+	env.add_module_function("Device", "perf_overlay",             device_perf_overlay);
+	env.add_module_function("Device", "memory_usage",             device_memory_usage);
+	env.add_module_function("Device", "screenshot",               device_screenshot);
+	env.add_module_function("Device", "start_capture",            device_start_capture);
+	env.add_module_function("Device", "stop_capture",             device_stop_capture);
 
 	env.add_module_function("Profiler", "enter_scope", profiler_enter_scope);
 	env.add_module_function("Profiler", "leave_scope", profiler_leave_scope);
 	env.add_module_function("Profiler", "record",      profiler_record);
 
+	env.add_module_function("Job", "run",     job_run);
+	env.add_module_function("Job", "is_done", job_is_done);
+	env.add_module_function("Job", "result",  job_result);
+
 	env.add_module_function("DebugLine", "add_line",    debug_line_add_line);
 	env.add_module_function("DebugLine", "add_axes",    debug_line_add_axes);
 	env.add_module_function("DebugLine", "add_arc",     debug_line_add_arc);
@@ -3699,6 +5306,9 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("DebugLine", "add_obb",     debug_line_add_obb);
 	env.add_module_function("DebugLine", "add_frustum", debug_line_add_frustum);
 	env.add_module_function("DebugLine", "add_unit",    debug_line_add_unit);
+	env.add_module_function("DebugLine", "set_duration", debug_line_set_duration);
+	env.add_module_function("DebugLine", "update",      debug_line_update);
+	env.add_module_function("DebugLine", "set_pose",    debug_line_set_pose);
 	env.add_module_function("DebugLine", "reset",       debug_line_reset);
 	env.add_module_function("DebugLine", "submit",      debug_line_submit);
 	env.add_module_metafunction("DebugLine", "__tostring", debug_line_tostring);
@@ -3719,6 +5329,11 @@ void load_api(LuaEnvironment& env)
 	env.add_module_function("Gui", "image",         gui_image);
 	env.add_module_function("Gui", "image_uv",      gui_image_uv);
 	env.add_module_function("Gui", "text",          gui_text);
+	env.add_module_function("Gui", "dirty",         gui_dirty);
+	env.add_module_function("Gui", "set_dirty",     gui_set_dirty);
+	env.add_module_function("Gui", "begin_layer",   gui_begin_layer);
+	env.add_module_function("Gui", "end_layer",     gui_end_layer);
+	env.add_module_function("Gui", "draw_layer",    gui_draw_layer);
 
 	env.add_module_function("Display", "modes",    display_modes);
 	env.add_module_function("Display", "set_mode", display_set_mode);
@@ -4,34 +4,309 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
 #include "core/error/error.h"
+#include "core/memory/memory.h"
+#include "core/os.h"
+#include "core/strings/string.h"
 #include "device/device.h"
 #include "device/log.h"
+#include "device/profiler.h"
 #include "lua/lua_environment.h"
 #include "lua/lua_stack.h"
 #include "resource/lua_resource.h"
 #include "resource/resource_manager.h"
 #include <stdarg.h>
+#include <stdio.h> // snprintf
+#include <string.h> // memcpy
 
 namespace { const crown::log_internal::System LUA = { "lua" }; }
 
 namespace crown
 {
 extern void load_api(LuaEnvironment& env);
+extern void load_ffi(LuaEnvironment& env);
+
+// Defines the FFI types of the math values and their operators, so that
+// LuaJIT can compile math code without calling into C. The most common
+// Vector3 functions are redefined on top of them for the same reason.
+static const char* s_math_types =
+	"local ffi = require 'ffi'\n"
+	"ffi.cdef [[\n"
+	"typedef struct { float x, y, z; } Vector3;\n"
+	"typedef struct { float x, y, z, w; } Vector4;\n"
+	"typedef struct { float x, y, z, w; } Quaternion;\n"
+	"typedef struct { Vector4 x, y, z, t; } Matrix4x4;\n"
+	"typedef struct { uint64_t state, inc; } Random;\n"
+	"]]\n"
+	"local vector3\n"
+	"vector3 = ffi.metatype('Vector3', {\n"
+	"	__add = function(a, b) return vector3(a.x + b.x, a.y + b.y, a.z + b.z) end,\n"
+	"	__sub = function(a, b) return vector3(a.x - b.x, a.y - b.y, a.z - b.z) end,\n"
+	"	__mul = function(a, b)\n"
+	"		if type(a) == 'number' then return vector3(a * b.x, a * b.y, a * b.z) end\n"
+	"		return vector3(a.x * b, a.y * b, a.z * b)\n"
+	"	end,\n"
+	"	__unm = function(a) return vector3(-a.x, -a.y, -a.z) end,\n"
+	"	__tostring = function(a) return Vector3.to_string(a) end,\n"
+	"})\n"
+	"local quaternion = ffi.metatype('Quaternion', { __tostring = function(a) return Quaternion.to_string(a) end })\n"
+	"local matrix4x4 = ffi.metatype('Matrix4x4', { __tostring = function(a) return Matrix4x4.to_string(a) end })\n"
+	"getmetatable(Vector3).__call = function(_, x, y, z) return vector3(x, y, z) end\n"
+	"function Vector3.x(v) return v.x end\n"
+	"function Vector3.y(v) return v.y end\n"
+	"function Vector3.z(v) return v.z end\n"
+	"function Vector3.set_x(v, x) v.x = x end\n"
+	"function Vector3.set_y(v, y) v.y = y end\n"
+	"function Vector3.set_z(v, z) v.z = z end\n"
+	"function Vector3.elements(v) return v.x, v.y, v.z end\n"
+	"function Vector3.add(a, b) return a + b end\n"
+	"function Vector3.subtract(a, b) return a - b end\n"
+	"function Vector3.multiply(a, k) return a * k end\n"
+	"function Vector3.dot(a, b) return a.x * b.x + a.y * b.y + a.z * b.z end\n"
+	"function Vector3.cross(a, b) return vector3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x) end\n"
+	"function Vector3.length_squared(a) return a.x * a.x + a.y * a.y + a.z * a.z end\n"
+	"function Vector3.length(a) return math.sqrt(a.x * a.x + a.y * a.y + a.z * a.z) end\n"
+	"return vector3, quaternion, matrix4x4, ffi.typeof('Random'), ffi.istype\n"
+	;
+
+// Reloads a script in place, see LuaEnvironment::reload_module(). The
+// new chunk runs with its own globals, so that the state of the old
+// version survives: functions replace the old ones in the tables of the
+// module, other values are kept, and upvalues which are not functions
+// are joined with those of the same name of the old functions.
+static const char* s_reload_module =
+	"local function is_lua(f) return debug.getinfo(f, 'S').what ~= 'C' end\n"
+	"local function collect(old, new, cells, seen)\n"
+	"	if seen[old] then return end\n"
+	"	seen[old] = true\n"
+	"	for k, v in pairs(new) do\n"
+	"		local o = rawget(old, k)\n"
+	"		if type(o) == 'function' and is_lua(o) then\n"
+	"			for i = 1, math.huge do\n"
+	"				local name, value = debug.getupvalue(o, i)\n"
+	"				if name == nil then break end\n"
+	"				if cells[name] == nil and type(value) ~= 'function' then cells[name] = { o, i } end\n"
+	"			end\n"
+	"		elseif type(o) == 'table' and type(v) == 'table' and o ~= v then\n"
+	"			collect(o, v, cells, seen)\n"
+	"		end\n"
+	"	end\n"
+	"end\n"
+	"local function join(f, cells)\n"
+	"	if not is_lua(f) then return end\n"
+	"	for i = 1, math.huge do\n"
+	"		local name, value = debug.getupvalue(f, i)\n"
+	"		if name == nil then break end\n"
+	"		local c = cells[name]\n"
+	"		if c ~= nil and type(value) ~= 'function' then debug.upvaluejoin(f, i, c[1], c[2]) end\n"
+	"	end\n"
+	"end\n"
+	"local function patch(old, new, cells, seen)\n"
+	"	if seen[old] then return end\n"
+	"	seen[old] = true\n"
+	"	for k, v in pairs(new) do\n"
+	"		local o = rawget(old, k)\n"
+	"		if type(v) == 'function' then\n"
+	"			join(v, cells)\n"
+	"			rawset(old, k, v)\n"
+	"		elseif type(v) == 'table' and type(o) == 'table' then\n"
+	"			if o ~= v then patch(o, v, cells, seen) end\n"
+	"		elseif o == nil then\n"
+	"			rawset(old, k, v)\n"
+	"		end\n"
+	"	end\n"
+	"end\n"
+	"return function(chunk, modules)\n"
+	"	local globals = {}\n"
+	"	local env = setmetatable({}, {\n"
+	"		__index = function(_, k) local v = globals[k] if v ~= nil then return v end return _G[k] end,\n"
+	"		__newindex = function(_, k, v) globals[k] = v end,\n"
+	"	})\n"
+	"	setfenv(chunk, env)\n"
+	"	local module = chunk()\n"
+	"	setmetatable(env, { __index = _G, __newindex = _G })\n"
+	"	local cells = {}\n"
+	"	local seen = {}\n"
+	"	if type(module) == 'table' then\n"
+	"		for _, m in ipairs(modules) do collect(m, module, cells, seen) end\n"
+	"	end\n"
+	"	collect(_G, globals, cells, seen)\n"
+	"	seen = {}\n"
+	"	if type(module) == 'table' then\n"
+	"		for _, m in ipairs(modules) do if m ~= module then patch(m, module, cells, seen) end end\n"
+	"	end\n"
+	"	patch(_G, globals, cells, seen)\n"
+	"end\n"
+	;
+
+#if LUA_ENGINE_ALLOCATOR
+// Returns the size class of blocks of @a size bytes, or
+// CROWN_LUA_NUM_SIZE_CLASSES if they are not pooled.
+static inline u32 size_class(size_t size)
+{
+	u32 sc = 0;
+	for (size_t block_size = 16; block_size < size; block_size *= 2)
+		++sc;
+	return sc;
+}
+
+LuaAllocator::LuaAllocator(Allocator& a)
+	: _allocated(0)
+	, _allocator(a, "lua")
+	, _chunks(a)
+{
+	for (u32 i = 0; i < CROWN_LUA_NUM_SIZE_CLASSES; ++i)
+		_freelist[i] = NULL;
+}
+
+LuaAllocator::~LuaAllocator()
+{
+	for (u32 i = 0; i < array::size(_chunks); ++i)
+		_allocator.deallocate(_chunks[i]);
+}
 
-LuaEnvironment::LuaEnvironment()
-	: L(NULL)
-	, _num_vec3(0)
-	, _num_quat(0)
-	, _num_mat4(0)
+void LuaAllocator::record()
 {
+}
+
+void* LuaAllocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	LuaAllocator& la = *(LuaAllocator*)ud;
+
+	if (ptr == NULL)
+		osize = 0;
+
+	const u32 osc = size_class(osize);
+	const u32 nsc = size_class(nsize);
+	la._allocated += u32(nsize) - u32(osize);
+
+	// Blocks keep their size class when resized within it
+	if (ptr != NULL && nsize != 0 && osc == nsc && osc < CROWN_LUA_NUM_SIZE_CLASSES)
+		return ptr;
+
+	void* p = NULL;
+	if (nsize != 0)
+	{
+		if (nsc < CROWN_LUA_NUM_SIZE_CLASSES)
+		{
+			if (la._freelist[nsc] == NULL)
+			{
+				// Carve a new chunk into a list of free blocks
+				const u32 block_size = 16u << nsc;
+				const u32 num = CROWN_LUA_POOL_CHUNK_SIZE / block_size;
+				char* mem = (char*)la._allocator.allocate(CROWN_LUA_POOL_CHUNK_SIZE, 16);
+				for (u32 i = 0; i < num - 1; ++i)
+					*(void**)(mem + i*block_size) = mem + (i + 1)*block_size;
+				*(void**)(mem + (num - 1)*block_size) = NULL;
+				la._freelist[nsc] = mem;
+				array::push_back(la._chunks, (void*)mem);
+			}
+
+			p = la._freelist[nsc];
+			la._freelist[nsc] = *(void**)p;
+		}
+		else
+		{
+			p = la._allocator.allocate(u32(nsize), 16);
+		}
+
+		if (ptr != NULL)
+			memcpy(p, ptr, osize < nsize ? osize : nsize);
+	}
+
+	if (ptr != NULL)
+	{
+		if (osc < CROWN_LUA_NUM_SIZE_CLASSES)
+		{
+			*(void**)ptr = la._freelist[osc];
+			la._freelist[osc] = ptr;
+		}
+		else
+		{
+			la._allocator.deallocate(ptr);
+		}
+	}
+
+	return p;
+}
+#else
+LuaAllocator::LuaAllocator(Allocator& /*a*/)
+	: _allocated(0)
+	, _allocf(NULL)
+	, _ud(NULL)
+	, _recorded(0)
+{
+}
+
+LuaAllocator::~LuaAllocator()
+{
+}
+
+void LuaAllocator::record()
+{
+	if (_allocated > _recorded)
+		ALLOCATE_MEMORY("lua", _allocated - _recorded);
+	else if (_allocated < _recorded)
+		DEALLOCATE_MEMORY("lua", _recorded - _allocated);
+	_recorded = _allocated;
+}
+
+void* LuaAllocator::alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	LuaAllocator& la = *(LuaAllocator*)ud;
+
+	if (ptr == NULL)
+		osize = 0;
+
+	void* p = la._allocf(la._ud, ptr, osize, nsize);
+	if (p != NULL || nsize == 0)
+		la._allocated += u32(nsize) - u32(osize);
+
+	return p;
+}
+#endif // LUA_ENGINE_ALLOCATOR
+
+LuaEnvironment::LuaEnvironment(Allocator& a)
+	: _allocator(a)
+	, L(NULL)
+	, _istype(LUA_NOREF)
+	, _chunks(LUA_NOREF)
+	, _reload_module(LUA_NOREF)
+	, _num_gc_cycles(0)
+	, _strings(default_allocator())
+	, _string_map(default_allocator())
+	, _sampling(false)
+	, _sample_time(0)
+	, _samples(default_allocator())
+	, _sample_map(default_allocator())
+	, _jobs(default_allocator())
+{
+	for (u32 i = 0; i < LuaCType::COUNT; ++i)
+		_ctypes[i] = LUA_NOREF;
+
+#if LUA_ENGINE_ALLOCATOR
+	L = lua_newstate(LuaAllocator::alloc, &_allocator);
+	CE_ASSERT(L, "Unable to create lua state");
+	lua_atpanic(L, LuaEnvironment::panic);
+#else
 	L = luaL_newstate();
 	CE_ASSERT(L, "Unable to create lua state");
+
+	// Track the allocations made from now on, plus those made so far
+	_allocator._allocf = lua_getallocf(L, &_allocator._ud);
+	_allocator._allocated = u32(lua_gc(L, LUA_GCCOUNT, 0))*1024 + u32(lua_gc(L, LUA_GCCOUNTB, 0));
+	lua_setallocf(L, LuaAllocator::alloc, &_allocator);
+#endif // LUA_ENGINE_ALLOCATOR
 }
 
 LuaEnvironment::~LuaEnvironment()
 {
 	lua_close(L);
+
+	for (u32 i = 0; i < array::size(_strings); ++i)
+		default_allocator().deallocate(_strings[i]);
 }
 
 void LuaEnvironment::load_libs()
@@ -61,11 +336,28 @@ void LuaEnvironment::load_libs()
 	lua_rawset(L, -3);
 	lua_pop(L, 1);
 
-	// Create metatable for lightuserdata
-	lua_pushlightuserdata(L, 0);
-	lua_getfield(L, LUA_REGISTRYINDEX, "Lightuserdata_mt");
-	lua_setmetatable(L, -2);
-	lua_pop(L, 1);
+	lua_newtable(L);
+	_chunks = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	// Define the FFI types of the math values
+	int err = luaL_loadstring(L, s_math_types);
+	CE_ASSERT(err == 0, "luaL_loadstring: %s", lua_tostring(L, -1));
+	CE_UNUSED(err);
+	lua_call(L, 0, 5);
+	_istype = luaL_ref(L, LUA_REGISTRYINDEX);
+	_ctypes[LuaCType::RANDOM] = luaL_ref(L, LUA_REGISTRYINDEX);
+	_ctypes[LuaCType::MATRIX4X4] = luaL_ref(L, LUA_REGISTRYINDEX);
+	_ctypes[LuaCType::QUATERNION] = luaL_ref(L, LUA_REGISTRYINDEX);
+	_ctypes[LuaCType::VECTOR3] = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	// Define the function which reloads the scripts in place
+	err = luaL_loadstring(L, s_reload_module);
+	CE_ASSERT(err == 0, "luaL_loadstring: %s", lua_tostring(L, -1));
+	lua_call(L, 0, 1);
+	_reload_module = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	// Register the FFI fast paths of the hottest functions
+	load_ffi(*this);
 
 	// Ensure stack is clean
 	CE_ASSERT(lua_gettop(L) == 0, "Stack not clean");
@@ -73,6 +365,57 @@ void LuaEnvironment::load_libs()
 	lua_gc(L, LUA_GCRESTART, 0);
 }
 
+void LuaEnvironment::reload(StringId64 name)
+{
+	lua_rawgeti(L, LUA_REGISTRYINDEX, _chunks);
+	lua_pushlstring(L, (const char*)&name, sizeof(name));
+	lua_pushnil(L);
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+}
+
+void LuaEnvironment::reload_module(StringId64 name, const LuaResource* lr, const int* module_refs, u32 num)
+{
+	lua_pushcfunction(L, LuaEnvironment::error);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, _reload_module);
+	if (luaL_loadbuffer(L, lua_resource::program(lr), lr->size, "<unknown>") != 0)
+	{
+		loge(LUA, "%s", lua_tostring(L, -1));
+		lua_pop(L, 3);
+		return;
+	}
+
+	// Gather the tables the module has been returned as so far
+	lua_newtable(L);
+	int n = 0;
+	for (u32 i = 0; i < num; ++i)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, module_refs[i]);
+		if (lua_istable(L, -1))
+			lua_rawseti(L, -2, ++n);
+		else
+			lua_pop(L, 1);
+	}
+
+	lua_getfield(L, LUA_GLOBALSINDEX, "package");
+	lua_getfield(L, -1, "loaded");
+	lua_remove(L, -2);
+	lua_pushnil(L);
+	while (lua_next(L, -2) != 0)
+	{
+		if (lua_type(L, -2) == LUA_TSTRING && lua_istable(L, -1) && StringId64(lua_tostring(L, -2)) == name)
+		{
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, -5, ++n);
+		}
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+
+	lua_pcall(L, 2, 0, -4);
+	lua_pop(L, 1);
+}
+
 LuaStack LuaEnvironment::execute(const LuaResource* lr)
 {
 	LuaStack stack(L);
@@ -192,61 +535,172 @@ LuaStack LuaEnvironment::get_global(const char* global)
 	return stack;
 }
 
-Vector3* LuaEnvironment::next_vector3(const Vector3& v)
+void LuaEnvironment::collect_garbage(f32 budget)
 {
-	CE_ASSERT(_num_vec3 < LUA_MAX_VECTOR3, "Maximum number of Vector3 reached");
-	return &(_vec3[_num_vec3++] = v);
-}
+	const s64 t0 = os::clocktime();
 
-Quaternion* LuaEnvironment::next_quaternion(const Quaternion& q)
-{
-	CE_ASSERT(_num_quat < LUA_MAX_QUATERNION, "Maximum number of Quaternion reached");
-	return &(_quat[_num_quat++] = q);
+	if (budget > 0.0f)
+	{
+		const s64 end = t0 + s64(f64(budget) * f64(os::clockfrequency()) / 1000.0);
+
+		// Each step does a small amount of work: do at least one so that
+		// the collector always makes progress
+		do
+		{
+			if (lua_gc(L, LUA_GCSTEP, 0) == 1)
+			{
+				++_num_gc_cycles;
+				break;
+			}
+		}
+		while (os::clocktime() < end);
+
+		// A step re-arms the automatic collection
+		lua_gc(L, LUA_GCSTOP, 0);
+	}
+
+	RECORD_FLOAT("lua.gc", f32(f64(os::clocktime() - t0) / f64(os::clockfrequency())));
+	RECORD_FLOAT("lua.gc_cycles", f32(_num_gc_cycles));
+	RECORD_FLOAT("lua.heap_kb", f32(lua_gc(L, LUA_GCCOUNT, 0)));
+	_allocator.record();
 }
 
-Matrix4x4* LuaEnvironment::next_matrix4x4(const Matrix4x4& m)
+const char* LuaEnvironment::intern(const char* str)
 {
-	CE_ASSERT(_num_mat4 < LUA_MAX_MATRIX4X4, "Maximum number of Matrix4x4 reached");
-	return &(_mat4[_num_mat4++] = m);
+	const StringId64 id(str);
+	const u32 i = hash_map::get(_string_map, id, UINT32_MAX);
+	if (i != UINT32_MAX)
+		return _strings[i];
+
+	const u32 len = strlen32(str);
+	char* copy = (char*)default_allocator().allocate(len + 1);
+	memcpy(copy, str, len + 1);
+	hash_map::set(_string_map, id, array::size(_strings));
+	array::push_back(_strings, copy);
+	return copy;
 }
 
-bool LuaEnvironment::is_vector3(const Vector3* p) const
+void LuaEnvironment::set_sampling(bool enable)
 {
-	return p >= &_vec3[0]
-		&& p <= &_vec3[LUA_MAX_VECTOR3 - 1];
+	if (enable == _sampling)
+		return;
+
+	_sampling = enable;
+	_sample_time = os::clocktime();
+
+	// Hooks do not run inside compiled traces: disable the JIT compiler
+	// so that the samples cover all the code, at the cost of speed
+	if (enable)
+	{
+		luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_OFF);
+		lua_sethook(L, LuaEnvironment::sample, LUA_MASKCOUNT, CROWN_LUA_SAMPLE_INSTRUCTIONS);
+	}
+	else
+	{
+		lua_sethook(L, NULL, 0, 0);
+		luaJIT_setmode(L, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+	}
 }
 
-bool LuaEnvironment::is_quaternion(const Quaternion* p) const
+void LuaEnvironment::record_samples()
 {
-	return p >= &_quat[0]
-		&& p <= &_quat[LUA_MAX_QUATERNION - 1];
+	for (u32 i = 0; i < array::size(_samples); ++i)
+		profiler::record_samples(_samples[i].stack, _samples[i].num);
+
+	array::clear(_samples);
+	hash_map::clear(_sample_map);
 }
 
-bool LuaEnvironment::is_matrix4x4(const Matrix4x4* p) const
+void* LuaEnvironment::push_cdata(lua_State* L, LuaCType::Enum type)
 {
-	return p >= &_mat4[0]
-		&& p <= &_mat4[LUA_MAX_MATRIX4X4 - 1];
+	// Calling a ctype with no arguments returns a zero-filled cdata
+	lua_rawgeti(L, LUA_REGISTRYINDEX, _ctypes[type]);
+	lua_call(L, 0, 1);
+	return (void*)lua_topointer(L, -1);
 }
 
-void LuaEnvironment::temp_count(u32& num_vec3, u32& num_quat, u32& num_mat4)
+bool LuaEnvironment::is_cdata(lua_State* L, int i, LuaCType::Enum type)
 {
-	num_vec3 = _num_vec3;
-	num_quat = _num_quat;
-	num_mat4 = _num_mat4;
+	if (lua_type(L, i) != LUA_TCDATA)
+		return false;
+
+	const int index = i > 0 ? i : lua_gettop(L) + i + 1;
+	lua_rawgeti(L, LUA_REGISTRYINDEX, _istype);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, _ctypes[type]);
+	lua_pushvalue(L, index);
+	lua_call(L, 2, 1);
+	const bool is = lua_toboolean(L, -1) == 1;
+	lua_pop(L, 1);
+	return is;
 }
 
-void LuaEnvironment::set_temp_count(u32 num_vec3, u32 num_quat, u32 num_mat4)
+void LuaEnvironment::sample(lua_State* L, lua_Debug* /*ar*/)
 {
-	_num_vec3 = num_vec3;
-	_num_quat = num_quat;
-	_num_mat4 = num_mat4;
+	LuaEnvironment* env = device()->_lua_environment;
+
+	// The hook runs every CROWN_LUA_SAMPLE_INSTRUCTIONS instructions: only
+	// sample once per interval so that the samples are evenly spread in time
+	const s64 now = os::clocktime();
+	const s64 interval = s64(f64(CROWN_LUA_SAMPLE_INTERVAL) * f64(os::clockfrequency()) / 1000.0);
+	if (now - env->_sample_time < interval)
+		return;
+	env->_sample_time = now;
+
+	lua_Debug ar;
+	int depth = 0;
+	while (depth < CROWN_LUA_SAMPLE_MAX_DEPTH && lua_getstack(L, depth, &ar))
+		++depth;
+
+	// Write the frames outermost first
+	char stack[1024];
+	u32 len = 0;
+	stack[0] = '\0';
+	for (int level = depth - 1; level >= 0; --level)
+	{
+		lua_getstack(L, level, &ar);
+		lua_getinfo(L, "Sn", &ar);
+
+		const int num = snprintf(stack + len
+			, sizeof(stack) - len
+			, "%s%s (%s:%d)"
+			, len > 0 ? ";" : ""
+			, ar.name != NULL ? ar.name : "?"
+			, ar.short_src
+			, ar.linedefined
+			);
+		if (num < 0 || len + num >= sizeof(stack))
+			break;
+		len += num;
+	}
+
+	// The stacks are written verbatim to the profiler's JSON
+	for (u32 i = 0; i < len; ++i)
+	{
+		if (stack[i] == '"')
+			stack[i] = '\'';
+		else if (stack[i] == '\\')
+			stack[i] = '/';
+	}
+
+	const StringId64 id(stack);
+	u32 i = hash_map::get(env->_sample_map, id, UINT32_MAX);
+	if (i == UINT32_MAX)
+	{
+		LuaSample ls;
+		ls.stack = env->intern(stack);
+		ls.num = 0;
+		i = array::size(env->_samples);
+		array::push_back(env->_samples, ls);
+		hash_map::set(env->_sample_map, id, i);
+	}
+
+	++env->_samples[i].num;
 }
 
-void LuaEnvironment::reset_temporaries()
+int LuaEnvironment::panic(lua_State* L)
 {
-	_num_vec3 = 0;
-	_num_quat = 0;
-	_num_mat4 = 0;
+	CE_FATAL("Unprotected error in Lua: %s", lua_tostring(L, -1));
+	return 0;
 }
 
 int LuaEnvironment::error(lua_State* L)
@@ -280,8 +734,23 @@ int LuaEnvironment::error(lua_State* L)
 int LuaEnvironment::require(lua_State* L)
 {
 	LuaStack stack(L);
-	const LuaResource* lr = (LuaResource*)device()->_resource_manager->get(RESOURCE_TYPE_SCRIPT, stack.get_resource_id(1));
+	const StringId64 name = stack.get_resource_id(1);
+	const int chunks = device()->_lua_environment->_chunks;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, chunks);
+	lua_pushlstring(L, (const char*)&name, sizeof(name));
+	lua_rawget(L, -2);
+	if (!lua_isnil(L, -1))
+		return 1;
+	lua_pop(L, 1);
+
+	const LuaResource* lr = (LuaResource*)device()->_resource_manager->get(RESOURCE_TYPE_SCRIPT, name);
 	luaL_loadbuffer(L, lua_resource::program(lr), lr->size, "");
+
+	// Cache the chunk so that it is loaded only once
+	lua_pushlstring(L, (const char*)&name, sizeof(name));
+	lua_pushvalue(L, -2);
+	lua_rawset(L, -4);
 	return 1;
 }
 
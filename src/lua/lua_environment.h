@@ -6,12 +6,21 @@
 #pragma once
 
 #include "config.h"
+#include "core/containers/types.h"
 #include "core/math/types.h"
+#include "core/memory/proxy_allocator.h"
+#include "core/platform.h"
+#include "core/strings/string_id.h"
 #include "core/types.h"
+#include "lua/lua_jobs.h"
 #include "lua/lua_stack.h"
 #include "resource/types.h"
 #include <lua.hpp>
 
+// 64-bit LuaJIT 2.0 must allocate from the low 2GB of the address space
+// and refuses any allocator but its own, see lua_newstate() in lj_state.c.
+#define LUA_ENGINE_ALLOCATOR CROWN_ARCH_32BIT
+
 namespace crown
 {
 enum LuaArgumentType
@@ -19,30 +28,66 @@ enum LuaArgumentType
 	ARGUMENT_FLOAT
 };
 
+/// Allocator of a Lua state.
+/// Small blocks are served by size-class pools and larger ones by an engine
+/// allocator named "lua". Where LuaJIT does not allow it, the allocations
+/// are forwarded to LuaJIT's own allocator and only tracked.
+struct LuaAllocator
+{
+	u32 _allocated; ///< Bytes currently allocated by the Lua state.
+#if LUA_ENGINE_ALLOCATOR
+	ProxyAllocator _allocator;
+	void* _freelist[CROWN_LUA_NUM_SIZE_CLASSES];
+	Array<void*> _chunks;
+#else
+	lua_Alloc _allocf;
+	void* _ud;
+	u32 _recorded;  ///< Bytes reported to the profiler by record().
+#endif
+
+	///
+	LuaAllocator(Allocator& a);
+
+	///
+	~LuaAllocator();
+
+	/// Reports to the profiler the memory allocated by the Lua state since
+	/// the last call, if the engine allocator does not already do it.
+	void record();
+
+	/// lua_Alloc function, @a ud is the LuaAllocator.
+	static void* alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+};
+
+/// Number of times a call stack has been sampled in the current frame.
+struct LuaSample
+{
+	const char* stack;
+	u32 num;
+};
+
 /// Wraps a subset of Lua functions and provides utilities for extending Lua.
 ///
 /// @ingroup Lua
 struct LuaEnvironment
 {
+	LuaAllocator _allocator;
 	lua_State* L;
-
-#define LUA_MAX_VECTOR3 (CROWN_LUA_MAX_VECTOR3_SIZE / sizeof(Vector3))
-CE_STATIC_ASSERT(CROWN_LUA_MAX_VECTOR3_SIZE % sizeof(Vector3) == 0);
-
-#define LUA_MAX_QUATERNION (CROWN_LUA_MAX_QUATERNION_SIZE / sizeof(Quaternion))
-CE_STATIC_ASSERT(CROWN_LUA_MAX_QUATERNION_SIZE % sizeof(Quaternion) == 0);
-
-#define LUA_MAX_MATRIX4X4 (CROWN_LUA_MAX_MATRIX4X4_SIZE / sizeof(Matrix4x4))
-CE_STATIC_ASSERT(CROWN_LUA_MAX_MATRIX4X4_SIZE % sizeof(Matrix4x4) == 0);
-
-	u32 _num_vec3;
-	Vector3 _vec3[LUA_MAX_VECTOR3];
-	u32 _num_quat;
-	Quaternion _quat[LUA_MAX_QUATERNION];
-	u32 _num_mat4;
-	Matrix4x4 _mat4[LUA_MAX_MATRIX4X4];
-
-	LuaEnvironment();
+	int _ctypes[LuaCType::COUNT]; ///< Registry references to the FFI types of the math values.
+	int _istype;                  ///< Registry reference to ffi.istype().
+	int _chunks;                  ///< Registry reference to the table of the chunks loaded by require(), by resource name.
+	int _reload_module;           ///< Registry reference to the function which reloads a script in place.
+	u32 _num_gc_cycles;           ///< Number of garbage collection cycles completed by collect_garbage().
+	Array<char*> _strings;
+	HashMap<StringId64, u32> _string_map; ///< Index into _strings of each string interned by intern().
+	bool _sampling;
+	s64 _sample_time;                     ///< Time of the last sample.
+	Array<LuaSample> _samples;
+	HashMap<StringId64, u32> _sample_map; ///< Index into _samples of each stack sampled in the current frame.
+	LuaJobs _jobs;
+
+	///
+	LuaEnvironment(Allocator& a);
 	~LuaEnvironment();
 	LuaEnvironment(const LuaEnvironment&) = delete;
 	LuaEnvironment& operator=(const LuaEnvironment&) = delete;
@@ -73,33 +118,49 @@ CE_STATIC_ASSERT(CROWN_LUA_MAX_MATRIX4X4_SIZE % sizeof(Matrix4x4) == 0);
 
 	LuaStack get_global(const char* global);
 
-	/// Returns the number of temporary objects in use.
-	void temp_count(u32& num_vec3, u32& num_quat, u32& num_mat4);
-
-	/// Sets the number of temporary objects in use.
-	void set_temp_count(u32 num_vec3, u32 num_quat, u32 num_mat4);
-
-	/// Resets temporary types.
-	void reset_temporaries();
-
-	/// Returns a new temporary Vector3.
-	Vector3* next_vector3(const Vector3& v);
-
-	/// Returns a new temporary Quaternion.
-	Quaternion* next_quaternion(const Quaternion& q);
-
-	/// Returns a new temporary Matrix4x4.
-	Matrix4x4* next_matrix4x4(const Matrix4x4& m);
-
-	/// Returns whether @a p is a temporary Vector3.
-	bool is_vector3(const Vector3* p) const;
-
-	/// Returns whether @a p is a temporary Quaternion.
-	bool is_quaternion(const Quaternion* p) const;
-
-	/// Returns whether @a p is a temporary Matrix4x4.
-	bool is_matrix4x4(const Matrix4x4* p) const;
-
+	/// Discards the chunk of the script @a name cached by require(), so that
+	/// the next require() loads it again from the resource manager.
+	void reload(StringId64 name);
+
+	/// Reloads the script @a name from @a lr without rebuilding the state
+	/// of the old version. The script runs again with its own globals;
+	/// then the functions it defines replace the old ones in the module
+	/// tables, which keep all their other values, and the upvalues of the
+	/// new functions which are not functions are joined with those of
+	/// the same name of the old ones. The module tables are those held by
+	/// package.loaded for @a name and by the @a num registry references
+	/// @a module_refs. Globals the script assigns are merged the same way.
+	void reload_module(StringId64 name, const LuaResource* lr, const int* module_refs, u32 num);
+
+	/// Runs the incremental garbage collector for about @a budget
+	/// milliseconds and leaves it stopped until the next call, so that
+	/// collection only happens at a known point of the frame. If @a budget
+	/// is 0, the garbage collector runs automatically instead.
+	/// Records the size of the heap and the time spent to the profiler.
+	void collect_garbage(f32 budget);
+
+	/// Returns a copy of the string @a str which is valid for the lifetime of
+	/// the environment. Copies of equal strings share the same memory.
+	const char* intern(const char* str);
+
+	/// Starts or stops sampling the call stack of the running scripts every
+	/// CROWN_LUA_SAMPLE_INTERVAL milliseconds.
+	/// @note The JIT compiler is disabled while sampling.
+	void set_sampling(bool enable);
+
+	/// Records to the profiler the stacks sampled since the last call.
+	void record_samples();
+
+	/// Pushes a new zero-filled cdata of the given @a type to @a L and
+	/// returns a pointer to its contents.
+	void* push_cdata(lua_State* L, LuaCType::Enum type);
+
+	/// Returns whether the value at index @a i of @a L is a cdata of the
+	/// given @a type.
+	bool is_cdata(lua_State* L, int i, LuaCType::Enum type);
+
+	static void sample(lua_State* L, lua_Debug* ar);
+	static int panic(lua_State* L);
 	static int error(lua_State* L);
 	static int require(lua_State* L);
 };
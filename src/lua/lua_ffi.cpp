@@ -0,0 +1,353 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/math/random.h"
+#include "core/math/types.h"
+#include "core/memory/temp_allocator.h"
+#include "lua/lua_environment.h"
+#include "lua/lua_stack.h"
+#include "world/physics_world.h"
+#include "world/render_world.h"
+#include "world/scene_graph.h"
+#include "world/world.h"
+
+namespace crown
+{
+// Decodes a unit pushed with LuaStack::push_unit().
+static inline UnitId ffi_unit(void* unit)
+{
+	const u32 enc = (u32)(uintptr_t)unit;
+	CE_ASSERT((enc & LIGHTDATA_TYPE_MASK) == UNIT_MARKER, "Not a unit");
+	UnitId id;
+	id._idx = enc >> 2;
+	return id;
+}
+
+// Decodes the @a num units pushed with LuaStack::push_unit() into @a ids.
+static void ffi_units(void* const* units, u32 num, Array<UnitId>& ids)
+{
+	array::resize(ids, num);
+	for (u32 i = 0; i < num; ++i)
+		ids[i] = ffi_unit(units[i]);
+}
+
+static f32 ffi_random_unit_float(Pcg32* r)
+{
+	return r->unit_float();
+}
+
+static f32 ffi_random_range(Pcg32* r, f32 min, f32 max)
+{
+	return r->range(min, max);
+}
+
+static void ffi_random_fill(Pcg32* r, f32* values, u32 num, f32 min, f32 max)
+{
+	random::fill(*r, values, num, min, max);
+}
+
+static Vector3 ffi_scene_graph_local_position(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->local_position(ffi_unit(unit));
+}
+
+static Quaternion ffi_scene_graph_local_rotation(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->local_rotation(ffi_unit(unit));
+}
+
+static Vector3 ffi_scene_graph_local_scale(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->local_scale(ffi_unit(unit));
+}
+
+static Vector3 ffi_scene_graph_world_position(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->world_position(ffi_unit(unit));
+}
+
+static Quaternion ffi_scene_graph_world_rotation(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->world_rotation(ffi_unit(unit));
+}
+
+static Matrix4x4 ffi_scene_graph_world_pose(void* sg, void* unit)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	return ((SceneGraph*)sg)->world_pose(ffi_unit(unit));
+}
+
+static void ffi_scene_graph_set_local_position(void* sg, void* unit, const Vector3* pos)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	((SceneGraph*)sg)->set_local_position(ffi_unit(unit), *pos);
+}
+
+static void ffi_scene_graph_set_local_rotation(void* sg, void* unit, const Quaternion* rot)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	((SceneGraph*)sg)->set_local_rotation(ffi_unit(unit), *rot);
+}
+
+static void ffi_scene_graph_set_local_scale(void* sg, void* unit, const Vector3* scale)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	((SceneGraph*)sg)->set_local_scale(ffi_unit(unit), *scale);
+}
+
+static void ffi_scene_graph_set_local_pose(void* sg, void* unit, const Matrix4x4* pose)
+{
+	CE_ASSERT(((SceneGraph*)sg)->has(ffi_unit(unit)), "Unit does not have transform");
+	((SceneGraph*)sg)->set_local_pose(ffi_unit(unit), *pose);
+}
+
+static void ffi_scene_graph_set_local_positions(void* sg, void* const* units, const Vector3* positions, u32 num)
+{
+	TempAllocator4096 ta;
+	Array<UnitId> ids(ta);
+	ffi_units(units, num, ids);
+	((SceneGraph*)sg)->set_local_positions(array::begin(ids), positions, num);
+}
+
+static void ffi_scene_graph_set_local_rotations(void* sg, void* const* units, const Quaternion* rotations, u32 num)
+{
+	TempAllocator4096 ta;
+	Array<UnitId> ids(ta);
+	ffi_units(units, num, ids);
+	((SceneGraph*)sg)->set_local_rotations(array::begin(ids), rotations, num);
+}
+
+static void ffi_scene_graph_set_local_poses(void* sg, void* const* units, const Matrix4x4* poses, u32 num)
+{
+	TempAllocator4096 ta;
+	Array<UnitId> ids(ta);
+	ffi_units(units, num, ids);
+	((SceneGraph*)sg)->set_local_poses(array::begin(ids), poses, num);
+}
+
+static Vector3 ffi_world_camera_screen_to_world(void* world, void* unit, const Vector3* pos)
+{
+	return ((World*)world)->camera_screen_to_world(ffi_unit(unit), *pos);
+}
+
+static Vector3 ffi_world_camera_world_to_screen(void* world, void* unit, const Vector3* pos)
+{
+	return ((World*)world)->camera_world_to_screen(ffi_unit(unit), *pos);
+}
+
+static void ffi_render_world_mesh_set_visible(void* rw, u32 mesh, bool visible)
+{
+	MeshInstance inst = { mesh };
+	((RenderWorld*)rw)->mesh_set_visible(inst, visible);
+}
+
+static void ffi_render_world_sprite_set_frame(void* rw, void* unit, u32 index)
+{
+	((RenderWorld*)rw)->sprite_set_frame(ffi_unit(unit), index);
+}
+
+static void ffi_render_world_sprite_set_visible(void* rw, void* unit, bool visible)
+{
+	((RenderWorld*)rw)->sprite_set_visible(ffi_unit(unit), visible);
+}
+
+static void ffi_world_set_sound_positions(void* world, const u32* ids, const Vector3* positions, u32 num)
+{
+	((World*)world)->set_sound_positions(num, ids, positions);
+}
+
+static void ffi_render_world_sprite_set_frames(void* rw, void* const* units, const u32* frames, u32 num)
+{
+	TempAllocator4096 ta;
+	Array<UnitId> ids(ta);
+	ffi_units(units, num, ids);
+	((RenderWorld*)rw)->sprite_set_frames(array::begin(ids), frames, num);
+}
+
+static void ffi_render_world_sprite_set_visibilities(void* rw, void* const* units, const bool* visible, u32 num)
+{
+	TempAllocator4096 ta;
+	Array<UnitId> ids(ta);
+	ffi_units(units, num, ids);
+	((RenderWorld*)rw)->sprite_set_visibilities(array::begin(ids), visible, num);
+}
+
+static void ffi_physics_world_actor_set_linear_velocities(void* pw, const u32* actors, const Vector3* vels, u32 num)
+{
+	CE_STATIC_ASSERT(sizeof(ActorInstance) == sizeof(u32));
+	((PhysicsWorld*)pw)->actor_set_linear_velocities((const ActorInstance*)actors, vels, num);
+}
+
+// Table of the functions callable through LuaJIT's FFI. Exporting them
+// through a table of pointers instead of as symbols of the executable
+// works without any linker support on every platform.
+// Keep in sync with s_ffi_api below.
+struct FfiApi
+{
+	Vector3 (*scene_graph_local_position)(void*, void*);
+	Quaternion (*scene_graph_local_rotation)(void*, void*);
+	Vector3 (*scene_graph_local_scale)(void*, void*);
+	Vector3 (*scene_graph_world_position)(void*, void*);
+	Quaternion (*scene_graph_world_rotation)(void*, void*);
+	Matrix4x4 (*scene_graph_world_pose)(void*, void*);
+	void (*scene_graph_set_local_position)(void*, void*, const Vector3*);
+	void (*scene_graph_set_local_rotation)(void*, void*, const Quaternion*);
+	void (*scene_graph_set_local_scale)(void*, void*, const Vector3*);
+	void (*scene_graph_set_local_pose)(void*, void*, const Matrix4x4*);
+	void (*scene_graph_set_local_positions)(void*, void* const*, const Vector3*, u32);
+	void (*scene_graph_set_local_rotations)(void*, void* const*, const Quaternion*, u32);
+	void (*scene_graph_set_local_poses)(void*, void* const*, const Matrix4x4*, u32);
+	Vector3 (*world_camera_screen_to_world)(void*, void*, const Vector3*);
+	Vector3 (*world_camera_world_to_screen)(void*, void*, const Vector3*);
+	void (*render_world_mesh_set_visible)(void*, u32, bool);
+	void (*render_world_sprite_set_frame)(void*, void*, u32);
+	void (*render_world_sprite_set_visible)(void*, void*, bool);
+	void (*world_set_sound_positions)(void*, const u32*, const Vector3*, u32);
+	void (*render_world_sprite_set_frames)(void*, void* const*, const u32*, u32);
+	void (*render_world_sprite_set_visibilities)(void*, void* const*, const bool*, u32);
+	void (*physics_world_actor_set_linear_velocities)(void*, const u32*, const Vector3*, u32);
+	f32 (*random_unit_float)(Pcg32*);
+	f32 (*random_range)(Pcg32*, f32, f32);
+	void (*random_fill)(Pcg32*, f32*, u32, f32, f32);
+};
+
+static const FfiApi s_api =
+{
+	ffi_scene_graph_local_position,
+	ffi_scene_graph_local_rotation,
+	ffi_scene_graph_local_scale,
+	ffi_scene_graph_world_position,
+	ffi_scene_graph_world_rotation,
+	ffi_scene_graph_world_pose,
+	ffi_scene_graph_set_local_position,
+	ffi_scene_graph_set_local_rotation,
+	ffi_scene_graph_set_local_scale,
+	ffi_scene_graph_set_local_pose,
+	ffi_scene_graph_set_local_positions,
+	ffi_scene_graph_set_local_rotations,
+	ffi_scene_graph_set_local_poses,
+	ffi_world_camera_screen_to_world,
+	ffi_world_camera_world_to_screen,
+	ffi_render_world_mesh_set_visible,
+	ffi_render_world_sprite_set_frame,
+	ffi_render_world_sprite_set_visible,
+	ffi_world_set_sound_positions,
+	ffi_render_world_sprite_set_frames,
+	ffi_render_world_sprite_set_visibilities,
+	ffi_physics_world_actor_set_linear_velocities,
+	ffi_random_unit_float,
+	ffi_random_range,
+	ffi_random_fill
+};
+
+// Declares FfiApi and replaces the matching functions of the SceneGraph,
+// World, RenderWorld and Random modules with direct calls through it, which
+// LuaJIT compiles into its traces. Types are checked by the FFI itself. The
+// batch functions take tables as usual, or FFI arrays followed by their size.
+// The layout of the World events is declared too, so that scripts can walk
+// them in place.
+static const char* s_ffi_api =
+	"local ffi = require 'ffi'\n"
+	"ffi.cdef [[\n"
+	"typedef struct {\n"
+	"	Vector3 (*scene_graph_local_position)(void*, void*);\n"
+	"	Quaternion (*scene_graph_local_rotation)(void*, void*);\n"
+	"	Vector3 (*scene_graph_local_scale)(void*, void*);\n"
+	"	Vector3 (*scene_graph_world_position)(void*, void*);\n"
+	"	Quaternion (*scene_graph_world_rotation)(void*, void*);\n"
+	"	Matrix4x4 (*scene_graph_world_pose)(void*, void*);\n"
+	"	void (*scene_graph_set_local_position)(void*, void*, const Vector3*);\n"
+	"	void (*scene_graph_set_local_rotation)(void*, void*, const Quaternion*);\n"
+	"	void (*scene_graph_set_local_scale)(void*, void*, const Vector3*);\n"
+	"	void (*scene_graph_set_local_pose)(void*, void*, const Matrix4x4*);\n"
+	"	void (*scene_graph_set_local_positions)(void*, void* const*, const Vector3*, uint32_t);\n"
+	"	void (*scene_graph_set_local_rotations)(void*, void* const*, const Quaternion*, uint32_t);\n"
+	"	void (*scene_graph_set_local_poses)(void*, void* const*, const Matrix4x4*, uint32_t);\n"
+	"	Vector3 (*world_camera_screen_to_world)(void*, void*, const Vector3*);\n"
+	"	Vector3 (*world_camera_world_to_screen)(void*, void*, const Vector3*);\n"
+	"	void (*render_world_mesh_set_visible)(void*, uint32_t, bool);\n"
+	"	void (*render_world_sprite_set_frame)(void*, void*, uint32_t);\n"
+	"	void (*render_world_sprite_set_visible)(void*, void*, bool);\n"
+	"	void (*world_set_sound_positions)(void*, const uint32_t*, const Vector3*, uint32_t);\n"
+	"	void (*render_world_sprite_set_frames)(void*, void* const*, const uint32_t*, uint32_t);\n"
+	"	void (*render_world_sprite_set_visibilities)(void*, void* const*, const bool*, uint32_t);\n"
+	"	void (*physics_world_actor_set_linear_velocities)(void*, const uint32_t*, const Vector3*, uint32_t);\n"
+	"	float (*random_unit_float)(Random*);\n"
+	"	float (*random_range)(Random*, float, float);\n"
+	"	void (*random_fill)(Random*, float*, uint32_t, float, float);\n"
+	"} FfiApi;\n"
+	"typedef struct { uint32_t type, size; } EventHeader;\n"
+	"typedef struct { uint32_t unit; } UnitSpawnedEvent;\n"
+	"typedef struct { uint32_t unit; } UnitDestroyedEvent;\n"
+	"]]\n"
+	"local api = ffi.cast('const FfiApi*', ...)\n"
+	"SceneGraph.local_position     = api.scene_graph_local_position\n"
+	"SceneGraph.local_rotation     = api.scene_graph_local_rotation\n"
+	"SceneGraph.local_scale        = api.scene_graph_local_scale\n"
+	"SceneGraph.world_position     = api.scene_graph_world_position\n"
+	"SceneGraph.world_rotation     = api.scene_graph_world_rotation\n"
+	"SceneGraph.world_pose         = api.scene_graph_world_pose\n"
+	"SceneGraph.set_local_position = api.scene_graph_set_local_position\n"
+	"SceneGraph.set_local_rotation = api.scene_graph_set_local_rotation\n"
+	"SceneGraph.set_local_scale    = api.scene_graph_set_local_scale\n"
+	"SceneGraph.set_local_pose     = api.scene_graph_set_local_pose\n"
+	"World.camera_screen_to_world  = api.world_camera_screen_to_world\n"
+	"World.camera_world_to_screen  = api.world_camera_world_to_screen\n"
+	"RenderWorld.mesh_set_visible  = api.render_world_mesh_set_visible\n"
+	"RenderWorld.sprite_set_frame  = api.render_world_sprite_set_frame\n"
+	"RenderWorld.sprite_set_visible = api.render_world_sprite_set_visible\n"
+	"local function batch(f, g)\n"
+	"	return function(a, b, c, num) if num then return g(a, b, c, num) end return f(a, b, c) end\n"
+	"end\n"
+	"SceneGraph.set_local_positions = batch(SceneGraph.set_local_positions, api.scene_graph_set_local_positions)\n"
+	"SceneGraph.set_local_rotations = batch(SceneGraph.set_local_rotations, api.scene_graph_set_local_rotations)\n"
+	"SceneGraph.set_local_poses     = batch(SceneGraph.set_local_poses, api.scene_graph_set_local_poses)\n"
+	"World.set_sound_positions      = batch(World.set_sound_positions, api.world_set_sound_positions)\n"
+	"RenderWorld.sprite_set_frames  = batch(RenderWorld.sprite_set_frames, api.render_world_sprite_set_frames)\n"
+	"RenderWorld.sprite_set_visibilities = batch(RenderWorld.sprite_set_visibilities, api.render_world_sprite_set_visibilities)\n"
+	"PhysicsWorld.actor_set_linear_velocities = batch(PhysicsWorld.actor_set_linear_velocities, api.physics_world_actor_set_linear_velocities)\n"
+	"local world_events = World.events\n"
+	"World.events = function(w)\n"
+	"	local size, data = world_events(w)\n"
+	"	return size, ffi.cast('const uint8_t*', data)\n"
+	"end\n"
+	"Random.unit_float = api.random_unit_float\n"
+	"Random.range = api.random_range\n"
+	"local random_fill = Random.fill\n"
+	"Random.fill = function(r, values, num, min, max)\n"
+	"	if type(values) == 'cdata' then return api.random_fill(r, values, num, min or 0, max or 1) end\n"
+	"	return random_fill(r, values, num, min, max)\n"
+	"end\n"
+	;
+
+void load_ffi(LuaEnvironment& env)
+{
+	lua_State* L = env.L;
+
+	int err = luaL_loadstring(L, s_ffi_api);
+	CE_ASSERT(err == 0, "luaL_loadstring: %s", lua_tostring(L, -1));
+	CE_UNUSED(err);
+	lua_pushlightuserdata(L, (void*)&s_api);
+	lua_call(L, 1, 0);
+
+	// Types of the events returned by World.events()
+	lua_createtable(L, 0, 3);
+	lua_pushinteger(L, EventType::UNIT_SPAWNED);
+	lua_setfield(L, -2, "UNIT_SPAWNED");
+	lua_pushinteger(L, EventType::UNIT_DESTROYED);
+	lua_setfield(L, -2, "UNIT_DESTROYED");
+	lua_pushinteger(L, EventType::LEVEL_LOADED);
+	lua_setfield(L, -2, "LEVEL_LOADED");
+	lua_setglobal(L, "EventType");
+}
+
+} // namespace crown
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/memory/memory.h"
+#include "core/thread/job_system.h"
+#include "lua/lua_jobs.h"
+#include "resource/lua_resource.h"
+#include <lua.hpp>
+#include <string.h> // memcpy
+
+namespace crown
+{
+LuaJobs::LuaJobs(Allocator& a)
+	: _allocator(&a)
+	, _states(a)
+	, _jobs(a)
+	, _next_id(0)
+{
+}
+
+LuaJobs::~LuaJobs()
+{
+	while (array::size(_jobs) > 0)
+	{
+		wait(_jobs[0]->id);
+		destroy(_jobs[0]->id);
+	}
+
+	for (u32 i = 0; i < array::size(_states); ++i)
+		lua_close(_states[i]);
+}
+
+u32 LuaJobs::run(const LuaResource* lr, const char* input, u32 size)
+{
+	LuaJob* lj = CE_NEW(*_allocator, LuaJob)();
+	lj->script = lr;
+	lj->input = (char*)_allocator->allocate(size + 1);
+	memcpy(lj->input, input, size);
+	lj->input[size] = '\0';
+	lj->input_size = size;
+	lj->id = _next_id++;
+	lj->jobs = this;
+	array::push_back(_jobs, lj);
+
+	Job job;
+	job.function = LuaJobs::execute;
+	job.user_data = lj;
+	job_system::run(&job, 1, &lj->counter);
+	return lj->id;
+}
+
+bool LuaJobs::is_done(u32 id)
+{
+	return find(id)->counter.load() == 0;
+}
+
+LuaJob& LuaJobs::wait(u32 id)
+{
+	LuaJob* lj = find(id);
+	job_system::wait(lj->counter);
+	return *lj;
+}
+
+void LuaJobs::destroy(u32 id)
+{
+	for (u32 i = 0; i < array::size(_jobs); ++i)
+	{
+		LuaJob* lj = _jobs[i];
+		if (lj->id != id)
+			continue;
+
+		CE_ASSERT(lj->counter.load() == 0, "Job not completed: %u", id);
+		_allocator->deallocate(lj->input);
+		_allocator->deallocate(lj->output);
+		CE_DELETE(*_allocator, lj);
+
+		_jobs[i] = array::back(_jobs);
+		array::pop_back(_jobs);
+		return;
+	}
+
+	CE_FATAL("Job not found: %u", id);
+}
+
+LuaJob* LuaJobs::find(u32 id)
+{
+	for (u32 i = 0; i < array::size(_jobs); ++i)
+	{
+		if (_jobs[i]->id == id)
+			return _jobs[i];
+	}
+
+	CE_FATAL("Job not found: %u", id);
+	return NULL;
+}
+
+lua_State* LuaJobs::acquire_state()
+{
+	{
+		ScopedMutex sm(_mutex);
+		if (array::size(_states) > 0)
+		{
+			lua_State* L = array::back(_states);
+			array::pop_back(_states);
+			return L;
+		}
+	}
+
+	lua_State* L = luaL_newstate();
+	CE_ASSERT(L, "Unable to create lua state");
+	luaL_openlibs(L);
+	return L;
+}
+
+void LuaJobs::release_state(lua_State* L)
+{
+	ScopedMutex sm(_mutex);
+	array::push_back(_states, L);
+}
+
+void LuaJobs::execute(void* user_data)
+{
+	LuaJob& lj = *(LuaJob*)user_data;
+	lua_State* L = lj.jobs->acquire_state();
+
+	// The script returns the function to call with the input
+	int err = luaL_loadbuffer(L, lua_resource::program(lj.script), lj.script->size, "<job>");
+	if (err == 0)
+		err = lua_pcall(L, 0, 1, 0);
+	if (err == 0)
+	{
+		lua_pushlstring(L, lj.input, lj.input_size);
+		err = lua_pcall(L, 1, 1, 0);
+	}
+
+	size_t size;
+	const char* output = lua_tolstring(L, -1, &size);
+	if (output != NULL)
+	{
+		lj.output = (char*)lj.jobs->_allocator->allocate(u32(size) + 1);
+		memcpy(lj.output, output, size);
+		lj.output[size] = '\0';
+		lj.output_size = u32(size);
+	}
+	lj.error = err != 0;
+
+	lua_settop(L, 0);
+	lj.jobs->release_state(L);
+}
+
+} // namespace crown
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/mutex.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+struct lua_State;
+
+namespace crown
+{
+struct LuaJobs;
+
+/// Script executed by the job system.
+///
+/// @ingroup Lua
+struct LuaJob
+{
+	const LuaResource* script;
+	char* input;
+	u32 input_size;
+	char* output;        ///< Value returned by the script or error message, NULL if none.
+	u32 output_size;
+	bool error;
+	AtomicInt counter;   ///< Zero when the job has completed.
+	u32 id;
+	LuaJobs* jobs;
+
+	LuaJob()
+		: script(NULL)
+		, input(NULL)
+		, input_size(0)
+		, output(NULL)
+		, output_size(0)
+		, error(false)
+		, counter(0)
+		, id(0)
+		, jobs(NULL)
+	{
+	}
+};
+
+/// Runs scripts on the threads of the job system.
+/// Each job runs in a Lua state of its own, which only has the standard
+/// libraries and the FFI loaded: scripts executed by jobs can not access
+/// the engine API nor the globals of the main Lua state, and exchange data
+/// with it through strings only.
+///
+/// @ingroup Lua
+struct LuaJobs
+{
+	Allocator* _allocator;
+	Mutex _mutex;
+	Array<lua_State*> _states; ///< Lua states not in use by any job.
+	Array<LuaJob*> _jobs;      ///< Jobs not destroyed yet.
+	u32 _next_id;
+
+	///
+	LuaJobs(Allocator& a);
+
+	/// Waits for all the jobs to complete.
+	~LuaJobs();
+
+	LuaJobs(const LuaJobs&) = delete;
+	LuaJobs& operator=(const LuaJobs&) = delete;
+
+	/// Runs the script @a lr in a job and returns its id.
+	/// The script must return a function, which is called with the string
+	/// @a input of @a size bytes and returns a string back. The resource
+	/// @a lr must stay loaded until the job completes.
+	u32 run(const LuaResource* lr, const char* input, u32 size);
+
+	/// Returns whether the job @a id has completed.
+	bool is_done(u32 id);
+
+	/// Waits for the job @a id to complete, executing other jobs in the
+	/// meantime, and returns it. The job must then be released with destroy().
+	LuaJob& wait(u32 id);
+
+	/// Releases the job @a id, which must have completed.
+	void destroy(u32 id);
+
+	LuaJob* find(u32 id);
+	lua_State* acquire_state();
+	void release_state(lua_State* L);
+	static void execute(void* user_data);
+};
+
+} // namespace crown
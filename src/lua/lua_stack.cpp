@@ -11,39 +11,29 @@ namespace crown
 {
 bool LuaStack::is_vector3(int i)
 {
-	return device()->_lua_environment->is_vector3((Vector3*)lua_touserdata(L, i));
+	return device()->_lua_environment->is_cdata(L, i, LuaCType::VECTOR3);
 }
 
 bool LuaStack::is_quaternion(int i)
 {
-	return device()->_lua_environment->is_quaternion((Quaternion*)lua_touserdata(L, i));
+	return device()->_lua_environment->is_cdata(L, i, LuaCType::QUATERNION);
 }
 
 bool LuaStack::is_matrix4x4(int i)
 {
-	return device()->_lua_environment->is_matrix4x4((Matrix4x4*)lua_touserdata(L, i));
+	return device()->_lua_environment->is_cdata(L, i, LuaCType::MATRIX4X4);
 }
 
-#if CROWN_DEBUG
-void LuaStack::check_temporary(int i, const Vector3* p)
-{
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_vector3(p))
-		luaL_typerror(L, i, "Vector3");
-}
-
-void LuaStack::check_temporary(int i, const Quaternion* p)
+bool LuaStack::is_random(int i)
 {
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_quaternion(p))
-		luaL_typerror(L, i, "Quaternion");
+	return device()->_lua_environment->is_cdata(L, i, LuaCType::RANDOM);
 }
 
-void LuaStack::check_temporary(int i, const Matrix4x4* p)
+#if CROWN_DEBUG
+void LuaStack::check_cdata(int i, LuaCType::Enum type, const char* name)
 {
-	LuaEnvironment* env = device()->_lua_environment;
-	if (!is_pointer(i) || !env->is_matrix4x4(p))
-		luaL_typerror(L, i, "Matrix4x4");
+	if (!device()->_lua_environment->is_cdata(L, i, type))
+		luaL_typerror(L, i, name);
 }
 #endif // CROWN_DEBUG
 
@@ -58,17 +48,17 @@ void LuaStack::push_vector2(const Vector2& v)
 
 void LuaStack::push_vector3(const Vector3& v)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_vector3(v));
+	*(Vector3*)device()->_lua_environment->push_cdata(L, LuaCType::VECTOR3) = v;
 }
 
 void LuaStack::push_quaternion(const Quaternion& q)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_quaternion(q));
+	*(Quaternion*)device()->_lua_environment->push_cdata(L, LuaCType::QUATERNION) = q;
 }
 
 void LuaStack::push_matrix4x4(const Matrix4x4& m)
 {
-	lua_pushlightuserdata(L, device()->_lua_environment->next_matrix4x4(m));
+	*(Matrix4x4*)device()->_lua_environment->push_cdata(L, LuaCType::MATRIX4X4) = m;
 }
 
 void LuaStack::push_color4(const Color4& c)
@@ -82,4 +72,9 @@ void LuaStack::push_color4(const Color4& c)
 	push_quaternion(q);
 }
 
+void LuaStack::push_random(const Pcg32& r)
+{
+	*(Pcg32*)device()->_lua_environment->push_cdata(L, LuaCType::RANDOM) = r;
+}
+
 } // namespace crown
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "config.h"
+#include "core/math/random.h"
 #include "core/math/types.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
@@ -31,6 +32,10 @@
 	#define LUA_ASSERT(...) CE_NOOP()
 #endif // CROWN_DEBUG
 
+#ifndef LUA_TCDATA
+	#define LUA_TCDATA 10 // Type of LuaJIT's FFI values, see lj_obj.h
+#endif
+
 #define LIGHTDATA_TYPE_BITS  2
 #define LIGHTDATA_TYPE_MASK  0x3
 #define LIGHTDATA_TYPE_SHIFT 0
@@ -40,6 +45,22 @@
 
 namespace crown
 {
+/// Math values are exchanged with Lua as cdata of these FFI types.
+///
+/// @ingroup Lua
+struct LuaCType
+{
+	enum Enum
+	{
+		VECTOR3,
+		QUATERNION,
+		MATRIX4X4,
+		RANDOM,
+
+		COUNT
+	};
+};
+
 /// Wrapper to manipulate Lua stack.
 ///
 /// @ingroup Lua
@@ -113,6 +134,7 @@ struct LuaStack
 	bool is_vector3(int i);
 	bool is_quaternion(int i);
 	bool is_matrix4x4(int i);
+	bool is_random(int i);
 
 	/// Wraps lua_type.
 	int value_type(int i)
@@ -152,6 +174,18 @@ struct LuaStack
 #endif
 	}
 
+	const char* get_lstring(int i, u32& len)
+	{
+		size_t size;
+#if CROWN_DEBUG
+		const char* s = luaL_checklstring(L, i, &size);
+#else
+		const char* s = lua_tolstring(L, i, &size);
+#endif
+		len = u32(size);
+		return s;
+	}
+
 	void* get_pointer(int i)
 	{
 		if (!lua_isuserdata(L, i))
@@ -267,6 +301,15 @@ struct LuaStack
 		return p;
 	}
 
+	NavigationWorld* get_navigation_world(int i)
+	{
+		NavigationWorld* p = (NavigationWorld*)get_pointer(i);
+#if CROWN_DEBUG
+		check_type(i, p);
+#endif // CROWN_DEBUG
+		return p;
+	}
+
 	ScriptWorld* get_script_world(int i)
 	{
 		ScriptWorld* p = (ScriptWorld*)get_pointer(i);
@@ -285,6 +328,24 @@ struct LuaStack
 		return p;
 	}
 
+	SkeletonAnimation* get_skeleton_animation(int i)
+	{
+		SkeletonAnimation* p = (SkeletonAnimation*)get_pointer(i);
+#if CROWN_DEBUG
+		check_type(i, p);
+#endif // CROWN_DEBUG
+		return p;
+	}
+
+	Replication* get_replication(int i)
+	{
+		Replication* p = (Replication*)get_pointer(i);
+#if CROWN_DEBUG
+		check_type(i, p);
+#endif // CROWN_DEBUG
+		return p;
+	}
+
 	UnitId get_unit(int i)
 	{
 		u32 enc = (u32)(uintptr_t)get_pointer(i);
@@ -327,6 +388,18 @@ struct LuaStack
 		return inst;
 	}
 
+	ParticleInstance get_particle_instance(int i)
+	{
+		ParticleInstance inst = { get_id(i) };
+		return inst;
+	}
+
+	TilemapInstance get_tilemap_instance(int i)
+	{
+		TilemapInstance inst = { get_id(i) };
+		return inst;
+	}
+
 	Material* get_material(int i)
 	{
 		return (Material*)get_pointer(i);
@@ -338,6 +411,12 @@ struct LuaStack
 		return inst;
 	}
 
+	MoverInstance get_mover(int i)
+	{
+		MoverInstance inst = { get_id(i) };
+		return inst;
+	}
+
 	SoundInstanceId get_sound_instance_id(int i)
 	{
 		return get_id(i);
@@ -360,29 +439,34 @@ struct LuaStack
 
 	Vector3& get_vector3(int i)
 	{
-		Vector3* v = (Vector3*)get_pointer(i);
 #if CROWN_DEBUG
-		check_temporary(i, v);
+		check_cdata(i, LuaCType::VECTOR3, "Vector3");
 #endif // CROWN_DEBUG
-		return *v;
+		return *(Vector3*)lua_topointer(L, i);
 	}
 
 	Quaternion& get_quaternion(int i)
 	{
-		Quaternion* q = (Quaternion*)get_pointer(i);
 #if CROWN_DEBUG
-		check_temporary(i, q);
+		check_cdata(i, LuaCType::QUATERNION, "Quaternion");
 #endif // CROWN_DEBUG
-		return *q;
+		return *(Quaternion*)lua_topointer(L, i);
 	}
 
 	Matrix4x4& get_matrix4x4(int i)
 	{
-		Matrix4x4* m = (Matrix4x4*)get_pointer(i);
 #if CROWN_DEBUG
-		check_temporary(i, m);
+		check_cdata(i, LuaCType::MATRIX4X4, "Matrix4x4");
 #endif // CROWN_DEBUG
-		return *m;
+		return *(Matrix4x4*)lua_topointer(L, i);
+	}
+
+	Pcg32& get_random(int i)
+	{
+#if CROWN_DEBUG
+		check_cdata(i, LuaCType::RANDOM, "Random");
+#endif // CROWN_DEBUG
+		return *(Pcg32*)lua_topointer(L, i);
 	}
 
 	Color4 get_color4(int i)
@@ -561,6 +645,11 @@ struct LuaStack
 		push_pointer(world);
 	}
 
+	void push_navigation_world(NavigationWorld* world)
+	{
+		push_pointer(world);
+	}
+
 	void push_script_world(ScriptWorld* world)
 	{
 		push_pointer(world);
@@ -571,6 +660,16 @@ struct LuaStack
 		push_pointer(sm);
 	}
 
+	void push_skeleton_animation(SkeletonAnimation* sa)
+	{
+		push_pointer(sa);
+	}
+
+	void push_replication(Replication* r)
+	{
+		push_pointer(r);
+	}
+
 	void push_unit(UnitId id)
 	{
 		u32 encoded = (id._idx << 2) | UNIT_MARKER;
@@ -602,6 +701,16 @@ struct LuaStack
 		push_id(i.i);
 	}
 
+	void push_particle_instance(ParticleInstance i)
+	{
+		push_id(i.i);
+	}
+
+	void push_tilemap_instance(TilemapInstance i)
+	{
+		push_id(i.i);
+	}
+
 	void push_material(Material* material)
 	{
 		push_pointer(material);
@@ -612,6 +721,11 @@ struct LuaStack
 		push_id(i.i);
 	}
 
+	void push_mover(MoverInstance i)
+	{
+		push_id(i.i);
+	}
+
 	void push_sound_instance_id(SoundInstanceId id)
 	{
 		push_id(id);
@@ -627,6 +741,7 @@ struct LuaStack
 	void push_matrix4x4(const Matrix4x4& m);
 	void push_quaternion(const Quaternion& q);
 	void push_color4(const Color4& c);
+	void push_random(const Pcg32& r);
 
 	void push_vector2box(const Vector2& v)
 	{
@@ -671,9 +786,7 @@ struct LuaStack
 	}
 
 #if CROWN_DEBUG
-	void check_temporary(int i, const Vector3* p);
-	void check_temporary(int i, const Quaternion* p);
-	void check_temporary(int i, const Matrix4x4* p);
+	void check_cdata(int i, LuaCType::Enum type, const char* name);
 
 	void check_type(int i, const Gui* p)
 	{
@@ -723,6 +836,12 @@ struct LuaStack
 			luaL_typerror(L, i, "SoundWorld");
 	}
 
+	void check_type(int i, const NavigationWorld* p)
+	{
+		if (!is_pointer(i) || *(u32*)p != NAVIGATION_WORLD_MARKER)
+			luaL_typerror(L, i, "NavigationWorld");
+	}
+
 	void check_type(int i, const Level* p)
 	{
 		if (!is_pointer(i) || *(u32*)p != LEVEL_MARKER)
@@ -740,6 +859,18 @@ struct LuaStack
 		if (!is_pointer(i) || *(u32*)p != ANIMATION_STATE_MACHINE_MARKER)
 			luaL_typerror(L, i, "AnimationStateMachine");
 	}
+
+	void check_type(int i, const SkeletonAnimation* p)
+	{
+		if (!is_pointer(i) || *(u32*)p != SKELETON_ANIMATION_MARKER)
+			luaL_typerror(L, i, "SkeletonAnimation");
+	}
+
+	void check_type(int i, const Replication* p)
+	{
+		if (!is_pointer(i) || *(u32*)p != REPLICATION_MARKER)
+			luaL_typerror(L, i, "Replication");
+	}
 #endif // CROWN_DEBUG
 };
 
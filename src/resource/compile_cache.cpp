@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/filesystem/file.h"
+#include "core/guid.h"
+#include "core/memory/temp_allocator.h"
+#include "core/os.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
+#include "device/log.h"
+#include "resource/compile_cache.h"
+#include <inttypes.h> // PRIx64
+#include <stdio.h>    // snprintf
+
+namespace { const crown::log_internal::System COMPILE_CACHE = { "compile_cache" }; }
+
+namespace crown
+{
+static void entry_path(u64 key, const char* suffix, DynamicString& path)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.16" PRIx64 "%s", key, suffix);
+	path = buf;
+}
+
+CompileCache::CompileCache(Allocator& a, const char* dir)
+	: _filesystem(a)
+	, _stats(a)
+{
+	_filesystem.set_prefix(dir);
+	_filesystem.create_directory("");
+}
+
+CompileCache::Stats& CompileCache::stats(const char* type)
+{
+	for (u32 i = 0; i < array::size(_stats); ++i)
+	{
+		if (strcmp(_stats[i].type, type) == 0)
+			return _stats[i];
+	}
+
+	Stats st;
+	strncpy(st.type, type, sizeof(st.type) - 1);
+	st.type[sizeof(st.type) - 1] = '\0';
+	st.hits = 0;
+	st.misses = 0;
+	array::push_back(_stats, st);
+	return array::back(_stats);
+}
+
+bool CompileCache::read(u64 key, const char* suffix, Buffer& data)
+{
+	TempAllocator256 ta;
+	DynamicString path(ta);
+	entry_path(key, suffix, path);
+
+	if (!_filesystem.exists(path.c_str()))
+		return false;
+
+	File* file = _filesystem.open(path.c_str(), FileOpenMode::READ);
+	if (!file->is_open())
+	{
+		_filesystem.close(*file);
+		return false;
+	}
+
+	const u32 size = file->size();
+	array::resize(data, size);
+	const u32 num = file->read(array::begin(data), size);
+	_filesystem.close(*file);
+	return num == size;
+}
+
+void CompileCache::write(u64 key, const char* suffix, const void* data, u32 size)
+{
+	TempAllocator512 ta;
+	DynamicString path(ta);
+	DynamicString tmp_path(ta);
+	DynamicString abs_path(ta);
+	DynamicString abs_tmp_path(ta);
+	entry_path(key, suffix, path);
+
+	// Write to a unique file first, then move it in place
+	guid::to_string(guid::new_guid(), tmp_path);
+	tmp_path += ".tmp";
+
+	File* file = _filesystem.open(tmp_path.c_str(), FileOpenMode::WRITE);
+	if (!file->is_open())
+	{
+		_filesystem.close(*file);
+		logw(COMPILE_CACHE, "Failed to write '%s'", path.c_str());
+		return;
+	}
+	const u32 num = file->write(data, size);
+	_filesystem.close(*file);
+
+	_filesystem.get_absolute_path(path.c_str(), abs_path);
+	_filesystem.get_absolute_path(tmp_path.c_str(), abs_tmp_path);
+
+	if (num != size || !os::rename(abs_tmp_path.c_str(), abs_path.c_str()))
+	{
+		logw(COMPILE_CACHE, "Failed to write '%s'", path.c_str());
+		_filesystem.delete_file(tmp_path.c_str());
+	}
+}
+
+void CompileCache::add_hit(const char* type)
+{
+	ScopedMutex sm(_mutex);
+	++stats(type).hits;
+}
+
+void CompileCache::add_miss(const char* type)
+{
+	ScopedMutex sm(_mutex);
+	++stats(type).misses;
+}
+
+void CompileCache::log_stats()
+{
+	ScopedMutex sm(_mutex);
+	for (u32 i = 0; i < array::size(_stats); ++i)
+	{
+		const Stats& st = _stats[i];
+		logi(COMPILE_CACHE, "%-16s %u hits, %u misses", st.type, st.hits, st.misses);
+	}
+}
+
+void CompileCache::reset_stats()
+{
+	ScopedMutex sm(_mutex);
+	array::clear(_stats);
+}
+
+} // namespace crown
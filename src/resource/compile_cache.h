@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/filesystem_disk.h"
+#include "core/thread/mutex.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Stores compiled resources by the hash of their inputs, so that
+/// resources compiled on a machine can be fetched by the others.
+/// The cache is a directory, usually on a network share.
+///
+/// @ingroup Resource
+struct CompileCache
+{
+	struct Stats
+	{
+		char type[32];
+		u32 hits;
+		u32 misses;
+	};
+
+	FilesystemDisk _filesystem;
+	Mutex _mutex;
+	Array<Stats> _stats;
+
+	Stats& stats(const char* type);
+
+	/// Uses the directory @a dir as storage.
+	CompileCache(Allocator& a, const char* dir);
+
+	/// Reads the entry @a key with the given @a suffix into @a data.
+	/// Returns false if the entry does not exist.
+	bool read(u64 key, const char* suffix, Buffer& data);
+
+	/// Writes @a size bytes of @a data to the entry @a key with
+	/// the given @a suffix. Readers never see partially written entries.
+	void write(u64 key, const char* suffix, const void* data, u32 size);
+
+	/// Counts a hit for a resource of the given @a type.
+	void add_hit(const char* type);
+
+	/// Counts a miss for a resource of the given @a type.
+	void add_miss(const char* type);
+
+	/// Logs the hit/miss statistics of each resource type.
+	void log_stats();
+
+	/// Resets the hit/miss statistics.
+	void reset_stats();
+};
+
+} // namespace crown
@@ -13,6 +13,7 @@
 #include "core/memory/temp_allocator.h"
 #include "core/os.h"
 #include "core/strings/dynamic_string.h"
+#include "core/strings/inline_string.h"
 #include "core/strings/string_stream.h"
 #include "device/log.h"
 #include "resource/compile_options.h"
@@ -27,6 +28,10 @@ CompileOptions::CompileOptions(DataCompiler& dc, Filesystem& data_filesystem, Dy
 	, _output(output)
 	, _platform(platform)
 	, _dependencies(default_allocator())
+	, _compression(ResourceCompression::NONE)
+	, _quantize_vertices(false)
+	, _texture_format("RGBA8")
+	, _normal_map_format("RGBA8")
 {
 }
 
@@ -62,8 +67,7 @@ bool CompileOptions::file_exists(const char* path)
 
 bool CompileOptions::resource_exists(const char* type, const char* name)
 {
-	TempAllocator1024 ta;
-	DynamicString path(ta);
+	InlineString<256> path;
 	path += name;
 	path += ".";
 	path += type;
@@ -121,6 +125,9 @@ Buffer CompileOptions::read(const char* path)
 
 void CompileOptions::get_absolute_path(const char* path, DynamicString& abs)
 {
+	// The file is most likely passed to an external compiler
+	add_dependency(path);
+
 	TempAllocator256 ta;
 	DynamicString source_dir(ta);
 	_data_compiler.source_dir(path, source_dir);
@@ -132,9 +139,8 @@ void CompileOptions::get_absolute_path(const char* path, DynamicString& abs)
 
 void CompileOptions::get_temporary_path(const char* suffix, DynamicString& abs)
 {
-	TempAllocator1024 ta;
-	DynamicString str(ta);
-	DynamicString prefix(ta);
+	InlineString<256> str;
+	InlineString<64> prefix;
 	guid::to_string(guid::new_guid(), prefix);
 
 	_data_filesystem.get_absolute_path(CROWN_TEMP_DIRECTORY, str);
@@ -164,6 +170,37 @@ const char* CompileOptions::platform() const
 	return _platform;
 }
 
+ResourceCompression::Enum CompileOptions::compression() const
+{
+	return _compression;
+}
+
+void CompileOptions::set_compression(ResourceCompression::Enum compression)
+{
+	_compression = compression;
+}
+
+bool CompileOptions::quantize_vertices() const
+{
+	return _quantize_vertices;
+}
+
+void CompileOptions::set_quantize_vertices(bool quantize)
+{
+	_quantize_vertices = quantize;
+}
+
+const char* CompileOptions::texture_format(bool normal_map) const
+{
+	return normal_map ? _normal_map_format : _texture_format;
+}
+
+void CompileOptions::set_texture_format(const char* format, const char* normal_map_format)
+{
+	_texture_format = format;
+	_normal_map_format = normal_map_format;
+}
+
 const Vector<DynamicString>& CompileOptions::dependencies() const
 {
 	return _dependencies;
@@ -174,12 +211,34 @@ void CompileOptions::add_dependency(const char* path)
 	TempAllocator256 ta;
 	DynamicString dep(ta);
 	dep += path;
+
+	ScopedMutex sm(_mutex);
 	vector::push_back(_dependencies, dep);
 }
 
+u32 CompileOptions::num_threads() const
+{
+	return _data_compiler._num_threads;
+}
+
+bool CompileOptions::run_guarded(void (*fn)(void* user_data), void* user_data)
+{
+	return _data_compiler.run_guarded(fn, user_data);
+}
+
 int CompileOptions::run_external_compiler(const char* const* argv, StringStream& output)
 {
 	return os::execute_process(argv, output);
 }
 
+bool CompileOptions::shader_cache_get(u64 key, Buffer& bytecode)
+{
+	return _data_compiler.shader_cache_get(key, bytecode);
+}
+
+void CompileOptions::shader_cache_set(u64 key, const Buffer& bytecode)
+{
+	_data_compiler.shader_cache_set(key, bytecode);
+}
+
 } // namespace crown
@@ -9,6 +9,7 @@
 #include "core/filesystem/types.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/types.h"
+#include "core/thread/mutex.h"
 #include "resource/types.h"
 #include <stdarg.h>
 
@@ -44,6 +45,11 @@ struct CompileOptions
 	Buffer& _output;
 	const char* _platform;
 	Vector<DynamicString> _dependencies;
+	ResourceCompression::Enum _compression;
+	bool _quantize_vertices;
+	const char* _texture_format;
+	const char* _normal_map_format;
+	Mutex _mutex;
 
 	///
 	CompileOptions(DataCompiler& dc, Filesystem& data_filesystem, DynamicString& source_path, Buffer& output, const char* platform);
@@ -103,14 +109,56 @@ struct CompileOptions
 	///
 	const char* platform() const;
 
+	/// Returns the compression applied to the output.
+	ResourceCompression::Enum compression() const;
+
+	/// Sets the @a compression applied to the output.
+	/// It defaults to the compression of the resource type on the target platform.
+	void set_compression(ResourceCompression::Enum compression);
+
+	/// Returns whether meshes are compiled with quantized vertices unless
+	/// they specify otherwise.
+	bool quantize_vertices() const;
+
+	/// Sets whether meshes are compiled with quantized vertices unless they
+	/// specify otherwise. It defaults to the setting of the target platform.
+	void set_quantize_vertices(bool quantize);
+
+	/// Returns the name of the format textures are compressed to when they
+	/// ask for the platform's format, or for normal maps if @a normal_map.
+	const char* texture_format(bool normal_map) const;
+
+	/// Sets the names of the formats textures and normal maps are compressed
+	/// to when they ask for the platform's format. They default to the
+	/// formats of the target platform.
+	void set_texture_format(const char* format, const char* normal_map_format);
+
 	///
 	const Vector<DynamicString>& dependencies() const;
 
-	///
+	/// Adds @a path to the dependencies of the resource.
+	/// It is safe to call it from multiple threads.
 	void add_dependency(const char* path);
 
+	/// Returns the number of threads the compiler may use to compile
+	/// parts of the resource in parallel.
+	u32 num_threads() const;
+
+	/// Calls @a fn with @a user_data, stopping it if it fails with error().
+	/// Returns false if @a fn failed, true otherwise. Compilers must run
+	/// any code which might fail on other threads through this function,
+	/// then report the failure with error() on the calling thread.
+	bool run_guarded(void (*fn)(void* user_data), void* user_data);
+
 	///
 	int run_external_compiler(const char* const* argv, StringStream& output);
+
+	/// Returns whether shader bytecode with the given @a key has already been
+	/// compiled during this build and, if so, copies it to @a bytecode.
+	bool shader_cache_get(u64 key, Buffer& bytecode);
+
+	/// Adds the shader @a bytecode with the given @a key to the cache of this build.
+	void shader_cache_set(u64 key, const Buffer& bytecode);
 };
 
 } // namespace crown
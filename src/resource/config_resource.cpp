@@ -37,6 +37,13 @@ namespace config_resource_internal
 		DATA_COMPILER_ASSERT_RESOURCE_EXISTS("lua", boot_script.c_str(), opts);
 		DATA_COMPILER_ASSERT_RESOURCE_EXISTS("package", boot_package.c_str(), opts);
 
+		if (json_object::has(boot, "render_graph"))
+		{
+			DynamicString render_graph(ta);
+			sjson::parse_string(boot["render_graph"], render_graph);
+			DATA_COMPILER_ASSERT_RESOURCE_EXISTS("render_graph", render_graph.c_str(), opts);
+		}
+
 		opts.write(buf);
 	}
 
@@ -4,22 +4,29 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/containers/map.h"
 #include "core/containers/vector.h"
 #include "core/filesystem/file.h"
 #include "core/filesystem/filesystem_disk.h"
 #include "core/filesystem/path.h"
+#include "core/json/json_document.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
+#include "core/murmur.h"
 #include "core/memory/allocator.h"
 #include "core/memory/temp_allocator.h"
 #include "core/os.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string_stream.h"
+#include "core/thread/condition_variable.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 #include "device/console_server.h"
 #include "device/device_options.h"
 #include "device/log.h"
+#include "resource/compile_cache.h"
 #include "resource/compile_options.h"
 #include "resource/config_resource.h"
 #include "resource/data_compiler.h"
@@ -28,15 +35,25 @@
 #include "resource/lua_resource.h"
 #include "resource/material_resource.h"
 #include "resource/mesh_resource.h"
+#include "resource/nav_grid_resource.h"
 #include "resource/package_resource.h"
+#include "resource/particle_resource.h"
 #include "resource/physics_resource.h"
+#include "resource/render_graph_resource.h"
+#include "resource/resource_bundle.h"
+#include "resource/resource_compression.h"
 #include "resource/shader_resource.h"
+#include "resource/skeleton_resource.h"
 #include "resource/sound_resource.h"
 #include "resource/sprite_resource.h"
 #include "resource/state_machine_resource.h"
 #include "resource/texture_resource.h"
+#include "resource/tilemap_resource.h"
 #include "resource/types.h"
 #include "resource/unit_resource.h"
+#include <inttypes.h> // PRIx64, SCNx64
+#include <setjmp.h>
+#include <string.h> // memset
 
 namespace { const crown::log_internal::System DATA_COMPILER = { "data_compiler" }; }
 
@@ -69,6 +86,92 @@ struct LineReader
 	}
 };
 
+struct PlatformCompression
+{
+	const char* platform;
+	StringId64 type;
+	ResourceCompression::Enum compression;
+};
+
+// Resource types compressed on each platform. Loading them is I/O bound.
+static const PlatformCompression s_compression[] =
+{
+	{ "android", RESOURCE_TYPE_LEVEL,            ResourceCompression::LZ4 },
+	{ "android", RESOURCE_TYPE_MESH,             ResourceCompression::LZ4 },
+	{ "android", RESOURCE_TYPE_SPRITE,           ResourceCompression::LZ4 },
+	{ "android", RESOURCE_TYPE_SPRITE_ANIMATION, ResourceCompression::LZ4 },
+	{ "android", RESOURCE_TYPE_UNIT,             ResourceCompression::LZ4 },
+	{ "linux",   RESOURCE_TYPE_LEVEL,            ResourceCompression::LZ4 },
+	{ "linux",   RESOURCE_TYPE_MESH,             ResourceCompression::LZ4 },
+	{ "linux",   RESOURCE_TYPE_SPRITE,           ResourceCompression::LZ4 },
+	{ "linux",   RESOURCE_TYPE_SPRITE_ANIMATION, ResourceCompression::LZ4 },
+	{ "linux",   RESOURCE_TYPE_UNIT,             ResourceCompression::LZ4 },
+	{ "windows", RESOURCE_TYPE_LEVEL,            ResourceCompression::LZ4 },
+	{ "windows", RESOURCE_TYPE_MESH,             ResourceCompression::LZ4 },
+	{ "windows", RESOURCE_TYPE_SPRITE,           ResourceCompression::LZ4 },
+	{ "windows", RESOURCE_TYPE_SPRITE_ANIMATION, ResourceCompression::LZ4 },
+	{ "windows", RESOURCE_TYPE_UNIT,             ResourceCompression::LZ4 },
+};
+
+static ResourceCompression::Enum platform_compression(const char* platform, StringId64 type)
+{
+	for (u32 i = 0; i < countof(s_compression); ++i)
+	{
+		if (s_compression[i].type == type && strcmp(s_compression[i].platform, platform) == 0)
+			return s_compression[i].compression;
+	}
+
+	return ResourceCompression::NONE;
+}
+
+// Platforms whose meshes are compiled with quantized vertices by default.
+// Vertex memory and bandwidth are scarce there.
+static const char* s_quantize_vertices[] =
+{
+	"android"
+};
+
+static bool platform_quantize_vertices(const char* platform)
+{
+	for (u32 i = 0; i < countof(s_quantize_vertices); ++i)
+	{
+		if (strcmp(s_quantize_vertices[i], platform) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+struct PlatformTextureFormat
+{
+	const char* platform;
+	const char* format;
+	const char* normal_map_format;
+};
+
+// Formats textures are compressed to when they ask for the platform's
+// format. Every GLES 3 device samples ETC2, ASTC must be asked for.
+static const PlatformTextureFormat s_texture_formats[] =
+{
+	{ "android", "ETC2", "ETC2" },
+	{ "linux",   "BC7",  "BC5"  },
+	{ "windows", "BC7",  "BC5"  },
+};
+
+static const PlatformTextureFormat& platform_texture_format(const char* platform)
+{
+	for (u32 i = 0; i < countof(s_texture_formats); ++i)
+	{
+		if (strcmp(s_texture_formats[i].platform, platform) == 0)
+			return s_texture_formats[i];
+	}
+
+	return s_texture_formats[0];
+}
+
+// Where to jump when a resource compiler running on this thread fails.
+static CE_THREAD jmp_buf* s_jmpbuf = NULL;
+
 static void console_command_compile(ConsoleServer& cs, TCPSocket client, const char* json, void* user_data)
 {
 	TempAllocator4096 ta;
@@ -89,7 +192,8 @@ static void console_command_compile(ConsoleServer& cs, TCPSocket client, const c
 		cs.send(client, string_stream::c_str(ss));
 	}
 
-	bool succ = ((DataCompiler*)user_data)->compile(data_dir.c_str(), platform.c_str());
+	DataCompiler* dc = (DataCompiler*)user_data;
+	bool succ = dc->compile(data_dir.c_str(), platform.c_str());
 
 	{
 		TempAllocator512 ta;
@@ -97,9 +201,47 @@ static void console_command_compile(ConsoleServer& cs, TCPSocket client, const c
 		ss << "{\"type\":\"compile\",\"id\":\"" << id.c_str() << "\",\"success\":" << (succ ? "true" : "false") << "}";
 		cs.send(client, string_stream::c_str(ss));
 	}
+
+	{
+		StringStream ss(default_allocator());
+		ss << "{\"type\":\"compile_report\",\"id\":\"" << id.c_str() << "\",\"report\":";
+		dc->compile_report(ss);
+		ss << "}";
+		cs.send(client, string_stream::c_str(ss));
+	}
+}
+
+// Returns the id written as a hexadecimal string in @a json.
+static StringId64 parse_id(const char* json)
+{
+	TempAllocator64 ta;
+	DynamicString str(ta);
+	sjson::parse_string(json, str);
+
+	u64 id = 0;
+	sscanf(str.c_str(), "%" SCNx64, &id);
+	return StringId64(id);
+}
+
+static void console_command_missing_resources(ConsoleServer& /*cs*/, TCPSocket /*client*/, const char* json, void* user_data)
+{
+	TempAllocator4096 ta;
+	JsonObject obj(ta);
+	JsonArray resources(ta);
+
+	sjson::parse(json, obj);
+	sjson::parse_array(obj["resources"], resources);
+
+	DataCompiler* dc = (DataCompiler*)user_data;
+	for (u32 i = 0; i < array::size(resources); ++i)
+	{
+		JsonObject resource(ta);
+		sjson::parse_object(resources[i], resource);
+		dc->request(parse_id(resource["type"]), parse_id(resource["name"]));
+	}
 }
 
-DataCompiler::DataCompiler(ConsoleServer& cs)
+DataCompiler::DataCompiler(ConsoleServer& cs, u32 num_threads)
 	: _console_server(&cs)
 	, _source_fs(default_allocator())
 	, _source_dirs(default_allocator())
@@ -107,14 +249,32 @@ DataCompiler::DataCompiler(ConsoleServer& cs)
 	, _files(default_allocator())
 	, _globs(default_allocator())
 	, _data_index(default_allocator())
+	, _compile_db(default_allocator())
+	, _file_hashes(default_allocator())
+	, _shader_cache(default_allocator())
+	, _num_shaders_compiled(0)
+	, _num_shaders_reused(0)
 	, _file_monitor(default_allocator())
+	, _num_threads(num_threads)
+	, _compile_cache(NULL)
+	, _compile_stats(default_allocator())
+	, _compile_time(0.0)
+	, _file_events(default_allocator())
+	, _file_events_first(0)
+	, _file_events_last(0)
+	, _data_dir(default_allocator())
+	, _platform(default_allocator())
+	, _requests(default_allocator())
 {
+	CE_ASSERT(num_threads > 0 && num_threads <= CROWN_MAX_COMPILER_THREADS, "Invalid number of threads");
 	cs.register_command("compile", console_command_compile, this);
+	cs.register_command("missing_resources", console_command_missing_resources, this);
 }
 
 DataCompiler::~DataCompiler()
 {
 	_file_monitor.stop();
+	CE_DELETE(default_allocator(), _compile_cache);
 }
 
 void DataCompiler::add_file(const char* path)
@@ -192,39 +352,245 @@ void DataCompiler::remove_tree(const char* path)
 	}
 }
 
-void DataCompiler::scan_source_dir(const char* prefix, const char* cur_dir)
+struct ScanJobs
+{
+	const Vector<DynamicString>* globs;
+	const char* root;
+	const char* prefix;
+	const JsonDocument* snapshot;
+	HashMap<StringId64, const JsonNode*> snapshot_dirs;
+	u64 snapshot_mtime;
+	Mutex mutex;
+	ConditionVariable queue_changed;
+	Vector<DynamicString> queue;
+	u32 num_busy;
+	Vector<DynamicString> files;
+	StringStream updated_snapshot;
+	u32 num_listed;
+	u32 num_reused;
+
+	ScanJobs()
+		: snapshot_dirs(default_allocator())
+		, queue(default_allocator())
+		, files(default_allocator())
+		, updated_snapshot(default_allocator())
+	{
+	}
+};
+
+// Returns whether the snapshot can safely store @a str.
+static bool can_snapshot(const char* str)
+{
+	return strchr(str, '"') == NULL && strchr(str, '\\') == NULL;
+}
+
+// Returns whether all the files in the directory @a resource_name are ignored.
+static bool ignored_tree(const Vector<DynamicString>& globs, const char* resource_name)
+{
+	TempAllocator512 ta;
+	DynamicString dir(ta);
+	dir  = resource_name;
+	dir += '/';
+
+	for (u32 i = 0; i < vector::size(globs); ++i)
+	{
+		const DynamicString& glob = globs[i];
+		if (glob.length() > 0 && glob.c_str()[glob.length() - 1] == '*' && wildcmp(glob.c_str(), dir.c_str()))
+			return true;
+	}
+
+	return false;
+}
+
+// Lists the directory @a dir. Entries which are directories end with '/'.
+static void scan_dir(ScanJobs& sj, const char* dir)
 {
-	Vector<DynamicString> my_files(default_allocator());
-	_source_fs.list_files(cur_dir, my_files);
+	TempAllocator1024 ta;
+	DynamicString abs_dir(ta);
+	if (strcmp(dir, "") != 0)
+		path::join(abs_dir, sj.root, dir);
+	else
+		abs_dir = sj.root;
 
-	for (u32 i = 0; i < vector::size(my_files); ++i)
+	Stat st;
+	os::stat(st, abs_dir.c_str());
+
+	// Reuse the entries of the snapshot if the directory did not change since.
+	// Directories modified in the same second the snapshot was written are
+	// listed again because mtime could not tell the difference.
+	const JsonNode* deffault = NULL;
+	const JsonNode* node = hash_map::get(sj.snapshot_dirs, StringId64(dir), deffault);
+	bool reused = false;
+
+	Vector<DynamicString> entries(default_allocator());
+	if (node != NULL && st.mtime < sj.snapshot_mtime)
 	{
-		TempAllocator512 ta;
-		DynamicString file_i(ta);
+		DynamicString mtime(ta);
+		sjson::parse_string(*sj.snapshot, json_document::get(*sj.snapshot, node, "mtime"), mtime);
+		u64 snapshot_mtime = 0;
+		sscanf(mtime.c_str(), "%" SCNx64, &snapshot_mtime);
+
+		if (snapshot_mtime == st.mtime)
+		{
+			const JsonNode* items = json_document::get(*sj.snapshot, node, "entries");
+			for (const JsonNode* n = json_document::first(*sj.snapshot, items); n != NULL; n = json_document::next(*sj.snapshot, n))
+			{
+				DynamicString name(ta);
+				sjson::parse_string(*sj.snapshot, n, name);
+				vector::push_back(entries, name);
+			}
+			reused = true;
+		}
+	}
+
+	if (!reused)
+	{
+		os::list_files(abs_dir.c_str(), entries);
+		for (u32 i = 0; i < vector::size(entries); ++i)
+		{
+			DynamicString abs_path(ta);
+			path::join(abs_path, abs_dir.c_str(), entries[i].c_str());
+
+			Stat est;
+			os::stat(est, abs_path.c_str());
+			if (est.file_type == Stat::DIRECTORY)
+				entries[i] += '/';
+		}
+	}
 
-		if (strcmp(cur_dir, "") != 0)
+	Vector<DynamicString> subdirs(default_allocator());
+	Vector<DynamicString> files(default_allocator());
+	bool snapshot = can_snapshot(dir);
+
+	for (u32 i = 0; i < vector::size(entries); ++i)
+	{
+		const DynamicString& entry = entries[i];
+		const bool is_dir = entry.has_suffix("/");
+		snapshot = snapshot && can_snapshot(entry.c_str());
+
+		DynamicString name(ta);
+		name.set(entry.c_str(), is_dir ? entry.length() - 1 : entry.length());
+
+		DynamicString file_i(ta);
+		if (strcmp(dir, "") != 0)
 		{
-			file_i += cur_dir;
+			file_i += dir;
 			file_i += '/';
 		}
-		file_i += my_files[i];
+		file_i += name;
 
-		if (_source_fs.is_directory(file_i.c_str()))
+		DynamicString resource_name(ta);
+		if (strcmp(sj.prefix, "") != 0)
 		{
-			DataCompiler::scan_source_dir(prefix, file_i.c_str());
+			resource_name += sj.prefix;
+			resource_name += '/';
 		}
-		else // Assume a regular file
+		resource_name += file_i;
+
+		if (!is_dir)
+			vector::push_back(files, resource_name);
+		else if (!ignored_tree(*sj.globs, resource_name.c_str()))
+			vector::push_back(subdirs, file_i);
+	}
+
+	ScopedMutex sm(sj.mutex);
+	for (u32 i = 0; i < vector::size(subdirs); ++i)
+		vector::push_back(sj.queue, subdirs[i]);
+	for (u32 i = 0; i < vector::size(files); ++i)
+		vector::push_back(sj.files, files[i]);
+
+	if (snapshot)
+	{
+		char mtime[32];
+		snprintf(mtime, sizeof(mtime), "%.16" PRIx64, st.mtime);
+
+		StringStream& ss = sj.updated_snapshot;
+		ss << "\t\"" << dir << "\" = { mtime = \"" << mtime << "\" entries = [";
+		for (u32 i = 0; i < vector::size(entries); ++i)
+			ss << " \"" << entries[i].c_str() << "\"";
+		ss << " ] }\n";
+	}
+
+	if (reused)
+		++sj.num_reused;
+	else
+		++sj.num_listed;
+
+	if (vector::size(subdirs) > 0)
+		sj.queue_changed.broadcast();
+}
+
+static s32 scan_thread(void* user_data)
+{
+	ScanJobs& sj = *(ScanJobs*)user_data;
+
+	while (true)
+	{
+		TempAllocator512 ta;
+		DynamicString dir(ta);
 		{
-			DynamicString resource_name(ta);
-			if (strcmp(prefix, "") != 0)
-			{
-				resource_name += prefix;
-				resource_name += '/';
-			}
-			resource_name += file_i;
-			add_file(resource_name.c_str());
+			ScopedMutex sm(sj.mutex);
+			while (vector::empty(sj.queue) && sj.num_busy > 0)
+				sj.queue_changed.wait(sj.mutex);
+
+			if (vector::empty(sj.queue))
+				break;
+
+			dir = vector::back(sj.queue);
+			vector::pop_back(sj.queue);
+			++sj.num_busy;
 		}
+
+		scan_dir(sj, dir.c_str());
+
+		ScopedMutex sm(sj.mutex);
+		--sj.num_busy;
+		if (sj.num_busy == 0 && vector::empty(sj.queue))
+			sj.queue_changed.broadcast();
 	}
+
+	return 0;
+}
+
+// Scans the directories in the queue of @a sj using the compiler threads.
+static void run_scan_jobs(ScanJobs& sj, u32 num_threads)
+{
+	// The calling thread takes part in the scan too
+	Thread threads[CROWN_MAX_COMPILER_THREADS];
+	for (u32 i = 1; i < num_threads; ++i)
+		threads[i].start(scan_thread, &sj);
+
+	scan_thread(&sj);
+
+	for (u32 i = 1; i < num_threads; ++i)
+		threads[i].stop();
+
+	std::sort(vector::begin(sj.files), vector::end(sj.files));
+}
+
+void DataCompiler::scan_source_dir(const char* prefix, const char* cur_dir)
+{
+	TempAllocator1024 ta;
+	DynamicString root(ta);
+	_source_fs.get_absolute_path("", root);
+
+	ScanJobs sj;
+	sj.globs = &_globs;
+	sj.root = root.c_str();
+	sj.prefix = prefix;
+	sj.snapshot = NULL;
+	sj.snapshot_mtime = 0;
+	sj.num_busy = 0;
+	sj.num_listed = 0;
+	sj.num_reused = 0;
+
+	DynamicString dir(ta);
+	dir = cur_dir;
+	vector::push_back(sj.queue, dir);
+	run_scan_jobs(sj, _num_threads);
+
+	for (u32 i = 0; i < vector::size(sj.files); ++i)
+		add_file(sj.files[i].c_str());
 }
 
 void DataCompiler::map_source_dir(const char* name, const char* source_dir)
@@ -257,6 +623,12 @@ void DataCompiler::source_dir(const char* resource_name, DynamicString& source_d
 	source_dir = map::get(_source_dirs, source_name, deffault);
 }
 
+void DataCompiler::set_compile_cache(const char* dir)
+{
+	CE_DELETE(default_allocator(), _compile_cache);
+	_compile_cache = CE_NEW(default_allocator(), CompileCache)(default_allocator(), dir);
+}
+
 void DataCompiler::add_ignore_glob(const char* glob)
 {
 	TempAllocator64 ta;
@@ -265,10 +637,30 @@ void DataCompiler::add_ignore_glob(const char* glob)
 	vector::push_back(_globs, str);
 }
 
-void DataCompiler::scan()
+void DataCompiler::scan(const char* data_dir)
 {
 	const s64 time_start = os::clocktime();
 
+	FilesystemDisk data_filesystem(default_allocator());
+	data_filesystem.set_prefix(data_dir);
+
+	// Load the snapshot of the source tree taken by the last scan
+	Buffer snapshot_data(default_allocator());
+	JsonDocument snapshot(default_allocator());
+	u64 snapshot_mtime = 0;
+	if (data_filesystem.exists(CROWN_SOURCE_SNAPSHOT))
+	{
+		File* file = data_filesystem.open(CROWN_SOURCE_SNAPSHOT, FileOpenMode::READ);
+		const u32 size = file->size();
+		array::resize(snapshot_data, size);
+		file->read(array::begin(snapshot_data), size);
+		data_filesystem.close(*file);
+		sjson::parse(snapshot_data, snapshot);
+		snapshot_mtime = data_filesystem.last_modified_time(CROWN_SOURCE_SNAPSHOT);
+	}
+
+	StringStream updated_snapshot(default_allocator());
+
 	// Scan all source directories
 	auto cur = map::begin(_source_dirs);
 	auto end = map::end(_source_dirs);
@@ -307,150 +699,905 @@ void DataCompiler::scan()
 			default_allocator().deallocate(data);
 		}
 
-		scan_source_dir(cur->pair.first.c_str(), "");
+		TempAllocator1024 ta;
+		DynamicString root(ta);
+		_source_fs.get_absolute_path("", root);
+
+		char root_hash[32];
+		snprintf(root_hash, sizeof(root_hash), "%.16" PRIx64, murmur64(root.c_str(), root.length(), 0));
+
+		ScanJobs sj;
+		sj.globs = &_globs;
+		sj.root = root.c_str();
+		sj.prefix = cur->pair.first.c_str();
+		sj.snapshot = &snapshot;
+		sj.snapshot_mtime = snapshot_mtime;
+		sj.num_busy = 0;
+		sj.num_listed = 0;
+		sj.num_reused = 0;
+
+		// The snapshot is only valid if it has been taken from the same directory
+		const JsonNode* source = array::size(snapshot._nodes) > 0 ? snapshot[cur->pair.first.c_str()] : NULL;
+		if (source != NULL && json_document::has(snapshot, source, "root"))
+		{
+			DynamicString source_root(ta);
+			sjson::parse_string(snapshot, json_document::get(snapshot, source, "root"), source_root);
+
+			const JsonNode* dirs = json_document::get(snapshot, source, "dirs");
+			if (source_root == root_hash && dirs != NULL)
+			{
+				for (const JsonNode* n = json_document::first(snapshot, dirs); n != NULL; n = json_document::next(snapshot, n))
+				{
+					const FixedString key = json_document::key(snapshot, n);
+					hash_map::set(sj.snapshot_dirs, StringId64(key.data(), key.length()), n);
+				}
+			}
+		}
+
+		DynamicString dir(ta);
+		vector::push_back(sj.queue, dir);
+		run_scan_jobs(sj, _num_threads);
+
+		for (u32 i = 0; i < vector::size(sj.files); ++i)
+			add_file(sj.files[i].c_str());
+
+		updated_snapshot << "\"" << cur->pair.first.c_str() << "\" = {\n";
+		updated_snapshot << "root = \"" << root_hash << "\"\n";
+		updated_snapshot << "dirs = {\n" << string_stream::c_str(sj.updated_snapshot) << "}\n";
+		updated_snapshot << "}\n";
+
+		logi(DATA_COMPILER, "Scanned %u directories in '%s' (%u unchanged)"
+			, sj.num_listed + sj.num_reused
+			, root.c_str()
+			, sj.num_reused
+			);
 	}
 
+	// Save the snapshot for the next scan
+	data_filesystem.create_directory("");
+	if (!data_filesystem.exists(CROWN_TEMP_DIRECTORY))
+		data_filesystem.create_directory(CROWN_TEMP_DIRECTORY);
+
+	File* file = data_filesystem.open(CROWN_SOURCE_SNAPSHOT, FileOpenMode::WRITE);
+	if (file->is_open())
+		file->write(string_stream::c_str(updated_snapshot), strlen32(string_stream::c_str(updated_snapshot)));
+	data_filesystem.close(*file);
+
 	logi(DATA_COMPILER, "Scanned data in %.2fs", f64(os::clocktime() - time_start)/f64(os::clockfrequency()));
 	_file_monitor.start(map::begin(_source_dirs)->pair.second.c_str(), true, filemonitor_callback, this);
 }
 
-bool DataCompiler::compile(const char* data_dir, const char* platform)
+bool DataCompiler::file_hash(const char* path, u64 mtime, u64 hash, FileHash& fh)
 {
-	const s64 time_start = os::clocktime();
-
-	FilesystemDisk data_filesystem(default_allocator());
-	data_filesystem.set_prefix(data_dir);
-	data_filesystem.create_directory("");
+	const StringId64 id(path);
+	{
+		ScopedMutex sm(_mutex);
+		if (hash_map::has(_file_hashes, id))
+		{
+			FileHash deffh = { 0u, 0u };
+			fh = hash_map::get(_file_hashes, id, deffh);
+			return true;
+		}
+	}
 
-	if (!data_filesystem.exists(CROWN_DATA_DIRECTORY))
-		data_filesystem.create_directory(CROWN_DATA_DIRECTORY);
+	TempAllocator256 ta;
+	DynamicString dir(ta);
+	source_dir(path, dir);
 
-	if (!data_filesystem.exists(CROWN_TEMP_DIRECTORY))
-		data_filesystem.create_directory(CROWN_TEMP_DIRECTORY);
+	FilesystemDisk source_filesystem(ta);
+	source_filesystem.set_prefix(dir.c_str());
 
-	std::sort(vector::begin(_files), vector::end(_files));
+	if (!source_filesystem.exists(path))
+		return false;
 
-	bool success = false;
+	fh.mtime = source_filesystem.last_modified_time(path);
+	fh.hash  = hash;
 
-	// Compile all changed resources
-	for (u32 i = 0; i < vector::size(_files); ++i)
+	// Read the content only when the file has been touched
+	if (fh.mtime != mtime)
 	{
-		const char* filename = _files[i].c_str();
-		const char* type = path::extension(filename);
+		File* file = source_filesystem.open(path, FileOpenMode::READ);
+		const u32 size = file->size();
+		Buffer buf(default_allocator());
+		array::resize(buf, size);
+		file->read(array::begin(buf), size);
+		source_filesystem.close(*file);
+		fh.hash = murmur64(array::begin(buf), size, 0);
+	}
 
-		if (type == NULL)
-			continue;
+	ScopedMutex sm(_mutex);
+	hash_map::set(_file_hashes, id, fh);
+	return true;
+}
 
-		char name[256];
-		const u32 size = u32(type - filename - 1);
-		strncpy(name, filename, size);
-		name[size] = '\0';
+bool DataCompiler::up_to_date(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path, const char* record)
+{
+	if (record == NULL)
+		return false;
 
-		TempAllocator1024 ta;
-		DynamicString path(ta);
-		DynamicString src_path(ta);
-		DynamicString dst_path(ta);
+	TempAllocator1024 ta;
+	JsonObject obj(ta);
+	JsonObject deps(ta);
+	DynamicString record_platform(ta);
+	DynamicString path(ta);
+	sjson::parse_object(record, obj);
+	sjson::parse_string(obj["platform"], record_platform);
+	sjson::parse_object(obj["dependencies"], deps);
+
+	const StringId64 type(path::extension(src_path));
+	if (u32(sjson::parse_int(obj["version"])) != version(type) || !(record_platform == platform))
+		return false;
+
+	path::join(path, CROWN_DATA_DIRECTORY, dst_path);
+	if (!data_filesystem.exists(path.c_str()))
+		return false;
+
+	// Check that no dependency changed
+	auto cur = json_object::begin(deps);
+	auto end = json_object::end(deps);
+	for (; cur != end; ++cur)
+	{
+		JsonObject dep(ta);
+		DynamicString dep_path(ta);
+		DynamicString dep_mtime(ta);
+		DynamicString dep_hash(ta);
+		dep_path.set(cur->pair.first.data(), cur->pair.first.length());
+		sjson::parse_object(cur->pair.second, dep);
+		sjson::parse_string(dep["mtime"], dep_mtime);
+		sjson::parse_string(dep["hash"], dep_hash);
+
+		u64 mtime = 0;
+		u64 hash = 0;
+		sscanf(dep_mtime.c_str(), "%" SCNx64, &mtime);
+		sscanf(dep_hash.c_str(), "%" SCNx64, &hash);
+
+		FileHash fh;
+		if (!file_hash(dep_path.c_str(), mtime, hash, fh) || fh.hash != hash)
+			return false;
+	}
 
-		StringId64 _type(type);
-		StringId64 _name(name);
+	return json_object::size(deps) > 0;
+}
 
-		// Build source file path
-		src_path += name;
-		src_path += '.';
-		src_path += type;
+void DataCompiler::add_record(const char* platform, const char* src_path, const Vector<DynamicString>& dependencies)
+{
+	const StringId64 type(path::extension(src_path));
 
-		// Build destination file path
-		StringId64 mix;
-		mix._id = _type._id ^ _name._id;
-		mix.to_string(dst_path);
+	StringStream ss(default_allocator());
+	ss << "{\n";
+	ss << "\tversion = " << version(type) << "\n";
+	ss << "\tplatform = \"" << platform << "\"\n";
+	ss << "\tdependencies = {\n";
 
-		path::join(path, CROWN_DATA_DIRECTORY, dst_path.c_str());
+	for (u32 i = 0; i < vector::size(dependencies); ++i)
+	{
+		const char* dep = dependencies[i].c_str();
 
-		logi(DATA_COMPILER, "%s", src_path.c_str());
+		// Skip duplicates
+		u32 j = 0;
+		for (; j < i && !(dependencies[j] == dep); ++j) ;
+		if (j != i)
+			continue;
 
-		if (!can_compile(_type))
-		{
-			loge(DATA_COMPILER, "Unknown resource type: '%s'", type);
-			loge(DATA_COMPILER, "Append extension to " CROWN_DATAIGNORE " to ignore the type");
-			success = false;
-			break;
-		}
+		FileHash fh;
+		if (!file_hash(dep, 0u, 0u, fh))
+			continue;
 
-		Buffer output(default_allocator());
-		array::reserve(output, 4*1024*1024);
+		char buf[64];
+		snprintf(buf, sizeof(buf), "{ mtime = \"%.16" PRIx64 "\" hash = \"%.16" PRIx64 "\" }", fh.mtime, fh.hash);
+		ss << "\t\t\"" << dep << "\" = " << buf << "\n";
+	}
 
-		if (!setjmp(_jmpbuf))
-		{
-			CompileOptions opts(*this, data_filesystem, src_path, output, platform);
+	ss << "\t}\n";
+	ss << "}";
 
-			hash_map::get(_compilers, _type, ResourceTypeData()).compiler(opts);
+	TempAllocator512 ta;
+	DynamicString key(ta);
+	DynamicString value(ta);
+	key = src_path;
+	value = string_stream::c_str(ss);
 
-			File* outf = data_filesystem.open(path.c_str(), FileOpenMode::WRITE);
-			u32 size = array::size(output);
-			u32 written = outf->write(array::begin(output), size);
-			data_filesystem.close(*outf);
+	ScopedMutex sm(_mutex);
+	map::set(_compile_db, key, value);
+}
 
-			success = size == written;
-		}
-		else
-		{
-			success = false;
-		}
+bool DataCompiler::cache_key(const char* platform, const char* src_path, u64& key)
+{
+	FileHash fh;
+	if (!file_hash(src_path, 0u, 0u, fh))
+		return false;
+
+	const u32 ver = version(StringId64(path::extension(src_path)));
+	key = murmur64(src_path, strlen32(src_path), fh.hash);
+	key = murmur64(platform, strlen32(platform), key);
+	key = murmur64(&ver, sizeof(ver), key);
+	return true;
+}
 
-		if (success)
-		{
-			if (!map::has(_data_index, dst_path))
-				map::set(_data_index, dst_path, src_path);
-		}
-		else
-		{
-			loge(DATA_COMPILER, "Failed to compile data");
-			break;
-		}
+bool DataCompiler::cache_inputs_key(u64 key, const Vector<DynamicString>& dependencies, u64& inputs_key)
+{
+	inputs_key = key;
+	for (u32 i = 0; i < vector::size(dependencies); ++i)
+	{
+		FileHash fh;
+		if (!file_hash(dependencies[i].c_str(), 0u, 0u, fh))
+			return false;
+
+		inputs_key = murmur64(dependencies[i].c_str(), dependencies[i].length(), inputs_key);
+		inputs_key = murmur64(&fh.hash, sizeof(fh.hash), inputs_key);
 	}
 
-	// Write data index
+	return true;
+}
+
+bool DataCompiler::cache_fetch(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path)
+{
+	const char* type = path::extension(src_path);
+
+	// The dependencies are known only after the resource has been compiled
+	// once, so they are looked up by the hash of the source file first.
+	u64 key;
+	Buffer deps_data(default_allocator());
+	if (!cache_key(platform, src_path, key) || !_compile_cache->read(key, ".dependencies", deps_data))
 	{
-		File* file = data_filesystem.open("data_index.sjson", FileOpenMode::WRITE);
-		if (file)
-		{
-			StringStream ss(default_allocator());
+		_compile_cache->add_miss(type);
+		return false;
+	}
 
-			auto cur = map::begin(_data_index);
-			auto end = map::end(_data_index);
-			for (; cur != end; ++cur)
-			{
-				ss << "\"" << cur->pair.first.c_str() << "\" = \"" << cur->pair.second.c_str() << "\"\n";
-			}
+	TempAllocator1024 ta;
+	JsonArray arr(ta);
+	Vector<DynamicString> dependencies(default_allocator());
+	array::push_back(deps_data, '\0');
+	sjson::parse_array(array::begin(deps_data), arr);
+	for (u32 i = 0; i < array::size(arr); ++i)
+	{
+		DynamicString dep(ta);
+		sjson::parse_string(arr[i], dep);
+		vector::push_back(dependencies, dep);
+	}
 
-			file->write(string_stream::c_str(ss), strlen32(string_stream::c_str(ss)));
-			data_filesystem.close(*file);
-		}
+	u64 inputs_key;
+	Buffer output(default_allocator());
+	if (!cache_inputs_key(key, dependencies, inputs_key) || !_compile_cache->read(inputs_key, "", output))
+	{
+		_compile_cache->add_miss(type);
+		return false;
 	}
 
-	if (success)
-		logi(DATA_COMPILER, "Compiled data in %.2fs", f64(os::clocktime() - time_start)/f64(os::clockfrequency()));
+	File* outf = data_filesystem.open(dst_path, FileOpenMode::WRITE);
+	const u32 size = array::size(output);
+	const u32 written = outf->write(array::begin(output), size);
+	data_filesystem.close(*outf);
 
-	return success;
+	if (size != written)
+		return false;
+
+	add_record(platform, src_path, dependencies);
+	_compile_cache->add_hit(type);
+	return true;
 }
 
-void DataCompiler::register_compiler(StringId64 type, u32 version, CompileFunction compiler)
+void DataCompiler::cache_store(const char* platform, const char* src_path, const Vector<DynamicString>& dependencies, const Buffer& output)
 {
-	CE_ASSERT(!hash_map::has(_compilers, type), "Type already registered");
-	CE_ENSURE(NULL != compiler);
+	Vector<DynamicString> deps(default_allocator());
+	StringStream ss(default_allocator());
+	ss << "[\n";
+	for (u32 i = 0; i < vector::size(dependencies); ++i)
+	{
+		// Skip duplicates
+		u32 j = 0;
+		for (; j < i && !(dependencies[j] == dependencies[i].c_str()); ++j) ;
+		if (j != i)
+			continue;
 
-	ResourceTypeData rtd;
-	rtd.version = version;
-	rtd.compiler = compiler;
+		vector::push_back(deps, dependencies[i]);
+		ss << "\t\"" << dependencies[i].c_str() << "\"\n";
+	}
+	ss << "]\n";
 
-	hash_map::set(_compilers, type, rtd);
+	u64 key;
+	u64 inputs_key;
+	if (!cache_key(platform, src_path, key) || !cache_inputs_key(key, deps, inputs_key))
+		return;
+
+	const char* deps_data = string_stream::c_str(ss);
+	_compile_cache->write(inputs_key, "", array::begin(output), array::size(output));
+	_compile_cache->write(key, ".dependencies", deps_data, strlen32(deps_data));
 }
 
-u32 DataCompiler::version(StringId64 type)
+bool DataCompiler::compile(FilesystemDisk& data_filesystem, const char* platform, const char* filename, const char* record, bool& compiled)
 {
-	ResourceTypeData rtd;
-	rtd.version = COMPILER_NOT_FOUND;
-	rtd.compiler = NULL;
+	const char* type = path::extension(filename);
+
+	char name[256];
+	const u32 size = u32(type - filename - 1);
+	strncpy(name, filename, size);
+	name[size] = '\0';
+
+	TempAllocator1024 ta;
+	DynamicString path(ta);
+	DynamicString src_path(ta);
+	DynamicString dst_path(ta);
+
+	StringId64 _type(type);
+	StringId64 _name(name);
+
+	// Build source file path
+	src_path += name;
+	src_path += '.';
+	src_path += type;
+
+	// Build destination file path
+	StringId64 mix;
+	mix._id = _type._id ^ _name._id;
+	mix.to_string(dst_path);
+
+	path::join(path, CROWN_DATA_DIRECTORY, dst_path.c_str());
+
+	const s64 time_begin = os::clocktime();
+	CompileStatus::Enum status = CompileStatus::FAILED;
+	compiled = false;
+	bool success = false;
+
+	if (up_to_date(data_filesystem, platform, src_path.c_str(), dst_path.c_str(), record))
+	{
+		// Refresh the record with the current modification times
+		TempAllocator1024 ta;
+		JsonObject obj(ta);
+		JsonObject deps(ta);
+		Vector<DynamicString> dependencies(default_allocator());
+		sjson::parse_object(record, obj);
+		sjson::parse_object(obj["dependencies"], deps);
+
+		auto cur = json_object::begin(deps);
+		auto end = json_object::end(deps);
+		for (; cur != end; ++cur)
+		{
+			DynamicString dep(ta);
+			dep.set(cur->pair.first.data(), cur->pair.first.length());
+			vector::push_back(dependencies, dep);
+		}
+
+		add_record(platform, src_path.c_str(), dependencies);
+		status = CompileStatus::UP_TO_DATE;
+		success = true;
+	}
+	else if (_compile_cache != NULL && cache_fetch(data_filesystem, platform, src_path.c_str(), path.c_str()))
+	{
+		logi(DATA_COMPILER, "%s (cached)", src_path.c_str());
+		status = CompileStatus::CACHED;
+		compiled = true;
+		success = true;
+	}
+	else
+	{
+		logi(DATA_COMPILER, "%s", src_path.c_str());
+		compiled = true;
+		success = compile(data_filesystem, platform, src_path.c_str(), path.c_str());
+		status = success ? CompileStatus::COMPILED : CompileStatus::FAILED;
+	}
+
+	add_stats(data_filesystem, src_path.c_str(), path.c_str(), status, os::clocktime() - time_begin);
+
+	if (success)
+	{
+		ScopedMutex sm(_mutex);
+		if (!map::has(_data_index, dst_path))
+			map::set(_data_index, dst_path, src_path);
+	}
+
+	return success;
+}
+
+bool DataCompiler::compile(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path)
+{
+	const StringId64 _type(path::extension(src_path));
+	TempAllocator512 ta;
+	DynamicString src(ta);
+	src = src_path;
+
+	Buffer output(default_allocator());
+	array::reserve(output, 4*1024*1024);
+
+	bool success = false;
+	jmp_buf jb;
+	s_jmpbuf = &jb;
+
+	if (!setjmp(jb))
+	{
+		CompileOptions opts(*this, data_filesystem, src, output, platform);
+		opts.set_compression(platform_compression(platform, _type));
+		opts.set_quantize_vertices(platform_quantize_vertices(platform));
+		const PlatformTextureFormat& ptf = platform_texture_format(platform);
+		opts.set_texture_format(ptf.format, ptf.normal_map_format);
+
+		hash_map::get(_compilers, _type, ResourceTypeData()).compiler(opts);
+
+		if (opts.compression() != ResourceCompression::NONE)
+		{
+			Buffer compressed(default_allocator());
+			resource_compression::compress(opts.compression(), output, compressed);
+			output = compressed;
+		}
+
+		File* outf = data_filesystem.open(dst_path, FileOpenMode::WRITE);
+		u32 size = array::size(output);
+		u32 written = outf->write(array::begin(output), size);
+		data_filesystem.close(*outf);
+
+		success = size == written;
+		if (success)
+		{
+			add_record(platform, src_path, opts.dependencies());
+
+			if (_compile_cache != NULL)
+				cache_store(platform, src_path, opts.dependencies(), output);
+		}
+	}
+
+	s_jmpbuf = NULL;
+	return success;
+}
+
+static u64 file_size(FilesystemDisk& fs, const char* path)
+{
+	TempAllocator1024 ta;
+	DynamicString abs_path(ta);
+	fs.get_absolute_path(path, abs_path);
+
+	Stat st;
+	os::stat(st, abs_path.c_str());
+	return st.file_type == Stat::REGULAR ? st.size : 0;
+}
+
+void DataCompiler::add_stats(FilesystemDisk& data_filesystem, const char* src_path, const char* dst_path, CompileStatus::Enum status, s64 time)
+{
+	TempAllocator256 ta;
+	DynamicString dir(ta);
+	source_dir(src_path, dir);
+
+	FilesystemDisk source_filesystem(ta);
+	source_filesystem.set_prefix(dir.c_str());
+
+	CompileStats cs(default_allocator());
+	cs.name        = src_path;
+	cs.status      = status;
+	cs.time        = time;
+	cs.input_size  = file_size(source_filesystem, src_path);
+	cs.output_size = status != CompileStatus::FAILED ? file_size(data_filesystem, dst_path) : 0;
+
+	ScopedMutex sm(_mutex);
+	vector::push_back(_compile_stats, cs);
+}
+
+struct CompileJobs
+{
+	DataCompiler* data_compiler;
+	FilesystemDisk* data_filesystem;
+	const char* platform;
+	const JsonObject* compile_db;
+	Mutex mutex;
+	u32 next;
+	u32 num_compiled;
+	Vector<DynamicString> failed;
+	Array<u32> order;    ///< Index in _files of the files to compile, in order.
+	Array<u8> requested; ///< Whether the clients wait for each file.
+
+	CompileJobs()
+		: failed(default_allocator())
+		, order(default_allocator())
+		, requested(default_allocator())
+	{
+	}
+};
+
+// Tells the clients that the resource @a filename has been compiled.
+static void notify_compiled(ConsoleServer& cs, const char* filename, bool success)
+{
+	const char* type = path::extension(filename);
+
+	TempAllocator512 ta;
+	DynamicString name(ta);
+	name.set(filename, u32(type - filename - 1));
+
+	StringStream ss(ta);
+	ss << "{\"type\":\"resource_compiled\"";
+	ss << ",\"resource_type\":\"" << type << "\"";
+	ss << ",\"name\":\"" << name.c_str() << "\"";
+	ss << ",\"success\":" << (success ? "true" : "false");
+	ss << "}";
+	cs.send(string_stream::c_str(ss));
+}
+
+static s32 compile_thread(void* user_data)
+{
+	CompileJobs& cj = *(CompileJobs*)user_data;
+	const Vector<DynamicString>& files = cj.data_compiler->_files;
+
+	while (true)
+	{
+		u32 i;
+		{
+			ScopedMutex sm(cj.mutex);
+			if (cj.next == array::size(cj.order))
+				break;
+			i = cj.order[cj.next++];
+		}
+
+		const char* filename = files[i].c_str();
+		if (path::extension(filename) == NULL)
+			continue;
+
+		const char* record = (*cj.compile_db)[filename];
+		bool compiled = false;
+		const bool success = cj.data_compiler->compile(*cj.data_filesystem, cj.platform, filename, record, compiled);
+
+		if (cj.requested[i])
+			notify_compiled(*cj.data_compiler->_console_server, filename, success);
+
+		ScopedMutex sm(cj.mutex);
+		if (compiled)
+			++cj.num_compiled;
+		if (!success)
+			vector::push_back(cj.failed, files[i]);
+	}
+
+	return 0;
+}
+
+bool DataCompiler::compile(const char* data_dir, const char* platform)
+{
+	const s64 time_start = os::clocktime();
+
+	_data_dir = data_dir;
+	_platform = platform;
+
+	FilesystemDisk data_filesystem(default_allocator());
+	data_filesystem.set_prefix(data_dir);
+	data_filesystem.create_directory("");
+
+	if (!data_filesystem.exists(CROWN_DATA_DIRECTORY))
+		data_filesystem.create_directory(CROWN_DATA_DIRECTORY);
+
+	if (!data_filesystem.exists(CROWN_TEMP_DIRECTORY))
+		data_filesystem.create_directory(CROWN_TEMP_DIRECTORY);
+
+	std::sort(vector::begin(_files), vector::end(_files));
+
+	bool success = true;
+
+	// Check that all types can be compiled before starting
+	for (u32 i = 0; i < vector::size(_files); ++i)
+	{
+		const char* type = path::extension(_files[i].c_str());
+
+		if (type != NULL && !can_compile(StringId64(type)))
+		{
+			loge(DATA_COMPILER, "Unknown resource type: '%s'", type);
+			loge(DATA_COMPILER, "Append extension to " CROWN_DATAIGNORE " to ignore the type");
+			success = false;
+			break;
+		}
+	}
+
+	// Read the compile database
+	Buffer compile_db_data(default_allocator());
+	JsonObject compile_db(default_allocator());
+	if (data_filesystem.exists(CROWN_COMPILE_DATABASE))
+	{
+		File* file = data_filesystem.open(CROWN_COMPILE_DATABASE, FileOpenMode::READ);
+		const u32 size = file->size();
+		array::resize(compile_db_data, size);
+		file->read(array::begin(compile_db_data), size);
+		data_filesystem.close(*file);
+		sjson::parse(compile_db_data, compile_db);
+	}
+
+	hash_map::clear(_file_hashes);
+	map::clear(_compile_db);
+	hash_map::clear(_shader_cache);
+	_num_shaders_compiled = 0;
+	_num_shaders_reused = 0;
+
+	if (_compile_cache != NULL)
+		_compile_cache->reset_stats();
+
+	vector::clear(_compile_stats);
+
+	u32 num_compiled = 0;
+
+	// Compile all changed resources
+	if (success)
+	{
+		CompileJobs cj;
+		cj.data_compiler = this;
+		cj.data_filesystem = &data_filesystem;
+		cj.platform = platform;
+		cj.compile_db = &compile_db;
+		cj.next = 0;
+		cj.num_compiled = 0;
+		array::resize(cj.requested, vector::size(_files));
+		memset(array::begin(cj.requested), 0, array::size(cj.requested));
+
+		// The resources requested since the last compile go first, so
+		// that the clients waiting for them get them as soon as possible
+		{
+			HashMap<StringId64, u32> index(default_allocator());
+			for (u32 i = 0; i < vector::size(_files); ++i)
+			{
+				const char* filename = _files[i].c_str();
+				const char* type = path::extension(filename);
+				if (type == NULL)
+					continue;
+
+				StringId64 mix;
+				mix._id = StringId64(type)._id ^ StringId64(filename, u32(type - filename - 1))._id;
+				hash_map::set(index, mix, i);
+			}
+
+			ScopedMutex sm(_mutex);
+			for (u32 i = 0; i < array::size(_requests); ++i)
+			{
+				const u32 j = hash_map::get(index, _requests[i], UINT32_MAX);
+				if (j == UINT32_MAX || cj.requested[j])
+					continue;
+
+				cj.requested[j] = 1;
+				array::push_back(cj.order, j);
+			}
+			array::clear(_requests);
+		}
+
+		for (u32 i = 0; i < vector::size(_files); ++i)
+		{
+			if (!cj.requested[i])
+				array::push_back(cj.order, i);
+		}
+
+		// The calling thread takes part in the compilation too
+		const u32 num_threads = _num_threads < vector::size(_files) ? _num_threads : vector::size(_files);
+		Thread threads[CROWN_MAX_COMPILER_THREADS];
+		for (u32 i = 1; i < num_threads; ++i)
+			threads[i].start(compile_thread, &cj);
+
+		compile_thread(&cj);
+
+		for (u32 i = 1; i < num_threads; ++i)
+			threads[i].stop();
+
+		std::sort(vector::begin(cj.failed), vector::end(cj.failed));
+		for (u32 i = 0; i < vector::size(cj.failed); ++i)
+			loge(DATA_COMPILER, "Failed to compile '%s'", cj.failed[i].c_str());
+
+		if (vector::size(cj.failed) > 0)
+		{
+			loge(DATA_COMPILER, "Failed to compile data (%u errors)", vector::size(cj.failed));
+			success = false;
+		}
+
+		num_compiled = cj.num_compiled;
+
+		if (_num_shaders_compiled + _num_shaders_reused > 0)
+			logi(DATA_COMPILER, "Shader variants: %u compiled, %u reused", _num_shaders_compiled, _num_shaders_reused);
+
+		if (_compile_cache != NULL)
+			_compile_cache->log_stats();
+	}
+
+	// Write compile database
+	{
+		File* file = data_filesystem.open(CROWN_COMPILE_DATABASE, FileOpenMode::WRITE);
+		if (file)
+		{
+			StringStream ss(default_allocator());
+
+			auto cur = map::begin(_compile_db);
+			auto end = map::end(_compile_db);
+			for (; cur != end; ++cur)
+			{
+				ss << "\"" << cur->pair.first.c_str() << "\" = " << cur->pair.second.c_str() << "\n";
+			}
+
+			file->write(string_stream::c_str(ss), strlen32(string_stream::c_str(ss)));
+			data_filesystem.close(*file);
+		}
+	}
+
+	// Pack the resources of each package into its bundle
+	for (u32 i = 0; i < vector::size(_files) && success; ++i)
+	{
+		const char* filename = _files[i].c_str();
+		const char* type = path::extension(filename);
+
+		if (type == NULL || StringId64(type) != RESOURCE_TYPE_PACKAGE)
+			continue;
+
+		const StringId64 name(filename, u32(type - filename - 1));
+
+		// Bundles are packed again only when some resource changed
+		TempAllocator256 ta;
+		DynamicString path(ta);
+		resource_bundle::path(name, path);
+		if (num_compiled == 0 && data_filesystem.exists(path.c_str()))
+			continue;
+
+		success = resource_bundle::write(data_filesystem, name);
+		if (!success)
+			loge(DATA_COMPILER, "Failed to write bundle for '%s'", filename);
+	}
+
+	// Write data index
+	{
+		File* file = data_filesystem.open("data_index.sjson", FileOpenMode::WRITE);
+		if (file)
+		{
+			StringStream ss(default_allocator());
+
+			auto cur = map::begin(_data_index);
+			auto end = map::end(_data_index);
+			for (; cur != end; ++cur)
+			{
+				ss << "\"" << cur->pair.first.c_str() << "\" = \"" << cur->pair.second.c_str() << "\"\n";
+			}
+
+			file->write(string_stream::c_str(ss), strlen32(string_stream::c_str(ss)));
+			data_filesystem.close(*file);
+		}
+	}
+
+	_compile_time = f64(os::clocktime() - time_start)/f64(os::clockfrequency());
+
+	// Write compile report
+	{
+		File* file = data_filesystem.open(CROWN_COMPILE_REPORT, FileOpenMode::WRITE);
+		if (file)
+		{
+			StringStream ss(default_allocator());
+			compile_report(ss);
+
+			file->write(string_stream::c_str(ss), strlen32(string_stream::c_str(ss)));
+			data_filesystem.close(*file);
+		}
+	}
+
+	if (success)
+		logi(DATA_COMPILER, "Compiled data in %.2fs (%u resources out of date)", _compile_time, num_compiled);
+
+	return success;
+}
+
+static const char* s_compile_status[] =
+{
+	"up_to_date",
+	"cached",
+	"compiled",
+	"failed"
+};
+CE_STATIC_ASSERT(countof(s_compile_status) == DataCompiler::CompileStatus::COUNT);
+
+struct TypeStats
+{
+	const char* type;
+	u32 num[DataCompiler::CompileStatus::COUNT];
+	s64 time;
+	u64 input_size;
+	u64 output_size;
+};
+
+static bool slower(const DataCompiler::CompileStats* a, const DataCompiler::CompileStats* b)
+{
+	return a->time > b->time;
+}
+
+static void write_stats(StringStream& ss, const DataCompiler::CompileStats& cs, f64 freq)
+{
+	ss << "{\"name\":\"" << cs.name.c_str() << "\"";
+	ss << ",\"type\":\"" << path::extension(cs.name.c_str()) << "\"";
+	ss << ",\"status\":\"" << s_compile_status[cs.status] << "\"";
+	ss << ",\"time\":" << f64(cs.time)/freq;
+	ss << ",\"input_size\":" << cs.input_size;
+	ss << ",\"output_size\":" << cs.output_size;
+	ss << "}";
+}
+
+void DataCompiler::compile_report(StringStream& ss)
+{
+	const f64 freq = f64(os::clockfrequency());
+	const u32 num = vector::size(_compile_stats);
+
+	// Per-type totals
+	Array<TypeStats> types(default_allocator());
+	for (u32 i = 0; i < num; ++i)
+	{
+		const CompileStats& cs = _compile_stats[i];
+		const char* type = path::extension(cs.name.c_str());
+
+		u32 j = 0;
+		for (; j < array::size(types) && strcmp(types[j].type, type) != 0; ++j) ;
+		if (j == array::size(types))
+		{
+			TypeStats ts;
+			memset(&ts, 0, sizeof(ts));
+			ts.type = type;
+			array::push_back(types, ts);
+		}
+
+		TypeStats& ts = types[j];
+		++ts.num[cs.status];
+		ts.time        += cs.time;
+		ts.input_size  += cs.input_size;
+		ts.output_size += cs.output_size;
+	}
+
+	ss << "{";
+	ss << "\"time\":" << _compile_time;
+	ss << ",\"num_resources\":" << num;
+
+	ss << ",\"types\":{";
+	for (u32 i = 0; i < array::size(types); ++i)
+	{
+		const TypeStats& ts = types[i];
+		ss << (i > 0 ? "," : "") << "\"" << ts.type << "\":{";
+		for (u32 j = 0; j < CompileStatus::COUNT; ++j)
+			ss << "\"" << s_compile_status[j] << "\":" << ts.num[j] << ",";
+		ss << "\"time\":" << f64(ts.time)/freq;
+		ss << ",\"input_size\":" << ts.input_size;
+		ss << ",\"output_size\":" << ts.output_size;
+		ss << "}";
+	}
+	ss << "}";
+
+	// Resources which were not up to date
+	ss << ",\"resources\":[";
+	bool first = true;
+	for (u32 i = 0; i < num; ++i)
+	{
+		const CompileStats& cs = _compile_stats[i];
+		if (cs.status == CompileStatus::UP_TO_DATE)
+			continue;
+
+		ss << (first ? "" : ",");
+		write_stats(ss, cs, freq);
+		first = false;
+	}
+	ss << "]";
+
+	// Slowest resources
+	Array<const CompileStats*> slowest(default_allocator());
+	array::resize(slowest, num);
+	for (u32 i = 0; i < num; ++i)
+		slowest[i] = &_compile_stats[i];
+	std::sort(array::begin(slowest), array::end(slowest), slower);
+
+	const u32 num_slowest = num < CROWN_COMPILE_REPORT_SLOWEST ? num : CROWN_COMPILE_REPORT_SLOWEST;
+	ss << ",\"slowest\":[";
+	for (u32 i = 0; i < num_slowest; ++i)
+	{
+		ss << (i > 0 ? "," : "");
+		write_stats(ss, *slowest[i], freq);
+	}
+	ss << "]";
+
+	ss << "}";
+}
+
+void DataCompiler::register_compiler(StringId64 type, u32 version, CompileFunction compiler)
+{
+	CE_ASSERT(!hash_map::has(_compilers, type), "Type already registered");
+	CE_ENSURE(NULL != compiler);
+
+	ResourceTypeData rtd;
+	rtd.version = version;
+	rtd.compiler = compiler;
+
+	hash_map::set(_compilers, type, rtd);
+}
+
+u32 DataCompiler::version(StringId64 type)
+{
+	ResourceTypeData rtd;
+	rtd.version = COMPILER_NOT_FOUND;
+	rtd.compiler = NULL;
 
 	return hash_map::get(_compilers, type, rtd).version;
 }
@@ -463,7 +1610,43 @@ bool DataCompiler::can_compile(StringId64 type)
 void DataCompiler::error(const char* msg, va_list args)
 {
 	vloge(DATA_COMPILER, msg, args);
-	longjmp(_jmpbuf, 1);
+	longjmp(*s_jmpbuf, 1);
+}
+
+bool DataCompiler::run_guarded(void (*fn)(void* user_data), void* user_data)
+{
+	jmp_buf* prev = s_jmpbuf;
+	jmp_buf jb;
+	s_jmpbuf = &jb;
+
+	bool success = false;
+	if (!setjmp(jb))
+	{
+		fn(user_data);
+		success = true;
+	}
+
+	s_jmpbuf = prev;
+	return success;
+}
+
+bool DataCompiler::shader_cache_get(u64 key, Buffer& bytecode)
+{
+	ScopedMutex sm(_mutex);
+	if (!hash_map::has(_shader_cache, key))
+		return false;
+
+	Buffer deffault(default_allocator());
+	bytecode = hash_map::get(_shader_cache, key, deffault);
+	++_num_shaders_reused;
+	return true;
+}
+
+void DataCompiler::shader_cache_set(u64 key, const Buffer& bytecode)
+{
+	ScopedMutex sm(_mutex);
+	hash_map::set(_shader_cache, key, bytecode);
+	++_num_shaders_compiled;
 }
 
 void DataCompiler::filemonitor_callback(FileMonitorEvent::Enum fme, bool is_dir, const char* path, const char* path_renamed)
@@ -480,39 +1663,166 @@ void DataCompiler::filemonitor_callback(FileMonitorEvent::Enum fme, bool is_dir,
 	switch (fme)
 	{
 	case FileMonitorEvent::CREATED:
-		if (!is_dir)
-			add_file(resource_name.c_str());
-		else
-			add_tree(resource_name.c_str());
-		break;
-
 	case FileMonitorEvent::DELETED:
-		if (!is_dir)
-			remove_file(resource_name.c_str());
-		else
-			remove_tree(resource_name.c_str());
+	case FileMonitorEvent::CHANGED:
+		add_file_event(resource_name.c_str(), fme, is_dir);
 		break;
 
 	case FileMonitorEvent::RENAMED:
-		if (!is_dir)
+		add_file_event(resource_name.c_str(), FileMonitorEvent::DELETED, is_dir);
+		add_file_event(resource_name_renamed.c_str(), FileMonitorEvent::CREATED, is_dir);
+		break;
+
+	default:
+		CE_ASSERT(false, "Unknown FileMonitorEvent: %d", fme);
+		break;
+	}
+}
+
+void DataCompiler::add_file_event(const char* path, FileMonitorEvent::Enum type, bool is_dir)
+{
+	TempAllocator512 ta;
+	DynamicString key(ta);
+	key = path;
+
+	ScopedMutex sm(_file_events_mutex);
+
+	const s64 now = os::clocktime();
+	if (map::size(_file_events) == 0)
+		_file_events_first = now;
+	_file_events_last = now;
+
+	FileEvent ev;
+	ev.type = type;
+	ev.is_dir = is_dir;
+
+	if (map::has(_file_events, key))
+	{
+		FileEvent deffault = { FileMonitorEvent::COUNT, false };
+		const FileEvent prev = map::get(_file_events, key, deffault);
+
+		if (prev.type == FileMonitorEvent::CREATED && type == FileMonitorEvent::DELETED)
+		{
+			// Temporary file: nothing happened
+			map::remove(_file_events, key);
+			return;
+		}
+		else if (prev.type == FileMonitorEvent::DELETED && type == FileMonitorEvent::CREATED)
+		{
+			// Replaced, e.g. by an editor saving to a temporary file first
+			ev.type = FileMonitorEvent::CHANGED;
+		}
+		else if (prev.type == FileMonitorEvent::CREATED && type == FileMonitorEvent::CHANGED)
+		{
+			ev.type = FileMonitorEvent::CREATED;
+		}
+
+		map::remove(_file_events, key);
+	}
+
+	map::set(_file_events, key, ev);
+}
+
+void DataCompiler::process_file_events()
+{
+	Vector<DynamicString> paths(default_allocator());
+	Array<FileEvent> events(default_allocator());
+	{
+		ScopedMutex sm(_file_events_mutex);
+		if (map::size(_file_events) == 0)
+			return;
+
+		const s64 now = os::clocktime();
+		const s64 freq = os::clockfrequency();
+		const bool quiet = (now - _file_events_last)*1000 >= CROWN_FILE_MONITOR_QUIET_TIME*freq;
+		const bool late  = (now - _file_events_first)*1000 >= CROWN_FILE_MONITOR_MAX_DELAY*freq;
+		if (!quiet && !late)
+			return;
+
+		auto cur = map::begin(_file_events);
+		auto end = map::end(_file_events);
+		for (; cur != end; ++cur)
+		{
+			vector::push_back(paths, cur->pair.first);
+			array::push_back(events, cur->pair.second);
+		}
+
+		map::clear(_file_events);
+	}
+
+	// Apply deletions first, so that entries re-created at the
+	// same path or inside a deleted directory are not lost
+	for (u32 i = 0; i < vector::size(paths); ++i)
+	{
+		const char* path = paths[i].c_str();
+		const FileEvent& ev = events[i];
+
+		if (ev.type == FileMonitorEvent::DELETED || (ev.type == FileMonitorEvent::CHANGED && ev.is_dir))
+		{
+			if (!ev.is_dir)
+				remove_file(path);
+			else
+				remove_tree(path);
+		}
+	}
+
+	for (u32 i = 0; i < vector::size(paths); ++i)
+	{
+		const char* path = paths[i].c_str();
+		const FileEvent& ev = events[i];
+
+		if (ev.type == FileMonitorEvent::DELETED)
+			continue;
+
+		if (ev.is_dir)
 		{
-			remove_file(resource_name.c_str());
-			add_file(resource_name_renamed.c_str());
+			add_tree(path);
 		}
 		else
 		{
-			remove_tree(resource_name.c_str());
-			add_tree(resource_name_renamed.c_str());
+			// Files inside a new directory have been added already
+			u32 j = 0;
+			for (; j < vector::size(_files) && !(_files[j] == path); ++j) ;
+			if (j == vector::size(_files))
+				add_file(path);
 		}
-		break;
+	}
 
-	case FileMonitorEvent::CHANGED:
-		break;
+	if (_platform.length() == 0)
+		return;
 
-	default:
-		CE_ASSERT(false, "Unknown FileMonitorEvent: %d", fme);
-		break;
+	logi(DATA_COMPILER, "%u source changes", vector::size(paths));
+	const bool success = compile(_data_dir.c_str(), _platform.c_str());
+
+	TempAllocator512 ta;
+	StringStream ss(ta);
+	ss << "{\"type\":\"changeset_compiled\",\"num_changes\":" << vector::size(paths) << ",\"success\":" << (success ? "true" : "false") << "}";
+	_console_server->send(string_stream::c_str(ss));
+}
+
+void DataCompiler::request(StringId64 type, StringId64 name)
+{
+	StringId64 mix;
+	mix._id = type._id ^ name._id;
+
+	ScopedMutex sm(_mutex);
+	array::push_back(_requests, mix);
+}
+
+void DataCompiler::process_requests()
+{
+	u32 num_requests;
+	{
+		ScopedMutex sm(_mutex);
+		num_requests = array::size(_requests);
 	}
+
+	// Requests made before the first compile() are served by it
+	if (num_requests == 0 || _platform.length() == 0)
+		return;
+
+	logi(DATA_COMPILER, "%u resources requested", num_requests);
+	compile(_data_dir.c_str(), _platform.c_str());
 }
 
 void DataCompiler::filemonitor_callback(void* thiz, FileMonitorEvent::Enum fme, bool is_dir, const char* path_original, const char* path_modified)
@@ -554,33 +1864,45 @@ int main_data_compiler(int argc, char** argv)
 	namespace lvr = level_resource_internal;
 	namespace mhr = mesh_resource_internal;
 	namespace mtr = material_resource_internal;
+	namespace ngr = nav_grid_resource_internal;
+	namespace ptr = particle_resource_internal;
 	namespace pcr = physics_config_resource_internal;
 	namespace phr = physics_resource_internal;
+	namespace rgr = render_graph_resource_internal;
 	namespace pkr = package_resource_internal;
 	namespace sar = sprite_animation_resource_internal;
 	namespace sdr = sound_resource_internal;
 	namespace shr = shader_resource_internal;
+	namespace skr = skeleton_resource_internal;
+	namespace ska = skeleton_animation_resource_internal;
 	namespace smr = state_machine_internal;
 	namespace spr = sprite_resource_internal;
 	namespace txr = texture_resource_internal;
+	namespace tmr = tilemap_resource_internal;
 	namespace utr = unit_resource_internal;
 
-	DataCompiler* dc = CE_NEW(default_allocator(), DataCompiler)(*console_server());
+	DataCompiler* dc = CE_NEW(default_allocator(), DataCompiler)(*console_server(), opts._compiler_threads);
 	dc->register_compiler(RESOURCE_TYPE_CONFIG,           RESOURCE_VERSION_CONFIG,           cor::compile);
 	dc->register_compiler(RESOURCE_TYPE_FONT,             RESOURCE_VERSION_FONT,             ftr::compile);
 	dc->register_compiler(RESOURCE_TYPE_LEVEL,            RESOURCE_VERSION_LEVEL,            lvr::compile);
 	dc->register_compiler(RESOURCE_TYPE_MATERIAL,         RESOURCE_VERSION_MATERIAL,         mtr::compile);
 	dc->register_compiler(RESOURCE_TYPE_MESH,             RESOURCE_VERSION_MESH,             mhr::compile);
+	dc->register_compiler(RESOURCE_TYPE_NAV_GRID,         RESOURCE_VERSION_NAV_GRID,         ngr::compile);
 	dc->register_compiler(RESOURCE_TYPE_PACKAGE,          RESOURCE_VERSION_PACKAGE,          pkr::compile);
+	dc->register_compiler(RESOURCE_TYPE_PARTICLE,         RESOURCE_VERSION_PARTICLE,         ptr::compile);
 	dc->register_compiler(RESOURCE_TYPE_PHYSICS,          RESOURCE_VERSION_PHYSICS,          phr::compile);
 	dc->register_compiler(RESOURCE_TYPE_PHYSICS_CONFIG,   RESOURCE_VERSION_PHYSICS_CONFIG,   pcr::compile);
+	dc->register_compiler(RESOURCE_TYPE_RENDER_GRAPH,     RESOURCE_VERSION_RENDER_GRAPH,     rgr::compile);
 	dc->register_compiler(RESOURCE_TYPE_SCRIPT,           RESOURCE_VERSION_SCRIPT,           lur::compile);
 	dc->register_compiler(RESOURCE_TYPE_SHADER,           RESOURCE_VERSION_SHADER,           shr::compile);
+	dc->register_compiler(RESOURCE_TYPE_SKELETON,         RESOURCE_VERSION_SKELETON,         skr::compile);
+	dc->register_compiler(RESOURCE_TYPE_SKELETON_ANIMATION, RESOURCE_VERSION_SKELETON_ANIMATION, ska::compile);
 	dc->register_compiler(RESOURCE_TYPE_SOUND,            RESOURCE_VERSION_SOUND,            sdr::compile);
 	dc->register_compiler(RESOURCE_TYPE_SPRITE,           RESOURCE_VERSION_SPRITE,           spr::compile);
 	dc->register_compiler(RESOURCE_TYPE_SPRITE_ANIMATION, RESOURCE_VERSION_SPRITE_ANIMATION, sar::compile);
 	dc->register_compiler(RESOURCE_TYPE_STATE_MACHINE,    RESOURCE_VERSION_STATE_MACHINE,    smr::compile);
 	dc->register_compiler(RESOURCE_TYPE_TEXTURE,          RESOURCE_VERSION_TEXTURE,          txr::compile);
+	dc->register_compiler(RESOURCE_TYPE_TILEMAP,          RESOURCE_VERSION_TILEMAP,          tmr::compile);
 	dc->register_compiler(RESOURCE_TYPE_UNIT,             RESOURCE_VERSION_UNIT,             utr::compile);
 
 	// Add ignore globs
@@ -608,7 +1930,10 @@ int main_data_compiler(int argc, char** argv)
 			);
 	}
 
-	dc->scan();
+	if (opts._compile_cache_dir)
+		dc->set_compile_cache(opts._compile_cache_dir);
+
+	dc->scan(opts._data_dir.c_str());
 
 	bool success = true;
 
@@ -617,6 +1942,8 @@ int main_data_compiler(int argc, char** argv)
 		while (true)
 		{
 			console_server()->update();
+			dc->process_file_events();
+			dc->process_requests();
 			os::sleep(60);
 		}
 	}
@@ -5,12 +5,14 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/containers/types.h"
 #include "core/filesystem/file_monitor.h"
 #include "core/filesystem/filesystem_disk.h"
+#include "core/strings/dynamic_string.h"
+#include "core/thread/mutex.h"
 #include "device/console_server.h"
 #include "resource/types.h"
-#include <setjmp.h>
 
 namespace crown
 {
@@ -27,6 +29,51 @@ struct DataCompiler
 		CompileFunction compiler;
 	};
 
+	struct FileHash
+	{
+		u64 mtime;
+		u64 hash; ///< Hash of the file content.
+	};
+
+	struct FileEvent
+	{
+		FileMonitorEvent::Enum type;
+		bool is_dir;
+	};
+
+	struct CompileStatus
+	{
+		enum Enum
+		{
+			UP_TO_DATE,
+			CACHED,
+			COMPILED,
+			FAILED,
+
+			COUNT
+		};
+	};
+
+	struct CompileStats
+	{
+		ALLOCATOR_AWARE;
+
+		DynamicString name;
+		CompileStatus::Enum status;
+		s64 time;
+		u64 input_size;
+		u64 output_size;
+
+		CompileStats(Allocator& a)
+			: name(a)
+			, status(CompileStatus::FAILED)
+			, time(0)
+			, input_size(0)
+			, output_size(0)
+		{
+		}
+	};
+
 	ConsoleServer* _console_server;
 	FilesystemDisk _source_fs;
 	Map<DynamicString, DynamicString> _source_dirs;
@@ -34,20 +81,47 @@ struct DataCompiler
 	Vector<DynamicString> _files;
 	Vector<DynamicString> _globs;
 	Map<DynamicString, DynamicString> _data_index;
+	Map<DynamicString, DynamicString> _compile_db;
+	HashMap<StringId64, FileHash> _file_hashes;
+	HashMap<u64, Buffer> _shader_cache;
+	u32 _num_shaders_compiled;
+	u32 _num_shaders_reused;
+	Mutex _mutex;
 	FileMonitor _file_monitor;
-	jmp_buf _jmpbuf;
+	u32 _num_threads;
+	CompileCache* _compile_cache;
+	Vector<CompileStats> _compile_stats;
+	f64 _compile_time;
+	Map<DynamicString, FileEvent> _file_events;
+	Mutex _file_events_mutex;
+	s64 _file_events_first;
+	s64 _file_events_last;
+	DynamicString _data_dir;
+	DynamicString _platform;
+	Array<StringId64> _requests; ///< Resources (type ^ name) requested with request(), oldest first.
 
 	void add_file(const char* path);
 	void add_tree(const char* path);
 	void remove_file(const char* path);
 	void remove_tree(const char* path);
 	void scan_source_dir(const char* prefix, const char* path);
-
+	bool file_hash(const char* path, u64 mtime, u64 hash, FileHash& fh);
+	bool up_to_date(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path, const char* record);
+	void add_record(const char* platform, const char* src_path, const Vector<DynamicString>& dependencies);
+	bool cache_key(const char* platform, const char* src_path, u64& key);
+	bool cache_inputs_key(u64 key, const Vector<DynamicString>& dependencies, u64& inputs_key);
+	bool cache_fetch(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path);
+	void cache_store(const char* platform, const char* src_path, const Vector<DynamicString>& dependencies, const Buffer& output);
+	bool compile(FilesystemDisk& data_filesystem, const char* platform, const char* filename, const char* record, bool& compiled);
+	bool compile(FilesystemDisk& data_filesystem, const char* platform, const char* src_path, const char* dst_path);
+	void add_stats(FilesystemDisk& data_filesystem, const char* src_path, const char* dst_path, CompileStatus::Enum status, s64 time);
+
+	void add_file_event(const char* path, FileMonitorEvent::Enum type, bool is_dir);
 	void filemonitor_callback(FileMonitorEvent::Enum fme, bool is_dir, const char* path, const char* path_renamed);
 	static void filemonitor_callback(void* thiz, FileMonitorEvent::Enum fme, bool is_dir, const char* path_original, const char* path_modified);
 
-	///
-	DataCompiler(ConsoleServer& cs);
+	/// Compiles resources using @a num_threads threads.
+	DataCompiler(ConsoleServer& cs, u32 num_threads = CROWN_DEFAULT_COMPILER_THREADS);
 
 	///
 	~DataCompiler();
@@ -58,16 +132,50 @@ struct DataCompiler
 	///
 	void source_dir(const char* resource_name, DynamicString& source_dir);
 
+	/// Shares compiled resources through the compile cache in @a dir.
+	/// Resources found in the cache are fetched instead of being compiled,
+	/// and the compiled ones are added to the cache.
+	void set_compile_cache(const char* dir);
+
 	/// Adds a @a glob pattern to ignore when scanning the source directory.
 	void add_ignore_glob(const char* glob);
 
 	/// Scans source directory for resources.
-	void scan();
+	/// Directories are scanned in parallel. A snapshot of the source tree is
+	/// kept in @a data_dir so that the directories which did not change since
+	/// the last scan do not need to be listed again.
+	void scan(const char* data_dir);
 
 	/// Compiles all the resources found in the source directory and puts them in @a data_dir.
+	/// Resources are compiled in parallel; a failure does not stop the
+	/// compilation of the others. Resources whose compiler, platform and
+	/// dependencies did not change since the last compilation are skipped.
 	/// Returns true on success, false otherwise.
 	bool compile(const char* data_dir, const char* platform);
 
+	/// Applies the changes to the source directory reported by the file
+	/// monitor. Changes are collected until none has been reported for
+	/// CROWN_FILE_MONITOR_QUIET_TIME milliseconds, or for at most
+	/// CROWN_FILE_MONITOR_MAX_DELAY milliseconds, and applied as a single
+	/// batch. If data has been compiled before, the batch is followed by
+	/// one incremental compile() with the same data directory and platform.
+	void process_file_events();
+
+	/// Compiles the resource @a name of the given @a type before the others
+	/// in the next compile(), and notifies the clients with a
+	/// "resource_compiled" message as soon as it is up to date.
+	void request(StringId64 type, StringId64 name);
+
+	/// Runs one incremental compile() with the same data directory and
+	/// platform as the last one, if resources have been requested since.
+	void process_requests();
+
+	/// Writes the report of the last compile() to @a ss as JSON.
+	/// The report contains the compile time, the input and output size and the
+	/// outcome for each resource type, for each resource which was not up to
+	/// date and for the CROWN_COMPILE_REPORT_SLOWEST slowest resources.
+	void compile_report(StringStream& ss);
+
 	/// Registers the resource @a compiler for the given resource @a type and @a version.
 	void register_compiler(StringId64 type, u32 version, CompileFunction compiler);
 
@@ -81,6 +189,15 @@ struct DataCompiler
 	///
 	void error(const char* msg, va_list args);
 
+	/// See CompileOptions::run_guarded().
+	bool run_guarded(void (*fn)(void* user_data), void* user_data);
+
+	/// See CompileOptions::shader_cache_get().
+	bool shader_cache_get(u64 key, Buffer& bytecode);
+
+	/// See CompileOptions::shader_cache_set().
+	void shader_cache_set(u64 key, const Buffer& bytecode);
+
 	static const u32 COMPILER_NOT_FOUND = UINT32_MAX;
 };
 
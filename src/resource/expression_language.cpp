@@ -1,5 +1,6 @@
 #include "core/error/error.h"
 #include "core/math/math.h"
+#include "core/math/simd.h"
 #include "core/strings/string.h"
 #include "resource/expression_language.h"
 #include <alloca.h>
@@ -13,22 +14,6 @@ namespace skinny
 {
 namespace expression_language
 {
-	/// Byte code constants.
-	///
-	/// If the upper 12 bits of the byte code do not match one of these values, the operation is
-	/// BC_PUSH_FLOAT and the byte code specify the 32 bit float to push. If the upper 12 bits
-	/// match one of these values (which are all NaNs, so they should never appear as regular
-	/// floats), the operation will instead be the one matching.
-	///
-	/// The remaining 20 bits of the byte code are used for the id of functions and variables.
-	enum ByteCode {BC_FUNCTION = 0x7f800000, BC_PUSH_VAR = 0x7f900000, BC_END = 0x7fa00000};
-
-	/// Returns the byte code operation part of the byte code word.
-	static inline unsigned bc_mask(unsigned i) {return i & 0xfff00000;}
-
-	/// Returns the id part of the byte code word.
-	static inline unsigned id_mask(unsigned i) {return i & 0x000fffff;}
-
 	/// Opcodes for functions
 	enum OpCode
 	{
@@ -42,7 +27,13 @@ namespace expression_language
 		OP_COS,
 		OP_ABS,
 		OP_MATCH,
-		OP_MATCH_2D
+		OP_MATCH_2D,
+		OP_MIN,
+		OP_MAX,
+		OP_LESS,
+		OP_LESS_EQUAL,
+		OP_GREATER,
+		OP_GREATER_EQUAL
 	};
 
 	static inline float pop(Stack &stack) 			{CE_ASSERT(stack.size > 0, "Stack underflow"); return stack.data[--stack.size];}
@@ -68,6 +59,27 @@ namespace expression_language
 		return match(a, b) * match(c, d);
 	}
 
+	/// Computes the binary function specified by @a op_code with the arguments @a a and @a b.
+	static inline float compute_binary(OpCode op_code, float a, float b)
+	{
+		switch(op_code) {
+			case OP_ADD: return a+b;
+			case OP_SUB: return a-b;
+			case OP_MUL: return a*b;
+			case OP_DIV: return a/b;
+			case OP_MATCH: return match(a, b);
+			case OP_MIN: return a < b ? a : b;
+			case OP_MAX: return a > b ? a : b;
+			case OP_LESS: return a < b ? 1.0f : 0.0f;
+			case OP_LESS_EQUAL: return a <= b ? 1.0f : 0.0f;
+			case OP_GREATER: return a > b ? 1.0f : 0.0f;
+			case OP_GREATER_EQUAL: return a >= b ? 1.0f : 0.0f;
+			default:
+				CE_FATAL("Unknown binary opcode");
+				return 0.0f;
+		}
+	}
+
 	/// Computes the function specified by @a op_code on the @a stack.
 	static inline void compute_function(OpCode op_code, Stack &stack)
 	{
@@ -77,19 +89,13 @@ namespace expression_language
 		float a,b,c,d;
 
 		switch(op_code) {
-			case OP_ADD: b=POP(); a=POP(); PUSH(a+b); break;
-			case OP_SUB: b=POP(); a=POP(); PUSH(a-b); break;
-			case OP_MUL: b=POP(); a=POP(); PUSH(a*b); break;
-			case OP_DIV: b=POP(); a=POP(); PUSH(a/b); break;
 			case OP_UNARY_MINUS: PUSH(-POP()); break;
 			case OP_SIN: PUSH(fsin(POP())); break;
 			case OP_COS: PUSH(fcos(POP())); break;
 			case OP_ABS: a = POP(); PUSH(fabs(a)); break;
-			case OP_MATCH: b=POP(); a=POP(); PUSH(match(a, b)); break;
 			case OP_MATCH_2D: d=POP(); c=POP(); b=POP(); a=POP(); PUSH(match2d(a,b,c,d)); break;
 			case OP_NOP: break;
-			default:
-				CE_FATAL("Unknown opcode");
+			default: b=POP(); a=POP(); PUSH(compute_binary(op_code, a, b)); break;
 		}
 
 		#undef POP
@@ -302,6 +308,132 @@ namespace expression_language
 		}
 	}
 
+	/// Returns the index of the first token of the sub-expression which ends
+	/// with the token at @a end in the program @a rpl.
+	static unsigned expression_start(const Token *rpl, unsigned end, const CompileEnvironment &env)
+	{
+		unsigned i = end + 1;
+		unsigned needed = 1;
+		while (needed > 0) {
+			CE_ASSERT(i > 0, "Too few arguments to function");
+			--i;
+			--needed;
+			if (rpl[i].type == Token::FUNCTION)
+				needed += env.function_values[rpl[i].id].arity;
+		}
+		return i;
+	}
+
+	/// Removes @a num tokens starting at @a start from the program @a rpl.
+	static void remove_tokens(Token *rpl, unsigned &num_tokens, unsigned start, unsigned num)
+	{
+		memmove(&rpl[start], &rpl[start+num], sizeof(Token)*(num_tokens-start-num));
+		num_tokens -= num;
+	}
+
+	/// True if the token @a t is the number @a value.
+	static inline bool is_number(const Token &t, float value)
+	{
+		return t.type == Token::NUMBER && t.value == value;
+	}
+
+	/// True if the token @a t is the function with the specified @a op_code.
+	static inline bool is_function(const Token &t, OpCode op_code, const CompileEnvironment &env)
+	{
+		return t.type == Token::FUNCTION && env.function_values[t.id].op_code == op_code;
+	}
+
+	/// Removes from the program @a rpl the operations which do not change the
+	/// result, such as x*1 or -(-x), and the sub-expressions whose value is
+	/// never used, such as x in x*0. Variables are assumed to be finite.
+	/// Returns true if the program has been modified.
+	static bool eliminate_dead_code(Token *rpl, unsigned &num_tokens, const CompileEnvironment &env)
+	{
+		for (unsigned i=0; i<num_tokens; ++i) {
+			if (rpl[i].type != Token::FUNCTION)
+				continue;
+
+			const OpCode op = env.function_values[rpl[i].id].op_code;
+
+			if (op == OP_UNARY_MINUS && i > 0 && is_function(rpl[i-1], OP_UNARY_MINUS, env)) {
+				remove_tokens(rpl, num_tokens, i-1, 2);
+				return true;
+			}
+
+			if (op != OP_ADD && op != OP_SUB && op != OP_MUL && op != OP_DIV)
+				continue;
+
+			const unsigned rhs = expression_start(rpl, i-1, env);
+			const unsigned lhs = expression_start(rpl, rhs-1, env);
+
+			// x+0, x-0, x*1, x/1
+			const float identity = (op == OP_ADD || op == OP_SUB) ? 0.0f : 1.0f;
+			if (rhs == i-1 && is_number(rpl[rhs], identity)) {
+				remove_tokens(rpl, num_tokens, rhs, 2);
+				return true;
+			}
+
+			// 0+x, 1*x
+			if ((op == OP_ADD || op == OP_MUL) && lhs == rhs-1 && is_number(rpl[lhs], identity)) {
+				remove_tokens(rpl, num_tokens, i, 1);
+				remove_tokens(rpl, num_tokens, lhs, 1);
+				return true;
+			}
+
+			// x*0, 0*x
+			if (op == OP_MUL && ((rhs == i-1 && is_number(rpl[rhs], 0.0f)) || (lhs == rhs-1 && is_number(rpl[lhs], 0.0f)))) {
+				rpl[lhs] = Token(Token::NUMBER, 0.0f);
+				remove_tokens(rpl, num_tokens, lhs+1, i-lhs);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// Rewrites the chains of min and max functions nested on the left, such as
+	/// min(min(a, b), c), into chains nested on the right, such as min(a, min(b, c)),
+	/// which generate_bytecode() fuses into a single instruction.
+	/// Returns true if the program has been modified.
+	static bool reassociate(Token *rpl, unsigned num_tokens, const CompileEnvironment &env)
+	{
+		for (unsigned i=0; i<num_tokens; ++i) {
+			if (!is_function(rpl[i], OP_MIN, env) && !is_function(rpl[i], OP_MAX, env))
+				continue;
+
+			const OpCode op = env.function_values[rpl[i].id].op_code;
+			const unsigned rhs = expression_start(rpl, i-1, env);
+
+			// a b min E min -> a b E min min
+			if (is_function(rpl[rhs-1], op, env)) {
+				const Token t = rpl[rhs-1];
+				memmove(&rpl[rhs-1], &rpl[rhs], sizeof(Token)*(i-rhs));
+				rpl[i-1] = t;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// Optimizes the program represented by @a rpl until no more changes can be
+	/// made.
+	static void optimize(Token *rpl, unsigned &num_tokens, CompileEnvironment &env)
+	{
+		fold_constants(rpl, num_tokens, env);
+		while (eliminate_dead_code(rpl, num_tokens, env) || reassociate(rpl, num_tokens, env))
+			fold_constants(rpl, num_tokens, env);
+	}
+
+	/// Appends the byte code word @a op to @a byte_code.
+	static inline void emit(unsigned op, unsigned *byte_code, unsigned capacity, unsigned &size, unsigned &overflow)
+	{
+		if (size < capacity)
+			byte_code[size++] = op;
+		else
+			++overflow;
+	}
+
 	/// Generates bytecode from a program in RPL token stream form.
 	/// Returns the number of byte_code tokens generated. If the returned number is > capacity, only the first
 	/// capacity items are generated.
@@ -313,6 +445,36 @@ namespace expression_language
 		for (unsigned i=0; i<num_tokens; ++i) {
 			Function f;
 			Token t = rpl[i];
+
+			// Fuse "variable constant function" into a single instruction
+			if (t.type == Token::VARIABLE
+				&& t.id < 0x1000
+				&& i+2 < num_tokens
+				&& rpl[i+1].type == Token::NUMBER
+				&& rpl[i+2].type == Token::FUNCTION
+				&& env.function_values[rpl[i+2].id].arity == 2
+				) {
+				f = env.function_values[rpl[i+2].id];
+				emit(BC_VAR_CONST + (t.id << 8) + f.op_code, byte_code, capacity, size, overflow);
+				emit(float_to_unsigned(rpl[i+1].value), byte_code, capacity, size, overflow);
+				i += 2;
+				continue;
+			}
+
+			// Fuse chains of min and max into a single instruction
+			if (is_function(t, OP_MIN, env) || is_function(t, OP_MAX, env)) {
+				f = env.function_values[t.id];
+				unsigned num = 1;
+				while (i+num < num_tokens && num < 0xfff && is_function(rpl[i+num], f.op_code, env))
+					++num;
+
+				if (num > 1) {
+					emit(BC_REDUCE + (num << 8) + f.op_code, byte_code, capacity, size, overflow);
+					i += num - 1;
+					continue;
+				}
+			}
+
 			unsigned op;
 			switch (t.type) {
 				case Token::NUMBER:
@@ -330,18 +492,10 @@ namespace expression_language
 					CE_FATAL("Unknown token");
 					break;
 			}
-			if (size < capacity)
-				byte_code[size++] = op;
-			else
-				++overflow;
+			emit(op, byte_code, capacity, size, overflow);
 		}
 
-		unsigned op = BC_END;
-		if (size < capacity)
-			byte_code[size++] = op;
-		else
-			++overflow;
-
+		emit(BC_END, byte_code, capacity, size, overflow);
 		return size + overflow;
 	}
 
@@ -366,7 +520,7 @@ namespace expression_language
 		int par_level;
 	};
 
-	const int NUM_DEFAULT_FUNCTIONS = 12;
+	const int NUM_DEFAULT_FUNCTIONS = 18;
 
 	/// Sets up the functions that should be usable in the language.
 	static unsigned setup_functions(const char **names, Function *functions, unsigned capacity)
@@ -385,6 +539,12 @@ namespace expression_language
 		names[9] = "abs"; functions[9] = Function(OP_ABS, 17, 1);
 		names[10] = "match"; functions[10] = Function(OP_MATCH, 17, 2);
 		names[11] = "match_2d"; functions[11] = Function(OP_MATCH_2D, 17, 4);
+		names[12] = "min"; functions[12] = Function(OP_MIN, 17, 2);
+		names[13] = "max"; functions[13] = Function(OP_MAX, 17, 2);
+		names[14] = "<"; functions[14] = Function(OP_LESS, 10, 2);
+		names[15] = "<="; functions[15] = Function(OP_LESS_EQUAL, 10, 2);
+		names[16] = ">"; functions[16] = Function(OP_GREATER, 10, 2);
+		names[17] = ">="; functions[17] = Function(OP_GREATER_EQUAL, 10, 2);
 		return NUM_DEFAULT_FUNCTIONS;
 	}
 
@@ -448,10 +608,33 @@ namespace expression_language
 		while (num_function_stack>0)
 			rpl[num_rpl++] = function_stack[--num_function_stack].token;
 
-		fold_constants(rpl, num_rpl, env);
+		optimize(rpl, num_rpl, env);
 		return generate_bytecode(rpl, num_rpl, env, byte_code, capacity);
 	}
 
+	bool uses_variable(const unsigned *byte_code, unsigned variable)
+	{
+		const unsigned *p = byte_code;
+		while (true) {
+			unsigned bc = *p++;
+			unsigned op = bc_mask(bc);
+			unsigned id = id_mask(bc);
+			switch (op) {
+				case BC_PUSH_VAR:
+					if (id == variable) return true;
+					break;
+				case BC_VAR_CONST:
+					if ((id >> 8) == variable) return true;
+					++p; // Skip the float argument
+					break;
+				case BC_END:
+					return false;
+				default:
+					break;
+			}
+		}
+	}
+
 	#endif // CAN_COMPILE
 
 	bool run(const unsigned *byte_code, const float *variables, Stack &stack)
@@ -469,6 +652,26 @@ namespace expression_language
 				case BC_FUNCTION:
 					compute_function((OpCode)id, stack);
 					break;
+				case BC_VAR_CONST:
+					if (stack.size == stack.capacity) return false;
+					stack.data[stack.size++] = compute_binary((OpCode)(id & 0xff), variables[id >> 8], unsigned_to_float(*p++));
+					break;
+				case BC_REDUCE: {
+					const unsigned num = id >> 8;
+					CE_ASSERT(stack.size > num, "Stack underflow");
+					float *args = &stack.data[stack.size - num - 1];
+					float r = args[num];
+					if ((id & 0xff) == OP_MIN) {
+						for (unsigned i = num; i-- > 0; )
+							r = args[i] < r ? args[i] : r;
+					} else {
+						for (unsigned i = num; i-- > 0; )
+							r = args[i] > r ? args[i] : r;
+					}
+					args[0] = r;
+					stack.size -= num;
+					break;
+				}
 				case BC_END:
 					return true;
 				default: // BC_PUSH_FLOAT
@@ -480,6 +683,147 @@ namespace expression_language
 		}
 	}
 
+	/// Capacity of the stack used by run_batch().
+	static const unsigned BATCH_STACK_CAPACITY = 32;
+
+	static inline simd::Float4 match4(simd::Float4 a, simd::Float4 b)
+	{
+		return simd::max(simd::sub(simd::splat(1.0f), simd::abs(simd::sub(b, a))), simd::splat(0.0f));
+	}
+
+	/// Computes the binary function specified by @a op_code on four lanes at once.
+	static inline simd::Float4 compute_binary4(OpCode op_code, simd::Float4 a, simd::Float4 b)
+	{
+		const simd::Float4 one = simd::splat(1.0f);
+		const simd::Float4 zero = simd::splat(0.0f);
+
+		switch(op_code) {
+			case OP_ADD: return simd::add(a, b);
+			case OP_SUB: return simd::sub(a, b);
+			case OP_MUL: return simd::mul(a, b);
+			case OP_DIV: return simd::div(a, b);
+			case OP_MATCH: return match4(a, b);
+			case OP_MIN: return simd::min(a, b);
+			case OP_MAX: return simd::max(a, b);
+			case OP_LESS: return simd::select(simd::cmplt(a, b), one, zero);
+			case OP_LESS_EQUAL: return simd::select(simd::cmple(a, b), one, zero);
+			case OP_GREATER: return simd::select(simd::cmpgt(a, b), one, zero);
+			case OP_GREATER_EQUAL: return simd::select(simd::cmple(b, a), one, zero);
+			default:
+				CE_FATAL("Unknown binary opcode");
+				return zero;
+		}
+	}
+
+	/// Computes the function specified by @a op_code on the four lanes @a stack.
+	static inline void compute_function4(OpCode op_code, simd::Float4 *stack, unsigned &size)
+	{
+		float lanes[4];
+
+		switch(op_code) {
+			case OP_UNARY_MINUS:
+				CE_ASSERT(size > 0, "Stack underflow");
+				stack[size-1] = simd::sub(simd::splat(0.0f), stack[size-1]);
+				break;
+			case OP_SIN:
+			case OP_COS:
+				CE_ASSERT(size > 0, "Stack underflow");
+				simd::store(lanes, stack[size-1]);
+				for (unsigned i = 0; i < 4; ++i)
+					lanes[i] = op_code == OP_SIN ? fsin(lanes[i]) : fcos(lanes[i]);
+				stack[size-1] = simd::load(lanes);
+				break;
+			case OP_ABS:
+				CE_ASSERT(size > 0, "Stack underflow");
+				stack[size-1] = simd::abs(stack[size-1]);
+				break;
+			case OP_MATCH_2D:
+				CE_ASSERT(size > 3, "Stack underflow");
+				stack[size-4] = simd::mul(match4(stack[size-4], stack[size-3]), match4(stack[size-2], stack[size-1]));
+				size -= 3;
+				break;
+			case OP_NOP:
+				break;
+			default:
+				CE_ASSERT(size > 1, "Stack underflow");
+				stack[size-2] = compute_binary4(op_code, stack[size-2], stack[size-1]);
+				--size;
+				break;
+		}
+	}
+
+	bool run_batch(const unsigned *byte_code, const float *variables, unsigned stride, unsigned n, float *out)
+	{
+		CE_ASSERT(stride % 4 == 0 && stride >= n, "Invalid stride");
+
+		simd::Float4 stack[BATCH_STACK_CAPACITY];
+
+		for (unsigned i = 0; i < n; i += 4) {
+			const unsigned *p = byte_code;
+			unsigned size = 0;
+			bool end = false;
+
+			while (!end) {
+				unsigned bc = *p++;
+				unsigned op = bc_mask(bc);
+				unsigned id = id_mask(bc);
+				switch (op) {
+					case BC_PUSH_VAR:
+						if (size == BATCH_STACK_CAPACITY) return false;
+						stack[size++] = simd::load(&variables[id*stride + i]);
+						break;
+					case BC_FUNCTION:
+						compute_function4((OpCode)id, stack, size);
+						break;
+					case BC_VAR_CONST:
+						if (size == BATCH_STACK_CAPACITY) return false;
+						stack[size++] = compute_binary4((OpCode)(id & 0xff)
+							, simd::load(&variables[(id >> 8)*stride + i])
+							, simd::splat(unsigned_to_float(*p++))
+							);
+						break;
+					case BC_REDUCE: {
+						const unsigned num = id >> 8;
+						CE_ASSERT(size > num, "Stack underflow");
+						simd::Float4 *args = &stack[size - num - 1];
+						simd::Float4 r = args[num];
+						if ((id & 0xff) == OP_MIN) {
+							for (unsigned j = num; j-- > 0; )
+								r = simd::min(args[j], r);
+						} else {
+							for (unsigned j = num; j-- > 0; )
+								r = simd::max(args[j], r);
+						}
+						args[0] = r;
+						size -= num;
+						break;
+					}
+					case BC_END:
+						end = true;
+						break;
+					default: // BC_PUSH_FLOAT
+						if (size == BATCH_STACK_CAPACITY) return false;
+						stack[size++] = simd::splat(unsigned_to_float(bc));
+						break;
+				}
+			}
+
+			if (size == 0)
+				return false;
+
+			if (n - i >= 4) {
+				simd::store(&out[i], stack[size-1]);
+			} else {
+				float lanes[4];
+				simd::store(lanes, stack[size-1]);
+				for (unsigned j = 0; j < n - i; ++j)
+					out[i + j] = lanes[j];
+			}
+		}
+
+		return true;
+	}
+
 } // namespace expression_language
 
 } // namespace skinny
@@ -22,7 +22,16 @@
 /// NAN_MARKER (9) BC_PUSH_VAR (3)	id (20)		Pushes the variable with the specified id.
 ///	NAN_MARKER (9) BC_FUNCTION (3)	id (20)		Computes the function with the specified id.
 /// NAN_MARKER (9) BC_END (3)	    zero (20)	Marks the end of the byte code.
+/// NAN_MARKER (9) BC_VAR_CONST (3) var (12) id (8), float (32)
+///											Computes the binary function id with the variable var
+///											and the float as arguments.
+/// NAN_MARKER (9) BC_REDUCE (3)	num (12) id (8)
+///											Computes the binary function id num times in a row.
 /// float (32)									Pushes the float.
+///
+/// The compiler folds constant sub-expressions, removes operations which do
+/// not change the result (such as x*1 or x+0) and fuses common instruction
+/// sequences into BC_VAR_CONST and BC_REDUCE.
 
 /// Flag used to include the parts of the code needed to compile to bytecode.
 /// If you compile offline you can exclude this code in the runtime version.
@@ -56,8 +65,40 @@ namespace expression_language
 			, unsigned *byte_code
 			, unsigned byte_code_capacity
 			);
+
+		/// Returns true if the @a byte_code reads the variable with index @a variable.
+		bool uses_variable(const unsigned *byte_code, unsigned variable);
 #endif
 
+	/// Byte code constants.
+	///
+	/// If the upper 12 bits of the byte code do not match one of these values, the operation is
+	/// BC_PUSH_FLOAT and the byte code specify the 32 bit float to push. If the upper 12 bits
+	/// match one of these values (which are all NaNs, so they should never appear as regular
+	/// floats), the operation will instead be the one matching.
+	///
+	/// The remaining 20 bits of the byte code are used for the id of functions and variables.
+	enum ByteCode
+	{
+		BC_FUNCTION  = 0x7f800000,
+		BC_PUSH_VAR  = 0x7f900000,
+		BC_END       = 0x7fa00000,
+		BC_VAR_CONST = 0x7fb00000,
+		BC_REDUCE    = 0x7fc00000
+	};
+
+	/// Returns the byte code operation part of the byte code word.
+	inline unsigned bc_mask(unsigned i) {return i & 0xfff00000;}
+
+	/// Returns the id part of the byte code word.
+	inline unsigned id_mask(unsigned i) {return i & 0x000fffff;}
+
+	/// Returns true if the byte code word @a i pushes a float.
+	inline bool is_float(unsigned i)
+	{
+		return bc_mask(i) < BC_FUNCTION || bc_mask(i) > BC_REDUCE;
+	}
+
 	/// Represents the working stack.
 	struct Stack
 	{
@@ -78,6 +119,42 @@ namespace expression_language
 	/// They should match the list of variable names supplied to the compile function.
 	bool run(const unsigned *byte_code, const float *variables, Stack &stack);
 
+	/// Runs the @a byte_code for @a n instances at once, four at a time on
+	/// SIMD lanes, and writes the value left on top of the stack by each
+	/// instance to @a out. @a variables holds the variables of the instances
+	/// one after the other: variable v of instance i is variables[v*stride + i].
+	/// @a stride must be a multiple of four and at least @a n; the padding
+	/// lanes are evaluated but never written to @a out. Returns false, leaving
+	/// @a out partially written, if the stack overflows or if the byte code
+	/// leaves nothing on the stack.
+	bool run_batch(const unsigned *byte_code, const float *variables, unsigned stride, unsigned n, float *out);
+
+	/// Evaluates the @a byte_code without running the interpreter when it
+	/// consists of a single variable or constant. Returns true and puts the
+	/// value into @a result in that case, false otherwise.
+	inline bool evaluate_trivial(const unsigned *byte_code, const float *variables, float &result)
+	{
+		const unsigned bc = byte_code[0];
+		if (bc == BC_END || byte_code[1] != BC_END)
+			return false;
+
+		if (bc_mask(bc) == BC_PUSH_VAR)
+		{
+			result = variables[id_mask(bc)];
+			return true;
+		}
+
+		if (is_float(bc))
+		{
+			union { unsigned u; float f; } fu;
+			fu.u = bc;
+			result = fu.f;
+			return true;
+		}
+
+		return false;
+	}
+
 } // namespace expression_language
 
 } // namespace skinny
@@ -5,21 +5,176 @@
 
 #include "core/containers/array.h"
 #include "core/containers/map.h"
+#include "core/containers/vector.h"
 #include "core/filesystem/file.h"
 #include "core/filesystem/filesystem.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/vector3.h"
 #include "core/memory/memory.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
+#include "device/device.h"
 #include "resource/compile_options.h"
 #include "resource/level_resource.h"
+#include "resource/mesh_resource.h"
+#include "resource/resource_manager.h"
 #include "resource/unit_compiler.h"
+#include "world/types.h"
+#include "world/unit_template.h"
+#include <algorithm> // std::sort
+#include <math.h>      // floorf
 
 namespace crown
 {
 namespace level_resource_internal
 {
+	struct CellUnit
+	{
+		s32 x;
+		s32 y;
+		s32 z;
+		u32 index;
+		const char* json;
+
+		bool same_cell(const CellUnit& a) const
+		{
+			return x == a.x && y == a.y && z == a.z;
+		}
+
+		bool operator<(const CellUnit& a) const
+		{
+			if (x != a.x) return x < a.x;
+			if (y != a.y) return y < a.y;
+			if (z != a.z) return z < a.z;
+			return index < a.index;
+		}
+	};
+
+	// Returns the position of the transform component of the @a unit, or
+	// the origin if it has none of its own.
+	static Vector3 unit_position(const char* unit)
+	{
+		TempAllocator4096 ta;
+		JsonObject obj(ta);
+		sjson::parse(unit, obj);
+
+		const char* sections[] = { "modified_components", "components" };
+		for (u32 i = 0; i < countof(sections); ++i)
+		{
+			if (!json_object::has(obj, sections[i]))
+				continue;
+
+			JsonObject components(ta);
+			sjson::parse_object(obj[sections[i]], components);
+
+			auto cur = json_object::begin(components);
+			auto end = json_object::end(components);
+			for (; cur != end; ++cur)
+			{
+				JsonObject component(ta);
+				sjson::parse_object(cur->pair.second, component);
+
+				if (sjson::parse_string_id(component["type"]) != COMPONENT_TYPE_TRANSFORM)
+					continue;
+
+				JsonObject data(ta);
+				sjson::parse_object(component["data"], data);
+				return sjson::parse_vector3(data["position"]);
+			}
+		}
+
+		return VECTOR3_ZERO;
+	}
+
+	struct StaticMesh
+	{
+		StringId64 material;
+		StringId64 mesh;
+		StringId32 geometry;
+		u32 name;       ///< Index of the names of the mesh and of the geometry.
+		Matrix4x4 pose;
+
+		bool operator<(const StaticMesh& a) const
+		{
+			if (material != a.material) return material < a.material;
+			if (mesh != a.mesh) return mesh < a.mesh;
+			return geometry < a.geometry;
+		}
+	};
+
+	// Unit which holds the merged static meshes of a batch.
+	static const char* s_batch_unit = "{"
+		"components = {"
+			"batch = {"
+				"type = \"transform\" "
+				"data = { position = [ 0 0 0 ] rotation = [ 0 0 0 1 ] scale = [ 1 1 1 ] }"
+			"}"
+		"}"
+	"}";
+
+	// Returns whether the @a unit only has a transform and a visible mesh
+	// renderer, and if so, writes them to @a sm and the names of its mesh
+	// and geometry to @a names.
+	static bool parse_static_mesh(CompileOptions& opts, UnitCompiler& uc, const char* unit, StaticMesh& sm, Vector<DynamicString>& names)
+	{
+		TempAllocator4096 ta;
+		JsonObject components(ta);
+		uc.parse_components(unit, components);
+
+		if (json_object::size(components) != 2)
+			return false;
+
+		const char* transform = NULL;
+		const char* mesh_renderer = NULL;
+
+		auto cur = json_object::begin(components);
+		auto end = json_object::end(components);
+		for (; cur != end; ++cur)
+		{
+			JsonObject component(ta);
+			sjson::parse_object(cur->pair.second, component);
+
+			const StringId32 type = sjson::parse_string_id(component["type"]);
+			if (type == COMPONENT_TYPE_TRANSFORM)
+				transform = component["data"];
+			else if (type == COMPONENT_TYPE_MESH_RENDERER)
+				mesh_renderer = component["data"];
+		}
+
+		if (transform == NULL || mesh_renderer == NULL)
+			return false;
+
+		JsonObject mrd(ta);
+		sjson::parse_object(mesh_renderer, mrd);
+		if (!sjson::parse_bool(mrd["visible"]))
+			return false;
+
+		DynamicString mesh(ta);
+		DynamicString geometry(ta);
+		sjson::parse_string(mrd["mesh_resource"], mesh);
+		sjson::parse_string(mrd["geometry_name"], geometry);
+		DATA_COMPILER_ASSERT_RESOURCE_EXISTS("mesh"
+			, mesh.c_str()
+			, opts
+			);
+
+		// Scale is not applied to meshes when units are spawned either
+		JsonObject td(ta);
+		sjson::parse_object(transform, td);
+
+		sm.material = sjson::parse_resource_id(mrd["material"]);
+		sm.mesh     = sjson::parse_resource_id(mrd["mesh_resource"]);
+		sm.geometry = sjson::parse_string_id(mrd["geometry_name"]);
+		sm.name     = vector::size(names);
+		sm.pose     = matrix4x4(sjson::parse_quaternion(td["rotation"]), sjson::parse_vector3(td["position"]));
+
+		vector::push_back(names, mesh);
+		vector::push_back(names, geometry);
+		return true;
+	}
+
 	void compile(CompileOptions& opts)
 	{
 		Buffer buf = opts.read();
@@ -57,23 +212,174 @@ namespace level_resource_internal
 			}
 		}
 
+		Array<StringId64> neighbours(default_allocator());
+		if (json_object::has(object, "neighbours"))
+		{
+			JsonArray neighbours_json(ta);
+			sjson::parse_array(object["neighbours"], neighbours_json);
+
+			for (u32 i = 0; i < array::size(neighbours_json); ++i)
+			{
+				DynamicString package_name(ta);
+				sjson::parse_string(neighbours_json[i], package_name);
+				DATA_COMPILER_ASSERT_RESOURCE_EXISTS("package"
+					, package_name.c_str()
+					, opts
+					);
+
+				array::push_back(neighbours, sjson::parse_resource_id(neighbours_json[i]));
+			}
+		}
+
 		UnitCompiler uc(opts);
-		uc.compile_multiple_units(object["units"]);
-		Buffer unit_blob = uc.blob();
+		Array<LevelCell> cells(default_allocator());
+
+		const f32 cell_size = json_object::has(object, "cell_size")
+			? sjson::parse_float(object["cell_size"])
+			: 0.0f
+			;
+
+		// Optionally merge the static meshes of each cell which share a
+		// material. A mesh is static if its unit only has a transform and
+		// a mesh renderer.
+		const bool static_batching = json_object::has(object, "static_batching")
+			? sjson::parse_bool(object["static_batching"])
+			: false
+			;
+
+		Array<CellUnit> units(default_allocator());
+		{
+			DynamicString key(ta);
+			const char* value;
+			const char* json = object["units"];
+			while ((json = sjson::parse_object_member(json, key, value)) != NULL)
+			{
+				const Vector3 pos = cell_size > 0.0f ? unit_position(value) : VECTOR3_ZERO;
+
+				CellUnit cu;
+				cu.x = cell_size > 0.0f ? (s32)floorf(pos.x / cell_size) : 0;
+				cu.y = cell_size > 0.0f ? (s32)floorf(pos.y / cell_size) : 0;
+				cu.z = cell_size > 0.0f ? (s32)floorf(pos.z / cell_size) : 0;
+				cu.index = array::size(units);
+				cu.json = value;
+				array::push_back(units, cu);
+			}
+		}
+
+		// Sort the units by cell so that the units of each cell can be
+		// spawned as a single range.
+		std::sort(array::begin(units), array::end(units));
+
+		Array<const char*> units_json(default_allocator());
+		Array<StaticMesh> static_meshes(default_allocator());
+		Vector<DynamicString> names(default_allocator());
+		Array<LevelBatch> batches(default_allocator());
+		Array<u32> mesh_batch(default_allocator());
+
+		for (u32 i = 0; i < array::size(units); )
+		{
+			u32 end = i + 1;
+			while (end < array::size(units) && units[end].same_cell(units[i]))
+				++end;
+
+			const u32 first_unit = array::size(units_json);
+			const u32 first_mesh = array::size(static_meshes);
+
+			for (u32 j = i; j < end; ++j)
+			{
+				StaticMesh sm;
+				if (static_batching && parse_static_mesh(opts, uc, units[j].json, sm, names))
+					array::push_back(static_meshes, sm);
+				else
+					array::push_back(units_json, units[j].json);
+			}
+
+			// Spawn each batch of the cell with a unit of its own
+			StaticMesh* meshes = array::begin(static_meshes) + first_mesh;
+			const u32 num_meshes = array::size(static_meshes) - first_mesh;
+			std::sort(meshes, meshes + num_meshes);
+
+			for (u32 j = 0; j < num_meshes; ++j)
+			{
+				if (j == 0 || meshes[j].material != meshes[j - 1].material)
+				{
+					LevelBatch lb;
+					lb.material = meshes[j].material;
+					lb.unit = array::size(units_json);
+					lb._pad = 0;
+					array::push_back(batches, lb);
+					array::push_back(units_json, s_batch_unit);
+				}
+
+				array::push_back(mesh_batch, array::size(batches) - 1);
+			}
+
+			if (cell_size > 0.0f)
+			{
+				const CellUnit& cu = units[i];
+
+				LevelCell cell;
+				cell.bounds.min = vector3(cu.x*cell_size, cu.y*cell_size, cu.z*cell_size);
+				cell.bounds.max = cell.bounds.min + vector3(cell_size, cell_size, cell_size);
+				cell.first_unit = first_unit;
+				cell.num_units = array::size(units_json) - first_unit;
+				array::push_back(cells, cell);
+			}
+
+			i = end;
+		}
+
+		uc.compile_multiple_units(array::begin(units_json), array::size(units_json));
+
+		Buffer batch_mesh(default_allocator());
+		if (array::size(batches) > 0)
+		{
+			Array<mesh_resource_internal::MeshBatchInstance> instances(default_allocator());
+			array::resize(instances, array::size(static_meshes));
+			for (u32 i = 0; i < array::size(static_meshes); ++i)
+			{
+				instances[i].batch    = mesh_batch[i];
+				instances[i].mesh     = names[static_meshes[i].name + 0].c_str();
+				instances[i].geometry = names[static_meshes[i].name + 1].c_str();
+				instances[i].pose     = static_meshes[i].pose;
+			}
+
+			mesh_resource_internal::compile_batches(opts
+				, batch_mesh
+				, array::begin(instances)
+				, array::size(instances)
+				);
+		}
 
 		// Write
 		LevelResource lr;
 		lr.version       = RESOURCE_VERSION_LEVEL;
 		lr.num_sounds    = array::size(sounds);
 		lr.units_offset  = sizeof(LevelResource);
-		lr.sounds_offset = lr.units_offset + array::size(unit_blob);
+		lr.sounds_offset = lr.units_offset + uc.blob_size();
+		lr.num_neighbours    = array::size(neighbours);
+		lr.neighbours_offset = lr.sounds_offset + sizeof(LevelSound)*lr.num_sounds;
+		lr.num_cells         = array::size(cells);
+		lr.cells_offset      = lr.neighbours_offset + sizeof(StringId64)*lr.num_neighbours;
+		lr.num_batches       = array::size(batches);
+		lr.batches_offset    = lr.cells_offset + sizeof(LevelCell)*lr.num_cells;
+		lr.batch_mesh_offset = lr.batches_offset + sizeof(LevelBatch)*lr.num_batches;
+		lr.batch_mesh_size   = array::size(batch_mesh);
 
 		opts.write(lr.version);
 		opts.write(lr.units_offset);
 		opts.write(lr.num_sounds);
 		opts.write(lr.sounds_offset);
+		opts.write(lr.num_neighbours);
+		opts.write(lr.neighbours_offset);
+		opts.write(lr.num_cells);
+		opts.write(lr.cells_offset);
+		opts.write(lr.num_batches);
+		opts.write(lr.batches_offset);
+		opts.write(lr.batch_mesh_offset);
+		opts.write(lr.batch_mesh_size);
 
-		opts.write(unit_blob);
+		uc.write_blob();
 
 		for (u32 i = 0; i < array::size(sounds); ++i)
 		{
@@ -86,6 +392,37 @@ namespace level_resource_internal
 			opts.write(sounds[i]._pad[1]);
 			opts.write(sounds[i]._pad[2]);
 		}
+
+		for (u32 i = 0; i < array::size(neighbours); ++i)
+			opts.write(neighbours[i]);
+
+		for (u32 i = 0; i < array::size(cells); ++i)
+		{
+			opts.write(cells[i].bounds);
+			opts.write(cells[i].first_unit);
+			opts.write(cells[i].num_units);
+		}
+
+		for (u32 i = 0; i < array::size(batches); ++i)
+		{
+			opts.write(batches[i].material);
+			opts.write(batches[i].unit);
+			opts.write(batches[i]._pad);
+		}
+
+		opts.write(batch_mesh);
+	}
+
+	void online(StringId64 id, ResourceManager& rm)
+	{
+		const LevelResource* lr = (const LevelResource*)rm.get(RESOURCE_TYPE_LEVEL, id);
+		device()->_unit_template_manager->create(level_resource::unit_resource(lr));
+	}
+
+	void offline(StringId64 id, ResourceManager& rm)
+	{
+		const LevelResource* lr = (const LevelResource*)rm.get(RESOURCE_TYPE_LEVEL, id);
+		device()->_unit_template_manager->destroy(level_resource::unit_resource(lr));
 	}
 
 } // namespace level_resource_internal
@@ -109,6 +446,48 @@ namespace level_resource
 		return &begin[i];
 	}
 
+	u32 num_neighbours(const LevelResource* lr)
+	{
+		return lr->num_neighbours;
+	}
+
+	StringId64 get_neighbour(const LevelResource* lr, u32 i)
+	{
+		CE_ASSERT(i < num_neighbours(lr), "Index out of bounds");
+		const StringId64* begin = (StringId64*)((char*)lr + lr->neighbours_offset);
+		return begin[i];
+	}
+
+	u32 num_cells(const LevelResource* lr)
+	{
+		return lr->num_cells;
+	}
+
+	const LevelCell* get_cell(const LevelResource* lr, u32 i)
+	{
+		CE_ASSERT(i < num_cells(lr), "Index out of bounds");
+		const LevelCell* begin = (LevelCell*)((char*)lr + lr->cells_offset);
+		return &begin[i];
+	}
+
+	u32 num_batches(const LevelResource* lr)
+	{
+		return lr->num_batches;
+	}
+
+	const LevelBatch* get_batch(const LevelResource* lr, u32 i)
+	{
+		CE_ASSERT(i < num_batches(lr), "Index out of bounds");
+		const LevelBatch* begin = (LevelBatch*)((char*)lr + lr->batches_offset);
+		return &begin[i];
+	}
+
+	const void* batch_mesh(const LevelResource* lr, u32& size)
+	{
+		size = lr->batch_mesh_size;
+		return (char*)lr + lr->batch_mesh_offset;
+	}
+
 } // namespace level_resource
 
 } // namespace crown
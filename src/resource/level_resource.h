@@ -10,7 +10,6 @@
 #include "core/memory/types.h"
 #include "core/strings/string_id.h"
 #include "resource/types.h"
-#include "resource/types.h"
 
 namespace crown
 {
@@ -20,6 +19,14 @@ struct LevelResource
 	u32 units_offset;
 	u32 num_sounds;
 	u32 sounds_offset;
+	u32 num_neighbours;
+	u32 neighbours_offset;
+	u32 num_cells;
+	u32 cells_offset;
+	u32 num_batches;
+	u32 batches_offset;
+	u32 batch_mesh_offset;
+	u32 batch_mesh_size;
 };
 
 struct LevelSound
@@ -32,10 +39,34 @@ struct LevelSound
 	char _pad[3];
 };
 
+/// Region of a level whose units are spawned and destroyed together when
+/// the level is streamed. See Level::stream().
+struct LevelCell
+{
+	AABB bounds;    ///< Bounds of the cell in level space.
+	u32 first_unit; ///< Index of the first unit of the cell.
+	u32 num_units;  ///< Number of units in the cell.
+};
+
+/// Static meshes of a cell merged at compile time. The merged geometry is
+/// rendered by the unit @a unit, which is spawned with the cell.
+struct LevelBatch
+{
+	StringId64 material; ///< Material shared by the merged meshes.
+	u32 unit;            ///< Index of the unit which renders the batch.
+	u32 _pad;
+};
+
 namespace level_resource_internal
 {
 	void compile(CompileOptions& opts);
 
+	///
+	void online(StringId64 id, ResourceManager& rm);
+
+	///
+	void offline(StringId64 id, ResourceManager& rm);
+
 } // namespace level_resource_internal
 
 namespace level_resource
@@ -49,6 +80,31 @@ namespace level_resource
 	/// Returns the sound @a i.
 	const LevelSound* get_sound(const LevelResource* lr, u32 i);
 
+	/// Returns the number of packages the level declares as its neighbours.
+	u32 num_neighbours(const LevelResource* lr);
+
+	/// Returns the name of the neighbour package @a i.
+	StringId64 get_neighbour(const LevelResource* lr, u32 i);
+
+	/// Returns the number of cells of the level, or 0 if it has not been
+	/// partitioned with a cell_size.
+	u32 num_cells(const LevelResource* lr);
+
+	/// Returns the cell @a i. Cells are sorted by position and their units
+	/// are contiguous.
+	const LevelCell* get_cell(const LevelResource* lr, u32 i);
+
+	/// Returns the number of batches of static meshes of the level.
+	u32 num_batches(const LevelResource* lr);
+
+	/// Returns the batch @a i. Its geometry is the geometry @a i of the
+	/// batch mesh.
+	const LevelBatch* get_batch(const LevelResource* lr, u32 i);
+
+	/// Returns the mesh resource, in its compiled form, which holds the
+	/// geometries of the batches and writes its @a size.
+	const void* batch_mesh(const LevelResource* lr, u32& size);
+
 } // namespace level_resource
 
 } // namespace crown
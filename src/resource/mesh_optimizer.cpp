@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/math/aabb.h"
+#include "core/math/vector3.h"
+#include "core/memory/memory.h"
+#include "resource/mesh_optimizer.h"
+#include <algorithm> // std::sort
+#include <math.h>    // powf, sqrtf
+#include <string.h>  // memcpy
+
+namespace crown
+{
+namespace mesh_optimizer
+{
+	// Size of the simulated LRU vertex cache.
+	static const u32 CACHE_SIZE = 32;
+
+	static f32 vertex_score(s32 cache_pos, u32 num_live_triangles)
+	{
+		// No triangles left to emit: the vertex is of no use anymore
+		if (num_live_triangles == 0)
+			return -1.0f;
+
+		f32 score = 0.0f;
+		if (cache_pos >= 0)
+		{
+			// Vertices used by the last triangle get a fixed score so that
+			// the next triangle does not always share an edge with it
+			if (cache_pos < 3)
+			{
+				score = 0.75f;
+			}
+			else
+			{
+				const f32 s = 1.0f - f32(cache_pos - 3) / f32(CACHE_SIZE - 3);
+				score = powf(s, 1.5f);
+			}
+		}
+
+		// Favor vertices with few triangles left to get rid of them quickly
+		score += 2.0f / sqrtf(f32(num_live_triangles));
+		return score;
+	}
+
+	void optimize_vertex_cache(u32* indices, u32 num_indices, u32 num_vertices)
+	{
+		const u32 num_triangles = num_indices / 3;
+		if (num_triangles == 0)
+			return;
+
+		Allocator& a = default_allocator();
+
+		// Build the vertex-triangle adjacency. The live triangles of vertex
+		// v are adjacency[offsets[v]] .. adjacency[offsets[v] + num_live[v]]
+		Array<u32> num_live(a);
+		Array<u32> offsets(a);
+		Array<u32> adjacency(a);
+		array::resize(num_live, num_vertices);
+		array::resize(offsets, num_vertices);
+		array::resize(adjacency, num_triangles*3);
+		memset(array::begin(num_live), 0, num_vertices*sizeof(u32));
+
+		for (u32 i = 0; i < num_triangles*3; ++i)
+			++num_live[indices[i]];
+
+		u32 offset = 0;
+		for (u32 v = 0; v < num_vertices; ++v)
+		{
+			offsets[v] = offset;
+			offset += num_live[v];
+			num_live[v] = 0;
+		}
+
+		for (u32 i = 0; i < num_triangles*3; ++i)
+		{
+			const u32 v = indices[i];
+			adjacency[offsets[v] + num_live[v]++] = i / 3;
+		}
+
+		// Initial scores
+		Array<s32> cache_pos(a);
+		Array<f32> score(a);
+		Array<u8> emitted(a);
+		array::resize(cache_pos, num_vertices);
+		array::resize(score, num_vertices);
+		array::resize(emitted, num_triangles);
+		memset(array::begin(emitted), 0, num_triangles);
+
+		for (u32 v = 0; v < num_vertices; ++v)
+		{
+			cache_pos[v] = -1;
+			score[v] = vertex_score(-1, num_live[v]);
+		}
+
+		s32 best_triangle = 0;
+		f32 best_score = -1.0f;
+		for (u32 t = 0; t < num_triangles; ++t)
+		{
+			const u32* tri = &indices[t*3];
+			const f32 ts = score[tri[0]] + score[tri[1]] + score[tri[2]];
+
+			if (ts > best_score)
+			{
+				best_score = ts;
+				best_triangle = t;
+			}
+		}
+
+		Array<u32> output(a);
+		array::resize(output, num_triangles*3);
+
+		u32 cache[CACHE_SIZE + 3];
+		u32 cache_size = 0;
+		u32 next_unemitted = 0;
+
+		for (u32 t = 0; t < num_triangles; ++t)
+		{
+			// No candidates in cache: pick the first triangle not emitted yet
+			if (best_triangle < 0)
+			{
+				while (emitted[next_unemitted])
+					++next_unemitted;
+				best_triangle = next_unemitted;
+			}
+
+			const u32* tri = &indices[best_triangle*3];
+			output[t*3 + 0] = tri[0];
+			output[t*3 + 1] = tri[1];
+			output[t*3 + 2] = tri[2];
+			emitted[best_triangle] = 1;
+
+			// Remove the triangle from the live triangles of its vertices
+			for (u32 i = 0; i < 3; ++i)
+			{
+				const u32 v = tri[i];
+				u32* live = &adjacency[offsets[v]];
+
+				for (u32 j = 0; j < num_live[v]; ++j)
+				{
+					if (live[j] == u32(best_triangle))
+					{
+						live[j] = live[num_live[v] - 1];
+						--num_live[v];
+						break;
+					}
+				}
+			}
+
+			// Move the triangle's vertices to the front of the cache
+			u32 new_cache[CACHE_SIZE + 3];
+			u32 new_cache_size = 0;
+
+			for (u32 i = 0; i < 3; ++i)
+			{
+				if (new_cache_size > 0 && new_cache[0] == tri[i])
+					continue;
+				if (new_cache_size > 1 && new_cache[1] == tri[i])
+					continue;
+				new_cache[new_cache_size++] = tri[i];
+			}
+
+			for (u32 i = 0; i < cache_size; ++i)
+			{
+				const u32 v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+					new_cache[new_cache_size++] = v;
+			}
+
+			// Update the scores of the vertices in the cache, including
+			// the ones which have just been evicted
+			for (u32 i = 0; i < new_cache_size; ++i)
+			{
+				const u32 v = new_cache[i];
+				cache_pos[v] = i < CACHE_SIZE ? s32(i) : -1;
+				score[v] = vertex_score(cache_pos[v], num_live[v]);
+			}
+
+			// Find the best candidate among the triangles touched by the cache
+			best_triangle = -1;
+			best_score = -1.0f;
+			for (u32 i = 0; i < new_cache_size; ++i)
+			{
+				const u32 v = new_cache[i];
+				const u32* live = &adjacency[offsets[v]];
+
+				for (u32 j = 0; j < num_live[v]; ++j)
+				{
+					const u32* lt = &indices[live[j]*3];
+					const f32 ts = score[lt[0]] + score[lt[1]] + score[lt[2]];
+
+					if (ts > best_score)
+					{
+						best_score = ts;
+						best_triangle = live[j];
+					}
+				}
+			}
+
+			cache_size = new_cache_size < CACHE_SIZE ? new_cache_size : CACHE_SIZE;
+			memcpy(cache, new_cache, cache_size*sizeof(u32));
+		}
+
+		memcpy(indices, array::begin(output), num_triangles*3*sizeof(u32));
+	}
+
+	static const Vector3& position(const void* positions, u32 stride, u32 v)
+	{
+		return *(const Vector3*)((const char*)positions + v*stride);
+	}
+
+	struct Cluster
+	{
+		u32 offset;
+		u32 num_indices;
+		f32 sort_key;
+
+		bool operator<(const Cluster& other) const
+		{
+			return sort_key > other.sort_key;
+		}
+	};
+
+	void optimize_overdraw(u32* indices, u32 num_indices, const void* positions, u32 stride, u32 num_vertices)
+	{
+		const u32 num_triangles = num_indices / 3;
+		if (num_triangles == 0)
+			return;
+
+		Allocator& a = default_allocator();
+
+		// Split the triangles into clusters. A new cluster starts whenever
+		// a triangle misses the (simulated FIFO) vertex cache entirely, so
+		// that reordering whole clusters barely affects the cache hit ratio.
+		Array<u32> cache_time(a);
+		array::resize(cache_time, num_vertices);
+		memset(array::begin(cache_time), 0, num_vertices*sizeof(u32));
+		u32 time = CACHE_SIZE + 1;
+
+		Array<Cluster> clusters(a);
+		for (u32 t = 0; t < num_triangles; ++t)
+		{
+			u32 num_misses = 0;
+			for (u32 i = 0; i < 3; ++i)
+			{
+				const u32 v = indices[t*3 + i];
+				if (time - cache_time[v] > CACHE_SIZE)
+				{
+					cache_time[v] = time++;
+					++num_misses;
+				}
+			}
+
+			if (t == 0 || num_misses == 3)
+			{
+				Cluster c;
+				c.offset = t*3;
+				c.num_indices = 0;
+				c.sort_key = 0.0f;
+				array::push_back(clusters, c);
+			}
+
+			array::back(clusters).num_indices += 3;
+		}
+
+		if (array::size(clusters) < 2)
+			return;
+
+		// Mesh centroid
+		Vector3 mesh_centroid = VECTOR3_ZERO;
+		for (u32 i = 0; i < num_triangles*3; ++i)
+			mesh_centroid += position(positions, stride, indices[i]);
+		mesh_centroid *= 1.0f / f32(num_triangles*3);
+
+		// Clusters which face away from the center of the mesh are more
+		// likely to occlude the others: draw them first
+		for (u32 c = 0; c < array::size(clusters); ++c)
+		{
+			Cluster& cl = clusters[c];
+
+			Vector3 centroid = VECTOR3_ZERO;
+			Vector3 normal = VECTOR3_ZERO;
+			f32 area = 0.0f;
+
+			for (u32 i = cl.offset; i < cl.offset + cl.num_indices; i += 3)
+			{
+				const Vector3& v0 = position(positions, stride, indices[i + 0]);
+				const Vector3& v1 = position(positions, stride, indices[i + 1]);
+				const Vector3& v2 = position(positions, stride, indices[i + 2]);
+
+				// Normal is weighted by twice the area of the triangle
+				const Vector3 n = cross(v1 - v0, v2 - v0);
+				const f32 w = length(n);
+
+				centroid += (v0 + v1 + v2) * (w / 3.0f);
+				normal += n;
+				area += w;
+			}
+
+			if (area > 0.0f)
+				centroid *= 1.0f / area;
+
+			const f32 len = length(normal);
+			cl.sort_key = len > 0.0f ? dot(centroid - mesh_centroid, normal) / len : 0.0f;
+		}
+
+		std::sort(array::begin(clusters), array::end(clusters));
+
+		Array<u32> output(a);
+		array::reserve(output, num_triangles*3);
+		for (u32 c = 0; c < array::size(clusters); ++c)
+			array::push(output, &indices[clusters[c].offset], clusters[c].num_indices);
+
+		memcpy(indices, array::begin(output), num_triangles*3*sizeof(u32));
+	}
+
+	u32 optimize_vertex_fetch(void* dst, const void* vertices, u32 stride, u32 num_vertices, u32* indices, u32 num_indices)
+	{
+		Array<u32> remap(default_allocator());
+		array::resize(remap, num_vertices);
+		memset(array::begin(remap), 0xff, num_vertices*sizeof(u32));
+
+		u32 num = 0;
+		for (u32 i = 0; i < num_indices; ++i)
+		{
+			const u32 v = indices[i];
+			if (remap[v] == UINT32_MAX)
+			{
+				memcpy((char*)dst + num*stride, (const char*)vertices + v*stride, stride);
+				remap[v] = num++;
+			}
+
+			indices[i] = remap[v];
+		}
+
+		return num;
+	}
+
+	// Collapses the vertices into the cells of a grid with @a size cells
+	// along each axis and writes the surviving triangles to @a dst.
+	static u32 simplify_grid(u32* dst
+		, const u32* indices
+		, u32 num_indices
+		, const void* positions
+		, u32 stride
+		, u32 num_vertices
+		, const AABB& bounds
+		, u32 size
+		)
+	{
+		HashMap<u32, u32> cells(default_allocator());
+		Array<u32> remap(default_allocator());
+		array::resize(remap, num_vertices);
+
+		const Vector3 extents = bounds.max - bounds.min;
+		const f32 scale_x = extents.x > 0.0f ? f32(size) / extents.x : 0.0f;
+		const f32 scale_y = extents.y > 0.0f ? f32(size) / extents.y : 0.0f;
+		const f32 scale_z = extents.z > 0.0f ? f32(size) / extents.z : 0.0f;
+
+		for (u32 v = 0; v < num_vertices; ++v)
+		{
+			const Vector3 p = position(positions, stride, v) - bounds.min;
+			u32 x = u32(p.x * scale_x);
+			u32 y = u32(p.y * scale_y);
+			u32 z = u32(p.z * scale_z);
+			x = x < size ? x : size - 1;
+			y = y < size ? y : size - 1;
+			z = z < size ? z : size - 1;
+
+			// The first vertex of each cell represents the whole cell
+			const u32 cell = x + (y + z*size)*size;
+			remap[v] = hash_map::get(cells, cell, v);
+			if (remap[v] == v)
+				hash_map::set(cells, cell, v);
+		}
+
+		u32 num = 0;
+		for (u32 i = 0; i < num_indices; i += 3)
+		{
+			const u32 a = remap[indices[i + 0]];
+			const u32 b = remap[indices[i + 1]];
+			const u32 c = remap[indices[i + 2]];
+
+			if (a == b || b == c || c == a)
+				continue;
+
+			dst[num++] = a;
+			dst[num++] = b;
+			dst[num++] = c;
+		}
+
+		return num;
+	}
+
+	u32 simplify(u32* dst, const u32* indices, u32 num_indices, const void* positions, u32 stride, u32 num_vertices, u32 target_num_indices)
+	{
+		if (num_indices <= target_num_indices)
+		{
+			memcpy(dst, indices, num_indices*sizeof(u32));
+			return num_indices;
+		}
+
+		AABB bounds;
+		aabb::from_points(bounds, num_vertices, stride, (const f32*)positions);
+
+		// Binary search for the finest grid which meets the target
+		u32 lo = 1;
+		u32 hi = 1024;
+		while (lo < hi)
+		{
+			const u32 mid = (lo + hi + 1) / 2;
+			if (simplify_grid(dst, indices, num_indices, positions, stride, num_vertices, bounds, mid) <= target_num_indices)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		return simplify_grid(dst, indices, num_indices, positions, stride, num_vertices, bounds, lo);
+	}
+
+} // namespace mesh_optimizer
+
+} // namespace crown
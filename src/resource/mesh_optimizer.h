@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+namespace crown
+{
+/// Functions to reorder indexed triangle lists for faster rendering.
+/// All the functions operate on lists of @a num_indices indices
+/// referencing @a num_vertices vertices.
+///
+/// @ingroup Resource
+namespace mesh_optimizer
+{
+	/// Reorders the triangles in @a indices to maximize post-transform
+	/// vertex cache hits.
+	/// See: Tom Forsyth, Linear-Speed Vertex Cache Optimisation.
+	void optimize_vertex_cache(u32* indices, u32 num_indices, u32 num_vertices);
+
+	/// Reorders the triangles in @a indices to reduce overdraw while
+	/// preserving most of the vertex cache efficiency. @a positions points
+	/// to the Vector3 position of the first vertex and @a stride is the
+	/// distance in bytes between two consecutive vertices.
+	/// It should be called after optimize_vertex_cache().
+	void optimize_overdraw(u32* indices, u32 num_indices, const void* positions, u32 stride, u32 num_vertices);
+
+	/// Copies to @a dst the vertices in @a vertices in the order they are
+	/// first referenced by @a indices, and remaps @a indices accordingly.
+	/// Vertices not referenced by any triangle are discarded.
+	/// Returns the number of vertices written to @a dst.
+	u32 optimize_vertex_fetch(void* dst, const void* vertices, u32 stride, u32 num_vertices, u32* indices, u32 num_indices);
+
+	/// Writes to @a dst a coarser version of the triangles in @a indices
+	/// with at most @a target_num_indices indices. The vertices falling
+	/// in the same cell of a uniform grid are collapsed into one of them,
+	/// using the finest grid which meets the target, and the triangles
+	/// which become degenerate are discarded.
+	/// Returns the number of indices written to @a dst.
+	u32 simplify(u32* dst, const u32* indices, u32 num_indices, const void* positions, u32 stride, u32 num_vertices, u32 target_num_indices);
+
+} // namespace mesh_optimizer
+
+} // namespace crown
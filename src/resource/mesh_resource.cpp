@@ -3,6 +3,9 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
 #include "core/containers/map.h"
 #include "core/containers/vector.h"
 #include "core/filesystem/filesystem.h"
@@ -13,17 +16,49 @@
 #include "core/math/matrix4x4.h"
 #include "core/math/vector2.h"
 #include "core/math/vector3.h"
+#include "core/math/vector4.h"
 #include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
 #include "core/strings/dynamic_string.h"
+#include "device/gpu_memory.h"
 #include "device/log.h"
 #include "resource/compile_options.h"
+#include "resource/mesh_optimizer.h"
 #include "resource/mesh_resource.h"
 #include "resource/resource_manager.h"
+#include <bx/uint32_t.h> // bx::halfFromFloat
+#include <float.h> // FLT_MAX
+#include <string.h> // strcmp
 
 namespace crown
 {
 namespace mesh_resource_internal
 {
+	// Returns @a v in [-1, 1] as a 16-bit normalized integer.
+	static s16 snorm16(f32 v)
+	{
+		v = fclamp(v, -1.0f, 1.0f);
+		return s16(v * 32767.0f + (v >= 0.0f ? 0.5f : -0.5f));
+	}
+
+	// Returns the unit vector @a n projected on the octahedron and unfolded
+	// in the [-1, 1] square.
+	static Vector2 octahedral_encode(const Vector3& n)
+	{
+		const f32 l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+		if (l1 == 0.0f)
+			return VECTOR2_ZERO;
+
+		Vector2 e = { n.x / l1, n.y / l1 };
+		if (n.z < 0.0f)
+		{
+			const f32 x = e.x;
+			e.x = (1.0f - fabs(e.y)) * (x   >= 0.0f ? 1.0f : -1.0f);
+			e.y = (1.0f - fabs(x))   * (e.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return e;
+	}
+
 	struct MeshCompiler
 	{
 		CompileOptions& _opts;
@@ -33,45 +68,63 @@ namespace mesh_resource_internal
 		Array<f32> _uvs;
 		Array<f32> _tangents;
 		Array<f32> _binormals;
+		Array<f32> _joints;  ///< Four bones for each position.
+		Array<f32> _weights; ///< Weight of each of the four bones.
 
-		Array<u16> _position_indices;
-		Array<u16> _normal_indices;
-		Array<u16> _uv_indices;
-		Array<u16> _tangent_indices;
-		Array<u16> _binormal_indices;
+		Array<u32> _position_indices;
+		Array<u32> _normal_indices;
+		Array<u32> _uv_indices;
+		Array<u32> _tangent_indices;
+		Array<u32> _binormal_indices;
 
 		Matrix4x4 _matrix_local;
 
+		u32 _welded_stride;
+		Array<char> _welded_vertices;
+		Array<u32> _welded_indices;
+
 		u32 _vertex_stride;
 		Array<char> _vertex_buffer;
-		Array<u16> _index_buffer;
+		u32 _index_stride;
+		Array<char> _index_buffer;
 
 		AABB _aabb;
 		OBB _obb;
+		Vector4 _decode[2];
 
 		bgfx::VertexDecl _decl;
 
 		bool _has_normal;
 		bool _has_uv;
+		bool _has_skin;
+		bool _quantize;
 
-		MeshCompiler(CompileOptions& opts)
+		MeshCompiler(CompileOptions& opts, bool quantize)
 			: _opts(opts)
 			, _positions(default_allocator())
 			, _normals(default_allocator())
 			, _uvs(default_allocator())
 			, _tangents(default_allocator())
 			, _binormals(default_allocator())
+			, _joints(default_allocator())
+			, _weights(default_allocator())
 			, _position_indices(default_allocator())
 			, _normal_indices(default_allocator())
 			, _uv_indices(default_allocator())
 			, _tangent_indices(default_allocator())
 			, _binormal_indices(default_allocator())
 			, _matrix_local(MATRIX4X4_IDENTITY)
+			, _welded_stride(0)
+			, _welded_vertices(default_allocator())
+			, _welded_indices(default_allocator())
 			, _vertex_stride(0)
 			, _vertex_buffer(default_allocator())
+			, _index_stride(0)
 			, _index_buffer(default_allocator())
 			, _has_normal(false)
 			, _has_uv(false)
+			, _has_skin(false)
+			, _quantize(quantize)
 		{
 		}
 
@@ -82,6 +135,8 @@ namespace mesh_resource_internal
 			array::clear(_uvs);
 			array::clear(_tangents);
 			array::clear(_binormals);
+			array::clear(_joints);
+			array::clear(_weights);
 
 			array::clear(_position_indices);
 			array::clear(_normal_indices);
@@ -89,16 +144,23 @@ namespace mesh_resource_internal
 			array::clear(_tangent_indices);
 			array::clear(_binormal_indices);
 
+			_welded_stride = 0;
+			array::clear(_welded_vertices);
+			array::clear(_welded_indices);
+
 			_vertex_stride = 0;
 			array::clear(_vertex_buffer);
+			_index_stride = 0;
 			array::clear(_index_buffer);
 
 			aabb::reset(_aabb);
 			memset(&_obb, 0, sizeof(_obb));
+			memset(_decode, 0, sizeof(_decode));
 			memset((void*)&_decl, 0, sizeof(_decl));
 
 			_has_normal = false;
 			_has_uv = false;
+			_has_skin = false;
 		}
 
 		void parse(const char* geometry, const char* node)
@@ -111,6 +173,7 @@ namespace mesh_resource_internal
 
 			_has_normal = json_object::has(object, "normal");
 			_has_uv     = json_object::has(object, "texcoord");
+			_has_skin   = json_object::has(object, "skin");
 
 			parse_float_array(object["position"], _positions);
 
@@ -123,6 +186,30 @@ namespace mesh_resource_internal
 				parse_float_array(object["texcoord"], _uvs);
 			}
 
+			// Skinned geometries: skin = { joints = [ ... ] weights = [ ... ] },
+			// with the indices of four bones and their weights for each position
+			if (_has_skin)
+			{
+				JsonObject skin(ta);
+				sjson::parse(object["skin"], skin);
+				parse_float_array(skin["joints"], _joints);
+				parse_float_array(skin["weights"], _weights);
+
+				const u32 num_positions = array::size(_positions) / 3;
+				DATA_COMPILER_ASSERT(array::size(_joints) == num_positions*4 && array::size(_weights) == num_positions*4
+					, _opts
+					, "Skin must have four joints and weights for each position"
+					);
+				for (u32 i = 0; i < array::size(_joints); ++i)
+				{
+					DATA_COMPILER_ASSERT(_joints[i] >= 0.0f && _joints[i] < f32(CROWN_MAX_SKELETON_BONES)
+						, _opts
+						, "Joint index out of bounds: %g"
+						, _joints[i]
+						);
+				}
+			}
+
 			parse_indices(object["indices"]);
 
 			_matrix_local = sjson::parse_matrix4x4(object_node["matrix_local"]);
@@ -141,7 +228,7 @@ namespace mesh_resource_internal
 			}
 		}
 
-		void parse_index_array(const char* array_json, Array<u16>& output)
+		void parse_index_array(const char* array_json, Array<u32>& output)
 		{
 			TempAllocator4096 ta;
 			JsonArray array(ta);
@@ -150,7 +237,7 @@ namespace mesh_resource_internal
 			array::resize(output, array::size(array));
 			for (u32 i = 0; i < array::size(array); ++i)
 			{
-				output[i] = (u16)sjson::parse_int(array[i]);
+				output[i] = (u32)sjson::parse_int(array[i]);
 			}
 		}
 
@@ -175,85 +262,315 @@ namespace mesh_resource_internal
 			}
 		}
 
-		void compile()
+		/// Builds the vertex and index buffers of the welded geometry. If
+		/// the vertices are quantized, their positions are mapped from the
+		/// @a box to [-1, 1].
+		void compile(const AABB& box)
 		{
-			_vertex_stride = 0;
-			_vertex_stride += 3 * sizeof(f32);
-			_vertex_stride += (_has_normal ? 3 * sizeof(f32) : 0);
-			_vertex_stride += (_has_uv     ? 2 * sizeof(f32) : 0);
+			set_decode(box);
+			build(array::begin(_welded_indices), array::size(_welded_indices));
+		}
+
+		/// Returns the box enclosing the welded vertices.
+		AABB welded_aabb()
+		{
+			AABB box;
+			aabb::from_points(box
+				, array::size(_welded_vertices) / _welded_stride
+				, _welded_stride
+				, array::begin(_welded_vertices)
+				);
+			return box;
+		}
+
+		void set_decode(const AABB& box)
+		{
+			if (!_quantize)
+			{
+				_decode[0] = vector4(1.0f, 1.0f, 1.0f, 0.0f);
+				_decode[1] = VECTOR4_ZERO;
+				return;
+			}
+
+			const Vector3 scale = (box.max - box.min) * 0.5f;
+			const Vector3 bias = aabb::center(box);
+			_decode[0] = vector4(fmax(scale.x, FLT_EPSILON), fmax(scale.y, FLT_EPSILON), fmax(scale.z, FLT_EPSILON), 1.0f);
+			_decode[1] = vector4(bias.x, bias.y, bias.z, 0.0f);
+		}
+
+		void weld()
+		{
+			_welded_stride = 0;
+			_welded_stride += 3 * sizeof(f32);
+			_welded_stride += (_has_normal ? 3 * sizeof(f32) : 0);
+			_welded_stride += (_has_uv     ? 2 * sizeof(f32) : 0);
+			_welded_stride += (_has_skin   ? 8 * sizeof(f32) : 0);
+
+			const u32 num_indices = array::size(_position_indices);
 
-			// Generate vb/ib
-			array::resize(_index_buffer, array::size(_position_indices));
+			Array<char>& vertices = _welded_vertices;
+			Array<u32>& indices = _welded_indices;
+			HashMap<u64, u32> welded(default_allocator());
+			array::resize(indices, num_indices);
 
-			u16 index = 0;
-			for (u32 i = 0; i < array::size(_position_indices); ++i)
+			u32 num_vertices = 0;
+			for (u32 i = 0; i < num_indices; ++i)
 			{
-				_index_buffer[i] = index++;
+				f32 vertex[16];
+				u32 num = 0;
 
-				const u16 p_idx = _position_indices[i] * 3;
+				const u32 p_idx = _position_indices[i] * 3;
 				Vector3 xyz;
 				xyz.x = _positions[p_idx + 0];
 				xyz.y = _positions[p_idx + 1];
 				xyz.z = _positions[p_idx + 2];
 				xyz = xyz * _matrix_local;
-				array::push(_vertex_buffer, (char*)&xyz, sizeof(xyz));
+				vertex[num++] = xyz.x;
+				vertex[num++] = xyz.y;
+				vertex[num++] = xyz.z;
 
 				if (_has_normal)
 				{
-					const u16 n_idx = _normal_indices[i] * 3;
-					Vector3 n;
-					n.x = _normals[n_idx + 0];
-					n.y = _normals[n_idx + 1];
-					n.z = _normals[n_idx + 2];
-					array::push(_vertex_buffer, (char*)&n, sizeof(n));
+					const u32 n_idx = _normal_indices[i] * 3;
+					vertex[num++] = _normals[n_idx + 0];
+					vertex[num++] = _normals[n_idx + 1];
+					vertex[num++] = _normals[n_idx + 2];
 				}
 				if (_has_uv)
 				{
-					const u16 t_idx = _uv_indices[i] * 2;
-					Vector2 uv;
-					uv.x = _uvs[t_idx + 0];
-					uv.y = _uvs[t_idx + 1];
-					array::push(_vertex_buffer, (char*)&uv, sizeof(uv));
+					const u32 t_idx = _uv_indices[i] * 2;
+					vertex[num++] = _uvs[t_idx + 0];
+					vertex[num++] = _uvs[t_idx + 1];
+				}
+				if (_has_skin)
+				{
+					// Weights are normalized so that they sum to one
+					const u32 s_idx = _position_indices[i] * 4;
+					const f32 sum = _weights[s_idx + 0] + _weights[s_idx + 1] + _weights[s_idx + 2] + _weights[s_idx + 3];
+					const f32 inv_sum = sum > 0.0f ? 1.0f / sum : 0.0f;
+					for (u32 j = 0; j < 4; ++j)
+						vertex[num++] = _joints[s_idx + j];
+					for (u32 j = 0; j < 4; ++j)
+						vertex[num++] = _weights[s_idx + j] * inv_sum;
+				}
+
+				const u64 key = murmur64(vertex, _welded_stride, 0);
+				const u32 index = hash_map::get(welded, key, UINT32_MAX);
+
+				if (index != UINT32_MAX && memcmp(&vertices[index*_welded_stride], vertex, _welded_stride) == 0)
+				{
+					indices[i] = index;
 				}
+				else
+				{
+					array::push(vertices, (char*)vertex, _welded_stride);
+					hash_map::set(welded, key, num_vertices);
+					indices[i] = num_vertices++;
+				}
+			}
+
+			// Bounds
+			aabb::from_points(_aabb
+				, array::size(_positions) / 3
+				, sizeof(_positions[0]) * 3
+				, array::begin(_positions)
+				);
+
+			_obb.tm = matrix4x4(QUATERNION_IDENTITY, aabb::center(_aabb) * _matrix_local);
+			_obb.half_extents = (_aabb.max - _aabb.min) * 0.5f;
+		}
+
+		/// Builds the vertex and index buffers from the @a num_indices
+		/// @a indices referencing the welded vertices.
+		void build(const u32* welded_indices, u32 num_indices)
+		{
+			const u32 num_welded = array::size(_welded_vertices) / _welded_stride;
+			_vertex_stride = _welded_stride;
+
+			Array<u32> indices(default_allocator());
+			array::resize(indices, num_indices);
+			memcpy(array::begin(indices), welded_indices, num_indices*sizeof(u32));
+
+			// Optimize for vertex cache, overdraw and vertex fetch, in that order
+			mesh_optimizer::optimize_vertex_cache(array::begin(indices), num_indices, num_welded);
+			mesh_optimizer::optimize_overdraw(array::begin(indices), num_indices, array::begin(_welded_vertices), _vertex_stride, num_welded);
+
+			array::resize(_vertex_buffer, array::size(_welded_vertices));
+			const u32 num_vertices = mesh_optimizer::optimize_vertex_fetch(array::begin(_vertex_buffer)
+				, array::begin(_welded_vertices)
+				, _vertex_stride
+				, num_welded
+				, array::begin(indices)
+				, num_indices
+				);
+			array::resize(_vertex_buffer, num_vertices*_vertex_stride);
+
+			if (_quantize)
+				quantize(num_vertices);
+
+			// Use 16-bit indices whenever possible
+			_index_stride = num_vertices > UINT16_MAX ? sizeof(u32) : sizeof(u16);
+			array::resize(_index_buffer, num_indices*_index_stride);
+
+			if (_index_stride == sizeof(u32))
+			{
+				memcpy(array::begin(_index_buffer), array::begin(indices), num_indices*sizeof(u32));
+			}
+			else
+			{
+				u16* ib = (u16*)array::begin(_index_buffer);
+				for (u32 i = 0; i < num_indices; ++i)
+					ib[i] = (u16)indices[i];
 			}
 
 			// Vertex decl
 			_decl.begin();
-			_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
+			if (_quantize)
+				_decl.add(bgfx::Attrib::Position, 4, bgfx::AttribType::Int16, true);
+			else
+				_decl.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float);
 
 			if (_has_normal)
 			{
-				_decl.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float, true);
+				if (_quantize)
+					_decl.add(bgfx::Attrib::Normal, 2, bgfx::AttribType::Int16, true);
+				else
+					_decl.add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Float, true);
 			}
 			if (_has_uv)
 			{
-				_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+				if (_quantize)
+					_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Half);
+				else
+					_decl.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+			}
+			if (_has_skin)
+			{
+				if (_quantize)
+				{
+					_decl.add(bgfx::Attrib::Indices, 4, bgfx::AttribType::Uint8);
+					_decl.add(bgfx::Attrib::Weight, 4, bgfx::AttribType::Uint8, true);
+				}
+				else
+				{
+					_decl.add(bgfx::Attrib::Indices, 4, bgfx::AttribType::Float);
+					_decl.add(bgfx::Attrib::Weight, 4, bgfx::AttribType::Float);
+				}
 			}
 
 			_decl.end();
+		}
 
-			// Bounds
-			aabb::from_points(_aabb
-				, array::size(_positions) / 3
-				, sizeof(_positions[0]) * 3
-				, array::begin(_positions)
+		/// Writes to @a indices a coarser version of the welded geometry
+		/// with about @a ratio times its triangles.
+		void simplify(f32 ratio, Array<u32>& indices)
+		{
+			const u32 num_indices = array::size(_welded_indices);
+			const u32 target = u32(num_indices / 3 * fclamp(ratio, 0.0f, 1.0f)) * 3;
+
+			array::resize(indices, num_indices);
+			const u32 num = mesh_optimizer::simplify(array::begin(indices)
+				, array::begin(_welded_indices)
+				, num_indices
+				, array::begin(_welded_vertices)
+				, _welded_stride
+				, array::size(_welded_vertices) / _welded_stride
+				, target
 				);
+			array::resize(indices, num);
+		}
 
-			_obb.tm = matrix4x4(QUATERNION_IDENTITY, aabb::center(_aabb) * _matrix_local);
-			_obb.half_extents = (_aabb.max - _aabb.min) * 0.5f;
+		/// Converts positions to 16-bit normalized integers relative to the
+		/// box set by compile(), normals to octahedral 16-bit normalized
+		/// integers, texture coordinates to half floats and bone indices and
+		/// weights to 8-bit integers.
+		void quantize(u32 num_vertices)
+		{
+			u32 stride = 4 * sizeof(s16);
+			stride += (_has_normal ? 2 * sizeof(s16) : 0);
+			stride += (_has_uv     ? 2 * sizeof(u16) : 0);
+			stride += (_has_skin   ? 8 * sizeof(u8)  : 0);
+
+			Array<char> vb(default_allocator());
+			array::resize(vb, num_vertices*stride);
+
+			for (u32 i = 0; i < num_vertices; ++i)
+			{
+				const f32* src = (const f32*)&_vertex_buffer[i*_vertex_stride];
+				char* dst = &vb[i*stride];
+
+				s16* p = (s16*)dst;
+				p[0] = snorm16((src[0] - _decode[1].x) / _decode[0].x);
+				p[1] = snorm16((src[1] - _decode[1].y) / _decode[0].y);
+				p[2] = snorm16((src[2] - _decode[1].z) / _decode[0].z);
+				p[3] = 0;
+				src += 3;
+				dst += 4 * sizeof(s16);
+
+				if (_has_normal)
+				{
+					const Vector2 e = octahedral_encode(vector3(src[0], src[1], src[2]));
+					s16* n = (s16*)dst;
+					n[0] = snorm16(e.x);
+					n[1] = snorm16(e.y);
+					src += 3;
+					dst += 2 * sizeof(s16);
+				}
+				if (_has_uv)
+				{
+					u16* uv = (u16*)dst;
+					uv[0] = bx::halfFromFloat(src[0]);
+					uv[1] = bx::halfFromFloat(src[1]);
+					src += 2;
+					dst += 2 * sizeof(u16);
+				}
+				if (_has_skin)
+				{
+					u8* s = (u8*)dst;
+					for (u32 j = 0; j < 4; ++j)
+						s[j] = u8(src[j]);
+					for (u32 j = 0; j < 4; ++j)
+						s[4 + j] = u8(fclamp(src[4 + j], 0.0f, 1.0f) * 255.0f + 0.5f);
+				}
+			}
+
+			_vertex_stride = stride;
+			_vertex_buffer = vb;
 		}
 
-		void write()
+		template <typename T>
+		static void push(Buffer& output, const T& data)
 		{
-			_opts.write(_decl);
-			_opts.write(_obb);
+			array::push(output, (const char*)&data, sizeof(data));
+		}
 
-			_opts.write(array::size(_vertex_buffer) / _vertex_stride);
-			_opts.write(_vertex_stride);
-			_opts.write(array::size(_index_buffer));
+		void write(Buffer& output, u32 num_lods)
+		{
+			push(output, _decl);
+			push(output, _obb);
+			push(output, _decode[0]);
+			push(output, _decode[1]);
+
+			push(output, array::size(_vertex_buffer) / _vertex_stride);
+			push(output, _vertex_stride);
+			push(output, array::size(_index_buffer) / _index_stride);
+			push(output, _index_stride);
+			push(output, num_lods);
+
+			array::push(output, array::begin(_vertex_buffer), array::size(_vertex_buffer));
+			array::push(output, array::begin(_index_buffer), array::size(_index_buffer));
+		}
 
-			_opts.write(_vertex_buffer);
-			_opts.write(array::begin(_index_buffer), array::size(_index_buffer) * sizeof(u16));
+		void write_lod(Buffer& output, f32 screen_size)
+		{
+			push(output, screen_size);
+
+			push(output, array::size(_vertex_buffer) / _vertex_stride);
+			push(output, array::size(_index_buffer) / _index_stride);
+			push(output, _index_stride);
+
+			array::push(output, array::begin(_vertex_buffer), array::size(_vertex_buffer));
+			array::push(output, array::begin(_index_buffer), array::size(_index_buffer));
 		}
 	};
 
@@ -270,13 +587,57 @@ namespace mesh_resource_internal
 		JsonObject nodes(ta);
 		sjson::parse(object["nodes"], nodes);
 
+		// Lods of each geometry, either other geometries of the mesh or
+		// generated by simplifying the geometry itself:
+		// lods = { name = [ { screen_size = 0.3 geometry = "name_lod1" } { screen_size = 0.1 triangles = 0.25 } ] }
+		JsonObject lods(ta);
+		if (json_object::has(object, "lods"))
+			sjson::parse(object["lods"], lods);
+
+		// Geometries used as lods are not compiled on their own
+		HashMap<StringId32, bool> lod_geometries(default_allocator());
+		auto cur = json_object::begin(lods);
+		auto end = json_object::end(lods);
+		for (; cur != end; ++cur)
+		{
+			JsonArray levels(ta);
+			sjson::parse_array(cur->pair.second, levels);
+
+			for (u32 i = 0; i < array::size(levels); ++i)
+			{
+				JsonObject level(ta);
+				sjson::parse(levels[i], level);
+
+				if (json_object::has(level, "geometry"))
+				{
+					DynamicString lod_name(ta);
+					sjson::parse_string(level["geometry"], lod_name);
+					DATA_COMPILER_ASSERT(json_object::has(geometries, lod_name.c_str())
+						, opts
+						, "Lod geometry not found: '%s'"
+						, lod_name.c_str()
+						);
+					hash_map::set(lod_geometries, lod_name.to_string_id(), true);
+				}
+			}
+		}
+
 		opts.write(RESOURCE_VERSION_MESH);
-		opts.write(json_object::size(geometries));
+		opts.write(json_object::size(geometries) - hash_map::size(lod_geometries));
 
-		MeshCompiler mc(opts);
+		// Optionally trade some precision for smaller vertices
+		const bool quantize = json_object::has(object, "quantize_attributes")
+			? sjson::parse_bool(object["quantize_attributes"])
+			: opts.quantize_vertices()
+			;
 
-		auto cur = json_object::begin(geometries);
-		auto end = json_object::end(geometries);
+		MeshCompiler mc(opts, quantize);
+		MeshCompiler lc(opts, quantize);
+		Array<u32> lod_indices(default_allocator());
+		Buffer output(default_allocator());
+
+		cur = json_object::begin(geometries);
+		end = json_object::end(geometries);
 		for (; cur != end; ++cur)
 		{
 			const FixedString key = cur->pair.first;
@@ -284,15 +645,243 @@ namespace mesh_resource_internal
 			const char* node = nodes[key];
 
 			const StringId32 name(key.data(), key.length());
-			opts.write(name._id);
+			if (hash_map::has(lod_geometries, name))
+				continue;
+
+			MeshCompiler::push(output, name._id);
+
+			JsonArray levels(ta);
+			if (lods[key] != NULL)
+				sjson::parse_array(lods[key], levels);
 
 			mc.reset();
 			mc.parse(geometry, node);
-			mc.compile();
-			mc.write();
+			mc.weld();
+
+			// The lods share the quantization of the positions of the
+			// geometry, so it must enclose the lod geometries as well
+			AABB boxes[2];
+			boxes[0] = mc.welded_aabb();
+			for (u32 i = 0; i < array::size(levels); ++i)
+			{
+				JsonObject level(ta);
+				sjson::parse(levels[i], level);
+				if (!json_object::has(level, "geometry"))
+					continue;
+
+				DynamicString lod_name(ta);
+				sjson::parse_string(level["geometry"], lod_name);
+
+				lc.reset();
+				lc.parse(geometries[lod_name.c_str()], nodes[lod_name.c_str()]);
+				DATA_COMPILER_ASSERT(lc._has_normal == mc._has_normal && lc._has_uv == mc._has_uv && lc._has_skin == mc._has_skin
+					, opts
+					, "Lod geometry '%s' must have the same attributes as '%.*s'"
+					, lod_name.c_str()
+					, key.length()
+					, key.data()
+					);
+				lc.weld();
+				boxes[1] = lc.welded_aabb();
+				aabb::from_boxes(boxes[0], 2, boxes);
+			}
+
+			mc.compile(boxes[0]);
+			mc.write(output, array::size(levels));
+
+			f32 last_screen_size = FLT_MAX;
+			for (u32 i = 0; i < array::size(levels); ++i)
+			{
+				JsonObject level(ta);
+				sjson::parse(levels[i], level);
+
+				const f32 screen_size = sjson::parse_float(level["screen_size"]);
+				DATA_COMPILER_ASSERT(screen_size < last_screen_size
+					, opts
+					, "Lods must have decreasing screen_size"
+					);
+				last_screen_size = screen_size;
+
+				if (json_object::has(level, "geometry"))
+				{
+					DynamicString lod_name(ta);
+					sjson::parse_string(level["geometry"], lod_name);
+
+					lc.reset();
+					lc.parse(geometries[lod_name.c_str()], nodes[lod_name.c_str()]);
+					lc.weld();
+					lc.compile(boxes[0]);
+					lc.write_lod(output, screen_size);
+				}
+				else
+				{
+					mc.simplify(sjson::parse_float(level["triangles"]), lod_indices);
+					mc.build(array::begin(lod_indices), array::size(lod_indices));
+					mc.write_lod(output, screen_size);
+				}
+			}
+		}
+
+		opts.write(output);
+	}
+
+	void compile_batches(CompileOptions& opts, Buffer& output, const MeshBatchInstance* instances, u32 num)
+	{
+		const u32 num_batches = num > 0 ? instances[num - 1].batch + 1 : 0;
+		MeshCompiler::push(output, RESOURCE_VERSION_MESH);
+		MeshCompiler::push(output, num_batches);
+
+		MeshCompiler bc(opts, opts.quantize_vertices());
+		MeshCompiler mc(opts, false);
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const MeshBatchInstance& inst = instances[i];
+
+			// Instances of the same geometry are adjacent, parse it once
+			if (i == 0
+				|| strcmp(inst.mesh, instances[i - 1].mesh) != 0
+				|| strcmp(inst.geometry, instances[i - 1].geometry) != 0
+				)
+			{
+				TempAllocator1024 ta;
+				DynamicString path(ta);
+				path  = inst.mesh;
+				path += ".mesh";
+
+				Buffer buf = opts.read(path.c_str());
+				JsonObject object(ta);
+				sjson::parse(buf, object);
+				JsonObject geometries(ta);
+				sjson::parse(object["geometries"], geometries);
+				JsonObject nodes(ta);
+				sjson::parse(object["nodes"], nodes);
+
+				DATA_COMPILER_ASSERT(json_object::has(geometries, inst.geometry)
+					, opts
+					, "Geometry not found: '%s' in '%s'"
+					, inst.geometry
+					, path.c_str()
+					);
+
+				mc.reset();
+				mc.parse(geometries[inst.geometry], nodes[inst.geometry]);
+				mc.weld();
+				DATA_COMPILER_ASSERT(!mc._has_skin
+					, opts
+					, "Skinned geometries cannot be batched: '%s' in '%s'"
+					, inst.geometry
+					, path.c_str()
+					);
+			}
+
+			if (i == 0 || inst.batch != instances[i - 1].batch)
+			{
+				bc.reset();
+				bc._has_normal    = mc._has_normal;
+				bc._has_uv        = mc._has_uv;
+				bc._welded_stride = mc._welded_stride;
+			}
+
+			DATA_COMPILER_ASSERT(mc._has_normal == bc._has_normal && mc._has_uv == bc._has_uv
+				, opts
+				, "Batched geometries must have the same attributes: '%s' in '%s'"
+				, inst.geometry
+				, inst.mesh
+				);
+
+			// Append the welded vertices in level space
+			const u32 stride = mc._welded_stride;
+			const u32 num_vertices = array::size(mc._welded_vertices) / stride;
+			const u32 first_vertex = array::size(bc._welded_vertices) / stride;
+			array::push(bc._welded_vertices, array::begin(mc._welded_vertices), array::size(mc._welded_vertices));
+
+			Matrix4x4 rotation = inst.pose;
+			set_translation(rotation, VECTOR3_ZERO);
+
+			for (u32 v = 0; v < num_vertices; ++v)
+			{
+				f32* vertex = (f32*)&bc._welded_vertices[(first_vertex + v)*stride];
+
+				const Vector3 pos = vector3(vertex[0], vertex[1], vertex[2]) * inst.pose;
+				vertex[0] = pos.x;
+				vertex[1] = pos.y;
+				vertex[2] = pos.z;
+
+				if (mc._has_normal)
+				{
+					Vector3 n = vector3(vertex[3], vertex[4], vertex[5]) * rotation;
+					normalize(n);
+					vertex[3] = n.x;
+					vertex[4] = n.y;
+					vertex[5] = n.z;
+				}
+			}
+
+			for (u32 j = 0; j < array::size(mc._welded_indices); ++j)
+				array::push_back(bc._welded_indices, first_vertex + mc._welded_indices[j]);
+
+			if (i == num - 1 || inst.batch != instances[i + 1].batch)
+			{
+				const AABB box = bc.welded_aabb();
+				bc._obb.tm = matrix4x4(QUATERNION_IDENTITY, aabb::center(box));
+				bc._obb.half_extents = (box.max - box.min) * 0.5f;
+				bc.compile(box);
+
+				MeshCompiler::push(output, inst.batch);
+				bc.write(output, 0);
+			}
 		}
 	}
 
+	static u32 align_size(u32 size, u32 align)
+	{
+		return (size + align - 1) & ~(align - 1);
+	}
+
+	struct GeometryHeader
+	{
+		StringId32 name;
+		bgfx::VertexDecl decl;
+		OBB obb;
+		Vector4 decode[2];
+		u32 num_verts;
+		u32 stride;
+		u32 num_inds;
+		u32 index_stride;
+		u32 num_lods;
+	};
+
+	struct LodHeader
+	{
+		f32 screen_size;
+		u32 num_verts;
+		u32 num_inds;
+		u32 index_stride;
+	};
+
+	static void read_header(BinaryReader& br, GeometryHeader& gh)
+	{
+		br.read(gh.name);
+		br.read(gh.decl);
+		br.read(gh.obb);
+		br.read(gh.decode[0]);
+		br.read(gh.decode[1]);
+		br.read(gh.num_verts);
+		br.read(gh.stride);
+		br.read(gh.num_inds);
+		br.read(gh.index_stride);
+		br.read(gh.num_lods);
+	}
+
+	static void read_header(BinaryReader& br, LodHeader& lh)
+	{
+		br.read(lh.screen_size);
+		br.read(lh.num_verts);
+		br.read(lh.num_inds);
+		br.read(lh.index_stride);
+	}
+
 	void* load(File& file, Allocator& a)
 	{
 		BinaryReader br(file);
@@ -304,103 +893,218 @@ namespace mesh_resource_internal
 		u32 num_geoms;
 		br.read(num_geoms);
 
-		MeshResource* mr = CE_NEW(a, MeshResource)(a);
-		array::resize(mr->geometry_names, num_geoms);
-		array::resize(mr->geometries, num_geoms);
+		// Compute the size of the whole resource first.
+		const u32 geoms_offset = br.position();
+		u32 size = sizeof(MeshResource);
+		size  = align_size(size + num_geoms*sizeof(StringId32), alignof(MeshGeometry*));
+		size += num_geoms*sizeof(MeshGeometry*);
 
 		for (u32 i = 0; i < num_geoms; ++i)
 		{
-			StringId32 name;
-			br.read(name);
+			GeometryHeader gh;
+			read_header(br, gh);
 
-			bgfx::VertexDecl decl;
-			br.read(decl);
+			const u32 vsize = gh.num_verts*gh.stride;
+			const u32 isize = gh.num_inds*gh.index_stride;
+			size  = align_size(size, alignof(MeshGeometry));
+			size += sizeof(MeshGeometry) + gh.num_lods*sizeof(MeshLod) + vsize + isize;
+			br.skip(vsize + isize);
 
-			OBB obb;
-			br.read(obb);
+			for (u32 j = 0; j < gh.num_lods; ++j)
+			{
+				LodHeader lh;
+				read_header(br, lh);
 
-			u32 num_verts;
-			br.read(num_verts);
+				const u32 lod_vsize = lh.num_verts*gh.stride;
+				const u32 lod_isize = lh.num_inds*lh.index_stride;
+				size += lod_vsize + lod_isize;
+				br.skip(lod_vsize + lod_isize);
+			}
+		}
 
-			u32 stride;
-			br.read(stride);
+		// Read the geometries straight into their final place.
+		br.seek(geoms_offset);
 
-			u32 num_inds;
-			br.read(num_inds);
+		char* mem = (char*)a.allocate(size, alignof(MeshResource));
+		MeshResource* mr    = (MeshResource*)mem;
+		mr->num_geometries  = num_geoms;
+		mr->geometry_names  = (StringId32*)&mr[1];
+		mr->geometries      = (MeshGeometry**)(mem + align_size(sizeof(MeshResource) + num_geoms*sizeof(StringId32), alignof(MeshGeometry*)));
 
-			const u32 vsize = num_verts*stride;
-			const u32 isize = num_inds*sizeof(u16);
+		u32 offset = u32((char*)(mr->geometries + num_geoms) - mem);
+		for (u32 i = 0; i < num_geoms; ++i)
+		{
+			GeometryHeader gh;
+			read_header(br, gh);
+
+			const u32 vsize = gh.num_verts*gh.stride;
+			const u32 isize = gh.num_inds*gh.index_stride;
 
-			const u32 size = sizeof(MeshGeometry) + vsize + isize;
+			offset = align_size(offset, alignof(MeshGeometry));
+			MeshGeometry* mg = (MeshGeometry*)(mem + offset);
+			offset += sizeof(MeshGeometry) + gh.num_lods*sizeof(MeshLod) + vsize + isize;
 
-			MeshGeometry* mg = (MeshGeometry*)a.allocate(size);
-			mg->obb             = obb;
-			mg->decl            = decl;
+			mg->obb             = gh.obb;
+			mg->decode[0]       = gh.decode[0];
+			mg->decode[1]       = gh.decode[1];
+			mg->decl            = gh.decl;
 			mg->vertex_buffer   = BGFX_INVALID_HANDLE;
 			mg->index_buffer    = BGFX_INVALID_HANDLE;
-			mg->vertices.num    = num_verts;
-			mg->vertices.stride = stride;
-			mg->vertices.data   = (char*)&mg[1];
-			mg->indices.num     = num_inds;
+			mg->vertices.num    = gh.num_verts;
+			mg->vertices.stride = gh.stride;
+			mg->indices.num     = gh.num_inds;
+			mg->indices.stride  = gh.index_stride;
+			mg->num_lods        = gh.num_lods;
+			mg->lods            = (MeshLod*)&mg[1];
+			mg->vertices.data   = (char*)(mg->lods + gh.num_lods);
 			mg->indices.data    = mg->vertices.data + vsize;
 
 			br.read(mg->vertices.data, vsize);
 			br.read(mg->indices.data, isize);
 
-			mr->geometry_names[i] = name;
+			for (u32 j = 0; j < gh.num_lods; ++j)
+			{
+				LodHeader lh;
+				read_header(br, lh);
+
+				const u32 lod_vsize = lh.num_verts*gh.stride;
+				const u32 lod_isize = lh.num_inds*lh.index_stride;
+
+				MeshLod& ml = mg->lods[j];
+				ml.screen_size     = lh.screen_size;
+				ml.vertex_buffer   = BGFX_INVALID_HANDLE;
+				ml.index_buffer    = BGFX_INVALID_HANDLE;
+				ml.vertices.num    = lh.num_verts;
+				ml.vertices.stride = gh.stride;
+				ml.vertices.data   = mem + offset;
+				ml.indices.num     = lh.num_inds;
+				ml.indices.stride  = lh.index_stride;
+				ml.indices.data    = ml.vertices.data + lod_vsize;
+				offset += lod_vsize + lod_isize;
+
+				br.read(ml.vertices.data, lod_vsize);
+				br.read(ml.indices.data, lod_isize);
+			}
+
+			mr->geometry_names[i] = gh.name;
 			mr->geometries[i] = mg;
 		}
+		CE_ASSERT(offset == size, "Wrong mesh size");
 
 		return mr;
 	}
 
+	static void create_buffers(const bgfx::VertexDecl& decl
+		, const VertexData& vertices
+		, const IndexData& indices
+		, bgfx::VertexBufferHandle& vertex_buffer
+		, bgfx::IndexBufferHandle& index_buffer
+		)
+	{
+		const u32 vsize = vertices.num * vertices.stride;
+		const u32 isize = indices.num * indices.stride;
+
+		const bgfx::Memory* vmem = bgfx::makeRef(vertices.data, vsize);
+		const bgfx::Memory* imem = bgfx::makeRef(indices.data, isize);
+
+		bgfx::VertexBufferHandle vbh = bgfx::createVertexBuffer(vmem, decl);
+		bgfx::IndexBufferHandle ibh  = bgfx::createIndexBuffer(imem
+			, indices.stride == sizeof(u32) ? BGFX_BUFFER_INDEX32 : BGFX_BUFFER_NONE
+			);
+		CE_ASSERT(bgfx::isValid(vbh), "Invalid vertex buffer");
+		CE_ASSERT(bgfx::isValid(ibh), "Invalid index buffer");
+		gpu_memory::allocate(GpuMemoryCategory::MESH, vsize + isize);
+
+		vertex_buffer = vbh;
+		index_buffer  = ibh;
+	}
+
+	static void destroy_buffers(const VertexData& vertices
+		, const IndexData& indices
+		, bgfx::VertexBufferHandle vertex_buffer
+		, bgfx::IndexBufferHandle index_buffer
+		)
+	{
+		bgfx::destroy(vertex_buffer);
+		bgfx::destroy(index_buffer);
+		gpu_memory::deallocate(GpuMemoryCategory::MESH, vertices.num*vertices.stride + indices.num*indices.stride);
+	}
+
 	void online(StringId64 id, ResourceManager& rm)
 	{
-		MeshResource* mr = (MeshResource*)rm.get(RESOURCE_TYPE_MESH, id);
+		mesh_resource::create_buffers((MeshResource*)rm.get(RESOURCE_TYPE_MESH, id));
+	}
 
-		for (u32 i = 0; i < array::size(mr->geometries); ++i)
-		{
-			MeshGeometry& mg = *mr->geometries[i];
+	void offline(StringId64 id, ResourceManager& rm)
+	{
+		mesh_resource::destroy_buffers((MeshResource*)rm.get(RESOURCE_TYPE_MESH, id));
+	}
 
-			const u32 vsize = mg.vertices.num * mg.vertices.stride;
-			const u32 isize = mg.indices.num * sizeof(u16);
+	void unload(Allocator& a, void* res)
+	{
+		a.deallocate(res);
+	}
 
-			const bgfx::Memory* vmem = bgfx::makeRef(mg.vertices.data, vsize);
-			const bgfx::Memory* imem = bgfx::makeRef(mg.indices.data, isize);
+} // namespace mesh_resource_internal
 
-			bgfx::VertexBufferHandle vbh = bgfx::createVertexBuffer(vmem, mg.decl);
-			bgfx::IndexBufferHandle ibh  = bgfx::createIndexBuffer(imem);
-			CE_ASSERT(bgfx::isValid(vbh), "Invalid vertex buffer");
-			CE_ASSERT(bgfx::isValid(ibh), "Invalid index buffer");
+namespace mesh_resource
+{
+	bool quantized(const MeshGeometry* mg)
+	{
+		return mg->decode[0].w != 0.0f;
+	}
+
+	const char* positions(const MeshGeometry* mg, Array<Vector3>& positions, u32& stride)
+	{
+		if (!quantized(mg))
+		{
+			stride = mg->vertices.stride;
+			return mg->vertices.data;
+		}
 
-			mg.vertex_buffer = vbh;
-			mg.index_buffer  = ibh;
+		array::resize(positions, mg->vertices.num);
+		for (u32 i = 0; i < mg->vertices.num; ++i)
+		{
+			const s16* p = (const s16*)(mg->vertices.data + i*mg->vertices.stride);
+			positions[i].x = fmax(p[0] / 32767.0f, -1.0f) * mg->decode[0].x + mg->decode[1].x;
+			positions[i].y = fmax(p[1] / 32767.0f, -1.0f) * mg->decode[0].y + mg->decode[1].y;
+			positions[i].z = fmax(p[2] / 32767.0f, -1.0f) * mg->decode[0].z + mg->decode[1].z;
 		}
+
+		stride = sizeof(Vector3);
+		return (const char*)array::begin(positions);
 	}
 
-	void offline(StringId64 id, ResourceManager& rm)
+	void create_buffers(MeshResource* mr)
 	{
-		MeshResource* mr = (MeshResource*)rm.get(RESOURCE_TYPE_MESH, id);
-
-		for (u32 i = 0; i < array::size(mr->geometries); ++i)
+		for (u32 i = 0; i < mr->num_geometries; ++i)
 		{
 			MeshGeometry& mg = *mr->geometries[i];
-			bgfx::destroy(mg.vertex_buffer);
-			bgfx::destroy(mg.index_buffer);
+			mesh_resource_internal::create_buffers(mg.decl, mg.vertices, mg.indices, mg.vertex_buffer, mg.index_buffer);
+
+			for (u32 j = 0; j < mg.num_lods; ++j)
+			{
+				MeshLod& ml = mg.lods[j];
+				mesh_resource_internal::create_buffers(mg.decl, ml.vertices, ml.indices, ml.vertex_buffer, ml.index_buffer);
+			}
 		}
 	}
 
-	void unload(Allocator& a, void* res)
+	void destroy_buffers(MeshResource* mr)
 	{
-		MeshResource* mr = (MeshResource*)res;
-
-		for (u32 i = 0; i < array::size(mr->geometries); ++i)
+		for (u32 i = 0; i < mr->num_geometries; ++i)
 		{
-			a.deallocate(mr->geometries[i]);
+			MeshGeometry& mg = *mr->geometries[i];
+			mesh_resource_internal::destroy_buffers(mg.vertices, mg.indices, mg.vertex_buffer, mg.index_buffer);
+
+			for (u32 j = 0; j < mg.num_lods; ++j)
+			{
+				MeshLod& ml = mg.lods[j];
+				mesh_resource_internal::destroy_buffers(ml.vertices, ml.indices, ml.vertex_buffer, ml.index_buffer);
+			}
 		}
-		CE_DELETE(a, (MeshResource*)res);
 	}
 
-} // namespace mesh_resource_internal
+} // namespace mesh_resource
 
 } // namespace crown
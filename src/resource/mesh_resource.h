@@ -5,14 +5,13 @@
 
 #pragma once
 
-#include "core/containers/array.h"
 #include "core/containers/types.h"
+#include "core/error/error.h"
 #include "core/filesystem/types.h"
 #include "core/math/types.h"
 #include "core/memory/types.h"
 #include "core/strings/string_id.h"
 #include "resource/types.h"
-#include "resource/types.h"
 #include <bgfx/bgfx.h>
 
 namespace crown
@@ -27,33 +26,49 @@ struct VertexData
 struct IndexData
 {
 	u32 num;
-	char* data; // size = num*sizeof(u16)
+	u32 stride; // sizeof(u16) or sizeof(u32)
+	char* data; // size = num*stride
 };
 
+/// Coarser level of detail of a MeshGeometry. It uses the same vertex
+/// declaration as the geometry.
+struct MeshLod
+{
+	f32 screen_size; ///< Projected size, relative to the screen height, below which the lod is used.
+	bgfx::VertexBufferHandle vertex_buffer;
+	bgfx::IndexBufferHandle index_buffer;
+	VertexData vertices;
+	IndexData indices;
+};
+
+/// Geometry of a mesh. If its vertices are quantized, positions are 16-bit
+/// normalized integers decoded as position*decode[0].xyz + decode[1].xyz
+/// and normals are octahedral-encoded in two 16-bit normalized integers.
 struct MeshGeometry
 {
 	bgfx::VertexDecl decl;
 	bgfx::VertexBufferHandle vertex_buffer;
 	bgfx::IndexBufferHandle index_buffer;
 	OBB obb;
+	Vector4 decode[2]; ///< Scale and bias of the positions, decode[0].w is 1 if the vertices are quantized.
 	VertexData vertices;
 	IndexData indices;
+	u32 num_lods;
+	MeshLod* lods; ///< From the finest to the coarsest, with decreasing screen_size.
 };
 
+/// Mesh resource. The resource, its geometries, their lods and their vertex
+/// and index data are stored in a single allocation; bgfx buffers reference
+/// the vertex and index data in place.
 struct MeshResource
 {
-	Array<StringId32> geometry_names;
-	Array<MeshGeometry*> geometries;
-
-	MeshResource(Allocator& a)
-		: geometry_names(a)
-		, geometries(a)
-	{
-	}
+	u32 num_geometries;
+	StringId32* geometry_names;
+	MeshGeometry** geometries;
 
 	const MeshGeometry* geometry(StringId32 name) const
 	{
-		for (u32 i = 0; i < array::size(geometry_names); ++i)
+		for (u32 i = 0; i < num_geometries; ++i)
 		{
 			if (geometry_names[i] == name)
 				return geometries[i];
@@ -66,7 +81,23 @@ struct MeshResource
 
 namespace mesh_resource_internal
 {
+	/// Geometry placed in a level and merged with others by compile_batches().
+	struct MeshBatchInstance
+	{
+		u32 batch;            ///< Index of the batch the geometry is merged into.
+		const char* mesh;     ///< Name of the .mesh resource.
+		const char* geometry; ///< Name of the geometry in @a mesh.
+		Matrix4x4 pose;       ///< Pose of the geometry in level space.
+	};
+
 	void compile(CompileOptions& opts);
+
+	/// Merges the geometries of the @a num @a instances, transformed by
+	/// their poses, into one geometry for each batch and writes them to
+	/// @a output as a mesh resource. Instances must be sorted by batch, and
+	/// the geometry of batch i is named StringId32(i).
+	void compile_batches(CompileOptions& opts, Buffer& output, const MeshBatchInstance* instances, u32 num);
+
 	void* load(File& file, Allocator& a);
 	void online(StringId64 /*id*/, ResourceManager& /*rm*/);
 	void offline(StringId64 /*id*/, ResourceManager& /*rm*/);
@@ -74,4 +105,21 @@ namespace mesh_resource_internal
 
 } // namespace mesh_resource_internal
 
+namespace mesh_resource
+{
+	/// Returns whether the vertices of @a mg are quantized.
+	bool quantized(const MeshGeometry* mg);
+
+	/// Returns the positions of the vertices of @a mg and writes their
+	/// @a stride. Quantized positions are decoded to @a positions first.
+	const char* positions(const MeshGeometry* mg, Array<Vector3>& positions, u32& stride);
+
+	/// Creates the vertex and index buffers of the geometries of @a mr.
+	void create_buffers(MeshResource* mr);
+
+	/// Destroys the vertex and index buffers of the geometries of @a mr.
+	void destroy_buffers(MeshResource* mr);
+
+} // namespace mesh_resource
+
 } // namespace crown
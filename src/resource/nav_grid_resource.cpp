@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/memory/temp_allocator.h"
+#include "core/strings/dynamic_string.h"
+#include "resource/compile_options.h"
+#include "resource/nav_grid_resource.h"
+#include "resource/types.h"
+#include <stdint.h> // UINT32_MAX
+
+namespace crown
+{
+namespace nav_grid_resource_internal
+{
+	// Returns the cost of the cell @a c, or UINT32_MAX if @a c is not valid.
+	static u32 cell_cost(char c)
+	{
+		if (c == '.')
+			return 1;
+		if (c == '#')
+			return 0;
+		if (c >= '1' && c <= '9')
+			return c - '0';
+
+		return UINT32_MAX;
+	}
+
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		JsonArray rows(ta);
+
+		sjson::parse(buf, object);
+		sjson::parse_array(object["cells"], rows);
+
+		const Vector3 origin = sjson::parse_vector3(object["origin"]);
+		const f32 cell_size  = sjson::parse_float(object["cell_size"]);
+		const u32 height     = array::size(rows);
+
+		DATA_COMPILER_ASSERT(cell_size > 0.0f
+			, opts
+			, "Cell size must be > 0"
+			);
+		DATA_COMPILER_ASSERT(height > 0
+			, opts
+			, "Grid must have at least one row"
+			);
+
+		// Rows are along z, the characters of each row along x:
+		// '.' is walkable, '#' is blocked and '1' to '9' are walkable
+		// with the given cost.
+		Array<u8> cells(default_allocator());
+		u32 width = 0;
+		for (u32 z = 0; z < height; ++z)
+		{
+			TempAllocator256 ta;
+			DynamicString row(ta);
+			sjson::parse_string(rows[z], row);
+
+			if (z == 0)
+				width = row.length();
+
+			DATA_COMPILER_ASSERT(row.length() == width && width > 0
+				, opts
+				, "Row %u must have %u cells"
+				, z
+				, width
+				);
+
+			const char* str = row.c_str();
+			for (u32 x = 0; x < width; ++x)
+			{
+				const u32 cost = cell_cost(str[x]);
+				DATA_COMPILER_ASSERT(cost != UINT32_MAX
+					, opts
+					, "Unknown cell '%c' at row %u"
+					, str[x]
+					, z
+					);
+				array::push_back(cells, (u8)cost);
+			}
+		}
+
+		opts.write(RESOURCE_VERSION_NAV_GRID);
+		opts.write(width);
+		opts.write(height);
+		opts.write(cell_size);
+		opts.write(origin);
+		opts.write(array::begin(cells), array::size(cells));
+	}
+
+} // namespace nav_grid_resource_internal
+
+namespace nav_grid_resource
+{
+	const u8* cells(const NavGridResource* ngr)
+	{
+		return (const u8*)&ngr[1];
+	}
+
+} // namespace nav_grid_resource
+
+} // namespace crown
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/filesystem/types.h"
+#include "core/math/types.h"
+#include "core/memory/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Grid of cells on the XZ plane, used for path finding.
+/// The header is followed by width*height costs, row by row along z.
+/// A cost of 0 marks a cell which can not be walked.
+struct NavGridResource
+{
+	u32 version;
+	u32 width;
+	u32 height;
+	f32 cell_size;
+	Vector3 origin; ///< Corner of the first cell.
+};
+
+namespace nav_grid_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace nav_grid_resource_internal
+
+namespace nav_grid_resource
+{
+	/// Returns the costs of the cells of @a ngr.
+	const u8* cells(const NavGridResource* ngr);
+
+} // namespace nav_grid_resource
+
+} // namespace crown
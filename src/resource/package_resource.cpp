@@ -57,6 +57,11 @@ namespace package_resource_internal
 		JsonArray phyconf(ta);
 		JsonArray shader(ta);
 		JsonArray sprite_animation(ta);
+		JsonArray skeleton(ta);
+		JsonArray skeleton_animation(ta);
+		JsonArray nav_grid(ta);
+		JsonArray particle(ta);
+		JsonArray tilemap(ta);
 
 		if (json_object::has(object, "texture"))          sjson::parse_array(object["texture"], texture);
 		if (json_object::has(object, "lua"))              sjson::parse_array(object["lua"], script);
@@ -70,21 +75,33 @@ namespace package_resource_internal
 		if (json_object::has(object, "physics_config"))   sjson::parse_array(object["physics_config"], phyconf);
 		if (json_object::has(object, "shader"))           sjson::parse_array(object["shader"], shader);
 		if (json_object::has(object, "sprite_animation")) sjson::parse_array(object["sprite_animation"], sprite_animation);
+		if (json_object::has(object, "skeleton"))         sjson::parse_array(object["skeleton"], skeleton);
+		if (json_object::has(object, "skeleton_animation")) sjson::parse_array(object["skeleton_animation"], skeleton_animation);
+		if (json_object::has(object, "nav_grid"))         sjson::parse_array(object["nav_grid"], nav_grid);
+		if (json_object::has(object, "particle"))         sjson::parse_array(object["particle"], particle);
+		if (json_object::has(object, "tilemap"))          sjson::parse_array(object["tilemap"], tilemap);
 
 		Array<PackageResource::Resource> resources(default_allocator());
 
+		// Resources are loaded, and laid out in the bundle, in this order:
+		// the ones that others depend on come first
 		compile_resources("texture", texture, resources, opts);
-		compile_resources("lua", script, resources, opts);
-		compile_resources("sound", sound, resources, opts);
+		compile_resources("shader", shader, resources, opts);
+		compile_resources("material", material, resources, opts);
 		compile_resources("mesh", mesh, resources, opts);
-		compile_resources("unit", unit, resources, opts);
+		compile_resources("skeleton", skeleton, resources, opts);
+		compile_resources("skeleton_animation", skeleton_animation, resources, opts);
 		compile_resources("sprite", sprite, resources, opts);
-		compile_resources("material", material, resources, opts);
+		compile_resources("sprite_animation", sprite_animation, resources, opts);
 		compile_resources("font", font, resources, opts);
-		compile_resources("level", level, resources, opts);
+		compile_resources("sound", sound, resources, opts);
 		compile_resources("physics_config", phyconf, resources, opts);
-		compile_resources("shader", shader, resources, opts);
-		compile_resources("sprite_animation", sprite_animation, resources, opts);
+		compile_resources("nav_grid", nav_grid, resources, opts);
+		compile_resources("particle", particle, resources, opts);
+		compile_resources("tilemap", tilemap, resources, opts);
+		compile_resources("unit", unit, resources, opts);
+		compile_resources("level", level, resources, opts);
+		compile_resources("lua", script, resources, opts);
 
 		// Write
 		opts.write(RESOURCE_VERSION_PACKAGE);
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/math/vector2.h"
+#include "core/math/vector3.h"
+#include "core/memory/temp_allocator.h"
+#include "resource/compile_options.h"
+#include "resource/particle_resource.h"
+#include "resource/types.h"
+
+namespace crown
+{
+namespace particle_resource_internal
+{
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		sjson::parse(buf, object);
+
+		const u32 max_particles = sjson::parse_int(object["max_particles"]);
+		const f32 spawn_rate    = sjson::parse_float(object["spawn_rate"]);
+		const Vector2 lifetime  = sjson::parse_vector2(object["lifetime"]);
+		const Vector2 size      = sjson::parse_vector2(object["size"]);
+		const Vector3 velocity_min = sjson::parse_vector3(object["velocity_min"]);
+		const Vector3 velocity_max = sjson::parse_vector3(object["velocity_max"]);
+		const Vector4 color_start  = sjson::parse_vector4(object["color_start"]);
+		const Vector4 color_end    = sjson::parse_vector4(object["color_end"]);
+
+		const Vector3 spawn_extents = json_object::has(object, "spawn_extents")
+			? sjson::parse_vector3(object["spawn_extents"])
+			: VECTOR3_ZERO
+			;
+		const Vector3 gravity = json_object::has(object, "gravity")
+			? sjson::parse_vector3(object["gravity"])
+			: VECTOR3_ZERO
+			;
+		const f32 drag = json_object::has(object, "drag")
+			? sjson::parse_float(object["drag"])
+			: 0.0f
+			;
+
+		DATA_COMPILER_ASSERT(max_particles > 0 && max_particles <= CROWN_MAX_PARTICLES
+			, opts
+			, "Max particles must be in [1, %u]"
+			, CROWN_MAX_PARTICLES
+			);
+		DATA_COMPILER_ASSERT(spawn_rate >= 0.0f
+			, opts
+			, "Spawn rate must be >= 0"
+			);
+		DATA_COMPILER_ASSERT(lifetime.x > 0.0f && lifetime.x <= lifetime.y
+			, opts
+			, "Lifetime must be > 0 and its min <= max"
+			);
+		DATA_COMPILER_ASSERT(drag >= 0.0f
+			, opts
+			, "Drag must be >= 0"
+			);
+
+		opts.write(RESOURCE_VERSION_PARTICLE);
+		opts.write(max_particles);
+		opts.write(spawn_rate);
+		opts.write(lifetime.x);
+		opts.write(lifetime.y);
+		opts.write(spawn_extents);
+		opts.write(velocity_min);
+		opts.write(velocity_max);
+		opts.write(gravity);
+		opts.write(drag);
+		opts.write(size.x);
+		opts.write(size.y);
+		opts.write(color_start);
+		opts.write(color_end);
+	}
+
+} // namespace particle_resource_internal
+
+} // namespace crown
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/filesystem/types.h"
+#include "core/math/types.h"
+#include "core/memory/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Parameters of a particle emitter. Positions, velocities and extents
+/// are in the space of the emitter, the gravity is in world space.
+struct ParticleResource
+{
+	u32 version;
+	u32 max_particles;    ///< Particles alive at the same time, at most.
+	f32 spawn_rate;       ///< Particles spawned per second while playing.
+	f32 lifetime_min;     ///< In seconds.
+	f32 lifetime_max;
+	Vector3 spawn_extents; ///< Half size of the box particles spawn in.
+	Vector3 velocity_min; ///< Initial velocity, picked in [min, max] on each axis.
+	Vector3 velocity_max;
+	Vector3 gravity;
+	f32 drag;             ///< Fraction of the velocity lost each second.
+	f32 size_start;       ///< Half size of the quad at birth, in meters.
+	f32 size_end;         ///< Half size of the quad at death.
+	Vector4 color_start;
+	Vector4 color_end;
+};
+
+namespace particle_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace particle_resource_internal
+
+} // namespace crown
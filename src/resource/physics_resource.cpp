@@ -3,6 +3,7 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/map.h"
 #include "core/filesystem/file.h"
 #include "core/filesystem/filesystem.h"
@@ -11,12 +12,19 @@
 #include "core/math/aabb.h"
 #include "core/math/quaternion.h"
 #include "core/math/sphere.h"
+#include "core/math/vector3.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
 #include "resource/compile_options.h"
 #include "resource/physics_resource.h"
 #include "world/types.h"
+#if CROWN_PHYSICS_BULLET
+	#define BT_THREADSAFE CROWN_PHYSICS_BULLET_MT
+	#include <BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h>
+	#include <BulletCollision/CollisionShapes/btTriangleIndexVertexArray.h>
+	#include <LinearMath/btConvexHullComputer.h>
+#endif
 
 namespace crown
 {
@@ -105,6 +113,50 @@ namespace physics_resource_internal
 		sd.box.half_size = (aabb.max - aabb.min) * 0.5f;
 	}
 
+#if CROWN_PHYSICS_BULLET
+	/// Removes the points which do not lie on the convex hull of @a points.
+	void compile_convex_hull(Array<Vector3>& points)
+	{
+		btConvexHullComputer chc;
+		chc.compute((const f32*)array::begin(points), sizeof(Vector3), (int)array::size(points), 0.0f, 0.0f);
+
+		array::resize(points, (u32)chc.vertices.size());
+		for (int i = 0; i < chc.vertices.size(); ++i)
+		{
+			points[i].x = chc.vertices[i].x();
+			points[i].y = chc.vertices[i].y();
+			points[i].z = chc.vertices[i].z();
+		}
+	}
+
+	/// Builds the quantized BVH of the triangle mesh and serializes it
+	/// to @a bvh in the layout expected by btQuantizedBvh::deSerializeInPlace().
+	void compile_mesh_bvh(const Array<Vector3>& points, const Array<u16>& indices, Buffer& bvh)
+	{
+		btIndexedMesh part;
+		part.m_vertexBase          = (const unsigned char*)array::begin(points);
+		part.m_vertexStride        = sizeof(Vector3);
+		part.m_numVertices         = array::size(points);
+		part.m_triangleIndexBase   = (const unsigned char*)array::begin(indices);
+		part.m_triangleIndexStride = sizeof(u16)*3;
+		part.m_numTriangles        = array::size(indices)/3;
+		part.m_indexType           = PHY_SHORT;
+
+		btTriangleIndexVertexArray vertex_array;
+		vertex_array.addIndexedMesh(part, PHY_SHORT);
+
+		btBvhTriangleMeshShape shape(&vertex_array, true, true);
+		const btOptimizedBvh* ob = shape.getOptimizedBvh();
+		const u32 size = ob->calculateSerializeBufferSize();
+
+		// Bullet serializes into aligned memory only
+		void* mem = default_allocator().allocate(size, 16);
+		ob->serialize(mem, size, false);
+		array::push(bvh, (const char*)mem, size);
+		default_allocator().deallocate(mem);
+	}
+#endif // CROWN_PHYSICS_BULLET
+
 	Buffer compile_collider(const char* json, CompileOptions& opts)
 	{
 		TempAllocator4096 ta;
@@ -192,13 +244,27 @@ namespace physics_resource_internal
 		case ColliderType::SPHERE:      compile_sphere(points, cd); break;
 		case ColliderType::CAPSULE:     compile_capsule(points, cd); break;
 		case ColliderType::BOX:         compile_box(points, cd); break;
-		case ColliderType::CONVEX_HULL: break;
+		case ColliderType::CONVEX_HULL:
+#if CROWN_PHYSICS_BULLET
+			compile_convex_hull(points);
+#endif
+			break;
 		case ColliderType::MESH:        break;
 		case ColliderType::HEIGHTFIELD:
 			DATA_COMPILER_ASSERT(false, opts, "Not implemented yet");
 			break;
 		}
 
+		// The serialized BVH embeds pointer-sized fields, so it is only
+		// usable by runtimes with the same pointer size as the compiler
+		Buffer bvh(default_allocator());
+		const u32 bvh_pointer_size = sizeof(void*);
+#if CROWN_PHYSICS_BULLET
+		if (cd.type == ColliderType::MESH)
+			compile_mesh_bvh(points, point_indices, bvh);
+#endif
+		const u32 bvh_size = array::size(bvh);
+
 		const u32 num_points  = array::size(points);
 		const u32 num_indices = array::size(point_indices);
 
@@ -207,6 +273,7 @@ namespace physics_resource_internal
 
 		cd.size += (needs_points ? sizeof(u32) + sizeof(Vector3)*array::size(points) : 0);
 		cd.size += (cd.type == ColliderType::MESH ? sizeof(u32) + sizeof(u16)*array::size(point_indices) : 0);
+		cd.size += (cd.type == ColliderType::MESH ? sizeof(u32)*2 + bvh_size : 0);
 
 		Buffer buf(default_allocator());
 		array::push(buf, (char*)&cd, sizeof(cd));
@@ -220,6 +287,9 @@ namespace physics_resource_internal
 		{
 			array::push(buf, (char*)&num_indices, sizeof(num_indices));
 			array::push(buf, (char*)array::begin(point_indices), sizeof(u16)*array::size(point_indices));
+			array::push(buf, (char*)&bvh_pointer_size, sizeof(bvh_pointer_size));
+			array::push(buf, (char*)&bvh_size, sizeof(bvh_size));
+			array::push(buf, array::begin(bvh), bvh_size);
 		}
 
 		return buf;
@@ -299,6 +369,30 @@ namespace physics_resource_internal
 
 namespace physics_config_resource_internal
 {
+	struct BroadphaseInfo
+	{
+		const char* name;
+		PhysicsBroadphaseType::Enum type;
+	};
+
+	static const BroadphaseInfo s_broadphase[] =
+	{
+		{ "dbvt",       PhysicsBroadphaseType::DBVT       },
+		{ "axis_sweep", PhysicsBroadphaseType::AXIS_SWEEP }
+	};
+	CE_STATIC_ASSERT(countof(s_broadphase) == PhysicsBroadphaseType::COUNT);
+
+	static PhysicsBroadphaseType::Enum broadphase_type_to_enum(const char* type)
+	{
+		for (u32 i = 0; i < countof(s_broadphase); ++i)
+		{
+			if (strcmp(type, s_broadphase[i].name) == 0)
+				return s_broadphase[i].type;
+		}
+
+		return PhysicsBroadphaseType::COUNT;
+	}
+
 	void parse_materials(const char* json, Array<PhysicsMaterial>& objects)
 	{
 		TempAllocator4096 ta;
@@ -345,11 +439,14 @@ namespace physics_config_resource_internal
 			pa.name = StringId32(key.data(), key.length());
 			pa.linear_damping  = 0.0f;
 			pa.angular_damping = 0.0f;
+			pa.max_linear_velocity = 100.0f;
 
 			if (json_object::has(actor, "linear_damping"))
 				pa.linear_damping = sjson::parse_float(actor["linear_damping"]);
 			if (json_object::has(actor, "angular_damping"))
 				pa.angular_damping = sjson::parse_float(actor["angular_damping"]);
+			if (json_object::has(actor, "max_linear_velocity"))
+				pa.max_linear_velocity = sjson::parse_float(actor["max_linear_velocity"]);
 
 			const bool has_dynamic         = json_object::has(actor, "dynamic");
 			const bool has_kinematic       = json_object::has(actor, "kinematic");
@@ -387,6 +484,10 @@ namespace physics_config_resource_internal
 					);
 			}
 
+			// Contacts are reported unless disabled
+			if (!json_object::has(actor, "report_contacts") || sjson::parse_bool(actor["report_contacts"]))
+				pa.flags |= PhysicsActor::REPORT_CONTACTS;
+
 			array::push_back(objects, pa);
 		}
 	}
@@ -449,6 +550,10 @@ namespace physics_config_resource_internal
 				pcf.name = id;
 				pcf.me   = filter_to_mask(id);
 				pcf.mask = mask;
+				pcf.report_contacts = json_object::has(filter, "report_contacts")
+					? sjson::parse_bool(filter["report_contacts"])
+					: 1
+					;
 
 				array::push_back(_filters, pcf);
 			}
@@ -503,6 +608,131 @@ namespace physics_config_resource_internal
 		pcr.num_actors    = array::size(actors);
 		pcr.num_filters   = array::size(cfc._filters);
 
+		// Simulation defaults, overridden by the optional "simulation" object
+		pcr.step_frequency    = 60.0f;
+		pcr.max_substeps      = 7;
+		pcr.solver_iterations = 10;
+		if (json_object::has(object, "simulation"))
+		{
+			JsonObject simulation(ta);
+			sjson::parse_object(object["simulation"], simulation);
+
+			if (json_object::has(simulation, "step_frequency"))
+				pcr.step_frequency = sjson::parse_float(simulation["step_frequency"]);
+			s32 max_substeps = s32(pcr.max_substeps);
+			if (json_object::has(simulation, "max_substeps"))
+				max_substeps = sjson::parse_int(simulation["max_substeps"]);
+			s32 solver_iterations = s32(pcr.solver_iterations);
+			if (json_object::has(simulation, "solver_iterations"))
+				solver_iterations = sjson::parse_int(simulation["solver_iterations"]);
+
+			DATA_COMPILER_ASSERT(pcr.step_frequency > 0.0f
+				, opts
+				, "Step frequency must be greater than zero"
+				);
+			DATA_COMPILER_ASSERT(max_substeps > 0
+				, opts
+				, "Max substeps must be greater than zero"
+				);
+			DATA_COMPILER_ASSERT(solver_iterations > 0
+				, opts
+				, "Solver iterations must be greater than zero"
+				);
+			pcr.max_substeps      = u32(max_substeps);
+			pcr.solver_iterations = u32(solver_iterations);
+		}
+
+		// Broadphase defaults, overridden by the optional "broadphase" object
+		pcr.broadphase_type             = PhysicsBroadphaseType::DBVT;
+		pcr.broadphase_world_min        = vector3(-1000.0f, -1000.0f, -1000.0f);
+		pcr.broadphase_world_max        = vector3( 1000.0f,  1000.0f,  1000.0f);
+		pcr.broadphase_max_handles      = 16384;
+		pcr.broadphase_prediction       = 0.0f;
+		pcr.broadphase_dynamic_updates  = 0;
+		pcr.broadphase_fixed_updates    = 1;
+		pcr.broadphase_deferred_collide = 0;
+		if (json_object::has(object, "broadphase"))
+		{
+			JsonObject broadphase(ta);
+			sjson::parse_object(object["broadphase"], broadphase);
+
+			if (json_object::has(broadphase, "type"))
+			{
+				DynamicString type(ta);
+				sjson::parse_string(broadphase["type"], type);
+
+				pcr.broadphase_type = broadphase_type_to_enum(type.c_str());
+				DATA_COMPILER_ASSERT(pcr.broadphase_type != PhysicsBroadphaseType::COUNT
+					, opts
+					, "Unknown broadphase type: '%s'"
+					, type.c_str()
+					);
+			}
+
+			if (json_object::has(broadphase, "world_min"))
+				pcr.broadphase_world_min = sjson::parse_vector3(broadphase["world_min"]);
+			if (json_object::has(broadphase, "world_max"))
+				pcr.broadphase_world_max = sjson::parse_vector3(broadphase["world_max"]);
+			s32 max_handles = s32(pcr.broadphase_max_handles);
+			if (json_object::has(broadphase, "max_handles"))
+				max_handles = sjson::parse_int(broadphase["max_handles"]);
+			if (json_object::has(broadphase, "prediction"))
+				pcr.broadphase_prediction = sjson::parse_float(broadphase["prediction"]);
+			s32 dynamic_updates = s32(pcr.broadphase_dynamic_updates);
+			if (json_object::has(broadphase, "dynamic_updates"))
+				dynamic_updates = sjson::parse_int(broadphase["dynamic_updates"]);
+			s32 fixed_updates = s32(pcr.broadphase_fixed_updates);
+			if (json_object::has(broadphase, "fixed_updates"))
+				fixed_updates = sjson::parse_int(broadphase["fixed_updates"]);
+			if (json_object::has(broadphase, "deferred_collide"))
+				pcr.broadphase_deferred_collide = sjson::parse_bool(broadphase["deferred_collide"]);
+
+			DATA_COMPILER_ASSERT(pcr.broadphase_world_min.x < pcr.broadphase_world_max.x
+				&& pcr.broadphase_world_min.y < pcr.broadphase_world_max.y
+				&& pcr.broadphase_world_min.z < pcr.broadphase_world_max.z
+				, opts
+				, "World bounds must be non-empty"
+				);
+			DATA_COMPILER_ASSERT(max_handles > 0
+				, opts
+				, "Max handles must be greater than zero"
+				);
+			DATA_COMPILER_ASSERT(dynamic_updates >= 0 && dynamic_updates <= 100
+				&& fixed_updates >= 0 && fixed_updates <= 100
+				, opts
+				, "Updates must be percentages in [0..100]"
+				);
+			pcr.broadphase_max_handles     = u32(max_handles);
+			pcr.broadphase_dynamic_updates = u32(dynamic_updates);
+			pcr.broadphase_fixed_updates   = u32(fixed_updates);
+		}
+
+		// LOD defaults, overridden by the optional "lod" object
+		pcr.lod_reduced_distance    = 0.0f;
+		pcr.lod_sleep_distance      = 0.0f;
+		pcr.lod_reduced_sleep_scale = 4.0f;
+		if (json_object::has(object, "lod"))
+		{
+			JsonObject lod(ta);
+			sjson::parse_object(object["lod"], lod);
+
+			if (json_object::has(lod, "reduced_distance"))
+				pcr.lod_reduced_distance = sjson::parse_float(lod["reduced_distance"]);
+			if (json_object::has(lod, "sleep_distance"))
+				pcr.lod_sleep_distance = sjson::parse_float(lod["sleep_distance"]);
+			if (json_object::has(lod, "reduced_sleep_scale"))
+				pcr.lod_reduced_sleep_scale = sjson::parse_float(lod["reduced_sleep_scale"]);
+
+			DATA_COMPILER_ASSERT(pcr.lod_reduced_distance >= 0.0f && pcr.lod_sleep_distance >= 0.0f
+				, opts
+				, "LOD distances must be positive or zero"
+				);
+			DATA_COMPILER_ASSERT(pcr.lod_reduced_sleep_scale >= 1.0f
+				, opts
+				, "Reduced sleep scale must be greater than or equal to one"
+				);
+		}
+
 		u32 offt = sizeof(PhysicsConfigResource);
 		pcr.materials_offset = offt;
 		offt += sizeof(PhysicsMaterial) * pcr.num_materials;
@@ -521,6 +751,20 @@ namespace physics_config_resource_internal
 		opts.write(pcr.actors_offset);
 		opts.write(pcr.num_filters);
 		opts.write(pcr.filters_offset);
+		opts.write(pcr.step_frequency);
+		opts.write(pcr.max_substeps);
+		opts.write(pcr.solver_iterations);
+		opts.write(pcr.broadphase_type);
+		opts.write(pcr.broadphase_world_min);
+		opts.write(pcr.broadphase_world_max);
+		opts.write(pcr.broadphase_max_handles);
+		opts.write(pcr.broadphase_prediction);
+		opts.write(pcr.broadphase_dynamic_updates);
+		opts.write(pcr.broadphase_fixed_updates);
+		opts.write(pcr.broadphase_deferred_collide);
+		opts.write(pcr.lod_reduced_distance);
+		opts.write(pcr.lod_sleep_distance);
+		opts.write(pcr.lod_reduced_sleep_scale);
 
 		// Write materials
 		for (u32 i = 0; i < pcr.num_materials; ++i)
@@ -537,6 +781,7 @@ namespace physics_config_resource_internal
 			opts.write(actors[i].name._id);
 			opts.write(actors[i].linear_damping);
 			opts.write(actors[i].angular_damping);
+			opts.write(actors[i].max_linear_velocity);
 			opts.write(actors[i].flags);
 		}
 
@@ -546,6 +791,7 @@ namespace physics_config_resource_internal
 			opts.write(cfc._filters[i].name._id);
 			opts.write(cfc._filters[i].me);
 			opts.write(cfc._filters[i].mask);
+			opts.write(cfc._filters[i].report_contacts);
 		}
 	}
 
@@ -24,6 +24,17 @@ namespace physics_resource_internal
 
 } // namespace physics_resource_internal
 
+struct PhysicsBroadphaseType
+{
+	enum Enum
+	{
+		DBVT,       ///< Dynamic AABB trees, for general scenes.
+		AXIS_SWEEP, ///< Sweep and prune inside fixed world bounds.
+
+		COUNT
+	};
+};
+
 struct PhysicsConfigResource
 {
 	u32 version;
@@ -33,6 +44,20 @@ struct PhysicsConfigResource
 	u32 actors_offset;
 	u32 num_filters;
 	u32 filters_offset;
+	f32 step_frequency;    ///< Rate of the fixed simulation substeps, in Hz.
+	u32 max_substeps;      ///< Maximum number of substeps per update, the time in excess is dropped.
+	u32 solver_iterations; ///< Iterations of the constraint solver per substep.
+	u32 broadphase_type;             ///< PhysicsBroadphaseType::Enum
+	Vector3 broadphase_world_min;    ///< Axis sweep: lower bound of the world.
+	Vector3 broadphase_world_max;    ///< Axis sweep: upper bound of the world.
+	u32 broadphase_max_handles;      ///< Axis sweep: maximum number of objects.
+	f32 broadphase_prediction;       ///< Dbvt: distance the moving AABBs are extended by, along their velocity.
+	u32 broadphase_dynamic_updates;  ///< Dbvt: percentage of the dynamic tree optimized each step.
+	u32 broadphase_fixed_updates;    ///< Dbvt: percentage of the fixed tree optimized each step.
+	u32 broadphase_deferred_collide; ///< Dbvt: whether new dynamic/static pairs are found in the collide phase only.
+	f32 lod_reduced_distance;        ///< Distance from the observers beyond which actors fall asleep sooner, 0 to disable.
+	f32 lod_sleep_distance;          ///< Distance from the observers beyond which actors are put to sleep, 0 to disable.
+	f32 lod_reduced_sleep_scale;     ///< Scale of the sleeping thresholds of the actors beyond lod_reduced_distance.
 };
 
 struct PhysicsMaterial
@@ -48,6 +73,7 @@ struct PhysicsCollisionFilter
 	StringId32 name;
 	u32 me;
 	u32 mask;
+	u32 report_contacts; ///< Whether the actors in the filter report their contacts.
 };
 
 struct PhysicsActor
@@ -57,12 +83,14 @@ struct PhysicsActor
 		DYNAMIC         = 1 << 0,
 		KINEMATIC       = 1 << 1,
 		DISABLE_GRAVITY = 1 << 2,
-		TRIGGER         = 1 << 3
+		TRIGGER         = 1 << 3,
+		REPORT_CONTACTS = 1 << 4
 	};
 
 	StringId32 name;
 	f32 linear_damping;
 	f32 angular_damping;
+	f32 max_linear_velocity; ///< Speed the actors are clamped to, 0 if unlimited.
 	u32 flags;
 };
 
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/memory/temp_allocator.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string.h"
+#include "resource/compile_options.h"
+#include "resource/render_graph_resource.h"
+#include <bgfx/bgfx.h>
+#include <string.h> // memset, strcmp, strncpy
+
+namespace crown
+{
+namespace render_graph_resource_internal
+{
+	struct TextureFormatInfo
+	{
+		const char* name;
+		bgfx::TextureFormat::Enum value;
+	};
+
+	static const TextureFormatInfo _texture_format_map[] =
+	{
+		{ "R8",       bgfx::TextureFormat::R8       },
+		{ "R16F",     bgfx::TextureFormat::R16F     },
+		{ "R32F",     bgfx::TextureFormat::R32F     },
+		{ "RG16F",    bgfx::TextureFormat::RG16F    },
+		{ "BGRA8",    bgfx::TextureFormat::BGRA8    },
+		{ "RGBA8",    bgfx::TextureFormat::RGBA8    },
+		{ "RGBA16F",  bgfx::TextureFormat::RGBA16F  },
+		{ "RGBA32F",  bgfx::TextureFormat::RGBA32F  },
+		{ "RGB10A2",  bgfx::TextureFormat::RGB10A2  },
+		{ "RG11B10F", bgfx::TextureFormat::RG11B10F },
+		{ "D16",      bgfx::TextureFormat::D16      },
+		{ "D24",      bgfx::TextureFormat::D24      },
+		{ "D24S8",    bgfx::TextureFormat::D24S8    },
+		{ "D32F",     bgfx::TextureFormat::D32F     }
+	};
+
+	struct PassTypeInfo
+	{
+		const char* name;
+		RenderGraphPassType::Enum value;
+	};
+
+	static const PassTypeInfo _pass_type_map[] =
+	{
+		{ "scene",      RenderGraphPassType::SCENE      },
+		{ "fullscreen", RenderGraphPassType::FULLSCREEN }
+	};
+	CE_STATIC_ASSERT(countof(_pass_type_map) == RenderGraphPassType::COUNT);
+
+	static bgfx::TextureFormat::Enum name_to_texture_format(const char* name)
+	{
+		for (u32 i = 0; i < countof(_texture_format_map); ++i)
+		{
+			if (strcmp(name, _texture_format_map[i].name) == 0)
+				return _texture_format_map[i].value;
+		}
+
+		return bgfx::TextureFormat::Count;
+	}
+
+	static RenderGraphPassType::Enum name_to_pass_type(const char* name)
+	{
+		for (u32 i = 0; i < countof(_pass_type_map); ++i)
+		{
+			if (strcmp(name, _pass_type_map[i].name) == 0)
+				return _pass_type_map[i].value;
+		}
+
+		return RenderGraphPassType::COUNT;
+	}
+
+	static bool is_depth(u32 format)
+	{
+		return format >= bgfx::TextureFormat::D16 && format <= bgfx::TextureFormat::D0S8;
+	}
+
+	static u32 find_target(const Array<RenderGraphTarget>& targets, StringId32 name)
+	{
+		for (u32 i = 0; i < array::size(targets); ++i)
+		{
+			if (targets[i].name == name)
+				return i;
+		}
+
+		return UINT32_MAX;
+	}
+
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		sjson::parse(buf, object);
+
+		JsonObject targets_json(ta);
+		JsonArray passes_json(ta);
+		sjson::parse_object(object["targets"], targets_json);
+		sjson::parse_array(object["passes"], passes_json);
+
+		Array<RenderGraphTarget> targets(default_allocator());
+		Array<RenderGraphPass> passes(default_allocator());
+		Array<u32> written(default_allocator()); // Whether each target has been written
+
+		auto cur = json_object::begin(targets_json);
+		auto end = json_object::end(targets_json);
+		for (; cur != end; ++cur)
+		{
+			TempAllocator512 tta;
+			JsonObject obj(tta);
+			sjson::parse_object(cur->pair.second, obj);
+
+			DynamicString name(tta);
+			name.set(cur->pair.first.data(), cur->pair.first.length());
+			DATA_COMPILER_ASSERT(strcmp(name.c_str(), "backbuffer") != 0
+				, opts
+				, "Target name is reserved: 'backbuffer'"
+				);
+
+			DynamicString format(tta);
+			sjson::parse_string(obj["format"], format);
+
+			RenderGraphTarget rt;
+			rt.name   = StringId32(name.c_str());
+			rt.format = name_to_texture_format(format.c_str());
+			rt.scale  = json_object::has(obj, "scale") ? sjson::parse_float(obj["scale"]) : 1.0f;
+			DATA_COMPILER_ASSERT(rt.format != bgfx::TextureFormat::Count
+				, opts
+				, "Unknown texture format: '%s'"
+				, format.c_str()
+				);
+			DATA_COMPILER_ASSERT(rt.scale > 0.0f && rt.scale <= 1.0f
+				, opts
+				, "Target scale must be in (0; 1]: '%s'"
+				, name.c_str()
+				);
+
+			DATA_COMPILER_ASSERT(array::size(targets) < RENDER_GRAPH_MAX_TARGETS
+				, opts
+				, "Too many targets"
+				);
+
+			array::push_back(targets, rt);
+			array::push_back(written, 0u);
+		}
+
+		for (u32 i = 0; i < array::size(passes_json); ++i)
+		{
+			TempAllocator1024 pta;
+			JsonObject obj(pta);
+			sjson::parse_object(passes_json[i], obj);
+
+			DynamicString name(pta);
+			DynamicString type(pta);
+			sjson::parse_string(obj["name"], name);
+			sjson::parse_string(obj["type"], type);
+
+			DATA_COMPILER_ASSERT(i < RENDER_GRAPH_MAX_PASSES
+				, opts
+				, "Too many passes"
+				);
+
+			RenderGraphPass pass;
+			memset(&pass, 0, sizeof(pass));
+			pass.name = StringId32(name.c_str());
+			pass.type = name_to_pass_type(type.c_str());
+			DATA_COMPILER_ASSERT(pass.type != RenderGraphPassType::COUNT
+				, opts
+				, "Unknown pass type: '%s'"
+				, type.c_str()
+				);
+
+			// The worlds are rendered before any fullscreen pass
+			DATA_COMPILER_ASSERT((i == 0) == (pass.type == RenderGraphPassType::SCENE)
+				, opts
+				, "The scene pass must be the first and only one: '%s'"
+				, name.c_str()
+				);
+
+			if (pass.type == RenderGraphPassType::FULLSCREEN)
+			{
+				DATA_COMPILER_ASSERT(json_object::has(obj, "shader")
+					, opts
+					, "Fullscreen pass must specify a shader: '%s'"
+					, name.c_str()
+					);
+				pass.shader = sjson::parse_string_id(obj["shader"]);
+			}
+
+			if (json_object::has(obj, "inputs"))
+			{
+				JsonObject inputs(pta);
+				sjson::parse_object(obj["inputs"], inputs);
+
+				auto icur = json_object::begin(inputs);
+				auto iend = json_object::end(inputs);
+				for (; icur != iend; ++icur)
+				{
+					DATA_COMPILER_ASSERT(pass.num_inputs < RENDER_GRAPH_MAX_INPUTS
+						, opts
+						, "Too many inputs: '%s'"
+						, name.c_str()
+						);
+					DATA_COMPILER_ASSERT(icur->pair.first.length() < RENDER_GRAPH_NAME_LEN
+						, opts
+						, "Sampler name is too long: '%s'"
+						, name.c_str()
+						);
+
+					DynamicString target(pta);
+					sjson::parse_string(icur->pair.second, target);
+					const u32 t = find_target(targets, StringId32(target.c_str()));
+					DATA_COMPILER_ASSERT(t != UINT32_MAX
+						, opts
+						, "Unknown target: '%s'"
+						, target.c_str()
+						);
+					DATA_COMPILER_ASSERT(written[t]
+						, opts
+						, "Target is read before being written: '%s'"
+						, target.c_str()
+						);
+
+					strncpy(pass.samplers[pass.num_inputs], icur->pair.first.data(), icur->pair.first.length());
+					pass.inputs[pass.num_inputs] = t;
+					++pass.num_inputs;
+				}
+			}
+
+			JsonArray outputs(pta);
+			sjson::parse_array(obj["outputs"], outputs);
+			DATA_COMPILER_ASSERT(array::size(outputs) > 0 && array::size(outputs) <= RENDER_GRAPH_MAX_OUTPUTS
+				, opts
+				, "Pass must have between 1 and %u outputs: '%s'"
+				, RENDER_GRAPH_MAX_OUTPUTS
+				, name.c_str()
+				);
+
+			u32 num_depth = 0;
+			for (u32 j = 0; j < array::size(outputs); ++j)
+			{
+				DynamicString target(pta);
+				sjson::parse_string(outputs[j], target);
+
+				u32 t = RENDER_GRAPH_BACKBUFFER;
+				if (target == "backbuffer")
+				{
+					DATA_COMPILER_ASSERT(array::size(outputs) == 1
+						, opts
+						, "The back buffer must be the only output: '%s'"
+						, name.c_str()
+						);
+				}
+				else
+				{
+					t = find_target(targets, StringId32(target.c_str()));
+					DATA_COMPILER_ASSERT(t != UINT32_MAX
+						, opts
+						, "Unknown target: '%s'"
+						, target.c_str()
+						);
+
+					for (u32 k = 0; k < pass.num_inputs; ++k)
+					{
+						DATA_COMPILER_ASSERT(pass.inputs[k] != t
+							, opts
+							, "Target is both read and written: '%s'"
+							, target.c_str()
+							);
+					}
+
+					DATA_COMPILER_ASSERT(j == 0 || targets[t].scale == targets[pass.outputs[0]].scale
+						, opts
+						, "Outputs must have the same scale: '%s'"
+						, target.c_str()
+						);
+
+					num_depth += is_depth(targets[t].format) ? 1 : 0;
+					written[t] = 1;
+				}
+
+				pass.outputs[pass.num_outputs++] = t;
+			}
+
+			DATA_COMPILER_ASSERT(num_depth <= 1
+				, opts
+				, "Pass must have at most one depth output: '%s'"
+				, name.c_str()
+				);
+			DATA_COMPILER_ASSERT(pass.type != RenderGraphPassType::SCENE
+				|| (num_depth == 1 && pass.num_outputs == 2 && pass.outputs[0] != RENDER_GRAPH_BACKBUFFER)
+				, opts
+				, "Scene pass must write one color and one depth target: '%s'"
+				, name.c_str()
+				);
+			DATA_COMPILER_ASSERT(pass.type != RenderGraphPassType::SCENE
+				|| (targets[pass.outputs[0]].scale == 1.0f && targets[pass.outputs[1]].scale == 1.0f)
+				, opts
+				, "Scene pass targets must have scale 1: '%s'"
+				, name.c_str()
+				);
+			DATA_COMPILER_ASSERT(pass.type != RenderGraphPassType::SCENE || pass.num_inputs == 0
+				, opts
+				, "Scene pass must not have inputs: '%s'"
+				, name.c_str()
+				);
+
+			array::push_back(passes, pass);
+		}
+
+		DATA_COMPILER_ASSERT(array::size(passes) > 0
+			, opts
+			, "Render graph must have a scene pass"
+			);
+
+		// Write
+		RenderGraphResource rgr;
+		rgr.version     = RESOURCE_VERSION_RENDER_GRAPH;
+		rgr.num_targets = array::size(targets);
+		rgr.num_passes  = array::size(passes);
+
+		opts.write(rgr.version);
+		opts.write(rgr.num_targets);
+		opts.write(rgr.num_passes);
+
+		for (u32 i = 0; i < array::size(targets); ++i)
+		{
+			opts.write(targets[i].name);
+			opts.write(targets[i].format);
+			opts.write(targets[i].scale);
+		}
+
+		for (u32 i = 0; i < array::size(passes); ++i)
+			opts.write(passes[i]);
+	}
+
+} // namespace render_graph_resource_internal
+
+namespace render_graph_resource
+{
+	const RenderGraphTarget* target(const RenderGraphResource* rgr, u32 i)
+	{
+		CE_ASSERT(i < rgr->num_targets, "Index out of bounds");
+		const RenderGraphTarget* targets = (RenderGraphTarget*)&rgr[1];
+		return &targets[i];
+	}
+
+	const RenderGraphPass* pass(const RenderGraphResource* rgr, u32 i)
+	{
+		CE_ASSERT(i < rgr->num_passes, "Index out of bounds");
+		const RenderGraphTarget* targets = (RenderGraphTarget*)&rgr[1];
+		const RenderGraphPass* passes = (RenderGraphPass*)&targets[rgr->num_targets];
+		return &passes[i];
+	}
+
+} // namespace render_graph_resource
+
+} // namespace crown
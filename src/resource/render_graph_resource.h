@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/strings/string_id.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+#define RENDER_GRAPH_MAX_TARGETS 32
+#define RENDER_GRAPH_MAX_PASSES  32
+#define RENDER_GRAPH_MAX_INPUTS  4
+#define RENDER_GRAPH_MAX_OUTPUTS 4
+#define RENDER_GRAPH_NAME_LEN    32
+#define RENDER_GRAPH_BACKBUFFER  UINT32_MAX // Output index of the back buffer
+
+namespace crown
+{
+struct RenderGraphResource
+{
+	u32 version;
+	u32 num_targets;
+	u32 num_passes;
+	// RenderGraphTarget targets[num_targets]
+	// RenderGraphPass passes[num_passes]
+};
+
+/// Render target sized relative to the back buffer.
+struct RenderGraphTarget
+{
+	StringId32 name;
+	u32 format; ///< bgfx::TextureFormat::Enum
+	f32 scale;
+};
+
+struct RenderGraphPassType
+{
+	enum Enum
+	{
+		SCENE,      ///< Sprites, meshes, debug lines and guis of the worlds.
+		FULLSCREEN, ///< Full screen triangle drawn with a shader.
+
+		COUNT
+	};
+};
+
+/// Pass of the graph. Passes run in the order they are declared and read
+/// only targets written by the passes before them.
+struct RenderGraphPass
+{
+	StringId32 name;
+	u32 type;          ///< RenderGraphPassType::Enum
+	StringId32 shader; ///< Only for fullscreen passes.
+	u32 num_inputs;
+	char samplers[RENDER_GRAPH_MAX_INPUTS][RENDER_GRAPH_NAME_LEN]; ///< Sampler each input is bound to.
+	u32 inputs[RENDER_GRAPH_MAX_INPUTS];   ///< Index of the target.
+	u32 num_outputs;
+	u32 outputs[RENDER_GRAPH_MAX_OUTPUTS]; ///< Index of the target or RENDER_GRAPH_BACKBUFFER.
+};
+
+namespace render_graph_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace render_graph_resource_internal
+
+namespace render_graph_resource
+{
+	/// Returns the target @a i.
+	const RenderGraphTarget* target(const RenderGraphResource* rgr, u32 i);
+
+	/// Returns the pass @a i.
+	const RenderGraphPass* pass(const RenderGraphResource* rgr, u32 i);
+
+} // namespace render_graph_resource
+
+} // namespace crown
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/filesystem/file.h"
+#include "core/filesystem/file_memory.h"
+#include "core/filesystem/filesystem.h"
+#include "core/filesystem/path.h"
+#include "core/memory/allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/inline_string.h"
+#include "resource/package_resource.h"
+#include "resource/resource_bundle.h"
+#include "resource/resource_compression.h"
+#include <algorithm>
+#include <string.h> // memcmp
+
+namespace crown
+{
+static bool operator<(const ResourceBundleEntry& a, const ResourceBundleEntry& b)
+{
+	return a.type < b.type || (a.type == b.type && a.name < b.name);
+}
+
+ResourceBundle::ResourceBundle(Allocator& a)
+	: _allocator(&a)
+	, _filesystem(NULL)
+	, _file(NULL)
+	, _data(NULL)
+	, _size(0)
+	, _mapped(false)
+{
+}
+
+ResourceBundle::~ResourceBundle()
+{
+	close();
+}
+
+bool ResourceBundle::open(Filesystem& fs, const char* path)
+{
+	CE_ASSERT(_data == NULL, "Bundle already open");
+
+	if (!fs.exists(path))
+		return false;
+
+	File* file = fs.open(path, FileOpenMode::READ);
+	if (file->is_open())
+	{
+		_data = (const char*)file->map(_size);
+		_mapped = _data != NULL;
+
+		if (_mapped)
+		{
+			// Keep the file open for as long as the bundle is mapped.
+			_filesystem = &fs;
+			_file = file;
+		}
+		else
+		{
+			_size = file->size();
+			char* data = (char*)_allocator->allocate(_size, RESOURCE_BUNDLE_ALIGN);
+			file->read(data, _size);
+			_data = data;
+		}
+	}
+
+	if (!_mapped)
+		fs.close(*file);
+
+	if (_data == NULL)
+		return false;
+
+	const ResourceBundleHeader* header = (const ResourceBundleHeader*)_data;
+	if (_size < sizeof(*header) || header->version != RESOURCE_BUNDLE_VERSION)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void ResourceBundle::close()
+{
+	if (_data == NULL)
+		return;
+
+	if (_mapped)
+		_filesystem->close(*_file);
+	else
+		_allocator->deallocate((void*)_data);
+
+	_filesystem = NULL;
+	_file = NULL;
+	_data = NULL;
+	_size = 0;
+	_mapped = false;
+}
+
+bool ResourceBundle::find(StringId64 type, StringId64 name, const void*& data, u32& size, u64& hash) const
+{
+	CE_ASSERT(_data != NULL, "Bundle is not open");
+
+	const ResourceBundleHeader* header = (const ResourceBundleHeader*)_data;
+	const ResourceBundleEntry* begin = (const ResourceBundleEntry*)&header[1];
+	const ResourceBundleEntry* end = begin + header->num_resources;
+
+	ResourceBundleEntry key;
+	key.type = type;
+	key.name = name;
+
+	const ResourceBundleEntry* entry = std::lower_bound(begin, end, key);
+	if (entry == end || entry->type != type || entry->name != name)
+		return false;
+
+	data = _data + entry->offset;
+	size = entry->size;
+	hash = entry->hash;
+	return true;
+}
+
+namespace resource_bundle
+{
+	static u32 align_offset(u32 offset, u32 align)
+	{
+		return (offset + align - 1) & ~(align - 1);
+	}
+
+	static void resource_path(StringId64 type, StringId64 name, DynamicString& path)
+	{
+		StringId64 mix;
+		mix._id = type._id ^ name._id;
+
+		InlineString<32> res_path;
+		mix.to_string(res_path);
+
+		path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+	}
+
+	void path(StringId64 package_name, DynamicString& path)
+	{
+		resource_path(RESOURCE_TYPE_PACKAGE, package_name, path);
+		path += RESOURCE_BUNDLE_EXTENSION;
+	}
+
+	bool write(Filesystem& data_filesystem, StringId64 package_name)
+	{
+		TempAllocator1024 ta;
+		DynamicString path(ta);
+		resource_path(RESOURCE_TYPE_PACKAGE, package_name, path);
+
+		File* file = data_filesystem.open(path.c_str(), FileOpenMode::READ);
+		if (!file->is_open())
+		{
+			data_filesystem.close(*file);
+			return false;
+		}
+		PackageResource* pr = NULL;
+		if (resource_compression::is_compressed(*file))
+		{
+			u32 size;
+			void* data = resource_compression::decompress(*file, default_allocator(), size);
+			FileMemory fm(data, size);
+			pr = (PackageResource*)package_resource_internal::load(fm, default_allocator());
+			default_allocator().deallocate(data);
+		}
+		else
+		{
+			pr = (PackageResource*)package_resource_internal::load(*file, default_allocator());
+		}
+		data_filesystem.close(*file);
+
+		const u32 num = array::size(pr->resources);
+
+		Array<ResourceBundleEntry> toc(default_allocator());
+		array::resize(toc, num);
+		for (u32 i = 0; i < num; ++i)
+		{
+			toc[i].type = pr->resources[i].type;
+			toc[i].name = pr->resources[i].name;
+		}
+		package_resource_internal::unload(default_allocator(), pr);
+
+		Buffer blobs(default_allocator());
+		const u32 toc_end = sizeof(ResourceBundleHeader) + num*sizeof(ResourceBundleEntry);
+		const u32 blobs_offset = align_offset(toc_end, RESOURCE_BUNDLE_ALIGN);
+		const char pad[RESOURCE_BUNDLE_ALIGN] = { 0 };
+
+		// Index of the first entry of each unique blob
+		HashMap<u64, u32> unique(default_allocator());
+
+		bool success = true;
+		for (u32 i = 0; i < num && success; ++i)
+		{
+			DynamicString res_path(ta);
+			resource_path(toc[i].type, toc[i].name, res_path);
+
+			File* res = data_filesystem.open(res_path.c_str(), FileOpenMode::READ);
+			success = res->is_open();
+			if (success)
+			{
+				const u32 size = res->size();
+				const u32 pos = array::size(blobs);
+				array::resize(blobs, pos + size);
+				res->read(array::begin(blobs) + pos, size);
+
+				const u64 hash = murmur64(array::begin(blobs) + pos, size, 0);
+				const u32 first = hash_map::get(unique, hash, UINT32_MAX);
+
+				toc[i].size = size;
+				toc[i].hash = hash;
+
+				if (first != UINT32_MAX
+					&& toc[first].size == size
+					&& memcmp(array::begin(blobs) + toc[first].offset - blobs_offset, array::begin(blobs) + pos, size) == 0
+					)
+				{
+					// Same data as a previous resource: point to its blob
+					toc[i].offset = toc[first].offset;
+					array::resize(blobs, pos);
+				}
+				else
+				{
+					toc[i].offset = blobs_offset + pos;
+					if (first == UINT32_MAX)
+						hash_map::set(unique, hash, i);
+
+					// Pad to the next blob
+					const u32 padded = align_offset(pos + size, RESOURCE_BUNDLE_ALIGN);
+					array::push(blobs, pad, padded - (pos + size));
+				}
+			}
+			data_filesystem.close(*res);
+		}
+
+		if (!success)
+			return false;
+
+		// The blobs follow the order of the package, which is the order
+		// the resources are requested in, while the table of contents is
+		// sorted for lookup
+		std::sort(array::begin(toc), array::end(toc));
+
+		ResourceBundleHeader header;
+		header.version = RESOURCE_BUNDLE_VERSION;
+		header.num_resources = num;
+
+		DynamicString bundle_path(ta);
+		resource_bundle::path(package_name, bundle_path);
+
+		File* out = data_filesystem.open(bundle_path.c_str(), FileOpenMode::WRITE);
+		u32 written = 0;
+		written += out->write(&header, sizeof(header));
+		written += out->write(array::begin(toc), num*sizeof(ResourceBundleEntry));
+		written += out->write(pad, blobs_offset - toc_end);
+		written += out->write(array::begin(blobs), array::size(blobs));
+		data_filesystem.close(*out);
+
+		return written == blobs_offset + array::size(blobs);
+	}
+
+} // namespace resource_bundle
+
+} // namespace crown
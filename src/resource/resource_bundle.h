@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/filesystem/types.h"
+#include "core/memory/types.h"
+#include "core/strings/string_id.h"
+#include "core/strings/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+#define RESOURCE_BUNDLE_VERSION   u32(2)
+#define RESOURCE_BUNDLE_ALIGN     u32(16)
+#define RESOURCE_BUNDLE_EXTENSION ".bundle"
+
+namespace crown
+{
+struct ResourceBundleHeader
+{
+	u32 version;
+	u32 num_resources;
+};
+
+/// Table of contents entry. Entries are sorted by (type, name).
+/// Resources with identical compiled data share the same offset.
+struct ResourceBundleEntry
+{
+	StringId64 type;
+	StringId64 name;
+	u32 offset; ///< From the beginning of the bundle.
+	u32 size;
+	u64 hash;   ///< Hash of the compiled data.
+};
+
+/// Compiled resources of a package packed into a single file.
+/// The file is accessed in place with File::map() when the filesystem
+/// allows it, otherwise it is read in memory with a single read.
+///
+/// @ingroup Resource
+struct ResourceBundle
+{
+	Allocator* _allocator;
+	Filesystem* _filesystem;
+	File* _file;
+	const char* _data;
+	u32 _size;
+	bool _mapped;
+
+	///
+	ResourceBundle(Allocator& a);
+
+	///
+	~ResourceBundle();
+
+	///
+	ResourceBundle(const ResourceBundle&) = delete;
+
+	///
+	ResourceBundle& operator=(const ResourceBundle&) = delete;
+
+	/// Opens the bundle at @a path in the filesystem @a fs.
+	/// Returns whether the bundle has been opened.
+	bool open(Filesystem& fs, const char* path);
+
+	/// Closes the bundle.
+	void close();
+
+	/// Returns whether the bundle contains the resource (@a type, @a name)
+	/// and, if so, fills @a data and @a size with its compiled data and
+	/// @a hash with the hash of the data.
+	bool find(StringId64 type, StringId64 name, const void*& data, u32& size, u64& hash) const;
+};
+
+namespace resource_bundle
+{
+	/// Fills @a path with the path of the bundle of @a package_name.
+	void path(StringId64 package_name, DynamicString& path);
+
+	/// Packs the compiled resources listed in the package @a package_name
+	/// into its bundle. The data is laid out in the order of the package,
+	/// so that loading the package reads the bundle front to back.
+	/// Resources with identical compiled data are stored only once.
+	/// Returns true on success, false otherwise.
+	bool write(Filesystem& data_filesystem, StringId64 package_name);
+
+} // namespace resource_bundle
+
+} // namespace crown
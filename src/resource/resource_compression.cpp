@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/error/error.h"
+#include "core/filesystem/file.h"
+#include "core/lz4.h"
+#include "core/memory/allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "resource/resource_compression.h"
+#include <string.h> // memcpy
+
+namespace crown
+{
+namespace resource_compression
+{
+	void compress(ResourceCompression::Enum compression, const Buffer& data, Buffer& output)
+	{
+		CE_ASSERT(compression == ResourceCompression::LZ4, "Unknown compression: %d", compression);
+
+		const u32 size = array::size(data);
+		const u32 num_chunks = (size + RESOURCE_COMPRESSION_CHUNK_SIZE - 1) / RESOURCE_COMPRESSION_CHUNK_SIZE;
+
+		CompressedResourceHeader header;
+		header.magic       = RESOURCE_COMPRESSION_MAGIC;
+		header.compression = compression;
+		header.size        = size;
+		header.num_chunks  = num_chunks;
+
+		const u32 chunks_offset = sizeof(header) + num_chunks*sizeof(u32);
+		array::resize(output, chunks_offset + lz4::compress_bound(RESOURCE_COMPRESSION_CHUNK_SIZE)*num_chunks);
+		memcpy(array::begin(output), &header, sizeof(header));
+
+		u32* chunk_size = (u32*)&output[sizeof(header)];
+		u32 offset = chunks_offset;
+
+		for (u32 i = 0; i < num_chunks; ++i)
+		{
+			const u32 begin = i*RESOURCE_COMPRESSION_CHUNK_SIZE;
+			const u32 len   = size - begin < RESOURCE_COMPRESSION_CHUNK_SIZE
+				? size - begin
+				: RESOURCE_COMPRESSION_CHUNK_SIZE
+				;
+
+			chunk_size[i] = lz4::compress(&data[begin]
+				, len
+				, &output[offset]
+				, array::size(output) - offset
+				);
+			CE_ENSURE(chunk_size[i] != 0);
+			offset += chunk_size[i];
+		}
+
+		array::resize(output, offset);
+	}
+
+	bool is_compressed(File& file)
+	{
+		const u32 pos = file.position();
+		u32 magic = 0;
+		const u32 num = file.read(&magic, sizeof(magic));
+		file.seek(pos);
+
+		return num == sizeof(magic) && magic == RESOURCE_COMPRESSION_MAGIC;
+	}
+
+	void* decompress(File& file, Allocator& a, u32& size)
+	{
+		CompressedResourceHeader header;
+		file.read(&header, sizeof(header));
+		CE_ASSERT(header.magic == RESOURCE_COMPRESSION_MAGIC, "Not a compressed resource");
+		CE_ASSERT(header.compression == ResourceCompression::LZ4, "Unknown compression: %d", header.compression);
+
+		TempAllocator1024 ta;
+		Array<u32> chunk_size(ta);
+		array::resize(chunk_size, header.num_chunks);
+		file.read(array::begin(chunk_size), header.num_chunks*sizeof(u32));
+
+		// Decompress straight from the file content if it can be accessed in place.
+		u32 mapped_size;
+		const char* mapped = (const char*)file.map(mapped_size);
+		u32 pos = file.position();
+
+		char* data = (char*)a.allocate(header.size);
+		char* chunk = mapped == NULL
+			? (char*)a.allocate(lz4::compress_bound(RESOURCE_COMPRESSION_CHUNK_SIZE))
+			: NULL
+			;
+
+		for (u32 i = 0; i < header.num_chunks; ++i)
+		{
+			const u32 begin = i*RESOURCE_COMPRESSION_CHUNK_SIZE;
+			const u32 len   = header.size - begin < RESOURCE_COMPRESSION_CHUNK_SIZE
+				? header.size - begin
+				: RESOURCE_COMPRESSION_CHUNK_SIZE
+				;
+
+			CE_ENSURE(chunk_size[i] <= lz4::compress_bound(RESOURCE_COMPRESSION_CHUNK_SIZE));
+			const char* src = chunk;
+			if (mapped != NULL)
+			{
+				CE_ENSURE(pos + chunk_size[i] <= mapped_size);
+				src = mapped + pos;
+				pos += chunk_size[i];
+			}
+			else
+			{
+				file.read(chunk, chunk_size[i]);
+			}
+
+			const bool ok = lz4::decompress(src, chunk_size[i], &data[begin], len);
+			CE_ASSERT(ok, "Corrupted resource");
+			CE_UNUSED(ok);
+		}
+
+		if (mapped != NULL)
+			file.seek(pos);
+		else
+			a.deallocate(chunk);
+
+		size = header.size;
+		return data;
+	}
+
+} // namespace resource_compression
+
+} // namespace crown
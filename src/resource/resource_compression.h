@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/filesystem/types.h"
+#include "core/memory/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+#define RESOURCE_COMPRESSION_MAGIC      u32(0x5a435243) // "CRCZ"
+#define RESOURCE_COMPRESSION_CHUNK_SIZE u32(64*1024)
+
+namespace crown
+{
+/// Header of a compressed resource.
+/// It is followed by the compressed size of each chunk and by the chunks
+/// themselves. Every chunk but the last one decompresses to
+/// RESOURCE_COMPRESSION_CHUNK_SIZE bytes, independently of the others.
+struct CompressedResourceHeader
+{
+	u32 magic;
+	u32 compression; ///< ResourceCompression::Enum
+	u32 size;        ///< Size of the resource once decompressed.
+	u32 num_chunks;
+};
+
+/// Functions to compress and decompress compiled resources.
+///
+/// @ingroup Resource
+namespace resource_compression
+{
+	/// Compresses @a data with the given @a compression and writes it to @a output.
+	void compress(ResourceCompression::Enum compression, const Buffer& data, Buffer& output);
+
+	/// Returns whether @a file contains a compressed resource.
+	/// The file position is left unchanged.
+	bool is_compressed(File& file);
+
+	/// Decompresses the resource @a file into memory allocated with @a a.
+	/// Returns the memory and its @a size.
+	void* decompress(File& file, Allocator& a, u32& size);
+
+} // namespace resource_compression
+
+} // namespace crown
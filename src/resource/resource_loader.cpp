@@ -4,16 +4,20 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/containers/queue.h"
 #include "core/filesystem/file.h"
+#include "core/filesystem/file_memory.h"
 #include "core/filesystem/filesystem.h"
 #include "core/filesystem/path.h"
 #include "core/memory/memory.h"
-#include "core/memory/temp_allocator.h"
 #include "core/os.h"
 #include "core/strings/dynamic_string.h"
+#include "core/strings/inline_string.h"
 #include "device/log.h"
+#include "resource/resource_bundle.h"
+#include "resource/resource_compression.h"
 #include "resource/resource_loader.h"
 
 namespace { const crown::log_internal::System RESOURCE_LOADER = { "resource_loader" }; }
@@ -25,39 +29,116 @@ static s32 thread_proc(void* thiz)
 	return ((ResourceLoader*)thiz)->run();
 }
 
-ResourceLoader::ResourceLoader(Filesystem& data_filesystem)
+ResourceLoader::ResourceLoader(Filesystem& data_filesystem, u32 num_threads)
 	: _data_filesystem(data_filesystem)
-	, _requests(default_allocator())
 	, _loaded(default_allocator())
 	, _fallback(default_allocator())
+	, _missing(default_allocator())
+	, _bundles(default_allocator())
+	, _num_threads(num_threads)
+	, _next_id(0)
+	, _pending(default_allocator())
 	, _exit(false)
 {
-	_thread.start(thread_proc, this);
+	CE_ASSERT(num_threads > 0 && num_threads <= CROWN_MAX_RESOURCE_LOADER_THREADS
+		, "Invalid number of loader threads: %u"
+		, num_threads
+		);
+
+	for (u32 i = 0; i < countof(_requests); ++i)
+		_requests[i] = CE_NEW(default_allocator(), Queue<ResourceRequest>)(default_allocator());
+
+	for (u32 i = 0; i < _num_threads; ++i)
+	{
+		_threads[i].set_name("resource_loader");
+		_threads[i].set_priority(ThreadPriority::LOW);
+		_threads[i].start(thread_proc, this);
+	}
 }
 
 ResourceLoader::~ResourceLoader()
 {
+	_mutex.lock();
 	_exit = true;
-	_requests_condition.signal(); // Spurious wake to exit thread
-	_thread.stop();
+	_requests_condition.broadcast(); // Spurious wake to exit threads
+	_mutex.unlock();
+
+	for (u32 i = 0; i < _num_threads; ++i)
+		_threads[i].stop();
+
+	for (u32 i = 0; i < countof(_requests); ++i)
+		CE_DELETE(default_allocator(), _requests[i]);
+
+	for (u32 i = 0; i < array::size(_bundles); ++i)
+		CE_DELETE(default_allocator(), _bundles[i].bundle);
 }
 
-void ResourceLoader::add_request(const ResourceRequest& rr)
+u32 ResourceLoader::add_request(const ResourceRequest& rr)
 {
+	CE_ASSERT(rr.priority < ResourcePriority::COUNT, "Unknown priority: %d", rr.priority);
+
+	ResourceRequest request = rr;
+	request.bundle = NULL;
+	request.bundle_offset = 0;
+	{
+		ScopedMutex sm(_bundles_mutex);
+		for (u32 i = 0; i < array::size(_bundles); ++i)
+		{
+			const void* data;
+			u32 size;
+			u64 hash;
+			if (_bundles[i].bundle->find(rr.type, rr.name, data, size, hash))
+			{
+				request.bundle = _bundles[i].bundle;
+				request.bundle_offset = u32((const char*)data - _bundles[i].bundle->_data);
+				break;
+			}
+		}
+	}
+
 	ScopedMutex sm(_mutex);
-	queue::push_back(_requests, rr);
+	const u32 id = _next_id++;
+
+	request.id = id;
+	request.time_requested = os::clocktime();
+
+	Queue<ResourceRequest>& requests = *_requests[rr.priority];
+	queue::push_back(requests, request);
+
+	// Move the request before the ones for data further in the same
+	// bundle, so that the bundle is read front to back.
+	for (u32 i = queue::size(requests) - 1; i > 0 && request.bundle != NULL; --i)
+	{
+		const ResourceRequest prev = requests[i - 1];
+		if (prev.bundle != request.bundle || prev.bundle_offset <= request.bundle_offset)
+			break;
+
+		requests[i - 1] = request;
+		requests[i] = prev;
+	}
+	hash_map::set(_pending, id, id);
 	_requests_condition.signal();
+	return id;
+}
+
+void ResourceLoader::wait(u32 id)
+{
+	ScopedMutex sm(_mutex);
+	while (hash_map::has(_pending, id))
+		_completed_condition.wait(_mutex);
 }
 
 void ResourceLoader::flush()
 {
-	while (num_requests()) {}
+	ScopedMutex sm(_mutex);
+	while (hash_map::size(_pending) != 0)
+		_completed_condition.wait(_mutex);
 }
 
 u32 ResourceLoader::num_requests()
 {
 	ScopedMutex sm(_mutex);
-	return queue::size(_requests);
+	return hash_map::size(_pending);
 }
 
 void ResourceLoader::add_loaded(ResourceRequest rr)
@@ -80,70 +161,225 @@ void ResourceLoader::get_loaded(Array<ResourceRequest>& loaded)
 	}
 }
 
+bool ResourceLoader::pop_loaded(ResourceRequest& rr)
+{
+	ScopedMutex sm(_loaded_mutex);
+
+	if (queue::empty(_loaded))
+		return false;
+
+	rr = queue::front(_loaded);
+	queue::pop_front(_loaded);
+	return true;
+}
+
+u32 ResourceLoader::num_loaded()
+{
+	ScopedMutex sm(_loaded_mutex);
+	return queue::size(_loaded);
+}
+
 void ResourceLoader::register_fallback(StringId64 type, StringId64 name)
 {
 	hash_map::set(_fallback, type, name);
 }
 
-s32 ResourceLoader::run()
+void ResourceLoader::get_missing(Array<MissingResource>& missing)
 {
-	while (1)
+	ScopedMutex sm(_missing_mutex);
+	array::push(missing, array::begin(_missing), array::size(_missing));
+	array::clear(_missing);
+}
+
+void ResourceLoader::mount_bundle(StringId64 package_name)
+{
+	ScopedMutex sm(_bundles_mutex);
+
+	for (u32 i = 0; i < array::size(_bundles); ++i)
 	{
-		_mutex.lock();
-		while (queue::empty(_requests) && !_exit)
-			_requests_condition.wait(_mutex);
+		if (_bundles[i].package_name == package_name)
+		{
+			++_bundles[i].references;
+			return;
+		}
+	}
 
-		if (_exit)
-			break;
+	InlineString<256> path;
+	resource_bundle::path(package_name, path);
 
-		ResourceRequest rr = queue::front(_requests);
-		_mutex.unlock();
+	ResourceBundle* bundle = CE_NEW(default_allocator(), ResourceBundle)(default_allocator());
+	if (!bundle->open(_data_filesystem, path.c_str()))
+	{
+		CE_DELETE(default_allocator(), bundle);
+		return;
+	}
 
-		StringId64 mix;
-		mix._id = rr.type._id ^ rr.name._id;
+	MountedBundle mb;
+	mb.package_name = package_name;
+	mb.references = 1;
+	mb.bundle = bundle;
+	array::push_back(_bundles, mb);
+}
 
-		TempAllocator128 ta;
-		DynamicString res_path(ta);
-		mix.to_string(res_path);
+void ResourceLoader::unmount_bundle(StringId64 package_name)
+{
+	// Requests in flight may still be reading from the bundle
+	flush();
 
-		DynamicString path(ta);
-		path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+	ScopedMutex sm(_bundles_mutex);
 
-		File* file = _data_filesystem.open(path.c_str(), FileOpenMode::READ);
-		if (!file->is_open())
+	for (u32 i = 0, n = array::size(_bundles); i < n; ++i)
+	{
+		if (_bundles[i].package_name == package_name)
 		{
-			logw(RESOURCE_LOADER, "Can't load resource #ID(%s). Falling back...", res_path.c_str());
+			if (--_bundles[i].references == 0)
+			{
+				CE_DELETE(default_allocator(), _bundles[i].bundle);
+				_bundles[i] = _bundles[n-1];
+				array::pop_back(_bundles);
+			}
+			return;
+		}
+	}
+}
 
-			StringId64 fallback_name;
-			fallback_name = hash_map::get(_fallback, rr.type, fallback_name);
-			CE_ENSURE(fallback_name._id != 0);
+void ResourceLoader::load_file(ResourceRequest& rr, File& file)
+{
+	// Decompress in memory and load from there
+	if (resource_compression::is_compressed(file))
+	{
+		u32 size;
+		void* data = resource_compression::decompress(file, default_allocator(), size);
+		FileMemory fm(data, size);
+		load_file(rr, fm);
+		default_allocator().deallocate(data);
+		return;
+	}
 
-			mix._id = rr.type._id ^ fallback_name._id;
-			mix.to_string(res_path);
-			path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+	if (rr.stream_function)
+	{
+		rr.stream_function(file, rr.user_data);
+	}
+	else if (rr.load_function)
+	{
+		rr.size = file.size();
+		rr.data = rr.load_function(file, *rr.allocator);
+	}
+	else
+	{
+		rr.size = file.size();
+		rr.data = rr.allocator->allocate(rr.size);
+		file.read(rr.data, rr.size);
+		CE_ASSERT(*(u32*)rr.data == rr.version, "Wrong version");
+	}
+}
 
-			_data_filesystem.close(*file);
-			file = _data_filesystem.open(path.c_str(), FileOpenMode::READ);
+bool ResourceLoader::load_from_bundle(ResourceRequest& rr)
+{
+	const void* data = NULL;
+	u32 size = 0;
+	u64 hash = 0;
+	{
+		ScopedMutex sm(_bundles_mutex);
+		u32 i = 0;
+		for (; i < array::size(_bundles); ++i)
+		{
+			if (_bundles[i].bundle->find(rr.type, rr.name, data, size, hash))
+				break;
 		}
-		CE_ASSERT(file->is_open(), "Can't load resource #ID(%s)", res_path.c_str());
 
-		if (rr.load_function)
+		if (i == array::size(_bundles))
+			return false;
+	}
+
+	rr.time_opened = os::clocktime();
+	rr.content_hash = hash;
+	FileMemory file(data, size);
+	load_file(rr, file);
+	return true;
+}
+
+void ResourceLoader::load(ResourceRequest& rr)
+{
+	if (load_from_bundle(rr))
+		return;
+
+	StringId64 mix;
+	mix._id = rr.type._id ^ rr.name._id;
+
+	InlineString<32> res_path;
+	mix.to_string(res_path);
+
+	InlineString<64> path;
+	path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+
+	File* file = _data_filesystem.open(path.c_str(), FileOpenMode::READ);
+	if (!file->is_open())
+	{
+		logw(RESOURCE_LOADER, "Can't load resource #ID(%s). Falling back...", res_path.c_str());
+
 		{
-			rr.data = rr.load_function(*file, *rr.allocator);
+			MissingResource mr;
+			mr.type = rr.type;
+			mr.name = rr.name;
+			ScopedMutex sm(_missing_mutex);
+			array::push_back(_missing, mr);
 		}
-		else
+
+		StringId64 fallback_name;
+		fallback_name = hash_map::get(_fallback, rr.type, fallback_name);
+		CE_ENSURE(fallback_name._id != 0);
+
+		mix._id = rr.type._id ^ fallback_name._id;
+		mix.to_string(res_path);
+		path::join(path, CROWN_DATA_DIRECTORY, res_path.c_str());
+
+		_data_filesystem.close(*file);
+		file = _data_filesystem.open(path.c_str(), FileOpenMode::READ);
+	}
+	CE_ASSERT(file->is_open(), "Can't load resource #ID(%s)", res_path.c_str());
+
+	rr.time_opened = os::clocktime();
+	load_file(rr, *file);
+	_data_filesystem.close(*file);
+}
+
+s32 ResourceLoader::run()
+{
+	while (1)
+	{
+		_mutex.lock();
+
+		u32 prio = 0;
+		while (!_exit)
 		{
-			const u32 size = file->size();
-			rr.data = rr.allocator->allocate(size);
-			file->read(rr.data, size);
-			CE_ASSERT(*(u32*)rr.data == rr.version, "Wrong version");
+			for (prio = 0; prio < ResourcePriority::COUNT; ++prio)
+			{
+				if (!queue::empty(*_requests[prio]))
+					break;
+			}
+
+			if (prio != ResourcePriority::COUNT)
+				break;
+
+			_requests_condition.wait(_mutex);
 		}
 
-		_data_filesystem.close(*file);
+		if (_exit)
+			break;
+
+		ResourceRequest rr = queue::front(*_requests[prio]);
+		queue::pop_front(*_requests[prio]);
+		_mutex.unlock();
+
+		rr.time_started = os::clocktime();
+		load(rr);
+		rr.time_loaded = os::clocktime();
 
 		add_loaded(rr);
 		_mutex.lock();
-		queue::pop_front(_requests);
+		hash_map::remove(_pending, rr.id);
+		_completed_condition.broadcast();
 		_mutex.unlock();
 	}
 
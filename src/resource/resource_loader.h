@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/containers/types.h"
 #include "core/filesystem/types.h"
 #include "core/strings/string_id.h"
@@ -12,52 +13,114 @@
 #include "core/thread/mutex.h"
 #include "core/thread/thread.h"
 #include "core/types.h"
+#include "resource/types.h"
 
 namespace crown
 {
 struct ResourceRequest
 {
 	typedef void* (*LoadFunction)(File& file, Allocator& a);
+	typedef void (*StreamFunction)(File& file, void* user_data);
+	typedef void (*CompleteFunction)(void* user_data);
 
+	u32 id;
 	StringId64 type;
 	StringId64 name;
 	u32 version;
+	ResourcePriority::Enum priority;
 	LoadFunction load_function;
 	Allocator* allocator;
 	void* data;
+	u32 size;
+
+	s64 time_requested;
+	s64 time_started;
+	s64 time_opened;
+	s64 time_loaded;
+
+	/// Hash of the compiled data if known, 0 otherwise.
+	u64 content_hash;
+
+	/// If not NULL, called by the loader thread in place of load_function.
+	StreamFunction stream_function;
+	/// Called by ResourceManager when the stream request has completed.
+	CompleteFunction complete_function;
+	void* user_data;
+
+	/// Mounted bundle containing the resource, if any, and the offset of
+	/// its data in the bundle. Set by ResourceLoader::add_request().
+	const ResourceBundle* bundle;
+	u32 bundle_offset;
 };
 
-/// Loads resources in a background thread.
+/// Loads resources in a pool of background threads.
+/// Resources contained in a mounted ResourceBundle are served from
+/// the bundle's memory, all the others are read from their own file.
 ///
 /// @ingroup Resource
 struct ResourceLoader
 {
 	Filesystem& _data_filesystem;
 
-	Queue<ResourceRequest> _requests;
+	Queue<ResourceRequest>* _requests[ResourcePriority::COUNT];
 	Queue<ResourceRequest> _loaded;
 	HashMap<StringId64, StringId64> _fallback;
 
-	Thread _thread;
+	struct MissingResource
+	{
+		StringId64 type;
+		StringId64 name;
+	};
+
+	Array<MissingResource> _missing; ///< Resources replaced by their fallback.
+	Mutex _missing_mutex;
+
+	struct MountedBundle
+	{
+		StringId64 package_name;
+		u32 references;
+		ResourceBundle* bundle;
+	};
+
+	Array<MountedBundle> _bundles;
+	Mutex _bundles_mutex;
+
+	Thread _threads[CROWN_MAX_RESOURCE_LOADER_THREADS];
+	u32 _num_threads;
+	u32 _next_id;
+	HashMap<u32, u32> _pending;
 	Mutex _mutex;
 	ConditionVariable _requests_condition;
+	ConditionVariable _completed_condition;
 	Mutex _loaded_mutex;
 	bool _exit;
 
 	u32 num_requests();
 	void add_loaded(ResourceRequest rr);
+	void load(ResourceRequest& rr);
+	void load_file(ResourceRequest& rr, File& file);
+	bool load_from_bundle(ResourceRequest& rr);
 
 	/// Do not call explicitly.
 	s32 run();
 
-	/// Read resources from @a data_filesystem.
-	ResourceLoader(Filesystem& data_filesystem);
+	/// Read resources from @a data_filesystem using @a num_threads
+	/// loader threads.
+	ResourceLoader(Filesystem& data_filesystem, u32 num_threads = CROWN_DEFAULT_RESOURCE_LOADER_THREADS);
 
 	///
 	~ResourceLoader();
 
 	/// Adds a request for loading the resource described by @a rr.
-	void add_request(const ResourceRequest& rr);
+	/// Requests with higher priority are served first; requests with
+	/// the same priority are served in FIFO order, except that consecutive
+	/// requests for resources in the same bundle are served in the order
+	/// their data is laid out in the bundle.
+	/// Returns a handle that can be passed to wait().
+	u32 add_request(const ResourceRequest& rr);
+
+	/// Blocks until the request @a id has been processed.
+	void wait(u32 id);
 
 	/// Blocks until all pending requests have been processed.
 	void flush();
@@ -65,8 +128,27 @@ struct ResourceLoader
 	/// Returns all the resources that have been loaded.
 	void get_loaded(Array<ResourceRequest>& loaded);
 
+	/// Removes the oldest loaded resource and copies it to @a rr.
+	/// Returns false if no resources have been loaded.
+	bool pop_loaded(ResourceRequest& rr);
+
+	/// Returns the number of resources that have been loaded but not
+	/// yet returned by get_loaded() or pop_loaded().
+	u32 num_loaded();
+
 	/// Registers a fallback resource @a name for the given resource @a type.
 	void register_fallback(StringId64 type, StringId64 name);
+
+	/// Returns the resources which have been replaced by their fallback
+	/// because their data could not be found since the last call.
+	void get_missing(Array<MissingResource>& missing);
+
+	/// Mounts the bundle of the package @a package_name, if any.
+	/// Subsequent requests for resources in the bundle are served from it.
+	void mount_bundle(StringId64 package_name);
+
+	/// Unmounts the bundle of the package @a package_name.
+	void unmount_bundle(StringId64 package_name);
 };
 
 } // namespace crown
@@ -4,126 +4,288 @@
  */
 
 #include "core/containers/array.h"
+#include "core/containers/hash_map.h"
 #include "core/containers/sort_map.h"
+#include "core/memory/memory.h"
 #include "core/memory/temp_allocator.h"
-#include "core/strings/dynamic_string.h"
+#include "core/os.h"
+#include "device/profiler.h"
 #include "resource/resource_loader.h"
 #include "resource/resource_manager.h"
+#include "resource/resource_package.h"
+#include <inttypes.h> // PRIx64
 
 namespace crown
 {
-const ResourceManager::ResourceEntry ResourceManager::ResourceEntry::NOT_FOUND = { 0xffffffffu, NULL };
+static StringId64 resource_id(StringId64 type, StringId64 name)
+{
+	StringId64 mix;
+	mix._id = type._id ^ name._id;
+	return mix;
+}
 
 ResourceManager::ResourceManager(ResourceLoader& rl)
 	: _resource_heap(default_allocator(), "resource")
 	, _loader(&rl)
 	, _type_data(default_allocator())
 	, _rm(default_allocator())
+	, _entries(default_allocator())
+	, _free_entries(default_allocator())
+	, _pending(default_allocator())
+	, _shared(default_allocator())
+	, _prefetched(default_allocator())
 	, _autoload(false)
+	, _prefetch_neighbours(false)
+	, _version(0)
 {
 }
 
 ResourceManager::~ResourceManager()
 {
-	auto cur = sort_map::begin(_rm);
-	auto end = sort_map::end(_rm);
-	for (; cur != end; ++cur)
+	CE_ASSERT(array::size(_prefetched) == 0, "Prefetched packages must be unloaded");
+
+	for (u32 i = 0; i < array::size(_entries); ++i)
 	{
-		const StringId64 type = cur->first.type;
-		const StringId64 name = cur->first.name;
-		on_offline(type, name);
-		on_unload(type, cur->second.data);
+		ResourceEntry& entry = _entries[i];
+		if (entry.data == NULL)
+			continue;
+
+		on_offline(entry.type, entry.name);
+		release_data(i);
 	}
 }
 
-void ResourceManager::load(StringId64 type, StringId64 name)
+ResourceManager::ResourceEntry* ResourceManager::find(StringId64 type, StringId64 name)
 {
-	ResourcePair id = { type, name };
-	ResourceEntry& entry = sort_map::get(_rm, id, ResourceEntry::NOT_FOUND);
+	const u32 index = hash_map::get(_rm, resource_id(type, name), UINT32_MAX);
+	return index != UINT32_MAX ? &_entries[index] : NULL;
+}
 
-	if (entry == ResourceEntry::NOT_FOUND)
-	{
-		ResourceTypeData rtd;
-		rtd.version = UINT32_MAX;
-		rtd.load = NULL;
-		rtd.online = NULL;
-		rtd.offline = NULL;
-		rtd.unload = NULL;
-		rtd = sort_map::get(_type_data, type, rtd);
+void ResourceManager::destroy_entry(u32 index)
+{
+	if (_entries[index].references == 0)
+		lru_remove(index);
+
+	type_data(_entries[index].type).size -= _entries[index].size;
+
+	const StringId64 type = _entries[index].type;
+	const StringId64 name = _entries[index].name;
 
-		ResourceRequest rr;
-		rr.type = type;
-		rr.name = name;
-		rr.version = rtd.version;
-		rr.load_function = rtd.load;
-		rr.allocator = &_resource_heap;
-		rr.data = NULL;
+	on_offline(type, name);
+	release_data(index);
 
-		_loader->add_request(rr);
+	// Callbacks may have loaded other resources, re-fetch the entry.
+	ResourceEntry& entry = _entries[index];
+	hash_map::remove(_rm, resource_id(type, name));
+	entry.references = 0;
+	entry.size = 0;
+	entry.data = NULL;
+	++entry.generation;
+	array::push_back(_free_entries, index);
+}
+
+u32 ResourceManager::add_request(StringId64 type, StringId64 name, ResourcePriority::Enum priority)
+{
+	ResourceTypeData rtd;
+	rtd.version = UINT32_MAX;
+	rtd.load = NULL;
+	rtd.online = NULL;
+	rtd.offline = NULL;
+	rtd.unload = NULL;
+	rtd = sort_map::get(_type_data, type, rtd);
+
+	ResourceRequest rr;
+	rr.type = type;
+	rr.name = name;
+	rr.version = rtd.version;
+	rr.priority = priority;
+	rr.load_function = rtd.load;
+	rr.allocator = &_resource_heap;
+	rr.data = NULL;
+	rr.size = 0;
+	rr.time_requested = 0;
+	rr.time_started = 0;
+	rr.time_opened = 0;
+	rr.time_loaded = 0;
+	rr.content_hash = 0;
+	rr.stream_function = NULL;
+	rr.complete_function = NULL;
+	rr.user_data = NULL;
+
+	return _loader->add_request(rr);
+}
+
+void ResourceManager::load(StringId64 type, StringId64 name, ResourcePriority::Enum priority)
+{
+	ResourceEntry* entry = find(type, name);
+
+	if (entry == NULL)
+	{
+		const StringId64 mix = resource_id(type, name);
+		if (hash_map::has(_pending, mix))
+		{
+			PendingRequest pr = hash_map::get(_pending, mix, PendingRequest());
+			++pr.references;
+			hash_map::set(_pending, mix, pr);
+			return;
+		}
+
+		PendingRequest pr;
+		pr.id = add_request(type, name, priority);
+		pr.references = 1;
+		hash_map::set(_pending, mix, pr);
 		return;
 	}
 
-	entry.references++;
+	if (entry->references++ == 0)
+		lru_remove(u32(entry - array::begin(_entries)));
+}
+
+void ResourceManager::stream(StringId64 type
+	, StringId64 name
+	, ResourcePriority::Enum priority
+	, ResourceRequest::StreamFunction stream_function
+	, ResourceRequest::CompleteFunction complete_function
+	, void* user_data
+	)
+{
+	CE_ENSURE(NULL != stream_function);
+	CE_ENSURE(NULL != complete_function);
+
+	ResourceRequest rr;
+	rr.type = type;
+	rr.name = name;
+	rr.version = UINT32_MAX;
+	rr.priority = priority;
+	rr.load_function = NULL;
+	rr.allocator = NULL;
+	rr.data = NULL;
+	rr.size = 0;
+	rr.time_requested = 0;
+	rr.time_started = 0;
+	rr.time_opened = 0;
+	rr.time_loaded = 0;
+	rr.content_hash = 0;
+	rr.stream_function = stream_function;
+	rr.complete_function = complete_function;
+	rr.user_data = user_data;
+
+	_loader->add_request(rr);
 }
 
 void ResourceManager::unload(StringId64 type, StringId64 name)
 {
-	flush();
+	wait(type, name);
 
-	ResourcePair id = { type, name };
-	ResourceEntry& entry = sort_map::get(_rm, id, ResourceEntry::NOT_FOUND);
+	ResourceEntry* entry = find(type, name);
+	CE_ASSERT(entry != NULL, "Resource not loaded");
 
-	if (--entry.references == 0)
+	if (--entry->references == 0)
 	{
-		on_offline(type, name);
-		on_unload(type, entry.data);
-
-		sort_map::remove(_rm, id);
-		sort_map::sort(_rm);
+		lru_push_front(u32(entry - array::begin(_entries)));
+		evict(type);
 	}
 }
 
 void ResourceManager::reload(StringId64 type, StringId64 name)
 {
-	const ResourcePair id = { type, name };
-	const ResourceEntry& entry = sort_map::get(_rm, id, ResourceEntry::NOT_FOUND);
-	const u32 old_refs = entry.references;
+	const StringId64 mix = resource_id(type, name);
+	if (hash_map::has(_pending, mix))
+	{
+		// Being reloaded already.
+		if (find(type, name) != NULL)
+			return;
+
+		wait(type, name);
+	}
+
+	ResourceEntry* entry = find(type, name);
+	CE_ASSERT(entry != NULL, "Resource not loaded");
+
+	// Cached resources are simply evicted.
+	if (entry->references == 0)
+	{
+		destroy_entry(u32(entry - array::begin(_entries)));
+		return;
+	}
+
+	// The old resource is replaced by complete_request() once the new one
+	// has been loaded.
+	PendingRequest pr;
+	pr.id = add_request(type, name, ResourcePriority::NORMAL);
+	pr.references = 0;
+	hash_map::set(_pending, mix, pr);
+}
 
-	unload(type, name);
-	load(type, name);
-	flush();
+void ResourceManager::replace_entry(u32 index, const ResourceRequest& rr)
+{
+	const StringId64 type = rr.type;
+	const StringId64 name = rr.name;
+
+	on_offline(type, name);
+	release_data(index);
+
+	// Callbacks may have loaded other resources, re-fetch the entry.
+	// Reloaded data is never shared, other resources keep the old one.
+	ResourceEntry& entry = _entries[index];
+	ResourceTypeData& rtd = type_data(type);
+	rtd.size -= entry.size;
+	rtd.size += rr.size;
+	entry.size = rr.size;
+	entry.data = rr.data;
+	entry.shared = 0;
+	++entry.generation;
 
-	ResourceEntry& new_entry = sort_map::get(_rm, id, ResourceEntry::NOT_FOUND);
-	new_entry.references = old_refs;
+	on_online(type, name);
 }
 
 bool ResourceManager::can_get(StringId64 type, StringId64 name)
 {
-	const ResourcePair id = { type, name };
-	return _autoload ? true : sort_map::has(_rm, id);
+	if (_autoload)
+		return true;
+
+	ResourceEntry* entry = find(type, name);
+	return entry != NULL && entry->references != 0;
 }
 
 const void* ResourceManager::get(StringId64 type, StringId64 name)
 {
-	const ResourcePair id = { type, name };
+	ResourceEntry* entry = find(type, name);
 
-	StringId64 mix;
-	mix._id = type._id ^ name._id;
+	if (entry == NULL)
+	{
+		CE_ASSERT(_autoload, "Resource not loaded #ID(%.16" PRIx64 ")", resource_id(type, name)._id);
+		if (!_autoload)
+			return NULL;
 
-	TempAllocator64 ta;
-	DynamicString path(ta);
-	mix.to_string(path);
+		load(type, name, ResourcePriority::CRITICAL);
+		wait(type, name);
+		entry = find(type, name);
+	}
 
-	CE_ASSERT(can_get(type, name), "Resource not loaded #ID(%s)", path.c_str());
+	return entry->data;
+}
 
-	if (_autoload && !sort_map::has(_rm, id))
-	{
-		load(type, name);
-		flush();
-	}
+ResourceHandle ResourceManager::handle(StringId64 type, StringId64 name)
+{
+	ResourceHandle h;
+	h.index = hash_map::get(_rm, resource_id(type, name), UINT32_MAX);
+	h.generation = h.index != UINT32_MAX ? _entries[h.index].generation : 0;
+	return h;
+}
+
+bool ResourceManager::is_valid(ResourceHandle h) const
+{
+	return h.index < array::size(_entries)
+		&& _entries[h.index].generation == h.generation
+		&& _entries[h.index].references != 0
+		;
+}
 
-	const ResourceEntry& entry = sort_map::get(_rm, id, ResourceEntry::NOT_FOUND);
-	return entry.data;
+const void* ResourceManager::get(ResourceHandle h) const
+{
+	CE_ASSERT(is_valid(h), "Stale resource handle");
+	return _entries[h.index].data;
 }
 
 void ResourceManager::enable_autoload(bool enable)
@@ -131,6 +293,20 @@ void ResourceManager::enable_autoload(bool enable)
 	_autoload = enable;
 }
 
+void ResourceManager::wait(StringId64 type, StringId64 name)
+{
+	PendingRequest pr;
+	pr.id = UINT32_MAX;
+	pr.references = 0;
+	pr = hash_map::get(_pending, resource_id(type, name), pr);
+
+	if (pr.id != UINT32_MAX)
+	{
+		_loader->wait(pr.id);
+		complete_requests();
+	}
+}
+
 void ResourceManager::flush()
 {
 	_loader->flush();
@@ -144,21 +320,172 @@ void ResourceManager::complete_requests()
 	_loader->get_loaded(loaded);
 
 	for (u32 i = 0; i < array::size(loaded); ++i)
-		complete_request(loaded[i].type, loaded[i].name, loaded[i].data);
+		complete_request(loaded[i]);
 }
 
-void ResourceManager::complete_request(StringId64 type, StringId64 name, void* data)
+void ResourceManager::complete_requests(f32 time_budget)
 {
-	ResourceEntry entry;
-	entry.references = 1;
-	entry.data = data;
+	if (time_budget <= 0.0f)
+	{
+		complete_requests();
+		return;
+	}
 
-	ResourcePair id = { type, name };
+	const s64 t0 = os::clocktime();
+	const s64 budget = s64(f64(time_budget) * f64(os::clockfrequency()) / 1000.0);
+	u32 num_completed = 0;
 
-	sort_map::set(_rm, id, entry);
-	sort_map::sort(_rm);
+	ResourceRequest rr;
+	while (_loader->pop_loaded(rr))
+	{
+		complete_request(rr);
+		++num_completed;
 
+		if (os::clocktime() - t0 >= budget)
+			break;
+	}
+
+	RECORD_FLOAT("resource_manager.completed", f32(num_completed));
+	RECORD_FLOAT("resource_manager.backlog", f32(num_backlog()));
+	RECORD_FLOAT("resource_loader.requests", f32(_loader->num_requests()));
+	RECORD_FLOAT("resource_manager.online_time", f32(f64(os::clocktime() - t0) * 1000.0 / f64(os::clockfrequency())));
+}
+
+void ResourceManager::prefetch(StringId64 package_name)
+{
+	for (u32 i = 0; i < array::size(_prefetched); ++i)
+	{
+		if (_prefetched[i]->_package_id == package_name)
+			return;
+	}
+
+	ResourcePackage* rp = CE_NEW(default_allocator(), ResourcePackage)(package_name, *this);
+	rp->prefetch();
+	array::push_back(_prefetched, rp);
+}
+
+void ResourceManager::unload_prefetched(StringId64 package_name)
+{
+	for (u32 i = 0, n = array::size(_prefetched); i < n; ++i)
+	{
+		if (_prefetched[i]->_package_id == package_name)
+		{
+			_prefetched[i]->unload();
+			CE_DELETE(default_allocator(), _prefetched[i]);
+			_prefetched[i] = _prefetched[n-1];
+			array::pop_back(_prefetched);
+			return;
+		}
+	}
+
+	CE_FATAL("Package not prefetched");
+}
+
+void ResourceManager::unload_prefetched()
+{
+	for (u32 i = 0; i < array::size(_prefetched); ++i)
+	{
+		_prefetched[i]->unload();
+		CE_DELETE(default_allocator(), _prefetched[i]);
+	}
+
+	array::clear(_prefetched);
+}
+
+void ResourceManager::update_prefetched()
+{
+	for (u32 i = 0; i < array::size(_prefetched); ++i)
+		_prefetched[i]->update();
+}
+
+void ResourceManager::enable_neighbours_prefetch(bool enable)
+{
+	_prefetch_neighbours = enable;
+}
+
+u32 ResourceManager::num_backlog()
+{
+	return _loader->num_loaded();
+}
+
+void ResourceManager::complete_request(const ResourceRequest& rr)
+{
+	if (rr.complete_function)
+	{
+		rr.complete_function(rr.user_data);
+		return;
+	}
+
+	const StringId64 type = rr.type;
+	const StringId64 name = rr.name;
+	const StringId64 mix = resource_id(type, name);
+
+	PendingRequest pr;
+	pr.id = UINT32_MAX;
+	pr.references = 1;
+	pr = hash_map::get(_pending, mix, pr);
+	hash_map::remove(_pending, mix);
+
+	const u32 reload_index = hash_map::get(_rm, mix, UINT32_MAX);
+	if (reload_index != UINT32_MAX)
+	{
+		replace_entry(reload_index, rr);
+		return;
+	}
+
+	// Reloaded resource which has been unloaded in the meantime.
+	if (pr.references == 0)
+	{
+		on_unload(type, rr.data);
+		return;
+	}
+
+	u64 shared;
+	void* data = share_data(rr, shared);
+
+	u32 index;
+	if (array::size(_free_entries) != 0)
+	{
+		index = array::back(_free_entries);
+		array::pop_back(_free_entries);
+	}
+	else
+	{
+		ResourceEntry entry;
+		entry.generation = 1;
+		index = array::size(_entries);
+		array::push_back(_entries, entry);
+	}
+
+	ResourceEntry& entry = _entries[index];
+	entry.type = type;
+	entry.name = name;
+	entry.references = pr.references;
+	entry.size = rr.size;
+	entry.prev = UINT32_MAX;
+	entry.next = UINT32_MAX;
+	entry.data = data;
+	entry.shared = shared;
+	hash_map::set(_rm, mix, index);
+	type_data(type).size += rr.size;
+
+	const s64 time_online = os::clocktime();
+	ENTER_PROFILE_SCOPE("resource_manager.online");
 	on_online(type, name);
+	LEAVE_PROFILE_SCOPE();
+
+	RecordResourceLoad ev;
+	ev.type = type;
+	ev.name = name;
+	ev.size = rr.size;
+	ev.time_requested = rr.time_requested;
+	ev.time_started = rr.time_started;
+	ev.time_opened = rr.time_opened;
+	ev.time_loaded = rr.time_loaded;
+	ev.time_online = time_online;
+	ev.time_completed = os::clocktime();
+	RECORD_RESOURCE_LOAD(ev);
+	CE_UNUSED(ev);
 }
 
 void ResourceManager::register_type(StringId64 type, u32 version, LoadFunction load, UnloadFunction unload, OnlineFunction online, OfflineFunction offline)
@@ -169,9 +496,80 @@ void ResourceManager::register_type(StringId64 type, u32 version, LoadFunction l
 	rtd.online = online;
 	rtd.offline = offline;
 	rtd.unload = unload;
+	rtd.budget = 0;
+	rtd.size = 0;
+	rtd.lru_head = UINT32_MAX;
+	rtd.lru_tail = UINT32_MAX;
 
 	sort_map::set(_type_data, type, rtd);
-	sort_map::sort(_type_data);
+}
+
+ResourceManager::ResourceTypeData& ResourceManager::type_data(StringId64 type)
+{
+	CE_ASSERT(sort_map::has(_type_data, type), "Unknown resource type");
+	ResourceTypeData deffault;
+	return sort_map::get(_type_data, type, deffault);
+}
+
+void ResourceManager::lru_remove(u32 index)
+{
+	ResourceEntry& entry = _entries[index];
+	ResourceTypeData& rtd = type_data(entry.type);
+
+	if (entry.prev != UINT32_MAX)
+		_entries[entry.prev].next = entry.next;
+	else
+		rtd.lru_head = entry.next;
+
+	if (entry.next != UINT32_MAX)
+		_entries[entry.next].prev = entry.prev;
+	else
+		rtd.lru_tail = entry.prev;
+
+	entry.prev = UINT32_MAX;
+	entry.next = UINT32_MAX;
+}
+
+void ResourceManager::lru_push_front(u32 index)
+{
+	ResourceEntry& entry = _entries[index];
+	ResourceTypeData& rtd = type_data(entry.type);
+
+	entry.prev = UINT32_MAX;
+	entry.next = rtd.lru_head;
+
+	if (rtd.lru_head != UINT32_MAX)
+		_entries[rtd.lru_head].prev = index;
+	else
+		rtd.lru_tail = index;
+
+	rtd.lru_head = index;
+}
+
+void ResourceManager::evict(StringId64 type)
+{
+	for (;;)
+	{
+		// Callbacks may register types or load resources, re-fetch each time.
+		const ResourceTypeData& rtd = type_data(type);
+		if (rtd.lru_tail == UINT32_MAX)
+			break;
+		if (rtd.budget != 0 && rtd.size <= rtd.budget)
+			break;
+
+		destroy_entry(rtd.lru_tail);
+	}
+}
+
+void ResourceManager::set_budget(StringId64 type, u64 size)
+{
+	type_data(type).budget = size;
+	evict(type);
+}
+
+u64 ResourceManager::memory_usage(StringId64 type)
+{
+	return type_data(type).size;
 }
 
 void ResourceManager::on_online(StringId64 type, StringId64 name)
@@ -179,7 +577,10 @@ void ResourceManager::on_online(StringId64 type, StringId64 name)
 	OnlineFunction func = sort_map::get(_type_data, type, ResourceTypeData()).online;
 
 	if (func)
+	{
 		func(name, *this);
+		touch();
+	}
 }
 
 void ResourceManager::on_offline(StringId64 type, StringId64 name)
@@ -187,7 +588,21 @@ void ResourceManager::on_offline(StringId64 type, StringId64 name)
 	OfflineFunction func = sort_map::get(_type_data, type, ResourceTypeData()).offline;
 
 	if (func)
+	{
 		func(name, *this);
+		touch();
+	}
+}
+
+u32 ResourceManager::version() const
+{
+	return _version;
+}
+
+void ResourceManager::touch()
+{
+	if (++_version == UINT32_MAX)
+		_version = 0;
 }
 
 void ResourceManager::on_unload(StringId64 type, void* data)
@@ -200,4 +615,67 @@ void ResourceManager::on_unload(StringId64 type, void* data)
 		_resource_heap.deallocate(data);
 }
 
+void* ResourceManager::share_data(const ResourceRequest& rr, u64& shared)
+{
+	shared = 0;
+
+	// Only data which is not modified by online() and offline() can be shared.
+	const ResourceTypeData& rtd = type_data(rr.type);
+	if (rr.content_hash == 0 || rtd.online != NULL || rtd.offline != NULL)
+		return rr.data;
+
+	const u64 key = rr.content_hash ^ rr.type._id;
+
+	SharedData sd;
+	sd.data = NULL;
+	sd.size = 0;
+	sd.references = 0;
+	sd = hash_map::get(_shared, key, sd);
+
+	if (sd.data == NULL)
+	{
+		sd.data = rr.data;
+		sd.size = rr.size;
+		sd.references = 1;
+		hash_map::set(_shared, key, sd);
+		shared = key;
+		return rr.data;
+	}
+
+	if (sd.size != rr.size)
+		return rr.data;
+
+	// Another resource has the same data: drop the copy just loaded.
+	on_unload(rr.type, rr.data);
+	++sd.references;
+	hash_map::set(_shared, key, sd);
+	shared = key;
+	return sd.data;
+}
+
+void ResourceManager::release_data(u32 index)
+{
+	const ResourceEntry& entry = _entries[index];
+
+	if (entry.shared != 0)
+	{
+		SharedData sd;
+		sd.data = NULL;
+		sd.size = 0;
+		sd.references = 0;
+		sd = hash_map::get(_shared, entry.shared, sd);
+		CE_ASSERT(sd.references > 0, "Shared data not found");
+
+		if (--sd.references != 0)
+		{
+			hash_map::set(_shared, entry.shared, sd);
+			return;
+		}
+
+		hash_map::remove(_shared, entry.shared);
+	}
+
+	on_unload(entry.type, entry.data);
+}
+
 } // namespace crown
@@ -10,6 +10,7 @@
 #include "core/memory/proxy_allocator.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
+#include "resource/resource_loader.h"
 #include "resource/types.h"
 
 namespace crown
@@ -24,28 +25,24 @@ struct ResourceManager
 	typedef void (*OfflineFunction)(StringId64 name, ResourceManager& rm);
 	typedef void (*UnloadFunction)(Allocator& allocator, void* resource);
 
-	struct ResourcePair
+	struct ResourceEntry
 	{
 		StringId64 type;
 		StringId64 name;
-
-		bool operator<(const ResourcePair& a) const
-		{
-			return type < a.type || (type == a.type && name < a.name);
-		}
+		u32 references;
+		u32 generation;
+		u32 size;
+		u32 prev;
+		u32 next;
+		void* data;
+		u64 shared; ///< Key of data in _shared, 0 if the data is not shared.
 	};
 
-	struct ResourceEntry
+	struct SharedData
 	{
-		u32 references;
 		void* data;
-
-		bool operator==(const ResourceEntry& e)
-		{
-			return references == e.references && data == e.data;
-		}
-
-		static const ResourceEntry NOT_FOUND;
+		u32 size;
+		u32 references;
 	};
 
 	struct ResourceTypeData
@@ -55,21 +52,50 @@ struct ResourceManager
 		OnlineFunction online;
 		OfflineFunction offline;
 		UnloadFunction unload;
+		u64 budget;
+		u64 size;
+		u32 lru_head;
+		u32 lru_tail;
+	};
+
+	struct PendingRequest
+	{
+		u32 id;
+		u32 references;
 	};
 
 	typedef SortMap<StringId64, ResourceTypeData> TypeMap;
-	typedef SortMap<ResourcePair, ResourceEntry> ResourceMap;
+	typedef HashMap<StringId64, u32> ResourceMap;
+	typedef HashMap<StringId64, PendingRequest> PendingMap;
+	typedef HashMap<u64, SharedData> SharedMap;
 
 	ProxyAllocator _resource_heap;
 	ResourceLoader* _loader;
 	TypeMap _type_data;
 	ResourceMap _rm;
+	Array<ResourceEntry> _entries;
+	Array<u32> _free_entries;
+	PendingMap _pending;
+	SharedMap _shared;
+	Array<ResourcePackage*> _prefetched;
 	bool _autoload;
-
+	bool _prefetch_neighbours;
+	u32 _version;
+
+	ResourceEntry* find(StringId64 type, StringId64 name);
+	void destroy_entry(u32 index);
+	void replace_entry(u32 index, const ResourceRequest& rr);
+	u32 add_request(StringId64 type, StringId64 name, ResourcePriority::Enum priority);
+	ResourceTypeData& type_data(StringId64 type);
+	void lru_remove(u32 index);
+	void lru_push_front(u32 index);
+	void evict(StringId64 type);
 	void on_online(StringId64 type, StringId64 name);
 	void on_offline(StringId64 type, StringId64 name);
 	void on_unload(StringId64 type, void* data);
-	void complete_request(StringId64 type, StringId64 name, void* data);
+	void* share_data(const ResourceRequest& rr, u64& shared);
+	void release_data(u32 index);
+	void complete_request(const ResourceRequest& rr);
 
 	/// Uses @a rl to load resources.
 	ResourceManager(ResourceLoader& rl);
@@ -77,32 +103,130 @@ struct ResourceManager
 	///
 	~ResourceManager();
 
-	/// Loads the resource (@a type, @a name).
-	/// You can check whether the resource is available with can_get().
-	void load(StringId64 type, StringId64 name);
+	/// Loads the resource (@a type, @a name) with the given @a priority.
+	/// You can check whether the resource is available with can_get()
+	/// or wait for it with wait().
+	/// @note
+	/// Loading a resource that is already being loaded does not
+	/// issue another request.
+	void load(StringId64 type, StringId64 name, ResourcePriority::Enum priority = ResourcePriority::NORMAL);
+
+	/// Streams data from the resource (@a type, @a name) with the given
+	/// @a priority. @a stream_function is called by a loader thread with the
+	/// resource file and @a user_data; @a complete_function is called with
+	/// @a user_data by complete_requests() afterwards.
+	/// @note
+	/// The resource itself is not loaded nor referenced.
+	void stream(StringId64 type
+		, StringId64 name
+		, ResourcePriority::Enum priority
+		, ResourceRequest::StreamFunction stream_function
+		, ResourceRequest::CompleteFunction complete_function
+		, void* user_data
+		);
 
 	/// Unloads the resource @a type @a name.
+	/// @note
+	/// Resources which are not referenced anymore are kept in memory
+	/// until the budget of their type is exceeded. See set_budget().
 	void unload(StringId64 type, StringId64 name);
 
-	/// Reloads the resource (@a type, @a name).
+	/// Reloads the resource (@a type, @a name) in the background.
+	/// The old resource stays available until the new one has been loaded;
+	/// complete_requests() then swaps them and brings the new one online.
 	/// @note The user has to manually update all the references to the old resource.
+	/// Handles to the old resource become stale once the swap has happened.
 	void reload(StringId64 type, StringId64 name);
 
 	/// Returns whether the manager has the resource (@a type, @a name).
 	bool can_get(StringId64 type, StringId64 name);
 
 	/// Returns the data of the resource (@a type, @a name).
+	/// @note
+	/// It is safe to call get() from multiple threads at the same time as
+	/// long as the resource is loaded and no thread is modifying the
+	/// manager (e.g. with load(), unload(), reload(), flush() or
+	/// complete_requests()). Getting a resource which is not loaded
+	/// triggers the autoload, which is only allowed on the main thread.
 	const void* get(StringId64 type, StringId64 name);
 
+	/// Returns a handle to the resource (@a type, @a name) or an invalid
+	/// handle if the resource is not loaded.
+	ResourceHandle handle(StringId64 type, StringId64 name);
+
+	/// Returns whether the handle @a h refers to a loaded resource.
+	bool is_valid(ResourceHandle h) const;
+
+	/// Returns the data of the resource referred by @a h.
+	const void* get(ResourceHandle h) const;
+
 	/// Sets whether resources should be automatically loaded when accessed.
 	void enable_autoload(bool enable);
 
+	/// Returns a number which changes whenever a resource with online()
+	/// or offline() functions is brought online or offline, or touch() is
+	/// called. Caches of the objects created by online() can compare it
+	/// instead of validating each of their resources.
+	u32 version() const;
+
+	/// Changes version(), e.g. after recreating the objects created by
+	/// online() for a resource.
+	void touch();
+
+	/// Blocks until the resource (@a type, @a name) has been loaded
+	/// and brought online. Other load() requests may complete as well.
+	void wait(StringId64 type, StringId64 name);
+
 	/// Blocks until all load() requests have been completed.
 	void flush();
 
 	/// Completes all load() requests which have been loaded by ResourceLoader.
 	void complete_requests();
 
+	/// Completes load() requests which have been loaded by ResourceLoader
+	/// until @a time_budget milliseconds have elapsed. Requests that do
+	/// not fit in the budget are completed by subsequent calls.
+	/// At least one request is completed, if any. A @a time_budget of 0
+	/// completes all requests.
+	void complete_requests(f32 time_budget);
+
+	/// Returns the number of resources that have been loaded but are
+	/// waiting to be completed.
+	u32 num_backlog();
+
+	/// Loads the package @a package_name in the background.
+	/// The resources in the package are loaded with background priority
+	/// by update_prefetched() while the game runs.
+	/// @note
+	/// Prefetching a package that is already being prefetched does nothing.
+	void prefetch(StringId64 package_name);
+
+	/// Unloads the package @a package_name loaded with prefetch().
+	void unload_prefetched(StringId64 package_name);
+
+	/// Unloads all the packages loaded with prefetch().
+	void unload_prefetched();
+
+	/// Requests the resources of the packages being prefetched as soon
+	/// as their package resources are loaded.
+	void update_prefetched();
+
+	/// Sets whether to prefetch the packages that a level declares as its
+	/// neighbours when the level is loaded.
+	void enable_neighbours_prefetch(bool enable);
+
+	/// Sets the memory budget of the resource @a type to @a size bytes.
+	/// Resources of that type which are not referenced anymore are cached,
+	/// and the least recently used ones are evicted when the total size of
+	/// the resources of that type exceeds the budget.
+	/// A budget of 0 disables caching; this is the default.
+	void set_budget(StringId64 type, u64 size);
+
+	/// Returns the size in bytes of the resources of the given @a type
+	/// currently in memory, including the cached ones.
+	/// The size of a resource is the size of its compiled data.
+	u64 memory_usage(StringId64 type);
+
 	/// Registers a new resource @a type into the resource manager.
 	void register_type(StringId64 type, u32 version, LoadFunction load, UnloadFunction unload, OnlineFunction online, OfflineFunction offline);
 };
@@ -5,6 +5,7 @@
 
 #include "core/containers/array.h"
 #include "resource/package_resource.h"
+#include "resource/resource_loader.h"
 #include "resource/resource_manager.h"
 #include "resource/resource_package.h"
 #include "world/types.h"
@@ -16,6 +17,7 @@ ResourcePackage::ResourcePackage(StringId64 id, ResourceManager& resman)
 	, _resource_manager(&resman)
 	, _package_id(id)
 	, _package(NULL)
+	, _prefetching(false)
 {
 }
 
@@ -25,24 +27,59 @@ ResourcePackage::~ResourcePackage()
 	_marker = 0;
 }
 
-void ResourcePackage::load()
+void ResourcePackage::load(ResourcePriority::Enum priority)
+{
+	_resource_manager->load(RESOURCE_TYPE_PACKAGE, _package_id, ResourcePriority::CRITICAL);
+	_resource_manager->wait(RESOURCE_TYPE_PACKAGE, _package_id);
+	load_resources(priority);
+}
+
+void ResourcePackage::load_resources(ResourcePriority::Enum priority)
 {
-	_resource_manager->load(RESOURCE_TYPE_PACKAGE, _package_id);
-	_resource_manager->flush();
 	_package = (const PackageResource*)_resource_manager->get(RESOURCE_TYPE_PACKAGE, _package_id);
+	_resource_manager->_loader->mount_bundle(_package_id);
 
 	for (u32 i = 0; i < array::size(_package->resources); ++i)
 	{
-		_resource_manager->load(_package->resources[i].type, _package->resources[i].name);
+		_resource_manager->load(_package->resources[i].type, _package->resources[i].name, priority);
 	}
 }
 
+void ResourcePackage::prefetch()
+{
+	_resource_manager->load(RESOURCE_TYPE_PACKAGE, _package_id, ResourcePriority::BACKGROUND);
+	_prefetching = true;
+}
+
+bool ResourcePackage::update()
+{
+	if (!_prefetching)
+		return true;
+
+	// Do not use can_get(): it would trigger a blocking load with autoload enabled.
+	if (!_resource_manager->is_valid(_resource_manager->handle(RESOURCE_TYPE_PACKAGE, _package_id)))
+		return false;
+
+	load_resources(ResourcePriority::BACKGROUND);
+	_prefetching = false;
+	return true;
+}
+
 void ResourcePackage::unload()
 {
+	if (_prefetching)
+	{
+		// Resources have not been requested yet.
+		_prefetching = false;
+		return;
+	}
+
 	for (u32 i = 0; i < array::size(_package->resources); ++i)
 	{
 		_resource_manager->unload(_package->resources[i].type, _package->resources[i].name);
 	}
+
+	_resource_manager->_loader->unmount_bundle(_package_id);
 }
 
 void ResourcePackage::flush()
@@ -52,6 +89,9 @@ void ResourcePackage::flush()
 
 bool ResourcePackage::has_loaded() const
 {
+	if (_package == NULL)
+		return false;
+
 	for (u32 i = 0; i < array::size(_package->resources); ++i)
 	{
 		if (!_resource_manager->can_get(_package->resources[i].type, _package->resources[i].name))
@@ -18,6 +18,9 @@ struct ResourcePackage
 	ResourceManager* _resource_manager;
 	StringId64 _package_id;
 	const PackageResource* _package;
+	bool _prefetching;
+
+	void load_resources(ResourcePriority::Enum priority);
 
 	///
 	ResourcePackage(StringId64 id, ResourceManager& resman);
@@ -25,11 +28,22 @@ struct ResourcePackage
 	///
 	~ResourcePackage();
 
-	/// Loads all the resources in the package.
+	/// Loads all the resources in the package with the given @a priority.
 	/// @note
 	/// The resources are not immediately available after the call is made,
 	/// instead, you have to poll for completion with has_loaded()
-	void load();
+	void load(ResourcePriority::Enum priority = ResourcePriority::NORMAL);
+
+	/// Loads all the resources in the package with background priority.
+	/// Unlike load(), it does not block waiting for the package resource:
+	/// the resources in the package are requested by update() as soon as
+	/// the package resource becomes available.
+	void prefetch();
+
+	/// Requests the resources of a package being prefetched once its
+	/// package resource is available.
+	/// Returns whether the resources in the package have been requested.
+	bool update();
 
 	/// Unloads all the resources in the package.
 	void unload();
@@ -38,6 +52,8 @@ struct ResourcePackage
 	void flush();
 
 	/// Returns whether the package has been loaded.
+	/// It always returns false for a package being prefetched until
+	/// update() requests its resources.
 	bool has_loaded() const;
 };
 
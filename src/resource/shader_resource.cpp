@@ -9,6 +9,7 @@
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
 #include "core/memory/temp_allocator.h"
+#include "core/murmur.h"
 #include "core/strings/string_stream.h"
 #include "device/device.h"
 #include "resource/compile_options.h"
@@ -571,6 +572,7 @@ namespace shader_resource_internal
 		DynamicString _vs_input_output;
 		DynamicString _fs_input_output;
 		Map<DynamicString, DynamicString> _samplers;
+		bool _instancing;
 
 		BgfxShader()
 			: _includes(default_allocator())
@@ -581,6 +583,7 @@ namespace shader_resource_internal
 			, _vs_input_output(default_allocator())
 			, _fs_input_output(default_allocator())
 			, _samplers(default_allocator())
+			, _instancing(false)
 		{
 		}
 
@@ -593,6 +596,7 @@ namespace shader_resource_internal
 			, _vs_input_output(a)
 			, _fs_input_output(a)
 			, _samplers(a)
+			, _instancing(false)
 		{
 		}
 	};
@@ -954,6 +958,8 @@ namespace shader_resource_internal
 					sjson::parse_verbatim(shader["fs_input_output"], bgfxshader._fs_input_output);
 				if (json_object::has(shader, "samplers"))
 					parse_bgfx_samplers(shader["samplers"], bgfxshader);
+				if (json_object::has(shader, "instancing"))
+					bgfxshader._instancing = sjson::parse_bool(shader["instancing"]);
 
 				DynamicString key(ta);
 				key = cur->pair.first;
@@ -1128,6 +1134,12 @@ namespace shader_resource_internal
 				_opts.write(rs.encode());                    // Render state
 				compile_sampler_states(bgfx_shader.c_str()); // Sampler states
 				compile(bgfx_shader.c_str(), defines);       // Shader code
+
+				// Instanced variant
+				const bool instancing = _bgfx_shaders[bgfx_shader]._instancing;
+				_opts.write(u32(instancing));
+				if (instancing)
+					compile(bgfx_shader.c_str(), defines, true);
 			}
 		}
 
@@ -1153,7 +1165,22 @@ namespace shader_resource_internal
 			}
 		}
 
-		void compile(const char* bgfx_shader, const Vector<DynamicString>& defines)
+		u64 bytecode_key(StringStream& code, const DynamicString& varying, const char* type)
+		{
+			const char* str = string_stream::c_str(code);
+			u64 key = murmur64(str, strlen32(str), 0);
+			key = murmur64(varying.c_str(), varying.length(), key);
+			key = murmur64(type, strlen32(type), key);
+			key = murmur64(_opts.platform(), strlen32(_opts.platform()), key);
+			return key;
+		}
+
+		// Compiles the @a bgfx_shader with the given @a defines. If @a instanced
+		// is true, the vertex shader also gets the per-instance model matrix
+		// in i_data0-3 and INSTANCING is defined. If SKINNING is defined, the
+		// vertex shader also gets the bone indices and weights in a_indices
+		// and a_weight.
+		void compile(const char* bgfx_shader, const Vector<DynamicString>& defines, bool instanced = false)
 		{
 			TempAllocator512 taa;
 			DynamicString key(taa);
@@ -1167,9 +1194,58 @@ namespace shader_resource_internal
 				included_code = included._code;
 			}
 
+			DynamicString varying(default_allocator());
+			varying = shader._varying;
+
+			bool skinned = false;
+			for (u32 i = 0; i < vector::size(defines); ++i)
+				skinned = skinned || defines[i] == "SKINNING";
+
+			// shaderc reads the inputs before preprocessing, so they can not
+			// depend on the defines: append the extra inputs to $input instead
+			TempAllocator256 tai;
+			DynamicString inputs(tai);
+			if (instanced)
+			{
+				inputs += ", i_data0, i_data1, i_data2, i_data3";
+				varying += "\nvec4 i_data0 : TEXCOORD7;";
+				varying += "\nvec4 i_data1 : TEXCOORD6;";
+				varying += "\nvec4 i_data2 : TEXCOORD5;";
+				varying += "\nvec4 i_data3 : TEXCOORD4;\n";
+			}
+			if (skinned)
+			{
+				inputs += ", a_indices, a_weight";
+				varying += "\nvec4 a_indices : BLENDINDICES;";
+				varying += "\nvec4 a_weight : BLENDWEIGHT;\n";
+			}
+
 			StringStream vs_code(default_allocator());
 			StringStream fs_code(default_allocator());
-			vs_code << shader._vs_input_output.c_str();
+			if (inputs.length() > 0)
+			{
+				const char* io = shader._vs_input_output.c_str();
+				const char* input = strstr(io, "$input");
+				DATA_COMPILER_ASSERT(input != NULL
+					, _opts
+					, "Instanced or skinned bgfx shader without inputs: '%s'"
+					, bgfx_shader
+					);
+				const char* input_end = strchr(input, '\n');
+				if (input_end == NULL)
+					input_end = input + strlen32(input);
+
+				TempAllocator1024 ta;
+				DynamicString before(ta);
+				before.set(io, u32(input_end - io));
+				vs_code << before.c_str() << inputs.c_str() << input_end;
+				if (instanced)
+					vs_code << "#define INSTANCING\n";
+			}
+			else
+			{
+				vs_code << shader._vs_input_output.c_str();
+			}
 			for (u32 i = 0; i < vector::size(defines); ++i)
 			{
 				vs_code << "#define " << defines[i].c_str() << "\n";
@@ -1186,52 +1262,76 @@ namespace shader_resource_internal
 			fs_code << shader._code.c_str();
 			fs_code << shader._fs_code.c_str();
 
-			_opts.write_temporary(_vs_source_path.c_str(), vs_code);
-			_opts.write_temporary(_fs_source_path.c_str(), fs_code);
-			_opts.write_temporary(_varying_path.c_str(), shader._varying.c_str(), shader._varying.length());
+			// Variants with the same code, stage and platform compile to the same
+			// bytecode, even across shader resources: reuse it when possible.
+			const u64 vs_key = bytecode_key(vs_code, varying, "vertex");
+			const u64 fs_key = bytecode_key(fs_code, varying, "fragment");
 
-			TempAllocator4096 ta;
-			StringStream output(ta);
-
-			int ec = run_external_compiler(_opts, _vs_source_path.c_str()
-				, _vs_compiled_path.c_str()
-				, _varying_path.c_str()
-				, "vertex"
-				, _opts.platform()
-				, output
-				);
-			if (ec)
-			{
-				delete_temp_files();
-				DATA_COMPILER_ASSERT(false
-					, _opts
-					, "Failed to compile vertex shader:\n%s"
-					, string_stream::c_str(output)
-					);
-			}
+			Buffer tmpvs(default_allocator());
+			Buffer tmpfs(default_allocator());
+			const bool has_vs = _opts.shader_cache_get(vs_key, tmpvs);
+			const bool has_fs = _opts.shader_cache_get(fs_key, tmpfs);
 
-			array::clear(output);
-			ec = run_external_compiler(_opts, _fs_source_path.c_str()
-				, _fs_compiled_path.c_str()
-				, _varying_path.c_str()
-				, "fragment"
-				, _opts.platform()
-				, output
-				);
-			if (ec)
+			if (!has_vs || !has_fs)
 			{
-				delete_temp_files();
-				DATA_COMPILER_ASSERT(false
-					, _opts
-					, "Failed to compile fragment shader:\n%s"
-					, string_stream::c_str(output)
-					);
-			}
+				_opts.write_temporary(_varying_path.c_str(), varying.c_str(), varying.length());
 
-			Buffer tmpvs = _opts.read_temporary(_vs_compiled_path.c_str());
-			Buffer tmpfs = _opts.read_temporary(_fs_compiled_path.c_str());
+				TempAllocator4096 ta;
+				StringStream output(ta);
 
-			delete_temp_files();
+				if (!has_vs)
+				{
+					_opts.write_temporary(_vs_source_path.c_str(), vs_code);
+
+					int ec = run_external_compiler(_opts, _vs_source_path.c_str()
+						, _vs_compiled_path.c_str()
+						, _varying_path.c_str()
+						, "vertex"
+						, _opts.platform()
+						, output
+						);
+					if (ec)
+					{
+						delete_temp_files();
+						DATA_COMPILER_ASSERT(false
+							, _opts
+							, "Failed to compile vertex shader:\n%s"
+							, string_stream::c_str(output)
+							);
+					}
+
+					tmpvs = _opts.read_temporary(_vs_compiled_path.c_str());
+					_opts.shader_cache_set(vs_key, tmpvs);
+				}
+
+				if (!has_fs)
+				{
+					_opts.write_temporary(_fs_source_path.c_str(), fs_code);
+
+					array::clear(output);
+					int ec = run_external_compiler(_opts, _fs_source_path.c_str()
+						, _fs_compiled_path.c_str()
+						, _varying_path.c_str()
+						, "fragment"
+						, _opts.platform()
+						, output
+						);
+					if (ec)
+					{
+						delete_temp_files();
+						DATA_COMPILER_ASSERT(false
+							, _opts
+							, "Failed to compile fragment shader:\n%s"
+							, string_stream::c_str(output)
+							);
+					}
+
+					tmpfs = _opts.read_temporary(_fs_compiled_path.c_str());
+					_opts.shader_cache_set(fs_key, tmpfs);
+				}
+
+				delete_temp_files();
+			}
 
 			// Write
 			_opts.write(array::size(tmpvs));
@@ -29,13 +29,23 @@ struct ShaderResource
 		u32 state;
 	};
 
+	/// Compiled code of a shader stage. It is kept in the memory of the
+	/// resource, so that it can be loaded before bgfx is initialized.
+	struct Code
+	{
+		void* data;
+		u32 size;
+	};
+
 	struct Data
 	{
 		StringId32 name;
 		u64 state;
 		Sampler samplers[4];
-		const bgfx::Memory* vsmem;
-		const bgfx::Memory* fsmem;
+		Code vs;
+		Code fs;
+		Code vs_instanced; ///< Empty if the shader has no instanced variant.
+		Code fs_instanced;
 	};
 
 	Array<Data> _data;
@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/vector.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/quaternion.h"
+#include "core/math/simd.h"
+#include "core/math/vector4.h"
+#include "core/memory/temp_allocator.h"
+#include "core/strings/dynamic_string.h"
+#include "resource/compile_options.h"
+#include "resource/skeleton_resource.h"
+#include <bx/math.h> // bx::min, bx::max
+#include <string.h> // memset
+
+#define SKELETON_ANIMATION_CONSTANT_EPSILON 0.00001f // Tracks changing less than this are stored as constants
+
+namespace crown
+{
+namespace skeleton_resource_internal
+{
+	struct Bone
+	{
+		DynamicString name;
+		u32 parent;
+		BonePose pose;
+
+		ALLOCATOR_AWARE;
+
+		Bone(Allocator& a)
+			: name(a)
+			, parent(UINT32_MAX)
+		{
+		}
+	};
+
+	// Parses the bones of the skeleton @a json.
+	static void parse_bones(Buffer& json, Vector<Bone>& bones, CompileOptions& opts)
+	{
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		sjson::parse(json, object);
+
+		JsonArray bones_json(ta);
+		sjson::parse_array(object["bones"], bones_json);
+
+		DATA_COMPILER_ASSERT(array::size(bones_json) > 0
+			, opts
+			, "Skeleton has no bones"
+			);
+		DATA_COMPILER_ASSERT(array::size(bones_json) <= CROWN_MAX_SKELETON_BONES
+			, opts
+			, "Too many bones: %u (max %u)"
+			, array::size(bones_json)
+			, CROWN_MAX_SKELETON_BONES
+			);
+
+		for (u32 i = 0; i < array::size(bones_json); ++i)
+		{
+			TempAllocator512 bta;
+			JsonObject bone(bta);
+			sjson::parse_object(bones_json[i], bone);
+
+			Bone b(default_allocator());
+			sjson::parse_string(bone["name"], b.name);
+
+			for (u32 j = 0; j < vector::size(bones); ++j)
+			{
+				DATA_COMPILER_ASSERT(!(bones[j].name == b.name)
+					, opts
+					, "Bone already exists: '%s'"
+					, b.name.c_str()
+					);
+			}
+
+			if (json_object::has(bone, "parent"))
+			{
+				DynamicString parent(bta);
+				sjson::parse_string(bone["parent"], parent);
+
+				for (u32 j = 0; j < vector::size(bones); ++j)
+				{
+					if (bones[j].name == parent)
+						b.parent = j;
+				}
+				DATA_COMPILER_ASSERT(b.parent != UINT32_MAX
+					, opts
+					, "Parent must be declared before its children: '%s'"
+					, parent.c_str()
+					);
+			}
+
+			const Vector3 pos   = json_object::has(bone, "position") ? sjson::parse_vector3(bone["position"]) : VECTOR3_ZERO;
+			const Vector3 scale = json_object::has(bone, "scale") ? sjson::parse_vector3(bone["scale"]) : VECTOR3_ONE;
+			Quaternion rot      = json_object::has(bone, "rotation") ? sjson::parse_quaternion(bone["rotation"]) : QUATERNION_IDENTITY;
+			b.pose.position = vector4(pos.x, pos.y, pos.z, 0.0f);
+			b.pose.rotation = normalize(rot);
+			b.pose.scale    = vector4(scale.x, scale.y, scale.z, 0.0f);
+
+			vector::push_back(bones, b);
+		}
+	}
+
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		Vector<Bone> bones(default_allocator());
+		parse_bones(buf, bones, opts);
+		const u32 num_bones = vector::size(bones);
+
+		// Model-space bind matrices, parents come first
+		Array<Matrix4x4> model(default_allocator());
+		array::resize(model, num_bones);
+		for (u32 i = 0; i < num_bones; ++i)
+		{
+			model[i] = skeleton_resource::bone_matrix(bones[i].pose);
+			if (bones[i].parent != UINT32_MAX)
+				model[i] *= model[bones[i].parent];
+		}
+
+		opts.write(RESOURCE_VERSION_SKELETON);
+		opts.write(num_bones);
+
+		for (u32 i = 0; i < num_bones; ++i)
+			opts.write(bones[i].name.to_string_id()._id);
+		for (u32 i = 0; i < num_bones; ++i)
+			opts.write(bones[i].parent);
+		for (u32 i = 0; i < num_bones; ++i)
+			opts.write(bones[i].pose);
+		for (u32 i = 0; i < num_bones; ++i)
+			opts.write(get_inverted(model[i]));
+	}
+
+} // namespace skeleton_resource_internal
+
+namespace skeleton_resource
+{
+	const StringId32* names(const SkeletonResource* sr)
+	{
+		return (const StringId32*)&sr[1];
+	}
+
+	const u32* parents(const SkeletonResource* sr)
+	{
+		return (const u32*)(names(sr) + sr->num_bones);
+	}
+
+	const BonePose* bind_poses(const SkeletonResource* sr)
+	{
+		return (const BonePose*)(parents(sr) + sr->num_bones);
+	}
+
+	const Matrix4x4* inverse_binds(const SkeletonResource* sr)
+	{
+		return (const Matrix4x4*)(bind_poses(sr) + sr->num_bones);
+	}
+
+	Matrix4x4 bone_matrix(const BonePose& bp)
+	{
+		Matrix4x4 m = matrix4x4(bp.rotation, vector3(bp.position.x, bp.position.y, bp.position.z));
+		m.x *= bp.scale.x;
+		m.y *= bp.scale.y;
+		m.z *= bp.scale.z;
+		return m;
+	}
+
+	u32 bone_index(const SkeletonResource* sr, StringId32 name)
+	{
+		const StringId32* n = names(sr);
+		for (u32 i = 0; i < sr->num_bones; ++i)
+		{
+			if (n[i] == name)
+				return i;
+		}
+
+		return UINT32_MAX;
+	}
+
+} // namespace skeleton_resource
+
+namespace skeleton_animation_resource_internal
+{
+	// Appends to @a keys the keys of a track with @a num_components
+	// components per key and returns their number.
+	static u32 parse_keys(const char* json, u32 num_components, Array<Vector4>& keys)
+	{
+		TempAllocator4096 ta;
+		JsonArray keys_json(ta);
+		sjson::parse_array(json, keys_json);
+
+		for (u32 i = 0; i < array::size(keys_json); ++i)
+		{
+			if (num_components == 4)
+			{
+				const Quaternion q = sjson::parse_quaternion(keys_json[i]);
+				array::push_back(keys, vector4(q.x, q.y, q.z, q.w));
+			}
+			else
+			{
+				const Vector3 v = sjson::parse_vector3(keys_json[i]);
+				array::push_back(keys, vector4(v.x, v.y, v.z, 0.0f));
+			}
+		}
+
+		return array::size(keys_json);
+	}
+
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		sjson::parse(buf, object);
+
+		DynamicString skeleton(ta);
+		sjson::parse_string(object["skeleton"], skeleton);
+		DATA_COMPILER_ASSERT_RESOURCE_EXISTS("skeleton", skeleton.c_str(), opts);
+
+		DynamicString skeleton_path(ta);
+		skeleton_path = skeleton;
+		skeleton_path += ".skeleton";
+		Buffer skeleton_buf = opts.read(skeleton_path.c_str());
+
+		Vector<skeleton_resource_internal::Bone> bones(default_allocator());
+		skeleton_resource_internal::parse_bones(skeleton_buf, bones, opts);
+		const u32 num_bones = vector::size(bones);
+
+		const f32 fps = sjson::parse_float(object["frames_per_second"]);
+		DATA_COMPILER_ASSERT(fps > 0.0f
+			, opts
+			, "Frames per second must be greater than zero"
+			);
+
+		JsonObject tracks_json(ta);
+		sjson::parse_object(object["bones"], tracks_json);
+
+		// Keys of each track, bones without keys keep the bind pose
+		static const char* track_names[] = { "position", "rotation", "scale" };
+		CE_STATIC_ASSERT(countof(track_names) == SkeletonAnimationTrackType::COUNT);
+
+		Array<Vector4> keys(default_allocator());
+		Array<u32> first_key(default_allocator()); // First key of each track in keys
+		Array<u32> num_keys(default_allocator());
+		array::resize(first_key, num_bones*SkeletonAnimationTrackType::COUNT);
+		array::resize(num_keys, num_bones*SkeletonAnimationTrackType::COUNT);
+		memset(array::begin(num_keys), 0, array::size(num_keys)*sizeof(u32));
+		u32 num_frames = 1;
+
+		auto cur = json_object::begin(tracks_json);
+		auto end = json_object::end(tracks_json);
+		for (; cur != end; ++cur)
+		{
+			TempAllocator512 bta;
+			DynamicString name(bta);
+			name.set(cur->pair.first.data(), cur->pair.first.length());
+
+			u32 bone = UINT32_MAX;
+			for (u32 i = 0; i < num_bones; ++i)
+			{
+				if (bones[i].name == name.c_str())
+					bone = i;
+			}
+			DATA_COMPILER_ASSERT(bone != UINT32_MAX
+				, opts
+				, "Bone not found in '%s': '%s'"
+				, skeleton.c_str()
+				, name.c_str()
+				);
+
+			JsonObject track(bta);
+			sjson::parse_object(cur->pair.second, track);
+
+			for (u32 t = 0; t < SkeletonAnimationTrackType::COUNT; ++t)
+			{
+				if (!json_object::has(track, track_names[t]))
+					continue;
+
+				const u32 tt = bone*SkeletonAnimationTrackType::COUNT + t;
+				first_key[tt] = array::size(keys);
+				num_keys[tt] = parse_keys(track[track_names[t]], t == SkeletonAnimationTrackType::ROTATION ? 4 : 3, keys);
+				DATA_COMPILER_ASSERT(num_keys[tt] > 0
+					, opts
+					, "Track has no keys: '%s.%s'"
+					, name.c_str()
+					, track_names[t]
+					);
+				num_frames = bx::max(num_frames, num_keys[tt]);
+			}
+		}
+
+		// Build the tracks
+		Array<SkeletonAnimationTrack> tracks(default_allocator());
+		Array<u16> quantized(default_allocator());
+		array::resize(tracks, num_bones*SkeletonAnimationTrackType::COUNT);
+
+		for (u32 i = 0; i < num_bones; ++i)
+		{
+			for (u32 t = 0; t < SkeletonAnimationTrackType::COUNT; ++t)
+			{
+				const u32 tt = i*SkeletonAnimationTrackType::COUNT + t;
+				SkeletonAnimationTrack& track = tracks[tt];
+				Vector4* k = array::begin(keys) + first_key[tt];
+				const u32 num = num_keys[tt];
+
+				if (num == 0)
+				{
+					const BonePose& bind = bones[i].pose;
+					track.min = t == SkeletonAnimationTrackType::POSITION ? bind.position
+						: t == SkeletonAnimationTrackType::ROTATION ? vector4(bind.rotation.x, bind.rotation.y, bind.rotation.z, bind.rotation.w)
+						: bind.scale
+						;
+					track.extent = VECTOR4_ZERO;
+					track.offset = UINT32_MAX;
+					continue;
+				}
+
+				DATA_COMPILER_ASSERT(num == 1 || num == num_frames
+					, opts
+					, "Track must have either 1 or %u keys: '%s.%s'"
+					, num_frames
+					, bones[i].name.c_str()
+					, track_names[t]
+					);
+
+				// Keep consecutive rotations in the same hemisphere so that
+				// they can be interpolated component-wise
+				if (t == SkeletonAnimationTrackType::ROTATION)
+				{
+					for (u32 j = 0; j < num; ++j)
+					{
+						Quaternion q = quaternion(k[j].x, k[j].y, k[j].z, k[j].w);
+						normalize(q);
+						k[j] = vector4(q.x, q.y, q.z, q.w);
+						if (j > 0 && dot(k[j], k[j-1]) < 0.0f)
+							k[j] = -k[j];
+					}
+				}
+
+				Vector4 mn = k[0];
+				Vector4 mx = k[0];
+				for (u32 j = 1; j < num; ++j)
+				{
+					mn = vector4(bx::min(mn.x, k[j].x), bx::min(mn.y, k[j].y), bx::min(mn.z, k[j].z), bx::min(mn.w, k[j].w));
+					mx = vector4(bx::max(mx.x, k[j].x), bx::max(mx.y, k[j].y), bx::max(mx.z, k[j].z), bx::max(mx.w, k[j].w));
+				}
+
+				const Vector4 range = mx - mn;
+				track.min = mn;
+
+				if (bx::max(bx::max(range.x, range.y), bx::max(range.z, range.w)) < SKELETON_ANIMATION_CONSTANT_EPSILON)
+				{
+					track.extent = VECTOR4_ZERO;
+					track.offset = UINT32_MAX;
+					continue;
+				}
+
+				track.extent = range * (1.0f / 65535.0f);
+				track.offset = array::size(quantized) / 4;
+
+				// Single keys are repeated so that every animated track has num_frames keys
+				for (u32 f = 0; f < num_frames; ++f)
+				{
+					const Vector4& v = k[num == 1 ? 0 : f];
+					const f32 c[] = { v.x, v.y, v.z, v.w };
+					const f32 mnc[] = { mn.x, mn.y, mn.z, mn.w };
+					const f32 rc[] = { range.x, range.y, range.z, range.w };
+					for (u32 j = 0; j < 4; ++j)
+					{
+						const f32 n = rc[j] > 0.0f ? (c[j] - mnc[j]) / rc[j] : 0.0f;
+						array::push_back(quantized, u16(fclamp(n, 0.0f, 1.0f) * 65535.0f + 0.5f));
+					}
+				}
+			}
+		}
+
+		SkeletonAnimationResource sar;
+		sar.version    = RESOURCE_VERSION_SKELETON_ANIMATION;
+		sar.skeleton   = StringId64(skeleton.c_str());
+		sar.num_bones  = num_bones;
+		sar.num_frames = num_frames;
+		sar.total_time = f32(num_frames - 1) / fps;
+		sar.num_keys   = array::size(quantized) / 4;
+
+		opts.write(sar.version);
+		opts.write(sar.skeleton);
+		opts.write(sar.num_bones);
+		opts.write(sar.num_frames);
+		opts.write(sar.total_time);
+		opts.write(sar.num_keys);
+
+		for (u32 i = 0; i < array::size(tracks); ++i)
+		{
+			opts.write(tracks[i].min);
+			opts.write(tracks[i].extent);
+			opts.write(tracks[i].offset);
+		}
+		for (u32 i = 0; i < array::size(quantized); ++i)
+			opts.write(quantized[i]);
+	}
+
+} // namespace skeleton_animation_resource_internal
+
+namespace skeleton_animation_resource
+{
+	const SkeletonAnimationTrack* track(const SkeletonAnimationResource* sar, u32 i, SkeletonAnimationTrackType::Enum type)
+	{
+		CE_ASSERT(i < sar->num_bones, "Index out of bounds");
+		const SkeletonAnimationTrack* tracks = (const SkeletonAnimationTrack*)&sar[1];
+		return &tracks[i*SkeletonAnimationTrackType::COUNT + type];
+	}
+
+	const u16* keys(const SkeletonAnimationResource* sar)
+	{
+		const SkeletonAnimationTrack* tracks = (const SkeletonAnimationTrack*)&sar[1];
+		return (const u16*)(tracks + sar->num_bones*SkeletonAnimationTrackType::COUNT);
+	}
+
+	// Returns the key @a k of @a track dequantized.
+	static inline simd::Float4 dequantize(const SkeletonAnimationTrack& track, const u16* keys, u32 k)
+	{
+		const u16* q = &keys[(track.offset + k) * 4];
+		const f32 v[] = { f32(q[0]), f32(q[1]), f32(q[2]), f32(q[3]) };
+		return simd::madd(simd::load(v), simd::load(&track.extent.x), simd::load(&track.min.x));
+	}
+
+	void sample(const SkeletonAnimationResource* sar, f32 time, BonePose* poses)
+	{
+		const SkeletonAnimationTrack* tracks = track(sar, 0, SkeletonAnimationTrackType::POSITION);
+		const u16* k = keys(sar);
+
+		// Keys to interpolate and the weight of the second one
+		const f32 frame = sar->total_time > 0.0f
+			? fclamp(time / sar->total_time, 0.0f, 1.0f) * f32(sar->num_frames - 1)
+			: 0.0f
+			;
+		const u32 k0 = bx::min(u32(frame), sar->num_frames - 1);
+		const u32 k1 = bx::min(k0 + 1, sar->num_frames - 1);
+		const simd::Float4 t = simd::splat(frame - f32(k0));
+
+		for (u32 i = 0; i < sar->num_bones; ++i)
+		{
+			f32* pose = &poses[i].position.x;
+
+			for (u32 j = 0; j < SkeletonAnimationTrackType::COUNT; ++j, ++tracks, pose += 4)
+			{
+				if (tracks->offset == UINT32_MAX)
+				{
+					simd::store(pose, simd::load(&tracks->min.x));
+					continue;
+				}
+
+				const simd::Float4 a = dequantize(*tracks, k, k0);
+				const simd::Float4 b = dequantize(*tracks, k, k1);
+				simd::store(pose, simd::madd(simd::sub(b, a), t, a));
+			}
+		}
+	}
+
+} // namespace skeleton_animation_resource
+
+} // namespace crown
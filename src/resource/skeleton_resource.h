@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/math/types.h"
+#include "core/strings/string_id.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Pose of a bone relative to its parent. Every component is stored in a
+/// four-wide vector so that poses can be sampled and blended with SIMD.
+struct BonePose
+{
+	Vector4 position; ///< w is unused.
+	Quaternion rotation;
+	Vector4 scale;    ///< w is unused.
+};
+
+struct SkeletonResource
+{
+	u32 version;
+	u32 num_bones;
+	// StringId32 names[num_bones]
+	// u32 parents[num_bones]        Index of the parent, UINT32_MAX for roots. Parents come before their children.
+	// BonePose bind_poses[num_bones]
+	// Matrix4x4 inverse_binds[num_bones] From model-space to the space of the bone in bind pose.
+};
+
+namespace skeleton_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace skeleton_resource_internal
+
+namespace skeleton_resource
+{
+	/// Returns the names of the bones of @a sr.
+	const StringId32* names(const SkeletonResource* sr);
+
+	/// Returns the parents of the bones of @a sr.
+	const u32* parents(const SkeletonResource* sr);
+
+	/// Returns the poses of the bones of @a sr in bind pose.
+	const BonePose* bind_poses(const SkeletonResource* sr);
+
+	/// Returns the inverse model-space bind matrices of the bones of @a sr.
+	const Matrix4x4* inverse_binds(const SkeletonResource* sr);
+
+	/// Returns the matrix of the bone pose @a bp.
+	Matrix4x4 bone_matrix(const BonePose& bp);
+
+	/// Returns the index of the bone @a name or UINT32_MAX if not found.
+	u32 bone_index(const SkeletonResource* sr, StringId32 name);
+
+} // namespace skeleton_resource
+
+/// Curve of a component of the pose of a bone. Keys are quantized to 16
+/// bits per channel in the range [min, min + extent*65535]. Tracks which
+/// do not change over the animation store no keys at all.
+struct SkeletonAnimationTrack
+{
+	Vector4 min;
+	Vector4 extent;
+	u32 offset; ///< Offset of the first key in the keys, UINT32_MAX if constant.
+};
+
+struct SkeletonAnimationTrackType
+{
+	enum Enum
+	{
+		POSITION,
+		ROTATION,
+		SCALE,
+
+		COUNT
+	};
+};
+
+struct SkeletonAnimationResource
+{
+	u32 version;
+	StringId64 skeleton;
+	u32 num_bones;   ///< Number of bones of the skeleton.
+	u32 num_frames;
+	f32 total_time;
+	u32 num_keys;
+	// SkeletonAnimationTrack tracks[num_bones*SkeletonAnimationTrackType::COUNT]
+	// u16 keys[num_keys*4]
+};
+
+namespace skeleton_animation_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace skeleton_animation_resource_internal
+
+namespace skeleton_animation_resource
+{
+	/// Returns the track of type @a type of the bone @a i.
+	const SkeletonAnimationTrack* track(const SkeletonAnimationResource* sar, u32 i, SkeletonAnimationTrackType::Enum type);
+
+	/// Returns the quantized keys of the tracks of @a sar.
+	const u16* keys(const SkeletonAnimationResource* sar);
+
+	/// Samples the animation @a sar at @a time, which is clamped to the
+	/// duration of the animation, and writes the pose of each bone to
+	/// @a poses. Rotations are not normalized.
+	void sample(const SkeletonAnimationResource* sar, f32 time, BonePose* poses);
+
+} // namespace skeleton_animation_resource
+
+} // namespace crown
@@ -3,19 +3,43 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/adpcm.h"
+#include "core/containers/array.h"
 #include "core/filesystem/file.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
+#include "core/math/math.h"
 #include "core/memory/allocator.h"
+#include "core/memory/memory.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
 #include "resource/compile_options.h"
+#include "resource/resource_manager.h"
 #include "resource/sound_resource.h"
+#include "world/audio.h"
+#include <stdlib.h> // free
+#include <string.h> // memcmp, memcpy, memmove
+#define STB_VORBIS_NO_STDIO
+#define STB_VORBIS_HEADER_ONLY
+#include <stb_vorbis.c>
 
 namespace crown
 {
 namespace sound_resource_internal
 {
+	struct SoundCompression
+	{
+		const char* name;
+		SoundType::Enum type;
+	};
+
+	static const SoundCompression s_compression[] =
+	{
+		{ "none",   SoundType::WAV   },
+		{ "adpcm",  SoundType::ADPCM },
+		{ "vorbis", SoundType::OGG   }
+	};
+
 	struct WAVHeader
 	{
 		char riff[4];        // Should contain 'RIFF'
@@ -44,21 +68,141 @@ namespace sound_resource_internal
 		DynamicString name(ta);
 		sjson::parse_string(object["source"], name);
 
+		const bool stream = json_object::has(object, "stream")
+			? sjson::parse_bool(object["stream"])
+			: false
+			;
+
 		Buffer sound = opts.read(name.c_str());
-		const WAVHeader* wav = (const WAVHeader*)array::begin(sound);
-		const char* wavdata = (const char*)&wav[1];
+		const char* data = array::begin(sound);
+		const bool is_ogg = array::size(sound) >= 4 && memcmp(data, "OggS", 4) == 0;
+
+		// The compression can be set per platform
+		DynamicString compression(ta);
+		compression = is_ogg ? "vorbis" : "none";
+		if (json_object::has(object, "compression"))
+		{
+			const char* value = object["compression"];
+			if (sjson::type(value) == JsonValueType::OBJECT)
+			{
+				JsonObject platforms(ta);
+				sjson::parse(value, platforms);
+				if (json_object::has(platforms, opts.platform()))
+					sjson::parse_string(platforms[opts.platform()], compression);
+			}
+			else
+			{
+				sjson::parse_string(value, compression);
+			}
+		}
+
+		u32 sound_type = SoundType::COUNT;
+		for (u32 i = 0; i < countof(s_compression); ++i)
+		{
+			if (compression == s_compression[i].name)
+				sound_type = s_compression[i].type;
+		}
+		DATA_COMPILER_ASSERT(sound_type != SoundType::COUNT
+			, opts
+			, "Unknown compression: '%s'"
+			, compression.c_str()
+			);
+		DATA_COMPILER_ASSERT(sound_type != SoundType::OGG || is_ogg
+			, opts
+			, "Vorbis compression requires an OGG source: '%s'"
+			, name.c_str()
+			);
 
-		// Write
 		SoundResource sr;
-		sr.version      = RESOURCE_VERSION_SOUND;
-		sr.size         = wav->data_size;
-		sr.sample_rate  = wav->fmt_sample_rate;
-		sr.avg_bytes_ps = wav->fmt_avarage;
-		sr.channels     = wav->fmt_channels;
-		sr.block_size   = wav->fmt_block_align;
-		sr.bits_ps      = wav->fmt_bits_ps;
-		sr.sound_type   = SoundType::WAV;
+		sr.version    = RESOURCE_VERSION_SOUND;
+		sr.sound_type = sound_type;
+		sr.buffer     = UINT32_MAX;
+		sr.stream     = stream;
+		sr.name       = StringId64(u64(0));
+
+		short* pcm = NULL;
 
+		if (is_ogg)
+		{
+			int error;
+			stb_vorbis* vorbis = stb_vorbis_open_memory((const unsigned char*)data, array::size(sound), &error, NULL);
+			DATA_COMPILER_ASSERT(vorbis != NULL
+				, opts
+				, "Invalid OGG: '%s'"
+				, name.c_str()
+				);
+			const stb_vorbis_info info = stb_vorbis_get_info(vorbis);
+			const u32 num_samples = stb_vorbis_stream_length_in_samples(vorbis);
+			stb_vorbis_close(vorbis);
+
+			sr.sample_rate  = info.sample_rate;
+			sr.channels     = info.channels;
+			sr.block_size   = u16(info.channels*2);
+			sr.bits_ps      = 16;
+			sr.avg_bytes_ps = info.sample_rate*sr.block_size;
+			sr.size         = array::size(sound);
+			sr.pcm_size     = num_samples*sr.block_size;
+
+			// Other compressions start from PCM
+			if (sound_type != SoundType::OGG)
+			{
+				int channels;
+				int sample_rate;
+				const int num = stb_vorbis_decode_memory((const unsigned char*)data
+					, array::size(sound)
+					, &channels
+					, &sample_rate
+					, &pcm
+					);
+				DATA_COMPILER_ASSERT(num >= 0
+					, opts
+					, "Failed to decode OGG: '%s'"
+					, name.c_str()
+					);
+
+				data        = (const char*)pcm;
+				sr.size     = num*sr.block_size;
+				sr.pcm_size = sr.size;
+			}
+		}
+		else
+		{
+			const WAVHeader* wav = (const WAVHeader*)data;
+			data = (const char*)&wav[1];
+
+			sr.size         = wav->data_size;
+			sr.pcm_size     = wav->data_size;
+			sr.sample_rate  = wav->fmt_sample_rate;
+			sr.avg_bytes_ps = wav->fmt_avarage;
+			sr.channels     = wav->fmt_channels;
+			sr.block_size   = wav->fmt_block_align;
+			sr.bits_ps      = wav->fmt_bits_ps;
+		}
+
+		Buffer encoded(default_allocator());
+		if (sound_type == SoundType::ADPCM)
+		{
+			DATA_COMPILER_ASSERT(sr.bits_ps == 16 && sr.channels <= 2
+				, opts
+				, "ADPCM compression requires 16 bits mono or stereo samples: '%s'"
+				, name.c_str()
+				);
+
+			const u32 num_samples = sr.size / (sr.channels*2);
+			array::resize(encoded, adpcm::encoded_size(num_samples, sr.channels));
+			adpcm::encode((const s16*)data, num_samples, sr.channels, array::begin(encoded));
+
+			data          = array::begin(encoded);
+			sr.size       = array::size(encoded);
+			sr.pcm_size   = num_samples*sr.channels*2;
+			sr.block_size = u16(adpcm::block_size(sr.channels));
+		}
+
+		// Streamed sounds are read in chunks straight from the file
+		if (stream)
+			opts.set_compression(ResourceCompression::NONE);
+
+		// Write
 		opts.write(sr.version);
 		opts.write(sr.size);
 		opts.write(sr.sample_rate);
@@ -67,8 +211,70 @@ namespace sound_resource_internal
 		opts.write(sr.block_size);
 		opts.write(sr.bits_ps);
 		opts.write(sr.sound_type);
+		opts.write(sr.buffer);
+		opts.write(sr.stream);
+		opts.write(sr.pcm_size);
+		opts.write(sr.name);
 
-		opts.write(wavdata, wav->data_size);
+		opts.write(data, sr.size);
+		free(pcm);
+	}
+
+	void* load(File& file, Allocator& a)
+	{
+		SoundResource header;
+		file.read(&header, sizeof(header));
+		CE_ASSERT(header.version == RESOURCE_VERSION_SOUND, "Wrong version");
+
+		// Streamed sounds keep their data on disk
+		if (header.stream)
+		{
+			SoundResource* sr = (SoundResource*)a.allocate(sizeof(SoundResource));
+			*sr = header;
+			return sr;
+		}
+
+		SoundResource* sr = (SoundResource*)a.allocate(sizeof(SoundResource) + header.pcm_size);
+		*sr = header;
+
+		// Compressed sounds are decoded to PCM
+		if (header.sound_type != SoundType::WAV)
+		{
+			SoundDecoder* sd = CE_NEW(a, SoundDecoder)();
+			sound_resource::decoder_init(*sd, header);
+			sr->size = sound_resource::decode(*sd, file, false, (char*)&sr[1], header.pcm_size);
+			sound_resource::decoder_shutdown(*sd);
+			CE_DELETE(a, sd);
+
+			sr->sound_type = SoundType::WAV;
+			return sr;
+		}
+
+		file.read(&sr[1], header.size);
+		return sr;
+	}
+
+	void online(StringId64 id, ResourceManager& rm)
+	{
+		SoundResource* sr = (SoundResource*)rm.get(RESOURCE_TYPE_SOUND, id);
+		sr->name = id;
+
+		if (!sr->stream)
+			sr->buffer = audio_globals::create_buffer(*sr);
+	}
+
+	void offline(StringId64 id, ResourceManager& rm)
+	{
+		SoundResource* sr = (SoundResource*)rm.get(RESOURCE_TYPE_SOUND, id);
+
+		if (!sr->stream)
+			audio_globals::destroy_buffer(sr->buffer);
+		sr->buffer = UINT32_MAX;
+	}
+
+	void unload(Allocator& a, void* resource)
+	{
+		a.deallocate(resource);
 	}
 
 } // namespace sound_resource_internal
@@ -80,6 +286,210 @@ namespace sound_resource
 		return (char*)&sr[1];
 	}
 
+	void decoder_init(SoundDecoder& sd, const SoundResource& sr)
+	{
+		sd.sound_type = sr.sound_type;
+		sd.size       = sr.size;
+		sd.pcm_size   = sr.pcm_size;
+		sd.channels   = sr.channels;
+		sd.block_size = sr.block_size;
+		sd.offset     = 0;
+		sd.vorbis     = NULL;
+		sd.frame      = NULL;
+		sd.frame_size = 0;
+		sd.frame_used = 0;
+		sd.input_size = 0;
+	}
+
+	void decoder_shutdown(SoundDecoder& sd)
+	{
+		if (sd.vorbis != NULL)
+			stb_vorbis_close((stb_vorbis*)sd.vorbis);
+
+		sd.vorbis     = NULL;
+		sd.frame_size = 0;
+		sd.frame_used = 0;
+		sd.input_size = 0;
+	}
+
+	// Appends as much sound data as fits to the input of the decoder.
+	static void read_input(SoundDecoder& sd, File& file)
+	{
+		const u32 space = sizeof(sd.input) - sd.input_size;
+		const u32 num = space < sd.size - sd.offset ? space : sd.size - sd.offset;
+		file.seek(sizeof(SoundResource) + sd.offset);
+		file.read(sd.input + sd.input_size, num);
+		sd.offset     += num;
+		sd.input_size += num;
+	}
+
+	// Removes the first @a num bytes from the input of the decoder.
+	static void consume_input(SoundDecoder& sd, u32 num)
+	{
+		memmove(sd.input, sd.input + num, sd.input_size - num);
+		sd.input_size -= num;
+	}
+
+	static u32 decode_wav(SoundDecoder& sd, File& file, bool loop, char* pcm, u32 size)
+	{
+		u32 num = 0;
+
+		while (num < size)
+		{
+			if (sd.offset == sd.size)
+			{
+				if (!loop || sd.size == 0)
+					break;
+
+				sd.offset = 0;
+			}
+
+			const u32 n = size - num < sd.size - sd.offset
+				? size - num
+				: sd.size - sd.offset
+				;
+			file.seek(sizeof(SoundResource) + sd.offset);
+			file.read(pcm + num, n);
+			sd.offset += n;
+			num += n;
+		}
+
+		return num;
+	}
+
+	static u32 decode_ogg(SoundDecoder& sd, File& file, bool loop, char* pcm, u32 size)
+	{
+		s16* samples = (s16*)pcm;
+		const u32 num_samples = size / (sd.channels*2);
+		u32 num = 0;
+
+		while (num < num_samples)
+		{
+			// Output the rest of the last decoded frame first
+			if (sd.frame_used < sd.frame_size)
+			{
+				const u32 n = num_samples - num < sd.frame_size - sd.frame_used
+					? num_samples - num
+					: sd.frame_size - sd.frame_used
+					;
+				for (u32 i = 0; i < n; ++i)
+				{
+					for (u32 c = 0; c < sd.channels; ++c)
+					{
+						const f32 s = fclamp(sd.frame[c][sd.frame_used + i], -1.0f, 1.0f);
+						samples[(num + i)*sd.channels + c] = s16(s*32767.0f);
+					}
+				}
+
+				sd.frame_used += n;
+				num += n;
+				continue;
+			}
+
+			int used = 0;
+			int num_frame = 0;
+
+			if (sd.vorbis == NULL)
+			{
+				int error = 0;
+				sd.vorbis = stb_vorbis_open_pushdata(sd.input, sd.input_size, &used, &error, NULL);
+				CE_ASSERT(sd.vorbis != NULL || error == VORBIS_need_more_data, "stb_vorbis_open_pushdata: error %d", error);
+			}
+			else
+			{
+				float** frame;
+				used = stb_vorbis_decode_frame_pushdata((stb_vorbis*)sd.vorbis, sd.input, sd.input_size, NULL, &frame, &num_frame);
+				sd.frame      = frame;
+				sd.frame_size = num_frame;
+				sd.frame_used = 0;
+			}
+
+			if (used > 0 || num_frame > 0)
+			{
+				consume_input(sd, used);
+				continue;
+			}
+
+			// The decoder needs more data
+			if (sd.offset < sd.size)
+			{
+				CE_ASSERT(sd.input_size < sizeof(sd.input), "OGG page larger than the input of the decoder");
+				read_input(sd, file);
+				continue;
+			}
+
+			if (!loop)
+				break;
+
+			// Restart from the headers
+			decoder_shutdown(sd);
+			sd.offset = 0;
+		}
+
+		return num*sd.channels*2;
+	}
+
+	static u32 decode_adpcm(SoundDecoder& sd, File& file, bool loop, char* pcm, u32 size)
+	{
+		s16* samples = (s16*)pcm;
+		const u32 num_samples = size / (sd.channels*2);
+		const u32 total_samples = sd.pcm_size / (sd.channels*2);
+		u32 num = 0;
+
+		while (num < num_samples)
+		{
+			// Output the rest of the last decoded block first
+			if (sd.frame_used < sd.frame_size)
+			{
+				const u32 n = num_samples - num < sd.frame_size - sd.frame_used
+					? num_samples - num
+					: sd.frame_size - sd.frame_used
+					;
+				memcpy(samples + num*sd.channels, sd.block + sd.frame_used*sd.channels, n*sd.channels*2);
+				sd.frame_used += n;
+				num += n;
+				continue;
+			}
+
+			if (sd.offset == sd.size)
+			{
+				if (!loop || sd.size == 0)
+					break;
+
+				sd.offset = 0;
+			}
+
+			const u32 first = (sd.offset / sd.block_size) * ADPCM_SAMPLES_PER_BLOCK;
+			const u32 n = total_samples - first < ADPCM_SAMPLES_PER_BLOCK
+				? total_samples - first
+				: ADPCM_SAMPLES_PER_BLOCK
+				;
+
+			file.seek(sizeof(SoundResource) + sd.offset);
+			file.read(sd.input, sd.block_size);
+			sd.offset += sd.block_size;
+
+			adpcm::decode_block(sd.input, n, sd.channels, sd.block);
+			sd.frame_size = n;
+			sd.frame_used = 0;
+		}
+
+		return num*sd.channels*2;
+	}
+
+	u32 decode(SoundDecoder& sd, File& file, bool loop, char* pcm, u32 size)
+	{
+		switch (sd.sound_type)
+		{
+		case SoundType::OGG:   return decode_ogg(sd, file, loop, pcm, size);
+		case SoundType::ADPCM: return decode_adpcm(sd, file, loop, pcm, size);
+		default:               return decode_wav(sd, file, loop, pcm, size);
+		}
+	}
+
 } // namespace sound_resource
 
 } // namespace crown
+
+#undef STB_VORBIS_HEADER_ONLY
+#include <stb_vorbis.c>
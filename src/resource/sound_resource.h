@@ -5,47 +5,96 @@
 
 #pragma once
 
+#include "config.h"
+#include "core/adpcm.h"
 #include "core/filesystem/types.h"
 #include "core/memory/types.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
 #include "resource/types.h"
-#include "resource/types.h"
 
 namespace crown
 {
+/// Enumerates the formats of the sound data.
 struct SoundType
 {
 	enum Enum
 	{
-		WAV,
-		OGG
+		WAV,   ///< Uncompressed PCM.
+		OGG,   ///< Vorbis compressed.
+		ADPCM, ///< IMA ADPCM compressed, 16 bits samples only.
+
+		COUNT
 	};
 };
 
 struct SoundResource
 {
 	u32 version;
-	u32 size;
+	u32 size;        ///< Size of the sound data.
 	u32 sample_rate;
 	u32 avg_bytes_ps;
 	u32 channels;
 	u16 block_size;
 	u16 bits_ps;
 	u32 sound_type;
+	u32 buffer;      ///< Audio buffer of the sound, set when online. Unused if streamed.
+	u32 stream;      ///< Whether the sound data is streamed from disk instead of being loaded.
+	u32 pcm_size;    ///< Size of the sound data once decoded to PCM.
+	StringId64 name; ///< Name of the resource, set when online.
+	// char data[size] Not loaded if the sound is streamed.
+};
+
+/// Decodes the data of a sound to PCM a chunk at a time. WAV sounds are
+/// read as they are.
+struct SoundDecoder
+{
+	u32 sound_type;
+	u32 size;       ///< Size of the sound data.
+	u32 pcm_size;   ///< Size of the sound data once decoded.
+	u32 channels;
+	u32 block_size; ///< Size of the ADPCM blocks.
+	u32 offset;     ///< Offset of the next byte to read from the sound data.
+	void* vorbis;   ///< Vorbis decoder, NULL until the headers have been read.
+	f32** frame;    ///< Samples of the last decoded Vorbis frame.
+	u32 frame_size; ///< Number of samples per channel in the last decoded frame or block.
+	u32 frame_used; ///< Number of samples per channel already output from the frame or block.
+	u32 input_size; ///< Number of bytes in input not yet consumed.
+	s16 block[ADPCM_SAMPLES_PER_BLOCK*2]; ///< Samples of the last decoded ADPCM block.
+	u8 input[CROWN_SOUND_STREAM_BUFFER_SIZE];
 };
 
 namespace sound_resource_internal
 {
 	void compile(CompileOptions& opts);
+	void* load(File& file, Allocator& a);
+	void online(StringId64 id, ResourceManager& rm);
+	void offline(StringId64 id, ResourceManager& rm);
+	void unload(Allocator& a, void* resource);
 
 } // namespace	sound_resource_internal
 
 namespace sound_resource
 {
 	/// Returns the sound data.
+	/// @note
+	/// Streamed sounds have no data in memory. The data of the sounds which
+	/// are not streamed is decoded to PCM when loaded.
 	const char* data(const SoundResource* sr);
 
+	/// Initializes the decoder @a sd to stream the sound @a sr.
+	void decoder_init(SoundDecoder& sd, const SoundResource& sr);
+
+	/// Releases the memory used by the decoder @a sd.
+	void decoder_shutdown(SoundDecoder& sd);
+
+	/// Reads the sound data of the decoder @a sd from the resource @a file
+	/// and writes up to @a size bytes of PCM samples to @a pcm. Compressed
+	/// sounds are decoded to 16 bits samples. If @a loop is true the sound restarts
+	/// from the beginning once it ends. Returns the number of bytes written,
+	/// which is less than @a size only when the sound has ended.
+	u32 decode(SoundDecoder& sd, File& file, bool loop, char* pcm, u32 size);
+
 } // namespace sound_resource
 
 } // namespace crown
@@ -5,6 +5,7 @@
 
 #include "config.h"
 #include "core/containers/array.h"
+#include "core/containers/vector.h"
 #include "core/filesystem/reader_writer.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
@@ -12,10 +13,12 @@
 #include "core/math/vector2.h"
 #include "core/math/vector4.h"
 #include "core/memory/temp_allocator.h"
+#include "core/strings/dynamic_string.h"
 #include "core/strings/string.h"
 #include "resource/compile_options.h"
 #include "resource/resource_manager.h"
 #include "resource/sprite_resource.h"
+#include "resource/texture_resource.h"
 
 namespace crown
 {
@@ -50,11 +53,80 @@ namespace sprite_resource_internal
 		JsonArray frames(ta);
 		sjson::parse_array(object["frames"], frames);
 
-		// Read width/height
-		const f32 width      = sjson::parse_float(object["width" ]);
-		const f32 height     = sjson::parse_float(object["height"]);
 		const u32 num_frames = array::size(frames);
 
+		// Offset of the image in the texture and size of the texture
+		f32 offset_x = 0.0f;
+		f32 offset_y = 0.0f;
+		f32 width;
+		f32 height;
+
+		if (json_object::has(object, "atlas"))
+		{
+			// Find the image of the sprite in the atlas by laying it out
+			// again, the same way the texture compiler does
+			DynamicString atlas(ta);
+			sjson::parse_string(object["atlas"], atlas);
+			DATA_COMPILER_ASSERT_RESOURCE_EXISTS("texture", atlas.c_str(), opts);
+			atlas += ".texture";
+
+			DynamicString source(ta);
+			sjson::parse_string(object["source"], source);
+
+			Buffer atlas_buf = opts.read(atlas.c_str());
+			TempAllocator4096 atlas_ta;
+			JsonObject atlas_obj(atlas_ta);
+			sjson::parse(atlas_buf, atlas_obj);
+			DATA_COMPILER_ASSERT(json_object::has(atlas_obj, "atlas")
+				, opts
+				, "Texture is not an atlas: %s"
+				, atlas.c_str()
+				);
+
+			Vector<DynamicString> sources(default_allocator());
+			u32 padding;
+			texture_resource_internal::parse_atlas(atlas_obj["atlas"], sources, padding);
+
+			const u32 num = vector::size(sources);
+			u32 index = UINT32_MAX;
+			Array<u32> sizes(default_allocator());
+			array::resize(sizes, num*2);
+			for (u32 i = 0; i < num; ++i)
+			{
+				texture_resource_internal::image_size(opts, sources[i].c_str(), sizes[i*2 + 0], sizes[i*2 + 1]);
+				if (sources[i] == source.c_str())
+					index = i;
+			}
+			DATA_COMPILER_ASSERT(index != UINT32_MAX
+				, opts
+				, "Image not in atlas: %s"
+				, source.c_str()
+				);
+
+			Array<texture_resource_internal::AtlasRect> rects(default_allocator());
+			array::resize(rects, num);
+			u32 atlas_width;
+			u32 atlas_height;
+			const bool fits = texture_resource_internal::atlas_layout(array::begin(rects)
+				, atlas_width
+				, atlas_height
+				, array::begin(sizes)
+				, num
+				, padding
+				);
+			DATA_COMPILER_ASSERT(fits, opts, "Atlas images do not fit: %s", atlas.c_str());
+
+			offset_x = (f32)rects[index].x;
+			offset_y = (f32)rects[index].y;
+			width    = (f32)atlas_width;
+			height   = (f32)atlas_height;
+		}
+		else
+		{
+			width  = sjson::parse_float(object["width" ]);
+			height = sjson::parse_float(object["height"]);
+		}
+
 		Array<f32> vertices(default_allocator());
 		for (u32 i = 0; i < num_frames; ++i)
 		{
@@ -64,10 +136,10 @@ namespace sprite_resource_internal
 			const SpriteFrame& fd = frame;
 
 			// Compute uv coords
-			const f32 u0 = (              fd.region.x) / width;
-			const f32 v0 = (fd.region.w + fd.region.y) / height;
-			const f32 u1 = (fd.region.z + fd.region.x) / width;
-			const f32 v1 = (              fd.region.y) / height;
+			const f32 u0 = (offset_x +               fd.region.x) / width;
+			const f32 v0 = (offset_y + fd.region.w + fd.region.y) / height;
+			const f32 u1 = (offset_x + fd.region.z + fd.region.x) / width;
+			const f32 v1 = (offset_y +               fd.region.y) / height;
 
 			// Compute positions
 			f32 x0 = (              fd.region.x - fd.pivot.x) / CROWN_DEFAULT_PIXELS_PER_METER;
@@ -106,6 +106,7 @@ namespace state_machine_internal
 		DynamicString speed;
 		u32 speed_bytecode;
 		u32 loop;
+		u32 time_dependent;
 
 		StateInfo()
 			: animations(default_allocator())
@@ -113,6 +114,7 @@ namespace state_machine_internal
 			, speed(default_allocator())
 			, speed_bytecode(UINT32_MAX)
 			, loop(0)
+			, time_dependent(0)
 		{
 		}
 
@@ -122,6 +124,7 @@ namespace state_machine_internal
 			, speed(a)
 			, speed_bytecode(UINT32_MAX)
 			, loop(0)
+			, time_dependent(0)
 		{
 		}
 	};
@@ -149,7 +152,7 @@ namespace state_machine_internal
 
 	struct StateMachineCompiler
 	{
-		CompileOptions _opts;
+		CompileOptions& _opts;
 		Guid _initial_state;
 		Map<Guid, StateInfo> _states;
 		OffsetAccumulator _offset_accumulator;
@@ -157,7 +160,7 @@ namespace state_machine_internal
 		Vector<VariableInfo> _variables;
 		Array<u32> _byte_code;
 
-		StateMachineCompiler(CompileOptions opts)
+		StateMachineCompiler(CompileOptions& opts)
 			: _opts(opts)
 			, _states(default_allocator())
 			, _offsets(default_allocator())
@@ -289,8 +292,20 @@ namespace state_machine_internal
 					vi.value = sjson::parse_float(variable["value"]);
 					sjson::parse_string(variable["name"], vi.name_string);
 
+					DATA_COMPILER_ASSERT(vi.name != STATE_MACHINE_TIME_VARIABLE
+						, _opts
+						, "Variable name is reserved: 'time'"
+						);
+
 					vector::push_back(_variables, vi);
 				}
+
+				// The built-in time variable is always the last one
+				VariableInfo vi;
+				vi.name = STATE_MACHINE_TIME_VARIABLE;
+				vi.value = 0.0f;
+				vi.name_string = "time";
+				vector::push_back(_variables, vi);
 			}
 
 			// Compute state offsets
@@ -300,6 +315,7 @@ namespace state_machine_internal
 				u32 written = 0;
 
 				const u32 num_variables = vector::size(_variables);
+				const u32 time_variable = num_variables - 1;
 				const char** variables = (const char**)default_allocator().allocate(num_variables*sizeof(char*));
 
 				for (u32 i = 0; i < num_variables; ++i)
@@ -338,6 +354,8 @@ namespace state_machine_internal
 							 );
 
 						const_cast<AnimationInfo&>(si.animations[i]).bytecode_entry = num > 0 ? written : UINT32_MAX;
+						if (num > 0 && skinny::expression_language::uses_variable(array::begin(_byte_code) + written, time_variable))
+							const_cast<StateInfo&>(si).time_dependent = 1;
 						written += num;
 					}
 
@@ -352,6 +370,8 @@ namespace state_machine_internal
 						 );
 
 					const_cast<StateInfo&>(si).speed_bytecode = num > 0 ? written : UINT32_MAX;
+					if (num > 0 && skinny::expression_language::uses_variable(array::begin(_byte_code) + written, time_variable))
+						const_cast<StateInfo&>(si).time_dependent = 1;
 					written += num;
 				}
 
@@ -390,6 +410,9 @@ namespace state_machine_internal
 				// Write loop
 				opts.write(si.loop);
 
+				// Write time dependency
+				opts.write(si.time_dependent);
+
 				// Write transitions
 				TransitionArray ta;
 				ta.num = num_transitions;
@@ -524,6 +547,11 @@ namespace state_machine
 		return UINT32_MAX;
 	}
 
+	u32 time_variable(const StateMachineResource* smr)
+	{
+		return smr->num_variables - 1;
+	}
+
 	const u32* byte_code(const StateMachineResource* smr)
 	{
 		return (u32*)((char*)smr + smr->bytecode_offset);
@@ -55,12 +55,17 @@ struct State
 {
 	u32 speed_bytecode;
 	u32 loop;
+	u32 time_dependent; ///< Whether any expression of the state reads the time variable.
 	TransitionArray ta;
 	// Transition[num_transitions]
 	// AnimationArray
 	// Animation[num_animations]
 };
 
+/// Built-in variable holding the time elapsed in the playing animation.
+/// It is always the last variable of a state machine.
+#define STATE_MACHINE_TIME_VARIABLE "time"_id32
+
 struct TransitionMode
 {
 	enum Enum
@@ -108,6 +113,9 @@ namespace state_machine
 	/// Returns the index of the variable @a name or UINT32_MAX if not found.
 	u32 variable_index(const StateMachineResource* smr, StringId32 name);
 
+	/// Returns the index of the built-in time variable.
+	u32 time_variable(const StateMachineResource* smr);
+
 	/// Returns the byte code of the state machine.
 	const u32* byte_code(const StateMachineResource* smr);
 
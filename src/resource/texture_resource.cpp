@@ -4,36 +4,465 @@
  */
 
 #include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/vector.h"
 #include "core/filesystem/reader_writer.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
+#include "core/math/math.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
 #include "core/strings/string_stream.h"
+#include "device/device.h"
 #include "resource/compile_options.h"
 #include "resource/resource_manager.h"
 #include "resource/texture_resource.h"
-
-#if CROWN_DEVELOPMENT
-	#define TEXTUREC_NAME "texturec-development"
-#elif CROWN_DEBUG
-	#define TEXTUREC_NAME "texturec-debug"
-#else
-	#define TEXTUREC_NAME "texturec-release"
-#endif  // CROWN_DEBUG
-
-#if CROWN_PLATFORM_LINUX
-	#define TEXTUREC_PATH "./" TEXTUREC_NAME ""
-#elif CROWN_PLATFORM_WINDOWS
-	#define TEXTUREC_PATH TEXTUREC_NAME ".exe"
-#else
-	#define TEXTUREC_PATH ""
-#endif // CROWN_PLATFORM_LINUX
+#include "world/texture_manager.h"
+#include <bimg/decode.h>
+#include <bimg/encode.h>
+#include <bx/allocator.h>
+#include <bx/error.h>
+#include <bx/math.h>
+#include <bx/readerwriter.h>
+#include <algorithm> // std::sort
+#include <string.h> // memcpy, memset
 
 namespace crown
 {
+// Indices of the u32 fields of the KTX header.
+#define KTX_ENDIANNESS         3
+#define KTX_PIXEL_WIDTH        9
+#define KTX_PIXEL_HEIGHT       10
+#define KTX_PIXEL_DEPTH        11
+#define KTX_NUM_ARRAY_ELEMENTS 12
+#define KTX_NUM_FACES          13
+#define KTX_NUM_MIPS           14
+#define KTX_KEY_VALUE_SIZE     15
+
 namespace texture_resource_internal
 {
+	// Forces 16-byte alignment, as bimg expects.
+	struct AlignedAllocator : public bx::AllocatorI
+	{
+		bx::DefaultAllocator _allocator;
+
+		virtual void* realloc(void* ptr, size_t size, size_t align, const char* file, u32 line)
+		{
+			return _allocator.realloc(ptr, size, align < 16 ? 16 : align, file, line);
+		}
+	};
+
+	struct BufferWriter : public bx::WriterI
+	{
+		Buffer& _buffer;
+
+		BufferWriter(Buffer& buffer)
+			: _buffer(buffer)
+		{
+		}
+
+		virtual int32_t write(const void* data, int32_t size, bx::Error* /*err*/)
+		{
+			array::push(_buffer, (const char*)data, u32(size));
+			return size;
+		}
+	};
+
+	static void normalize(float* rgba, u32 num)
+	{
+		for (u32 i = 0; i < num; ++i, rgba += 4)
+		{
+			float xyz[3];
+			xyz[0] = rgba[0];
+			xyz[1] = rgba[1];
+			xyz[2] = rgba[2];
+			bx::vec3Norm(rgba, xyz);
+		}
+	}
+
+	/// Converts the image @a input to @a format, optionally generating
+	/// @a mips and treating it as a @a normal_map. Compressed formats are
+	/// encoded with the given @a quality. @a input is freed.
+	/// This is the subset of texturec used by texture resources.
+	static bimg::ImageContainer* convert(bx::AllocatorI* a, bimg::ImageContainer* input, bimg::TextureFormat::Enum format, bool mips, bool normal_map, bimg::Quality::Enum quality, bx::Error* err)
+	{
+		if (format == input->m_format && (1 < input->m_numMips) == mips && !normal_map)
+		{
+			bimg::ImageContainer* output = bimg::imageConvert(a, format, *input);
+			bimg::imageFree(input);
+			return output;
+		}
+
+		const bimg::ImageBlockInfo& bi = bimg::getBlockInfo(format);
+		const bool hdr = !bimg::isCompressed(format) && bi.rBits != 8;
+
+		bimg::ImageContainer* output = bimg::imageAlloc(a
+			, format
+			, uint16_t(input->m_width)
+			, uint16_t(input->m_height)
+			, uint16_t(input->m_depth)
+			, input->m_numLayers
+			, input->m_cubeMap
+			, mips
+			);
+
+		const u8 num_mips = output->m_numMips;
+		const u16 num_sides = output->m_numLayers * (output->m_cubeMap ? 6 : 1);
+
+		for (u16 side = 0; side < num_sides && err->isOk(); ++side)
+		{
+			bimg::ImageMip mip;
+			if (!bimg::imageGetRawData(*input, side, 0, input->m_data, input->m_size, mip))
+				continue;
+
+			bimg::ImageMip dst;
+			bimg::imageGetRawData(*output, side, 0, output->m_data, output->m_size, dst);
+
+			if (normal_map || hdr)
+			{
+				const u32 rgba_size = mip.m_width*mip.m_height*mip.m_depth*16;
+				float* rgba = (float*)BX_ALLOC(a, rgba_size);
+				float* rgba_dst = (float*)BX_ALLOC(a, rgba_size);
+
+				bimg::imageDecodeToRgba32f(a, rgba, mip.m_data, mip.m_width, mip.m_height, mip.m_depth, mip.m_width*16, mip.m_format);
+
+				if (normal_map)
+				{
+					// Unpack to [-1; 1] and normalize
+					if (mip.m_format != bimg::TextureFormat::BC5)
+					{
+						for (u32 i = 0; i < mip.m_width*mip.m_height*4; ++i)
+							rgba[i] = rgba[i] * 2.0f - 1.0f;
+					}
+					normalize(rgba, mip.m_width*mip.m_height);
+					bimg::imageRgba32f11to01(rgba_dst, dst.m_width, dst.m_height, dst.m_depth, dst.m_width*16, rgba);
+				}
+				else
+				{
+					memcpy(rgba_dst, rgba, rgba_size);
+					bimg::imageRgba32fToLinear(rgba, mip.m_width, mip.m_height, mip.m_depth, mip.m_width*16, rgba);
+				}
+
+				bimg::imageEncodeFromRgba32f(a, const_cast<u8*>(dst.m_data), rgba_dst, dst.m_width, dst.m_height, dst.m_depth, format, quality, err);
+
+				for (u8 lod = 1; lod < num_mips && err->isOk(); ++lod)
+				{
+					if (normal_map)
+					{
+						bimg::imageRgba32fDownsample2x2NormalMap(rgba, dst.m_width, dst.m_height, dst.m_width*16, bx::strideAlign(dst.m_width/2, bi.blockWidth)*16, rgba);
+						bimg::imageGetRawData(*output, side, lod, output->m_data, output->m_size, dst);
+						bimg::imageRgba32f11to01(rgba_dst, dst.m_width, dst.m_height, dst.m_depth, dst.m_width*16, rgba);
+					}
+					else
+					{
+						bimg::imageRgba32fLinearDownsample2x2(rgba, dst.m_width, dst.m_height, dst.m_depth, dst.m_width*16, rgba);
+						bimg::imageGetRawData(*output, side, lod, output->m_data, output->m_size, dst);
+						bimg::imageRgba32fToGamma(rgba_dst, dst.m_width, dst.m_height, dst.m_depth, dst.m_width*16, rgba);
+					}
+
+					bimg::imageEncodeFromRgba32f(a, const_cast<u8*>(dst.m_data), rgba_dst, dst.m_width, dst.m_height, dst.m_depth, format, quality, err);
+				}
+
+				BX_FREE(a, rgba_dst);
+				BX_FREE(a, rgba);
+			}
+			else
+			{
+				u8* rgba = (u8*)BX_ALLOC(a, mip.m_width*mip.m_height*mip.m_depth*4);
+
+				bimg::imageDecodeToRgba8(a, rgba, mip.m_data, mip.m_width, mip.m_height, mip.m_width*4, mip.m_format);
+				bimg::imageEncodeFromRgba8(a, const_cast<u8*>(dst.m_data), rgba, dst.m_width, dst.m_height, dst.m_depth, format, quality, err);
+
+				for (u8 lod = 1; lod < num_mips && err->isOk(); ++lod)
+				{
+					bimg::imageRgba8Downsample2x2(rgba, dst.m_width, dst.m_height, dst.m_depth, dst.m_width*4, bx::strideAlign(dst.m_width/2, bi.blockWidth)*4, rgba);
+					bimg::imageGetRawData(*output, side, lod, output->m_data, output->m_size, dst);
+					bimg::imageEncodeFromRgba8(a, const_cast<u8*>(dst.m_data), rgba, dst.m_width, dst.m_height, dst.m_depth, format, quality, err);
+				}
+
+				BX_FREE(a, rgba);
+			}
+		}
+
+		bimg::imageFree(input);
+
+		if (!err->isOk())
+		{
+			bimg::imageFree(output);
+			return NULL;
+		}
+
+		return output;
+	}
+
+	/// Reads the image @a source and converts it to RGBA8.
+	static bimg::ImageContainer* read_rgba8(CompileOptions& opts, bx::AllocatorI* a, const char* source)
+	{
+		DATA_COMPILER_ASSERT_FILE_EXISTS(source, opts);
+		Buffer data = opts.read(source);
+
+		bx::Error err;
+		bimg::ImageContainer* ic = bimg::imageParse(a
+			, array::begin(data)
+			, array::size(data)
+			, bimg::TextureFormat::RGBA8
+			, &err
+			);
+		DATA_COMPILER_ASSERT(ic != NULL && err.isOk()
+			, opts
+			, "Failed to read image: %s"
+			, source
+			);
+		DATA_COMPILER_ASSERT(ic->m_depth == 1 && ic->m_numLayers == 1 && !ic->m_cubeMap
+			, opts
+			, "Atlas images must be 2D: %s"
+			, source
+			);
+		return ic;
+	}
+
+	void parse_atlas(const char* atlas, Vector<DynamicString>& sources, u32& padding)
+	{
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		sjson::parse(atlas, object);
+
+		JsonArray images(ta);
+		sjson::parse_array(object["images"], images);
+
+		padding = json_object::has(object, "padding")
+			? (u32)sjson::parse_int(object["padding"])
+			: 2
+			;
+
+		for (u32 i = 0; i < array::size(images); ++i)
+		{
+			DynamicString source(default_allocator());
+			sjson::parse_string(images[i], source);
+			vector::push_back(sources, source);
+		}
+	}
+
+	void image_size(CompileOptions& opts, const char* source, u32& width, u32& height)
+	{
+		AlignedAllocator allocator;
+		bimg::ImageContainer* ic = read_rgba8(opts, &allocator, source);
+		width = ic->m_width;
+		height = ic->m_height;
+		bimg::imageFree(ic);
+	}
+
+	struct AtlasCellLess
+	{
+		const u32* sizes;
+
+		bool operator()(u32 a, u32 b) const
+		{
+			// Tallest first, widest among equally tall, then by index so that
+			// the order does not depend on the sort implementation
+			if (sizes[a*2 + 1] != sizes[b*2 + 1])
+				return sizes[a*2 + 1] > sizes[b*2 + 1];
+			if (sizes[a*2 + 0] != sizes[b*2 + 0])
+				return sizes[a*2 + 0] > sizes[b*2 + 0];
+			return a < b;
+		}
+	};
+
+	static u32 align_cell(u32 size)
+	{
+		return (size + CROWN_SPRITE_ATLAS_ALIGN - 1) / CROWN_SPRITE_ATLAS_ALIGN * CROWN_SPRITE_ATLAS_ALIGN;
+	}
+
+	static u32 next_pow2(u32 x)
+	{
+		u32 p = 1;
+		while (p < x)
+			p *= 2;
+		return p;
+	}
+
+	bool atlas_layout(AtlasRect* rects, u32& width, u32& height, const u32* sizes, u32 num, u32 padding)
+	{
+		Array<u32> order(default_allocator());
+		array::resize(order, num);
+
+		u32 area = 0;
+		u32 max_cell_width = 1;
+		for (u32 i = 0; i < num; ++i)
+		{
+			order[i] = i;
+
+			const u32 cw = align_cell(sizes[i*2 + 0] + padding*2);
+			const u32 ch = align_cell(sizes[i*2 + 1] + padding*2);
+			area += cw*ch;
+			max_cell_width = bx::max(max_cell_width, cw);
+		}
+
+		AtlasCellLess less;
+		less.sizes = sizes;
+		std::sort(array::begin(order), array::end(order), less);
+
+		// Start from the smallest square which could hold all the images and
+		// double the width until the shelves are not taller than it
+		u32 w = next_pow2(bx::max(max_cell_width, (u32)fsqrt((f32)area)));
+		for (; w <= CROWN_SPRITE_ATLAS_MAX_SIZE; w *= 2)
+		{
+			u32 shelf_x = 0;
+			u32 shelf_y = 0;
+			u32 shelf_height = 0;
+
+			for (u32 i = 0; i < num; ++i)
+			{
+				const u32 j = order[i];
+				const u32 cw = align_cell(sizes[j*2 + 0] + padding*2);
+				const u32 ch = align_cell(sizes[j*2 + 1] + padding*2);
+
+				if (shelf_x + cw > w)
+				{
+					shelf_x = 0;
+					shelf_y += shelf_height;
+					shelf_height = 0;
+				}
+
+				rects[j].x      = shelf_x + padding;
+				rects[j].y      = shelf_y + padding;
+				rects[j].width  = sizes[j*2 + 0];
+				rects[j].height = sizes[j*2 + 1];
+
+				shelf_x += cw;
+				shelf_height = bx::max(shelf_height, ch);
+			}
+
+			const u32 h = next_pow2(bx::max(1u, shelf_y + shelf_height));
+			if (h <= w)
+			{
+				width = w;
+				height = h;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/// Packs the images of the @a atlas object in a single RGBA8 image,
+	/// extruding the edges of each image into its padding so that filtering
+	/// and the mips do not bleed the neighbouring images into it.
+	static bimg::ImageContainer* build_atlas(CompileOptions& opts, bx::AllocatorI* a, const char* atlas)
+	{
+		Vector<DynamicString> sources(default_allocator());
+		u32 padding;
+		parse_atlas(atlas, sources, padding);
+
+		const u32 num = vector::size(sources);
+		DATA_COMPILER_ASSERT(num > 0, opts, "Atlas has no images");
+
+		Array<bimg::ImageContainer*> images(default_allocator());
+		Array<u32> sizes(default_allocator());
+		for (u32 i = 0; i < num; ++i)
+		{
+			bimg::ImageContainer* ic = read_rgba8(opts, a, sources[i].c_str());
+			array::push_back(images, ic);
+			array::push_back(sizes, ic->m_width);
+			array::push_back(sizes, ic->m_height);
+		}
+
+		Array<AtlasRect> rects(default_allocator());
+		array::resize(rects, num);
+		u32 width;
+		u32 height;
+		const bool fits = atlas_layout(array::begin(rects), width, height, array::begin(sizes), num, padding);
+		DATA_COMPILER_ASSERT(fits
+			, opts
+			, "Atlas images do not fit in %ux%u"
+			, CROWN_SPRITE_ATLAS_MAX_SIZE
+			, CROWN_SPRITE_ATLAS_MAX_SIZE
+			);
+
+		bimg::ImageContainer* output = bimg::imageAlloc(a
+			, bimg::TextureFormat::RGBA8
+			, uint16_t(width)
+			, uint16_t(height)
+			, 1
+			, 1
+			, false
+			, false
+			);
+		memset(output->m_data, 0, output->m_size);
+
+		u32* dst = (u32*)output->m_data;
+		for (u32 i = 0; i < num; ++i)
+		{
+			const AtlasRect& r = rects[i];
+			const u32* src = (const u32*)images[i]->m_data;
+
+			for (u32 y = 0; y < r.height + padding*2; ++y)
+			{
+				const s32 sy = bx::clamp((s32)y - (s32)padding, 0, (s32)r.height - 1);
+				for (u32 x = 0; x < r.width + padding*2; ++x)
+				{
+					const s32 sx = bx::clamp((s32)x - (s32)padding, 0, (s32)r.width - 1);
+					dst[(r.y - padding + y)*width + r.x - padding + x] = src[sy*r.width + sx];
+				}
+			}
+
+			bimg::imageFree(images[i]);
+		}
+
+		return output;
+	}
+
+	/// Returns the name of the format the texture @a object asks for on the
+	/// target platform, or NULL to keep the format of its source image.
+	/// The format is either a name, or an object with a name for each
+	/// platform. The name "platform" selects the platform's own format.
+	static const char* parse_format(CompileOptions& opts, const JsonObject& object, bool normal_map, DynamicString& name)
+	{
+		if (!json_object::has(object, "format"))
+			return NULL;
+
+		const char* format = object["format"];
+		if (sjson::type(format) == JsonValueType::OBJECT)
+		{
+			TempAllocator512 ta;
+			JsonObject formats(ta);
+			sjson::parse_object(format, formats);
+
+			if (!json_object::has(formats, opts.platform()))
+				return NULL;
+
+			format = formats[opts.platform()];
+		}
+
+		sjson::parse_string(format, name);
+		return name == "platform"
+			? opts.texture_format(normal_map)
+			: name.c_str()
+			;
+	}
+
+	static bimg::Quality::Enum parse_quality(CompileOptions& opts, const JsonObject& object)
+	{
+		if (!json_object::has(object, "quality"))
+			return bimg::Quality::Default;
+
+		TempAllocator256 ta;
+		DynamicString quality(ta);
+		sjson::parse_string(object["quality"], quality);
+
+		if (quality == "fastest")
+			return bimg::Quality::Fastest;
+		if (quality == "highest")
+			return bimg::Quality::Highest;
+
+		DATA_COMPILER_ASSERT(quality == "default"
+			, opts
+			, "Unknown quality: %s"
+			, quality.c_str()
+			);
+		return bimg::Quality::Default;
+	}
+
 	void compile(CompileOptions& opts)
 	{
 		Buffer buf = opts.read();
@@ -42,79 +471,257 @@ namespace texture_resource_internal
 		JsonObject object(ta);
 		sjson::parse(buf, object);
 
-		DynamicString name(ta);
-		sjson::parse_string(object["source"], name);
-		DATA_COMPILER_ASSERT_FILE_EXISTS(name.c_str(), opts);
-
 		const bool generate_mips = sjson::parse_bool(object["generate_mips"]);
 		const bool normal_map    = sjson::parse_bool(object["normal_map"]);
+		const bimg::Quality::Enum quality = parse_quality(opts, object);
+
+		DynamicString format_name(ta);
+		const char* format_str = parse_format(opts, object, normal_map, format_name);
+		const bimg::TextureFormat::Enum format = format_str != NULL
+			? bimg::getFormat(format_str)
+			: bimg::TextureFormat::Count
+			;
+		DATA_COMPILER_ASSERT(format_str == NULL || format != bimg::TextureFormat::Count
+			, opts
+			, "Unknown format: %s"
+			, format_str
+			);
+
+		AlignedAllocator allocator;
+		bx::Error err;
+		bimg::ImageContainer* input = NULL;
 
-		DynamicString texsrc(ta);
-		DynamicString texout(ta);
-		opts.get_absolute_path(name.c_str(), texsrc);
-		opts.get_temporary_path("ktx", texout);
-
-		const char* argv[] =
-		{
-			TEXTUREC_PATH,
-			"-f",
-			texsrc.c_str(),
-			"-o",
-			texout.c_str(),
-			(generate_mips ? "-m" : ""),
-			(normal_map    ? "-n" : ""),
-			NULL
-		};
-
-		StringStream output(ta);
-		int ec = opts.run_external_compiler(argv, output);
-		DATA_COMPILER_ASSERT(ec == 0
+		if (json_object::has(object, "atlas"))
+		{
+			input = build_atlas(opts, &allocator, object["atlas"]);
+		}
+		else
+		{
+			DynamicString name(ta);
+			sjson::parse_string(object["source"], name);
+			DATA_COMPILER_ASSERT_FILE_EXISTS(name.c_str(), opts);
+
+			Buffer image = opts.read(name.c_str());
+			input = bimg::imageParse(&allocator
+				, array::begin(image)
+				, array::size(image)
+				, bimg::TextureFormat::Count
+				, &err
+				);
+		}
+
+		bimg::ImageContainer* ic = NULL;
+		if (input != NULL && err.isOk())
+			ic = convert(&allocator
+				, input
+				, format != bimg::TextureFormat::Count ? format : input->m_format
+				, generate_mips
+				, normal_map
+				, quality
+				, &err
+				);
+		DATA_COMPILER_ASSERT(ic != NULL
 			, opts
-			, "Failed to compile texture:\n%s"
-			, string_stream::c_str(output)
+			, "Failed to compile texture: %.*s"
+			, err.getMessage().getLength()
+			, err.getMessage().getPtr()
 			);
 
-		Buffer blob = opts.read_temporary(texout.c_str());
-		opts.delete_file(texout.c_str());
+		Buffer blob(default_allocator());
+		BufferWriter writer(blob);
+		bimg::imageWriteKtx(&writer, *ic, ic->m_data, ic->m_size, &err);
+		bimg::imageFree(ic);
+		DATA_COMPILER_ASSERT(err.isOk()
+			, opts
+			, "Failed to write KTX: %.*s"
+			, err.getMessage().getLength()
+			, err.getMessage().getPtr()
+			);
+
+		// Find the offset of each mip. Only single-layer 2D textures are streamed.
+		u32 num_mips = 0;
+		u32 mip_offset[TEXTURE_MAX_MIPS];
+
+		const u32* ktx = (const u32*)array::begin(blob);
+		if (array::size(blob) >= TEXTURE_KTX_HEADER_SIZE
+			&& ktx[KTX_ENDIANNESS] == 0x04030201
+			&& ktx[KTX_PIXEL_DEPTH] <= 1
+			&& ktx[KTX_NUM_ARRAY_ELEMENTS] == 0
+			&& ktx[KTX_NUM_FACES] <= 1
+			&& ktx[KTX_NUM_MIPS] > 1
+			&& ktx[KTX_NUM_MIPS] <= TEXTURE_MAX_MIPS
+			)
+		{
+			u32 offset = TEXTURE_KTX_HEADER_SIZE + ktx[KTX_KEY_VALUE_SIZE];
+			for (u32 i = 0; i < ktx[KTX_NUM_MIPS]; ++i)
+			{
+				DATA_COMPILER_ASSERT(offset + sizeof(u32) <= array::size(blob)
+					, opts
+					, "Malformed KTX"
+					);
+				mip_offset[i] = offset;
+				offset += sizeof(u32) + *(const u32*)&blob[offset];
+			}
+
+			num_mips = ktx[KTX_NUM_MIPS];
+		}
 
 		// Write DDS
 		opts.write(RESOURCE_VERSION_TEXTURE);
+		opts.write(num_mips);
+		for (u32 i = 0; i < num_mips; ++i)
+			opts.write(mip_offset[i]);
 		opts.write(array::size(blob));
 		opts.write(blob);
 	}
 
-	void* load(File& file, Allocator& a)
+	static void read_header(BinaryReader& br, TextureResource& tr)
 	{
-		BinaryReader br(file);
-
 		u32 version;
 		br.read(version);
 		CE_ASSERT(version == RESOURCE_VERSION_TEXTURE, "Wrong version");
 
-		u32 size;
-		br.read(size);
+		br.read(tr.num_mips);
+		CE_ENSURE(tr.num_mips <= TEXTURE_MAX_MIPS);
+		for (u32 i = 0; i < tr.num_mips; ++i)
+			br.read(tr.mip_offset[i]);
+		br.read(tr.blob_size);
+
+		tr.blob_offset = sizeof(u32)*(3 + tr.num_mips);
+		tr.base_mip = 0;
+	}
+
+	static void read_mips(BinaryReader& br, const TextureResource& tr, u32 base_mip, void* data)
+	{
+		char* header = (char*)data;
+		br.seek(tr.blob_offset);
+		br.read(header, TEXTURE_KTX_HEADER_SIZE);
+
+		// Patch the header to describe the mip chain that starts at base_mip.
+		u32* ktx = (u32*)header;
+		const u32 width  = ktx[KTX_PIXEL_WIDTH] >> base_mip;
+		const u32 height = ktx[KTX_PIXEL_HEIGHT] >> base_mip;
+		ktx[KTX_PIXEL_WIDTH]    = width  > 0 ? width  : 1;
+		ktx[KTX_PIXEL_HEIGHT]   = height > 0 ? height : 1;
+		ktx[KTX_NUM_MIPS]      -= base_mip;
+		ktx[KTX_KEY_VALUE_SIZE] = 0;
+
+		br.seek(tr.blob_offset + tr.mip_offset[base_mip]);
+		br.read(header + TEXTURE_KTX_HEADER_SIZE, tr.blob_size - tr.mip_offset[base_mip]);
+	}
+
+	/// Returns whether the GPU can sample the KTX container @a data natively.
+	/// Before the renderer is initialized all formats are assumed supported.
+	static bool is_supported(const void* data, u32 size)
+	{
+		const bgfx::Caps* caps = bgfx::getCaps();
+		if (caps->formats[bgfx::TextureFormat::RGBA8] == BGFX_CAPS_FORMAT_TEXTURE_NONE)
+			return true;
+
+		bimg::ImageContainer ic;
+		if (!bimg::imageParse(ic, data, size))
+			return true;
+
+		return (caps->formats[ic.m_format] & BGFX_CAPS_FORMAT_TEXTURE_2D) != 0;
+	}
+
+	/// Decodes the whole KTX blob of @a tr to RGBA8 and returns a new,
+	/// non-streamed, texture resource allocated with @a a. @a tr is freed.
+	static TextureResource* transcode(BinaryReader& br, TextureResource* tr, Allocator& a)
+	{
+		AlignedAllocator allocator;
+
+		Buffer blob(default_allocator());
+		array::resize(blob, tr->blob_size);
+		br.seek(tr->blob_offset);
+		br.read(array::begin(blob), tr->blob_size);
+
+		bimg::ImageContainer* ic = bimg::imageConvert(&allocator
+			, bimg::TextureFormat::RGBA8
+			, array::begin(blob)
+			, array::size(blob)
+			);
+		if (ic == NULL)
+			return tr;
+
+		array::clear(blob);
+		BufferWriter writer(blob);
+		bx::Error err;
+		bimg::imageWriteKtx(&writer, *ic, ic->m_data, ic->m_size, &err);
+		bimg::imageFree(ic);
+		if (!err.isOk())
+			return tr;
+
+		TextureResource* rgba = (TextureResource*)a.allocate(sizeof(TextureResource) + array::size(blob));
+		*rgba = *tr;
+		memcpy(&rgba[1], array::begin(blob), array::size(blob));
+		rgba->data      = &rgba[1];
+		rgba->size      = array::size(blob);
+		rgba->num_mips  = 0;
+		rgba->base_mip  = 0;
+		rgba->blob_size = array::size(blob);
+
+		a.deallocate(tr);
+		return rgba;
+	}
+
+	void* load(File& file, Allocator& a)
+	{
+		BinaryReader br(file);
+
+		TextureResource header;
+		read_header(br, header);
 
+		// Only load the least detailed mips, the others are streamed in later.
+		u32 base_mip = 0;
+		if (header.num_mips > 0)
+		{
+			br.read(header.header, sizeof(header.header));
+			const u32* ktx   = (const u32*)header.header;
+			const u32 size   = ktx[KTX_PIXEL_WIDTH] > ktx[KTX_PIXEL_HEIGHT]
+				? ktx[KTX_PIXEL_WIDTH]
+				: ktx[KTX_PIXEL_HEIGHT]
+				;
+
+			while (base_mip < header.num_mips - 1
+				&& size >> base_mip > CROWN_TEXTURE_STREAMING_BASE_SIZE
+				)
+			{
+				++base_mip;
+			}
+		}
+
+		const u32 size = texture_resource::mips_size(&header, base_mip);
 		TextureResource* tr = (TextureResource*)a.allocate(sizeof(TextureResource) + size);
+		*tr = header;
 
 		void* data = &tr[1];
-		br.read(data, size);
+		if (tr->num_mips > 0)
+			read_mips(br, *tr, base_mip, data);
+		else
+			br.read(data, size);
 
-		tr->mem        = bgfx::makeRef(data, size);
+		tr->data       = data;
+		tr->size       = size;
 		tr->handle.idx = BGFX_INVALID_HANDLE;
+		tr->base_mip   = base_mip;
+
+		// Formats the GPU cannot sample are decoded here, on the loader
+		// threads, instead of failing at texture creation.
+		if (!is_supported(tr->data, tr->size))
+			tr = transcode(br, tr, a);
 
 		return tr;
 	}
 
 	void online(StringId64 id, ResourceManager& rm)
 	{
-		TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
-		tr->handle = bgfx::createTexture(tr->mem);
+		device()->_texture_manager->online(id, rm);
 	}
 
 	void offline(StringId64 id, ResourceManager& rm)
 	{
-		TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
-		bgfx::destroy(tr->handle);
+		device()->_texture_manager->offline(id, rm);
 	}
 
 	void unload(Allocator& a, void* resource)
@@ -124,4 +731,31 @@ namespace texture_resource_internal
 
 } // namespace texture_resource_internal
 
+namespace texture_resource
+{
+	u32 mips_size(const TextureResource* tr, u32 base_mip)
+	{
+		if (tr->num_mips == 0)
+			return tr->blob_size;
+
+		CE_ASSERT(base_mip < tr->num_mips, "Index out of bounds");
+		return TEXTURE_KTX_HEADER_SIZE + tr->blob_size - tr->mip_offset[base_mip];
+	}
+
+	void* load_mips(File& file, u32 base_mip, Allocator& a, u32& size)
+	{
+		BinaryReader br(file);
+
+		TextureResource tr;
+		texture_resource_internal::read_header(br, tr);
+		CE_ASSERT(base_mip < tr.num_mips, "Index out of bounds");
+
+		size = mips_size(&tr, base_mip);
+		void* data = a.allocate(size);
+		texture_resource_internal::read_mips(br, tr, base_mip, data);
+		return data;
+	}
+
+} // namespace texture_resource
+
 } // namespace crown
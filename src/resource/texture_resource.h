@@ -5,23 +5,58 @@
 
 #pragma once
 
+#include "core/containers/types.h"
 #include "core/filesystem/types.h"
 #include "core/memory/types.h"
-#include "core/memory/types.h"
-#include "resource/types.h"
+#include "core/strings/types.h"
 #include "resource/types.h"
 #include <bgfx/bgfx.h>
 
+#define TEXTURE_KTX_HEADER_SIZE 64
+#define TEXTURE_MAX_MIPS 16
+
 namespace crown
 {
 struct TextureResource
 {
-	const bgfx::Memory* mem;
+	const void* data; ///< KTX container of the mips from base_mip.
+	u32 size;
 	bgfx::TextureHandle handle;
+
+	u32 num_mips;     ///< Number of streamable mips, 0 if the texture is not streamed.
+	u32 base_mip;     ///< Most detailed mip in mem.
+	u32 blob_offset;  ///< Offset of the KTX blob in the resource file.
+	u32 blob_size;    ///< Size of the KTX blob.
+	u32 mip_offset[TEXTURE_MAX_MIPS]; ///< Offset of each mip in the KTX blob.
+	char header[TEXTURE_KTX_HEADER_SIZE]; ///< KTX header of the full texture.
 };
 
 namespace texture_resource_internal
 {
+	/// Position of an image in a texture atlas, in pixels.
+	struct AtlasRect
+	{
+		u32 x;
+		u32 y;
+		u32 width;
+		u32 height;
+	};
+
+	/// Parses the @a atlas object of a texture and returns the @a sources
+	/// of its images and the @a padding around each of them.
+	void parse_atlas(const char* atlas, Vector<DynamicString>& sources, u32& padding);
+
+	/// Returns the @a width and @a height of the image @a source.
+	void image_size(CompileOptions& opts, const char* source, u32& width, u32& height);
+
+	/// Packs @a num images, whose width and height are in @a sizes, in an
+	/// atlas leaving @a padding pixels around each of them. Returns the
+	/// position of each image in @a rects and the @a width and @a height of
+	/// the atlas, or false if they do not fit in CROWN_SPRITE_ATLAS_MAX_SIZE.
+	/// The layout only depends on its inputs, so that the sprites can find
+	/// their images without reading the compiled atlas.
+	bool atlas_layout(AtlasRect* rects, u32& width, u32& height, const u32* sizes, u32 num, u32 padding);
+
 	void compile(CompileOptions& opts);
 	void* load(File& file, Allocator& a);
 	void offline(StringId64 id, ResourceManager& rm);
@@ -30,4 +65,19 @@ namespace texture_resource_internal
 
 } // namespace texture_resource_internal
 
+namespace texture_resource
+{
+	/// Returns the size of the KTX container holding the mips from
+	/// @a base_mip to the least detailed one.
+	u32 mips_size(const TextureResource* tr, u32 base_mip);
+
+	/// Reads the mips from @a base_mip to the least detailed one from the
+	/// texture resource @a file into a KTX container allocated with @a a.
+	/// Returns the container and its @a size.
+	/// @note
+	/// It is safe to call this function from the loader threads.
+	void* load_mips(File& file, u32 base_mip, Allocator& a, u32& size);
+
+} // namespace texture_resource
+
 } // namespace crown
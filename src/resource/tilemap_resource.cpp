@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/json/json_object.h"
+#include "core/json/sjson.h"
+#include "core/memory/temp_allocator.h"
+#include "resource/compile_options.h"
+#include "resource/tilemap_resource.h"
+#include "resource/types.h"
+
+namespace crown
+{
+namespace tilemap_resource_internal
+{
+	void compile(CompileOptions& opts)
+	{
+		Buffer buf = opts.read();
+
+		TempAllocator4096 ta;
+		JsonObject object(ta);
+		JsonArray rows(ta);
+
+		sjson::parse(buf, object);
+		sjson::parse_array(object["tiles"], rows);
+
+		const f32 tile_size       = sjson::parse_float(object["tile_size"]);
+		const u32 tileset_columns = sjson::parse_int(object["tileset_columns"]);
+		const u32 tileset_rows    = sjson::parse_int(object["tileset_rows"]);
+		const u32 height          = array::size(rows);
+
+		DATA_COMPILER_ASSERT(tile_size > 0.0f
+			, opts
+			, "Tile size must be > 0"
+			);
+		DATA_COMPILER_ASSERT(tileset_columns > 0 && tileset_rows > 0
+			, opts
+			, "Tileset must have at least one column and one row"
+			);
+		DATA_COMPILER_ASSERT(tileset_columns*tileset_rows < UINT16_MAX
+			, opts
+			, "Tileset must have less than %u tiles"
+			, UINT16_MAX
+			);
+		DATA_COMPILER_ASSERT(height > 0
+			, opts
+			, "Tilemap must have at least one row"
+			);
+
+		// Rows go from the top of the map to the bottom, the tiles of
+		// each row from left to right.
+		Array<u16> tiles(default_allocator());
+		u32 width = 0;
+		for (u32 y = 0; y < height; ++y)
+		{
+			TempAllocator1024 ta;
+			JsonArray row(ta);
+			sjson::parse_array(rows[y], row);
+
+			if (y == 0)
+				width = array::size(row);
+
+			DATA_COMPILER_ASSERT(array::size(row) == width && width > 0
+				, opts
+				, "Row %u must have %u tiles"
+				, y
+				, width
+				);
+
+			for (u32 x = 0; x < width; ++x)
+			{
+				const s32 tile = sjson::parse_int(row[x]);
+				DATA_COMPILER_ASSERT(tile >= 0 && u32(tile) <= tileset_columns*tileset_rows
+					, opts
+					, "Tile %d at row %u, column %u is not in the tileset"
+					, tile
+					, y
+					, x
+					);
+				array::push_back(tiles, (u16)tile);
+			}
+		}
+
+		opts.write(RESOURCE_VERSION_TILEMAP);
+		opts.write(width);
+		opts.write(height);
+		opts.write(tile_size);
+		opts.write(tileset_columns);
+		opts.write(tileset_rows);
+		opts.write(array::begin(tiles), array::size(tiles)*sizeof(u16));
+	}
+
+} // namespace tilemap_resource_internal
+
+namespace tilemap_resource
+{
+	const u16* tiles(const TilemapResource* tr)
+	{
+		return (const u16*)&tr[1];
+	}
+
+} // namespace tilemap_resource
+
+} // namespace crown
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/filesystem/types.h"
+#include "core/math/types.h"
+#include "core/memory/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
+namespace crown
+{
+/// Grid of tiles on the XZ plane, drawn with the tiles of a tileset
+/// texture. The header is followed by width*height tile indices, row by
+/// row from the top of the map. Index 0 marks an empty cell, index i the
+/// tile i-1 of the tileset, counted row by row from its top-left corner.
+struct TilemapResource
+{
+	u32 version;
+	u32 width;           ///< Number of tiles along x.
+	u32 height;          ///< Number of tiles along z.
+	f32 tile_size;       ///< Size of a tile in meters.
+	u32 tileset_columns; ///< Number of tiles along the width of the tileset texture.
+	u32 tileset_rows;    ///< Number of tiles along the height of the tileset texture.
+};
+
+namespace tilemap_resource_internal
+{
+	void compile(CompileOptions& opts);
+
+} // namespace tilemap_resource_internal
+
+namespace tilemap_resource
+{
+	/// Returns the tile indices of @a tr.
+	const u16* tiles(const TilemapResource* tr);
+
+} // namespace tilemap_resource
+
+} // namespace crown
@@ -5,35 +5,87 @@
 
 #pragma once
 
+#include "core/types.h"
+
 /// @defgroup Resource Resource
 namespace crown
 {
+struct CompileCache;
 struct CompileOptions;
 struct DataCompiler;
+struct ResourceBundle;
 struct ResourceLoader;
 struct ResourceManager;
 struct ResourcePackage;
 
 struct ActorResource;
 struct StateMachineResource;
+struct ComponentData;
 struct ControllerResource;
 struct FontResource;
 struct JointResource;
 struct LevelResource;
 struct LuaResource;
 struct MaterialResource;
+struct MeshGeometry;
 struct MeshResource;
+struct NavGridResource;
 struct PackageResource;
+struct ParticleResource;
 struct PhysicsConfigResource;
 struct PhysicsResource;
+struct RenderGraphResource;
 struct ShaderResource;
 struct ShapeResource;
+struct SkeletonAnimationResource;
+struct SkeletonResource;
 struct SoundResource;
 struct SpriteAnimationResource;
 struct SpriteResource;
 struct TextureResource;
+struct TilemapResource;
 struct UnitResource;
 
+/// Enumerates resource load priorities.
+///
+/// @ingroup Resource
+struct ResourcePriority
+{
+	enum Enum
+	{
+		CRITICAL,   ///< Needed to boot or to continue the game.
+		NORMAL,     ///< Regular gameplay content.
+		BACKGROUND, ///< Speculative prefetches.
+
+		COUNT
+	};
+};
+
+/// Enumerates compression methods of compiled resources.
+///
+/// @ingroup Resource
+struct ResourceCompression
+{
+	enum Enum
+	{
+		NONE,
+		LZ4,
+
+		COUNT
+	};
+};
+
+/// Stable reference to a resource owned by ResourceManager.
+/// The handle becomes stale as soon as the resource is unloaded or
+/// reloaded; check it with ResourceManager::is_valid().
+///
+/// @ingroup Resource
+struct ResourceHandle
+{
+	u32 index;
+	u32 generation;
+};
+
 } // namespace crown
 
 /// @addtogroup Resource
@@ -44,31 +96,43 @@ struct UnitResource;
 #define RESOURCE_TYPE_LEVEL            StringId64(0x2a690fd348fe9ac5)
 #define RESOURCE_TYPE_MATERIAL         StringId64(0xeac0b497876adedf)
 #define RESOURCE_TYPE_MESH             StringId64(0x48ff313713a997a1)
+#define RESOURCE_TYPE_NAV_GRID         StringId64(0x09501c516c99475d)
 #define RESOURCE_TYPE_PACKAGE          StringId64(0xad9c6d9ed1e5e77a)
+#define RESOURCE_TYPE_PARTICLE         StringId64(0x4f5dfccdd9dfa839)
 #define RESOURCE_TYPE_PHYSICS_CONFIG   StringId64(0x72e3cc03787a11a1)
 #define RESOURCE_TYPE_PHYSICS          StringId64(0x5f7203c8f280dab8)
+#define RESOURCE_TYPE_RENDER_GRAPH     StringId64(0x21bdb056bfd9b0aa)
 #define RESOURCE_TYPE_SCRIPT           StringId64(0xa14e8dfa2cd117e2)
 #define RESOURCE_TYPE_SHADER           StringId64(0xcce8d5b5f5ae333f)
+#define RESOURCE_TYPE_SKELETON_ANIMATION StringId64(0xb9879b0e60451841)
+#define RESOURCE_TYPE_SKELETON         StringId64(0x975cebbda510e575)
 #define RESOURCE_TYPE_SOUND            StringId64(0x90641b51c98b7aac)
 #define RESOURCE_TYPE_SPRITE_ANIMATION StringId64(0x487e78e3f87f238d)
 #define RESOURCE_TYPE_SPRITE           StringId64(0x8d5871f9ebdb651c)
 #define RESOURCE_TYPE_TEXTURE          StringId64(0xcd4238c6a0c69e32)
+#define RESOURCE_TYPE_TILEMAP          StringId64(0x3c40e019516c1a0e)
 #define RESOURCE_TYPE_UNIT             StringId64(0xe0a48d0be9a7453f)
 
-#define RESOURCE_VERSION_STATE_MACHINE    u32(1)
+#define RESOURCE_VERSION_STATE_MACHINE    u32(2)
 #define RESOURCE_VERSION_CONFIG           u32(1)
 #define RESOURCE_VERSION_FONT             u32(1)
-#define RESOURCE_VERSION_LEVEL            u32(1)
+#define RESOURCE_VERSION_LEVEL            u32(4)
 #define RESOURCE_VERSION_MATERIAL         u32(1)
-#define RESOURCE_VERSION_MESH             u32(1)
-#define RESOURCE_VERSION_PACKAGE          u32(1)
-#define RESOURCE_VERSION_PHYSICS_CONFIG   u32(1)
+#define RESOURCE_VERSION_MESH             u32(4)
+#define RESOURCE_VERSION_NAV_GRID         u32(1)
+#define RESOURCE_VERSION_PACKAGE          u32(2)
+#define RESOURCE_VERSION_PARTICLE         u32(1)
+#define RESOURCE_VERSION_PHYSICS_CONFIG   u32(5)
 #define RESOURCE_VERSION_PHYSICS          u32(1)
+#define RESOURCE_VERSION_RENDER_GRAPH     u32(1)
 #define RESOURCE_VERSION_SCRIPT           u32(1)
-#define RESOURCE_VERSION_SHADER           u32(1)
-#define RESOURCE_VERSION_SOUND            u32(1)
+#define RESOURCE_VERSION_SHADER           u32(2)
+#define RESOURCE_VERSION_SKELETON_ANIMATION u32(1)
+#define RESOURCE_VERSION_SKELETON         u32(1)
+#define RESOURCE_VERSION_SOUND            u32(4)
 #define RESOURCE_VERSION_SPRITE_ANIMATION u32(1)
 #define RESOURCE_VERSION_SPRITE           u32(1)
-#define RESOURCE_VERSION_TEXTURE          u32(1)
-#define RESOURCE_VERSION_UNIT             u32(1)
+#define RESOURCE_VERSION_TEXTURE          u32(2)
+#define RESOURCE_VERSION_TILEMAP          u32(1)
+#define RESOURCE_VERSION_UNIT             u32(3)
 /// @}
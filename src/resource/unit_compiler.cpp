@@ -3,14 +3,18 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/array.h"
 #include "core/containers/map.h"
 #include "core/containers/sort_map.h"
+#include "core/json/json_document.h"
 #include "core/json/json_object.h"
 #include "core/json/sjson.h"
 #include "core/math/math.h"
 #include "core/memory/temp_allocator.h"
 #include "core/strings/dynamic_string.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 #include "resource/compile_options.h"
 #include "resource/physics_resource.h"
 #include "resource/unit_compiler.h"
@@ -71,13 +75,13 @@ static LightType::Enum light_name_to_enum(const char* name)
 static Buffer compile_transform(const char* json, CompileOptions& /*opts*/)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	TransformDesc td;
-	td.position = sjson::parse_vector3   (obj["position"]);
-	td.rotation = sjson::parse_quaternion(obj["rotation"]);
-	td.scale    = sjson::parse_vector3   (obj["scale"]);
+	td.position = sjson::parse_vector3   (jd, jd["position"]);
+	td.rotation = sjson::parse_quaternion(jd, jd["rotation"]);
+	td.scale    = sjson::parse_vector3   (jd, jd["scale"]);
 
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&td, sizeof(td));
@@ -87,11 +91,11 @@ static Buffer compile_transform(const char* json, CompileOptions& /*opts*/)
 static Buffer compile_camera(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString type(ta);
-	sjson::parse_string(obj["projection"], type);
+	sjson::parse_string(jd, jd["projection"], type);
 
 	ProjectionType::Enum pt = projection_name_to_enum(type.c_str());
 	DATA_COMPILER_ASSERT(pt != ProjectionType::COUNT
@@ -102,9 +106,9 @@ static Buffer compile_camera(const char* json, CompileOptions& opts)
 
 	CameraDesc cd;
 	cd.type       = pt;
-	cd.fov        = sjson::parse_float(obj["fov"]);
-	cd.near_range = sjson::parse_float(obj["near_range"]);
-	cd.far_range  = sjson::parse_float(obj["far_range"]);
+	cd.fov        = sjson::parse_float(jd, jd["fov"]);
+	cd.near_range = sjson::parse_float(jd, jd["near_range"]);
+	cd.far_range  = sjson::parse_float(jd, jd["far_range"]);
 
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&cd, sizeof(cd));
@@ -114,21 +118,21 @@ static Buffer compile_camera(const char* json, CompileOptions& opts)
 static Buffer compile_mesh_renderer(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString mesh_resource(ta);
-	sjson::parse_string(obj["mesh_resource"], mesh_resource);
+	sjson::parse_string(jd, jd["mesh_resource"], mesh_resource);
 	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("mesh"
 		, mesh_resource.c_str()
 		, opts
 		);
 
 	MeshRendererDesc mrd;
-	mrd.mesh_resource     = sjson::parse_resource_id(obj["mesh_resource"]);
-	mrd.geometry_name     = sjson::parse_string_id  (obj["geometry_name"]);
-	mrd.material_resource = sjson::parse_resource_id(obj["material"]);
-	mrd.visible           = sjson::parse_bool       (obj["visible"]);
+	mrd.mesh_resource     = sjson::parse_resource_id(jd, jd["mesh_resource"]);
+	mrd.geometry_name     = sjson::parse_string_id  (jd, jd["geometry_name"]);
+	mrd.material_resource = sjson::parse_resource_id(jd, jd["material"]);
+	mrd.visible           = sjson::parse_bool       (jd, jd["visible"]);
 	mrd._pad0[0]          = 0;
 	mrd._pad0[1]          = 0;
 	mrd._pad0[2]          = 0;
@@ -141,22 +145,22 @@ static Buffer compile_mesh_renderer(const char* json, CompileOptions& opts)
 static Buffer compile_sprite_renderer(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString sprite_resource(ta);
-	sjson::parse_string(obj["sprite_resource"], sprite_resource);
+	sjson::parse_string(jd, jd["sprite_resource"], sprite_resource);
 	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("sprite"
 		, sprite_resource.c_str()
 		, opts
 		);
 
 	SpriteRendererDesc srd;
-	srd.sprite_resource   = sjson::parse_resource_id(obj["sprite_resource"]);
-	srd.material_resource = sjson::parse_resource_id(obj["material"]);
-	srd.layer             = sjson::parse_int        (obj["layer"]);
-	srd.depth             = sjson::parse_int        (obj["depth"]);
-	srd.visible           = sjson::parse_bool       (obj["visible"]);
+	srd.sprite_resource   = sjson::parse_resource_id(jd, jd["sprite_resource"]);
+	srd.material_resource = sjson::parse_resource_id(jd, jd["material"]);
+	srd.layer             = sjson::parse_int        (jd, jd["layer"]);
+	srd.depth             = sjson::parse_int        (jd, jd["depth"]);
+	srd.visible           = sjson::parse_bool       (jd, jd["visible"]);
 	srd._pad0[0]          = 0;
 	srd._pad0[1]          = 0;
 	srd._pad0[2]          = 0;
@@ -173,11 +177,11 @@ static Buffer compile_sprite_renderer(const char* json, CompileOptions& opts)
 static Buffer compile_light(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString type(ta);
-	sjson::parse_string(obj["type"], type);
+	sjson::parse_string(jd, jd["type"], type);
 
 	LightType::Enum lt = light_name_to_enum(type.c_str());
 	DATA_COMPILER_ASSERT(lt != LightType::COUNT
@@ -188,31 +192,88 @@ static Buffer compile_light(const char* json, CompileOptions& opts)
 
 	LightDesc ld;
 	ld.type       = lt;
-	ld.range      = sjson::parse_float  (obj["range"]);
-	ld.intensity  = sjson::parse_float  (obj["intensity"]);
-	ld.spot_angle = sjson::parse_float  (obj["spot_angle"]);
-	ld.color      = sjson::parse_vector3(obj["color"]);
+	ld.range      = sjson::parse_float  (jd, jd["range"]);
+	ld.intensity  = sjson::parse_float  (jd, jd["intensity"]);
+	ld.spot_angle = sjson::parse_float  (jd, jd["spot_angle"]);
+	ld.color      = sjson::parse_vector3(jd, jd["color"]);
+	ld.cast_shadows = jd["cast_shadows"] != NULL ? sjson::parse_bool(jd, jd["cast_shadows"]) : false;
 
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&ld, sizeof(ld));
 	return buf;
 }
 
+static Buffer compile_particle_emitter(const char* json, CompileOptions& opts)
+{
+	TempAllocator4096 ta;
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
+
+	DynamicString particle_resource(ta);
+	sjson::parse_string(jd, jd["particle_resource"], particle_resource);
+	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("particle"
+		, particle_resource.c_str()
+		, opts
+		);
+
+	ParticleEmitterDesc ped;
+	ped.particle_resource = sjson::parse_resource_id(jd, jd["particle_resource"]);
+	ped.material_resource = sjson::parse_resource_id(jd, jd["material"]);
+	ped.playing           = jd["playing"] != NULL ? sjson::parse_bool(jd, jd["playing"]) : true;
+	ped._pad0[0]          = 0;
+	ped._pad0[1]          = 0;
+	ped._pad0[2]          = 0;
+	ped._pad0[3]          = 0;
+
+	Buffer buf(default_allocator());
+	array::push(buf, (char*)&ped, sizeof(ped));
+	return buf;
+}
+
+static Buffer compile_tilemap(const char* json, CompileOptions& opts)
+{
+	TempAllocator4096 ta;
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
+
+	DynamicString tilemap_resource(ta);
+	sjson::parse_string(jd, jd["tilemap_resource"], tilemap_resource);
+	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("tilemap"
+		, tilemap_resource.c_str()
+		, opts
+		);
+
+	TilemapDesc td;
+	td.tilemap_resource  = sjson::parse_resource_id(jd, jd["tilemap_resource"]);
+	td.material_resource = sjson::parse_resource_id(jd, jd["material"]);
+	td.layer             = sjson::parse_int        (jd, jd["layer"]);
+	td.depth             = sjson::parse_int        (jd, jd["depth"]);
+
+	DATA_COMPILER_ASSERT(td.layer < 8
+		, opts
+		, "Layer must be in [0, 7]"
+		);
+
+	Buffer buf(default_allocator());
+	array::push(buf, (char*)&td, sizeof(td));
+	return buf;
+}
+
 static Buffer compile_script(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString script_resource(ta);
-	sjson::parse_string(obj["script_resource"], script_resource);
+	sjson::parse_string(jd, jd["script_resource"], script_resource);
 	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("lua"
 		, script_resource.c_str()
 		, opts
 		);
 
 	ScriptDesc sd;
-	sd.script_resource = sjson::parse_resource_id(obj["script_resource"]);
+	sd.script_resource = sjson::parse_resource_id(jd, jd["script_resource"]);
 
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&sd, sizeof(sd));
@@ -222,59 +283,103 @@ static Buffer compile_script(const char* json, CompileOptions& opts)
 static Buffer compile_animation_state_machine(const char* json, CompileOptions& opts)
 {
 	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
 
 	DynamicString state_machine_resource(ta);
-	sjson::parse_string(obj["state_machine_resource"], state_machine_resource);
+	sjson::parse_string(jd, jd["state_machine_resource"], state_machine_resource);
 	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("state_machine"
 		, state_machine_resource.c_str()
 		, opts
 		);
 
 	AnimationStateMachineDesc asmd;
-	asmd.state_machine_resource = sjson::parse_resource_id(obj["state_machine_resource"]);
+	asmd.state_machine_resource = sjson::parse_resource_id(jd, jd["state_machine_resource"]);
 
 	Buffer buf(default_allocator());
 	array::push(buf, (char*)&asmd, sizeof(asmd));
 	return buf;
 }
 
+static Buffer compile_skeleton(const char* json, CompileOptions& opts)
+{
+	TempAllocator4096 ta;
+	JsonDocument jd(ta);
+	sjson::parse(json, jd);
+
+	DynamicString skeleton_resource(ta);
+	sjson::parse_string(jd, jd["skeleton_resource"], skeleton_resource);
+	DATA_COMPILER_ASSERT_RESOURCE_EXISTS("skeleton"
+		, skeleton_resource.c_str()
+		, opts
+		);
+
+	SkeletonDesc sd;
+	sd.skeleton_resource  = sjson::parse_resource_id(jd, jd["skeleton_resource"]);
+	sd.animation_resource = StringId64();
+
+	if (jd["animation_resource"] != NULL)
+	{
+		DynamicString animation_resource(ta);
+		sjson::parse_string(jd, jd["animation_resource"], animation_resource);
+		DATA_COMPILER_ASSERT_RESOURCE_EXISTS("skeleton_animation"
+			, animation_resource.c_str()
+			, opts
+			);
+		sd.animation_resource = sjson::parse_resource_id(jd, jd["animation_resource"]);
+	}
+
+	Buffer buf(default_allocator());
+	array::push(buf, (char*)&sd, sizeof(sd));
+	return buf;
+}
+
 UnitCompiler::UnitCompiler(CompileOptions& opts)
 	: _opts(opts)
 	, _num_units(0)
 	, _component_data(default_allocator())
 	, _component_info(default_allocator())
+	, _unit_data(default_allocator())
+	, _pending(default_allocator())
 {
 	register_component_compiler("transform",               &compile_transform,                             0.0f);
 	register_component_compiler("camera",                  &compile_camera,                                1.0f);
 	register_component_compiler("mesh_renderer",           &compile_mesh_renderer,                         1.0f);
 	register_component_compiler("sprite_renderer",         &compile_sprite_renderer,                       1.0f);
 	register_component_compiler("light",                   &compile_light,                                 1.0f);
+	register_component_compiler("particle_emitter",        &compile_particle_emitter,                      1.0f);
+	register_component_compiler("tilemap",                 &compile_tilemap,                               1.0f);
 	register_component_compiler("script",                  &compile_script,                                1.0f);
 	register_component_compiler("collider",                &physics_resource_internal::compile_collider,   1.0f);
 	register_component_compiler("actor",                   &physics_resource_internal::compile_actor,      2.0f);
 	register_component_compiler("joint",                   &physics_resource_internal::compile_joint,      3.0f);
 	register_component_compiler("animation_state_machine", &compile_animation_state_machine,               1.0f);
+	register_component_compiler("skeleton",                &compile_skeleton,                              1.0f);
+}
+
+UnitCompiler::~UnitCompiler()
+{
+	for (u32 i = 0; i < array::size(_unit_data); ++i)
+		CE_DELETE(default_allocator(), _unit_data[i]);
 }
 
-Buffer UnitCompiler::read_unit(const char* path)
+Buffer* UnitCompiler::read_unit(const char* path)
 {
-	Buffer buf = _opts.read(path);
-	array::push_back(buf, '\0');
+	// Components are compiled later on, keep the data alive until then
+	Buffer* buf = CE_NEW(default_allocator(), Buffer)(_opts.read(path));
+	array::push_back(*buf, '\0');
+	array::push_back(_unit_data, buf);
 	return buf;
 }
 
 void UnitCompiler::compile_unit(const char* path)
 {
-	compile_unit_from_json(array::begin(read_unit(path)));
+	compile_unit_from_json(array::begin(*read_unit(path)));
+	flush();
 }
 
-void UnitCompiler::compile_unit_from_json(const char* json)
+void UnitCompiler::parse_components(const char* json, JsonObject& components)
 {
-	Buffer data(default_allocator());
-	array::reserve(data, 1024*1024);
-
 	u32 num_prefabs = 1;
 
 	TempAllocator4096 ta;
@@ -297,15 +402,12 @@ void UnitCompiler::compile_unit_from_json(const char* json)
 			);
 		path += ".unit";
 
-		Buffer buf = read_unit(path.c_str());
-		const char* d = array::end(data);
-		array::push(data, array::begin(buf), array::size(buf));
-		sjson::parse(d, prefabs[i + 1]);
+		Buffer* buf = read_unit(path.c_str());
+		sjson::parse(array::begin(*buf), prefabs[i + 1]);
 	}
 
 	JsonObject& prefab_root = prefabs[num_prefabs - 1];
-	JsonObject prefab_root_components(ta);
-	sjson::parse(prefab_root["components"], prefab_root_components);
+	sjson::parse(prefab_root["components"], components);
 
 	if (num_prefabs > 1)
 	{
@@ -329,11 +431,18 @@ void UnitCompiler::compile_unit_from_json(const char* json)
 				const char* value = cur->pair.second;
 
 				// FIXME
-				map::remove(prefab_root_components._map, id);
-				map::set(prefab_root_components._map, id, value);
+				map::remove(components._map, id);
+				map::set(components._map, id, value);
 			}
 		}
 	}
+}
+
+void UnitCompiler::compile_unit_from_json(const char* json)
+{
+	TempAllocator4096 ta;
+	JsonObject prefab_root_components(ta);
+	parse_components(json, prefab_root_components);
 
 	if (json_object::size(prefab_root_components) > 0)
 	{
@@ -348,9 +457,13 @@ void UnitCompiler::compile_unit_from_json(const char* json)
 			sjson::parse(value, component);
 
 			const StringId32 type = sjson::parse_string_id(component["type"]);
+			DATA_COMPILER_ASSERT(sort_map::has(_component_data, type), _opts, "Unknown component");
 
-			Buffer buf = compile_component(type, component["data"]);
-			add_component_data(type, buf, _num_units);
+			PendingComponent pc;
+			pc._type = type;
+			pc._data = component["data"];
+			pc._unit_index = _num_units;
+			array::push_back(_pending, pc);
 		}
 	}
 
@@ -359,18 +472,149 @@ void UnitCompiler::compile_unit_from_json(const char* json)
 
 void UnitCompiler::compile_multiple_units(const char* json)
 {
-	TempAllocator4096 ta;
-	JsonObject obj(ta);
-	sjson::parse(json, obj);
+	TempAllocator512 ta;
+	DynamicString key(ta);
+	const char* value;
+
+	while ((json = sjson::parse_object_member(json, key, value)) != NULL)
+	{
+		compile_unit_from_json(value);
 
-	auto cur = json_object::begin(obj);
-	auto end = json_object::end(obj);
+		if (_num_units % CROWN_UNIT_COMPILER_CHUNK_SIZE == 0)
+			flush();
+	}
+
+	flush();
+}
+
+void UnitCompiler::compile_multiple_units(const char* const* units, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		compile_unit_from_json(units[i]);
+
+		if (_num_units % CROWN_UNIT_COMPILER_CHUNK_SIZE == 0)
+			flush();
+	}
+
+	flush();
+}
+
+void UnitCompiler::compile_pending_components(StringId32 type)
+{
+	for (u32 i = 0; i < array::size(_pending); ++i)
+	{
+		const PendingComponent& pc = _pending[i];
+		if (pc._type != type)
+			continue;
+
+		Buffer buf = compile_component(type, pc._data);
+		add_component_data(type, buf, pc._unit_index);
+	}
+}
+
+struct FlushJobs
+{
+	UnitCompiler* unit_compiler;
+	Mutex mutex;
+	u32 next;
+	bool failed;
+};
+
+static void flush_job(void* user_data)
+{
+	FlushJobs& fj = *(FlushJobs*)user_data;
+	const UnitCompiler::ComponentTypeArray& info = fj.unit_compiler->_component_info;
+
+	while (true)
+	{
+		u32 i;
+		{
+			ScopedMutex sm(fj.mutex);
+			if (fj.next == array::size(info))
+				break;
+			i = fj.next++;
+		}
+
+		fj.unit_compiler->compile_pending_components(info[i]._type);
+	}
+}
+
+static s32 flush_thread(void* user_data)
+{
+	FlushJobs& fj = *(FlushJobs*)user_data;
+
+	if (!fj.unit_compiler->_opts.run_guarded(flush_job, &fj))
+	{
+		ScopedMutex sm(fj.mutex);
+		fj.failed = true;
+	}
+
+	return 0;
+}
+
+void UnitCompiler::flush()
+{
+	if (array::size(_pending) == 0)
+		return;
+
+	// Each component type is compiled by a single thread, so that the data
+	// of each type is appended in the order it has been read.
+	FlushJobs fj;
+	fj.unit_compiler = this;
+	fj.next = 0;
+	fj.failed = false;
+
+	u32 num_threads = _opts.num_threads();
+	num_threads = num_threads < array::size(_component_info) ? num_threads : array::size(_component_info);
+	num_threads = num_threads < CROWN_MAX_COMPILER_THREADS ? num_threads : CROWN_MAX_COMPILER_THREADS;
+
+	// The calling thread takes part in the compilation too
+	Thread threads[CROWN_MAX_COMPILER_THREADS];
+	for (u32 i = 1; i < num_threads; ++i)
+		threads[i].start(flush_thread, &fj);
+
+	flush_thread(&fj);
+
+	for (u32 i = 1; i < num_threads; ++i)
+		threads[i].stop();
+
+	DATA_COMPILER_ASSERT(!fj.failed, _opts, "Failed to compile components");
+
+	array::clear(_pending);
+	for (u32 i = 0; i < array::size(_unit_data); ++i)
+		CE_DELETE(default_allocator(), _unit_data[i]);
+	array::clear(_unit_data);
+}
+
+u32 UnitCompiler::component_data_size(const ComponentTypeData& ctd)
+{
+	u32 size = array::size(ctd._data) + sizeof(u32)*array::size(ctd._unit_index);
+	const u32 pad = size % alignof(ComponentData);
+	return size + pad;
+}
+
+u32 UnitCompiler::blob_size()
+{
+	flush();
+
+	u32 size = sizeof(UnitResource);
+
+	auto cur = sort_map::begin(_component_data);
+	auto end = sort_map::end(_component_data);
 	for (; cur != end; ++cur)
-		compile_unit_from_json(cur->pair.second);
+	{
+		if (cur->second._num > 0)
+			size += sizeof(ComponentData) + component_data_size(cur->second);
+	}
+
+	return size;
 }
 
-Buffer UnitCompiler::blob()
+void UnitCompiler::write_blob()
 {
+	flush();
+
 	UnitResource ur;
 	ur.version = RESOURCE_VERSION_UNIT;
 	ur.num_units = _num_units;
@@ -386,13 +630,12 @@ Buffer UnitCompiler::blob()
 			++ur.num_component_types;
 	}
 
-	Buffer buf(default_allocator());
-	array::push(buf, (char*)&ur, sizeof(ur));
+	_opts.write(&ur, sizeof(ur));
 
 	for (u32 i = 0; i < array::size(_component_info); ++i)
 	{
-		const StringId32 type        = _component_info[i]._type;
-		const ComponentTypeData& ctd = sort_map::get(_component_data, type, ComponentTypeData(default_allocator()));
+		const StringId32 type  = _component_info[i]._type;
+		ComponentTypeData& ctd = const_cast<ComponentTypeData&>(sort_map::get(_component_data, type, ComponentTypeData(default_allocator())));
 
 		const Buffer& data           = ctd._data;
 		const Array<u32>& unit_index = ctd._unit_index;
@@ -403,22 +646,23 @@ Buffer UnitCompiler::blob()
 			ComponentData cd;
 			cd.type = type;
 			cd.num_instances = num;
-			cd.size = array::size(data) + sizeof(u32)*array::size(unit_index);
+			cd.size = component_data_size(ctd);
 
-			const u32 pad = cd.size % alignof(cd);
-			cd.size += pad;
+			const u32 pad = cd.size - array::size(data) - sizeof(u32)*array::size(unit_index);
 
-			array::push(buf, (char*)&cd, sizeof(cd));
-			array::push(buf, (char*)array::begin(unit_index), sizeof(u32)*array::size(unit_index));
-			array::push(buf, array::begin(data), array::size(data));
+			_opts.write(&cd, sizeof(cd));
+			_opts.write(array::begin(unit_index), sizeof(u32)*array::size(unit_index));
+			_opts.write(array::begin(data), array::size(data));
 
 			// Insert proper padding
 			for (u32 i = 0; i < pad; ++i)
-				array::push_back(buf, (char)0);
+				_opts.write((char)0);
+
+			// Data is not needed anymore
+			array::set_capacity(ctd._data, 0);
+			array::set_capacity(ctd._unit_index, 0);
 		}
 	}
-
-	return buf;
 }
 
 void UnitCompiler::add_component_data(StringId32 type, const Buffer& data, u32 unit_index)
@@ -445,7 +689,6 @@ void UnitCompiler::register_component_compiler(StringId32 type, CompileFunction
 	cti._spawn_order = spawn_order;
 
 	sort_map::set(_component_data, type, ctd);
-	sort_map::sort(_component_data);
 
 	array::push_back(_component_info, cti);
 	std::sort(array::begin(_component_info), array::end(_component_info));
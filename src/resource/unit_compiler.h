@@ -45,6 +45,13 @@ struct UnitCompiler
 		}
 	};
 
+	struct PendingComponent
+	{
+		StringId32 _type;
+		const char* _data;
+		u32 _unit_index;
+	};
+
 	typedef SortMap<StringId32, ComponentTypeData> ComponentTypeMap;
 	typedef Array<ComponentTypeInfo> ComponentTypeArray;
 
@@ -52,21 +59,50 @@ struct UnitCompiler
 	u32 _num_units;
 	ComponentTypeMap _component_data;
 	ComponentTypeArray _component_info;
+	Array<Buffer*> _unit_data;
+	Array<PendingComponent> _pending;
 
 	void register_component_compiler(const char* type, CompileFunction fn, f32 spawn_order);
 	void register_component_compiler(StringId32 type, CompileFunction fn, f32 spawn_order);
 	Buffer compile_component(StringId32 type, const char* json);
 	void add_component_data(StringId32 type, const Buffer& data, u32 unit_index);
+	void compile_pending_components(StringId32 type);
+	u32 component_data_size(const ComponentTypeData& ctd);
 
 	///
 	UnitCompiler(CompileOptions& opts);
 
-	Buffer read_unit(const char* name);
+	///
+	~UnitCompiler();
+
+	Buffer* read_unit(const char* name);
+
+	/// Resolves the prefabs of the unit @a json and writes its final
+	/// components to @a components. The components reference data which is
+	/// freed by the next flush().
+	void parse_components(const char* json, JsonObject& components);
+
 	void compile_unit(const char* path);
 	void compile_unit_from_json(const char* json);
+
+	/// Compiles the units in the SJSON object @a json. Units are read
+	/// CROWN_UNIT_COMPILER_CHUNK_SIZE at a time, and the components of
+	/// each chunk are compiled in parallel, one component type per thread.
 	void compile_multiple_units(const char* json);
 
-	Buffer blob();
+	/// Compiles the @a num units in the SJSON objects @a units, in order.
+	/// See compile_multiple_units().
+	void compile_multiple_units(const char* const* units, u32 num);
+
+	/// Compiles the components of the units read so far.
+	void flush();
+
+	/// Returns the size of the blob written by write_blob().
+	u32 blob_size();
+
+	/// Writes the unit resource to the output and frees the compiled
+	/// component data as it goes.
+	void write_blob();
 };
 
 } // namespace crown
@@ -8,8 +8,12 @@
 #include "core/filesystem/file.h"
 #include "core/filesystem/filesystem.h"
 #include "core/memory/allocator.h"
+#include "device/device.h"
+#include "resource/resource_manager.h"
 #include "resource/types.h"
 #include "resource/unit_compiler.h"
+#include "resource/unit_resource.h"
+#include "world/unit_template.h"
 
 namespace crown
 {
@@ -17,12 +21,21 @@ namespace unit_resource_internal
 {
 	void compile(CompileOptions& opts)
 	{
-		Buffer unit_data(default_allocator());
-
 		UnitCompiler uc(opts);
 		uc.compile_unit(opts.source_path());
+		uc.write_blob();
+	}
+
+	void online(StringId64 id, ResourceManager& rm)
+	{
+		const UnitResource* ur = (const UnitResource*)rm.get(RESOURCE_TYPE_UNIT, id);
+		device()->_unit_template_manager->create(ur);
+	}
 
-		opts.write(uc.blob());
+	void offline(StringId64 id, ResourceManager& rm)
+	{
+		const UnitResource* ur = (const UnitResource*)rm.get(RESOURCE_TYPE_UNIT, id);
+		device()->_unit_template_manager->destroy(ur);
 	}
 
 } // namespace unit_resource_internal
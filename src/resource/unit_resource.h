@@ -32,6 +32,12 @@ namespace unit_resource_internal
 {
 	void compile(CompileOptions& opts);
 
+	///
+	void online(StringId64 id, ResourceManager& rm);
+
+	///
+	void offline(StringId64 id, ResourceManager& rm);
+
 } // namespace unit_resource_internal
 
 } // namespace crown
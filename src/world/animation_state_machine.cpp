@@ -3,30 +3,41 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/containers/types.h"
+#include "core/memory/memory.h"
+#include "core/memory/temp_allocator.h"
+#include "core/thread/job_system.h"
 #include "resource/expression_language.h"
 #include "resource/resource_manager.h"
 #include "resource/sprite_resource.h"
 #include "resource/state_machine_resource.h"
 #include "world/animation_state_machine.h"
+#include "world/snapshot.h"
 #include "world/types.h"
 #include "world/unit_manager.h"
+#include <algorithm> // std::sort
+#include <stdint.h> // uintptr_t
+#include <string.h> // memcpy, memmove
 
 namespace crown
 {
-static void unit_destroyed_callback_bridge(UnitId id, void* user_ptr)
+static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
 {
-	((AnimationStateMachine*)user_ptr)->unit_destroyed_callback(id);
+	for (u32 i = 0; i < num; ++i)
+		((AnimationStateMachine*)user_ptr)->unit_destroyed_callback(units[i]);
 }
 
 AnimationStateMachine::AnimationStateMachine(Allocator& a, ResourceManager& rm, UnitManager& um)
 	: _marker(ANIMATION_STATE_MACHINE_MARKER)
+	, _allocator(&a)
 	, _resource_manager(&rm)
 	, _unit_manager(&um)
 	, _map(a)
-	, _animations(a)
+	, _state_offsets(a)
+	, _state_resources(a)
 	, _events(a)
 {
 	um.register_destroy_function(unit_destroyed_callback_bridge, this);
@@ -35,31 +46,153 @@ AnimationStateMachine::AnimationStateMachine(Allocator& a, ResourceManager& rm,
 AnimationStateMachine::~AnimationStateMachine()
 {
 	_unit_manager->unregister_destroy_function(this);
+
+	for (u32 i = 0; i < _data.size; ++i)
+		default_allocator().deallocate(_data.variables[i]);
+	_allocator->deallocate(_data.buffer);
+
 	_marker = 0;
 }
 
+void AnimationStateMachine::allocate(u32 num)
+{
+	CE_ASSERT(num > _data.size, "num > _data.size");
+
+	const u32 bytes = 0
+		+ num*sizeof(UnitId) + alignof(UnitId)
+		+ num*sizeof(StateMachineResource*) + alignof(StateMachineResource*)
+		+ num*sizeof(State*) * 2 + alignof(State*)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(f32*) + alignof(f32*)
+		+ num*sizeof(SpriteAnimationResource*) + alignof(SpriteAnimationResource*)
+		+ num*sizeof(u32*) + alignof(u32*)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(f32) * 3 + alignof(f32)
+		+ num*sizeof(u8) + alignof(u8)
+		;
+
+	AnimationData new_data;
+	new_data.size = _data.size;
+	new_data.capacity = num;
+	new_data.buffer = _allocator->allocate(bytes);
+
+	new_data.unit          = (UnitId*                        )new_data.buffer;
+	new_data.state_machine = (const StateMachineResource**   )memory::align_top(new_data.unit + num,          alignof(StateMachineResource*  ));
+	new_data.state         = (const State**                  )memory::align_top(new_data.state_machine + num, alignof(State*                 ));
+	new_data.state_next    = new_data.state + num;
+	new_data.state_offset  = (u32*                           )memory::align_top(new_data.state_next + num,    alignof(u32                    ));
+	new_data.variables     = (f32**                          )memory::align_top(new_data.state_offset + num,  alignof(f32*                   ));
+	new_data.resource      = (const SpriteAnimationResource**)memory::align_top(new_data.variables + num,     alignof(SpriteAnimationResource*));
+	new_data.frames        = (const u32**                    )memory::align_top(new_data.resource + num,      alignof(u32*                   ));
+	new_data.num_frames    = (u32*                           )memory::align_top(new_data.frames + num,        alignof(u32                    ));
+	new_data.time          = (f32*                           )memory::align_top(new_data.num_frames + num,    alignof(f32                    ));
+	new_data.time_total    = new_data.time + num;
+	new_data.speed         = new_data.time_total + num;
+	new_data.dirty         = (u8*                            )memory::align_top(new_data.speed + num,         alignof(u8                     ));
+
+	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
+	memcpy(new_data.state_machine, _data.state_machine, _data.size * sizeof(StateMachineResource*));
+	memcpy(new_data.state, _data.state, _data.size * sizeof(State*));
+	memcpy(new_data.state_next, _data.state_next, _data.size * sizeof(State*));
+	memcpy(new_data.state_offset, _data.state_offset, _data.size * sizeof(u32));
+	memcpy(new_data.variables, _data.variables, _data.size * sizeof(f32*));
+	memcpy(new_data.resource, _data.resource, _data.size * sizeof(SpriteAnimationResource*));
+	memcpy(new_data.frames, _data.frames, _data.size * sizeof(u32*));
+	memcpy(new_data.num_frames, _data.num_frames, _data.size * sizeof(u32));
+	memcpy(new_data.time, _data.time, _data.size * sizeof(f32));
+	memcpy(new_data.time_total, _data.time_total, _data.size * sizeof(f32));
+	memcpy(new_data.speed, _data.speed, _data.size * sizeof(f32));
+	memcpy(new_data.dirty, _data.dirty, _data.size * sizeof(u8));
+
+	_allocator->deallocate(_data.buffer);
+	_data = new_data;
+}
+
+void AnimationStateMachine::grow()
+{
+	allocate(_data.capacity * 2 + 1);
+}
+
+// Resolves the resources of the animations of all the states reachable
+// from the initial state of @a smr, so that update() never has to look
+// them up.
+void AnimationStateMachine::cache_resources(const StateMachineResource* smr)
+{
+	const State* initial = state_machine::initial_state(smr);
+	if (hash_map::has(_state_offsets, (u64)(uintptr_t)initial))
+		return;
+
+	TempAllocator512 ta;
+	Array<const State*> stack(ta);
+	array::push_back(stack, initial);
+	hash_map::set(_state_offsets, (u64)(uintptr_t)initial, UINT32_MAX);
+
+	while (array::size(stack) > 0)
+	{
+		const State* s = array::back(stack);
+		array::pop_back(stack);
+
+		const AnimationArray* aa = state_machine::state_animations(s);
+		hash_map::set(_state_offsets, (u64)(uintptr_t)s, array::size(_state_resources));
+
+		for (u32 i = 0; i < aa->num; ++i)
+		{
+			const crown::Animation* animation = state_machine::animation(aa, i);
+			array::push_back(_state_resources, (const SpriteAnimationResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE_ANIMATION, animation->name));
+		}
+
+		const TransitionArray* tr = state_machine::state_transitions(s);
+		for (u32 i = 0; i < tr->num; ++i)
+		{
+			const State* next = state_machine::state(smr, state_machine::transition(tr, i));
+			if (hash_map::has(_state_offsets, (u64)(uintptr_t)next))
+				continue;
+
+			hash_map::set(_state_offsets, (u64)(uintptr_t)next, UINT32_MAX);
+			array::push_back(stack, next);
+		}
+	}
+}
+
+// Returns the offset into _state_resources of the animations of the state @a s.
+// Only reads the cache: it is safe to call from multiple threads.
+u32 AnimationStateMachine::state_offset(const State* s)
+{
+	const u32 offset = hash_map::get(_state_offsets, (u64)(uintptr_t)s, UINT32_MAX);
+	CE_ASSERT(offset != UINT32_MAX, "State not cached");
+	return offset;
+}
+
 u32 AnimationStateMachine::create(UnitId unit, const AnimationStateMachineDesc& desc)
 {
 	CE_ASSERT(!hash_map::has(_map, unit), "Unit already has this component");
 
 	const StateMachineResource* smr = (StateMachineResource*)_resource_manager->get(RESOURCE_TYPE_STATE_MACHINE, desc.state_machine_resource);
-
-	Animation anim;
-	anim.unit          = unit;
-	anim.time          = 0.0f;
-	anim.time_total    = 0.0f;
-	anim.num_frames    = 0;
-	anim.frames        = NULL;
-	anim.resource      = NULL;
-	anim.state         = state_machine::initial_state(smr);
-	anim.state_next    = NULL;
-	anim.state_machine = smr;
-	anim.variables     = (f32*)default_allocator().allocate(sizeof(*anim.variables)*smr->num_variables);
-
-	memcpy(anim.variables, state_machine::variables(smr), sizeof(*anim.variables)*smr->num_variables);
-
-	u32 last = array::size(_animations);
-	array::push_back(_animations, anim);
+	cache_resources(smr);
+
+	if (_data.size == _data.capacity)
+		grow();
+
+	const u32 last = _data.size;
+	const State* initial = state_machine::initial_state(smr);
+
+	_data.unit[last]            = unit;
+	_data.state_machine[last]   = smr;
+	_data.state[last]           = initial;
+	_data.state_next[last]      = NULL;
+	_data.state_offset[last]    = state_offset(initial);
+	_data.variables[last]       = (f32*)default_allocator().allocate(sizeof(f32)*smr->num_variables);
+	_data.resource[last]        = NULL;
+	_data.frames[last]          = NULL;
+	_data.num_frames[last]      = 0;
+	_data.time[last]            = 0.0f;
+	_data.time_total[last]      = 0.0f;
+	_data.speed[last]           = 1.0f;
+	_data.dirty[last]           = 1;
+
+	memcpy(_data.variables[last], state_machine::variables(smr), sizeof(f32)*smr->num_variables);
+
+	++_data.size;
 	hash_map::set(_map, unit, last);
 	return 0;
 }
@@ -67,13 +200,26 @@ u32 AnimationStateMachine::create(UnitId unit, const AnimationStateMachineDesc&
 void AnimationStateMachine::destroy(UnitId unit)
 {
 	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
-	const u32 last_i = array::size(_animations) - 1;
-	const UnitId last_u = _animations[last_i].unit;
-
-	default_allocator().deallocate(_animations[i].variables);
-	_animations[i] = _animations[last_i];
-
-	array::pop_back(_animations);
+	const u32 last_i = _data.size - 1;
+	const UnitId last_u = _data.unit[last_i];
+
+	default_allocator().deallocate(_data.variables[i]);
+
+	_data.unit[i]            = _data.unit[last_i];
+	_data.state_machine[i]   = _data.state_machine[last_i];
+	_data.state[i]           = _data.state[last_i];
+	_data.state_next[i]      = _data.state_next[last_i];
+	_data.state_offset[i]    = _data.state_offset[last_i];
+	_data.variables[i]       = _data.variables[last_i];
+	_data.resource[i]        = _data.resource[last_i];
+	_data.frames[i]          = _data.frames[last_i];
+	_data.num_frames[i]      = _data.num_frames[last_i];
+	_data.time[i]            = _data.time[last_i];
+	_data.time_total[i]      = _data.time_total[last_i];
+	_data.speed[i]           = _data.speed[last_i];
+	_data.dirty[i]           = _data.dirty[last_i];
+
+	--_data.size;
 	hash_map::set(_map, last_u, i);
 	hash_map::remove(_map, unit);
 }
@@ -91,7 +237,7 @@ bool AnimationStateMachine::has(UnitId unit)
 u32 AnimationStateMachine::variable_id(UnitId unit, StringId32 name)
 {
 	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
-	const u32 index = state_machine::variable_index(_animations[i].state_machine, name);
+	const u32 index = state_machine::variable_index(_data.state_machine[i], name);
 	return index;
 }
 
@@ -99,14 +245,15 @@ f32 AnimationStateMachine::variable(UnitId unit, u32 variable_id)
 {
 	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
 	CE_ENSURE(variable_id != UINT32_MAX);
-	return _animations[i].variables[variable_id];
+	return _data.variables[i][variable_id];
 }
 
 void AnimationStateMachine::set_variable(UnitId unit, u32 variable_id, f32 value)
 {
 	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
 	CE_ENSURE(variable_id != UINT32_MAX);
-	_animations[i].variables[variable_id] = value;
+	_data.variables[i][variable_id] = value;
+	_data.dirty[i] = 1;
 }
 
 void AnimationStateMachine::trigger(UnitId unit, StringId32 event)
@@ -114,8 +261,8 @@ void AnimationStateMachine::trigger(UnitId unit, StringId32 event)
 	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
 
 	const Transition* transition;
-	const State* s = state_machine::trigger(_animations[i].state_machine
-		, _animations[i].state
+	const State* s = state_machine::trigger(_data.state_machine[i]
+		, _data.state[i]
 		, event
 		, &transition
 		);
@@ -124,104 +271,388 @@ void AnimationStateMachine::trigger(UnitId unit, StringId32 event)
 		return;
 
 	if (transition->mode == TransitionMode::IMMEDIATE)
-		_animations[i].state = s;
+	{
+		_data.state[i] = s;
+		_data.state_offset[i] = state_offset(s);
+		_data.dirty[i] = 1;
+	}
 	else if (transition->mode == TransitionMode::WAIT_UNTIL_END)
-		_animations[i].state_next = s;
+	{
+		_data.state_next[i] = s;
+	}
 	else
+	{
 		CE_FATAL("Unknown transition mode");
+	}
 }
 
-void AnimationStateMachine::update(float dt)
+// Writes the values of the expression @a byte_code for the @a n instances
+// whose variables are in @a variables, laid out as expected by
+// run_batch(), to @a out. Writes @a default_value if the expression is empty.
+static void evaluate_batch(const u32* byte_code, const f32* variables, u32 stride, u32 n, f32 default_value, f32* out)
 {
-	f32 stack_data[32];
-	skinny::expression_language::Stack stack(stack_data, countof(stack_data));
+	// Most expressions are a plain variable or constant: skip the interpreter
+	const u32 bc = byte_code[0];
+	if (bc != skinny::expression_language::BC_END && byte_code[1] == skinny::expression_language::BC_END)
+	{
+		if (skinny::expression_language::bc_mask(bc) == skinny::expression_language::BC_PUSH_VAR)
+		{
+			memcpy(out, &variables[skinny::expression_language::id_mask(bc)*stride], n*sizeof(f32));
+			return;
+		}
+
+		if (skinny::expression_language::is_float(bc))
+		{
+			f32 value;
+			memcpy(&value, &bc, sizeof(value));
+			for (u32 i = 0; i < n; ++i)
+				out[i] = value;
+			return;
+		}
+	}
 
-	for (u32 i = 0; i < array::size(_animations); ++i)
+	if (!skinny::expression_language::run_batch(byte_code, variables, stride, n, out))
 	{
-		Animation& anim_i = _animations[i];
+		for (u32 i = 0; i < n; ++i)
+			out[i] = default_value;
+	}
+}
 
-		const f32* variables = anim_i.variables;
-		const u32* byte_code = state_machine::byte_code(anim_i.state_machine);
+struct StateLess
+{
+	const State** state;
 
-		// Evaluate animation weights
-		f32 max_v = 0.0f;
-		u32 max_i = UINT32_MAX;
-		StringId64 name;
+	bool operator()(u32 a, u32 b) const
+	{
+		const uintptr_t sa = (uintptr_t)state[a];
+		const uintptr_t sb = (uintptr_t)state[b];
+		return sa < sb || (sa == sb && a < b);
+	}
+};
 
-		const AnimationArray* aa = state_machine::state_animations(anim_i.state);
-		for (u32 i = 0; i < aa->num; ++i)
+// Evaluates weights and speed of the instances in [begin, end) that need
+// it and writes the animation each should play to @a sar[i - begin].
+// Instances in the same state run the same byte code, so they are grouped
+// by state and evaluated together with run_batch().
+void AnimationStateMachine::evaluate(u32 begin, u32 end, const SpriteAnimationResource** sar)
+{
+	Array<u32> eval(default_frame_allocator());
+	for (u32 i = begin; i < end; ++i)
+	{
+		if (_data.dirty[i] || !!_data.state[i]->time_dependent)
 		{
-			const crown::Animation* animation = state_machine::animation(aa, i);
+			const StateMachineResource* smr = _data.state_machine[i];
+			_data.variables[i][state_machine::time_variable(smr)] = _data.time[i];
+			array::push_back(eval, i);
+		}
+	}
+
+	if (array::size(eval) == 0)
+		return;
+
+	StateLess sl;
+	sl.state = _data.state;
+	std::sort(array::begin(eval), array::end(eval), sl);
+
+	Array<f32> variables(default_frame_allocator());
+	Array<f32> values(default_frame_allocator());
+	Array<f32> max_v(default_frame_allocator());
+	Array<u32> max_i(default_frame_allocator());
 
-			stack.size = 0;
-			skinny::expression_language::run(&byte_code[animation->bytecode_entry], variables, stack);
-			const f32 cur = stack.size > 0 ? stack_data[stack.size-1] : 0.0f;
-			if (cur > max_v || max_i == UINT32_MAX)
+	for (u32 first = 0; first < array::size(eval); )
+	{
+		const State* state = _data.state[eval[first]];
+		u32 last = first + 1;
+		while (last < array::size(eval) && _data.state[eval[last]] == state)
+			++last;
+
+		const u32* group = &eval[first];
+		const u32 n = last - first;
+		const u32 stride = (n + 3) & ~3u;
+		const StateMachineResource* smr = _data.state_machine[group[0]];
+		const u32* byte_code = state_machine::byte_code(smr);
+
+		// Transpose the variables of the group, zeroing the padding lanes
+		array::resize(variables, smr->num_variables * stride);
+		for (u32 v = 0; v < smr->num_variables; ++v)
+		{
+			f32* row = &variables[v * stride];
+			for (u32 j = 0; j < n; ++j)
+				row[j] = _data.variables[group[j]][v];
+			for (u32 j = n; j < stride; ++j)
+				row[j] = 0.0f;
+		}
+
+		array::resize(values, n);
+		array::resize(max_v, n);
+		array::resize(max_i, n);
+		for (u32 j = 0; j < n; ++j)
+		{
+			max_v[j] = 0.0f;
+			max_i[j] = UINT32_MAX;
+		}
+
+		// Evaluate animation weights
+		const AnimationArray* aa = state_machine::state_animations(state);
+		for (u32 k = 0; k < aa->num; ++k)
+		{
+			const crown::Animation* animation = state_machine::animation(aa, k);
+
+			evaluate_batch(&byte_code[animation->bytecode_entry], array::begin(variables), stride, n, 0.0f, array::begin(values));
+			for (u32 j = 0; j < n; ++j)
 			{
-				max_v = cur;
-				max_i = i;
-				name = animation->name;
+				if (values[j] > max_v[j] || max_i[j] == UINT32_MAX)
+				{
+					max_v[j] = values[j];
+					max_i[j] = k;
+				}
 			}
 		}
 
 		// Evaluate animation speed
-		stack.size = 0;
-		skinny::expression_language::run(&byte_code[anim_i.state->speed_bytecode], variables, stack);
-		const f32 speed = stack.size > 0 ? stack_data[stack.size-1] : 1.0f;
+		evaluate_batch(&byte_code[state->speed_bytecode], array::begin(variables), stride, n, 1.0f, array::begin(values));
+
+		for (u32 j = 0; j < n; ++j)
+		{
+			const u32 i = group[j];
+			_data.speed[i] = values[j];
+			_data.dirty[i] = 0;
+			sar[i - begin] = max_i[j] != UINT32_MAX ? _state_resources[_data.state_offset[i] + max_i[j]] : NULL;
+		}
+
+		first = last;
+	}
+}
+
+// Updates the animations [begin, end) and writes the frame changes to
+// @a units and @a frame_num. Returns the number of frame changes.
+u32 AnimationStateMachine::update(u32 begin, u32 end, f32 dt, UnitId* units, u32* frame_num)
+{
+	Array<const SpriteAnimationResource*> resources(default_frame_allocator());
+	array::resize(resources, end - begin);
+	for (u32 i = begin; i < end; ++i)
+		resources[i - begin] = _data.resource[i];
+
+	evaluate(begin, end, array::begin(resources));
+
+	u32 num_events = 0;
+
+	for (u32 i = begin; i < end; ++i)
+	{
+		const State* state = _data.state[i];
+		const SpriteAnimationResource* sar = resources[i - begin];
+
+		const f32 speed = _data.speed[i];
 
 		// Play animation
-		const SpriteAnimationResource* sar = (SpriteAnimationResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE_ANIMATION, name);
-		if (anim_i.resource != sar)
+		if (sar != NULL && _data.resource[i] != sar)
 		{
-			anim_i.time       = 0.0f;
-			anim_i.time_total = sar->total_time;
-			anim_i.num_frames = sar->num_frames;
-			anim_i.frames     = sprite_animation_resource::frames(sar);
-			anim_i.resource   = sar;
+			_data.time[i]       = 0.0f;
+			_data.time_total[i] = sar->total_time;
+			_data.num_frames[i] = sar->num_frames;
+			_data.frames[i]     = sprite_animation_resource::frames(sar);
+			_data.resource[i]   = sar;
 		}
 
-		if (!anim_i.resource)
+		if (!_data.resource[i])
 			continue;
 
-		const f32 frame_time  = f32(anim_i.num_frames) * (anim_i.time/anim_i.time_total);
-		const u32 frame_index = u32(frame_time) % anim_i.num_frames;
+		const f32 frame_time  = f32(_data.num_frames[i]) * (_data.time[i]/_data.time_total[i]);
+		const u32 frame_index = u32(frame_time) % _data.num_frames[i];
 
-		anim_i.time += dt*speed;
+		_data.time[i] += dt*speed;
 
 		// If animation finished playing
-		if (anim_i.time > anim_i.time_total)
+		if (_data.time[i] > _data.time_total[i])
 		{
-			if (anim_i.state_next)
+			if (_data.state_next[i])
 			{
-				anim_i.state = anim_i.state_next;
-				anim_i.state_next = NULL;
-				anim_i.time = 0.0f;
+				_data.state[i] = _data.state_next[i];
+				_data.state_offset[i] = state_offset(_data.state[i]);
+				_data.state_next[i] = NULL;
+				_data.time[i] = 0.0f;
+				_data.dirty[i] = 1;
 			}
 			else
 			{
-				if (!!anim_i.state->loop)
+				if (!!state->loop)
 				{
-					anim_i.time = anim_i.time - anim_i.time_total;
+					_data.time[i] = _data.time[i] - _data.time_total[i];
 				}
 				else
 				{
 					const Transition* dummy;
-					const State* s = state_machine::trigger(anim_i.state_machine
-						, anim_i.state
-						, StringId32("animation_end")
+					const State* s = state_machine::trigger(_data.state_machine[i]
+						, state
+						, "animation_end"_id32
 						, &dummy
 						);
-					anim_i.time = anim_i.state != s ? 0.0f : anim_i.time_total;
-					anim_i.state = s;
+					_data.time[i] = state != s ? 0.0f : _data.time_total[i];
+					_data.state[i] = s;
+					_data.state_offset[i] = state_offset(s);
+					_data.dirty[i] = state != s;
 				}
 			}
 		}
 
 		// Emit events
-		SpriteFrameChangeEvent ev;
-		ev.unit      = anim_i.unit;
-		ev.frame_num = anim_i.frames[frame_index];
-		event_stream::write(_events, 0, ev);
+		units[num_events] = _data.unit[i];
+		frame_num[num_events] = _data.frames[i][frame_index];
+		++num_events;
+	}
+
+	return num_events;
+}
+
+struct AnimationUpdateJob
+{
+	AnimationStateMachine* machine;
+	f32 dt;
+	u32 grain_size;
+	u32 first_event;
+	u32* num_events;
+};
+
+static void animation_update_job(u32 begin, u32 end, void* user_data)
+{
+	AnimationUpdateJob& job = *(AnimationUpdateJob*)user_data;
+	SpriteFrameChangeEvents& ev = job.machine->_events;
+
+	// Each chunk writes its events to the slots of its own animations
+	job.num_events[begin / job.grain_size] = job.machine->update(begin
+		, end
+		, job.dt
+		, array::begin(ev.unit) + job.first_event + begin
+		, array::begin(ev.frame_num) + job.first_event + begin
+		);
+}
+
+void AnimationStateMachine::update(float dt)
+{
+	const u32 num = _data.size;
+	const u32 first_event = array::size(_events.unit);
+
+	// At most one frame change per animation
+	array::resize(_events.unit, first_event + num);
+	array::resize(_events.frame_num, first_event + num);
+
+	if (num < CROWN_ANIMATION_PARALLEL_THRESHOLD || job_system::num_threads() == 1)
+	{
+		const u32 n = update(0
+			, num
+			, dt
+			, array::begin(_events.unit) + first_event
+			, array::begin(_events.frame_num) + first_event
+			);
+		array::resize(_events.unit, first_event + n);
+		array::resize(_events.frame_num, first_event + n);
+		return;
+	}
+
+	const u32 num_chunks = job_system::num_threads() * 4;
+	const u32 grain_size = (num + num_chunks - 1) / num_chunks;
+
+	TempAllocator1024 ta;
+	Array<u32> num_events(ta);
+	array::resize(num_events, num_chunks);
+	memset(array::begin(num_events), 0, num_chunks*sizeof(u32));
+
+	AnimationUpdateJob job;
+	job.machine     = this;
+	job.dt          = dt;
+	job.grain_size  = grain_size;
+	job.first_event = first_event;
+	job.num_events  = array::begin(num_events);
+	job_system::parallel_for(0, num, grain_size, animation_update_job, &job);
+
+	// Merge the events of the chunks, preserving the order of the animations
+	u32 size = first_event;
+	for (u32 c = 0; c < num_chunks; ++c)
+	{
+		const u32 src = first_event + c*grain_size;
+		const u32 n = num_events[c];
+		if (n == 0)
+			continue;
+
+		memmove(array::begin(_events.unit) + size, array::begin(_events.unit) + src, n*sizeof(UnitId));
+		memmove(array::begin(_events.frame_num) + size, array::begin(_events.frame_num) + src, n*sizeof(u32));
+		size += n;
+	}
+
+	array::resize(_events.unit, size);
+	array::resize(_events.frame_num, size);
+}
+
+void AnimationStateMachine::snapshot(Buffer& buf)
+{
+	const u32 num = _data.size;
+	snapshot::write(buf, num);
+	snapshot::write(buf, _data.unit, num*sizeof(UnitId));
+	snapshot::write(buf, _data.state_machine, num*sizeof(StateMachineResource*));
+	snapshot::write(buf, _data.state, num*sizeof(State*));
+	snapshot::write(buf, _data.state_next, num*sizeof(State*));
+	snapshot::write(buf, _data.state_offset, num*sizeof(u32));
+	snapshot::write(buf, _data.resource, num*sizeof(SpriteAnimationResource*));
+	snapshot::write(buf, _data.frames, num*sizeof(u32*));
+	snapshot::write(buf, _data.num_frames, num*sizeof(u32));
+	snapshot::write(buf, _data.time, num*sizeof(f32));
+	snapshot::write(buf, _data.time_total, num*sizeof(f32));
+	snapshot::write(buf, _data.speed, num*sizeof(f32));
+	snapshot::write(buf, _data.dirty, num*sizeof(u8));
+
+	for (u32 i = 0; i < num; ++i)
+		snapshot::write(buf, _data.variables[i], _data.state_machine[i]->num_variables*sizeof(f32));
+}
+
+bool AnimationStateMachine::can_restore(const char* data)
+{
+	u32 num;
+	snapshot::read(data, num);
+	if (num != _data.size)
+		return false;
+
+	const char* smr = data + num*sizeof(UnitId);
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 j = hash_map::get(_map, snapshot::element<UnitId>(data, i), UINT32_MAX);
+		if (j == UINT32_MAX || _data.state_machine[j] != snapshot::element<const StateMachineResource*>(smr, i))
+			return false;
+	}
+
+	return true;
+}
+
+void AnimationStateMachine::restore(const char* data)
+{
+	u32 num;
+	snapshot::read(data, num);
+	CE_ASSERT(num == _data.size, "Instances do not match");
+
+	// Reorder the variables of the instances as in the snapshot
+	TempAllocator1024 ta;
+	Array<f32*> variables(ta);
+	array::resize(variables, num);
+	for (u32 i = 0; i < num; ++i)
+		variables[i] = _data.variables[hash_map::get(_map, snapshot::element<UnitId>(data, i), UINT32_MAX)];
+	memcpy(_data.variables, array::begin(variables), num*sizeof(f32*));
+
+	snapshot::read(data, _data.unit, num*sizeof(UnitId));
+	snapshot::read(data, _data.state_machine, num*sizeof(StateMachineResource*));
+	snapshot::read(data, _data.state, num*sizeof(State*));
+	snapshot::read(data, _data.state_next, num*sizeof(State*));
+	snapshot::read(data, _data.state_offset, num*sizeof(u32));
+	snapshot::read(data, _data.resource, num*sizeof(SpriteAnimationResource*));
+	snapshot::read(data, _data.frames, num*sizeof(u32*));
+	snapshot::read(data, _data.num_frames, num*sizeof(u32));
+	snapshot::read(data, _data.time, num*sizeof(f32));
+	snapshot::read(data, _data.time_total, num*sizeof(f32));
+	snapshot::read(data, _data.speed, num*sizeof(f32));
+	snapshot::read(data, _data.dirty, num*sizeof(u8));
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		snapshot::read(data, _data.variables[i], _data.state_machine[i]->num_variables*sizeof(f32));
+		hash_map::set(_map, _data.unit[i], i);
 	}
 }
 
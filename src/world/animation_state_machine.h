@@ -5,7 +5,7 @@
 
 #pragma once
 
-#include "core/containers/event_stream.h"
+#include "core/containers/array.h"
 #include "core/containers/types.h"
 #include "resource/state_machine_resource.h"
 #include "resource/types.h"
@@ -13,34 +13,74 @@
 
 namespace crown
 {
-struct SpriteFrameChangeEvent
+/// Sprite frames selected by the last update, stored as parallel arrays
+/// so that they can be applied in bulk.
+/// The arrays are cleared but never shrunk, so their memory is reused
+/// from one frame to the next.
+struct SpriteFrameChangeEvents
 {
-	UnitId unit;
-	u32 frame_num;
+	Array<UnitId> unit;
+	Array<u32> frame_num;
+
+	SpriteFrameChangeEvents(Allocator& a)
+		: unit(a)
+		, frame_num(a)
+	{
+	}
 };
 
 struct AnimationStateMachine
 {
-	struct Animation
+	struct AnimationData
 	{
-		UnitId unit;
-		f32 time_total;
-		f32 time;
-		u32 num_frames;
-		const u32* frames;
-		const SpriteAnimationResource* resource;
-		const State* state;
-		const State* state_next;
-		const StateMachineResource* state_machine;
-		f32* variables;
+		AnimationData()
+			: size(0)
+			, capacity(0)
+			, buffer(NULL)
+			, unit(NULL)
+			, state_machine(NULL)
+			, state(NULL)
+			, state_next(NULL)
+			, state_offset(NULL)
+			, variables(NULL)
+			, resource(NULL)
+			, frames(NULL)
+			, num_frames(NULL)
+			, time(NULL)
+			, time_total(NULL)
+			, speed(NULL)
+			, dirty(NULL)
+		{
+		}
+
+		u32 size;
+		u32 capacity;
+		void* buffer;
+
+		UnitId* unit;
+		const StateMachineResource** state_machine;
+		const State** state;
+		const State** state_next;
+		u32* state_offset; ///< Offset into _state_resources of the animations of state.
+		f32** variables;
+		const SpriteAnimationResource** resource; ///< Animation being played.
+		const u32** frames;
+		u32* num_frames;
+		f32* time;
+		f32* time_total;
+		f32* speed;  ///< Speed computed by the last evaluation.
+		u8* dirty;   ///< Whether variables or state changed since the last evaluation.
 	};
 
 	u32 _marker;
+	Allocator* _allocator;
 	ResourceManager* _resource_manager;
 	UnitManager* _unit_manager;
 	HashMap<UnitId, u32> _map;
-	Array<Animation> _animations;
-	EventStream _events;
+	AnimationData _data;
+	HashMap<u64, u32> _state_offsets; ///< Offset into _state_resources of each state, by address.
+	Array<const SpriteAnimationResource*> _state_resources;
+	SpriteFrameChangeEvents _events;
 
 	///
 	AnimationStateMachine(Allocator& a, ResourceManager& rm, UnitManager& um);
@@ -72,11 +112,34 @@ struct AnimationStateMachine
 	///
 	void trigger(UnitId unit, StringId32 event);
 
-	///
+	/// Advances all the animations by @a dt and collects the resulting
+	/// sprite frames in _events. Weights and speed are only re-evaluated for
+	/// instances whose variables or state changed, or whose state reads the
+	/// time variable; the others just advance their time. Instances in the
+	/// same state are evaluated together, four at a time on SIMD lanes.
+	/// Instances are updated in parallel when there are more than
+	/// CROWN_ANIMATION_PARALLEL_THRESHOLD of them.
 	void update(float dt);
 
+	/// Appends the state of the instances to @a buf.
+	void snapshot(Buffer& buf);
+
+	/// Returns whether the state at @a data, written by snapshot(), has
+	/// instances for the same units as this.
+	bool can_restore(const char* data);
+
+	/// Restores the state at @a data, written by snapshot().
+	void restore(const char* data);
+
 	///
 	void unit_destroyed_callback(UnitId unit);
+
+	void allocate(u32 num);
+	void grow();
+	void cache_resources(const StateMachineResource* smr);
+	u32 state_offset(const State* s);
+	void evaluate(u32 begin, u32 end, const SpriteAnimationResource** sar);
+	u32 update(u32 begin, u32 end, f32 dt, UnitId* units, u32* frame_num);
 };
 
 } // namespace crown
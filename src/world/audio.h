@@ -5,6 +5,10 @@
 
 #pragma once
 
+#include "core/strings/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+
 namespace crown
 {
 /// Global audio-related functions
@@ -19,6 +23,20 @@ namespace audio_globals
 	/// It should reverse the actions performed by audio_globals::init().
 	void shutdown();
 
+	/// Uploads the samples of @a sr to a new audio buffer, shared by all
+	/// the sounds playing @a sr, and returns its index.
+	u32 create_buffer(const SoundResource& sr);
+
+	/// Destroys the audio buffer @a i as soon as no sound plays it anymore.
+	void destroy_buffer(u32 i);
+
+	/// Records the voices, the stream underruns, the time spent decoding
+	/// and in AL calls and the audio memory since the last call to the profiler.
+	void record_stats();
+
+	/// Writes the sounds playing in all the worlds to @a json.
+	void to_json(StringStream& json);
+
 } // namespace audio_globals
 
 } // namespace crown
@@ -3,12 +3,14 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
 #include "core/math/color4.h"
 #include "core/math/frustum.h"
 #include "core/math/intersection.h"
 #include "core/math/math.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/vector3.h"
+#include "core/memory/temp_allocator.h"
 #include "device/pipeline.h"
 #include "resource/mesh_resource.h"
 #include "resource/resource_manager.h"
@@ -20,34 +22,54 @@
 
 namespace crown
 {
-DebugLine::DebugLine(ShaderManager& sm, bool depth_test)
+DebugLine::DebugLine(Allocator& a, ShaderManager& sm, bool depth_test)
 	: _marker(DEBUG_LINE_MARKER)
 	, _shader_manager(&sm)
 	, _shader(depth_test ? "debug_line" : "debug_line_noz")
-	, _num(0)
+	, _lines(a)
+	, _timed_lines(a)
+	, _time_left(a)
+	, _duration(0.0f)
+	, _pose(MATRIX4X4_IDENTITY)
+	, _vertex_buffer_capacity(0)
+	, _num_uploaded(0)
+	, _dirty(false)
 {
 	_vertex_decl.begin()
 		.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
 		.add(bgfx::Attrib::Color0,   4, bgfx::AttribType::Uint8, true)
 		.end();
+
+	_vertex_buffer.idx = bgfx::kInvalidHandle;
 }
 
 DebugLine::~DebugLine()
 {
+	if (bgfx::isValid(_vertex_buffer))
+		bgfx::destroy(_vertex_buffer);
+
 	_marker = 0;
 }
 
 void DebugLine::add_line(const Vector3& start, const Vector3& end, const Color4& color)
 {
-	if (_num >= MAX_LINES)
-		 return;
+	Line line;
+	line.p0 = start;
+	line.c0 = to_abgr(color);
+	line.p1 = end;
+	line.c1 = to_abgr(color);
 
-	_lines[_num].p0 = start;
-	_lines[_num].c0 = to_abgr(color);
-	_lines[_num].p1 = end;
-	_lines[_num].c1 = to_abgr(color);
+	if (_duration > 0.0f)
+	{
+		array::push_back(_timed_lines, line);
+		array::push_back(_time_left, _duration);
+	}
+	else
+	{
+		array::push_back(_lines, line);
+	}
 
-	++_num;
+	_dirty = true;
 }
 
 void DebugLine::add_axes(const Matrix4x4& m, f32 length)
@@ -188,7 +210,8 @@ void DebugLine::add_obb(const Matrix4x4& tm, const Vector3& half_extents, const
 	add_line(o - x + y - z, o - x + y + z, color);
 }
 
-void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num, const Color4& color)
+template <typename IndexType>
+static void add_mesh_internal(DebugLine& dl, const Matrix4x4& tm, const void* vertices, u32 stride, const IndexType* indices, u32 num, const Color4& color)
 {
 	for (u32 i = 0; i < num; i += 3)
 	{
@@ -200,12 +223,22 @@ void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride,
 		const Vector3& v1 = *(const Vector3*)((const char*)vertices + i1*stride) * tm;
 		const Vector3& v2 = *(const Vector3*)((const char*)vertices + i2*stride) * tm;
 
-		add_line(v0, v1, color);
-		add_line(v1, v2, color);
-		add_line(v2, v0, color);
+		dl.add_line(v0, v1, color);
+		dl.add_line(v1, v2, color);
+		dl.add_line(v2, v0, color);
 	}
 }
 
+void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num, const Color4& color)
+{
+	add_mesh_internal(*this, tm, vertices, stride, indices, num, color);
+}
+
+void DebugLine::add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num, const Color4& color)
+{
+	add_mesh_internal(*this, tm, vertices, stride, indices, num, color);
+}
+
 void DebugLine::add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 name, const Color4& color)
 {
 	const UnitResource& ur = *(const UnitResource*)rm.get(RESOURCE_TYPE_UNIT, name);
@@ -226,13 +259,31 @@ void DebugLine::add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 na
 				const MeshResource* mr = (const MeshResource*)rm.get(RESOURCE_TYPE_MESH, mrd->mesh_resource);
 				const MeshGeometry* mg = mr->geometry(mrd->geometry_name);
 
-				add_mesh(tm
-					, mg->vertices.data
-					, mg->vertices.stride
-					, (u16*)mg->indices.data
-					, mg->indices.num
-					, color
-					);
+				TempAllocator4096 ta;
+				Array<Vector3> decoded(ta);
+				u32 stride;
+				const char* vertices = mesh_resource::positions(mg, decoded, stride);
+
+				if (mg->indices.stride == sizeof(u32))
+				{
+					add_mesh(tm
+						, vertices
+						, stride
+						, (u32*)mg->indices.data
+						, mg->indices.num
+						, color
+						);
+				}
+				else
+				{
+					add_mesh(tm
+						, vertices
+						, stride
+						, (u16*)mg->indices.data
+						, mg->indices.num
+						, color
+						);
+				}
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
@@ -253,25 +304,87 @@ void DebugLine::add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 na
 	}
 }
 
+void DebugLine::set_duration(f32 duration)
+{
+	_duration = duration;
+}
+
+void DebugLine::update(f32 dt)
+{
+	for (u32 i = 0; i < array::size(_timed_lines);)
+	{
+		_time_left[i] -= dt;
+		if (_time_left[i] > 0.0f)
+		{
+			++i;
+			continue;
+		}
+
+		// Order does not matter, swap with the last line
+		const u32 last = array::size(_timed_lines) - 1;
+		_timed_lines[i] = _timed_lines[last];
+		_time_left[i] = _time_left[last];
+		array::pop_back(_timed_lines);
+		array::pop_back(_time_left);
+		_dirty = true;
+	}
+}
+
+void DebugLine::set_pose(const Matrix4x4& pose)
+{
+	_pose = pose;
+}
+
 void DebugLine::reset()
 {
-	_num = 0;
+	if (array::size(_lines) == 0)
+		return;
+
+	array::clear(_lines);
+	_dirty = true;
 }
 
 void DebugLine::submit()
 {
-	if (!_num)
-		return;
+	submit(VIEW_DEBUG);
+}
 
-	if (!bgfx::getAvailTransientVertexBuffer(_num * 2, _vertex_decl))
-		return;
+void DebugLine::submit(u16 view)
+{
+	if (_dirty)
+	{
+		const u32 num_lines = array::size(_lines);
+		const u32 num_timed = array::size(_timed_lines);
+		const u32 num = num_lines + num_timed;
+
+		// Recreate the vertex buffer when the lines do not fit anymore
+		if (num > _vertex_buffer_capacity)
+		{
+			if (bgfx::isValid(_vertex_buffer))
+				bgfx::destroy(_vertex_buffer);
 
-	bgfx::TransientVertexBuffer tvb;
-	bgfx::allocTransientVertexBuffer(&tvb, _num * 2, _vertex_decl);
-	memcpy(tvb.data, _lines, sizeof(Line) * _num);
+			_vertex_buffer_capacity = num + num/2;
+			_vertex_buffer = bgfx::createDynamicVertexBuffer(_vertex_buffer_capacity*2, _vertex_decl);
+		}
+
+		if (num > 0)
+		{
+			const bgfx::Memory* mem = bgfx::alloc(num*sizeof(Line));
+			memcpy(mem->data, array::begin(_lines), num_lines*sizeof(Line));
+			memcpy(mem->data + num_lines*sizeof(Line), array::begin(_timed_lines), num_timed*sizeof(Line));
+			bgfx::update(_vertex_buffer, 0, mem);
+		}
+
+		_num_uploaded = num;
+		_dirty = false;
+	}
+
+	if (_num_uploaded == 0)
+		return;
 
-	bgfx::setVertexBuffer(0, &tvb, 0, _num * 2);
-	_shader_manager->submit(_shader, VIEW_DEBUG);
+	bgfx::setTransform(to_float_ptr(_pose));
+	bgfx::setVertexBuffer(0, _vertex_buffer, 0, _num_uploaded*2);
+	_shader_manager->submit(_shader, view);
 }
 
 } // namespace crown
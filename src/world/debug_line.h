@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include "core/containers/types.h"
 #include "core/math/types.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
@@ -16,12 +17,15 @@ namespace crown
 {
 /// Draws lines.
 ///
+/// The lines are kept in a vertex buffer which is only uploaded again when
+/// they change, so lines added once and never reset are drawn every frame
+/// at no cost other than the draw call.
+///
 /// @ingroup World
 struct DebugLine
 {
 	/// Default number of segments.
 	static const u32 NUM_SEGMENTS = 36;
-	static const u32 MAX_LINES = 32768;
 
 	struct Line
 	{
@@ -36,11 +40,18 @@ struct DebugLine
 	StringId32 _shader;
 	bgfx::VertexDecl _vertex_decl;
 
-	u32 _num;
-	Line _lines[MAX_LINES];
+	Array<Line> _lines;
+	Array<Line> _timed_lines; ///< Lines with a duration, kept by reset().
+	Array<f32> _time_left;    ///< Seconds left to each timed line.
+	f32 _duration;
+	Matrix4x4 _pose;
+	bgfx::DynamicVertexBufferHandle _vertex_buffer;
+	u32 _vertex_buffer_capacity; ///< In lines.
+	u32 _num_uploaded;
+	bool _dirty; ///< Whether the lines have changed since they were uploaded.
 
 	/// Whether to enable @a depth_test
-	DebugLine(ShaderManager& sm, bool depth_test);
+	DebugLine(Allocator& a, ShaderManager& sm, bool depth_test);
 
 	///
 	~DebugLine();
@@ -73,14 +84,33 @@ struct DebugLine
 	/// Adds the mesh described by (vertices, stride, indices, num).
 	void add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u16* indices, u32 num, const Color4& color);
 
+	/// @copydoc DebugLine::add_mesh()
+	void add_mesh(const Matrix4x4& tm, const void* vertices, u32 stride, const u32* indices, u32 num, const Color4& color);
+
 	/// Adds the meshes from the unit @a name.
 	void add_unit(ResourceManager& rm, const Matrix4x4& tm, StringId64 name, const Color4& color);
 
-	/// Resets all the lines.
+	/// Sets the @a duration, in seconds, of the lines added from now on.
+	/// The lines with a duration are kept by reset() and removed by
+	/// update() once their duration has elapsed. A duration of 0, the
+	/// default, keeps the lines until the next reset().
+	void set_duration(f32 duration);
+
+	/// Advances the time of the lines with a duration by @a dt seconds and
+	/// removes those whose duration has elapsed.
+	void update(f32 dt);
+
+	/// Sets the @a pose the lines are transformed by when drawn.
+	void set_pose(const Matrix4x4& pose);
+
+	/// Resets all the lines without a duration.
 	void reset();
 
 	/// Submits the lines to renderer for drawing.
 	void submit();
+
+	/// Submits the lines to renderer for drawing into @a view.
+	void submit(u16 view);
 };
 
 } // namespace crown
@@ -3,22 +3,303 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/error/error.h"
 #include "core/math/color4.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/vector2.h"
 #include "core/math/vector3.h"
+#include "core/murmur.h"
 #include "core/strings/string.h"
 #include "core/strings/utf8.h"
 #include "resource/font_resource.h"
 #include "resource/material_resource.h"
+#include "device/pipeline.h"
 #include "resource/resource_manager.h"
 #include "world/gui.h"
+#include "world/material.h"
 #include "world/material_manager.h"
 #include "world/shader_manager.h"
 #include <bgfx/bgfx.h>
+#include <string.h> // memcmp
 
 namespace crown
 {
+GuiBuffer::GuiBuffer(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, bool retained)
+	: _resource_manager(&rm)
+	, _shader_manager(&sm)
+	, _material_manager(&mm)
+	, _num_vertices(0)
+	, _num_indices(0)
+	, _max_vertices(0)
+	, _max_indices(0)
+	, _batch_vertices(0)
+	, _batch_indices(0)
+	, _batch_world(MATRIX4X4_IDENTITY)
+	, _text_runs(a)
+	, _glyph_quads(a)
+	, _retained(retained)
+	, _vertex_data(a)
+	, _index_data(a)
+	, _batches(a)
+{
+}
+
+void* GuiBuffer::vertex_buffer_end()
+{
+	u8* data = _retained ? (u8*)array::begin(_vertex_data) : tvb.data;
+	return data + _num_vertices*_pos_tex_col.getStride();
+}
+
+void* GuiBuffer::index_buffer_end()
+{
+	u8* data = _retained ? (u8*)array::begin(_index_data) : tib.data;
+	return data + _num_indices*sizeof(u16);
+}
+
+void GuiBuffer::create()
+{
+	_pos_tex_col.begin()
+		.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, true)
+		.add(bgfx::Attrib::Color0,    4, bgfx::AttribType::Uint8, true)
+		.end()
+		;
+}
+
+void GuiBuffer::reset()
+{
+	flush();
+
+	_num_vertices = 0;
+	_num_indices = 0;
+	_batch_vertices = 0;
+	_batch_indices = 0;
+
+	_max_vertices = bgfx::getAvailTransientVertexBuffer(CROWN_GUI_MAX_VERTICES, _pos_tex_col);
+	_max_indices = bgfx::getAvailTransientIndexBuffer(CROWN_GUI_MAX_INDICES);
+	if (_max_vertices == 0 || _max_indices == 0)
+	{
+		_max_vertices = 0;
+		_max_indices = 0;
+	}
+	else
+	{
+		bgfx::allocTransientVertexBuffer(&tvb, _max_vertices, _pos_tex_col);
+		bgfx::allocTransientIndexBuffer(&tib, _max_indices);
+	}
+
+	// Drop the cached layouts when there are too many of them, e.g. because
+	// of texts changing every frame
+	if (array::size(_glyph_quads) > CROWN_GUI_TEXT_CACHE_SIZE)
+	{
+		hash_map::clear(_text_runs);
+		array::clear(_glyph_quads);
+	}
+}
+
+u32 GuiBuffer::begin(u32 num_vertices, u32 num_indices, const Matrix4x4& batch_world, StringId64 material)
+{
+	if (_num_vertices + num_vertices > _max_vertices || _num_indices + num_indices > _max_indices)
+		return UINT32_MAX;
+
+	if (_retained)
+	{
+		const u32 size = (_num_vertices + num_vertices)*_pos_tex_col.getStride();
+		array::reserve(_vertex_data, size);
+		array::resize(_vertex_data, size);
+		array::reserve(_index_data, _num_indices + num_indices);
+		array::resize(_index_data, _num_indices + num_indices);
+	}
+
+	// Retained batches are drawn with the transform of their layer
+	const Matrix4x4& world = _retained ? MATRIX4X4_IDENTITY : batch_world;
+
+	if (_num_vertices != _batch_vertices)
+	{
+		if (material != _batch_material
+			|| memcmp(&world, &_batch_world, sizeof(world)) != 0
+			|| _num_vertices - _batch_vertices + num_vertices > UINT16_MAX + 1
+			)
+			flush();
+	}
+
+	if (_num_vertices == _batch_vertices)
+	{
+		_batch_material = material;
+		_batch_world = world;
+	}
+
+	return _num_vertices - _batch_vertices;
+}
+
+void GuiBuffer::end(u32 num_vertices, u32 num_indices)
+{
+	_num_vertices += num_vertices;
+	_num_indices += num_indices;
+}
+
+void GuiBuffer::flush()
+{
+	if (_num_vertices == _batch_vertices)
+		return;
+
+	if (_retained)
+	{
+		Batch b;
+		b.first_vertex = _batch_vertices;
+		b.num_vertices = _num_vertices - _batch_vertices;
+		b.first_index  = _batch_indices;
+		b.num_indices  = _num_indices - _batch_indices;
+		b.material     = _batch_material;
+		array::push_back(_batches, b);
+	}
+	else
+	{
+		bgfx::setVertexBuffer(0, &tvb, _batch_vertices, _num_vertices - _batch_vertices);
+		bgfx::setIndexBuffer(&tib, _batch_indices, _num_indices - _batch_indices);
+		bgfx::setTransform(to_float_ptr(_batch_world));
+		submit(_batch_material);
+	}
+
+	_batch_vertices = _num_vertices;
+	_batch_indices = _num_indices;
+}
+
+void GuiBuffer::submit(StringId64 material)
+{
+	if (material == StringId64())
+		_shader_manager->submit("gui"_id32, VIEW_GUI);
+	else
+		_material_manager->get(material)->bind(*_resource_manager, *_shader_manager, VIEW_GUI);
+}
+
+void GuiBuffer::record()
+{
+	CE_ASSERT(_retained, "Buffer is not retained");
+	_num_vertices = 0;
+	_num_indices = 0;
+	_batch_vertices = 0;
+	_batch_indices = 0;
+	_max_vertices = CROWN_GUI_MAX_VERTICES;
+	_max_indices = CROWN_GUI_MAX_INDICES;
+	array::clear(_vertex_data);
+	array::clear(_index_data);
+	array::clear(_batches);
+
+	if (array::size(_glyph_quads) > CROWN_GUI_TEXT_CACHE_SIZE)
+	{
+		hash_map::clear(_text_runs);
+		array::clear(_glyph_quads);
+	}
+}
+
+void GuiBuffer::commit()
+{
+	CE_ASSERT(_retained, "Buffer is not retained");
+	flush();
+	_max_vertices = 0;
+	_max_indices = 0;
+}
+
+const GuiBuffer::TextRun& GuiBuffer::text_run(const char* str, StringId64 font, u32 font_size)
+{
+	const FontResource* fr = (FontResource*)_resource_manager->get(RESOURCE_TYPE_FONT, font);
+	const u32 len = strlen32(str);
+
+	// The resource address is part of the key so that reloaded fonts are
+	// laid out again
+	u64 seed = font._id ^ (u64)(uintptr_t)fr;
+	seed ^= (u64)font_size << 32;
+	const u64 key = murmur64(str, len, seed);
+
+	const TextRun deffault = { UINT32_MAX, 0 };
+	const TextRun& cached = hash_map::get(_text_runs, key, deffault);
+	if (cached.first != UINT32_MAX)
+		return cached;
+
+	const f32 scale = (f32)font_size / (f32)fr->font_size;
+
+	TextRun run;
+	run.first = array::size(_glyph_quads);
+	run.num = 0;
+
+	f32 pen_advance_x = 0.0f;
+	f32 pen_advance_y = 0.0f;
+
+	u32 state = 0;
+	u32 code_point = 0;
+	for (u32 i = 0; i < len; ++i)
+	{
+		switch (str[i])
+		{
+		case '\n':
+			pen_advance_x = 0.0f;
+			pen_advance_y -= scale*fr->font_size;
+			continue;
+
+		case '\t':
+			pen_advance_x += scale*font_size*4;
+			continue;
+		}
+
+		if (utf8::decode(&state, &code_point, str[i]) == UTF8_ACCEPT)
+		{
+			const GlyphData* glyph = font_resource::glyph(fr, code_point);
+
+			const f32 baseline = glyph->height - glyph->y_offset;
+
+			// Set pen position
+			const f32 pen_x = scale*glyph->x_offset;
+			const f32 pen_y = -scale*baseline;
+
+			GlyphQuad gq;
+
+			// Position coords
+			gq.x0 = (pen_x + pen_advance_x);
+			gq.y0 = (pen_y + pen_advance_y);
+			gq.x1 = (pen_x + pen_advance_x + scale*glyph->width );
+			gq.y1 = (pen_y + pen_advance_y + scale*glyph->height);
+
+			// Texture coords
+			gq.u0 = glyph->x / fr->texture_size;
+			gq.v1 = glyph->y / fr->texture_size; // Upper-left char corner
+			gq.u1 = glyph->width  / fr->texture_size + gq.u0;
+			gq.v0 = glyph->height / fr->texture_size + gq.v1; // Bottom-left char corner
+
+			array::push_back(_glyph_quads, gq);
+			++run.num;
+
+			// Advance pen position
+			pen_advance_x += scale*glyph->x_advance;
+		}
+	}
+
+	hash_map::set(_text_runs, key, run);
+	return hash_map::get(_text_runs, key, deffault);
+}
+
+GuiLayer::GuiLayer(Allocator& a, GuiBuffer& screen, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm)
+	: _buffer(a, rm, sm, mm, true)
+	, _screen_buffer(&screen)
+	, _vb(BGFX_INVALID_HANDLE)
+	, _ib(BGFX_INVALID_HANDLE)
+	, _dirty(true)
+	, _recording(false)
+{
+	_buffer.create();
+}
+
+GuiLayer::~GuiLayer()
+{
+	if (bgfx::isValid(_vb))
+		bgfx::destroy(_vb);
+	if (bgfx::isValid(_ib))
+		bgfx::destroy(_ib);
+}
+
 Gui::Gui(GuiBuffer& gb, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm)
 	: _marker(DEBUG_GUI_MARKER)
 	, _buffer(&gb)
@@ -26,6 +307,18 @@ Gui::Gui(GuiBuffer& gb, ResourceManager& rm, ShaderManager& sm, MaterialManager&
 	, _shader_manager(&sm)
 	, _material_manager(&mm)
 	, _world(MATRIX4X4_IDENTITY)
+	, _layer(NULL)
+{
+}
+
+Gui::Gui(GuiLayer& layer, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm)
+	: _marker(DEBUG_GUI_MARKER)
+	, _buffer(&layer._buffer)
+	, _resource_manager(&rm)
+	, _shader_manager(&sm)
+	, _material_manager(&mm)
+	, _world(MATRIX4X4_IDENTITY)
+	, _layer(&layer)
 {
 }
 
@@ -41,6 +334,10 @@ void Gui::move(const Vector2& pos)
 
 void Gui::triangle_3d(const Vector3& a, const Vector3& b, const Vector3& c, const Color4& color)
 {
+	const u32 base = _buffer->begin(3, 3, _world, StringId64());
+	if (base == UINT32_MAX)
+		return;
+
 	VertexData* vd = (VertexData*)_buffer->vertex_buffer_end();
 	vd[0].pos.x = a.x;
 	vd[0].pos.y = a.y;
@@ -64,11 +361,11 @@ void Gui::triangle_3d(const Vector3& a, const Vector3& b, const Vector3& c, cons
 	vd[2].col   = to_abgr(color);
 
 	u16* inds = (u16*)_buffer->index_buffer_end();
-	inds[0] = 0;
-	inds[1] = 1;
-	inds[2] = 2;
+	inds[0] = u16(base + 0);
+	inds[1] = u16(base + 1);
+	inds[2] = u16(base + 2);
 
-	_buffer->submit(3, 3, _world);
+	_buffer->end(3, 3);
 }
 
 void Gui::triangle(const Vector2& a, const Vector2& b, const Vector2& c, const Color4& color)
@@ -78,6 +375,10 @@ void Gui::triangle(const Vector2& a, const Vector2& b, const Vector2& c, const C
 
 void Gui::rect_3d(const Vector3& pos, const Vector2& size, const Color4& color)
 {
+	const u32 base = _buffer->begin(4, 6, _world, StringId64());
+	if (base == UINT32_MAX)
+		return;
+
 	VertexData* vd = (VertexData*)_buffer->vertex_buffer_end();
 	vd[0].pos.x = pos.x;
 	vd[0].pos.y = pos.y;
@@ -108,14 +409,14 @@ void Gui::rect_3d(const Vector3& pos, const Vector2& size, const Color4& color)
 	vd[3].col   = to_abgr(color);
 
 	u16* inds = (u16*)_buffer->index_buffer_end();
-	inds[0] = 0;
-	inds[1] = 1;
-	inds[2] = 2;
-	inds[3] = 0;
-	inds[4] = 2;
-	inds[5] = 3;
-
-	_buffer->submit(4, 6, _world);
+	inds[0] = u16(base + 0);
+	inds[1] = u16(base + 1);
+	inds[2] = u16(base + 2);
+	inds[3] = u16(base + 0);
+	inds[4] = u16(base + 2);
+	inds[5] = u16(base + 3);
+
+	_buffer->end(4, 6);
 }
 
 void Gui::rect(const Vector2& pos, const Vector2& size, const Color4& color)
@@ -125,6 +426,12 @@ void Gui::rect(const Vector2& pos, const Vector2& size, const Color4& color)
 
 void Gui::image_uv_3d(const Vector3& pos, const Vector2& size, const Vector2& uv0, const Vector2& uv1, StringId64 material, const Color4& color)
 {
+	_material_manager->create_material(material);
+
+	const u32 base = _buffer->begin(4, 6, _world, material);
+	if (base == UINT32_MAX)
+		return;
+
 	VertexData* vd = (VertexData*)_buffer->vertex_buffer_end();
 	vd[0].pos.x = pos.x;
 	vd[0].pos.y = pos.y;
@@ -155,20 +462,14 @@ void Gui::image_uv_3d(const Vector3& pos, const Vector2& size, const Vector2& uv
 	vd[3].col   = to_abgr(color);
 
 	u16* inds = (u16*)_buffer->index_buffer_end();
-	inds[0] = 0;
-	inds[1] = 1;
-	inds[2] = 2;
-	inds[3] = 0;
-	inds[4] = 2;
-	inds[5] = 3;
-
-	_material_manager->create_material(material);
-	_buffer->submit_with_material(4
-		, 6
-		, _world
-		, *_resource_manager
-		, _material_manager->get(material)
-		);
+	inds[0] = u16(base + 0);
+	inds[1] = u16(base + 1);
+	inds[2] = u16(base + 2);
+	inds[3] = u16(base + 0);
+	inds[4] = u16(base + 2);
+	inds[5] = u16(base + 3);
+
+	_buffer->end(4, 6);
 }
 
 void Gui::image_uv(const Vector2& pos, const Vector2& size, const Vector2& uv0, const Vector2& uv1, StringId64 material, const Color4& color)
@@ -190,116 +491,138 @@ void Gui::text_3d(const Vector3& pos, u32 font_size, const char* str, StringId64
 {
 	_material_manager->create_material(material);
 
-	const FontResource* fr = (FontResource*)_resource_manager->get(RESOURCE_TYPE_FONT, font);
-	const f32 scale = (f32)font_size / (f32)fr->font_size;
+	const GuiBuffer::TextRun run = _buffer->text_run(str, font, font_size);
+	if (run.num == 0)
+		return;
 
-	f32 pen_x;
-	f32 pen_y;
-	f32 pen_advance_x = 0.0f;
-	f32 pen_advance_y = 0.0f;
+	const GuiBuffer::GlyphQuad* gq = &_buffer->_glyph_quads[run.first];
+	const u32 col = to_abgr(color);
+
+	const u32 base = _buffer->begin(run.num*4, run.num*6, _world, material);
+	if (base == UINT32_MAX)
+		return;
 
 	VertexData* vd = (VertexData*)_buffer->vertex_buffer_end();
 	u16* id = (u16*)_buffer->index_buffer_end();
 
-	const u32 len = strlen32(str);
-	u32 num_vertices = 0;
-	u32 num_indices = 0;
-	for (u32 i = 0; i < len; ++i)
+	// The cached quads are relative to the pen origin
+	for (u32 i = 0; i < run.num; ++i, ++gq)
 	{
-		switch (str[i])
-		{
-		case '\n':
-			pen_advance_x = 0.0f;
-			pen_advance_y -= scale*fr->font_size;
-			continue;
-
-		case '\t':
-			pen_advance_x += scale*font_size*4;
-			continue;
-		}
-
-		u32 state = 0;
-		u32 code_point = 0;
-		if (utf8::decode(&state, &code_point, str[i]) == UTF8_ACCEPT)
-		{
-			const GlyphData* glyph = font_resource::glyph(fr, code_point);
-
-			const f32 baseline = glyph->height - glyph->y_offset;
+		// Fill vertex buffer
+		vd[0].pos.x = pos.x + gq->x0;
+		vd[0].pos.y = pos.y + gq->y0;
+		vd[0].pos.z = pos.z;
+		vd[0].uv.x  = gq->u0;
+		vd[0].uv.y  = gq->v0;
+		vd[0].col   = col;
+
+		vd[1].pos.x = pos.x + gq->x1;
+		vd[1].pos.y = pos.y + gq->y0;
+		vd[1].pos.z = pos.z;
+		vd[1].uv.x  = gq->u1;
+		vd[1].uv.y  = gq->v0;
+		vd[1].col   = col;
+
+		vd[2].pos.x = pos.x + gq->x1;
+		vd[2].pos.y = pos.y + gq->y1;
+		vd[2].pos.z = pos.z;
+		vd[2].uv.x  = gq->u1;
+		vd[2].uv.y  = gq->v1;
+		vd[2].col   = col;
+
+		vd[3].pos.x = pos.x + gq->x0;
+		vd[3].pos.y = pos.y + gq->y1;
+		vd[3].pos.z = pos.z;
+		vd[3].uv.x  = gq->u0;
+		vd[3].uv.y  = gq->v1;
+		vd[3].col   = col;
+
+		// Fill index buffer
+		const u16 first = u16(base + i*4);
+		id[0] = first + 0;
+		id[1] = first + 1;
+		id[2] = first + 2;
+		id[3] = first + 0;
+		id[4] = first + 2;
+		id[5] = first + 3;
+
+		vd += 4;
+		id += 6;
+	}
 
-			// Set pen position
-			pen_x = pos.x + scale*glyph->x_offset;
-			pen_y = pos.y - scale*baseline;
+	_buffer->end(run.num*4, run.num*6);
+}
 
-			// Position coords
-			const f32 x0 = (pen_x + pen_advance_x);
-			const f32 y0 = (pen_y + pen_advance_y);
-			const f32 x1 = (pen_x + pen_advance_x + scale*glyph->width );
-			const f32 y1 = (pen_y + pen_advance_y + scale*glyph->height);
+void Gui::text(const Vector2& pos, u32 font_size, const char* str, StringId64 font, StringId64 material, const Color4& color)
+{
+	text_3d(vector3(pos.x, pos.y, 0.0f), font_size, str, font, material, color);
+}
 
-			// Texture coords
-			const f32 u0 = glyph->x / fr->texture_size;
-			const f32 v1 = glyph->y / fr->texture_size; // Upper-left char corner
-			const f32 u1 = glyph->width  / fr->texture_size + u0;
-			const f32 v0 = glyph->height / fr->texture_size + v1; // Bottom-left char corner
-
-			// Fill vertex buffer
-			vd[0].pos.x = x0;
-			vd[0].pos.y = y0;
-			vd[0].pos.z = pos.z;
-			vd[0].uv.x  = u0;
-			vd[0].uv.y  = v0;
-			vd[0].col   = to_abgr(color);
-
-			vd[1].pos.x = x1;
-			vd[1].pos.y = y0;
-			vd[1].pos.z = pos.z;
-			vd[1].uv.x  = u1;
-			vd[1].uv.y  = v0;
-			vd[1].col   = to_abgr(color);
-
-			vd[2].pos.x = x1;
-			vd[2].pos.y = y1;
-			vd[2].pos.z = pos.z;
-			vd[2].uv.x  = u1;
-			vd[2].uv.y  = v1;
-			vd[2].col   = to_abgr(color);
-
-			vd[3].pos.x = x0;
-			vd[3].pos.y = y1;
-			vd[3].pos.z = pos.z;
-			vd[3].uv.x  = u0;
-			vd[3].uv.y  = v1;
-			vd[3].col   = to_abgr(color);
-
-			// Fill index buffer
-			id[0] = num_vertices + 0;
-			id[1] = num_vertices + 1;
-			id[2] = num_vertices + 2;
-			id[3] = num_vertices + 0;
-			id[4] = num_vertices + 2;
-			id[5] = num_vertices + 3;
+bool Gui::dirty() const
+{
+	CE_ASSERT(_layer != NULL, "Gui is not a layer");
+	return _layer->_dirty;
+}
 
-			// Advance pen position
-			pen_advance_x += scale*glyph->x_advance;
+void Gui::set_dirty()
+{
+	CE_ASSERT(_layer != NULL, "Gui is not a layer");
+	_layer->_dirty = true;
+}
 
-			vd += 4;
-			id += 6;
-			num_vertices += 4;
-			num_indices  += 6;
-		}
-	}
+void Gui::begin_layer()
+{
+	CE_ASSERT(_layer != NULL, "Gui is not a layer");
+	CE_ASSERT(!_layer->_recording, "Layer is already recording");
+	_layer->_recording = true;
+	_layer->_buffer.record();
+}
 
-	_buffer->submit_with_material(num_vertices
-		, num_indices
-		, _world
-		, *_resource_manager
-		, _material_manager->get(material)
+void Gui::end_layer()
+{
+	CE_ASSERT(_layer != NULL, "Gui is not a layer");
+	CE_ASSERT(_layer->_recording, "Layer is not recording");
+	GuiLayer& l = *_layer;
+	GuiBuffer& gb = l._buffer;
+	gb.commit();
+	l._recording = false;
+	l._dirty = false;
+
+	// Destruction is deferred by bgfx until the frames using the old
+	// buffers have been rendered
+	if (bgfx::isValid(l._vb))
+		bgfx::destroy(l._vb);
+	if (bgfx::isValid(l._ib))
+		bgfx::destroy(l._ib);
+	l._vb = BGFX_INVALID_HANDLE;
+	l._ib = BGFX_INVALID_HANDLE;
+
+	if (array::size(gb._batches) == 0)
+		return;
+
+	l._vb = bgfx::createVertexBuffer(bgfx::copy(array::begin(gb._vertex_data), array::size(gb._vertex_data))
+		, gb._pos_tex_col
 		);
+	l._ib = bgfx::createIndexBuffer(bgfx::copy(array::begin(gb._index_data), array::size(gb._index_data)*sizeof(u16)));
 }
 
-void Gui::text(const Vector2& pos, u32 font_size, const char* str, StringId64 font, StringId64 material, const Color4& color)
+void Gui::draw_layer()
 {
-	text_3d(vector3(pos.x, pos.y, 0.0f), font_size, str, font, material, color);
+	CE_ASSERT(_layer != NULL, "Gui is not a layer");
+	const GuiLayer& l = *_layer;
+	if (!bgfx::isValid(l._vb))
+		return;
+
+	l._screen_buffer->flush();
+
+	for (u32 i = 0; i < array::size(l._buffer._batches); ++i)
+	{
+		const GuiBuffer::Batch& b = l._buffer._batches[i];
+		bgfx::setVertexBuffer(0, l._vb, b.first_vertex, b.num_vertices);
+		bgfx::setIndexBuffer(l._ib, b.first_index, b.num_indices);
+		bgfx::setTransform(to_float_ptr(_world));
+		_layer->_buffer.submit(b.material);
+	}
 }
 
 } // namespace crown
@@ -5,89 +5,154 @@
 
 #pragma once
 
+#include "core/containers/types.h"
 #include "core/math/types.h"
+#include "core/strings/string_id.h"
 #include "resource/types.h"
 #include "world/types.h"
 #include <bgfx/bgfx.h>
 
-#include "world/shader_manager.h"
-#include "core/math/matrix4x4.h"
-#include "world/material.h"
-#include "device/pipeline.h"
-
 namespace crown
 {
+/// Vertices and indices of the guis of a world.
+///
+/// The primitives are appended to batches which are submitted only when the
+/// material or the transform changes, so that guis drawing with few
+/// materials need few draw calls. It also caches the layout of the texts.
+///
+/// A retained buffer records the batches to arrays instead of the
+/// transient buffers of the frame, between record() and commit(), see
+/// GuiLayer.
+///
+/// @ingroup World
 struct GuiBuffer
 {
+	struct GlyphQuad
+	{
+		f32 x0;
+		f32 y0;
+		f32 x1;
+		f32 y1;
+		f32 u0;
+		f32 v0;
+		f32 u1;
+		f32 v1;
+	};
+
+	struct TextRun
+	{
+		u32 first; ///< Index of the first quad in _glyph_quads.
+		u32 num;
+	};
+
+	struct Batch
+	{
+		u32 first_vertex;
+		u32 num_vertices;
+		u32 first_index;
+		u32 num_indices;
+		StringId64 material;
+	};
+
+	ResourceManager* _resource_manager;
 	ShaderManager* _shader_manager;
+	MaterialManager* _material_manager;
 	u32 _num_vertices;
 	u32 _num_indices;
+	u32 _max_vertices;
+	u32 _max_indices;
 	bgfx::VertexDecl _pos_tex_col;
 	bgfx::TransientVertexBuffer tvb;
 	bgfx::TransientIndexBuffer tib;
 
-	GuiBuffer(ShaderManager& sm)
-		: _shader_manager(&sm)
-		, _num_vertices(0)
-		, _num_indices(0)
-	{
-	}
+	u32 _batch_vertices; ///< First vertex of the batch.
+	u32 _batch_indices;  ///< First index of the batch.
+	StringId64 _batch_material; ///< Empty to draw with the gui shader.
+	Matrix4x4 _batch_world;
 
-	void* vertex_buffer_end()
-	{
-		return tvb.data + _num_vertices*24;
-	}
+	HashMap<u64, TextRun> _text_runs; ///< By string, font and size.
+	Array<GlyphQuad> _glyph_quads;
 
-	void* index_buffer_end()
-	{
-		return tib.data + _num_indices*2;
-	}
+	bool _retained;
+	Array<char> _vertex_data;
+	Array<u16> _index_data;
+	Array<Batch> _batches;
 
-	void create()
-	{
-		_pos_tex_col.begin()
-			.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
-			.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, true)
-			.add(bgfx::Attrib::Color0,    4, bgfx::AttribType::Uint8, true)
-			.end()
-			;
-	}
-
-	void reset()
-	{
-		_num_vertices = 0;
-		_num_indices = 0;
+	///
+	GuiBuffer(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, bool retained = false);
 
-		bgfx::allocTransientVertexBuffer(&tvb, 4096, _pos_tex_col);
-		bgfx::allocTransientIndexBuffer(&tib, 6144);
-	}
+	///
+	void* vertex_buffer_end();
 
-	void submit(u32 num_vertices, u32 num_indices, const Matrix4x4& world)
-	{
-		bgfx::setVertexBuffer(0, &tvb, _num_vertices, num_vertices);
-		bgfx::setIndexBuffer(&tib, _num_indices, num_indices);
-		bgfx::setTransform(to_float_ptr(world));
+	///
+	void* index_buffer_end();
 
-		_shader_manager->submit(StringId32("gui"), VIEW_GUI);
+	///
+	void create();
 
-		_num_vertices += num_vertices;
-		_num_indices += num_indices;
-	}
+	/// Submits the pending batch and starts a new frame.
+	void reset();
 
-	void submit_with_material(u32 num_vertices, u32 num_indices, const Matrix4x4& world, ResourceManager& rm, Material* material)
-	{
-		bgfx::setVertexBuffer(0, &tvb, _num_vertices, num_vertices);
-		bgfx::setIndexBuffer(&tib, _num_indices, num_indices);
-		bgfx::setTransform(to_float_ptr(world));
+	/// Makes room for @a num_vertices and @a num_indices drawn with
+	/// @a material and the @a world transform, submitting the pending batch
+	/// if it uses a different material or transform.
+	/// Returns the index, relative to the batch, of the first vertex of the
+	/// primitive or UINT32_MAX if there is no room left for it.
+	u32 begin(u32 num_vertices, u32 num_indices, const Matrix4x4& world, StringId64 material);
+
+	/// Adds the @a num_vertices and @a num_indices written after begin() to
+	/// the batch.
+	void end(u32 num_vertices, u32 num_indices);
+
+	/// Submits the pending batch.
+	void flush();
+
+	/// Submits the primitives of @a material, which have been set in the
+	/// vertex and index buffers.
+	void submit(StringId64 material);
 
-		material->bind(rm, *_shader_manager, VIEW_GUI);
+	/// Discards the batches of a retained buffer and starts recording new
+	/// ones.
+	void record();
 
-		_num_vertices += num_vertices;
-		_num_indices += num_indices;
-	}
+	/// Stops recording the batches of a retained buffer.
+	void commit();
+
+	/// Returns the layout of @a str drawn with @a font at @a font_size,
+	/// relative to the pen origin.
+	const TextRun& text_run(const char* str, StringId64 font, u32 font_size);
 };
 
-/// Immediate mode Gui.
+/// Geometry of a retained Gui.
+///
+/// The primitives are recorded once to static buffers and drawn every
+/// frame with the transform of the Gui, until the layer is marked dirty
+/// and recorded again.
+///
+/// @ingroup World
+struct GuiLayer
+{
+	GuiBuffer _buffer;
+	GuiBuffer* _screen_buffer; ///< Flushed before drawing the layer to keep the order of the draws.
+	bgfx::VertexBufferHandle _vb;
+	bgfx::IndexBufferHandle _ib;
+	bool _dirty;
+	bool _recording;
+
+	///
+	GuiLayer(Allocator& a, GuiBuffer& screen, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm);
+
+	///
+	~GuiLayer();
+
+	///
+	GuiLayer(const GuiLayer&) = delete;
+
+	///
+	GuiLayer& operator=(const GuiLayer&) = delete;
+};
+
+/// Immediate mode Gui, or retained if it has a GuiLayer.
 ///
 /// @ingroup World
 struct Gui
@@ -111,10 +176,14 @@ struct Gui
 	ShaderManager* _shader_manager;
 	MaterialManager* _material_manager;
 	Matrix4x4 _world;
+	GuiLayer* _layer;
 
 	///
 	Gui(GuiBuffer& gb, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm);
 
+	/// Creates a retained Gui which records to @a layer.
+	Gui(GuiLayer& layer, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm);
+
 	///
 	~Gui();
 
@@ -150,6 +219,26 @@ struct Gui
 
 	///
 	void text(const Vector2& pos, u32 font_size, const char* str, StringId64 font, StringId64 material, const Color4& color);
+
+	/// Returns whether the layer must be recorded again. Layers are dirty
+	/// when created.
+	bool dirty() const;
+
+	/// Marks the layer as dirty.
+	void set_dirty();
+
+	/// Discards the primitives of the layer. The primitives drawn until
+	/// end_layer() are recorded to the layer, those drawn outside are
+	/// ignored.
+	void begin_layer();
+
+	/// Uploads the primitives recorded since begin_layer() and clears the
+	/// dirty flag.
+	void end_layer();
+
+	/// Draws the primitives recorded to the layer at the position of the
+	/// Gui, after those drawn so far by the screen guis.
+	void draw_layer();
 };
 
 } // namespace crown
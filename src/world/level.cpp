@@ -3,11 +3,23 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
+#include "core/filesystem/file_memory.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/vector3.h"
+#include "core/memory/temp_allocator.h"
+#include "core/os.h"
 #include "resource/level_resource.h"
+#include "resource/mesh_resource.h"
 #include "resource/unit_resource.h"
 #include "world/level.h"
+#include "world/material_manager.h"
+#include "world/physics_world.h"
+#include "world/render_world.h"
+#include "world/scene_graph.h"
 #include "world/unit_manager.h"
 #include "world/world.h"
+#include <float.h> // FLT_MAX
 
 namespace crown
 {
@@ -18,24 +30,142 @@ Level::Level(Allocator& a, UnitManager& um, World& w, const LevelResource& lr)
 	, _world(&w)
 	, _resource(&lr)
 	, _unit_lookup(a)
+	, _pose(MATRIX4X4_IDENTITY)
+	, _num_spawned(0)
+	, _max_units(0)
+	, _max_time(0.0f)
+	, _loaded(false)
+	, _streaming(false)
+	, _loading_cell(UINT32_MAX)
+	, _load_radius(0.0f)
+	, _unload_radius(0.0f)
+	, _cell_state(a)
+	, _observers(a)
+	, _batch_mesh(NULL)
 {
+	if (level_resource::num_batches(&lr) > 0)
+	{
+		u32 size;
+		const void* data = level_resource::batch_mesh(&lr, size);
+		FileMemory fm(data, size);
+		_batch_mesh = (MeshResource*)mesh_resource_internal::load(fm, a);
+		mesh_resource::create_buffers(_batch_mesh);
+	}
 }
 
 Level::~Level()
 {
+	if (_batch_mesh != NULL)
+	{
+		mesh_resource::destroy_buffers(_batch_mesh);
+		_allocator->deallocate(_batch_mesh);
+	}
+
 	_marker = 0;
 }
 
 void Level::load(const Vector3& pos, const Quaternion& rot)
 {
-	// Spawn units
-	const UnitResource* ur = level_resource::unit_resource(_resource);
+	load_async(pos, rot, 0, 0.0f);
+	load_step();
+}
 
+void Level::load_async(const Vector3& pos, const Quaternion& rot, u32 max_units, f32 max_time)
+{
+	CE_ASSERT(!_loaded && array::size(_unit_lookup) == 0, "Level already loaded");
+
+	const UnitResource* ur = level_resource::unit_resource(_resource);
 	array::resize(_unit_lookup, ur->num_units);
-	for (u32 i = 0; i < ur->num_units; ++i)
-		_unit_lookup[i] = _unit_manager->create();
 
-	spawn_units(*_world, *ur, pos, rot, array::begin(_unit_lookup));
+	_pose        = matrix4x4(rot, pos);
+	_num_spawned = 0;
+	_max_units   = max_units;
+	_max_time    = max_time;
+
+	reserve();
+}
+
+void Level::unload()
+{
+	if (_streaming)
+	{
+		for (u32 i = 0; i < array::size(_cell_state); ++i)
+		{
+			if (_cell_state[i] != CellState::UNLOADED)
+				destroy_cell(i);
+		}
+	}
+	else
+	{
+		// Units may have been destroyed by gameplay code in the meantime
+		TempAllocator1024 ta;
+		Array<UnitId> units(ta);
+		for (u32 i = 0; i < _num_spawned; ++i)
+		{
+			if (_unit_manager->alive(_unit_lookup[i]))
+				array::push_back(units, _unit_lookup[i]);
+		}
+
+		_world->destroy_units(array::begin(units), array::size(units));
+	}
+
+	array::clear(_unit_lookup);
+	_num_spawned = 0;
+	_loaded = false;
+	_streaming = false;
+}
+
+void Level::reserve()
+{
+	const UnitResource* ur = level_resource::unit_resource(_resource);
+
+	u32 num_transforms = 0;
+	u32 num_colliders = 0;
+	u32 num_actors = 0;
+	u32 num_meshes = level_resource::num_batches(_resource);
+	u32 num_sprites = 0;
+	u32 num_lights = 0;
+
+	const ComponentData* component = (const ComponentData*)(ur + 1);
+	for (u32 cc = 0; cc < ur->num_component_types; ++cc)
+	{
+		if (component->type == COMPONENT_TYPE_TRANSFORM)
+			num_transforms += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_COLLIDER)
+			num_colliders += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_ACTOR)
+			num_actors += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_MESH_RENDERER)
+			num_meshes += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
+			num_sprites += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_LIGHT)
+			num_lights += component->num_instances;
+
+		component = (const ComponentData*)((const char*)(component + 1) + component->size);
+	}
+
+	_world->_scene_graph->reserve(num_transforms);
+	_world->_physics_world->reserve(num_colliders, num_actors);
+	_world->_render_world->reserve(num_meshes, num_sprites, num_lights);
+}
+
+bool Level::load_step()
+{
+	if (_loaded)
+		return true;
+
+	const UnitResource* ur = level_resource::unit_resource(_resource);
+	const u32 num_units = ur->num_units;
+	const u32 last_unit = _max_units == 0 || num_units - _num_spawned < _max_units
+		? num_units
+		: _num_spawned + _max_units
+		;
+
+	spawn_next(last_unit);
+
+	if (_num_spawned < num_units)
+		return false;
 
 	// Play sounds
 	const u32 num_sounds = level_resource::num_sounds(_resource);
@@ -49,6 +179,199 @@ void Level::load(const Vector3& pos, const Quaternion& rot)
 			, ls->range
 			);
 	}
+
+	_loaded = true;
+	return true;
+}
+
+bool Level::is_loaded() const
+{
+	return _loaded;
+}
+
+f32 Level::progress() const
+{
+	const u32 num_units = array::size(_unit_lookup);
+	return _loaded || num_units == 0 ? 1.0f : f32(_num_spawned) / f32(num_units);
+}
+
+void Level::spawn_next(u32 last_unit)
+{
+	const UnitResource* ur = level_resource::unit_resource(_resource);
+	const s64 time_start = os::clocktime();
+	const s64 time_budget = s64(_max_time * f32(os::clockfrequency()));
+
+	// Spawn units in chunks, checking the time budget after each one
+	const u32 chunk_size = _max_time > 0.0f ? CROWN_LEVEL_LOAD_CHUNK_SIZE : UINT32_MAX;
+	while (_num_spawned < last_unit)
+	{
+		const u32 first = _num_spawned;
+		const u32 end = last_unit - first < chunk_size
+			? last_unit
+			: first + chunk_size
+			;
+
+		_unit_manager->create(end - first, array::begin(_unit_lookup) + first);
+		spawn_units(*_world, *ur, &_pose, 1, array::begin(_unit_lookup), first, end);
+		spawn_batches(first, end);
+		_num_spawned = end;
+
+		if (_max_time > 0.0f && os::clocktime() - time_start >= time_budget)
+			break;
+	}
+}
+
+void Level::spawn_batches(u32 first_unit, u32 end_unit)
+{
+	const u32 num_batches = level_resource::num_batches(_resource);
+	for (u32 i = 0; i < num_batches; ++i)
+	{
+		const LevelBatch* lb = level_resource::get_batch(_resource, i);
+		if (lb->unit < first_unit || lb->unit >= end_unit)
+			continue;
+
+		const UnitId unit = _unit_lookup[lb->unit];
+		const Matrix4x4 pose = _world->_scene_graph->world_pose(unit);
+		_world->_material_manager->create_material(lb->material);
+		_world->_render_world->mesh_create(&unit
+			, &pose
+			, 1
+			, _batch_mesh
+			, _batch_mesh->geometries[i]
+			, lb->material
+			);
+	}
+}
+
+void Level::stream(const Vector3& pos, const Quaternion& rot, f32 load_radius, f32 unload_radius, u32 max_units, f32 max_time)
+{
+	CE_ASSERT(!_loaded && array::size(_unit_lookup) == 0, "Level already loaded");
+	CE_ASSERT(level_resource::num_cells(_resource) > 0, "Level has no cells");
+	CE_ASSERT(load_radius <= unload_radius, "Unload radius must not be smaller than load radius");
+
+	const UnitResource* ur = level_resource::unit_resource(_resource);
+	array::resize(_unit_lookup, ur->num_units);
+	array::resize(_cell_state, level_resource::num_cells(_resource));
+	for (u32 i = 0; i < array::size(_cell_state); ++i)
+		_cell_state[i] = CellState::UNLOADED;
+
+	_pose          = matrix4x4(rot, pos);
+	_max_units     = max_units;
+	_max_time      = max_time;
+	_streaming     = true;
+	_loading_cell  = UINT32_MAX;
+	_load_radius   = load_radius;
+	_unload_radius = unload_radius;
+}
+
+void Level::set_observers(const Vector3* positions, u32 num)
+{
+	const Matrix4x4 inv_pose = get_inverted(_pose);
+
+	array::resize(_observers, num);
+	for (u32 i = 0; i < num; ++i)
+		_observers[i] = positions[i] * inv_pose;
+}
+
+// Returns the distance from @a cell to the nearest of the @a num observers.
+static f32 cell_distance(const LevelCell& cell, const Vector3* observers, u32 num)
+{
+	f32 dist = FLT_MAX;
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const Vector3 d = max(max(cell.bounds.min - observers[i], VECTOR3_ZERO), observers[i] - cell.bounds.max);
+		dist = fmin(dist, length(d));
+	}
+
+	return dist;
+}
+
+void Level::stream_step()
+{
+	const u32 num_cells = array::size(_cell_state);
+	const Vector3* observers = array::begin(_observers);
+	const u32 num_observers = array::size(_observers);
+
+	// Destroy the cells all the observers have left
+	for (u32 i = 0; i < num_cells; ++i)
+	{
+		if (_cell_state[i] == CellState::UNLOADED)
+			continue;
+
+		const LevelCell* cell = level_resource::get_cell(_resource, i);
+		if (cell_distance(*cell, observers, num_observers) > _unload_radius)
+			destroy_cell(i);
+	}
+
+	// Start spawning the nearest cell in range
+	if (_loading_cell == UINT32_MAX)
+	{
+		f32 nearest = _load_radius;
+
+		for (u32 i = 0; i < num_cells; ++i)
+		{
+			if (_cell_state[i] != CellState::UNLOADED)
+				continue;
+
+			const f32 dist = cell_distance(*level_resource::get_cell(_resource, i), observers, num_observers);
+			if (dist <= nearest)
+			{
+				nearest = dist;
+				_loading_cell = i;
+			}
+		}
+
+		if (_loading_cell == UINT32_MAX)
+			return;
+
+		_cell_state[_loading_cell] = CellState::LOADING;
+		_num_spawned = level_resource::get_cell(_resource, _loading_cell)->first_unit;
+	}
+
+	const LevelCell* cell = level_resource::get_cell(_resource, _loading_cell);
+	const u32 end_unit = cell->first_unit + cell->num_units;
+	const u32 last_unit = _max_units == 0 || end_unit - _num_spawned < _max_units
+		? end_unit
+		: _num_spawned + _max_units
+		;
+
+	spawn_next(last_unit);
+
+	if (_num_spawned == end_unit)
+	{
+		_cell_state[_loading_cell] = CellState::LOADED;
+		_loading_cell = UINT32_MAX;
+	}
+}
+
+bool Level::is_cell_loaded(u32 i) const
+{
+	CE_ASSERT(i < array::size(_cell_state), "Index out of bounds");
+	return _cell_state[i] == CellState::LOADED;
+}
+
+void Level::destroy_cell(u32 i)
+{
+	CE_ASSERT(i < array::size(_cell_state), "Index out of bounds");
+
+	const LevelCell* cell = level_resource::get_cell(_resource, i);
+	const u32 end_unit = i == _loading_cell ? _num_spawned : cell->first_unit + cell->num_units;
+
+	// Units may have been destroyed by gameplay code in the meantime
+	TempAllocator1024 ta;
+	Array<UnitId> units(ta);
+	for (u32 u = cell->first_unit; u < end_unit; ++u)
+	{
+		if (_unit_manager->alive(_unit_lookup[u]))
+			array::push_back(units, _unit_lookup[u]);
+	}
+
+	_world->destroy_units(array::begin(units), array::size(units));
+
+	_cell_state[i] = CellState::UNLOADED;
+	if (i == _loading_cell)
+		_loading_cell = UINT32_MAX;
 }
 
 } // namespace crown
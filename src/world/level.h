@@ -18,12 +18,34 @@ namespace crown
 /// @ingroup World
 struct Level
 {
+	struct CellState
+	{
+		enum Enum
+		{
+			UNLOADED,
+			LOADING,
+			LOADED
+		};
+	};
+
 	u32 _marker;
 	Allocator* _allocator;
 	UnitManager* _unit_manager;
 	World* _world;
 	const LevelResource* _resource;
 	Array<UnitId> _unit_lookup;
+	Matrix4x4 _pose;
+	u32 _num_spawned;
+	u32 _max_units;
+	f32 _max_time;
+	bool _loaded;
+	bool _streaming;
+	u32 _loading_cell;         ///< Cell being spawned, or UINT32_MAX.
+	f32 _load_radius;
+	f32 _unload_radius;
+	Array<u8> _cell_state;     ///< CellState::Enum of each cell.
+	Array<Vector3> _observers; ///< Positions of the observers in level space.
+	MeshResource* _batch_mesh; ///< Geometries of the batches of static meshes, or NULL.
 
 	///
 	Level(Allocator& a, UnitManager& um, World& w, const LevelResource& lr);
@@ -31,8 +53,61 @@ struct Level
 	///
 	~Level();
 
-	///
+	/// Spawns all the units of the level at once.
 	void load(const Vector3& pos, const Quaternion& rot);
+
+	/// Prepares the level to be spawned over multiple calls to
+	/// load_step(), each of which spawns at most @a max_units units or
+	/// stops as soon as @a max_time seconds have elapsed.
+	/// A budget of 0 means no limit.
+	void load_async(const Vector3& pos, const Quaternion& rot, u32 max_units, f32 max_time);
+
+	/// Spawns the next batch of units within the budget given to
+	/// load_async(). Returns true when the level has been fully loaded.
+	bool load_step();
+
+	/// Destroys the units of the level which have been spawned and are
+	/// still alive.
+	void unload();
+
+	/// Makes room in the component managers of the world for all the units
+	/// of the level, so that each manager grows at most once while the
+	/// level is spawned.
+	void reserve();
+
+	/// Returns whether all the units of the level have been spawned.
+	bool is_loaded() const;
+
+	/// Returns the fraction of the units spawned so far, in [0; 1].
+	f32 progress() const;
+
+	/// Prepares the level to be streamed over multiple calls to
+	/// stream_step(). The units of each cell are spawned when an observer
+	/// gets closer than @a load_radius to the cell, and destroyed when all
+	/// the observers are farther than @a unload_radius. The budget is the
+	/// same as load_async().
+	void stream(const Vector3& pos, const Quaternion& rot, f32 load_radius, f32 unload_radius, u32 max_units, f32 max_time);
+
+	/// Sets the world-space @a positions of the @a num observers.
+	void set_observers(const Vector3* positions, u32 num);
+
+	/// Destroys the cells all the observers have left, then spawns the
+	/// next batch of units of the nearest cell within @a load_radius.
+	void stream_step();
+
+	/// Returns whether all the units of the cell @a i have been spawned.
+	bool is_cell_loaded(u32 i) const;
+
+	/// Destroys the units of the cell @a i which are still alive.
+	void destroy_cell(u32 i);
+
+	/// Spawns the units from _num_spawned up to @a last_unit, or as many as
+	/// fit in the time budget.
+	void spawn_next(u32 last_unit);
+
+	/// Creates the meshes of the batches rendered by the units from
+	/// @a first_unit up to @a end_unit.
+	void spawn_batches(u32 first_unit, u32 end_unit);
 };
 
 } // namespace crown
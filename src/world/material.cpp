@@ -12,41 +12,58 @@
 
 namespace crown
 {
-void Material::bind(ResourceManager& rm, ShaderManager& sm, u8 view, s32 depth) const
+void Material::bind(ResourceManager& rm, ShaderManager& sm, u8 view, s32 depth, bool instanced) const
+{
+	// On the API thread, bgfx::begin() returns the default encoder.
+	bgfx::Encoder& encoder = *bgfx::begin();
+	set_state(rm, sm, encoder);
+	sm.submit(encoder, _resource->shader, view, depth, UINT64_MAX, instanced);
+}
+
+void Material::set_state(ResourceManager& rm, ShaderManager& sm) const
+{
+	set_state(rm, sm, *bgfx::begin());
+}
+
+void Material::update_textures(ResourceManager& rm, ShaderManager& sm) const
 {
 	using namespace material_resource;
 
-	// Set samplers
+	if (_bind_version == rm.version())
+		return;
+
 	for (u32 i = 0; i < _resource->num_textures; ++i)
 	{
-		const TextureData* td   = get_texture_data(_resource, i);
-		const TextureHandle* th = get_texture_handle(_resource, i, _data);
+		const TextureData* td = get_texture_data(_resource, i);
+
+		// Re-acquire the handles if the textures have been reloaded.
+		if (!rm.is_valid(_textures[i]))
+			_textures[i] = rm.handle(RESOURCE_TYPE_TEXTURE, td->id);
 
-		const TextureResource* teximg = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, td->id);
+		const TextureResource* teximg = (TextureResource*)rm.get(_textures[i]);
+		_texture_binds[i].sampler.idx = get_texture_handle(_resource, i, _data)->sampler_handle;
+		_texture_binds[i].texture.idx = teximg->handle.idx;
+		_texture_binds[i].flags = sm.sampler_state(_resource->shader, td->name);
+	}
+
+	_bind_version = rm.version();
+}
 
-		bgfx::UniformHandle sampler;
-		bgfx::TextureHandle texture;
-		sampler.idx = th->sampler_handle;
-		texture.idx = teximg->handle.idx;
+void Material::set_state(ResourceManager& rm, ShaderManager& sm, bgfx::Encoder& encoder) const
+{
+	update_textures(rm, sm);
 
-		bgfx::setTexture(i
-			, sampler
-			, texture
-			, sm.sampler_state(_resource->shader, td->name)
-			);
+	for (u32 i = 0; i < _resource->num_textures; ++i)
+	{
+		const TextureBind& tb = _texture_binds[i];
+		encoder.setTexture(i, tb.sampler, tb.texture, tb.flags);
 	}
 
-	// Set uniforms
 	for (u32 i = 0; i < _resource->num_uniforms; ++i)
 	{
-		const UniformHandle* uh = get_uniform_handle(_resource, i, _data);
-
-		bgfx::UniformHandle buh;
-		buh.idx = uh->uniform_handle;
-		bgfx::setUniform(buh, (char*)uh + sizeof(uh->uniform_handle));
+		const UniformBind& ub = _uniform_binds[i];
+		encoder.setUniform(ub.uniform, ub.value);
 	}
-
-	sm.submit(_resource->shader, view, depth);
 }
 
 void Material::set_float(StringId32 name, f32 value)
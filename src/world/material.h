@@ -8,6 +8,7 @@
 #include "core/math/types.h"
 #include "resource/types.h"
 #include "world/types.h"
+#include <bgfx/bgfx.h>
 
 namespace crown
 {
@@ -16,11 +17,45 @@ namespace crown
 /// @ingroup World
 struct Material
 {
+	/// Sampler, texture and sampler flags of a texture, ready to bind.
+	struct TextureBind
+	{
+		bgfx::UniformHandle sampler;
+		bgfx::TextureHandle texture;
+		u32 flags;
+	};
+
+	/// Uniform and its value in _data, ready to bind.
+	struct UniformBind
+	{
+		bgfx::UniformHandle uniform;
+		const void* value;
+	};
+
 	const MaterialResource* _resource;
+	ResourceHandle _resource_handle;
+	ResourceHandle* _textures;
+	TextureBind* _texture_binds;
+	UniformBind* _uniform_binds;
+	mutable u32 _bind_version; ///< ResourceManager::version() the texture binds have been resolved with.
 	char* _data;
 
-	///
-	void bind(ResourceManager& rm, ShaderManager& sm, u8 view, s32 depth = 0) const;
+	/// Sets the samplers and the uniforms of the material.
+	void set_state(ResourceManager& rm, ShaderManager& sm) const;
+
+	/// Sets the samplers and the uniforms of the material with @a encoder.
+	/// Call update_textures() from the main thread first when @a encoder
+	/// belongs to another thread.
+	void set_state(ResourceManager& rm, ShaderManager& sm, bgfx::Encoder& encoder) const;
+
+	/// Resolves the texture binds again if any texture or shader has gone
+	/// online or offline, or has been streamed, since they were resolved.
+	void update_textures(ResourceManager& rm, ShaderManager& sm) const;
+
+	/// Sets the samplers and the uniforms of the material and submits the
+	/// primitive to @a view. If @a instanced is true, the instanced variant
+	/// of the shader is used.
+	void bind(ResourceManager& rm, ShaderManager& sm, u8 view, s32 depth = 0, bool instanced = false) const;
 
 	/// Sets the @a value of the variable @a name.
 	void set_float(StringId32 name, f32 value);
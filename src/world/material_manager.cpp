@@ -99,16 +99,36 @@ void MaterialManager::create_material(StringId64 id)
 
 	const MaterialResource* mr = (MaterialResource*)_resource_manager->get(RESOURCE_TYPE_MATERIAL, id);
 
-	const u32 size = sizeof(Material) + mr->dynamic_data_size;
+	const u32 size = sizeof(Material)
+		+ sizeof(ResourceHandle)*mr->num_textures
+		+ sizeof(Material::TextureBind)*mr->num_textures
+		+ sizeof(Material::UniformBind)*mr->num_uniforms
+		+ mr->dynamic_data_size
+		;
 	Material* mat  = (Material*)_allocator->allocate(size);
 	mat->_resource = mr;
-	mat->_data     = (char*)&mat[1];
+	mat->_resource_handle = _resource_manager->handle(RESOURCE_TYPE_MATERIAL, id);
+	mat->_textures = (ResourceHandle*)&mat[1];
+	mat->_texture_binds = (Material::TextureBind*)&mat->_textures[mr->num_textures];
+	mat->_uniform_binds = (Material::UniformBind*)&mat->_texture_binds[mr->num_textures];
+	mat->_bind_version = UINT32_MAX;
+	mat->_data     = (char*)&mat->_uniform_binds[mr->num_uniforms];
+
+	for (u32 i = 0; i < mr->num_textures; ++i)
+		mat->_textures[i] = _resource_manager->handle(RESOURCE_TYPE_TEXTURE, material_resource::get_texture_data(mr, i)->id);
 
 	const char* data = (char*)mr + mr->dynamic_data_offset;
 	memcpy(mat->_data, data, mr->dynamic_data_size);
 
+	// The uniforms never change, the textures are resolved when first bound
+	for (u32 i = 0; i < mr->num_uniforms; ++i)
+	{
+		const UniformHandle* uh = material_resource::get_uniform_handle(mr, i, mat->_data);
+		mat->_uniform_binds[i].uniform.idx = uh->uniform_handle;
+		mat->_uniform_binds[i].value = (const char*)uh + sizeof(uh->uniform_handle);
+	}
+
 	sort_map::set(_materials, id, mat);
-	sort_map::sort(_materials);
 }
 
 void MaterialManager::destroy_material(StringId64 id)
@@ -117,13 +137,22 @@ void MaterialManager::destroy_material(StringId64 id)
 	_allocator->deallocate(mat);
 
 	sort_map::remove(_materials, id);
-	sort_map::sort(_materials);
 }
 
 Material* MaterialManager::get(StringId64 id)
 {
 	CE_ASSERT(sort_map::has(_materials, id), "Material not found");
-	return sort_map::get(_materials, id, (Material*)NULL);
+	Material* mat = sort_map::get(_materials, id, (Material*)NULL);
+
+	// Re-create the material if its resource has been reloaded.
+	if (!_resource_manager->is_valid(mat->_resource_handle))
+	{
+		destroy_material(id);
+		create_material(id);
+		mat = sort_map::get(_materials, id, (Material*)NULL);
+	}
+
+	return mat;
 }
 
 } // namespace crown
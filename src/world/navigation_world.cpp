@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/error/error.h"
+#include "core/math/vector3.h"
+#include "core/memory/allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "core/thread/job_system.h"
+#include "resource/nav_grid_resource.h"
+#include "resource/resource_manager.h"
+#include "world/navigation_world.h"
+#include "world/physics_world.h"
+#include <algorithm> // std::push_heap, std::pop_heap, std::reverse
+#include <math.h>    // floorf
+#include <stdint.h>  // UINT32_MAX
+#include <stdlib.h>  // abs
+#include <string.h>  // memset, memcpy
+
+namespace crown
+{
+namespace navigation_world_internal
+{
+	struct OpenNode
+	{
+		f32 f;
+		u32 cell;
+
+		// Inverted, so that the heap returns the lowest f first.
+		bool operator<(const OpenNode& a) const
+		{
+			return f > a.f;
+		}
+	};
+
+	// Per-job buffers, reused by all the searches of the job.
+	// A cell has been reached by the current search if its mark is
+	// 2*search, and closed if it is 2*search + 1.
+	struct Scratch
+	{
+		Array<f32> cost;
+		Array<u32> parent;
+		Array<u32> mark;
+		Array<OpenNode> open;
+		Array<u32> cells;
+
+		Scratch(Allocator& a, u32 num_cells)
+			: cost(a)
+			, parent(a)
+			, mark(a)
+			, open(a)
+			, cells(a)
+		{
+			array::resize(cost, num_cells);
+			array::resize(parent, num_cells);
+			array::resize(mark, num_cells);
+			memset(array::begin(mark), 0, num_cells*sizeof(u32));
+		}
+	};
+
+	static const s32 s_neighbours[8][2] =
+	{
+		{ -1, -1 }, { 0, -1 }, { 1, -1 },
+		{ -1,  0 },            { 1,  0 },
+		{ -1,  1 }, { 0,  1 }, { 1,  1 }
+	};
+
+	// Returns the index of the cell at @a pos, or UINT32_MAX if @a pos is
+	// outside the grid.
+	static u32 cell_index(const NavigationWorld& nw, const Vector3& pos)
+	{
+		if (nw._cell_size <= 0.0f)
+			return UINT32_MAX;
+
+		const f32 fx = floorf((pos.x - nw._origin.x) / nw._cell_size);
+		const f32 fz = floorf((pos.z - nw._origin.z) / nw._cell_size);
+		if (fx < 0.0f || fz < 0.0f || fx >= f32(nw._width) || fz >= f32(nw._height))
+			return UINT32_MAX;
+
+		return u32(fz)*nw._width + u32(fx);
+	}
+
+	static Vector3 cell_center(const NavigationWorld& nw, u32 cell)
+	{
+		Vector3 pos;
+		pos.x = nw._origin.x + (f32(cell % nw._width) + 0.5f) * nw._cell_size;
+		pos.y = nw._origin.y;
+		pos.z = nw._origin.z + (f32(cell / nw._width) + 0.5f) * nw._cell_size;
+		return pos;
+	}
+
+	// Octile distance, admissible since the cheapest cell costs 1.
+	static f32 heuristic(const NavigationWorld& nw, u32 a, u32 b)
+	{
+		const s32 dx = abs(s32(a % nw._width) - s32(b % nw._width));
+		const s32 dz = abs(s32(a / nw._width) - s32(b / nw._width));
+		const s32 lo = dx < dz ? dx : dz;
+		const s32 hi = dx < dz ? dz : dx;
+		return f32(hi - lo) + f32(lo)*1.41421356f;
+	}
+
+	static bool walkable(const NavigationWorld& nw, s32 x, s32 z)
+	{
+		return x >= 0 && z >= 0 && x < s32(nw._width) && z < s32(nw._height)
+			&& nw._cells[z*nw._width + x] != 0
+			;
+	}
+
+	// A* search on the 8-connected grid. Diagonal moves can not cut the
+	// corners of blocked cells. Writes the cells of the path, from the
+	// start to the goal, to s.cells.
+	static bool search(const NavigationWorld& nw, Scratch& s, u32 search_id, u32 start, u32 goal)
+	{
+		const u32 reached = 2*search_id;
+		const u32 closed = reached + 1;
+
+		array::clear(s.open);
+		array::clear(s.cells);
+
+		s.cost[start] = 0.0f;
+		s.parent[start] = UINT32_MAX;
+		s.mark[start] = reached;
+		OpenNode on = { heuristic(nw, start, goal), start };
+		array::push_back(s.open, on);
+
+		while (array::size(s.open) != 0)
+		{
+			std::pop_heap(array::begin(s.open), array::end(s.open));
+			const u32 cur = array::back(s.open).cell;
+			array::pop_back(s.open);
+
+			if (s.mark[cur] == closed)
+				continue;
+			s.mark[cur] = closed;
+
+			if (cur == goal)
+			{
+				for (u32 c = goal; c != UINT32_MAX; c = s.parent[c])
+					array::push_back(s.cells, c);
+				std::reverse(array::begin(s.cells), array::end(s.cells));
+				return true;
+			}
+
+			const s32 cx = s32(cur % nw._width);
+			const s32 cz = s32(cur / nw._width);
+			for (u32 i = 0; i < countof(s_neighbours); ++i)
+			{
+				const s32 dx = s_neighbours[i][0];
+				const s32 dz = s_neighbours[i][1];
+				if (!walkable(nw, cx + dx, cz + dz))
+					continue;
+
+				const bool diagonal = dx != 0 && dz != 0;
+				if (diagonal && (!walkable(nw, cx + dx, cz) || !walkable(nw, cx, cz + dz)))
+					continue;
+
+				const u32 next = u32(cz + dz)*nw._width + u32(cx + dx);
+				if (s.mark[next] == closed)
+					continue;
+
+				// Each move costs the average of the two cells it crosses
+				const f32 step = (f32(nw._cells[cur]) + f32(nw._cells[next])) * 0.5f;
+				const f32 cost = s.cost[cur] + (diagonal ? step*1.41421356f : step);
+				if (s.mark[next] == reached && cost >= s.cost[next])
+					continue;
+
+				s.cost[next] = cost;
+				s.parent[next] = cur;
+				s.mark[next] = reached;
+				OpenNode on = { cost + heuristic(nw, next, goal), next };
+				array::push_back(s.open, on);
+				std::push_heap(array::begin(s.open), array::end(s.open));
+			}
+		}
+
+		return false;
+	}
+
+	// Searches the path of @a req and writes its points, without the
+	// intermediate cells along straight lines.
+	static void find_path(const NavigationWorld& nw, Scratch& s, u32 search_id, NavigationWorld::Request& req)
+	{
+		req.status = PathStatus::NOT_FOUND;
+		req.num_points = 0;
+		req.points = NULL;
+
+		const u32 start = cell_index(nw, req.from);
+		const u32 goal = cell_index(nw, req.to);
+		if (start == UINT32_MAX || goal == UINT32_MAX || nw._cells[start] == 0 || nw._cells[goal] == 0)
+			return;
+
+		if (!search(nw, s, search_id, start, goal))
+			return;
+
+		const u32 num_cells = array::size(s.cells);
+		u32 num = 0;
+		req.points = (Vector3*)nw._allocator->allocate(sizeof(Vector3)*(num_cells + 1), alignof(Vector3));
+		req.points[num++] = req.from;
+		for (u32 i = 1; i + 1 < num_cells; ++i)
+		{
+			const u32 prev = s.cells[i - 1];
+			const u32 cur = s.cells[i];
+			const u32 next = s.cells[i + 1];
+			if (cur - prev != next - cur)
+				req.points[num++] = cell_center(nw, cur);
+		}
+		req.points[num++] = req.to;
+
+		req.status = PathStatus::FOUND;
+		req.num_points = num;
+	}
+
+	static void search_job(void* user_data)
+	{
+		NavigationWorld::SearchJob* sj = (NavigationWorld::SearchJob*)user_data;
+		NavigationWorld& nw = *sj->world;
+
+		Scratch s(*nw._allocator, array::size(nw._cells));
+		for (u32 i = 0; i < sj->num; ++i)
+			find_path(nw, s, i + 1, nw._running[sj->first + i]);
+	}
+
+} // namespace navigation_world_internal
+
+NavigationWorld::NavigationWorld(Allocator& a, ResourceManager& rm)
+	: _marker(NAVIGATION_WORLD_MARKER)
+	, _allocator(&a)
+	, _resource_manager(&rm)
+	, _width(0)
+	, _height(0)
+	, _cell_size(0.0f)
+	, _origin(VECTOR3_ZERO)
+	, _cells(a)
+	, _queued(a)
+	, _running(a)
+	, _search_jobs(a)
+	, _counter(0)
+	, _path_index(a)
+	, _paths(a)
+	, _next_handle(0)
+{
+}
+
+NavigationWorld::~NavigationWorld()
+{
+	wait();
+
+	for (u32 i = 0; i < array::size(_running); ++i)
+		_allocator->deallocate(_running[i].points);
+
+	for (u32 i = 0; i < array::size(_paths); ++i)
+		_allocator->deallocate(_paths[i].points);
+
+	_marker = 0;
+}
+
+void NavigationWorld::set_grid(StringId64 name)
+{
+	wait();
+
+	const NavGridResource* ngr = (const NavGridResource*)_resource_manager->get(RESOURCE_TYPE_NAV_GRID, name);
+	_width = ngr->width;
+	_height = ngr->height;
+	_cell_size = ngr->cell_size;
+	_origin = ngr->origin;
+
+	array::resize(_cells, _width*_height);
+	memcpy(array::begin(_cells), nav_grid_resource::cells(ngr), _width*_height);
+}
+
+void NavigationWorld::block_static(PhysicsWorld& pw, f32 step, f32 height)
+{
+	CE_ASSERT(height > step, "Height must be greater than step");
+	wait();
+
+	const u32 num = array::size(_cells);
+
+	TempAllocator4096 ta;
+	Array<PhysicsCast> casts(ta);
+	Array<RaycastHit> hits(ta);
+	array::resize(casts, num);
+	array::resize(hits, num);
+
+	// Sweep a box slightly smaller than each cell down from the top of
+	// the obstacles to the highest step
+	const f32 half = _cell_size * 0.45f;
+	for (u32 i = 0; i < num; ++i)
+	{
+		casts[i].type = PhysicsCast::BOX;
+		casts[i].from = navigation_world_internal::cell_center(*this, i);
+		casts[i].from.y += height;
+		casts[i].dir = -VECTOR3_UP;
+		casts[i].len = height - step;
+		casts[i].half_extents = vector3(half, 0.01f, half);
+	}
+
+	pw.cast_batch(array::begin(hits), array::begin(casts), num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		if (hits[i].actor.i != UINT32_MAX && pw.actor_is_static(hits[i].actor))
+			_cells[i] = 0;
+	}
+}
+
+bool NavigationWorld::is_walkable(const Vector3& pos) const
+{
+	const u32 cell = navigation_world_internal::cell_index(*this, pos);
+	return cell != UINT32_MAX && _cells[cell] != 0;
+}
+
+u32 NavigationWorld::find_paths(const Vector3* from, const Vector3* to, u32 num)
+{
+	const u32 first = _next_handle;
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		Request req;
+		req.from = from[i];
+		req.to = to[i];
+		req.handle = _next_handle++;
+		req.status = PathStatus::PENDING;
+		req.num_points = 0;
+		req.points = NULL;
+		array::push_back(_queued, req);
+
+		Path path;
+		path.handle = req.handle;
+		path.status = PathStatus::PENDING;
+		path.num_points = 0;
+		path.points = NULL;
+		hash_map::set(_path_index, req.handle, array::size(_paths));
+		array::push_back(_paths, path);
+	}
+
+	return first;
+}
+
+PathStatus::Enum NavigationWorld::path_status(u32 handle) const
+{
+	const u32 i = hash_map::get(_path_index, handle, UINT32_MAX);
+	return i != UINT32_MAX ? (PathStatus::Enum)_paths[i].status : PathStatus::INVALID;
+}
+
+void NavigationWorld::path(u32 handle, Array<Vector3>& points) const
+{
+	const u32 i = hash_map::get(_path_index, handle, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Invalid path");
+	CE_ASSERT(_paths[i].status == PathStatus::FOUND, "Path not found");
+
+	array::push(points, _paths[i].points, _paths[i].num_points);
+}
+
+void NavigationWorld::destroy_path(u32 handle)
+{
+	const u32 i = hash_map::get(_path_index, handle, UINT32_MAX);
+	if (i == UINT32_MAX)
+		return;
+
+	_allocator->deallocate(_paths[i].points);
+
+	const u32 last = array::size(_paths) - 1;
+	_paths[i] = _paths[last];
+	hash_map::set(_path_index, _paths[i].handle, i);
+	array::pop_back(_paths);
+	hash_map::remove(_path_index, handle);
+}
+
+void NavigationWorld::update()
+{
+	// Keep searching if the jobs started by the previous update are
+	// still running
+	if (_counter.load() != 0)
+		return;
+
+	for (u32 i = 0; i < array::size(_running); ++i)
+	{
+		const Request& req = _running[i];
+		const u32 p = hash_map::get(_path_index, req.handle, UINT32_MAX);
+		if (p == UINT32_MAX)
+		{
+			// The path has been destroyed while it was searched
+			_allocator->deallocate(req.points);
+			continue;
+		}
+
+		_paths[p].status = req.status;
+		_paths[p].num_points = req.num_points;
+		_paths[p].points = req.points;
+	}
+	array::clear(_running);
+
+	const u32 num = array::size(_queued);
+	if (num == 0)
+		return;
+
+	if (array::size(_cells) == 0)
+	{
+		// Without a grid there is nothing to search
+		for (u32 i = 0; i < num; ++i)
+		{
+			const u32 p = hash_map::get(_path_index, _queued[i].handle, UINT32_MAX);
+			if (p != UINT32_MAX)
+				_paths[p].status = PathStatus::NOT_FOUND;
+		}
+		array::clear(_queued);
+		return;
+	}
+
+	array::push(_running, array::begin(_queued), num);
+	array::clear(_queued);
+
+	const u32 num_jobs = (num + CROWN_NAVIGATION_PATHS_PER_JOB - 1) / CROWN_NAVIGATION_PATHS_PER_JOB;
+	array::resize(_search_jobs, num_jobs);
+
+	TempAllocator1024 ta;
+	Array<Job> jobs(ta);
+	array::resize(jobs, num_jobs);
+	for (u32 i = 0; i < num_jobs; ++i)
+	{
+		const u32 first = i*CROWN_NAVIGATION_PATHS_PER_JOB;
+		_search_jobs[i].world = this;
+		_search_jobs[i].first = first;
+		_search_jobs[i].num = num - first < CROWN_NAVIGATION_PATHS_PER_JOB ? num - first : CROWN_NAVIGATION_PATHS_PER_JOB;
+
+		jobs[i].function = navigation_world_internal::search_job;
+		jobs[i].user_data = &_search_jobs[i];
+		jobs[i].counter = NULL;
+	}
+
+	job_system::run(array::begin(jobs), num_jobs, &_counter);
+}
+
+void NavigationWorld::wait()
+{
+	job_system::wait(_counter);
+}
+
+} // namespace crown
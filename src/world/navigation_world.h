@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "core/memory/types.h"
+#include "core/thread/atomic_int.h"
+#include "core/types.h"
+#include "resource/types.h"
+#include "world/types.h"
+
+namespace crown
+{
+/// Finds paths on a grid of cells loaded from a .nav_grid resource.
+///
+/// Paths are requested in batches with find_paths() and are searched by
+/// the job system: update() starts the requests made since the previous
+/// update and collects the paths of the requests it started before, so a
+/// path is usually available the frame after it has been requested.
+///
+/// @ingroup World
+struct NavigationWorld
+{
+	struct Request
+	{
+		Vector3 from;
+		Vector3 to;
+		u32 handle;
+		u32 status;     ///< PathStatus::Enum, written by the job.
+		u32 num_points;
+		Vector3* points; ///< Allocated by the job, owned by _paths when collected.
+	};
+
+	struct Path
+	{
+		u32 handle;
+		u32 status;
+		u32 num_points;
+		Vector3* points;
+	};
+
+	struct SearchJob
+	{
+		NavigationWorld* world;
+		u32 first;
+		u32 num;
+	};
+
+	u32 _marker;
+	Allocator* _allocator;
+	ResourceManager* _resource_manager;
+	u32 _width;
+	u32 _height;
+	f32 _cell_size;
+	Vector3 _origin;
+	Array<u8> _cells;
+	Array<Request> _queued;       ///< Requests waiting for the next update().
+	Array<Request> _running;      ///< Requests being searched by the jobs.
+	Array<SearchJob> _search_jobs;
+	AtomicInt _counter;           ///< Number of jobs still running.
+	HashMap<u32, u32> _path_index; ///< Index in _paths of each handle.
+	Array<Path> _paths;
+	u32 _next_handle;
+
+	///
+	NavigationWorld(Allocator& a, ResourceManager& rm);
+
+	///
+	~NavigationWorld();
+
+	/// Replaces the grid with the .nav_grid resource @a name.
+	/// Pending requests are searched on the new grid.
+	void set_grid(StringId64 name);
+
+	/// Marks as blocked the cells that contain static actors of @a pw
+	/// between @a step and @a height meters above the origin of the grid.
+	/// Obstacles lower than @a step can be walked over.
+	void block_static(PhysicsWorld& pw, f32 step, f32 height);
+
+	/// Returns whether the cell at @a pos can be walked.
+	bool is_walkable(const Vector3& pos) const;
+
+	/// Requests @a num paths, from @a from[i] to @a to[i], and returns the
+	/// handle of the first one. The handles of the others follow it.
+	u32 find_paths(const Vector3* from, const Vector3* to, u32 num);
+
+	/// Returns the status of the path @a handle.
+	PathStatus::Enum path_status(u32 handle) const;
+
+	/// Returns the points of the path @a handle, from the start to the goal.
+	/// The path must have been found.
+	void path(u32 handle, Array<Vector3>& points) const;
+
+	/// Destroys the path @a handle. Pending paths are discarded when found.
+	void destroy_path(u32 handle);
+
+	/// Collects the paths found since the previous call and starts
+	/// searching the paths requested since then.
+	void update();
+
+	/// Waits for the jobs started by update().
+	void wait();
+};
+
+} // namespace crown
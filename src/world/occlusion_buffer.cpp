@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/vector4.h"
+#include "world/occlusion_buffer.h"
+#include <float.h> // FLT_MAX
+#include <math.h>  // floorf
+
+namespace crown
+{
+OcclusionBuffer::OcclusionBuffer(Allocator& a)
+	: _depth(a)
+	, _offsets(a)
+	, _width(0)
+	, _height(0)
+	, _view_proj(MATRIX4X4_IDENTITY)
+	, _homogeneous_depth(false)
+	, _origin_bottom_left(false)
+	, _valid(false)
+{
+}
+
+void OcclusionBuffer::set(const f32* depth, u32 width, u32 height, const Matrix4x4& view_proj, bool homogeneous_depth, bool origin_bottom_left)
+{
+	CE_ENSURE(width > 0 && height > 0);
+
+	_width              = width;
+	_height             = height;
+	_view_proj          = view_proj;
+	_homogeneous_depth  = homogeneous_depth;
+	_origin_bottom_left = origin_bottom_left;
+	_valid              = true;
+
+	array::clear(_depth);
+	array::clear(_offsets);
+	array::push_back(_offsets, 0u);
+	array::push(_depth, depth, width*height);
+
+	// Each level keeps the farthest depth of 2x2 texels of the previous
+	// one. Odd sizes are rounded up so that every texel is covered.
+	u32 w = width;
+	u32 h = height;
+	while (w > 1 || h > 1)
+	{
+		const u32 src = array::back(_offsets);
+		const u32 lw = (w + 1) / 2;
+		const u32 lh = (h + 1) / 2;
+		array::push_back(_offsets, array::size(_depth));
+		array::resize(_depth, array::size(_depth) + lw*lh);
+
+		f32* dst = &_depth[array::back(_offsets)];
+		for (u32 y = 0; y < lh; ++y)
+		{
+			const u32 y0 = y*2;
+			const u32 y1 = y*2 + 1 < h ? y*2 + 1 : h - 1;
+
+			for (u32 x = 0; x < lw; ++x)
+			{
+				const u32 x0 = x*2;
+				const u32 x1 = x*2 + 1 < w ? x*2 + 1 : w - 1;
+
+				const f32 d0 = fmax(_depth[src + y0*w + x0], _depth[src + y0*w + x1]);
+				const f32 d1 = fmax(_depth[src + y1*w + x0], _depth[src + y1*w + x1]);
+				dst[y*lw + x] = fmax(d0, d1);
+			}
+		}
+
+		w = lw;
+		h = lh;
+	}
+}
+
+void OcclusionBuffer::reset()
+{
+	_valid = false;
+}
+
+// Returns the texel at @a t in [0, 1] along an axis with @a num texels.
+static u32 occlusion_texel(f32 t, u32 num)
+{
+	return u32(fclamp(floorf(t * num), 0.0f, num - 1.0f));
+}
+
+bool OcclusionBuffer::visible(const AABB& b) const
+{
+	if (!_valid)
+		return true;
+
+	// Bounds of the box in normalized device coordinates
+	f32 min_x = FLT_MAX;
+	f32 min_y = FLT_MAX;
+	f32 min_z = FLT_MAX;
+	f32 max_x = -FLT_MAX;
+	f32 max_y = -FLT_MAX;
+
+	for (u32 i = 0; i < 8; ++i)
+	{
+		const Vector4 p = vector4((i & 1) ? b.max.x : b.min.x
+			, (i & 2) ? b.max.y : b.min.y
+			, (i & 4) ? b.max.z : b.min.z
+			, 1.0f
+			) * _view_proj;
+
+		// Boxes crossing the near plane are never occluded
+		if (p.w <= 0.0001f)
+			return true;
+
+		const f32 inv_w = 1.0f / p.w;
+		min_x = fmin(min_x, p.x * inv_w);
+		min_y = fmin(min_y, p.y * inv_w);
+		min_z = fmin(min_z, p.z * inv_w);
+		max_x = fmax(max_x, p.x * inv_w);
+		max_y = fmax(max_y, p.y * inv_w);
+	}
+
+	// Nothing is known about what was outside the view
+	if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+		return true;
+
+	const f32 depth = _homogeneous_depth ? min_z*0.5f + 0.5f : min_z;
+
+	const u32 x0 = occlusion_texel(min_x*0.5f + 0.5f, _width);
+	const u32 x1 = occlusion_texel(max_x*0.5f + 0.5f, _width);
+	const u32 y0 = occlusion_texel(_origin_bottom_left ? min_y*0.5f + 0.5f : 0.5f - max_y*0.5f, _height);
+	const u32 y1 = occlusion_texel(_origin_bottom_left ? max_y*0.5f + 0.5f : 0.5f - min_y*0.5f, _height);
+
+	// Pick the finest level where the box covers at most 2x2 texels
+	u32 level = 0;
+	u32 w = _width;
+	while (level + 1 < array::size(_offsets)
+		&& ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)
+		)
+	{
+		++level;
+		w = (w + 1) / 2;
+	}
+
+	f32 max_depth = 0.0f;
+	const f32* level_depth = &_depth[_offsets[level]];
+	for (u32 y = y0 >> level; y <= y1 >> level; ++y)
+	{
+		for (u32 x = x0 >> level; x <= x1 >> level; ++x)
+			max_depth = fmax(max_depth, level_depth[y*w + x]);
+	}
+
+	return depth <= max_depth;
+}
+
+} // namespace crown
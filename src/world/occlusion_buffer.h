@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "core/types.h"
+#include "world/types.h"
+
+namespace crown
+{
+/// Hierarchical depth buffer read back from the GPU, used to skip the
+/// objects hidden behind others.
+///
+/// Level 0 is the depth read back, each following level stores the
+/// farthest depth of 2x2 texels of the previous one. Since the depth is
+/// the one of a previous frame, boxes are tested with the view-projection
+/// it was rendered with.
+///
+/// @ingroup World
+struct OcclusionBuffer
+{
+	Array<f32> _depth;    ///< All the levels, from the finest.
+	Array<u32> _offsets;  ///< Offset of each level in _depth.
+	u32 _width;           ///< Width of level 0.
+	u32 _height;          ///< Height of level 0.
+	Matrix4x4 _view_proj;
+	bool _homogeneous_depth;  ///< Whether clip-space depth is in [-1, 1].
+	bool _origin_bottom_left; ///< Whether the first row of the depth is the bottom one.
+	bool _valid;
+
+	///
+	OcclusionBuffer(Allocator& a);
+
+	/// Sets the @a width x @a height @a depth, rendered with @a view_proj,
+	/// and builds the levels from it.
+	void set(const f32* depth, u32 width, u32 height, const Matrix4x4& view_proj, bool homogeneous_depth, bool origin_bottom_left);
+
+	/// Invalidates the depth, every box is visible until the next set().
+	void reset();
+
+	/// Returns whether any part of the box @a b may be visible.
+	bool visible(const AABB& b) const;
+};
+
+} // namespace crown
@@ -14,6 +14,29 @@ namespace crown
 {
 struct PhysicsWorldImpl;
 
+/// Poses of the actors moved by the last simulation step and of the
+/// movers moved by the last update, stored as parallel arrays so that
+/// they can be applied in bulk.
+/// The arrays are cleared but never shrunk, so their memory is reused
+/// from one frame to the next.
+struct PhysicsTransformEvents
+{
+	Array<UnitId> unit;
+	Array<u32> actor;                  ///< Index of the actor or of the mover, opaque outside of PhysicsWorld.
+	Array<TransformInstance> transform; ///< Transform of the unit cached by the actor or the mover, may be stale.
+	Array<Vector3> position;           ///< In world-space.
+	Array<Quaternion> rotation;        ///< In world-space.
+
+	PhysicsTransformEvents(Allocator& a)
+		: unit(a)
+		, actor(a)
+		, transform(a)
+		, position(a)
+		, rotation(a)
+	{
+	}
+};
+
 /// Manages physics objects in a World.
 ///
 /// @ingroup World
@@ -29,6 +52,9 @@ struct PhysicsWorld
 	///
 	~PhysicsWorld();
 
+	/// Makes room for @a num_colliders and @a num_actors more instances.
+	void reserve(u32 num_colliders, u32 num_actors);
+
 	///
 	ColliderInstance collider_create(UnitId id, const ColliderDesc* sd);
 
@@ -121,6 +147,11 @@ struct PhysicsWorld
 	/// @note This call only affects nonkinematic actors.
 	void actor_set_linear_velocity(ActorInstance i, const Vector3& vel);
 
+	/// Sets the linear velocity of each of the @a num @a actors to the
+	/// corresponding velocity in @a vels.
+	/// @note This call only affects nonkinematic actors.
+	void actor_set_linear_velocities(const ActorInstance* actors, const Vector3* vels, u32 num);
+
 	/// Returns the angular velocity of the actor.
 	Vector3 actor_angular_velocity(ActorInstance i) const;
 
@@ -154,6 +185,50 @@ struct PhysicsWorld
 	/// Wakes the actor up.
 	void actor_wake_up(ActorInstance i);
 
+	/// Sets the maximum linear velocity of the actor.
+	/// Static actors are not affected.
+	void actor_set_max_linear_velocity(ActorInstance i, f32 velocity);
+
+	/// Sets whether the actor reports collision events.
+	/// Collisions between two actors are reported if any of them reports.
+	void actor_set_report_contacts(ActorInstance i, bool report);
+
+	/// Sets the @a num @a positions the LOD distances in the physics config
+	/// are measured from, usually those of the cameras. Dynamic actors
+	/// farther than "lod.reduced_distance" from all of them fall asleep
+	/// sooner, those farther than "lod.sleep_distance" are put to sleep.
+	/// With no observers all the actors are simulated normally.
+	void set_lod_observers(const Vector3* positions, u32 num);
+
+	/// Creates a mover for the unit @a id at the position of @a tm. A mover
+	/// is a kinematic capsule which slides along the actors it hits, climbs
+	/// steps and sticks to the ground. Movers do not collide with each other
+	/// and do not push the actors.
+	MoverInstance mover_create(UnitId id, const MoverDesc& md, const Matrix4x4& tm);
+
+	///
+	void mover_destroy(MoverInstance i);
+
+	/// Returns the mover of the unit @a id.
+	MoverInstance mover(UnitId id);
+
+	/// Returns the world position of the feet of the mover.
+	Vector3 mover_position(MoverInstance i) const;
+
+	/// Sets the velocity of each of the @a num @a movers to the
+	/// corresponding velocity in @a velocities. The movers keep moving at
+	/// that velocity at each update() until it is changed.
+	void mover_set_velocities(const MoverInstance* movers, const Vector3* velocities, u32 num);
+
+	/// Returns whether the mover stood on the ground at the end of the last update().
+	bool mover_on_ground(MoverInstance i) const;
+
+	/// Returns whether the mover hit something on its sides during the last update().
+	bool mover_collides_sides(MoverInstance i) const;
+
+	/// Returns whether the mover hit something above its head during the last update().
+	bool mover_collides_up(MoverInstance i) const;
+
 	/// Creates joint
 	JointInstance joint_create(ActorInstance a0, ActorInstance a1, const JointDesc& jd);
 
@@ -172,6 +247,12 @@ struct PhysicsWorld
 	/// Casts a box into the physics world and returns info about the closest collision if any.
 	bool cast_box(RaycastHit& hit, const Vector3& from, const Vector3& half_extents, const Vector3& dir, f32 len);
 
+	/// Runs the @a num @a casts and writes the closest collision of each
+	/// one to @a hits. The actor of the casts that hit nothing is invalid.
+	/// Returns the number of casts that hit something. Casts are run in
+	/// parallel when Bullet is built thread-safe (CROWN_PHYSICS_BULLET_MT).
+	u32 cast_batch(RaycastHit* hits, const PhysicsCast* casts, u32 num);
+
 	/// Returns the gravity.
 	Vector3 gravity() const;
 
@@ -180,17 +261,53 @@ struct PhysicsWorld
 
 	void update_actor_world_poses(const UnitId* begin, const UnitId* end, const Matrix4x4* begin_world);
 
-	/// Updates the physics simulation.
+	/// Moves all the movers by their velocity, in parallel when Bullet is
+	/// built thread-safe (CROWN_PHYSICS_BULLET_MT), then updates the
+	/// physics simulation.
 	void update(f32 dt);
 
 	///
 	EventStream& events();
 
+	/// Returns the poses of the actors and of the movers moved by the last update().
+	PhysicsTransformEvents& transform_events();
+
+	/// Caches on the actors and the movers of @a events their transforms,
+	/// once they have been refreshed by SceneGraph::set_world_poses().
+	void update_transform_cache(const PhysicsTransformEvents& events);
+
 	/// Draws debug lines.
 	void debug_draw();
 
 	///
 	void enable_debug_drawing(bool enable);
+
+	/// Sets whether to @a enable running the simulation steps on a worker
+	/// thread. When enabled, update() publishes the results of the step
+	/// started by the previous update() and starts the next one, so that
+	/// physics overlaps the rest of the frame with one step of latency.
+	/// The other functions wait for the running step to complete.
+	void enable_async_update(bool enable);
+
+	/// Sets the @a frequency, in Hz, of the fixed substeps of the simulation.
+	void set_step_frequency(f32 frequency);
+
+	/// Sets the maximum @a num of substeps per update(). The simulated time
+	/// in excess is dropped and recorded as physics_world.dropped_time.
+	void set_max_substeps(u32 num);
+
+	/// Sets the @a num of iterations of the constraint solver per substep.
+	void set_solver_iterations(u32 num);
+
+	/// Appends the pose, velocities and activation state of the actors to @a buf.
+	void snapshot(Buffer& buf);
+
+	/// Returns whether the state at @a data, written by snapshot(), has
+	/// actors for the same units as this.
+	bool can_restore(const char* data);
+
+	/// Restores the state at @a data, written by snapshot().
+	void restore(const char* data);
 };
 
 } // namespace crown
@@ -10,21 +10,28 @@
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/math/color4.h"
+#include "core/math/math.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/quaternion.h"
 #include "core/math/vector3.h"
 #include "core/memory/proxy_allocator.h"
+#include "core/thread/job_system.h"
 #include "device/log.h"
+#include "device/profiler.h"
 #include "resource/physics_resource.h"
 #include "resource/resource_manager.h"
 #include "world/debug_line.h"
 #include "world/physics.h"
 #include "world/physics_world.h"
+#include "world/snapshot.h"
 #include "world/unit_manager.h"
+#define BT_THREADSAFE CROWN_PHYSICS_BULLET_MT
+#include <BulletCollision/BroadphaseCollision/btAxisSweep3.h>
 #include <BulletCollision/BroadphaseCollision/btDbvtBroadphase.h>
 #include <BulletCollision/CollisionDispatch/btCollisionObject.h>
 #include <BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h>
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <BulletCollision/CollisionDispatch/btSimulationIslandManager.h>
 #include <BulletCollision/CollisionShapes/btBoxShape.h>
 #include <BulletCollision/CollisionShapes/btBvhTriangleMeshShape.h>
 #include <BulletCollision/CollisionShapes/btCapsuleShape.h>
@@ -40,41 +47,153 @@
 #include <BulletDynamics/ConstraintSolver/btPoint2PointConstraint.h>
 #include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
 #include <BulletDynamics/ConstraintSolver/btSliderConstraint.h>
-#define BT_THREADSAFE 0
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
 #include <BulletDynamics/Dynamics/btRigidBody.h>
 #include <LinearMath/btDefaultMotionState.h>
 #include <LinearMath/btIDebugDraw.h>
+#include <LinearMath/btQuickprof.h>
+#include <algorithm> // std::sort
+#include <float.h> // FLT_MAX
+#include <string.h> // memcpy
+#if CROWN_PHYSICS_BULLET_MT
+	#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+	#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+	#include <LinearMath/btThreads.h>
+#endif
 
 namespace { const crown::log_internal::System PHYSICS = { "physics" }; }
 
 namespace crown
 {
+#if CROWN_PHYSICS_BULLET_MT
+/// Runs the parallel loops of the multithreaded Bullet classes on the
+/// job system.
+struct JobTaskScheduler : public btITaskScheduler
+{
+	JobTaskScheduler()
+		: btITaskScheduler("crown")
+	{
+	}
+
+	int getMaxNumThreads() const
+	{
+		return BT_MAX_THREAD_COUNT;
+	}
+
+	int getNumThreads() const
+	{
+		return (int)job_system::num_threads();
+	}
+
+	void setNumThreads(int /*num*/)
+	{
+	}
+
+	static void for_loop(u32 begin, u32 end, void* user_data)
+	{
+		((const btIParallelForBody*)user_data)->forLoop((int)begin, (int)end);
+	}
+
+	void parallelFor(int begin, int end, int grain_size, const btIParallelForBody& body)
+	{
+		job_system::parallel_for((u32)begin, (u32)end, (u32)grain_size, for_loop, (void*)&body);
+	}
+};
+#endif // CROWN_PHYSICS_BULLET_MT
+
+/// Broadphase @a T which profiles the pair update of each substep.
+template <typename T>
+struct ProfiledBroadphase : public T
+{
+	ProfiledBroadphase()
+		: T()
+	{
+	}
+
+	template <typename A0, typename A1, typename A2>
+	ProfiledBroadphase(const A0& a0, const A1& a1, A2 a2)
+		: T(a0, a1, a2)
+	{
+	}
+
+	virtual void calculateOverlappingPairs(btDispatcher* dispatcher)
+	{
+		ENTER_PROFILE_SCOPE("physics_world.broadphase");
+		T::calculateOverlappingPairs(dispatcher);
+		LEAVE_PROFILE_SCOPE();
+		RECORD_FLOAT("physics_world.broadphase_pairs", (f32)this->getOverlappingPairCache()->getNumOverlappingPairs());
+	}
+};
+
 namespace physics_globals
 {
-	static btDefaultCollisionConfiguration* _bt_configuration;
-	static btCollisionDispatcher* _bt_dispatcher;
-	static btBroadphaseInterface* _bt_interface;
-	static btSequentialImpulseConstraintSolver* _bt_solver;
+#if CROWN_PHYSICS_BULLET_MT
+	static JobTaskScheduler* _task_scheduler = NULL;
+#endif
+	static btEnterProfileZoneFunc* _enter_profile_zone = NULL;
+	static btLeaveProfileZoneFunc* _leave_profile_zone = NULL;
+
+#if CROWN_DEBUG
+	// Bullet's profile zones (broadphase, narrowphase, solver etc.) are
+	// recorded as scopes of the engine profiler
+	static void enter_profile_zone(const char* name)
+	{
+		ENTER_PROFILE_SCOPE(name);
+	}
+
+	static void leave_profile_zone()
+	{
+		LEAVE_PROFILE_SCOPE();
+	}
+#else
+	static void enter_profile_zone(const char* /*name*/)
+	{
+	}
+
+	static void leave_profile_zone()
+	{
+	}
+#endif // CROWN_DEBUG
 
+	// Collision configuration, dispatcher, broadphase and solver are all
+	// stateful and they are owned by each PhysicsWorld, so that different
+	// worlds can be simulated at the same time.
 	void init(Allocator& a)
 	{
-		_bt_configuration = CE_NEW(a, btDefaultCollisionConfiguration);
-		_bt_dispatcher    = CE_NEW(a, btCollisionDispatcher)(_bt_configuration);
-		_bt_interface     = CE_NEW(a, btDbvtBroadphase);
-		_bt_solver        = CE_NEW(a, btSequentialImpulseConstraintSolver);
+		_enter_profile_zone = btGetCurrentEnterProfileZoneFunc();
+		_leave_profile_zone = btGetCurrentLeaveProfileZoneFunc();
+		btSetCustomEnterProfileZoneFunc(enter_profile_zone);
+		btSetCustomLeaveProfileZoneFunc(leave_profile_zone);
+
+#if CROWN_PHYSICS_BULLET_MT
+		_task_scheduler = CE_NEW(a, JobTaskScheduler)();
+		btSetTaskScheduler(_task_scheduler);
+#else
+		CE_UNUSED(a);
+#endif
 	}
 
 	void shutdown(Allocator& a)
 	{
-		CE_DELETE(a, _bt_solver);
-		CE_DELETE(a, _bt_interface);
-		CE_DELETE(a, _bt_dispatcher);
-		CE_DELETE(a, _bt_configuration);
+#if CROWN_PHYSICS_BULLET_MT
+		btSetTaskScheduler(btGetSequentialTaskScheduler());
+		CE_DELETE(a, _task_scheduler);
+		_task_scheduler = NULL;
+#else
+		CE_UNUSED(a);
+#endif
+
+		btSetCustomEnterProfileZoneFunc(_enter_profile_zone);
+		btSetCustomLeaveProfileZoneFunc(_leave_profile_zone);
 	}
 
 } // namespace physics_globals
 
+static const f32 LINEAR_SLEEPING_THRESHOLD  = 0.5f; // FIXME
+static const f32 ANGULAR_SLEEPING_THRESHOLD = 0.7f; // FIXME
+static const f32 MOVER_SKIN_WIDTH = 0.01f; // Distance kept by the movers from the surfaces they hit
+static const u32 MOVER_EVENT_BIT = 0x80000000u; // Marks the movers in PhysicsTransformEvents::actor
+
 static btVector3 to_btVector3(const Vector3& v)
 {
 	return btVector3(v.x, v.y, v.z);
@@ -161,71 +280,382 @@ struct MyFilterCallback : public btOverlapFilterCallback
 	}
 };
 
+/// Finds the closest surface hit by the sweep of a mover. Triggers and
+/// the surfaces the mover is moving away from are ignored, so that the
+/// mover does not get stuck on the surfaces it is touching.
+struct MoverSweepCallback : public btCollisionWorld::ClosestConvexResultCallback
+{
+	btVector3 _delta;
+
+	MoverSweepCallback(const btVector3& from, const btVector3& to)
+		: btCollisionWorld::ClosestConvexResultCallback(from, to)
+		, _delta(to - from)
+	{
+		// Collide with everything
+		m_collisionFilterGroup = -1;
+		m_collisionFilterMask = -1;
+	}
+
+	btScalar addSingleResult(btCollisionWorld::LocalConvexResult& result, bool normal_in_world_space)
+	{
+		if (!result.m_hitCollisionObject->hasContactResponse())
+			return btScalar(1.0);
+
+		const btVector3 normal = normal_in_world_space
+			? result.m_hitNormalLocal
+			: result.m_hitCollisionObject->getWorldTransform().getBasis() * result.m_hitNormalLocal
+			;
+		if (normal.dot(_delta) >= btScalar(0.0))
+			return btScalar(1.0);
+
+		return btCollisionWorld::ClosestConvexResultCallback::addSingleResult(result, normal_in_world_space);
+	}
+};
+
+/// Motion state of the movable actors. Bullet sets the world transform of
+/// the active bodies only, after each substep: the first time it does so
+/// in a step, the actor is added to the list of the actors moved. The
+/// velocity of the actor is clamped at the same time, so that sleeping
+/// actors cost nothing.
+struct ActorMotionState : public btDefaultMotionState
+{
+	Array<u32>* _moved_actors;
+	btRigidBody* _body;
+	f32 _max_linear_velocity; ///< 0 if unlimited.
+	bool _moved;
+
+	ActorMotionState(const btTransform& tr, Array<u32>& moved_actors, f32 max_linear_velocity)
+		: btDefaultMotionState(tr)
+		, _moved_actors(&moved_actors)
+		, _body(NULL)
+		, _max_linear_velocity(max_linear_velocity)
+		, _moved(false)
+	{
+	}
+
+	void setWorldTransform(const btTransform& tr)
+	{
+		btDefaultMotionState::setWorldTransform(tr);
+
+		if (_max_linear_velocity > 0.0f)
+		{
+			const btVector3 velocity = _body->getLinearVelocity();
+			const btScalar speed = velocity.length();
+			if (speed > _max_linear_velocity)
+				_body->setLinearVelocity(velocity * (_max_linear_velocity / speed));
+		}
+
+		if (!_moved)
+		{
+			array::push_back(*_moved_actors, (u32)(uintptr_t)_body->getUserPointer());
+			_moved = true;
+		}
+	}
+};
+
+/// Allocates blocks of a fixed maximum size from chunks of the backing
+/// allocator. Chunks are only returned to the backing allocator on
+/// destruction, so that objects created and destroyed at a high rate
+/// recycle the same blocks.
+struct BlockPool : public Allocator
+{
+	Allocator* _backing;
+	u32 _block_size;
+	u32 _block_align;
+	void* _freelist;
+	u32 _num_free;
+	u32 _num_allocations;
+	Array<void*> _chunks;
+
+	BlockPool(Allocator& backing, u32 block_size, u32 block_align)
+		: _backing(&backing)
+		, _block_size(block_size < sizeof(void*) ? sizeof(void*) : block_size)
+		, _block_align(block_align < alignof(void*) ? alignof(void*) : block_align)
+		, _freelist(NULL)
+		, _num_free(0)
+		, _num_allocations(0)
+		, _chunks(backing)
+	{
+	}
+
+	~BlockPool()
+	{
+		CE_ASSERT(_num_allocations == 0, "%u blocks still allocated", _num_allocations);
+
+		for (u32 i = 0; i < array::size(_chunks); ++i)
+			_backing->deallocate(_chunks[i]);
+	}
+
+	/// Makes sure that @a num blocks can be allocated without allocating
+	/// from the backing allocator.
+	void reserve(u32 num)
+	{
+		if (num > _num_free)
+			add_chunk(num - _num_free);
+	}
+
+	void add_chunk(u32 num)
+	{
+		const u32 stride = (_block_size + _block_align - 1) & ~(_block_align - 1);
+		char* mem = (char*)_backing->allocate(num*stride, _block_align);
+
+		for (u32 i = 0; i < num - 1; ++i)
+			*(void**)(mem + i*stride) = mem + (i + 1)*stride;
+		*(void**)(mem + (num - 1)*stride) = _freelist;
+
+		_freelist = mem;
+		_num_free += num;
+		array::push_back(_chunks, (void*)mem);
+	}
+
+	void* allocate(u32 size, u32 align = Allocator::DEFAULT_ALIGN)
+	{
+		CE_ASSERT(size <= _block_size, "Size must not exceed block size");
+		CE_UNUSED(size);
+		CE_ASSERT(_block_align % align == 0, "Align must divide block align");
+		CE_UNUSED(align);
+
+		// Grow geometrically
+		if (_freelist == NULL)
+			add_chunk(_num_allocations > CROWN_PHYSICS_POOL_CHUNK_SIZE ? _num_allocations : CROWN_PHYSICS_POOL_CHUNK_SIZE);
+
+		void* data = _freelist;
+		_freelist = *(void**)data;
+		--_num_free;
+		++_num_allocations;
+		return data;
+	}
+
+	void deallocate(void* data)
+	{
+		if (!data)
+			return;
+
+		CE_ASSERT(_num_allocations > 0, "Did not allocate");
+		*(void**)data = _freelist;
+		_freelist = data;
+		++_num_free;
+		--_num_allocations;
+	}
+
+	u32 allocated_size(const void* /*ptr*/)
+	{
+		return SIZE_NOT_TRACKED;
+	}
+
+	u32 total_allocated()
+	{
+		return _num_allocations * _block_size;
+	}
+};
+
 struct PhysicsWorldImpl
 {
 	struct ColliderInstanceData
 	{
 		UnitId unit;
 		Matrix4x4 local_tm;
-		btTriangleIndexVertexArray* vertex_array;
+		const ColliderDesc* desc;
 		btCollisionShape* shape;
 		ColliderInstance next;
 	};
 
+	/// Shape shared by all the colliders created from the same descriptor.
+	struct ShapeData
+	{
+		const ColliderDesc* desc;
+		btTriangleIndexVertexArray* vertex_array;
+		btCollisionShape* shape;
+		btQuantizedBvh* bvh; ///< Deserialized in place, NULL if the shape owns its BVH.
+		u32 num_refs;
+	};
+
 	struct ActorInstanceData
 	{
 		UnitId unit;
 		btRigidBody* actor;
+		bool report_contacts;
+		u32 lod; ///< LodLevel::Enum
+	};
+
+	/// Character moved by collide-and-slide.
+	struct MoverData
+	{
+		UnitId unit;
+		btCapsuleShape* shape;
+		Vector3 position;     ///< Feet, in world-space.
+		Quaternion rotation;  ///< In world-space, not used by the collisions.
+		Vector3 velocity;     ///< In world-space.
+		f32 half_height;      ///< Distance from the feet to the center of the capsule.
+		f32 step_height;
+		f32 min_ground_dot;   ///< Cosine of the maximum slope.
+		u32 flags;            ///< MoverFlags::Enum
+		bool moved;           ///< Whether the last update moved the mover.
+	};
+
+	struct MoverFlags
+	{
+		enum Enum
+		{
+			ON_GROUND      = 1 << 0,
+			COLLIDES_SIDES = 1 << 1,
+			COLLIDES_UP    = 1 << 2
+		};
+	};
+
+	/// Level of detail of the simulation of an actor.
+	struct LodLevel
+	{
+		enum Enum
+		{
+			FULL,    ///< Simulated normally.
+			REDUCED, ///< Falls asleep sooner.
+			ASLEEP   ///< Put to sleep by the LOD, woken up when back in range.
+		};
+	};
+
+	/// Pair of actors touching each other.
+	struct Contact
+	{
+		const btPersistentManifold* manifold;
+		const btCollisionObject* objects[2];
+		u32 step; ///< Step in which the contact began.
+		Vector3 position;
+		Vector3 normal;
+		f32 distance;
+
+		bool operator<(const Contact& other) const
+		{
+			return manifold < other.manifold;
+		}
 	};
 
 	Allocator* _allocator;
 	UnitManager* _unit_manager;
+	BlockPool _body_pool;         ///< btRigidBody
+	BlockPool _motion_state_pool; ///< ActorMotionState
+	BlockPool _compound_pool;     ///< btCompoundShape
 
 	HashMap<UnitId, u32> _collider_map;
 	HashMap<UnitId, u32> _actor_map;
+	HashMap<UnitId, u32> _mover_map;
 	Array<ColliderInstanceData> _collider;
 	Array<ActorInstanceData> _actor;
+	Array<MoverData> _mover;
+	Array<TransformInstance> _mover_transform; ///< Cached transform of each mover, may be stale.
+	HashMap<u64, u32> _shape_map; ///< Index into _shape by address of the descriptor.
+	Array<ShapeData> _shape;
+	Array<TransformInstance> _actor_transform; ///< Cached transform of each actor, may be stale.
+	Array<u32> _moved_actors;                  ///< Actors moved by the running step.
+	Array<Contact> _contacts;      ///< Contacts as of the last substep, sorted by manifold.
+	Array<Contact> _tick_contacts; ///< Contacts found by the current substep.
+	Array<Vector3> _lod_observers; ///< Positions the LOD distances are measured from.
+	u32 _step_id;
 	Array<btTypedConstraint*> _joints;
 
 	MyFilterCallback _filter_callback;
+	btDefaultCollisionConfiguration* _bt_configuration;
+	btCollisionDispatcher* _bt_dispatcher;
+	btBroadphaseInterface* _bt_interface;
+	btConstraintSolver* _bt_solver;
 	btDiscreteDynamicsWorld* _dynamics_world;
 	MyDebugDrawer _debug_drawer;
 
-	EventStream _events;
+	EventStream _events;                                ///< Written by the step.
+	PhysicsTransformEvents _transform_events;           ///< Written by the step.
+	EventStream _completed_events;                      ///< Events of the completed steps.
+	PhysicsTransformEvents _completed_transform_events; ///< Poses of the completed steps.
 
 	const PhysicsConfigResource* _config_resource;
 	bool _debug_drawing;
+	bool _async;
+	f32 _step_dt;
+	f32 _step_frequency;
+	u32 _max_substeps;
+	f32 _step_accumulator; ///< Mirrors the time left over by Bullet from the last substep.
+	AtomicInt _step_counter; ///< Non-zero while a step is running on a worker.
 
 	PhysicsWorldImpl(Allocator& a, ResourceManager& rm, UnitManager& um, DebugLine& dl)
 		: _allocator(&a)
 		, _unit_manager(&um)
+		, _body_pool(a, sizeof(btRigidBody), alignof(btRigidBody))
+		, _motion_state_pool(a, sizeof(ActorMotionState), alignof(ActorMotionState))
+		, _compound_pool(a, sizeof(btCompoundShape), alignof(btCompoundShape))
 		, _collider_map(a)
 		, _actor_map(a)
+		, _mover_map(a)
 		, _collider(a)
 		, _actor(a)
+		, _mover(a)
+		, _mover_transform(a)
+		, _shape_map(a)
+		, _shape(a)
+		, _actor_transform(a)
+		, _moved_actors(a)
+		, _contacts(a)
+		, _tick_contacts(a)
+		, _lod_observers(a)
+		, _step_id(0)
 		, _joints(a)
+		, _bt_configuration(NULL)
+		, _bt_dispatcher(NULL)
+		, _bt_interface(NULL)
+		, _bt_solver(NULL)
 		, _dynamics_world(NULL)
 		, _debug_drawer(dl)
 		, _events(a)
+		, _transform_events(a)
+		, _completed_events(a)
+		, _completed_transform_events(a)
 		, _debug_drawing(false)
-	{
-		_dynamics_world = CE_NEW(*_allocator, btDiscreteDynamicsWorld)(physics_globals::_bt_dispatcher
-			, physics_globals::_bt_interface
-			, physics_globals::_bt_solver
-			, physics_globals::_bt_configuration
+		, _async(false)
+		, _step_dt(0.0f)
+		, _step_frequency(60.0f)
+		, _max_substeps(7)
+		, _step_accumulator(0.0f)
+		, _step_counter(0)
+	{
+		_config_resource = (const PhysicsConfigResource*)rm.get(RESOURCE_TYPE_PHYSICS_CONFIG, "global"_id64);
+
+#if CROWN_PHYSICS_BULLET_MT
+		// Narrowphase, islands and solver run in parallel on the job system,
+		// with one solver per thread
+		_bt_configuration = CE_NEW(*_allocator, btDefaultCollisionConfiguration);
+		_bt_dispatcher    = CE_NEW(*_allocator, btCollisionDispatcherMt)(_bt_configuration, CROWN_PHYSICS_DISPATCHER_GRAIN_SIZE);
+		_bt_interface     = broadphase_create(_config_resource);
+		btConstraintSolverPoolMt* solver_pool = CE_NEW(*_allocator, btConstraintSolverPoolMt)(job_system::num_threads());
+		_bt_solver        = solver_pool;
+		_dynamics_world   = CE_NEW(*_allocator, btDiscreteDynamicsWorldMt)(_bt_dispatcher
+			, _bt_interface
+			, solver_pool
+			, _bt_configuration
+			);
+#else
+		_bt_configuration = CE_NEW(*_allocator, btDefaultCollisionConfiguration);
+		_bt_dispatcher    = CE_NEW(*_allocator, btCollisionDispatcher)(_bt_configuration);
+		_bt_interface     = broadphase_create(_config_resource);
+		_bt_solver        = CE_NEW(*_allocator, btSequentialImpulseConstraintSolver);
+		_dynamics_world   = CE_NEW(*_allocator, btDiscreteDynamicsWorld)(_bt_dispatcher
+			, _bt_interface
+			, _bt_solver
+			, _bt_configuration
 			);
+#endif
 
 		_dynamics_world->getCollisionWorld()->setDebugDrawer(&_debug_drawer);
 		_dynamics_world->setInternalTickCallback(tick_cb, this);
 		_dynamics_world->getPairCache()->setOverlapFilterCallback(&_filter_callback);
 
-		_config_resource = (const PhysicsConfigResource*)rm.get(RESOURCE_TYPE_PHYSICS_CONFIG, StringId64("global"));
+		_step_frequency = _config_resource->step_frequency;
+		_max_substeps = _config_resource->max_substeps;
+		_dynamics_world->getSolverInfo().m_numIterations = (int)_config_resource->solver_iterations;
 
 		um.register_destroy_function(PhysicsWorldImpl::unit_destroyed_callback, this);
 	}
 
 	~PhysicsWorldImpl()
 	{
+		wait_step();
 		_unit_manager->unregister_destroy_function(this);
 
 		for (u32 i = 0; i < array::size(_actor); ++i)
@@ -233,24 +663,83 @@ struct PhysicsWorldImpl
 			btRigidBody* rb = _actor[i].actor;
 
 			_dynamics_world->removeRigidBody(rb);
-			CE_DELETE(*_allocator, rb->getMotionState());
-			CE_DELETE(*_allocator, rb->getCollisionShape());
-			CE_DELETE(*_allocator, rb);
+			CE_DELETE(_motion_state_pool, rb->getMotionState());
+			CE_DELETE(_compound_pool, rb->getCollisionShape());
+			CE_DELETE(_body_pool, rb);
 		}
 
-		for (u32 i = 0; i < array::size(_collider); ++i)
+		for (u32 i = 0; i < array::size(_mover); ++i)
+			CE_DELETE(*_allocator, _mover[i].shape);
+
+		for (u32 i = 0; i < array::size(_shape); ++i)
+			shape_delete(_shape[i]);
+
+		CE_DELETE(*_allocator, _dynamics_world);
+		CE_DELETE(*_allocator, _bt_solver);
+		CE_DELETE(*_allocator, _bt_interface);
+		CE_DELETE(*_allocator, _bt_dispatcher);
+		CE_DELETE(*_allocator, _bt_configuration);
+	}
+
+	btBroadphaseInterface* broadphase_create(const PhysicsConfigResource* pcr)
+	{
+		switch (pcr->broadphase_type)
 		{
-			CE_DELETE(*_allocator, _collider[i].vertex_array);
-			CE_DELETE(*_allocator, _collider[i].shape);
+		case PhysicsBroadphaseType::DBVT:
+			{
+				btDbvtBroadphase* dbvt = CE_NEW(*_allocator, ProfiledBroadphase<btDbvtBroadphase>)();
+				dbvt->m_prediction     = pcr->broadphase_prediction;
+				dbvt->m_dupdates       = (int)pcr->broadphase_dynamic_updates;
+				dbvt->m_fupdates       = (int)pcr->broadphase_fixed_updates;
+				dbvt->m_deferedcollide = pcr->broadphase_deferred_collide != 0;
+				return dbvt;
+			}
+
+		case PhysicsBroadphaseType::AXIS_SWEEP:
+			{
+				const btVector3 world_min = to_btVector3(pcr->broadphase_world_min);
+				const btVector3 world_max = to_btVector3(pcr->broadphase_world_max);
+
+				// Handles are 16-bit up to 32767 objects
+				if (pcr->broadphase_max_handles < 32767)
+					return CE_NEW(*_allocator, ProfiledBroadphase<btAxisSweep3>)(world_min, world_max, (unsigned short)pcr->broadphase_max_handles);
+				else
+					return CE_NEW(*_allocator, ProfiledBroadphase<bt32BitAxisSweep3>)(world_min, world_max, (unsigned int)pcr->broadphase_max_handles);
+			}
+
+		default:
+			CE_FATAL("Unknown broadphase type");
+			return NULL;
 		}
+	}
 
-		CE_DELETE(*_allocator, _dynamics_world);
+	void reserve(u32 num_colliders, u32 num_actors)
+	{
+		array::reserve(_collider, array::size(_collider) + num_colliders);
+		hash_map::reserve(_collider_map, hash_map::size(_collider_map) + num_colliders);
+		array::reserve(_actor, array::size(_actor) + num_actors);
+		_body_pool.reserve(num_actors);
+		_motion_state_pool.reserve(num_actors);
+		_compound_pool.reserve(num_actors);
+		hash_map::reserve(_actor_map, hash_map::size(_actor_map) + num_actors);
 	}
 
-	ColliderInstance collider_create(UnitId id, const ColliderDesc* sd)
+	/// Returns the shape described by @a sd, creating it if no collider
+	/// references it yet. Descriptors live in the unit resources, so
+	/// units spawned from the same resource share the same shapes.
+	btCollisionShape* shape_acquire(const ColliderDesc* sd)
 	{
+		const u64 key = (u64)(uintptr_t)sd;
+		const u32 si = hash_map::get(_shape_map, key, UINT32_MAX);
+		if (si != UINT32_MAX)
+		{
+			++_shape[si].num_refs;
+			return _shape[si].shape;
+		}
+
 		btTriangleIndexVertexArray* vertex_array = NULL;
 		btCollisionShape* child_shape = NULL;
+		btQuantizedBvh* bvh = NULL;
 
 		switch(sd->type)
 		{
@@ -296,9 +785,27 @@ struct PhysicsWorldImpl
 				vertex_array = CE_NEW(*_allocator, btTriangleIndexVertexArray)();
 				vertex_array->addIndexedMesh(part, PHY_SHORT);
 
-				const btVector3 aabb_min(-1000.0f,-1000.0f,-1000.0f);
-				const btVector3 aabb_max(1000.0f,1000.0f,1000.0f);
-				child_shape = CE_NEW(*_allocator, btBvhTriangleMeshShape)(vertex_array, false, aabb_min, aabb_max);
+				const char* bvh_data       = indices + num_indices*sizeof(u16);
+				const u32 bvh_pointer_size = *(u32*)bvh_data;
+				const u32 bvh_size         = *(u32*)(bvh_data + sizeof(u32));
+
+				if (bvh_size > 0 && bvh_pointer_size == sizeof(void*))
+				{
+					// Use the BVH built by the data compiler
+					void* mem = _allocator->allocate(bvh_size, 16);
+					memcpy(mem, bvh_data + sizeof(u32)*2, bvh_size);
+					bvh = btQuantizedBvh::deSerializeInPlace(mem, bvh_size, false);
+
+					btBvhTriangleMeshShape* mesh_shape = CE_NEW(*_allocator, btBvhTriangleMeshShape)(vertex_array, true, false);
+					mesh_shape->setOptimizedBvh((btOptimizedBvh*)bvh);
+					child_shape = mesh_shape;
+				}
+				else
+				{
+					const btVector3 aabb_min(-1000.0f,-1000.0f,-1000.0f);
+					const btVector3 aabb_max(1000.0f,1000.0f,1000.0f);
+					child_shape = CE_NEW(*_allocator, btBvhTriangleMeshShape)(vertex_array, false, aabb_min, aabb_max);
+				}
 			}
 			break;
 
@@ -311,14 +818,62 @@ struct PhysicsWorldImpl
 			break;
 		}
 
+		ShapeData sdata;
+		sdata.desc         = sd;
+		sdata.vertex_array = vertex_array;
+		sdata.shape        = child_shape;
+		sdata.bvh          = bvh;
+		sdata.num_refs     = 1;
+
+		hash_map::set(_shape_map, key, array::size(_shape));
+		array::push_back(_shape, sdata);
+		return child_shape;
+	}
+
+	void shape_delete(ShapeData& sd)
+	{
+		CE_DELETE(*_allocator, sd.shape);
+		CE_DELETE(*_allocator, sd.vertex_array);
+
+		if (sd.bvh)
+		{
+			sd.bvh->~btQuantizedBvh();
+			_allocator->deallocate(sd.bvh);
+		}
+	}
+
+	void shape_release(const ColliderDesc* sd)
+	{
+		const u64 key = (u64)(uintptr_t)sd;
+		const u32 si = hash_map::get(_shape_map, key, UINT32_MAX);
+		CE_ASSERT(si != UINT32_MAX, "Shape not found");
+
+		if (--_shape[si].num_refs > 0)
+			return;
+
+		shape_delete(_shape[si]);
+
+		const u32 last = array::size(_shape) - 1;
+		if (si != last)
+		{
+			_shape[si] = _shape[last];
+			hash_map::set(_shape_map, (u64)(uintptr_t)_shape[si].desc, si);
+		}
+
+		array::pop_back(_shape);
+		hash_map::remove(_shape_map, key);
+	}
+
+	ColliderInstance collider_create(UnitId id, const ColliderDesc* sd)
+	{
 		const u32 last = array::size(_collider);
 
 		ColliderInstanceData cid;
-		cid.unit         = id;
-		cid.local_tm     = sd->local_tm;
-		cid.vertex_array = vertex_array;
-		cid.shape        = child_shape;
-		cid.next.i       = UINT32_MAX;
+		cid.unit     = id;
+		cid.local_tm = sd->local_tm;
+		cid.desc     = sd;
+		cid.shape    = shape_acquire(sd);
+		cid.next.i   = UINT32_MAX;
 
 		ColliderInstance ci = collider_first(id);
 		while (is_valid(ci) && is_valid(collider_next(ci)))
@@ -345,8 +900,7 @@ struct PhysicsWorldImpl
 		collider_swap_node(last_i, i);
 		collider_remove_node(first_i, i);
 
-		CE_DELETE(*_allocator, _collider[i.i].vertex_array);
-		CE_DELETE(*_allocator, _collider[i.i].shape);
+		shape_release(_collider[i.i].desc);
 
 		_collider[i.i] = _collider[last];
 
@@ -434,7 +988,7 @@ struct PhysicsWorldImpl
 		const f32  mass         = is_dynamic ? ar->mass : 0.0f;
 
 		// Create compound shape
-		btCompoundShape* shape = CE_NEW(*_allocator, btCompoundShape)(true);
+		btCompoundShape* shape = CE_NEW(_compound_pool, btCompoundShape)(true);
 		ColliderInstance ci = collider_first(id);
 		while (is_valid(ci))
 		{
@@ -444,9 +998,9 @@ struct PhysicsWorldImpl
 
 		// Create motion state
 		const btTransform tr = to_btTransform(tm);
-		btDefaultMotionState* ms = is_static
+		ActorMotionState* ms = is_static
 			? NULL
-			: CE_NEW(*_allocator, btDefaultMotionState)(tr)
+			: CE_NEW(_motion_state_pool, ActorMotionState)(tr, _moved_actors, actor_class->max_linear_velocity)
 			;
 
 		// If dynamic, calculate inertia
@@ -461,11 +1015,13 @@ struct PhysicsWorldImpl
 		rbinfo.m_restitution              = material->restitution;
 		rbinfo.m_friction                 = material->friction;
 		rbinfo.m_rollingFriction          = material->rolling_friction;
-		rbinfo.m_linearSleepingThreshold  = 0.5f; // FIXME
-		rbinfo.m_angularSleepingThreshold = 0.7f; // FIXME
+		rbinfo.m_linearSleepingThreshold  = LINEAR_SLEEPING_THRESHOLD;
+		rbinfo.m_angularSleepingThreshold = ANGULAR_SLEEPING_THRESHOLD;
 
 		// Create rigid body
-		btRigidBody* actor = CE_NEW(*_allocator, btRigidBody)(rbinfo);
+		btRigidBody* actor = CE_NEW(_body_pool, btRigidBody)(rbinfo);
+		if (ms)
+			ms->_body = actor;
 
 		int cflags = actor->getCollisionFlags();
 		cflags |= is_kinematic ? btCollisionObject::CF_KINEMATIC_OBJECT : 0;
@@ -488,16 +1044,20 @@ struct PhysicsWorldImpl
 		actor->setUserPointer((void*)(uintptr_t)last);
 
 		// Set collision filters
-		const u32 me   = physics_config_resource::filter(_config_resource, ar->collision_filter)->me;
-		const u32 mask = physics_config_resource::filter(_config_resource, ar->collision_filter)->mask;
+		const PhysicsCollisionFilter* filter = physics_config_resource::filter(_config_resource, ar->collision_filter);
+		const u32 me   = filter->me;
+		const u32 mask = filter->mask;
 
 		_dynamics_world->addRigidBody(actor, me, mask);
 
 		ActorInstanceData aid;
 		aid.unit  = id;
 		aid.actor = actor;
+		aid.report_contacts = (actor_class->flags & PhysicsActor::REPORT_CONTACTS) != 0 && filter->report_contacts != 0;
+		aid.lod   = LodLevel::FULL;
 
 		array::push_back(_actor, aid);
+		array::push_back(_actor_transform, make_transform_instance(UINT32_MAX));
 		hash_map::set(_actor_map, id, last);
 
 		return make_actor_instance(last);
@@ -509,15 +1069,26 @@ struct PhysicsWorldImpl
 		const UnitId u      = _actor[i.i].unit;
 		const UnitId last_u = _actor[last].unit;
 
+		// Forget the contacts of the actor without reporting their end
+		u32 num_contacts = 0;
+		for (u32 c = 0; c < array::size(_contacts); ++c)
+		{
+			if (_contacts[c].objects[0] != _actor[i.i].actor && _contacts[c].objects[1] != _actor[i.i].actor)
+				_contacts[num_contacts++] = _contacts[c];
+		}
+		array::resize(_contacts, num_contacts);
+
 		_dynamics_world->removeRigidBody(_actor[i.i].actor);
-		CE_DELETE(*_allocator, _actor[i.i].actor->getMotionState());
-		CE_DELETE(*_allocator, _actor[i.i].actor->getCollisionShape());
-		CE_DELETE(*_allocator, _actor[i.i].actor);
+		CE_DELETE(_motion_state_pool, _actor[i.i].actor->getMotionState());
+		CE_DELETE(_compound_pool, _actor[i.i].actor->getCollisionShape());
+		CE_DELETE(_body_pool, _actor[i.i].actor);
 
 		_actor[i.i] = _actor[last];
 		_actor[i.i].actor->setUserPointer((void*)(uintptr_t)i.i);
+		_actor_transform[i.i] = _actor_transform[last];
 
 		array::pop_back(_actor);
+		array::pop_back(_actor_transform);
 
 		hash_map::set(_actor_map, last_u, i.i);
 		hash_map::remove(_actor_map, u);
@@ -724,6 +1295,92 @@ struct PhysicsWorldImpl
 		_actor[i.i].actor->activate(true);
 	}
 
+	void actor_set_max_linear_velocity(ActorInstance i, f32 velocity)
+	{
+		ActorMotionState* ms = (ActorMotionState*)_actor[i.i].actor->getMotionState();
+		if (ms)
+			ms->_max_linear_velocity = velocity;
+	}
+
+	void actor_set_report_contacts(ActorInstance i, bool report)
+	{
+		_actor[i.i].report_contacts = report;
+	}
+
+	MoverInstance mover_create(UnitId id, const MoverDesc& md, const Matrix4x4& tm)
+	{
+		CE_ASSERT(!hash_map::has(_mover_map, id), "Unit already has a mover");
+		CE_ASSERT(md.radius > 0.0f, "Radius must be > 0");
+
+		MoverData mv;
+		mv.unit           = id;
+		mv.shape          = CE_NEW(*_allocator, btCapsuleShape)(md.radius, fmax(md.height - 2.0f*md.radius, 0.0f));
+		mv.position       = translation(tm);
+		mv.rotation       = rotation(tm);
+		mv.velocity       = VECTOR3_ZERO;
+		mv.half_height    = fmax(md.height*0.5f, md.radius);
+		mv.step_height    = md.step_height;
+		mv.min_ground_dot = fcos(md.max_slope);
+		mv.flags          = 0;
+		mv.moved          = false;
+
+		const u32 last = array::size(_mover);
+		array::push_back(_mover, mv);
+		array::push_back(_mover_transform, make_transform_instance(UINT32_MAX));
+		hash_map::set(_mover_map, id, last);
+
+		return make_mover_instance(last);
+	}
+
+	void mover_destroy(MoverInstance i)
+	{
+		const u32 last      = array::size(_mover) - 1;
+		const UnitId u      = _mover[i.i].unit;
+		const UnitId last_u = _mover[last].unit;
+
+		CE_DELETE(*_allocator, _mover[i.i].shape);
+
+		_mover[i.i] = _mover[last];
+		_mover_transform[i.i] = _mover_transform[last];
+
+		array::pop_back(_mover);
+		array::pop_back(_mover_transform);
+
+		hash_map::set(_mover_map, last_u, i.i);
+		hash_map::remove(_mover_map, u);
+	}
+
+	MoverInstance mover(UnitId id)
+	{
+		return make_mover_instance(hash_map::get(_mover_map, id, UINT32_MAX));
+	}
+
+	Vector3 mover_position(MoverInstance i) const
+	{
+		return _mover[i.i].position;
+	}
+
+	void mover_set_velocities(const MoverInstance* movers, const Vector3* velocities, u32 num)
+	{
+		for (u32 i = 0; i < num; ++i)
+			_mover[movers[i].i].velocity = velocities[i];
+	}
+
+	bool mover_on_ground(MoverInstance i) const
+	{
+		return (_mover[i.i].flags & MoverFlags::ON_GROUND) != 0;
+	}
+
+	bool mover_collides_sides(MoverInstance i) const
+	{
+		return (_mover[i.i].flags & MoverFlags::COLLIDES_SIDES) != 0;
+	}
+
+	bool mover_collides_up(MoverInstance i) const
+	{
+		return (_mover[i.i].flags & MoverFlags::COLLIDES_UP) != 0;
+	}
+
 	JointInstance joint_create(ActorInstance a0, ActorInstance a1, const JointDesc& jd)
 	{
 		const btVector3 anchor_0 = to_btVector3(jd.anchor_0);
@@ -893,75 +1550,579 @@ struct PhysicsWorldImpl
 		return cast(hit, &shape, from, dir, len);
 	}
 
-	Vector3 gravity() const
+	struct CastBatchData
 	{
-		return to_vector3(_dynamics_world->getGravity());
-	}
+		PhysicsWorldImpl* world;
+		RaycastHit* hits;
+		const PhysicsCast* casts;
+	};
 
-	void set_gravity(const Vector3& g)
+	static void cast_batch_job(u32 begin, u32 end, void* user_data)
 	{
-		_dynamics_world->setGravity(to_btVector3(g));
-	}
+		CastBatchData* cbd = (CastBatchData*)user_data;
 
-	void update_actor_world_poses(const UnitId* begin, const UnitId* end, const Matrix4x4* begin_world)
-	{
-		for (; begin != end; ++begin, ++begin_world)
+		for (u32 i = begin; i < end; ++i)
 		{
-			const u32 ai = hash_map::get(_actor_map, *begin, UINT32_MAX);
-			if (ai == UINT32_MAX)
-				continue;
-
-			const Quaternion rot = rotation(*begin_world);
-			const Vector3 pos = translation(*begin_world);
-			// http://www.bulletphysics.org/mediawiki-1.5.8/index.php/MotionStates
-			btMotionState* ms = _actor[ai].actor->getMotionState();
-			if (ms)
-				ms->setWorldTransform(btTransform(to_btQuaternion(rot), to_btVector3(pos)));
-		}
-	}
+			const PhysicsCast& pc = cbd->casts[i];
+			RaycastHit& hit = cbd->hits[i];
+			bool has_hit = false;
 
-	void update(f32 dt)
-	{
-		// 12Hz to 120Hz
-		_dynamics_world->stepSimulation(dt, 7, 1.0f/60.0f);
+			switch (pc.type)
+			{
+			case PhysicsCast::RAY:
+				has_hit = cbd->world->cast_ray(hit, pc.from, pc.dir, pc.len);
+				break;
 
-		const int num = _dynamics_world->getNumCollisionObjects();
-		const btCollisionObjectArray& collision_array = _dynamics_world->getCollisionObjectArray();
-	    // Update actors
-		for (int i = 0; i < num; ++i)
-		{
-			if ((uintptr_t)collision_array[i]->getUserPointer() == (uintptr_t)UINT32_MAX)
-				continue;
+			case PhysicsCast::SPHERE:
+				has_hit = cbd->world->cast_sphere(hit, pc.from, pc.half_extents.x, pc.dir, pc.len);
+				break;
 
-			btRigidBody* body = btRigidBody::upcast(collision_array[i]);
-			if (body
-				&& body->getMotionState()
-				&& body->isActive()
-				)
-			{
-				const UnitId unit_id = _actor[(u32)(uintptr_t)body->getUserPointer()].unit;
+			case PhysicsCast::BOX:
+				has_hit = cbd->world->cast_box(hit, pc.from, pc.half_extents, pc.dir, pc.len);
+				break;
 
-				btTransform tr;
-				body->getMotionState()->getWorldTransform(tr);
+			default:
+				CE_FATAL("Unknown cast type");
+				break;
+			}
 
-				// Post transform event
-				{
-					PhysicsTransformEvent ev;
-					ev.unit_id = unit_id;
-					ev.position = to_vector3(tr.getOrigin());
-					ev.rotation = to_quaternion(tr.getRotation());
-					event_stream::write(_events, EventType::PHYSICS_TRANSFORM, ev);
-				}
+			if (!has_hit)
+			{
+				hit.unit    = UNIT_INVALID;
+				hit.actor.i = UINT32_MAX;
 			}
 		}
 	}
 
-	EventStream& events()
+	u32 cast_batch(RaycastHit* hits, const PhysicsCast* casts, u32 num)
 	{
-		return _events;
+		CastBatchData cbd;
+		cbd.world = this;
+		cbd.hits  = hits;
+		cbd.casts = casts;
+
+#if CROWN_PHYSICS_BULLET_MT
+		// Queries only read the world, the broadphase keeps a ray test
+		// stack per thread when Bullet is built thread-safe
+		job_system::parallel_for(0, num, CROWN_PHYSICS_CAST_GRAIN_SIZE, cast_batch_job, &cbd);
+#else
+		cast_batch_job(0, num, &cbd);
+#endif
+
+		u32 num_hits = 0;
+		for (u32 i = 0; i < num; ++i)
+			num_hits += hits[i].actor.i != UINT32_MAX;
+
+		return num_hits;
 	}
 
-	void debug_draw()
+	/// Sweeps the capsule of @a mv, rotated by @a rot, from the feet
+	/// position @a from by @a delta. Returns the fraction of @a delta
+	/// travelled before the closest hit, 1.0 if nothing was hit, and
+	/// writes the normal of the surface hit to @a normal.
+	f32 mover_sweep(Vector3& normal, const MoverData& mv, const btQuaternion& rot, const Vector3& up, const Vector3& from, const Vector3& delta) const
+	{
+		const Vector3 center = from + up*mv.half_height;
+		const btTransform aa(rot, to_btVector3(center));
+		const btTransform bb(rot, to_btVector3(center + delta));
+
+		MoverSweepCallback cb(aa.getOrigin(), bb.getOrigin());
+		_dynamics_world->convexSweepTest(mv.shape, aa, bb, cb);
+		CE_COUNTER_INC("physics_world.mover_sweeps");
+
+		if (!cb.hasHit())
+			return 1.0f;
+
+		normal = to_vector3(cb.m_hitNormalWorld);
+		return (f32)cb.m_closestHitFraction;
+	}
+
+	/// Moves @a mv by its velocity for @a dt seconds: steps up, slides
+	/// along the surfaces hit while moving sideways, then steps down and
+	/// snaps to the ground if it was standing on it.
+	void mover_move(MoverData& mv, f32 dt, const btQuaternion& rot, const Vector3& up) const
+	{
+		const Vector3 disp = mv.velocity*dt;
+		const f32 disp_up = dot(disp, up);
+		const bool was_on_ground = (mv.flags & MoverFlags::ON_GROUND) != 0;
+		const f32 snap = was_on_ground && disp_up <= 0.0f ? mv.step_height : 0.0f;
+		Vector3 pos = mv.position;
+		Vector3 normal;
+		u32 flags = 0;
+
+		// Step up, together with the upward part of the displacement
+		const f32 rise = (was_on_ground ? mv.step_height : 0.0f) + fmax(disp_up, 0.0f);
+		f32 risen = 0.0f;
+		if (rise > 0.0f)
+		{
+			const f32 t = mover_sweep(normal, mv, rot, up, pos, up*rise);
+			risen = t < 1.0f ? fmax(rise*t - MOVER_SKIN_WIDTH, 0.0f) : rise;
+			if (t < 1.0f)
+				flags |= MoverFlags::COLLIDES_UP;
+			pos += up*risen;
+		}
+
+		// Move sideways, sliding along the surfaces hit
+		Vector3 move = disp - up*disp_up;
+		for (u32 i = 0; i < CROWN_PHYSICS_MOVER_ITERATIONS; ++i)
+		{
+			const f32 len = length(move);
+			if (len <= MOVER_SKIN_WIDTH*0.1f)
+				break;
+
+			const f32 t = mover_sweep(normal, mv, rot, up, pos, move);
+			if (t >= 1.0f)
+			{
+				pos += move;
+				break;
+			}
+
+			flags |= MoverFlags::COLLIDES_SIDES;
+			const f32 travelled = fmax(len*t - MOVER_SKIN_WIDTH, 0.0f) / len;
+			pos += move*travelled;
+
+			// Slide the rest along the surface, climbing is left to the steps
+			move = move*(1.0f - travelled);
+			move -= normal*dot(move, normal);
+			move -= up*dot(move, up);
+		}
+
+		// Step down by what was climbed, plus the downward part of the
+		// displacement and, if standing on the ground, the snap distance
+		const f32 descent = fmax(risen - fmax(disp_up, 0.0f), 0.0f) + fmax(-disp_up, 0.0f);
+		const f32 fall = descent + snap;
+		if (fall > 0.0f)
+		{
+			const f32 t = mover_sweep(normal, mv, rot, up, pos, -up*fall);
+			if (t >= 1.0f)
+			{
+				pos -= up*descent;
+			}
+			else if (dot(normal, up) >= mv.min_ground_dot)
+			{
+				pos -= up*fmax(fall*t - MOVER_SKIN_WIDTH, 0.0f);
+				flags |= MoverFlags::ON_GROUND;
+			}
+			else
+			{
+				// Too steep to stand on, slide down along it
+				const f32 fallen = fmin(fmax(fall*t - MOVER_SKIN_WIDTH, 0.0f), descent);
+				pos -= up*fallen;
+
+				Vector3 slide = -up*(descent - fallen);
+				slide -= normal*dot(slide, normal);
+				if (length(slide) > MOVER_SKIN_WIDTH*0.1f)
+				{
+					const f32 ts = mover_sweep(normal, mv, rot, up, pos, slide);
+					pos += slide*(ts < 1.0f ? fmax(ts - MOVER_SKIN_WIDTH/length(slide), 0.0f) : 1.0f);
+				}
+			}
+		}
+
+		mv.moved = !(pos == mv.position);
+		mv.position = pos;
+		mv.flags = flags;
+	}
+
+	struct MoverUpdateData
+	{
+		PhysicsWorldImpl* world;
+		f32 dt;
+		btQuaternion rot;
+		Vector3 up;
+	};
+
+	static void mover_update_job(u32 begin, u32 end, void* user_data)
+	{
+		MoverUpdateData* mud = (MoverUpdateData*)user_data;
+
+		for (u32 i = begin; i < end; ++i)
+		{
+			MoverData& mv = mud->world->_mover[i];
+
+			// Movers at rest on the ground have nowhere to go
+			if (mv.velocity == VECTOR3_ZERO && (mv.flags & MoverFlags::ON_GROUND) != 0)
+			{
+				mv.moved = false;
+				continue;
+			}
+
+			mud->world->mover_move(mv, mud->dt, mud->rot, mud->up);
+		}
+	}
+
+	/// Moves all the movers and posts the poses of those that moved.
+	/// Must not run concurrently with a step.
+	void update_movers(f32 dt)
+	{
+		const u32 num = array::size(_mover);
+		if (num == 0)
+			return;
+
+		ENTER_PROFILE_SCOPE("physics_world.movers");
+
+		// Movers stand against the gravity
+		Vector3 up = -gravity();
+		if (length(up) > 0.0f)
+			normalize(up);
+		else
+			up = VECTOR3_YAXIS;
+
+		MoverUpdateData mud;
+		mud.world = this;
+		mud.dt    = dt;
+		mud.rot   = shortestArcQuat(btVector3(0.0f, 1.0f, 0.0f), to_btVector3(up));
+		mud.up    = up;
+
+#if CROWN_PHYSICS_BULLET_MT
+		// Sweeps only read the world and each job writes its own movers
+		job_system::parallel_for(0, num, CROWN_PHYSICS_MOVER_GRAIN_SIZE, mover_update_job, &mud);
+#else
+		mover_update_job(0, num, &mud);
+#endif
+
+		// Post the poses of the movers moved
+		PhysicsTransformEvents& te = _completed_transform_events;
+		for (u32 i = 0; i < num; ++i)
+		{
+			if (!_mover[i].moved)
+				continue;
+
+			array::push_back(te.unit, _mover[i].unit);
+			array::push_back(te.actor, MOVER_EVENT_BIT | i);
+			array::push_back(te.transform, _mover_transform[i]);
+			array::push_back(te.position, _mover[i].position);
+			array::push_back(te.rotation, _mover[i].rotation);
+		}
+
+		LEAVE_PROFILE_SCOPE();
+	}
+
+	Vector3 gravity() const
+	{
+		return to_vector3(_dynamics_world->getGravity());
+	}
+
+	void set_gravity(const Vector3& g)
+	{
+		_dynamics_world->setGravity(to_btVector3(g));
+	}
+
+	void update_actor_world_poses(const UnitId* begin, const UnitId* end, const Matrix4x4* begin_world)
+	{
+		for (; begin != end; ++begin, ++begin_world)
+		{
+			const u32 mi = hash_map::get(_mover_map, *begin, UINT32_MAX);
+			if (mi != UINT32_MAX)
+			{
+				_mover[mi].position = translation(*begin_world);
+				_mover[mi].rotation = rotation(*begin_world);
+			}
+
+			const u32 ai = hash_map::get(_actor_map, *begin, UINT32_MAX);
+			if (ai == UINT32_MAX)
+				continue;
+
+			const Quaternion rot = rotation(*begin_world);
+			const Vector3 pos = translation(*begin_world);
+			// http://www.bulletphysics.org/mediawiki-1.5.8/index.php/MotionStates
+			// Bypass the tracking of the actors moved by the simulation
+			ActorMotionState* ms = (ActorMotionState*)_actor[ai].actor->getMotionState();
+			if (ms)
+				ms->btDefaultMotionState::setWorldTransform(btTransform(to_btQuaternion(rot), to_btVector3(pos)));
+		}
+	}
+
+	void set_lod_observers(const Vector3* positions, u32 num)
+	{
+		array::clear(_lod_observers);
+		array::push(_lod_observers, positions, num);
+
+		// Without observers every actor is simulated normally
+		if (num == 0)
+		{
+			for (u32 i = 0; i < array::size(_actor); ++i)
+				actor_set_lod(i, LodLevel::FULL);
+		}
+	}
+
+	void actor_set_lod(u32 i, LodLevel::Enum lod)
+	{
+		btRigidBody* rb = _actor[i].actor;
+		const LodLevel::Enum prev = (LodLevel::Enum)_actor[i].lod;
+		if (lod == prev)
+			return;
+
+		if (lod == LodLevel::REDUCED)
+		{
+			const f32 scale = _config_resource->lod_reduced_sleep_scale;
+			rb->setSleepingThresholds(LINEAR_SLEEPING_THRESHOLD*scale, ANGULAR_SLEEPING_THRESHOLD*scale);
+		}
+		else
+		{
+			rb->setSleepingThresholds(LINEAR_SLEEPING_THRESHOLD, ANGULAR_SLEEPING_THRESHOLD);
+		}
+
+		if (lod == LodLevel::ASLEEP)
+		{
+			if (rb->isActive())
+				rb->setActivationState(ISLAND_SLEEPING);
+		}
+		else if (prev == LodLevel::ASLEEP)
+		{
+			rb->activate(true);
+		}
+
+		_actor[i].lod = lod;
+	}
+
+	/// Assigns the LOD of the dynamic actors by their distance from the
+	/// nearest observer.
+	void update_lod()
+	{
+		const f32 reduced_distance = _config_resource->lod_reduced_distance;
+		const f32 sleep_distance = _config_resource->lod_sleep_distance;
+		if (array::size(_lod_observers) == 0 || (reduced_distance == 0.0f && sleep_distance == 0.0f))
+			return;
+
+		const f32 reduced_distance_sq = reduced_distance*reduced_distance;
+		const f32 sleep_distance_sq = sleep_distance*sleep_distance;
+		u32 num_reduced = 0;
+		u32 num_asleep = 0;
+
+		for (u32 i = 0; i < array::size(_actor); ++i)
+		{
+			const btRigidBody* rb = _actor[i].actor;
+			if (rb->isStaticOrKinematicObject())
+				continue;
+
+			const Vector3 pos = to_vector3(rb->getWorldTransform().getOrigin());
+			f32 dist_sq = FLT_MAX;
+			for (u32 j = 0; j < array::size(_lod_observers); ++j)
+				dist_sq = fmin(dist_sq, length_squared(pos - _lod_observers[j]));
+
+			LodLevel::Enum lod = LodLevel::FULL;
+			if (sleep_distance != 0.0f && dist_sq > sleep_distance_sq)
+				lod = LodLevel::ASLEEP;
+			else if (reduced_distance != 0.0f && dist_sq > reduced_distance_sq)
+				lod = LodLevel::REDUCED;
+
+			// Actors put to sleep are woken up by contacts with active
+			// ones, they stay in the LOD but are not forced asleep again
+			// until they come back in range
+			actor_set_lod(i, lod);
+			num_reduced += lod == LodLevel::REDUCED;
+			num_asleep += lod == LodLevel::ASLEEP;
+		}
+
+		RECORD_FLOAT("physics_world.lod_reduced", (f32)num_reduced);
+		RECORD_FLOAT("physics_world.lod_asleep", (f32)num_asleep);
+	}
+
+	/// Records the counters of the simulation state after a step.
+	void record_stats()
+	{
+		u32 num_active = 0;
+		u32 num_sleeping = 0;
+		for (u32 i = 0; i < array::size(_actor); ++i)
+		{
+			const btRigidBody* rb = _actor[i].actor;
+			if (rb->isStaticObject())
+				continue;
+
+			if (rb->isActive())
+				++num_active;
+			else
+				++num_sleeping;
+		}
+
+		// Elements are sorted by island after the islands are built
+		btUnionFind& uf = _dynamics_world->getSimulationIslandManager()->getUnionFind();
+		u32 num_islands = 0;
+		for (int i = 0; i < uf.getNumElements(); ++i)
+		{
+			if (i == 0 || uf.getElement(i).m_id != uf.getElement(i - 1).m_id)
+				++num_islands;
+		}
+
+		btDispatcher* dispatcher = _dynamics_world->getDispatcher();
+		const int num_manifolds = dispatcher->getNumManifolds();
+		u32 num_contacts = 0;
+		for (int i = 0; i < num_manifolds; ++i)
+			num_contacts += (u32)dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+
+		RECORD_FLOAT("physics_world.active_bodies", (f32)num_active);
+		RECORD_FLOAT("physics_world.sleeping_bodies", (f32)num_sleeping);
+		RECORD_FLOAT("physics_world.islands", (f32)num_islands);
+		RECORD_FLOAT("physics_world.manifolds", (f32)num_manifolds);
+		RECORD_FLOAT("physics_world.contact_points", (f32)num_contacts);
+	}
+
+	void step(f32 dt)
+	{
+		// Bullet silently drops the substeps exceeding the maximum, track
+		// them to report the simulated time lost
+		const f32 fixed_dt = 1.0f / _step_frequency;
+		_step_accumulator += dt;
+		const u32 num_substeps = u32(_step_accumulator / fixed_dt);
+		_step_accumulator -= f32(num_substeps) * fixed_dt;
+		const u32 num_dropped = num_substeps > _max_substeps ? num_substeps - _max_substeps : 0;
+
+		update_lod();
+
+		++_step_id;
+		_dynamics_world->stepSimulation(dt, (int)_max_substeps, fixed_dt);
+
+		// Report the contacts which began in a previous step and persist
+		if (num_substeps > 0)
+		{
+			for (u32 i = 0; i < array::size(_contacts); ++i)
+			{
+				if (_contacts[i].step != _step_id)
+					post_collision_event(PhysicsCollisionEvent::TOUCHING, _contacts[i]);
+			}
+		}
+
+		RECORD_FLOAT("physics_world.substeps", f32(num_substeps - num_dropped));
+		RECORD_FLOAT("physics_world.dropped_time", f32(num_dropped) * fixed_dt);
+#if CROWN_DEBUG
+		record_stats();
+#else
+		CE_UNUSED(num_dropped);
+#endif
+
+		// Post the poses of the actors moved by the step
+		const u32 num = array::size(_moved_actors);
+		const u32 first = array::size(_transform_events.unit);
+		array::resize(_transform_events.unit, first + num);
+		array::resize(_transform_events.actor, first + num);
+		array::resize(_transform_events.position, first + num);
+		array::resize(_transform_events.rotation, first + num);
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const u32 ai = _moved_actors[i];
+			ActorMotionState* ms = (ActorMotionState*)_actor[ai].actor->getMotionState();
+			ms->_moved = false;
+
+			const btTransform& tr = ms->m_graphicsWorldTrans;
+			_transform_events.unit[first + i]     = _actor[ai].unit;
+			_transform_events.actor[first + i]    = ai;
+			_transform_events.position[first + i] = to_vector3(tr.getOrigin());
+			_transform_events.rotation[first + i] = to_quaternion(tr.getRotation());
+		}
+		array::clear(_moved_actors);
+	}
+
+	/// Waits for the step running on a worker, if any.
+	void wait_step()
+	{
+		job_system::wait(_step_counter);
+	}
+
+	/// Appends the results of the last step to the completed ones.
+	void complete_step()
+	{
+		array::push(_completed_events, array::begin(_events), array::size(_events));
+		array::push(_completed_transform_events.unit, array::begin(_transform_events.unit), array::size(_transform_events.unit));
+		array::push(_completed_transform_events.actor, array::begin(_transform_events.actor), array::size(_transform_events.actor));
+		array::push(_completed_transform_events.position, array::begin(_transform_events.position), array::size(_transform_events.position));
+		array::push(_completed_transform_events.rotation, array::begin(_transform_events.rotation), array::size(_transform_events.rotation));
+
+		// The cached transforms are only accessed from the main thread
+		const u32 first = array::size(_completed_transform_events.transform);
+		const u32 num = array::size(_transform_events.actor);
+		array::resize(_completed_transform_events.transform, first + num);
+		for (u32 i = 0; i < num; ++i)
+			_completed_transform_events.transform[first + i] = _actor_transform[_transform_events.actor[i]];
+
+		array::clear(_events);
+		array::clear(_transform_events.unit);
+		array::clear(_transform_events.actor);
+		array::clear(_transform_events.position);
+		array::clear(_transform_events.rotation);
+	}
+
+	void update_transform_cache(const PhysicsTransformEvents& events)
+	{
+		const u32 num = array::size(events.actor);
+		for (u32 i = 0; i < num; ++i)
+		{
+			const u32 ai = events.actor[i];
+			if (ai & MOVER_EVENT_BIT)
+				_mover_transform[ai & ~MOVER_EVENT_BIT] = events.transform[i];
+			else
+				_actor_transform[ai] = events.transform[i];
+		}
+	}
+
+	static void step_job(void* user_data)
+	{
+		PhysicsWorldImpl* pw = (PhysicsWorldImpl*)user_data;
+		pw->step(pw->_step_dt);
+	}
+
+	void update(f32 dt)
+	{
+		wait_step();
+		update_movers(dt);
+
+		if (_async)
+		{
+			// Publish the results of the step started by the previous
+			// update and start the next one
+			complete_step();
+
+			_step_dt = dt;
+			Job job;
+			job.function = step_job;
+			job.user_data = this;
+			job.counter = NULL;
+			job_system::run(&job, 1, &_step_counter);
+		}
+		else
+		{
+			step(dt);
+			complete_step();
+		}
+	}
+
+	EventStream& events()
+	{
+		return _completed_events;
+	}
+
+	PhysicsTransformEvents& transform_events()
+	{
+		return _completed_transform_events;
+	}
+
+	void enable_async_update(bool enable)
+	{
+		wait_step();
+		_async = enable;
+	}
+
+	void set_step_frequency(f32 frequency)
+	{
+		CE_ASSERT(frequency > 0.0f, "Frequency must be greater than zero");
+		_step_frequency = frequency;
+		_step_accumulator = 0.0f;
+	}
+
+	void set_max_substeps(u32 num)
+	{
+		CE_ASSERT(num > 0, "Max substeps must be greater than zero");
+		_max_substeps = num;
+	}
+
+	void set_solver_iterations(u32 num)
+	{
+		CE_ASSERT(num > 0, "Solver iterations must be greater than zero");
+		_dynamics_world->getSolverInfo().m_numIterations = (int)num;
+	}
+
+	void debug_draw()
 	{
 		if (!_debug_drawing)
 			return;
@@ -976,52 +2137,171 @@ struct PhysicsWorldImpl
 		_debug_drawing = enable;
 	}
 
-	void tick_callback(btDynamicsWorld* world, btScalar /*dt*/)
+	/// State of the body of an actor in a snapshot.
+	struct ActorState
 	{
-		// Limit bodies velocity
-		for (u32 i = 0; i < array::size(_actor); ++i)
+		btTransform transform; ///< Center of mass.
+		btVector3 linear_velocity;
+		btVector3 angular_velocity;
+		UnitId unit;
+		s32 activation_state;
+		f32 deactivation_time;
+	};
+
+	void snapshot(Buffer& buf)
+	{
+		const u32 num = array::size(_actor);
+		snapshot::write(buf, num);
+
+		for (u32 i = 0; i < num; ++i)
 		{
-			CE_ENSURE(NULL != _actor[i].actor);
-			const btVector3 velocity = _actor[i].actor->getLinearVelocity();
-			const btScalar speed = velocity.length();
+			const btRigidBody* rb = _actor[i].actor;
+
+			ActorState as;
+			memset(&as, 0, sizeof(as));
+			as.transform         = rb->getCenterOfMassTransform();
+			as.linear_velocity   = rb->getLinearVelocity();
+			as.angular_velocity  = rb->getAngularVelocity();
+			as.unit              = _actor[i].unit;
+			as.activation_state  = rb->getActivationState();
+			as.deactivation_time = rb->getDeactivationTime();
+			snapshot::write(buf, as);
+		}
+	}
+
+	bool can_restore(const char* data)
+	{
+		u32 num;
+		snapshot::read(data, num);
+		if (num != array::size(_actor))
+			return false;
 
-			if (speed > 100.0f)
-				_actor[i].actor->setLinearVelocity(velocity * 100.0f / speed);
+		for (u32 i = 0; i < num; ++i)
+		{
+			const ActorState as = snapshot::element<ActorState>(data, i);
+			if (!hash_map::has(_actor_map, as.unit))
+				return false;
+		}
+
+		return true;
+	}
+
+	void restore(const char* data)
+	{
+		u32 num;
+		snapshot::read(data, num);
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			const ActorState as = snapshot::element<ActorState>(data, i);
+			btRigidBody* rb = _actor[actor(as.unit).i].actor;
+
+			rb->setCenterOfMassTransform(as.transform);
+			rb->setInterpolationWorldTransform(as.transform);
+			rb->getMotionState()->setWorldTransform(as.transform);
+			rb->setLinearVelocity(as.linear_velocity);
+			rb->setAngularVelocity(as.angular_velocity);
+			rb->setInterpolationLinearVelocity(as.linear_velocity);
+			rb->setInterpolationAngularVelocity(as.angular_velocity);
+			rb->clearForces();
+			rb->forceActivationState(as.activation_state);
+			rb->setDeactivationTime(as.deactivation_time);
 		}
+	}
 
-		// Check collisions
-		int num_manifolds = world->getDispatcher()->getNumManifolds();
+	void post_collision_event(PhysicsCollisionEvent::Type type, const Contact& c)
+	{
+		const ActorInstance a0 = make_actor_instance((u32)(uintptr_t)c.objects[0]->getUserPointer());
+		const ActorInstance a1 = make_actor_instance((u32)(uintptr_t)c.objects[1]->getUserPointer());
+
+		PhysicsCollisionEvent ev;
+		ev.type = type;
+		ev.units[0] = _actor[a0.i].unit;
+		ev.units[1] = _actor[a1.i].unit;
+		ev.actors[0] = a0;
+		ev.actors[1] = a1;
+		ev.position = c.position;
+		ev.normal = c.normal;
+		ev.distance = c.distance;
+		event_stream::write(_events, EventType::PHYSICS_COLLISION, ev);
+	}
+
+	void tick_callback(btDynamicsWorld* world, btScalar /*dt*/)
+	{
+		// Find the pairs touching, at their deepest point, among the ones
+		// reporting contacts
+		array::clear(_tick_contacts);
+
+		const int num_manifolds = world->getDispatcher()->getNumManifolds();
 		for (int i = 0; i < num_manifolds; ++i)
 		{
 			const btPersistentManifold* manifold = world->getDispatcher()->getManifoldByIndexInternal(i);
-
 			const btCollisionObject* obj_a = manifold->getBody0();
 			const btCollisionObject* obj_b = manifold->getBody1();
-			const ActorInstance a0 = make_actor_instance((u32)(uintptr_t)obj_a->getUserPointer());
-			const ActorInstance a1 = make_actor_instance((u32)(uintptr_t)obj_b->getUserPointer());
-			const UnitId u0 = _actor[a0.i].unit;
-			const UnitId u1 = _actor[a1.i].unit;
+			if (!_actor[(u32)(uintptr_t)obj_a->getUserPointer()].report_contacts
+				&& !_actor[(u32)(uintptr_t)obj_b->getUserPointer()].report_contacts
+				)
+				continue;
 
-			int num_contacts = manifold->getNumContacts();
+			int deepest = -1;
+			const int num_contacts = manifold->getNumContacts();
 			for (int j = 0; j < num_contacts; ++j)
 			{
 				const btManifoldPoint& pt = manifold->getContactPoint(j);
-				if (pt.m_distance1 < 0.0f)
+				if (pt.m_distance1 < 0.0f && (deepest == -1 || pt.m_distance1 < manifold->getContactPoint(deepest).m_distance1))
+					deepest = j;
+			}
+			if (deepest == -1)
+				continue;
+
+			const btManifoldPoint& pt = manifold->getContactPoint(deepest);
+			Contact c;
+			c.manifold = manifold;
+			c.objects[0] = obj_a;
+			c.objects[1] = obj_b;
+			c.step = _step_id;
+			c.position = to_vector3(pt.m_positionWorldOnB);
+			c.normal = to_vector3(pt.m_normalWorldOnB);
+			c.distance = pt.m_distance1;
+			array::push_back(_tick_contacts, c);
+		}
+
+		std::sort(array::begin(_tick_contacts), array::end(_tick_contacts));
+
+		// Compare with the contacts of the previous substep: persistent
+		// contacts are reported once per step, by step()
+		const u32 num_prev = array::size(_contacts);
+		const u32 num_curr = array::size(_tick_contacts);
+		u32 p = 0;
+		u32 c = 0;
+		while (p < num_prev || c < num_curr)
+		{
+			if (p == num_prev || (c < num_curr && _tick_contacts[c].manifold < _contacts[p].manifold))
+			{
+				post_collision_event(PhysicsCollisionEvent::TOUCH_BEGIN, _tick_contacts[c++]);
+			}
+			else if (c == num_curr || _contacts[p].manifold < _tick_contacts[c].manifold)
+			{
+				post_collision_event(PhysicsCollisionEvent::TOUCH_END, _contacts[p++]);
+			}
+			else
+			{
+				// Manifolds are recycled by Bullet, check the pair is the same
+				if (_contacts[p].objects[0] == _tick_contacts[c].objects[0] && _contacts[p].objects[1] == _tick_contacts[c].objects[1])
+				{
+					_tick_contacts[c].step = _contacts[p].step;
+				}
+				else
 				{
-					// Post collision event
-					PhysicsCollisionEvent ev;
-					ev.type = pt.m_lifeTime == 1 ? PhysicsCollisionEvent::TOUCH_BEGIN : PhysicsCollisionEvent::TOUCHING;
-					ev.units[0] = u0;
-					ev.units[1] = u1;
-					ev.actors[0] = a0;
-					ev.actors[1] = a1;
-					ev.position = to_vector3(pt.m_positionWorldOnB);
-					ev.normal = to_vector3(pt.m_normalWorldOnB);
-					ev.distance = pt.m_distance1;
-					event_stream::write(_events, EventType::PHYSICS_COLLISION, ev);
+					post_collision_event(PhysicsCollisionEvent::TOUCH_END, _contacts[p]);
+					post_collision_event(PhysicsCollisionEvent::TOUCH_BEGIN, _tick_contacts[c]);
 				}
+				++p;
+				++c;
 			}
 		}
+
+		_contacts = _tick_contacts;
 	}
 
 	void unit_destroyed_callback(UnitId id)
@@ -1032,6 +2312,12 @@ struct PhysicsWorldImpl
 				actor_destroy(first);
 		}
 
+		{
+			MoverInstance mi = mover(id);
+			if (is_valid(mi))
+				mover_destroy(mi);
+		}
+
 		{
 			ColliderInstance curr = collider_first(id);
 			ColliderInstance next;
@@ -1051,14 +2337,18 @@ struct PhysicsWorldImpl
 		bw->tick_callback(world, dt);
 	}
 
-	static void unit_destroyed_callback(UnitId id, void* user_ptr)
+	static void unit_destroyed_callback(const UnitId* units, u32 num, void* user_ptr)
 	{
-		((PhysicsWorldImpl*)user_ptr)->unit_destroyed_callback(id);
+		((PhysicsWorldImpl*)user_ptr)->wait_step();
+		for (u32 i = 0; i < num; ++i)
+			((PhysicsWorldImpl*)user_ptr)->unit_destroyed_callback(units[i]);
 	}
 
 	static ColliderInstance make_collider_instance(u32 i) { ColliderInstance inst = { i }; return inst; }
 	static ActorInstance make_actor_instance(u32 i) { ActorInstance inst = { i }; return inst; }
+	static MoverInstance make_mover_instance(u32 i) { MoverInstance inst = { i }; return inst; }
 	static JointInstance make_joint_instance(u32 i) { JointInstance inst = { i }; return inst; }
+	static TransformInstance make_transform_instance(u32 i) { TransformInstance inst = { i }; return inst; }
 };
 
 PhysicsWorld::PhysicsWorld(Allocator& a, ResourceManager& rm, UnitManager& um, DebugLine& dl)
@@ -1075,243 +2365,370 @@ PhysicsWorld::~PhysicsWorld()
 	_marker = 0;
 }
 
+void PhysicsWorld::reserve(u32 num_colliders, u32 num_actors)
+{
+	_impl->wait_step();
+	_impl->reserve(num_colliders, num_actors);
+}
+
 ColliderInstance PhysicsWorld::collider_create(UnitId id, const ColliderDesc* sd)
 {
+	_impl->wait_step();
 	return _impl->collider_create(id, sd);
 }
 
 void PhysicsWorld::collider_destroy(ColliderInstance i)
 {
+	_impl->wait_step();
 	_impl->collider_destroy(i);
 }
 
 ColliderInstance PhysicsWorld::collider_first(UnitId id)
 {
+	_impl->wait_step();
 	return _impl->collider_first(id);
 }
 
 ColliderInstance PhysicsWorld::collider_next(ColliderInstance i)
 {
+	_impl->wait_step();
 	return _impl->collider_next(i);
 }
 
 ActorInstance PhysicsWorld::actor_create(UnitId id, const ActorResource* ar, const Matrix4x4& tm)
 {
+	_impl->wait_step();
 	return _impl->actor_create(id, ar, tm);
 }
 
 void PhysicsWorld::actor_destroy(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_destroy(i);
 }
 
 ActorInstance PhysicsWorld::actor(UnitId id)
 {
+	_impl->wait_step();
 	return _impl->actor(id);
 }
 
 Vector3 PhysicsWorld::actor_world_position(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_world_position(i);
 }
 
 Quaternion PhysicsWorld::actor_world_rotation(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_world_rotation(i);
 }
 
 Matrix4x4 PhysicsWorld::actor_world_pose(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_world_pose(i);
 }
 
 void PhysicsWorld::actor_teleport_world_position(ActorInstance i, const Vector3& p)
 {
+	_impl->wait_step();
 	_impl->actor_teleport_world_position(i, p);
 }
 
 void PhysicsWorld::actor_teleport_world_rotation(ActorInstance i, const Quaternion& r)
 {
+	_impl->wait_step();
 	_impl->actor_teleport_world_rotation(i, r);
 }
 
 void PhysicsWorld::actor_teleport_world_pose(ActorInstance i, const Matrix4x4& m)
 {
+	_impl->wait_step();
 	_impl->actor_teleport_world_pose(i, m);
 }
 
 Vector3 PhysicsWorld::actor_center_of_mass(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_center_of_mass(i);
 }
 
 void PhysicsWorld::actor_enable_gravity(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_enable_gravity(i);
 }
 
 void PhysicsWorld::actor_disable_gravity(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_disable_gravity(i);
 }
 
 void PhysicsWorld::actor_enable_collision(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_enable_collision(i);
 }
 
 void PhysicsWorld::actor_disable_collision(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_disable_collision(i);
 }
 
 void PhysicsWorld::actor_set_collision_filter(ActorInstance i, StringId32 filter)
 {
+	_impl->wait_step();
 	_impl->actor_set_collision_filter(i, filter);
 }
 
 void PhysicsWorld::actor_set_kinematic(ActorInstance i, bool kinematic)
 {
+	_impl->wait_step();
 	_impl->actor_set_kinematic(i, kinematic);
 }
 
 bool PhysicsWorld::actor_is_static(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_is_static(i);
 }
 
 bool PhysicsWorld::actor_is_dynamic(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_is_dynamic(i);
 }
 
 bool PhysicsWorld::actor_is_kinematic(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_is_kinematic(i);
 }
 
 bool PhysicsWorld::actor_is_nonkinematic(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_is_nonkinematic(i);
 }
 
 f32 PhysicsWorld::actor_linear_damping(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_linear_damping(i);
 }
 
 void PhysicsWorld::actor_set_linear_damping(ActorInstance i, f32 rate)
 {
+	_impl->wait_step();
 	_impl->actor_set_linear_damping(i, rate);
 }
 
 f32 PhysicsWorld::actor_angular_damping(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_angular_damping(i);
 }
 
 void PhysicsWorld::actor_set_angular_damping(ActorInstance i, f32 rate)
 {
+	_impl->wait_step();
 	_impl->actor_set_angular_damping(i, rate);
 }
 
 Vector3 PhysicsWorld::actor_linear_velocity(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_linear_velocity(i);
 }
 
 void PhysicsWorld::actor_set_linear_velocity(ActorInstance i, const Vector3& vel)
 {
+	_impl->wait_step();
 	_impl->actor_set_linear_velocity(i, vel);
 }
 
+void PhysicsWorld::actor_set_linear_velocities(const ActorInstance* actors, const Vector3* vels, u32 num)
+{
+	_impl->wait_step();
+	for (u32 i = 0; i < num; ++i)
+		_impl->actor_set_linear_velocity(actors[i], vels[i]);
+}
+
 Vector3 PhysicsWorld::actor_angular_velocity(ActorInstance i) const
 {
+	_impl->wait_step();
 	return _impl->actor_angular_velocity(i);
 }
 
 void PhysicsWorld::actor_set_angular_velocity(ActorInstance i, const Vector3& vel)
 {
+	_impl->wait_step();
 	_impl->actor_set_angular_velocity(i, vel);
 }
 
 void PhysicsWorld::actor_add_impulse(ActorInstance i, const Vector3& impulse)
 {
+	_impl->wait_step();
 	_impl->actor_add_impulse(i, impulse);
 }
 
 void PhysicsWorld::actor_add_impulse_at(ActorInstance i, const Vector3& impulse, const Vector3& pos)
 {
+	_impl->wait_step();
 	_impl->actor_add_impulse_at(i, impulse, pos);
 }
 
 void PhysicsWorld::actor_add_torque_impulse(ActorInstance i, const Vector3& imp)
 {
+	_impl->wait_step();
 	_impl->actor_add_torque_impulse(i, imp);
 }
 
 void PhysicsWorld::actor_push(ActorInstance i, const Vector3& vel, f32 mass)
 {
+	_impl->wait_step();
 	_impl->actor_push(i, vel, mass);
 }
 
 void PhysicsWorld::actor_push_at(ActorInstance i, const Vector3& vel, f32 mass, const Vector3& pos)
 {
+	_impl->wait_step();
 	_impl->actor_push_at(i, vel, mass, pos);
 }
 
 bool PhysicsWorld::actor_is_sleeping(ActorInstance i)
 {
+	_impl->wait_step();
 	return _impl->actor_is_sleeping(i);
 }
 
 void PhysicsWorld::actor_wake_up(ActorInstance i)
 {
+	_impl->wait_step();
 	_impl->actor_wake_up(i);
 }
 
+void PhysicsWorld::actor_set_max_linear_velocity(ActorInstance i, f32 velocity)
+{
+	_impl->wait_step();
+	_impl->actor_set_max_linear_velocity(i, velocity);
+}
+
+void PhysicsWorld::actor_set_report_contacts(ActorInstance i, bool report)
+{
+	_impl->wait_step();
+	_impl->actor_set_report_contacts(i, report);
+}
+
+void PhysicsWorld::set_lod_observers(const Vector3* positions, u32 num)
+{
+	_impl->wait_step();
+	_impl->set_lod_observers(positions, num);
+}
+
+MoverInstance PhysicsWorld::mover_create(UnitId id, const MoverDesc& md, const Matrix4x4& tm)
+{
+	_impl->wait_step();
+	return _impl->mover_create(id, md, tm);
+}
+
+void PhysicsWorld::mover_destroy(MoverInstance i)
+{
+	_impl->wait_step();
+	_impl->mover_destroy(i);
+}
+
+MoverInstance PhysicsWorld::mover(UnitId id)
+{
+	return _impl->mover(id);
+}
+
+Vector3 PhysicsWorld::mover_position(MoverInstance i) const
+{
+	return _impl->mover_position(i);
+}
+
+void PhysicsWorld::mover_set_velocities(const MoverInstance* movers, const Vector3* velocities, u32 num)
+{
+	_impl->mover_set_velocities(movers, velocities, num);
+}
+
+bool PhysicsWorld::mover_on_ground(MoverInstance i) const
+{
+	return _impl->mover_on_ground(i);
+}
+
+bool PhysicsWorld::mover_collides_sides(MoverInstance i) const
+{
+	return _impl->mover_collides_sides(i);
+}
+
+bool PhysicsWorld::mover_collides_up(MoverInstance i) const
+{
+	return _impl->mover_collides_up(i);
+}
+
 JointInstance PhysicsWorld::joint_create(ActorInstance a0, ActorInstance a1, const JointDesc& jd)
 {
+	_impl->wait_step();
 	return _impl->joint_create(a0, a1, jd);
 }
 
 void PhysicsWorld::joint_destroy(JointInstance i)
 {
+	_impl->wait_step();
 	_impl->joint_destroy(i);
 }
 
 bool PhysicsWorld::cast_ray(RaycastHit& hit, const Vector3& from, const Vector3& dir, f32 len)
 {
+	_impl->wait_step();
 	return _impl->cast_ray(hit, from, dir, len);
 }
 
 bool PhysicsWorld::cast_ray_all(Array<RaycastHit>& hits, const Vector3& from, const Vector3& dir, f32 len)
 {
+	_impl->wait_step();
 	return _impl->cast_ray_all(hits, from, dir, len);
 }
 
 bool PhysicsWorld::cast_sphere(RaycastHit& hit, const Vector3& from, f32 radius, const Vector3& dir, f32 len)
 {
+	_impl->wait_step();
 	return _impl->cast_sphere(hit, from, radius, dir, len);
 }
 
 bool PhysicsWorld::cast_box(RaycastHit& hit, const Vector3& from, const Vector3& half_extents, const Vector3& dir, f32 len)
 {
+	_impl->wait_step();
 	return _impl->cast_box(hit, from, half_extents, dir, len);
 }
 
+u32 PhysicsWorld::cast_batch(RaycastHit* hits, const PhysicsCast* casts, u32 num)
+{
+	_impl->wait_step();
+	return _impl->cast_batch(hits, casts, num);
+}
+
 Vector3 PhysicsWorld::gravity() const
 {
+	_impl->wait_step();
 	return _impl->gravity();
 }
 
 void PhysicsWorld::set_gravity(const Vector3& g)
 {
+	_impl->wait_step();
 	_impl->set_gravity(g);
 }
 
 void PhysicsWorld::update_actor_world_poses(const UnitId* begin, const UnitId* end, const Matrix4x4* begin_world)
 {
+	_impl->wait_step();
 	_impl->update_actor_world_poses(begin, end, begin_world);
 }
 
@@ -1320,13 +2737,50 @@ void PhysicsWorld::update(f32 dt)
 	_impl->update(dt);
 }
 
+void PhysicsWorld::enable_async_update(bool enable)
+{
+	_impl->enable_async_update(enable);
+}
+
+void PhysicsWorld::set_step_frequency(f32 frequency)
+{
+	_impl->wait_step();
+	_impl->set_step_frequency(frequency);
+}
+
+void PhysicsWorld::set_max_substeps(u32 num)
+{
+	_impl->wait_step();
+	_impl->set_max_substeps(num);
+}
+
+void PhysicsWorld::set_solver_iterations(u32 num)
+{
+	_impl->wait_step();
+	_impl->set_solver_iterations(num);
+}
+
 EventStream& PhysicsWorld::events()
 {
 	return _impl->events();
 }
 
+PhysicsTransformEvents& PhysicsWorld::transform_events()
+{
+	return _impl->transform_events();
+}
+
+void PhysicsWorld::update_transform_cache(const PhysicsTransformEvents& events)
+{
+	_impl->update_transform_cache(events);
+}
+
 void PhysicsWorld::debug_draw()
 {
+	if (!_impl->_debug_drawing)
+		return;
+
+	_impl->wait_step();
 	_impl->debug_draw();
 }
 
@@ -1335,6 +2789,24 @@ void PhysicsWorld::enable_debug_drawing(bool enable)
 	_impl->enable_debug_drawing(enable);
 }
 
+void PhysicsWorld::snapshot(Buffer& buf)
+{
+	_impl->wait_step();
+	_impl->snapshot(buf);
+}
+
+bool PhysicsWorld::can_restore(const char* data)
+{
+	_impl->wait_step();
+	return _impl->can_restore(data);
+}
+
+void PhysicsWorld::restore(const char* data)
+{
+	_impl->wait_step();
+	_impl->restore(data);
+}
+
 } // namespace crown
 
 #endif // CROWN_PHYSICS_BULLET
@@ -8,6 +8,7 @@
 #if CROWN_PHYSICS_NOOP
 
 #include "world/physics_world.h"
+#include "world/snapshot.h"
 
 namespace crown
 {
@@ -26,9 +27,11 @@ namespace physics_globals
 struct PhysicsWorldImpl
 {
 	EventStream _events;
+	PhysicsTransformEvents _transform_events;
 
 	PhysicsWorldImpl(Allocator& a)
 		: _events(a)
+		, _transform_events(a)
 	{
 	}
 
@@ -36,6 +39,10 @@ struct PhysicsWorldImpl
 	{
 	}
 
+	void reserve(u32 /*num_colliders*/, u32 /*num_actors*/)
+	{
+	}
+
 	ColliderInstance collider_create(UnitId /*id*/, const ColliderDesc* /*sd*/)
 	{
 		return make_collider_instance(UINT32_MAX);
@@ -210,6 +217,56 @@ struct PhysicsWorldImpl
 	{
 	}
 
+	void actor_set_max_linear_velocity(ActorInstance /*i*/, f32 /*velocity*/)
+	{
+	}
+
+	void actor_set_report_contacts(ActorInstance /*i*/, bool /*report*/)
+	{
+	}
+
+	void set_lod_observers(const Vector3* /*positions*/, u32 /*num*/)
+	{
+	}
+
+	MoverInstance mover_create(UnitId /*id*/, const MoverDesc& /*md*/, const Matrix4x4& /*tm*/)
+	{
+		return make_mover_instance(UINT32_MAX);
+	}
+
+	void mover_destroy(MoverInstance /*i*/)
+	{
+	}
+
+	MoverInstance mover(UnitId /*id*/)
+	{
+		return make_mover_instance(UINT32_MAX);
+	}
+
+	Vector3 mover_position(MoverInstance /*i*/) const
+	{
+		return VECTOR3_ZERO;
+	}
+
+	void mover_set_velocities(const MoverInstance* /*movers*/, const Vector3* /*velocities*/, u32 /*num*/)
+	{
+	}
+
+	bool mover_on_ground(MoverInstance /*i*/) const
+	{
+		return false;
+	}
+
+	bool mover_collides_sides(MoverInstance /*i*/) const
+	{
+		return false;
+	}
+
+	bool mover_collides_up(MoverInstance /*i*/) const
+	{
+		return false;
+	}
+
 	JointInstance joint_create(ActorInstance /*a0*/, ActorInstance /*a1*/, const JointDesc& /*jd*/)
 	{
 		return make_joint_instance(UINT32_MAX);
@@ -239,6 +296,17 @@ struct PhysicsWorldImpl
 		return false;
 	}
 
+	u32 cast_batch(RaycastHit* hits, const PhysicsCast* /*casts*/, u32 num)
+	{
+		for (u32 i = 0; i < num; ++i)
+		{
+			hits[i].unit    = UNIT_INVALID;
+			hits[i].actor.i = UINT32_MAX;
+		}
+
+		return 0;
+	}
+
 	Vector3 gravity() const
 	{
 		return VECTOR3_ZERO;
@@ -261,6 +329,15 @@ struct PhysicsWorldImpl
 		return _events;
 	}
 
+	PhysicsTransformEvents& transform_events()
+	{
+		return _transform_events;
+	}
+
+	void update_transform_cache(const PhysicsTransformEvents& /*events*/)
+	{
+	}
+
 	void debug_draw()
 	{
 	}
@@ -269,8 +346,40 @@ struct PhysicsWorldImpl
 	{
 	}
 
+	void snapshot(Buffer& buf)
+	{
+		const u32 num = 0;
+		snapshot::write(buf, num);
+	}
+
+	bool can_restore(const char* /*data*/)
+	{
+		return true;
+	}
+
+	void restore(const char* /*data*/)
+	{
+	}
+
+	void enable_async_update(bool /*enable*/)
+	{
+	}
+
+	void set_step_frequency(f32 /*frequency*/)
+	{
+	}
+
+	void set_max_substeps(u32 /*num*/)
+	{
+	}
+
+	void set_solver_iterations(u32 /*num*/)
+	{
+	}
+
 	ColliderInstance make_collider_instance(u32 i) { ColliderInstance inst = { i }; return inst; }
 	ActorInstance make_actor_instance(u32 i) { ActorInstance inst = { i }; return inst; }
+	MoverInstance make_mover_instance(u32 i) { MoverInstance inst = { i }; return inst; }
 	JointInstance make_joint_instance(u32 i) { JointInstance inst = { i }; return inst; }
 };
 
@@ -288,6 +397,11 @@ PhysicsWorld::~PhysicsWorld()
 	_marker = 0;
 }
 
+void PhysicsWorld::reserve(u32 num_colliders, u32 num_actors)
+{
+	_impl->reserve(num_colliders, num_actors);
+}
+
 ColliderInstance PhysicsWorld::collider_create(UnitId id, const ColliderDesc* sd)
 {
 	return _impl->collider_create(id, sd);
@@ -438,6 +552,12 @@ void PhysicsWorld::actor_set_linear_velocity(ActorInstance i, const Vector3& vel
 	_impl->actor_set_linear_velocity(i, vel);
 }
 
+void PhysicsWorld::actor_set_linear_velocities(const ActorInstance* actors, const Vector3* vels, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+		_impl->actor_set_linear_velocity(actors[i], vels[i]);
+}
+
 Vector3 PhysicsWorld::actor_angular_velocity(ActorInstance i) const
 {
 	return _impl->actor_angular_velocity(i);
@@ -483,6 +603,61 @@ void PhysicsWorld::actor_wake_up(ActorInstance i)
 	_impl->actor_wake_up(i);
 }
 
+void PhysicsWorld::actor_set_max_linear_velocity(ActorInstance i, f32 velocity)
+{
+	_impl->actor_set_max_linear_velocity(i, velocity);
+}
+
+void PhysicsWorld::actor_set_report_contacts(ActorInstance i, bool report)
+{
+	_impl->actor_set_report_contacts(i, report);
+}
+
+void PhysicsWorld::set_lod_observers(const Vector3* positions, u32 num)
+{
+	_impl->set_lod_observers(positions, num);
+}
+
+MoverInstance PhysicsWorld::mover_create(UnitId id, const MoverDesc& md, const Matrix4x4& tm)
+{
+	return _impl->mover_create(id, md, tm);
+}
+
+void PhysicsWorld::mover_destroy(MoverInstance i)
+{
+	_impl->mover_destroy(i);
+}
+
+MoverInstance PhysicsWorld::mover(UnitId id)
+{
+	return _impl->mover(id);
+}
+
+Vector3 PhysicsWorld::mover_position(MoverInstance i) const
+{
+	return _impl->mover_position(i);
+}
+
+void PhysicsWorld::mover_set_velocities(const MoverInstance* movers, const Vector3* velocities, u32 num)
+{
+	_impl->mover_set_velocities(movers, velocities, num);
+}
+
+bool PhysicsWorld::mover_on_ground(MoverInstance i) const
+{
+	return _impl->mover_on_ground(i);
+}
+
+bool PhysicsWorld::mover_collides_sides(MoverInstance i) const
+{
+	return _impl->mover_collides_sides(i);
+}
+
+bool PhysicsWorld::mover_collides_up(MoverInstance i) const
+{
+	return _impl->mover_collides_up(i);
+}
+
 JointInstance PhysicsWorld::joint_create(ActorInstance a0, ActorInstance a1, const JointDesc& jd)
 {
 	return _impl->joint_create(a0, a1, jd);
@@ -513,6 +688,11 @@ bool PhysicsWorld::cast_box(RaycastHit& hit, const Vector3& from, const Vector3&
 	return _impl->cast_box(hit, from, half_extents, dir, len);
 }
 
+u32 PhysicsWorld::cast_batch(RaycastHit* hits, const PhysicsCast* casts, u32 num)
+{
+	return _impl->cast_batch(hits, casts, num);
+}
+
 Vector3 PhysicsWorld::gravity() const
 {
 	return _impl->gravity();
@@ -538,6 +718,16 @@ EventStream& PhysicsWorld::events()
 	return _impl->events();
 }
 
+PhysicsTransformEvents& PhysicsWorld::transform_events()
+{
+	return _impl->transform_events();
+}
+
+void PhysicsWorld::update_transform_cache(const PhysicsTransformEvents& events)
+{
+	_impl->update_transform_cache(events);
+}
+
 void PhysicsWorld::debug_draw()
 {
 	_impl->debug_draw();
@@ -548,6 +738,41 @@ void PhysicsWorld::enable_debug_drawing(bool enable)
 	_impl->enable_debug_drawing(enable);
 }
 
+void PhysicsWorld::enable_async_update(bool enable)
+{
+	_impl->enable_async_update(enable);
+}
+
+void PhysicsWorld::set_step_frequency(f32 frequency)
+{
+	_impl->set_step_frequency(frequency);
+}
+
+void PhysicsWorld::set_max_substeps(u32 num)
+{
+	_impl->set_max_substeps(num);
+}
+
+void PhysicsWorld::set_solver_iterations(u32 num)
+{
+	_impl->set_solver_iterations(num);
+}
+
+void PhysicsWorld::snapshot(Buffer& buf)
+{
+	_impl->snapshot(buf);
+}
+
+bool PhysicsWorld::can_restore(const char* data)
+{
+	return _impl->can_restore(data);
+}
+
+void PhysicsWorld::restore(const char* data)
+{
+	_impl->restore(data);
+}
+
 } // namespace crown
 
 #endif // CROWN_PHYSICS_NOOP
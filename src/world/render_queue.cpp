@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/array.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/vector4.h"
+#include "core/radix_sort.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/job_system.h"
+#include "config.h"
+#include "resource/material_resource.h"
+#include "world/material.h"
+#include "world/render_queue.h"
+#include "world/shader_manager.h"
+#include <string.h> // memcpy
+
+namespace crown
+{
+// Returns the sort key of a draw:
+// [view:8][shader:16][material:24][depth:16]
+static u64 sort_key(u8 view, const Material& material, f32 depth)
+{
+	const u64 shader = material._resource->shader._id >> 16;
+	const u64 mat = u64(material._resource_handle.index) & 0xffffff;
+
+	// Bits of non-negative floats sort like the floats themselves
+	u32 depth_bits;
+	depth = depth > 0.0f ? depth : 0.0f;
+	memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+	return u64(view) << 56
+		| shader << 40
+		| mat << 16
+		| u64(depth_bits >> 16)
+		;
+}
+
+RenderQueue::RenderQueue(Allocator& a)
+	: _keys(a)
+	, _order(a)
+	, _tmp_keys(a)
+	, _tmp_order(a)
+	, _draws(a)
+	, _transforms(a)
+	, _num_textures(0)
+	, _num_uniforms(0)
+{
+	_u_skin.idx = bgfx::kInvalidHandle;
+	_u_mesh_decode.idx = bgfx::kInvalidHandle;
+}
+
+Matrix4x4* RenderQueue::add(u8 view, const Material& material, bgfx::VertexBufferHandle vbh, bgfx::IndexBufferHandle ibh, const Vector4* decode, u32 num, f32 depth, u32 skin)
+{
+	CE_ASSERT(num > 0, "No transforms");
+	CE_ASSERT(num == 1 || skin == UINT32_MAX, "Skinned draws can not be instanced");
+
+	Draw d;
+	d.material = &material;
+	d.vbh = vbh;
+	d.ibh = ibh;
+	d.first_transform = array::size(_transforms);
+	d.num_instances = num;
+	d.decode = decode;
+	d.skin = skin;
+	d.view = view;
+
+	Matrix4x4* transforms;
+	if (num > 1)
+	{
+		bgfx::allocInstanceDataBuffer(&d.idb, num, sizeof(Matrix4x4));
+		transforms = (Matrix4x4*)d.idb.data;
+	}
+	else
+	{
+		array::resize(_transforms, d.first_transform + 1);
+		transforms = &_transforms[d.first_transform];
+	}
+
+	array::push_back(_keys, sort_key(view, material, depth));
+	array::push_back(_order, array::size(_draws));
+	array::push_back(_draws, d);
+	return transforms;
+}
+
+void RenderQueue::set_texture(u8 stage, bgfx::UniformHandle sampler, bgfx::TextureHandle texture, u32 flags)
+{
+	CE_ASSERT(_num_textures < countof(_textures), "Too many textures");
+	Texture& t = _textures[_num_textures++];
+	t.stage = stage;
+	t.sampler = sampler;
+	t.texture = texture;
+	t.flags = flags;
+}
+
+void RenderQueue::set_uniform(bgfx::UniformHandle handle, const Vector4& value)
+{
+	CE_ASSERT(_num_uniforms < countof(_uniforms), "Too many uniforms");
+	Uniform& u = _uniforms[_num_uniforms++];
+	u.handle = handle;
+	u.value = value;
+	u.values = NULL;
+	u.num = 1;
+}
+
+void RenderQueue::set_uniform(bgfx::UniformHandle handle, const Matrix4x4* values, u32 num)
+{
+	CE_ASSERT(_num_uniforms < countof(_uniforms), "Too many uniforms");
+	Uniform& u = _uniforms[_num_uniforms++];
+	u.handle = handle;
+	u.value = VECTOR4_ZERO;
+	u.values = values;
+	u.num = num;
+}
+
+void RenderQueue::set_skin_uniform(bgfx::UniformHandle handle)
+{
+	_u_skin = handle;
+}
+
+void RenderQueue::set_mesh_decode_uniform(bgfx::UniformHandle handle)
+{
+	_u_mesh_decode = handle;
+}
+
+struct SubmitRangeData
+{
+	RenderQueue* queue;
+	ResourceManager* resource_manager;
+	ShaderManager* shader_manager;
+	AtomicInt* num_binds;
+};
+
+static void submit_range(u32 begin, u32 end, void* user_data)
+{
+	SubmitRangeData* data = (SubmitRangeData*)user_data;
+
+	bgfx::Encoder* encoder = bgfx::begin();
+	CE_ENSURE(encoder != NULL);
+	data->num_binds->fetch_add(data->queue->submit(*encoder
+		, *data->resource_manager
+		, *data->shader_manager
+		, begin
+		, end
+		));
+	bgfx::end(encoder);
+}
+
+u32 RenderQueue::submit(ResourceManager& rm, ShaderManager& sm, u32 num_chunks)
+{
+	const u32 num = array::size(_draws);
+	array::resize(_tmp_keys, num);
+	array::resize(_tmp_order, num);
+	radix_sort(array::begin(_keys)
+		, array::begin(_order)
+		, array::begin(_tmp_keys)
+		, array::begin(_tmp_order)
+		, num
+		);
+
+	const u32 grain_size = num_chunks > 1 ? (num + num_chunks - 1) / num_chunks : num;
+	if (grain_size < CROWN_RENDER_QUEUE_MIN_CHUNK_SIZE || grain_size >= num)
+		return submit(*bgfx::begin(), rm, sm, 0, num);
+
+	// Materials must not be modified from the job threads
+	for (u32 i = 0; i < num; ++i)
+		_draws[i].material->update_textures(rm, sm);
+
+	AtomicInt num_binds(0);
+
+	SubmitRangeData data;
+	data.queue = this;
+	data.resource_manager = &rm;
+	data.shader_manager = &sm;
+	data.num_binds = &num_binds;
+	job_system::parallel_for(0, num, grain_size, submit_range, &data);
+
+	return num_binds.load();
+}
+
+u32 RenderQueue::submit(bgfx::Encoder& encoder, ResourceManager& rm, ShaderManager& sm, u32 begin, u32 end)
+{
+	u32 num_binds = 0;
+	bool bound = false;
+	bool skinned = true; // Whether u_skin may be set by a previous draw
+	const Vector4* decode = NULL;
+
+	for (u32 u = 0; u < _num_uniforms; ++u)
+	{
+		const Uniform& uniform = _uniforms[u];
+		if (uniform.values != NULL)
+			encoder.setUniform(uniform.handle, uniform.values, uniform.num);
+		else
+			encoder.setUniform(uniform.handle, to_float_ptr(uniform.value));
+	}
+
+	for (u32 i = begin; i < end; ++i)
+	{
+		const Draw& d = _draws[_order[i]];
+		const bool instanced = d.num_instances > 1;
+
+		if (!bound)
+		{
+			d.material->set_state(rm, sm, encoder);
+			for (u32 t = 0; t < _num_textures; ++t)
+				encoder.setTexture(_textures[t].stage, _textures[t].sampler, _textures[t].texture, _textures[t].flags);
+			++num_binds;
+		}
+
+		encoder.setVertexBuffer(0, d.vbh);
+		encoder.setIndexBuffer(d.ibh);
+
+		if (instanced)
+			encoder.setInstanceDataBuffer(&d.idb);
+		else
+			encoder.setTransform(to_float_ptr(_transforms[d.first_transform]));
+
+		// Draws which are not skinned only reset u_skin after a skinned one
+		if (bgfx::isValid(_u_skin) && (d.skin != UINT32_MAX || skinned))
+		{
+			skinned = d.skin != UINT32_MAX;
+			const Vector4 skin = vector4(skinned ? f32(d.skin) : 0.0f, skinned ? 1.0f : 0.0f, 0.0f, 0.0f);
+			encoder.setUniform(_u_skin, to_float_ptr(skin));
+		}
+
+		// Consecutive draws of the same geometry share the decoding
+		if (bgfx::isValid(_u_mesh_decode) && d.decode != decode)
+		{
+			decode = d.decode;
+			encoder.setUniform(_u_mesh_decode, decode, 2);
+		}
+
+		// Keep the bindings if the next draw uses the same material. Instance
+		// data cannot be unbound, so draws with instancing never keep them.
+		const Draw* next = i + 1 < end ? &_draws[_order[i + 1]] : NULL;
+		bound = next != NULL
+			&& next->material == d.material
+			&& next->view == d.view
+			&& !instanced
+			&& next->num_instances == 1
+			;
+
+		sm.submit(encoder, d.material->_resource->shader, d.view, s32(i), UINT64_MAX, instanced, bound);
+	}
+
+	return num_binds;
+}
+
+void RenderQueue::clear()
+{
+	array::clear(_keys);
+	array::clear(_order);
+	array::clear(_draws);
+	array::clear(_transforms);
+	_num_textures = 0;
+	_num_uniforms = 0;
+}
+
+} // namespace crown
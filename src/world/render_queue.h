@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "core/types.h"
+#include "resource/types.h"
+#include "world/types.h"
+#include <bgfx/bgfx.h>
+
+namespace crown
+{
+/// Collects draws and submits them sorted by a 64-bit key made of the
+/// view, the shader, the material and the depth, so that draws sharing
+/// a material are contiguous and the material state is only set when it
+/// changes.
+///
+/// Draws are submitted with their position in the sorted queue as depth,
+/// so the views the queue submits to must sort by ascending depth. This
+/// keeps the order, and the state shared by consecutive draws, when the
+/// queue is split in chunks submitted from several threads.
+///
+/// @ingroup World
+struct RenderQueue
+{
+	struct Draw
+	{
+		const Material* material;
+		bgfx::VertexBufferHandle vbh;
+		bgfx::IndexBufferHandle ibh;
+		u32 first_transform;  ///< Unused if the draw is instanced.
+		u32 num_instances;
+		bgfx::InstanceDataBuffer idb; ///< Valid if the draw is instanced.
+		const Vector4* decode; ///< Decoding of the vertices, see MeshGeometry::decode.
+		u32 skin;             ///< Offset of the bones in the skin palette, UINT32_MAX if not skinned.
+		u8 view;
+	};
+
+	struct Texture
+	{
+		u8 stage;
+		bgfx::UniformHandle sampler;
+		bgfx::TextureHandle texture;
+		u32 flags;
+	};
+
+	struct Uniform
+	{
+		bgfx::UniformHandle handle;
+		Vector4 value;
+		const Matrix4x4* values; ///< Used instead of value if not NULL.
+		u32 num;
+	};
+
+	Array<u64> _keys;
+	Array<u32> _order;
+	Array<u64> _tmp_keys;
+	Array<u32> _tmp_order;
+	Array<Draw> _draws;
+	Array<Matrix4x4> _transforms;
+	Texture _textures[8];
+	u32 _num_textures;
+	Uniform _uniforms[8];
+	u32 _num_uniforms;
+	bgfx::UniformHandle _u_skin;
+	bgfx::UniformHandle _u_mesh_decode;
+
+	///
+	RenderQueue(Allocator& a);
+
+	/// Adds a draw of the geometry (@a vbh, @a ibh) with @a material to
+	/// @a view and returns the @a num transforms to fill. The geometry is
+	/// drawn once for each transform, with instancing if @a num is greater
+	/// than 1, in which case the transforms are written directly to a bgfx
+	/// instance data buffer. @a decode are the two vectors decoding the
+	/// vertices of the geometry, see MeshGeometry::decode, and must stay
+	/// valid until submit(). @a depth is the view-space depth used to order
+	/// draws sharing a material. @a skin is the offset of the bones of a
+	/// skinned geometry in the skin palette, skinned geometries can not be
+	/// drawn with instancing.
+	Matrix4x4* add(u8 view, const Material& material, bgfx::VertexBufferHandle vbh, bgfx::IndexBufferHandle ibh, const Vector4* decode, u32 num, f32 depth, u32 skin = UINT32_MAX);
+
+	/// Adds the @a texture to bind to @a stage for every draw.
+	void set_texture(u8 stage, bgfx::UniformHandle sampler, bgfx::TextureHandle texture, u32 flags);
+
+	/// Adds the uniform @a handle to set to @a value for every draw.
+	void set_uniform(bgfx::UniformHandle handle, const Vector4& value);
+
+	/// Adds the matrix array uniform @a handle to set to the @a num
+	/// @a values for every draw. The values must stay valid until submit().
+	void set_uniform(bgfx::UniformHandle handle, const Matrix4x4* values, u32 num);
+
+	/// Sets the uniform @a handle to set to the offset of the bones of each
+	/// skinned draw.
+	void set_skin_uniform(bgfx::UniformHandle handle);
+
+	/// Sets the uniform @a handle to set to the decoding of the vertices of
+	/// each draw.
+	void set_mesh_decode_uniform(bgfx::UniformHandle handle);
+
+	/// Sorts the draws and submits them in at most @a num_chunks chunks,
+	/// each one with its own bgfx encoder on a job system thread.
+	/// Returns the number of times the state of a material has been set.
+	u32 submit(ResourceManager& rm, ShaderManager& sm, u32 num_chunks = 1);
+
+	/// Submits the sorted draws in [@a begin, @a end) with @a encoder.
+	/// Returns the number of times the state of a material has been set.
+	u32 submit(bgfx::Encoder& encoder, ResourceManager& rm, ShaderManager& sm, u32 begin, u32 end);
+
+	/// Removes all the draws, the textures and the uniforms.
+	void clear();
+};
+
+} // namespace crown
@@ -3,78 +3,286 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/math/aabb.h"
+#include "core/math/aabb_tree.h"
 #include "core/math/color4.h"
+#include "core/math/frustum.h"
 #include "core/math/intersection.h"
 #include "core/math/matrix4x4.h"
+#include "core/math/simd.h"
+#include "core/memory/temp_allocator.h"
+#include "core/radix_sort.h"
+#include "core/thread/job_system.h"
 #include "device/pipeline.h"
+#include "device/profiler.h"
+#include "resource/material_resource.h"
 #include "resource/mesh_resource.h"
+#include "resource/particle_resource.h"
 #include "resource/resource_manager.h"
 #include "resource/sprite_resource.h"
+#include "resource/tilemap_resource.h"
 #include "world/debug_line.h"
 #include "world/material.h"
 #include "world/material_manager.h"
+#include "world/occlusion_buffer.h"
 #include "world/render_world.h"
+#include "world/shader_manager.h"
+#include "world/snapshot.h"
+#include "world/texture_manager.h"
 #include "world/unit_manager.h"
 #include <bgfx/bgfx.h>
+#include <algorithm> // std::sort
+#include <float.h> // FLT_MAX
+#include <math.h> // logf, powf, floorf
+#include <string.h> // memset
+
+#define LIGHT_CLUSTERS_XY    (CROWN_LIGHT_CLUSTERS_X*CROWN_LIGHT_CLUSTERS_Y)
+#define LIGHT_CLUSTERS       (LIGHT_CLUSTERS_XY*CROWN_LIGHT_CLUSTERS_Z)
+#define LIGHT_INDICES_WIDTH  256
+#define LIGHT_INDICES_HEIGHT ((CROWN_MAX_LIGHT_INDICES + LIGHT_INDICES_WIDTH - 1) / LIGHT_INDICES_WIDTH)
+#define LIGHT_TEXTURE_FLAGS  (BGFX_TEXTURE_MIN_POINT | BGFX_TEXTURE_MAG_POINT | BGFX_TEXTURE_MIP_POINT | BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP)
+#define LIGHT_DATA_ROWS      8 // Must match the mesh shader
+
+#define SHADOW_CASCADE_SIZE  (CROWN_SHADOW_ATLAS_SIZE / CROWN_SHADOW_CASCADES)
+#define SHADOW_TILES_X       (CROWN_SHADOW_ATLAS_SIZE / CROWN_SHADOW_TILE_SIZE)
+#define SHADOW_TILES_Y       ((CROWN_SHADOW_ATLAS_SIZE - SHADOW_CASCADE_SIZE) / CROWN_SHADOW_TILE_SIZE)
+#define SHADOW_TILES         (SHADOW_TILES_X*SHADOW_TILES_Y)
+#define SHADOW_MAX_CHANGES   1024
+#define SHADOW_ATLAS_FLAGS   (BGFX_TEXTURE_COMPARE_LEQUAL | BGFX_TEXTURE_U_CLAMP | BGFX_TEXTURE_V_CLAMP)
+
+#define SKIN_PALETTE_WIDTH   1024 // Must match the shaders
+#define SKIN_PALETTE_HEIGHT  ((CROWN_MAX_SKIN_BONES*3 + SKIN_PALETTE_WIDTH - 1) / SKIN_PALETTE_WIDTH)
+#define SKIN_PALETTE_STAGE   11
+
+#define PARTICLE_DEPTH       0x40000000 // Above the RenderQueue order of the meshes
+
+#if CROWN_TILEMAP_CHUNK_SIZE*CROWN_TILEMAP_CHUNK_SIZE > CROWN_SPRITE_BATCH_SIZE
+	#error "Chunks of CROWN_TILEMAP_CHUNK_SIZE must fit the sprite index buffer"
+#endif
+
+#if CROWN_SPRITE_BATCH_SIZE > 16384
+	#error "CROWN_SPRITE_BATCH_SIZE must fit 16-bit indices"
+#endif
+
+CE_STATIC_ASSERT(SHADOW_TILES <= 64); // Tiles in use are tracked with a u64
+CE_STATIC_ASSERT(CROWN_SHADOW_CASCADES <= 4); // Splits are stored in a Vector4
+CE_STATIC_ASSERT(CROWN_SHADOW_CASCADES + SHADOW_TILES <= MAX_SHADOW_VIEWS);
 
 namespace crown
 {
-static void unit_destroyed_callback_bridge(UnitId id, void* user_ptr)
+static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
 {
-	((RenderWorld*)user_ptr)->unit_destroyed_callback(id);
+	for (u32 i = 0; i < num; ++i)
+		((RenderWorld*)user_ptr)->unit_destroyed_callback(units[i]);
 }
 
-RenderWorld::RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, UnitManager& um)
+// Returns the box enclosing the @a obb transformed by @a world.
+static AABB world_aabb(const OBB& obb, const Matrix4x4& world)
+{
+	AABB b;
+	b.min = -obb.half_extents;
+	b.max =  obb.half_extents;
+	return aabb::transformed(b, obb.tm * world);
+}
+
+// Returns the number of f32 in each stream of the particles of @a pr.
+static u32 particle_stride(const ParticleResource* pr)
+{
+	return (pr->max_particles + 3) & ~3u;
+}
+
+// Returns the number of chunks along the width of @a tmr.
+static u32 tilemap_num_chunks_x(const TilemapResource* tmr)
+{
+	return (tmr->width + CROWN_TILEMAP_CHUNK_SIZE - 1) / CROWN_TILEMAP_CHUNK_SIZE;
+}
+
+// Returns the number of chunks along the height of @a tmr.
+static u32 tilemap_num_chunks_y(const TilemapResource* tmr)
+{
+	return (tmr->height + CROWN_TILEMAP_CHUNK_SIZE - 1) / CROWN_TILEMAP_CHUNK_SIZE;
+}
+
+// Returns the columns [@a x0, @a x1) and the rows [@a y0, @a y1) of the
+// tiles of the chunk @a c of @a tmr.
+static void tilemap_chunk_rect(const TilemapResource* tmr, u32 c, u32& x0, u32& y0, u32& x1, u32& y1)
+{
+	const u32 num_chunks_x = tilemap_num_chunks_x(tmr);
+	x0 = (c % num_chunks_x)*CROWN_TILEMAP_CHUNK_SIZE;
+	y0 = (c / num_chunks_x)*CROWN_TILEMAP_CHUNK_SIZE;
+	x1 = x0 + CROWN_TILEMAP_CHUNK_SIZE < tmr->width ? x0 + CROWN_TILEMAP_CHUNK_SIZE : tmr->width;
+	y1 = y0 + CROWN_TILEMAP_CHUNK_SIZE < tmr->height ? y0 + CROWN_TILEMAP_CHUNK_SIZE : tmr->height;
+}
+
+RenderWorld::RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, TextureManager& tm, UnitManager& um)
 	: _marker(RENDER_WORLD_MARKER)
 	, _allocator(&a)
 	, _resource_manager(&rm)
 	, _shader_manager(&sm)
 	, _material_manager(&mm)
+	, _texture_manager(&tm)
 	, _unit_manager(&um)
+	, _shadow_light(UINT32_MAX)
+	, _shadow_changes(a)
+	, _shadow_changes_overflow(false)
+	, _skin_matrices(a)
+	, _skin_dirty(false)
+	, _time(0.0f)
 	, _debug_drawing(false)
+	, _mesh_lod_bias(1.0f)
+	, _occlusion_buffer(NULL)
+	, _render_queue(a)
 	, _mesh_manager(a)
 	, _sprite_manager(a)
 	, _light_manager(a)
+	, _particle_manager(a)
+	, _tilemap_manager(a)
 {
 	um.register_destroy_function(unit_destroyed_callback_bridge, this);
 
-	_u_light_position  = bgfx::createUniform("u_light_position", bgfx::UniformType::Vec4);
-	_u_light_direction = bgfx::createUniform("u_light_direction", bgfx::UniformType::Vec4);
-	_u_light_color     = bgfx::createUniform("u_light_color", bgfx::UniformType::Vec4);
-	_u_light_range     = bgfx::createUniform("u_light_range", bgfx::UniformType::Vec4);
-	_u_light_intensity = bgfx::createUniform("u_light_intensity", bgfx::UniformType::Vec4);
+	memset(&_stats, 0, sizeof(_stats));
+
+	_u_lighting       = bgfx::createUniform("u_lighting", bgfx::UniformType::Vec4);
+	_u_light_clusters = bgfx::createUniform("u_light_clusters", bgfx::UniformType::Vec4);
+	_u_light_textures = bgfx::createUniform("u_light_textures", bgfx::UniformType::Vec4);
+	_u_light_data     = bgfx::createUniform("u_light_data", bgfx::UniformType::Int1);
+	_u_light_cluster  = bgfx::createUniform("u_light_cluster", bgfx::UniformType::Int1);
+	_u_light_index    = bgfx::createUniform("u_light_index", bgfx::UniformType::Int1);
+
+	_u_shadow_atlas    = bgfx::createUniform("u_shadow_atlas", bgfx::UniformType::Int1);
+	_u_shadow_cascades = bgfx::createUniform("u_shadow_cascades", bgfx::UniformType::Mat4, CROWN_SHADOW_CASCADES);
+	_u_shadow_splits   = bgfx::createUniform("u_shadow_splits", bgfx::UniformType::Vec4);
+	_u_shadow_params   = bgfx::createUniform("u_shadow_params", bgfx::UniformType::Vec4);
+
+	_u_skin         = bgfx::createUniform("u_skin", bgfx::UniformType::Vec4);
+	_u_mesh_decode  = bgfx::createUniform("u_mesh_decode", bgfx::UniformType::Vec4, 2);
+	_u_skin_palette = bgfx::createUniform("u_skin_palette", bgfx::UniformType::Int1);
+	_render_queue.set_skin_uniform(_u_skin);
+	_render_queue.set_mesh_decode_uniform(_u_mesh_decode);
+
+	// The skin palette is only created when a mesh is skinned
+	_skin_palette.idx = bgfx::kInvalidHandle;
+
+	// The shadow atlas is only created when a light casts shadows
+	_shadow_atlas.idx = bgfx::kInvalidHandle;
+	_shadow_frame_buffer.idx = bgfx::kInvalidHandle;
+	memset(_shadow_cascades, 0, sizeof(_shadow_cascades));
+	_shadow_splits = VECTOR4_ZERO;
+
+	for (u32 c = 0; c < CROWN_MAX_CAMERAS; ++c)
+	{
+		_light_data[c]     = bgfx::createTexture2D(CROWN_MAX_LIGHTS, LIGHT_DATA_ROWS, false, 1, bgfx::TextureFormat::RGBA32F);
+		_light_clusters[c] = bgfx::createTexture2D(LIGHT_CLUSTERS_XY, CROWN_LIGHT_CLUSTERS_Z, false, 1, bgfx::TextureFormat::RG32F);
+		_light_indices[c]  = bgfx::createTexture2D(LIGHT_INDICES_WIDTH, LIGHT_INDICES_HEIGHT, false, 1, bgfx::TextureFormat::R32F);
+	}
+
+	// The quads of the sprites drawn together are consecutive, the first
+	// six indices draw a single sprite
+	const bgfx::Memory* indices = bgfx::alloc(CROWN_SPRITE_BATCH_SIZE*6*sizeof(u16));
+	for (u32 i = 0; i < CROWN_SPRITE_BATCH_SIZE; ++i)
+	{
+		u16* quad = (u16*)indices->data + i*6;
+		quad[0] = u16(i*4 + 0);
+		quad[1] = u16(i*4 + 1);
+		quad[2] = u16(i*4 + 2);
+		quad[3] = u16(i*4 + 0);
+		quad[4] = u16(i*4 + 2);
+		quad[5] = u16(i*4 + 3);
+	}
+	_sprite_index_buffer = bgfx::createIndexBuffer(indices);
+	_u_sprite_time = bgfx::createUniform("u_sprite_time", bgfx::UniformType::Vec4);
 }
 
 RenderWorld::~RenderWorld()
 {
 	_unit_manager->unregister_destroy_function(this);
 
-	bgfx::destroy(_u_light_intensity);
-	bgfx::destroy(_u_light_range);
-	bgfx::destroy(_u_light_color);
-	bgfx::destroy(_u_light_direction);
-	bgfx::destroy(_u_light_position);
+	bgfx::destroy(_u_sprite_time);
+	bgfx::destroy(_sprite_index_buffer);
+	if (bgfx::isValid(_skin_palette))
+		bgfx::destroy(_skin_palette);
+	bgfx::destroy(_u_skin_palette);
+	bgfx::destroy(_u_mesh_decode);
+	bgfx::destroy(_u_skin);
+	if (bgfx::isValid(_shadow_frame_buffer))
+		bgfx::destroy(_shadow_frame_buffer);
+	if (bgfx::isValid(_shadow_atlas))
+		bgfx::destroy(_shadow_atlas);
+	bgfx::destroy(_u_shadow_params);
+	bgfx::destroy(_u_shadow_splits);
+	bgfx::destroy(_u_shadow_cascades);
+	bgfx::destroy(_u_shadow_atlas);
+	for (u32 c = 0; c < CROWN_MAX_CAMERAS; ++c)
+	{
+		bgfx::destroy(_light_indices[c]);
+		bgfx::destroy(_light_clusters[c]);
+		bgfx::destroy(_light_data[c]);
+	}
+	bgfx::destroy(_u_light_index);
+	bgfx::destroy(_u_light_cluster);
+	bgfx::destroy(_u_light_data);
+	bgfx::destroy(_u_light_textures);
+	bgfx::destroy(_u_light_clusters);
+	bgfx::destroy(_u_lighting);
 
 	_mesh_manager.destroy();
 	_sprite_manager.destroy();
 	_light_manager.destroy();
+	_particle_manager.destroy();
+	_tilemap_manager.destroy();
 
 	_marker = 0;
 }
 
+void RenderWorld::reserve(u32 num_meshes, u32 num_sprites, u32 num_lights)
+{
+	_mesh_manager.reserve(num_meshes);
+	_sprite_manager.reserve(num_sprites);
+	_light_manager.reserve(num_lights);
+}
+
+void RenderWorld::shrink_to_fit()
+{
+	_mesh_manager.shrink_to_fit();
+	_sprite_manager.shrink_to_fit();
+	_light_manager.shrink_to_fit();
+}
+
 MeshInstance RenderWorld::mesh_create(UnitId id, const MeshRendererDesc& mrd, const Matrix4x4& tr)
 {
 	const MeshResource* mr = (const MeshResource*)_resource_manager->get(RESOURCE_TYPE_MESH, mrd.mesh_resource);
 	const MeshGeometry* mg = mr->geometry(mrd.geometry_name);
 	_material_manager->create_material(mrd.material_resource);
 
-	return _mesh_manager.create(id, mr, mg, mrd.material_resource, tr);
+	MeshInstance inst = _mesh_manager.create(id, mr, mg, mrd.material_resource, tr);
+	add_shadow_change(world_aabb(_mesh_manager._data.obb[inst.i], tr));
+	return inst;
+}
+
+void RenderWorld::mesh_create(const UnitId* units, const Matrix4x4* tr, u32 num, const MeshRendererDesc& mrd)
+{
+	const MeshResource* mr = (const MeshResource*)_resource_manager->get(RESOURCE_TYPE_MESH, mrd.mesh_resource);
+	const MeshGeometry* mg = mr->geometry(mrd.geometry_name);
+	_material_manager->create_material(mrd.material_resource);
+
+	mesh_create(units, tr, num, mr, mg, mrd.material_resource);
+}
+
+void RenderWorld::mesh_create(const UnitId* units, const Matrix4x4* tr, u32 num, const MeshResource* mr, const MeshGeometry* mg, StringId64 material)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		MeshInstance inst = _mesh_manager.create(units[i], mr, mg, material, tr[i]);
+		add_shadow_change(world_aabb(_mesh_manager._data.obb[inst.i], tr[i]));
+	}
 }
 
 void RenderWorld::mesh_destroy(MeshInstance i)
 {
+	CE_ASSERT(i.i < _mesh_manager._data.size, "Index out of bounds");
+	add_shadow_change(world_aabb(_mesh_manager._data.obb[i.i], _mesh_manager._data.world[i.i]));
 	_mesh_manager.destroy(i);
 }
 
@@ -118,16 +326,165 @@ f32 RenderWorld::mesh_cast_ray(MeshInstance i, const Vector3& from, const Vector
 {
 	CE_ASSERT(i.i < _mesh_manager._data.size, "Index out of bounds");
 	const MeshGeometry* mg = _mesh_manager._data.geometry[i.i];
+
+	TempAllocator4096 ta;
+	Array<Vector3> decoded(ta);
+	u32 stride;
+	const char* vertices = mesh_resource::positions(mg, decoded, stride);
+
+	if (mg->indices.stride == sizeof(u32))
+	{
+		return ray_mesh_intersection(from
+			, dir
+			, _mesh_manager._data.world[i.i]
+			, vertices
+			, stride
+			, (u32*)mg->indices.data
+			, mg->indices.num
+			);
+	}
+
 	return ray_mesh_intersection(from
 		, dir
 		, _mesh_manager._data.world[i.i]
-		, mg->vertices.data
-		, mg->vertices.stride
+		, vertices
+		, stride
 		, (u16*)mg->indices.data
 		, mg->indices.num
 		);
 }
 
+void RenderWorld::mesh_query_aabb(const AABB& b, Array<MeshInstance>& instances)
+{
+	TempAllocator1024 ta;
+	Array<u32> result(ta);
+	_mesh_manager._tree.query_aabb(b, result);
+
+	for (u32 i = 0; i < array::size(result); ++i)
+		array::push_back(instances, _mesh_manager.make_instance(result[i]));
+}
+
+void RenderWorld::mesh_query_frustum(const Frustum& f, Array<MeshInstance>& instances)
+{
+	TempAllocator1024 ta;
+	Array<u32> result(ta);
+	_mesh_manager._tree.query_frustum(f, result);
+
+	for (u32 i = 0; i < array::size(result); ++i)
+		array::push_back(instances, _mesh_manager.make_instance(result[i]));
+}
+
+void RenderWorld::mesh_cast_rays(const Vector3* from, const Vector3* dir, u32 num, RenderRaycastHit* hits)
+{
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+
+	TempAllocator1024 ta;
+	Array<u32> candidates(ta);
+
+	for (u32 r = 0; r < num; ++r)
+	{
+		RenderRaycastHit& hit = hits[r];
+		hit.unit = UNIT_INVALID;
+		hit.distance = -1.0f;
+
+		array::clear(candidates);
+		_mesh_manager._tree.query_ray(from[r], dir[r], FLT_MAX, candidates);
+
+		for (u32 c = 0; c < array::size(candidates); ++c)
+		{
+			const u32 i = candidates[c];
+
+			// Skip the meshes whose box is farther than the nearest hit so far
+			if (hit.distance != -1.0f && ray_aabb_intersection(from[r], dir[r], _mesh_manager._tree.fat_aabb(mid.leaf[i])) > hit.distance)
+				continue;
+
+			const f32 t = mesh_cast_ray(_mesh_manager.make_instance(i), from[r], dir[r]);
+			if (t != -1.0f && (hit.distance == -1.0f || t < hit.distance))
+			{
+				hit.unit = mid.unit[i];
+				hit.distance = t;
+			}
+		}
+	}
+}
+
+void RenderWorld::skin_update(const UnitId* units, const u32* offsets, u32 num, const Matrix4x4* matrices, u32 num_matrices)
+{
+	CE_ASSERT(num_matrices <= CROWN_MAX_SKIN_BONES, "Too many skinned bones: %u (max %u)", num_matrices, CROWN_MAX_SKIN_BONES);
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+
+	array::resize(_skin_matrices, num_matrices);
+	memcpy(array::begin(_skin_matrices), matrices, num_matrices*sizeof(Matrix4x4));
+	_skin_dirty = true;
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		MeshInstance inst = _mesh_manager.first(units[i]);
+
+		while (is_valid(inst))
+		{
+			// Bounds are the ones of the bind pose
+			mid.skin[inst.i] = offsets[i];
+			add_shadow_change(world_aabb(mid.obb[inst.i], mid.world[inst.i]));
+			inst = _mesh_manager.next(inst);
+		}
+	}
+}
+
+// Uploads the skin matrices to the skin palette, if they have changed.
+static void update_skin_palette(RenderWorld& rw)
+{
+	if (!rw._skin_dirty)
+		return;
+
+	rw._skin_dirty = false;
+	const u32 num = array::size(rw._skin_matrices);
+	if (num == 0)
+		return;
+
+	if (!bgfx::isValid(rw._skin_palette))
+	{
+		rw._skin_palette = bgfx::createTexture2D(SKIN_PALETTE_WIDTH
+			, SKIN_PALETTE_HEIGHT
+			, false
+			, 1
+			, bgfx::TextureFormat::RGBA32F
+			, LIGHT_TEXTURE_FLAGS
+			);
+	}
+
+	// Only the rows in use are uploaded
+	const u32 rows = (num*3 + SKIN_PALETTE_WIDTH - 1) / SKIN_PALETTE_WIDTH;
+	const bgfx::Memory* mem = bgfx::alloc(rows*SKIN_PALETTE_WIDTH*sizeof(Vector4));
+	Vector4* texels = (Vector4*)mem->data;
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const Matrix4x4& m = rw._skin_matrices[i];
+		texels[i*3 + 0] = vector4(m.x.x, m.y.x, m.z.x, m.t.x);
+		texels[i*3 + 1] = vector4(m.x.y, m.y.y, m.z.y, m.t.y);
+		texels[i*3 + 2] = vector4(m.x.z, m.y.z, m.z.z, m.t.z);
+	}
+	memset((void*)&texels[num*3], 0, (rows*SKIN_PALETTE_WIDTH - num*3)*sizeof(Vector4));
+
+	bgfx::updateTexture2D(rw._skin_palette, 0, 0, 0, 0, SKIN_PALETTE_WIDTH, u16(rows), mem);
+}
+
+u32 RenderWorld::mesh_num() const
+{
+	return _mesh_manager._data.size;
+}
+
+const UnitId* RenderWorld::mesh_units() const
+{
+	return _mesh_manager._data.unit;
+}
+
+const Matrix4x4* RenderWorld::mesh_world_poses() const
+{
+	return _mesh_manager._data.world;
+}
+
 SpriteInstance RenderWorld::sprite_create(UnitId unit, const SpriteRendererDesc& srd, const Matrix4x4& tr)
 {
 	const SpriteResource* sr = (const SpriteResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE, srd.sprite_resource);
@@ -142,6 +499,20 @@ SpriteInstance RenderWorld::sprite_create(UnitId unit, const SpriteRendererDesc&
 		);
 }
 
+void RenderWorld::sprite_create(const UnitId* units, const Matrix4x4* tr, u32 num, const SpriteRendererDesc& srd)
+{
+	const SpriteResource* sr = (const SpriteResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE, srd.sprite_resource);
+	_material_manager->create_material(srd.material_resource);
+
+	sprite_create(units, tr, num, sr, srd.material_resource, srd.layer, srd.depth);
+}
+
+void RenderWorld::sprite_create(const UnitId* units, const Matrix4x4* tr, u32 num, const SpriteResource* sr, StringId64 material, u32 layer, u32 depth)
+{
+	for (u32 i = 0; i < num; ++i)
+		_sprite_manager.create(units[i], sr, material, layer, depth, tr[i]);
+}
+
 void RenderWorld::sprite_destroy(UnitId unit, SpriteInstance /*i*/)
 {
 	SpriteInstance i = _sprite_manager.sprite(unit);
@@ -159,13 +530,24 @@ void RenderWorld::sprite_set_material(UnitId unit, StringId64 id)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.material[i.i] = id;
+	_sprite_manager._loops_dirty = _sprite_manager._loops_dirty || _sprite_manager._data.loop[i.i].num_frames > 0;
 }
 
 void RenderWorld::sprite_set_frame(UnitId unit, u32 index)
 {
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
-	_sprite_manager._data.frame[i.i] = index;
+	_sprite_manager.set_frame(i, index);
+}
+
+void RenderWorld::sprite_set_frames(const UnitId* units, const u32* indices, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		SpriteInstance si = _sprite_manager.sprite(units[i]);
+		CE_ASSERT(si.i < _sprite_manager._data.size, "Index out of bounds");
+		_sprite_manager.set_frame(si, indices[i]);
+	}
 }
 
 void RenderWorld::sprite_set_visible(UnitId unit, bool visible)
@@ -175,18 +557,28 @@ void RenderWorld::sprite_set_visible(UnitId unit, bool visible)
 	_sprite_manager.set_visible(i, visible);
 }
 
+void RenderWorld::sprite_set_visibilities(const UnitId* units, const bool* visible, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		SpriteInstance si = _sprite_manager.sprite(units[i]);
+		CE_ASSERT(si.i < _sprite_manager._data.size, "Index out of bounds");
+		_sprite_manager.set_visible(si, visible[i]);
+	}
+}
+
 void RenderWorld::sprite_flip_x(UnitId unit, bool flip)
 {
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
-	_sprite_manager._data.flip_x[i.i] = flip;
+	_sprite_manager.set_flip(i, flip, _sprite_manager._data.flip_y[i.i]);
 }
 
 void RenderWorld::sprite_flip_y(UnitId unit, bool flip)
 {
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
-	_sprite_manager._data.flip_y[i.i] = flip;
+	_sprite_manager.set_flip(i, _sprite_manager._data.flip_x[i.i], flip);
 }
 
 void RenderWorld::sprite_set_layer(UnitId unit, u32 layer)
@@ -194,6 +586,7 @@ void RenderWorld::sprite_set_layer(UnitId unit, u32 layer)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.layer[i.i] = layer;
+	_sprite_manager._loops_dirty = _sprite_manager._loops_dirty || _sprite_manager._data.loop[i.i].num_frames > 0;
 }
 
 void RenderWorld::sprite_set_depth(UnitId unit, u32 depth)
@@ -201,6 +594,24 @@ void RenderWorld::sprite_set_depth(UnitId unit, u32 depth)
 	SpriteInstance i = _sprite_manager.sprite(unit);
 	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
 	_sprite_manager._data.depth[i.i] = depth;
+	_sprite_manager._loops_dirty = _sprite_manager._loops_dirty || _sprite_manager._data.loop[i.i].num_frames > 0;
+}
+
+void RenderWorld::sprite_set_loop(UnitId unit, u32 first_frame, u32 num_frames, f32 fps, f32 start_time)
+{
+	SpriteInstance i = _sprite_manager.sprite(unit);
+	CE_ASSERT(i.i < _sprite_manager._data.size, "Index out of bounds");
+	_sprite_manager.set_loop(i, first_frame, num_frames, fps, start_time);
+}
+
+void RenderWorld::update_time(f32 dt)
+{
+	_time += dt;
+}
+
+f32 RenderWorld::time() const
+{
+	return _time;
 }
 
 OBB RenderWorld::sprite_obb(UnitId unit)
@@ -253,6 +664,87 @@ f32 RenderWorld::sprite_cast_ray(UnitId unit, const Vector3& from, const Vector3
 		);
 }
 
+void RenderWorld::sprite_query_aabb(const AABB& b, Array<UnitId>& units)
+{
+	TempAllocator1024 ta;
+	Array<u32> result(ta);
+	_sprite_manager._tree.query_aabb(b, result);
+
+	for (u32 i = 0; i < array::size(result); ++i)
+		array::push_back(units, _sprite_manager._data.unit[result[i]]);
+}
+
+void RenderWorld::sprite_query_frustum(const Frustum& f, Array<UnitId>& units)
+{
+	TempAllocator1024 ta;
+	Array<u32> result(ta);
+	_sprite_manager._tree.query_frustum(f, result);
+
+	for (u32 i = 0; i < array::size(result); ++i)
+		array::push_back(units, _sprite_manager._data.unit[result[i]]);
+}
+
+void RenderWorld::sprite_cast_rays(const Vector3* from, const Vector3* dir, u32 num, RenderRaycastHit* hits)
+{
+	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
+
+	TempAllocator1024 ta;
+	Array<u32> candidates(ta);
+
+	for (u32 r = 0; r < num; ++r)
+	{
+		RenderRaycastHit& hit = hits[r];
+		hit.unit = UNIT_INVALID;
+		hit.distance = -1.0f;
+
+		u32 hit_layer = 0;
+		u32 hit_depth = 0;
+
+		array::clear(candidates);
+		_sprite_manager._tree.query_ray(from[r], dir[r], FLT_MAX, candidates);
+
+		for (u32 c = 0; c < array::size(candidates); ++c)
+		{
+			const UnitId unit = sid.unit[candidates[c]];
+
+			u32 layer;
+			u32 depth;
+			const f32 t = sprite_cast_ray(unit, from[r], dir[r], layer, depth);
+			if (t == -1.0f)
+				continue;
+
+			const bool is_above = hit.distance == -1.0f
+				|| layer > hit_layer
+				|| (layer == hit_layer && depth > hit_depth)
+				|| (layer == hit_layer && depth == hit_depth && t < hit.distance)
+				;
+
+			if (is_above)
+			{
+				hit.unit = unit;
+				hit.distance = t;
+				hit_layer = layer;
+				hit_depth = depth;
+			}
+		}
+	}
+}
+
+u32 RenderWorld::sprite_num() const
+{
+	return _sprite_manager._data.size;
+}
+
+const UnitId* RenderWorld::sprite_units() const
+{
+	return _sprite_manager._data.unit;
+}
+
+const Matrix4x4* RenderWorld::sprite_world_poses() const
+{
+	return _sprite_manager._data.world;
+}
+
 LightInstance RenderWorld::light_create(UnitId unit, const LightDesc& ld, const Matrix4x4& tr)
 {
 	return _light_manager.create(unit, ld, tr);
@@ -305,6 +797,13 @@ f32 RenderWorld::light_spot_angle(UnitId unit)
 	return _light_manager._data.spot_angle[i.i];
 }
 
+bool RenderWorld::light_cast_shadows(UnitId unit)
+{
+	LightInstance i = _light_manager.light(unit);
+	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
+	return _light_manager._data.cast_shadows[i.i];
+}
+
 void RenderWorld::light_set_color(UnitId unit, const Color4& col)
 {
 	LightInstance i = _light_manager.light(unit);
@@ -316,6 +815,7 @@ void RenderWorld::light_set_type(UnitId unit, LightType::Enum type)
 {
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
+	_light_manager.release_shadow_tiles(i.i);
 	_light_manager._data.type[i.i] = type;
 }
 
@@ -324,6 +824,7 @@ void RenderWorld::light_set_range(UnitId unit, f32 range)
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
 	_light_manager._data.range[i.i] = range;
+	_light_manager._data.shadow_dirty[i.i] = true;
 }
 
 void RenderWorld::light_set_intensity(UnitId unit, f32 intensity)
@@ -338,495 +839,2830 @@ void RenderWorld::light_set_spot_angle(UnitId unit, f32 angle)
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
 	_light_manager._data.spot_angle[i.i] = angle;
+	_light_manager._data.shadow_dirty[i.i] = true;
 }
 
-void RenderWorld::light_debug_draw(UnitId unit, DebugLine& dl)
+void RenderWorld::light_set_cast_shadows(UnitId unit, bool cast_shadows)
 {
 	LightInstance i = _light_manager.light(unit);
 	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
-	_light_manager.debug_draw(i.i, 1, dl);
+	if (!cast_shadows)
+		_light_manager.release_shadow_tiles(i.i);
+	_light_manager._data.cast_shadows[i.i] = cast_shadows;
 }
 
-void RenderWorld::update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
+void RenderWorld::snapshot(Buffer& buf)
 {
-	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
-	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
-	LightManager::LightInstanceData& lid = _light_manager._data;
+	const SpriteManager::SpriteInstanceData& sd = _sprite_manager._data;
+	snapshot::write(buf, sd.size);
+	snapshot::write(buf, sd.unit, sd.size*sizeof(UnitId));
+	snapshot::write(buf, sd.frame, sd.size*sizeof(u32));
+	snapshot::write(buf, sd.flip_x, sd.size*sizeof(bool));
+	snapshot::write(buf, sd.flip_y, sd.size*sizeof(bool));
+
+	const LightManager::LightInstanceData& ld = _light_manager._data;
+	snapshot::write(buf, ld.size);
+	snapshot::write(buf, ld.unit, ld.size*sizeof(UnitId));
+	snapshot::write(buf, ld.range, ld.size*sizeof(f32));
+	snapshot::write(buf, ld.intensity, ld.size*sizeof(f32));
+	snapshot::write(buf, ld.spot_angle, ld.size*sizeof(f32));
+	snapshot::write(buf, ld.color, ld.size*sizeof(Color4));
+	snapshot::write(buf, ld.type, ld.size*sizeof(u32));
+	snapshot::write(buf, ld.cast_shadows, ld.size*sizeof(bool));
+}
 
-	for (; begin != end; ++begin, ++world)
+bool RenderWorld::can_restore(const char* data)
+{
+	u32 num_sprites;
+	snapshot::read(data, num_sprites);
+	if (num_sprites != _sprite_manager._data.size)
+		return false;
+
+	for (u32 i = 0; i < num_sprites; ++i)
 	{
-		if (_mesh_manager.has(*begin))
-		{
-			MeshInstance inst = _mesh_manager.first(*begin);
-			mid.world[inst.i] = *world;
-		}
+		if (!_sprite_manager.has(snapshot::element<UnitId>(data, i)))
+			return false;
+	}
+	data += num_sprites*(sizeof(UnitId) + sizeof(u32) + sizeof(bool)*2);
 
-		if (_sprite_manager.has(*begin))
-		{
-			SpriteInstance inst = _sprite_manager.sprite(*begin);
-			sid.world[inst.i] = *world;
-		}
+	u32 num_lights;
+	snapshot::read(data, num_lights);
+	if (num_lights != _light_manager._data.size)
+		return false;
 
-		if (_light_manager.has(*begin))
-		{
-			LightInstance inst = _light_manager.light(*begin);
-			lid.world[inst.i] = *world;
-		}
+	for (u32 i = 0; i < num_lights; ++i)
+	{
+		if (!_light_manager.has(snapshot::element<UnitId>(data, i)))
+			return false;
 	}
+
+	return true;
 }
 
-void RenderWorld::render(const Matrix4x4& view)
+void RenderWorld::restore(const char* data)
 {
-	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
-	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
-	LightManager::LightInstanceData& lid = _light_manager._data;
-
-	for (u32 ll = 0; ll < lid.size; ++ll)
+	// The instances may have been reordered since the snapshot: the state is
+	// restored one instance at a time
+	u32 num_sprites;
+	snapshot::read(data, num_sprites);
+	const char* sprite_units = data;
+	const char* frame        = sprite_units + num_sprites*sizeof(UnitId);
+	const char* flip_x       = frame + num_sprites*sizeof(u32);
+	const char* flip_y       = flip_x + num_sprites*sizeof(bool);
+	data = flip_y + num_sprites*sizeof(bool);
+
+	for (u32 i = 0; i < num_sprites; ++i)
 	{
-		const Vector4 ldir = normalize(lid.world[ll].z) * view;
-		const Vector3 lpos = translation(lid.world[ll]);
-
-		bgfx::setUniform(_u_light_position, to_float_ptr(lpos));
-		bgfx::setUniform(_u_light_direction, to_float_ptr(ldir));
-		bgfx::setUniform(_u_light_color, to_float_ptr(lid.color[ll]));
-		bgfx::setUniform(_u_light_range, &lid.range[ll]);
-		bgfx::setUniform(_u_light_intensity, &lid.intensity[ll]);
-
-		// Render meshes
-		for (u32 i = 0; i < mid.first_hidden; ++i)
-		{
-			bgfx::setTransform(to_float_ptr(mid.world[i]));
-			bgfx::setVertexBuffer(0, mid.mesh[i].vbh);
-			bgfx::setIndexBuffer(mid.mesh[i].ibh);
-
-			_material_manager->get(mid.material[i])->bind(*_resource_manager, *_shader_manager, VIEW_MESH);
-		}
+		SpriteInstance si = _sprite_manager.sprite(snapshot::element<UnitId>(sprite_units, i));
+		_sprite_manager.set_frame(si, snapshot::element<u32>(frame, i));
+		_sprite_manager.set_flip(si, snapshot::element<bool>(flip_x, i), snapshot::element<bool>(flip_y, i));
 	}
 
-	// Render sprites
-	if (sid.first_hidden)
+	u32 num_lights;
+	snapshot::read(data, num_lights);
+	const char* light_units  = data;
+	const char* range        = light_units + num_lights*sizeof(UnitId);
+	const char* intensity    = range + num_lights*sizeof(f32);
+	const char* spot_angle   = intensity + num_lights*sizeof(f32);
+	const char* color        = spot_angle + num_lights*sizeof(f32);
+	const char* type         = color + num_lights*sizeof(Color4);
+	const char* cast_shadows = type + num_lights*sizeof(u32);
+
+	LightManager::LightInstanceData& ld = _light_manager._data;
+	for (u32 i = 0; i < num_lights; ++i)
 	{
-		bgfx::VertexDecl decl;
-		decl.begin()
-			.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
-			.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, false)
-			.end()
-			;
-		bgfx::TransientVertexBuffer tvb;
-		bgfx::allocTransientVertexBuffer(&tvb, 4*sid.first_hidden, decl);
-		bgfx::TransientIndexBuffer tib;
-		bgfx::allocTransientIndexBuffer(&tib, 6*sid.first_hidden);
+		const u32 j = _light_manager.light(snapshot::element<UnitId>(light_units, i)).i;
+		const u32 type_i = snapshot::element<u32>(type, i);
+		const bool cast_shadows_i = snapshot::element<bool>(cast_shadows, i);
+		if (ld.type[j] != type_i || !cast_shadows_i)
+			_light_manager.release_shadow_tiles(j);
+
+		ld.range[j]        = snapshot::element<f32>(range, i);
+		ld.intensity[j]    = snapshot::element<f32>(intensity, i);
+		ld.spot_angle[j]   = snapshot::element<f32>(spot_angle, i);
+		ld.color[j]        = snapshot::element<Color4>(color, i);
+		ld.type[j]         = type_i;
+		ld.cast_shadows[j] = cast_shadows_i;
+		ld.shadow_dirty[j] = true;
+	}
+}
 
-		f32* vdata = (f32*)tvb.data;
-		u16* idata = (u16*)tib.data;
+void RenderWorld::light_debug_draw(UnitId unit, DebugLine& dl)
+{
+	LightInstance i = _light_manager.light(unit);
+	CE_ASSERT(i.i < _light_manager._data.size, "Index out of bounds");
+	_light_manager.debug_draw(i.i, 1, dl);
+}
 
-		// Render sprites
-		for (u32 i = 0; i < sid.first_hidden; ++i)
-		{
-			const f32* frame = sprite_resource::frame_data(sid.resource[i], sid.frame[i]);
+ParticleInstance RenderWorld::particle_create(UnitId unit, const ParticleEmitterDesc& ped, const Matrix4x4& tr)
+{
+	const ParticleResource* pr = (const ParticleResource*)_resource_manager->get(RESOURCE_TYPE_PARTICLE, ped.particle_resource);
+	_material_manager->create_material(ped.material_resource);
 
-			f32 u0 = frame[ 3]; // u
-			f32 v0 = frame[ 4]; // v
+	return _particle_manager.create(unit, pr, ped.material_resource, ped.playing != 0, tr);
+}
 
-			f32 u1 = frame[ 8]; // u
-			f32 v1 = frame[ 9]; // v
+void RenderWorld::particle_destroy(UnitId unit, ParticleInstance /*i*/)
+{
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	_particle_manager.destroy(i);
+}
 
-			f32 u2 = frame[13]; // u
-			f32 v2 = frame[14]; // v
+ParticleInstance RenderWorld::particle_instance(UnitId unit)
+{
+	return _particle_manager.particle(unit);
+}
 
-			f32 u3 = frame[18]; // u
-			f32 v3 = frame[19]; // v
+void RenderWorld::particle_play(UnitId unit)
+{
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	_particle_manager._data.playing[i.i] = true;
+}
 
-			if (sid.flip_x[i])
-			{
-				f32 u;
-				u = u0; u0 = u1; u1 = u;
-				u = u2; u2 = u3; u3 = u;
-			}
+void RenderWorld::particle_stop(UnitId unit)
+{
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	_particle_manager._data.playing[i.i] = false;
+}
 
-			if (sid.flip_y[i])
-			{
-				f32 v;
-				v = v0; v0 = v2; v2 = v;
-				v = v1; v1 = v3; v3 = v;
-			}
+bool RenderWorld::particle_is_playing(UnitId unit)
+{
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	return _particle_manager._data.playing[i.i];
+}
 
-			vdata[ 0] = frame[ 0]; // x
-			vdata[ 1] = frame[ 1]; // y
-			vdata[ 2] = frame[ 2]; // z
-			vdata[ 3] = u0;
-			vdata[ 4] = v0;
-
-			vdata[ 5] = frame[ 5]; // x
-			vdata[ 6] = frame[ 6]; // y
-			vdata[ 7] = frame[ 7]; // z
-			vdata[ 8] = u1;
-			vdata[ 9] = v1;
-
-			vdata[10] = frame[10]; // x
-			vdata[11] = frame[11]; // y
-			vdata[12] = frame[12]; // z
-			vdata[13] = u2;
-			vdata[14] = v2;
-
-			vdata[15] = frame[15]; // x
-			vdata[16] = frame[16]; // y
-			vdata[17] = frame[17]; // z
-			vdata[18] = u3;
-			vdata[19] = v3;
-
-			vdata += 20;
-
-			*idata++ = i*4+0;
-			*idata++ = i*4+1;
-			*idata++ = i*4+2;
-			*idata++ = i*4+0;
-			*idata++ = i*4+2;
-			*idata++ = i*4+3;
-
-			bgfx::setTransform(to_float_ptr(sid.world[i]));
-			bgfx::setVertexBuffer(0, &tvb);
-			bgfx::setIndexBuffer(&tib, i*6, 6);
-
-			_material_manager->get(sid.material[i])->bind(*_resource_manager
-				, *_shader_manager
-				, sid.layer[i] + VIEW_SPRITE_0
-				, sid.depth[i]
-				);
-		}
-	}
+void RenderWorld::particle_burst(UnitId unit, u32 num)
+{
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	_particle_manager._data.spawn[i.i] += f32(num);
 }
 
-void RenderWorld::debug_draw(DebugLine& dl)
+u32 RenderWorld::particle_num(UnitId unit)
 {
-	if (!_debug_drawing)
-		return;
+	ParticleInstance i = _particle_manager.particle(unit);
+	CE_ASSERT(i.i < _particle_manager._data.size, "Index out of bounds");
+	return _particle_manager._data.num[i.i];
+}
 
-	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+TilemapInstance RenderWorld::tilemap_create(UnitId unit, const TilemapDesc& td, const Matrix4x4& tr)
+{
+	const TilemapResource* tmr = (const TilemapResource*)_resource_manager->get(RESOURCE_TYPE_TILEMAP, td.tilemap_resource);
+	_material_manager->create_material(td.material_resource);
 
-	for (u32 i = 0; i < mid.size; ++i)
+	return _tilemap_manager.create(unit, tmr, td.material_resource, td.layer, td.depth, tr);
+}
+
+void RenderWorld::tilemap_destroy(UnitId unit, TilemapInstance /*i*/)
+{
+	TilemapInstance i = _tilemap_manager.tilemap(unit);
+	CE_ASSERT(i.i < _tilemap_manager._data.size, "Index out of bounds");
+	_tilemap_manager.destroy(i);
+}
+
+TilemapInstance RenderWorld::tilemap_instance(UnitId unit)
+{
+	return _tilemap_manager.tilemap(unit);
+}
+
+void RenderWorld::tilemap_size(UnitId unit, u32& width, u32& height)
+{
+	TilemapInstance i = _tilemap_manager.tilemap(unit);
+	CE_ASSERT(i.i < _tilemap_manager._data.size, "Index out of bounds");
+	width = _tilemap_manager._data.resource[i.i]->width;
+	height = _tilemap_manager._data.resource[i.i]->height;
+}
+
+u32 RenderWorld::tilemap_tile(UnitId unit, u32 x, u32 y)
+{
+	TilemapInstance i = _tilemap_manager.tilemap(unit);
+	CE_ASSERT(i.i < _tilemap_manager._data.size, "Index out of bounds");
+	const TilemapResource* tmr = _tilemap_manager._data.resource[i.i];
+	CE_ASSERT(x < tmr->width && y < tmr->height, "Tile out of bounds");
+	return _tilemap_manager._data.tiles[i.i][y*tmr->width + x];
+}
+
+void RenderWorld::tilemap_set_tile(UnitId unit, u32 x, u32 y, u32 tile)
+{
+	TilemapInstance i = _tilemap_manager.tilemap(unit);
+	CE_ASSERT(i.i < _tilemap_manager._data.size, "Index out of bounds");
+	_tilemap_manager.set_tile(i, x, y, tile);
+}
+
+struct SimulateParticlesData
+{
+	RenderWorld::ParticleManager* manager;
+	f32 dt;
+};
+
+// Simulates the particle emitters in [@a begin, @a end).
+static void simulate_particles(u32 begin, u32 end, void* user_data)
+{
+	SimulateParticlesData* data = (SimulateParticlesData*)user_data;
+
+	for (u32 i = begin; i < end; ++i)
+		data->manager->simulate(i, data->dt);
+}
+
+void RenderWorld::update_particles(f32 dt)
+{
+	ParticleManager::ParticleInstanceData& pid = _particle_manager._data;
+
+	SimulateParticlesData spd;
+	spd.manager = &_particle_manager;
+	spd.dt = dt;
+
+	// Emitters are independent, each one is simulated by a single job
+	if (_particle_manager._num_particles < CROWN_PARTICLE_MIN_JOB_SIZE || job_system::num_threads() == 1)
+		simulate_particles(0, pid.size, &spd);
+	else
+		job_system::parallel_for(0, pid.size, 1, simulate_particles, &spd);
+
+	u32 num_particles = 0;
+	for (u32 i = 0; i < pid.size; ++i)
+		num_particles += pid.num[i];
+	_particle_manager._num_particles = num_particles;
+
+	RECORD_FLOAT("render_world.particles", f32(num_particles));
+}
+
+void RenderWorld::update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
+{
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
+	LightManager::LightInstanceData& lid = _light_manager._data;
+	ParticleManager::ParticleInstanceData& pid = _particle_manager._data;
+
+	for (; begin != end; ++begin, ++world)
+	{
+		if (_mesh_manager.has(*begin))
+		{
+			MeshInstance inst = _mesh_manager.first(*begin);
+			const AABB box = world_aabb(mid.obb[inst.i], *world);
+			add_shadow_change(world_aabb(mid.obb[inst.i], mid.world[inst.i]));
+			add_shadow_change(box);
+			mid.world[inst.i] = *world;
+			_mesh_manager._tree.move(mid.leaf[inst.i], box);
+		}
+
+		if (_sprite_manager.has(*begin))
+		{
+			SpriteInstance inst = _sprite_manager.sprite(*begin);
+			sid.world[inst.i] = *world;
+			_sprite_manager._tree.move(sid.leaf[inst.i], world_aabb(sid.resource[inst.i]->obb, *world));
+			_sprite_manager._loops_dirty = _sprite_manager._loops_dirty || sid.loop[inst.i].num_frames > 0;
+		}
+
+		if (_light_manager.has(*begin))
+		{
+			LightInstance inst = _light_manager.light(*begin);
+			lid.world[inst.i] = *world;
+			lid.shadow_dirty[inst.i] = true;
+		}
+
+		if (_particle_manager.has(*begin))
+		{
+			ParticleInstance inst = _particle_manager.particle(*begin);
+			pid.world[inst.i] = *world;
+		}
+
+		if (_tilemap_manager.has(*begin))
+		{
+			TilemapInstance inst = _tilemap_manager.tilemap(*begin);
+			_tilemap_manager._data.world[inst.i] = *world;
+		}
+	}
+}
+
+void RenderWorld::set_textures_distance(StringId64 material, f32 distance)
+{
+	const MaterialResource* mr = _material_manager->get(material)->_resource;
+
+	for (u32 i = 0; i < mr->num_textures; ++i)
+		_texture_manager->set_distance(material_resource::get_texture_data(mr, i)->id, distance);
+}
+
+// Writes the four vertices of the @a frame_num of the sprite @a i to @a vdata.
+static void sprite_vertices(f32* vdata, const RenderWorld::SpriteManager::SpriteInstanceData& sid, u32 i, u32 frame_num)
+{
+	const f32* frame = sprite_resource::frame_data(sid.resource[i], frame_num);
+
+	f32 u0 = frame[ 3]; // u
+	f32 v0 = frame[ 4]; // v
+
+	f32 u1 = frame[ 8]; // u
+	f32 v1 = frame[ 9]; // v
+
+	f32 u2 = frame[13]; // u
+	f32 v2 = frame[14]; // v
+
+	f32 u3 = frame[18]; // u
+	f32 v3 = frame[19]; // v
+
+	if (sid.flip_x[i])
+	{
+		f32 u;
+		u = u0; u0 = u1; u1 = u;
+		u = u2; u2 = u3; u3 = u;
+	}
+
+	if (sid.flip_y[i])
+	{
+		f32 v;
+		v = v0; v0 = v2; v2 = v;
+		v = v1; v1 = v3; v3 = v;
+	}
+
+	vdata[ 0] = frame[ 0]; // x
+	vdata[ 1] = frame[ 1]; // y
+	vdata[ 2] = frame[ 2]; // z
+	vdata[ 3] = u0;
+	vdata[ 4] = v0;
+
+	vdata[ 5] = frame[ 5]; // x
+	vdata[ 6] = frame[ 6]; // y
+	vdata[ 7] = frame[ 7]; // z
+	vdata[ 8] = u1;
+	vdata[ 9] = v1;
+
+	vdata[10] = frame[10]; // x
+	vdata[11] = frame[11]; // y
+	vdata[12] = frame[12]; // z
+	vdata[13] = u2;
+	vdata[14] = v2;
+
+	vdata[15] = frame[15]; // x
+	vdata[16] = frame[16]; // y
+	vdata[17] = frame[17]; // z
+	vdata[18] = u3;
+	vdata[19] = v3;
+}
+
+static bgfx::VertexDecl sprite_vertex_decl()
+{
+	bgfx::VertexDecl decl;
+	decl.begin()
+		.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, false)
+		.end()
+		;
+	return decl;
+}
+
+// Vertices of the looping sprites: the texcoord1 holds the frame of the
+// quad in the loop, the number of frames, the fps and the start time.
+static bgfx::VertexDecl sprite_loop_vertex_decl()
+{
+	bgfx::VertexDecl decl;
+	decl.begin()
+		.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, false)
+		.add(bgfx::Attrib::TexCoord1, 4, bgfx::AttribType::Float, false)
+		.end()
+		;
+	return decl;
+}
+
+// Sorts the @a num @a sprites by layer, depth and material into @a order.
+static void sort_sprites(const RenderWorld::SpriteManager::SpriteInstanceData& sid, const u32* sprites, u32 num, Array<u32>& order)
+{
+	// Materials are keyed by their order of appearance, the sort only
+	// needs sprites sharing material to be contiguous.
+	HashMap<StringId64, u32> materials(default_frame_allocator());
+	Array<u64> keys(default_frame_allocator());
+	Array<u64> tmp_keys(default_frame_allocator());
+	Array<u32> tmp_order(default_frame_allocator());
+	array::resize(keys, num);
+	array::resize(order, num);
+	array::resize(tmp_keys, num);
+	array::resize(tmp_order, num);
+
+	for (u32 s = 0; s < num; ++s)
+	{
+		const u32 i = sprites[s];
+		u32 material = hash_map::get(materials, sid.material[i], UINT32_MAX);
+		if (material == UINT32_MAX)
+		{
+			material = hash_map::size(materials);
+			hash_map::set(materials, sid.material[i], material);
+		}
+
+		CE_ASSERT(sid.layer[i] < 256, "Layer out of bounds: %u", sid.layer[i]);
+		keys[s] = (u64(sid.layer[i]) << 56) | (u64(sid.depth[i]) << 24) | u64(material & 0xffffff);
+		order[s] = i;
+	}
+
+	radix_sort(array::begin(keys), array::begin(order), array::begin(tmp_keys), array::begin(tmp_order), num);
+}
+
+/// Sprites drawn with a single draw call.
+struct SpriteDraw
+{
+	u32 sprite;       ///< First sprite of the draw.
+	u32 num;          ///< Number of sprites, drawn in world space if greater than one or if loop.
+	u32 first_vertex; ///< First vertex in the transient buffer, or in the loop buffer if loop.
+	u32 num_vertices;
+	bool loop;        ///< Whether the sprites loop.
+};
+
+// Sorts the visible @a sprites which do not loop by layer, depth and
+// material and appends to @a draws one draw for each run of sprites sharing
+// layer and material. The vertices of the runs are written, in world
+// space, to @a tvb.
+static void batch_sprites(const RenderWorld& rw, const Array<u32>& sprites, Array<SpriteDraw>& draws, bgfx::TransientVertexBuffer& tvb)
+{
+	const RenderWorld::SpriteManager::SpriteInstanceData& sid = rw._sprite_manager._data;
+
+	Array<u32> still(default_frame_allocator());
+	for (u32 s = 0; s < array::size(sprites); ++s)
+	{
+		if (sid.loop[sprites[s]].num_frames == 0)
+			array::push_back(still, sprites[s]);
+	}
+
+	const u32 num = array::size(still);
+	Array<u32> order(default_frame_allocator());
+	sort_sprites(sid, array::begin(still), num, order);
+
+	// Runs of sprites sharing layer and material
+	const u32 first_draw = array::size(draws);
+	u32 num_batched = 0;
+	for (u32 s = 0; s < num;)
+	{
+		const u32 i = order[s];
+		u32 run = 1;
+		while (s + run < num
+			&& run < CROWN_SPRITE_BATCH_SIZE
+			&& sid.layer[order[s + run]] == sid.layer[i]
+			&& sid.material[order[s + run]] == sid.material[i]
+			)
+			++run;
+
+		SpriteDraw sd;
+		sd.sprite = s;
+		sd.num = run;
+		sd.first_vertex = 0;
+		sd.num_vertices = run*4;
+		sd.loop = false;
+		array::push_back(draws, sd);
+
+		if (run > 1)
+			num_batched += run;
+		s += run;
+	}
+
+	// Draw each sprite on its own when the runs do not fit the transient
+	// buffer.
+	const bgfx::VertexDecl decl = sprite_vertex_decl();
+	if (num_batched == 0 || bgfx::getAvailTransientVertexBuffer(num_batched*4, decl) < num_batched*4)
+	{
+		array::resize(draws, first_draw);
+		for (u32 s = 0; s < num; ++s)
+		{
+			SpriteDraw sd = { order[s], 1, 0, 4, false };
+			array::push_back(draws, sd);
+		}
+		return;
+	}
+
+	bgfx::allocTransientVertexBuffer(&tvb, num_batched*4, decl);
+	f32* vdata = (f32*)tvb.data;
+	u32 num_vertices = 0;
+
+	for (u32 d = first_draw; d < array::size(draws); ++d)
+	{
+		SpriteDraw& sd = draws[d];
+		const u32 first = sd.sprite;
+		sd.sprite = order[first];
+		if (sd.num == 1)
+			continue;
+
+		sd.first_vertex = num_vertices;
+		for (u32 s = first; s < first + sd.num; ++s)
+		{
+			const u32 i = order[s];
+			sprite_vertices(vdata, sid, i, sid.frame[i]);
+			for (u32 v = 0; v < 4; ++v)
+			{
+				f32* pos = vdata + v*5;
+				const Vector3 p = vector3(pos[0], pos[1], pos[2]) * sid.world[i];
+				pos[0] = p.x;
+				pos[1] = p.y;
+				pos[2] = p.z;
+			}
+			vdata += 4*5;
+		}
+		num_vertices += sd.num*4;
+	}
+}
+
+// Appends to @a draws one draw for each run of the visible @a sprites
+// which loop and are contiguous in the loop buffer with the same layer,
+// depth and material.
+static void batch_sprite_loops(const RenderWorld& rw, const Array<u32>& sprites, Array<SpriteDraw>& draws)
+{
+	const RenderWorld::SpriteManager& sm = rw._sprite_manager;
+	const RenderWorld::SpriteManager::SpriteInstanceData& sid = sm._data;
+
+	Array<u32> slots(default_frame_allocator());
+	for (u32 s = 0; s < array::size(sprites); ++s)
+	{
+		const RenderWorld::SpriteManager::SpriteLoop& sl = sid.loop[sprites[s]];
+		if (sl.num_frames > 0)
+			array::push_back(slots, sl.slot);
+	}
+	std::sort(array::begin(slots), array::end(slots));
+
+	const u32 num = array::size(slots);
+	for (u32 s = 0; s < num;)
+	{
+		const u32 first = slots[s];
+		const u32 i = sm._loop_sprites[first];
+		u32 run = 1;
+		while (s + run < num && slots[s + run] == first + run)
+		{
+			const u32 next = sm._loop_sprites[first + run];
+			if (sid.layer[next] != sid.layer[i]
+				|| sid.depth[next] != sid.depth[i]
+				|| sid.material[next] != sid.material[i]
+				|| sm._loop_first_vertex[first + run + 1] - sm._loop_first_vertex[first] > CROWN_SPRITE_BATCH_SIZE*4
+				)
+				break;
+			++run;
+		}
+
+		SpriteDraw sd;
+		sd.sprite = i;
+		sd.num = run;
+		sd.first_vertex = sm._loop_first_vertex[first];
+		sd.num_vertices = sm._loop_first_vertex[first + run] - sd.first_vertex;
+		sd.loop = true;
+		array::push_back(draws, sd);
+
+		s += run;
+	}
+}
+
+struct SubmitSpritesData
+{
+	RenderWorld* render_world;
+	const SpriteDraw* draws;
+	const bgfx::TransientVertexBuffer* tvb;
+	u8 view_offset; ///< Offset of the views of the camera.
+};
+
+// Submits the sprite draws in [@a begin, @a end) with the encoder of the
+// calling thread.
+static void submit_sprites(u32 begin, u32 end, void* user_data)
+{
+	SubmitSpritesData* data = (SubmitSpritesData*)user_data;
+	RenderWorld* rw = data->render_world;
+	const RenderWorld::SpriteManager::SpriteInstanceData& sid = rw->_sprite_manager._data;
+	const Vector4 time = vector4(rw->_time, 0.0f, 0.0f, 0.0f);
+
+	bgfx::Encoder* encoder = bgfx::begin();
+	CE_ENSURE(encoder != NULL);
+
+	for (u32 d = begin; d < end; ++d)
+	{
+		const SpriteDraw& sd = data->draws[d];
+		const u32 i = sd.sprite;
+		const Material* material = rw->_material_manager->get(sid.material[i]);
+
+		if (sd.loop)
+		{
+			encoder->setVertexBuffer(0, rw->_sprite_manager._loop_vertex_buffer, sd.first_vertex, sd.num_vertices);
+			encoder->setUniform(rw->_u_sprite_time, to_float_ptr(time));
+		}
+		else if (sd.num == 1)
+		{
+			encoder->setTransform(to_float_ptr(sid.world[i]));
+			encoder->setVertexBuffer(0, rw->_sprite_manager._vertex_buffer, i*4, 4);
+		}
+		else
+		{
+			encoder->setVertexBuffer(0, data->tvb, sd.first_vertex, sd.num_vertices);
+		}
+		encoder->setIndexBuffer(rw->_sprite_index_buffer, 0, sd.num_vertices/4*6);
+
+		// The draws are in depth order already, the depth of the first
+		// sprite keeps them so across draws.
+		material->set_state(*rw->_resource_manager, *rw->_shader_manager, *encoder);
+		rw->_shader_manager->submit(*encoder
+			, sd.loop ? "sprite_loop"_id32 : material->_resource->shader
+			, sid.layer[i] + VIEW_SPRITE_0 + data->view_offset
+			, sid.depth[i]
+			);
+	}
+
+	bgfx::end(encoder);
+}
+
+// Orders mesh instances by geometry and material so that instances which
+// can be drawn together are contiguous.
+struct MeshBatchLess
+{
+	const RenderWorld::MeshManager::MeshInstanceData* mid;
+
+	bool operator()(u32 a, u32 b) const
+	{
+		const RenderWorld::MeshManager::MeshData& ma = mid->mesh[a];
+		const RenderWorld::MeshManager::MeshData& mb = mid->mesh[b];
+		if (ma.vbh.idx != mb.vbh.idx)
+			return ma.vbh.idx < mb.vbh.idx;
+		if (ma.ibh.idx != mb.ibh.idx)
+			return ma.ibh.idx < mb.ibh.idx;
+		if (mid->material[a] != mid->material[b])
+			return mid->material[a] < mid->material[b];
+		return a < b;
+	}
+};
+
+// Appends to @a visible the instances before @a first_hidden whose box in
+// @a tree intersects the frustum @a f, in ascending order.
+static void cull(AABBTree& tree, const Frustum& f, u32 first_hidden, Array<u32>& visible)
+{
+	tree.query_frustum(f, visible);
+
+	u32 num = 0;
+	for (u32 i = 0; i < array::size(visible); ++i)
+	{
+		if (visible[i] < first_hidden)
+			visible[num++] = visible[i];
+	}
+	array::resize(visible, num);
+
+	// Keep the submission order independent of the shape of the tree
+	std::sort(array::begin(visible), array::end(visible));
+}
+
+struct CullCamerasData
+{
+	RenderWorld* render_world;
+	const Frustum* frustums;
+	Array<u32>** meshes;
+	Array<u32>** sprites;
+};
+
+// Collects the visible meshes and sprites of the cameras in
+// [@a begin, @a end).
+static void cull_cameras(u32 begin, u32 end, void* user_data)
+{
+	CullCamerasData* data = (CullCamerasData*)user_data;
+	RenderWorld* rw = data->render_world;
+
+	for (u32 c = begin; c < end; ++c)
+	{
+		cull(rw->_mesh_manager._tree, data->frustums[c], rw->_mesh_manager._data.first_hidden, *data->meshes[c]);
+		cull(rw->_sprite_manager._tree, data->frustums[c], rw->_sprite_manager._data.first_hidden, *data->sprites[c]);
+	}
+}
+
+// Draws the chunks of the tilemaps inside the frustum @a f, in their
+// sprite layer, and returns the number of chunks culled.
+static u32 render_tilemaps(RenderWorld& rw, const Frustum& f, const Vector3& camera_pos, u8 view_offset)
+{
+	const RenderWorld::TilemapManager::TilemapInstanceData& tid = rw._tilemap_manager._data;
+	u32 num_culled = 0;
+
+	for (u32 i = 0; i < tid.size; ++i)
+	{
+		const TilemapResource* tmr = tid.resource[i];
+		const u32 num_chunks = tilemap_num_chunks_x(tmr) * tilemap_num_chunks_y(tmr);
+		const Material* material = rw._material_manager->get(tid.material[i]);
+
+		for (u32 c = 0; c < num_chunks; ++c)
+		{
+			const RenderWorld::TilemapManager::Chunk& chunk = tid.chunks[i][c];
+			if (chunk.num_tiles == 0)
+				continue;
+
+			const AABB box = aabb::transformed(chunk.aabb, tid.world[i]);
+			if (!frustum_box_intersection(f, box))
+			{
+				++num_culled;
+				continue;
+			}
+
+			rw.set_textures_distance(tid.material[i], distance(camera_pos, aabb::center(box)));
+
+			bgfx::setTransform(to_float_ptr(tid.world[i]));
+			bgfx::setVertexBuffer(0, chunk.vbh);
+			bgfx::setIndexBuffer(rw._sprite_index_buffer, 0, chunk.num_tiles*6);
+			material->bind(*rw._resource_manager
+				, *rw._shader_manager
+				, u8(VIEW_SPRITE_0 + tid.layer[i] + view_offset)
+				, s32(tid.depth[i])
+				);
+			++rw._stats.tilemap_draw_calls;
+		}
+	}
+
+	return num_culled;
+}
+
+struct ParticleVertex
+{
+	f32 x, y, z;
+	f32 u, v;
+	u8 color[4];
+};
+
+static bgfx::VertexDecl particle_vertex_decl()
+{
+	bgfx::VertexDecl decl;
+	decl.begin()
+		.add(bgfx::Attrib::Position,  3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float, false)
+		.add(bgfx::Attrib::Color0,    4, bgfx::AttribType::Uint8, true)
+		.end()
+		;
+	return decl;
+}
+
+// Orders particle emitters from the farthest to the nearest to the camera.
+struct ParticleDepthGreater
+{
+	const f32* depth;
+
+	bool operator()(u32 a, u32 b) const
+	{
+		return depth[a] != depth[b] ? depth[a] > depth[b] : a < b;
+	}
+};
+
+// Writes the camera-facing quads of the @a num particles of the emitter
+// @a i to @a vertices. The size and the color of four particles at a
+// time are interpolated by their age.
+static void particle_vertices(ParticleVertex* vertices, const RenderWorld::ParticleManager::ParticleInstanceData& pid, u32 i, u32 num, const Vector3& right, const Vector3& up)
+{
+	const ParticleResource* pr = pid.resource[i];
+	const u32 stride = particle_stride(pr);
+	const f32* px = pid.particles[i] + RenderWorld::ParticleManager::PX*stride;
+	const f32* py = pid.particles[i] + RenderWorld::ParticleManager::PY*stride;
+	const f32* pz = pid.particles[i] + RenderWorld::ParticleManager::PZ*stride;
+	const f32* age = pid.particles[i] + RenderWorld::ParticleManager::AGE*stride;
+	const f32* lifetime = pid.particles[i] + RenderWorld::ParticleManager::LIFETIME*stride;
+
+	const simd::Float4 size_start  = simd::splat(pr->size_start);
+	const simd::Float4 size_delta  = simd::splat(pr->size_end - pr->size_start);
+	const simd::Float4 color_start[] =
+	{
+		simd::splat(pr->color_start.x*255.0f),
+		simd::splat(pr->color_start.y*255.0f),
+		simd::splat(pr->color_start.z*255.0f),
+		simd::splat(pr->color_start.w*255.0f)
+	};
+	const simd::Float4 color_delta[] =
+	{
+		simd::splat((pr->color_end.x - pr->color_start.x)*255.0f),
+		simd::splat((pr->color_end.y - pr->color_start.y)*255.0f),
+		simd::splat((pr->color_end.z - pr->color_start.z)*255.0f),
+		simd::splat((pr->color_end.w - pr->color_start.w)*255.0f)
+	};
+
+	// Streams are padded to a multiple of four particles
+	for (u32 j = 0; j < num; j += 4)
+	{
+		const simd::Float4 t = simd::div(simd::load(age + j), simd::load(lifetime + j));
+
+		f32 size[4];
+		f32 color[4][4];
+		simd::store(size, simd::madd(t, size_delta, size_start));
+		for (u32 c = 0; c < 4; ++c)
+			simd::store(color[c], simd::madd(t, color_delta[c], color_start[c]));
+
+		const u32 n = num - j < 4 ? num - j : 4;
+		for (u32 k = 0; k < n; ++k)
+		{
+			const Vector3 pos = vector3(px[j + k], py[j + k], pz[j + k]);
+			const Vector3 r = right*size[k];
+			const Vector3 u = up*size[k];
+			const Vector3 corners[] = { pos - r - u, pos + r - u, pos + r + u, pos - r + u };
+			const f32 uvs[][2] = { { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f }, { 0.0f, 0.0f } };
+
+			u8 rgba[4];
+			for (u32 c = 0; c < 4; ++c)
+			{
+				const f32 v = color[c][k];
+				rgba[c] = u8(v < 0.0f ? 0.0f : v > 255.0f ? 255.0f : v);
+			}
+
+			ParticleVertex* quad = vertices + (j + k)*4;
+			for (u32 v = 0; v < 4; ++v)
+			{
+				quad[v].x = corners[v].x;
+				quad[v].y = corners[v].y;
+				quad[v].z = corners[v].z;
+				quad[v].u = uvs[v][0];
+				quad[v].v = uvs[v][1];
+				memcpy(quad[v].color, rgba, sizeof(rgba));
+			}
+		}
+	}
+}
+
+// Draws the particle emitters inside the frustum @a f of the camera with
+// the given @a view matrix, back to front, after the meshes. Each emitter
+// is a single draw of a transient vertex buffer, split in chunks of
+// CROWN_SPRITE_BATCH_SIZE particles to share the sprite index buffer.
+static void render_particles(RenderWorld& rw, const Frustum& f, const Matrix4x4& view, u8 view_offset)
+{
+	const RenderWorld::ParticleManager::ParticleInstanceData& pid = rw._particle_manager._data;
+	if (rw._particle_manager._num_particles == 0)
+		return;
+
+	Array<u32> visible(default_frame_allocator());
+	Array<f32> depth(default_frame_allocator());
+	array::resize(depth, pid.size);
+	for (u32 i = 0; i < pid.size; ++i)
+	{
+		if (pid.num[i] == 0 || !frustum_box_intersection(f, pid.aabb[i]))
+			continue;
+
+		depth[i] = (aabb::center(pid.aabb[i]) * view).z;
+		array::push_back(visible, i);
+	}
+
+	ParticleDepthGreater pdg = { array::begin(depth) };
+	std::sort(array::begin(visible), array::end(visible), pdg);
+
+	const Matrix4x4 camera = get_inverted(view);
+	const Vector3 right = x(camera);
+	const Vector3 up = y(camera);
+	const bgfx::VertexDecl decl = particle_vertex_decl();
+
+	for (u32 v = 0; v < array::size(visible); ++v)
+	{
+		const u32 i = visible[v];
+		const u32 avail = bgfx::getAvailTransientVertexBuffer(pid.num[i]*4, decl) / 4;
+		const u32 num = pid.num[i] < avail ? pid.num[i] : avail;
+		if (num == 0)
+			break;
+
+		bgfx::TransientVertexBuffer tvb;
+		bgfx::allocTransientVertexBuffer(&tvb, num*4, decl);
+		particle_vertices((ParticleVertex*)tvb.data, pid, i, num, right, up);
+
+		const Material* material = rw._material_manager->get(pid.material[i]);
+		for (u32 first = 0; first < num; first += CROWN_SPRITE_BATCH_SIZE)
+		{
+			const u32 n = num - first < CROWN_SPRITE_BATCH_SIZE ? num - first : CROWN_SPRITE_BATCH_SIZE;
+			bgfx::setVertexBuffer(0, &tvb, first*4, n*4);
+			bgfx::setIndexBuffer(rw._sprite_index_buffer, 0, n*6);
+			material->bind(*rw._resource_manager, *rw._shader_manager, VIEW_MESH + view_offset, PARTICLE_DEPTH + s32(v));
+		}
+	}
+}
+
+void RenderWorld::render(const Matrix4x4& view, const Matrix4x4& proj)
+{
+	render(&view, &proj, 1);
+}
+
+void RenderWorld::render(const Matrix4x4* views, const Matrix4x4* projs, u32 num_cameras)
+{
+	CE_ASSERT(num_cameras > 0 && num_cameras <= CROWN_MAX_CAMERAS, "Invalid number of cameras: %u", num_cameras);
+
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+	SpriteManager::SpriteInstanceData& sid = _sprite_manager._data;
+
+	// The cameras are culled in parallel, so the visible sets are allocated
+	// from the thread-safe frame allocator
+	Frustum frustums[CROWN_MAX_CAMERAS];
+	Array<u32>* meshes[CROWN_MAX_CAMERAS];
+	Array<u32>* sprites[CROWN_MAX_CAMERAS];
+	for (u32 c = 0; c < num_cameras; ++c)
+	{
+		frustum::from_matrix(frustums[c], views[c] * projs[c]);
+		meshes[c] = CE_NEW(default_frame_allocator(), Array<u32>)(default_frame_allocator());
+		sprites[c] = CE_NEW(default_frame_allocator(), Array<u32>)(default_frame_allocator());
+	}
+
+	CullCamerasData ccd;
+	ccd.render_world = this;
+	ccd.frustums = frustums;
+	ccd.meshes = meshes;
+	ccd.sprites = sprites;
+
+	if (num_cameras == 1 || job_system::num_threads() == 1)
+		cull_cameras(0, num_cameras, &ccd);
+	else
+		job_system::parallel_for(0, num_cameras, 1, cull_cameras, &ccd);
+
+	// The occlusion buffer is rasterized from the first camera only
+	const u32 num_frustum_meshes = array::size(*meshes[0]);
+	if (_occlusion_buffer != NULL && num_cameras == 1)
+		cull_occluded(*meshes[0]);
+
+	u32 num_meshes = 0;
+	u32 num_sprites = 0;
+	for (u32 c = 0; c < num_cameras; ++c)
+	{
+		num_meshes += array::size(*meshes[c]);
+		num_sprites += array::size(*sprites[c]);
+	}
+
+	// Lods are shared by all the cameras and picked from the first one
+	update_mesh_lods(array::begin(*meshes[0]), array::size(*meshes[0]), views[0], projs[0]);
+
+	memset(&_stats, 0, sizeof(_stats));
+	_stats.meshes_submitted  = num_meshes;
+	_stats.meshes_culled     = mid.first_hidden - num_frustum_meshes;
+	_stats.meshes_occluded   = num_frustum_meshes - array::size(*meshes[0]);
+	_stats.sprites_submitted = num_sprites;
+	_stats.sprites_culled    = sid.first_hidden - array::size(*sprites[0]);
+	_stats.transient_vb_used = u32(bgfx::getStats()->transientVbUsed);
+	_stats.texture_memory    = _texture_manager->_memory;
+
+	RECORD_FLOAT("render_world.meshes_submitted", f32(_stats.meshes_submitted));
+	RECORD_FLOAT("render_world.meshes_culled", f32(_stats.meshes_culled));
+	RECORD_FLOAT("render_world.meshes_occluded", f32(_stats.meshes_occluded));
+	RECORD_FLOAT("render_world.sprites_submitted", f32(_stats.sprites_submitted));
+	RECORD_FLOAT("render_world.sprites_culled", f32(_stats.sprites_culled));
+
+	// Hint the distance of the textures to the nearest camera
+	Vector3 camera_pos[CROWN_MAX_CAMERAS];
+	for (u32 c = 0; c < num_cameras; ++c)
+		camera_pos[c] = translation(get_inverted(views[c]));
+
+	for (u32 i = 0; i < mid.first_hidden; ++i)
+	{
+		f32 dist = FLT_MAX;
+		for (u32 c = 0; c < num_cameras; ++c)
+			dist = fmin(dist, distance(camera_pos[c], translation(mid.world[i])));
+		set_textures_distance(mid.material[i], dist);
+	}
+
+	for (u32 i = 0; i < sid.first_hidden; ++i)
+	{
+		f32 dist = FLT_MAX;
+		for (u32 c = 0; c < num_cameras; ++c)
+			dist = fmin(dist, distance(camera_pos[c], translation(sid.world[i])));
+		set_textures_distance(sid.material[i], dist);
+	}
+
+	// Split the submission among the encoders available to the job threads,
+	// half for the meshes and half for the sprites
+	const bgfx::Caps* caps = bgfx::getCaps();
+	u32 num_chunks = (caps->limits.maxEncoders - 1) / 2;
+	num_chunks = num_chunks < job_system::num_threads() ? num_chunks : job_system::num_threads();
+	num_chunks = num_chunks > 0 ? num_chunks : 1;
+
+	// The skin matrices, the sprite vertices and the shadow maps are shared
+	// by all the cameras. The shadows are fitted to the first camera.
+	update_skin_palette(*this);
+	_sprite_manager.update_vertices();
+	_sprite_manager.update_loop_vertices();
+	_tilemap_manager.update_chunks();
+	const bool shadows = num_meshes > 0 && update_shadows(views[0], projs[0]);
+
+	const bool instancing = (caps->supported & BGFX_CAPS_INSTANCING) != 0;
+	u32 num_instances_avail = instancing ? bgfx::getAvailInstanceDataBuffer(num_meshes, sizeof(Matrix4x4)) : 0;
+
+	for (u32 c = 0; c < num_cameras; ++c)
+	{
+		Array<u32>& cmeshes = *meshes[c];
+		const u32 num_cmeshes = array::size(cmeshes);
+		const u32 num_csprites = array::size(*sprites[c]);
+		const u8 view_offset = u8(c*VIEW_CAMERA_NUM);
+
+		// Render meshes, all the lights are applied in a single pass
+		_render_queue.clear();
+		Matrix4x4 cascades[CROWN_SHADOW_CASCADES];
+		if (num_cmeshes)
+		{
+			if (shadows)
+				set_shadows(views[c], cascades);
+			update_lights(views[c], projs[c], c);
+		}
+
+		// Meshes sharing geometry and material are drawn with instancing
+		MeshBatchLess mbl = { &mid };
+		std::sort(array::begin(cmeshes), array::end(cmeshes), mbl);
+
+		_render_queue.set_texture(13, _u_light_data, _light_data[c], LIGHT_TEXTURE_FLAGS);
+		_render_queue.set_texture(14, _u_light_cluster, _light_clusters[c], LIGHT_TEXTURE_FLAGS);
+		_render_queue.set_texture(15, _u_light_index, _light_indices[c], LIGHT_TEXTURE_FLAGS);
+		if (bgfx::isValid(_skin_palette))
+			_render_queue.set_texture(SKIN_PALETTE_STAGE, _u_skin_palette, _skin_palette, LIGHT_TEXTURE_FLAGS);
+
+		for (u32 m = 0; m < num_cmeshes;)
+		{
+			const u32 i = cmeshes[m];
+			const Material* material = _material_manager->get(mid.material[i]);
+
+			// Skinned meshes are never drawn with instancing
+			u32 num = 1;
+			while (mid.skin[i] == UINT32_MAX
+				&& m + num < num_cmeshes
+				&& mid.skin[cmeshes[m + num]] == UINT32_MAX
+				&& mid.mesh[cmeshes[m + num]].vbh.idx == mid.mesh[i].vbh.idx
+				&& mid.mesh[cmeshes[m + num]].ibh.idx == mid.mesh[i].ibh.idx
+				&& mid.material[cmeshes[m + num]] == mid.material[i]
+				)
+				++num;
+			if (num < CROWN_MIN_MESH_INSTANCES || !_shader_manager->has_instancing(material->_resource->shader))
+				num = 1;
+			else
+				num = num < num_instances_avail ? num : num_instances_avail;
+
+			if (num > 1)
+				num_instances_avail -= num;
+			else
+				num = 1;
+
+			const f32 depth = (translation(mid.world[i]) * views[c]).z;
+			Matrix4x4* transforms = _render_queue.add(VIEW_MESH + view_offset, *material, mid.mesh[i].vbh, mid.mesh[i].ibh, mid.geometry[i]->decode, num, depth, mid.skin[i]);
+			for (u32 n = 0; n < num; ++n)
+				transforms[n] = mid.world[cmeshes[m + n]];
+
+			const u32 lod = mid.mesh[i].lod;
+			const u32 num_indices = lod == 0 ? mid.geometry[i]->indices.num : mid.geometry[i]->lods[lod - 1].indices.num;
+			_stats.mesh_triangles += num_indices/3 * num;
+
+			m += num;
+		}
+
+		const u32 num_binds = _render_queue.submit(*_resource_manager, *_shader_manager, num_chunks);
+
+		_stats.mesh_draw_calls += array::size(_render_queue._draws);
+		_stats.mesh_material_binds += num_binds;
+
+		// Render sprites, the ones sharing layer and material are drawn
+		// together
+		Array<SpriteDraw> sprite_draws(default_frame_allocator());
+		bgfx::TransientVertexBuffer sprite_tvb;
+		if (num_csprites)
+		{
+			batch_sprites(*this, *sprites[c], sprite_draws, sprite_tvb);
+			batch_sprite_loops(*this, *sprites[c], sprite_draws);
+		}
+
+		const u32 num_sprite_draws = array::size(sprite_draws);
+		_stats.sprite_draw_calls += num_sprite_draws;
+
+		SubmitSpritesData ssd;
+		ssd.render_world = this;
+		ssd.draws = array::begin(sprite_draws);
+		ssd.tvb = &sprite_tvb;
+		ssd.view_offset = view_offset;
+
+		const u32 grain_size = (num_sprite_draws + num_chunks - 1) / num_chunks;
+		if (num_chunks == 1 || grain_size < CROWN_RENDER_QUEUE_MIN_CHUNK_SIZE)
+		{
+			submit_sprites(0, num_sprite_draws, &ssd);
+		}
+		else
+		{
+			// Materials must not be modified from the job threads
+			for (u32 d = 0; d < num_sprite_draws; ++d)
+				_material_manager->get(sid.material[sprite_draws[d].sprite])->update_textures(*_resource_manager, *_shader_manager);
+
+			job_system::parallel_for(0, num_sprite_draws, grain_size, submit_sprites, &ssd);
+		}
+
+		const u32 num_chunks_culled = render_tilemaps(*this, frustums[c], camera_pos[c], view_offset);
+		if (c == 0)
+			_stats.tilemap_chunks_culled = num_chunks_culled;
+
+		render_particles(*this, frustums[c], views[c], view_offset);
+	}
+
+	RECORD_FLOAT("render_world.mesh_draw_calls", f32(_stats.mesh_draw_calls));
+	RECORD_FLOAT("render_world.mesh_material_binds", f32(_stats.mesh_material_binds));
+	RECORD_FLOAT("render_world.mesh_triangles", f32(_stats.mesh_triangles));
+	RECORD_FLOAT("render_world.sprite_draw_calls", f32(_stats.sprite_draw_calls));
+	RECORD_FLOAT("render_world.tilemap_draw_calls", f32(_stats.tilemap_draw_calls));
+	RECORD_FLOAT("render_world.tilemap_chunks_culled", f32(_stats.tilemap_chunks_culled));
+
+	for (u32 c = 0; c < num_cameras; ++c)
+	{
+		CE_DELETE(default_frame_allocator(), sprites[c]);
+		CE_DELETE(default_frame_allocator(), meshes[c]);
+	}
+}
+
+// Returns the lod of @a mg to use at @a screen_size when @a lod is the
+// current one. Switching lod requires the size to move past the threshold
+// by CROWN_MESH_LOD_HYSTERESIS to avoid popping back and forth.
+static u32 mesh_lod(const MeshGeometry* mg, f32 screen_size, u32 lod)
+{
+	while (lod < mg->num_lods && screen_size < mg->lods[lod].screen_size * (1.0f - CROWN_MESH_LOD_HYSTERESIS))
+		++lod;
+	while (lod > 0 && screen_size > mg->lods[lod - 1].screen_size * (1.0f + CROWN_MESH_LOD_HYSTERESIS))
+		--lod;
+	return lod;
+}
+
+void RenderWorld::update_mesh_lods(const u32* meshes, u32 num, const Matrix4x4& view, const Matrix4x4& proj)
+{
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+
+	for (u32 m = 0; m < num; ++m)
+	{
+		const u32 i = meshes[m];
+		const MeshGeometry* mg = mid.geometry[i];
+		if (mg->num_lods == 0)
+			continue;
+
+		// Size of the bounding sphere projected on the screen, relative to
+		// the screen height
+		const Vector3 s = scale(mid.world[i]);
+		const f32 max_scale = fmax(s.x, fmax(s.y, s.z));
+		const f32 radius = length(mid.obb[i].half_extents) * max_scale;
+		const Vector3 center = translation(mid.obb[i].tm * mid.world[i]);
+		const Vector4 c = vector4(center.x, center.y, center.z, 1.0f) * view;
+		const f32 w = c.z * proj.z.w + proj.t.w;
+		const f32 screen_size = radius * proj.y.y / fmax(w, 0.0001f) * _mesh_lod_bias;
+
+		MeshManager::MeshData& md = mid.mesh[i];
+		const u32 lod = mesh_lod(mg, screen_size, md.lod);
+		if (lod == md.lod)
+			continue;
+
+		md.lod = lod;
+		md.vbh = lod == 0 ? mg->vertex_buffer : mg->lods[lod - 1].vertex_buffer;
+		md.ibh = lod == 0 ? mg->index_buffer  : mg->lods[lod - 1].index_buffer;
+	}
+}
+
+void RenderWorld::cull_occluded(Array<u32>& meshes)
+{
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+
+	u32 num = 0;
+	for (u32 m = 0; m < array::size(meshes); ++m)
+	{
+		const u32 i = meshes[m];
+		if (_occlusion_buffer->visible(world_aabb(mid.obb[i], mid.world[i])))
+			meshes[num++] = i;
+	}
+	array::resize(meshes, num);
+}
+
+void RenderWorld::set_occlusion_buffer(const OcclusionBuffer* ob)
+{
+	_occlusion_buffer = ob;
+}
+
+void RenderWorld::set_mesh_lod_bias(f32 bias)
+{
+	_mesh_lod_bias = bias;
+}
+
+f32 RenderWorld::mesh_lod_bias() const
+{
+	return _mesh_lod_bias;
+}
+
+const RenderStats& RenderWorld::stats() const
+{
+	return _stats;
+}
+
+void RenderWorld::add_shadow_change(const AABB& b)
+{
+	if (array::size(_shadow_changes) < SHADOW_MAX_CHANGES)
+		array::push_back(_shadow_changes, b);
+	else
+		_shadow_changes_overflow = true;
+}
+
+// Returns the number of shadow atlas tiles used by the light @a i.
+static u32 shadow_num_tiles(const RenderWorld::LightManager::LightInstanceData& lid, u32 i)
+{
+	return lid.type[i] == LightType::OMNI ? 6 : 1;
+}
+
+// Returns whether the boxes @a a and @a b overlap.
+static bool aabb_overlap(const AABB& a, const AABB& b)
+{
+	return a.min.x <= b.max.x && a.max.x >= b.min.x
+		&& a.min.y <= b.max.y && a.max.y >= b.min.y
+		&& a.min.z <= b.max.z && a.max.z >= b.min.z
+		;
+}
+
+// Returns whether a mesh inside the box @a b has changed since the shadows
+// have been rendered.
+static bool shadow_changed(const RenderWorld& rw, const AABB& b)
+{
+	if (rw._shadow_changes_overflow)
+		return true;
+
+	for (u32 i = 0; i < array::size(rw._shadow_changes); ++i)
+	{
+		if (aabb_overlap(rw._shadow_changes[i], b))
+			return true;
+	}
+
+	return false;
+}
+
+// Returns a vector to use as up for a light pointing towards @a dir.
+static Vector3 shadow_up(const Vector3& dir)
+{
+	return fabs(dir.y) < 0.99f ? VECTOR3_YAXIS : VECTOR3_ZAXIS;
+}
+
+// Returns the view matrix of a light at @a pos pointing towards @a dir.
+static Matrix4x4 shadow_view(const Vector3& pos, const Vector3& dir, const Vector3& up)
+{
+	Vector3 x = cross(up, dir);
+	normalize(x);
+	const Vector3 y = cross(dir, x);
+	return get_inverted(matrix4x4(x, y, dir, pos));
+}
+
+// Fills @a view and @a proj with the matrices of the shadow map of the spot light @a i.
+static void spot_shadow(const RenderWorld::LightManager::LightInstanceData& lid, u32 i, Matrix4x4& view, Matrix4x4& proj)
+{
+	Vector3 dir = -z(lid.world[i]);
+	normalize(dir);
+	view = shadow_view(translation(lid.world[i]), dir, shadow_up(dir));
+	perspective(proj, fmin(2.0f*lid.spot_angle[i], frad(170.0f)), 1.0f, CROWN_SHADOW_NEAR, lid.range[i]);
+}
+
+// Fills @a x and @a y with the top-left corner of the shadow atlas @a tile, in pixels.
+static void shadow_tile_rect(u32 tile, u32& x, u32& y)
+{
+	x = tile % SHADOW_TILES_X * CROWN_SHADOW_TILE_SIZE;
+	y = tile / SHADOW_TILES_X * CROWN_SHADOW_TILE_SIZE + SHADOW_CASCADE_SIZE;
+}
+
+// Returns the matrix from clip-space to the coordinates and the depth of
+// the @a size pixels wide region of the shadow atlas whose top-left corner
+// is at (@a x, @a y) pixels.
+static Matrix4x4 shadow_atlas_matrix(u32 x, u32 y, u32 size, const bgfx::Caps* caps)
+{
+	const f32 s = f32(size) / CROWN_SHADOW_ATLAS_SIZE;
+	const f32 u = f32(x) / CROWN_SHADOW_ATLAS_SIZE;
+	const f32 v = f32(y) / CROWN_SHADOW_ATLAS_SIZE;
+	const f32 sy = caps->originBottomLeft ? 0.5f*s : -0.5f*s;
+	const f32 ty = caps->originBottomLeft ? 1.0f - v - 0.5f*s : v + 0.5f*s;
+	const f32 sz = caps->homogeneousDepth ? 0.5f : 1.0f;
+	const f32 tz = caps->homogeneousDepth ? 0.5f : 0.0f;
+
+	return matrix4x4(0.5f*s, 0.0f, 0.0f, 0.0f
+		, 0.0f, sy, 0.0f, 0.0f
+		, 0.0f, 0.0f, sz, 0.0f
+		, u + 0.5f*s, ty, tz, 1.0f
+		);
+}
+
+// Renders the meshes inside the frustum of @a light_view and @a light_proj
+// to the @a size pixels wide region of the shadow atlas at (@a x, @a y).
+static void render_shadow(RenderWorld& rw, u8 view, u32 x, u32 y, u32 size, const Matrix4x4& light_view, const Matrix4x4& light_proj)
+{
+	const RenderWorld::MeshManager::MeshInstanceData& mid = rw._mesh_manager._data;
+
+	Frustum f;
+	frustum::from_matrix(f, light_view * light_proj);
+
+	Array<u32> casters(default_frame_allocator());
+	cull(rw._mesh_manager._tree, f, mid.first_hidden, casters);
+
+	bgfx::setViewFrameBuffer(view, rw._shadow_frame_buffer);
+	bgfx::setViewRect(view, u16(x), u16(y), u16(size), u16(size));
+	bgfx::setViewClear(view, BGFX_CLEAR_DEPTH, 0, 1.0f, 0);
+	bgfx::setViewTransform(view, to_float_ptr(light_view), to_float_ptr(light_proj));
+	bgfx::touch(view);
+
+	for (u32 c = 0; c < array::size(casters); ++c)
+	{
+		const u32 i = casters[c];
+		bgfx::setTransform(to_float_ptr(mid.world[i]));
+		bgfx::setVertexBuffer(0, mid.mesh[i].vbh);
+		bgfx::setIndexBuffer(mid.mesh[i].ibh);
+		bgfx::setUniform(rw._u_mesh_decode, mid.geometry[i]->decode, 2);
+
+		if (mid.skin[i] != UINT32_MAX && bgfx::isValid(rw._skin_palette))
+		{
+			const Vector4 skin = vector4(f32(mid.skin[i]), 1.0f, 0.0f, 0.0f);
+			bgfx::setUniform(rw._u_skin, to_float_ptr(skin));
+			bgfx::setTexture(SKIN_PALETTE_STAGE, rw._u_skin_palette, rw._skin_palette, LIGHT_TEXTURE_FLAGS);
+			rw._shader_manager->submit("shadow+SKINNING"_id32, view);
+		}
+		else
+		{
+			rw._shader_manager->submit("shadow"_id32, view);
+		}
+	}
+}
+
+// Direction and up vector of each face of the shadow map of an omni light.
+// Must match the mesh shader.
+static const Vector3 s_omni_faces[][2] =
+{
+	{ {  1.0f,  0.0f,  0.0f }, { 0.0f, 1.0f,  0.0f } },
+	{ { -1.0f,  0.0f,  0.0f }, { 0.0f, 1.0f,  0.0f } },
+	{ {  0.0f,  1.0f,  0.0f }, { 0.0f, 0.0f, -1.0f } },
+	{ {  0.0f, -1.0f,  0.0f }, { 0.0f, 0.0f,  1.0f } },
+	{ {  0.0f,  0.0f,  1.0f }, { 0.0f, 1.0f,  0.0f } },
+	{ {  0.0f,  0.0f, -1.0f }, { 0.0f, 1.0f,  0.0f } }
+};
+
+struct ShadowLight
+{
+	f32 distance;
+	u32 light;
+
+	bool operator<(const ShadowLight& other) const
+	{
+		return distance < other.distance;
+	}
+};
+
+bool RenderWorld::update_shadows(const Matrix4x4& view, const Matrix4x4& proj)
+{
+	LightManager::LightInstanceData& lid = _light_manager._data;
+	const bgfx::Caps* caps = bgfx::getCaps();
+
+	// The first directional light casting shadows gets the cascades
+	_shadow_light = UINT32_MAX;
+	bool cast_shadows = false;
+	for (u32 i = 0; i < lid.size; ++i)
+	{
+		if (!lid.cast_shadows[i])
+			continue;
+
+		cast_shadows = true;
+		if (lid.type[i] == LightType::DIRECTIONAL && _shadow_light == UINT32_MAX)
+			_shadow_light = i;
+	}
+
+	if (!cast_shadows || (caps->supported & BGFX_CAPS_TEXTURE_COMPARE_LEQUAL) == 0)
+	{
+		_shadow_light = UINT32_MAX;
+		array::clear(_shadow_changes);
+		_shadow_changes_overflow = false;
+		return false;
+	}
+
+	if (!bgfx::isValid(_shadow_atlas))
+	{
+		_shadow_atlas = bgfx::createTexture2D(CROWN_SHADOW_ATLAS_SIZE
+			, CROWN_SHADOW_ATLAS_SIZE
+			, false
+			, 1
+			, bgfx::TextureFormat::D24
+			, BGFX_TEXTURE_RT | SHADOW_ATLAS_FLAGS
+			);
+		_shadow_frame_buffer = bgfx::createFrameBuffer(1, &_shadow_atlas);
+	}
+
+	const Matrix4x4 inv_view = get_inverted(view);
+	const Matrix4x4 inv_proj = get_inverted(proj);
+	u32 num_views = 0;
+
+	// Corners of the near and far planes of the camera in view-space
+	Vector3 corners[8];
+	for (u32 c = 0; c < 8; ++c)
+	{
+		const Vector4 p = vector4(c & 1 ? 1.0f : -1.0f
+			, c & 2 ? 1.0f : -1.0f
+			, c & 4 ? 1.0f : 0.0f
+			, 1.0f
+			) * inv_proj;
+		corners[c] = vector3(p.x / p.w, p.y / p.w, p.z / p.w);
+	}
+
+	// Split the shadow distance between the cascades, halfway between
+	// uniform and logarithmic splits
+	const f32 near = fmax(corners[0].z, 0.01f);
+	const f32 far = fmax(corners[4].z, near + 0.01f);
+	const f32 shadow_far = fmin(far, CROWN_SHADOW_DISTANCE);
+
+	f32 splits[CROWN_SHADOW_CASCADES + 1];
+	splits[0] = near;
+	for (u32 c = 0; c < CROWN_SHADOW_CASCADES; ++c)
+	{
+		const f32 t = f32(c + 1) / CROWN_SHADOW_CASCADES;
+		splits[c + 1] = lerp(near + (shadow_far - near)*t, near*powf(shadow_far / near, t), 0.75f);
+		to_float_ptr(_shadow_splits)[c] = splits[c + 1];
+	}
+
+	if (_shadow_light != UINT32_MAX)
+	{
+		Vector3 dir = -z(lid.world[_shadow_light]);
+		normalize(dir);
+		const Vector3 up = shadow_up(dir);
+
+		for (u32 c = 0; c < CROWN_SHADOW_CASCADES; ++c)
+		{
+			// Bounding sphere of the slice of the frustum covered by the cascade
+			const f32 t0 = (splits[c    ] - corners[0].z) / (corners[4].z - corners[0].z);
+			const f32 t1 = (splits[c + 1] - corners[0].z) / (corners[4].z - corners[0].z);
+
+			Vector3 points[8];
+			Vector3 center = VECTOR3_ZERO;
+			for (u32 p = 0; p < 4; ++p)
+			{
+				points[p*2 + 0] = lerp(corners[p], corners[p + 4], t0) * inv_view;
+				points[p*2 + 1] = lerp(corners[p], corners[p + 4], t1) * inv_view;
+				center += points[p*2 + 0] + points[p*2 + 1];
+			}
+			center *= 1.0f / 8.0f;
+
+			f32 radius = 0.0f;
+			for (u32 p = 0; p < 8; ++p)
+				radius = fmax(radius, distance(center, points[p]));
+
+			// The cascade is enlarged so that it can be reused until the
+			// slice moves out of it
+			ShadowCascade& sc = _shadow_cascades[c];
+			bool render = !sc.valid
+				|| dot(sc.direction, dir) < 0.9999f
+				|| distance(center, sc.center) + radius > sc.radius
+				|| radius < sc.radius * 0.5f
+				;
+
+			if (render)
+			{
+				const f32 r = radius * (1.0f + CROWN_SHADOW_CASCADE_PADDING);
+				const f32 depth = 2.0f*r + CROWN_SHADOW_DISTANCE;
+
+				// Snap the center to the texels to keep the edges of the
+				// shadows still when the cascade is rendered again
+				const Matrix4x4 rotation = shadow_view(VECTOR3_ZERO, dir, up);
+				const f32 texel = 2.0f*r / SHADOW_CASCADE_SIZE;
+				Vector3 lc = center * rotation;
+				lc.x = floorf(lc.x / texel) * texel;
+				lc.y = floorf(lc.y / texel) * texel;
+
+				sc.center = lc * get_inverted(rotation);
+				sc.radius = r;
+				sc.direction = dir;
+				sc.view = shadow_view(sc.center - dir*(r + CROWN_SHADOW_DISTANCE), dir, up);
+				orthographic(sc.proj, -r, r, -r, r, 0.0f, depth);
+
+				AABB box;
+				box.min = vector3(-r, -r, 0.0f);
+				box.max = vector3( r,  r, depth);
+				sc.box = aabb::transformed(box, get_inverted(sc.view));
+				sc.valid = true;
+			}
+			else
+			{
+				render = shadow_changed(*this, sc.box);
+			}
+
+			if (render)
+			{
+				render_shadow(*this, VIEW_SHADOW + c, c*SHADOW_CASCADE_SIZE, 0, SHADOW_CASCADE_SIZE, sc.view, sc.proj);
+				++num_views;
+			}
+
+			_shadow_cascade_matrices[c] = sc.view * sc.proj * shadow_atlas_matrix(c*SHADOW_CASCADE_SIZE, 0, SHADOW_CASCADE_SIZE, caps);
+		}
+	}
+
+	// Local lights inside the frustum get tiles, nearest first
+	Frustum f;
+	frustum::from_matrix(f, view * proj);
+	const Vector3 camera_pos = translation(inv_view);
+
+	Array<ShadowLight> lights(default_frame_allocator());
+	for (u32 i = 0; i < lid.size; ++i)
+	{
+		if (!lid.cast_shadows[i] || lid.type[i] == LightType::DIRECTIONAL)
+			continue;
+
+		Sphere s;
+		s.c = translation(lid.world[i]);
+		s.r = lid.range[i];
+		if (!frustum_sphere_intersection(f, s))
+		{
+			_light_manager.release_shadow_tiles(i);
+			continue;
+		}
+
+		ShadowLight sl;
+		sl.distance = fmax(0.0f, distance(camera_pos, s.c) - s.r);
+		sl.light = i;
+		array::push_back(lights, sl);
+	}
+	std::sort(array::begin(lights), array::end(lights));
+
+	// Lights which do not fit in the atlas give their tiles back first, so
+	// that the nearest ones can get them
+	u32 num_lights = 0;
+	u32 num_tiles = 0;
+	for (u32 l = 0; l < array::size(lights); ++l)
+	{
+		const u32 i = lights[l].light;
+		const u32 num = shadow_num_tiles(lid, i);
+		if (num_tiles + num > SHADOW_TILES)
+		{
+			_light_manager.release_shadow_tiles(i);
+			continue;
+		}
+
+		num_tiles += num;
+		lights[num_lights++] = lights[l];
+	}
+	array::resize(lights, num_lights);
+
+	for (u32 l = 0; l < array::size(lights); ++l)
+	{
+		const u32 i = lights[l].light;
+		if (lid.shadow_tile[i] == UINT32_MAX && !_light_manager.allocate_shadow_tiles(i))
+			continue;
+
+		const Vector3 pos = translation(lid.world[i]);
+		const f32 range = lid.range[i];
+		AABB box;
+		box.min = pos - vector3(range, range, range);
+		box.max = pos + vector3(range, range, range);
+		if (!lid.shadow_dirty[i] && !shadow_changed(*this, box))
+			continue;
+
+		const u32 tile = lid.shadow_tile[i];
+		Matrix4x4 light_view;
+		Matrix4x4 light_proj;
+		u32 x;
+		u32 y;
+
+		if (lid.type[i] == LightType::SPOT)
+		{
+			spot_shadow(lid, i, light_view, light_proj);
+			shadow_tile_rect(tile, x, y);
+			render_shadow(*this, VIEW_SHADOW + CROWN_SHADOW_CASCADES + tile, x, y, CROWN_SHADOW_TILE_SIZE, light_view, light_proj);
+			++num_views;
+		}
+		else
+		{
+			perspective(light_proj, frad(90.0f), 1.0f, CROWN_SHADOW_NEAR, range);
+			for (u32 face = 0; face < countof(s_omni_faces); ++face)
+			{
+				light_view = shadow_view(pos, s_omni_faces[face][0], s_omni_faces[face][1]);
+				shadow_tile_rect(tile + face, x, y);
+				render_shadow(*this, VIEW_SHADOW + CROWN_SHADOW_CASCADES + tile + face, x, y, CROWN_SHADOW_TILE_SIZE, light_view, light_proj);
+				++num_views;
+			}
+		}
+
+		lid.shadow_dirty[i] = false;
+	}
+
+	array::clear(_shadow_changes);
+	_shadow_changes_overflow = false;
+
+	RECORD_FLOAT("render_world.shadow_views", f32(num_views));
+	return true;
+}
+
+void RenderWorld::set_shadows(const Matrix4x4& view, Matrix4x4* cascades)
+{
+	const Matrix4x4 inv_view = get_inverted(view);
+	for (u32 c = 0; c < CROWN_SHADOW_CASCADES; ++c)
+		cascades[c] = inv_view * _shadow_cascade_matrices[c];
+
+	_render_queue.set_texture(12, _u_shadow_atlas, _shadow_atlas, SHADOW_ATLAS_FLAGS);
+	_render_queue.set_uniform(_u_shadow_cascades, cascades, CROWN_SHADOW_CASCADES);
+	_render_queue.set_uniform(_u_shadow_splits, _shadow_splits);
+}
+
+// Returns the cluster along an axis with @a num clusters at @a t in [0, 1].
+static s32 light_cluster(f32 t, u32 num)
+{
+	return s32(fclamp(t * num, 0.0f, num - 1.0f));
+}
+
+// Returns the world-space sphere bounding the volume lit by the local light @a i.
+// Spot lights are bounded by the smallest sphere enclosing their cone.
+static Sphere light_bounding_sphere(const RenderWorld::LightManager::LightInstanceData& lid, u32 i)
+{
+	Sphere s;
+	s.c = translation(lid.world[i]);
+	s.r = lid.range[i];
+
+	if (lid.type[i] == LightType::SPOT)
+	{
+		Vector3 dir = -z(lid.world[i]);
+		normalize(dir);
+		const f32 angle = lid.spot_angle[i];
+		if (angle <= frad(45.0f))
+		{
+			s.r = lid.range[i] / (2.0f*fcos(angle));
+			s.c += dir*s.r;
+		}
+		else if (angle < frad(90.0f))
+		{
+			s.c += dir*(lid.range[i]*fcos(angle));
+			s.r = lid.range[i]*fsin(angle);
+		}
+	}
+
+	return s;
+}
+
+void RenderWorld::update_lights(const Matrix4x4& view, const Matrix4x4& proj, u32 camera)
+{
+	LightManager::LightInstanceData& lid = _light_manager._data;
+	const bgfx::Caps* caps = bgfx::getCaps();
+
+	const Matrix4x4 inv_view = get_inverted(view);
+	const Matrix4x4 inv_proj = get_inverted(proj);
+	const Vector4 near_pos = vector4(0.0f, 0.0f, 0.0f, 1.0f) * inv_proj;
+	const Vector4 far_pos = vector4(0.0f, 0.0f, 1.0f, 1.0f) * inv_proj;
+	const f32 near = fmax(near_pos.z / near_pos.w, 0.01f);
+	const f32 far = fmax(far_pos.z / far_pos.w, near + 0.01f);
+	const f32 log_depth = logf(far / near);
+
+	Frustum frustum;
+	frustum::from_matrix(frustum, view * proj);
+
+	const bgfx::Memory* data_mem = bgfx::alloc(CROWN_MAX_LIGHTS*LIGHT_DATA_ROWS*sizeof(Vector4));
+	const bgfx::Memory* clusters_mem = bgfx::alloc(LIGHT_CLUSTERS*2*sizeof(f32));
+	const bgfx::Memory* indices_mem = bgfx::alloc(LIGHT_INDICES_WIDTH*LIGHT_INDICES_HEIGHT*sizeof(f32));
+	Vector4* position = (Vector4*)data_mem->data;
+	Vector4* direction = position + CROWN_MAX_LIGHTS;
+	Vector4* color = direction + CROWN_MAX_LIGHTS;
+	Vector4* shadow = color + CROWN_MAX_LIGHTS;
+	Vector4* shadow_matrix = shadow + CROWN_MAX_LIGHTS; // Four rows
+	f32* clusters = (f32*)clusters_mem->data;
+	f32* indices = (f32*)indices_mem->data;
+	memset(data_mem->data, 0, data_mem->size);
+
+	// Directional lights come first and affect every cluster
+	u32 num_directional = 0;
+	f32 shadow_directional = -1.0f;
+	for (u32 i = 0; i < lid.size && num_directional < CROWN_MAX_DIRECTIONAL_LIGHTS; ++i)
+	{
+		if (lid.type[i] != LightType::DIRECTIONAL)
+			continue;
+
+		if (i == _shadow_light)
+			shadow_directional = f32(num_directional);
+
+		direction[num_directional] = normalize(lid.world[i].z) * view;
+		color[num_directional] = lid.color[i] * lid.intensity[i];
+		++num_directional;
+	}
+
+	// Local lights and the clusters their bounding sphere overlaps
+	struct ClusterRange { s32 min[3]; s32 max[3]; };
+	Array<ClusterRange> ranges(default_frame_allocator());
+	Array<u32> counts(default_frame_allocator());
+	array::resize(counts, LIGHT_CLUSTERS);
+	memset(array::begin(counts), 0, LIGHT_CLUSTERS*sizeof(u32));
+
+	// Clusters are assigned from the bounding sphere of the lit volume,
+	// which for spot lights is much smaller than the sphere of their range.
+	// The spheres are culled against the frustum four at a time
+	Array<Sphere> spheres(default_frame_allocator());
+	Array<f32> soa(default_frame_allocator());
+	Array<u32> visible(default_frame_allocator());
+	array::resize(spheres, lid.size);
+	array::resize(soa, 4*lid.size);
+	array::resize(visible, (lid.size + 31) / 32);
+	for (u32 i = 0; i < lid.size; ++i)
+	{
+		spheres[i] = light_bounding_sphere(lid, i);
+		soa[0*lid.size + i] = spheres[i].c.x;
+		soa[1*lid.size + i] = spheres[i].c.y;
+		soa[2*lid.size + i] = spheres[i].c.z;
+		soa[3*lid.size + i] = spheres[i].r;
+	}
+	const f32* soa_data = array::begin(soa);
+	const SphereSoA ss = { { soa_data, soa_data + lid.size, soa_data + 2*lid.size }, soa_data + 3*lid.size, lid.size };
+	frustum_sphere_intersection(frustum, ss, array::begin(visible));
+
+	u32 num_lights = num_directional;
+	u32 num_culled = 0;
+	for (u32 i = 0; i < lid.size && num_lights < CROWN_MAX_LIGHTS; ++i)
+	{
+		if (lid.type[i] == LightType::DIRECTIONAL)
+			continue;
+
+		const Sphere& bs = spheres[i];
+		if (((visible[i / 32] >> (i % 32)) & 1) == 0)
+		{
+			++num_culled;
+			continue;
+		}
+
+		const Vector3 pos = translation(lid.world[i]) * view;
+		const Vector3 center = bs.c * view;
+		const f32 range = lid.range[i];
+		const f32 radius = bs.r;
+		const f32 zmin = fmax(center.z - radius, near);
+		const f32 zmax = fmin(center.z + radius, far);
+		if (zmin > zmax)
+		{
+			++num_culled;
+			continue;
+		}
+
+		// Project the box enclosing the sphere to find the tiles it covers
+		Vector2 ndc_min = {  FLT_MAX,  FLT_MAX };
+		Vector2 ndc_max = { -FLT_MAX, -FLT_MAX };
+		for (u32 c = 0; c < 8; ++c)
+		{
+			const Vector4 corner = vector4(center.x + (c & 1 ? radius : -radius)
+				, center.y + (c & 2 ? radius : -radius)
+				, c & 4 ? zmax : zmin
+				, 1.0f
+				) * proj;
+			ndc_min.x = fmin(ndc_min.x, corner.x / corner.w);
+			ndc_min.y = fmin(ndc_min.y, corner.y / corner.w);
+			ndc_max.x = fmax(ndc_max.x, corner.x / corner.w);
+			ndc_max.y = fmax(ndc_max.y, corner.y / corner.w);
+		}
+		if (ndc_min.x > 1.0f || ndc_min.y > 1.0f || ndc_max.x < -1.0f || ndc_max.y < -1.0f)
+		{
+			++num_culled;
+			continue;
+		}
+
+		ClusterRange cr;
+		cr.min[0] = light_cluster(ndc_min.x*0.5f + 0.5f, CROWN_LIGHT_CLUSTERS_X);
+		cr.min[1] = light_cluster(ndc_min.y*0.5f + 0.5f, CROWN_LIGHT_CLUSTERS_Y);
+		cr.min[2] = light_cluster(logf(zmin / near) / log_depth, CROWN_LIGHT_CLUSTERS_Z);
+		cr.max[0] = light_cluster(ndc_max.x*0.5f + 0.5f, CROWN_LIGHT_CLUSTERS_X);
+		cr.max[1] = light_cluster(ndc_max.y*0.5f + 0.5f, CROWN_LIGHT_CLUSTERS_Y);
+		cr.max[2] = light_cluster(logf(zmax / near) / log_depth, CROWN_LIGHT_CLUSTERS_Z);
+		array::push_back(ranges, cr);
+
+		const bool spot = lid.type[i] == LightType::SPOT;
+		position[num_lights] = vector4(pos.x, pos.y, pos.z, range);
+		direction[num_lights] = normalize(lid.world[i].z) * view;
+		direction[num_lights].w = spot ? fcos(lid.spot_angle[i]) : -1.0f;
+		color[num_lights] = lid.color[i] * lid.intensity[i];
+		color[num_lights].w = f32(lid.type[i]);
+
+		// Shadow atlas tile and, for spot lights, the matrix from view-space
+		// to the atlas
+		if (lid.shadow_tile[i] != UINT32_MAX)
+		{
+			u32 x;
+			u32 y;
+			shadow_tile_rect(lid.shadow_tile[i], x, y);
+			shadow[num_lights] = vector4(f32(x) / CROWN_SHADOW_ATLAS_SIZE
+				, f32(y) / CROWN_SHADOW_ATLAS_SIZE
+				, f32(CROWN_SHADOW_TILE_SIZE) / CROWN_SHADOW_ATLAS_SIZE
+				, 1.0f
+				);
+
+			if (spot)
+			{
+				Matrix4x4 light_view;
+				Matrix4x4 light_proj;
+				spot_shadow(lid, i, light_view, light_proj);
+				const Matrix4x4 m = inv_view * light_view * light_proj * shadow_atlas_matrix(x, y, CROWN_SHADOW_TILE_SIZE, caps);
+				shadow_matrix[CROWN_MAX_LIGHTS*0 + num_lights] = m.x;
+				shadow_matrix[CROWN_MAX_LIGHTS*1 + num_lights] = m.y;
+				shadow_matrix[CROWN_MAX_LIGHTS*2 + num_lights] = m.z;
+				shadow_matrix[CROWN_MAX_LIGHTS*3 + num_lights] = m.t;
+			}
+		}
+		++num_lights;
+
+		for (s32 z = cr.min[2]; z <= cr.max[2]; ++z)
+			for (s32 y = cr.min[1]; y <= cr.max[1]; ++y)
+				for (s32 x = cr.min[0]; x <= cr.max[0]; ++x)
+					++counts[(z*CROWN_LIGHT_CLUSTERS_Y + y)*CROWN_LIGHT_CLUSTERS_X + x];
+	}
+
+	// Reserve the indices of each cluster
+	u32 offset = 0;
+	for (u32 c = 0; c < LIGHT_CLUSTERS; ++c)
+	{
+		u32 num = counts[c] < CROWN_MAX_LIGHTS_PER_CLUSTER ? counts[c] : CROWN_MAX_LIGHTS_PER_CLUSTER;
+		num = num < CROWN_MAX_LIGHT_INDICES - offset ? num : CROWN_MAX_LIGHT_INDICES - offset;
+		clusters[c*2 + 0] = f32(offset);
+		clusters[c*2 + 1] = 0.0f;
+		counts[c] = num;
+		offset += num;
+	}
+
+	// Fill the indices
+	for (u32 l = 0; l < array::size(ranges); ++l)
+	{
+		const ClusterRange& cr = ranges[l];
+		for (s32 z = cr.min[2]; z <= cr.max[2]; ++z)
+		{
+			for (s32 y = cr.min[1]; y <= cr.max[1]; ++y)
+			{
+				for (s32 x = cr.min[0]; x <= cr.max[0]; ++x)
+				{
+					const u32 c = (z*CROWN_LIGHT_CLUSTERS_Y + y)*CROWN_LIGHT_CLUSTERS_X + x;
+					const u32 n = u32(clusters[c*2 + 1]);
+					if (n == counts[c])
+						continue;
+
+					indices[u32(clusters[c*2 + 0]) + n] = f32(num_directional + l);
+					clusters[c*2 + 1] = f32(n + 1);
+				}
+			}
+		}
+	}
+
+	bgfx::updateTexture2D(_light_data[camera], 0, 0, 0, 0, CROWN_MAX_LIGHTS, LIGHT_DATA_ROWS, data_mem);
+	bgfx::updateTexture2D(_light_clusters[camera], 0, 0, 0, 0, LIGHT_CLUSTERS_XY, CROWN_LIGHT_CLUSTERS_Z, clusters_mem);
+	bgfx::updateTexture2D(_light_indices[camera], 0, 0, 0, 0, LIGHT_INDICES_WIDTH, LIGHT_INDICES_HEIGHT, indices_mem);
+
+	const Vector4 lighting = { f32(num_directional), near, CROWN_LIGHT_CLUSTERS_Z / log_depth, 0.0f };
+	const Vector4 light_clusters = { CROWN_LIGHT_CLUSTERS_X, CROWN_LIGHT_CLUSTERS_Y, CROWN_LIGHT_CLUSTERS_Z, 0.0f };
+	const Vector4 light_textures = { CROWN_MAX_LIGHTS, LIGHT_INDICES_WIDTH, LIGHT_INDICES_HEIGHT, 0.0f };
+	_render_queue.set_uniform(_u_lighting, lighting);
+	_render_queue.set_uniform(_u_light_clusters, light_clusters);
+	_render_queue.set_uniform(_u_light_textures, light_textures);
+
+	const Vector4 shadow_params = { CROWN_SHADOW_BIAS
+		, shadow_directional
+		, caps->homogeneousDepth ? 1.0f : 0.0f
+		, caps->originBottomLeft ? 1.0f : 0.0f
+		};
+	_render_queue.set_uniform(_u_shadow_params, shadow_params);
+
+	RECORD_FLOAT("render_world.lights", f32(num_lights));
+	RECORD_FLOAT("render_world.lights_culled", f32(num_culled));
+	RECORD_FLOAT("render_world.light_indices", f32(offset));
+}
+
+void RenderWorld::debug_draw(DebugLine& dl)
+{
+	if (!_debug_drawing)
+		return;
+
+	MeshManager::MeshInstanceData& mid = _mesh_manager._data;
+
+	for (u32 i = 0; i < mid.size; ++i)
+	{
+		const OBB& obb = mid.obb[i];
+		const Matrix4x4& world = mid.world[i];
+		dl.add_obb(obb.tm * world, obb.half_extents, COLOR4_RED);
+	}
+
+	_light_manager.debug_draw(0, _light_manager._data.size, dl);
+}
+
+void RenderWorld::enable_debug_drawing(bool enable)
+{
+	_debug_drawing = enable;
+}
+
+void RenderWorld::unit_destroyed_callback(UnitId id)
+{
+	{
+		MeshInstance curr = _mesh_manager.first(id);
+		MeshInstance next;
+
+		while (is_valid(curr))
+		{
+			next = _mesh_manager.next(curr);
+			mesh_destroy(curr);
+			curr = next;
+		}
+	}
+
+	{
+		SpriteInstance first = sprite_instances(id);
+
+		if (is_valid(first))
+			sprite_destroy(id, first);
+	}
+
+	{
+		LightInstance first = light_instances(id);
+
+		if (is_valid(first))
+			light_destroy(id, first);
+	}
+
+	{
+		ParticleInstance first = particle_instance(id);
+
+		if (is_valid(first))
+			particle_destroy(id, first);
+	}
+
+	{
+		TilemapInstance first = tilemap_instance(id);
+
+		if (is_valid(first))
+			tilemap_destroy(id, first);
+	}
+}
+
+void RenderWorld::MeshManager::allocate(u32 num)
+{
+	CE_ENSURE(num >= _data.size);
+
+	const u32 bytes = 0
+		+ num*sizeof(UnitId) + alignof(UnitId)
+		+ num*sizeof(MeshResource*) + alignof(MeshResource*)
+		+ num*sizeof(MeshGeometry*) + alignof(MeshGeometry*)
+		+ num*sizeof(MeshData) + alignof(MeshData)
+		+ num*sizeof(StringId64) + alignof(StringId64)
+		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
+		+ num*sizeof(OBB) + alignof(OBB)
+		+ num*sizeof(MeshInstance) + alignof(MeshInstance)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u32) + alignof(u32)
+		;
+
+	MeshInstanceData new_data;
+	new_data.size = _data.size;
+	new_data.capacity = num;
+	new_data.buffer = _allocator->allocate(bytes);
+	new_data.first_hidden = _data.first_hidden;
+
+	new_data.unit          = (UnitId*             )new_data.buffer;
+	new_data.resource      = (const MeshResource**)memory::align_top(new_data.unit + num,     alignof(const MeshResource*));
+	new_data.geometry      = (const MeshGeometry**)memory::align_top(new_data.resource + num, alignof(const MeshGeometry*));
+	new_data.mesh          = (MeshData*           )memory::align_top(new_data.geometry + num, alignof(MeshData           ));
+	new_data.material      = (StringId64*         )memory::align_top(new_data.mesh + num,     alignof(StringId64         ));
+	new_data.world         = (Matrix4x4*          )memory::align_top(new_data.material + num, alignof(Matrix4x4          ));
+	new_data.obb           = (OBB*                )memory::align_top(new_data.world + num,    alignof(OBB                ));
+	new_data.next_instance = (MeshInstance*       )memory::align_top(new_data.obb + num,      alignof(MeshInstance       ));
+	new_data.leaf          = (u32*                )memory::align_top(new_data.next_instance + num, alignof(u32));
+	new_data.skin          = new_data.leaf + num;
+
+	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
+	memcpy(new_data.resource, _data.resource, _data.size * sizeof(MeshResource*));
+	memcpy(new_data.geometry, _data.geometry, _data.size * sizeof(MeshGeometry*));
+	memcpy(new_data.mesh, _data.mesh, _data.size * sizeof(MeshData));
+	memcpy(new_data.material, _data.material, _data.size * sizeof(StringId64));
+	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
+	memcpy(new_data.obb, _data.obb, _data.size * sizeof(OBB));
+	memcpy(new_data.next_instance, _data.next_instance, _data.size * sizeof(MeshInstance));
+	memcpy(new_data.leaf, _data.leaf, _data.size * sizeof(u32));
+	memcpy(new_data.skin, _data.skin, _data.size * sizeof(u32));
+
+	_allocator->deallocate(_data.buffer);
+	_data = new_data;
+}
+
+void RenderWorld::MeshManager::grow()
+{
+	allocate(_data.capacity * 2 + 1);
+}
+
+void RenderWorld::MeshManager::reserve(u32 num)
+{
+	if (_data.size + num > _data.capacity)
+		allocate(_data.size + num);
+
+	hash_map::reserve(_map, hash_map::size(_map) + num);
+}
+
+void RenderWorld::MeshManager::shrink_to_fit()
+{
+	if (_data.capacity > _data.size)
+		allocate(_data.size);
+
+	hash_map::shrink_to_fit(_map);
+}
+
+MeshInstance RenderWorld::MeshManager::create(UnitId id, const MeshResource* mr, const MeshGeometry* mg, StringId64 mat, const Matrix4x4& tr)
+{
+	if (_data.size == _data.capacity)
+		grow();
+
+	const u32 last = _data.size;
+
+	_data.unit[last]          = id;
+	_data.resource[last]      = mr;
+	_data.geometry[last]      = mg;
+	_data.mesh[last].vbh      = mg->vertex_buffer;
+	_data.mesh[last].ibh      = mg->index_buffer;
+	_data.mesh[last].lod      = 0;
+	_data.material[last]      = mat;
+	_data.world[last]         = tr;
+	_data.obb[last]           = mg->obb;
+	_data.next_instance[last] = make_instance(UINT32_MAX);
+	_data.leaf[last]          = _tree.create(world_aabb(mg->obb, tr), last);
+	_data.skin[last]          = UINT32_MAX;
+
+	++_data.size;
+	++_data.first_hidden;
+
+	MeshInstance curr = first(id);
+	if (!is_valid(curr))
+	{
+		hash_map::set(_map, id, last);
+	}
+	else
+	{
+		add_node(curr, make_instance(last));
+	}
+
+	return make_instance(last);
+}
+
+void RenderWorld::MeshManager::destroy(MeshInstance i)
+{
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	const u32 last             = _data.size - 1;
+	const UnitId u             = _data.unit[i.i];
+	const MeshInstance first_i = first(u);
+	const MeshInstance last_i  = make_instance(last);
+
+	swap_node(last_i, i);
+	remove_node(first_i, i);
+	_tree.destroy(_data.leaf[i.i]);
+
+	_data.unit[i.i]          = _data.unit[last];
+	_data.resource[i.i]      = _data.resource[last];
+	_data.geometry[i.i]      = _data.geometry[last];
+	_data.mesh[i.i].vbh      = _data.mesh[last].vbh;
+	_data.mesh[i.i].ibh      = _data.mesh[last].ibh;
+	_data.mesh[i.i].lod      = _data.mesh[last].lod;
+	_data.material[i.i]      = _data.material[last];
+	_data.world[i.i]         = _data.world[last];
+	_data.obb[i.i]           = _data.obb[last];
+	_data.next_instance[i.i] = _data.next_instance[last];
+	_data.leaf[i.i]          = _data.leaf[last];
+	_data.skin[i.i]          = _data.skin[last];
+
+	if (i.i != last)
+		_tree.set_user_data(_data.leaf[i.i], i.i);
+
+	--_data.size;
+	--_data.first_hidden;
+}
+
+bool RenderWorld::MeshManager::has(UnitId id)
+{
+	return is_valid(first(id));
+}
+
+MeshInstance RenderWorld::MeshManager::first(UnitId id)
+{
+	return make_instance(hash_map::get(_map, id, UINT32_MAX));
+}
+
+MeshInstance RenderWorld::MeshManager::next(MeshInstance i)
+{
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+	return _data.next_instance[i.i];
+}
+
+MeshInstance RenderWorld::MeshManager::previous(MeshInstance i)
+{
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	const UnitId u = _data.unit[i.i];
+
+	MeshInstance curr = first(u);
+	MeshInstance prev = { UINT32_MAX };
+
+	while (curr.i != i.i)
+	{
+		prev = curr;
+		curr = next(curr);
+	}
+
+	return prev;
+}
+
+void RenderWorld::MeshManager::add_node(MeshInstance first, MeshInstance i)
+{
+	CE_ASSERT(first.i < _data.size, "Index out of bounds");
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	MeshInstance curr = first;
+	while (is_valid(next(curr)))
+		curr = next(curr);
+
+	_data.next_instance[curr.i] = i;
+}
+
+void RenderWorld::MeshManager::remove_node(MeshInstance first, MeshInstance i)
+{
+	CE_ASSERT(first.i < _data.size, "Index out of bounds");
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	const UnitId u = _data.unit[first.i];
+
+	if (i.i == first.i)
+	{
+		if (!is_valid(next(i)))
+			hash_map::remove(_map, u);
+		else
+			hash_map::set(_map, u, next(i).i);
+	}
+	else
+	{
+		MeshInstance prev = previous(i);
+		_data.next_instance[prev.i] = next(i);
+	}
+}
+
+void RenderWorld::MeshManager::swap_node(MeshInstance a, MeshInstance b)
+{
+	CE_ASSERT(a.i < _data.size, "Index out of bounds");
+	CE_ASSERT(b.i < _data.size, "Index out of bounds");
+
+	const UnitId u = _data.unit[a.i];
+	const MeshInstance first_i = first(u);
+
+	if (a.i == first_i.i)
+	{
+		hash_map::set(_map, u, b.i);
+	}
+	else
+	{
+		const MeshInstance prev_a = previous(a);
+		CE_ENSURE(prev_a.i != a.i);
+		_data.next_instance[prev_a.i] = b;
+	}
+}
+
+void RenderWorld::MeshManager::destroy()
+{
+	_allocator->deallocate(_data.buffer);
+}
+
+void RenderWorld::SpriteManager::allocate(u32 num)
+{
+	CE_ENSURE(num >= _data.size);
+
+	const u32 bytes = 0
+		+ num*sizeof(UnitId) + alignof(UnitId)
+		+ num*sizeof(SpriteResource**) + alignof(SpriteResource*)
+		+ num*sizeof(StringId64) + alignof(StringId64)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
+		+ num*sizeof(AABB) + alignof(AABB)
+		+ num*sizeof(bool) + alignof(bool)
+		+ num*sizeof(bool) + alignof(bool)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(SpriteLoop) + alignof(SpriteLoop)
+		;
+
+	SpriteInstanceData new_data;
+	new_data.size = _data.size;
+	new_data.capacity = num;
+	new_data.buffer = _allocator->allocate(bytes);
+	new_data.first_hidden = _data.first_hidden;
+
+	new_data.unit     = (UnitId*               )new_data.buffer;
+	new_data.resource = (const SpriteResource**)memory::align_top(new_data.unit + num,     alignof(const SpriteResource*));
+	new_data.material = (StringId64*           )memory::align_top(new_data.resource + num, alignof(StringId64           ));
+	new_data.frame    = (u32*                  )memory::align_top(new_data.material + num, alignof(u32                  ));
+	new_data.world    = (Matrix4x4*            )memory::align_top(new_data.frame + num,    alignof(Matrix4x4            ));
+	new_data.aabb     = (AABB*                 )memory::align_top(new_data.world + num,    alignof(AABB                 ));
+	new_data.flip_x   = (bool*                 )memory::align_top(new_data.aabb + num,     alignof(bool                 ));
+	new_data.flip_y   = (bool*                 )memory::align_top(new_data.flip_x + num,   alignof(bool                 ));
+	new_data.layer    = (u32*                  )memory::align_top(new_data.flip_y + num,   alignof(u32                  ));
+	new_data.depth    = (u32*                  )memory::align_top(new_data.layer + num,    alignof(u32                  ));
+	new_data.leaf     = (u32*                  )memory::align_top(new_data.depth + num,    alignof(u32                  ));
+	new_data.loop     = (SpriteLoop*           )memory::align_top(new_data.leaf + num,     alignof(SpriteLoop           ));
+
+	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
+	memcpy(new_data.resource, _data.resource, _data.size * sizeof(SpriteResource**));
+	memcpy(new_data.material, _data.material, _data.size * sizeof(StringId64));
+	memcpy(new_data.frame, _data.frame, _data.size * sizeof(u32));
+	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
+	memcpy(new_data.aabb, _data.aabb, _data.size * sizeof(AABB));
+	memcpy(new_data.flip_x, _data.flip_x, _data.size * sizeof(bool));
+	memcpy(new_data.flip_y, _data.flip_y, _data.size * sizeof(bool));
+	memcpy(new_data.layer, _data.layer, _data.size * sizeof(u32));
+	memcpy(new_data.depth, _data.depth, _data.size * sizeof(u32));
+	memcpy(new_data.leaf, _data.leaf, _data.size * sizeof(u32));
+	memcpy(new_data.loop, _data.loop, _data.size * sizeof(SpriteLoop));
+
+	_allocator->deallocate(_data.buffer);
+	_data = new_data;
+}
+
+void RenderWorld::SpriteManager::grow()
+{
+	allocate(_data.capacity * 2 + 1);
+}
+
+void RenderWorld::SpriteManager::reserve(u32 num)
+{
+	if (_data.size + num > _data.capacity)
+		allocate(_data.size + num);
+
+	hash_map::reserve(_map, hash_map::size(_map) + num);
+}
+
+void RenderWorld::SpriteManager::shrink_to_fit()
+{
+	if (_data.capacity > _data.size)
+		allocate(_data.size);
+
+	hash_map::shrink_to_fit(_map);
+}
+
+SpriteInstance RenderWorld::SpriteManager::create(UnitId id, const SpriteResource* sr, StringId64 mat, u32 layer, u32 depth, const Matrix4x4& tr)
+{
+	if (_data.size == _data.capacity)
+		grow();
+
+	const u32 last = _data.size;
+
+	_data.unit[last]     = id;
+	_data.resource[last] = sr;
+	_data.material[last] = mat;
+	_data.frame[last]    = 0;
+	_data.world[last]    = tr;
+	_data.aabb[last]     = AABB();
+	_data.flip_x[last]   = false;
+	_data.flip_y[last]   = false;
+	_data.layer[last]    = layer;
+	_data.depth[last]    = depth;
+	_data.leaf[last]     = _tree.create(world_aabb(sr->obb, tr), last);
+	memset(&_data.loop[last], 0, sizeof(SpriteLoop));
+
+	++_data.size;
+	++_data.first_hidden;
+	array::push_back(_dirty, last);
+
+	hash_map::set(_map, id, last);
+	return make_instance(last);
+}
+
+void RenderWorld::SpriteManager::destroy(SpriteInstance i)
+{
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	const u32 last      = _data.size - 1;
+	const UnitId u      = _data.unit[i.i];
+	const UnitId last_u = _data.unit[last];
+
+	_tree.destroy(_data.leaf[i.i]);
+
+	if (_data.loop[i.i].num_frames > 0)
+		--_num_loops;
+	_loops_dirty = _loops_dirty || _num_loops > 0;
+
+	_data.unit[i.i]     = _data.unit[last];
+	_data.resource[i.i] = _data.resource[last];
+	_data.material[i.i] = _data.material[last];
+	_data.frame[i.i]    = _data.frame[last];
+	_data.world[i.i]    = _data.world[last];
+	_data.aabb[i.i]     = _data.aabb[last];
+	_data.flip_x[i.i]   = _data.flip_x[last];
+	_data.flip_y[i.i]   = _data.flip_y[last];
+	_data.layer[i.i]    = _data.layer[last];
+	_data.depth[i.i]    = _data.depth[last];
+	_data.leaf[i.i]     = _data.leaf[last];
+	_data.loop[i.i]     = _data.loop[last];
+
+	if (i.i != last)
+	{
+		_tree.set_user_data(_data.leaf[i.i], i.i);
+		array::push_back(_dirty, i.i);
+	}
+
+	--_data.size;
+	--_data.first_hidden;
+
+	hash_map::set(_map, last_u, i.i);
+	hash_map::remove(_map, u);
+}
+
+bool RenderWorld::SpriteManager::has(UnitId id)
+{
+	return is_valid(sprite(id));
+}
+
+void RenderWorld::SpriteManager::set_visible(SpriteInstance i, bool visible)
+{
+	u32 swap_index = UINT32_MAX;
+	const UnitId unit = _data.unit[i.i];
+
+	if (visible && i.i >= _data.first_hidden)
 	{
-		const OBB& obb = mid.obb[i];
-		const Matrix4x4& world = mid.world[i];
-		dl.add_obb(obb.tm * world, obb.half_extents, COLOR4_RED);
+		const u32 first_hidden = _data.first_hidden;
+		const UnitId first_hidden_unit = _data.unit[first_hidden];
+		hash_map::set(_map, unit, first_hidden);
+		hash_map::set(_map, first_hidden_unit, i.i);
+		swap_index = first_hidden;
+		++_data.first_hidden;
+	}
+	else if (!visible && i.i < _data.first_hidden)
+	{
+		const u32 last_visible = _data.first_hidden - 1;
+		const UnitId last_visible_unit = _data.unit[last_visible];
+		hash_map::set(_map, unit, last_visible);
+		hash_map::set(_map, last_visible_unit, i.i);
+		swap_index = last_visible;
+		--_data.first_hidden;
 	}
 
-	_light_manager.debug_draw(0, _light_manager._data.size, dl);
+	if (swap_index != UINT32_MAX)
+	{
+		std::swap(_data.unit[i.i], _data.unit[swap_index]);
+		std::swap(_data.resource[i.i], _data.resource[swap_index]);
+		std::swap(_data.material[i.i], _data.material[swap_index]);
+		std::swap(_data.frame[i.i], _data.frame[swap_index]);
+		std::swap(_data.world[i.i], _data.world[swap_index]);
+		std::swap(_data.aabb[i.i], _data.aabb[swap_index]);
+		std::swap(_data.flip_x[i.i], _data.flip_x[swap_index]);
+		std::swap(_data.flip_y[i.i], _data.flip_y[swap_index]);
+		std::swap(_data.layer[i.i], _data.layer[swap_index]);
+		std::swap(_data.depth[i.i], _data.depth[swap_index]);
+		std::swap(_data.leaf[i.i], _data.leaf[swap_index]);
+		std::swap(_data.loop[i.i], _data.loop[swap_index]);
+		_tree.set_user_data(_data.leaf[i.i], i.i);
+		_tree.set_user_data(_data.leaf[swap_index], swap_index);
+		array::push_back(_dirty, i.i);
+		array::push_back(_dirty, swap_index);
+		_loops_dirty = _loops_dirty || _num_loops > 0;
+	}
 }
 
-void RenderWorld::enable_debug_drawing(bool enable)
+SpriteInstance RenderWorld::SpriteManager::sprite(UnitId id)
 {
-	_debug_drawing = enable;
+	return make_instance(hash_map::get(_map, id, UINT32_MAX));
 }
 
-void RenderWorld::unit_destroyed_callback(UnitId id)
+void RenderWorld::SpriteManager::set_frame(SpriteInstance i, u32 frame)
+{
+	if (_data.frame[i.i] == frame)
+		return;
+
+	_data.frame[i.i] = frame;
+	array::push_back(_dirty, i.i);
+}
+
+void RenderWorld::SpriteManager::set_flip(SpriteInstance i, bool flip_x, bool flip_y)
+{
+	if (_data.flip_x[i.i] == flip_x && _data.flip_y[i.i] == flip_y)
+		return;
+
+	_data.flip_x[i.i] = flip_x;
+	_data.flip_y[i.i] = flip_y;
+	array::push_back(_dirty, i.i);
+	_loops_dirty = _loops_dirty || _data.loop[i.i].num_frames > 0;
+}
+
+void RenderWorld::SpriteManager::set_loop(SpriteInstance i, u32 first_frame, u32 num_frames, f32 fps, f32 start_time)
+{
+	CE_ASSERT(first_frame + num_frames <= _data.resource[i.i]->num_verts/4, "Frame out of bounds");
+	CE_ASSERT(num_frames <= CROWN_SPRITE_BATCH_SIZE, "Too many frames: %u", num_frames);
+
+	SpriteLoop& sl = _data.loop[i.i];
+	if (sl.num_frames > 0)
+		--_num_loops;
+	if (num_frames > 0)
+		++_num_loops;
+
+	sl.first_frame = first_frame;
+	sl.num_frames = num_frames;
+	sl.fps = fps;
+	sl.start_time = start_time;
+	_loops_dirty = true;
+}
+
+void RenderWorld::SpriteManager::update_vertices()
 {
+	// Recreate the vertex buffer when the instances do not fit anymore
+	if (_data.capacity > _vertex_buffer_capacity)
 	{
-		MeshInstance curr = _mesh_manager.first(id);
-		MeshInstance next;
+		if (bgfx::isValid(_vertex_buffer))
+			bgfx::destroy(_vertex_buffer);
 
-		while (is_valid(curr))
+		_vertex_buffer = bgfx::createDynamicVertexBuffer(_data.capacity*4, sprite_vertex_decl());
+		_vertex_buffer_capacity = _data.capacity;
+
+		array::resize(_dirty, _data.size);
+		for (u32 i = 0; i < _data.size; ++i)
+			_dirty[i] = i;
+	}
+
+	const u32 num_dirty = array::size(_dirty);
+	if (num_dirty == 0)
+		return;
+
+	// Upload each run of consecutive dirty instances at once
+	std::sort(array::begin(_dirty), array::end(_dirty));
+
+	u32 num_updates = 0;
+	for (u32 d = 0; d < num_dirty;)
+	{
+		const u32 first = _dirty[d];
+		if (first >= _data.size)
+			break;
+
+		u32 end = first + 1;
+		while (d < num_dirty && _dirty[d] < end + 1 && _dirty[d] < _data.size)
 		{
-			next = _mesh_manager.next(curr);
-			mesh_destroy(curr);
-			curr = next;
+			end = _dirty[d] + 1;
+			++d;
 		}
+
+		const u32 num = end - first;
+		const bgfx::Memory* mem = bgfx::alloc(num*4*5*sizeof(f32));
+		for (u32 i = 0; i < num; ++i)
+			sprite_vertices((f32*)mem->data + i*20, _data, first + i, _data.frame[first + i]);
+
+		bgfx::update(_vertex_buffer, first*4, mem);
+		++num_updates;
 	}
 
+	RECORD_FLOAT("render_world.sprites_updated", f32(num_dirty));
+	RECORD_FLOAT("render_world.sprite_buffer_updates", f32(num_updates));
+	array::clear(_dirty);
+}
+
+void RenderWorld::SpriteManager::update_loop_vertices()
+{
+	if (!_loops_dirty)
+		return;
+	_loops_dirty = false;
+
+	// The visible looping instances sharing layer, depth and material are
+	// contiguous, so that they can be drawn together.
+	Array<u32> loops(default_frame_allocator());
+	for (u32 i = 0; i < _data.first_hidden; ++i)
 	{
-		SpriteInstance first = sprite_instances(id);
+		if (_data.loop[i].num_frames > 0)
+			array::push_back(loops, i);
+	}
+	sort_sprites(_data, array::begin(loops), array::size(loops), _loop_sprites);
 
-		if (is_valid(first))
-			sprite_destroy(id, first);
+	const u32 num = array::size(_loop_sprites);
+	array::resize(_loop_first_vertex, num + 1);
+	u32 num_vertices = 0;
+	for (u32 s = 0; s < num; ++s)
+	{
+		SpriteLoop& sl = _data.loop[_loop_sprites[s]];
+		sl.slot = s;
+		_loop_first_vertex[s] = num_vertices;
+		num_vertices += sl.num_frames*4;
 	}
+	_loop_first_vertex[num] = num_vertices;
+
+	if (num_vertices == 0)
+		return;
 
+	if (num_vertices > _loop_vertex_buffer_capacity)
 	{
-		LightInstance first = light_instances(id);
+		if (bgfx::isValid(_loop_vertex_buffer))
+			bgfx::destroy(_loop_vertex_buffer);
 
-		if (is_valid(first))
-			light_destroy(id, first);
+		_loop_vertex_buffer_capacity = num_vertices > _loop_vertex_buffer_capacity*2 ? num_vertices : _loop_vertex_buffer_capacity*2;
+		_loop_vertex_buffer = bgfx::createDynamicVertexBuffer(_loop_vertex_buffer_capacity, sprite_loop_vertex_decl());
+	}
+
+	// Each quad is collapsed by the shader unless its frame is the current one
+	const bgfx::Memory* mem = bgfx::alloc(num_vertices*9*sizeof(f32));
+	f32* vdata = (f32*)mem->data;
+	for (u32 s = 0; s < num; ++s)
+	{
+		const u32 i = _loop_sprites[s];
+		const SpriteLoop& sl = _data.loop[i];
+
+		for (u32 f = 0; f < sl.num_frames; ++f)
+		{
+			f32 frame[20];
+			sprite_vertices(frame, _data, i, sl.first_frame + f);
+
+			for (u32 v = 0; v < 4; ++v)
+			{
+				const Vector3 p = vector3(frame[v*5 + 0], frame[v*5 + 1], frame[v*5 + 2]) * _data.world[i];
+				vdata[0] = p.x;
+				vdata[1] = p.y;
+				vdata[2] = p.z;
+				vdata[3] = frame[v*5 + 3];
+				vdata[4] = frame[v*5 + 4];
+				vdata[5] = f32(f);
+				vdata[6] = f32(sl.num_frames);
+				vdata[7] = sl.fps;
+				vdata[8] = sl.start_time;
+				vdata += 9;
+			}
+		}
 	}
+
+	bgfx::update(_loop_vertex_buffer, 0, mem);
+	RECORD_FLOAT("render_world.sprite_loop_vertices", f32(num_vertices));
 }
 
-void RenderWorld::MeshManager::allocate(u32 num)
+void RenderWorld::SpriteManager::destroy()
+{
+	if (bgfx::isValid(_vertex_buffer))
+		bgfx::destroy(_vertex_buffer);
+	if (bgfx::isValid(_loop_vertex_buffer))
+		bgfx::destroy(_loop_vertex_buffer);
+
+	_allocator->deallocate(_data.buffer);
+}
+
+void RenderWorld::LightManager::allocate(u32 num)
 {
-	CE_ENSURE(num > _data.size);
+	CE_ENSURE(num >= _data.size);
 
 	const u32 bytes = 0
 		+ num*sizeof(UnitId) + alignof(UnitId)
-		+ num*sizeof(MeshResource*) + alignof(MeshResource*)
-		+ num*sizeof(MeshGeometry*) + alignof(MeshGeometry*)
-		+ num*sizeof(MeshData) + alignof(MeshData)
-		+ num*sizeof(StringId64) + alignof(StringId64)
 		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
-		+ num*sizeof(OBB) + alignof(OBB)
-		+ num*sizeof(MeshInstance) + alignof(MeshInstance)
+		+ num*sizeof(f32) + alignof(f32)
+		+ num*sizeof(f32) + alignof(f32)
+		+ num*sizeof(f32) + alignof(f32)
+		+ num*sizeof(Color4) + alignof(Color4)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(bool) + alignof(bool)
+		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(bool) + alignof(bool)
 		;
 
-	MeshInstanceData new_data;
+	LightInstanceData new_data;
 	new_data.size = _data.size;
 	new_data.capacity = num;
 	new_data.buffer = _allocator->allocate(bytes);
-	new_data.first_hidden = _data.first_hidden;
 
-	new_data.unit          = (UnitId*             )new_data.buffer;
-	new_data.resource      = (const MeshResource**)memory::align_top(new_data.unit + num,     alignof(const MeshResource*));
-	new_data.geometry      = (const MeshGeometry**)memory::align_top(new_data.resource + num, alignof(const MeshGeometry*));
-	new_data.mesh          = (MeshData*           )memory::align_top(new_data.geometry + num, alignof(MeshData           ));
-	new_data.material      = (StringId64*         )memory::align_top(new_data.mesh + num,     alignof(StringId64         ));
-	new_data.world         = (Matrix4x4*          )memory::align_top(new_data.material + num, alignof(Matrix4x4          ));
-	new_data.obb           = (OBB*                )memory::align_top(new_data.world + num,    alignof(OBB                ));
-	new_data.next_instance = (MeshInstance*       )memory::align_top(new_data.obb + num,      alignof(MeshInstance       ));
+	new_data.unit         = (UnitId*   )new_data.buffer;
+	new_data.world        = (Matrix4x4*)memory::align_top(new_data.unit + num,         alignof(Matrix4x4));
+	new_data.range        = (f32*      )memory::align_top(new_data.world + num,        alignof(f32      ));
+	new_data.intensity    = (f32*      )memory::align_top(new_data.range + num,        alignof(f32      ));
+	new_data.spot_angle   = (f32*      )memory::align_top(new_data.intensity + num,    alignof(f32      ));
+	new_data.color        = (Color4*   )memory::align_top(new_data.spot_angle + num,   alignof(Color4   ));
+	new_data.type         = (u32*      )memory::align_top(new_data.color + num,        alignof(u32      ));
+	new_data.cast_shadows = (bool*     )memory::align_top(new_data.type + num,         alignof(bool     ));
+	new_data.shadow_tile  = (u32*      )memory::align_top(new_data.cast_shadows + num, alignof(u32      ));
+	new_data.shadow_dirty = (bool*     )memory::align_top(new_data.shadow_tile + num,  alignof(bool     ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
-	memcpy(new_data.resource, _data.resource, _data.size * sizeof(MeshResource*));
-	memcpy(new_data.geometry, _data.geometry, _data.size * sizeof(MeshGeometry*));
-	memcpy(new_data.mesh, _data.mesh, _data.size * sizeof(MeshData));
-	memcpy(new_data.material, _data.material, _data.size * sizeof(StringId64));
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
-	memcpy(new_data.obb, _data.obb, _data.size * sizeof(OBB));
-	memcpy(new_data.next_instance, _data.next_instance, _data.size * sizeof(MeshInstance));
+	memcpy(new_data.range, _data.range, _data.size * sizeof(f32));
+	memcpy(new_data.intensity, _data.intensity, _data.size * sizeof(f32));
+	memcpy(new_data.spot_angle, _data.spot_angle, _data.size * sizeof(f32));
+	memcpy(new_data.color, _data.color, _data.size * sizeof(Color4));
+	memcpy(new_data.type, _data.type, _data.size * sizeof(u32));
+	memcpy(new_data.cast_shadows, _data.cast_shadows, _data.size * sizeof(bool));
+	memcpy(new_data.shadow_tile, _data.shadow_tile, _data.size * sizeof(u32));
+	memcpy(new_data.shadow_dirty, _data.shadow_dirty, _data.size * sizeof(bool));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
 }
 
-void RenderWorld::MeshManager::grow()
+void RenderWorld::LightManager::grow()
 {
 	allocate(_data.capacity * 2 + 1);
 }
 
-MeshInstance RenderWorld::MeshManager::create(UnitId id, const MeshResource* mr, const MeshGeometry* mg, StringId64 mat, const Matrix4x4& tr)
+void RenderWorld::LightManager::reserve(u32 num)
 {
-	if (_data.size == _data.capacity)
-		grow();
-
-	const u32 last = _data.size;
-
-	_data.unit[last]          = id;
-	_data.resource[last]      = mr;
-	_data.geometry[last]      = mg;
-	_data.mesh[last].vbh      = mg->vertex_buffer;
-	_data.mesh[last].ibh      = mg->index_buffer;
-	_data.material[last]      = mat;
-	_data.world[last]         = tr;
-	_data.obb[last]           = mg->obb;
-	_data.next_instance[last] = make_instance(UINT32_MAX);
+	if (_data.size + num > _data.capacity)
+		allocate(_data.size + num);
 
-	++_data.size;
-	++_data.first_hidden;
+	hash_map::reserve(_map, hash_map::size(_map) + num);
+}
 
-	MeshInstance curr = first(id);
-	if (!is_valid(curr))
-	{
-		hash_map::set(_map, id, last);
-	}
-	else
-	{
-		add_node(curr, make_instance(last));
-	}
+void RenderWorld::LightManager::shrink_to_fit()
+{
+	if (_data.capacity > _data.size)
+		allocate(_data.size);
 
-	return make_instance(last);
+	hash_map::shrink_to_fit(_map);
 }
 
-void RenderWorld::MeshManager::destroy(MeshInstance i)
+LightInstance RenderWorld::LightManager::create(UnitId id, const LightDesc& ld, const Matrix4x4& tr)
 {
-	CE_ASSERT(i.i < _data.size, "Index out of bounds");
-
-	const u32 last             = _data.size - 1;
-	const UnitId u             = _data.unit[i.i];
-	const MeshInstance first_i = first(u);
-	const MeshInstance last_i  = make_instance(last);
+	CE_ASSERT(!hash_map::has(_map, id), "Unit already has light");
 
-	swap_node(last_i, i);
-	remove_node(first_i, i);
+	if (_data.size == _data.capacity)
+		grow();
 
-	_data.unit[i.i]          = _data.unit[last];
-	_data.resource[i.i]      = _data.resource[last];
-	_data.geometry[i.i]      = _data.geometry[last];
-	_data.mesh[i.i].vbh      = _data.mesh[last].vbh;
-	_data.mesh[i.i].ibh      = _data.mesh[last].ibh;
-	_data.material[i.i]      = _data.material[last];
-	_data.world[i.i]         = _data.world[last];
-	_data.obb[i.i]           = _data.obb[last];
-	_data.next_instance[i.i] = _data.next_instance[last];
+	const u32 last = _data.size;
 
-	--_data.size;
-	--_data.first_hidden;
-}
+	_data.unit[last]         = id;
+	_data.world[last]        = tr;
+	_data.range[last]        = ld.range;
+	_data.intensity[last]    = ld.intensity;
+	_data.spot_angle[last]   = ld.spot_angle;
+	_data.color[last]        = vector4(ld.color.x, ld.color.y, ld.color.z, 1.0f);
+	_data.type[last]         = ld.type;
+	_data.cast_shadows[last] = ld.cast_shadows != 0;
+	_data.shadow_tile[last]  = UINT32_MAX;
+	_data.shadow_dirty[last] = true;
 
-bool RenderWorld::MeshManager::has(UnitId id)
-{
-	return is_valid(first(id));
-}
+	++_data.size;
 
-MeshInstance RenderWorld::MeshManager::first(UnitId id)
-{
-	return make_instance(hash_map::get(_map, id, UINT32_MAX));
+	hash_map::set(_map, id, last);
+	return make_instance(last);
 }
 
-MeshInstance RenderWorld::MeshManager::next(MeshInstance i)
+void RenderWorld::LightManager::destroy(LightInstance i)
 {
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
-	return _data.next_instance[i.i];
-}
 
-MeshInstance RenderWorld::MeshManager::previous(MeshInstance i)
-{
-	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+	const u32 last      = _data.size - 1;
+	const UnitId u      = _data.unit[i.i];
+	const UnitId last_u = _data.unit[last];
 
-	const UnitId u = _data.unit[i.i];
+	release_shadow_tiles(i.i);
 
-	MeshInstance curr = first(u);
-	MeshInstance prev = { UINT32_MAX };
+	_data.unit[i.i]         = _data.unit[last];
+	_data.world[i.i]        = _data.world[last];
+	_data.range[i.i]        = _data.range[last];
+	_data.intensity[i.i]    = _data.intensity[last];
+	_data.spot_angle[i.i]   = _data.spot_angle[last];
+	_data.color[i.i]        = _data.color[last];
+	_data.type[i.i]         = _data.type[last];
+	_data.cast_shadows[i.i] = _data.cast_shadows[last];
+	_data.shadow_tile[i.i]  = _data.shadow_tile[last];
+	_data.shadow_dirty[i.i] = _data.shadow_dirty[last];
 
-	while (curr.i != i.i)
-	{
-		prev = curr;
-		curr = next(curr);
-	}
+	--_data.size;
 
-	return prev;
+	hash_map::set(_map, last_u, i.i);
+	hash_map::remove(_map, u);
 }
 
-void RenderWorld::MeshManager::add_node(MeshInstance first, MeshInstance i)
+bool RenderWorld::LightManager::has(UnitId id)
 {
-	CE_ASSERT(first.i < _data.size, "Index out of bounds");
-	CE_ASSERT(i.i < _data.size, "Index out of bounds");
-
-	MeshInstance curr = first;
-	while (is_valid(next(curr)))
-		curr = next(curr);
-
-	_data.next_instance[curr.i] = i;
+	return is_valid(light(id));
 }
 
-void RenderWorld::MeshManager::remove_node(MeshInstance first, MeshInstance i)
-{
-	CE_ASSERT(first.i < _data.size, "Index out of bounds");
-	CE_ASSERT(i.i < _data.size, "Index out of bounds");
-
-	const UnitId u = _data.unit[first.i];
-
-	if (i.i == first.i)
-	{
-		if (!is_valid(next(i)))
-			hash_map::remove(_map, u);
-		else
-			hash_map::set(_map, u, next(i).i);
-	}
-	else
-	{
-		MeshInstance prev = previous(i);
-		_data.next_instance[prev.i] = next(i);
-	}
+LightInstance RenderWorld::LightManager::light(UnitId id)
+{
+	return make_instance(hash_map::get(_map, id, UINT32_MAX));
 }
 
-void RenderWorld::MeshManager::swap_node(MeshInstance a, MeshInstance b)
+bool RenderWorld::LightManager::allocate_shadow_tiles(u32 i)
 {
-	CE_ASSERT(a.i < _data.size, "Index out of bounds");
-	CE_ASSERT(b.i < _data.size, "Index out of bounds");
+	CE_ASSERT(_data.shadow_tile[i] == UINT32_MAX, "Light already has shadow tiles");
 
-	const UnitId u = _data.unit[a.i];
-	const MeshInstance first_i = first(u);
+	const u32 num = shadow_num_tiles(_data, i);
+	const u64 mask = (u64(1) << num) - 1;
 
-	if (a.i == first_i.i)
+	for (u32 t = 0; t + num <= SHADOW_TILES; ++t)
 	{
-		hash_map::set(_map, u, b.i);
-	}
-	else
-	{
-		const MeshInstance prev_a = previous(a);
-		CE_ENSURE(prev_a.i != a.i);
-		_data.next_instance[prev_a.i] = b;
+		// The faces of an omni light are in the same row
+		if (t % SHADOW_TILES_X + num > SHADOW_TILES_X)
+			continue;
+		if ((_shadow_tiles & (mask << t)) != 0)
+			continue;
+
+		_shadow_tiles |= mask << t;
+		_data.shadow_tile[i] = t;
+		_data.shadow_dirty[i] = true;
+		return true;
 	}
+
+	return false;
 }
 
-void RenderWorld::MeshManager::destroy()
+void RenderWorld::LightManager::release_shadow_tiles(u32 i)
+{
+	if (_data.shadow_tile[i] == UINT32_MAX)
+		return;
+
+	const u64 mask = (u64(1) << shadow_num_tiles(_data, i)) - 1;
+	_shadow_tiles &= ~(mask << _data.shadow_tile[i]);
+	_data.shadow_tile[i] = UINT32_MAX;
+}
+
+void RenderWorld::LightManager::destroy()
 {
 	_allocator->deallocate(_data.buffer);
 }
 
-void RenderWorld::SpriteManager::allocate(u32 num)
+void RenderWorld::LightManager::debug_draw(u32 start_index, u32 num, DebugLine& dl)
+{
+	for (u32 i = start_index; i < start_index + num; ++i)
+	{
+		const Vector3 pos = translation(_data.world[i]);
+		const Vector3 dir = -z(_data.world[i]);
+
+		switch (_data.type[i])
+		{
+		case LightType::DIRECTIONAL:
+			{
+				const Vector3 end = pos + dir*3.0f;
+				dl.add_line(pos, end, COLOR4_YELLOW);
+				dl.add_cone(pos + dir*2.8f, end, 0.1f, COLOR4_YELLOW);
+			}
+			break;
+
+		case LightType::OMNI:
+			dl.add_sphere(pos, _data.range[i], COLOR4_YELLOW);
+			break;
+
+		case LightType::SPOT:
+			{
+				const f32 angle  = _data.spot_angle[i];
+				const f32 range  = _data.range[i];
+				const f32 radius = ftan(angle)*range;
+				dl.add_cone(pos + range*dir, pos, radius, COLOR4_YELLOW);
+			}
+			break;
+
+		default:
+			CE_FATAL("Unknown light type");
+			break;
+		}
+	}
+}
+
+void RenderWorld::TilemapManager::allocate(u32 num)
 {
-	CE_ENSURE(num > _data.size);
+	CE_ENSURE(num >= _data.size);
 
 	const u32 bytes = 0
 		+ num*sizeof(UnitId) + alignof(UnitId)
-		+ num*sizeof(SpriteResource**) + alignof(SpriteResource*)
+		+ num*sizeof(TilemapResource*) + alignof(TilemapResource*)
 		+ num*sizeof(StringId64) + alignof(StringId64)
-		+ num*sizeof(u32) + alignof(u32)
 		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
-		+ num*sizeof(AABB) + alignof(AABB)
-		+ num*sizeof(bool) + alignof(bool)
-		+ num*sizeof(bool) + alignof(bool)
 		+ num*sizeof(u32) + alignof(u32)
 		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(u16*) + alignof(u16*)
+		+ num*sizeof(Chunk*) + alignof(Chunk*)
+		+ num*sizeof(bool) + alignof(bool)
 		;
 
-	SpriteInstanceData new_data;
+	TilemapInstanceData new_data;
 	new_data.size = _data.size;
 	new_data.capacity = num;
 	new_data.buffer = _allocator->allocate(bytes);
-	new_data.first_hidden = _data.first_hidden;
 
-	new_data.unit     = (UnitId*               )new_data.buffer;
-	new_data.resource = (const SpriteResource**)memory::align_top(new_data.unit + num,     alignof(const SpriteResource*));
-	new_data.material = (StringId64*           )memory::align_top(new_data.resource + num, alignof(StringId64           ));
-	new_data.frame    = (u32*                  )memory::align_top(new_data.material + num, alignof(u32                  ));
-	new_data.world    = (Matrix4x4*            )memory::align_top(new_data.frame + num,    alignof(Matrix4x4            ));
-	new_data.aabb     = (AABB*                 )memory::align_top(new_data.world + num,    alignof(AABB                 ));
-	new_data.flip_x   = (bool*                 )memory::align_top(new_data.aabb + num,     alignof(bool                 ));
-	new_data.flip_y   = (bool*                 )memory::align_top(new_data.flip_x + num,   alignof(bool                 ));
-	new_data.layer    = (u32*                  )memory::align_top(new_data.flip_y + num,   alignof(u32                  ));
-	new_data.depth    = (u32*                  )memory::align_top(new_data.layer + num,    alignof(u32                  ));
+	new_data.unit     = (UnitId*                )new_data.buffer;
+	new_data.resource = (const TilemapResource**)memory::align_top(new_data.unit + num,     alignof(TilemapResource*));
+	new_data.material = (StringId64*            )memory::align_top(new_data.resource + num, alignof(StringId64      ));
+	new_data.world    = (Matrix4x4*             )memory::align_top(new_data.material + num, alignof(Matrix4x4       ));
+	new_data.layer    = (u32*                   )memory::align_top(new_data.world + num,    alignof(u32             ));
+	new_data.depth    = (u32*                   )memory::align_top(new_data.layer + num,    alignof(u32             ));
+	new_data.tiles    = (u16**                  )memory::align_top(new_data.depth + num,    alignof(u16*            ));
+	new_data.chunks   = (Chunk**                )memory::align_top(new_data.tiles + num,    alignof(Chunk*          ));
+	new_data.dirty    = (bool*                  )memory::align_top(new_data.chunks + num,   alignof(bool            ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
-	memcpy(new_data.resource, _data.resource, _data.size * sizeof(SpriteResource**));
+	memcpy(new_data.resource, _data.resource, _data.size * sizeof(TilemapResource*));
 	memcpy(new_data.material, _data.material, _data.size * sizeof(StringId64));
-	memcpy(new_data.frame, _data.frame, _data.size * sizeof(u32));
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
-	memcpy(new_data.aabb, _data.aabb, _data.size * sizeof(AABB));
-	memcpy(new_data.flip_x, _data.flip_x, _data.size * sizeof(bool));
-	memcpy(new_data.flip_y, _data.flip_y, _data.size * sizeof(bool));
 	memcpy(new_data.layer, _data.layer, _data.size * sizeof(u32));
 	memcpy(new_data.depth, _data.depth, _data.size * sizeof(u32));
+	memcpy(new_data.tiles, _data.tiles, _data.size * sizeof(u16*));
+	memcpy(new_data.chunks, _data.chunks, _data.size * sizeof(Chunk*));
+	memcpy(new_data.dirty, _data.dirty, _data.size * sizeof(bool));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
 }
 
-void RenderWorld::SpriteManager::grow()
+void RenderWorld::TilemapManager::grow()
 {
 	allocate(_data.capacity * 2 + 1);
 }
 
-SpriteInstance RenderWorld::SpriteManager::create(UnitId id, const SpriteResource* sr, StringId64 mat, u32 layer, u32 depth, const Matrix4x4& tr)
+TilemapInstance RenderWorld::TilemapManager::create(UnitId id, const TilemapResource* tmr, StringId64 material, u32 layer, u32 depth, const Matrix4x4& tr)
 {
+	CE_ASSERT(!hash_map::has(_map, id), "Unit already has tilemap");
+
 	if (_data.size == _data.capacity)
 		grow();
 
 	const u32 last = _data.size;
+	const u32 num_tiles = tmr->width*tmr->height;
+	const u32 num_chunks_x = tilemap_num_chunks_x(tmr);
+	const u32 num_chunks_y = tilemap_num_chunks_y(tmr);
+
+	// The chunks and a copy of the tiles, which can be edited
+	const u32 bytes = num_chunks_x*num_chunks_y*sizeof(Chunk) + num_tiles*sizeof(u16);
+	Chunk* chunks = (Chunk*)_allocator->allocate(bytes, alignof(Chunk));
+	u16* tiles = (u16*)(chunks + num_chunks_x*num_chunks_y);
+	memcpy(tiles, tilemap_resource::tiles(tmr), num_tiles*sizeof(u16));
+
+	for (u32 c = 0; c < num_chunks_x*num_chunks_y; ++c)
+	{
+		u32 x0, y0, x1, y1;
+		tilemap_chunk_rect(tmr, c, x0, y0, x1, y1);
+
+		// Same thickness as the sprites
+		Chunk& chunk = chunks[c];
+		chunk.vbh.idx   = bgfx::kInvalidHandle;
+		chunk.num_tiles = 0;
+		chunk.aabb.min  = vector3(f32(x0)*tmr->tile_size, -0.25f, -f32(y1)*tmr->tile_size);
+		chunk.aabb.max  = vector3(f32(x1)*tmr->tile_size,  0.25f, -f32(y0)*tmr->tile_size);
+		chunk.dirty     = true;
+	}
 
 	_data.unit[last]     = id;
-	_data.resource[last] = sr;
-	_data.material[last] = mat;
-	_data.frame[last]    = 0;
+	_data.resource[last] = tmr;
+	_data.material[last] = material;
 	_data.world[last]    = tr;
-	_data.aabb[last]     = AABB();
-	_data.flip_x[last]   = false;
-	_data.flip_y[last]   = false;
 	_data.layer[last]    = layer;
 	_data.depth[last]    = depth;
+	_data.tiles[last]    = tiles;
+	_data.chunks[last]   = chunks;
+	_data.dirty[last]    = true;
 
 	++_data.size;
-	++_data.first_hidden;
 
 	hash_map::set(_map, id, last);
 	return make_instance(last);
 }
 
-void RenderWorld::SpriteManager::destroy(SpriteInstance i)
+void RenderWorld::TilemapManager::destroy(TilemapInstance i)
 {
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
 
@@ -834,138 +3670,230 @@ void RenderWorld::SpriteManager::destroy(SpriteInstance i)
 	const UnitId u      = _data.unit[i.i];
 	const UnitId last_u = _data.unit[last];
 
+	const TilemapResource* tmr = _data.resource[i.i];
+	const u32 num_chunks = tilemap_num_chunks_x(tmr) * tilemap_num_chunks_y(tmr);
+	for (u32 c = 0; c < num_chunks; ++c)
+	{
+		if (bgfx::isValid(_data.chunks[i.i][c].vbh))
+			bgfx::destroy(_data.chunks[i.i][c].vbh);
+	}
+	_allocator->deallocate(_data.chunks[i.i]);
+
 	_data.unit[i.i]     = _data.unit[last];
 	_data.resource[i.i] = _data.resource[last];
 	_data.material[i.i] = _data.material[last];
-	_data.frame[i.i]    = _data.frame[last];
 	_data.world[i.i]    = _data.world[last];
-	_data.aabb[i.i]     = _data.aabb[last];
-	_data.flip_x[i.i]   = _data.flip_x[last];
-	_data.flip_y[i.i]   = _data.flip_y[last];
 	_data.layer[i.i]    = _data.layer[last];
 	_data.depth[i.i]    = _data.depth[last];
+	_data.tiles[i.i]    = _data.tiles[last];
+	_data.chunks[i.i]   = _data.chunks[last];
+	_data.dirty[i.i]    = _data.dirty[last];
 
 	--_data.size;
-	--_data.first_hidden;
 
 	hash_map::set(_map, last_u, i.i);
 	hash_map::remove(_map, u);
 }
 
-bool RenderWorld::SpriteManager::has(UnitId id)
+bool RenderWorld::TilemapManager::has(UnitId id)
 {
-	return is_valid(sprite(id));
+	return is_valid(tilemap(id));
 }
 
-void RenderWorld::SpriteManager::set_visible(SpriteInstance i, bool visible)
+TilemapInstance RenderWorld::TilemapManager::tilemap(UnitId id)
 {
-	u32 swap_index = UINT32_MAX;
-	const UnitId unit = _data.unit[i.i];
+	return make_instance(hash_map::get(_map, id, UINT32_MAX));
+}
 
-	if (visible && i.i >= _data.first_hidden)
-	{
-		const u32 first_hidden = _data.first_hidden;
-		const UnitId first_hidden_unit = _data.unit[first_hidden];
-		hash_map::set(_map, unit, first_hidden);
-		hash_map::set(_map, first_hidden_unit, i.i);
-		swap_index = first_hidden;
-		++_data.first_hidden;
-	}
-	else if (!visible && i.i < _data.first_hidden)
+void RenderWorld::TilemapManager::set_tile(TilemapInstance i, u32 x, u32 y, u32 tile)
+{
+	const TilemapResource* tmr = _data.resource[i.i];
+	CE_ASSERT(x < tmr->width && y < tmr->height, "Tile out of bounds");
+	CE_ASSERT(tile <= tmr->tileset_columns*tmr->tileset_rows, "Tile not in the tileset");
+
+	u16& t = _data.tiles[i.i][y*tmr->width + x];
+	if (t == tile)
+		return;
+
+	t = u16(tile);
+	_data.chunks[i.i][(y/CROWN_TILEMAP_CHUNK_SIZE)*tilemap_num_chunks_x(tmr) + x/CROWN_TILEMAP_CHUNK_SIZE].dirty = true;
+	_data.dirty[i.i] = true;
+}
+
+void RenderWorld::TilemapManager::build_chunk(u32 i, u32 c)
+{
+	const TilemapResource* tmr = _data.resource[i];
+	Chunk& chunk = _data.chunks[i][c];
+
+	if (bgfx::isValid(chunk.vbh))
+		bgfx::destroy(chunk.vbh);
+	chunk.vbh.idx = bgfx::kInvalidHandle;
+	chunk.num_tiles = 0;
+	chunk.dirty = false;
+
+	u32 x0, y0, x1, y1;
+	tilemap_chunk_rect(tmr, c, x0, y0, x1, y1);
+	const u16* tiles = _data.tiles[i];
+
+	u32 num_tiles = 0;
+	for (u32 y = y0; y < y1; ++y)
 	{
-		const u32 last_visible = _data.first_hidden - 1;
-		const UnitId last_visible_unit = _data.unit[last_visible];
-		hash_map::set(_map, unit, last_visible);
-		hash_map::set(_map, last_visible_unit, i.i);
-		swap_index = last_visible;
-		--_data.first_hidden;
+		for (u32 x = x0; x < x1; ++x)
+			num_tiles += tiles[y*tmr->width + x] != 0;
 	}
 
-	if (swap_index != UINT32_MAX)
+	if (num_tiles == 0)
+		return;
+
+	// Same layout as the sprites, four vertices per tile
+	const bgfx::Memory* mem = bgfx::alloc(num_tiles*4*5*sizeof(f32));
+	f32* vdata = (f32*)mem->data;
+	const f32 ts = tmr->tile_size;
+	const f32 du = 1.0f / f32(tmr->tileset_columns);
+	const f32 dv = 1.0f / f32(tmr->tileset_rows);
+
+	for (u32 y = y0; y < y1; ++y)
 	{
-		std::swap(_data.unit[i.i], _data.unit[swap_index]);
-		std::swap(_data.resource[i.i], _data.resource[swap_index]);
-		std::swap(_data.material[i.i], _data.material[swap_index]);
-		std::swap(_data.frame[i.i], _data.frame[swap_index]);
-		std::swap(_data.world[i.i], _data.world[swap_index]);
-		std::swap(_data.aabb[i.i], _data.aabb[swap_index]);
-		std::swap(_data.flip_x[i.i], _data.flip_x[swap_index]);
-		std::swap(_data.flip_y[i.i], _data.flip_y[swap_index]);
-		std::swap(_data.layer[i.i], _data.layer[swap_index]);
-		std::swap(_data.depth[i.i], _data.depth[swap_index]);
+		for (u32 x = x0; x < x1; ++x)
+		{
+			const u32 tile = tiles[y*tmr->width + x];
+			if (tile == 0)
+				continue;
+
+			const f32 u0 = f32((tile - 1) % tmr->tileset_columns) * du;
+			const f32 v0 = f32((tile - 1) / tmr->tileset_columns) * dv;
+			const f32 px0 = f32(x)*ts;
+			const f32 px1 = px0 + ts;
+			const f32 pz0 = -f32(y + 1)*ts; // Bottom of the tile
+			const f32 pz1 = pz0 + ts;
+
+			const f32 quad[] =
+			{
+				px0, 0.0f, pz0, u0,      v0 + dv,
+				px1, 0.0f, pz0, u0 + du, v0 + dv,
+				px1, 0.0f, pz1, u0 + du, v0,
+				px0, 0.0f, pz1, u0,      v0
+			};
+			memcpy(vdata, quad, sizeof(quad));
+			vdata += countof(quad);
+		}
 	}
+
+	chunk.vbh = bgfx::createVertexBuffer(mem, sprite_vertex_decl());
+	chunk.num_tiles = num_tiles;
 }
 
-SpriteInstance RenderWorld::SpriteManager::sprite(UnitId id)
+void RenderWorld::TilemapManager::update_chunks()
 {
-	return make_instance(hash_map::get(_map, id, UINT32_MAX));
+	for (u32 i = 0; i < _data.size; ++i)
+	{
+		if (!_data.dirty[i])
+			continue;
+
+		const TilemapResource* tmr = _data.resource[i];
+		const u32 num_chunks = tilemap_num_chunks_x(tmr) * tilemap_num_chunks_y(tmr);
+		for (u32 c = 0; c < num_chunks; ++c)
+		{
+			if (_data.chunks[i][c].dirty)
+				build_chunk(i, c);
+		}
+
+		_data.dirty[i] = false;
+	}
 }
 
-void RenderWorld::SpriteManager::destroy()
+void RenderWorld::TilemapManager::destroy()
 {
+	for (u32 i = 0; i < _data.size; ++i)
+	{
+		const TilemapResource* tmr = _data.resource[i];
+		const u32 num_chunks = tilemap_num_chunks_x(tmr) * tilemap_num_chunks_y(tmr);
+		for (u32 c = 0; c < num_chunks; ++c)
+		{
+			if (bgfx::isValid(_data.chunks[i][c].vbh))
+				bgfx::destroy(_data.chunks[i][c].vbh);
+		}
+		_allocator->deallocate(_data.chunks[i]);
+	}
+
 	_allocator->deallocate(_data.buffer);
 }
 
-void RenderWorld::LightManager::allocate(u32 num)
+void RenderWorld::ParticleManager::allocate(u32 num)
 {
-	CE_ENSURE(num > _data.size);
+	CE_ENSURE(num >= _data.size);
 
 	const u32 bytes = 0
 		+ num*sizeof(UnitId) + alignof(UnitId)
+		+ num*sizeof(ParticleResource*) + alignof(ParticleResource*)
+		+ num*sizeof(StringId64) + alignof(StringId64)
 		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
+		+ num*sizeof(bool) + alignof(bool)
 		+ num*sizeof(f32) + alignof(f32)
-		+ num*sizeof(f32) + alignof(f32)
-		+ num*sizeof(f32) + alignof(f32)
-		+ num*sizeof(Color4) + alignof(Color4)
 		+ num*sizeof(u32) + alignof(u32)
+		+ num*sizeof(f32*) + alignof(f32*)
+		+ num*sizeof(AABB) + alignof(AABB)
+		+ num*sizeof(Pcg32) + alignof(Pcg32)
 		;
 
-	LightInstanceData new_data;
+	ParticleInstanceData new_data;
 	new_data.size = _data.size;
 	new_data.capacity = num;
 	new_data.buffer = _allocator->allocate(bytes);
 
-	new_data.unit       = (UnitId*   )new_data.buffer;
-	new_data.world      = (Matrix4x4*)memory::align_top(new_data.unit + num,       alignof(Matrix4x4));
-	new_data.range      = (f32*      )memory::align_top(new_data.world + num,      alignof(f32      ));
-	new_data.intensity  = (f32*      )memory::align_top(new_data.range + num,      alignof(f32      ));
-	new_data.spot_angle = (f32*      )memory::align_top(new_data.intensity + num,  alignof(f32      ));
-	new_data.color      = (Color4*   )memory::align_top(new_data.spot_angle + num, alignof(Color4   ));
-	new_data.type       = (u32*      )memory::align_top(new_data.color + num,      alignof(u32      ));
+	new_data.unit      = (UnitId*                 )new_data.buffer;
+	new_data.resource  = (const ParticleResource**)memory::align_top(new_data.unit + num,      alignof(ParticleResource*));
+	new_data.material  = (StringId64*             )memory::align_top(new_data.resource + num,  alignof(StringId64       ));
+	new_data.world     = (Matrix4x4*              )memory::align_top(new_data.material + num,  alignof(Matrix4x4        ));
+	new_data.playing   = (bool*                   )memory::align_top(new_data.world + num,     alignof(bool             ));
+	new_data.spawn     = (f32*                    )memory::align_top(new_data.playing + num,   alignof(f32              ));
+	new_data.num       = (u32*                    )memory::align_top(new_data.spawn + num,     alignof(u32              ));
+	new_data.particles = (f32**                   )memory::align_top(new_data.num + num,       alignof(f32*             ));
+	new_data.aabb      = (AABB*                   )memory::align_top(new_data.particles + num, alignof(AABB             ));
+	new_data.random    = (Pcg32*                  )memory::align_top(new_data.aabb + num,      alignof(Pcg32            ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
+	memcpy(new_data.resource, _data.resource, _data.size * sizeof(ParticleResource*));
+	memcpy(new_data.material, _data.material, _data.size * sizeof(StringId64));
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
-	memcpy(new_data.range, _data.range, _data.size * sizeof(f32));
-	memcpy(new_data.intensity, _data.intensity, _data.size * sizeof(f32));
-	memcpy(new_data.spot_angle, _data.spot_angle, _data.size * sizeof(f32));
-	memcpy(new_data.color, _data.color, _data.size * sizeof(Color4));
-	memcpy(new_data.type, _data.type, _data.size * sizeof(u32));
+	memcpy(new_data.playing, _data.playing, _data.size * sizeof(bool));
+	memcpy(new_data.spawn, _data.spawn, _data.size * sizeof(f32));
+	memcpy(new_data.num, _data.num, _data.size * sizeof(u32));
+	memcpy(new_data.particles, _data.particles, _data.size * sizeof(f32*));
+	memcpy(new_data.aabb, _data.aabb, _data.size * sizeof(AABB));
+	memcpy(new_data.random, _data.random, _data.size * sizeof(Pcg32));
 
 	_allocator->deallocate(_data.buffer);
 	_data = new_data;
 }
 
-void RenderWorld::LightManager::grow()
+void RenderWorld::ParticleManager::grow()
 {
 	allocate(_data.capacity * 2 + 1);
 }
 
-LightInstance RenderWorld::LightManager::create(UnitId id, const LightDesc& ld, const Matrix4x4& tr)
+ParticleInstance RenderWorld::ParticleManager::create(UnitId id, const ParticleResource* pr, StringId64 material, bool playing, const Matrix4x4& tr)
 {
-	CE_ASSERT(!hash_map::has(_map, id), "Unit already has light");
+	CE_ASSERT(!hash_map::has(_map, id), "Unit already has particle emitter");
 
 	if (_data.size == _data.capacity)
 		grow();
 
 	const u32 last = _data.size;
-
-	_data.unit[last]       = id;
-	_data.world[last]      = tr;
-	_data.range[last]      = ld.range;
-	_data.intensity[last]  = ld.intensity;
-	_data.spot_angle[last] = ld.spot_angle;
-	_data.color[last]      = vector4(ld.color.x, ld.color.y, ld.color.z, 1.0f);
-	_data.type[last]       = ld.type;
+	const u32 bytes = COUNT*particle_stride(pr)*sizeof(f32);
+
+	_data.unit[last]      = id;
+	_data.resource[last]  = pr;
+	_data.material[last]  = material;
+	_data.world[last]     = tr;
+	_data.playing[last]   = playing;
+	_data.spawn[last]     = 0.0f;
+	_data.num[last]       = 0;
+	_data.particles[last] = (f32*)_allocator->allocate(bytes, 16);
+	_data.aabb[last].min  = translation(tr);
+	_data.aabb[last].max  = translation(tr);
+	_data.random[last]    = Pcg32(id._idx);
+	memset(_data.particles[last], 0, bytes);
 
 	++_data.size;
 
@@ -973,7 +3901,7 @@ LightInstance RenderWorld::LightManager::create(UnitId id, const LightDesc& ld,
 	return make_instance(last);
 }
 
-void RenderWorld::LightManager::destroy(LightInstance i)
+void RenderWorld::ParticleManager::destroy(ParticleInstance i)
 {
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
 
@@ -981,13 +3909,19 @@ void RenderWorld::LightManager::destroy(LightInstance i)
 	const UnitId u      = _data.unit[i.i];
 	const UnitId last_u = _data.unit[last];
 
-	_data.unit[i.i]       = _data.unit[last];
-	_data.world[i.i]      = _data.world[last];
-	_data.range[i.i]      = _data.range[last];
-	_data.intensity[i.i]  = _data.intensity[last];
-	_data.spot_angle[i.i] = _data.spot_angle[last];
-	_data.color[i.i]      = _data.color[last];
-	_data.type[i.i]       = _data.type[last];
+	_num_particles -= _data.num[i.i];
+	_allocator->deallocate(_data.particles[i.i]);
+
+	_data.unit[i.i]      = _data.unit[last];
+	_data.resource[i.i]  = _data.resource[last];
+	_data.material[i.i]  = _data.material[last];
+	_data.world[i.i]     = _data.world[last];
+	_data.playing[i.i]   = _data.playing[last];
+	_data.spawn[i.i]     = _data.spawn[last];
+	_data.num[i.i]       = _data.num[last];
+	_data.particles[i.i] = _data.particles[last];
+	_data.aabb[i.i]      = _data.aabb[last];
+	_data.random[i.i]    = _data.random[last];
 
 	--_data.size;
 
@@ -995,56 +3929,170 @@ void RenderWorld::LightManager::destroy(LightInstance i)
 	hash_map::remove(_map, u);
 }
 
-bool RenderWorld::LightManager::has(UnitId id)
+bool RenderWorld::ParticleManager::has(UnitId id)
 {
-	return is_valid(light(id));
+	return is_valid(particle(id));
 }
 
-LightInstance RenderWorld::LightManager::light(UnitId id)
+ParticleInstance RenderWorld::ParticleManager::particle(UnitId id)
 {
 	return make_instance(hash_map::get(_map, id, UINT32_MAX));
 }
 
-void RenderWorld::LightManager::destroy()
+void RenderWorld::ParticleManager::simulate(u32 i, f32 dt)
 {
-	_allocator->deallocate(_data.buffer);
-}
+	const ParticleResource* pr = _data.resource[i];
+	const u32 stride = particle_stride(pr);
+	f32* s[COUNT];
+	for (u32 k = 0; k < COUNT; ++k)
+		s[k] = _data.particles[i] + k*stride;
+
+	// Kill the particles which reach the end of their lifetime by moving
+	// the last particle in their place
+	u32 num = _data.num[i];
+	for (u32 j = 0; j < num;)
+	{
+		if (s[AGE][j] + dt < s[LIFETIME][j])
+		{
+			++j;
+			continue;
+		}
 
-void RenderWorld::LightManager::debug_draw(u32 start_index, u32 num, DebugLine& dl)
-{
-	for (u32 i = start_index; i < start_index + num; ++i)
+		--num;
+		for (u32 k = 0; k < COUNT; ++k)
+			s[k][j] = s[k][num];
+	}
+
+	// Spawn the particles due, the ones which do not fit are dropped
+	if (_data.playing[i])
+		_data.spawn[i] += pr->spawn_rate*dt;
+
+	const u32 num_due = u32(_data.spawn[i]);
+	const u32 num_spawn = num_due < pr->max_particles - num ? num_due : pr->max_particles - num;
+	_data.spawn[i] -= f32(num_due);
+
+	const Matrix4x4& tm = _data.world[i];
+	const Vector3 origin = translation(tm);
+	Vector3 ax = x(tm);
+	Vector3 ay = y(tm);
+	Vector3 az = z(tm);
+	normalize(ax);
+	normalize(ay);
+	normalize(az);
+
+	Pcg32& r = _data.random[i];
+	const Vector3& e = pr->spawn_extents;
+	for (u32 n = 0; n < num_spawn; ++n, ++num)
 	{
-		const Vector3 pos = translation(_data.world[i]);
-		const Vector3 dir = -z(_data.world[i]);
+		const Vector3 p = origin
+			+ ax*r.range(-e.x, e.x)
+			+ ay*r.range(-e.y, e.y)
+			+ az*r.range(-e.z, e.z)
+			;
+		const Vector3 v = ax*r.range(pr->velocity_min.x, pr->velocity_max.x)
+			+ ay*r.range(pr->velocity_min.y, pr->velocity_max.y)
+			+ az*r.range(pr->velocity_min.z, pr->velocity_max.z)
+			;
 
-		switch (_data.type[i])
-		{
-		case LightType::DIRECTIONAL:
-			{
-				const Vector3 end = pos + dir*3.0f;
-				dl.add_line(pos, end, COLOR4_YELLOW);
-				dl.add_cone(pos + dir*2.8f, end, 0.1f, COLOR4_YELLOW);
-			}
-			break;
+		s[PX][num] = p.x;
+		s[PY][num] = p.y;
+		s[PZ][num] = p.z;
+		s[VX][num] = v.x;
+		s[VY][num] = v.y;
+		s[VZ][num] = v.z;
+		s[AGE][num] = 0.0f;
+		s[LIFETIME][num] = r.range(pr->lifetime_min, pr->lifetime_max);
+	}
 
-		case LightType::OMNI:
-			dl.add_sphere(pos, _data.range[i], COLOR4_YELLOW);
-			break;
+	_data.num[i] = num;
 
-		case LightType::SPOT:
-			{
-				const f32 angle  = _data.spot_angle[i];
-				const f32 range  = _data.range[i];
-				const f32 radius = ftan(angle)*range;
-				dl.add_cone(pos + range*dir, pos, radius, COLOR4_YELLOW);
-			}
-			break;
+	if (num == 0)
+	{
+		_data.aabb[i].min = origin;
+		_data.aabb[i].max = origin;
+		return;
+	}
 
-		default:
-			CE_FATAL("Unknown light type");
-			break;
-		}
+	// Integrate four particles at a time. Streams are padded to a
+	// multiple of four, the lanes past the last particle are don't care.
+	const f32 damping = 1.0f - pr->drag*dt;
+	const simd::Float4 k  = simd::splat(damping > 0.0f ? damping : 0.0f);
+	const simd::Float4 t  = simd::splat(dt);
+	const simd::Float4 gx = simd::splat(pr->gravity.x*dt);
+	const simd::Float4 gy = simd::splat(pr->gravity.y*dt);
+	const simd::Float4 gz = simd::splat(pr->gravity.z*dt);
+
+	for (u32 j = 0; j < num; j += 4)
+	{
+		const simd::Float4 vx = simd::madd(simd::load(s[VX] + j), k, gx);
+		const simd::Float4 vy = simd::madd(simd::load(s[VY] + j), k, gy);
+		const simd::Float4 vz = simd::madd(simd::load(s[VZ] + j), k, gz);
+		simd::store(s[VX] + j, vx);
+		simd::store(s[VY] + j, vy);
+		simd::store(s[VZ] + j, vz);
+		simd::store(s[PX] + j, simd::madd(vx, t, simd::load(s[PX] + j)));
+		simd::store(s[PY] + j, simd::madd(vy, t, simd::load(s[PY] + j)));
+		simd::store(s[PZ] + j, simd::madd(vz, t, simd::load(s[PZ] + j)));
+		simd::store(s[AGE] + j, simd::add(simd::load(s[AGE] + j), t));
+	}
+
+	// Bounding box of the particles, without the padding lanes
+	simd::Float4 min_x = simd::splat(s[PX][0]);
+	simd::Float4 min_y = simd::splat(s[PY][0]);
+	simd::Float4 min_z = simd::splat(s[PZ][0]);
+	simd::Float4 max_x = min_x;
+	simd::Float4 max_y = min_y;
+	simd::Float4 max_z = min_z;
+
+	u32 j = 0;
+	for (; j + 4 <= num; j += 4)
+	{
+		const simd::Float4 px = simd::load(s[PX] + j);
+		const simd::Float4 py = simd::load(s[PY] + j);
+		const simd::Float4 pz = simd::load(s[PZ] + j);
+		min_x = simd::min(min_x, px);
+		min_y = simd::min(min_y, py);
+		min_z = simd::min(min_z, pz);
+		max_x = simd::max(max_x, px);
+		max_y = simd::max(max_y, py);
+		max_z = simd::max(max_z, pz);
+	}
+
+	f32 lanes[6][4];
+	simd::store(lanes[0], min_x);
+	simd::store(lanes[1], min_y);
+	simd::store(lanes[2], min_z);
+	simd::store(lanes[3], max_x);
+	simd::store(lanes[4], max_y);
+	simd::store(lanes[5], max_z);
+
+	AABB& b = _data.aabb[i];
+	b.min = vector3(lanes[0][0], lanes[1][0], lanes[2][0]);
+	b.max = vector3(lanes[3][0], lanes[4][0], lanes[5][0]);
+	for (u32 l = 1; l < 4; ++l)
+	{
+		b.min = min(b.min, vector3(lanes[0][l], lanes[1][l], lanes[2][l]));
+		b.max = max(b.max, vector3(lanes[3][l], lanes[4][l], lanes[5][l]));
 	}
+	for (; j < num; ++j)
+	{
+		const Vector3 p = vector3(s[PX][j], s[PY][j], s[PZ][j]);
+		b.min = min(b.min, p);
+		b.max = max(b.max, p);
+	}
+
+	// Grow by the largest quad so that particles are not culled too early
+	const f32 size = pr->size_start > pr->size_end ? pr->size_start : pr->size_end;
+	b.min -= vector3(size, size, size);
+	b.max += vector3(size, size, size);
+}
+
+void RenderWorld::ParticleManager::destroy()
+{
+	for (u32 i = 0; i < _data.size; ++i)
+		_allocator->deallocate(_data.particles[i]);
+
+	_allocator->deallocate(_data.buffer);
 }
 
 } // namespace crown
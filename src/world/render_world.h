@@ -5,11 +5,15 @@
 
 #pragma once
 
+#include "config.h"
 #include "core/containers/types.h"
+#include "core/math/aabb_tree.h"
+#include "core/math/random.h"
 #include "core/math/types.h"
 #include "core/strings/string_id.h"
 #include "resource/mesh_resource.h"
 #include "resource/types.h"
+#include "world/render_queue.h"
 #include "world/types.h"
 #include <bgfx/bgfx.h>
 
@@ -21,14 +25,29 @@ namespace crown
 struct RenderWorld
 {
 	///
-	RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, UnitManager& um);
+	RenderWorld(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, TextureManager& tm, UnitManager& um);
 
 	///
 	~RenderWorld();
 
+	/// Makes room for @a num_meshes, @a num_sprites and @a num_lights more instances.
+	void reserve(u32 num_meshes, u32 num_sprites, u32 num_lights);
+
+	/// Frees the memory of the mesh, sprite and light instances which have
+	/// been destroyed.
+	void shrink_to_fit();
+
 	/// Creates a new mesh instance.
 	MeshInstance mesh_create(UnitId id, const MeshRendererDesc& mrd, const Matrix4x4& tr);
 
+	/// Creates a mesh instance for each of the @a num @a units, with the
+	/// corresponding transform in @a tr.
+	void mesh_create(const UnitId* units, const Matrix4x4* tr, u32 num, const MeshRendererDesc& mrd);
+
+	/// Like mesh_create() but uses the geometry @a mg of the already
+	/// resolved @a mr, and the @a material which must already exist.
+	void mesh_create(const UnitId* units, const Matrix4x4* tr, u32 num, const MeshResource* mr, const MeshGeometry* mg, StringId64 material);
+
 	/// Destroys the mesh @a i.
 	void mesh_destroy(MeshInstance i);
 
@@ -48,9 +67,48 @@ struct RenderWorld
 	/// or -1.0 if no intersection.
 	f32 mesh_cast_ray(MeshInstance i, const Vector3& from, const Vector3& dir);
 
+	/// Appends to @a instances the meshes whose bounding box overlaps the box @a b.
+	void mesh_query_aabb(const AABB& b, Array<MeshInstance>& instances);
+
+	/// Appends to @a instances the meshes whose bounding box intersects the frustum @a f.
+	void mesh_query_frustum(const Frustum& f, Array<MeshInstance>& instances);
+
+	/// Casts the @a num rays (@a from[i], @a dir[i]) against all the meshes
+	/// and fills @a hits[i] with the nearest mesh hit by each of them.
+	void mesh_cast_rays(const Vector3* from, const Vector3* dir, u32 num, RenderRaycastHit* hits);
+
+	/// Returns the number of mesh instances.
+	u32 mesh_num() const;
+
+	/// Sets the skin matrices of the meshes of each of the @a num @a units
+	/// to the ones starting at the corresponding offset in @a offsets in
+	/// the @a num_matrices @a matrices, which replace the ones of the
+	/// previous update. The skin matrices transform from the model-space
+	/// of the bind pose to the model-space of the animated pose. They are
+	/// uploaded to the skin palette once, by the next render().
+	void skin_update(const UnitId* units, const u32* offsets, u32 num, const Matrix4x4* matrices, u32 num_matrices);
+
+	/// Returns the units of the mesh instances, mesh_num() in total. The
+	/// mesh at index i is the MeshInstance { i }.
+	/// The returned pointers, and the indices of the meshes, are only valid
+	/// until the next mesh is created, destroyed, shown or hidden.
+	const UnitId* mesh_units() const;
+
+	/// Returns the world poses of the mesh instances, mesh_num() in total.
+	/// @copydetails RenderWorld::mesh_units()
+	const Matrix4x4* mesh_world_poses() const;
+
 	/// Creates a new sprite instance.
 	SpriteInstance sprite_create(UnitId id, const SpriteRendererDesc& srd, const Matrix4x4& tr);
 
+	/// Creates a sprite instance for each of the @a num @a units, with the
+	/// corresponding transform in @a tr.
+	void sprite_create(const UnitId* units, const Matrix4x4* tr, u32 num, const SpriteRendererDesc& srd);
+
+	/// Like sprite_create() but uses the already resolved @a sr, and the
+	/// @a material which must already exist.
+	void sprite_create(const UnitId* units, const Matrix4x4* tr, u32 num, const SpriteResource* sr, StringId64 material, u32 layer, u32 depth);
+
 	/// Destroys the sprite of the @a unit.
 	void sprite_destroy(UnitId unit, SpriteInstance i);
 
@@ -63,9 +121,17 @@ struct RenderWorld
 	/// Sets the frame @a index of the sprite.
 	void sprite_set_frame(UnitId unit, u32 index);
 
+	/// Sets the frame of each of the @a num sprites of @a units to the
+	/// corresponding frame in @a indices.
+	void sprite_set_frames(const UnitId* units, const u32* indices, u32 num);
+
 	/// Sets whether the sprite is @a visible.
 	void sprite_set_visible(UnitId unit, bool visible);
 
+	/// Sets whether each of the @a num sprites of @a units is visible
+	/// according to the corresponding value in @a visible.
+	void sprite_set_visibilities(const UnitId* units, const bool* visible, u32 num);
+
 	/// Sets whether to flip the sprite on the x-axis.
 	void sprite_flip_x(UnitId unit, bool flip);
 
@@ -78,6 +144,23 @@ struct RenderWorld
 	/// Sets the depth of the sprite.
 	void sprite_set_depth(UnitId unit, u32 depth);
 
+	/// Loops the sprite through the @a num_frames frames starting at
+	/// @a first_frame, at @a fps frames per second from @a start_time, as
+	/// returned by time(). The frame is picked in the vertex shader, so the
+	/// sprite costs nothing on the CPU while it does not move. A
+	/// @a num_frames of 0 stops the loop and draws the frame set with
+	/// sprite_set_frame() again.
+	///
+	/// Looping sprites are drawn with the core sprite_loop shader and the
+	/// textures and uniforms of their material.
+	void sprite_set_loop(UnitId unit, u32 first_frame, u32 num_frames, f32 fps, f32 start_time);
+
+	/// Advances the time used by the looping sprites by @a dt.
+	void update_time(f32 dt);
+
+	/// Returns the time used by the looping sprites.
+	f32 time() const;
+
 	/// Returns the OBB of the sprite.
 	OBB sprite_obb(UnitId unit);
 
@@ -85,6 +168,31 @@ struct RenderWorld
 	/// or -1.0 if no intersection.
 	f32 sprite_cast_ray(UnitId unit, const Vector3& from, const Vector3& dir, u32& layer, u32& depth);
 
+	/// Appends to @a units the units whose sprite's bounding box overlaps the box @a b.
+	void sprite_query_aabb(const AABB& b, Array<UnitId>& units);
+
+	/// Appends to @a units the units whose sprite's bounding box intersects the frustum @a f.
+	void sprite_query_frustum(const Frustum& f, Array<UnitId>& units);
+
+	/// Casts the @a num rays (@a from[i], @a dir[i]) against all the sprites
+	/// and fills @a hits[i] with the topmost sprite hit by each of them:
+	/// the one in the highest layer, then with the highest depth, then
+	/// the nearest.
+	void sprite_cast_rays(const Vector3* from, const Vector3* dir, u32 num, RenderRaycastHit* hits);
+
+	/// Returns the number of sprite instances.
+	u32 sprite_num() const;
+
+	/// Returns the units of the sprite instances, sprite_num() in total.
+	/// The sprite at index i is the SpriteInstance { i }.
+	/// The returned pointers, and the indices of the sprites, are only
+	/// valid until the next sprite is created, destroyed, shown or hidden.
+	const UnitId* sprite_units() const;
+
+	/// Returns the world poses of the sprite instances, sprite_num() in total.
+	/// @copydetails RenderWorld::sprite_units()
+	const Matrix4x4* sprite_world_poses() const;
+
 	/// Creates a new light instance.
 	LightInstance light_create(UnitId unit, const LightDesc& ld, const Matrix4x4& tr);
 
@@ -109,6 +217,9 @@ struct RenderWorld
 	/// Returns the spot angle of the light.
 	f32 light_spot_angle(UnitId unit);
 
+	/// Returns whether the light casts shadows.
+	bool light_cast_shadows(UnitId unit);
+
 	/// Sets the @a type of the light.
 	void light_set_type(UnitId unit, LightType::Enum type);
 
@@ -124,12 +235,119 @@ struct RenderWorld
 	/// Sets the spot @a angle of the light.
 	void light_set_spot_angle(UnitId unit, f32 angle);
 
+	/// Sets whether the light casts shadows.
+	void light_set_cast_shadows(UnitId unit, bool cast_shadows);
+
 	/// Fills @a dl with debug lines from the light.
 	void light_debug_draw(UnitId unit, DebugLine& dl);
 
+	/// Creates a new particle emitter instance.
+	ParticleInstance particle_create(UnitId unit, const ParticleEmitterDesc& ped, const Matrix4x4& tr);
+
+	/// Destroys the particle emitter and its particles.
+	void particle_destroy(UnitId unit, ParticleInstance i);
+
+	/// Returns the particle emitter of the @a unit.
+	ParticleInstance particle_instance(UnitId unit);
+
+	/// Starts spawning particles at the rate of the emitter.
+	void particle_play(UnitId unit);
+
+	/// Stops spawning particles. The particles alive keep moving until
+	/// the end of their lifetime.
+	void particle_stop(UnitId unit);
+
+	/// Returns whether the emitter is spawning particles.
+	bool particle_is_playing(UnitId unit);
+
+	/// Spawns @a num particles at once, whether the emitter is playing or not.
+	void particle_burst(UnitId unit, u32 num);
+
+	/// Returns the number of particles alive in the emitter.
+	u32 particle_num(UnitId unit);
+
+	/// Creates a new tilemap instance.
+	TilemapInstance tilemap_create(UnitId unit, const TilemapDesc& td, const Matrix4x4& tr);
+
+	/// Destroys the tilemap.
+	void tilemap_destroy(UnitId unit, TilemapInstance i);
+
+	/// Returns the tilemap of the @a unit.
+	TilemapInstance tilemap_instance(UnitId unit);
+
+	/// Returns the number of tiles of the tilemap along x and z.
+	void tilemap_size(UnitId unit, u32& width, u32& height);
+
+	/// Returns the tile at column @a x and row @a y of the tilemap, 0 if
+	/// the cell is empty.
+	u32 tilemap_tile(UnitId unit, u32 x, u32 y);
+
+	/// Sets the @a tile at column @a x and row @a y of the tilemap, 0 to
+	/// empty the cell. Only the chunk containing the cell is rebuilt, by
+	/// the next render().
+	void tilemap_set_tile(UnitId unit, u32 x, u32 y, u32 tile);
+
+	/// Kills, spawns and moves the particles of all the emitters by @a dt
+	/// seconds. Emitters are simulated on the job threads when there are
+	/// at least CROWN_PARTICLE_MIN_JOB_SIZE particles in total.
+	void update_particles(f32 dt);
+
 	void update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world);
 
-	void render(const Matrix4x4& view);
+	/// Renders the meshes, the sprites, the tilemaps and the particles
+	/// inside the frustum of the camera with the given @a view and @a proj
+	/// matrices.
+	void render(const Matrix4x4& view, const Matrix4x4& proj);
+
+	/// Renders the meshes and the sprites as seen by @a num cameras with
+	/// the given @a views and @a projs matrices. The cameras are culled in
+	/// parallel and share the lods, the skin matrices and the shadow maps.
+	/// Camera i is drawn into the views starting at VIEW_SPRITE_0 + i*VIEW_CAMERA_NUM.
+	void render(const Matrix4x4* views, const Matrix4x4* projs, u32 num);
+
+	/// Renders the shadow maps of the lights casting shadows inside the
+	/// frustum of the camera with the given @a view and @a proj matrices.
+	/// The shadow maps of the previous frames are reused unless the light
+	/// or a mesh inside its volume has changed since.
+	/// Returns whether any light casts shadows.
+	bool update_shadows(const Matrix4x4& view, const Matrix4x4& proj);
+
+	/// Binds the shadow atlas and the cascades to the render queue for the
+	/// camera with the given @a view matrix. The cascade matrices are
+	/// written to @a cascades, which must stay valid until the queue is submitted.
+	void set_shadows(const Matrix4x4& view, Matrix4x4* cascades);
+
+	/// Notifies that the meshes inside the box @a b have changed, so that
+	/// the shadow maps overlapping it have to be rendered again.
+	void add_shadow_change(const AABB& b);
+
+	/// Assigns the lights to the clusters of the frustum of the camera
+	/// with the given @a view and @a proj matrices and uploads them to
+	/// the light textures of the @a camera.
+	void update_lights(const Matrix4x4& view, const Matrix4x4& proj, u32 camera);
+
+	/// Sets the @a bias applied to the projected size of the meshes when
+	/// picking their lods. Values above 1 keep the finer lods further away
+	/// from the camera, values below 1 switch to the coarser lods sooner.
+	void set_mesh_lod_bias(f32 bias);
+
+	/// Returns the bias applied to the projected size of the meshes when
+	/// picking their lods.
+	f32 mesh_lod_bias() const;
+
+	/// Picks the lod of each of the @a num visible @a meshes from its
+	/// size projected by the camera with the given @a view and @a proj matrices.
+	void update_mesh_lods(const u32* meshes, u32 num, const Matrix4x4& view, const Matrix4x4& proj);
+
+	/// Removes from @a meshes the ones hidden in the occlusion buffer.
+	void cull_occluded(Array<u32>& meshes);
+
+	/// Sets the occlusion buffer @a ob used to skip the meshes hidden behind
+	/// others, or NULL to disable occlusion culling.
+	void set_occlusion_buffer(const OcclusionBuffer* ob);
+
+	/// Hints the @a distance of the textures of @a material to the camera.
+	void set_textures_distance(StringId64 material, f32 distance);
 
 	/// Sets whether to @a enable debug drawing
 	void enable_debug_drawing(bool enable);
@@ -137,6 +355,20 @@ struct RenderWorld
 	/// Fills @a dl with debug lines
 	void debug_draw(DebugLine& dl);
 
+	/// Returns the statistics of the last frame rendered.
+	const RenderStats& stats() const;
+
+	/// Appends the frames of the sprites and the parameters of the lights
+	/// to @a buf. Transforms are restored through the SceneGraph.
+	void snapshot(Buffer& buf);
+
+	/// Returns whether the state at @a data, written by snapshot(), has
+	/// sprites and lights for the same units as this.
+	bool can_restore(const char* data);
+
+	/// Restores the state at @a data, written by snapshot().
+	void restore(const char* data);
+
 	void unit_destroyed_callback(UnitId id);
 
 	struct MeshManager
@@ -145,6 +377,7 @@ struct RenderWorld
 		{
 			bgfx::VertexBufferHandle vbh;
 			bgfx::IndexBufferHandle ibh;
+			u32 lod; ///< 0 for the geometry itself, i for its lod i-1.
 		};
 
 		struct MeshInstanceData
@@ -163,21 +396,27 @@ struct RenderWorld
 			Matrix4x4* world;
 			OBB* obb;
 			MeshInstance* next_instance;
+			u32* leaf;
+			u32* skin; ///< Offset of the bones in the skin palette, UINT32_MAX if not skinned.
 		};
 
 		Allocator* _allocator;
 		HashMap<UnitId, u32> _map;
 		MeshInstanceData _data;
+		AABBTree _tree;
 
 		MeshManager(Allocator& a)
 			: _allocator(&a)
 			, _map(a)
+			, _tree(a)
 		{
 			memset(&_data, 0, sizeof(_data));
 		}
 
 		void allocate(u32 num);
 		void grow();
+		void reserve(u32 num);
+		void shrink_to_fit();
 		MeshInstance create(UnitId id, const MeshResource* mr, const MeshGeometry* mg, StringId64 material, const Matrix4x4& tr);
 		void destroy(MeshInstance i);
 		bool has(UnitId id);
@@ -194,6 +433,15 @@ struct RenderWorld
 
 	struct SpriteManager
 	{
+		struct SpriteLoop
+		{
+			u32 first_frame;
+			u32 num_frames; ///< 0 if the sprite does not loop.
+			f32 fps;
+			f32 start_time;
+			u32 slot;       ///< Position in _loop_sprites.
+		};
+
 		struct SpriteInstanceData
 		{
 			u32 size;
@@ -212,17 +460,40 @@ struct RenderWorld
 			bool* flip_y;
 			u32* layer;
 			u32* depth;
+			u32* leaf;
+			SpriteLoop* loop;
 		};
 
 		Allocator* _allocator;
 		HashMap<UnitId, u32> _map;
 		SpriteInstanceData _data;
+		AABBTree _tree;
+		Array<u32> _dirty; ///< Instances whose vertices need to be rewritten.
+		bgfx::DynamicVertexBufferHandle _vertex_buffer; ///< Four vertices for each instance.
+		u32 _vertex_buffer_capacity;
+
+		u32 _num_loops;                  ///< Instances which loop, visible or not.
+		bool _loops_dirty;               ///< Whether the loop vertices have to be rewritten.
+		Array<u32> _loop_sprites;        ///< Visible looping instances, sorted by layer, depth and material.
+		Array<u32> _loop_first_vertex;   ///< First vertex of each of _loop_sprites, and the end of the last.
+		bgfx::DynamicVertexBufferHandle _loop_vertex_buffer; ///< Four world-space vertices for each frame of _loop_sprites.
+		u32 _loop_vertex_buffer_capacity;
 
 		SpriteManager(Allocator& a)
 			: _allocator(&a)
 			, _map(a)
+			, _tree(a)
+			, _dirty(a)
+			, _vertex_buffer_capacity(0)
+			, _num_loops(0)
+			, _loops_dirty(false)
+			, _loop_sprites(a)
+			, _loop_first_vertex(a)
+			, _loop_vertex_buffer_capacity(0)
 		{
 			memset(&_data, 0, sizeof(_data));
+			_vertex_buffer.idx = bgfx::kInvalidHandle;
+			_loop_vertex_buffer.idx = bgfx::kInvalidHandle;
 		}
 
 		SpriteInstance create(UnitId id, const SpriteResource* sr, StringId64 material, u32 layer, u32 depth, const Matrix4x4& tr);
@@ -230,8 +501,15 @@ struct RenderWorld
 		bool has(UnitId id);
 		void set_visible(SpriteInstance i, bool visible);
 		SpriteInstance sprite(UnitId id);
+		void set_frame(SpriteInstance i, u32 frame);
+		void set_flip(SpriteInstance i, bool flip_x, bool flip_y);
+		void set_loop(SpriteInstance i, u32 first_frame, u32 num_frames, f32 fps, f32 start_time);
+		void update_vertices();
+		void update_loop_vertices();
 		void allocate(u32 num);
 		void grow();
+		void reserve(u32 num);
+		void shrink_to_fit();
 		void destroy();
 
 		SpriteInstance make_instance(u32 i) { SpriteInstance inst = { i }; return inst; }
@@ -252,15 +530,20 @@ struct RenderWorld
 			f32* spot_angle;
 			Color4* color;
 			u32* type; // LightType::Enum
+			bool* cast_shadows;
+			u32* shadow_tile;   ///< First shadow atlas tile of the light, UINT32_MAX if none.
+			bool* shadow_dirty; ///< Whether the shadow map has to be rendered again.
 		};
 
 		Allocator* _allocator;
 		HashMap<UnitId, u32> _map;
 		LightInstanceData _data;
+		u64 _shadow_tiles; ///< Shadow atlas tiles in use, one bit each.
 
 		LightManager(Allocator& a)
 			: _allocator(&a)
 			, _map(a)
+			, _shadow_tiles(0)
 		{
 			memset(&_data, 0, sizeof(_data));
 		}
@@ -269,32 +552,193 @@ struct RenderWorld
 		void destroy(LightInstance i);
 		bool has(UnitId id);
 		LightInstance light(UnitId id);
+		bool allocate_shadow_tiles(u32 i);
+		void release_shadow_tiles(u32 i);
 		void debug_draw(u32 start_index, u32 num, DebugLine& dl);
 
 		void allocate(u32 num);
 		void grow();
+		void reserve(u32 num);
+		void shrink_to_fit();
 		void destroy();
 
 		LightInstance make_instance(u32 i) { LightInstance inst = { i }; return inst; }
 	};
 
+	struct TilemapManager
+	{
+		/// Square of CROWN_TILEMAP_CHUNK_SIZE tiles drawn with a single draw call.
+		struct Chunk
+		{
+			bgfx::VertexBufferHandle vbh; ///< Quads of the tiles, invalid if the chunk is empty.
+			u32 num_tiles;                ///< Tiles which are not empty.
+			AABB aabb;                    ///< Box enclosing the chunk in the space of the tilemap.
+			bool dirty;                   ///< Whether the vertex buffer has to be built again.
+		};
+
+		struct TilemapInstanceData
+		{
+			u32 size;
+			u32 capacity;
+			void* buffer;
+
+			UnitId* unit;
+			const TilemapResource** resource;
+			StringId64* material;
+			Matrix4x4* world;
+			u32* layer;
+			u32* depth;
+			u16** tiles;      ///< Tiles of the tilemap, they can differ from the ones of the resource.
+			Chunk** chunks;   ///< Chunks row by row, in the same allocation as the tiles.
+			bool* dirty;      ///< Whether any chunk is dirty.
+		};
+
+		Allocator* _allocator;
+		HashMap<UnitId, u32> _map;
+		TilemapInstanceData _data;
+
+		TilemapManager(Allocator& a)
+			: _allocator(&a)
+			, _map(a)
+		{
+			memset(&_data, 0, sizeof(_data));
+		}
+
+		TilemapInstance create(UnitId id, const TilemapResource* tmr, StringId64 material, u32 layer, u32 depth, const Matrix4x4& tr);
+		void destroy(TilemapInstance i);
+		bool has(UnitId id);
+		TilemapInstance tilemap(UnitId id);
+		void set_tile(TilemapInstance i, u32 x, u32 y, u32 tile);
+		void build_chunk(u32 i, u32 chunk);
+		void update_chunks();
+
+		void allocate(u32 num);
+		void grow();
+		void destroy();
+
+		TilemapInstance make_instance(u32 i) { TilemapInstance inst = { i }; return inst; }
+	};
+
+	struct ParticleManager
+	{
+		/// Streams of the particles of an emitter, each one f32 per particle.
+		enum Stream
+		{
+			PX, PY, PZ,
+			VX, VY, VZ,
+			AGE,
+			LIFETIME,
+
+			COUNT
+		};
+
+		struct ParticleInstanceData
+		{
+			u32 size;
+			u32 capacity;
+			void* buffer;
+
+			UnitId* unit;
+			const ParticleResource** resource;
+			StringId64* material;
+			Matrix4x4* world;
+			bool* playing;
+			f32* spawn;       ///< Particles due to be spawned, fractional part included.
+			u32* num;         ///< Particles alive.
+			f32** particles;  ///< Stream::COUNT streams of max_particles rounded up to 4, in a single allocation.
+			AABB* aabb;       ///< World-space box enclosing the particles alive.
+			Pcg32* random;
+		};
+
+		Allocator* _allocator;
+		HashMap<UnitId, u32> _map;
+		ParticleInstanceData _data;
+		u32 _num_particles; ///< Particles alive in all the emitters.
+
+		ParticleManager(Allocator& a)
+			: _allocator(&a)
+			, _map(a)
+			, _num_particles(0)
+		{
+			memset(&_data, 0, sizeof(_data));
+		}
+
+		ParticleInstance create(UnitId id, const ParticleResource* pr, StringId64 material, bool playing, const Matrix4x4& tr);
+		void destroy(ParticleInstance i);
+		bool has(UnitId id);
+		ParticleInstance particle(UnitId id);
+		void simulate(u32 i, f32 dt);
+
+		void allocate(u32 num);
+		void grow();
+		void destroy();
+
+		ParticleInstance make_instance(u32 i) { ParticleInstance inst = { i }; return inst; }
+	};
+
 	u32 _marker;
 	Allocator* _allocator;
 	ResourceManager* _resource_manager;
 	ShaderManager* _shader_manager;
 	MaterialManager* _material_manager;
+	TextureManager* _texture_manager;
 	UnitManager* _unit_manager;
 
-	bgfx::UniformHandle _u_light_position;
-	bgfx::UniformHandle _u_light_direction;
-	bgfx::UniformHandle _u_light_color;
-	bgfx::UniformHandle _u_light_range;
-	bgfx::UniformHandle _u_light_intensity;
+	bgfx::UniformHandle _u_lighting;
+	bgfx::UniformHandle _u_light_clusters;
+	bgfx::UniformHandle _u_light_textures;
+	bgfx::UniformHandle _u_light_data;
+	bgfx::UniformHandle _u_light_cluster;
+	bgfx::UniformHandle _u_light_index;
+	bgfx::TextureHandle _light_data[CROWN_MAX_CAMERAS];     ///< Position, direction and color of each light.
+	bgfx::TextureHandle _light_clusters[CROWN_MAX_CAMERAS]; ///< Offset and number of light indices of each cluster.
+	bgfx::TextureHandle _light_indices[CROWN_MAX_CAMERAS];  ///< Lights affecting each cluster.
+
+	struct ShadowCascade
+	{
+		Matrix4x4 view;
+		Matrix4x4 proj;
+		AABB box;          ///< World-space box enclosing the cascade.
+		Vector3 center;
+		f32 radius;
+		Vector3 direction; ///< Direction of the light.
+		bool valid;
+	};
+
+	bgfx::UniformHandle _u_shadow_atlas;
+	bgfx::UniformHandle _u_shadow_cascades;
+	bgfx::UniformHandle _u_shadow_splits;
+	bgfx::UniformHandle _u_shadow_params;
+	bgfx::TextureHandle _shadow_atlas; ///< Cascades in the first row, tiles of the local lights below.
+	bgfx::FrameBufferHandle _shadow_frame_buffer;
+	ShadowCascade _shadow_cascades[CROWN_SHADOW_CASCADES];
+	Matrix4x4 _shadow_cascade_matrices[CROWN_SHADOW_CASCADES]; ///< From world-space to the atlas.
+	Vector4 _shadow_splits; ///< Far view-space depth of each cascade.
+	u32 _shadow_light;      ///< Directional light casting the cascades, UINT32_MAX if none.
+	Array<AABB> _shadow_changes; ///< Boxes of the meshes changed since the shadows were rendered.
+	bool _shadow_changes_overflow;
+
+	bgfx::UniformHandle _u_skin;
+	bgfx::UniformHandle _u_mesh_decode;
+	bgfx::UniformHandle _u_skin_palette;
+	bgfx::TextureHandle _skin_palette; ///< Three texels for each bone, the rows of its transposed skin matrix.
+	Array<Matrix4x4> _skin_matrices;
+	bool _skin_dirty; ///< Whether _skin_matrices has to be uploaded to the palette.
+
+	bgfx::IndexBufferHandle _sprite_index_buffer;
+	bgfx::UniformHandle _u_sprite_time;
+	f32 _time;
 
 	bool _debug_drawing;
+	f32 _mesh_lod_bias;
+	const OcclusionBuffer* _occlusion_buffer;
+	RenderStats _stats;
+	RenderQueue _render_queue;
 	MeshManager _mesh_manager;
 	SpriteManager _sprite_manager;
 	LightManager _light_manager;
+	ParticleManager _particle_manager;
+	TilemapManager _tilemap_manager;
 };
 
 } // namespace crown
@@ -0,0 +1,982 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/quaternion.h"
+#include "core/memory/temp_allocator.h"
+#include "world/replication.h"
+#include "world/scene_graph.h"
+#include "world/unit_manager.h"
+#include <math.h>   // floorf, sqrtf
+#include <stddef.h> // offsetof
+#include <stdint.h> // uintptr_t
+#include <string.h> // memcpy, memmove
+
+namespace crown
+{
+namespace replication_internal
+{
+	const u32 PROTOCOL_ID = 0x31505243; // "CRP1"
+	const u32 MAX_PARTS = 255;
+	const u32 MAX_ENTRY_SIZE = 5 + 2 + 3*5 + 7 + 3*5 + CROWN_REPLICATION_MAX_VALUES*4;
+	const u32 RECEIVE_BATCH = 32;
+
+	struct PacketType
+	{
+		enum Enum
+		{
+			SNAPSHOT,
+			ACK
+		};
+	};
+
+	/// Header of a part of a snapshot. A part holds the ids removed since
+	/// the baseline, then the entries changed since the baseline.
+	struct SnapshotHeader
+	{
+		u32 protocol;
+		u8 type;
+		u8 has_baseline;
+		u8 part;
+		u8 num_parts;
+		u16 sequence;
+		u16 baseline;
+	};
+
+	struct AckHeader
+	{
+		u32 protocol;
+		u8 type;
+		u8 has_ack;
+		u16 ack;
+	};
+
+	struct EntryFlags
+	{
+		enum Enum
+		{
+			POSITION_X = 1 << 0,
+			POSITION_Y = 1 << 1,
+			POSITION_Z = 1 << 2,
+			ROTATION   = 1 << 3,
+			SCALE      = 1 << 4,
+			VALUE_0    = 1 << 5 ///< First of CROWN_REPLICATION_MAX_VALUES flags.
+		};
+	};
+
+	// Returns whether the sequence @a a is more recent than @a b.
+	static inline bool newer(u16 a, u16 b)
+	{
+		return s16(a - b) > 0;
+	}
+
+	// Returns the index of the first element of @a a whose id is not less than @a id.
+	template <typename T>
+	static u32 lower_bound(const Array<T>& a, u32 id)
+	{
+		u32 first = 0;
+		u32 count = array::size(a);
+		while (count > 0)
+		{
+			const u32 step = count / 2;
+			if (a[first + step].id < id)
+			{
+				first += step + 1;
+				count -= step + 1;
+			}
+			else
+			{
+				count = step;
+			}
+		}
+		return first;
+	}
+
+	// Returns the index of the element of @a a with the given @a id or UINT32_MAX.
+	template <typename T>
+	static u32 find(const Array<T>& a, u32 id)
+	{
+		const u32 i = lower_bound(a, id);
+		return i < array::size(a) && a[i].id == id ? i : UINT32_MAX;
+	}
+
+	static s32 quantize(f32 val)
+	{
+		const f32 q = floorf(val * f32(CROWN_REPLICATION_POSITION_STEPS) + 0.5f);
+		return s32(fclamp(q, -1073741824.0f, 1073741824.0f));
+	}
+
+	static f32 dequantize(s32 val)
+	{
+		return f32(val) / f32(CROWN_REPLICATION_POSITION_STEPS);
+	}
+
+	// Encodes the three smallest components of @a q in 16 bits each, and
+	// the index of the largest one, which is recomputed from the others.
+	static u64 quantize_rotation(const Quaternion& q)
+	{
+		f32 c[4] = { q.x, q.y, q.z, q.w };
+		u32 largest = 0;
+		for (u32 i = 1; i < 4; ++i)
+		{
+			if (fabsf(c[i]) > fabsf(c[largest]))
+				largest = i;
+		}
+
+		const f32 sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+		u64 r = largest;
+		u32 shift = 2;
+		for (u32 i = 0; i < 4; ++i)
+		{
+			if (i == largest)
+				continue;
+
+			// The other components are in [-1/sqrt(2), 1/sqrt(2)].
+			const f32 n = fclamp(c[i] * sign * 0.70710678f + 0.5f, 0.0f, 1.0f);
+			r |= u64(floorf(n * 65535.0f + 0.5f)) << shift;
+			shift += 16;
+		}
+
+		return r;
+	}
+
+	static Quaternion dequantize_rotation(u64 r)
+	{
+		const u32 largest = u32(r & 3);
+		f32 c[4];
+		f32 sum = 0.0f;
+		u32 shift = 2;
+		for (u32 i = 0; i < 4; ++i)
+		{
+			if (i == largest)
+				continue;
+
+			c[i] = (f32((r >> shift) & 0xffff) / 65535.0f - 0.5f) * 1.41421356f;
+			sum += c[i] * c[i];
+			shift += 16;
+		}
+		c[largest] = sqrtf(fmax(0.0f, 1.0f - sum));
+
+		Quaternion q = { c[0], c[1], c[2], c[3] };
+		return normalize(q);
+	}
+
+	// Returns the entry @a id of a unit at the origin, which new entries
+	// are delta-compressed against.
+	static Replication::Entry default_entry(u32 id)
+	{
+		Replication::Entry e;
+		memset(&e, 0, sizeof(e));
+		e.id = id;
+		e.scale[0] = CROWN_REPLICATION_POSITION_STEPS;
+		e.scale[1] = CROWN_REPLICATION_POSITION_STEPS;
+		e.scale[2] = CROWN_REPLICATION_POSITION_STEPS;
+		e.rotation = quantize_rotation(QUATERNION_IDENTITY);
+		return e;
+	}
+
+	static inline void write_u8(Buffer& out, u8 val)
+	{
+		array::push_back(out, (char)val);
+	}
+
+	static inline void write_varint(Buffer& out, u64 val)
+	{
+		while (val >= 0x80)
+		{
+			write_u8(out, u8(val | 0x80));
+			val >>= 7;
+		}
+		write_u8(out, u8(val));
+	}
+
+	static inline void write_zigzag(Buffer& out, s64 val)
+	{
+		write_varint(out, (u64(val) << 1) ^ u64(val >> 63));
+	}
+
+	static inline void write_raw(Buffer& out, const void* data, u32 size)
+	{
+		array::push(out, (const char*)data, size);
+	}
+
+	struct Reader
+	{
+		const u8* cur;
+		const u8* end;
+		bool error;
+
+		Reader(const void* data, u32 size)
+			: cur((const u8*)data)
+			, end((const u8*)data + size)
+			, error(false)
+		{
+		}
+
+		u64 read_varint()
+		{
+			u64 val = 0;
+			for (u32 shift = 0; shift < 64; shift += 7)
+			{
+				if (cur == end)
+					break;
+
+				const u8 b = *cur++;
+				val |= u64(b & 0x7f) << shift;
+				if ((b & 0x80) == 0)
+					return val;
+			}
+
+			error = true;
+			return 0;
+		}
+
+		s64 read_zigzag()
+		{
+			const u64 val = read_varint();
+			return s64(val >> 1) ^ -s64(val & 1);
+		}
+
+		void read_raw(void* data, u32 size)
+		{
+			if (u32(end - cur) < size)
+			{
+				error = true;
+				memset(data, 0, size);
+				return;
+			}
+
+			memcpy(data, cur, size);
+			cur += size;
+		}
+	};
+
+	// Returns the flags of the fields of @a e which differ from @a base.
+	static u32 changes(const Replication::Entry& e, const Replication::Entry& base)
+	{
+		u32 flags = 0;
+		flags |= e.position[0] != base.position[0] ? EntryFlags::POSITION_X : 0;
+		flags |= e.position[1] != base.position[1] ? EntryFlags::POSITION_Y : 0;
+		flags |= e.position[2] != base.position[2] ? EntryFlags::POSITION_Z : 0;
+		flags |= e.rotation != base.rotation ? EntryFlags::ROTATION : 0;
+		flags |= memcmp(e.scale, base.scale, sizeof(e.scale)) != 0 ? EntryFlags::SCALE : 0;
+		for (u32 i = 0; i < CROWN_REPLICATION_MAX_VALUES; ++i)
+			flags |= memcmp(&e.values[i], &base.values[i], sizeof(f32)) != 0 ? EntryFlags::VALUE_0 << i : 0;
+		return flags;
+	}
+
+	static void write_entry(Buffer& out, const Replication::Entry& e, const Replication::Entry& base, u32 flags, u32 prev_id)
+	{
+		write_varint(out, e.id - prev_id);
+		write_varint(out, flags);
+		for (u32 i = 0; i < 3; ++i)
+		{
+			if (flags & (EntryFlags::POSITION_X << i))
+				write_zigzag(out, s64(e.position[i]) - s64(base.position[i]));
+		}
+		if (flags & EntryFlags::ROTATION)
+			write_raw(out, &e.rotation, 7);
+		if (flags & EntryFlags::SCALE)
+		{
+			for (u32 i = 0; i < 3; ++i)
+				write_zigzag(out, s64(e.scale[i]) - s64(base.scale[i]));
+		}
+		for (u32 i = 0; i < CROWN_REPLICATION_MAX_VALUES; ++i)
+		{
+			if (flags & (EntryFlags::VALUE_0 << i))
+				write_raw(out, &e.values[i], sizeof(f32));
+		}
+	}
+
+	// Reads the fields in @a flags into @a e, which holds the baseline.
+	static void read_entry(Reader& r, Replication::Entry& e, u32 flags)
+	{
+		for (u32 i = 0; i < 3; ++i)
+		{
+			if (flags & (EntryFlags::POSITION_X << i))
+				e.position[i] = s32(s64(e.position[i]) + r.read_zigzag());
+		}
+		if (flags & EntryFlags::ROTATION)
+		{
+			e.rotation = 0;
+			r.read_raw(&e.rotation, 7);
+		}
+		if (flags & EntryFlags::SCALE)
+		{
+			for (u32 i = 0; i < 3; ++i)
+				e.scale[i] = s32(s64(e.scale[i]) + r.read_zigzag());
+		}
+		for (u32 i = 0; i < CROWN_REPLICATION_MAX_VALUES; ++i)
+		{
+			if (flags & (EntryFlags::VALUE_0 << i))
+				r.read_raw(&e.values[i], sizeof(f32));
+		}
+	}
+
+	static Matrix4x4 entry_pose(const Replication::Entry& e)
+	{
+		const Vector3 pos = { dequantize(e.position[0]), dequantize(e.position[1]), dequantize(e.position[2]) };
+		const Vector3 scl = { dequantize(e.scale[0]), dequantize(e.scale[1]), dequantize(e.scale[2]) };
+		Matrix4x4 pose = matrix4x4(dequantize_rotation(e.rotation), pos);
+		set_scale(pose, scl);
+		return pose;
+	}
+
+	// Returns the snapshot @a sequence if it is still kept.
+	static Replication::Snapshot* snapshot(Replication& r, u16 sequence)
+	{
+		Replication::Snapshot* s = r._snapshots[sequence % CROWN_REPLICATION_SNAPSHOTS];
+		return s->valid && s->sequence == sequence ? s : NULL;
+	}
+
+	// Returns the last snapshot sent or received completely.
+	static Replication::Snapshot* last_snapshot(Replication& r)
+	{
+		return r._has_sequence ? snapshot(r, r._sequence) : NULL;
+	}
+
+	struct Change
+	{
+		const Replication::Entry* entry;
+		const Replication::Entry* base; ///< NULL if the entry is not in the baseline.
+		u32 flags;
+	};
+
+	// Encodes the snapshot @a snap as a delta against @a baseline, or
+	// against default_entry() if it is NULL. The parts are appended to
+	// @a out and their offsets to @a packets. Returns false if the
+	// snapshot needs more than MAX_PARTS parts.
+	static bool encode(Buffer& out, Array<u32>& packets, const Replication::Snapshot& snap, const Replication::Snapshot* baseline)
+	{
+		Array<u32> removed(default_frame_allocator());
+		Array<Change> changed(default_frame_allocator());
+
+		const Replication::Entry* c = array::begin(snap.entries);
+		const Replication::Entry* c_end = array::end(snap.entries);
+		const Replication::Entry* b = baseline != NULL ? array::begin(baseline->entries) : NULL;
+		const Replication::Entry* b_end = baseline != NULL ? array::end(baseline->entries) : NULL;
+
+		while (c != c_end || b != b_end)
+		{
+			if (c == c_end || (b != b_end && b->id < c->id))
+			{
+				array::push_back(removed, b->id);
+				++b;
+				continue;
+			}
+
+			Change ch;
+			ch.entry = c;
+			ch.base = NULL;
+			if (b != b_end && b->id == c->id)
+				ch.base = b++;
+			++c;
+
+			const Replication::Entry def = default_entry(ch.entry->id);
+			ch.flags = changes(*ch.entry, ch.base != NULL ? *ch.base : def);
+			if (ch.flags != 0)
+				array::push_back(changed, ch);
+		}
+
+		const u32 first_packet = array::size(packets);
+		const u32 first_byte = array::size(out);
+		u32 num_removed = 0;
+		u32 num_changed = 0;
+		u32 num_parts = 0;
+
+		// Parts are sent even if nothing changed, so that the client can
+		// acknowledge the snapshot.
+		do
+		{
+			if (num_parts == MAX_PARTS)
+			{
+				array::resize(out, first_byte);
+				array::resize(packets, first_packet);
+				return false;
+			}
+
+			const u32 part_begin = array::size(out);
+			array::push_back(packets, part_begin);
+
+			SnapshotHeader sh;
+			sh.protocol = PROTOCOL_ID;
+			sh.type = PacketType::SNAPSHOT;
+			sh.has_baseline = baseline != NULL;
+			sh.part = u8(num_parts++);
+			sh.num_parts = 0;
+			sh.sequence = snap.sequence;
+			sh.baseline = baseline != NULL ? baseline->sequence : 0;
+			write_raw(out, &sh, sizeof(sh));
+
+			// Removed ids first, at most 127 so that their count fits one byte.
+			const u32 max_removed = (CROWN_REPLICATION_PACKET_SIZE - sizeof(sh) - 1) / 5;
+			u32 n = array::size(removed) - num_removed;
+			n = n < max_removed ? n : max_removed;
+			n = n < 127 ? n : 127;
+			write_u8(out, u8(n));
+
+			u32 prev_id = 0;
+			for (u32 i = num_removed; i < num_removed + n; ++i)
+			{
+				write_varint(out, removed[i] - prev_id);
+				prev_id = removed[i];
+			}
+			num_removed += n;
+
+			prev_id = 0;
+			while (num_changed < array::size(changed)
+				&& array::size(out) - part_begin + MAX_ENTRY_SIZE <= CROWN_REPLICATION_PACKET_SIZE
+				)
+			{
+				const Change& ch = changed[num_changed++];
+				const Replication::Entry def = default_entry(ch.entry->id);
+				write_entry(out, *ch.entry, ch.base != NULL ? *ch.base : def, ch.flags, prev_id);
+				prev_id = ch.entry->id;
+			}
+		}
+		while (num_removed < array::size(removed) || num_changed < array::size(changed));
+
+		for (u32 i = first_packet; i < array::size(packets); ++i)
+			out[packets[i] + offsetof(SnapshotHeader, num_parts)] = char(num_parts);
+
+		return true;
+	}
+
+	// Reads the quantized state of the units into the snapshot @a snap.
+	static void capture(Replication& r, Replication::Snapshot& snap)
+	{
+		array::resize(snap.entries, array::size(r._units));
+		for (u32 i = 0; i < array::size(r._units); ++i)
+		{
+			const Replication::Unit& u = r._units[i];
+			Replication::Entry& e = snap.entries[i];
+			e = default_entry(u.id);
+
+			if (r._scene_graph->has(u.unit))
+			{
+				const Vector3 pos = r._scene_graph->local_position(u.unit);
+				const Vector3 scl = r._scene_graph->local_scale(u.unit);
+				e.position[0] = quantize(pos.x);
+				e.position[1] = quantize(pos.y);
+				e.position[2] = quantize(pos.z);
+				e.scale[0] = quantize(scl.x);
+				e.scale[1] = quantize(scl.y);
+				e.scale[2] = quantize(scl.z);
+				e.rotation = quantize_rotation(r._scene_graph->local_rotation(u.unit));
+			}
+
+			memcpy(e.values, u.values, sizeof(e.values));
+		}
+	}
+
+	// Sets the unit with the id of @a e to the state in @a e.
+	static void apply(Replication& r, const Replication::Entry& e, Array<UnitId>& units, Array<Matrix4x4>& poses)
+	{
+		const u32 i = find(r._units, e.id);
+		if (i == UINT32_MAX)
+			return;
+
+		Replication::Unit& u = r._units[i];
+		memcpy(u.values, e.values, sizeof(u.values));
+
+		if (r._scene_graph->has(u.unit))
+		{
+			array::push_back(units, u.unit);
+			array::push_back(poses, entry_pose(e));
+		}
+	}
+
+	static void receive_ack(Replication& r, const IPAddress& ip, u16 port, const AckHeader& ah)
+	{
+		Replication::Client* client = NULL;
+		for (u32 i = 0; i < array::size(r._clients); ++i)
+		{
+			if (r._clients[i].ip.address() == ip.address() && r._clients[i].port == port)
+			{
+				client = &r._clients[i];
+				break;
+			}
+		}
+
+		if (client == NULL)
+		{
+			if (array::size(r._clients) == CROWN_REPLICATION_MAX_CLIENTS)
+				return;
+
+			Replication::Client c;
+			c.ip = ip;
+			c.port = port;
+			c.ack = 0;
+			c.has_ack = false;
+			c.idle_time = 0.0f;
+			array::push_back(r._clients, c);
+			client = &array::back(r._clients);
+		}
+
+		client->idle_time = 0.0f;
+		if (ah.has_ack && (!client->has_ack || newer(ah.ack, client->ack)))
+		{
+			client->ack = ah.ack;
+			client->has_ack = true;
+		}
+	}
+
+	static void receive_snapshot(Replication& r, const char* data, u32 size, Array<UnitId>& units, Array<Matrix4x4>& poses)
+	{
+		SnapshotHeader sh;
+		memcpy(&sh, data, sizeof(sh));
+		if (sh.num_parts == 0 || sh.part >= sh.num_parts)
+			return;
+
+		// Drop the parts of snapshots older than the last one received.
+		if (r._has_sequence && !newer(sh.sequence, r._sequence))
+			return;
+
+		Replication::Snapshot& as = *r._assembly;
+		if (!as.valid || newer(sh.sequence, as.sequence))
+		{
+			const Replication::Snapshot* baseline = NULL;
+			if (sh.has_baseline)
+			{
+				baseline = snapshot(r, sh.baseline);
+				if (baseline == NULL)
+					return;
+			}
+
+			as.valid = true;
+			as.sequence = sh.sequence;
+			array::clear(as.entries);
+			if (baseline != NULL)
+				array::push(as.entries, array::begin(baseline->entries), array::size(baseline->entries));
+			memset(r._assembly_parts, 0, sizeof(r._assembly_parts));
+			r._assembly_num_received = 0;
+		}
+		else if (sh.sequence != as.sequence)
+		{
+			return;
+		}
+
+		u64& part_bit = r._assembly_parts[sh.part / 64];
+		if (part_bit & (u64(1) << (sh.part % 64)))
+			return;
+
+		Reader reader(data + sizeof(sh), size - sizeof(sh));
+
+		// Removed ids.
+		const u32 num_removed = u32(reader.read_varint());
+		u32 id = 0;
+		for (u32 i = 0; i < num_removed && !reader.error; ++i)
+		{
+			id += u32(reader.read_varint());
+			const u32 index = find(as.entries, id);
+			if (index == UINT32_MAX)
+				continue;
+
+			memmove(array::begin(as.entries) + index
+				, array::begin(as.entries) + index + 1
+				, (array::size(as.entries) - index - 1) * sizeof(Replication::Entry)
+				);
+			array::pop_back(as.entries);
+		}
+
+		// Changed entries.
+		id = 0;
+		while (reader.cur < reader.end && !reader.error)
+		{
+			id += u32(reader.read_varint());
+			const u32 flags = u32(reader.read_varint());
+
+			u32 index = lower_bound(as.entries, id);
+			if (index == array::size(as.entries) || as.entries[index].id != id)
+			{
+				array::push_back(as.entries, default_entry(id));
+				memmove(array::begin(as.entries) + index + 1
+					, array::begin(as.entries) + index
+					, (array::size(as.entries) - index - 1) * sizeof(Replication::Entry)
+					);
+				as.entries[index] = default_entry(id);
+			}
+
+			read_entry(reader, as.entries[index], flags);
+			if (!reader.error)
+				apply(r, as.entries[index], units, poses);
+		}
+
+		if (reader.error)
+		{
+			// The snapshot can not be completed without this part.
+			as.valid = false;
+			return;
+		}
+
+		part_bit |= u64(1) << (sh.part % 64);
+		if (++r._assembly_num_received < sh.num_parts)
+			return;
+
+		// The snapshot is complete: keep it as a baseline.
+		Replication::Snapshot*& slot = r._snapshots[as.sequence % CROWN_REPLICATION_SNAPSHOTS];
+		Replication::Snapshot* old = slot;
+		slot = r._assembly;
+		r._assembly = old;
+		r._assembly->valid = false;
+		r._sequence = slot->sequence;
+		r._has_sequence = true;
+	}
+
+} // namespace replication_internal
+
+static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
+{
+	for (u32 i = 0; i < num; ++i)
+		((Replication*)user_ptr)->unit_destroyed_callback(units[i]);
+}
+
+Replication::Snapshot::Snapshot(Allocator& a)
+	: sequence(0)
+	, valid(false)
+	, entries(a)
+{
+}
+
+Replication::Replication(Allocator& a, UnitManager& um, SceneGraph& sg)
+	: _marker(REPLICATION_MARKER)
+	, _allocator(&a)
+	, _unit_manager(&um)
+	, _scene_graph(&sg)
+	, _mode(Mode::NONE)
+	, _server_port(0)
+	, _units(a)
+	, _map(a)
+	, _clients(a)
+	, _assembly(NULL)
+	, _assembly_num_received(0)
+	, _sequence(0)
+	, _has_sequence(false)
+	, _send_interval(0.0f)
+	, _send_time(0.0f)
+	, _packets(a)
+{
+	memset(_snapshots, 0, sizeof(_snapshots));
+	memset(_assembly_parts, 0, sizeof(_assembly_parts));
+	_server_ip = IP_ADDRESS_LOOPBACK;
+
+	um.register_destroy_function(unit_destroyed_callback_bridge, this);
+}
+
+Replication::~Replication()
+{
+	_unit_manager->unregister_destroy_function(this);
+	stop();
+	_marker = 0;
+}
+
+bool Replication::listen(u16 port)
+{
+	stop();
+
+	if (_socket.bind(port).error != BindResult::SUCCESS)
+	{
+		_socket.close();
+		return false;
+	}
+
+	for (u32 i = 0; i < countof(_snapshots); ++i)
+		_snapshots[i] = CE_NEW(*_allocator, Snapshot)(*_allocator);
+
+	_mode = Mode::SERVER;
+	return true;
+}
+
+bool Replication::connect(const IPAddress& ip, u16 port)
+{
+	stop();
+
+	if (_socket.bind(0).error != BindResult::SUCCESS)
+	{
+		_socket.close();
+		return false;
+	}
+
+	for (u32 i = 0; i < countof(_snapshots); ++i)
+		_snapshots[i] = CE_NEW(*_allocator, Snapshot)(*_allocator);
+	_assembly = CE_NEW(*_allocator, Snapshot)(*_allocator);
+
+	_server_ip = ip;
+	_server_port = port;
+	_mode = Mode::CLIENT;
+	return true;
+}
+
+void Replication::stop()
+{
+	_socket.close();
+
+	for (u32 i = 0; i < countof(_snapshots); ++i)
+	{
+		CE_DELETE(*_allocator, _snapshots[i]);
+		_snapshots[i] = NULL;
+	}
+	CE_DELETE(*_allocator, _assembly);
+	_assembly = NULL;
+
+	array::clear(_clients);
+	_sequence = 0;
+	_has_sequence = false;
+	_send_time = 0.0f;
+	_mode = Mode::NONE;
+}
+
+Replication::Mode::Enum Replication::mode() const
+{
+	return _mode;
+}
+
+void Replication::add(UnitId unit, u32 id)
+{
+	using namespace replication_internal;
+	CE_ASSERT(!hash_map::has(_map, unit), "Unit already replicated");
+	CE_ASSERT(find(_units, id) == UINT32_MAX, "Id already used: %u", id);
+
+	Unit u;
+	u.id = id;
+	u.unit = unit;
+	memset(u.values, 0, sizeof(u.values));
+
+	const u32 index = lower_bound(_units, id);
+	array::push_back(_units, u);
+	memmove(array::begin(_units) + index + 1
+		, array::begin(_units) + index
+		, (array::size(_units) - index - 1) * sizeof(Unit)
+		);
+	_units[index] = u;
+	hash_map::set(_map, unit, id);
+
+	// Clients set the unit to its last state received, since the server
+	// only sends the state again when it changes.
+	if (_mode == Mode::CLIENT)
+	{
+		const Snapshot* snap = last_snapshot(*this);
+		const u32 entry = snap != NULL ? find(snap->entries, id) : UINT32_MAX;
+		if (entry != UINT32_MAX)
+		{
+			memcpy(_units[index].values, snap->entries[entry].values, sizeof(u.values));
+			if (_scene_graph->has(unit))
+				_scene_graph->set_local_pose(unit, entry_pose(snap->entries[entry]));
+		}
+	}
+}
+
+void Replication::remove(UnitId unit)
+{
+	using namespace replication_internal;
+	CE_ASSERT(hash_map::has(_map, unit), "Unit not replicated");
+
+	const u32 index = find(_units, hash_map::get(_map, unit, 0u));
+	memmove(array::begin(_units) + index
+		, array::begin(_units) + index + 1
+		, (array::size(_units) - index - 1) * sizeof(Unit)
+		);
+	array::pop_back(_units);
+	hash_map::remove(_map, unit);
+}
+
+bool Replication::has(UnitId unit)
+{
+	return hash_map::has(_map, unit);
+}
+
+void Replication::set_value(UnitId unit, u32 index, f32 value)
+{
+	CE_ASSERT(hash_map::has(_map, unit), "Unit not replicated");
+	CE_ASSERT(index < CROWN_REPLICATION_MAX_VALUES, "Index out of bounds");
+	const u32 i = replication_internal::find(_units, hash_map::get(_map, unit, 0u));
+	_units[i].values[index] = value;
+}
+
+f32 Replication::value(UnitId unit, u32 index)
+{
+	CE_ASSERT(hash_map::has(_map, unit), "Unit not replicated");
+	CE_ASSERT(index < CROWN_REPLICATION_MAX_VALUES, "Index out of bounds");
+	const u32 i = replication_internal::find(_units, hash_map::get(_map, unit, 0u));
+	return _units[i].values[index];
+}
+
+void Replication::set_send_interval(f32 seconds)
+{
+	_send_interval = seconds;
+}
+
+u32 Replication::num_clients() const
+{
+	return array::size(_clients);
+}
+
+void Replication::receive(f32 dt)
+{
+	using namespace replication_internal;
+
+	if (_mode == Mode::NONE)
+		return;
+
+	Array<UnitId> units(default_frame_allocator());
+	Array<Matrix4x4> poses(default_frame_allocator());
+
+	array::resize(_packets, RECEIVE_BATCH * CROWN_REPLICATION_PACKET_SIZE);
+	UDPDatagram datagrams[RECEIVE_BATCH];
+
+	for (;;)
+	{
+		for (u32 i = 0; i < RECEIVE_BATCH; ++i)
+		{
+			datagrams[i].data = array::begin(_packets) + i * CROWN_REPLICATION_PACKET_SIZE;
+			datagrams[i].size = CROWN_REPLICATION_PACKET_SIZE;
+		}
+
+		const u32 num = _socket.receive(datagrams, RECEIVE_BATCH);
+		for (u32 i = 0; i < num; ++i)
+		{
+			const UDPDatagram& dg = datagrams[i];
+			const char* data = (const char*)dg.data;
+			u32 protocol;
+			if (dg.size < sizeof(protocol) + 1)
+				continue;
+
+			memcpy(&protocol, data, sizeof(protocol));
+			if (protocol != PROTOCOL_ID)
+				continue;
+
+			const u8 type = (u8)data[sizeof(protocol)];
+			if (_mode == Mode::SERVER && type == PacketType::ACK && dg.size >= sizeof(AckHeader))
+			{
+				AckHeader ah;
+				memcpy(&ah, data, sizeof(ah));
+				receive_ack(*this, dg.ip, dg.port, ah);
+			}
+			else if (_mode == Mode::CLIENT && type == PacketType::SNAPSHOT && dg.size >= sizeof(SnapshotHeader)
+				&& dg.ip.address() == _server_ip.address() && dg.port == _server_port)
+			{
+				receive_snapshot(*this, data, dg.size, units, poses);
+			}
+		}
+
+		if (num < RECEIVE_BATCH)
+			break;
+	}
+
+	if (array::size(units) > 0)
+	{
+		// Keep only the last pose of the units received more than once.
+		HashMap<UnitId, u32> last(default_frame_allocator());
+		u32 num = 0;
+		for (u32 i = 0; i < array::size(units); ++i)
+		{
+			const u32 j = hash_map::get(last, units[i], UINT32_MAX);
+			if (j != UINT32_MAX)
+			{
+				poses[j] = poses[i];
+				continue;
+			}
+
+			hash_map::set(last, units[i], num);
+			units[num] = units[i];
+			poses[num] = poses[i];
+			++num;
+		}
+
+		_scene_graph->set_local_poses(array::begin(units), array::begin(poses), num);
+	}
+
+	// Drop the clients which stopped acknowledging.
+	for (u32 i = 0; i < array::size(_clients);)
+	{
+		_clients[i].idle_time += dt;
+		if (_clients[i].idle_time > CROWN_REPLICATION_TIMEOUT)
+		{
+			_clients[i] = array::back(_clients);
+			array::pop_back(_clients);
+			continue;
+		}
+		++i;
+	}
+}
+
+void Replication::send(f32 dt)
+{
+	using namespace replication_internal;
+
+	if (_mode == Mode::CLIENT)
+	{
+		// The ack also tells the server the client is still there.
+		AckHeader ah;
+		ah.protocol = PROTOCOL_ID;
+		ah.type = PacketType::ACK;
+		ah.has_ack = _has_sequence;
+		ah.ack = _sequence;
+		_socket.send(_server_ip, _server_port, &ah, sizeof(ah));
+		return;
+	}
+
+	if (_mode != Mode::SERVER)
+		return;
+
+	_send_time += dt;
+	if (_send_time < _send_interval)
+		return;
+	_send_time = 0.0f;
+
+	_sequence = _has_sequence ? u16(_sequence + 1) : 0;
+	_has_sequence = true;
+
+	Snapshot& snap = *_snapshots[_sequence % CROWN_REPLICATION_SNAPSHOTS];
+	snap.sequence = _sequence;
+	snap.valid = true;
+	capture(*this, snap);
+
+	if (array::size(_clients) == 0)
+		return;
+
+	array::clear(_packets);
+	Array<u32> packets(default_frame_allocator());
+	Array<UDPDatagram> datagrams(default_frame_allocator());
+
+	for (u32 i = 0; i < array::size(_clients); ++i)
+	{
+		const Client& c = _clients[i];
+		const Snapshot* baseline = c.has_ack ? snapshot(*this, c.ack) : NULL;
+		if (baseline == &snap)
+			baseline = NULL;
+
+		const u32 first = array::size(packets);
+		if (!encode(_packets, packets, snap, baseline))
+			continue;
+
+		for (u32 p = first; p < array::size(packets); ++p)
+		{
+			UDPDatagram dg;
+			dg.ip = c.ip;
+			dg.port = c.port;
+			dg.data = (void*)(uintptr_t)packets[p]; // Offset until _packets stops growing.
+			dg.size = (p + 1 < array::size(packets) ? packets[p + 1] : array::size(_packets)) - packets[p];
+			array::push_back(datagrams, dg);
+		}
+	}
+
+	for (u32 i = 0; i < array::size(datagrams); ++i)
+		datagrams[i].data = array::begin(_packets) + (uintptr_t)datagrams[i].data;
+
+	_socket.send(array::begin(datagrams), array::size(datagrams));
+}
+
+void Replication::unit_destroyed_callback(UnitId unit)
+{
+	if (has(unit))
+		remove(unit);
+}
+
+} // namespace crown
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "config.h"
+#include "core/containers/types.h"
+#include "core/network/socket.h"
+#include "core/types.h"
+#include "world/types.h"
+
+namespace crown
+{
+/// Replicates the local poses, and CROWN_REPLICATION_MAX_VALUES values, of
+/// a set of units from a server world to the worlds of its clients over UDP.
+///
+/// Units are replicated by id: the server and its clients must add the
+/// units they want to keep in sync with the same ids. The server sends a
+/// snapshot of all its units at each update, quantized and delta-compressed
+/// against the last snapshot each client acknowledged, and the clients set
+/// the poses of their units to the ones received.
+///
+/// @ingroup World
+struct Replication
+{
+	struct Mode
+	{
+		enum Enum
+		{
+			NONE,
+			SERVER,
+			CLIENT
+		};
+	};
+
+	/// Quantized state of a unit in a snapshot.
+	struct Entry
+	{
+		u32 id;
+		s32 position[3]; ///< Multiples of 1/CROWN_REPLICATION_POSITION_STEPS.
+		s32 scale[3];    ///< Multiples of 1/CROWN_REPLICATION_POSITION_STEPS.
+		u64 rotation;    ///< Index of the largest component and the other three in 16 bits each.
+		f32 values[CROWN_REPLICATION_MAX_VALUES];
+	};
+
+	struct Snapshot
+	{
+		u16 sequence;
+		bool valid;
+		Array<Entry> entries; ///< Sorted by id.
+
+		///
+		Snapshot(Allocator& a);
+	};
+
+	struct Unit
+	{
+		u32 id;
+		UnitId unit;
+		f32 values[CROWN_REPLICATION_MAX_VALUES];
+	};
+
+	struct Client
+	{
+		IPAddress ip;
+		u16 port;
+		u16 ack;        ///< Last snapshot acknowledged, valid if has_ack.
+		bool has_ack;
+		f32 idle_time;  ///< Seconds since the last packet from the client.
+	};
+
+	u32 _marker;
+	Allocator* _allocator;
+	UnitManager* _unit_manager;
+	SceneGraph* _scene_graph;
+	Mode::Enum _mode;
+	UDPSocket _socket;
+	IPAddress _server_ip;
+	u16 _server_port;
+	Array<Unit> _units;            ///< Sorted by id.
+	HashMap<UnitId, u32> _map;     ///< Id of each unit.
+	Array<Client> _clients;
+	Snapshot* _snapshots[CROWN_REPLICATION_SNAPSHOTS]; ///< Indexed by sequence.
+	Snapshot* _assembly;           ///< Client only: snapshot being received, if valid.
+	u64 _assembly_parts[4];        ///< Client only: bitset of the parts of _assembly received.
+	u32 _assembly_num_received;
+	u16 _sequence;                 ///< Last snapshot sent or acknowledged.
+	bool _has_sequence;
+	f32 _send_interval;
+	f32 _send_time;
+	Buffer _packets;               ///< Packets being sent or received.
+
+	///
+	Replication(Allocator& a, UnitManager& um, SceneGraph& sg);
+
+	///
+	~Replication();
+
+	///
+	Replication(const Replication&) = delete;
+
+	///
+	Replication& operator=(const Replication&) = delete;
+
+	/// Starts sending the units to the clients which connect to @a port.
+	/// Returns false if @a port can not be bound.
+	bool listen(u16 port);
+
+	/// Starts receiving the units from the server at @a ip and @a port.
+	/// Returns false if no port can be bound.
+	bool connect(const IPAddress& ip, u16 port);
+
+	/// Stops sending or receiving.
+	void stop();
+
+	/// Returns the mode of the replication.
+	Mode::Enum mode() const;
+
+	/// Replicates the @a unit with the given @a id.
+	void add(UnitId unit, u32 id);
+
+	/// Stops replicating the @a unit.
+	void remove(UnitId unit);
+
+	/// Returns whether the @a unit is replicated.
+	bool has(UnitId unit);
+
+	/// Sets the value at @a index of the @a unit to @a value. The server
+	/// sends the values with the poses.
+	void set_value(UnitId unit, u32 index, f32 value);
+
+	/// Returns the value at @a index of the @a unit.
+	f32 value(UnitId unit, u32 index);
+
+	/// Sets the server to send a snapshot at most every @a seconds.
+	/// The default of 0 sends a snapshot at each update.
+	void set_send_interval(f32 seconds);
+
+	/// Returns the number of clients connected to the server.
+	u32 num_clients() const;
+
+	/// Receives the packets from the network: the server updates the
+	/// snapshots acknowledged by the clients and the clients set the poses
+	/// of their units to the ones received.
+	void receive(f32 dt);
+
+	/// Sends the packets to the network: the server sends each client a
+	/// snapshot of its units, and the clients acknowledge the last one
+	/// they received.
+	void send(f32 dt);
+
+	///
+	void unit_destroyed_callback(UnitId unit);
+};
+
+} // namespace crown
@@ -3,6 +3,7 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
 #include "core/math/matrix3x3.h"
@@ -10,16 +11,102 @@
 #include "core/math/quaternion.h"
 #include "core/math/vector3.h"
 #include "core/memory/allocator.h"
+#include "core/memory/temp_allocator.h"
+#include "core/thread/job_system.h"
 #include "world/scene_graph.h"
+#include "world/snapshot.h"
 #include "world/unit_manager.h"
+#include <algorithm> // std::sort
 #include <stdint.h> // UINT_MAX
 #include <string.h> // memcpy
 
 namespace crown
 {
-static void unit_destroyed_callback_bridge(UnitId id, void* user_ptr)
+static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
 {
-	((SceneGraph*)user_ptr)->unit_destroyed_callback(id);
+	for (u32 i = 0; i < num; ++i)
+		((SceneGraph*)user_ptr)->unit_destroyed_callback(units[i]);
+}
+
+static Matrix4x4 pose_matrix(const SceneGraph::Pose& pose)
+{
+	Matrix4x4 tr = matrix4x4(quaternion(pose.rotation), pose.position);
+	set_scale(tr, pose.scale);
+	return tr;
+}
+
+// Removes the scale from the axes of @a m.
+static void normalize_axes(Matrix4x4& m)
+{
+	Vector3 mx = x(m);
+	Vector3 my = y(m);
+	Vector3 mz = z(m);
+	set_x(m, normalize(mx));
+	set_y(m, normalize(my));
+	set_z(m, normalize(mz));
+}
+
+// Returns the pose between @a a and @a b at @a t.
+static Matrix4x4 interpolate(const Matrix4x4& a, const Matrix4x4& b, f32 t)
+{
+	SceneGraph::Pose pa;
+	SceneGraph::Pose pb;
+	pa = a;
+	pb = b;
+
+	SceneGraph::Pose pose;
+	pose.position = lerp(pa.position, pb.position, t);
+	pose.rotation = matrix3x3(lerp(quaternion(pa.rotation), quaternion(pb.rotation), t));
+	pose.scale    = lerp(pa.scale, pb.scale, t);
+	return pose_matrix(pose);
+}
+
+// Reorders @a data so that the i-th element is the one at order[i].
+template <typename T>
+static void permute(T* data, const u32* order, u32 num, void* scratch)
+{
+	T* tmp = (T*)scratch;
+	for (u32 i = 0; i < num; ++i)
+		tmp[i] = data[order[i]];
+	memcpy(data, tmp, num*sizeof(T));
+}
+
+// Makes the valid instances in @a data refer to the new indices in @a remap.
+static void remap_instances(TransformInstance* data, const u32* remap, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		if (is_valid(data[i]))
+			data[i].i = remap[data[i].i];
+	}
+}
+
+// Removes the node @a i from the list of changed nodes.
+static void remove_changed(Array<u32>& changed, u32 i)
+{
+	for (u32 j = 0; j < array::size(changed); ++j)
+	{
+		if (changed[j] == i)
+		{
+			changed[j] = array::back(changed);
+			array::pop_back(changed);
+			return;
+		}
+	}
+}
+
+struct TransformJob
+{
+	SceneGraph* sg;
+	const u32* roots; // Nodes whose subtrees must be updated
+};
+
+static void transform_job(u32 begin, u32 end, void* user_data)
+{
+	TransformJob& tj = *(TransformJob*)user_data;
+
+	for (u32 i = begin; i < end; ++i)
+		tj.sg->transform_range(tj.roots[i], tj.roots[i] + tj.sg->_data.count[tj.roots[i]]);
 }
 
 SceneGraph::Pose& SceneGraph::Pose::operator=(const Matrix4x4& m)
@@ -40,6 +127,9 @@ SceneGraph::SceneGraph(Allocator& a, UnitManager& um)
 	, _allocator(&a)
 	, _unit_manager(&um)
 	, _map(a)
+	, _changed(a)
+	, _moving(a)
+	, _sorted(true)
 {
 	um.register_destroy_function(unit_destroyed_callback_bridge, this);
 }
@@ -61,13 +151,14 @@ TransformInstance SceneGraph::make_instance(u32 i)
 
 void SceneGraph::allocate(u32 num)
 {
-	CE_ASSERT(num > _data.size, "num > _data.size");
+	CE_ASSERT(num >= _data.size, "num >= _data.size");
 
 	const u32 bytes = 0
 		+ num*sizeof(UnitId) + alignof(UnitId)
-		+ num*sizeof(Matrix4x4) + alignof(Matrix4x4)
+		+ num*sizeof(Matrix4x4) * 3 + alignof(Matrix4x4)
 		+ num*sizeof(Pose) + alignof(Pose)
 		+ num*sizeof(TransformInstance) * 4 + alignof(TransformInstance)
+		+ num*sizeof(u32) + alignof(u32)
 		+ num*sizeof(bool) + alignof(bool)
 		;
 
@@ -78,20 +169,26 @@ void SceneGraph::allocate(u32 num)
 
 	new_data.unit         = (UnitId*           )new_data.buffer;
 	new_data.world        = (Matrix4x4*        )memory::align_top(new_data.unit + num,         alignof(Matrix4x4        ));
-	new_data.local        = (Pose*             )memory::align_top(new_data.world + num,        alignof(Pose             ));
+	new_data.world_prev   = new_data.world + num;
+	new_data.world_curr   = new_data.world_prev + num;
+	new_data.local        = (Pose*             )memory::align_top(new_data.world_curr + num,   alignof(Pose             ));
 	new_data.parent       = (TransformInstance*)memory::align_top(new_data.local + num,        alignof(TransformInstance));
 	new_data.first_child  = (TransformInstance*)memory::align_top(new_data.parent + num,       alignof(TransformInstance));
 	new_data.next_sibling = (TransformInstance*)memory::align_top(new_data.first_child + num,  alignof(TransformInstance));
 	new_data.prev_sibling = (TransformInstance*)memory::align_top(new_data.next_sibling + num, alignof(TransformInstance));
-	new_data.changed      = (bool*             )memory::align_top(new_data.prev_sibling + num, alignof(bool             ));
+	new_data.count        = (u32*              )memory::align_top(new_data.prev_sibling + num, alignof(u32              ));
+	new_data.changed      = (bool*             )memory::align_top(new_data.count + num,        alignof(bool             ));
 
 	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
 	memcpy(new_data.world, _data.world, _data.size * sizeof(Matrix4x4));
+	memcpy(new_data.world_prev, _data.world_prev, _data.size * sizeof(Matrix4x4));
+	memcpy(new_data.world_curr, _data.world_curr, _data.size * sizeof(Matrix4x4));
 	memcpy(new_data.local, _data.local, _data.size * sizeof(Pose));
 	memcpy(new_data.parent, _data.parent, _data.size * sizeof(TransformInstance));
 	memcpy(new_data.first_child, _data.first_child, _data.size * sizeof(TransformInstance));
 	memcpy(new_data.next_sibling, _data.next_sibling, _data.size * sizeof(TransformInstance));
 	memcpy(new_data.prev_sibling, _data.prev_sibling, _data.size * sizeof(TransformInstance));
+	memcpy(new_data.count, _data.count, _data.size * sizeof(u32));
 	memcpy(new_data.changed, _data.changed, _data.size * sizeof(bool));
 
 	_allocator->deallocate(_data.buffer);
@@ -126,11 +223,14 @@ TransformInstance SceneGraph::create(UnitId unit, const Matrix4x4& pose)
 
 	_data.unit[last]           = unit;
 	_data.world[last]          = pose;
+	_data.world_prev[last]     = pose;
+	_data.world_curr[last]     = pose;
 	_data.local[last]          = pose;
 	_data.parent[last].i       = UINT32_MAX;
 	_data.first_child[last].i  = UINT32_MAX;
 	_data.next_sibling[last].i = UINT32_MAX;
 	_data.prev_sibling[last].i = UINT32_MAX;
+	_data.count[last]          = 1;
 	_data.changed[last]        = false;
 
 	++_data.size;
@@ -145,25 +245,92 @@ void SceneGraph::destroy(UnitId unit, TransformInstance /*id*/)
 	TransformInstance i = make_instance(hash_map::get(_map, unit, UINT32_MAX));
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
 
-	const u32 last = _data.size - 1;
-	const UnitId u = _data.unit[i.i];
-	const UnitId last_u = _data.unit[last];
+	// Children become roots and keep their world pose
+	TransformInstance child = _data.first_child[i.i];
+	while (is_valid(child))
+	{
+		const TransformInstance next = _data.next_sibling[child.i];
+		_data.local[child.i] = _data.world[child.i];
+		_data.parent[child.i].i = UINT32_MAX;
+		_data.next_sibling[child.i].i = UINT32_MAX;
+		_data.prev_sibling[child.i].i = UINT32_MAX;
+		child = next;
+		_sorted = false;
+	}
+	_data.first_child[i.i].i = UINT32_MAX;
 
-	_data.unit[i.i]         = _data.unit[last];
-	_data.world[i.i]        = _data.world[last];
-	_data.local[i.i]        = _data.local[last];
-	_data.parent[i.i]       = _data.parent[last];
-	_data.first_child[i.i]  = _data.first_child[last];
-	_data.next_sibling[i.i] = _data.next_sibling[last];
-	_data.prev_sibling[i.i] = _data.prev_sibling[last];
-	_data.changed[i.i]      = _data.changed[last];
+	unlink(unit);
 
-	hash_map::set(_map, last_u, i.i);
-	hash_map::remove(_map, u);
+	if (_data.changed[i.i])
+		remove_changed(_changed, i.i);
+	remove_changed(_moving, i.i);
+
+	const u32 last = _data.size - 1;
+	if (i.i != last)
+		move(last, i.i);
+
+	hash_map::remove(_map, unit);
 
 	--_data.size;
 }
 
+void SceneGraph::move(u32 from, u32 to)
+{
+	_data.unit[to]         = _data.unit[from];
+	_data.world[to]        = _data.world[from];
+	_data.world_prev[to]   = _data.world_prev[from];
+	_data.world_curr[to]   = _data.world_curr[from];
+	_data.local[to]        = _data.local[from];
+	_data.parent[to]       = _data.parent[from];
+	_data.first_child[to]  = _data.first_child[from];
+	_data.next_sibling[to] = _data.next_sibling[from];
+	_data.prev_sibling[to] = _data.prev_sibling[from];
+	_data.count[to]        = _data.count[from];
+	_data.changed[to]      = _data.changed[from];
+
+	if (_data.changed[to])
+	{
+		for (u32 i = 0; i < array::size(_changed); ++i)
+		{
+			if (_changed[i] == from)
+			{
+				_changed[i] = to;
+				break;
+			}
+		}
+	}
+
+	for (u32 i = 0; i < array::size(_moving); ++i)
+	{
+		if (_moving[i] == from)
+		{
+			_moving[i] = to;
+			break;
+		}
+	}
+
+	// Update the nodes which refer to the moved one
+	const TransformInstance ti = make_instance(to);
+	const TransformInstance parent = _data.parent[to];
+
+	if (is_valid(_data.prev_sibling[to]))
+		_data.next_sibling[_data.prev_sibling[to].i] = ti;
+	else if (is_valid(parent))
+		_data.first_child[parent.i] = ti;
+
+	if (is_valid(_data.next_sibling[to]))
+		_data.prev_sibling[_data.next_sibling[to].i] = ti;
+
+	for (TransformInstance c = _data.first_child[to]; is_valid(c); c = _data.next_sibling[c.i])
+		_data.parent[c.i] = ti;
+
+	// Nodes in a hierarchy may end up before their parent
+	if (is_valid(parent) || is_valid(_data.first_child[to]))
+		_sorted = false;
+
+	hash_map::set(_map, _data.unit[to], to);
+}
+
 TransformInstance SceneGraph::instances(UnitId unit)
 {
 	return make_instance(hash_map::get(_map, unit, UINT32_MAX));
@@ -231,9 +398,7 @@ Matrix4x4 SceneGraph::local_pose(UnitId unit)
 {
 	TransformInstance i = make_instance(hash_map::get(_map, unit, UINT32_MAX));
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
-	Matrix4x4 tr = matrix4x4(quaternion(_data.local[i.i].rotation), _data.local[i.i].position);
-	set_scale(tr, _data.local[i.i].scale);
-	return tr;
+	return pose_matrix(_data.local[i.i]);
 }
 
 Vector3 SceneGraph::world_position(UnitId unit)
@@ -261,7 +426,24 @@ void SceneGraph::set_world_pose(TransformInstance i, const Matrix4x4& pose)
 {
 	CE_ASSERT(i.i < _data.size, "Index out of bounds");
 	_data.world[i.i] = pose;
-	_data.changed[i.i] = true;
+	mark_changed(i.i);
+}
+
+void SceneGraph::set_world_poses(const UnitId* units, TransformInstance* transforms, const Vector3* positions, const Quaternion* rotations, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		u32 n = transforms[i].i;
+		if (n >= _data.size || !(_data.unit[n] == units[i]))
+		{
+			n = hash_map::get(_map, units[i], UINT32_MAX);
+			transforms[i].i = n;
+		}
+		CE_ASSERT(n < _data.size, "Index out of bounds");
+
+		_data.world[n] = matrix4x4(rotations[i], positions[i]);
+		mark_changed(n);
+	}
 }
 
 u32 SceneGraph::num_nodes() const
@@ -269,63 +451,105 @@ u32 SceneGraph::num_nodes() const
 	return _data.size;
 }
 
-void SceneGraph::link(UnitId child, UnitId parent)
+const UnitId* SceneGraph::units() const
 {
-	TransformInstance tc = make_instance(hash_map::get(_map, child, UINT32_MAX));
-	TransformInstance tp = make_instance(hash_map::get(_map, parent, UINT32_MAX));
-	CE_ASSERT(tc.i < _data.size, "Index out of bounds");
-	CE_ASSERT(tp.i < _data.size, "Index out of bounds");
+	return _data.unit;
+}
 
-	unlink(child);
+const Matrix4x4* SceneGraph::world_poses() const
+{
+	return _data.world;
+}
 
-	if (!is_valid(_data.first_child[tp.i]))
+void SceneGraph::join(const UnitId* units, u32 num, Array<u32>& indices, Array<TransformInstance>& instances)
+{
+	for (u32 i = 0; i < num; ++i)
 	{
-		_data.first_child[tp.i] = tc;
-		_data.parent[tc.i] = tp;
+		const u32 ti = hash_map::get(_map, units[i], UINT32_MAX);
+		if (ti == UINT32_MAX)
+			continue;
+
+		array::push_back(indices, i);
+		array::push_back(instances, make_instance(ti));
 	}
-	else
-	{
-		TransformInstance prev = { UINT32_MAX };
-		TransformInstance node = _data.first_child[tp.i];
-		while (is_valid(node))
-		{
-			prev = node;
-			node = _data.next_sibling[node.i];
-		}
+}
+
+void SceneGraph::link(UnitId child, UnitId parent)
+{
+	link_batch(&child, &parent, 1);
+}
 
-		_data.next_sibling[prev.i] = tc;
+void SceneGraph::link_batch(const UnitId* children, const UnitId* parents, u32 num)
+{
+	// Group the links by parent, preserving the order of the children of
+	// each parent: key = [parent index][link index]
+	TempAllocator1024 ta;
+	Array<u64> keys(ta);
+	array::resize(keys, num);
 
-		_data.first_child[tc.i].i = UINT32_MAX;
-		_data.next_sibling[tc.i].i = UINT32_MAX;
-		_data.prev_sibling[tc.i] = prev;
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 tc = hash_map::get(_map, children[i], UINT32_MAX);
+		const u32 tp = hash_map::get(_map, parents[i], UINT32_MAX);
+		CE_ASSERT(tc < _data.size, "Index out of bounds");
+		CE_ASSERT(tp < _data.size, "Index out of bounds");
+		CE_UNUSED(tc);
+
+		unlink(children[i]);
+		keys[i] = (u64(tp) << 32) | i;
 	}
 
-	Matrix4x4 parent_tr = _data.world[tp.i];
-	Matrix4x4 child_tr = _data.world[tc.i];
-	const Vector3 cs = scale(child_tr);
+	std::sort(array::begin(keys), array::end(keys));
 
-	Vector3 px = x(parent_tr);
-	Vector3 py = y(parent_tr);
-	Vector3 pz = z(parent_tr);
-	Vector3 cx = x(child_tr);
-	Vector3 cy = y(child_tr);
-	Vector3 cz = z(child_tr);
+	for (u32 k = 0; k < num; )
+	{
+		const u32 tp = u32(keys[k] >> 32);
 
-	set_x(parent_tr, normalize(px));
-	set_y(parent_tr, normalize(py));
-	set_z(parent_tr, normalize(pz));
-	set_x(child_tr, normalize(cx));
-	set_y(child_tr, normalize(cy));
-	set_z(child_tr, normalize(cz));
+		// Linking does not change world poses, so the parent pose is
+		// inverted once for all of its new children
+		Matrix4x4 parent_tr = _data.world[tp];
+		normalize_axes(parent_tr);
+		const Matrix4x4 parent_inv = get_inverted(parent_tr);
 
-	const Matrix4x4 rel_tr = child_tr * get_inverted(parent_tr);
+		TransformInstance last = { UINT32_MAX };
+		for (TransformInstance node = _data.first_child[tp]; is_valid(node); node = _data.next_sibling[node.i])
+			last = node;
 
-	_data.local[tc.i].position = translation(rel_tr);
-	_data.local[tc.i].rotation = to_matrix3x3(rel_tr);
-	_data.local[tc.i].scale = cs;
-	_data.parent[tc.i] = tp;
+		for (; k < num && u32(keys[k] >> 32) == tp; ++k)
+		{
+			TransformInstance tc = make_instance(hash_map::get(_map, children[u32(keys[k])], UINT32_MAX));
+
+			if (!is_valid(last))
+			{
+				_data.first_child[tp] = tc;
+			}
+			else
+			{
+				_data.next_sibling[last.i] = tc;
+				_data.prev_sibling[tc.i] = last;
+			}
+			last = tc;
+
+			Matrix4x4 child_tr = _data.world[tc.i];
+			const Vector3 cs = scale(child_tr);
+			normalize_axes(child_tr);
+
+			const Matrix4x4 rel_tr = child_tr * parent_inv;
+
+			_data.local[tc.i].position = translation(rel_tr);
+			_data.local[tc.i].rotation = to_matrix3x3(rel_tr);
+			_data.local[tc.i].scale = cs;
+			_data.parent[tc.i] = make_instance(tp);
+
+			// The world pose of the subtree does not change: the nodes are
+			// sorted lazily, once for the whole batch, the next time a
+			// transform is propagated
+			_data.world[tc.i] = pose_matrix(_data.local[tc.i]) * parent_tr;
+			mark_changed(tc.i);
+		}
+	}
 
-	transform(parent_tr, tc);
+	_sorted = false;
 }
 
 void SceneGraph::unlink(UnitId unit)
@@ -344,55 +568,397 @@ void SceneGraph::unlink(UnitId unit)
 	if (is_valid(_data.next_sibling[tc.i]))
 		_data.prev_sibling[_data.next_sibling[tc.i].i] = _data.prev_sibling[tc.i];
 
+	_data.local[tc.i] = _data.world[tc.i];
 	_data.parent[tc.i].i = UINT32_MAX;
 	_data.next_sibling[tc.i].i = UINT32_MAX;
 	_data.prev_sibling[tc.i].i = UINT32_MAX;
+
+	_sorted = false;
 }
 
-void SceneGraph::clear_changed()
+void SceneGraph::snapshot(Buffer& buf)
 {
-	for (u32 i = 0; i < _data.size; ++i)
+	const u32 num = _data.size;
+	snapshot::write(buf, num);
+	snapshot::write(buf, _data.unit, num*sizeof(UnitId));
+	snapshot::write(buf, _data.world, num*sizeof(Matrix4x4));
+	snapshot::write(buf, _data.world_prev, num*sizeof(Matrix4x4));
+	snapshot::write(buf, _data.world_curr, num*sizeof(Matrix4x4));
+	snapshot::write(buf, _data.local, num*sizeof(Pose));
+	snapshot::write(buf, _data.parent, num*sizeof(TransformInstance));
+	snapshot::write(buf, _data.first_child, num*sizeof(TransformInstance));
+	snapshot::write(buf, _data.next_sibling, num*sizeof(TransformInstance));
+	snapshot::write(buf, _data.prev_sibling, num*sizeof(TransformInstance));
+	snapshot::write(buf, _data.count, num*sizeof(u32));
+	snapshot::write(buf, _sorted);
+}
+
+bool SceneGraph::can_restore(const char* data)
+{
+	u32 num;
+	snapshot::read(data, num);
+	if (num != _data.size)
+		return false;
+
+	for (u32 i = 0; i < num; ++i)
 	{
-		_data.changed[i] = false;
+		if (!hash_map::has(_map, snapshot::element<UnitId>(data, i)))
+			return false;
 	}
+
+	return true;
 }
 
-void SceneGraph::get_changed(Array<UnitId>& units, Array<Matrix4x4>& world_poses)
+void SceneGraph::restore(const char* data)
+{
+	u32 num;
+	snapshot::read(data, num);
+	CE_ASSERT(num == _data.size, "Nodes do not match");
+
+	snapshot::read(data, _data.unit, num*sizeof(UnitId));
+	snapshot::read(data, _data.world, num*sizeof(Matrix4x4));
+	snapshot::read(data, _data.world_prev, num*sizeof(Matrix4x4));
+	snapshot::read(data, _data.world_curr, num*sizeof(Matrix4x4));
+	snapshot::read(data, _data.local, num*sizeof(Pose));
+	snapshot::read(data, _data.parent, num*sizeof(TransformInstance));
+	snapshot::read(data, _data.first_child, num*sizeof(TransformInstance));
+	snapshot::read(data, _data.next_sibling, num*sizeof(TransformInstance));
+	snapshot::read(data, _data.prev_sibling, num*sizeof(TransformInstance));
+	snapshot::read(data, _data.count, num*sizeof(u32));
+	snapshot::read(data, _sorted);
+
+	for (u32 i = 0; i < num; ++i)
+		hash_map::set(_map, _data.unit[i], i);
+
+	// Propagate the restored poses to the other managers
+	memset(_data.changed, 0, num*sizeof(bool));
+	array::clear(_changed);
+	array::clear(_moving);
+	for (u32 i = 0; i < num; ++i)
+		mark_changed(i);
+}
+
+void SceneGraph::clear_changed()
+{
+	for (u32 i = 0; i < array::size(_changed); ++i)
+		_data.changed[_changed[i]] = false;
+
+	array::clear(_changed);
+}
+
+void SceneGraph::end_step()
 {
-	for (u32 i = 0; i < _data.size; ++i)
+	const u32 num_changed = array::size(_changed);
+
+	// Nodes which stopped moving rest at their current pose
+	for (u32 i = 0; i < array::size(_moving); ++i)
 	{
-		if (_data.changed[i])
+		const u32 n = _moving[i];
+		if (!_data.changed[n])
 		{
-			array::push_back(units, _data.unit[i]);
-			array::push_back(world_poses, _data.world[i]);
+			_data.world_prev[n] = _data.world_curr[n];
+			mark_changed(n);
 		}
 	}
+	array::clear(_moving);
+
+	for (u32 i = 0; i < num_changed; ++i)
+	{
+		const u32 n = _changed[i];
+		_data.world_prev[n] = _data.world_curr[n];
+		_data.world_curr[n] = _data.world[n];
+		array::push_back(_moving, n);
+	}
+}
+
+void SceneGraph::get_interpolated(f32 alpha, Array<UnitId>& units, Array<Matrix4x4>& world_poses)
+{
+	const u32 num = array::size(_moving);
+	array::reserve(units, array::size(units) + num);
+	array::reserve(world_poses, array::size(world_poses) + num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 n = _moving[i];
+		array::push_back(units, _data.unit[n]);
+		array::push_back(world_poses, interpolate(_data.world_prev[n], _data.world_curr[n], alpha));
+	}
+}
+
+Matrix4x4 SceneGraph::interpolated_world_pose(UnitId unit, f32 alpha)
+{
+	TransformInstance i = make_instance(hash_map::get(_map, unit, UINT32_MAX));
+	CE_ASSERT(i.i < _data.size, "Index out of bounds");
+
+	for (u32 j = 0; j < array::size(_moving); ++j)
+	{
+		if (_moving[j] == i.i)
+			return interpolate(_data.world_prev[i.i], _data.world_curr[i.i], alpha);
+	}
+
+	return _data.world[i.i];
+}
+
+void SceneGraph::get_changed(Array<UnitId>& units, Array<Matrix4x4>& world_poses)
+{
+	const u32 num = array::size(_changed);
+	array::reserve(units, array::size(units) + num);
+	array::reserve(world_poses, array::size(world_poses) + num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 n = _changed[i];
+		array::push_back(units, _data.unit[n]);
+		array::push_back(world_poses, _data.world[n]);
+	}
+}
+
+void SceneGraph::mark_changed(u32 i)
+{
+	if (_data.changed[i])
+		return;
+
+	_data.changed[i] = true;
+	array::push_back(_changed, i);
 }
 
 void SceneGraph::set_local(TransformInstance i)
 {
+	if (!_sorted)
+	{
+		const UnitId unit = _data.unit[i.i];
+		sort();
+		i = make_instance(hash_map::get(_map, unit, UINT32_MAX));
+	}
+
 	TransformInstance parent = _data.parent[i.i];
 	Matrix4x4 parent_tm = is_valid(parent) ? _data.world[parent.i] : MATRIX4X4_IDENTITY;
 	transform(parent_tm, i);
-
-	_data.changed[i.i] = true;
 }
 
 void SceneGraph::transform(const Matrix4x4& parent, TransformInstance i)
 {
-	_data.world[i.i] = local_pose(_data.unit[i.i]) * parent;
+	CE_ASSERT(_sorted, "Nodes are not sorted");
 
-	TransformInstance child = _data.first_child[i.i];
-	while (is_valid(child))
+	_data.world[i.i] = pose_matrix(_data.local[i.i]) * parent;
+	mark_changed(i.i);
+
+	// The subtree follows the node: parents are always updated before
+	// their children
+	const u32 end = i.i + _data.count[i.i];
+	transform_range(i.i + 1, end);
+
+	for (u32 j = i.i + 1; j < end; ++j)
+		mark_changed(j);
+}
+
+void SceneGraph::transform_range(u32 first, u32 end)
+{
+	for (u32 j = first; j < end; ++j)
 	{
-		transform(_data.world[i.i], child);
-		child = _data.next_sibling[child.i];
+		const TransformInstance parent = _data.parent[j];
+		const Matrix4x4 local = pose_matrix(_data.local[j]);
+		_data.world[j] = is_valid(parent) ? local * _data.world[parent.i] : local;
 	}
 }
 
+void SceneGraph::set_local_poses(const UnitId* units, const Matrix4x4* poses, u32 num)
+{
+	sort();
+
+	TempAllocator4096 ta;
+	Array<u32> roots(ta);
+	array::resize(roots, num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 n = hash_map::get(_map, units[i], UINT32_MAX);
+		CE_ASSERT(n < _data.size, "Index out of bounds");
+		_data.local[n] = poses[i];
+		roots[i] = n;
+	}
+
+	transform_subtrees(roots);
+}
+
+void SceneGraph::set_local_positions(const UnitId* units, const Vector3* positions, u32 num)
+{
+	sort();
+
+	TempAllocator4096 ta;
+	Array<u32> roots(ta);
+	array::resize(roots, num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 n = hash_map::get(_map, units[i], UINT32_MAX);
+		CE_ASSERT(n < _data.size, "Index out of bounds");
+		_data.local[n].position = positions[i];
+		roots[i] = n;
+	}
+
+	transform_subtrees(roots);
+}
+
+void SceneGraph::set_local_rotations(const UnitId* units, const Quaternion* rotations, u32 num)
+{
+	sort();
+
+	TempAllocator4096 ta;
+	Array<u32> roots(ta);
+	array::resize(roots, num);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 n = hash_map::get(_map, units[i], UINT32_MAX);
+		CE_ASSERT(n < _data.size, "Index out of bounds");
+		_data.local[n].rotation = matrix3x3(rotations[i]);
+		roots[i] = n;
+	}
+
+	transform_subtrees(roots);
+}
+
+void SceneGraph::transform_subtrees(Array<u32>& roots)
+{
+	const u32 num = array::size(roots);
+
+	// Keep only the nodes which are not in the subtree of another one:
+	// the remaining subtrees are disjoint and do not depend on each other
+	std::sort(array::begin(roots), array::end(roots));
+
+	u32 num_roots = 0;
+	u32 num_nodes = 0;
+	u32 end = 0;
+	for (u32 i = 0; i < num; ++i)
+	{
+		if (roots[i] < end)
+			continue;
+
+		end = roots[i] + _data.count[roots[i]];
+		num_nodes += _data.count[roots[i]];
+		roots[num_roots++] = roots[i];
+	}
+	array::resize(roots, num_roots);
+
+	TransformJob tj;
+	tj.sg = this;
+	tj.roots = array::begin(roots);
+
+	if (num_nodes < CROWN_SCENE_GRAPH_PARALLEL_THRESHOLD)
+		transform_job(0, num_roots, &tj);
+	else
+		job_system::parallel_for(0, num_roots, 0, transform_job, &tj);
+
+	// Merge the changes
+	for (u32 i = 0; i < num_roots; ++i)
+	{
+		for (u32 j = roots[i]; j < roots[i] + _data.count[roots[i]]; ++j)
+			mark_changed(j);
+	}
+}
+
+void SceneGraph::sort()
+{
+	if (_sorted)
+		return;
+
+	const u32 num = _data.size;
+
+	Array<u32> order(*_allocator);
+	Array<u32> remap(*_allocator);
+	array::resize(order, num);
+	array::resize(remap, num);
+
+	// Visit each tree in depth-first order
+	u32 n = 0;
+	for (u32 root = 0; root < num; ++root)
+	{
+		if (is_valid(_data.parent[root]))
+			continue;
+
+		u32 node = root;
+		while (true)
+		{
+			order[n++] = node;
+
+			if (is_valid(_data.first_child[node]))
+			{
+				node = _data.first_child[node].i;
+				continue;
+			}
+
+			while (node != root && !is_valid(_data.next_sibling[node]))
+				node = _data.parent[node].i;
+
+			if (node == root)
+				break;
+
+			node = _data.next_sibling[node].i;
+		}
+	}
+	CE_ASSERT(n == num, "Cycle in the hierarchy");
+
+	for (u32 i = 0; i < num; ++i)
+		remap[order[i]] = i;
+
+	void* scratch = _allocator->allocate(num*sizeof(Matrix4x4));
+	permute(_data.unit, array::begin(order), num, scratch);
+	permute(_data.world, array::begin(order), num, scratch);
+	permute(_data.world_prev, array::begin(order), num, scratch);
+	permute(_data.world_curr, array::begin(order), num, scratch);
+	permute(_data.local, array::begin(order), num, scratch);
+	permute(_data.parent, array::begin(order), num, scratch);
+	permute(_data.first_child, array::begin(order), num, scratch);
+	permute(_data.next_sibling, array::begin(order), num, scratch);
+	permute(_data.prev_sibling, array::begin(order), num, scratch);
+	permute(_data.changed, array::begin(order), num, scratch);
+	_allocator->deallocate(scratch);
+
+	remap_instances(_data.parent, array::begin(remap), num);
+	remap_instances(_data.first_child, array::begin(remap), num);
+	remap_instances(_data.next_sibling, array::begin(remap), num);
+	remap_instances(_data.prev_sibling, array::begin(remap), num);
+
+	for (u32 i = 0; i < array::size(_changed); ++i)
+		_changed[i] = remap[_changed[i]];
+	for (u32 i = 0; i < array::size(_moving); ++i)
+		_moving[i] = remap[_moving[i]];
+
+	// Children follow their parent: accumulate the subtree sizes backwards
+	for (u32 i = 0; i < num; ++i)
+		_data.count[i] = 1;
+	for (u32 i = num; i-- > 0; )
+	{
+		if (is_valid(_data.parent[i]))
+			_data.count[_data.parent[i].i] += _data.count[i];
+	}
+
+	for (u32 i = 0; i < num; ++i)
+		hash_map::set(_map, _data.unit[i], i);
+
+	_sorted = true;
+}
+
 void SceneGraph::grow()
 {
 	allocate(_data.capacity * 2 + 1);
 }
 
+void SceneGraph::reserve(u32 num)
+{
+	if (_data.size + num > _data.capacity)
+		allocate(_data.size + num);
+
+	hash_map::reserve(_map, hash_map::size(_map) + num);
+}
+
+void SceneGraph::shrink_to_fit()
+{
+	if (_data.capacity > _data.size)
+		allocate(_data.size);
+
+	hash_map::shrink_to_fit(_map);
+}
+
 } // namespace crown
@@ -14,6 +14,8 @@
 namespace crown
 {
 /// Represents a collection of nodes, possibly linked together to form a tree.
+/// Nodes are stored in depth-first order, so that each node is followed by
+/// its whole subtree and world poses can be updated with a linear sweep.
 ///
 /// @ingroup World
 struct SceneGraph
@@ -35,11 +37,14 @@ struct SceneGraph
 			, buffer(NULL)
 			, unit(NULL)
 			, world(NULL)
+			, world_prev(NULL)
+			, world_curr(NULL)
 			, local(NULL)
 			, parent(NULL)
 			, first_child(NULL)
 			, next_sibling(NULL)
 			, prev_sibling(NULL)
+			, count(NULL)
 			, changed(NULL)
 		{
 		}
@@ -50,12 +55,15 @@ struct SceneGraph
 
 		UnitId* unit;
 		Matrix4x4* world;
+		Matrix4x4* world_prev; ///< World pose at the end of the step before the last one.
+		Matrix4x4* world_curr; ///< World pose at the end of the last step.
 		Pose* local;
 		TransformInstance* parent;
 		TransformInstance* first_child;
 		TransformInstance* next_sibling;
 		TransformInstance* prev_sibling;
-		bool* changed;
+		u32* count; ///< Number of nodes in the subtree, valid when _sorted.
+		bool* changed; ///< Whether the node is in _changed.
 	};
 
 	u32 _marker;
@@ -63,6 +71,9 @@ struct SceneGraph
 	UnitManager* _unit_manager;
 	InstanceData _data;
 	HashMap<UnitId, u32> _map;
+	Array<u32> _changed; ///< Indices of the nodes changed since clear_changed().
+	Array<u32> _moving; ///< Indices of the nodes moved during the last step.
+	bool _sorted;
 
 	///
 	SceneGraph(Allocator& a, UnitManager& um);
@@ -76,6 +87,12 @@ struct SceneGraph
 	/// Creates a new transform instance for unit @a id.
 	TransformInstance create(UnitId id, const Vector3& pos, const Quaternion& rot, const Vector3& scale);
 
+	/// Makes room for @a num more transform instances.
+	void reserve(u32 num);
+
+	/// Frees the memory of the transform instances which have been destroyed.
+	void shrink_to_fit();
+
 	/// Destroys the transform for the @a unit. The transform is ignored.
 	void destroy(UnitId unit, TransformInstance id);
 
@@ -97,6 +114,20 @@ struct SceneGraph
 	/// @copydoc SceneGraph::set_local_position()
 	void set_local_pose(UnitId unit, const Matrix4x4& pose);
 
+	/// Sets the local pose of each of the @a num @a units to the
+	/// corresponding pose in @a poses. The world poses of the units and of
+	/// their descendants are updated in parallel when many nodes are
+	/// affected, since hierarchies with different roots are independent.
+	void set_local_poses(const UnitId* units, const Matrix4x4* poses, u32 num);
+
+	/// Sets the local position of each of the @a num @a units to the
+	/// corresponding position in @a positions, see set_local_poses().
+	void set_local_positions(const UnitId* units, const Vector3* positions, u32 num);
+
+	/// Sets the local rotation of each of the @a num @a units to the
+	/// corresponding rotation in @a rotations, see set_local_poses().
+	void set_local_rotations(const UnitId* units, const Quaternion* rotations, u32 num);
+
 	/// Returns the local position, rotation or pose of the given @a unit.
 	Vector3 local_position(UnitId unit);
 
@@ -120,20 +151,82 @@ struct SceneGraph
 
 	void set_world_pose(TransformInstance i, const Matrix4x4& pose);
 
+	/// Sets the world pose of each of the @a num @a units to the pose
+	/// described by the corresponding entries in @a positions and
+	/// @a rotations. The nodes are accessed through the cached
+	/// @a transforms of the units: the ones made stale by nodes being
+	/// moved are looked up again and refreshed in place.
+	void set_world_poses(const UnitId* units, TransformInstance* transforms, const Vector3* positions, const Quaternion* rotations, u32 num);
+
+	/// Ends a simulation step: the world poses of the nodes changed since
+	/// clear_changed() become their current poses, and the current ones
+	/// become the previous ones. Nodes which moved during the previous
+	/// step but not during this one are marked as changed, so that their
+	/// final pose is propagated even if it was being interpolated.
+	void end_step();
+
+	/// Returns the poses of the nodes moved during the last step,
+	/// interpolated by @a alpha between their previous and current poses.
+	void get_interpolated(f32 alpha, Array<UnitId>& units, Array<Matrix4x4>& world_poses);
+
+	/// Returns the world pose of @a unit interpolated by @a alpha between
+	/// its previous and current poses if it moved during the last step, or
+	/// its world pose otherwise.
+	Matrix4x4 interpolated_world_pose(UnitId unit, f32 alpha);
+
 	/// Returns the number of nodes in the graph.
 	u32 num_nodes() const;
 
+	/// Returns the units of the nodes, num_nodes() in total. The node at
+	/// index i is the TransformInstance { i }.
+	/// The returned pointers, and the indices of the nodes, are only valid
+	/// until the next node is created or destroyed, or the graph is
+	/// linked, unlinked or sorted.
+	const UnitId* units() const;
+
+	/// Returns the world poses of the nodes, num_nodes() in total.
+	/// @copydetails SceneGraph::units()
+	const Matrix4x4* world_poses() const;
+
+	/// Appends to @a indices the index into @a units of each of the @a num
+	/// @a units which has a transform, and to @a instances its transform.
+	/// This joins the instances of any other component to the transforms
+	/// with a single pass, e.g. with RenderWorld::mesh_units().
+	void join(const UnitId* units, u32 num, Array<u32>& indices, Array<TransformInstance>& instances);
+
 	/// Links the unit @a child to the unit @a parent.
 	void link(UnitId child, UnitId parent);
 
+	/// Links each of the @a num @a children to the corresponding unit in
+	/// @a parents. The pose of each parent is inverted once for all of its
+	/// new children and the nodes are sorted once, the next time a
+	/// transform is propagated, instead of once per link.
+	void link_batch(const UnitId* children, const UnitId* parents, u32 num);
+
 	/// Unlinks the @a unit from its parent if it has any.
 	/// After unlinking, the @a unit's local pose is set to its previous world pose.
 	void unlink(UnitId unit);
 
+	/// Appends the nodes, with their poses and hierarchy, to @a buf.
+	void snapshot(Buffer& buf);
+
+	/// Returns whether the state at @a data, written by snapshot(), has
+	/// nodes for the same units as the graph.
+	bool can_restore(const char* data);
+
+	/// Restores the state at @a data, written by snapshot(). The order of
+	/// the nodes is restored as well and all of them are marked as changed.
+	void restore(const char* data);
+
 	void clear_changed();
 	void get_changed(Array<UnitId>& units, Array<Matrix4x4>& world_poses);
+	void mark_changed(u32 i);
 	void set_local(TransformInstance i);
 	void transform(const Matrix4x4& parent, TransformInstance i);
+	void transform_range(u32 first, u32 end);
+	void transform_subtrees(Array<u32>& roots);
+	void sort();
+	void move(u32 from, u32 to);
 	void grow();
 	void allocate(u32 num);
 	TransformInstance make_instance(u32 i);
@@ -5,11 +5,13 @@
 
 #include "core/containers/array.h"
 #include "core/containers/hash_map.h"
+#include "core/memory/temp_allocator.h"
 #include "lua/lua_environment.h"
 #include "lua/lua_stack.h"
 #include "resource/resource_manager.h"
 #include "world/script_world.h"
 #include "world/unit_manager.h"
+#include <algorithm> // std::sort
 
 namespace crown
 {
@@ -21,15 +23,111 @@ namespace script_world_internal
 		return inst;
 	}
 
+	struct Contact
+	{
+		u32 script_i;
+		u32 event_i;
+		u32 unit_i; ///< Which of the units of the event owns the script instance.
+
+		bool operator<(const Contact& other) const
+		{
+			return script_i < other.script_i
+				|| (script_i == other.script_i && event_i < other.event_i)
+				|| (script_i == other.script_i && event_i == other.event_i && unit_i < other.unit_i)
+				;
+		}
+	};
+
+	// Pushes a table of arrays (one per field) describing the @a num contacts.
+	static void push_collisions(LuaStack& stack, const PhysicsCollisionEvent* events, const Contact* contacts, u32 num)
+	{
+		const char* fields[] =
+		{
+			"type",
+			"unit",
+			"other_unit",
+			"actor",
+			"position",
+			"normal",
+			"distance"
+		};
+
+		stack.push_table(0, countof(fields));
+		for (u32 f = 0; f < countof(fields); ++f)
+		{
+			stack.push_key_begin(fields[f]);
+			stack.push_table(num);
+
+			for (u32 i = 0; i < num; ++i)
+			{
+				const PhysicsCollisionEvent& ev = events[contacts[i].event_i];
+				const u32 unit_i = contacts[i].unit_i;
+
+				stack.push_key_begin(i + 1);
+				switch (f)
+				{
+				case 0:
+					stack.push_string(ev.type == PhysicsCollisionEvent::TOUCH_BEGIN
+						? "touch_begin"
+						: ev.type == PhysicsCollisionEvent::TOUCHING
+						? "touching"
+						: "touch_end"
+						);
+					break;
+				case 1: stack.push_unit(ev.units[unit_i]); break;
+				case 2: stack.push_unit(ev.units[1-unit_i]); break;
+				case 3: stack.push_actor(ev.actors[unit_i]); break;
+				case 4: stack.push_vector3(ev.position); break;
+				case 5: stack.push_vector3(ev.normal); break;
+				case 6: stack.push_float(ev.distance); break;
+				default: break;
+				}
+				stack.push_key_end();
+			}
+
+			stack.push_key_end();
+		}
+	}
+
+	// Sorts the units of all the instances by script: the units of the
+	// script i are units[offsets[i]] .. units[offsets[i + 1]].
+	static void group_units(ScriptWorld& sw, Array<u32>& offsets, Array<UnitId>& units)
+	{
+		const u32 num_scripts = array::size(sw._script);
+		const u32 num_instances = array::size(sw._data);
+
+		array::resize(offsets, num_scripts + 1);
+		memset(array::begin(offsets), 0, (num_scripts + 1)*sizeof(u32));
+
+		for (u32 i = 0; i < num_instances; ++i)
+			++offsets[sw._data[i].script_i + 1];
+
+		for (u32 i = 0; i < num_scripts; ++i)
+			offsets[i + 1] += offsets[i];
+
+		array::resize(units, num_instances);
+		for (u32 i = 0; i < num_instances; ++i)
+		{
+			const u32 script_i = sw._data[i].script_i;
+			units[offsets[script_i]++] = sw._data[i].unit;
+		}
+
+		// Restore the offsets, which have been advanced to the end of each range
+		for (u32 i = num_scripts; i > 0; --i)
+			offsets[i] = offsets[i - 1];
+		offsets[0] = 0;
+	}
+
 	static void unit_destroyed_callback(ScriptWorld& sw, UnitId unit, ScriptInstance i)
 	{
 		if (hash_map::has(sw._map, unit))
 			script_world::destroy(sw, unit, i);
 	}
 
-	static void unit_destroyed_callback_bridge(UnitId unit, void* user_ptr)
+	static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
 	{
-		unit_destroyed_callback(*((ScriptWorld*)user_ptr), unit, make_instance(UINT32_MAX));
+		for (u32 i = 0; i < num; ++i)
+			unit_destroyed_callback(*((ScriptWorld*)user_ptr), units[i], make_instance(UINT32_MAX));
 	}
 } // script_world_internal
 
@@ -37,9 +135,12 @@ namespace script_world
 {
 	ScriptInstance create(ScriptWorld& sw, UnitId unit, const ScriptDesc& desc)
 	{
+		create(sw, &unit, 1, desc);
+		return script_world_internal::make_instance(hash_map::get(sw._map, unit, UINT32_MAX));
+	}
 
-		CE_ASSERT(!hash_map::has(sw._map, unit), "Unit already has script component");
-
+	void create(ScriptWorld& sw, const UnitId* units, u32 num, const ScriptDesc& desc)
+	{
 		u32 script_i = hash_map::get(sw._cache
 			, desc.script_resource
 			, UINT32_MAX
@@ -56,8 +157,8 @@ namespace script_world
 		{
 			script_i = array::size(sw._script);
 
-			sw._resource_manager->load(RESOURCE_TYPE_SCRIPT, desc.script_resource);
-			sw._resource_manager->flush();
+			sw._resource_manager->load(RESOURCE_TYPE_SCRIPT, desc.script_resource, ResourcePriority::CRITICAL);
+			sw._resource_manager->wait(RESOURCE_TYPE_SCRIPT, desc.script_resource);
 			const LuaResource* lr = (LuaResource*)sw._resource_manager->get(RESOURCE_TYPE_SCRIPT, desc.script_resource);
 
 			LuaStack stack = sw._lua_environment->execute(lr);
@@ -69,27 +170,37 @@ namespace script_world
 			hash_map::set(sw._cache, desc.script_resource, script_i);
 		}
 
-		ScriptWorld::InstanceData data;
-		data.unit     = unit;
-		data.script_i = script_i;
+		array::reserve(sw._data, array::size(sw._data) + num);
+		hash_map::reserve(sw._map, hash_map::size(sw._map) + num);
+
+		for (u32 i = 0; i < num; ++i)
+		{
+			CE_ASSERT(!hash_map::has(sw._map, units[i]), "Unit already has script component");
+
+			ScriptWorld::InstanceData data;
+			data.unit     = units[i];
+			data.script_i = script_i;
 
-		u32 instance_i = array::size(sw._data);
-		array::push_back(sw._data, data);
-		hash_map::set(sw._map, unit, instance_i);
+			u32 instance_i = array::size(sw._data);
+			array::push_back(sw._data, data);
+			hash_map::set(sw._map, units[i], instance_i);
+		}
 
+		// Notify the script of all the units at once
 		LuaStack stack(sw._lua_environment->L);
 		stack.push_function(LuaEnvironment::error);
 		lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sd.module_ref);
 		lua_getfield(stack.L, -1, "spawned");
 		stack.push_world(sw._world);
-		stack.push_table(1);
-		stack.push_key_begin(1);
-		stack.push_unit(unit);
-		stack.push_key_end();
+		stack.push_table(num);
+		for (u32 i = 0; i < num; ++i)
+		{
+			stack.push_key_begin(i + 1);
+			stack.push_unit(units[i]);
+			stack.push_key_end();
+		}
 		lua_pcall(stack.L, 2, 0, -5);
 		stack.pop(2);
-
-		return script_world_internal::make_instance(instance_i);
 	}
 
 	void destroy(ScriptWorld& sw, UnitId unit, ScriptInstance /*i*/)
@@ -123,75 +234,161 @@ namespace script_world
 		return script_world_internal::make_instance(hash_map::get(sw._map, unit, UINT32_MAX));
 	}
 
+	int module_ref(ScriptWorld& sw, StringId64 script_resource)
+	{
+		const u32 script_i = hash_map::get(sw._cache, script_resource, UINT32_MAX);
+		return script_i != UINT32_MAX ? sw._script[script_i].module_ref : LUA_NOREF;
+	}
+
 	void update(ScriptWorld& sw, f32 dt)
 	{
+		TempAllocator4096 ta;
+		Array<u32> offsets(ta);
+		Array<UnitId> units(ta);
+		bool grouped = false;
+
 		LuaStack stack(sw._lua_environment->L);
 		stack.push_function(LuaEnvironment::error);
 
 		for (u32 i = 0; i < array::size(sw._script); ++i)
 		{
 			lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sw._script[i].module_ref);
+
 			lua_getfield(stack.L, -1, "update");
-			stack.push_world(sw._world);
-			stack.push_float(dt);
-			lua_pcall(stack.L, 2, 0, -5);
+			if (!lua_isnil(stack.L, -1))
+			{
+				stack.push_world(sw._world);
+				stack.push_float(dt);
+				lua_pcall(stack.L, 2, 0, -5);
+			}
+			else
+			{
+				stack.pop(1);
+			}
+
+			lua_getfield(stack.L, -1, "update_instances");
+			if (!lua_isnil(stack.L, -1))
+			{
+				if (!grouped)
+				{
+					script_world_internal::group_units(sw, offsets, units);
+					grouped = true;
+				}
+
+				const u32 first = offsets[i];
+				const u32 num = offsets[i + 1] - first;
+
+				stack.push_world(sw._world);
+				stack.push_float(dt);
+				stack.push_table(num);
+				for (u32 j = 0; j < num; ++j)
+				{
+					stack.push_unit(units[first + j]);
+					lua_rawseti(stack.L, -2, j + 1);
+				}
+				lua_pcall(stack.L, 3, 0, -6);
+			}
+			else
+			{
+				stack.pop(1);
+			}
+
 			stack.pop(1);
 		}
 
 		stack.pop(1);
 	}
 
-	void collision(ScriptWorld& sw, const PhysicsCollisionEvent& ev)
+	void collisions(ScriptWorld& sw, const PhysicsCollisionEvent* events, u32 num)
 	{
-		for (u32 i = 0; i < array::size(sw._data); ++i)
+		// Find the script instances involved in each contact
+		TempAllocator4096 ta;
+		Array<script_world_internal::Contact> contacts(ta);
+
+		for (u32 e = 0; e < num; ++e)
+		{
+			for (u32 j = 0; j < 2; ++j)
+			{
+				const u32 inst = hash_map::get(sw._map, events[e].units[j], UINT32_MAX);
+				if (inst == UINT32_MAX)
+					continue;
+
+				script_world_internal::Contact c;
+				c.script_i = sw._data[inst].script_i;
+				c.event_i  = e;
+				c.unit_i   = j;
+				array::push_back(contacts, c);
+			}
+		}
+
+		// Group the contacts by script
+		std::sort(array::begin(contacts), array::end(contacts));
+
+		LuaStack stack(sw._lua_environment->L);
+		const u32 num_contacts = array::size(contacts);
+
+		for (u32 first = 0, last = 0; first < num_contacts; first = last)
 		{
-			if (sw._data[i].unit == ev.units[0] || sw._data[i].unit == ev.units[1])
+			const u32 script_i = contacts[first].script_i;
+			while (last < num_contacts && contacts[last].script_i == script_i)
+				++last;
+
+			stack.push_function(LuaEnvironment::error);
+			lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sw._script[script_i].module_ref);
+			lua_getfield(stack.L, -1, "collisions");
+
+			if (!lua_isnil(stack.L, -1))
+			{
+				stack.push_world(sw._world);
+				script_world_internal::push_collisions(stack, events, &contacts[first], last - first);
+				lua_pcall(stack.L, 2, 0, -5);
+				stack.pop(2);
+				continue;
+			}
+
+			stack.pop(1);
+
+			for (u32 i = first; i < last; ++i)
 			{
-				int unit_index = sw._data[i].unit == ev.units[0] ? 0 : 1;
+				const PhysicsCollisionEvent& ev = events[contacts[i].event_i];
+				const u32 unit_i = contacts[i].unit_i;
 
-				LuaStack stack(sw._lua_environment->L);
-				stack.push_function(LuaEnvironment::error);
-				lua_rawgeti(stack.L, LUA_REGISTRYINDEX, sw._script[sw._data[i].script_i].module_ref);
 				switch (ev.type)
 				{
 				case PhysicsCollisionEvent::TOUCH_BEGIN:
 					lua_getfield(stack.L, -1, "collision_begin");
-					if (!lua_isnil(stack.L, -1))
-					{
-						stack.push_unit (ev.units[1-unit_index]);
-						stack.push_unit (ev.units[unit_index]);
-						stack.push_actor(ev.actors[unit_index]);
-						stack.push_vector3(ev.position);
-						stack.push_vector3(ev.normal);
-						stack.push_float(ev.distance);
-						lua_pcall(stack.L, 6, 0, -5);
-						stack.pop(2);
-					}
 					break;
 
 				case PhysicsCollisionEvent::TOUCHING:
 					lua_getfield(stack.L, -1, "collision");
-					if (!lua_isnil(stack.L, -1))
-					{
-						stack.push_unit (ev.units[1-unit_index]);
-						stack.push_unit (ev.units[unit_index]);
-						stack.push_actor(ev.actors[unit_index]);
-						stack.push_vector3(ev.position);
-						stack.push_vector3(ev.normal);
-						stack.push_float(ev.distance);
-						lua_pcall(stack.L, 6, 0, -5);
-						stack.pop(2);
-					}
+					break;
+
+				case PhysicsCollisionEvent::TOUCH_END:
+					lua_getfield(stack.L, -1, "collision_end");
 					break;
 
 				default:
 					CE_FATAL("Unknown physics collision event");
 					break;
 				}
+
+				if (lua_isnil(stack.L, -1))
+				{
+					stack.pop(1);
+					continue;
+				}
+
+				stack.push_unit (ev.units[1-unit_i]);
+				stack.push_unit (ev.units[unit_i]);
+				stack.push_actor(ev.actors[unit_i]);
+				stack.push_vector3(ev.position);
+				stack.push_vector3(ev.normal);
+				stack.push_float(ev.distance);
+				lua_pcall(stack.L, 6, 0, -9);
 			}
-		}
 
-		// Unit not found
+			stack.pop(2);
+		}
 	}
 
 } // namespace script_world
@@ -46,17 +46,32 @@ namespace script_world
 	/// Creates a new component for the @a unit and returns its id.
 	ScriptInstance create(ScriptWorld& sw, UnitId unit, const ScriptDesc& desc);
 
+	/// Creates a new component for each of the @a num @a units. The script's
+	/// spawned() function is called once with all the units.
+	void create(ScriptWorld& sw, const UnitId* units, u32 num, const ScriptDesc& desc);
+
 	/// Destroys the component for the @a unit.
 	void destroy(ScriptWorld& sw, UnitId unit, ScriptInstance i);
 
 	/// Returns the component id for the @a unit.
 	ScriptInstance instances(ScriptWorld& sw, UnitId unit);
 
-	/// Calls the update function on all scripts.
+	/// Returns the registry reference to the module returned by the script
+	/// @a script_resource, or LUA_NOREF if no unit of the world uses it.
+	int module_ref(ScriptWorld& sw, StringId64 script_resource);
+
+	/// Calls update(world, dt) on all the scripts which define it. Scripts
+	/// which define update_instances(world, dt, units) also receive the
+	/// array of the units which have an instance of the script.
 	void update(ScriptWorld& sw, f32 dt);
 
-	///
-	void collision(ScriptWorld& sw, const PhysicsCollisionEvent& ev);
+	/// Delivers the @a num collision @a events to the scripts of the units
+	/// involved. Scripts which define collisions(world, events) receive all
+	/// their contacts in a single call, with @a events being a table of
+	/// arrays: type ("touch_begin" or "touching"), unit, other_unit, actor,
+	/// position, normal and distance. Other scripts get a
+	/// collision_begin() or collision() call per contact.
+	void collisions(ScriptWorld& sw, const PhysicsCollisionEvent* events, u32 num);
 
 } // namespace script_world
 
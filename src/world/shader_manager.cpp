@@ -7,6 +7,7 @@
 #include "core/containers/hash_map.h"
 #include "core/filesystem/reader_writer.h"
 #include "core/strings/string.h"
+#include "device/gpu_memory.h"
 #include "resource/resource_manager.h"
 #include "resource/shader_resource.h"
 #include "world/shader_manager.h"
@@ -18,6 +19,13 @@ ShaderManager::ShaderManager(Allocator& a)
 {
 }
 
+static void read_code(BinaryReader& br, Allocator& a, ShaderResource::Code& code)
+{
+	br.read(code.size);
+	code.data = a.allocate(code.size);
+	br.read(code.data, code.size);
+}
+
 void* ShaderManager::load(File& file, Allocator& a)
 {
 	BinaryReader br(file);
@@ -55,25 +63,33 @@ void* ShaderManager::load(File& file, Allocator& a)
 			sr->_data[i].samplers[s].state = sampler_state;
 		}
 
-		u32 vs_code_size;
-		br.read(vs_code_size);
-		const bgfx::Memory* vsmem = bgfx::alloc(vs_code_size);
-		br.read(vsmem->data, vs_code_size);
-
-		u32 fs_code_size;
-		br.read(fs_code_size);
-		const bgfx::Memory* fsmem = bgfx::alloc(fs_code_size);
-		br.read(fsmem->data, fs_code_size);
-
 		sr->_data[i].name._id = shader_name;
 		sr->_data[i].state = render_state;
-		sr->_data[i].vsmem = vsmem;
-		sr->_data[i].fsmem = fsmem;
+		read_code(br, a, sr->_data[i].vs);
+		read_code(br, a, sr->_data[i].fs);
+		sr->_data[i].vs_instanced.data = NULL;
+		sr->_data[i].vs_instanced.size = 0;
+		sr->_data[i].fs_instanced.data = NULL;
+		sr->_data[i].fs_instanced.size = 0;
+
+		u32 instanced;
+		br.read(instanced);
+		if (instanced)
+		{
+			read_code(br, a, sr->_data[i].vs_instanced);
+			read_code(br, a, sr->_data[i].fs_instanced);
+		}
 	}
 
 	return sr;
 }
 
+// Returns the size of the shader binaries of @a data.
+static u32 code_size(const ShaderResource::Data& data)
+{
+	return data.vs.size + data.fs.size + data.vs_instanced.size + data.fs_instanced.size;
+}
+
 void ShaderManager::online(StringId64 id, ResourceManager& rm)
 {
 	const ShaderResource* shader = (ShaderResource*)rm.get(RESOURCE_TYPE_SHADER, id);
@@ -82,14 +98,26 @@ void ShaderManager::online(StringId64 id, ResourceManager& rm)
 	{
 		const ShaderResource::Data& data = shader->_data[i];
 
-		bgfx::ShaderHandle vs = bgfx::createShader(data.vsmem);
+		bgfx::ShaderHandle vs = bgfx::createShader(bgfx::copy(data.vs.data, data.vs.size));
 		CE_ASSERT(bgfx::isValid(vs), "Failed to create vertex shader");
-		bgfx::ShaderHandle fs = bgfx::createShader(data.fsmem);
+		bgfx::ShaderHandle fs = bgfx::createShader(bgfx::copy(data.fs.data, data.fs.size));
 		CE_ASSERT(bgfx::isValid(fs), "Failed to create fragment shader");
 		bgfx::ProgramHandle program = bgfx::createProgram(vs, fs, true);
 		CE_ASSERT(bgfx::isValid(program), "Failed to create GPU program");
 
-		add_shader(data.name, data.state, data.samplers, program);
+		bgfx::ProgramHandle program_instanced = BGFX_INVALID_HANDLE;
+		if (data.vs_instanced.data != NULL)
+		{
+			vs = bgfx::createShader(bgfx::copy(data.vs_instanced.data, data.vs_instanced.size));
+			CE_ASSERT(bgfx::isValid(vs), "Failed to create vertex shader");
+			fs = bgfx::createShader(bgfx::copy(data.fs_instanced.data, data.fs_instanced.size));
+			CE_ASSERT(bgfx::isValid(fs), "Failed to create fragment shader");
+			program_instanced = bgfx::createProgram(vs, fs, true);
+			CE_ASSERT(bgfx::isValid(program_instanced), "Failed to create GPU program");
+		}
+
+		add_shader(data.name, data.state, data.samplers, program, program_instanced);
+		gpu_memory::allocate(GpuMemoryCategory::SHADER, code_size(data));
 	}
 }
 
@@ -104,25 +132,40 @@ void ShaderManager::offline(StringId64 id, ResourceManager& rm)
 		ShaderData sd;
 		sd.state = BGFX_STATE_DEFAULT;
 		sd.program = BGFX_INVALID_HANDLE;
+		sd.program_instanced = BGFX_INVALID_HANDLE;
 		sd = hash_map::get(_shader_map, data.name, sd);
 
 		bgfx::destroy(sd.program);
+		if (bgfx::isValid(sd.program_instanced))
+			bgfx::destroy(sd.program_instanced);
 
 		hash_map::remove(_shader_map, data.name);
+		gpu_memory::deallocate(GpuMemoryCategory::SHADER, code_size(data));
 	}
 }
 
 void ShaderManager::unload(Allocator& a, void* res)
 {
-	CE_DELETE(a, (ShaderResource*)res);
+	ShaderResource* sr = (ShaderResource*)res;
+
+	for (u32 i = 0; i < array::size(sr->_data); ++i)
+	{
+		a.deallocate(sr->_data[i].vs.data);
+		a.deallocate(sr->_data[i].fs.data);
+		a.deallocate(sr->_data[i].vs_instanced.data);
+		a.deallocate(sr->_data[i].fs_instanced.data);
+	}
+
+	CE_DELETE(a, sr);
 }
 
-void ShaderManager::add_shader(StringId32 name, u64 state, const ShaderResource::Sampler samplers[4], bgfx::ProgramHandle program)
+void ShaderManager::add_shader(StringId32 name, u64 state, const ShaderResource::Sampler samplers[4], bgfx::ProgramHandle program, bgfx::ProgramHandle program_instanced)
 {
 	ShaderData sd;
 	sd.state = state;
 	memcpy(sd.samplers, samplers, sizeof(sd.samplers));
 	sd.program = program;
+	sd.program_instanced = program_instanced;
 	hash_map::set(_shader_map, name, sd);
 }
 
@@ -132,6 +175,7 @@ u32 ShaderManager::sampler_state(StringId32 shader_id, StringId32 sampler_name)
 	ShaderData sd;
 	sd.state = BGFX_STATE_DEFAULT;
 	sd.program = BGFX_INVALID_HANDLE;
+	sd.program_instanced = BGFX_INVALID_HANDLE;
 	sd = hash_map::get(_shader_map, shader_id, sd);
 
 	for (u32 i = 0; i < countof(sd.samplers); ++i)
@@ -144,16 +188,36 @@ u32 ShaderManager::sampler_state(StringId32 shader_id, StringId32 sampler_name)
 	return UINT32_MAX;
 }
 
-void ShaderManager::submit(StringId32 shader_id, u8 view_id, s32 depth, u64 state)
+bool ShaderManager::has_instancing(StringId32 shader_id)
+{
+	CE_ASSERT(hash_map::has(_shader_map, shader_id), "Shader not found");
+	ShaderData sd;
+	sd.state = BGFX_STATE_DEFAULT;
+	sd.program = BGFX_INVALID_HANDLE;
+	sd.program_instanced = BGFX_INVALID_HANDLE;
+	sd = hash_map::get(_shader_map, shader_id, sd);
+
+	return bgfx::isValid(sd.program_instanced);
+}
+
+void ShaderManager::submit(StringId32 shader_id, u8 view_id, s32 depth, u64 state, bool instanced, bool preserve_state)
+{
+	// On the API thread, bgfx::begin() returns the default encoder.
+	submit(*bgfx::begin(), shader_id, view_id, depth, state, instanced, preserve_state);
+}
+
+void ShaderManager::submit(bgfx::Encoder& encoder, StringId32 shader_id, u8 view_id, s32 depth, u64 state, bool instanced, bool preserve_state)
 {
 	CE_ASSERT(hash_map::has(_shader_map, shader_id), "Shader not found");
 	ShaderData sd;
 	sd.state = BGFX_STATE_DEFAULT;
 	sd.program = BGFX_INVALID_HANDLE;
+	sd.program_instanced = BGFX_INVALID_HANDLE;
 	sd = hash_map::get(_shader_map, shader_id, sd);
+	CE_ASSERT(!instanced || bgfx::isValid(sd.program_instanced), "Shader has no instanced variant");
 
-	bgfx::setState(state != UINT64_MAX ? state : sd.state);
-	bgfx::submit(view_id, sd.program, depth);
+	encoder.setState(state != UINT64_MAX ? state : sd.state);
+	encoder.submit(view_id, instanced ? sd.program_instanced : sd.program, depth, preserve_state);
 }
 
 } // namespace crown
@@ -25,6 +25,7 @@ struct ShaderManager
 		u64 state;
 		ShaderResource::Sampler samplers[4];
 		bgfx::ProgramHandle program;
+		bgfx::ProgramHandle program_instanced; ///< Invalid if the shader has no instanced variant.
 	};
 
 	typedef HashMap<StringId32, ShaderData> ShaderMap;
@@ -46,13 +47,23 @@ struct ShaderManager
 	void unload(Allocator& a, void* res);
 
 	///
-	void add_shader(StringId32 name, u64 state, const ShaderResource::Sampler samplers[4], bgfx::ProgramHandle program);
+	void add_shader(StringId32 name, u64 state, const ShaderResource::Sampler samplers[4], bgfx::ProgramHandle program, bgfx::ProgramHandle program_instanced);
 
 	///
 	u32 sampler_state(StringId32 shader_id, StringId32 sampler_name);
 
-	///
-	void submit(StringId32 shader_id, u8 view_id, s32 depth = 0, u64 state = UINT64_MAX);
+	/// Returns whether the shader @a shader_id has an instanced variant
+	/// which reads the model matrix from the instance data buffer.
+	bool has_instancing(StringId32 shader_id);
+
+	/// Submits the primitive with the shader @a shader_id. If @a instanced
+	/// is true, the instanced variant of the shader is used. If
+	/// @a preserve_state is true, the bindings (textures, buffers etc.) are
+	/// kept for the next primitive.
+	void submit(StringId32 shader_id, u8 view_id, s32 depth = 0, u64 state = UINT64_MAX, bool instanced = false, bool preserve_state = false);
+
+	/// Same as above but submits with @a encoder.
+	void submit(bgfx::Encoder& encoder, StringId32 shader_id, u8 view_id, s32 depth = 0, u64 state = UINT64_MAX, bool instanced = false, bool preserve_state = false);
 };
 
 } // namespace crown
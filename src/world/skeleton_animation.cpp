@@ -0,0 +1,357 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/math/math.h"
+#include "core/math/matrix4x4.h"
+#include "core/math/quaternion.h"
+#include "core/math/simd.h"
+#include "core/thread/job_system.h"
+#include "resource/resource_manager.h"
+#include "resource/skeleton_resource.h"
+#include "world/skeleton_animation.h"
+#include "world/unit_manager.h"
+#include <math.h>   // fmodf
+#include <string.h> // memcpy
+
+namespace crown
+{
+static void unit_destroyed_callback_bridge(const UnitId* units, u32 num, void* user_ptr)
+{
+	for (u32 i = 0; i < num; ++i)
+		((SkeletonAnimation*)user_ptr)->unit_destroyed_callback(units[i]);
+}
+
+SkeletonAnimation::SkeletonAnimation(Allocator& a, ResourceManager& rm, UnitManager& um)
+	: _marker(SKELETON_ANIMATION_MARKER)
+	, _allocator(&a)
+	, _resource_manager(&rm)
+	, _unit_manager(&um)
+	, _map(a)
+	, _palette(a)
+{
+	um.register_destroy_function(unit_destroyed_callback_bridge, this);
+}
+
+SkeletonAnimation::~SkeletonAnimation()
+{
+	_unit_manager->unregister_destroy_function(this);
+	_allocator->deallocate(_data.buffer);
+	_marker = 0;
+}
+
+void SkeletonAnimation::allocate(u32 num)
+{
+	CE_ASSERT(num > _data.size, "num > _data.size");
+
+	const u32 bytes = 0
+		+ num*sizeof(UnitId) + alignof(UnitId)
+		+ num*sizeof(SkeletonResource*) + alignof(SkeletonResource*)
+		+ num*sizeof(SkeletonAnimationResource*) * 2 + alignof(SkeletonAnimationResource*)
+		+ num*sizeof(f32) * 5 + alignof(f32)
+		+ num*sizeof(u32) * 2 + alignof(u32)
+		;
+
+	SkeletonData new_data;
+	new_data.size = _data.size;
+	new_data.capacity = num;
+	new_data.buffer = _allocator->allocate(bytes);
+
+	new_data.unit           = (UnitId*                          )new_data.buffer;
+	new_data.skeleton       = (const SkeletonResource**         )memory::align_top(new_data.unit + num,     alignof(SkeletonResource*         ));
+	new_data.animation      = (const SkeletonAnimationResource**)memory::align_top(new_data.skeleton + num, alignof(SkeletonAnimationResource*));
+	new_data.animation_prev = new_data.animation + num;
+	new_data.time           = (f32*                             )memory::align_top(new_data.animation_prev + num, alignof(f32));
+	new_data.time_prev      = new_data.time + num;
+	new_data.speed          = new_data.time_prev + num;
+	new_data.fade_time      = new_data.speed + num;
+	new_data.fade_total     = new_data.fade_time + num;
+	new_data.loop           = (u32*                             )memory::align_top(new_data.fade_total + num, alignof(u32));
+	new_data.palette_offset = new_data.loop + num;
+
+	memcpy(new_data.unit, _data.unit, _data.size * sizeof(UnitId));
+	memcpy(new_data.skeleton, _data.skeleton, _data.size * sizeof(SkeletonResource*));
+	memcpy(new_data.animation, _data.animation, _data.size * sizeof(SkeletonAnimationResource*));
+	memcpy(new_data.animation_prev, _data.animation_prev, _data.size * sizeof(SkeletonAnimationResource*));
+	memcpy(new_data.time, _data.time, _data.size * sizeof(f32));
+	memcpy(new_data.time_prev, _data.time_prev, _data.size * sizeof(f32));
+	memcpy(new_data.speed, _data.speed, _data.size * sizeof(f32));
+	memcpy(new_data.fade_time, _data.fade_time, _data.size * sizeof(f32));
+	memcpy(new_data.fade_total, _data.fade_total, _data.size * sizeof(f32));
+	memcpy(new_data.loop, _data.loop, _data.size * sizeof(u32));
+	memcpy(new_data.palette_offset, _data.palette_offset, _data.size * sizeof(u32));
+
+	_allocator->deallocate(_data.buffer);
+	_data = new_data;
+}
+
+void SkeletonAnimation::grow()
+{
+	allocate(_data.capacity * 2 + 1);
+}
+
+u32 SkeletonAnimation::create(UnitId unit, const SkeletonDesc& desc)
+{
+	CE_ASSERT(!hash_map::has(_map, unit), "Unit already has this component");
+
+	if (_data.size == _data.capacity)
+		grow();
+
+	const u32 last = _data.size;
+
+	_data.unit[last]           = unit;
+	_data.skeleton[last]       = (const SkeletonResource*)_resource_manager->get(RESOURCE_TYPE_SKELETON, desc.skeleton_resource);
+	_data.animation[last]      = NULL;
+	_data.animation_prev[last] = NULL;
+	_data.time[last]           = 0.0f;
+	_data.time_prev[last]      = 0.0f;
+	_data.speed[last]          = 1.0f;
+	_data.fade_time[last]      = 0.0f;
+	_data.fade_total[last]     = 0.0f;
+	_data.loop[last]           = 0;
+	_data.palette_offset[last] = UINT32_MAX;
+
+	++_data.size;
+	hash_map::set(_map, unit, last);
+
+	if (desc.animation_resource != StringId64())
+		play(unit, desc.animation_resource, true);
+
+	return 0;
+}
+
+void SkeletonAnimation::destroy(UnitId unit)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	const u32 last_i = _data.size - 1;
+	const UnitId last_u = _data.unit[last_i];
+
+	_data.unit[i]           = _data.unit[last_i];
+	_data.skeleton[i]       = _data.skeleton[last_i];
+	_data.animation[i]      = _data.animation[last_i];
+	_data.animation_prev[i] = _data.animation_prev[last_i];
+	_data.time[i]           = _data.time[last_i];
+	_data.time_prev[i]      = _data.time_prev[last_i];
+	_data.speed[i]          = _data.speed[last_i];
+	_data.fade_time[i]      = _data.fade_time[last_i];
+	_data.fade_total[i]     = _data.fade_total[last_i];
+	_data.loop[i]           = _data.loop[last_i];
+	_data.palette_offset[i] = _data.palette_offset[last_i];
+
+	--_data.size;
+	hash_map::set(_map, last_u, i);
+	hash_map::remove(_map, unit);
+}
+
+bool SkeletonAnimation::has(UnitId unit)
+{
+	return hash_map::has(_map, unit);
+}
+
+void SkeletonAnimation::play(UnitId unit, StringId64 animation, bool loop)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Unit has no skeleton");
+
+	const SkeletonAnimationResource* sar = (const SkeletonAnimationResource*)_resource_manager->get(RESOURCE_TYPE_SKELETON_ANIMATION, animation);
+	CE_ASSERT(sar->num_bones == _data.skeleton[i]->num_bones, "Animation does not match the skeleton");
+
+	_data.animation[i]      = sar;
+	_data.animation_prev[i] = NULL;
+	_data.time[i]           = 0.0f;
+	_data.fade_time[i]      = 0.0f;
+	_data.fade_total[i]     = 0.0f;
+	_data.loop[i]           = loop ? LOOP : 0;
+}
+
+void SkeletonAnimation::crossfade(UnitId unit, StringId64 animation, f32 duration, bool loop)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Unit has no skeleton");
+
+	const SkeletonAnimationResource* prev = _data.animation[i];
+	const f32 time_prev = _data.time[i];
+	const u32 loop_prev = (_data.loop[i] & LOOP) ? LOOP_PREV : 0;
+
+	play(unit, animation, loop);
+
+	if (prev == NULL || duration <= 0.0f)
+		return;
+
+	_data.animation_prev[i] = prev;
+	_data.time_prev[i]      = time_prev;
+	_data.fade_total[i]     = duration;
+	_data.loop[i]          |= loop_prev;
+}
+
+void SkeletonAnimation::set_speed(UnitId unit, f32 speed)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Unit has no skeleton");
+	_data.speed[i] = speed;
+}
+
+f32 SkeletonAnimation::time(UnitId unit)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Unit has no skeleton");
+	return _data.time[i];
+}
+
+Matrix4x4 SkeletonAnimation::bone_pose(UnitId unit, StringId32 name)
+{
+	const u32 i = hash_map::get(_map, unit, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Unit has no skeleton");
+	CE_ASSERT(_data.palette_offset[i] != UINT32_MAX, "Skeleton has not been updated yet");
+
+	const SkeletonResource* sr = _data.skeleton[i];
+	const u32 bone = skeleton_resource::bone_index(sr, name);
+	CE_ASSERT(bone != UINT32_MAX, "Bone not found");
+
+	// The skin matrix is relative to the bind pose
+	const Matrix4x4 bind = get_inverted(skeleton_resource::inverse_binds(sr)[bone]);
+	return bind * _palette[_data.palette_offset[i] + bone];
+}
+
+// Advances @a time by @a dt and wraps or clamps it to @a total_time.
+static inline f32 advance(f32 time, f32 dt, f32 total_time, bool loop)
+{
+	time += dt;
+
+	if (total_time <= 0.0f)
+		return 0.0f;
+	if (loop)
+		return time >= 0.0f ? fmodf(time, total_time) : total_time + fmodf(time, total_time);
+	return fclamp(time, 0.0f, total_time);
+}
+
+// Blends the poses @a from towards @a to by @a t and writes the result to @a to.
+static void blend(BonePose* to, const BonePose* from, u32 num, f32 t)
+{
+	const simd::Float4 vt = simd::splat(t);
+
+	for (u32 i = 0; i < num; ++i)
+	{
+		// Interpolate rotations along the shortest arc
+		Quaternion rotation = from[i].rotation;
+		if (dot(rotation, to[i].rotation) < 0.0f)
+			rotation = -rotation;
+
+		const f32* a[] = { &from[i].position.x, &rotation.x, &from[i].scale.x };
+		f32* b[] = { &to[i].position.x, &to[i].rotation.x, &to[i].scale.x };
+
+		for (u32 j = 0; j < countof(a); ++j)
+		{
+			const simd::Float4 va = simd::load(a[j]);
+			simd::store(b[j], simd::madd(simd::sub(simd::load(b[j]), va), vt, va));
+		}
+	}
+}
+
+void SkeletonAnimation::update(u32 begin, u32 end, f32 dt)
+{
+	BonePose poses[CROWN_MAX_SKELETON_BONES];
+	BonePose poses_prev[CROWN_MAX_SKELETON_BONES];
+
+	for (u32 i = begin; i < end; ++i)
+	{
+		const SkeletonResource* sr = _data.skeleton[i];
+		const SkeletonAnimationResource* sar = _data.animation[i];
+		const SkeletonAnimationResource* sar_prev = _data.animation_prev[i];
+		const u32 num_bones = sr->num_bones;
+
+		// Sample
+		if (sar != NULL)
+		{
+			_data.time[i] = advance(_data.time[i], dt*_data.speed[i], sar->total_time, !!(_data.loop[i] & LOOP));
+			skeleton_animation_resource::sample(sar, _data.time[i], poses);
+		}
+		else
+		{
+			memcpy(poses, skeleton_resource::bind_poses(sr), num_bones*sizeof(BonePose));
+		}
+
+		if (sar_prev != NULL)
+		{
+			_data.time_prev[i] = advance(_data.time_prev[i], dt*_data.speed[i], sar_prev->total_time, !!(_data.loop[i] & LOOP_PREV));
+			_data.fade_time[i] += dt;
+
+			if (_data.fade_time[i] < _data.fade_total[i])
+			{
+				skeleton_animation_resource::sample(sar_prev, _data.time_prev[i], poses_prev);
+				blend(poses, poses_prev, num_bones, _data.fade_time[i] / _data.fade_total[i]);
+			}
+			else
+			{
+				_data.animation_prev[i] = NULL;
+			}
+		}
+
+		// Compute the model-space matrices, parents come before their children
+		const u32* parents = skeleton_resource::parents(sr);
+		const Matrix4x4* inverse_binds = skeleton_resource::inverse_binds(sr);
+		Matrix4x4* palette = array::begin(_palette) + _data.palette_offset[i];
+
+		for (u32 j = 0; j < num_bones; ++j)
+		{
+			normalize(poses[j].rotation);
+			palette[j] = skeleton_resource::bone_matrix(poses[j]);
+			if (parents[j] != UINT32_MAX)
+				palette[j] *= palette[parents[j]];
+		}
+
+		// Make them relative to the bind pose
+		for (u32 j = 0; j < num_bones; ++j)
+			palette[j] = inverse_binds[j] * palette[j];
+	}
+}
+
+struct SkeletonUpdateJob
+{
+	SkeletonAnimation* sa;
+	f32 dt;
+};
+
+static void skeleton_update_job(u32 begin, u32 end, void* user_data)
+{
+	SkeletonUpdateJob& job = *(SkeletonUpdateJob*)user_data;
+	job.sa->update(begin, end, job.dt);
+}
+
+void SkeletonAnimation::update(f32 dt)
+{
+	const u32 num = _data.size;
+
+	// Assign each skeleton its range of the palette
+	u32 num_matrices = 0;
+	for (u32 i = 0; i < num; ++i)
+	{
+		_data.palette_offset[i] = num_matrices;
+		num_matrices += _data.skeleton[i]->num_bones;
+	}
+	CE_ASSERT(num_matrices <= CROWN_MAX_SKIN_BONES, "Too many skinned bones: %u (max %u)", num_matrices, CROWN_MAX_SKIN_BONES);
+	array::resize(_palette, num_matrices);
+
+	if (num < CROWN_SKELETON_PARALLEL_THRESHOLD || job_system::num_threads() == 1)
+	{
+		update(0, num, dt);
+		return;
+	}
+
+	SkeletonUpdateJob job;
+	job.sa = this;
+	job.dt = dt;
+	job_system::parallel_for(0, num, 0, skeleton_update_job, &job);
+}
+
+void SkeletonAnimation::unit_destroyed_callback(UnitId unit)
+{
+	if (has(unit))
+		destroy(unit);
+}
+
+} // namespace crown
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "resource/skeleton_resource.h"
+#include "resource/types.h"
+#include "world/types.h"
+
+namespace crown
+{
+/// Plays skeletal animations and computes the skin matrices of the
+/// skeletons. The matrices of all the skeletons are stored contiguously
+/// in _palette, so that they can be uploaded to the GPU at once.
+struct SkeletonAnimation
+{
+	struct SkeletonData
+	{
+		SkeletonData()
+			: size(0)
+			, capacity(0)
+			, buffer(NULL)
+			, unit(NULL)
+			, skeleton(NULL)
+			, animation(NULL)
+			, animation_prev(NULL)
+			, time(NULL)
+			, time_prev(NULL)
+			, speed(NULL)
+			, fade_time(NULL)
+			, fade_total(NULL)
+			, loop(NULL)
+			, palette_offset(NULL)
+		{
+		}
+
+		u32 size;
+		u32 capacity;
+		void* buffer;
+
+		UnitId* unit;
+		const SkeletonResource** skeleton;
+		const SkeletonAnimationResource** animation;      ///< Animation being played, NULL if none.
+		const SkeletonAnimationResource** animation_prev; ///< Animation being faded out, NULL if none.
+		f32* time;
+		f32* time_prev;
+		f32* speed;
+		f32* fade_time;
+		f32* fade_total;
+		u32* loop;           ///< Combination of LOOP and LOOP_PREV.
+		u32* palette_offset; ///< Offset into _palette of the skin matrices.
+	};
+
+	enum
+	{
+		LOOP      = 1 << 0,
+		LOOP_PREV = 1 << 1
+	};
+
+	u32 _marker;
+	Allocator* _allocator;
+	ResourceManager* _resource_manager;
+	UnitManager* _unit_manager;
+	HashMap<UnitId, u32> _map;
+	SkeletonData _data;
+	Array<Matrix4x4> _palette;
+
+	///
+	SkeletonAnimation(Allocator& a, ResourceManager& rm, UnitManager& um);
+
+	///
+	~SkeletonAnimation();
+
+	///
+	u32 create(UnitId unit, const SkeletonDesc& desc);
+
+	///
+	void destroy(UnitId unit);
+
+	///
+	bool has(UnitId unit);
+
+	/// Plays the @a animation from the start, stopping the current one.
+	void play(UnitId unit, StringId64 animation, bool loop);
+
+	/// Plays the @a animation from the start, blending from the current
+	/// one over @a duration seconds.
+	void crossfade(UnitId unit, StringId64 animation, f32 duration, bool loop);
+
+	///
+	void set_speed(UnitId unit, f32 speed);
+
+	/// Returns the time of the animation being played.
+	f32 time(UnitId unit);
+
+	/// Returns the model-space pose of the bone @a name as of the last update.
+	Matrix4x4 bone_pose(UnitId unit, StringId32 name);
+
+	/// Advances all the animations by @a dt and computes the skin matrices
+	/// in _palette. Skeletons are updated in parallel when there are more
+	/// than CROWN_SKELETON_PARALLEL_THRESHOLD of them.
+	void update(f32 dt);
+
+	///
+	void unit_destroyed_callback(UnitId unit);
+
+	void allocate(u32 num);
+	void grow();
+	void update(u32 begin, u32 end, f32 dt);
+};
+
+} // namespace crown
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/array.h"
+#include "core/containers/types.h"
+#include <string.h> // memcpy
+
+namespace crown
+{
+/// Functions to write and read the state saved by World::snapshot().
+///
+/// The state of each manager is stored in a section of the form:
+/// [size][data], where size is the number of bytes of data.
+///
+/// @ingroup World
+namespace snapshot
+{
+	/// Appends @a size bytes of @a data to @a buf.
+	inline void write(Buffer& buf, const void* data, u32 size)
+	{
+		array::push(buf, (const char*)data, size);
+	}
+
+	/// Appends @a data to @a buf.
+	template <typename T>
+	inline void write(Buffer& buf, const T& data)
+	{
+		snapshot::write(buf, &data, sizeof(T));
+	}
+
+	/// Reads @a size bytes from @a data to @a dst and advances @a data.
+	inline void read(const char*& data, void* dst, u32 size)
+	{
+		memcpy(dst, data, size);
+		data += size;
+	}
+
+	/// Reads @a dst from @a data and advances @a data.
+	template <typename T>
+	inline void read(const char*& data, T& dst)
+	{
+		snapshot::read(data, &dst, sizeof(T));
+	}
+
+	/// Returns the @a i-th element of the array of T at @a data.
+	/// The data of a snapshot is not necessarily aligned.
+	template <typename T>
+	inline T element(const char* data, u32 i)
+	{
+		T val;
+		memcpy(&val, data + i*sizeof(T), sizeof(T));
+		return val;
+	}
+
+	/// Starts a new section in @a buf and returns its position.
+	inline u32 begin_section(Buffer& buf)
+	{
+		const u32 pos = array::size(buf);
+		const u32 size = 0;
+		snapshot::write(buf, size);
+		return pos;
+	}
+
+	/// Ends the section started at @a pos.
+	inline void end_section(Buffer& buf, u32 pos)
+	{
+		const u32 size = array::size(buf) - pos - sizeof(u32);
+		memcpy(array::begin(buf) + pos, &size, sizeof(size));
+	}
+
+	/// Returns the data of the section at @a data and advances @a data
+	/// to the next section.
+	inline const char* section(const char*& data)
+	{
+		u32 size;
+		snapshot::read(data, size);
+		const char* section = data;
+		data += size;
+		return section;
+	}
+
+} // namespace snapshot
+
+} // namespace crown
@@ -17,6 +17,20 @@ struct SoundWorldImpl;
 
 /// Manages sound objects in a World.
 ///
+/// Streamed sounds are decoded a chunk at a time by the resource loader
+/// threads into a small ring of audio buffers, so the memory they use
+/// does not depend on their length.
+///
+/// Sounds are mixed with voices from a pool shared by all the worlds.
+/// Sounds without a voice, because they are out of range or less important
+/// than CROWN_MAX_SOUND_VOICES others, are virtual: they keep playing
+/// silently and get a voice back as soon as they are important enough.
+///
+/// The sounds are mixed and streamed by a dedicated audio thread. The
+/// functions below only record commands, which update() hands over to
+/// the audio thread, so the sounds keep playing smoothly regardless of
+/// the frame rate of the World.
+///
 /// @ingroup World
 struct SoundWorld
 {
@@ -24,21 +38,23 @@ struct SoundWorld
 	Allocator* _allocator;
 	SoundWorldImpl* _impl;
 
-	///
-	SoundWorld(Allocator& a);
+	/// Streamed sounds are read from @a rm.
+	SoundWorld(Allocator& a, ResourceManager& rm);
 
 	///
 	~SoundWorld();
 
 	/// Plays the sound @a sr at the given @a volume [0 .. 1].
 	/// If loop is true the sound will be played looping.
-	SoundInstanceId play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos);
+	/// When more than CROWN_MAX_SOUND_VOICES sounds are audible, the ones
+	/// with the highest @a priority, then the loudest ones, are mixed.
+	SoundInstanceId play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority);
 
 	/// Stops the sound with the given @a id.
 	/// After this call, the instance will be destroyed.
 	void stop(SoundInstanceId id);
 
-	/// Returns whether the sound @a id is playing.
+	/// Returns whether the sound @a id is playing, as of the last update().
 	bool is_playing(SoundInstanceId id);
 
 	/// Stops all the sounds in the world.
@@ -50,6 +66,15 @@ struct SoundWorld
 	/// Resumes all previously paused sounds in the world.
 	void resume_all();
 
+	/// Makes the sound @a id follow the @a unit, starting from @a pos,
+	/// until the sound is stopped.
+	void link(SoundInstanceId id, UnitId unit, const Vector3& pos);
+
+	/// Moves the sounds linked to the units [@a begin, @a end) to the
+	/// translation of their @a world poses. The sources are only updated
+	/// for the sounds that moved, at the next update().
+	void update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world);
+
 	/// Sets the @a positions (in world space) of @a num sound instances @a ids.
 	void set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions);
 
@@ -65,7 +90,8 @@ struct SoundWorld
 	/// Sets the @a pose of the listener in world space.
 	void set_listener_pose(const Matrix4x4& pose);
 
-	///
+	/// Submits the commands recorded since the last call to the audio
+	/// thread and forgets about the sounds that finished playing.
 	void update();
 };
 
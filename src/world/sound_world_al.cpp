@@ -8,20 +8,36 @@
 #if CROWN_SOUND_OPENAL
 
 #include "core/containers/array.h"
+#include "core/containers/event_stream.h"
+#include "core/containers/hash_map.h"
+#include "core/math/math.h"
 #include "core/math/matrix4x4.h"
 #include "core/math/vector3.h"
 #include "core/memory/temp_allocator.h"
+#include "core/os.h"
+#include "core/strings/dynamic_string.h"
+#include "core/strings/string_stream.h"
+#include "core/thread/atomic_int.h"
+#include "core/thread/mutex.h"
+#include "core/thread/thread.h"
 #include "device/log.h"
+#include "device/profiler.h"
+#include "resource/resource_manager.h"
 #include "resource/sound_resource.h"
 #include "world/audio.h"
 #include "world/sound_world.h"
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <algorithm> // std::sort
+#include <math.h>      // fmodf
 
 namespace { const crown::log_internal::System SOUND = { "sound" }; }
 
 namespace crown
 {
+// Time spent in AL calls, protected by audio_globals::s_mutex.
+static s64 s_al_time = 0;
+
 #if CROWN_DEBUG
 	static const char* al_error_to_string(ALenum error)
 	{
@@ -36,7 +52,9 @@ namespace crown
 	}
 
 	#define AL_CHECK(function)                              \
+		s_al_time -= os::clocktime();                       \
 		function;                                           \
+		s_al_time += os::clocktime();                       \
 		do                                                  \
 		{                                                   \
 			ALenum error;                                   \
@@ -49,12 +67,91 @@ namespace crown
 	#define AL_CHECK(function) function
 #endif // CROWN_DEBUG
 
+static ALenum sound_format(const SoundResource& sr)
+{
+	switch (sr.bits_ps)
+	{
+	case  8: return sr.channels > 1 ? AL_FORMAT_STEREO8  : AL_FORMAT_MONO8;
+	case 16: return sr.channels > 1 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16;
+	default: CE_FATAL("Number of bits per sample not supported."); return AL_INVALID_ENUM;
+	}
+}
+
+struct SoundWorldImpl;
+
 /// Global audio-related functions
 namespace audio_globals
 {
 	static ALCdevice* s_al_device;
 	static ALCcontext* s_al_context;
 
+	// The audio thread makes all the AL calls of the sound worlds while
+	// holding s_mutex. Other threads take it to upload and delete buffers.
+	static Mutex s_mutex;
+	static Thread s_thread;
+	static AtomicInt s_exit(0);
+	static SoundWorldImpl* s_worlds = NULL; ///< Worlds updated by the audio thread.
+
+	// Counters recorded by record_stats(), protected by s_mutex.
+	static u32 s_num_virtual = 0;      ///< Sounds without a source as of the last update.
+	static u32 s_num_underruns = 0;    ///< Streams that ran out of buffers.
+	static u32 s_buffer_memory = 0;    ///< Bytes of the shared buffers.
+	static u32 s_stream_memory = 0;    ///< Bytes of the streams.
+	static AtomicInt s_decode_time(0); ///< Microseconds spent by the loader threads decoding streams.
+
+	static void add_world(SoundWorldImpl& w);
+	static void remove_world(SoundWorldImpl& w);
+	static s32 audio_thread(void* user_data);
+
+	static ALuint s_sources[CROWN_MAX_SOUND_VOICES];
+	static u32 s_num_sources = 0;
+	static ALuint s_free_sources[CROWN_MAX_SOUND_VOICES];
+	static u32 s_num_free_sources = 0;
+
+	// Creates the pool of sources shared by all the sound worlds. The
+	// device might support fewer sources than requested.
+	static void init_sources()
+	{
+		alGetError();
+		for (s_num_sources = 0; s_num_sources < CROWN_MAX_SOUND_VOICES; ++s_num_sources)
+		{
+			alGenSources(1, &s_sources[s_num_sources]);
+			if (alGetError() != AL_NO_ERROR)
+				break;
+
+			s_free_sources[s_num_sources] = s_sources[s_num_sources];
+		}
+		s_num_free_sources = s_num_sources;
+
+		logi(SOUND, "OpenAL Voices   : %u", s_num_sources);
+	}
+
+	/// Returns a source from the pool or 0 if there are none left.
+	static ALuint acquire_source()
+	{
+		if (s_num_free_sources == 0)
+			return 0;
+
+		const ALuint source = s_free_sources[--s_num_free_sources];
+		AL_CHECK(alSourcef(source, AL_REFERENCE_DISTANCE, 0.01f));
+		AL_CHECK(alSourcef(source, AL_PITCH, 1.0f));
+		return source;
+	}
+
+	/// Stops the @a source, detaches its buffers and returns it to the pool.
+	static void release_source(ALuint source)
+	{
+		AL_CHECK(alSourceStop(source));
+		AL_CHECK(alSourcei(source, AL_BUFFER, 0));
+		AL_CHECK(alSourcei(source, AL_LOOPING, AL_FALSE));
+		s_free_sources[s_num_free_sources++] = source;
+	}
+
+	static u32 num_free_sources()
+	{
+		return s_num_free_sources;
+	}
+
 	void init()
 	{
 		s_al_device = alcOpenDevice(NULL);
@@ -72,160 +169,523 @@ namespace audio_globals
 		AL_CHECK(alDistanceModel(AL_LINEAR_DISTANCE_CLAMPED));
 		AL_CHECK(alDopplerFactor(1.0f));
 		AL_CHECK(alDopplerVelocity(343.0f));
+
+		init_sources();
+
+		s_thread.set_name("audio");
+		s_thread.set_priority(ThreadPriority::CRITICAL);
+		s_thread.start(audio_thread);
 	}
 
 	void shutdown()
 	{
+		s_exit.store(1);
+		s_thread.stop();
+
+		AL_CHECK(alDeleteSources(s_num_sources, s_sources));
 		alcDestroyContext(s_al_context);
 	    alcCloseDevice(s_al_device);
 	}
 
+	/// Audio buffer shared by all the sounds playing the same resource.
+	struct SoundBuffer
+	{
+		ALuint buffer;
+		u32 size;
+		u32 num_refs; ///< Number of sounds playing the buffer.
+		u32 next;     ///< Next free buffer if not in use.
+		bool online;  ///< Whether the resource is still online.
+	};
+
+	static SoundBuffer s_buffers[CROWN_MAX_SOUND_BUFFERS];
+	static u32 s_num_buffers = 0;
+	static u32 s_freelist = UINT32_MAX;
+
+	u32 create_buffer(const SoundResource& sr)
+	{
+		ScopedMutex sm(s_mutex);
+
+		u32 i = s_freelist;
+		if (i != UINT32_MAX)
+		{
+			s_freelist = s_buffers[i].next;
+		}
+		else
+		{
+			CE_ASSERT(s_num_buffers < CROWN_MAX_SOUND_BUFFERS, "Maximum number of sound buffers reached");
+			i = s_num_buffers++;
+		}
+
+		SoundBuffer& sb = s_buffers[i];
+		AL_CHECK(alGenBuffers(1, &sb.buffer));
+		CE_ASSERT(alIsBuffer(sb.buffer), "alGenBuffers: error");
+
+		AL_CHECK(alBufferData(sb.buffer, sound_format(sr), sound_resource::data(&sr), sr.size, sr.sample_rate));
+
+		sb.size     = sr.size;
+		sb.num_refs = 0;
+		sb.next     = UINT32_MAX;
+		sb.online   = true;
+		s_buffer_memory += sb.size;
+		return i;
+	}
+
+	static void delete_buffer(u32 i)
+	{
+		AL_CHECK(alDeleteBuffers(1, &s_buffers[i].buffer));
+		s_buffer_memory -= s_buffers[i].size;
+		s_buffers[i].next = s_freelist;
+		s_freelist = i;
+	}
+
+	void destroy_buffer(u32 i)
+	{
+		ScopedMutex sm(s_mutex);
+
+		CE_ASSERT(i < s_num_buffers, "Index out of bounds");
+		s_buffers[i].online = false;
+
+		// Sounds still playing the resource keep the buffer alive
+		if (s_buffers[i].num_refs == 0)
+			delete_buffer(i);
+	}
+
+	static ALuint acquire_buffer(u32 i)
+	{
+		CE_ASSERT(i < s_num_buffers && s_buffers[i].online, "Sound resource is not online");
+		++s_buffers[i].num_refs;
+		return s_buffers[i].buffer;
+	}
+
+	static void release_buffer(u32 i)
+	{
+		CE_ASSERT(s_buffers[i].num_refs > 0, "Buffer is not in use");
+		if (--s_buffers[i].num_refs == 0 && !s_buffers[i].online)
+			delete_buffer(i);
+	}
+
 } // namespace audio_globals
 
+/// Sound streamed from disk. The buffers are queued to the source of the
+/// sound by the audio thread as soon as a loader thread has decoded them.
+struct SoundStream
+{
+	StringId64 name;
+	ALuint buffers[CROWN_SOUND_STREAM_BUFFERS];
+	ALuint free_buffers[CROWN_SOUND_STREAM_BUFFERS]; ///< Buffers not queued to the source.
+	u32 num_free;
+	ALenum format;
+	ALsizei sample_rate;
+	u32 chunk_size; ///< Number of bytes decoded at a time.
+	bool loop;
+	bool decoding;  ///< Whether a loader thread owns the decoder and pcm.
+	bool ended;     ///< Whether the decoder has reached the end of the sound.
+	AtomicInt decoded; ///< Set by the main thread once the loader thread has decoded into pcm.
+	u32 size;       ///< Number of bytes decoded into pcm.
+	SoundDecoder decoder;
+	char pcm[CROWN_SOUND_STREAM_BUFFER_SIZE];
+
+	SoundStream()
+		: decoded(0)
+	{
+	}
+};
+
+/// Sound playing in a SoundWorld. Sounds only hold a source from the pool
+/// while they are among the most important ones: the others are virtual,
+/// they keep their state and their timeline but are not mixed.
 struct SoundInstance
 {
 	const SoundResource* _resource;
 	SoundInstanceId _id;
+	u32 _buffer_index;
 	ALuint _buffer;
-	ALuint _source;
+	ALuint _source;       ///< 0 if the sound is virtual.
+	SoundStream* _stream; ///< NULL if the sound is not streamed or has no source yet.
+	Vector3 _position;
+	f32 _range;
+	f32 _volume;
+	f32 _time;            ///< Estimated playback position in seconds.
+	f32 _duration;
+	f32 _fade;            ///< Gain of the voice, ramps when the sound gains or loses its source.
+	u32 _priority;
+	bool _loop;
+	bool _paused;
+	bool _finished;
+	bool _fading_out;     ///< Whether the source is being released.
+	bool _moved;          ///< Whether _position has to be sent to the source.
+
+	void create(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority)
+	{
+		// The samples have been uploaded when the resource went online
+		_buffer_index = UINT32_MAX;
+		_buffer = 0;
+		if (!sr.stream)
+		{
+			_buffer_index = sr.buffer;
+			_buffer = audio_globals::acquire_buffer(_buffer_index);
+		}
 
-	void create(const SoundResource& sr, const Vector3& pos, f32 range)
+		_resource   = &sr;
+		_source     = 0;
+		_stream     = NULL;
+		_position   = pos;
+		_range      = range;
+		_volume     = volume;
+		_time       = 0.0f;
+		_duration   = f32(sr.size) / f32(sr.channels*sr.bits_ps/8) / f32(sr.sample_rate);
+		_fade       = 1.0f;
+		_priority   = priority;
+		_loop       = loop;
+		_paused     = false;
+		_finished   = false;
+		_fading_out = false;
+		_moved      = false;
+	}
+
+	void destroy()
 	{
-		using namespace sound_resource;
+		if (_source != 0)
+		{
+			if (_stream)
+				stop();
+			audio_globals::release_source(_source);
+			_source = 0;
+		}
 
-		AL_CHECK(alGenSources(1, &_source));
-		CE_ASSERT(alIsSource(_source), "alGenSources: error");
+		if (_buffer_index != UINT32_MAX)
+			audio_globals::release_buffer(_buffer_index);
+	}
 
-		AL_CHECK(alSourcef(_source, AL_REFERENCE_DISTANCE, 0.01f));
-		AL_CHECK(alSourcef(_source, AL_MAX_DISTANCE, range));
-		AL_CHECK(alSourcef(_source, AL_PITCH, 1.0f));
+	/// Starts mixing the sound with @a source from where its timeline is.
+	void bind(ALuint source)
+	{
+		_source = source;
+		_fading_out = false;
 
-		// Generates AL buffers
-		AL_CHECK(alGenBuffers(1, &_buffer));
-		CE_ASSERT(alIsBuffer(_buffer), "alGenBuffers: error");
+		// Fade in sounds resumed halfway through to not pop
+		_fade = _time > 0.0f ? 0.0f : 1.0f;
 
-		ALenum fmt = AL_INVALID_ENUM;
-		switch (sr.bits_ps)
+		AL_CHECK(alSourcef(_source, AL_MAX_DISTANCE, _range));
+		AL_CHECK(alSourcefv(_source, AL_POSITION, to_float_ptr(_position)));
+		set_volume(_volume);
+
+		// Streams are started once their first buffer is decoded
+		if (_resource->stream)
+			return;
+
+		AL_CHECK(alSourcei(_source, AL_LOOPING, (_loop ? AL_TRUE : AL_FALSE)));
+		AL_CHECK(alSourceQueueBuffers(_source, 1, &_buffer));
+		AL_CHECK(alSourcef(_source, AL_SEC_OFFSET, _time));
+		AL_CHECK(alSourcePlay(_source));
+		if (_paused)
 		{
-		case  8: fmt = sr.channels > 1 ? AL_FORMAT_STEREO8  : AL_FORMAT_MONO8; break;
-		case 16: fmt = sr.channels > 1 ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16; break;
-		default: CE_FATAL("Number of bits per sample not supported."); break;
+			AL_CHECK(alSourcePause(_source));
 		}
-		AL_CHECK(alBufferData(_buffer, fmt, data(&sr), sr.size, sr.sample_rate));
-
-		_resource = &sr;
-		set_position(pos);
 	}
 
-	void destroy()
+	/// Returns the source to the pool and keeps tracking the timeline.
+	void unbind()
 	{
-		stop();
-		AL_CHECK(alSourcei(_source, AL_BUFFER, 0));
-		AL_CHECK(alDeleteBuffers(1, &_buffer));
-		AL_CHECK(alDeleteSources(1, &_source));
+		CE_ASSERT(_stream == NULL, "Streams keep their source");
+
+		ALint state;
+		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
+		if (state == AL_STOPPED)
+			_finished = true;
+
+		AL_CHECK(alGetSourcef(_source, AL_SEC_OFFSET, &_time));
+		audio_globals::release_source(_source);
+		_source = 0;
+		_fading_out = false;
 	}
 
 	void reload(const SoundResource& new_sr)
 	{
 		destroy();
-		create(new_sr, position(), range());
-	}
-
-	void play(bool loop, f32 volume)
-	{
-		set_volume(volume);
-		AL_CHECK(alSourcei(_source, AL_LOOPING, (loop ? AL_TRUE : AL_FALSE)));
-		AL_CHECK(alSourceQueueBuffers(_source, 1, &_buffer));
-		AL_CHECK(alSourcePlay(_source));
+		create(new_sr, _loop, _volume, _range, _position, _priority);
 	}
 
 	void pause()
 	{
-		AL_CHECK(alSourcePause(_source));
+		_paused = true;
+		if (_source != 0)
+		{
+			AL_CHECK(alSourcePause(_source));
+		}
 	}
 
 	void resume()
 	{
+		_paused = false;
+		if (_source == 0)
+			return;
+
+		if (_stream)
+			reclaim_buffers();
 		AL_CHECK(alSourcePlay(_source));
 	}
 
 	void stop()
 	{
+		_finished = true;
+		if (_source == 0)
+			return;
+
 		AL_CHECK(alSourceStop(_source));
 		AL_CHECK(alSourceRewind(_source)); // Workaround
+
+		if (_stream)
+			reclaim_buffers();
+	}
+
+	/// Returns the buffers the source has finished playing to the stream.
+	void reclaim_buffers()
+	{
 		ALint processed;
 		AL_CHECK(alGetSourcei(_source, AL_BUFFERS_PROCESSED, &processed));
+		CE_ASSERT(_stream->num_free + processed <= CROWN_SOUND_STREAM_BUFFERS, "Too many buffers");
 
 		if (processed > 0)
 		{
-			ALuint removed;
-			AL_CHECK(alSourceUnqueueBuffers(_source, 1, &removed));
+			AL_CHECK(alSourceUnqueueBuffers(_source, processed, &_stream->free_buffers[_stream->num_free]));
+			_stream->num_free += processed;
+		}
+	}
+
+	/// Advances the timeline of the sound by @a dt. The source is only
+	/// queried once the sound should have finished playing.
+	void advance(f32 dt)
+	{
+		// Streams end when their decoder does
+		if (_paused || _finished || _resource->stream)
+			return;
+
+		_time += dt;
+		if (_time < _duration)
+			return;
+
+		if (_loop && _duration > 0.0f)
+		{
+			_time = fmodf(_time, _duration);
+			return;
+		}
+
+		// The source might lag behind the estimate by a few samples
+		if (_source != 0)
+		{
+			ALint state;
+			AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
+			if (state == AL_PLAYING)
+			{
+				_time = _duration;
+				return;
+			}
+		}
+
+		_finished = true;
+	}
+
+	/// Ramps the gain of the source by @a dt and releases it once faded out.
+	void fade(f32 dt)
+	{
+		const f32 step = dt / CROWN_SOUND_VOICE_FADE_TIME;
+
+		if (_fading_out)
+		{
+			_fade -= step;
+			if (_fade <= 0.0f)
+			{
+				_fade = 1.0f;
+				unbind();
+				return;
+			}
+		}
+		else if (_fade < 1.0f)
+		{
+			_fade = fmin(_fade + step, 1.0f);
+		}
+		else
+		{
+			return;
 		}
+
+		set_volume(_volume);
 	}
 
 	bool is_playing()
 	{
-		ALint state;
-		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
-		return state == AL_PLAYING;
+		if (_finished || _paused)
+			return false;
+
+		// Virtual sounds and streams waiting for their next buffer are still playing
+		return !finished();
 	}
 
 	bool finished()
 	{
+		if (_finished)
+			return true;
+
+		// Other sounds finish with their timeline, see advance()
+		if (_stream == NULL || _paused || !_stream->ended || _stream->decoding)
+			return false;
+
 		ALint state;
 		AL_CHECK(alGetSourcei(_source, AL_SOURCE_STATE, &state));
 		return (state != AL_PLAYING && state != AL_PAUSED);
 	}
 
-	Vector3 position()
+	void set_range(f32 range)
 	{
-		ALfloat pos[3];
-		AL_CHECK(alGetSourcefv(_source, AL_POSITION, pos));
-		return vector3(pos[0], pos[1], pos[2]);
+		_range = range;
+		if (_source != 0)
+		{
+			AL_CHECK(alSourcef(_source, AL_MAX_DISTANCE, range));
+		}
 	}
 
-	float range()
+	void set_volume(f32 volume)
 	{
-		ALfloat range;
-		AL_CHECK(alGetSourcefv(_source, AL_MAX_DISTANCE, &range));
-		return range;
+		_volume = volume;
+		if (_source != 0)
+		{
+			AL_CHECK(alSourcef(_source, AL_GAIN, volume*_fade));
+		}
 	}
 
-	void set_position(const Vector3& pos)
+	/// Returns the gain of the sound as heard from @a listener, following
+	/// AL_LINEAR_DISTANCE_CLAMPED.
+	f32 gain(const Vector3& listener) const
 	{
-		AL_CHECK(alSourcefv(_source, AL_POSITION, to_float_ptr(pos)));
+		const f32 ref = 0.01f;
+		const f32 dist = fclamp(length(_position - listener), ref, _range);
+		return _range > ref ? _volume * (1.0f - (dist - ref) / (_range - ref)) : 0.0f;
 	}
+};
 
-	void set_range(f32 range)
-	{
-		AL_CHECK(alSourcef(_source, AL_MAX_DISTANCE, range));
-	}
+/// Sound competing for a source.
+struct VoiceCandidate
+{
+	u32 index;
+	u32 priority;
+	f32 gain;
+	bool stream;
 
-	void set_volume(f32 volume)
+	bool operator<(const VoiceCandidate& other) const
 	{
-		AL_CHECK(alSourcef(_source, AL_GAIN, volume));
+		// Streams keep their source until they are destroyed
+		if (stream != other.stream)
+			return stream;
+		if (priority != other.priority)
+			return priority > other.priority;
+		return gain > other.gain;
 	}
 };
 
 #define MAX_OBJECTS       1024
 #define INDEX_MASK        0xffff
 #define NEW_OBJECT_ID_ADD 0x10000
+#define SOUND_INSTANCE_INVALID UINT32_MAX
+
+struct SoundCommand
+{
+	enum Enum
+	{
+		PLAY,
+		STOP,
+		STOP_ALL,
+		PAUSE_ALL,
+		RESUME_ALL,
+		SET_POSITION,
+		SET_RANGE,
+		SET_VOLUME,
+		SET_LISTENER_POSE
+	};
+};
+
+struct PlaySoundCommand
+{
+	SoundInstanceId id;
+	const SoundResource* resource;
+	Vector3 position;
+	f32 volume;
+	f32 range;
+	u32 priority;
+	bool loop;
+};
+
+struct StopSoundCommand
+{
+	SoundInstanceId id;
+};
+
+struct SetSoundPositionCommand
+{
+	SoundInstanceId id;
+	Vector3 position;
+};
+
+struct SetSoundFloatCommand
+{
+	SoundInstanceId id;
+	f32 value;
+};
+
+struct SetListenerPoseCommand
+{
+	Matrix4x4 pose;
+};
 
+static void decode_chunk(File& file, void* user_data);
+static void complete_chunk(void* user_data);
+
+/// The thread updating the World and the audio thread only share the
+/// commands and the finished sounds, exchanged once per frame under _mutex.
+/// Everything else is owned by one of them.
 struct SoundWorldImpl
 {
+	/// Sound as seen by the thread updating the World.
+	struct Handle
+	{
+		SoundInstanceId id;
+		u16 next;                     ///< Next free handle.
+		bool alive;
+		bool paused;
+		UnitId unit;                  ///< Unit the sound follows, UNIT_INVALID if none.
+		SoundInstanceId next_linked;  ///< Next sound following unit.
+	};
+
 	struct Index
 	{
 		SoundInstanceId id;
 		u16 index;
-		u16 next;
 	};
 
+	Allocator* _allocator;
+	ResourceManager* _resource_manager;
+	SoundWorldImpl* _next_world; ///< Next world updated by the audio thread.
+
+	// Owned by the thread updating the World.
+	Handle _handles[MAX_OBJECTS];
+	u32 _num_handles;
+	u16 _freelist_enqueue;
+	u16 _freelist_dequeue;
+	HashMap<UnitId, SoundInstanceId> _linked_sounds; ///< First sound following each unit.
+	EventStream _commands;
+
+	// Shared, protected by _mutex.
+	Mutex _mutex;
+	EventStream _submitted;
+	Array<SoundInstanceId> _finished_sounds;
+
+	// Owned by the audio thread.
 	u32 _num_objects;
 	SoundInstance _playing_sounds[MAX_OBJECTS];
 	Index _indices[MAX_OBJECTS];
-	u16 _freelist_enqueue;
-	u16 _freelist_dequeue;
 	Matrix4x4 _listener_pose;
+	EventStream _executing;
+	Array<SoundStream*> _dying_streams; ///< Streams destroyed while a loader thread was decoding them.
 
 	bool has(SoundInstanceId id)
 	{
@@ -238,15 +698,13 @@ struct SoundWorldImpl
 		return _playing_sounds[_indices[id & INDEX_MASK].index];
 	}
 
-	SoundInstanceId add()
+	void add(SoundInstanceId id)
 	{
-		Index& in = _indices[_freelist_dequeue];
-		_freelist_dequeue = in.next;
-		in.id += NEW_OBJECT_ID_ADD;
+		Index& in = _indices[id & INDEX_MASK];
+		CE_ASSERT(in.index == UINT16_MAX, "Sound is already playing");
+		in.id = id;
 		in.index = _num_objects++;
-		SoundInstance& o = _playing_sounds[in.index];
-		o._id = in.id;
-		return o._id;
+		_playing_sounds[in.index]._id = id;
 	}
 
 	void remove(SoundInstanceId id)
@@ -258,90 +716,574 @@ struct SoundWorldImpl
 		_indices[o._id & INDEX_MASK].index = in.index;
 
 		in.index = UINT16_MAX;
-		_indices[_freelist_enqueue].next = id & INDEX_MASK;
-		_freelist_enqueue = id & INDEX_MASK;
 	}
 
-	SoundWorldImpl()
+	SoundWorldImpl(Allocator& a, ResourceManager& rm)
+		: _linked_sounds(a)
+		, _commands(a)
+		, _submitted(a)
+		, _finished_sounds(a)
+		, _executing(a)
+		, _dying_streams(a)
 	{
-		_num_objects = 0;
+		_allocator = &a;
+		_resource_manager = &rm;
+		_next_world = NULL;
+
+		_num_handles = 0;
 		for (u32 i = 0; i < MAX_OBJECTS; ++i)
 		{
-			_indices[i].id = i;
-			_indices[i].next = i + 1;
+			_handles[i].id = i;
+			_handles[i].next = i + 1;
+			_handles[i].alive = false;
 		}
 		_freelist_dequeue = 0;
 		_freelist_enqueue = MAX_OBJECTS - 1;
 
+		_num_objects = 0;
+		for (u32 i = 0; i < MAX_OBJECTS; ++i)
+		{
+			_indices[i].id = i;
+			_indices[i].index = UINT16_MAX;
+		}
+
+		ScopedMutex sm(audio_globals::s_mutex);
 		set_listener_pose(MATRIX4X4_IDENTITY);
+		audio_globals::add_world(*this);
+	}
+
+	~SoundWorldImpl()
+	{
+		{
+			ScopedMutex sm(audio_globals::s_mutex);
+			audio_globals::remove_world(*this);
+			stop_all();
+		}
+
+		// The main thread has to complete the streams being decoded.
+		if (!array::empty(_dying_streams))
+		{
+			_resource_manager->flush();
+			free_dying_streams();
+		}
+	}
+
+	//
+	// Thread updating the World
+	//
+
+	SoundInstanceId create_handle()
+	{
+		// One handle is always left in the freelist
+		CE_ASSERT(_num_handles < MAX_OBJECTS - 1, "Maximum number of sounds reached");
+
+		Handle& h = _handles[_freelist_dequeue];
+		_freelist_dequeue = h.next;
+		h.id += NEW_OBJECT_ID_ADD;
+		h.alive = true;
+		h.paused = false;
+		h.unit = UNIT_INVALID;
+		h.next_linked = SOUND_INSTANCE_INVALID;
+		++_num_handles;
+		return h.id;
+	}
+
+	bool has_handle(SoundInstanceId id)
+	{
+		const Handle& h = _handles[id & INDEX_MASK];
+		return h.id == id && h.alive;
+	}
+
+	void destroy_handle(SoundInstanceId id)
+	{
+		Handle& h = _handles[id & INDEX_MASK];
+		unlink(h);
+		h.alive = false;
+		--_num_handles;
+
+		_handles[_freelist_enqueue].next = id & INDEX_MASK;
+		_freelist_enqueue = id & INDEX_MASK;
+	}
+
+	void unlink(Handle& h)
+	{
+		if (h.unit == UNIT_INVALID)
+			return;
+
+		const SoundInstanceId head = hash_map::get(_linked_sounds, h.unit, (SoundInstanceId)SOUND_INSTANCE_INVALID);
+		if (head == h.id)
+		{
+			if (h.next_linked == SOUND_INSTANCE_INVALID)
+				hash_map::remove(_linked_sounds, h.unit);
+			else
+				hash_map::set(_linked_sounds, h.unit, h.next_linked);
+		}
+		else
+		{
+			Handle* prev = &_handles[head & INDEX_MASK];
+			while (prev->next_linked != h.id)
+				prev = &_handles[prev->next_linked & INDEX_MASK];
+			prev->next_linked = h.next_linked;
+		}
+
+		h.unit = UNIT_INVALID;
+		h.next_linked = SOUND_INSTANCE_INVALID;
+	}
+
+	SoundInstanceId play_sound(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority)
+	{
+		PlaySoundCommand c;
+		c.id       = create_handle();
+		c.resource = &sr;
+		c.position = pos;
+		c.volume   = volume;
+		c.range    = range;
+		c.priority = priority;
+		c.loop     = loop;
+		event_stream::write(_commands, SoundCommand::PLAY, c);
+		return c.id;
+	}
+
+	void stop_sound(SoundInstanceId id)
+	{
+		if (!has_handle(id))
+			return;
+
+		destroy_handle(id);
+
+		StopSoundCommand c;
+		c.id = id;
+		event_stream::write(_commands, SoundCommand::STOP, c);
+	}
+
+	bool is_playing(SoundInstanceId id)
+	{
+		return has_handle(id) && !_handles[id & INDEX_MASK].paused;
+	}
+
+	void stop_all_sounds()
+	{
+		for (u32 i = 0; i < MAX_OBJECTS; ++i)
+		{
+			if (_handles[i].alive)
+				destroy_handle(_handles[i].id);
+		}
+
+		event_stream::write(_commands, SoundCommand::STOP_ALL, 0, NULL);
+	}
+
+	void pause_all_sounds(bool pause)
+	{
+		for (u32 i = 0; i < MAX_OBJECTS; ++i)
+			_handles[i].paused = pause;
+
+		event_stream::write(_commands, (pause ? SoundCommand::PAUSE_ALL : SoundCommand::RESUME_ALL), 0, NULL);
+	}
+
+	void set_sound_position(SoundInstanceId id, const Vector3& pos)
+	{
+		SetSoundPositionCommand c;
+		c.id = id;
+		c.position = pos;
+		event_stream::write(_commands, SoundCommand::SET_POSITION, c);
+	}
+
+	void set_sound_float(SoundCommand::Enum type, SoundInstanceId id, f32 value)
+	{
+		SetSoundFloatCommand c;
+		c.id = id;
+		c.value = value;
+		event_stream::write(_commands, type, c);
+	}
+
+	void link(SoundInstanceId id, UnitId unit, const Vector3& pos)
+	{
+		if (!has_handle(id))
+			return;
+
+		Handle& h = _handles[id & INDEX_MASK];
+		unlink(h);
+
+		h.unit = unit;
+		h.next_linked = hash_map::get(_linked_sounds, unit, (SoundInstanceId)SOUND_INSTANCE_INVALID);
+		hash_map::set(_linked_sounds, unit, id);
+		set_sound_position(id, pos);
+	}
+
+	void update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
+	{
+		if (hash_map::size(_linked_sounds) == 0)
+			return;
+
+		for (; begin != end; ++begin, ++world)
+		{
+			SoundInstanceId id = hash_map::get(_linked_sounds, *begin, (SoundInstanceId)SOUND_INSTANCE_INVALID);
+			while (id != SOUND_INSTANCE_INVALID)
+			{
+				set_sound_position(id, translation(*world));
+				id = _handles[id & INDEX_MASK].next_linked;
+			}
+		}
+	}
+
+	/// Hands the commands over to the audio thread and releases the
+	/// handles of the sounds that finished playing.
+	void submit()
+	{
+		{
+			ScopedMutex sm(_mutex);
+			array::push(_submitted, array::begin(_commands), array::size(_commands));
+
+			for (u32 i = 0; i < array::size(_finished_sounds); ++i)
+			{
+				if (has_handle(_finished_sounds[i]))
+					destroy_handle(_finished_sounds[i]);
+			}
+			array::clear(_finished_sounds);
+		}
+
+		array::clear(_commands);
+	}
+
+	//
+	// Audio thread
+	//
+
+	void execute_commands()
+	{
+		{
+			ScopedMutex sm(_mutex);
+			array::push(_executing, array::begin(_submitted), array::size(_submitted));
+			array::clear(_submitted);
+		}
+
+		const u32 size = array::size(_executing);
+		u32 read = 0;
+		while (read < size)
+		{
+			const EventHeader* eh = (EventHeader*)&_executing[read];
+			const char* data = (char*)&eh[1];
+
+			read += sizeof(*eh) + eh->size;
+
+			switch (eh->type)
+			{
+			case SoundCommand::PLAY:
+				{
+					const PlaySoundCommand& c = *(PlaySoundCommand*)data;
+					play(c.id, *c.resource, c.loop, c.volume, c.range, c.position, c.priority);
+				}
+				break;
+
+			case SoundCommand::STOP:
+				{
+					const StopSoundCommand& c = *(StopSoundCommand*)data;
+					if (has(c.id))
+						stop(c.id);
+				}
+				break;
+
+			case SoundCommand::STOP_ALL:
+				stop_all();
+				break;
+
+			case SoundCommand::PAUSE_ALL:
+				for (u32 i = 0; i < _num_objects; ++i)
+					_playing_sounds[i].pause();
+				break;
+
+			case SoundCommand::RESUME_ALL:
+				for (u32 i = 0; i < _num_objects; ++i)
+					_playing_sounds[i].resume();
+				break;
+
+			case SoundCommand::SET_POSITION:
+				{
+					const SetSoundPositionCommand& c = *(SetSoundPositionCommand*)data;
+					if (has(c.id))
+					{
+						SoundInstance& si = lookup(c.id);
+						si._position = c.position;
+						si._moved = true;
+					}
+				}
+				break;
+
+			case SoundCommand::SET_RANGE:
+				{
+					const SetSoundFloatCommand& c = *(SetSoundFloatCommand*)data;
+					if (has(c.id))
+						lookup(c.id).set_range(c.value);
+				}
+				break;
+
+			case SoundCommand::SET_VOLUME:
+				{
+					const SetSoundFloatCommand& c = *(SetSoundFloatCommand*)data;
+					if (has(c.id))
+						lookup(c.id).set_volume(c.value);
+				}
+				break;
+
+			case SoundCommand::SET_LISTENER_POSE:
+				set_listener_pose(((SetListenerPoseCommand*)data)->pose);
+				break;
+
+			default:
+				CE_FATAL("Unknown sound command");
+				break;
+			}
+		}
+
+		array::clear(_executing);
 	}
 
-	SoundInstanceId play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos)
+	void play(SoundInstanceId id, const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority)
 	{
-		SoundInstanceId id = add();
+		add(id);
 		SoundInstance& si = lookup(id);
-		si.create(sr, pos, range);
-		si.play(loop, volume);
-		return id;
+		si.create(sr, loop, volume, range, pos, priority);
+
+		// Start right away if a source is free, otherwise wait for
+		// update() to steal one.
+		if (sr.stream || si.gain(translation(_listener_pose)) > 0.0f)
+		{
+			const ALuint source = audio_globals::acquire_source();
+			if (source != 0)
+				bind(si, source);
+		}
 	}
 
 	void stop(SoundInstanceId id)
 	{
 		SoundInstance& si = lookup(id);
 		si.destroy();
+		if (si._stream)
+			destroy_stream(*si._stream);
 		remove(id);
 	}
 
-	bool is_playing(SoundInstanceId id)
+	void stop_all()
 	{
-		return has(id) && lookup(id).is_playing();
+		while (_num_objects > 0)
+			stop(_playing_sounds[0]._id);
 	}
 
-	void stop_all()
+	void bind(SoundInstance& si, ALuint source)
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
-		{
-			_playing_sounds[i].stop();
-		}
+		si.bind(source);
+
+		if (si._resource->stream && si._stream == NULL)
+			si._stream = create_stream(*si._resource, si._loop);
 	}
 
-	void pause_all()
+	SoundStream* create_stream(const SoundResource& sr, bool loop)
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		CE_ASSERT(sr.name._id != 0, "Sound resource is not online");
+
+		SoundStream* ss = CE_NEW(*_allocator, SoundStream)();
+		ss->name        = sr.name;
+		AL_CHECK(alGenBuffers(CROWN_SOUND_STREAM_BUFFERS, ss->buffers));
+		for (u32 i = 0; i < CROWN_SOUND_STREAM_BUFFERS; ++i)
+			ss->free_buffers[i] = ss->buffers[i];
+		ss->num_free    = CROWN_SOUND_STREAM_BUFFERS;
+		ss->format      = sound_format(sr);
+		ss->sample_rate = sr.sample_rate;
+		ss->chunk_size  = sizeof(ss->pcm) - sizeof(ss->pcm) % (sr.channels*sr.bits_ps/8);
+		ss->loop        = loop;
+		ss->decoding    = false;
+		ss->ended       = false;
+		ss->size        = 0;
+		sound_resource::decoder_init(ss->decoder, sr);
+		audio_globals::s_stream_memory += stream_memory(*ss);
+
+		decode_next(*ss);
+		return ss;
+	}
+
+	void destroy_stream(SoundStream& ss)
+	{
+		// The buffers have been detached from the source already.
+		AL_CHECK(alDeleteBuffers(CROWN_SOUND_STREAM_BUFFERS, ss.buffers));
+		audio_globals::s_stream_memory -= stream_memory(ss);
+
+		// The loader thread still owns the decoder.
+		if (ss.decoding)
 		{
-			_playing_sounds[i].pause();
+			array::push_back(_dying_streams, &ss);
+			return;
 		}
+
+		free_stream(ss);
 	}
 
-	void resume_all()
+	static u32 stream_memory(const SoundStream& ss)
 	{
-		for (u32 i = 0; i < _num_objects; ++i)
+		return sizeof(ss) + CROWN_SOUND_STREAM_BUFFERS*ss.chunk_size;
+	}
+
+	void free_stream(SoundStream& ss)
+	{
+		sound_resource::decoder_shutdown(ss.decoder);
+		CE_DELETE(*_allocator, &ss);
+	}
+
+	void free_dying_streams()
+	{
+		for (u32 i = 0; i < array::size(_dying_streams);)
 		{
-			_playing_sounds[i].resume();
+			SoundStream* ss = _dying_streams[i];
+			if (ss->decoded.load() == 0)
+			{
+				++i;
+				continue;
+			}
+
+			free_stream(*ss);
+			_dying_streams[i] = array::back(_dying_streams);
+			array::pop_back(_dying_streams);
 		}
 	}
 
-	void set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions)
+	void decode_next(SoundStream& ss)
+	{
+		ss.decoding = true;
+		ss.decoded.store(0);
+
+		// Starving the source would be audible.
+		_resource_manager->stream(RESOURCE_TYPE_SOUND
+			, ss.name
+			, ResourcePriority::CRITICAL
+			, decode_chunk
+			, complete_chunk
+			, &ss
+			);
+	}
+
+	void complete_stream(SoundInstance& si, SoundStream& ss)
 	{
-		for (u32 i = 0; i < num; ++i)
+		ss.decoding = false;
+		si.reclaim_buffers();
+
+		if (ss.size > 0)
 		{
-			lookup(ids[i]).set_position(positions[i]);
+			CE_ASSERT(ss.num_free > 0, "No free buffers");
+			ALuint buffer = ss.free_buffers[--ss.num_free];
+			AL_CHECK(alBufferData(buffer, ss.format, ss.pcm, ss.size, ss.sample_rate));
+			AL_CHECK(alSourceQueueBuffers(si._source, 1, &buffer));
+		}
+
+		ss.ended = ss.size < ss.chunk_size;
+
+		// Restart the source if it ran out of buffers.
+		ALint state;
+		AL_CHECK(alGetSourcei(si._source, AL_SOURCE_STATE, &state));
+		if (!si._finished && !si._paused && state != AL_PLAYING)
+		{
+			if (state == AL_STOPPED)
+				++audio_globals::s_num_underruns;
+			AL_CHECK(alSourcePlay(si._source));
 		}
 	}
 
-	void set_sound_ranges(u32 num, const SoundInstanceId* ids, const f32* ranges)
+	void update_streams()
 	{
-		for (u32 i = 0; i < num; ++i)
+		free_dying_streams();
+
+		for (u32 i = 0; i < _num_objects; ++i)
 		{
-			lookup(ids[i]).set_range(ranges[i]);
+			SoundInstance& si = _playing_sounds[i];
+			SoundStream* ss = si._stream;
+
+			if (ss == NULL || si._finished)
+				continue;
+
+			if (ss->decoding)
+			{
+				if (ss->decoded.load() == 0)
+					continue;
+
+				complete_stream(si, *ss);
+			}
+			else
+			{
+				si.reclaim_buffers();
+			}
+
+			if (!si._finished && !ss->ended && ss->num_free > 0)
+				decode_next(*ss);
 		}
 	}
 
-	void set_sound_volumes(u32 num, const SoundInstanceId* ids, const f32* volumes)
+	/// Gives the sources to the most important audible sounds and fades
+	/// out the sources of the others.
+	void update_voices()
 	{
-		for (u32 i = 0; i < num; i++)
+		const Vector3 listener = translation(_listener_pose);
+
+		TempAllocator4096 ta;
+		Array<VoiceCandidate> candidates(ta);
+		array::reserve(candidates, _num_objects);
+
+		u32 num_voices = audio_globals::num_free_sources();
+		for (u32 i = 0; i < _num_objects; ++i)
 		{
-			lookup(ids[i]).set_volume(volumes[i]);
+			const SoundInstance& si = _playing_sounds[i];
+			if (si._source != 0)
+				++num_voices;
+
+			if (si._finished)
+				continue;
+
+			VoiceCandidate vc;
+			vc.index    = i;
+			vc.priority = si._priority;
+			vc.gain     = si._paused ? 0.0f : si.gain(listener);
+			vc.stream   = si._stream != NULL;
+			array::push_back(candidates, vc);
+		}
+
+		std::sort(array::begin(candidates), array::end(candidates));
+
+		for (u32 i = 0; i < array::size(candidates); ++i)
+		{
+			const VoiceCandidate& vc = candidates[i];
+			SoundInstance& si = _playing_sounds[vc.index];
+			const bool voiced = vc.stream
+				|| (i < num_voices && (vc.gain > 0.0f || si._resource->stream))
+				;
+
+			if (si._source == 0 || si._stream)
+				continue;
+
+			if (voiced)
+			{
+				si._fading_out = false;
+			}
+			else if (vc.gain == 0.0f)
+			{
+				// Silent sounds do not pop
+				si.unbind();
+			}
+			else
+			{
+				si._fading_out = true;
+			}
+		}
+
+		for (u32 i = 0; i < array::size(candidates) && i < num_voices; ++i)
+		{
+			const VoiceCandidate& vc = candidates[i];
+			SoundInstance& si = _playing_sounds[vc.index];
+
+			if (si._source != 0 || (vc.gain == 0.0f && !si._resource->stream))
+				continue;
+
+			const ALuint source = audio_globals::acquire_source();
+			if (source == 0)
+				break;
+
+			bind(si, source);
 		}
 	}
 
@@ -349,9 +1291,13 @@ struct SoundWorldImpl
 	{
 		for (u32 i = 0; i < _num_objects; ++i)
 		{
-			if (_playing_sounds[i]._resource == &old_sr)
+			SoundInstance& si = _playing_sounds[i];
+			if (si._resource == &old_sr)
 			{
-				_playing_sounds[i].reload(new_sr);
+				SoundStream* ss = si._stream;
+				si.reload(new_sr);
+				if (ss)
+					destroy_stream(*ss);
 			}
 		}
 	}
@@ -370,8 +1316,62 @@ struct SoundWorldImpl
 		_listener_pose = pose;
 	}
 
-	void update()
+	/// Writes the sounds playing in the world to @a json.
+	void to_json(StringStream& json)
 	{
+		TempAllocator64 ta;
+		DynamicString name(ta);
+
+		for (u32 i = 0; i < _num_objects; ++i)
+		{
+			const SoundInstance& si = _playing_sounds[i];
+			StringId64 resource = si._resource->name;
+			resource.to_string(name);
+
+			json << (i > 0 ? ",{" : "{");
+			json << "\"id\":" << si._id;
+			json << ",\"resource\":\"" << name.c_str() << "\"";
+			json << ",\"position\":[" << si._position.x << "," << si._position.y << "," << si._position.z << "]";
+			json << ",\"volume\":" << si._volume;
+			json << ",\"range\":" << si._range;
+			json << ",\"priority\":" << si._priority;
+			json << ",\"time\":" << si._time;
+			json << ",\"virtual\":" << (si._source == 0 ? "true" : "false");
+			json << ",\"paused\":" << (si._paused ? "true" : "false");
+			json << "}";
+		}
+	}
+
+	/// Executes the commands submitted by the World and advances the
+	/// sounds by @a dt.
+	void update(f32 dt)
+	{
+		execute_commands();
+
+		for (u32 i = 0; i < _num_objects; ++i)
+		{
+			SoundInstance& si = _playing_sounds[i];
+			si.advance(dt);
+
+			if (si._source == 0)
+			{
+				si._moved = false;
+				++audio_globals::s_num_virtual;
+				continue;
+			}
+
+			if (si._moved)
+			{
+				si._moved = false;
+				AL_CHECK(alSourcefv(si._source, AL_POSITION, to_float_ptr(si._position)));
+			}
+
+			si.fade(dt);
+		}
+
+		update_streams();
+		update_voices();
+
 		TempAllocator256 alloc;
 		Array<SoundInstanceId> to_delete(alloc);
 
@@ -390,15 +1390,111 @@ struct SoundWorldImpl
 		{
 			stop(to_delete[i]);
 		}
+
+		if (array::size(to_delete) > 0)
+		{
+			ScopedMutex sm(_mutex);
+			array::push(_finished_sounds, array::begin(to_delete), array::size(to_delete));
+		}
 	}
 };
 
-SoundWorld::SoundWorld(Allocator& a)
+static void decode_chunk(File& file, void* user_data)
+{
+	SoundStream* ss = (SoundStream*)user_data;
+
+	const s64 t0 = os::clocktime();
+	ss->size = sound_resource::decode(ss->decoder, file, ss->loop, ss->pcm, ss->chunk_size);
+	const s64 us = (os::clocktime() - t0) * 1000000 / os::clockfrequency();
+	audio_globals::s_decode_time.fetch_add((s32)us);
+}
+
+static void complete_chunk(void* user_data)
+{
+	// Called by the main thread, the audio thread queues the buffer.
+	SoundStream* ss = (SoundStream*)user_data;
+	ss->decoded.store(1);
+}
+
+namespace audio_globals
+{
+	static void add_world(SoundWorldImpl& w)
+	{
+		w._next_world = s_worlds;
+		s_worlds = &w;
+	}
+
+	static void remove_world(SoundWorldImpl& w)
+	{
+		SoundWorldImpl** prev = &s_worlds;
+		while (*prev != &w)
+			prev = &(*prev)->_next_world;
+		*prev = w._next_world;
+	}
+
+	static s32 audio_thread(void* /*user_data*/)
+	{
+		s64 time_last = os::clocktime();
+
+		while (s_exit.load() == 0)
+		{
+			const s64 time = os::clocktime();
+			const f32 dt = f32(f64(time - time_last) / f64(os::clockfrequency()));
+			time_last = time;
+
+			{
+				ScopedMutex sm(s_mutex);
+				s_num_virtual = 0;
+				for (SoundWorldImpl* w = s_worlds; w != NULL; w = w->_next_world)
+					w->update(dt);
+			}
+
+			os::sleep(CROWN_SOUND_UPDATE_PERIOD);
+		}
+
+		return 0;
+	}
+
+	void record_stats()
+	{
+		ScopedMutex sm(s_mutex);
+
+		const s32 decode_time = s_decode_time.load();
+		s_decode_time.fetch_add(-decode_time);
+		CE_UNUSED(decode_time);
+
+		RECORD_FLOAT("sound.active_voices", f32(s_num_sources - s_num_free_sources));
+		RECORD_FLOAT("sound.virtual_voices", f32(s_num_virtual));
+		RECORD_FLOAT("sound.stream_underruns", f32(s_num_underruns));
+		RECORD_FLOAT("sound.decode_time", f32(decode_time) / 1000000.0f);
+		RECORD_FLOAT("sound.al_time", f32(f64(s_al_time) / f64(os::clockfrequency())));
+		RECORD_FLOAT("sound.memory", f32(s_buffer_memory + s_stream_memory));
+		s_num_underruns = 0;
+		s_al_time = 0;
+	}
+
+	void to_json(StringStream& json)
+	{
+		ScopedMutex sm(s_mutex);
+
+		json << "{\"type\":\"sounds\",\"worlds\":[";
+		for (SoundWorldImpl* w = s_worlds; w != NULL; w = w->_next_world)
+		{
+			json << (w != s_worlds ? ",[" : "[");
+			w->to_json(json);
+			json << "]";
+		}
+		json << "]}";
+	}
+
+} // namespace audio_globals
+
+SoundWorld::SoundWorld(Allocator& a, ResourceManager& rm)
 	: _marker(SOUND_WORLD_MARKER)
 	, _allocator(&a)
 	, _impl(NULL)
 {
-	_impl = CE_NEW(*_allocator, SoundWorldImpl)();
+	_impl = CE_NEW(*_allocator, SoundWorldImpl)(*_allocator, rm);
 }
 
 SoundWorld::~SoundWorld()
@@ -407,14 +1503,14 @@ SoundWorld::~SoundWorld()
 	_marker = 0;
 }
 
-SoundInstanceId SoundWorld::play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos)
+SoundInstanceId SoundWorld::play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority)
 {
-	return _impl->play(sr, loop, volume, range, pos);
+	return _impl->play_sound(sr, loop, volume, range, pos, priority);
 }
 
 void SoundWorld::stop(SoundInstanceId id)
 {
-	_impl->stop(id);
+	_impl->stop_sound(id);
 }
 
 bool SoundWorld::is_playing(SoundInstanceId id)
@@ -424,47 +1520,66 @@ bool SoundWorld::is_playing(SoundInstanceId id)
 
 void SoundWorld::stop_all()
 {
-	_impl->stop_all();
+	_impl->stop_all_sounds();
 }
 
 void SoundWorld::pause_all()
 {
-	_impl->pause_all();
+	_impl->pause_all_sounds(true);
 }
 
 void SoundWorld::resume_all()
 {
-	_impl->resume_all();
+	_impl->pause_all_sounds(false);
+}
+
+void SoundWorld::link(SoundInstanceId id, UnitId unit, const Vector3& pos)
+{
+	_impl->link(id, unit, pos);
+}
+
+void SoundWorld::update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
+{
+	_impl->update_transforms(begin, end, world);
 }
 
 void SoundWorld::set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions)
 {
-	_impl->set_sound_positions(num, ids, positions);
+	for (u32 i = 0; i < num; ++i)
+		_impl->set_sound_position(ids[i], positions[i]);
 }
 
 void SoundWorld::set_sound_ranges(u32 num, const SoundInstanceId* ids, const f32* ranges)
 {
-	_impl->set_sound_ranges(num, ids, ranges);
+	for (u32 i = 0; i < num; ++i)
+		_impl->set_sound_float(SoundCommand::SET_RANGE, ids[i], ranges[i]);
 }
 
 void SoundWorld::set_sound_volumes(u32 num, const SoundInstanceId* ids, const f32* volumes)
 {
-	_impl->set_sound_volumes(num, ids, volumes);
+	for (u32 i = 0; i < num; ++i)
+		_impl->set_sound_float(SoundCommand::SET_VOLUME, ids[i], volumes[i]);
 }
 
 void SoundWorld::reload_sounds(const SoundResource& old_sr, const SoundResource& new_sr)
 {
+	// The old resource goes away after this call.
+	_impl->submit();
+	ScopedMutex sm(audio_globals::s_mutex);
+	_impl->execute_commands();
 	_impl->reload_sounds(old_sr, new_sr);
 }
 
 void SoundWorld::set_listener_pose(const Matrix4x4& pose)
 {
-	_impl->set_listener_pose(pose);
+	SetListenerPoseCommand c;
+	c.pose = pose;
+	event_stream::write(_impl->_commands, SoundCommand::SET_LISTENER_POSE, c);
 }
 
 void SoundWorld::update()
 {
-	_impl->update();
+	_impl->submit();
 }
 
 } // namespace crown
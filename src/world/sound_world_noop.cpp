@@ -8,6 +8,7 @@
 #if CROWN_SOUND_NOOP
 
 #include "core/memory/memory.h"
+#include "core/strings/string_stream.h"
 #include "world/audio.h"
 #include "world/sound_world.h"
 
@@ -23,6 +24,24 @@ namespace audio_globals
 	{
 	}
 
+	u32 create_buffer(const SoundResource& /*sr*/)
+	{
+		return 0;
+	}
+
+	void destroy_buffer(u32 /*i*/)
+	{
+	}
+
+	void record_stats()
+	{
+	}
+
+	void to_json(StringStream& json)
+	{
+		json << "{\"type\":\"sounds\",\"worlds\":[]}";
+	}
+
 } // namespace audio_globals
 
 struct SoundWorldImpl
@@ -35,7 +54,7 @@ struct SoundWorldImpl
 	{
 	}
 
-	SoundInstanceId play(const SoundResource& /*sr*/, bool /*loop*/, f32 /*volume*/, f32 /*range*/, const Vector3& /*pos*/)
+	SoundInstanceId play(const SoundResource& /*sr*/, bool /*loop*/, f32 /*volume*/, f32 /*range*/, const Vector3& /*pos*/, u32 /*priority*/)
 	{
 		return 0;
 	}
@@ -61,6 +80,14 @@ struct SoundWorldImpl
 	{
 	}
 
+	void link(SoundInstanceId /*id*/, UnitId /*unit*/, const Vector3& /*pos*/)
+	{
+	}
+
+	void update_transforms(const UnitId* /*begin*/, const UnitId* /*end*/, const Matrix4x4* /*world*/)
+	{
+	}
+
 	void set_sound_positions(u32 /*num*/, const SoundInstanceId* /*ids*/, const Vector3* /*positions*/)
 	{
 	}
@@ -86,7 +113,7 @@ struct SoundWorldImpl
 	}
 };
 
-SoundWorld::SoundWorld(Allocator& a)
+SoundWorld::SoundWorld(Allocator& a, ResourceManager& /*rm*/)
 	: _marker(SOUND_WORLD_MARKER)
 	, _allocator(&a)
 	, _impl(NULL)
@@ -100,9 +127,9 @@ SoundWorld::~SoundWorld()
 	_marker = 0;
 }
 
-SoundInstanceId SoundWorld::play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos)
+SoundInstanceId SoundWorld::play(const SoundResource& sr, bool loop, f32 volume, f32 range, const Vector3& pos, u32 priority)
 {
-	return _impl->play(sr, loop, volume, range, pos);
+	return _impl->play(sr, loop, volume, range, pos, priority);
 }
 
 void SoundWorld::stop(SoundInstanceId id)
@@ -130,6 +157,16 @@ void SoundWorld::resume_all()
 	_impl->resume_all();
 }
 
+void SoundWorld::link(SoundInstanceId id, UnitId unit, const Vector3& pos)
+{
+	_impl->link(id, unit, pos);
+}
+
+void SoundWorld::update_transforms(const UnitId* begin, const UnitId* end, const Matrix4x4* world)
+{
+	_impl->update_transforms(begin, end, world);
+}
+
 void SoundWorld::set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions)
 {
 	_impl->set_sound_positions(num, ids, positions);
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "config.h"
+#include "core/containers/array.h"
+#include "core/containers/hash_map.h"
+#include "core/math/math.h"
+#include "core/memory/temp_allocator.h"
+#include "device/gpu_memory.h"
+#include "device/profiler.h"
+#include "resource/resource_manager.h"
+#include "resource/texture_resource.h"
+#include "world/texture_manager.h"
+#include <algorithm> // std::sort
+#include <bgfx/bgfx.h>
+#include <bimg/bimg.h>
+#include <bx/math.h>
+#include <float.h> // FLT_MAX
+#include <string.h> // memmove
+
+namespace crown
+{
+static void stream_mips(File& file, void* user_data)
+{
+	TextureManager::StreamData* sd = (TextureManager::StreamData*)user_data;
+	sd->data = texture_resource::load_mips(file, sd->base_mip, *sd->manager->_allocator, sd->size);
+}
+
+static void complete_mips(void* user_data)
+{
+	TextureManager::StreamData* sd = (TextureManager::StreamData*)user_data;
+	sd->manager->complete_stream(*sd);
+}
+
+static void release_mips(void* ptr, void* user_data)
+{
+	((Allocator*)user_data)->deallocate(ptr);
+}
+
+static u32 mip_for_distance(f32 distance, u32 num_mips)
+{
+	u32 mip = 0;
+	f32 max_distance = CROWN_TEXTURE_STREAMING_DISTANCE;
+
+	for (; mip < num_mips - 1 && distance > max_distance; ++mip)
+		max_distance *= 2.0f;
+
+	return mip;
+}
+
+TextureManager::TextureManager(Allocator& a, ResourceManager& rm)
+	: _allocator(&a)
+	, _resource_manager(&rm)
+	, _map(a)
+	, _textures(a)
+	, _next_stream_id(1)
+	, _num_streams(0)
+	, _memory_budget(u64(CROWN_DEFAULT_TEXTURE_MEMORY_BUDGET)*1024*1024)
+	, _memory(0)
+	, _uploads(a)
+	, _upload_budget(CROWN_DEFAULT_TEXTURE_UPLOAD_BUDGET*1024)
+{
+	_fallback.idx = bgfx::kInvalidHandle;
+}
+
+TextureManager::~TextureManager()
+{
+	// Streams in flight reference this manager.
+	if (_num_streams > 0)
+		_resource_manager->flush();
+
+	for (u32 i = 0; i < array::size(_uploads); ++i)
+	{
+		bgfx::destroy(_uploads[i].handle);
+		_allocator->deallocate(_uploads[i].owned);
+	}
+
+	if (bgfx::isValid(_fallback))
+		bgfx::destroy(_fallback);
+}
+
+void TextureManager::online(StringId64 id, ResourceManager& rm)
+{
+	TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
+
+	// Textures larger than the upload budget are drawn with the fallback
+	// until they are complete.
+	if (tr->size > _upload_budget
+		&& queue_upload(id, 0, tr->base_mip, tr->data, tr->size, NULL)
+		)
+	{
+		if (!bgfx::isValid(_fallback))
+		{
+			const u32 gray = 0xff808080;
+			_fallback = bgfx::createTexture2D(1, 1, false, 1, bgfx::TextureFormat::RGBA8, BGFX_TEXTURE_NONE, bgfx::copy(&gray, sizeof(gray)));
+		}
+
+		tr->handle = _fallback;
+	}
+	else
+	{
+		tr->handle = bgfx::createTexture(bgfx::makeRef(tr->data, tr->size));
+	}
+
+	TextureData td;
+	td.id            = id;
+	td.resource      = tr;
+	td.distance      = FLT_MAX;
+	td.last_distance = 0.0f;
+	td.target_mip    = tr->base_mip;
+	td.stream_id     = 0;
+
+	hash_map::set(_map, id, array::size(_textures));
+	array::push_back(_textures, td);
+
+	_memory += texture_resource::mips_size(tr, tr->base_mip);
+	gpu_memory::allocate(GpuMemoryCategory::TEXTURE, texture_resource::mips_size(tr, tr->base_mip));
+}
+
+void TextureManager::offline(StringId64 id, ResourceManager& rm)
+{
+	TextureResource* tr = (TextureResource*)rm.get(RESOURCE_TYPE_TEXTURE, id);
+	if (tr->handle.idx != _fallback.idx)
+		bgfx::destroy(tr->handle);
+
+	// Cancel its uploads, preserving the order of the others
+	u32 num_uploads = 0;
+	for (u32 j = 0; j < array::size(_uploads); ++j)
+	{
+		if (_uploads[j].id == id)
+		{
+			bgfx::destroy(_uploads[j].handle);
+			_allocator->deallocate(_uploads[j].owned);
+			continue;
+		}
+
+		_uploads[num_uploads++] = _uploads[j];
+	}
+	array::resize(_uploads, num_uploads);
+
+	const u32 i = hash_map::get(_map, id, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Texture not found");
+
+	_memory -= texture_resource::mips_size(tr, tr->base_mip);
+	gpu_memory::deallocate(GpuMemoryCategory::TEXTURE, texture_resource::mips_size(tr, tr->base_mip));
+
+	const u32 last = array::size(_textures) - 1;
+	_textures[i] = _textures[last];
+	hash_map::set(_map, _textures[i].id, i);
+	array::pop_back(_textures);
+	hash_map::remove(_map, id);
+}
+
+void TextureManager::set_distance(StringId64 id, f32 distance)
+{
+	const u32 i = hash_map::get(_map, id, UINT32_MAX);
+	if (i != UINT32_MAX)
+		_textures[i].distance = fmin(_textures[i].distance, distance);
+}
+
+void TextureManager::set_memory_budget(u64 size)
+{
+	_memory_budget = size;
+}
+
+void TextureManager::set_upload_budget(u32 size)
+{
+	_upload_budget = size;
+}
+
+struct FartherFirst
+{
+	const TextureManager::TextureData* textures;
+
+	bool operator()(u32 a, u32 b) const
+	{
+		return textures[a].last_distance > textures[b].last_distance;
+	}
+};
+
+void TextureManager::update()
+{
+	const u32 num = array::size(_textures);
+
+	// Select the target mip from the distance hints. Textures which have
+	// never been hinted get their most detailed mip.
+	u64 memory = 0;
+	for (u32 i = 0; i < num; ++i)
+	{
+		TextureData& td = _textures[i];
+		const TextureResource* tr = td.resource;
+
+		if (tr->num_mips > 0)
+		{
+			if (td.distance != FLT_MAX)
+				td.last_distance = td.distance;
+
+			td.distance   = FLT_MAX;
+			td.target_mip = mip_for_distance(td.last_distance, tr->num_mips);
+		}
+
+		memory += texture_resource::mips_size(tr, td.target_mip);
+	}
+
+	// Drop the most detailed mips of the farthest textures until the
+	// budget is met.
+	if (memory > _memory_budget)
+	{
+		TempAllocator4096 ta;
+		Array<u32> order(ta);
+		array::resize(order, num);
+		for (u32 i = 0; i < num; ++i)
+			order[i] = i;
+
+		FartherFirst cmp = { array::begin(_textures) };
+		std::sort(array::begin(order), array::end(order), cmp);
+
+		bool dropped = true;
+		while (memory > _memory_budget && dropped)
+		{
+			dropped = false;
+			for (u32 i = 0; i < num && memory > _memory_budget; ++i)
+			{
+				TextureData& td = _textures[order[i]];
+				const TextureResource* tr = td.resource;
+
+				if (tr->num_mips == 0 || td.target_mip == tr->num_mips - 1)
+					continue;
+
+				memory -= texture_resource::mips_size(tr, td.target_mip);
+				++td.target_mip;
+				memory += texture_resource::mips_size(tr, td.target_mip);
+				dropped = true;
+			}
+		}
+	}
+
+	// Stream the selected mips.
+	for (u32 i = 0; i < num && _num_streams < CROWN_MAX_TEXTURE_STREAMS; ++i)
+	{
+		TextureData& td = _textures[i];
+
+		if (td.stream_id != 0 || td.target_mip == td.resource->base_mip)
+			continue;
+
+		StreamData* sd = CE_NEW(*_allocator, StreamData)();
+		sd->manager   = this;
+		sd->id        = td.id;
+		sd->stream_id = _next_stream_id++;
+		sd->base_mip  = td.target_mip;
+		sd->data      = NULL;
+		sd->size      = 0;
+
+		td.stream_id = sd->stream_id;
+		++_num_streams;
+
+		_resource_manager->stream(RESOURCE_TYPE_TEXTURE
+			, td.id
+			, ResourcePriority::BACKGROUND
+			, stream_mips
+			, complete_mips
+			, sd
+			);
+	}
+
+	upload();
+
+	RECORD_FLOAT("texture_manager.memory", f32(f64(_memory) / (1024.0*1024.0)));
+	RECORD_FLOAT("texture_manager.streams", f32(_num_streams));
+	RECORD_FLOAT("texture_manager.uploads", f32(array::size(_uploads)));
+}
+
+bool TextureManager::queue_upload(StringId64 id, u32 stream_id, u32 base_mip, const void* data, u32 size, void* owned)
+{
+	bimg::ImageContainer ic;
+	if (!bimg::imageParse(ic, data, size, NULL))
+		return false;
+
+	u32 num_mips = 1;
+	for (u32 s = bx::max(ic.m_width, ic.m_height); s > 1; s >>= 1)
+		++num_mips;
+
+	// Only plain 2D textures with no or all the mips can be filled in parts
+	if (ic.m_numLayers > 1
+		|| ic.m_cubeMap
+		|| ic.m_depth > 1
+		|| (ic.m_numMips > 1 && ic.m_numMips != num_mips)
+		)
+		return false;
+
+	UploadData ud;
+	ud.id        = id;
+	ud.stream_id = stream_id;
+	ud.base_mip  = base_mip;
+	ud.handle    = bgfx::createTexture2D(u16(ic.m_width)
+		, u16(ic.m_height)
+		, ic.m_numMips > 1
+		, 1
+		, (bgfx::TextureFormat::Enum)ic.m_format
+		);
+	ud.data      = data;
+	ud.size      = size;
+	ud.owned     = owned;
+	ud.mip       = ic.m_numMips - 1;
+	ud.row       = 0;
+	array::push_back(_uploads, ud);
+	return true;
+}
+
+void TextureManager::upload()
+{
+	const u32 num = array::size(_uploads);
+	u32 budget = _upload_budget;
+	u32 num_done = 0;
+
+	// Textures are completed in the order they were queued
+	while (num_done < num && budget > 0)
+	{
+		UploadData& ud = _uploads[num_done];
+
+		bimg::ImageContainer ic;
+		bimg::imageParse(ic, ud.data, ud.size, NULL);
+		bimg::ImageMip mip;
+		bimg::imageGetRawData(ic, 0, u8(ud.mip), ud.data, ud.size, mip);
+
+		// Rows of blocks are the smallest unit that can be uploaded
+		const bimg::ImageBlockInfo& bi = bimg::getBlockInfo(ic.m_format);
+		const u32 width    = bx::max(ic.m_width >> ud.mip, 1u);
+		const u32 height   = bx::max(ic.m_height >> ud.mip, 1u);
+		const u32 num_rows = (mip.m_height + bi.blockHeight - 1) / bi.blockHeight;
+		const u32 pitch    = mip.m_size / num_rows;
+
+		// Upload at least one row, so that each texture progresses
+		const u32 n = bx::min(num_rows - ud.row, bx::max(budget / pitch, 1u));
+		const u32 y = ud.row * bi.blockHeight;
+		bgfx::updateTexture2D(ud.handle
+			, 0
+			, u8(ud.mip)
+			, 0
+			, u16(y)
+			, u16(width)
+			, u16(bx::min(n * bi.blockHeight, height - y))
+			, bgfx::copy(mip.m_data + ud.row*pitch, n*pitch)
+			);
+
+		budget -= bx::min(n*pitch, budget);
+		ud.row += n;
+
+		if (ud.row < num_rows)
+			continue;
+
+		ud.row = 0;
+		if (ud.mip > 0)
+		{
+			--ud.mip;
+			continue;
+		}
+
+		complete_upload(ud);
+		++num_done;
+	}
+
+	if (num_done > 0)
+	{
+		memmove(array::begin(_uploads), array::begin(_uploads) + num_done, (num - num_done)*sizeof(UploadData));
+		array::resize(_uploads, num - num_done);
+	}
+}
+
+void TextureManager::complete_upload(UploadData& ud)
+{
+	const u32 i = hash_map::get(_map, ud.id, UINT32_MAX);
+	CE_ASSERT(i != UINT32_MAX, "Texture not found");
+
+	TextureData& td = _textures[i];
+	TextureResource* tr = td.resource;
+
+	if (tr->handle.idx != _fallback.idx)
+		bgfx::destroy(tr->handle);
+	tr->handle = ud.handle;
+
+	if (ud.stream_id != 0)
+	{
+		_memory -= texture_resource::mips_size(tr, tr->base_mip);
+		gpu_memory::deallocate(GpuMemoryCategory::TEXTURE, texture_resource::mips_size(tr, tr->base_mip));
+		tr->base_mip = ud.base_mip;
+		_memory += texture_resource::mips_size(tr, tr->base_mip);
+		gpu_memory::allocate(GpuMemoryCategory::TEXTURE, texture_resource::mips_size(tr, tr->base_mip));
+
+		td.stream_id = 0;
+	}
+
+	_allocator->deallocate(ud.owned);
+
+	// The materials bind the texture handle directly
+	_resource_manager->touch();
+}
+
+void TextureManager::complete_stream(StreamData& sd)
+{
+	const u32 i = hash_map::get(_map, sd.id, UINT32_MAX);
+
+	// The texture might have been unloaded or reloaded in the meantime.
+	if (i != UINT32_MAX && _textures[i].stream_id == sd.stream_id)
+	{
+		// The texture keeps its current mips until the upload is complete
+		if (!queue_upload(sd.id, sd.stream_id, sd.base_mip, sd.data, sd.size, sd.data))
+		{
+			UploadData ud;
+			ud.id        = sd.id;
+			ud.stream_id = sd.stream_id;
+			ud.base_mip  = sd.base_mip;
+			ud.handle    = bgfx::createTexture(bgfx::makeRef(sd.data, sd.size, release_mips, _allocator));
+			ud.owned     = NULL;
+			complete_upload(ud);
+		}
+	}
+	else
+	{
+		_allocator->deallocate(sd.data);
+	}
+
+	--_num_streams;
+	CE_DELETE(*_allocator, &sd);
+}
+
+} // namespace crown
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/strings/string_id.h"
+#include "core/types.h"
+#include "resource/types.h"
+#include <bgfx/bgfx.h>
+
+namespace crown
+{
+/// Brings textures online and streams their mips.
+///
+/// Textures start with their least detailed mips only. More detailed
+/// mips are streamed in by the loader threads according to the distance
+/// hints received with set_distance(), and the most detailed mips of the
+/// farthest textures are dropped to stay within the memory budget.
+///
+/// Large textures are not uploaded to the GPU at once: they are filled a
+/// few rows at a time within the upload budget of each frame, and keep
+/// their previous handle until they are complete.
+///
+/// @ingroup World
+struct TextureManager
+{
+	struct TextureData
+	{
+		StringId64 id;
+		TextureResource* resource;
+		f32 distance;      ///< Smallest distance hinted since the last update().
+		f32 last_distance; ///< Distance used to select target_mip.
+		u32 target_mip;
+		u32 stream_id;     ///< Stream or upload in flight, 0 if none.
+	};
+
+	/// Texture being filled by update().
+	struct UploadData
+	{
+		StringId64 id;
+		u32 stream_id;              ///< Stream of the mips, 0 if uploading at online().
+		u32 base_mip;
+		bgfx::TextureHandle handle; ///< Texture being filled.
+		const void* data;           ///< KTX container.
+		u32 size;
+		void* owned;                ///< Deallocated when done, NULL if data belongs to the resource.
+		u32 mip;                    ///< Mip being uploaded, from the least detailed.
+		u32 row;                    ///< Next row of blocks of mip to upload.
+	};
+
+	struct StreamData
+	{
+		TextureManager* manager;
+		StringId64 id;
+		u32 stream_id;
+		u32 base_mip;
+		void* data;
+		u32 size;
+	};
+
+	Allocator* _allocator;
+	ResourceManager* _resource_manager;
+	HashMap<StringId64, u32> _map;
+	Array<TextureData> _textures;
+	u32 _next_stream_id;
+	u32 _num_streams;
+	u64 _memory_budget;
+	u64 _memory;
+	Array<UploadData> _uploads;
+	u32 _upload_budget;
+	bgfx::TextureHandle _fallback; ///< Used by textures uploading at online().
+
+	///
+	TextureManager(Allocator& a, ResourceManager& rm);
+
+	///
+	~TextureManager();
+
+	///
+	void online(StringId64 id, ResourceManager& rm);
+
+	///
+	void offline(StringId64 id, ResourceManager& rm);
+
+	/// Hints that the texture @a id is used at @a distance from the camera.
+	/// The smallest distance hinted between two update() calls is used.
+	void set_distance(StringId64 id, f32 distance);
+
+	/// Sets the maximum @a size in bytes of the texture memory.
+	void set_memory_budget(u64 size);
+
+	/// Sets the maximum @a size in bytes uploaded to textures each frame.
+	void set_upload_budget(u32 size);
+
+	/// Selects the mips of each texture, starts streaming them and
+	/// uploads the textures within the upload budget.
+	void update();
+
+	/// Queues the KTX container @a data for upload to the texture @a id.
+	/// Returns false if the container can only be uploaded at once.
+	bool queue_upload(StringId64 id, u32 stream_id, u32 base_mip, const void* data, u32 size, void* owned);
+
+	/// Uploads the queued textures until the upload budget is spent.
+	void upload();
+
+	/// Replaces the handle of the texture @a id with the uploaded one.
+	void complete_upload(UploadData& ud);
+
+	/// Do not call explicitly.
+	void complete_stream(StreamData& sd);
+};
+
+} // namespace crown
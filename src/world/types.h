@@ -19,13 +19,20 @@ struct Gui;
 struct Level;
 struct Material;
 struct MaterialManager;
+struct NavigationWorld;
+struct OcclusionBuffer;
 struct PhysicsWorld;
+struct RenderQueue;
 struct RenderWorld;
+struct Replication;
 struct SceneGraph;
 struct ScriptWorld;
 struct ShaderManager;
+struct SkeletonAnimation;
 struct SoundWorld;
+struct TextureManager;
 struct UnitManager;
+struct UnitTemplateManager;
 struct World;
 
 typedef u32 SoundInstanceId;
@@ -41,16 +48,22 @@ typedef u32 SoundInstanceId;
 #define SOUND_WORLD_MARKER             0x44052b07
 #define PHYSICS_WORLD_MARKER           0x1cf49bae
 #define ANIMATION_STATE_MACHINE_MARKER 0x59a1c462
-
-static const StringId32 COMPONENT_TYPE_ACTOR                   = StringId32("actor");
-static const StringId32 COMPONENT_TYPE_CAMERA                  = StringId32("camera");
-static const StringId32 COMPONENT_TYPE_COLLIDER                = StringId32("collider");
-static const StringId32 COMPONENT_TYPE_LIGHT                   = StringId32("light");
-static const StringId32 COMPONENT_TYPE_MESH_RENDERER           = StringId32("mesh_renderer");
-static const StringId32 COMPONENT_TYPE_SPRITE_RENDERER         = StringId32("sprite_renderer");
-static const StringId32 COMPONENT_TYPE_TRANSFORM               = StringId32("transform");
-static const StringId32 COMPONENT_TYPE_SCRIPT                  = StringId32("script");
-static const StringId32 COMPONENT_TYPE_ANIMATION_STATE_MACHINE = StringId32("animation_state_machine");
+#define SKELETON_ANIMATION_MARKER      0x3e6b9f15
+#define REPLICATION_MARKER             0x5b0e2d61
+#define NAVIGATION_WORLD_MARKER        0x2c7d9a43
+
+static constexpr StringId32 COMPONENT_TYPE_ACTOR                   = "actor"_id32;
+static constexpr StringId32 COMPONENT_TYPE_CAMERA                  = "camera"_id32;
+static constexpr StringId32 COMPONENT_TYPE_COLLIDER                = "collider"_id32;
+static constexpr StringId32 COMPONENT_TYPE_LIGHT                   = "light"_id32;
+static constexpr StringId32 COMPONENT_TYPE_MESH_RENDERER           = "mesh_renderer"_id32;
+static constexpr StringId32 COMPONENT_TYPE_PARTICLE_EMITTER        = "particle_emitter"_id32;
+static constexpr StringId32 COMPONENT_TYPE_TILEMAP                 = "tilemap"_id32;
+static constexpr StringId32 COMPONENT_TYPE_SPRITE_RENDERER         = "sprite_renderer"_id32;
+static constexpr StringId32 COMPONENT_TYPE_TRANSFORM               = "transform"_id32;
+static constexpr StringId32 COMPONENT_TYPE_SCRIPT                  = "script"_id32;
+static constexpr StringId32 COMPONENT_TYPE_ANIMATION_STATE_MACHINE = "animation_state_machine"_id32;
+static constexpr StringId32 COMPONENT_TYPE_SKELETON                = "skeleton"_id32;
 
 /// Enumerates camera projection types.
 ///
@@ -66,6 +79,22 @@ struct ProjectionType
 	};
 };
 
+/// Enumerates the states of a path requested to a NavigationWorld.
+///
+/// @ingroup World
+struct PathStatus
+{
+	enum Enum
+	{
+		PENDING,   ///< The path is being searched.
+		FOUND,
+		NOT_FOUND, ///< The goal can not be reached from the start.
+		INVALID,   ///< The handle does not refer to a path.
+
+		COUNT
+	};
+};
+
 /// Enumerates light types.
 ///
 /// @ingroup World
@@ -201,7 +230,6 @@ struct EventType
 
 		PHYSICS_COLLISION,
 		PHYSICS_TRIGGER,
-		PHYSICS_TRANSFORM,
 
 		COUNT
 	};
@@ -266,8 +294,11 @@ INSTANCE_ID(CameraInstance);
 INSTANCE_ID(MeshInstance);
 INSTANCE_ID(SpriteInstance);
 INSTANCE_ID(LightInstance);
+INSTANCE_ID(ParticleInstance);
+INSTANCE_ID(TilemapInstance);
 INSTANCE_ID(ColliderInstance);
 INSTANCE_ID(ActorInstance);
+INSTANCE_ID(MoverInstance);
 INSTANCE_ID(JointInstance);
 INSTANCE_ID(ScriptInstance);
 
@@ -307,6 +338,15 @@ struct AnimationStateMachineDesc
 	StringId64 state_machine_resource; ///< Name of .state_machine resource.
 };
 
+/// Skeleton description.
+///
+/// @ingroup World
+struct SkeletonDesc
+{
+	StringId64 skeleton_resource;  ///< Name of .skeleton resource.
+	StringId64 animation_resource; ///< Name of .skeleton_animation resource played at spawn, if any.
+};
+
 /// Light description.
 ///
 /// @ingroup World
@@ -317,6 +357,29 @@ struct LightDesc
 	f32 intensity;
 	f32 spot_angle; ///< In radians.
 	Vector3 color;  ///< Color of the light.
+	u32 cast_shadows; ///< Whether the light casts shadows.
+};
+
+/// Particle emitter description.
+///
+/// @ingroup World
+struct ParticleEmitterDesc
+{
+	StringId64 particle_resource; ///< Name of .particle resource.
+	StringId64 material_resource; ///< Name of .material resource.
+	u32 playing;                  ///< Whether the emitter spawns particles when created.
+	char _pad0[4];
+};
+
+/// Tilemap description.
+///
+/// @ingroup World
+struct TilemapDesc
+{
+	StringId64 tilemap_resource;  ///< Name of .tilemap resource.
+	StringId64 material_resource; ///< Name of .material resource.
+	u32 layer;                    ///< Sprite layer the tilemap is drawn in.
+	u32 depth;                    ///< Depth of the tilemap in its layer.
 };
 
 /// Script description.
@@ -396,6 +459,8 @@ struct ColliderDesc
 	HeightfieldShape heightfield;
 	u32 size;                     ///< Size of additional data.
 //	char data[size]               ///< Convex Hull, Mesh, Heightfield data.
+//	Mesh data is followed by the pointer size of the compiler and the
+//	size and data of the serialized btQuantizedBvh, if any.
 };
 
 struct HingeJoint
@@ -434,6 +499,51 @@ struct RaycastHit
 	ActorInstance actor; ///< The actor that was hit.
 };
 
+/// Shape and limits of a mover, a character moved by PhysicsWorld.
+struct MoverDesc
+{
+	f32 radius;      ///< Radius of the capsule.
+	f32 height;      ///< Height of the capsule, from the feet to the top of the head.
+	f32 step_height; ///< Maximum height of the steps climbed and descended.
+	f32 max_slope;   ///< Maximum slope, in radians, the mover can stand on.
+};
+
+/// Query of PhysicsWorld::cast_batch().
+struct PhysicsCast
+{
+	enum Type { RAY, SPHERE, BOX } type;
+	Vector3 from;         ///< In world-space.
+	Vector3 dir;          ///< In world-space, normalized.
+	f32 len;
+	Vector3 half_extents; ///< Half extents of the box, x is the radius of the sphere.
+};
+
+/// Result of a ray cast against the meshes or the sprites of a RenderWorld.
+struct RenderRaycastHit
+{
+	UnitId unit;  ///< The unit that was hit, invalid if nothing was hit.
+	f32 distance; ///< Distance along the ray, -1.0 if nothing was hit.
+};
+
+/// Statistics of the last frame rendered by a RenderWorld, summed over
+/// all its cameras.
+struct RenderStats
+{
+	u32 mesh_draw_calls;     ///< Draw calls of the meshes, instanced ones count once.
+	u32 mesh_material_binds; ///< Changes of material between the mesh draw calls.
+	u32 mesh_triangles;      ///< Triangles of the meshes drawn, at their current lod.
+	u32 meshes_submitted;    ///< Meshes which passed culling.
+	u32 meshes_culled;       ///< Meshes outside the frustum of the first camera.
+	u32 meshes_occluded;     ///< Meshes hidden in the occlusion buffer.
+	u32 sprites_submitted;   ///< Sprites which passed culling.
+	u32 sprites_culled;      ///< Sprites outside the frustum of the first camera.
+	u32 sprite_draw_calls;   ///< Draw calls of the sprites, the ones drawn together count once.
+	u32 tilemap_draw_calls;  ///< Draw calls of the tilemaps, one for each chunk drawn.
+	u32 tilemap_chunks_culled; ///< Chunks of the tilemaps outside the frustum of the first camera.
+	u32 transient_vb_used;   ///< Bytes of transient vertex buffer used by the previous frame.
+	u64 texture_memory;      ///< Bytes of texture memory used by the resident mip levels.
+};
+
 struct UnitSpawnedEvent
 {
 	UnitId unit; ///< The unit spawned.
@@ -465,11 +575,4 @@ struct PhysicsTriggerEvent
 	ActorInstance other;
 };
 
-struct PhysicsTransformEvent
-{
-	UnitId unit_id;
-	Vector3 position;    ///< In world-space.
-	Quaternion rotation; ///< In world-space.
-};
-
 } // namespace crown
@@ -3,12 +3,12 @@
  * License: https://github.com/dbartolini/crown/blob/master/LICENSE
  */
 
+#include "config.h"
 #include "core/containers/array.h"
 #include "core/containers/queue.h"
 #include "world/unit_manager.h"
 #include "world/world.h"
 
-#define MINIMUM_FREE_INDICES 1024
 
 namespace crown
 {
@@ -29,7 +29,9 @@ UnitId UnitManager::create()
 {
 	u32 idx;
 
-	if (queue::size(_free_indices) > MINIMUM_FREE_INDICES)
+	// Recycle indices only when there are plenty of them, so that the
+	// generation of each index wraps around as late as possible
+	if (queue::size(_free_indices) > CROWN_MIN_FREE_UNIT_INDICES)
 	{
 		idx = queue::front(_free_indices);
 		queue::pop_front(_free_indices);
@@ -44,6 +46,35 @@ UnitId UnitManager::create()
 	return make_unit(idx, _generation[idx]);
 }
 
+void UnitManager::create(u32 num, UnitId* units)
+{
+	u32 n = 0;
+
+	const u32 num_free = queue::size(_free_indices);
+	if (num_free > CROWN_MIN_FREE_UNIT_INDICES)
+	{
+		const u32 num_available = num_free - CROWN_MIN_FREE_UNIT_INDICES;
+		const u32 num_recycled = num < num_available ? num : num_available;
+		for (; n < num_recycled; ++n)
+		{
+			const u32 idx = queue::front(_free_indices);
+			queue::pop_front(_free_indices);
+			units[n] = make_unit(idx, _generation[idx]);
+		}
+	}
+
+	// Make new slots for the remaining ones
+	const u32 first = array::size(_generation);
+	CE_ASSERT(first + num - n <= (1 << UNIT_INDEX_BITS), "Indices out of bounds");
+	array::resize(_generation, first + num - n);
+
+	for (u32 idx = first; n < num; ++n, ++idx)
+	{
+		_generation[idx] = 0;
+		units[n] = make_unit(idx, 0);
+	}
+}
+
 UnitId UnitManager::create(World& world)
 {
 	return world.spawn_empty_unit();
@@ -60,7 +91,20 @@ void UnitManager::destroy(UnitId id)
 	++_generation[idx];
 	queue::push_back(_free_indices, idx);
 
-	trigger_destroy_callbacks(id);
+	trigger_destroy_callbacks(&id, 1);
+}
+
+void UnitManager::destroy(const UnitId* units, u32 num)
+{
+	for (u32 i = 0; i < num; ++i)
+	{
+		const u32 idx = units[i].index();
+		CE_ASSERT(alive(units[i]), "Unit is not alive");
+		++_generation[idx];
+		queue::push_back(_free_indices, idx);
+	}
+
+	trigger_destroy_callbacks(units, num);
 }
 
 void UnitManager::register_destroy_function(DestroyFunction fn, void* user_data)
@@ -86,10 +130,10 @@ void UnitManager::unregister_destroy_function(void* user_data)
 	CE_FATAL("Unknown destroy function");
 }
 
-void UnitManager::trigger_destroy_callbacks(UnitId id)
+void UnitManager::trigger_destroy_callbacks(const UnitId* units, u32 num)
 {
 	for (u32 i = 0; i < array::size(_destroy_callbacks); ++i)
-		_destroy_callbacks[i].destroy(id, _destroy_callbacks[i].user_data);
+		_destroy_callbacks[i].destroy(units, num, _destroy_callbacks[i].user_data);
 }
 
 } // namespace crown
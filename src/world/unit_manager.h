@@ -17,7 +17,8 @@ namespace crown
 /// @ingroup World
 struct UnitManager
 {
-	typedef void (*DestroyFunction)(UnitId unit, void* user_data);
+	/// Called with each batch of @a num @a units being destroyed.
+	typedef void (*DestroyFunction)(const UnitId* units, u32 num, void* user_data);
 
 	struct DestroyData
 	{
@@ -38,6 +39,9 @@ struct UnitManager
 	/// Creates a new empty unit.
 	UnitId create();
 
+	/// Creates @a num new empty units and writes them to @a units.
+	void create(u32 num, UnitId* units);
+
 	/// Creates a new empty unit in the given @a world.
 	UnitId create(World& world);
 
@@ -47,11 +51,15 @@ struct UnitManager
 	/// Destroys the unit @a id.
 	void destroy(UnitId id);
 
+	/// Destroys the @a num @a units. The destroy callbacks are grouped
+	/// by function: each one is called for all the units before the next.
+	void destroy(const UnitId* units, u32 num);
+
 	void register_destroy_function(DestroyFunction fn, void* user_data);
 
 	void unregister_destroy_function(void* user_data);
 
-	void trigger_destroy_callbacks(UnitId id);
+	void trigger_destroy_callbacks(const UnitId* units, u32 num);
 };
 
 } // namespace crown
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#include "core/containers/sort_map.h"
+#include "core/math/matrix4x4.h"
+#include "core/memory/memory.h"
+#include "resource/mesh_resource.h"
+#include "resource/resource_manager.h"
+#include "resource/unit_resource.h"
+#include "world/material_manager.h"
+#include "world/unit_template.h"
+
+namespace crown
+{
+static inline u64 template_key(const UnitResource* ur)
+{
+	return (u64)(uintptr_t)ur;
+}
+
+static inline const ComponentData* next_component(const ComponentData* cd)
+{
+	return (const ComponentData*)((const char*)(cd + 1) + cd->size);
+}
+
+UnitTemplateManager::UnitTemplateManager(Allocator& a, ResourceManager& rm, MaterialManager& mm)
+	: _allocator(&a)
+	, _resource_manager(&rm)
+	, _material_manager(&mm)
+	, _templates(a)
+{
+}
+
+UnitTemplateManager::~UnitTemplateManager()
+{
+	auto cur = sort_map::begin(_templates);
+	auto end = sort_map::end(_templates);
+	for (; cur != end; ++cur)
+	{
+		_allocator->deallocate(cur->second);
+	}
+}
+
+void UnitTemplateManager::create(const UnitResource* ur)
+{
+	if (sort_map::has(_templates, template_key(ur)))
+		return;
+
+	const u32 num_components = ur->num_component_types;
+
+	u32 num_transforms = 0;
+	u32 num_colliders = 0;
+	u32 num_meshes = 0;
+	u32 num_sprites = 0;
+
+	const ComponentData* component = (const ComponentData*)(ur + 1);
+	for (u32 cc = 0; cc < num_components; ++cc, component = next_component(component))
+	{
+		if (component->type == COMPONENT_TYPE_TRANSFORM)
+			num_transforms += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_COLLIDER)
+			num_colliders += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_MESH_RENDERER)
+			num_meshes += component->num_instances;
+		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
+			num_sprites += component->num_instances;
+	}
+
+	const u32 bytes = 0
+		+ sizeof(UnitTemplate)
+		+ num_components*sizeof(ComponentData*) + alignof(ComponentData*)
+		+ num_components*sizeof(u32) + alignof(u32)
+		+ num_transforms*sizeof(Matrix4x4) + alignof(Matrix4x4)
+		+ num_colliders*sizeof(ColliderDesc*) + alignof(ColliderDesc*)
+		+ num_meshes*sizeof(UnitTemplate::Mesh) + alignof(UnitTemplate::Mesh)
+		+ num_sprites*sizeof(UnitTemplate::Sprite) + alignof(UnitTemplate::Sprite)
+		;
+
+	UnitTemplate* ut = (UnitTemplate*)_allocator->allocate(bytes);
+	ut->num_components = num_components;
+	ut->components = (const ComponentData**  )memory::align_top(ut + 1,                            alignof(ComponentData*      ));
+	ut->offsets    = (u32*                   )memory::align_top(ut->components + num_components,   alignof(u32                 ));
+	ut->transforms = (Matrix4x4*             )memory::align_top(ut->offsets + num_components,      alignof(Matrix4x4           ));
+	ut->colliders  = (const ColliderDesc**   )memory::align_top(ut->transforms + num_transforms,   alignof(ColliderDesc*       ));
+	ut->meshes     = (UnitTemplate::Mesh*    )memory::align_top(ut->colliders + num_colliders,     alignof(UnitTemplate::Mesh  ));
+	ut->sprites    = (UnitTemplate::Sprite*  )memory::align_top(ut->meshes + num_meshes,           alignof(UnitTemplate::Sprite));
+
+	num_transforms = 0;
+	num_colliders = 0;
+	num_meshes = 0;
+	num_sprites = 0;
+
+	ResourceHandle invalid;
+	invalid.index = UINT32_MAX;
+	invalid.generation = 0;
+
+	component = (const ComponentData*)(ur + 1);
+	for (u32 cc = 0; cc < num_components; ++cc, component = next_component(component))
+	{
+		const u32* unit_index = (const u32*)(component + 1);
+		const char* data = (const char*)(unit_index + component->num_instances);
+		const u32 num = component->num_instances;
+
+		ut->components[cc] = component;
+		ut->offsets[cc] = 0;
+
+		if (component->type == COMPONENT_TYPE_TRANSFORM)
+		{
+			ut->offsets[cc] = num_transforms;
+
+			const TransformDesc* td = (const TransformDesc*)data;
+			for (u32 i = 0; i < num; ++i, ++td)
+				ut->transforms[num_transforms++] = matrix4x4(td->rotation, td->position);
+		}
+		else if (component->type == COMPONENT_TYPE_COLLIDER)
+		{
+			ut->offsets[cc] = num_colliders;
+
+			const ColliderDesc* cd = (const ColliderDesc*)data;
+			for (u32 i = 0; i < num; ++i)
+			{
+				ut->colliders[num_colliders++] = cd;
+				cd = (const ColliderDesc*)((const char*)(cd + 1) + cd->size);
+			}
+		}
+		else if (component->type == COMPONENT_TYPE_MESH_RENDERER)
+		{
+			ut->offsets[cc] = num_meshes;
+
+			for (u32 i = 0; i < num; ++i, ++num_meshes)
+			{
+				ut->meshes[num_meshes].handle = invalid;
+				ut->meshes[num_meshes].mr = NULL;
+				ut->meshes[num_meshes].mg = NULL;
+			}
+		}
+		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
+		{
+			ut->offsets[cc] = num_sprites;
+
+			for (u32 i = 0; i < num; ++i, ++num_sprites)
+			{
+				ut->sprites[num_sprites].handle = invalid;
+				ut->sprites[num_sprites].sr = NULL;
+			}
+		}
+	}
+
+	sort_map::set(_templates, template_key(ur), ut);
+}
+
+void UnitTemplateManager::destroy(const UnitResource* ur)
+{
+	UnitTemplate* ut = sort_map::get(_templates, template_key(ur), (UnitTemplate*)NULL);
+	if (ut == NULL)
+		return;
+
+	_allocator->deallocate(ut);
+	sort_map::remove(_templates, template_key(ur));
+}
+
+UnitTemplate& UnitTemplateManager::get(const UnitResource* ur)
+{
+	UnitTemplate* ut = sort_map::get(_templates, template_key(ur), (UnitTemplate*)NULL);
+
+	if (ut == NULL)
+	{
+		create(ur);
+		ut = sort_map::get(_templates, template_key(ur), (UnitTemplate*)NULL);
+	}
+
+	return *ut;
+}
+
+const UnitTemplate::Mesh& UnitTemplateManager::mesh(UnitTemplate& ut, u32 i, const MeshRendererDesc& mrd)
+{
+	UnitTemplate::Mesh& mesh = ut.meshes[i];
+
+	if (!_resource_manager->is_valid(mesh.handle))
+	{
+		mesh.mr = (const MeshResource*)_resource_manager->get(RESOURCE_TYPE_MESH, mrd.mesh_resource);
+		mesh.mg = mesh.mr->geometry(mrd.geometry_name);
+		mesh.handle = _resource_manager->handle(RESOURCE_TYPE_MESH, mrd.mesh_resource);
+		_material_manager->create_material(mrd.material_resource);
+	}
+
+	return mesh;
+}
+
+const UnitTemplate::Sprite& UnitTemplateManager::sprite(UnitTemplate& ut, u32 i, const SpriteRendererDesc& srd)
+{
+	UnitTemplate::Sprite& sprite = ut.sprites[i];
+
+	if (!_resource_manager->is_valid(sprite.handle))
+	{
+		sprite.sr = (const SpriteResource*)_resource_manager->get(RESOURCE_TYPE_SPRITE, srd.sprite_resource);
+		sprite.handle = _resource_manager->handle(RESOURCE_TYPE_SPRITE, srd.sprite_resource);
+		_material_manager->create_material(srd.material_resource);
+	}
+
+	return sprite;
+}
+
+} // namespace crown
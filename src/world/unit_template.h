@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2012-2018 Daniele Bartolini and individual contributors.
+ * License: https://github.com/dbartolini/crown/blob/master/LICENSE
+ */
+
+#pragma once
+
+#include "core/containers/types.h"
+#include "core/math/types.h"
+#include "core/strings/string_id.h"
+#include "core/types.h"
+#include "resource/types.h"
+#include "world/types.h"
+
+namespace crown
+{
+/// Data of a UnitResource converted once, so that spawning its units only
+/// has to copy it into the managers.
+///
+/// @ingroup World
+struct UnitTemplate
+{
+	struct Mesh
+	{
+		ResourceHandle handle; ///< Handle to the .mesh resource @a mr.
+		const MeshResource* mr;
+		const MeshGeometry* mg;
+	};
+
+	struct Sprite
+	{
+		ResourceHandle handle; ///< Handle to the .sprite resource @a sr.
+		const SpriteResource* sr;
+	};
+
+	u32 num_components;
+	const ComponentData** components; ///< Components in the order their instances must be created.
+	u32* offsets;                     ///< Index of the first instance of each component in its array below.
+	Matrix4x4* transforms;            ///< Local poses of the transform instances.
+	const ColliderDesc** colliders;   ///< Descriptions of the collider instances.
+	Mesh* meshes;                     ///< Resources of the mesh renderer instances, resolved when first spawned.
+	Sprite* sprites;                  ///< Resources of the sprite renderer instances, resolved when first spawned.
+};
+
+/// Builds and owns the UnitTemplate of each UnitResource.
+///
+/// @ingroup World
+struct UnitTemplateManager
+{
+	Allocator* _allocator;
+	ResourceManager* _resource_manager;
+	MaterialManager* _material_manager;
+	SortMap<u64, UnitTemplate*> _templates;
+
+	///
+	UnitTemplateManager(Allocator& a, ResourceManager& rm, MaterialManager& mm);
+
+	///
+	~UnitTemplateManager();
+
+	/// Creates the template of @a ur.
+	void create(const UnitResource* ur);
+
+	/// Destroys the template of @a ur.
+	void destroy(const UnitResource* ur);
+
+	/// Returns the template of @a ur, creating it if it does not exist.
+	UnitTemplate& get(const UnitResource* ur);
+
+	/// Returns the resources of the mesh renderer @a i of @a ut, which is
+	/// described by @a mrd. They are resolved again if they have been
+	/// reloaded since the last call.
+	const UnitTemplate::Mesh& mesh(UnitTemplate& ut, u32 i, const MeshRendererDesc& mrd);
+
+	/// Returns the resources of the sprite renderer @a i of @a ut, which is
+	/// described by @a srd.
+	/// @copydetails UnitTemplateManager::mesh()
+	const UnitTemplate::Sprite& sprite(UnitTemplate& ut, u32 i, const SpriteRendererDesc& srd);
+};
+
+} // namespace crown
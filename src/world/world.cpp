@@ -9,29 +9,50 @@
 #include "core/math/vector3.h"
 #include "core/math/vector4.h"
 #include "core/memory/temp_allocator.h"
+#include "core/thread/job_system.h"
+#include "device/pipeline.h"
+#include "device/profiler.h"
 #include "lua/lua_environment.h"
+#include "resource/level_resource.h"
 #include "resource/resource_manager.h"
 #include "resource/unit_resource.h"
 #include "world/animation_state_machine.h"
 #include "world/debug_line.h"
 #include "world/gui.h"
 #include "world/level.h"
+#include "world/navigation_world.h"
 #include "world/physics_world.h"
 #include "world/render_world.h"
+#include "world/replication.h"
 #include "world/scene_graph.h"
 #include "world/script_world.h"
+#include "world/skeleton_animation.h"
+#include "world/snapshot.h"
 #include "world/sound_world.h"
 #include "world/unit_manager.h"
+#include "world/unit_template.h"
 #include "world/world.h"
+#include <algorithm> // std::lower_bound
 
 namespace crown
 {
-World::World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, UnitManager& um, LuaEnvironment& env)
+World::World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, TextureManager& tm, UnitManager& um, UnitTemplateManager& utm, LuaEnvironment& env)
 	: _marker(WORLD_MARKER)
-	, _allocator(&a)
+	, _world_allocator(a, "world")
+	, _scene_graph_allocator(_world_allocator, "world.scene_graph")
+	, _render_world_allocator(_world_allocator, "world.render_world")
+	, _physics_world_allocator(_world_allocator, "world.physics_world")
+	, _sound_world_allocator(_world_allocator, "world.sound_world")
+	, _navigation_world_allocator(_world_allocator, "world.navigation_world")
+	, _script_world_allocator(_world_allocator, "world.script_world")
+	, _animation_state_machine_allocator(_world_allocator, "world.animation_state_machine")
+	, _skeleton_animation_allocator(_world_allocator, "world.skeleton_animation")
+	, _replication_allocator(_world_allocator, "world.replication")
+	, _allocator(&_world_allocator)
 	, _resource_manager(&rm)
 	, _shader_manager(&sm)
 	, _material_manager(&mm)
+	, _unit_template_manager(&utm)
 	, _lua_environment(&env)
 	, _unit_manager(&um)
 	, _lines(NULL)
@@ -39,42 +60,59 @@ World::World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManag
 	, _render_world(NULL)
 	, _physics_world(NULL)
 	, _sound_world(NULL)
+	, _navigation_world(NULL)
 	, _animation_state_machine(NULL)
-	, _units(a)
-	, _levels(a)
-	, _camera(a)
-	, _camera_map(a)
-	, _events(a)
-	, _gui_buffer(sm)
-	, _guis(a)
+	, _skeleton_animation(NULL)
+	, _replication(NULL)
+	, _units(_world_allocator)
+	, _unit_index(_world_allocator)
+	, _levels(_world_allocator)
+	, _camera(_world_allocator)
+	, _camera_map(_world_allocator)
+	, _events(_world_allocator)
+	, _gui_buffer(_world_allocator, rm, sm, mm)
+	, _guis(_world_allocator)
+	, _interpolation_alpha(1.0f)
 {
 	_lines = create_debug_line(true);
-	_scene_graph   = CE_NEW(*_allocator, SceneGraph)(*_allocator, um);
-	_render_world  = CE_NEW(*_allocator, RenderWorld)(*_allocator, rm, sm, mm, um);
-	_physics_world = CE_NEW(*_allocator, PhysicsWorld)(*_allocator, rm, um, *_lines);
-	_sound_world   = CE_NEW(*_allocator, SoundWorld)(*_allocator);
-	_script_world  = CE_NEW(*_allocator, ScriptWorld)(*_allocator, um, rm, env, *this);
-	_animation_state_machine = CE_NEW(*_allocator, AnimationStateMachine)(*_allocator, rm, um);
+	_scene_graph   = CE_NEW(_scene_graph_allocator, SceneGraph)(_scene_graph_allocator, um);
+	_render_world  = CE_NEW(_render_world_allocator, RenderWorld)(_render_world_allocator, rm, sm, mm, tm, um);
+	_physics_world = CE_NEW(_physics_world_allocator, PhysicsWorld)(_physics_world_allocator, rm, um, *_lines);
+	_sound_world   = CE_NEW(_sound_world_allocator, SoundWorld)(_sound_world_allocator, rm);
+	_navigation_world = CE_NEW(_navigation_world_allocator, NavigationWorld)(_navigation_world_allocator, rm);
+	_script_world  = CE_NEW(_script_world_allocator, ScriptWorld)(_script_world_allocator, um, rm, env, *this);
+	_animation_state_machine = CE_NEW(_animation_state_machine_allocator, AnimationStateMachine)(_animation_state_machine_allocator, rm, um);
+	_skeleton_animation = CE_NEW(_skeleton_animation_allocator, SkeletonAnimation)(_skeleton_animation_allocator, rm, um);
+	_replication   = CE_NEW(_replication_allocator, Replication)(_replication_allocator, um, *_scene_graph);
 
 	_gui_buffer.create();
 }
 
 World::~World()
 {
+	// Levels own the geometries of their static batches, destroy them last
+	_unit_manager->destroy(array::begin(_units), array::size(_units));
+
 	for (u32 i = 0; i < array::size(_levels); ++i)
 		CE_DELETE(*_allocator, _levels[i]);
 
-	for (u32 i = 0; i < array::size(_units); ++i)
-		_unit_manager->destroy(_units[i]);
-
-	CE_DELETE(*_allocator, _animation_state_machine);
-	CE_DELETE(*_allocator, _script_world);
-	CE_DELETE(*_allocator, _sound_world);
-	CE_DELETE(*_allocator, _physics_world);
-	CE_DELETE(*_allocator, _render_world);
-	CE_DELETE(*_allocator, _scene_graph);
+	CE_DELETE(_replication_allocator, _replication);
+	CE_DELETE(_skeleton_animation_allocator, _skeleton_animation);
+	CE_DELETE(_animation_state_machine_allocator, _animation_state_machine);
+	CE_DELETE(_script_world_allocator, _script_world);
+	CE_DELETE(_navigation_world_allocator, _navigation_world);
+	CE_DELETE(_sound_world_allocator, _sound_world);
+	CE_DELETE(_physics_world_allocator, _physics_world);
+	CE_DELETE(_render_world_allocator, _render_world);
+	CE_DELETE(_scene_graph_allocator, _scene_graph);
 	destroy_debug_line(*_lines);
 
+	for (u32 i = 0; i < array::size(_guis); ++i)
+	{
+		CE_DELETE(*_allocator, _guis[i]->_layer);
+		CE_DELETE(*_allocator, _guis[i]);
+	}
+
 	_marker = 0;
 }
 
@@ -86,10 +124,25 @@ UnitId World::spawn_unit(StringId64 name, const Vector3& pos, const Quaternion&
 	return id;
 }
 
+void World::spawn_unit_batch(StringId64 name, const Matrix4x4* poses, u32 num, UnitId* units)
+{
+	const UnitResource* ur = (const UnitResource*)_resource_manager->get(RESOURCE_TYPE_UNIT, name);
+
+	TempAllocator1024 ta;
+	Array<UnitId> unit_lookup(ta);
+	array::resize(unit_lookup, num * ur->num_units);
+	_unit_manager->create(array::size(unit_lookup), array::begin(unit_lookup));
+
+	spawn_units(*this, *ur, poses, num, array::begin(unit_lookup));
+
+	for (u32 i = 0; i < num; ++i)
+		units[i] = unit_lookup[i * ur->num_units];
+}
+
 UnitId World::spawn_empty_unit()
 {
 	UnitId id = _unit_manager->create();
-	array::push_back(_units, id);
+	add_unit(id);
 	post_unit_spawned_event(id);
 	return id;
 }
@@ -97,16 +150,48 @@ UnitId World::spawn_empty_unit()
 void World::destroy_unit(UnitId id)
 {
 	_unit_manager->destroy(id);
-	for (u32 i = 0, n = array::size(_units); i < n; ++i)
+	remove_unit(id);
+	post_unit_destroyed_event(id);
+}
+
+void World::destroy_units(const UnitId* units, u32 num)
+{
+	_unit_manager->destroy(units, num);
+
+	for (u32 i = 0; i < num; ++i)
 	{
-		if (_units[i] == id)
-		{
-			_units[i] = _units[n - 1];
-			array::pop_back(_units);
-			break;
-		}
+		remove_unit(units[i]);
+		post_unit_destroyed_event(units[i]);
 	}
-	post_unit_destroyed_event(id);
+}
+
+void World::add_unit(UnitId unit)
+{
+	const u32 idx = unit.index();
+	const u32 size = array::size(_unit_index);
+	if (idx >= size)
+	{
+		array::resize(_unit_index, idx + 1);
+		for (u32 i = size; i < idx; ++i)
+			_unit_index[i] = UINT32_MAX;
+	}
+
+	_unit_index[idx] = array::size(_units);
+	array::push_back(_units, unit);
+}
+
+void World::remove_unit(UnitId unit)
+{
+	const u32 idx = unit.index();
+	CE_ASSERT(idx < array::size(_unit_index), "Index out of bounds");
+	const u32 i = _unit_index[idx];
+	CE_ASSERT(i < array::size(_units) && _units[i] == unit, "Unit not in world");
+
+	const UnitId last = array::back(_units);
+	_units[i] = last;
+	_unit_index[last.index()] = i;
+	_unit_index[idx] = UINT32_MAX;
+	array::pop_back(_units);
 }
 
 u32 World::num_units() const
@@ -114,63 +199,211 @@ u32 World::num_units() const
 	return array::size(_units);
 }
 
+u32 World::allocated_memory()
+{
+	return _world_allocator.total_allocated();
+}
+
 void World::units(Array<UnitId>& units) const
 {
 	array::reserve(units, array::size(_units));
 	array::push(units, array::begin(_units), array::size(_units));
 }
 
+void World::snapshot(Buffer& buf)
+{
+	array::clear(buf);
+
+	const u32 marker = WORLD_MARKER;
+	const u32 num = array::size(_units);
+	snapshot::write(buf, marker);
+	snapshot::write(buf, num);
+	snapshot::write(buf, array::begin(_units), num*sizeof(UnitId));
+
+	u32 section = snapshot::begin_section(buf);
+	_scene_graph->snapshot(buf);
+	snapshot::end_section(buf, section);
+
+	section = snapshot::begin_section(buf);
+	_render_world->snapshot(buf);
+	snapshot::end_section(buf, section);
+
+	section = snapshot::begin_section(buf);
+	_physics_world->snapshot(buf);
+	snapshot::end_section(buf, section);
+
+	section = snapshot::begin_section(buf);
+	_animation_state_machine->snapshot(buf);
+	snapshot::end_section(buf, section);
+}
+
+bool World::restore(const Buffer& buf)
+{
+	if (array::size(buf) < sizeof(u32)*2)
+		return false;
+
+	const char* data = array::begin(buf);
+
+	u32 marker;
+	u32 num;
+	snapshot::read(data, marker);
+	snapshot::read(data, num);
+	if (marker != WORLD_MARKER || num != array::size(_units))
+		return false;
+
+	// The units of the world must be the same: the generation of their
+	// ids changes if they are destroyed and their index is reused
+	for (u32 i = 0; i < num; ++i)
+	{
+		const UnitId unit = snapshot::element<UnitId>(data, i);
+		const u32 idx = unit.index();
+		if (idx >= array::size(_unit_index)
+			|| _unit_index[idx] == UINT32_MAX
+			|| !(_units[_unit_index[idx]] == unit)
+			)
+			return false;
+	}
+	data += num*sizeof(UnitId);
+
+	const char* scene_graph = snapshot::section(data);
+	const char* render_world = snapshot::section(data);
+	const char* physics_world = snapshot::section(data);
+	const char* animation_state_machine = snapshot::section(data);
+
+	if (!_scene_graph->can_restore(scene_graph)
+		|| !_render_world->can_restore(render_world)
+		|| !_physics_world->can_restore(physics_world)
+		|| !_animation_state_machine->can_restore(animation_state_machine)
+		)
+		return false;
+
+	_scene_graph->restore(scene_graph);
+	_render_world->restore(render_world);
+	_physics_world->restore(physics_world);
+	_animation_state_machine->restore(animation_state_machine);
+	return true;
+}
+
 void World::update_animations(f32 dt)
 {
+	ENTER_PROFILE_SCOPE("world.animation");
 	_animation_state_machine->update(dt);
+	_skeleton_animation->update(dt);
+	LEAVE_PROFILE_SCOPE();
 }
 
-void World::update_scene(f32 dt)
+static void update_scene_simulation(World& w, f32 dt)
 {
+	ENTER_PROFILE_SCOPE("world.replication");
+	w._replication->receive(dt);
+	LEAVE_PROFILE_SCOPE();
+
 	// Process animation events
 	{
-		EventStream& events = _animation_state_machine->_events;
-		const u32 size = array::size(events);
-		u32 read = 0;
-		while (read < size)
-		{
-			const EventHeader* eh = (EventHeader*)&events[read];
-			const char* data = (char*)&eh[1];
+		SpriteFrameChangeEvents& events = w._animation_state_machine->_events;
+		w._render_world->sprite_set_frames(array::begin(events.unit)
+			, array::begin(events.frame_num)
+			, array::size(events.unit)
+			);
+		array::clear(events.unit);
+		array::clear(events.frame_num);
+	}
 
-			read += sizeof(*eh) + eh->size;
+	w._render_world->update_time(dt);
 
-			switch (eh->type)
-			{
-			case 0:
-				{
-					const SpriteFrameChangeEvent& ptev = *(SpriteFrameChangeEvent*)data;
-					_render_world->sprite_set_frame(ptev.unit, ptev.frame_num);
-				}
-				break;
+	// Process skin matrices
+	{
+		SkeletonAnimation* sa = w._skeleton_animation;
+		w._render_world->skin_update(sa->_data.unit
+			, sa->_data.palette_offset
+			, sa->_data.size
+			, array::begin(sa->_palette)
+			, array::size(sa->_palette)
+			);
+	}
 
-			default:
-				CE_FATAL("Unknown event type");
-				break;
-			}
-		}
-		array::clear(events);
+	Array<UnitId> changed_units(default_frame_allocator());
+	Array<Matrix4x4> changed_world(default_frame_allocator());
+
+	w._scene_graph->get_changed(changed_units, changed_world);
+
+	ENTER_PROFILE_SCOPE("world.physics");
+	w._physics_world->update_actor_world_poses(array::begin(changed_units)
+		, array::end(changed_units)
+		, array::begin(changed_world)
+		);
+
+	w._physics_world->update(dt);
+	LEAVE_PROFILE_SCOPE();
+
+	ENTER_PROFILE_SCOPE("world.scene_graph");
+
+	// Process physics transforms
+	{
+		PhysicsTransformEvents& events = w._physics_world->transform_events();
+		w._scene_graph->set_world_poses(array::begin(events.unit)
+			, array::begin(events.transform)
+			, array::begin(events.position)
+			, array::begin(events.rotation)
+			, array::size(events.unit)
+			);
+		w._physics_world->update_transform_cache(events);
+		array::clear(events.unit);
+		array::clear(events.actor);
+		array::clear(events.transform);
+		array::clear(events.position);
+		array::clear(events.rotation);
 	}
 
-	TempAllocator4096 ta;
-	Array<UnitId> changed_units(ta);
-	Array<Matrix4x4> changed_world(ta);
+	w._scene_graph->end_step();
 
-	_scene_graph->get_changed(changed_units, changed_world);
+	array::clear(changed_units);
+	array::clear(changed_world);
+	w._scene_graph->get_changed(changed_units, changed_world);
+	w._scene_graph->clear_changed();
+
+	w._render_world->update_transforms(array::begin(changed_units)
+		, array::end(changed_units)
+		, array::begin(changed_world)
+		);
 
-	_physics_world->update_actor_world_poses(array::begin(changed_units)
+	w._sound_world->update_transforms(array::begin(changed_units)
 		, array::end(changed_units)
 		, array::begin(changed_world)
 		);
+	LEAVE_PROFILE_SCOPE();
+
+	ENTER_PROFILE_SCOPE("world.particles");
+	w._render_world->update_particles(dt);
+	LEAVE_PROFILE_SCOPE();
+
+	ENTER_PROFILE_SCOPE("world.replication");
+	w._replication->send(dt);
+	LEAVE_PROFILE_SCOPE();
 
-	_physics_world->update(dt);
+	w._gui_buffer.reset();
 
+	array::clear(w._events);
+}
+
+void World::update_scene(f32 dt)
+{
+	update_scene_simulation(*this, dt);
+	update_callbacks(dt);
+}
+
+void World::update_simulation(f32 dt)
+{
+	update_animations(dt);
+	update_scene_simulation(*this, dt);
+}
+
+void World::update_callbacks(f32 dt)
+{
 	// Process physics events
 	{
+		Array<PhysicsCollisionEvent> collisions(default_frame_allocator());
+
 		EventStream& events = _physics_world->events();
 		const u32 size = array::size(events);
 		u32 read = 0;
@@ -183,19 +416,9 @@ void World::update_scene(f32 dt)
 
 			switch (eh->type)
 			{
-			case EventType::PHYSICS_TRANSFORM:
-				{
-					const PhysicsTransformEvent& ptev = *(PhysicsTransformEvent*)data;
-					const TransformInstance ti = _scene_graph->instances(ptev.unit_id);
-					const Matrix4x4 pose = matrix4x4(ptev.rotation, ptev.position);
-					_scene_graph->set_world_pose(ti, pose);
-				}
-				break;
-
 			case EventType::PHYSICS_COLLISION:
 				{
-					const PhysicsCollisionEvent& pcev = *(PhysicsCollisionEvent*)data;
-					script_world::collision(*_script_world, pcev);
+					array::push_back(collisions, *(PhysicsCollisionEvent*)data);
 				}
 				break;
 
@@ -208,41 +431,94 @@ void World::update_scene(f32 dt)
 			}
 		}
 		array::clear(events);
+
+		script_world::collisions(*_script_world, array::begin(collisions), array::size(collisions));
 	}
 
-	array::clear(changed_units);
-	array::clear(changed_world);
-	_scene_graph->get_changed(changed_units, changed_world);
-	_scene_graph->clear_changed();
+	// Spawn the next batch of units of the levels being loaded
+	for (u32 i = 0; i < array::size(_levels); ++i)
+	{
+		Level* level = _levels[i];
+		if (level->_streaming)
+			level->stream_step();
+		else if (!level->is_loaded() && level->load_step())
+			post_level_loaded_event();
+	}
 
-	_render_world->update_transforms(array::begin(changed_units)
-		, array::end(changed_units)
-		, array::begin(changed_world)
-		);
+	ENTER_PROFILE_SCOPE("world.navigation");
+	_navigation_world->update();
+	LEAVE_PROFILE_SCOPE();
 
 	_sound_world->update();
 
-	_gui_buffer.reset();
-
-	array::clear(_events);
-
+	ENTER_PROFILE_SCOPE("world.script");
 	script_world::update(*_script_world, dt);
+	LEAVE_PROFILE_SCOPE();
 }
 
 void World::update(f32 dt)
 {
-	update_animations(dt);
-	update_scene(dt);
+	update_simulation(dt);
+	update_callbacks(dt);
+	_lines->update(dt);
+}
+
+struct SimulationJob
+{
+	World* const* worlds;
+	f32 dt;
+};
+
+static void simulation_job(u32 begin, u32 end, void* user_data)
+{
+	SimulationJob& sj = *(SimulationJob*)user_data;
+
+	for (u32 i = begin; i < end; ++i)
+		sj.worlds[i]->update_simulation(sj.dt);
+}
+
+void update_worlds(World* const* worlds, u32 num, f32 dt)
+{
+	SimulationJob sj;
+	sj.worlds = worlds;
+	sj.dt = dt;
+	job_system::parallel_for(0, num, 1, simulation_job, &sj);
+
+	// Scripts are not thread-safe
+	for (u32 i = 0; i < num; ++i)
+		worlds[i]->update_callbacks(dt);
+}
+
+void World::interpolate(f32 alpha)
+{
+	_interpolation_alpha = alpha;
+
+	Array<UnitId> units(default_frame_allocator());
+	Array<Matrix4x4> poses(default_frame_allocator());
+	_scene_graph->get_interpolated(alpha, units, poses);
+
+	_render_world->update_transforms(array::begin(units)
+		, array::end(units)
+		, array::begin(poses)
+		);
 }
 
-void World::render(const Matrix4x4& view)
+void World::render(const Matrix4x4& view, const Matrix4x4& proj)
 {
-	_render_world->render(view);
+	render(&view, &proj, 1);
+}
+
+void World::render(const Matrix4x4* views, const Matrix4x4* projs, u32 num)
+{
+	ENTER_PROFILE_SCOPE("world.render");
+	_render_world->render(views, projs, num);
+	LEAVE_PROFILE_SCOPE();
 
 	_physics_world->debug_draw();
 	_render_world->debug_draw(*_lines);
 
-	_lines->submit();
+	for (u32 c = 0; c < num; ++c)
+		_lines->submit(VIEW_DEBUG + c);
 	_lines->reset();
 }
 
@@ -254,6 +530,7 @@ CameraInstance World::camera_create(UnitId id, const CameraDesc& cd, const Matri
 	camera.fov             = cd.fov;
 	camera.near_range      = cd.near_range;
 	camera.far_range       = cd.far_range;
+	camera.viewport        = vector4(0.0f, 0.0f, 1.0f, 1.0f);
 
 	const u32 last = array::size(_camera);
 	array::push_back(_camera, camera);
@@ -332,7 +609,10 @@ Matrix4x4 World::camera_projection_matrix(UnitId unit)
 Matrix4x4 World::camera_view_matrix(UnitId unit)
 {
 	CameraInstance i = camera_instances(unit);
-	Matrix4x4 view = _scene_graph->world_pose(_camera[i.i].unit);
+	Matrix4x4 view = _interpolation_alpha < 1.0f
+		? _scene_graph->interpolated_world_pose(_camera[i.i].unit, _interpolation_alpha)
+		: _scene_graph->world_pose(_camera[i.i].unit)
+		;
 	invert(view);
 	return view;
 }
@@ -394,6 +674,18 @@ void World::camera_set_viewport_metrics(UnitId unit, u16 x, u16 y, u16 width, u1
 	_camera[i.i].view_height = height;
 }
 
+void World::camera_set_viewport(UnitId unit, f32 x, f32 y, f32 width, f32 height)
+{
+	CameraInstance i = camera_instances(unit);
+	_camera[i.i].viewport = vector4(x, y, width, height);
+}
+
+Vector4 World::camera_viewport(UnitId unit)
+{
+	CameraInstance i = camera_instances(unit);
+	return _camera[i.i].viewport;
+}
+
 Vector3 World::camera_screen_to_world(UnitId unit, const Vector3& pos)
 {
 	CameraInstance i = camera_instances(unit);
@@ -446,15 +738,15 @@ Vector3 World::camera_world_to_screen(UnitId unit, const Vector3& pos)
 	return screen;
 }
 
-SoundInstanceId World::play_sound(const SoundResource& sr, const bool loop, const f32 volume, const Vector3& pos, const f32 range)
+SoundInstanceId World::play_sound(const SoundResource& sr, const bool loop, const f32 volume, const Vector3& pos, const f32 range, u32 priority)
 {
-	return _sound_world->play(sr, loop, volume, range, pos);
+	return _sound_world->play(sr, loop, volume, range, pos, priority);
 }
 
-SoundInstanceId World::play_sound(StringId64 name, const bool loop, const f32 volume, const Vector3& pos, const f32 range)
+SoundInstanceId World::play_sound(StringId64 name, const bool loop, const f32 volume, const Vector3& pos, const f32 range, u32 priority)
 {
 	const SoundResource* sr = (const SoundResource*)_resource_manager->get(RESOURCE_TYPE_SOUND, name);
-	return play_sound(*sr, loop, volume, pos, range);
+	return play_sound(*sr, loop, volume, pos, range, priority);
 }
 
 void World::stop_sound(SoundInstanceId id)
@@ -462,9 +754,10 @@ void World::stop_sound(SoundInstanceId id)
 	_sound_world->stop(id);
 }
 
-void World::link_sound(SoundInstanceId /*id*/, UnitId /*unit*/, s32 /*node*/)
+void World::link_sound(SoundInstanceId id, UnitId unit, s32 /*node*/)
 {
-	CE_FATAL("Not implemented yet");
+	// Units have a single node in the scene graph
+	_sound_world->link(id, unit, _scene_graph->world_position(unit));
 }
 
 void World::set_listener_pose(const Matrix4x4& pose)
@@ -477,6 +770,11 @@ void World::set_sound_position(SoundInstanceId id, const Vector3& pos)
 	_sound_world->set_sound_positions(1, &id, &pos);
 }
 
+void World::set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions)
+{
+	_sound_world->set_sound_positions(num, ids, positions);
+}
+
 void World::set_sound_range(SoundInstanceId id, f32 range)
 {
 	_sound_world->set_sound_ranges(1, &id, &range);
@@ -489,7 +787,7 @@ void World::set_sound_volume(SoundInstanceId id, f32 vol)
 
 DebugLine* World::create_debug_line(bool depth_test)
 {
-	return CE_NEW(*_allocator, DebugLine)(*_shader_manager, depth_test);
+	return CE_NEW(*_allocator, DebugLine)(*_allocator, *_shader_manager, depth_test);
 }
 
 void World::destroy_debug_line(DebugLine& line)
@@ -507,12 +805,29 @@ Gui* World::create_screen_gui()
 	return gui;
 }
 
+Gui* World::create_gui_layer()
+{
+	GuiLayer* layer = CE_NEW(*_allocator, GuiLayer)(*_allocator
+		, _gui_buffer
+		, *_resource_manager
+		, *_shader_manager
+		, *_material_manager
+		);
+	Gui* gui = CE_NEW(*_allocator, Gui)(*layer, *_resource_manager
+		, *_shader_manager
+		, *_material_manager
+		);
+	array::push_back(_guis, gui);
+	return gui;
+}
+
 void World::destroy_gui(Gui& gui)
 {
 	for (u32 i = 0, n = array::size(_guis); i < n; ++i)
 	{
 		if (_guis[i] == &gui)
 		{
+			CE_DELETE(*_allocator, gui._layer);
 			CE_DELETE(*_allocator, &gui);
 			_guis[i] = _guis[n-1];
 			array::pop_back(_guis);
@@ -530,12 +845,52 @@ Level* World::load_level(StringId64 name, const Vector3& pos, const Quaternion&
 	Level* level = CE_NEW(*_allocator, Level)(*_allocator, *_unit_manager, *this, *lr);
 	level->load(pos, rot);
 
+	if (_resource_manager->_prefetch_neighbours)
+	{
+		for (u32 i = 0; i < level_resource::num_neighbours(lr); ++i)
+			_resource_manager->prefetch(level_resource::get_neighbour(lr, i));
+	}
+
 	array::push_back(_levels, level);
 	post_level_loaded_event();
 
 	return level;
 }
 
+Level* World::load_level_async(StringId64 name, const Vector3& pos, const Quaternion& rot, u32 max_units, f32 max_time)
+{
+	const LevelResource* lr = (const LevelResource*)_resource_manager->get(RESOURCE_TYPE_LEVEL, name);
+
+	Level* level = CE_NEW(*_allocator, Level)(*_allocator, *_unit_manager, *this, *lr);
+	level->load_async(pos, rot, max_units, max_time);
+
+	if (_resource_manager->_prefetch_neighbours)
+	{
+		for (u32 i = 0; i < level_resource::num_neighbours(lr); ++i)
+			_resource_manager->prefetch(level_resource::get_neighbour(lr, i));
+	}
+
+	array::push_back(_levels, level);
+	return level;
+}
+
+Level* World::load_level_streamed(StringId64 name, const Vector3& pos, const Quaternion& rot, f32 load_radius, f32 unload_radius, u32 max_units, f32 max_time)
+{
+	const LevelResource* lr = (const LevelResource*)_resource_manager->get(RESOURCE_TYPE_LEVEL, name);
+
+	Level* level = CE_NEW(*_allocator, Level)(*_allocator, *_unit_manager, *this, *lr);
+	level->stream(pos, rot, load_radius, unload_radius, max_units, max_time);
+
+	if (_resource_manager->_prefetch_neighbours)
+	{
+		for (u32 i = 0; i < level_resource::num_neighbours(lr); ++i)
+			_resource_manager->prefetch(level_resource::get_neighbour(lr, i));
+	}
+
+	array::push_back(_levels, level);
+	return level;
+}
+
 void World::post_unit_spawned_event(UnitId id)
 {
 	UnitSpawnedEvent ev;
@@ -550,6 +905,29 @@ void World::post_unit_destroyed_event(UnitId id)
 	event_stream::write(_events, EventType::UNIT_DESTROYED, ev);
 }
 
+void World::unload_level(Level* level)
+{
+	for (u32 i = 0; i < array::size(_levels); ++i)
+	{
+		if (_levels[i] != level)
+			continue;
+
+		level->unload();
+		_levels[i] = array::back(_levels);
+		array::pop_back(_levels);
+		CE_DELETE(*_allocator, level);
+		break;
+	}
+
+	shrink_to_fit();
+}
+
+void World::shrink_to_fit()
+{
+	_scene_graph->shrink_to_fit();
+	_render_world->shrink_to_fit();
+}
+
 void World::post_level_loaded_event()
 {
 	LevelLoadedEvent ev;
@@ -558,95 +936,216 @@ void World::post_level_loaded_event()
 
 void spawn_units(World& w, const UnitResource& ur, const Vector3& pos, const Quaternion& rot, const UnitId* unit_lookup)
 {
+	const Matrix4x4 pose = matrix4x4(rot, pos);
+	spawn_units(w, ur, &pose, 1, unit_lookup);
+}
+
+void spawn_units(World& w, const UnitResource& ur, const Matrix4x4* poses, u32 num_instances, const UnitId* unit_lookup)
+{
+	spawn_units(w, ur, poses, num_instances, unit_lookup, 0, ur.num_units);
+}
+
+// Returns the range [lo, hi) of the instances of component @a cd which
+// belong to units in [first_unit, end_unit).
+static void component_range(const ComponentData& cd, u32 first_unit, u32 end_unit, u32& lo, u32& hi)
+{
+	const u32* unit_index = (const u32*)(&cd + 1);
+	lo = u32(std::lower_bound(unit_index, unit_index + cd.num_instances, first_unit) - unit_index);
+	hi = u32(std::lower_bound(unit_index + lo, unit_index + cd.num_instances, end_unit) - unit_index);
+}
+
+void spawn_units(World& w, const UnitResource& ur, const Matrix4x4* poses, u32 num_instances, const UnitId* unit_lookup, u32 first_unit, u32 end_unit)
+{
+	CE_ASSERT(first_unit <= end_unit && end_unit <= ur.num_units, "Index out of bounds");
+
 	SceneGraph* scene_graph = w._scene_graph;
 	RenderWorld* render_world = w._render_world;
 	PhysicsWorld* physics_world = w._physics_world;
 	ScriptWorld* script_world = w._script_world;
 	AnimationStateMachine* animation_state_machine = w._animation_state_machine;
+	SkeletonAnimation* skeleton_animation = w._skeleton_animation;
+
+	const u32 num_units = ur.num_units;
+	UnitTemplate& ut = w._unit_template_manager->get(&ur);
+
+	// Make room for all the instances up front
+	u32 num_transforms = 0;
+	u32 num_colliders = 0;
+	u32 num_actors = 0;
+	u32 num_meshes = 0;
+	u32 num_sprites = 0;
+	u32 num_lights = 0;
 
-	const ComponentData* component = (ComponentData*)(&ur + 1);
-	for (u32 cc = 0; cc < ur.num_component_types; ++cc, component = (ComponentData*)((char*)component + component->size + sizeof(*component)))
+	u32 lo;
+	u32 hi;
+
+	for (u32 cc = 0; cc < ut.num_components; ++cc)
 	{
+		const ComponentData* component = ut.components[cc];
+		component_range(*component, first_unit, end_unit, lo, hi);
+		const u32 num = (hi - lo) * num_instances;
+
+		if (component->type == COMPONENT_TYPE_TRANSFORM)
+			num_transforms += num;
+		else if (component->type == COMPONENT_TYPE_COLLIDER)
+			num_colliders += num;
+		else if (component->type == COMPONENT_TYPE_ACTOR)
+			num_actors += num;
+		else if (component->type == COMPONENT_TYPE_MESH_RENDERER)
+			num_meshes += num;
+		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
+			num_sprites += num;
+		else if (component->type == COMPONENT_TYPE_LIGHT)
+			num_lights += num;
+	}
+
+	scene_graph->reserve(num_transforms);
+	physics_world->reserve(num_colliders, num_actors);
+	render_world->reserve(num_meshes, num_sprites, num_lights);
+
+	TempAllocator4096 ta;
+	Array<UnitId> units(ta);
+	Array<Matrix4x4> poses_world(ta);
+	array::resize(units, num_instances);
+	array::resize(poses_world, num_instances);
+
+	for (u32 cc = 0; cc < ut.num_components; ++cc)
+	{
+		const ComponentData* component = ut.components[cc];
 		const u32* unit_index = (const u32*)(component + 1);
 		const char* data = (const char*)(unit_index + component->num_instances);
+		const u32 offset = ut.offsets[cc];
+		component_range(*component, first_unit, end_unit, lo, hi);
 
 		if (component->type == COMPONENT_TYPE_TRANSFORM)
 		{
-			const TransformDesc* td = (const TransformDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++td)
+			for (u32 i = lo; i < hi; ++i)
 			{
-				Matrix4x4 matrix = matrix4x4(rot, pos);
-				Matrix4x4 matrix_res = matrix4x4(td->rotation, td->position);
-				scene_graph->create(unit_lookup[unit_index[i]], matrix_res*matrix);
+				const Matrix4x4& matrix_res = ut.transforms[offset + i];
+				for (u32 k = 0; k < num_instances; ++k)
+					scene_graph->create(unit_lookup[k*num_units + unit_index[i]], matrix_res*poses[k]);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_CAMERA)
 		{
-			const CameraDesc* cd = (const CameraDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++cd)
+			const CameraDesc* cd = (const CameraDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++cd)
 			{
-				w.camera_create(unit_lookup[unit_index[i]], *cd, MATRIX4X4_IDENTITY);
+				for (u32 k = 0; k < num_instances; ++k)
+					w.camera_create(unit_lookup[k*num_units + unit_index[i]], *cd, MATRIX4X4_IDENTITY);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_COLLIDER)
 		{
-			const ColliderDesc* cd = (const ColliderDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i)
+			for (u32 i = lo; i < hi; ++i)
 			{
-				physics_world->collider_create(unit_lookup[unit_index[i]], cd);
-				cd = (ColliderDesc*)((char*)(cd + 1) + cd->size);
+				const ColliderDesc* cd = ut.colliders[offset + i];
+				for (u32 k = 0; k < num_instances; ++k)
+					physics_world->collider_create(unit_lookup[k*num_units + unit_index[i]], cd);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_ACTOR)
 		{
-			const ActorResource* ar = (const ActorResource*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++ar)
+			const ActorResource* ar = (const ActorResource*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++ar)
 			{
-				Matrix4x4 tm = scene_graph->world_pose(unit_lookup[unit_index[i]]);
-				physics_world->actor_create(unit_lookup[unit_index[i]], ar, tm);
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					const UnitId unit = unit_lookup[k*num_units + unit_index[i]];
+					physics_world->actor_create(unit, ar, scene_graph->world_pose(unit));
+				}
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_MESH_RENDERER)
 		{
-			const MeshRendererDesc* mrd = (const MeshRendererDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++mrd)
+			const MeshRendererDesc* mrd = (const MeshRendererDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++mrd)
 			{
-				Matrix4x4 tm = scene_graph->world_pose(unit_lookup[unit_index[i]]);
-				render_world->mesh_create(unit_lookup[unit_index[i]], *mrd, tm);
+				const UnitTemplate::Mesh& mesh = w._unit_template_manager->mesh(ut, offset + i, *mrd);
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					units[k] = unit_lookup[k*num_units + unit_index[i]];
+					poses_world[k] = scene_graph->world_pose(units[k]);
+				}
+				render_world->mesh_create(array::begin(units), array::begin(poses_world), num_instances, mesh.mr, mesh.mg, mrd->material_resource);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_SPRITE_RENDERER)
 		{
-			const SpriteRendererDesc* srd = (const SpriteRendererDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++srd)
+			const SpriteRendererDesc* srd = (const SpriteRendererDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++srd)
 			{
-				Matrix4x4 tm = scene_graph->world_pose(unit_lookup[unit_index[i]]);
-				render_world->sprite_create(unit_lookup[unit_index[i]], *srd, tm);
+				const UnitTemplate::Sprite& sprite = w._unit_template_manager->sprite(ut, offset + i, *srd);
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					units[k] = unit_lookup[k*num_units + unit_index[i]];
+					poses_world[k] = scene_graph->world_pose(units[k]);
+				}
+				render_world->sprite_create(array::begin(units), array::begin(poses_world), num_instances, sprite.sr, srd->material_resource, srd->layer, srd->depth);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_LIGHT)
 		{
-			const LightDesc* ld = (const LightDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++ld)
+			const LightDesc* ld = (const LightDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++ld)
 			{
-				Matrix4x4 tm = scene_graph->world_pose(unit_lookup[unit_index[i]]);
-				render_world->light_create(unit_lookup[unit_index[i]], *ld, tm);
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					const UnitId unit = unit_lookup[k*num_units + unit_index[i]];
+					render_world->light_create(unit, *ld, scene_graph->world_pose(unit));
+				}
+			}
+		}
+		else if (component->type == COMPONENT_TYPE_PARTICLE_EMITTER)
+		{
+			const ParticleEmitterDesc* ped = (const ParticleEmitterDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++ped)
+			{
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					const UnitId unit = unit_lookup[k*num_units + unit_index[i]];
+					render_world->particle_create(unit, *ped, scene_graph->world_pose(unit));
+				}
+			}
+		}
+		else if (component->type == COMPONENT_TYPE_TILEMAP)
+		{
+			const TilemapDesc* td = (const TilemapDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++td)
+			{
+				for (u32 k = 0; k < num_instances; ++k)
+				{
+					const UnitId unit = unit_lookup[k*num_units + unit_index[i]];
+					render_world->tilemap_create(unit, *td, scene_graph->world_pose(unit));
+				}
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_SCRIPT)
 		{
-			const ScriptDesc* sd = (const ScriptDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++sd)
+			const ScriptDesc* sd = (const ScriptDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++sd)
 			{
-				script_world::create(*script_world, unit_lookup[unit_index[i]], *sd);
+				for (u32 k = 0; k < num_instances; ++k)
+					units[k] = unit_lookup[k*num_units + unit_index[i]];
+				script_world::create(*script_world, array::begin(units), num_instances, *sd);
 			}
 		}
 		else if (component->type == COMPONENT_TYPE_ANIMATION_STATE_MACHINE)
 		{
-			const AnimationStateMachineDesc* asmd = (const AnimationStateMachineDesc*)data;
-			for (u32 i = 0, n = component->num_instances; i < n; ++i, ++asmd)
+			const AnimationStateMachineDesc* asmd = (const AnimationStateMachineDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++asmd)
 			{
-				animation_state_machine->create(unit_lookup[unit_index[i]], *asmd);
+				for (u32 k = 0; k < num_instances; ++k)
+					animation_state_machine->create(unit_lookup[k*num_units + unit_index[i]], *asmd);
+			}
+		}
+		else if (component->type == COMPONENT_TYPE_SKELETON)
+		{
+			const SkeletonDesc* sd = (const SkeletonDesc*)data + lo;
+			for (u32 i = lo; i < hi; ++i, ++sd)
+			{
+				for (u32 k = 0; k < num_instances; ++k)
+					skeleton_animation->create(unit_lookup[k*num_units + unit_index[i]], *sd);
 			}
 		}
 		else
@@ -655,12 +1154,21 @@ void spawn_units(World& w, const UnitResource& ur, const Vector3& pos, const Qua
 		}
 	}
 
-	for (u32 i = 0; i < ur.num_units; ++i)
-		array::push_back(w._units, unit_lookup[i]);
+	const u32 num_spawned = (end_unit - first_unit) * num_instances;
+	array::reserve(w._units, array::size(w._units) + num_spawned);
+
+	for (u32 k = 0; k < num_instances; ++k)
+	{
+		for (u32 i = first_unit; i < end_unit; ++i)
+			w.add_unit(unit_lookup[k*num_units + i]);
+	}
 
 	// Post events
-	for (u32 i = 0; i < ur.num_units; ++i)
-		w.post_unit_spawned_event(unit_lookup[i]);
+	for (u32 k = 0; k < num_instances; ++k)
+	{
+		for (u32 i = first_unit; i < end_unit; ++i)
+			w.post_unit_spawned_event(unit_lookup[k*num_units + i]);
+	}
 }
 
 } // namespace crown
@@ -7,6 +7,7 @@
 
 #include "core/containers/event_stream.h"
 #include "core/math/types.h"
+#include "core/memory/proxy_allocator.h"
 #include "core/strings/string_id.h"
 #include "core/types.h"
 #include "lua/types.h"
@@ -40,13 +41,26 @@ struct World
 		u16 view_y;
 		u16 view_width;
 		u16 view_height;
+
+		Vector4 viewport; ///< Normalized x, y, width and height in the window.
 	};
 
 	u32 _marker;
+	ProxyAllocator _world_allocator; ///< Everything allocated by the world, managers included.
+	ProxyAllocator _scene_graph_allocator;
+	ProxyAllocator _render_world_allocator;
+	ProxyAllocator _physics_world_allocator;
+	ProxyAllocator _sound_world_allocator;
+	ProxyAllocator _navigation_world_allocator;
+	ProxyAllocator _script_world_allocator;
+	ProxyAllocator _animation_state_machine_allocator;
+	ProxyAllocator _skeleton_animation_allocator;
+	ProxyAllocator _replication_allocator;
 	Allocator* _allocator;
 	ResourceManager* _resource_manager;
 	ShaderManager* _shader_manager;
 	MaterialManager* _material_manager;
+	UnitTemplateManager* _unit_template_manager;
 	LuaEnvironment* _lua_environment;
 	UnitManager* _unit_manager;
 
@@ -55,10 +69,14 @@ struct World
 	RenderWorld* _render_world;
 	PhysicsWorld* _physics_world;
 	SoundWorld* _sound_world;
+	NavigationWorld* _navigation_world;
 	ScriptWorld* _script_world;
 	AnimationStateMachine* _animation_state_machine;
+	SkeletonAnimation* _skeleton_animation;
+	Replication* _replication;
 
 	Array<UnitId> _units;
+	Array<u32> _unit_index; ///< Position in _units of each unit, by UnitId::index().
 	Array<Level*> _levels;
 	Array<Camera> _camera;
 	HashMap<UnitId, u32> _camera_map;
@@ -66,11 +84,12 @@ struct World
 	EventStream _events;
 	GuiBuffer _gui_buffer;
 	Array<Gui*> _guis;
+	f32 _interpolation_alpha;
 
 	CameraInstance camera_make_instance(u32 i) { CameraInstance inst = { i }; return inst; }
 
 	///
-	World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, UnitManager& um, LuaEnvironment& env);
+	World(Allocator& a, ResourceManager& rm, ShaderManager& sm, MaterialManager& mm, TextureManager& tm, UnitManager& um, UnitTemplateManager& utm, LuaEnvironment& env);
 
 	///
 	~World();
@@ -78,18 +97,48 @@ struct World
 	/// Spawns a new instance of the unit @a name at the given @a position and @a rotation.
 	UnitId spawn_unit(StringId64 name, const Vector3& pos = VECTOR3_ZERO, const Quaternion& rot = QUATERNION_IDENTITY);
 
+	/// Spawns @a num instances of the unit @a name, the i-th one at @a poses[i],
+	/// and writes their ids to @a units.
+	void spawn_unit_batch(StringId64 name, const Matrix4x4* poses, u32 num, UnitId* units);
+
 	/// Spawns a new empty unit and returns its id.
 	UnitId spawn_empty_unit();
 
 	/// Destroys the unit with the given @a id.
 	void destroy_unit(UnitId id);
 
+	/// Destroys the @a num @a units. Component managers destroy their
+	/// instances one manager at a time, for all the units at once.
+	void destroy_units(const UnitId* units, u32 num);
+
+	/// Adds the @a unit to the list of units in the world.
+	void add_unit(UnitId unit);
+
+	/// Removes the @a unit from the list of units in the world.
+	void remove_unit(UnitId unit);
+
 	/// Returns the number of units in the world.
 	u32 num_units() const;
 
+	/// Returns the number of bytes allocated by the world, including the
+	/// ones allocated by its managers.
+	u32 allocated_memory();
+
 	/// Returns all the the units in the world.
 	void units(Array<UnitId>& units) const;
 
+	/// Writes to @a buf the state of the units of the world: the poses and
+	/// hierarchy of the scene graph, the frames of the sprites, the lights,
+	/// the animation state machines and the bodies of the physics actors.
+	/// The state references resources by address: it can only be restored
+	/// in the same process, while the resources are loaded.
+	void snapshot(Buffer& buf);
+
+	/// Restores the state written to @a buf by snapshot(). The world must
+	/// contain the same units, with the same components, as when the
+	/// snapshot was taken: returns false and changes nothing otherwise.
+	bool restore(const Buffer& buf);
+
 	/// Creates a new camera.
 	CameraInstance camera_create(UnitId id, const CameraDesc& cd, const Matrix4x4& tr);
 
@@ -139,6 +188,13 @@ struct World
 	/// Sets the coordinates for the camera viewport in pixels.
 	void camera_set_viewport_metrics(UnitId unit, u16 x, u16 y, u16 width, u16 height);
 
+	/// Sets the viewport of the camera as a fraction of the window, with
+	/// the origin at the top-left corner. Defaults to the whole window.
+	void camera_set_viewport(UnitId unit, f32 x, f32 y, f32 width, f32 height);
+
+	/// Returns the viewport of the camera as a fraction of the window.
+	Vector4 camera_viewport(UnitId unit);
+
 	/// Returns @a pos from screen-space to world-space coordinates.
 	Vector3 camera_screen_to_world(UnitId unit, const Vector3& pos);
 
@@ -152,16 +208,38 @@ struct World
 	void update_scene(f32 dt);
 
 	/// Updates all units and sub-systems with the given @a dt delta time.
+	/// It is equivalent to update_simulation() followed by update_callbacks().
 	void update(f32 dt);
 
-	/// Renders the world using @a view.
-	void render(const Matrix4x4& view);
+	/// Updates animations, scene graph, physics and render transforms
+	/// with @a dt. It does not run scripts nor touch any state shared
+	/// with other worlds, so different worlds can be simulated concurrently.
+	void update_simulation(f32 dt);
+
+	/// Dispatches the physics events to the scripts, then updates sounds
+	/// and scripts with @a dt. Must be called from the main thread.
+	void update_callbacks(f32 dt);
 
-	SoundInstanceId play_sound(const SoundResource& sr, bool loop = false, f32 volume = 1.0f, const Vector3& position = VECTOR3_ZERO, f32 range = 50.0f);
+	/// Renders the world using @a view and @a proj.
+	void render(const Matrix4x4& view, const Matrix4x4& proj);
+
+	/// Renders the world as seen by @a num cameras with the given @a views
+	/// and @a projs matrices, see RenderWorld::render().
+	void render(const Matrix4x4* views, const Matrix4x4* projs, u32 num);
+
+	/// Sets the poses rendered by the world, and the poses of its cameras,
+	/// to the ones interpolated by @a alpha between the last two simulation
+	/// steps. Used when the simulation runs at a fixed rate different from
+	/// the render rate. An @a alpha of 1 renders the poses as they are.
+	void interpolate(f32 alpha);
+
+	SoundInstanceId play_sound(const SoundResource& sr, bool loop = false, f32 volume = 1.0f, const Vector3& position = VECTOR3_ZERO, f32 range = 50.0f, u32 priority = 0);
 
 	/// Plays the sound with the given @a name at the given @a position, with the given
 	/// @a volume and @a range. @a loop controls whether the sound must loop or not.
-	SoundInstanceId play_sound(StringId64 name, const bool loop, const f32 volume, const Vector3& pos, const f32 range);
+	/// Sounds with higher @a priority take the voices of the others when
+	/// too many sounds are audible at once.
+	SoundInstanceId play_sound(StringId64 name, const bool loop, const f32 volume, const Vector3& pos, const f32 range, u32 priority = 0);
 
 	/// Stops the sound with the given @a id.
 	void stop_sound(SoundInstanceId id);
@@ -176,6 +254,10 @@ struct World
 	/// Sets the @a position of the sound @a id.
 	void set_sound_position(SoundInstanceId id, const Vector3& position);
 
+	/// Sets the position of each of the @a num sounds @a ids to the
+	/// corresponding position in @a positions.
+	void set_sound_positions(u32 num, const SoundInstanceId* ids, const Vector3* positions);
+
 	/// Sets the @a range of the sound @a id.
 	void set_sound_range(SoundInstanceId id, f32 range);
 
@@ -192,12 +274,38 @@ struct World
 	/// Creates a new screen-space Gui.
 	Gui* create_screen_gui();
 
+	/// Creates a new screen-space Gui whose primitives are recorded to a
+	/// GuiLayer and drawn with Gui::draw_layer().
+	Gui* create_gui_layer();
+
 	/// Destroys the @a gui.
 	void destroy_gui(Gui& gui);
 
 	/// Loads the level @a name into the world.
 	Level* load_level(StringId64 name, const Vector3& pos, const Quaternion& rot);
 
+	/// Loads the level @a name into the world over multiple frames.
+	/// Each update_callbacks() spawns at most @a max_units units of the
+	/// level, or as many as fit in @a max_time seconds; a budget of 0 means
+	/// no limit. A level loaded event is posted when all the units have
+	/// been spawned. See Level::progress().
+	Level* load_level_async(StringId64 name, const Vector3& pos, const Quaternion& rot, u32 max_units, f32 max_time);
+
+	/// Streams the level @a name into the world. Its cells are spawned
+	/// over multiple frames when an observer gets within @a load_radius,
+	/// and destroyed when all observers are farther than @a unload_radius.
+	/// The level must have been compiled with a cell_size. See
+	/// Level::stream() and Level::set_observers().
+	Level* load_level_streamed(StringId64 name, const Vector3& pos, const Quaternion& rot, f32 load_radius, f32 unload_radius, u32 max_units, f32 max_time);
+
+	/// Destroys the units of the @a level and the level itself, then frees
+	/// the memory the component managers no longer need.
+	void unload_level(Level* level);
+
+	/// Shrinks the component managers to the instances alive, so that the
+	/// memory used by a level is returned once it has been unloaded.
+	void shrink_to_fit();
+
 	void post_unit_spawned_event(UnitId id);
 	void post_unit_destroyed_event(UnitId id);
 	void post_level_loaded_event();
@@ -205,4 +313,21 @@ struct World
 
 void spawn_units(World& w, const UnitResource& ur, const Vector3& pos, const Quaternion& rot, const UnitId* unit_lookup);
 
+/// Spawns @a num_instances copies of the units in @a ur, the i-th copy at
+/// @a poses[i]. The units of the i-th copy are read from @a unit_lookup
+/// starting at i*ur.num_units. Components are created one type at a time
+/// for all the copies.
+void spawn_units(World& w, const UnitResource& ur, const Matrix4x4* poses, u32 num_instances, const UnitId* unit_lookup);
+
+/// Like spawn_units() but only spawns, in each copy, the units of @a ur
+/// with index in [@a first_unit, @a end_unit).
+void spawn_units(World& w, const UnitResource& ur, const Matrix4x4* poses, u32 num_instances, const UnitId* unit_lookup, u32 first_unit, u32 end_unit);
+
+/// Updates the @a num @a worlds with @a dt.
+/// The worlds are simulated in parallel by the job system, then their
+/// callbacks are run in order on the calling thread.
+/// @note Resources must not be loaded nor unloaded while this runs; see
+/// ResourceManager::get().
+void update_worlds(World* const* worlds, u32 num, f32 dt);
+
 } // namespace crown
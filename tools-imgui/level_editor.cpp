@@ -1334,7 +1334,7 @@ void tool_shutdown()
 	CE_DELETE(default_allocator(), s_editor);
 }
 
-extern bool next_event(OsEvent& ev);
+extern bool next_event(OsEvent& ev, s64& time);
 
 bool tool_process_events()
 {
@@ -1347,7 +1347,8 @@ bool tool_process_events()
 	StringStream ss(ta);
 
 	OsEvent event;
-	while (next_event(event))
+	s64 time;
+	while (next_event(event, time))
 	{
 		if (event.type == OsEventType::NONE)
 			continue;
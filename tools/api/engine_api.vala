@@ -265,30 +265,44 @@ namespace Crown
 				);
 		}
 
-		public string set_light(Guid id, string type, double range, double intensity, double spot_angle, Vector3 color)
+		public string move_objects(Guid[] ids, Vector3[] positions, Quaternion[] rotations, Vector3[] scales)
 		{
-			return @"LevelEditor._objects[\"%s\"]:set_light(\"%s\", %f, %f, %f, %s)".printf(id.to_string()
-				, type
-				, range
-				, intensity
-				, spot_angle
-				, Lua.quaternion({color.x, color.y, color.z, 1.0})
-				);
+			StringBuilder sb_ids = new StringBuilder();
+			StringBuilder sb_poses = new StringBuilder();
+			for (int i = 0; i < ids.length; ++i)
+			{
+				sb_ids.append("\"%s\",".printf(ids[i].to_string()));
+				sb_poses.append("%f,%f,%f,".printf(positions[i].x, positions[i].y, positions[i].z));
+				sb_poses.append("%f,%f,%f,%f,".printf(rotations[i].x, rotations[i].y, rotations[i].z, rotations[i].w));
+				sb_poses.append("%f,%f,%f,".printf(scales[i].x, scales[i].y, scales[i].z));
+			}
+
+			return "LevelEditor:move_objects({%s},{%s})".printf(sb_ids.str, sb_poses.str);
 		}
 
-		public string set_sound_range(Guid id, double range)
+		public string set_properties(string edits)
 		{
-			return @"LevelEditor._objects[\"%s\"]:set_range(%f)".printf(id.to_string()
-				, range
-				);
+			return "LevelEditor:set_properties({%s})".printf(edits);
 		}
 
-		public string set_sprite(Guid id, double layer, double depth)
+		public string property_double(Guid id, string component, string key, double value)
 		{
-			return @"LevelEditor._objects[\"%s\"]:set_sprite(%f, %f)".printf(id.to_string()
-				, layer
-				, depth
-				);
+			return "{\"%s\",\"%s\",\"%s\",%f},".printf(id.to_string(), component, key, value);
+		}
+
+		public string property_bool(Guid id, string component, string key, bool value)
+		{
+			return "{\"%s\",\"%s\",\"%s\",%s},".printf(id.to_string(), component, key, Lua.bool(value));
+		}
+
+		public string property_string(Guid id, string component, string key, string value)
+		{
+			return "{\"%s\",\"%s\",\"%s\",\"%s\"},".printf(id.to_string(), component, key, value);
+		}
+
+		public string property_vector3(Guid id, string component, string key, Vector3 value)
+		{
+			return "{\"%s\",\"%s\",\"%s\",{%f,%f,%f}},".printf(id.to_string(), component, key, value.x, value.y, value.z);
 		}
 
 		public string set_placeable(string type, string name)
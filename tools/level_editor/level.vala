@@ -27,6 +27,14 @@ namespace Crown
 		public uint _num_units;
 		public uint _num_sounds;
 
+		// Edits sent to the engine once per frame
+		private StringBuilder _edits;
+		private Guid[] _move_ids;
+		private Vector3[] _move_positions;
+		private Quaternion[] _move_rotations;
+		private Vector3[] _move_scales;
+		private uint _flush_source;
+
 		// Signals
 		public signal void selection_changed(Gee.ArrayList<Guid?> selection);
 		public signal void object_editor_name_changed(Guid object_id, string name);
@@ -48,6 +56,13 @@ namespace Crown
 			_loaded_prefabs = new Gee.HashSet<string>();
 			_selection = new Gee.ArrayList<Guid?>();
 
+			_edits = new StringBuilder();
+			_move_ids = new Guid[0];
+			_move_positions = new Vector3[0];
+			_move_rotations = new Quaternion[0];
+			_move_scales = new Vector3[0];
+			_flush_source = 0;
+
 			reset();
 		}
 
@@ -300,7 +315,7 @@ namespace Crown
 			unit.set_component_property_vector3(component_id, "data.color",      color);
 			unit.set_component_property_string (component_id, "type", "light");
 
-			_client.send_script(LevelEditorApi.set_light(unit_id, type, range, intensity, spot_angle, color));
+			send_light(unit_id, component_id);
 		}
 
 		public void set_sprite(Guid unit_id, Guid component_id, double layer, double depth, string material, string sprite_resource, bool visible)
@@ -315,7 +330,7 @@ namespace Crown
 			unit.set_component_property_bool  (component_id, "data.visible", visible);
 			unit.set_component_property_string(component_id, "type", "sprite_renderer");
 
-			_client.send_script(LevelEditorApi.set_sprite(unit_id, layer, depth));
+			send_sprite(unit_id, component_id);
 		}
 
 		public void set_sound(Guid sound_id, string name, double range, double volume, bool loop)
@@ -327,7 +342,7 @@ namespace Crown
 			_db.set_property_double(sound_id, "volume", volume);
 			_db.set_property_bool  (sound_id, "loop", loop);
 
-			_client.send_script(LevelEditorApi.set_sound_range(sound_id, range));
+			send_sound(sound_id);
 		}
 
 		public string object_editor_name(Guid object_id)
@@ -386,13 +401,90 @@ namespace Crown
 			_client.send_script(sb.str);
 		}
 
+		/// Queues the new poses of the objects @a ids. Moving the same object
+		/// again before the edits are flushed overwrites its pending pose.
 		private void send_move_objects(Guid[] ids, Vector3[] positions, Quaternion[] rotations, Vector3[] scales)
 		{
-			StringBuilder sb = new StringBuilder();
 			for (int i = 0; i < ids.length; ++i)
-				sb.append(LevelEditorApi.move_object(ids[i], positions[i], rotations[i], scales[i]));
+			{
+				int j = 0;
+				for (; j < _move_ids.length; ++j)
+				{
+					if (Guid.equal_func(_move_ids[j], ids[i]))
+						break;
+				}
 
-			_client.send_script(sb.str);
+				if (j == _move_ids.length)
+				{
+					_move_ids += ids[i];
+					_move_positions += positions[i];
+					_move_rotations += rotations[i];
+					_move_scales += scales[i];
+				}
+				else
+				{
+					_move_positions[j] = positions[i];
+					_move_rotations[j] = rotations[i];
+					_move_scales[j] = scales[i];
+				}
+			}
+
+			schedule_flush();
+		}
+
+		private void send_light(Guid unit_id, Guid component_id)
+		{
+			Unit unit = new Unit(_db, unit_id, _prefabs);
+			_edits.append(LevelEditorApi.property_string (unit_id, "light", "type",       unit.get_component_property_string (component_id, "data.type")));
+			_edits.append(LevelEditorApi.property_double (unit_id, "light", "range",      unit.get_component_property_double (component_id, "data.range")));
+			_edits.append(LevelEditorApi.property_double (unit_id, "light", "intensity",  unit.get_component_property_double (component_id, "data.intensity")));
+			_edits.append(LevelEditorApi.property_double (unit_id, "light", "spot_angle", unit.get_component_property_double (component_id, "data.spot_angle")));
+			_edits.append(LevelEditorApi.property_vector3(unit_id, "light", "color",      unit.get_component_property_vector3(component_id, "data.color")));
+			schedule_flush();
+		}
+
+		private void send_sprite(Guid unit_id, Guid component_id)
+		{
+			Unit unit = new Unit(_db, unit_id, _prefabs);
+			_edits.append(LevelEditorApi.property_double(unit_id, "sprite_renderer", "layer",   unit.get_component_property_double(component_id, "data.layer")));
+			_edits.append(LevelEditorApi.property_double(unit_id, "sprite_renderer", "depth",   unit.get_component_property_double(component_id, "data.depth")));
+			_edits.append(LevelEditorApi.property_bool  (unit_id, "sprite_renderer", "visible", unit.get_component_property_bool  (component_id, "data.visible")));
+			schedule_flush();
+		}
+
+		private void send_sound(Guid sound_id)
+		{
+			_edits.append(LevelEditorApi.property_double(sound_id, "sound", "range", _db.get_property_double(sound_id, "range")));
+			schedule_flush();
+		}
+
+		private void schedule_flush()
+		{
+			if (_flush_source == 0)
+				_flush_source = GLib.Idle.add(flush_edits);
+		}
+
+		/// Sends all the pending edits to the engine with a single script.
+		private bool flush_edits()
+		{
+			_flush_source = 0;
+
+			StringBuilder sb = new StringBuilder();
+			if (_move_ids.length > 0)
+				sb.append(LevelEditorApi.move_objects(_move_ids, _move_positions, _move_rotations, _move_scales));
+			if (_edits.len > 0)
+				sb.append(LevelEditorApi.set_properties(_edits.str));
+
+			_move_ids = new Guid[0];
+			_move_positions = new Vector3[0];
+			_move_rotations = new Quaternion[0];
+			_move_scales = new Vector3[0];
+			_edits.truncate(0);
+
+			if (sb.len > 0)
+				_client.send_script(sb.str);
+
+			return false;
 		}
 
 		public void send_level()
@@ -645,13 +737,7 @@ namespace Crown
 					Unit unit = new Unit(_db, unit_id, _prefabs);
 					unit.has_component("light", ref component_id);
 
-					_client.send_script(LevelEditorApi.set_light(unit_id
-						, unit.get_component_property_string (component_id, "data.type")
-						, unit.get_component_property_double (component_id, "data.range")
-						, unit.get_component_property_double (component_id, "data.intensity")
-						, unit.get_component_property_double (component_id, "data.spot_angle")
-						, unit.get_component_property_vector3(component_id, "data.color")
-						));
+					send_light(unit_id, component_id);
 					// FIXME: Hack to force update the properties view
 					selection_changed(_selection);
 				}
@@ -665,10 +751,7 @@ namespace Crown
 					Unit unit = new Unit(_db, unit_id, _prefabs);
 					unit.has_component("sprite_renderer", ref component_id);
 
-					_client.send_script(LevelEditorApi.set_sprite(unit_id
-						, unit.get_component_property_double(component_id, "data.layer")
-						, unit.get_component_property_double(component_id, "data.depth")
-						));
+					send_sprite(unit_id, component_id);
 					// FIXME: Hack to force update the properties view
 					selection_changed(_selection);
 				}
@@ -678,9 +761,7 @@ namespace Crown
 				{
 					Guid sound_id = data[0];
 
-					_client.send_script(LevelEditorApi.set_sound_range(sound_id
-						, _db.get_property_double(sound_id, "range")
-						));
+					send_sound(sound_id);
 					// FIXME: Hack to force update the properties view
 					selection_changed(_selection);
 				}
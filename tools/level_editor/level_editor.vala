@@ -513,6 +513,25 @@ namespace Crown
 
 				_level.on_selection(ids);
 			}
+			else if (msg_type == "missing_resources")
+			{
+				// Let the compiler compile them first
+				if (_compiler.is_connected())
+					_compiler.send(JSON.encode(msg));
+			}
+			else if (msg_type == "resource_compiled")
+			{
+				if ((bool)msg["success"])
+				{
+					string type = (string)msg["resource_type"];
+					string name = (string)msg["name"];
+
+					if (_engine.is_connected())
+						_engine.send(DeviceApi.reload(type, name));
+					if (_game.is_connected())
+						_game.send(DeviceApi.reload(type, name));
+				}
+			}
 			else if (msg_type == "error")
 			{
 				_console_view.loge("editor", "Error: " + (string)msg["message"]);
@@ -563,6 +582,7 @@ namespace Crown
 				"--map-source-dir", "core", _project.toolchain_dir(),
 				"--server",
 				"--wait-console",
+				"--jobs", uint.min(GLib.get_num_processors(), 64).to_string(),
 				null
 			};
 
@@ -857,6 +877,15 @@ namespace Crown
 				saved = true;
 			}
 
+			// Live edits are applied to the running engine directly: the data
+			// only needs to be compiled, in the background, when it is saved.
+			if (saved)
+			{
+				_data_compiler.compile.begin(_project.data_dir(), _project.platform(), (obj, res) => {
+					_data_compiler.compile.end(res);
+				});
+			}
+
 			return saved;
 		}
 